@@ -1,6 +1,6 @@
 # pyright: reportUndefinedVariable=false
 
-import os, glob, re, shutil, configparser
+import os, glob, re, shutil, configparser, gzip
 from jinja2 import Environment, FileSystemLoader
 from yaml import load, Loader
 
@@ -25,6 +25,12 @@ def process_template(fname, build_platform, template_env, config, prefix, build_
     with open(destination, 'w') as f:
         f.write(r)
 
+def gzip_file(fname):
+    # mtime=0 keeps the output the same between builds of the same file
+    with open(fname, 'rb') as f_in, open(fname + '.gz', 'wb') as f_out:
+        with gzip.GzipFile(filename='', mode='wb', fileobj=f_out, compresslevel=9, mtime=0) as gz:
+            gz.write(f_in.read())
+
 def copy_file(fname, build_platform, prefix, build_data_dir=None):
     destination = prep_dst(fname, build_platform, prefix, build_data_dir)
     shutil.copy(fname, destination)
@@ -105,3 +111,18 @@ dev_specific_prefix = os.path.join('data', 'webui', 'device_specific', build_pla
 for filename in glob.iglob(f"{dev_specific_prefix}**", recursive=True):
     if os.path.isfile(filename) and filename != '.keep':
         copy_file(filename, build_platform, dev_specific_prefix, build_data_dir)
+
+# Atari boot disk images are stored gzipped and the firmware decompresses them into RAM when
+# it mounts them, which leaves flash room for bigger CONFIG images
+if build_platform == 'BUILD_ATARI':
+    for filename in glob.glob(os.path.join(build_data_dir, '*.atr')):
+        gzip_file(filename)
+        os.remove(filename)
+
+# gzip the static web assets; the firmware sends these when the browser accepts them.
+# html files have tags substituted by the firmware as they are sent, so are left alone
+gzip_matcher = re.compile(r'^.*\.(css|js|svg|ico|txt)$')
+www_dir = os.path.join(build_data_dir, 'www')
+for filename in glob.iglob(f"{os.path.join(www_dir, '')}**", recursive=True):
+    if os.path.isfile(filename) and gzip_matcher.search(filename):
+        gzip_file(filename)
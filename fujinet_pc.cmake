@@ -122,7 +122,7 @@ set(INCLUDE_DIRS include
     lib/FileSystem
     lib/tcpip lib/ftp lib/TNFSlib lib/telnet lib/fnjson
     lib/webdav lib/http lib/sam lib/task
-    lib/modem-sniffer lib/printer-emulator
+    lib/modem-sniffer lib/modem-core lib/printer-emulator
     lib/network-protocol
     lib/fuji lib/bus lib/device lib/media
     lib/encrypt lib/base64
@@ -161,14 +161,19 @@ set(SOURCES src/main.cpp
     lib/utils/peoples_url_parser.h lib/utils/peoples_url_parser.cpp
     lib/utils/punycode.h lib/utils/punycode.cpp
     lib/utils/U8Char.h lib/utils/U8Char.cpp
+    lib/utils/fnEvents.h lib/utils/fnEvents.cpp
+    lib/utils/deferred_log.h lib/utils/deferred_log.cpp
     lib/hardware/fnWiFi.h lib/hardware/fnDummyWiFi.h lib/hardware/fnDummyWiFi.cpp
     lib/hardware/led.h lib/hardware/led.cpp
     lib/hardware/fnUART.h lib/hardware/fnUART.cpp
     lib/hardware/fnUARTUnix.cpp lib/hardware/fnUARTWindows.cpp
     lib/hardware/fnSystem.h lib/hardware/fnSystem.cpp lib/hardware/fnSystemNet.cpp
+    lib/hardware/fnIdleWait.h lib/hardware/fnIdleWait.cpp
+    lib/hardware/fnArena.h lib/hardware/fnArena.cpp
     lib/FileSystem/fnDirCache.h lib/FileSystem/fnDirCache.cpp
     lib/FileSystem/fnFileCache.h lib/FileSystem/fnFileCache.cpp
     lib/FileSystem/fnFS.h lib/FileSystem/fnFS.cpp
+    lib/FileSystem/fnFlashCache.h lib/FileSystem/fnFlashCache.cpp
     lib/FileSystem/fnFsSPIFFS.h lib/FileSystem/fnFsSPIFFS.cpp
     lib/FileSystem/fnFsSD.h lib/FileSystem/fnFsSD.cpp
     lib/FileSystem/fnFsTNFS.h lib/FileSystem/fnFsTNFS.cpp
@@ -179,7 +184,14 @@ set(SOURCES src/main.cpp
     lib/FileSystem/fnFileLocal.h lib/FileSystem/fnFileLocal.cpp
     lib/FileSystem/fnFileTNFS.h lib/FileSystem/fnFileTNFS.cpp
     lib/FileSystem/fnFileSMB.h lib/FileSystem/fnFileSMB.cpp
+    lib/FileSystem/fnFileFTP.h lib/FileSystem/fnFileFTP.cpp
+    lib/FileSystem/fnSMBPool.h lib/FileSystem/fnSMBPool.cpp
     lib/FileSystem/fnFileMem.h lib/FileSystem/fnFileMem.cpp
+    lib/FileSystem/fnFilePreload.h lib/FileSystem/fnFilePreload.cpp
+    lib/FileSystem/fnFileHTTP.h lib/FileSystem/fnFileHTTP.cpp
+    lib/FileSystem/fnFileWriteback.h lib/FileSystem/fnFileWriteback.cpp
+    lib/FileSystem/fnInflate.h lib/FileSystem/fnInflate.cpp
+    lib/FileSystem/fnFileGzip.h lib/FileSystem/fnFileGzip.cpp
     lib/FileSystem/fnio.h lib/FileSystem/fnio.cpp
     lib/tcpip/fnDNS.h lib/tcpip/fnDNS.cpp
     lib/tcpip/fnUDP.h lib/tcpip/fnUDP.cpp
@@ -191,14 +203,18 @@ set(SOURCES src/main.cpp
     lib/TNFSlib/tnfslib_udp.h lib/TNFSlib/tnfslib_udp_testing.cpp
     lib/telnet/libtelnet.h lib/telnet/libtelnet.c
     lib/fnjson/fnjson.h lib/fnjson/fnjson.cpp
+    lib/fnjson/fnjsonfilter.h lib/fnjson/fnjsonfilter.cpp
     components_pc/mongoose/mongoose.h components_pc/mongoose/mongoose.c
     lib/webdav/WebDAV.h lib/webdav/WebDAV.cpp
     lib/webdav/IndexParser.h lib/webdav/IndexParser.cpp
     lib/http/httpService.h lib/http/mgHttpService.cpp
     lib/http/httpServiceParser.h lib/http/httpServiceParser.cpp
+    lib/http/httpServiceApi.h lib/http/httpServiceApi.cpp
     lib/http/httpServiceConfigurator.h lib/http/httpServiceConfigurator.cpp
     lib/http/httpServiceBrowser.h lib/http/httpServiceBrowser.cpp
     lib/http/mgHttpClient.h lib/http/mgHttpClient.cpp
+    lib/http/httpClientPool.h
+    lib/http/httpTlsStats.h lib/http/httpTlsStats.cpp
     lib/task/fnTask.h lib/task/fnTask.cpp
     lib/task/fnTaskManager.h lib/task/fnTaskManager.cpp
     lib/printer-emulator/atari_1020.h lib/printer-emulator/atari_1020.cpp
@@ -218,6 +234,7 @@ set(SOURCES src/main.cpp
     lib/printer-emulator/pdf_printer.h lib/printer-emulator/pdf_printer.cpp
     lib/printer-emulator/png_printer.h lib/printer-emulator/png_printer.cpp
     lib/printer-emulator/printer_emulator.h lib/printer-emulator/printer_emulator.cpp
+    lib/printer-emulator/printer_spool.h lib/printer-emulator/printer_spool.cpp
     lib/printer-emulator/svg_plotter.h lib/printer-emulator/svg_plotter.cpp
     lib/network-protocol/NetworkProtocolFactory.h
     lib/network-protocol/network_data.h
@@ -238,7 +255,12 @@ set(SOURCES src/main.cpp
     lib/fuji/fujiCmd.h
     lib/fuji/fujiHost.h lib/fuji/fujiHost.cpp
     lib/fuji/fujiDisk.h lib/fuji/fujiDisk.cpp
+    lib/fuji/fujiCopyTask.h lib/fuji/fujiCopyTask.cpp
+    lib/fuji/fujiMountAll.h lib/fuji/fujiMountAll.cpp
+    lib/fuji/fujiAppKeys.h lib/fuji/fujiAppKeys.cpp
     lib/bus/bus.h
+    lib/bus/busStats.h lib/bus/busStats.cpp
+    lib/bus/cmdArena.h lib/bus/cmdArena.cpp
     lib/device/device.h
     lib/device/disk.h
     lib/device/printer.h
@@ -249,6 +271,7 @@ set(SOURCES src/main.cpp
     lib/device/udpstream.h
     lib/device/siocpm.h
     lib/modem-sniffer/modem-sniffer.h lib/modem-sniffer/modem-sniffer.cpp
+    lib/modem-core/modem-core.h lib/modem-core/modem-core.cpp
     lib/media/media.h
     lib/encoding/base64.h lib/encoding/base64.cpp
     lib/encoding/hash.h lib/encoding/hash.cpp
@@ -263,6 +286,8 @@ if(FUJINET_TARGET STREQUAL "ATARI")
     list(APPEND SOURCES
 
     lib/bus/sio/sio.h lib/bus/sio/sio.cpp
+    lib/bus/sio/sioTrace.h lib/bus/sio/sioTrace.cpp
+    lib/bus/sio/sioHsioTuner.h lib/bus/sio/sioHsioTuner.cpp
     lib/bus/sio/siocom/sioport.h lib/bus/sio/siocom/sioport.cpp
     lib/bus/sio/siocom/serialsio.h lib/bus/sio/siocom/serialsio.cpp
     lib/bus/sio/siocom/netsio.h lib/bus/sio/siocom/netsio.cpp
@@ -361,6 +386,7 @@ if(FUJINET_TARGET STREQUAL "COCO")
     list(APPEND SOURCES
 
     lib/bus/drivewire/drivewire.h lib/bus/drivewire/drivewire.cpp
+    lib/bus/drivewire/dwchannel.h
     lib/bus/drivewire/dwcom/fnDwCom.h lib/bus/drivewire/dwcom/fnDwCom.cpp
     lib/bus/drivewire/dwcom/dwport.h lib/bus/drivewire/dwcom/dwport.cpp
     lib/bus/drivewire/dwcom/dwserial.h lib/bus/drivewire/dwcom/dwserial.cpp
@@ -496,6 +522,31 @@ add_custom_target(build_version DEPENDS "${CMAKE_BINARY_DIR}/include/build_versi
 add_dependencies(fujinet build_version)
 target_include_directories(fujinet PRIVATE "${CMAKE_BINARY_DIR}/include")
 
+# "media_bench", "protocol_bench" and "devrelay_bench" targets
+# the firmware sources with the main from tools/<name>/<name>.cpp; not built by default
+#  media_bench     replays disk access traces against the media types
+#  protocol_bench  times the network protocol end of line translation
+#  devrelay_bench  times dev-relay request/response round trips
+set(BENCH_SOURCES ${SOURCES})
+list(REMOVE_ITEM BENCH_SOURCES src/main.cpp)
+foreach(bench media_bench protocol_bench devrelay_bench)
+    add_executable(${bench} EXCLUDE_FROM_ALL tools/${bench}/${bench}.cpp ${BENCH_SOURCES})
+    if(UNIX AND NOT APPLE)
+        target_link_libraries(${bench} dl)
+    endif()
+    if(CMAKE_SYSTEM_NAME STREQUAL "Windows")
+        target_link_libraries(${bench} crypt32 ws2_32 bcrypt)
+    endif()
+    target_include_directories(${bench} PRIVATE ${INCLUDE_DIRS} ${MBEDTLS_INCLUDE_DIR} "${CMAKE_BINARY_DIR}/include")
+    target_link_libraries(${bench} ${CRYPTO_LIBS} pthread expat cjson cjson_utils smb2 ssh)
+    if(DEFINED USE_LIBSERIAL)
+        target_include_directories(${bench} PRIVATE ${LIBSERIALPORT_INCLUDE_DIRS})
+        target_link_libraries(${bench} ${LIBSERIALPORT_LIBRARIES})
+        target_compile_options(${bench} PRIVATE ${LIBSERIALPORT_CFLAGS_OTHER})
+    endif()
+    add_dependencies(${bench} build_version)
+endforeach()
+
 # WebUI
 # "build_webui" target
 add_custom_command(
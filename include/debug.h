@@ -17,6 +17,14 @@
 #undef DEBUG
 #endif
 
+// What Debug_tracef(), for messages on bus hot paths, does in a DEBUG build:
+//   0 - nothing
+//   1 - records them to be printed later by a low priority task, see deferred_log.h
+//   2 - prints them on the spot like Debug_printf()
+#ifndef DEBUG_TRACE_LEVEL
+#define DEBUG_TRACE_LEVEL 1
+#endif
+
 /*
   Debugging Macros
 */
@@ -49,6 +57,15 @@
 
     #define HEAP_CHECK(x) Debug_printf("HEAP CHECK %s " x "\r\n", heap_caps_check_integrity_all(true) ? "PASSED":"FAILED")
 #endif // ESP_PLATFORM
+
+#if DEBUG_TRACE_LEVEL == 1
+    #include "../lib/utils/deferred_log.h"
+    #define Debug_tracef(...) deferred_log.record(__VA_ARGS__)
+#elif DEBUG_TRACE_LEVEL == 2
+    #define Debug_tracef(...) Debug_printf(__VA_ARGS__)
+#else
+    #define Debug_tracef(...)
+#endif
 #endif // DEBUG
 
 #ifndef DEBUG
@@ -62,6 +79,7 @@
     #define Debug_printf(...)
     #define Debug_println(...)
     #define Debug_printv(format, ...)
+    #define Debug_tracef(...)
 
     #define HEAP_CHECK(x)
 #endif // !DEBUG
@@ -26,6 +26,44 @@
 #define PIN_SD_HOST_SCK         GPIO_NUM_18                    // use count: 20
 #endif /* PIN_SD_HOST_SCK */
 
+/* A board wired to the SDMMC host instead of SPI defines SDMMC_HOST_WIDTH as 1 or 4.
+   The defaults are the ESP32 slot 1 IOMUX pins, the only ones that run at 40MHz */
+#ifdef SDMMC_HOST_WIDTH
+#ifndef PIN_SD_HOST_CLK
+#define PIN_SD_HOST_CLK         GPIO_NUM_14
+#endif /* PIN_SD_HOST_CLK */
+#ifndef PIN_SD_HOST_CMD
+#define PIN_SD_HOST_CMD         GPIO_NUM_15
+#endif /* PIN_SD_HOST_CMD */
+#ifndef PIN_SD_HOST_D0
+#define PIN_SD_HOST_D0          GPIO_NUM_2
+#endif /* PIN_SD_HOST_D0 */
+#if SDMMC_HOST_WIDTH == 4
+#ifndef PIN_SD_HOST_D1
+#define PIN_SD_HOST_D1          GPIO_NUM_4
+#endif /* PIN_SD_HOST_D1 */
+#ifndef PIN_SD_HOST_D2
+#define PIN_SD_HOST_D2          GPIO_NUM_12
+#endif /* PIN_SD_HOST_D2 */
+#ifndef PIN_SD_HOST_D3
+#define PIN_SD_HOST_D3          GPIO_NUM_13
+#endif /* PIN_SD_HOST_D3 */
+#else
+#ifndef PIN_SD_HOST_D1
+#define PIN_SD_HOST_D1          GPIO_NUM_NC
+#endif /* PIN_SD_HOST_D1 */
+#ifndef PIN_SD_HOST_D2
+#define PIN_SD_HOST_D2          GPIO_NUM_NC
+#endif /* PIN_SD_HOST_D2 */
+#ifndef PIN_SD_HOST_D3
+#define PIN_SD_HOST_D3          GPIO_NUM_NC
+#endif /* PIN_SD_HOST_D3 */
+#endif /* SDMMC_HOST_WIDTH == 4 */
+#ifndef PIN_SD_HOST_WP
+#define PIN_SD_HOST_WP          GPIO_NUM_NC
+#endif /* PIN_SD_HOST_WP */
+#endif /* SDMMC_HOST_WIDTH */
+
 /* UART */
 #ifndef PIN_UART0_RX
 #define PIN_UART0_RX            GPIO_NUM_3                     // use count: 20
@@ -20,6 +20,14 @@
 
 #define PIN_DEBUG		PIN_IEC_SRQ
 
+/* DolphinDOS parallel cable, through an XRA1405 sharing the SD card's SPI bus.
+   Build with -D IEC_HAS_DOLPHIN_CABLE when one is wired to these pins */
+#ifdef IEC_HAS_DOLPHIN_CABLE
+#define PIN_XRA1405_CS          GPIO_NUM_27
+#define PIN_PARALLEL_PC2        GPIO_NUM_14 // from the C64, interrupts on the falling edge
+#define PIN_PARALLEL_FLAG2      GPIO_NUM_22 // to the C64
+#endif
+
 #include "iec-common.h"
 #include "common.h"
 
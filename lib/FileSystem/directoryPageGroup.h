@@ -33,25 +33,36 @@ public:
             return false;
         }
 
+        append_entry(data, f);
+        entry_count++;
+        return true;
+    }
+
+    // Append one entry in page group format to the end of dest
+    static void append_entry(std::vector<uint8_t> &dest, fsdir_entry_t *f) {
         size_t filename_len = strlen(f->filename) + 1;
         size_t entry_size = ENTRY_HEADER_SIZE + filename_len;
 
         // Pre-allocate the space needed for this entry
-        size_t new_size = data.size() + entry_size;
-        data.resize(new_size);
+        size_t current_pos = dest.size();
+        dest.resize(current_pos + entry_size);
 
-        // Get pointer to where we'll write the entry
-        size_t current_pos = data.size() - entry_size;
-        
-        set_block_entry_details(f, &data[current_pos]);
+        set_block_entry_details(f, &dest[current_pos]);
         // WE DO ***NOT*** NEED TO ADD A TRAILING "/" TO THE FILENAME FOR DIRS!
         // we're already indicating this through flags.
         // so please do not add one here if you read this, as it will break client code.
-        memcpy(&data[current_pos + ENTRY_HEADER_SIZE], f->filename, filename_len);
+        memcpy(&dest[current_pos + ENTRY_HEADER_SIZE], f->filename, filename_len);
 
         // Debug_printf("Entry added at pos %d: %s\n", current_pos, f->filename);
-        entry_count++;
-        return true;
+    }
+
+    // Write a group header in front of entry bytes already in place at dest + HEADER_SIZE
+    static void write_header(uint8_t *dest, uint8_t entry_count, uint16_t data_size, uint8_t index, bool is_last_group) {
+        dest[0] = is_last_group ? 0x80 : 0x00;
+        dest[1] = entry_count;
+        dest[2] = data_size & 0xFF;
+        dest[3] = (data_size >> 8) & 0xFF;
+        dest[4] = index;
     }
 
     void finalize() {
@@ -59,16 +70,8 @@ public:
             return;
         }
 
-        // Set flags (bit 7 indicates last group)
-        data[0] = is_last_group ? 0x80 : 0x00;
-        // Set entry count
-        data[1] = entry_count;
-        // Set data size (excluding header)
-        uint16_t data_size = data.size() - HEADER_SIZE;
-        data[2] = data_size & 0xFF;
-        data[3] = (data_size >> 8) & 0xFF;
-        // Set group index
-        data[4] = index;
+        // Flags (bit 7 indicates last group), entry count, data size excluding header and group index
+        write_header(data.data(), entry_count, data.size() - HEADER_SIZE, index, is_last_group);
     }
 
 private:
@@ -125,4 +128,58 @@ private:
     }
 };
 
+// The whole open directory already in page group entry format. It's built once,
+// so answering a block request only means copying ranges of it; nothing is
+// formatted, converted or looked up per request.
+class DirectoryPageCache {
+public:
+    std::vector<uint8_t> data;      // Every entry back to back
+    std::vector<uint32_t> offsets;  // Where each entry starts in data, plus the end of the last one
+    bool valid = false;
+    bool too_large = false;         // Don't try again until the directory is reopened
+
+    void clear() {
+        data.clear();
+        data.shrink_to_fit();
+        offsets.clear();
+        offsets.shrink_to_fit();
+        valid = false;
+        too_large = false;
+    }
+
+    void begin() {
+        clear();
+        offsets.push_back(0);
+    }
+
+    // Returns false once the listing grows beyond max_bytes
+    bool add_entry(fsdir_entry_t *f, size_t max_bytes) {
+        DirectoryPageGroup::append_entry(data, f);
+        offsets.push_back(data.size());
+        return data.size() + offsets.size() * sizeof(uint32_t) <= max_bytes;
+    }
+
+    void finish() {
+        data.shrink_to_fit();
+        offsets.shrink_to_fit();
+        valid = true;
+    }
+
+    uint16_t count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    // Bytes taken up by entries [first, first + n)
+    size_t entries_size(uint16_t first, uint16_t n) const {
+        return offsets[first + n] - offsets[first];
+    }
+
+    // Write a complete group holding entries [first, first + n) to dest, returning its size
+    size_t write_group(uint8_t *dest, uint16_t first, uint16_t n, uint8_t index, bool is_last_group) const {
+        size_t size = entries_size(first, n);
+        DirectoryPageGroup::write_header(dest, n, size, index, is_last_group);
+        if (size > 0)
+            memcpy(dest + DirectoryPageGroup::HEADER_SIZE, &data[offsets[first]], size);
+        return DirectoryPageGroup::HEADER_SIZE + size;
+    }
+};
+
 #endif /* DIRECTORY_PAGE_GROUP_H */
@@ -1,113 +1,205 @@
 
 #include "fnDirCache.h"
 
+#include <cctype>
 #include <cstring>
 #include <algorithm>
 #include "compat_string.h"
 
+#include "fnSystem.h"
 #include "utils.h"
 
 
-bool _fsdir_sort_name_ascend(const fsdir_entry* left, const fsdir_entry* right)
+size_t DirCache::max_bytes()
 {
-    if (left->isDir == right->isDir)
-        return strcasecmp(left->filename, right->filename) < 0;
-    else
-        return left->isDir;
+#ifdef ESP_PLATFORM
+    if (fnSystem.get_psram_size() > 0)
+        return DIRCACHE_MAX_BYTES_PSRAM;
+    return DIRCACHE_MAX_BYTES;
+#else
+    return DIRCACHE_MAX_BYTES_PSRAM;
+#endif
 }
 
-bool _fsdir_sort_name_descend(const fsdir_entry* left, const fsdir_entry* right)
+void DirCache::clear()
 {
-    if (left->isDir == right->isDir)
-        return strcasecmp(left->filename, right->filename) > 0;
-    else
-        return left->isDir;
+    _entries_filtered.clear();
+    _entries_filtered.shrink_to_fit();
+    _sorted_name.clear();
+    _sorted_name.shrink_to_fit();
+    _sorted_date.clear();
+    _sorted_date.shrink_to_fit();
+    _dir_count = 0;
+    _entries.clear();
+    _entries.shrink_to_fit();
+    _names.clear();
+    _names.shrink_to_fit();
+    _current = 0;
 }
 
-bool _fsdir_sort_time_ascend(const fsdir_entry* left, const fsdir_entry* right)
+bool DirCache::add_entry(const char *filename, bool isDir, uint32_t size, time_t modified_time)
 {
-    if (left->isDir == right->isDir)
-        return left->modified_time > right->modified_time;
-    else
-        return left->isDir;
-}
+    size_t name_len = strlen(filename) + 1;
+    if (name_len > MAX_PATHLEN)
+        name_len = MAX_PATHLEN;
 
-bool _fsdir_sort_time_descend(const fsdir_entry* left, const fsdir_entry* right)
-{
-    if (left->isDir == right->isDir)
-        return left->modified_time < right->modified_time;
-    else
-        return left->isDir;
-}
+    // tell() and seek() positions are 16 bits
+    if (_entries.size() >= FNFS_INVALID_DIRPOS)
+        return false;
+    // Leaves room for the filtered list and both sorted lists
+    size_t used = (_entries.size() + 1) * (sizeof(dircache_entry) + 3 * sizeof(uint32_t)) + _names.size() + name_len;
+    if (used > max_bytes())
+        return false;
 
-typedef bool (*sort_fn_t)(const fsdir_entry* left, const fsdir_entry* right);
+    dircache_entry entry;
+    entry.name_offset = _names.size();
+    entry.size = size;
+    entry.modified_time = modified_time > 0 ? (uint32_t)modified_time : 0;
+    entry.isDir = isDir;
 
+    _names.insert(_names.end(), filename, filename + name_len - 1);
+    _names.push_back('\0');
+    _entries.push_back(entry);
 
-void DirCache::clear()
-{
-    _entries_filtered.clear();
-    _entries_filtered.shrink_to_fit();
-    _entries.clear();
-    _entries.shrink_to_fit();
-    _current = 0;
+    // The sorted lists no longer cover everything
+    _sorted_name.clear();
+    _sorted_date.clear();
+    return true;
 }
 
-fsdir_entry &DirCache::new_entry()
+bool DirCache::add_entry(const fsdir_entry &entry)
 {
-    _entries.push_back(fsdir_entry());
-    return _entries.back();
+    return add_entry(entry.filename, entry.isDir, entry.size, entry.modified_time);
 }
 
 void DirCache::apply_filter(const char *pattern, uint16_t diropts)
 {
 	char realpat[MAX_PATHLEN];
-	//char *thepat = nullptr;
+	const char *thepat = nullptr;
     bool have_pattern = pattern != nullptr && pattern[0] != '\0';
 	bool filter_dirs = have_pattern && pattern[strlen(pattern)-1] == '/';
 	if (filter_dirs) {
 		strlcpy (realpat, pattern, sizeof (realpat));
 		realpat[strlen(realpat)-1] = '\0';
 	}
-	//thepat = filter_dirs ? realpat : (char *)pattern;
+	thepat = filter_dirs ? realpat : pattern;
 
-    _entries_filtered.clear();
-    _entries_filtered.shrink_to_fit();
+    // Walk the listing in sorted order, so filtering keeps it sorted. Descending
+    // walks the directories and then the files backwards, keeping directories first
+    bool by_date = diropts & DIR_OPTION_FILEDATE;
+    bool descending = diropts & DIR_OPTION_DESCENDING;
+    const index_list &sorted = _sorted(by_date);
 
-    // Filter directory entries
-    for (unsigned i=0; i<_entries.size(); ++i)
+    // Taken apart once here rather than for every name
+    util_wildcard matcher(have_pattern ? thepat : "");
+
+    _entries_filtered.clear();
+    _entries_filtered.reserve(sorted.size());
+    for (unsigned n=0; n<sorted.size(); ++n)
     {
-        fsdir_entry& entry = _entries[i];
+        unsigned pos = n;
+        if (descending)
+            pos = n < _dir_count ? _dir_count - 1 - n : sorted.size() - 1 - (n - _dir_count);
+        uint32_t i = sorted[pos];
+        dircache_entry& entry = _entries[i];
         // Skip this entry if we have a search filter and it doesn't match it
         if (have_pattern && (
             !entry.isDir || (entry.isDir && filter_dirs)
-            ) && util_wildcard_match(entry.filename, pattern) == false)
+            ) && matcher.match(_name(i)) == false)
             continue;
-        _entries_filtered.push_back(&entry);
+        _entries_filtered.push_back(i);
     }
 
-    // Choose the appropriate sorting function
-    sort_fn_t sortfn;
-    if (diropts & DIR_OPTION_FILEDATE)
+    // rewind read cursor
+    _current = 0;
+}
+
+// Case folded first four characters of a name, so most comparisons are one integer compare
+static uint32_t _sort_key(const char *name)
+{
+    uint32_t key = 0;
+    for (int i = 0; i < 4; i++)
     {
-        sortfn = (diropts & DIR_OPTION_DESCENDING) ? _fsdir_sort_time_descend : _fsdir_sort_time_ascend;
+        key <<= 8;
+        if (*name)
+            key |= (uint8_t)tolower((unsigned char)*name++);
     }
-    else
+    return key;
+}
+
+const DirCache::index_list &DirCache::_sorted(bool by_date)
+{
+    index_list &sorted = by_date ? _sorted_date : _sorted_name;
+    if (sorted.size() == _entries.size())
+        return sorted;
+
+    sorted.clear();
+    sorted.reserve(_entries.size());
+    _dir_count = 0;
+    for (unsigned i=0; i<_entries.size(); ++i)
+    {
+        sorted.push_back(i);
+        if (_entries[i].isDir)
+            _dir_count++;
+    }
+
+    if (by_date)
     {
-        sortfn = (diropts & DIR_OPTION_DESCENDING) ? _fsdir_sort_name_descend : _fsdir_sort_name_ascend;
+        std::sort(sorted.begin(), sorted.end(), [&](uint32_t left, uint32_t right) {
+            const dircache_entry &l = _entries[left];
+            const dircache_entry &r = _entries[right];
+            if (l.isDir != r.isDir)
+                return (bool)l.isDir;
+            return l.modified_time > r.modified_time;
+        });
+        return sorted;
     }
 
-    // Sort directory entries
-    std::sort(_entries_filtered.begin(), _entries_filtered.end(), sortfn);
+    // Sort (key, index) pairs so the folded prefixes are computed once per entry
+    // rather than on every comparison
+    std::vector<std::pair<uint32_t, uint32_t>> keyed;
+    keyed.reserve(_entries.size());
+    for (unsigned i=0; i<_entries.size(); ++i)
+        keyed.emplace_back(_sort_key(_name(i)), i);
+    std::sort(keyed.begin(), keyed.end(), [&](const std::pair<uint32_t, uint32_t> &left, const std::pair<uint32_t, uint32_t> &right) {
+        bool ldir = _entries[left.second].isDir;
+        bool rdir = _entries[right.second].isDir;
+        if (ldir != rdir)
+            return ldir;
+        if (left.first != right.first)
+            return left.first < right.first;
+        // Equal prefixes, and a name shorter than the prefix has nothing more to compare
+        if ((left.first & 0xFF) == 0)
+            return false;
+        return strcasecmp(_name(left.second) + 4, _name(right.second) + 4) < 0;
+    });
+    for (unsigned i=0; i<keyed.size(); ++i)
+        sorted[i] = keyed[i].second;
+    return sorted;
+}
+
+void DirCache::apply_no_filter()
+{
+    _entries_filtered.clear();
+    _entries_filtered.reserve(_entries.size());
+    for (unsigned i=0; i<_entries.size(); ++i)
+        _entries_filtered.push_back(i);
     // rewind read cursor
     _current = 0;
 }
 
 fsdir_entry *DirCache::read()
 {
-    if(_current < _entries_filtered.size())
-        return _entries_filtered[_current++];
-    else
+    if(_current >= _entries_filtered.size())
         return nullptr;
+
+    uint32_t index = _entries_filtered[_current++];
+    const dircache_entry &entry = _entries[index];
+    strlcpy(_read_entry.filename, _name(index), sizeof(_read_entry.filename));
+    _read_entry.isDir = entry.isDir;
+    _read_entry.size = entry.size;
+    _read_entry.modified_time = entry.modified_time;
+    return &_read_entry;
 }
 
 uint16_t DirCache::tell()
@@ -9,31 +9,75 @@
 
 #include "fnFS.h"
 
+// Most memory a single cached directory listing may use (entries plus names)
+#define DIRCACHE_MAX_BYTES (32 * 1024)
+// Used instead when PSRAM is available
+#define DIRCACHE_MAX_BYTES_PSRAM (256 * 1024)
+
+/*
+ Holds a whole directory listing so it can be filtered, sorted and paged through
+ without going back to the server. Names are packed back to back in one string pool
+ rather than each entry carrying a MAX_PATHLEN buffer.
+*/
 class DirCache
 {
 private:
+    // 12 bytes: the directory flag shares a word with the name offset and the
+    // time is kept as unsigned 32 bit seconds, good until 2106
+    struct dircache_entry
+    {
+        uint32_t name_offset : 31; // Into _names
+        uint32_t isDir : 1;
+        uint32_t size;
+        uint32_t modified_time;
+    };
+
 #ifdef ESP_PLATFORM
-    std::vector<fsdir_entry,PSRAMAllocator<fsdir_entry>> _entries;
-    std::vector<fsdir_entry *,PSRAMAllocator<fsdir_entry *>> _entries_filtered;
+    typedef std::vector<uint32_t,PSRAMAllocator<uint32_t>> index_list;
+    std::vector<dircache_entry,PSRAMAllocator<dircache_entry>> _entries;
+    std::vector<char,PSRAMAllocator<char>> _names;
 #else
-    std::vector<fsdir_entry> _entries;
-    std::vector<fsdir_entry *> _entries_filtered;
+    typedef std::vector<uint32_t> index_list;
+    std::vector<dircache_entry> _entries;
+    std::vector<char> _names;
 #endif
+    index_list _entries_filtered;
+    // Whole listing sorted by name (A-Z) and by date (newest first), directories
+    // first, built on first use so a new pattern or direction only re-filters
+    index_list _sorted_name;
+    index_list _sorted_date;
+    // Where the directories end in the sorted lists
+    uint32_t _dir_count = 0;
     uint16_t _current = 0;
+    // Returned by read(); only good until the next call
+    fsdir_entry _read_entry;
+
+    const char *_name(uint32_t index) { return _names.data() + _entries[index].name_offset; };
+    const index_list &_sorted(bool by_date);
 
 public:
     // DirCache();
     // ~DirCache();
 
     void clear();
-    fsdir_entry &new_entry();
+    // Returns false, without adding the entry, once the listing has used up its memory budget
+    bool add_entry(const fsdir_entry &entry);
+    bool add_entry(const char *filename, bool isDir, uint32_t size, time_t modified_time);
     void apply_filter(const char *pattern, uint16_t diropts);
+    // Lists every entry in the order it was added, for servers that filter and sort themselves
+    void apply_no_filter();
 
     bool empty() {return _entries.empty();}
+    size_t size() { return _entries.size(); }
+    // Memory held by the listing
+    size_t bytes() { return _entries.capacity() * sizeof(dircache_entry) + _names.capacity() +
+        (_entries_filtered.capacity() + _sorted_name.capacity() + _sorted_date.capacity()) * sizeof(uint32_t); }
+    // Most memory one listing is allowed
+    static size_t max_bytes();
 
     fsdir_entry *read();
     uint16_t tell();
     bool seek(uint16_t pos);
 };
 
-#endif // FN_DIRCACHE_H
\ No newline at end of file
+#endif // FN_DIRCACHE_H
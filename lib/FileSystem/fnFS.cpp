@@ -72,6 +72,17 @@ long FileSystem::filesize(const char *path)
     return -1;
 }
 
+time_t FileSystem::modified_time(const char *path)
+{
+    char *fpath = _make_fullpath(path);
+    if (fpath == nullptr)
+        return 0;
+    struct stat st;
+    int i = stat(fpath, &st);
+    free(fpath);
+    return i == 0 ? st.st_mtime : 0;
+}
+
 const char * FileSystem::type_to_string(fsType type)
 {
     switch(type)
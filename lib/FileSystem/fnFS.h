@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 #include <cstdint>
+#include <cstring>
 
 #include "fnio.h"
 
@@ -65,8 +66,12 @@ protected:
 #endif
     bool _started = false;
     fsdir_entry _direntry;
+    // Bumped whenever something may have changed the contents of a directory
+    uint32_t _changes = 0;
 
     char *_make_fullpath(const char *path);
+    void note_change() { _changes++; };
+    static bool mode_writes(const char *mode) { return mode != nullptr && strpbrk(mode, "wa+") != nullptr; };
 
 public:
     virtual ~FileSystem() {};
@@ -75,6 +80,8 @@ public:
     virtual bool is_global() { return false; };
 
     virtual bool running() { return _started; };
+    // Lets callers holding on to directory listings tell whether they may be out of date
+    uint32_t changes() { return _changes; };
     virtual const char * basepath() { return _basepath; };
     
     virtual fsType type()=0;
@@ -87,6 +94,8 @@ public:
     static long filesize(FileHandler *);
 #endif
     virtual long filesize(const char *path);
+    // Last modification time of path, or 0 when it's not known (or path isn't a file here)
+    virtual time_t modified_time(const char *path);
 
     // Different FS implemenations may require different startup parameters,
     // so each should define its own version of start()
@@ -95,17 +104,26 @@ public:
     virtual FILE * file_open(const char* path, const char* mode = FILE_READ) = 0;
 #ifdef FNIO_IS_STDIO
     fnFile * fnfile_open(const char* path, const char* mode = FILE_READ) {
+        if (mode_writes(mode))
+            note_change();
         return file_open(path, mode);
     }
 #else
     virtual FileHandler * filehandler_open(const char* path, const char* mode = FILE_READ) = 0;
     fnFile * fnfile_open(const char* path, const char* mode = FILE_READ) {
+        if (mode_writes(mode))
+            note_change();
         return filehandler_open(path, mode);
     }
 #endif
 
     virtual bool exists(const char* path) = 0;
 
+    // Creates path as a file of size bytes in one contiguous run, with undefined contents, for
+    // a new disk image to be written into in place. FALSE if this filesystem can't, in which
+    // case nothing has been created
+    virtual bool preallocate(const char* /*path*/, uint32_t /*size*/) { return false; };
+
     virtual bool remove(const char* path) = 0;
 
     virtual bool rename(const char* pathFrom, const char* pathTo) = 0;
@@ -1,8 +1,37 @@
 
 #include "fnFile.h"
 
-#include "../../include/debug.h"
+#include <cstdio>
 
-// nothing to do in base class
+#include "../../include/debug.h"
 
 FileHandler::~FileHandler() {};
+
+size_t FileHandler::pread(void *ptr, size_t len, long int offset)
+{
+    if (seek(offset, SEEK_SET) != 0)
+        return 0;
+    return read(ptr, 1, len);
+}
+
+size_t FileHandler::pwrite(const void *ptr, size_t len, long int offset)
+{
+    if (seek(offset, SEEK_SET) != 0)
+        return 0;
+    return write(ptr, 1, len);
+}
+
+size_t FileHandler::preadv(const fnIoVec *iov, int iovcnt, long int offset)
+{
+    // Each pread after the first carries on from where the last left off, which backends
+    // with a read cache serve without another request
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        size_t got = pread(iov[i].base, iov[i].len, offset + (long int)total);
+        total += got;
+        if (got < iov[i].len)
+            break;
+    }
+    return total;
+}
@@ -3,6 +3,13 @@
 
 #include <cstddef>
 
+// One buffer of a vectored read, as struct iovec
+struct fnIoVec
+{
+    void *base;
+    size_t len;
+};
+
 /* 
  * FileHandler - abstraction of FILE from stdio
  * it allows to implement other file protocols at application layer
@@ -23,6 +30,15 @@ public:
     virtual size_t write(const void *ptr, size_t size, size_t n) = 0;
     virtual int flush() = 0;
     virtual int eof() {return 0;}; // TODO!
+
+    // Positional I/O: offset and length reach the backend in one call, so remote ones can
+    // make a single request of it. Unlike POSIX, the file position is left just past the
+    // data, so a sequential read after it carries on. Return the bytes moved, short at
+    // EOF or on error. The defaults seek, then read or write
+    virtual size_t pread(void *ptr, size_t len, long int offset);
+    virtual size_t pwrite(const void *ptr, size_t len, long int offset);
+    // Fills each buffer in turn from consecutive bytes starting at offset
+    virtual size_t preadv(const fnIoVec *iov, int iovcnt, long int offset);
 };
 
 #endif // FN_FILE_H
@@ -6,6 +6,8 @@
 
 #include <iostream>
 #include <bitset>
+#include <map>
+#include <sstream>
 #include <string>
 #include <algorithm>
 
@@ -20,6 +22,7 @@
 #include "compat_gettimeofday.h"
 #endif
 
+#include "fnConfig.h"
 #include "fnFileMem.h"
 #include "fnFsSD.h"
 
@@ -30,7 +33,10 @@
 #define CACHE_FILE_MAX_AGE      10800
 // Files over this size are changed from in memory to SD
 #define DEFAULT_PERSISTENT_THRESHOLD  204800
-#define COPY_BLK_SIZE           4096
+// Copied from memory to SD on each write while changing over, on top of what was written
+#define SPILL_STEP_SIZE         8192
+// Lists the SD cache files with their size, last use and validator, so nothing needs a directory scan
+#define CACHE_MANIFEST          FILE_CACHE_DIRECTORY "/MANIFEST"
 
 
 static const std::string BASE32_ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
@@ -90,6 +96,114 @@ static std::string get_file_path(const std::string &name)
     return std::string(FILE_CACHE_DIRECTORY) + '/' + name;
 }
 
+// Where a cache file is written, it's renamed to its own name only once it's complete
+static std::string get_part_path(const std::string &name)
+{
+    return get_file_path(name) + ".PART";
+}
+
+static time_t get_time()
+{
+    struct timeval now;
+#ifdef ESP_PLATFORM
+    gettimeofday(&now, nullptr);
+#else
+    compat_gettimeofday(&now, nullptr);
+#endif
+    return now.tv_sec;
+}
+
+struct cache_entry
+{
+    long size;
+    time_t used;
+    std::string validator;
+};
+
+// Cache manifest, keyed by cache file name, read from SD on first use
+static std::map<std::string, cache_entry> manifest;
+static bool manifest_loaded = false;
+
+static void manifest_load()
+{
+    if (manifest_loaded || !fnSDFAT.running())
+        return;
+    manifest_loaded = true;
+
+    FileHandler *fh = fnSDFAT.filehandler_open(CACHE_MANIFEST, "rb");
+    if (fh == nullptr)
+        return;
+    std::string text;
+    char buf[256];
+    size_t count;
+    while ((count = fh->read(buf, 1, sizeof(buf))) > 0)
+        text.append(buf, count);
+    fh->close();
+
+    // One "name<TAB>size<TAB>used<TAB>validator" line per file
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        std::istringstream fields(line);
+        std::string name, size, used, validator;
+        if (std::getline(fields, name, '\t') && std::getline(fields, size, '\t') && std::getline(fields, used, '\t'))
+        {
+            std::getline(fields, validator);
+            manifest[name] = {atol(size.c_str()), (time_t)atoll(used.c_str()), validator};
+        }
+    }
+    Debug_printf("FileCache - %u files in cache manifest\n", (unsigned)manifest.size());
+}
+
+static void manifest_save()
+{
+    std::string text;
+    for (const auto &e : manifest)
+        text += e.first + '\t' + std::to_string(e.second.size) + '\t' + std::to_string((long long)e.second.used) + '\t' + e.second.validator + '\n';
+
+    FileHandler *fh = fnSDFAT.filehandler_open(CACHE_MANIFEST, "wb");
+    if (fh == nullptr)
+    {
+        Debug_println("FileCache - failed to write cache manifest");
+        return;
+    }
+    fh->write(text.data(), 1, text.size());
+    fh->close();
+}
+
+static void remove_cache_file(const std::string &name)
+{
+    fnSDFAT.remove(get_file_path(name).c_str());
+    fnSDFAT.remove(get_part_path(name).c_str());
+    fnSDFAT.remove((get_file_path(name) + ".TXT").c_str());
+}
+
+// Removes least recently used cache files until the cache fits its size budget, never keep
+static void evict(const std::string &keep)
+{
+    long long budget = (long long)Config.get_general_image_cache_mb() * 1024 * 1024;
+    long long total = 0;
+    for (const auto &e : manifest)
+        total += e.second.size;
+
+    while (total > budget)
+    {
+        auto oldest = manifest.end();
+        for (auto it = manifest.begin(); it != manifest.end(); ++it)
+        {
+            if (it->first != keep && (oldest == manifest.end() || it->second.used < oldest->second.used))
+                oldest = it;
+        }
+        if (oldest == manifest.end())
+            break;
+        Debug_printf("FileCache - evicting %s\n", oldest->first.c_str());
+        remove_cache_file(oldest->first);
+        total -= oldest->second.size;
+        manifest.erase(oldest);
+    }
+}
+
 FileHandler *FileCache::open(const char *host, const char *path, const char *mode)
 {
     FileHandler *fh = nullptr;
@@ -97,7 +211,14 @@ FileHandler *FileCache::open(const char *host, const char *path, const char *mod
     if (!fnSDFAT.running())
         return nullptr;
 
-    std::string cache_path(get_file_path(encode_host_path(host, path)));
+    std::string name(encode_host_path(host, path));
+    std::string cache_path(get_file_path(name));
+
+    // Only a file that was written to the end is in the manifest, at its full size
+    manifest_load();
+    auto it = manifest.find(name);
+    if (it == manifest.end() || fnSDFAT.filesize(cache_path.c_str()) != it->second.size)
+        return nullptr;
 
     // test file age, do not use old/expired
     struct timeval now;
@@ -116,11 +237,48 @@ FileHandler *FileCache::open(const char *host, const char *path, const char *mod
     {
         // Cache hit
         Debug_printf("Using SD cache file: %s\n", cache_path.c_str());
+        it->second.used = get_time();
+        manifest_save();
     }
 
     return fh;
 }
 
+FileHandler *FileCache::open_validated(const char *host, const char *path, const char *mode, const std::string &validator)
+{
+    if (validator.empty() || !fnSDFAT.running())
+        return nullptr;
+    manifest_load();
+
+    std::string name = encode_host_path(host, path);
+    auto it = manifest.find(name);
+    if (it == manifest.end() || it->second.validator != validator)
+        return nullptr;
+
+    FileHandler *fh = nullptr;
+    if (fnSDFAT.filesize(get_file_path(name).c_str()) == it->second.size)
+        fh = fnSDFAT.filehandler_open(get_file_path(name).c_str(), mode);
+    if (fh == nullptr)
+    {
+        // Gone from the SD card or cut short, forget it
+        manifest.erase(it);
+        manifest_save();
+        return nullptr;
+    }
+
+    Debug_printf("Using unchanged SD cache file: %s\n", get_file_path(name).c_str());
+    it->second.used = get_time();
+    manifest_save();
+    return fh;
+}
+
+std::string FileCache::validator(const char *host, const char *path)
+{
+    manifest_load();
+    auto it = manifest.find(encode_host_path(host, path));
+    return it == manifest.end() ? std::string() : it->second.validator;
+}
+
 fc_handle *FileCache::create(const char *host, const char *path, int threshold, int max_size)
 {
     fc_handle *fc;
@@ -142,6 +300,9 @@ fc_handle *FileCache::create(const char *host, const char *path, int threshold,
         return nullptr;
     }
     fc->fh = fh;
+    fc->spill = nullptr;
+    fc->spilled = 0;
+    fc->spill_failed = false;
     fc->threshold = (threshold < 0) ? DEFAULT_PERSISTENT_THRESHOLD : threshold;
     fc->max_size = max_size;
     fc->size = 0;
@@ -153,6 +314,75 @@ fc_handle *FileCache::create(const char *host, const char *path, int threshold,
     return fc;
 }
 
+// Opens the SD file the memory file will be copied to
+static bool spill_start(fc_handle *fc)
+{
+    if (!fnSDFAT.running())
+    {
+        Debug_println("FileCache::write - SD Filesystem is not running");
+        return false;
+    }
+
+    Debug_printf("Writing SD cache file: %s\n", get_file_path(fc->name).c_str());
+
+    // Ensure cache directory exists
+    fnSDFAT.create_path(FILE_CACHE_DIRECTORY);
+
+    fc->spill = fnSDFAT.filehandler_open(get_part_path(fc->name).c_str(), "wb+");
+    if (fc->spill == nullptr)
+    {
+        Debug_println("FileCache::write - failed to open SD file");
+        return false;
+    }
+    fc->spilled = 0;
+    return true;
+}
+
+// Copies up to budget bytes more of the memory file to SD, straight out of its chunks.
+// When everything is across, the SD file takes over the handle
+static void spill_step(fc_handle *fc, size_t budget)
+{
+    FileHandlerMem *mem = static_cast<FileHandlerMem *>(fc->fh);
+    while (budget > 0 && fc->spilled < fc->size)
+    {
+        size_t len;
+        const uint8_t *src = mem->peek(fc->spilled, &len);
+        if (src == nullptr)
+            break;
+        if (len > budget)
+            len = budget;
+        size_t out = fc->spill->write(src, 1, len);
+        fc->spilled += out;
+        budget -= len;
+        if (out != len)
+        {
+            // Don't try again on every write, the cache stays in memory
+            Debug_println("FileCache::write - failed to write SD file, keeping cache in memory");
+            fc->spill->close();
+            fc->spill = nullptr;
+            fc->spill_failed = true;
+            remove_cache_file(fc->name);
+            return;
+        }
+    }
+    if (fc->spilled < fc->size)
+        return;
+
+    // Update handle
+    fc->fh->close();
+    fc->fh = fc->spill;
+    fc->spill = nullptr;
+    fc->persistent = true;
+    // Write some info into file (optional, not used by anything)
+    FileHandler *fh_info = fnSDFAT.filehandler_open((get_file_path(fc->name) + ".TXT").c_str(), "wb+");
+    if (fh_info != nullptr)
+    {
+        std::string info("Host: "+ fc->host +"\r\nFile: "+ fc->path+ "\r\nCache: "+ fc->name +"\r\n");
+        fh_info->write(info.c_str(), 1, info.size());
+        fh_info->close();
+    }
+}
+
 size_t FileCache::write(fc_handle *fc, const void *data, size_t len)
 {
     if (fc == nullptr || fc->fh == nullptr)
@@ -168,51 +398,16 @@ size_t FileCache::write(fc_handle *fc, const void *data, size_t len)
     size_t result = fc->fh->write(data, 1, write_len);
     fc->size += result;
 
-    // check if memory file is over limit
-    if (!fc->persistent && fc->size >= fc->threshold)
+    // Memory file over limit, start changing over to SD card
+    if (!fc->persistent && fc->spill == nullptr && !fc->spill_failed && fc->size >= fc->threshold && !spill_start(fc))
     {
-        // Switch from memory to SD card
-        if (!fnSDFAT.running())
-        {
-            Debug_println("FileCache::write - SD Filesystem is not running");
-            return result;
-        }
-
-        Debug_printf("Writing SD cache file: %s\n", get_file_path(fc->name).c_str());
-
-        // Ensure cache directory exists
-        fnSDFAT.create_path(FILE_CACHE_DIRECTORY);
-
-        // Open SD file
-        FileHandler *fh_sd = fnSDFAT.filehandler_open(get_file_path(fc->name).c_str(), "wb+");
-        if (fh_sd == nullptr)
-        {
-            Debug_println("FileCache::write - failed to open SD file");
-            return result;
-        }
-
-        // Copy from memory to SD file
-        //Debug_println("Changing memory file to SD file");
-        size_t count = 0;
-        uint8_t *buf = (uint8_t *)malloc(COPY_BLK_SIZE);
-        fc->fh->seek(0, SEEK_SET);
-        do
-        {
-            count = fc->fh->read(buf, 1, COPY_BLK_SIZE);
-            fh_sd->write(buf, 1, count);
-        } while (count > 0);
-        free(buf);
-        // Update handle
-        fc->fh->close();
-        fc->fh = fh_sd;
-        fc->persistent = true;
-        // Write some info into file (optional, not used by anything)
-        fh_sd = fnSDFAT.filehandler_open((get_file_path(fc->name) + ".TXT").c_str(), "wb+");
-        std::string info("Host: "+ fc->host +"\r\nFile: "+ fc->path+ "\r\nCache: "+ fc->name +"\r\n");
-        fh_sd->write(info.c_str(), 1, info.size());
-        fh_sd->close();
-        //Debug_println("Changed to SD");
+        fc->spill_failed = true;
+        return result;
     }
+
+    // Copy faster than data arrives, so the change over finishes
+    if (fc->spill != nullptr)
+        spill_step(fc, result + SPILL_STEP_SIZE);
     return result;
 }
 
@@ -224,12 +419,47 @@ FileHandler *FileCache::reopen(fc_handle *fc, const char *mode)
     if (fc == nullptr || fc->fh == nullptr)
         return nullptr;
 
+    // Finish changing over to SD, or if the SD file can't be written stay in memory
+    if (fc->spill != nullptr)
+        spill_step(fc, fc->size);
+    if (fc->spill != nullptr)
+    {
+        fc->spill->close();
+        fc->spill = nullptr;
+        remove_cache_file(fc->name);
+    }
+
     if (fc->persistent)
     {
-        // reopen SD cache file
+        // The SD cache file is complete, it can have its own name and be reopened
         fc->fh->flush();
         fc->fh->close();
-        fh = fnSDFAT.filehandler_open(get_file_path(fc->name).c_str(), mode);
+        std::string cache_path = get_file_path(fc->name);
+        fnSDFAT.remove(cache_path.c_str());
+        if (fnSDFAT.rename(get_part_path(fc->name).c_str(), cache_path.c_str()))
+            fh = fnSDFAT.filehandler_open(cache_path.c_str(), mode);
+        else
+        {
+            Debug_println("FileCache::reopen - failed to rename SD cache file");
+            remove_cache_file(fc->name);
+            fh = nullptr;
+        }
+        if (fh == nullptr)
+        {
+            manifest_load();
+            if (manifest.erase(fc->name) > 0)
+                manifest_save();
+            delete fc;
+            return nullptr;
+        }
+
+        // Tabs and line breaks would break up the manifest line
+        std::string validator = fc->validator;
+        std::replace_if(validator.begin(), validator.end(), [](char c) { return c == '\t' || c == '\r' || c == '\n'; }, ' ');
+        manifest_load();
+        manifest[fc->name] = {(long)fc->size, get_time(), validator};
+        evict(fc->name);
+        manifest_save();
     }
     else
     {
@@ -248,11 +478,15 @@ void FileCache::remove(fc_handle *fc)
         return;
 
     fc->fh->close();
-    if (fc->persistent)
+    if (fc->spill != nullptr)
+        fc->spill->close();
+    if (fc->persistent || fc->spill != nullptr)
     {
         // remove SD cache file
-        fnSDFAT.remove(get_file_path(fc->name).c_str());
-        fnSDFAT.remove((get_file_path(fc->name) + ".TXT").c_str());
+        remove_cache_file(fc->name);
+        manifest_load();
+        if (manifest.erase(fc->name) > 0)
+            manifest_save();
     }
     delete fc;
 }
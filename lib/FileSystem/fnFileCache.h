@@ -10,6 +10,9 @@
 typedef struct fc_handle
 {
     FileHandler *fh;
+    FileHandler *spill;  // SD file the memory file is being copied to, once over threshold
+    int spilled;         // how much of the memory file has been copied so far
+    bool spill_failed;   // the SD file couldn't be written, the cache stays in memory
     int threshold;
     int max_size;
     int size;
@@ -17,6 +20,7 @@ typedef struct fc_handle
     std::string host;
     std::string path;
     std::string name;
+    std::string validator; // version of the remote file, see FileCache::open_validated()
 } fc_handle;
 
 
@@ -33,6 +37,19 @@ public:
     */
     static FileHandler *open(const char *host, const char *path, const char *mode);
 
+   /**
+    * @brief Open SD cache file if it was stored for the same version of the remote file, regardless of age
+    * @param validator identifies the remote file version, e.g. from its ETag, Last-Modified and size
+    * @return pointer to file handler to use or nullptr if not cached or changed
+    */
+    static FileHandler *open_validated(const char *host, const char *path, const char *mode, const std::string &validator);
+
+   /**
+    * @brief Validator the SD cache file was stored with
+    * @return validator, empty if there is no cache file or it was stored without one
+    */
+    static std::string validator(const char *host, const char *path);
+
    /**
     * @brief Create new empty cache file, ready for writes, file is created in memory
     * @param host name from host slot
@@ -45,6 +62,9 @@ public:
 
    /** 
     * @brief Write data to cache file
+    * Once the memory file reaches the threshold, each write also copies a little more of it to
+    * the SD file, so the download isn't held up by one long copy. The handle switches to the SD
+    * file when the copy catches up.
     * @return amount of written bytes
     */
     static size_t write(fc_handle *fc, const void *data, size_t len);
@@ -53,6 +73,8 @@ public:
     * @brief Open cache file (after successful create/write).
     * If cache file is on SD (see threshold), it is flushed/closed first, then opened again.
     * If cache file is still in memory, it is rewound (TODO: mode is ignored, shouldn't be).
+    * An SD file is recorded in the cache manifest, and least recently used cache files are
+    * removed to keep the cache within the configured size.
     * fc_handle is deleted and cannot be used anymore.
     * @return pointer to file handler to use (can be in memory or SD file) or nullptr on error
     */
@@ -0,0 +1,159 @@
+#include <errno.h>
+#include <stdio.h>
+
+#include "fnFileFTP.h"
+#include "../../include/debug.h"
+
+
+FileHandlerFTP::FileHandlerFTP(fnFTP *ftp, const std::string &path, long int size)
+{
+    Debug_println("new FileHandlerFTP");
+    _ftp = ftp;
+    _path = path;
+    _size = size;
+}
+
+
+FileHandlerFTP::~FileHandlerFTP()
+{
+    Debug_println("delete FileHandlerFTP");
+    if (_ftp != nullptr) close(false);
+}
+
+
+int FileHandlerFTP::close(bool destroy)
+{
+    Debug_println("FileHandlerFTP::close");
+    if (_ftp != nullptr)
+    {
+        _end_transfer();
+        _ftp->logout();
+        delete _ftp;
+        _ftp = nullptr;
+    }
+    if (destroy) delete this;
+    return 0;
+}
+
+
+void FileHandlerFTP::_end_transfer()
+{
+    if (_stream_position >= 0)
+        _ftp->abort_transfer();
+    _stream_position = -1;
+}
+
+
+bool FileHandlerFTP::_start_transfer(long int offset)
+{
+    _end_transfer();
+    if (_ftp->open_file(_path, false, offset))
+    {
+        Debug_printf("FileHandlerFTP - RETR from %ld failed\n", offset);
+        return false;
+    }
+    _stream_position = offset;
+    return true;
+}
+
+
+int FileHandlerFTP::seek(long int off, int whence)
+{
+    Debug_println("FileHandlerFTP::seek");
+    long int new_pos;
+    if (whence == SEEK_SET)
+        new_pos = off;
+    else if (whence == SEEK_CUR)
+        new_pos = _position + off;
+    else if (whence == SEEK_END)
+        new_pos = _size + off;
+    else
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (new_pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    // The transfer is left alone, the next read decides whether it's still any use
+    _position = new_pos;
+    return 0;
+}
+
+
+long int FileHandlerFTP::tell()
+{
+    Debug_println("FileHandlerFTP::tell");
+    return _position;
+}
+
+
+size_t FileHandlerFTP::read(void *ptr, size_t size, size_t count)
+{
+    if (_ftp == nullptr || size == 0 || _position >= _size)
+        return 0;
+
+    size_t want = size * count;
+    if (want > (size_t)(_size - _position))
+        want = _size - _position;
+
+    // A little way ahead, read through to it rather than pay for another RETR
+    if (_stream_position >= 0 && _position > _stream_position && _position - _stream_position <= FTP_SKIP_MAX)
+    {
+        uint8_t skip[256];
+        while (_stream_position < _position)
+        {
+            unsigned short n = _position - _stream_position > (long)sizeof(skip) ? sizeof(skip) : _position - _stream_position;
+            if (_ftp->read_data(skip, n) != n)
+            {
+                _end_transfer();
+                break;
+            }
+            _stream_position += n;
+        }
+    }
+
+    if (_stream_position != _position && !_start_transfer(_position))
+        return 0;
+
+    size_t total = 0;
+    while (total < want)
+    {
+        unsigned short n = want - total > 0xFFFF ? 0xFFFF : want - total;
+        int got = _ftp->read_data((uint8_t *)ptr + total, n);
+        if (got > 0)
+        {
+            total += got;
+            _stream_position += got;
+        }
+        if (got < n)
+        {
+            Debug_printf("FileHandlerFTP::read - transfer ended at %ld\n", _stream_position);
+            _end_transfer();
+            break;
+        }
+    }
+    _position += total;
+
+    // Done with the file, the server's told us so
+    if (_stream_position >= _size)
+        _end_transfer();
+
+    return size * count == total ? count : total / size;
+}
+
+
+size_t FileHandlerFTP::write(const void * /*ptr*/, size_t /*size*/, size_t /*count*/)
+{
+    Debug_println("FileHandlerFTP::write - read only");
+    errno = EROFS;
+    return 0;
+}
+
+
+int FileHandlerFTP::flush()
+{
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef FN_FILEFTP_H
+#define FN_FILEFTP_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+#include "fnFTP.h"
+#include "fnFile.h"
+
+// A read at most this far past the transfer in progress reads on to it instead of starting another
+#define FTP_SKIP_MAX 8192
+
+/*
+ * FileHandlerFTP - reads a file on an FTP server without downloading it first.
+ * It keeps one RETR streaming from wherever the last read left off; a read
+ * anywhere else ends it and starts another there with REST. Has a control
+ * connection of its own, so the file system's stays free for listings.
+ * Read only.
+ */
+class FileHandlerFTP : public FileHandler
+{
+protected:
+    fnFTP *_ftp;
+    std::string _path;
+    long int _size;
+    long int _position = 0;
+    // Where the RETR in progress is up to, -1 if there isn't one
+    long int _stream_position = -1;
+
+    void _end_transfer();
+    bool _start_transfer(long int offset);
+
+public:
+    // Takes over ftp, which must be logged in and have REST support
+    FileHandlerFTP(fnFTP *ftp, const std::string &path, long int size);
+    virtual ~FileHandlerFTP() override;
+
+    virtual int close(bool destroy=true) override;
+    virtual int seek(long int off, int whence) override;
+    virtual long int tell() override;
+    virtual size_t read(void *ptr, size_t size, size_t count) override;
+    virtual size_t write(const void *ptr, size_t size, size_t count) override;
+    virtual int flush() override;
+};
+
+#endif // FN_FILEFTP_H
@@ -0,0 +1,168 @@
+#ifdef ESP_PLATFORM
+// Only the firmware has FatFs underneath the SD card; FN-PC uses FileHandlerLocal
+
+#include "fnFileFat.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/debug.h"
+
+// Table entries tried first; enough for an image in up to 15 fragments.
+// If the file needs more, FatFs says how many and the table is made that size
+#define FAT_CLMT_INITIAL 32
+
+
+FileHandlerFat::~FileHandlerFat()
+{
+    if (_open) close(false);
+}
+
+
+bool FileHandlerFat::open(const char *path, const char *mode)
+{
+    BYTE fmode = FA_READ;
+    if (strchr(mode, '+') != nullptr)
+        fmode |= FA_WRITE;
+
+    if (f_open(&_fil, path, fmode) != FR_OK)
+        return false;
+    _open = true;
+
+#if FF_USE_FASTSEEK
+    // The first entry is the table size going in, and the size needed coming out
+    _clmt = (DWORD *)malloc(FAT_CLMT_INITIAL * sizeof(DWORD));
+    if (_clmt != nullptr)
+    {
+        _clmt[0] = FAT_CLMT_INITIAL;
+        _fil.cltbl = _clmt;
+        FRESULT r = f_lseek(&_fil, CREATE_LINKMAP);
+        if (r == FR_NOT_ENOUGH_CORE)
+        {
+            DWORD needed = _clmt[0];
+            DWORD *bigger = (DWORD *)realloc(_clmt, needed * sizeof(DWORD));
+            if (bigger != nullptr)
+            {
+                _clmt = bigger;
+                _clmt[0] = needed;
+                _fil.cltbl = _clmt;
+                r = f_lseek(&_fil, CREATE_LINKMAP);
+            }
+        }
+        if (r != FR_OK)
+            _drop_linkmap();
+    }
+    Debug_printf("FileHandlerFat \"%s\" fast seek %s\r\n", path, _clmt != nullptr ? "on" : "off");
+#endif
+
+    return true;
+}
+
+
+void FileHandlerFat::_drop_linkmap()
+{
+#if FF_USE_FASTSEEK
+    _fil.cltbl = nullptr;
+#endif
+    free(_clmt);
+    _clmt = nullptr;
+}
+
+
+int FileHandlerFat::close(bool destroy)
+{
+    int result = 0;
+    if (_open)
+    {
+        result = f_close(&_fil) == FR_OK ? 0 : EOF;
+        _open = false;
+    }
+    free(_clmt);
+    _clmt = nullptr;
+    if (destroy) delete this;
+    return result;
+}
+
+
+int FileHandlerFat::seek(long int off, int whence)
+{
+    FSIZE_t base;
+    switch (whence)
+    {
+    case SEEK_SET:
+        base = 0;
+        break;
+    case SEEK_CUR:
+        base = f_tell(&_fil);
+        break;
+    case SEEK_END:
+        base = f_size(&_fil);
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+    if (off < 0 && (FSIZE_t)-off > base)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    FSIZE_t pos = base + off;
+
+    // With the link map a seek can't extend the file, so leave it for ordinary seeks
+    if (pos > f_size(&_fil) && _clmt != nullptr)
+        _drop_linkmap();
+
+    if (f_lseek(&_fil, pos) != FR_OK)
+    {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+
+long int FileHandlerFat::tell()
+{
+    return f_tell(&_fil);
+}
+
+
+size_t FileHandlerFat::read(void *ptr, size_t size, size_t n)
+{
+    if (size == 0)
+        return 0;
+    UINT got = 0;
+    f_read(&_fil, ptr, size * n, &got);
+    return got / size;
+}
+
+
+size_t FileHandlerFat::write(const void *ptr, size_t size, size_t n)
+{
+    if (size == 0)
+        return 0;
+    if (_clmt != nullptr && f_tell(&_fil) + size * n > f_size(&_fil))
+        _drop_linkmap();
+
+    UINT put = 0;
+    f_write(&_fil, ptr, size * n, &put);
+    return put / size;
+}
+
+
+int FileHandlerFat::flush()
+{
+    // Same as fsync() through the VFS, in case we get reset at any moment
+    return f_sync(&_fil) == FR_OK ? 0 : EOF;
+}
+
+
+int FileHandlerFat::eof()
+{
+    return f_eof(&_fil);
+}
+
+#endif // ESP_PLATFORM
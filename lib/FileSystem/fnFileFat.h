@@ -0,0 +1,48 @@
+#ifndef FN_FILEFAT_H
+#define FN_FILEFAT_H
+
+#ifdef ESP_PLATFORM
+
+#include <ff.h>
+
+#include "fnFile.h"
+
+/*
+ * FileHandlerFat - a file on the SD card opened straight through FatFs
+ * instead of the VFS, so it can keep a cluster link map table. With the map
+ * built at open a seek is arithmetic rather than a walk down the FAT, which
+ * is what random access to a large disk image spends its time on.
+ *
+ * FatFs can't grow a file while the map is in use, so a write past the end
+ * drops it and the file carries on with ordinary seeks.
+ */
+class FileHandlerFat : public FileHandler
+{
+protected:
+    FIL _fil;
+    bool _open = false;
+    DWORD *_clmt = nullptr;
+
+    void _drop_linkmap();
+
+public:
+    FileHandlerFat() {};
+    virtual ~FileHandlerFat() override;
+
+    // Opens path (on the SD card's drive) with an fopen style mode; FALSE if FatFs wouldn't
+    bool open(const char *path, const char *mode);
+    // Whether seeks go through the link map
+    bool fast_seek() { return _clmt != nullptr; };
+
+    virtual int close(bool destroy=true) override;
+    virtual int seek(long int off, int whence) override;
+    virtual long int tell() override;
+    virtual size_t read(void *ptr, size_t size, size_t n) override;
+    virtual size_t write(const void *ptr, size_t size, size_t n) override;
+    virtual int flush() override;
+    virtual int eof() override;
+};
+
+#endif // ESP_PLATFORM
+
+#endif // FN_FILEFAT_H
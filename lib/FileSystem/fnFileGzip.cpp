@@ -0,0 +1,239 @@
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#include "fnFileGzip.h"
+#include "../../include/debug.h"
+
+#define GZIP_HEADER_SIZE 10
+// A BGZF member's header: the gzip one, XLEN 6 and a "BC" subfield holding BSIZE
+#define BGZF_HEADER_SIZE 18
+
+static bool _is_gzip(const uint8_t *hdr)
+{
+    return hdr[0] == 0x1F && hdr[1] == 0x8B && hdr[2] == 8;
+}
+
+static bool _is_bgzf(const uint8_t *hdr)
+{
+    return _is_gzip(hdr) && (hdr[3] & 0x04) && hdr[10] == 6 && hdr[11] == 0 &&
+           hdr[12] == 'B' && hdr[13] == 'C' && hdr[14] == 2 && hdr[15] == 0;
+}
+
+static uint32_t _le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+FileHandler *FileHandlerGzip::wrap(FileHandler *fh)
+{
+    if (fh == nullptr)
+        return fh;
+
+    uint8_t hdr[GZIP_HEADER_SIZE];
+    if (fh->pread(hdr, sizeof(hdr), 0) != sizeof(hdr) || !_is_gzip(hdr))
+    {
+        fh->seek(0, SEEK_SET);
+        return fh;
+    }
+
+    FileHandlerGzip *gz = new FileHandlerGzip(fh);
+    if (!gz->_index())
+    {
+        Debug_println("FileHandlerGzip::wrap - couldn't index the image");
+        gz->close();
+        return nullptr;
+    }
+
+    Debug_printf("FileHandlerGzip::wrap - %ld byte image, %u restart points\n",
+                 gz->_filesize, (unsigned)gz->_restarts.size());
+    return gz;
+}
+
+FileHandlerGzip::FileHandlerGzip(FileHandler *fh)
+    : _fh(fh)
+{
+}
+
+FileHandlerGzip::~FileHandlerGzip()
+{
+    if (_fh != nullptr)
+        close(false);
+}
+
+bool FileHandlerGzip::_index()
+{
+    if (_fh->seek(0, SEEK_END) != 0)
+        return false;
+    long int compressed_size = _fh->tell();
+
+    uint8_t hdr[BGZF_HEADER_SIZE];
+    if (compressed_size >= BGZF_HEADER_SIZE && _fh->pread(hdr, sizeof(hdr), 0) == sizeof(hdr) && _is_bgzf(hdr))
+        return _index_bgzf(compressed_size);
+
+    // A plain gzip file ends with its size (mod 2^32), which only covers the last member,
+    // so it's taken as having just the one
+    uint8_t isize[4];
+    if (compressed_size < GZIP_HEADER_SIZE + 8 || _fh->pread(isize, sizeof(isize), compressed_size - 4) != sizeof(isize))
+        return false;
+    _restarts.push_back({0, 0});
+    _filesize = _le32(isize);
+    return true;
+}
+
+bool FileHandlerGzip::_index_bgzf(long int compressed_size)
+{
+    long int in = 0, out = 0;
+    uint8_t hdr[BGZF_HEADER_SIZE];
+    if (_fh->pread(hdr, sizeof(hdr), 0) != sizeof(hdr))
+        return false;
+
+    while (true)
+    {
+        if (!_is_bgzf(hdr))
+            return false;
+        long int bsize = (hdr[16] | (hdr[17] << 8)) + 1;
+        if (in + bsize > compressed_size)
+            return false;
+
+        // The member's ISIZE and the next member's header come in the same read
+        uint8_t buf[4 + BGZF_HEADER_SIZE];
+        size_t got = _fh->pread(buf, sizeof(buf), in + bsize - 4);
+        if (got < 4)
+            return false;
+
+        uint32_t isize = _le32(buf);
+        if (isize > 0) // bgzip ends with an empty member
+            _restarts.push_back({in, out});
+        out += isize;
+        in += bsize;
+
+        if (in == compressed_size)
+            break;
+        if (got < sizeof(buf))
+            return false;
+        memcpy(hdr, buf + 4, sizeof(hdr));
+    }
+
+    _filesize = out;
+    return true;
+}
+
+// Gets the decoder to pos in the image, restarting it if it's already past it
+bool FileHandlerGzip::_decode_to(long int pos)
+{
+    auto it = std::upper_bound(_restarts.begin(), _restarts.end(), pos,
+                               [](long int p, const restart_point &r) { return p < r.out; });
+    if (it == _restarts.begin())
+        return false;
+    --it;
+
+    if (_decoded < 0 || pos < _decoded || it->out > _decoded || _inflate.error())
+    {
+        if (!_inflate.begin(_fh, it->in))
+            return false;
+        _decoded = it->out;
+    }
+
+    uint8_t skip[512];
+    while (_decoded < pos)
+    {
+        size_t n = _inflate.read(skip, std::min((long int)sizeof(skip), pos - _decoded));
+        if (n == 0)
+            return false;
+        _decoded += n;
+    }
+    return true;
+}
+
+int FileHandlerGzip::close(bool destroy)
+{
+    int result = 0;
+    if (_fh != nullptr)
+    {
+        result = _fh->close(true);
+        _fh = nullptr;
+    }
+    if (destroy) delete this;
+    return result;
+}
+
+int FileHandlerGzip::seek(long int off, int whence)
+{
+    long int new_pos;
+    switch (whence)
+    {
+        case SEEK_SET:
+            new_pos = off;
+            break;
+        case SEEK_END:
+            new_pos = _filesize + off;
+            break;
+        case SEEK_CUR:
+            new_pos = _position + off;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+
+    if (new_pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    _position = new_pos;
+    return 0;
+}
+
+long int FileHandlerGzip::tell()
+{
+    return _position;
+}
+
+size_t FileHandlerGzip::read(void *ptr, size_t size, size_t count)
+{
+    if (size == 0 || _fh == nullptr || _position >= _filesize)
+        return 0;
+
+    size_t requested = size * count;
+    size_t available = _filesize - _position;
+    size_t to_read = available > requested ? requested : available;
+    uint8_t *dst = (uint8_t *)ptr;
+    size_t done = 0;
+
+    // Rereading what was just decoded, as the sector before the one just read
+    if (_decoded > _position && (size_t)(_decoded - _position) <= _inflate.history())
+    {
+        done = std::min(to_read, (size_t)(_decoded - _position));
+        _inflate.copy_history(dst, _decoded - _position, done);
+    }
+
+    if (done < to_read && _decode_to(_position + done))
+    {
+        size_t got = _inflate.read(dst + done, to_read - done);
+        _decoded += got;
+        done += got;
+    }
+    _position += done;
+
+    return done / size;
+}
+
+size_t FileHandlerGzip::write(const void * /*ptr*/, size_t /*size*/, size_t /*count*/)
+{
+    errno = EROFS;
+    return 0;
+}
+
+int FileHandlerGzip::flush()
+{
+    return 0;
+}
+
+int FileHandlerGzip::eof()
+{
+    return _position >= _filesize;
+}
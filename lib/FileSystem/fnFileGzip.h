@@ -0,0 +1,64 @@
+#ifndef FN_FILEGZIP_H
+#define FN_FILEGZIP_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+#include "fnFile.h"
+#include "fnInflate.h"
+
+/*
+ * FileHandlerGzip - reads a gzip compressed disk image as the image itself
+ * Only the part of the image asked for is decompressed. Seeking forward
+ * decodes and throws away what's skipped, seeking back within the last
+ * INFLATE_WINDOW_SIZE bytes is served from the decoder's window, and
+ * anything further back starts again from the nearest restart point.
+ *
+ * Images compressed with bgzip (BGZF) are a run of small independent gzip
+ * members whose compressed sizes are in their headers, so mounting one
+ * indexes every member and no sector is more than one member (64K) of
+ * decoding away. A plain gzip file has a single restart point, its start,
+ * which is fine for the mostly sequential reads of booting or loading it.
+ *
+ * The image is read-only; write() fails.
+ */
+class FileHandlerGzip : public FileHandler
+{
+protected:
+    struct restart_point
+    {
+        long int in;  // Offset of a gzip member in the compressed file
+        long int out; // Where its data starts in the image
+    };
+
+    FileHandler *_fh;
+    fnInflate _inflate;
+    std::vector<restart_point> _restarts;
+    long int _filesize = 0;
+    long int _position = 0;
+    long int _decoded = -1; // Image offset of the decoder's next byte, -1 before it's started
+
+    FileHandlerGzip(FileHandler *fh);
+
+    bool _index();
+    bool _index_bgzf(long int compressed_size);
+    bool _decode_to(long int pos);
+
+public:
+    virtual ~FileHandlerGzip() override;
+
+    // Returns a handler reading the image compressed in fh, or fh itself if it isn't gzip.
+    // Returns nullptr, having closed fh, if it is but can't be read
+    static FileHandler *wrap(FileHandler *fh);
+
+    virtual int close(bool destroy=true) override;
+    virtual int seek(long int off, int whence) override;
+    virtual long int tell() override;
+    virtual size_t read(void *ptr, size_t size, size_t count) override;
+    virtual size_t write(const void *ptr, size_t size, size_t count) override;
+    virtual int flush() override;
+    virtual int eof() override;
+};
+
+#endif // FN_FILEGZIP_H
@@ -0,0 +1,414 @@
+#include "fnFileHTTP.h"
+
+#ifndef FNIO_IS_STDIO
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#include "fnSystem.h"
+#include "fnArena.h"
+#include "httpRange.h"
+#include "../../include/debug.h"
+
+
+std::vector<FileHandlerHTTP *> FileHandlerHTTP::_streams;
+
+FileHandler *FileHandlerHTTP::start(HTTP_CLIENT_CLASS *http, fc_handle *fc, long int size, const char *mode)
+{
+    Debug_printf("FileHandlerHTTP::start - streaming %ld bytes\n", size);
+    return new FileHandlerHTTP(http, fc, size, mode);
+}
+
+FileHandlerHTTP::FileHandlerHTTP(HTTP_CLIENT_CLASS *http, fc_handle *fc, long int size, const char *mode)
+    : _http(http), _fc(fc), _mode(mode), _size(size)
+{
+    _last_data = fnSystem.millis();
+    _streams.push_back(this);
+}
+
+FileHandlerHTTP::~FileHandlerHTTP()
+{
+    if (_http != nullptr || _fh != nullptr)
+        close(false);
+}
+
+void FileHandlerHTTP::service()
+{
+    // _download() may end a stream and take it off the list
+    for (size_t i = 0; i < _streams.size();)
+    {
+        FileHandlerHTTP *s = _streams[i];
+        s->_download();
+        if (i < _streams.size() && _streams[i] == s)
+            i++;
+    }
+}
+
+// Moves one block of response data into the cache, returns false once the download has ended
+bool FileHandlerHTTP::_download()
+{
+    if (_http == nullptr)
+        return false;
+
+    int available = _http->available();
+    if (available < 0)
+    {
+        Debug_println("FileHandlerHTTP - HTTP error");
+        _fail();
+        return false;
+    }
+    if (available == 0)
+    {
+        if (_http->is_transaction_done())
+        {
+            if (_fc->size < _size)
+            {
+                Debug_printf("FileHandlerHTTP - response ended after %d of %ld bytes\n", _fc->size, _size);
+                _fail();
+            }
+            else
+                _finish();
+            return false;
+        }
+        if (fnSystem.millis() - _last_data > HTTP_STREAM_TIMEOUT)
+        {
+            Debug_println("FileHandlerHTTP - Timeout");
+            _fail();
+            return false;
+        }
+        return true;
+    }
+
+    uint8_t buf[HTTP_STREAM_BLOCK_SIZE];
+    int to_read = std::min(available, HTTP_STREAM_BLOCK_SIZE);
+    int from_read = _http->read(buf, to_read);
+    if (from_read <= 0)
+    {
+        Debug_println("FileHandlerHTTP - HTTP read failed");
+        _fail();
+        return false;
+    }
+
+    // Reads may have moved the cache file position
+    _fc->fh->seek(_fc->size, SEEK_SET);
+    if (FileCache::write(_fc, buf, from_read) < (size_t)from_read)
+    {
+        Debug_println("FileHandlerHTTP - Cache write failed");
+        _fail();
+        return false;
+    }
+    _last_data = fnSystem.millis();
+
+    if (_fc->size >= _size)
+    {
+        _finish();
+        return false;
+    }
+    return true;
+}
+
+// Downloads until the first end bytes are in, returns false if they never will be
+bool FileHandlerHTTP::_download_to(long int end)
+{
+    while (_downloaded() < end)
+    {
+        long int before = _downloaded();
+        if (!_download())
+            return _downloaded() >= end;
+        if (_downloaded() == before)
+            fnSystem.delay(5); // wait for more data
+    }
+    return true;
+}
+
+// Whole file is in, switch over to the finished cache file
+void FileHandlerHTTP::_finish()
+{
+    Debug_printf("FileHandlerHTTP - %ld bytes downloaded\n", _size);
+    delete _http;
+    _http = nullptr;
+    _fh = FileCache::reopen(_fc, _mode.c_str());
+    _fc = nullptr;
+    _streams.erase(std::remove(_streams.begin(), _streams.end(), this), _streams.end());
+}
+
+// Drop the download and the partial cache file, so it's not taken for a complete one later
+void FileHandlerHTTP::_fail()
+{
+    delete _http;
+    _http = nullptr;
+    FileCache::remove(_fc);
+    _fc = nullptr;
+    _streams.erase(std::remove(_streams.begin(), _streams.end(), this), _streams.end());
+}
+
+int FileHandlerHTTP::close(bool destroy)
+{
+    int result = 0;
+    if (_http != nullptr)
+        _fail();
+    if (_fh != nullptr)
+    {
+        result = _fh->close(true);
+        _fh = nullptr;
+    }
+    if (destroy) delete this;
+    return result;
+}
+
+int FileHandlerHTTP::seek(long int off, int whence)
+{
+    long int new_pos;
+    switch (whence)
+    {
+        case SEEK_SET:
+            new_pos = off;
+            break;
+        case SEEK_END:
+            new_pos = _size + off;
+            break;
+        case SEEK_CUR:
+            new_pos = _position + off;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+
+    if (new_pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    _position = new_pos;
+    return 0;
+}
+
+long int FileHandlerHTTP::tell()
+{
+    return _position;
+}
+
+size_t FileHandlerHTTP::read(void *ptr, size_t size, size_t count)
+{
+    if (size == 0 || _position >= _size)
+        return 0;
+
+    long int end = std::min(_position + (long int)(size * count), _size);
+    if (!_download_to(end))
+    {
+        errno = EIO;
+        return 0;
+    }
+
+    FileHandler *fh = _fh != nullptr ? _fh : _fc->fh;
+    if (fh->seek(_position, SEEK_SET) != 0)
+        return 0;
+    size_t n = fh->read(ptr, 1, (end - _position) / size * size);
+    _position += n;
+    return n / size;
+}
+
+size_t FileHandlerHTTP::write(const void *ptr, size_t size, size_t count)
+{
+    // Writes go to the finished cache file
+    if (!_download_to(_size) || _fh == nullptr)
+    {
+        errno = EIO;
+        return 0;
+    }
+
+    if (_fh->seek(_position, SEEK_SET) != 0)
+        return 0;
+    size_t n = _fh->write(ptr, size, count);
+    _position += n * size;
+    return n;
+}
+
+int FileHandlerHTTP::flush()
+{
+    return _fh != nullptr ? _fh->flush() : 0;
+}
+
+
+FileHandler *FileHandlerHTTPRange::open(const std::string &url, long int size)
+{
+    Debug_printf("FileHandlerHTTPRange::open - %ld bytes, reading blocks on demand\n", size);
+    return new FileHandlerHTTPRange(url, size);
+}
+
+FileHandlerHTTPRange::FileHandlerHTTPRange(const std::string &url, long int size)
+    : _url(url), _size(size)
+{
+}
+
+FileHandlerHTTPRange::~FileHandlerHTTPRange()
+{
+    close(false);
+}
+
+// Cached block, fetching it into the least recently used slot if need be
+FileHandlerHTTPRange::block *FileHandlerHTTPRange::_get_block(uint32_t index)
+{
+    block *slot = nullptr;
+    for (block &b : _blocks)
+    {
+        if (b.index == index)
+        {
+            b.used = fnSystem.millis();
+            return &b;
+        }
+        if (slot == nullptr || b.used < slot->used)
+            slot = &b;
+    }
+
+    if (_blocks.size() < HTTP_RANGE_CACHE_BLOCKS)
+    {
+        uint8_t *data = (uint8_t *)fnArena.malloc(ARENA_NETWORK, HTTP_RANGE_BLOCK_SIZE);
+        if (data != nullptr)
+        {
+            _blocks.push_back({0, 0, 0, data});
+            slot = &_blocks.back();
+        }
+    }
+    if (slot == nullptr)
+        return nullptr;
+
+    slot->index = index;
+    slot->used = fnSystem.millis();
+    if (!_fetch(*slot))
+    {
+        slot->used = 0; // reuse this slot first
+        slot->index = UINT32_MAX;
+        return nullptr;
+    }
+    return slot;
+}
+
+// Fetches b.index with a range request
+bool FileHandlerHTTPRange::_fetch(block &b)
+{
+    long int offset = (long int)b.index * HTTP_RANGE_BLOCK_SIZE;
+    b.len = std::min((long int)HTTP_RANGE_BLOCK_SIZE, _size - offset);
+
+    HTTP_CLIENT_CLASS http;
+    if (!http.begin(_url))
+        return false;
+    http.set_header("Range", http_range_value(offset, offset + b.len - 1).c_str());
+
+    int status = http.GET();
+    // A server ignoring the range sends the whole file, which still starts with block 0
+    if (status != 206 && !(status == 200 && offset == 0))
+    {
+        Debug_printf("FileHandlerHTTPRange - block %u request failed, status %d\n", b.index, status);
+        return false;
+    }
+
+    size_t got = 0;
+    uint64_t last_data = fnSystem.millis();
+    while (got < b.len)
+    {
+        int available = http.available();
+        if (available < 0 || (available == 0 && http.is_transaction_done()))
+            break;
+        if (available == 0)
+        {
+            if (fnSystem.millis() - last_data > HTTP_STREAM_TIMEOUT)
+                break;
+            fnSystem.delay(5);
+            continue;
+        }
+        int from_read = http.read(b.data + got, std::min((size_t)available, b.len - got));
+        if (from_read <= 0)
+            break;
+        got += from_read;
+        last_data = fnSystem.millis();
+    }
+
+    if (got < b.len)
+    {
+        Debug_printf("FileHandlerHTTPRange - block %u short, %u of %u bytes\n", b.index, (unsigned)got, (unsigned)b.len);
+        return false;
+    }
+    return true;
+}
+
+int FileHandlerHTTPRange::close(bool destroy)
+{
+    for (block &b : _blocks)
+        fnArena.free(ARENA_NETWORK, b.data);
+    _blocks.clear();
+    if (destroy) delete this;
+    return 0;
+}
+
+int FileHandlerHTTPRange::seek(long int off, int whence)
+{
+    long int new_pos;
+    switch (whence)
+    {
+        case SEEK_SET:
+            new_pos = off;
+            break;
+        case SEEK_END:
+            new_pos = _size + off;
+            break;
+        case SEEK_CUR:
+            new_pos = _position + off;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+
+    if (new_pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    _position = new_pos;
+    return 0;
+}
+
+long int FileHandlerHTTPRange::tell()
+{
+    return _position;
+}
+
+size_t FileHandlerHTTPRange::read(void *ptr, size_t size, size_t count)
+{
+    if (size == 0 || _position >= _size)
+        return 0;
+
+    long int end = std::min(_position + (long int)(size * count), _size);
+    end = _position + (end - _position) / size * size;
+    uint8_t *dst = (uint8_t *)ptr;
+    long int start = _position;
+    while (_position < end)
+    {
+        block *b = _get_block(_position / HTTP_RANGE_BLOCK_SIZE);
+        if (b == nullptr)
+        {
+            errno = EIO;
+            break;
+        }
+        size_t in_block = _position % HTTP_RANGE_BLOCK_SIZE;
+        size_t len = std::min((long int)(b->len - in_block), end - _position);
+        memcpy(dst, b->data + in_block, len);
+        dst += len;
+        _position += len;
+    }
+    return (_position - start) / size;
+}
+
+size_t FileHandlerHTTPRange::write(const void *ptr, size_t size, size_t count)
+{
+    // HTTP hosts are read-only
+    errno = EROFS;
+    return 0;
+}
+
+#endif //!FNIO_IS_STDIO
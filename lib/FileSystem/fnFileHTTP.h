@@ -0,0 +1,126 @@
+#ifndef FN_FILEHTTP_H
+#define FN_FILEHTTP_H
+
+#include "fnio.h"
+
+#ifndef FNIO_IS_STDIO
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifdef ESP_PLATFORM
+#include "fnHttpClient.h"
+#define HTTP_CLIENT_CLASS fnHttpClient
+#else
+#include "mgHttpClient.h"
+#define HTTP_CLIENT_CLASS mgHttpClient
+#endif
+
+#include "fnFile.h"
+#include "fnFileCache.h"
+
+// Most response data moved into the cache per service() call
+#define HTTP_STREAM_BLOCK_SIZE 1024
+// Give up on a download that stalls this long
+#define HTTP_STREAM_TIMEOUT 20000
+
+// Files at least this big are read a block at a time with range requests when the server allows it
+#define HTTP_RANGE_MIN_SIZE 262144
+// Unit fetched with a range request
+#define HTTP_RANGE_BLOCK_SIZE 4096
+// Blocks kept in memory, least recently used ones are dropped first
+#define HTTP_RANGE_CACHE_BLOCKS 16
+
+/*
+ * FileHandlerHTTP - a file being downloaded into the file cache
+ * Handed out as soon as the response headers are in, so a mount doesn't wait
+ * for the whole image. FileHandlerHTTP::service() in the main loop keeps the
+ * download going; a read of bytes that haven't arrived yet downloads up to
+ * them on the spot. Once complete, everything goes to the finished cache file.
+ */
+class FileHandlerHTTP : public FileHandler
+{
+protected:
+    HTTP_CLIENT_CLASS *_http; // null once the download has ended
+    fc_handle *_fc;           // cache file being filled, null once the download has ended
+    FileHandler *_fh = nullptr; // finished cache file
+    std::string _mode;
+    long int _size;
+    long int _position = 0;
+    uint64_t _last_data;
+
+    static std::vector<FileHandlerHTTP *> _streams;
+
+    FileHandlerHTTP(HTTP_CLIENT_CLASS *http, fc_handle *fc, long int size, const char *mode);
+
+    bool _download();
+    bool _download_to(long int end);
+    void _finish();
+    void _fail();
+    // Bytes downloaded so far
+    long int _downloaded() { return _fh != nullptr ? _size : (_fc != nullptr ? _fc->size : 0); };
+
+public:
+    virtual ~FileHandlerHTTP() override;
+
+    // Takes over http, whose GET response headers are in, and fc, the cache file to fill with size bytes
+    static FileHandler *start(HTTP_CLIENT_CLASS *http, fc_handle *fc, long int size, const char *mode);
+    // Moves a block of every running download into its cache file; call from the main loop
+    static void service();
+    // Whether a download is running
+    static bool busy() { return !_streams.empty(); };
+
+    virtual int close(bool destroy=true) override;
+    virtual int seek(long int off, int whence) override;
+    virtual long int tell() override;
+    virtual size_t read(void *ptr, size_t size, size_t count) override;
+    virtual size_t write(const void *ptr, size_t size, size_t count) override;
+    virtual int flush() override;
+};
+
+/*
+ * FileHandlerHTTPRange - read-only file on a server that takes range requests
+ * Nothing is downloaded up front; each read fetches the HTTP_RANGE_BLOCK_SIZE
+ * aligned blocks it needs into a small LRU cache, so random access to a large
+ * image only transfers the sectors actually used.
+ */
+class FileHandlerHTTPRange : public FileHandler
+{
+protected:
+    struct block
+    {
+        uint32_t index;
+        uint64_t used;
+        size_t len;
+        uint8_t *data;
+    };
+
+    std::string _url;
+    long int _size;
+    long int _position = 0;
+    std::vector<block> _blocks;
+
+    FileHandlerHTTPRange(const std::string &url, long int size);
+
+    block *_get_block(uint32_t index);
+    bool _fetch(block &b);
+
+public:
+    virtual ~FileHandlerHTTPRange() override;
+
+    // url must advertise "Accept-Ranges: bytes" and be size bytes long
+    static FileHandler *open(const std::string &url, long int size);
+
+    virtual int close(bool destroy=true) override;
+    virtual int seek(long int off, int whence) override;
+    virtual long int tell() override;
+    virtual size_t read(void *ptr, size_t size, size_t count) override;
+    virtual size_t write(const void *ptr, size_t size, size_t count) override;
+    virtual int flush() override { return 0; };
+};
+
+#endif //!FNIO_IS_STDIO
+
+#endif // FN_FILEHTTP_H
@@ -3,10 +3,11 @@
 #include <string.h>
 
 #include "fnFileMem.h"
+#include "fnArena.h"
 #include "../../include/debug.h"
 
 
-FileHandlerMem::FileHandlerMem() : _buffer(nullptr), _size(0), _filesize(0), _position(0)
+FileHandlerMem::FileHandlerMem() : _filesize(0), _position(0)
 {
 //    Debug_println("new FileHandlerMem");
 };
@@ -15,7 +16,8 @@ FileHandlerMem::FileHandlerMem() : _buffer(nullptr), _size(0), _filesize(0), _po
 FileHandlerMem::~FileHandlerMem()
 {
 //    Debug_println("delete FileHandlerMem");
-    free(_buffer);
+    for (uint8_t *chunk : _chunks)
+        fnArena.free(ARENA_MEDIA, chunk);
 }
 
 
@@ -38,7 +40,7 @@ int FileHandlerMem::seek(long int off, int whence)
             new_pos = off;
             break;
         case SEEK_END:
-            new_pos = _filesize - off;
+            new_pos = _filesize + off;
             break;
         case SEEK_CUR:
             new_pos = _position + off;
@@ -73,21 +75,41 @@ long int FileHandlerMem::tell()
 }
 
 
+const uint8_t *FileHandlerMem::peek(long int pos, size_t *len)
+{
+    if (pos < 0 || pos >= _filesize)
+    {
+        *len = 0;
+        return nullptr;
+    }
+    long int in_chunk = pos % FILEMEM_CHUNK_SIZE;
+    long int left = FILEMEM_CHUNK_SIZE - in_chunk;
+    *len = (size_t)(left < _filesize - pos ? left : _filesize - pos);
+    return _chunks[pos / FILEMEM_CHUNK_SIZE] + in_chunk;
+}
+
+
 size_t FileHandlerMem::read(void *ptr, size_t size, size_t count)
 {
 //    Debug_println("FileHandlerMem::read");
 
     size_t requested = size * count;
-    size_t available = _filesize - _position;
-    size_t to_read = available > requested ? requested : available;
+    size_t done = 0;
 
-    if (to_read)
+    while (done < requested)
     {
-        memcpy(ptr, (void *)(_buffer + _position), to_read);
-        _position += to_read;
+        size_t len;
+        const uint8_t *src = peek(_position, &len);
+        if (src == nullptr)
+            break;
+        if (len > requested - done)
+            len = requested - done;
+        memcpy((uint8_t *)ptr + done, src, len);
+        _position += len;
+        done += len;
     }
 
-    return (size_t)(size * count == to_read ? count : to_read / size);
+    return (size_t)(requested == done ? count : done / size);
 }
 
 
@@ -96,25 +118,27 @@ size_t FileHandlerMem::write(const void *ptr, size_t size, size_t count)
 //    Debug_println("FileHandlerMem::write");
 
     size_t requested = size * count;
-    size_t available = _size - _position;
+    if (requested == 0)
+        return 0;
 
-    if (available < requested)
-    {
-        if (grow(_position + requested) < 0)
-            return 0;
-        available = _size - _position;
-    }
+    if (_reserve(_position + requested) < 0)
+        return 0;
 
-    size_t to_write = available > requested ? requested : available;
-    if (to_write)
+    size_t done = 0;
+    while (done < requested)
     {
-        memcpy((void *)(_buffer + _position), ptr, to_write);
-        _position += to_write;
-        if (_filesize < _position)
-            _filesize = _position;
+        long int in_chunk = _position % FILEMEM_CHUNK_SIZE;
+        size_t len = FILEMEM_CHUNK_SIZE - in_chunk;
+        if (len > requested - done)
+            len = requested - done;
+        memcpy(_chunks[_position / FILEMEM_CHUNK_SIZE] + in_chunk, (const uint8_t *)ptr + done, len);
+        _position += len;
+        done += len;
     }
+    if (_filesize < _position)
+        _filesize = _position;
 
-    return (size_t)(size * count == to_write ? count : to_write / size);
+    return count;
 }
 
 
@@ -124,34 +148,49 @@ int FileHandlerMem::flush()
     return 0;
 }
 
-// set new file size, allocate additional buffer space, if needed
-// (smaller than current file size can be set but it does not shrink allocated buffer)
-// return 0 on success, -1 on failure
-int FileHandlerMem::grow(long filesize)
+// allocate chunks until size bytes fit, return 0 on success, -1 on failure
+int FileHandlerMem::_reserve(long int size)
 {
-    long bufsize = 1024 * ((filesize + 1023) / 1024);
-//    Debug_printf("FileHandlerMem::grow - file size / buffer size: %ld / %ld\n", filesize, bufsize > _size ? bufsize : _size);
-    // grow buffer, if needed
-    if (bufsize > _size)
+    if (size > FILEMEM_MAXSIZE)
     {
-        if (_size >= FILEMEM_MAXSIZE)
+        Debug_println("FileHandlerMem::grow - failed, max size reached");
+        errno = EFBIG;
+        return -1;
+    }
+    while (_capacity() < size)
+    {
+        // PSRAM only: a megabyte of cache file in internal RAM would starve WiFi and TLS
+        uint8_t *chunk = (uint8_t *)fnArena.malloc_psram(ARENA_MEDIA, FILEMEM_CHUNK_SIZE);
+        if (chunk == nullptr)
         {
-            Debug_println("FileHandlerMem::grow - failed, max buffer size reached");
-            errno = EFBIG;
+            Debug_println("FileHandlerMem::grow - failed to allocate chunk");
+            errno = ENOMEM;
             return -1;
         }
-#ifdef ESP_PLATFORM
-        void *new_buf = heap_caps_realloc(_buffer, bufsize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-#else
-        void *new_buf = realloc(_buffer, bufsize);
-#endif
-        if (new_buf == nullptr) 
+        _chunks.push_back(chunk);
+    }
+    return 0;
+}
+
+// set new file size, allocate additional chunks, if needed
+// (smaller than current file size can be set but it does not free any chunks)
+// return 0 on success, -1 on failure
+int FileHandlerMem::grow(long filesize)
+{
+    if (_reserve(filesize) < 0)
+        return -1;
+    // The gap a seek past the end leaves reads as zeroes, as in a file
+    if (filesize > _filesize)
+    {
+        for (long int pos = _filesize; pos < filesize; )
         {
-            Debug_println("FileHandlerMem::grow - failed to reallocate buffer");
-            return -1;
-        } 
-        _buffer = (uint8_t *)new_buf;
-        _size = bufsize;
+            long int in_chunk = pos % FILEMEM_CHUNK_SIZE;
+            long int len = FILEMEM_CHUNK_SIZE - in_chunk;
+            if (len > filesize - pos)
+                len = filesize - pos;
+            memset(_chunks[pos / FILEMEM_CHUNK_SIZE] + in_chunk, 0, len);
+            pos += len;
+        }
     }
     // set new file size
     _filesize = filesize;
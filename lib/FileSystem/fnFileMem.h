@@ -3,18 +3,29 @@
 
 #include <stdint.h>
 #include <cstddef>
+#include <vector>
 
 #include "fnFile.h"
 
 #define FILEMEM_MAXSIZE   1048576
+// Unit the file grows by; each chunk is allocated once and never moved
+#define FILEMEM_CHUNK_SIZE 16384
 
+/*
+ * FileHandlerMem - a file in (PSRAM) memory, kept as a list of fixed size
+ * chunks from the media arena. Growing it adds chunks instead of
+ * reallocating and copying what's there, so appending costs the same
+ * however large the file already is.
+ */
 class FileHandlerMem : public FileHandler
 {
 protected:
-    uint8_t *_buffer;
-    long int _size;
+    std::vector<uint8_t *> _chunks;
     long int _filesize;
     long int _position;
+
+    long int _capacity() { return (long int)_chunks.size() * FILEMEM_CHUNK_SIZE; };
+    int _reserve(long int size);
 public:
     FileHandlerMem();
     virtual ~FileHandlerMem() override;
@@ -27,6 +38,9 @@ public:
     virtual int flush() override;
 
     int grow(long filesize);
+
+    // Contents at pos without copying, and how many bytes follow it in the same chunk
+    const uint8_t *peek(long int pos, size_t *len);
 };
 
 #endif // FN_FILEMEM_H
@@ -0,0 +1,266 @@
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+#include "fnFilePreload.h"
+#include "fnSystem.h"
+#include "../../include/debug.h"
+
+
+std::vector<FileHandlerPreload *> FileHandlerPreload::_preloads;
+
+FileHandler *FileHandlerPreload::wrap(FileHandler *fh, long int filesize)
+{
+    if (fh == nullptr || filesize <= 0 || filesize > PRELOAD_MAX_SIZE)
+        return fh;
+
+#ifdef ESP_PLATFORM
+    // Only worth it with PSRAM; internal RAM is too precious
+    uint8_t *buffer = (uint8_t *)heap_caps_malloc(filesize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+    uint8_t *buffer = (uint8_t *)malloc(filesize);
+#endif
+    if (buffer == nullptr)
+    {
+        Debug_printf("FileHandlerPreload::wrap - no room for %ld bytes, using file directly\n", filesize);
+        return fh;
+    }
+
+    Debug_printf("FileHandlerPreload::wrap - preloading %ld bytes\n", filesize);
+    return new FileHandlerPreload(fh, buffer, filesize);
+}
+
+FileHandlerPreload::FileHandlerPreload(FileHandler *fh, uint8_t *buffer, long int filesize)
+    : _fh(fh), _buffer(buffer), _filesize(filesize)
+{
+    _loaded.resize(_block_count(), false);
+    _dirty.resize(_block_count(), false);
+    _preloads.push_back(this);
+}
+
+FileHandlerPreload::~FileHandlerPreload()
+{
+    if (_fh != nullptr)
+        close(false);
+    free(_buffer);
+}
+
+void FileHandlerPreload::service()
+{
+    uint64_t now = fnSystem.millis();
+    for (FileHandlerPreload *p : _preloads)
+    {
+        // One block per call keeps the bus responsive
+        if (p->_blocks_loaded < p->_block_count())
+        {
+            while (p->_next_load < p->_block_count() && p->_loaded[p->_next_load])
+                p->_next_load++;
+            if (p->_next_load < p->_block_count() && !p->_load_block(p->_next_load))
+                p->_next_load++; // Leave it to the next read to retry and report the error
+            if (p->_blocks_loaded == p->_block_count())
+                Debug_printf("FileHandlerPreload - %ld bytes loaded\n", p->_filesize);
+        }
+        else if (p->_blocks_dirty > 0 && now - p->_dirty_since >= PRELOAD_WRITEBACK_MS)
+        {
+            for (uint32_t b = 0; b < p->_block_count(); b++)
+            {
+                if (p->_dirty[b])
+                {
+                    p->_write_block(b);
+                    break;
+                }
+            }
+            if (p->_blocks_dirty == 0)
+                p->_fh->flush();
+        }
+    }
+}
+
+bool FileHandlerPreload::busy()
+{
+    uint64_t now = fnSystem.millis();
+    for (FileHandlerPreload *p : _preloads)
+    {
+        if (p->_next_load < p->_block_count() ||
+            (p->_blocks_dirty > 0 && now - p->_dirty_since >= PRELOAD_WRITEBACK_MS))
+            return true;
+    }
+    return false;
+}
+
+bool FileHandlerPreload::_load_block(uint32_t block)
+{
+    long int offset = (long int)block * PRELOAD_BLOCK_SIZE;
+    size_t len = std::min((long int)PRELOAD_BLOCK_SIZE, _filesize - offset);
+
+    if (_fh->seek(offset, SEEK_SET) != 0 || _fh->read(_buffer + offset, 1, len) != len)
+    {
+        Debug_printf("FileHandlerPreload - failed to load block %u\n", block);
+        return false;
+    }
+    _loaded[block] = true;
+    _blocks_loaded++;
+    return true;
+}
+
+bool FileHandlerPreload::_write_block(uint32_t block)
+{
+    long int offset = (long int)block * PRELOAD_BLOCK_SIZE;
+    size_t len = std::min((long int)PRELOAD_BLOCK_SIZE, _filesize - offset);
+
+    // Whether or not it makes it, the block isn't waiting any more
+    _dirty[block] = false;
+    _blocks_dirty--;
+
+    if (_fh->seek(offset, SEEK_SET) != 0 || _fh->write(_buffer + offset, 1, len) != len)
+    {
+        Debug_printf("FileHandlerPreload - failed to write back block %u\n", block);
+        return false;
+    }
+    return true;
+}
+
+// Makes sure the blocks covering the range are in memory
+bool FileHandlerPreload::_load_range(long int start, size_t len)
+{
+    if (len == 0)
+        return true;
+    uint32_t last = (start + len - 1) / PRELOAD_BLOCK_SIZE;
+    for (uint32_t b = start / PRELOAD_BLOCK_SIZE; b <= last; b++)
+    {
+        if (!_loaded[b] && !_load_block(b))
+        {
+            errno = EIO;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Writes back every changed block, returns 0 on success
+int FileHandlerPreload::_write_back()
+{
+    int result = 0;
+    for (uint32_t b = 0; _blocks_dirty > 0 && b < _block_count(); b++)
+    {
+        if (_dirty[b] && !_write_block(b))
+            result = -1;
+    }
+    if (_fh->flush() != 0)
+        result = -1;
+    return result;
+}
+
+int FileHandlerPreload::close(bool destroy)
+{
+    int result = 0;
+    if (_fh != nullptr)
+    {
+        if (_blocks_dirty > 0)
+            result = _write_back();
+        if (_fh->close(true) != 0)
+            result = -1;
+        _fh = nullptr;
+        _preloads.erase(std::remove(_preloads.begin(), _preloads.end(), this), _preloads.end());
+    }
+    if (destroy) delete this;
+    return result;
+}
+
+int FileHandlerPreload::seek(long int off, int whence)
+{
+    long int new_pos;
+    switch (whence)
+    {
+        case SEEK_SET:
+            new_pos = off;
+            break;
+        case SEEK_END:
+            new_pos = _filesize + off;
+            break;
+        case SEEK_CUR:
+            new_pos = _position + off;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+
+    if (new_pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    _position = new_pos;
+    return 0;
+}
+
+long int FileHandlerPreload::tell()
+{
+    return _position;
+}
+
+size_t FileHandlerPreload::read(void *ptr, size_t size, size_t count)
+{
+    if (size == 0 || _position >= _filesize)
+        return 0;
+
+    size_t requested = size * count;
+    size_t available = _filesize - _position;
+    size_t to_read = available > requested ? requested : available;
+
+    if (!_load_range(_position, to_read))
+        return 0;
+
+    memcpy(ptr, _buffer + _position, to_read);
+    _position += to_read;
+
+    return to_read / size;
+}
+
+// Images don't grow, so writes past the end are cut short
+size_t FileHandlerPreload::write(const void *ptr, size_t size, size_t count)
+{
+    if (size == 0 || _position >= _filesize)
+        return 0;
+
+    size_t requested = size * count;
+    size_t available = _filesize - _position;
+    size_t to_write = available > requested ? requested : available;
+
+    // Partly written blocks need the rest of their contents first
+    if (!_load_range(_position, to_write))
+        return 0;
+
+    memcpy(_buffer + _position, ptr, to_write);
+
+    if (_blocks_dirty == 0)
+        _dirty_since = fnSystem.millis();
+    uint32_t last = (_position + to_write - 1) / PRELOAD_BLOCK_SIZE;
+    for (uint32_t b = _position / PRELOAD_BLOCK_SIZE; b <= last; b++)
+    {
+        if (!_dirty[b])
+        {
+            _dirty[b] = true;
+            _blocks_dirty++;
+        }
+    }
+    _position += to_write;
+
+    return to_write / size;
+}
+
+// Memory is always current; flush() is where changes are made durable
+int FileHandlerPreload::flush()
+{
+    if (_fh == nullptr)
+        return -1;
+    return _blocks_dirty > 0 ? _write_back() : 0;
+}
@@ -0,0 +1,66 @@
+#ifndef FN_FILEPRELOAD_H
+#define FN_FILEPRELOAD_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+#include "fnFile.h"
+
+// Unit the image is loaded and written back in
+#define PRELOAD_BLOCK_SIZE 1024
+// Largest image we'll try to hold in memory
+#define PRELOAD_MAX_SIZE (16 * 1024 * 1024)
+// How long a changed block may wait before it's written back to the real file
+#define PRELOAD_WRITEBACK_MS 500
+
+/*
+ * FileHandlerPreload - keeps a whole disk image in (PSRAM) memory
+ * The image is copied in a block at a time from FileHandlerPreload::service()
+ * in the main loop; anything read before it has arrived is loaded on the spot.
+ * Writes go to memory and are written back to the real file from service(),
+ * or straight away by flush() and close().
+ */
+class FileHandlerPreload : public FileHandler
+{
+protected:
+    FileHandler *_fh;
+    uint8_t *_buffer;
+    long int _filesize;
+    long int _position = 0;
+    std::vector<bool> _loaded;
+    std::vector<bool> _dirty;
+    uint32_t _blocks_loaded = 0;
+    uint32_t _next_load = 0;
+    uint32_t _blocks_dirty = 0;
+    uint64_t _dirty_since = 0;
+
+    static std::vector<FileHandlerPreload *> _preloads;
+
+    FileHandlerPreload(FileHandler *fh, uint8_t *buffer, long int filesize);
+
+    bool _load_block(uint32_t block);
+    bool _write_block(uint32_t block);
+    bool _load_range(long int start, size_t len);
+    int _write_back();
+    uint32_t _block_count() { return (_filesize + PRELOAD_BLOCK_SIZE - 1) / PRELOAD_BLOCK_SIZE; };
+
+public:
+    virtual ~FileHandlerPreload() override;
+
+    // Returns a preloading handler taking over fh, or fh itself if there isn't room for the image
+    static FileHandler *wrap(FileHandler *fh, long int filesize);
+    // Does a little background loading and write-back for every open preload; call from the main loop
+    static void service();
+    // Whether service() has loading or an overdue write-back to get on with
+    static bool busy();
+
+    virtual int close(bool destroy=true) override;
+    virtual int seek(long int off, int whence) override;
+    virtual long int tell() override;
+    virtual size_t read(void *ptr, size_t size, size_t count) override;
+    virtual size_t write(const void *ptr, size_t size, size_t count) override;
+    virtual int flush() override;
+};
+
+#endif // FN_FILEPRELOAD_H
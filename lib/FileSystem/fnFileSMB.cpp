@@ -1,15 +1,218 @@
-
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#define poll WSAPoll
+#elif defined(ESP_PLATFORM)
+#include <sys/poll.h>
+#else
+#include <poll.h>
+#endif
 
 #include "fnFileSMB.h"
+#include "fnArena.h"
 #include "../../include/debug.h"
 
 
+SMBReadahead::SMBReadahead(struct smb2_context *smb, struct smb2fh *fh)
+{
+    _smb = smb;
+    _fh = fh;
+
+    _chunk = SMB_READAHEAD_CHUNK;
+    uint32_t max_read = smb2_get_max_read_size(smb);
+    if (max_read > 0 && max_read < _chunk)
+        _chunk = max_read;
+
+    _slots = new slot[SMB_READAHEAD_DEPTH];
+    for (int i = 0; i < SMB_READAHEAD_DEPTH; i++)
+        _slots[i].buf = (uint8_t *)fnArena.malloc(ARENA_NETWORK, _chunk);
+}
+
+
+SMBReadahead::~SMBReadahead()
+{
+    invalidate();
+
+    // A READ that never finished still has its buffer, leak the lot rather
+    // than have a late reply land in freed memory
+    for (int i = 0; i < SMB_READAHEAD_DEPTH; i++)
+    {
+        if (_slots[i].busy)
+        {
+            Debug_println("SMBReadahead - READ still in flight, leaving its buffers");
+            return;
+        }
+    }
+
+    for (int i = 0; i < SMB_READAHEAD_DEPTH; i++)
+        fnArena.free(ARENA_NETWORK, _slots[i].buf);
+    delete[] _slots;
+}
+
+
+void SMBReadahead::_read_cb(struct smb2_context *smb, int status, void *command_data, void *cb_data)
+{
+    slot *s = (slot *)cb_data;
+    s->status = status;
+    s->done = true;
+}
+
+
+SMBReadahead::slot *SMBReadahead::_find(uint64_t offset)
+{
+    for (int i = 0; i < SMB_READAHEAD_DEPTH; i++)
+    {
+        slot *s = &_slots[i];
+        if (s->busy && offset >= s->offset && offset < s->offset + _chunk)
+            return s;
+    }
+    return nullptr;
+}
+
+
+void SMBReadahead::_issue()
+{
+    int in_use = 0;
+    for (int i = 0; i < SMB_READAHEAD_DEPTH; i++)
+        if (_slots[i].busy)
+            in_use++;
+
+    for (int i = 0; i < SMB_READAHEAD_DEPTH && in_use < _depth && !_eof; i++)
+    {
+        slot *s = &_slots[i];
+        if (s->busy || s->buf == nullptr)
+            continue;
+
+        s->offset = _next;
+        s->status = 0;
+        s->done = false;
+        s->busy = true;
+        if (smb2_pread_async(_smb, _fh, s->buf, _chunk, _next, _read_cb, s) < 0)
+        {
+            Debug_printf("SMBReadahead - %s\n", smb2_get_error(_smb));
+            s->busy = false;
+            break;
+        }
+        _next += _chunk;
+        in_use++;
+    }
+}
+
+
+bool smb_wait(struct smb2_context *smb, const bool *done)
+{
+    time_t start = time(nullptr);
+
+    // Other replies that come in meanwhile are handed to their own callbacks
+    while (!*done)
+    {
+        struct pollfd pfd;
+        pfd.fd = smb2_get_fd(smb);
+        pfd.events = smb2_which_events(smb);
+        pfd.revents = 0;
+
+        if (poll(&pfd, 1, 1000) < 0)
+            return false;
+        if (pfd.revents == 0)
+        {
+            if (time(nullptr) - start > SMB_REPLY_TIMEOUT)
+            {
+                Debug_println("smb_wait - timed out");
+                return false;
+            }
+            continue;
+        }
+        if (smb2_service(smb, pfd.revents) < 0)
+        {
+            Debug_printf("smb_wait - %s\n", smb2_get_error(smb));
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void SMBReadahead::invalidate()
+{
+    for (int i = 0; i < SMB_READAHEAD_DEPTH; i++)
+    {
+        slot *s = &_slots[i];
+        if (s->busy && (s->done || smb_wait(_smb, &s->done)))
+            s->busy = false;
+    }
+    _eof = false;
+}
+
+
+int SMBReadahead::pread(uint8_t *buf, uint32_t count, uint64_t offset)
+{
+    uint32_t total = 0;
+
+    while (total < count)
+    {
+        slot *s = _find(offset);
+        if (s == nullptr)
+        {
+            // Not where we were reading, start the window over from here
+            invalidate();
+            _depth = 1;
+            _next = offset;
+            _issue();
+            if ((s = _find(offset)) == nullptr)
+                return total > 0 ? total : -EIO;
+        }
+
+        if (!s->done && !smb_wait(_smb, &s->done))
+            return total > 0 ? total : -EIO;
+
+        if (s->status < 0)
+        {
+            int err = s->status;
+            s->busy = false;
+            _eof = false;
+            return total > 0 ? total : err;
+        }
+
+        uint64_t end = s->offset + s->status;
+        if (offset >= end)
+            break; // End of file
+
+        uint32_t n = end - offset;
+        if (n > count - total)
+            n = count - total;
+        memcpy(buf + total, s->buf + (offset - s->offset), n);
+        total += n;
+        offset += n;
+
+        // Read to the end of a slot, the reader is going on so send more ahead
+        if (offset == end)
+        {
+            s->busy = false;
+            if ((uint32_t)s->status < _chunk)
+            {
+                _eof = true;
+                break;
+            }
+            if (_depth < SMB_READAHEAD_DEPTH)
+                _depth *= 2;
+        }
+        _issue();
+    }
+
+    return total;
+}
+
+
 FileHandlerSMB::FileHandlerSMB(struct smb2_context *smb, struct smb2fh *handle)
 {
     Debug_println("new FileHandlerSMB");
     _smb = smb;
     _handle = handle;
+    _readahead = new SMBReadahead(smb, handle);
 };
 
 
@@ -26,6 +229,8 @@ int FileHandlerSMB::close(bool destroy)
     int result = 0;
     if (_handle != nullptr) 
     {
+        delete _readahead;
+        _readahead = nullptr;
         result = smb2_close(_smb, _handle);
         _handle = nullptr;
         _smb = nullptr;
@@ -39,11 +244,16 @@ int FileHandlerSMB::seek(long int off, int whence)
 {
     Debug_println("FileHandlerSMB::seek");
     uint64_t new_pos;
-    if (smb2_lseek(_smb, _handle, off, whence, &new_pos) < 0)
+    if (whence == SEEK_SET)
+        new_pos = off;
+    else if (whence == SEEK_CUR)
+        new_pos = _pos + off;
+    else if (smb2_lseek(_smb, _handle, off, whence, &new_pos) < 0)
     {
         Debug_printf("%s\n", smb2_get_error(_smb));
         return -1;
     }
+    _pos = new_pos;
     Debug_printf("new pos is %llu\n", new_pos);
     return 0;
 }
@@ -52,13 +262,7 @@ int FileHandlerSMB::seek(long int off, int whence)
 long int FileHandlerSMB::tell()
 {
     Debug_println("FileHandlerSMB::tell");
-    uint64_t pos;
-    if (smb2_lseek(_smb, _handle, 0, SEEK_CUR, &pos) < 0)
-    {
-        Debug_printf("%s\n", smb2_get_error(_smb));
-        return -1;
-    }
-    return (long)pos;
+    return (long)_pos;
 }
 
 
@@ -66,34 +270,8 @@ size_t FileHandlerSMB::read(void *ptr, size_t size, size_t count)
 {
     Debug_println("FileHandlerSMB::read");
 
-    size_t bytes_remaining = size * count;
-    size_t bytes_read = 0;
-    int result;
-    while (bytes_remaining > 0)
-    {
-        result = smb2_read(_smb, _handle, (uint8_t *)ptr, (uint32_t)bytes_remaining);
-        if (result < 0)
-        {
-            if (errno == EAGAIN)
-                continue;
-            else
-            {
-                Debug_printf("%s\n", smb2_get_error(_smb));
-                break;
-            }
-        }
-        else if (result == 0)
-        {
-            break; // EOF
-        }
-        else
-        {
-            bytes_read += result;
-            bytes_remaining -= result;
-        }
-    }
-
-    return (size_t)(size * count == bytes_read ? count : bytes_read / size);
+    size_t result = pread(ptr, size * count, (long)_pos);
+    return (size_t)(size * count == result ? count : result / size);
 }
 
 
@@ -101,15 +279,40 @@ size_t FileHandlerSMB::write(const void *ptr, size_t size, size_t count)
 {
     Debug_println("FileHandlerSMB::write");
 
-    size_t bytes_remaining = size * count;
+    size_t result = pwrite(ptr, size * count, (long)_pos);
+    return (size_t)(size * count == result ? count : result / size);
+}
+
+
+// SMB READ and WRITE carry their own offset, so there's never a seek to send
+size_t FileHandlerSMB::pread(void *ptr, size_t len, long int offset)
+{
+    int result = _readahead->pread((uint8_t *)ptr, (uint32_t)len, (uint64_t)offset);
+    if (result < 0)
+    {
+        Debug_printf("%s\n", smb2_get_error(_smb));
+        return 0;
+    }
+    _pos = offset + result;
+    return (size_t)result;
+}
+
+
+size_t FileHandlerSMB::pwrite(const void *ptr, size_t len, long int offset)
+{
+    // Whatever was read ahead may be about to change
+    _readahead->invalidate();
+
+    _pos = offset;
+    size_t bytes_remaining = len;
     size_t bytes_written = 0;
     int result;
     while (bytes_remaining > 0)
     {
-        result = smb2_write(_smb, _handle, (uint8_t *)ptr, (uint32_t)bytes_remaining);
+        result = smb2_pwrite(_smb, _handle, (uint8_t *)ptr + bytes_written, (uint32_t)bytes_remaining, _pos);
         if (result < 0)
         {
-            if (errno == EAGAIN)
+            if (result == -EAGAIN)
                 continue;
             else
             {
@@ -117,14 +320,19 @@ size_t FileHandlerSMB::write(const void *ptr, size_t size, size_t count)
                 break;
             }
         }
+        else if (result == 0)
+        {
+            break;
+        }
         else
         {
             bytes_written += result;
             bytes_remaining -= result;
+            _pos += result;
         }
     }
 
-    return (size_t)(size * count == bytes_written ? count : bytes_written / size);
+    return bytes_written;
 }
 
 
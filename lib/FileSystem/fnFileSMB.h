@@ -7,12 +7,67 @@
 
 #include "fnFile.h"
 
+// Size of each READ kept in flight, cut down to what the server allows
+#define SMB_READAHEAD_CHUNK 16384
+// Most READs in flight at once
+#define SMB_READAHEAD_DEPTH 4
+// How long to wait on a reply before giving up, in seconds
+#define SMB_REPLY_TIMEOUT 10
+
+// Services smb's socket until something sets done, as libsmb2's own synchronous calls
+// do for theirs. Commands of ours are in flight alongside. Returns false on failure
+bool smb_wait(struct smb2_context *smb, const bool *done);
+
+/*
+ * SMBReadahead - serves reads of an open SMB file from a window of large
+ * READs sent ahead of the reader, rather than a round trip per small read.
+ * The window starts at one READ wherever the reader is and doubles up to
+ * SMB_READAHEAD_DEPTH while it keeps reading on; a jump anywhere else starts
+ * it over. Nothing here knows about writes, call invalidate() before any.
+ */
+class SMBReadahead
+{
+protected:
+    struct slot
+    {
+        uint8_t *buf = nullptr;
+        uint64_t offset = 0;
+        int status = 0; // bytes read or -errno, once done
+        bool busy = false;
+        bool done = false;
+    };
+
+    struct smb2_context *_smb;
+    struct smb2fh *_fh;
+    uint32_t _chunk;
+    slot *_slots;
+    int _depth = 1;
+    uint64_t _next = 0; // where the next READ asks from
+    bool _eof = false;
+
+    static void _read_cb(struct smb2_context *smb, int status, void *command_data, void *cb_data);
+
+    slot *_find(uint64_t offset);
+    void _issue();
+
+public:
+    SMBReadahead(struct smb2_context *smb, struct smb2fh *fh);
+    ~SMBReadahead();
+
+    // Read up to count bytes from offset. Returns the bytes read, short only at the end of the file, or -errno
+    int pread(uint8_t *buf, uint32_t count, uint64_t offset);
+    // Wait out the READs in flight and forget everything read ahead
+    void invalidate();
+};
 
 class FileHandlerSMB : public FileHandler
 {
 protected:
     struct smb2_context *_smb;
     struct smb2fh *_handle;
+    SMBReadahead *_readahead;
+    // Our own position, the handle's moves with every READ sent ahead
+    uint64_t _pos = 0;
 public:
     FileHandlerSMB(struct smb2_context *smb, struct smb2fh *handle);
     virtual ~FileHandlerSMB() override;
@@ -23,6 +78,8 @@ public:
     virtual size_t read(void *ptr, size_t size, size_t count) override;
     virtual size_t write(const void *ptr, size_t size, size_t count) override;
     virtual int flush() override;
+    virtual size_t pread(void *ptr, size_t len, long int offset) override;
+    virtual size_t pwrite(const void *ptr, size_t len, long int offset) override;
 };
 
 
@@ -155,13 +155,88 @@ size_t FileHandlerTNFS::write(const void *ptr, size_t size, size_t count)
 }
 
 
+// The seek rides along with the first READ of the cache fill, see tnfs_lseek
+size_t FileHandlerTNFS::pread(void *ptr, size_t len, long int offset)
+{
+    Debug_println("FileHandlerTNFS::pread");
+
+    size_t total_bytes_read = 0;
+    uint16_t bytes_read;
+    uint16_t read_size;
+    int result;
+
+    while (total_bytes_read < len)
+    {
+        bytes_read = 0;
+        if (len - total_bytes_read > TNFS_MAX_READWRITE_PAYLOAD)
+            read_size = TNFS_MAX_READWRITE_PAYLOAD;
+        else
+            read_size = (uint16_t)(len - total_bytes_read);
+
+        uint32_t pos = (uint32_t)(offset + total_bytes_read);
+        result = tnfs_pread(_mountinfo, _handle, pos, ((uint8_t *)ptr)+total_bytes_read, read_size, &bytes_read);
+        if (result == TNFS_RESULT_BAD_FILENUM && _bad_fd_recovery() == TNFS_RESULT_SUCCESS)
+        {
+            // retry read command
+            result = tnfs_pread(_mountinfo, _handle, pos, ((uint8_t *)ptr)+total_bytes_read, read_size, &bytes_read);
+        }
+
+        if (result != TNFS_RESULT_SUCCESS)
+        {
+            if (result == TNFS_RESULT_END_OF_FILE && bytes_read > 0)
+                total_bytes_read += bytes_read;
+            else
+                errno = tnfs_code_to_errno(result);
+            break;
+        }
+        total_bytes_read += bytes_read;
+    }
+    return total_bytes_read;
+}
+
+
+size_t FileHandlerTNFS::pwrite(const void *ptr, size_t len, long int offset)
+{
+    Debug_println("FileHandlerTNFS::pwrite");
+
+    size_t total_bytes_written = 0;
+    uint16_t bytes_written;
+    uint16_t write_size;
+    int result;
+
+    while (total_bytes_written < len)
+    {
+        bytes_written = 0;
+        if (len - total_bytes_written > TNFS_MAX_READWRITE_PAYLOAD)
+            write_size = TNFS_MAX_READWRITE_PAYLOAD;
+        else
+            write_size = (uint16_t)(len - total_bytes_written);
+
+        result = tnfs_pwrite(_mountinfo, _handle, (uint32_t)(offset + total_bytes_written),
+                             ((uint8_t *)ptr)+total_bytes_written, write_size, &bytes_written);
+        if (result != TNFS_RESULT_SUCCESS)
+        {
+            errno = tnfs_code_to_errno(result);
+            break;
+        }
+        total_bytes_written += bytes_written;
+    }
+    return total_bytes_written;
+}
+
+
 int FileHandlerTNFS::flush()
 {
     Debug_println("FileHandlerTNFS::flush");
-    // int ret = fflush(_fh);    // This doesn't seem to be connected to anything in ESP-IDF VF, so it may not do anything
-    // ret = fsync(fileno(_fh)); // Since we might get reset at any moment, go ahead and sync the file (not clear if fflush does this)
-    // return ret;
-    return -1;
+    // Push out anything tnfs_write is still holding back
+    int result = tnfs_sync(_mountinfo, _handle);
+    if (result != TNFS_RESULT_SUCCESS)
+    {
+        errno = tnfs_code_to_errno(result);
+        return -1;
+    }
+    errno = 0;
+    return 0;
 }
 
 // reopen the file and seek to last known position
@@ -26,6 +26,8 @@ public:
     virtual size_t read(void *ptr, size_t size, size_t count) override;
     virtual size_t write(const void *ptr, size_t size, size_t count) override;
     virtual int flush() override;
+    virtual size_t pread(void *ptr, size_t len, long int offset) override;
+    virtual size_t pwrite(const void *ptr, size_t len, long int offset) override;
 };
 
 
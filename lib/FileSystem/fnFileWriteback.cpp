@@ -0,0 +1,262 @@
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+#include "fnFileWriteback.h"
+#include "../../include/debug.h"
+
+
+std::mutex FileHandlerWriteback::_mutex;
+std::condition_variable FileHandlerWriteback::_cv;
+std::vector<FileHandlerWriteback *> FileHandlerWriteback::_handles;
+bool FileHandlerWriteback::_task_started = false;
+
+FileHandler *FileHandlerWriteback::wrap(FileHandler *fh, long int filesize)
+{
+    if (fh == nullptr)
+        return fh;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _start_task();
+    if (!_task_started)
+        return fh;
+    return new FileHandlerWriteback(fh, filesize);
+}
+
+FileHandlerWriteback::FileHandlerWriteback(FileHandler *fh, long int filesize)
+    : _fh(fh), _filesize(filesize)
+{
+    _handles.push_back(this);
+}
+
+FileHandlerWriteback::~FileHandlerWriteback()
+{
+    if (_fh != nullptr)
+        close(false);
+}
+
+size_t FileHandlerWriteback::pending_writes()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t pending = 0;
+    for (FileHandlerWriteback *h : _handles)
+        pending += h->_queue.size();
+    return pending;
+}
+
+// Called with _mutex held. The task lives for the rest of the run once started.
+void FileHandlerWriteback::_start_task()
+{
+    if (_task_started)
+        return;
+#ifdef ESP_PLATFORM
+    if (xTaskCreatePinnedToCore(_writeback_task, "writeback_task", WRITEBACK_TASK_STACKSIZE, nullptr,
+                                WRITEBACK_TASK_PRIORITY, nullptr, 0) != pdPASS)
+    {
+        Debug_println("FileHandlerWriteback - failed to start writeback task, writing directly");
+        return;
+    }
+#else
+    std::thread(_task_loop).detach();
+#endif
+    _task_started = true;
+}
+
+#ifdef ESP_PLATFORM
+void FileHandlerWriteback::_writeback_task(void *param)
+{
+    _task_loop();  // Never returns
+    vTaskDelete(nullptr);
+}
+#endif
+
+void FileHandlerWriteback::_task_loop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        FileHandlerWriteback *h = nullptr;
+        for (FileHandlerWriteback *candidate : _handles)
+        {
+            if (!candidate->_queue.empty())
+            {
+                h = candidate;
+                break;
+            }
+        }
+        if (h == nullptr)
+        {
+            _cv.wait(lock);
+            continue;
+        }
+
+        // The entry stays at the front of the queue, and the handle can't be
+        // closed, until it has been written and popped
+        writeback_entry &entry = h->_queue.front();
+        lock.unlock();
+
+        bool ok;
+        {
+            std::lock_guard<std::mutex> io_lock(h->_io_mutex);
+            ok = h->_fh->seek(entry.offset, SEEK_SET) == 0 &&
+                 h->_fh->write(entry.data.data(), 1, entry.data.size()) == entry.data.size();
+        }
+        if (!ok)
+            Debug_printf("FileHandlerWriteback - write of %u bytes at %ld failed\n",
+                         (unsigned)entry.data.size(), entry.offset);
+
+        lock.lock();
+        if (!ok)
+            h->_write_error = true;
+        h->_queue.pop_front();
+        _cv.notify_all();
+    }
+}
+
+// Waits for this handle's queue to empty and flushes the underlying file
+int FileHandlerWriteback::_drain()
+{
+    bool write_error;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return _queue.empty(); });
+        write_error = _write_error;
+        _write_error = false;
+    }
+
+    std::lock_guard<std::mutex> io_lock(_io_mutex);
+    int result = _fh->flush();
+    if (write_error)
+    {
+        errno = EIO;
+        result = -1;
+    }
+    return result;
+}
+
+int FileHandlerWriteback::close(bool destroy)
+{
+    int result = 0;
+    if (_fh != nullptr)
+    {
+        result = _drain();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _handles.erase(std::remove(_handles.begin(), _handles.end(), this), _handles.end());
+        }
+        if (_fh->close(true) != 0)
+            result = -1;
+        _fh = nullptr;
+    }
+    if (destroy) delete this;
+    return result;
+}
+
+int FileHandlerWriteback::seek(long int off, int whence)
+{
+    long int new_pos;
+    switch (whence)
+    {
+        case SEEK_SET:
+            new_pos = off;
+            break;
+        case SEEK_END:
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            new_pos = _filesize + off;
+            break;
+        }
+        case SEEK_CUR:
+            new_pos = _position + off;
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+
+    if (new_pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    _position = new_pos;
+    return 0;
+}
+
+long int FileHandlerWriteback::tell()
+{
+    return _position;
+}
+
+size_t FileHandlerWriteback::read(void *ptr, size_t size, size_t count)
+{
+    if (size == 0)
+        return 0;
+
+    size_t requested = size * count;
+    size_t got = 0;
+    // Holding the file until the queue has been checked means an entry
+    // can't be written and dropped from the queue in between
+    std::lock_guard<std::mutex> io_lock(_io_mutex);
+    if (_fh->seek(_position, SEEK_SET) == 0)
+        got = _fh->read(ptr, 1, requested);
+
+    // Anything still queued is newer than what the file holds
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_position < _filesize && got < requested)
+    {
+        // Queued writes may have extended the file past what's been written
+        size_t extended = std::min((long int)requested, _filesize - _position);
+        if (extended > got)
+        {
+            memset((uint8_t *)ptr + got, 0, extended - got);
+            got = extended;
+        }
+    }
+    for (const writeback_entry &entry : _queue)
+    {
+        long int start = std::max(entry.offset, _position);
+        long int end = std::min(entry.offset + (long int)entry.data.size(), _position + (long int)got);
+        if (start < end)
+            memcpy((uint8_t *)ptr + (start - _position), entry.data.data() + (start - entry.offset), end - start);
+    }
+    _position += got;
+
+    return got / size;
+}
+
+size_t FileHandlerWriteback::write(const void *ptr, size_t size, size_t count)
+{
+    size_t len = size * count;
+    if (len == 0)
+        return 0;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    // Bounded queue: a burst of writes waits here for the task to catch up
+    _cv.wait(lock, [this] { return _queue.size() < WRITEBACK_QUEUE_MAX; });
+
+    const uint8_t *data = (const uint8_t *)ptr;
+    _queue.push_back({_position, std::vector<uint8_t>(data, data + len)});
+    _position += len;
+    _filesize = std::max(_filesize, _position);
+    _cv.notify_all();
+
+    return count;
+}
+
+// Durability barrier: returns once every queued write is on the underlying file
+int FileHandlerWriteback::flush()
+{
+    if (_fh == nullptr)
+        return -1;
+    return _drain();
+}
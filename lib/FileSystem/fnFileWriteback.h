@@ -0,0 +1,75 @@
+#ifndef FN_FILEWRITEBACK_H
+#define FN_FILEWRITEBACK_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "fnFile.h"
+
+// Most writes (sectors) a handle may have waiting before write() blocks
+#define WRITEBACK_QUEUE_MAX 32
+
+#define WRITEBACK_TASK_STACKSIZE 4096
+#define WRITEBACK_TASK_PRIORITY 5
+
+/*
+ * FileHandlerWriteback - hands writes off to a background task
+ * write() queues the data and returns at once, so a slow (network) file
+ * doesn't hold up the bus device's reply. The writeback task writes
+ * queued data out in the order it was written. Reads see queued data,
+ * and flush() and close() wait until everything has been written.
+ */
+class FileHandlerWriteback : public FileHandler
+{
+protected:
+    struct writeback_entry
+    {
+        long int offset;
+        std::vector<uint8_t> data;
+    };
+
+    FileHandler *_fh;
+    long int _filesize;
+    long int _position = 0;
+    // Entries stay queued until written so reads can still see them
+    std::deque<writeback_entry> _queue;
+    bool _write_error = false;
+    // Keeps the bus and writeback tasks off the underlying file at the same time
+    std::mutex _io_mutex;
+
+    // Guards every handle's queue and the handle list
+    static std::mutex _mutex;
+    static std::condition_variable _cv;
+    static std::vector<FileHandlerWriteback *> _handles;
+    static bool _task_started;
+
+    FileHandlerWriteback(FileHandler *fh, long int filesize);
+
+    static void _start_task();
+    static void _task_loop();
+#ifdef ESP_PLATFORM
+    static void _writeback_task(void *param);
+#endif
+    int _drain();
+
+public:
+    virtual ~FileHandlerWriteback() override;
+
+    // Returns a handler that takes over fh and writes to it in the background
+    static FileHandler *wrap(FileHandler *fh, long int filesize);
+    // Writes queued across all handles and not yet on the underlying files
+    static size_t pending_writes();
+
+    virtual int close(bool destroy=true) override;
+    virtual int seek(long int off, int whence) override;
+    virtual long int tell() override;
+    virtual size_t read(void *ptr, size_t size, size_t count) override;
+    virtual size_t write(const void *ptr, size_t size, size_t count) override;
+    virtual int flush() override;
+};
+
+#endif // FN_FILEWRITEBACK_H
@@ -0,0 +1,96 @@
+#include "fnFlashCache.h"
+
+#include <sys/stat.h>
+
+// A fresh stream over a copy of data for each open, so closing it frees only its own copy
+FILE *FlashFileCache::_stream(const std::string &data)
+{
+#ifdef _WIN32
+    return nullptr;
+#else
+    FILE *f = fmemopen(nullptr, data.size() + 1, "w+");
+    if (f == nullptr)
+        return nullptr;
+    if (fwrite(data.data(), 1, data.size(), f) != data.size())
+    {
+        fclose(f);
+        return nullptr;
+    }
+    rewind(f);
+    return f;
+#endif
+}
+
+FILE *FlashFileCache::open(const char *fpath)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    struct stat st;
+    bool found = stat(fpath, &st) == 0 && S_ISREG(st.st_mode);
+
+    for (auto it = _entries.begin(); it != _entries.end(); ++it)
+    {
+        if (it->path == fpath)
+        {
+            // Changed behind our back, by a writer that was still going when it was copied
+            if (!found || (size_t)st.st_size != it->data.size() || st.st_mtime != it->mtime)
+            {
+                _bytes -= it->data.size();
+                _entries.erase(it);
+                break;
+            }
+            _entries.splice(_entries.begin(), _entries, it);
+            hits++;
+            return _stream(_entries.front().data);
+        }
+    }
+
+    if (!found || st.st_size > FLASH_CACHE_MAX_FILE)
+        return nullptr;
+
+    // Just written, and maybe still being written: read it from flash this time
+    time_t now = time(nullptr);
+    if (st.st_mtime + FLASH_CACHE_SETTLE_TIME > now && st.st_mtime <= now)
+        return nullptr;
+
+    FILE *f = fopen(fpath, "rb");
+    if (f == nullptr)
+        return nullptr;
+    std::string data(st.st_size, '\0');
+    size_t got = fread(&data[0], 1, data.size(), f);
+    fclose(f);
+    if (got != data.size())
+        return nullptr;
+
+    misses++;
+    while (!_entries.empty() && _bytes + data.size() > FLASH_CACHE_SIZE)
+    {
+        _bytes -= _entries.back().data.size();
+        _entries.pop_back();
+    }
+    _bytes += data.size();
+    _entries.push_front({fpath, std::move(data), st.st_mtime});
+
+    return _stream(_entries.front().data);
+}
+
+void FlashFileCache::forget(const char *fpath)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _entries.begin(); it != _entries.end(); ++it)
+    {
+        if (it->path == fpath)
+        {
+            _bytes -= it->data.size();
+            _entries.erase(it);
+            return;
+        }
+    }
+}
+
+void FlashFileCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _bytes = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef FN_FLASHCACHE_H
+#define FN_FLASHCACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <list>
+#include <mutex>
+#include <string>
+
+// Largest file kept in memory, and all of them together
+#define FLASH_CACHE_MAX_FILE 8192
+#define FLASH_CACHE_SIZE 32768
+// A file changed more recently than this may still be being written, so it isn't cached yet, in seconds
+#define FLASH_CACHE_SETTLE_TIME 2
+
+/*
+ * FlashFileCache - RAM copies of the small files on internal flash that get
+ * read over and over (the config, web UI templates), so opening one again
+ * doesn't touch flash. A cached file is opened as a private memory stream,
+ * so the caller reads it like any other FILE.
+ *
+ * The flash filesystem tells the cache about anything that changes a file
+ * (a write mode open, remove, rename) and it forgets that file. As a writer
+ * may still be going when the file is read, a copy is only taken of a file
+ * that hasn't changed for a moment, and every hit checks the file's size
+ * and modification time against the copy's. The least recently opened
+ * files make way when the cache is full.
+ */
+class FlashFileCache
+{
+private:
+    struct entry
+    {
+        std::string path;
+        std::string data;
+        time_t mtime;
+    };
+
+    std::list<entry> _entries; // Most recently opened first
+    size_t _bytes = 0;
+    std::mutex _mutex;
+
+    FILE *_stream(const std::string &data);
+
+public:
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+
+    // Opens fpath (a full VFS path) for reading from memory, loading it first if it's small enough.
+    // Returns nullptr if the file isn't cacheable, for the caller to open it from flash
+    FILE *open(const char *fpath);
+
+    void forget(const char *fpath);
+    void clear();
+};
+
+#endif // FN_FLASHCACHE_H
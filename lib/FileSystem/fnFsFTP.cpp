@@ -7,6 +7,7 @@
 
 #include "fnSystem.h"
 #include "fnFileCache.h"
+#include "fnFileFTP.h"
 
 #define COPY_BLK_SIZE 4096
 
@@ -58,9 +59,12 @@ bool FileSystemFTP::start(const char *url, const char *user, const char *passwor
         return false;
     }
 
+    _user = user == nullptr ? "anonymous" : user;
+    _password = password == nullptr ? "fujinet@fujinet.online" : password;
+
     res = _ftp->login(
-        user == nullptr ? "anonymous" : user,
-        password == nullptr ? "fujinet@fujinet.online" : password,
+        _user,
+        _password,
         _url->host,
         _url->port.empty() ? 21 : atoi(_url->port.c_str())
     );
@@ -103,10 +107,44 @@ FILE  *FileSystemFTP::file_open(const char *path, const char *mode)
 #ifndef FNIO_IS_STDIO
 FileHandler *FileSystemFTP::filehandler_open(const char *path, const char *mode)
 {
+    // Straight from the server when it can start a download part way, unless it's on SD
+    // already. Whatever's written is put together in the cache first
+    if (!mode_writes(mode) && _ftp->has_rest())
+    {
+        FileHandler *fh = FileCache::open(_url->mRawUrl.c_str(), path, mode);
+        if (fh == nullptr)
+            fh = stream_file(path);
+        if (fh != nullptr)
+            return fh;
+    }
+
     FileHandler *fh = cache_file(path, mode);
     return fh;
 }
 
+// Open FTP path for reading on demand, on a control connection of its own
+// Return FileHandler* on success, nullptr on error
+FileHandler *FileSystemFTP::stream_file(const char *path)
+{
+    long size;
+    if (_ftp->file_size(path, size))
+    {
+        Debug_printf("FileSystemFTP::stream_file - SIZE failed for \"%s\"\n", path);
+        return nullptr;
+    }
+
+    fnFTP *ftp = new fnFTP();
+    if (ftp->login(_user, _password, _url->host, _url->port.empty() ? 21 : atoi(_url->port.c_str())) || !ftp->has_rest())
+    {
+        Debug_println("FileSystemFTP::stream_file - second login failed");
+        delete ftp;
+        return nullptr;
+    }
+
+    Debug_printf("FileSystemFTP::stream_file - streaming %ld bytes\n", size);
+    return new FileHandlerFTP(ftp, path, size);
+}
+
 // Read file from FTP path and write it to cache file
 // Return FileHandler* on success (memory or SD file), nullptr on error
 FileHandler *FileSystemFTP::cache_file(const char *path, const char *mode)
@@ -167,7 +205,7 @@ FileHandler *FileSystemFTP::cache_file(const char *path, const char *mode)
             while (available > 0)
             {
                 // Read FTP data
-                int to_read = available > sizeof(buf) ? sizeof(buf) : available;
+                int to_read = available > COPY_BLK_SIZE ? COPY_BLK_SIZE : available;
                 if (_ftp->read_file(buf, to_read))
                 {
                     Debug_println("FileSystemFTP::cache_file - FTP read failed");
@@ -229,7 +267,10 @@ bool FileSystemFTP::dir_open(const char  *path, const char *pattern, uint16_t di
     if (path == nullptr)
         return false;
 
-    if (strcmp(_last_dir, path) == 0 && !_dircache.empty())
+    // Reuse the listing of the directory we were just in, unless it's old or
+    // we've since changed something
+    if (strcmp(_last_dir, path) == 0 && !_dircache.empty() && _last_dir_changes == changes() &&
+        fnSystem.millis() - _last_dir_time <= FTP_DIRCACHE_TTL_MS)
     {
         Debug_printf("Use directory cache\n");
     }
@@ -253,32 +294,43 @@ bool FileSystemFTP::dir_open(const char  *path, const char *pattern, uint16_t di
 
         // Remember last visited directory
         strlcpy(_last_dir, path, MAX_PATHLEN);
+        _last_dir_time = fnSystem.millis();
+        _last_dir_changes = changes();
 
         // Populate directory cache with entries
         string filename;
         long filesz;
         bool is_dir;
+        time_t mtime;
         fsdir_entry *fs_de;
 
         // get first directory entry
-        res = _ftp->read_directory(filename, filesz, is_dir);
+        res = _ftp->read_directory(filename, filesz, is_dir, &mtime);
         while(res == false)
         {
             // skip hidden
             if (filename[0] == '.')
+            {
+                res = _ftp->read_directory(filename, filesz, is_dir, &mtime);
                 continue;
+            }
 
-            // new dir entry
-            fs_de = &_dircache.new_entry();
+            // new dir entry, filled in here and then copied into the cache
+            fs_de = &_direntry;
 
             // set entry members
             strlcpy(fs_de->filename, filename.c_str(), sizeof(fs_de->filename));
             fs_de->isDir = is_dir;
             fs_de->size = (uint32_t)filesz;
-            fs_de->modified_time = 0; // TODO
+            fs_de->modified_time = mtime;
+            if (!_dircache.add_entry(*fs_de))
+            {
+                Debug_println("Directory too large for cache, listing truncated");
+                break;
+            }
 
             // get next
-            res = _ftp->read_directory(filename, filesz, is_dir);
+            res = _ftp->read_directory(filename, filesz, is_dir, &mtime);
         }
     }
 
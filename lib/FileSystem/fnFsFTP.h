@@ -10,6 +10,9 @@
 #include "fnFS.h"
 #include "fnDirCache.h"
 
+// How long a directory listing is reused before it's read from the server again
+#define FTP_DIRCACHE_TTL_MS 30000
+
 
 class FileSystemFTP : public FileSystem
 {
@@ -20,9 +23,15 @@ private:
     // FTP client
     fnFTP *_ftp;
 
+    // Login, again for each file streamed on a connection of its own
+    std::string _user;
+    std::string _password;
+
     // directory cache
     char _last_dir[MAX_PATHLEN];
     DirCache _dircache;
+    uint64_t _last_dir_time = 0;
+    uint32_t _last_dir_changes = 0;
 
 public:
     FileSystemFTP();
@@ -57,6 +66,7 @@ public:
 
 #ifndef FNIO_IS_STDIO
     FileHandler *cache_file(const char *path, const char *mode);
+    FileHandler *stream_file(const char *path);
 #endif
 
 };
@@ -11,7 +11,10 @@
 #include "../../include/debug.h"
 
 #include "fnSystem.h"
+#include "fnConfig.h"
 #include "fnFileCache.h"
+#include "fnFileHTTP.h"
+#include "fnFsSD.h"
 #include "string_utils.h"
 
 // http timeout in ms
@@ -109,21 +112,56 @@ FileHandler *FileSystemHTTP::filehandler_open(const char *path, const char *mode
     return fh;
 }
 
+// Identifies the version of the file in a response, empty if the server gives nothing to tell versions apart
+static std::string response_validator(HTTP_CLIENT_CLASS *http)
+{
+    std::string etag = http->get_header("ETag");
+    std::string modified = http->get_header("Last-Modified");
+    if (etag.empty() && modified.empty())
+        return std::string();
+    return etag + '|' + modified + '|' + http->get_header("Content-Length");
+}
+
 // Read file from HTTP path and write it to cache file
 // Return FileHandler* on success (memory or SD file), nullptr on error
 FileHandler *FileSystemHTTP::cache_file(const char *path, const char *mode)
 {
-    // Try SD cache first
-    FileHandler *fh = FileCache::open(_url->mRawUrl.c_str(), path, mode);
-    if (fh != nullptr)
-        return fh; // cache hit, done
+    const char *host = _url->mRawUrl.c_str();
+    FileHandler *fh;
 
-    HEAP_DEBUG();
+    // url + '/' + path
+    std::string url_str = _url->url;
+    std::string path_str = mstr::urlEncode(path);
+    if (url_str.back() != '/') url_str.push_back('/');
+    if (path_str.front() == '/') path_str.erase(0, 1);
+    url_str += path_str;
 
-    // Create new cache file (starts in memory)
-    fc_handle *fc = FileCache::create(_url->mRawUrl.c_str(), path);
-    if (fc == nullptr)
-        return nullptr;
+    // Try SD cache first: a file stored with a validator is used for as long as a HEAD shows it unchanged
+    bool revalidated = false;
+    std::string cached_validator = FileCache::validator(host, path);
+    if (!cached_validator.empty())
+    {
+        HTTP_CLIENT_CLASS head;
+        head.begin(url_str);
+        head.create_empty_stored_headers({"Content-Length", "ETag", "Last-Modified"});
+        int status = head.HEAD();
+        if (status >= 200 && status < 400)
+        {
+            revalidated = true;
+            fh = FileCache::open_validated(host, path, mode, response_validator(&head));
+            if (fh != nullptr)
+                return fh; // unchanged, done
+        }
+    }
+    if (!revalidated)
+    {
+        // No validator or server unreachable, go by the cache file's age
+        fh = FileCache::open(host, path, mode);
+        if (fh != nullptr)
+            return fh; // cache hit, done
+    }
+
+    HEAP_DEBUG();
 
     // Setup HTTP client
     if (_http != nullptr)
@@ -134,12 +172,6 @@ FileHandler *FileSystemHTTP::cache_file(const char *path, const char *mode)
         Debug_println("FileSystemHTTP::cache_file() - failed to create HTTP client\n");
         return nullptr;
     }
-    // url + '/' + path
-    std::string url_str = _url->url;
-    std::string path_str = mstr::urlEncode(path);
-    if (url_str.back() != '/') url_str.push_back('/');
-    if (path_str.front() == '/') path_str.erase(0, 1);
-    url_str += path_str;
     if (!_http->begin(url_str))
     {
         Debug_println("FileSystemHTTP::cache_file - failed to start HTTP client");
@@ -148,12 +180,46 @@ FileHandler *FileSystemHTTP::cache_file(const char *path, const char *mode)
 
     // GET request
     Debug_println("Initiating GET request");
+    _http->create_empty_stored_headers({"Content-Length", "Accept-Ranges", "ETag", "Last-Modified"});
     if (_http->GET() > 399)
     {
         Debug_println("FileSystemHTTP::cache_file - GET failed");
         return nullptr;
     }
 
+    long int content_length = atol(_http->get_header("Content-Length").c_str());
+    std::string validator = response_validator(_http);
+    int64_t cache_budget = (int64_t)Config.get_general_image_cache_mb() * 1024 * 1024;
+
+    // Big files on servers that take range requests are read a block at a time, if the SD cache can't keep them
+    if (content_length >= HTTP_RANGE_MIN_SIZE && _http->get_header("Accept-Ranges") == "bytes" &&
+        strchr(mode, '+') == nullptr && strchr(mode, 'w') == nullptr &&
+        (!fnSDFAT.running() || content_length > cache_budget))
+    {
+        delete _http;
+        _http = nullptr;
+        return FileHandlerHTTPRange::open(url_str, content_length);
+    }
+
+    // Create new cache file, straight on SD when the server lets us tell later if it changed
+    bool persist = !validator.empty() && fnSDFAT.running() && content_length <= cache_budget;
+    fc_handle *fc = FileCache::create(host, path, persist ? 0 : -1);
+    if (fc == nullptr)
+    {
+        delete _http;
+        _http = nullptr;
+        return nullptr;
+    }
+    fc->validator = validator;
+
+    // With the size known up front, hand out the file now and let it download in the background
+    if (content_length > 0)
+    {
+        fh = FileHandlerHTTP::start(_http, fc, content_length, mode);
+        _http = nullptr;
+        return fh;
+    }
+
     // Retrieve HTTP data
     int tmout_counter = 1 + HTTP_GET_TIMEOUT / 50;
     bool cancel = false;
@@ -426,8 +492,8 @@ bool FileSystemHTTP::dir_open(const char  *path, const char *pattern, uint16_t d
         struct tm tm;
         while (dirEntryCursor != _parser.entries.end())
         {
-            // new dir entry
-            fs_de = &_dircache.new_entry();
+            // new dir entry, filled in here and then copied into the cache
+            fs_de = &_direntry;
 
             // Set entry members
 
@@ -500,6 +566,11 @@ bool FileSystemHTTP::dir_open(const char  *path, const char *pattern, uint16_t d
             {
                 Debug_printf(" add entry: \"%s\"\t%lu\n", fs_de->filename, fs_de->size);
             }
+            if (!_dircache.add_entry(*fs_de))
+            {
+                Debug_println("Directory too large for cache, listing truncated");
+                break;
+            }
 
             dirEntryCursor++;
         }
@@ -4,6 +4,7 @@
 
 #include "fnFsLittleFS.h"
 #include "fnFileLocal.h"
+#include "fnAssets.h"
 
 #include <esp_vfs.h>
 #include <errno.h>
@@ -150,7 +151,18 @@ bool FileSystemLittleFS::create_path(const char *fullpath)
 FILE * FileSystemLittleFS::file_open(const char* path, const char* mode)
 {
     char * fpath = _make_fullpath(path);
-    FILE * result = fopen(fpath, mode);
+    FILE * result = nullptr;
+    bool read_only = mode[0] == 'r' && strchr(mode, '+') == nullptr;
+    // Small files being read come from RAM; opening one any other way may change it
+    if (read_only)
+        result = _cache.open(fpath);
+    else
+        _cache.forget(fpath);
+    if (result == nullptr)
+        result = fopen(fpath, mode);
+    // Only a file the filesystem doesn't have comes from the asset partition
+    if (result == nullptr && read_only)
+        result = fnAssets.open(path);
     free(fpath);
     return result;
 }
@@ -173,12 +185,31 @@ bool FileSystemLittleFS::exists(const char* path)
     //Debug_printv("FileSystemLittleFS::exists returned %d on \"%s\" (%s)\r\n", i, path, fpath);
 #endif
     free(fpath);
+    size_t asset_size;
+    if (i != 0 && fnAssets.find(path, &asset_size) != nullptr)
+        return true;
     return (i == 0);
 }
 
+// Size of the file file_open() would open, from the filesystem or the asset partition
+long FileSystemLittleFS::filesize(const char *path)
+{
+    char * fpath = _make_fullpath(path);
+    struct stat st;
+    int i = stat(fpath, &st);
+    free(fpath);
+    if (i == 0)
+        return st.st_size;
+    size_t asset_size;
+    if (fnAssets.find(path, &asset_size) != nullptr)
+        return asset_size;
+    return -1;
+}
+
 bool FileSystemLittleFS::remove(const char* path)
 {
     char * fpath = _make_fullpath(path);
+    _cache.forget(fpath);
     int i = ::remove(fpath);
 #ifdef DEBUG
     Debug_printv("FileSystemLittleFS::remove returned %d on \"%s\" (%s)\r\n", i, path, fpath);
@@ -191,6 +222,8 @@ bool FileSystemLittleFS::rename(const char* pathFrom, const char* pathTo)
 {
     char * spath = _make_fullpath(pathFrom);
     char * dpath = _make_fullpath(pathTo);
+    _cache.forget(spath);
+    _cache.forget(dpath);
     int i = ::rename(spath, dpath);
 #ifdef DEBUG
     Debug_printv("FileSystemLittleFS::rename returned %d on \"%s\" -> \"%s\" (%s -> %s)\r\n", i, pathFrom, pathTo, spath, dpath);
@@ -5,6 +5,7 @@
 
 #include "fnFsSD.h"
 #include "fnFileLocal.h"
+#include "fnFileFat.h"
 
 #ifdef ESP_PLATFORM
 #include <esp_vfs.h>
@@ -12,10 +13,13 @@
 #include <driver/sdmmc_host.h>
 #include <esp_rom_gpio.h>
 #include <soc/sdmmc_periph.h>
+#include <sdmmc_cmd.h>
+#include <esp_heap_caps.h>
 #endif
 
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 #include "compat_string.h"
 
@@ -33,6 +37,19 @@
   #if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0)
   #define SDSPI_DEFAULT_DMA 1
   #endif
+
+  // Fastest SD clock to try. SDMMC boards start at high speed (40MHz) and step down if the
+  // card won't keep up; SPI stays at the default 20MHz unless a board knows better
+  #ifndef SD_HOST_MAX_FREQ_KHZ
+    #ifdef SDMMC_HOST_WIDTH
+    #define SD_HOST_MAX_FREQ_KHZ SDMMC_FREQ_HIGHSPEED
+    #else
+    #define SD_HOST_MAX_FREQ_KHZ SDMMC_FREQ_DEFAULT
+    #endif
+  #endif
+  // Sectors read back at each clock to decide whether it's stable, and how many times
+  #define SD_PROBE_SECTORS 8
+  #define SD_PROBE_PASSES 4
 #else
 // !ESP_PLATFORM
   #if defined(_WIN32)
@@ -48,36 +65,6 @@
 // Our global SD interface
 FileSystemSDFAT fnSDFAT;
 
-/*
- We maintain directory information cached to allow
- for sorting and to provide telldir/seekdir
-*/
-std::vector<fsdir_entry> _dir_entries;
-uint16_t _dir_entry_current = 0;
-
-bool _fssd_fsdir_sort_name_ascend(fsdir_entry &left, fsdir_entry &right)
-{
-    return strcasecmp(left.filename, right.filename) < 0;
-}
-
-bool _fssd_fsdir_sort_name_descend(fsdir_entry &left, fsdir_entry &right)
-{
-    return strcasecmp(left.filename, right.filename) > 0;
-}
-
-bool _fssd_fsdir_sort_time_ascend(fsdir_entry &left, fsdir_entry &right)
-{
-    return left.modified_time > right.modified_time;
-}
-
-bool _fssd_fsdir_sort_time_descend(fsdir_entry &left, fsdir_entry &right)
-{
-    return left.modified_time < right.modified_time;
-}
-
-typedef bool (*sort_fn_t)(fsdir_entry &left, fsdir_entry &right);
-
-
 #ifdef ESP_PLATFORM
 /*
   Converts the FatFs ftime and fdate to a POSIX time_t value
@@ -141,6 +128,7 @@ bool FileSystemSDFAT::mkdir(const char* path)
 
     int result = ::mkdir(fpath, S_IRWXU);
     free(fpath);
+    note_change();
     if(0 != result)
     {
         Debug_printf("  mkdir failed: errno %d\r\n", errno);
@@ -155,6 +143,7 @@ bool FileSystemSDFAT::rmdir(const char* path)
 
     int result = ::rmdir(fpath);
     free(fpath);
+    note_change();
     if(0 != result)
     {
         Debug_printf("  rmdir failed: errno %d\r\n", errno);
@@ -162,53 +151,59 @@ bool FileSystemSDFAT::rmdir(const char* path)
     return (0 == result);
 }
 
-bool FileSystemSDFAT::dir_open(const char * path, const char * pattern, uint16_t diropts)
+// Directory's modification time, part of what tells a kept listing it's out of date
+time_t FileSystemSDFAT::_dir_mtime(const char *path)
 {
-    // TODO: Add pattern and sorting options
+#ifdef ESP_PLATFORM
+    FILINFO finfo;
+    // The root has no directory entry of its own to stat
+    if (f_stat(path, &finfo) != FR_OK)
+        return 0;
+    return _fssd_fatdatetime_to_epoch(finfo.ftime, finfo.fdate);
+#else
+    return mtime(path);
+#endif
+}
 
+bool FileSystemSDFAT::dir_open(const char * path, const char * pattern, uint16_t diropts)
+{
 #ifndef ESP_PLATFORM
     Debug_printf("FileSystemSDFAT::dir_open \"%s\"\n", path);
 #endif
 
+    // Opening the same directory again only re-filters and re-sorts the listing we have,
+    // unless something was written through us or the directory's time moved. FatFs doesn't
+    // touch a directory's time when its entries change, so on the card the count is what counts
+    time_t dir_mtime = _dir_mtime(path);
+    if (_dircache_valid && _dircache_path == path && _dircache_changes == _changes && _dircache_mtime == dir_mtime)
+    {
+        Debug_printf("FileSystemSDFAT::dir_open reusing listing of %u entries\n", (unsigned)_dircache.size());
+        _dircache.apply_filter(pattern, diropts);
+        return true;
+    }
+
     // Throw out any existing directory entry data
-    _dir_entries.clear();
-    _dir_entry_current = 0;
+    _dircache.clear();
+    _dircache_valid = false;
 
 #ifdef ESP_PLATFORM
     FRESULT result = f_opendir(&_dir, path);
     if(result != FR_OK)
         return false;
 #else
-    char * fpath = _make_fullpath(path);
-    Debug_printf("FileSystemSDFAT::dir_open - opendir \"%s\"\n", fpath);
-    _dir = opendir(fpath);
-    free(fpath);
+    char * dpath = _make_fullpath(path);
+    Debug_printf("FileSystemSDFAT::dir_open - opendir \"%s\"\n", dpath);
+    _dir = opendir(dpath);
     if(_dir == nullptr)
+    {
+        free(dpath);
         return false;
+    }
 #endif
 
-	char realpat[MAX_PATHLEN];
-	char *thepat = nullptr;
-    bool have_pattern = pattern != nullptr && pattern[0] != '\0';
-	Debug_printf (
-		"FileSystemSDFAT::dir_open I%s have a pattern.\n",
-		have_pattern ? "" : " do not"
-	);
-	bool filter_dirs = have_pattern && pattern[strlen(pattern)-1] == '/';
-	if (filter_dirs) {
-		Debug_printf ("FileSystemSDFAT::dir_open I am filtering directories.\n");
-		strlcpy (realpat, pattern, sizeof (realpat));
-		realpat[strlen(realpat)-1] = '\0';
-	}
-	thepat = filter_dirs ? realpat : (char *)pattern;
-
-	
-
-    // Read all the directory entries and store them
-    // We temporarily keep separate lists of files and directories so we can sort them separately
-    std::vector<fsdir_entry> store_directories;
-    std::vector<fsdir_entry> store_files;
-    fsdir_entry *entry;
+    // Every entry goes into the compact listing once, in directory order. The pattern
+    // and sort order are applied to indices into it afterwards
+    bool fits = true;
 
 #ifdef ESP_PLATFORM
     FILINFO finfo;
@@ -231,38 +226,19 @@ bool FileSystemSDFAT::dir_open(const char * path, const char * pattern, uint16_t
         || strcmp(finfo.fname, "rs232dump") == 0)
             continue;
 
-        // Determine which list to put this in
-        if(finfo.fattrib & AM_DIR)
-        {
-			// Skip this entry if we're filtering directories and it doesn't match
-			if (filter_dirs && util_wildcard_match(finfo.fname, thepat) == false)
-				continue;
-
-            store_directories.push_back(fsdir_entry());
-            entry = &store_directories.back();
-            entry->isDir = true;
-        }
-        else
+        if (!_dircache.add_entry(finfo.fname, finfo.fattrib & AM_DIR, finfo.fsize,
+                                 _fssd_fatdatetime_to_epoch(finfo.ftime, finfo.fdate)))
         {
-            // Skip this entry if we have a search filter and it doesn't match it
-            if(have_pattern && util_wildcard_match(finfo.fname, thepat) == false)
-                continue;
-
-            store_files.push_back(fsdir_entry());
-            entry = &store_files.back();
-            entry->isDir = false;
+            fits = false;
+            break;
         }
-
-        // Copy the data we want into the record
-        strlcpy(entry->filename, finfo.fname, sizeof(entry->filename));
-        entry->size = finfo.fsize;
-        entry->modified_time = _fssd_fatdatetime_to_epoch(finfo.ftime, finfo.fdate);
     }
 // ESP_PLATFORM
 #else
 // !ESP_PLATFORM
     struct dirent *d;
     struct stat s;
+    char epath[MAX_PATHLEN];
 
     while((d = readdir(_dir)) != nullptr)
     {
@@ -276,61 +252,26 @@ bool FileSystemSDFAT::dir_open(const char * path, const char * pattern, uint16_t
             continue;
         // Debug_printf("Entry %s (%d)\n", d->d_name, d->d_type);
 
-        // Determine which list to put this in
-        if(d->d_type == DT_DIR || d->d_type == DT_LNK) // well, assume symlinks points to directories only
+        uint32_t size = 0;
+        time_t modified_time = 0;
+        snprintf(epath, sizeof(epath), "%s/%s", dpath, d->d_name);
+        if(stat(epath, &s) == 0)
         {
-			// Skip this entry if we're filtering directories and it doesn't match
-			if (filter_dirs && util_wildcard_match(d->d_name, thepat) == false)
-				continue;
-				
-            store_directories.push_back(fsdir_entry());
-            entry = &store_directories.back();
-            entry->isDir = true;
-        }
-        else
-        {
-            // Skip this entry if we have a search filter and it doesn't match it
-            if(have_pattern && util_wildcard_match(d->d_name, thepat) == false)
-                continue;
-
-            store_files.push_back(fsdir_entry());
-            entry = &store_files.back();
-            entry->isDir = false;
+            size = s.st_size;
+            modified_time = s.st_mtime;
         }
 
-        // Copy the data we want into the record
-        strlcpy(entry->filename, d->d_name, sizeof(entry->filename));
-        fpath = _make_fullpath(entry->filename);
-        if(stat(fpath, &s) == 0)
+        // well, assume symlinks points to directories only
+        if (!_dircache.add_entry(d->d_name, d->d_type == DT_DIR || d->d_type == DT_LNK, size, modified_time))
         {
-            entry->size = s.st_size;
-            entry->modified_time = s.st_mtime;
+            fits = false;
+            break;
         }
-        free(fpath);
     }
+    free(dpath);
 // !ESP_PLATFORM
 #endif
 
-    // Choose the appropriate sorting function
-    sort_fn_t sortfn;
-    if (diropts & DIR_OPTION_FILEDATE)
-    {
-        sortfn = (diropts & DIR_OPTION_DESCENDING) ? _fssd_fsdir_sort_time_descend : _fssd_fsdir_sort_time_ascend;
-    }
-    else
-    {
-        sortfn = (diropts & DIR_OPTION_DESCENDING) ? _fssd_fsdir_sort_name_descend : _fssd_fsdir_sort_name_ascend;        
-    }
-
-    // Sort each list
-    std::sort(store_directories.begin(), store_directories.end(), sortfn);
-    std::sort(store_files.begin(), store_files.end(), sortfn);
-
-    // Combine the folder and file entries
-    _dir_entries.reserve( store_directories.size() + store_files.size() );
-    _dir_entries = store_directories; // This copies the contents from one vector to the other
-    _dir_entries.insert( _dir_entries.end(), store_files.begin(), store_files.end() );
-
     // Future operations will be performed on the cache
 #ifdef ESP_PLATFORM
     f_closedir(&_dir);
@@ -338,45 +279,39 @@ bool FileSystemSDFAT::dir_open(const char * path, const char * pattern, uint16_t
     closedir(_dir);
 #endif
 
+    if (fits)
+    {
+        _dircache_valid = true;
+        _dircache_path = path;
+        _dircache_changes = _changes;
+        _dircache_mtime = dir_mtime;
+    }
+    else
+        Debug_printf("FileSystemSDFAT::dir_open \"%s\" too large, listing the first %u entries\n",
+                     path, (unsigned)_dircache.size());
+
+    _dircache.apply_filter(pattern, diropts);
     return true;
 }
 
+// The listing is kept for the next dir_open() of the same directory
 void FileSystemSDFAT::dir_close()
 {
-    // Throw out any existing directory entry data
-    _dir_entries.clear();
-    _dir_entries.shrink_to_fit();
-    _dir_entry_current = 0;
 }
 
 fsdir_entry * FileSystemSDFAT::dir_read()
 {
-    if(_dir_entry_current < _dir_entries.size())
-    {
-        //Debug_printf("#%d = \"%s\"\r\n", _dir_entry_current, _dir_entries[_dir_entry_current].filename);
-        return &_dir_entries[_dir_entry_current++];
-    }
-    else
-        return nullptr;
+    return _dircache.read();
 }
 
 uint16_t FileSystemSDFAT::dir_tell()
 {
-    if(_dir_entries.empty())
-        return FNFS_INVALID_DIRPOS;
-    else
-        return _dir_entry_current;
+    return _dircache.tell();
 }
 
 bool FileSystemSDFAT::dir_seek(uint16_t pos)
 {
-    if(pos < _dir_entries.size())
-    {
-        _dir_entry_current = pos;
-        return true;
-    }
-    else
-        return false;
+    return _dircache.seek(pos);
 }
 
 
@@ -386,6 +321,8 @@ FILE * FileSystemSDFAT::file_open(const char* path, const char* mode)
     char * fpath = _make_fullpath(path);
     FILE * result = fopen(fpath, mode);
     free(fpath);
+    if (result != nullptr && mode_writes(mode))
+        note_change();
     //Debug_printf("sdfileopen2: task hwm %u, %p\r\n", uxTaskGetStackHighWaterMark(NULL), pxTaskGetStackStart(NULL));
     Debug_printf("fopen = %s %s : %s\r\n", path, mode, result == nullptr ? "err" : "ok");
     return result;
@@ -395,6 +332,18 @@ FILE * FileSystemSDFAT::file_open(const char* path, const char* mode)
 FileHandler * FileSystemSDFAT::filehandler_open(const char* path, const char* mode)
 {
     //Debug_printf("FileSystemSDFAT::filehandler_open %s %s\r\n", path, mode);
+#ifdef ESP_PLATFORM
+    // Existing files, disk images among them, are opened through FatFs with a cluster link map
+    // so seeking around a large image doesn't walk the FAT each time. Anything that may create
+    // or truncate the file goes through the VFS as before
+    if (mode[0] == 'r')
+    {
+        FileHandlerFat *fat = new FileHandlerFat();
+        if (fat->open(path, mode))
+            return fat;
+        delete fat;
+    }
+#endif
     FILE * fh = file_open(path, mode);
     return (fh == nullptr) ? nullptr : new FileHandlerLocal(fh);
 }
@@ -416,6 +365,39 @@ bool FileSystemSDFAT::exists(const char* path)
 #endif
 }
 
+bool FileSystemSDFAT::preallocate(const char* path, uint32_t size)
+{
+    bool ok = false;
+#ifdef ESP_PLATFORM
+#if FF_USE_EXPAND
+    // f_expand only takes a run of free clusters, so a fragmented card still fails here
+    FIL fil;
+    if (f_open(&fil, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK)
+    {
+        ok = f_expand(&fil, size, 1) == FR_OK;
+        f_close(&fil);
+        if (!ok)
+            f_unlink(path);
+    }
+#endif
+#elif defined(__linux__)
+    char * fpath = _make_fullpath(path);
+    int fd = open(fpath, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+    if (fd >= 0)
+    {
+        ok = posix_fallocate(fd, 0, size) == 0;
+        ::close(fd);
+        if (!ok)
+            unlink(fpath);
+    }
+    free(fpath);
+#endif
+    if (ok)
+        note_change();
+    Debug_printf("FileSystemSDFAT::preallocate %lu bytes for \"%s\": %s\r\n", (unsigned long)size, path, ok ? "ok" : "no");
+    return ok;
+}
+
 long FileSystemSDFAT::filesize(const char *path)
 {
     char * fpath = _make_fullpath(path);
@@ -429,6 +411,7 @@ long FileSystemSDFAT::filesize(const char *path)
 
 bool FileSystemSDFAT::remove(const char* path)
 {
+    note_change();
 #ifdef ESP_PLATFORM
     FRESULT result = f_unlink(path);
     //Debug_printf("sdFileSystem::remove returned %d on \"%s\"\r\n", result, path);
@@ -534,6 +517,7 @@ bool FileSystemSDFAT::create_path(const char *path)
 
 bool FileSystemSDFAT::rename(const char* pathFrom, const char* pathTo)
 {
+    note_change();
 #ifdef ESP_PLATFORM
     FRESULT result = f_rename(pathFrom, pathTo);
     Debug_printf("FileSystemSDFAT::rename returned %d on \"%s\" -> \"%s\"\r\n", result, pathFrom, pathTo);
@@ -612,6 +596,28 @@ const char * FileSystemSDFAT::partition_type()
 }
 
 #ifdef ESP_PLATFORM
+// Clock rates tried from the fastest the board allows down, until the card reads back consistently
+static const int _sd_freqs_khz[] = { SDMMC_FREQ_HIGHSPEED, SDMMC_FREQ_26M, SDMMC_FREQ_DEFAULT };
+
+// Reads the start of the card twice and compares. A clock the wiring can't carry shows up
+// as read errors or data that doesn't match; not being able to get the buffers proves nothing
+static bool _sd_probe(sdmmc_card_t *card)
+{
+    size_t bytes = SD_PROBE_SECTORS * card->csd.sector_size;
+    uint8_t *first = (uint8_t *)heap_caps_malloc(bytes, MALLOC_CAP_DMA);
+    uint8_t *again = (uint8_t *)heap_caps_malloc(bytes, MALLOC_CAP_DMA);
+    bool ok = true;
+
+    for (int pass = 0; first != nullptr && again != nullptr && ok && pass < SD_PROBE_PASSES; pass++)
+        ok = sdmmc_read_sectors(card, first, 0, SD_PROBE_SECTORS) == ESP_OK &&
+             sdmmc_read_sectors(card, again, 0, SD_PROBE_SECTORS) == ESP_OK &&
+             memcmp(first, again, bytes) == 0;
+
+    heap_caps_free(first);
+    heap_caps_free(again);
+    return ok;
+}
+
 bool FileSystemSDFAT::start()
 {
     if(_started)
@@ -642,13 +648,10 @@ bool FileSystemSDFAT::start()
     slot_config.d3  = PIN_SD_HOST_D3;
     slot_config.wp  = PIN_SD_HOST_WP;
 
-    esp_err_t e = esp_vfs_fat_sdmmc_mount(_basepath, &host_config, &slot_config, &mount_config, &sdcard_info);
-
-#if SDMMC_HOST_WP_LEVEL
-    // Override WP routing of GPIO to SDMMC peripheral in order to omit inversion - the original routing is located at
-    // https://github.com/espressif/esp-idf/blob/51772f4fb5c2bbe25b60b4a51d707fa2afd3ac75/components/driver/sdmmc/sdmmc_host.c#L508-L510
-    esp_rom_gpio_connect_in_signal(PIN_SD_HOST_WP, sdmmc_slot_info[host_config.slot].write_protect, false);
-#endif
+    auto mount = [&]() {
+        return esp_vfs_fat_sdmmc_mount(_basepath, &host_config, &slot_config, &mount_config, &sdcard_info);
+    };
+    const char *bus = SDMMC_HOST_WIDTH == 4 ? "4 bit SDMMC" : "1 bit SDMMC";
 
 #else /* SDMMC_HOST_WIDTH */
 
@@ -676,15 +679,49 @@ bool FileSystemSDFAT::start()
     slot_config.gpio_cs = PIN_SD_HOST_CS;
     slot_config.host_id = SDSPI_DEFAULT_HOST;
 
-    esp_err_t e = esp_vfs_fat_sdspi_mount(_basepath, &host_config, &slot_config, &mount_config, &sdcard_info);
+    auto mount = [&]() {
+        return esp_vfs_fat_sdspi_mount(_basepath, &host_config, &slot_config, &mount_config, &sdcard_info);
+    };
+    const char *bus = "SPI";
 
 #endif /* SDMMC_HOST_WIDTH */
 
+    // Step down from the board's fastest clock until the card mounts and reads cleanly.
+    // The driver only switches the card to high speed if it says it supports it
+    esp_err_t e = ESP_FAIL;
+    const int slowest = _sd_freqs_khz[sizeof(_sd_freqs_khz) / sizeof(_sd_freqs_khz[0]) - 1];
+    for (int freq : _sd_freqs_khz)
+    {
+        if (freq > SD_HOST_MAX_FREQ_KHZ)
+            continue;
+
+        host_config.max_freq_khz = freq;
+        e = mount();
+        if (e != ESP_OK)
+        {
+            Debug_printf("SD mount at %dkHz failed with code #%d, \"%s\"\r\n", freq, e, esp_err_to_name(e));
+            continue;
+        }
+        if (freq == slowest || _sd_probe(sdcard_info))
+            break;
+
+        Debug_printf("SD reads unstable at %dkHz, slowing down\r\n", freq);
+        esp_vfs_fat_sdcard_unmount(_basepath, sdcard_info);
+        e = ESP_FAIL;
+    }
+
+#if defined(SDMMC_HOST_WIDTH) && SDMMC_HOST_WP_LEVEL
+    // Override WP routing of GPIO to SDMMC peripheral in order to omit inversion - the original routing is located at
+    // https://github.com/espressif/esp-idf/blob/51772f4fb5c2bbe25b60b4a51d707fa2afd3ac75/components/driver/sdmmc/sdmmc_host.c#L508-L510
+    if (e == ESP_OK)
+        esp_rom_gpio_connect_in_signal(PIN_SD_HOST_WP, sdmmc_slot_info[host_config.slot].write_protect, false);
+#endif
+
     if(e == ESP_OK)
     {
         _started = true;
         _card_capacity = (uint64_t)sdcard_info->csd.capacity * sdcard_info->csd.sector_size;
-        Debug_println("SD mounted.");
+        Debug_printf("SD mounted, %s at %dkHz.\r\n", bus, sdcard_info->max_freq_khz);
 
     /*
         Debug_printf("  manufacturer: %d, oem: 0x%x \"%c%c\"\r\n", sdcard_info->cid.mfg_id, sdcard_info->cid.oem_id,
@@ -6,8 +6,10 @@
 #endif
 
 #include <stdio.h>
+#include <string>
 
 #include "fnFS.h"
+#include "fnDirCache.h"
 
 class FileSystemSDFAT : public FileSystem
 {
@@ -18,6 +20,15 @@ private:
     DIR * _dir;
 #endif
     uint64_t _card_capacity = 0;
+
+    // The last directory listed, kept for the next dir_open() of the same path
+    DirCache _dircache;
+    bool _dircache_valid = false;
+    std::string _dircache_path;
+    uint32_t _dircache_changes = 0;
+    time_t _dircache_mtime = 0;
+
+    time_t _dir_mtime(const char *path);
 public:
 #ifdef ESP_PLATFORM
     bool start();
@@ -37,6 +48,7 @@ public:
 #endif
 
     bool exists(const char* path) override;
+    bool preallocate(const char* path, uint32_t size) override;
 
     bool remove(const char* path) override;
 
@@ -3,12 +3,17 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include "compat_string.h"
 
 #include "../../include/debug.h"
 
 #include "smb2/smb2.h"
+#include "smb2/libsmb2-raw.h"
 #include "fnFileSMB.h"
+#include "fnSMBPool.h"
+#include "fnSystem.h"
 
 FileSystemSMB::FileSystemSMB()
 {
@@ -26,55 +31,31 @@ FileSystemSMB::~FileSystemSMB()
     if (_started)
     {
         _dircache.clear();
-        smb2_disconnect_share(_smb);
         smb2_destroy_url(_url);
-        smb2_destroy_context(_smb);
+        // Left connected for the next one to open the share
+        smb_pool_release(_smb);
     }
 }
 
 bool FileSystemSMB::start(const char *url, const char *user, const char *password)
 {
-    int smb_error;
-
     if (_started)
         return false;
 
     if(url == nullptr || url[0] == '\0')
         return false;
 
-    _smb = smb2_init_context();
-    if (_smb == nullptr) 
-    {
-        Debug_printf("FileSystemSMB::start() - failed to init SMB2 context\n");
-        return false;
-    }
+    if (user == nullptr || password == nullptr)
+        user = password = nullptr;
 
-    _url = smb2_parse_url(_smb, url);
-    if (_url == nullptr) 
+    std::string error;
+    _smb = smb_pool_connect(url, user, password, &_url, &error);
+    if (_smb == nullptr)
     {
-        Debug_printf("FileSystemSMB::start() - failed to parse URL \"%s\", SMB2 error: %s\n", url, smb2_get_error(_smb));
+        Debug_printf("FileSystemSMB::start() - failed to connect share \"%s\", SMB2 error: %s\n", url, error.c_str());
         return false;
     }
 
-    smb2_set_security_mode(_smb, SMB2_NEGOTIATE_SIGNING_ENABLED);
-
-    if (user != nullptr && password != nullptr)
-    {
-        smb2_set_user(_smb, user);
-        smb2_set_password(_smb, password);
-        smb_error = smb2_connect_share(_smb, _url->server, _url->share, user);
-    }
-    else
-    {
-        smb_error = smb2_connect_share(_smb, _url->server, _url->share, _url->user);
-    }
-
-	if (smb_error != 0) 
-    {
-        Debug_printf("FileSystemSMB::start() - failed to connect share \"//%s/%s\", SMB2 error: %s\n", _url->server, _url->share, smb2_get_error(_smb));
-        return false;
-	}
-
     Debug_printf("SMB share connected: //%s/%s\n", _url->server, _url->share);
 
     _started = true;
@@ -100,6 +81,8 @@ bool FileSystemSMB::remove(const char *path)
     if (0 != smb2_stat(_smb, path, &st))
         return false;
 
+    note_change();
+
     int smb_error;
     if (st.smb2_type == SMB2_TYPE_DIRECTORY)
         smb_error = smb2_rmdir(_smb, path);
@@ -114,6 +97,7 @@ bool FileSystemSMB::remove(const char *path)
 
 bool FileSystemSMB::rename(const char *pathFrom, const char *pathTo)
 {
+    note_change();
     int smb_error = smb2_rename(_smb, pathFrom, pathTo);
     return smb_error == 0;    
 }
@@ -181,6 +165,225 @@ bool FileSystemSMB::is_dir(const char *path)
     return st.smb2_type == SMB2_TYPE_DIRECTORY;
 }
 
+/*
+ A listing in flight, shared by the callbacks of the compound requests reading it
+*/
+struct smb_dirlist
+{
+    DirCache *cache;
+    smb2_file_id file_id;
+    bool opened = false;
+    uint32_t status = SMB2_STATUS_SUCCESS; // First thing that went wrong
+    bool no_more = false; // The server has nothing left to list
+    bool full = false;    // The cache has no room for more
+    int pending = 0;
+    bool done = false;
+};
+
+static void _dirlist_reply(struct smb_dirlist *dl, uint32_t status)
+{
+    if (status != SMB2_STATUS_SUCCESS && dl->status == SMB2_STATUS_SUCCESS)
+        dl->status = status;
+    if (--dl->pending == 0)
+        dl->done = true;
+}
+
+static void _dirlist_create_cb(struct smb2_context *smb, int status, void *command_data, void *cb_data)
+{
+    struct smb_dirlist *dl = (struct smb_dirlist *)cb_data;
+    if (status == SMB2_STATUS_SUCCESS)
+    {
+        memcpy(dl->file_id, ((struct smb2_create_reply *)command_data)->file_id, SMB2_FD_SIZE);
+        dl->opened = true;
+    }
+    _dirlist_reply(dl, status);
+}
+
+static void _dirlist_query_cb(struct smb2_context *smb, int status, void *command_data, void *cb_data)
+{
+    struct smb_dirlist *dl = (struct smb_dirlist *)cb_data;
+
+    if ((uint32_t)status == SMB2_STATUS_NO_MORE_FILES)
+    {
+        dl->no_more = true;
+        status = SMB2_STATUS_SUCCESS;
+    }
+    else if (status == SMB2_STATUS_SUCCESS && !dl->full)
+    {
+        struct smb2_query_directory_reply *rep = (struct smb2_query_directory_reply *)command_data;
+        uint32_t offset = 0;
+
+        while (offset < rep->output_buffer_length)
+        {
+            struct smb2_iovec vec;
+            vec.buf = rep->output_buffer + offset;
+            vec.len = rep->output_buffer_length - offset;
+            vec.free = nullptr;
+
+            struct smb2_fileidfulldirectoryinformation fs;
+            if (smb2_decode_fileidfulldirectoryinformation(smb, &fs, &vec) < 0 || fs.name == nullptr)
+            {
+                status = SMB2_STATUS_INVALID_PARAMETER;
+                break;
+            }
+
+            // process only files and directories, i.e. skip SMB links, and skip hidden
+            if ((fs.file_attributes & SMB2_FILE_ATTRIBUTE_REPARSE_POINT) == 0 && fs.name[0] != '.')
+            {
+                bool isDir = (fs.file_attributes & SMB2_FILE_ATTRIBUTE_DIRECTORY) != 0;
+                if (isDir)
+                {
+                    Debug_printf(" add entry: \"%s\"\tDIR\n", fs.name);
+                }
+                else
+                {
+                    Debug_printf(" add entry: \"%s\"\t%llu\n", fs.name, (unsigned long long)fs.end_of_file);
+                }
+                if (!dl->cache->add_entry(fs.name, isDir, (uint32_t)fs.end_of_file, (time_t)fs.last_write_time.tv_sec))
+                    dl->full = true;
+            }
+            free((void *)fs.name);
+
+            if (dl->full || fs.next_entry_offset == 0)
+                break;
+            offset += fs.next_entry_offset;
+        }
+    }
+    _dirlist_reply(dl, status);
+}
+
+static void _dirlist_close_cb(struct smb2_context *smb, int status, void *command_data, void *cb_data)
+{
+    struct smb_dirlist *dl = (struct smb_dirlist *)cb_data;
+    dl->opened = false;
+    _dirlist_reply(dl, SMB2_STATUS_SUCCESS);
+}
+
+/*
+ Sends a CREATE of path, if there is one, then queries QUERY_DIRECTORYs and a CLOSE if close is set,
+ all as one compound request, and waits for the replies.
+ Returns false if they never came, when dl must be left to the callbacks.
+*/
+static bool _dirlist_send(struct smb2_context *smb, struct smb_dirlist *dl, const char *path, int queries, bool close)
+{
+    struct smb2_pdu *pdu = nullptr;
+    struct smb2_pdu *next;
+    // Within the compound the CREATE's handle isn't known yet
+    const uint8_t *file_id = path != nullptr ? compound_file_id : dl->file_id;
+
+    uint32_t buffer_length = SMB_DIRLIST_BUFFER;
+    uint32_t max_read = smb2_get_max_read_size(smb);
+    if (max_read > 0 && max_read < buffer_length)
+        buffer_length = max_read;
+
+    dl->pending = 0;
+    dl->done = false;
+
+    if (path != nullptr)
+    {
+        struct smb2_create_request req;
+        memset(&req, 0, sizeof(req));
+        req.requested_oplock_level = SMB2_OPLOCK_LEVEL_NONE;
+        req.impersonation_level = SMB2_IMPERSONATION_IMPERSONATION;
+        req.desired_access = SMB2_FILE_LIST_DIRECTORY | SMB2_FILE_READ_ATTRIBUTES;
+        req.file_attributes = SMB2_FILE_ATTRIBUTE_DIRECTORY;
+        req.share_access = SMB2_FILE_SHARE_READ | SMB2_FILE_SHARE_WRITE;
+        req.create_disposition = SMB2_FILE_OPEN;
+        req.create_options = SMB2_FILE_DIRECTORY_FILE;
+        req.name = path;
+
+        if ((pdu = smb2_cmd_create_async(smb, &req, _dirlist_create_cb, dl)) == nullptr)
+            goto fail;
+        dl->pending++;
+    }
+
+    for (int i = 0; i < queries; i++)
+    {
+        struct smb2_query_directory_request req;
+        memset(&req, 0, sizeof(req));
+        req.file_information_class = SMB2_FILE_ID_FULL_DIRECTORY_INFORMATION;
+        memcpy(req.file_id, file_id, SMB2_FD_SIZE);
+        req.output_buffer_length = buffer_length;
+        req.name = "*";
+
+        if ((next = smb2_cmd_query_directory_async(smb, &req, _dirlist_query_cb, dl)) == nullptr)
+            goto fail;
+        if (pdu == nullptr)
+            pdu = next;
+        else
+            smb2_add_compound_pdu(smb, pdu, next);
+        dl->pending++;
+    }
+
+    if (close)
+    {
+        struct smb2_close_request req;
+        memset(&req, 0, sizeof(req));
+        memcpy(req.file_id, file_id, SMB2_FD_SIZE);
+
+        if ((next = smb2_cmd_close_async(smb, &req, _dirlist_close_cb, dl)) == nullptr)
+            goto fail;
+        if (pdu == nullptr)
+            pdu = next;
+        else
+            smb2_add_compound_pdu(smb, pdu, next);
+        dl->pending++;
+    }
+
+    if (pdu == nullptr)
+        return true;
+
+    smb2_queue_pdu(smb, pdu);
+    return smb_wait(smb, &dl->done);
+
+fail:
+    Debug_printf("Failed to build directory request: %s\n", smb2_get_error(smb));
+    if (pdu != nullptr)
+        smb2_free_pdu(smb, pdu);
+    dl->pending = 0;
+    dl->status = SMB2_STATUS_INTERNAL_ERROR;
+    return true;
+}
+
+/*
+ Reads the whole of smb_path into _dircache. Opening, listing and closing go to the server
+ together, so most directories take a single round trip; one too big for that is listed
+ again with the directory kept open while it's read.
+*/
+bool FileSystemSMB::_list_dir(const char *smb_path)
+{
+    struct smb_dirlist *dl = new smb_dirlist;
+    dl->cache = &_dircache;
+
+    bool replied = _dirlist_send(_smb, dl, smb_path, 2, true);
+    if (replied && dl->status == SMB2_STATUS_SUCCESS && !dl->no_more && !dl->full)
+    {
+        Debug_printf("Large directory, listing it again\n");
+        _dircache.clear();
+        replied = _dirlist_send(_smb, dl, smb_path, 2, false);
+        while (replied && dl->status == SMB2_STATUS_SUCCESS && !dl->no_more && !dl->full)
+            replied = _dirlist_send(_smb, dl, nullptr, 2, false);
+        if (replied && dl->opened)
+            replied = _dirlist_send(_smb, dl, nullptr, 0, true);
+    }
+
+    if (!replied)
+    {
+        // Replies may still come in for it
+        Debug_printf("Failed to list directory: %s\n", smb2_get_error(_smb));
+        return false;
+    }
+
+    bool result = dl->status == SMB2_STATUS_SUCCESS;
+    if (!result)
+        Debug_printf("Failed to list directory: 0x%08x %s\n", (unsigned)dl->status, nterror_to_str(dl->status));
+    else if (dl->full)
+        Debug_println("Directory too large for cache, listing truncated");
+
+    delete dl;
+    return result;
+}
+
 bool FileSystemSMB::dir_open(const char  *path, const char *pattern, uint16_t diropts)
 {
     if(!_started)
@@ -193,7 +396,10 @@ bool FileSystemSMB::dir_open(const char  *path, const char *pattern, uint16_t di
     if (smb_path != nullptr && smb_path[0] == '/')
         smb_path += 1;
 
-    if (strcmp(_last_dir, smb_path) == 0)
+    // Reuse the listing of the directory we were just in, unless it's old or
+    // we've since changed something
+    if (strcmp(_last_dir, smb_path) == 0 && _last_dir_changes == changes() &&
+        fnSystem.millis() - _last_dir_time <= SMB_DIRCACHE_TTL_MS)
     {
         Debug_printf("Use directory cache\n");
     }
@@ -206,52 +412,13 @@ bool FileSystemSMB::dir_open(const char  *path, const char *pattern, uint16_t di
         _last_dir[0] = '/';
         _last_dir[1] = '\0';
 
-        // Open SMB directory
-        struct smb2dir *smb_dir;
-
-        smb_dir = smb2_opendir(_smb, smb_path);
-        if (smb_dir == nullptr)
-        {
-            Debug_printf("Failed to open directory: %s\n", smb2_get_error(_smb));
+        if (!_list_dir(smb_path))
             return false;
-        }
 
         // Remember last visited directory
         strlcpy(_last_dir, smb_path, MAX_PATHLEN);
-
-        // Populate directory cache with entries
-        smb2dirent *smb_de;
-        fsdir_entry *fs_de;
-
-        while ((smb_de = smb2_readdir(_smb, smb_dir)) != nullptr)
-        {
-            // process only files and directories, i.e. skip SMB links - TODO handle links?
-            if (smb_de->st.smb2_type != SMB2_TYPE_FILE && smb_de->st.smb2_type != SMB2_TYPE_DIRECTORY)
-                continue;
-
-            // skip hidden
-            if (smb_de->name[0] == '.')
-                continue;
-
-            // new dir entry
-            fs_de = &_dircache.new_entry();
-
-            // set entry members
-            strlcpy(fs_de->filename, smb_de->name, sizeof(fs_de->filename));
-            fs_de->isDir = smb_de->st.smb2_type == SMB2_TYPE_DIRECTORY;
-            fs_de->size = (uint32_t)smb_de->st.smb2_size;
-            fs_de->modified_time = (time_t)smb_de->st.smb2_mtime;
-
-            if (fs_de->isDir)
-            {
-                Debug_printf(" add entry: \"%s\"\tDIR\n", fs_de->filename);
-            }
-            else
-            {
-                Debug_printf(" add entry: \"%s\"\t%lu\n", fs_de->filename, fs_de->size);
-            }
-        }
-        smb2_closedir(_smb, smb_dir);
+        _last_dir_time = fnSystem.millis();
+        _last_dir_changes = changes();
     }
 
     // Apply pattern matching filter and sort entries
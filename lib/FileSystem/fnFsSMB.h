@@ -8,6 +8,15 @@
 #include "fnFS.h"
 #include "fnDirCache.h"
 
+// How long a directory listing is reused before it's read from the server again
+#define SMB_DIRCACHE_TTL_MS 30000
+// Most listing asked for per QUERY_DIRECTORY, cut down to what the server allows
+#ifdef ESP_PLATFORM
+#define SMB_DIRLIST_BUFFER 16384
+#else
+#define SMB_DIRLIST_BUFFER 65535
+#endif
+
 
 class FileSystemSMB : public FileSystem
 {
@@ -18,6 +27,10 @@ private:
     // directory cache
     char _last_dir[MAX_PATHLEN];
     DirCache _dircache;
+    uint64_t _last_dir_time = 0;
+    uint32_t _last_dir_changes = 0;
+
+    bool _list_dir(const char *smb_path);
 
 public:
     FileSystemSMB();
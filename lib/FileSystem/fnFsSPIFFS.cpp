@@ -6,6 +6,7 @@
 #ifdef ESP_PLATFORM
 #include <esp_vfs.h>
 #include <esp_spiffs.h>
+#include "fnAssets.h"
 #endif
 
 #include <sys/stat.h>
@@ -91,7 +92,22 @@ bool FileSystemSPIFFS::dir_seek(uint16_t)
 FILE * FileSystemSPIFFS::file_open(const char* path, const char* mode)
 {
     char * fpath = _make_fullpath(path);
-    FILE * result = fopen(fpath, mode);
+    FILE * result = nullptr;
+    bool read_only = mode[0] == 'r' && strchr(mode, '+') == nullptr;
+    // Small files being read come from RAM; opening one any other way may change it
+    if (read_only)
+        result = _cache.open(fpath);
+    else
+        _cache.forget(fpath);
+    if (result == nullptr)
+        result = fopen(fpath, mode);
+    // Only a file the filesystem doesn't have comes from the asset partition
+    if (result == nullptr && read_only)
+    {
+#ifdef ESP_PLATFORM
+        result = fnAssets.open(path);
+#endif
+    }
     free(fpath);
     return result;
 }
@@ -112,12 +128,35 @@ bool FileSystemSPIFFS::exists(const char* path)
     int i = stat(fpath, &st);
     //Debug_printf("FileSystemSPIFFS::exists returned %d on \"%s\" (%s)\r\n", i, path, fpath);
     free(fpath);
+#ifdef ESP_PLATFORM
+    size_t asset_size;
+    if (i != 0 && fnAssets.find(path, &asset_size) != nullptr)
+        return true;
+#endif
     return (i == 0);
 }
 
+// Size of the file file_open() would open, from the filesystem or the asset partition
+long FileSystemSPIFFS::filesize(const char *path)
+{
+    char * fpath = _make_fullpath(path);
+    struct stat st;
+    int i = stat(fpath, &st);
+    free(fpath);
+    if (i == 0)
+        return st.st_size;
+#ifdef ESP_PLATFORM
+    size_t asset_size;
+    if (fnAssets.find(path, &asset_size) != nullptr)
+        return asset_size;
+#endif
+    return -1;
+}
+
 bool FileSystemSPIFFS::remove(const char* path)
 {
     char * fpath = _make_fullpath(path);
+    _cache.forget(fpath);
     int i = ::remove(fpath);
     Debug_printf("FileSystemSPIFFS::remove returned %d on \"%s\" (%s)\r\n", i, path, fpath);
     free(fpath);
@@ -128,6 +167,8 @@ bool FileSystemSPIFFS::rename(const char* pathFrom, const char* pathTo)
 {
     char * spath = _make_fullpath(pathFrom);
     char * dpath = _make_fullpath(pathTo);
+    _cache.forget(spath);
+    _cache.forget(dpath);
     int i = ::rename(spath, dpath);
     Debug_printf("FileSystemSPIFFS::rename returned %d on \"%s\" -> \"%s\" (%s -> %s)\r\n", i, pathFrom, pathTo, spath, dpath);
     free(spath);
@@ -5,12 +5,14 @@
 #include "compat_dirent.h"
 
 #include "fnFS.h"
+#include "fnFlashCache.h"
 
 
 class FileSystemSPIFFS : public FileSystem
 {
 private:
     DIR * _dir = nullptr;
+    FlashFileCache _cache;
 public:
     FileSystemSPIFFS();
     bool start();
@@ -26,6 +28,7 @@ public:
 #endif
 
     bool exists(const char* path) override;
+    long filesize(const char *path) override;
 
     bool remove(const char* path) override;
 
@@ -4,6 +4,10 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <libgen.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #ifdef ESP_PLATFORM
 #include "fnFsTNFSvfs.h"
@@ -17,48 +21,51 @@
 #include "compat_string.h"
 #include "../../include/debug.h"
 
-FileSystemTNFS fnTNFS;
-
-FileSystemTNFS::FileSystemTNFS()
-{
-    // TODO: Maybe allocate space for our TNFS packet so it doesn't have to get put on the stack?
-}
-
-FileSystemTNFS::~FileSystemTNFS()
+struct tnfsPoolEntry
 {
-    if (_started)
-        tnfs_umount(&_mountinfo);
+    // What start() was called with, used to find the session again
+    std::string host;
+    uint16_t port;
+    std::string mountpath;
+    std::string user;
+    std::string password;
+
+    tnfsMountInfo mountinfo;
+    int refcount = 0;
+    // Set when a keep-alive goes unanswered; checked before the session is handed out again
+    bool stale = false;
+    // Set while the first user mounts it; anyone else after the same session waits
+    bool mounting = false;
 #ifdef ESP_PLATFORM
-    if(_basepath[0] != '\0')
-    vfs_tnfs_unregister(_basepath);
-
-    if (keepAliveTimerHandle != nullptr)
-    {
-        esp_timer_stop(keepAliveTimerHandle);
-        esp_timer_delete(keepAliveTimerHandle);
-        keepAliveTimerHandle = nullptr;
-    }
+    char basepath[20] = { '\0' };
+    esp_timer_handle_t keepAliveTimerHandle = nullptr;
 #endif
-}
+};
 
-bool FileSystemTNFS::start(const char *host, uint16_t port, const char * mountpath, const char * userid, const char * password)
-{
-    if (_started)
-        return false;
+static std::vector<tnfsPoolEntry *> _tnfs_pool;
+static std::recursive_mutex _tnfs_pool_mutex;
+static std::condition_variable_any _tnfs_pool_cv;
 
-    if(host == nullptr)
-        return false;
+FileSystemTNFS fnTNFS;
+
+static const char *_pool_str(const char *s) { return s == nullptr ? "" : s; }
+
+// Mounts the server described by a new pool entry. Returns false on failure
+static bool _tnfs_pool_mount(tnfsPoolEntry *entry)
+{
+    tnfsMountInfo &mi = entry->mountinfo;
+    const char *host = entry->host.c_str();
 
     const char *host_no_prefix;
     if (strncmp("_tcp.", host, 5) == 0)
     {
         host_no_prefix = &host[5];
-        _mountinfo.protocol = TNFS_PROTOCOL_TCP;
+        mi.protocol = TNFS_PROTOCOL_TCP;
     }
     else if (strncmp("_udp.", host, 5) == 0)
     {
         host_no_prefix = &host[5];
-        _mountinfo.protocol = TNFS_PROTOCOL_UDP;
+        mi.protocol = TNFS_PROTOCOL_UDP;
     }
     else
     {
@@ -68,69 +75,215 @@ bool FileSystemTNFS::start(const char *host, uint16_t port, const char * mountpa
     {
             return false;
     }
-    strlcpy(_mountinfo.hostname, host_no_prefix, sizeof(_mountinfo.hostname));
+    strlcpy(mi.hostname, host_no_prefix, sizeof(mi.hostname));
 
     // Try to resolve the hostname and store that so we don't have to keep looking it up
-    _mountinfo.host_ip = get_ip4_addr_by_name(_mountinfo.hostname);
-    if(_mountinfo.host_ip == IPADDR_NONE)
+    mi.host_ip = get_ip4_addr_by_name(mi.hostname);
+    if(mi.host_ip == IPADDR_NONE)
     {
-        Debug_printf("Failed to resolve hostname \"%s\"\r\n", _mountinfo.hostname);
+        Debug_printf("Failed to resolve hostname \"%s\"\r\n", mi.hostname);
         return false;
     }
-    // TODO: Refresh the DNS name we resolved after X amount of time
-    _last_dns_refresh = fnSystem.millis();
 
-    _mountinfo.port = port;
-    _mountinfo.session = TNFS_INVALID_SESSION;
+    mi.port = entry->port;
+    mi.session = TNFS_INVALID_SESSION;
 
-    if(mountpath != nullptr)
-        strlcpy(_mountinfo.mountpath, mountpath, sizeof(_mountinfo.mountpath));
-    else
-        _mountinfo.mountpath[0] = '\0';
+    strlcpy(mi.mountpath, entry->mountpath.c_str(), sizeof(mi.mountpath));
+    strlcpy(mi.user, entry->user.c_str(), sizeof(mi.user));
+    strlcpy(mi.password, entry->password.c_str(), sizeof(mi.password));
 
-    if(userid != nullptr)
-        strlcpy(_mountinfo.user, userid, sizeof(_mountinfo.user));
-    else
-        _mountinfo.user[0] = '\0';
-
-    if(password != nullptr)
-        strlcpy(_mountinfo.password, password, sizeof(_mountinfo.password));
-    else
-        _mountinfo.password[0] = '\0';
-
-    Debug_printf("TNFS mount %s[%s]:%hu\r\n", _mountinfo.hostname, compat_inet_ntoa(_mountinfo.host_ip), _mountinfo.port);
+    Debug_printf("TNFS mount %s[%s]:%hu\r\n", mi.hostname, compat_inet_ntoa(mi.host_ip), mi.port);
 
-    int r = tnfs_mount(&_mountinfo);
+    int r = tnfs_mount(&mi);
     if (r != TNFS_RESULT_SUCCESS)
     {
         Debug_printf("TNFS mount failed with code %d\r\n", r);
-        _mountinfo.mountpath[0] = '\0';
-        _started = false;
+        mi.mountpath[0] = '\0';
         return false;
     }
-    Debug_printf("TNFS mount successful. session: 0x%hx, version: 0x%04hx, min_retry: %hums\r\n", _mountinfo.session, _mountinfo.server_version, _mountinfo.min_retry_ms);
+    Debug_printf("TNFS mount successful. session: 0x%hx, version: 0x%04hx, min_retry: %hums\r\n", mi.session, mi.server_version, mi.min_retry_ms);
 
 #ifdef ESP_PLATFORM
+    // Mounts of other servers run alongside this one, but registering with the VFS doesn't take turns by itself
+    std::lock_guard<std::recursive_mutex> lock(_tnfs_pool_mutex);
+
     // Register a new VFS driver to handle this connection
-    if(vfs_tnfs_register(_mountinfo, _basepath, sizeof(_basepath)) != 0)
+    if(vfs_tnfs_register(mi, entry->basepath, sizeof(entry->basepath)) != 0)
     {
         Debug_println("Failed to register VFS driver!");
+        tnfs_umount(&mi);
         return false;
     }
 
     esp_timer_create_args_t tcfg = {
         .callback = keepAliveTNFS,
-        .arg = this,
+        .arg = entry,
         .dispatch_method = esp_timer_dispatch_t::ESP_TIMER_TASK,
         .name = "tnfs_keep_alive",
         .skip_unhandled_events = true,
     };
-    esp_timer_create(&tcfg, &keepAliveTimerHandle);
+    esp_timer_create(&tcfg, &entry->keepAliveTimerHandle);
     // Send a keep-alive message every 60s.
-    esp_timer_start_periodic(keepAliveTimerHandle, 60 * 1000000);
+    esp_timer_start_periodic(entry->keepAliveTimerHandle, 60 * 1000000);
+#endif
+
+    return true;
+}
+
+static void _tnfs_pool_unmount(tnfsPoolEntry *entry)
+{
+#ifdef ESP_PLATFORM
+    if (entry->keepAliveTimerHandle != nullptr)
+    {
+        esp_timer_stop(entry->keepAliveTimerHandle);
+        esp_timer_delete(entry->keepAliveTimerHandle);
+        entry->keepAliveTimerHandle = nullptr;
+    }
+
+    if(entry->basepath[0] != '\0')
+        vfs_tnfs_unregister(entry->basepath);
+#endif
+    tnfs_umount(&entry->mountinfo);
+}
+
+/*
+ Hands out the session for host/port/mountpath/user, mounting it if nobody has it yet.
+ A session whose keep-alive went unanswered is checked with a STAT first; if that
+ gets an answer (the library re-mounts an expired session by itself) it's reused,
+ otherwise it's dropped from the pool and mounted fresh.
+ The pool isn't held while a new session mounts, so different servers mount at the same time.
+ Returns nullptr on failure.
+*/
+static tnfsPoolEntry *_tnfs_pool_acquire(const char *host, uint16_t port, const char *mountpath, const char *userid, const char *password)
+{
+    std::unique_lock<std::recursive_mutex> lock(_tnfs_pool_mutex);
+
+    while (true)
+    {
+        auto it = _tnfs_pool.begin();
+        for (; it != _tnfs_pool.end(); ++it)
+        {
+            tnfsPoolEntry *e = *it;
+            if (e->host == host && e->port == port && e->mountpath == _pool_str(mountpath) &&
+                e->user == _pool_str(userid) && e->password == _pool_str(password))
+                break;
+        }
+        if (it == _tnfs_pool.end())
+            break;
+
+        tnfsPoolEntry *entry = *it;
+        if (entry->mounting)
+        {
+            // Look again once someone's mount finishes, this one may have failed and be gone
+            _tnfs_pool_cv.wait(lock);
+            continue;
+        }
+
+        if (entry->stale)
+        {
+            tnfsStat tstat;
+            if (tnfs_stat(&entry->mountinfo, &tstat, "/") == -1)
+            {
+                Debug_printf("TNFS pooled session to \"%s\" is gone\r\n", host);
+                // Anyone still holding it keeps their reference; it's freed with the last one
+                _tnfs_pool.erase(it);
+                if (entry->refcount == 0)
+                {
+                    _tnfs_pool_unmount(entry);
+                    delete entry;
+                }
+                break;
+            }
+            entry->stale = false;
+        }
+
+        entry->refcount++;
+        Debug_printf("TNFS reusing session 0x%hx to \"%s\" (%d users)\r\n", entry->mountinfo.session, host, entry->refcount);
+        return entry;
+    }
+
+    tnfsPoolEntry *entry = new tnfsPoolEntry;
+    entry->host = host;
+    entry->port = port;
+    entry->mountpath = _pool_str(mountpath);
+    entry->user = _pool_str(userid);
+    entry->password = _pool_str(password);
+    entry->refcount = 1;
+    entry->mounting = true;
+    _tnfs_pool.push_back(entry);
+
+    lock.unlock();
+    bool mounted = _tnfs_pool_mount(entry);
+    lock.lock();
+
+    entry->mounting = false;
+    _tnfs_pool_cv.notify_all();
+    if (!mounted)
+    {
+        for (auto it = _tnfs_pool.begin(); it != _tnfs_pool.end(); ++it)
+        {
+            if (*it == entry)
+            {
+                _tnfs_pool.erase(it);
+                break;
+            }
+        }
+        delete entry;
+        return nullptr;
+    }
+    return entry;
+}
+
+// Drops a reference to a session, unmounting it when the last one goes
+static void _tnfs_pool_release(tnfsPoolEntry *entry)
+{
+    std::lock_guard<std::recursive_mutex> lock(_tnfs_pool_mutex);
+
+    if (--entry->refcount > 0)
+        return;
+
+    for (auto it = _tnfs_pool.begin(); it != _tnfs_pool.end(); ++it)
+    {
+        if (*it == entry)
+        {
+            _tnfs_pool.erase(it);
+            break;
+        }
+    }
+    _tnfs_pool_unmount(entry);
+    delete entry;
+}
+
+FileSystemTNFS::FileSystemTNFS()
+{
+    // TODO: Maybe allocate space for our TNFS packet so it doesn't have to get put on the stack?
+}
+
+FileSystemTNFS::~FileSystemTNFS()
+{
+    if (_pool_entry != nullptr)
+        _tnfs_pool_release(_pool_entry);
+}
+
+bool FileSystemTNFS::start(const char *host, uint16_t port, const char * mountpath, const char * userid, const char * password)
+{
+    if (_started)
+        return false;
+
+    if(host == nullptr)
+        return false;
+
+    _pool_entry = _tnfs_pool_acquire(host, port, mountpath, userid, password);
+    if (_pool_entry == nullptr)
+        return false;
+
+    _mountinfo = &_pool_entry->mountinfo;
+#ifdef ESP_PLATFORM
+    strlcpy(_basepath, _pool_entry->basepath, sizeof(_basepath));
 #endif
 
     _started = true;
+    _server_filters = true;
 
     return true;
 }
@@ -139,7 +292,7 @@ bool FileSystemTNFS::exists(const char* path)
 {
     tnfsStat tstat;
 
-    int result = tnfs_stat(&_mountinfo, &tstat, path);
+    int result = tnfs_stat(_mountinfo, &tstat, path);
 
     return result == TNFS_RESULT_SUCCESS;
 }
@@ -151,21 +304,24 @@ bool FileSystemTNFS::remove(const char* path)
 
     // Figure out if this is a file or directory
     tnfsStat tstat;
-    if(TNFS_RESULT_SUCCESS != tnfs_stat(&_mountinfo, &tstat, path))
+    if(TNFS_RESULT_SUCCESS != tnfs_stat(_mountinfo, &tstat, path))
         return false;
 
+    note_change();
+
     int result;
     if(tstat.isDir)
-        result = tnfs_rmdir(&_mountinfo, path);
+        result = tnfs_rmdir(_mountinfo, path);
     else
-        result = tnfs_unlink(&_mountinfo, path);
+        result = tnfs_unlink(_mountinfo, path);
 
     return result == TNFS_RESULT_SUCCESS;
 }
 
 bool FileSystemTNFS::rename(const char* pathFrom, const char* pathTo)
 {
-    int result = tnfs_rename(&_mountinfo, pathFrom, pathTo);
+    note_change();
+    int result = tnfs_rename(_mountinfo, pathFrom, pathTo);
     return result == TNFS_RESULT_SUCCESS;
 }
 
@@ -194,7 +350,7 @@ bool FileSystemTNFS::is_dir(const char *path)
     return (info.st_mode == S_IFDIR) ? true: false;
 #else
     tnfsStat tstat;
-    int result = tnfs_stat(&_mountinfo, &tstat, path);
+    int result = tnfs_stat(_mountinfo, &tstat, path);
     return tstat.isDir ? true : false;
 #endif
 }
@@ -243,7 +399,7 @@ FileHandler * FileSystemTNFS::filehandler_open(const char* path, const char* mod
         return nullptr;
     }
 
-    int result = tnfs_open(&_mountinfo, path, open_mode, create_perms, &handle);
+    int result = tnfs_open(_mountinfo, path, open_mode, create_perms, &handle);
     if(result != TNFS_RESULT_SUCCESS)
     {
         #ifdef DEBUG
@@ -253,7 +409,7 @@ FileHandler * FileSystemTNFS::filehandler_open(const char* path, const char* mod
         return nullptr;
     }
     errno = 0;
-    return new FileHandlerTNFS(&_mountinfo, handle);
+    return new FileHandlerTNFS(_mountinfo, handle);
 #endif
 }
 #endif
@@ -293,7 +449,26 @@ bool FileSystemTNFS::dir_open(const char * path, const char *pattern, uint16_t d
     if(diropts & DIR_OPTION_FILEDATE)
         s_opt |= TNFS_DIRSORT_MODIFIED;
 
-    if(TNFS_RESULT_SUCCESS == tnfs_opendirx(&_mountinfo, path, s_opt, d_opt, thepat, 0))
+    // Have the server sort and filter the listing so it arrives ready to use. A
+    // server that turns the options down is asked for the bare listing instead,
+    // which is then sorted and filtered here. Recursive searches can't be done
+    // locally, so those always go to the server.
+    bool local_filter = false;
+    int result = TNFS_RESULT_FUNCTION_UNIMPLEMENTED;
+    if (_server_filters || (d_opt & TNFS_DIROPT_TRAVERSE))
+        result = tnfs_opendirx(_mountinfo, path, s_opt, d_opt, thepat, 0);
+    if (result == TNFS_RESULT_FUNCTION_UNIMPLEMENTED && !(d_opt & TNFS_DIROPT_TRAVERSE))
+    {
+        if (_server_filters)
+        {
+            Debug_print("FileSystemTNFS::dir_open server can't sort or filter, doing it locally\n");
+            _server_filters = false;
+        }
+        local_filter = true;
+        result = tnfs_opendirx(_mountinfo, path, TNFS_DIRSORT_NONE);
+    }
+
+    if(TNFS_RESULT_SUCCESS == result)
     {
         // Save the directory for later use, making sure it starts and ends with '/''
         if(path[0] != '/')
@@ -312,6 +487,42 @@ bool FileSystemTNFS::dir_open(const char * path, const char *pattern, uint16_t d
             _current_dirpath[l+1] = '\0';
         }
 
+        // Pull in the whole listing so paging through it later costs nothing
+        _dircache.clear();
+        _dir_cached = true;
+        tnfsStat fstat;
+        while (TNFS_RESULT_SUCCESS == tnfs_readdirx(_mountinfo, &fstat, _direntry.filename, sizeof(_direntry.filename)))
+        {
+            if (!_dircache.add_entry(_direntry.filename, fstat.isDir, fstat.filesize, fstat.m_time))
+            {
+                Debug_printf("FileSystemTNFS::dir_open \"%s\" too large to cache, reading from server\n", _current_dirpath);
+                _dir_cached = false;
+                _dircache.clear();
+                break;
+            }
+        }
+
+        if (_dir_cached)
+        {
+            tnfs_closedir(_mountinfo);
+            // Only re-sort when the server didn't do it for us
+            if (local_filter)
+                _dircache.apply_filter(pattern, diropts);
+            else
+                _dircache.apply_no_filter();
+        }
+        else if (local_filter)
+        {
+            // Paging through the server would hand back an unsorted, unfiltered listing
+            tnfs_closedir(_mountinfo);
+            return false;
+        }
+        else if (TNFS_RESULT_SUCCESS != tnfs_seekdir(_mountinfo, 0))
+        {
+            tnfs_closedir(_mountinfo);
+            return false;
+        }
+
         return true;
     }
 
@@ -323,10 +534,13 @@ fsdir_entry * FileSystemTNFS::dir_read()
     if(!_started)
         return nullptr;
 
+    if (_dir_cached)
+        return _dircache.read();
+
     tnfsStat fstat;
 
     _direntry.filename[0] = '\0';
-    if(TNFS_RESULT_SUCCESS != tnfs_readdirx(&_mountinfo, &fstat, _direntry.filename, sizeof(_direntry.filename)))
+    if(TNFS_RESULT_SUCCESS != tnfs_readdirx(_mountinfo, &fstat, _direntry.filename, sizeof(_direntry.filename)))
         return nullptr;
 
     _direntry.size = fstat.filesize;
@@ -340,7 +554,13 @@ void FileSystemTNFS::dir_close()
 {
     if(!_started)
         return;
-    tnfs_closedir(&_mountinfo);
+    if (_dir_cached)
+    {
+        _dircache.clear();
+        _dir_cached = false;
+    }
+    else
+        tnfs_closedir(_mountinfo);
     _current_dirpath[0] = '\0';
 }
 
@@ -349,8 +569,11 @@ uint16_t FileSystemTNFS::dir_tell()
     if(!_started)
         return FNFS_INVALID_DIRPOS;;
 
+    if (_dir_cached)
+        return _dircache.tell();
+
     uint16_t position;
-    if(0 != tnfs_telldir(&_mountinfo, &position))
+    if(0 != tnfs_telldir(_mountinfo, &position))
         position = FNFS_INVALID_DIRPOS;
 
     return position;
@@ -361,16 +584,21 @@ bool FileSystemTNFS::dir_seek(uint16_t position)
     if(!_started)
         return false;
 
-    return 0 == tnfs_seekdir(&_mountinfo, position);
+    if (_dir_cached)
+        return _dircache.seek(position);
+
+    return 0 == tnfs_seekdir(_mountinfo, position);
 }
 
 #ifdef ESP_PLATFORM
-void keepAliveTNFS(void *info)
+void keepAliveTNFS(void *entry)
 {
 #ifdef VERBOSE_TNFS
     Debug_println("Sending keep-alive command");
 #endif
-    FileSystemTNFS *parent = (FileSystemTNFS *)info;
-    parent->exists("keep-alive");
+    tnfsPoolEntry *pool_entry = (tnfsPoolEntry *)entry;
+    tnfsStat tstat;
+    // An expired session is re-mounted by the library; no answer at all means the server's gone
+    pool_entry->stale = tnfs_stat(&pool_entry->mountinfo, &tstat, "keep-alive") == -1;
 }
 #endif
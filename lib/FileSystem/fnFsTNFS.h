@@ -2,22 +2,26 @@
 #define _FN_FSTNFS_
 
 #include "fnFS.h"
+#include "fnDirCache.h"
 #include "tnfslib.h"
 #ifdef ESP_PLATFORM
 #include <esp_timer.h>
 #endif /* ESP_PLATFORM */
 
+// A TNFS session shared by every FileSystemTNFS started with the same host, port, mount and user
+struct tnfsPoolEntry;
+
 class FileSystemTNFS : public FileSystem
 {
 private:
-    tnfsMountInfo _mountinfo;
-#ifdef ESP_PLATFORM
-    unsigned long _last_dns_refresh  = 0;
-    esp_timer_handle_t keepAliveTimerHandle = nullptr;
-#else
-    uint64_t _last_dns_refresh  = 0;
-#endif
+    tnfsPoolEntry *_pool_entry = nullptr;
+    tnfsMountInfo *_mountinfo = nullptr;
     char _current_dirpath[TNFS_MAX_FILELEN];
+    // The open directory is read in full up front; when it's too big for that we page through the server
+    DirCache _dircache;
+    bool _dir_cached = false;
+    // Cleared once the server refuses OPENDIRX sort and pattern options
+    bool _server_filters = true;
 
 public:
     FileSystemTNFS();
@@ -54,7 +58,7 @@ public:
 extern FileSystemTNFS fnTNFS;
 
 #ifdef ESP_PLATFORM
-void keepAliveTNFS(void *info);
+void keepAliveTNFS(void *entry);
 #endif
 
 #endif // _FN_FSTNFS_
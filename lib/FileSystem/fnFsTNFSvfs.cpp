@@ -23,6 +23,7 @@
     ssize_t (*write_p)(void* p, int fd, const void * data, size_t size);
     off_t (*lseek_p)(void* p, int fd, off_t size, int mode);
     int (*fstat_p)(void* ctx, int fd, struct stat * st);
+    int (*fsync_p)(void* ctx, int fd);
     int (*unlink_p)(void* ctx, const char *path);
     int (*rename_p)(void* ctx, const char *src, const char *dst);
     int (*mkdir_p)(void* ctx, const char* name, mode_t mode);
@@ -237,6 +238,19 @@ int vfs_tnfs_fstat(void* ctx, int fd, struct stat * st)
     return vfs_tnfs_stat(mi, path, st);
 }
 
+int vfs_tnfs_fsync(void* ctx, int fd)
+{
+    tnfsMountInfo *mi = (tnfsMountInfo *)ctx;
+
+    int result = tnfs_sync(mi, fd);
+    if(result != TNFS_RESULT_SUCCESS)
+    {
+        errno = tnfs_code_to_errno(result);
+        return -1;
+    }
+    errno = 0;
+    return 0;
+}
 
 // Register our functions and use tnfsMountInfo as our context
 // New basepath will be stored in basepath
@@ -254,6 +268,7 @@ esp_err_t vfs_tnfs_register(tnfsMountInfo &m_info, char *basepath, int basepathl
     vfs.stat_p = &vfs_tnfs_stat;
     vfs.fstat_p = &vfs_tnfs_fstat;
     vfs.lseek_p = &vfs_tnfs_lseek;
+    vfs.fsync_p = &vfs_tnfs_fsync;
     vfs.unlink_p = &vfs_tnfs_unlink;
     vfs.rename_p = &vfs_tnfs_rename;
 
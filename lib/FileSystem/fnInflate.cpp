@@ -0,0 +1,417 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fnInflate.h"
+#include "../../include/debug.h"
+
+#define GZIP_FLAG_HCRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
+
+static const uint16_t _length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t _length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t _dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t _dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Order the code length code lengths come in
+static const uint8_t _clen_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+fnInflate::~fnInflate()
+{
+    free(_in);
+    free(_window);
+}
+
+bool fnInflate::begin(FileHandler *src, long int offset)
+{
+    if (_window == nullptr)
+        _window = (uint8_t *)malloc(INFLATE_WINDOW_SIZE);
+    if (_in == nullptr)
+        _in = (uint8_t *)malloc(INFLATE_INPUT_SIZE);
+    if (_window == nullptr || _in == nullptr)
+    {
+        Debug_println("fnInflate::begin - no room for the window");
+        _state = STATE_ERROR;
+        return false;
+    }
+
+    _src = src;
+    if (_src->seek(offset, SEEK_SET) != 0)
+    {
+        _state = STATE_ERROR;
+        return false;
+    }
+    _in_len = _in_pos = 0;
+    _bitbuf = 0;
+    _bitcount = 0;
+    _wpos = 0;
+    _history = 0;
+    _state = STATE_MEMBER;
+    _last_block = false;
+    _stored_left = _copy_len = _copy_dist = 0;
+    return true;
+}
+
+int fnInflate::_byte()
+{
+    if (_in_pos == _in_len)
+    {
+        _in_len = _src->read(_in, 1, INFLATE_INPUT_SIZE);
+        _in_pos = 0;
+        if (_in_len == 0)
+            return -1;
+    }
+    return _in[_in_pos++];
+}
+
+// Makes sure the bit buffer holds at least n bits
+bool fnInflate::_need(int n)
+{
+    while (_bitcount < n)
+    {
+        int b = _byte();
+        if (b < 0)
+            return false;
+        _bitbuf |= (uint32_t)b << _bitcount;
+        _bitcount += 8;
+    }
+    return true;
+}
+
+// Running out of data here means a truncated stream
+uint32_t fnInflate::_bits(int n)
+{
+    if (!_need(n))
+    {
+        _state = STATE_ERROR;
+        return 0;
+    }
+    uint32_t v = _bitbuf & ((1UL << n) - 1);
+    _bitbuf >>= n;
+    _bitcount -= n;
+    return v;
+}
+
+// Drops what's left of the current byte, then takes the next whole one
+int fnInflate::_aligned_byte()
+{
+    _bitbuf >>= _bitcount & 7;
+    _bitcount -= _bitcount & 7;
+    if (_bitcount > 0)
+    {
+        int b = _bitbuf & 0xFF;
+        _bitbuf >>= 8;
+        _bitcount -= 8;
+        return b;
+    }
+    return _byte();
+}
+
+// Canonical codes of the same length are consecutive, so a bit at a time
+// is enough to tell which length and symbol we have
+int fnInflate::_decode(const huffman &h)
+{
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++)
+    {
+        code |= _bits(1);
+        int count = h.counts[len];
+        if (code - count < first)
+            return h.symbols[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool fnInflate::_build(huffman &h, const uint8_t *lengths, int n)
+{
+    memset(h.counts, 0, sizeof(h.counts));
+    for (int i = 0; i < n; i++)
+        h.counts[lengths[i]]++;
+    h.counts[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len < 16; len++)
+    {
+        left <<= 1;
+        left -= h.counts[len];
+        if (left < 0)
+            return false; // Over-subscribed
+    }
+
+    uint16_t offs[16];
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++)
+        offs[len + 1] = offs[len] + h.counts[len];
+    for (int i = 0; i < n; i++)
+        if (lengths[i] != 0)
+            h.symbols[offs[lengths[i]]++] = i;
+    return true;
+}
+
+bool fnInflate::_fixed_tables()
+{
+    uint8_t lengths[288];
+    memset(lengths, 8, 144);
+    memset(lengths + 144, 9, 112);
+    memset(lengths + 256, 7, 24);
+    memset(lengths + 280, 8, 8);
+    _build(_lencode, lengths, 288);
+    memset(lengths, 5, 30);
+    _build(_distcode, lengths, 30);
+    return true;
+}
+
+bool fnInflate::_dynamic_tables()
+{
+    int nlen = _bits(5) + 257;
+    int ndist = _bits(5) + 1;
+    int ncode = _bits(4) + 4;
+    if (_state == STATE_ERROR || nlen > 286 || ndist > 30)
+        return false;
+
+    uint8_t lengths[286 + 30];
+    memset(lengths, 0, 19);
+    for (int i = 0; i < ncode; i++)
+        lengths[_clen_order[i]] = _bits(3);
+    if (!_build(_lencode, lengths, 19))
+        return false;
+
+    int i = 0;
+    while (i < nlen + ndist)
+    {
+        int sym = _decode(_lencode);
+        if (sym < 0 || _state == STATE_ERROR)
+            return false;
+        if (sym < 16)
+        {
+            lengths[i++] = sym;
+            continue;
+        }
+
+        uint8_t len = 0;
+        int repeat;
+        if (sym == 16)
+        {
+            if (i == 0)
+                return false;
+            len = lengths[i - 1];
+            repeat = 3 + _bits(2);
+        }
+        else if (sym == 17)
+            repeat = 3 + _bits(3);
+        else
+            repeat = 11 + _bits(7);
+        if (i + repeat > nlen + ndist)
+            return false;
+        while (repeat--)
+            lengths[i++] = len;
+    }
+
+    if (lengths[256] == 0)
+        return false; // No end of block code
+    return _build(_lencode, lengths, nlen) && _build(_distcode, lengths + nlen, ndist);
+}
+
+// Returns false at the end of the data, or if what follows isn't a gzip member
+bool fnInflate::_member_header()
+{
+    int id1 = _aligned_byte();
+    if (id1 < 0)
+        return false;
+    int id2 = _byte();
+    int method = _byte();
+    int flags = _byte();
+    if (id1 != 0x1F || id2 != 0x8B || method != 8 || flags < 0)
+        return false;
+    // MTIME, XFL and OS
+    for (int i = 0; i < 6; i++)
+        if (_byte() < 0)
+            return false;
+
+    if (flags & GZIP_FLAG_EXTRA)
+    {
+        int lo = _byte(), hi = _byte();
+        if (lo < 0 || hi < 0)
+            return false;
+        for (int xlen = lo | (hi << 8); xlen > 0; xlen--)
+            if (_byte() < 0)
+                return false;
+    }
+    // Zero terminated name and comment
+    static const int strings[2] = {GZIP_FLAG_NAME, GZIP_FLAG_COMMENT};
+    for (int flag : strings)
+    {
+        if (flags & flag)
+        {
+            int c;
+            while ((c = _byte()) > 0)
+                ;
+            if (c < 0)
+                return false;
+        }
+    }
+    if (flags & GZIP_FLAG_HCRC)
+        if (_byte() < 0 || _byte() < 0)
+            return false;
+    return true;
+}
+
+// CRC32 and ISIZE, which we don't check
+bool fnInflate::_member_trailer()
+{
+    if (_aligned_byte() < 0)
+        return false;
+    for (int i = 0; i < 7; i++)
+        if (_byte() < 0)
+            return false;
+    return true;
+}
+
+bool fnInflate::_block_header()
+{
+    _last_block = _bits(1);
+    switch (_bits(2))
+    {
+    case 0:
+    {
+        int b[4];
+        for (int i = 0; i < 4; i++)
+            b[i] = i == 0 ? _aligned_byte() : _byte();
+        if (b[0] < 0 || b[1] < 0 || b[2] < 0 || b[3] < 0)
+            return false;
+        uint16_t len = b[0] | (b[1] << 8);
+        uint16_t nlen = b[2] | (b[3] << 8);
+        if (len != (uint16_t)~nlen)
+            return false;
+        _stored_left = len;
+        _state = STATE_STORED;
+        return true;
+    }
+    case 1:
+        _fixed_tables();
+        break;
+    case 2:
+        if (!_dynamic_tables())
+            return false;
+        break;
+    default:
+        return false;
+    }
+    if (_state == STATE_ERROR)
+        return false;
+    _state = STATE_CODES;
+    return true;
+}
+
+// Decodes one literal/length symbol; a match is left in _copy_len and _copy_dist for read()
+bool fnInflate::_codes_symbol(uint8_t *out, size_t &produced)
+{
+    int sym = _decode(_lencode);
+    if (sym < 0 || _state == STATE_ERROR)
+        return false;
+    if (sym < 256)
+    {
+        _emit(out, produced, sym);
+        return true;
+    }
+    if (sym == 256)
+    {
+        _state = STATE_BLOCK;
+        return true;
+    }
+
+    sym -= 257;
+    if (sym >= 29)
+        return false;
+    _copy_len = _length_base[sym] + _bits(_length_extra[sym]);
+
+    int dsym = _decode(_distcode);
+    if (dsym < 0 || dsym >= 30)
+        return false;
+    _copy_dist = _dist_base[dsym] + _bits(_dist_extra[dsym]);
+    if (_state == STATE_ERROR || _copy_dist > _history)
+        return false;
+    return true;
+}
+
+size_t fnInflate::read(uint8_t *out, size_t len)
+{
+    size_t produced = 0;
+    while (produced < len)
+    {
+        // Whatever a match has left to copy goes first
+        if (_copy_len > 0)
+        {
+            while (_copy_len > 0 && produced < len)
+            {
+                _emit(out, produced, _window[(_wpos - _copy_dist) & (INFLATE_WINDOW_SIZE - 1)]);
+                _copy_len--;
+            }
+            continue;
+        }
+
+        switch (_state)
+        {
+        case STATE_MEMBER:
+            // Anything after the last member that isn't another one is ignored, as gzip does
+            if (!_member_header())
+                _state = STATE_END;
+            else
+                _state = STATE_BLOCK;
+            break;
+        case STATE_BLOCK:
+            if (_last_block)
+            {
+                _last_block = false;
+                _state = _member_trailer() ? STATE_MEMBER : STATE_ERROR;
+            }
+            else if (!_block_header())
+                _state = STATE_ERROR;
+            break;
+        case STATE_STORED:
+            while (_stored_left > 0 && produced < len)
+            {
+                int b = _byte();
+                if (b < 0)
+                {
+                    _state = STATE_ERROR;
+                    break;
+                }
+                _emit(out, produced, b);
+                _stored_left--;
+            }
+            if (_stored_left == 0 && _state == STATE_STORED)
+                _state = STATE_BLOCK;
+            break;
+        case STATE_CODES:
+            if (!_codes_symbol(out, produced))
+                _state = STATE_ERROR;
+            break;
+        case STATE_END:
+            return produced;
+        case STATE_ERROR:
+            Debug_println("fnInflate::read - corrupt or truncated data");
+            return produced;
+        }
+    }
+    return produced;
+}
+
+void fnInflate::copy_history(uint8_t *out, size_t back, size_t len) const
+{
+    uint32_t from = _wpos - back;
+    for (size_t i = 0; i < len; i++)
+        out[i] = _window[(from + i) & (INFLATE_WINDOW_SIZE - 1)];
+}
@@ -0,0 +1,95 @@
+#ifndef FN_INFLATE_H
+#define FN_INFLATE_H
+
+#include <stdint.h>
+#include <cstddef>
+
+#include "fnFile.h"
+
+// Furthest back a deflate match can reach, and so how much output we keep
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_INPUT_SIZE 1024
+
+/*
+ * fnInflate - streaming gzip (RFC 1952) / deflate (RFC 1951) decoder
+ * Pulls compressed data from a FileHandler as it goes and hands out the
+ * decompressed data in whatever size pieces read() is asked for, carrying
+ * on from where it left off, through any number of concatenated members.
+ * The last INFLATE_WINDOW_SIZE bytes it produced stay available through
+ * copy_history(). CRCs aren't checked.
+ */
+class fnInflate
+{
+protected:
+    struct huffman
+    {
+        uint16_t counts[16];   // Codes of each length
+        uint16_t symbols[288]; // Symbols ordered by code
+    };
+
+    enum inflate_state
+    {
+        STATE_MEMBER = 0, // Expecting a gzip header, or the end of the data
+        STATE_BLOCK,      // Expecting a block header, or the member trailer after the last block
+        STATE_STORED,     // Copying a stored block
+        STATE_CODES,      // Decoding a compressed block
+        STATE_END,
+        STATE_ERROR
+    };
+
+    FileHandler *_src = nullptr;
+    uint8_t *_in = nullptr;
+    size_t _in_len = 0;
+    size_t _in_pos = 0;
+    uint32_t _bitbuf = 0;
+    int _bitcount = 0;
+
+    uint8_t *_window = nullptr;
+    uint32_t _wpos = 0;
+    size_t _history = 0;
+
+    inflate_state _state = STATE_END;
+    bool _last_block = false;
+    uint32_t _stored_left = 0;
+    uint32_t _copy_len = 0;
+    uint32_t _copy_dist = 0;
+    huffman _lencode;
+    huffman _distcode;
+
+    int _byte();
+    bool _need(int n);
+    uint32_t _bits(int n);
+    int _aligned_byte();
+    int _decode(const huffman &h);
+    static bool _build(huffman &h, const uint8_t *lengths, int n);
+    bool _fixed_tables();
+    bool _dynamic_tables();
+    bool _member_header();
+    bool _member_trailer();
+    bool _block_header();
+    bool _codes_symbol(uint8_t *out, size_t &produced);
+
+    void _emit(uint8_t *out, size_t &produced, uint8_t b)
+    {
+        out[produced++] = b;
+        _window[_wpos++ & (INFLATE_WINDOW_SIZE - 1)] = b;
+        if (_history < INFLATE_WINDOW_SIZE)
+            _history++;
+    }
+
+public:
+    ~fnInflate();
+
+    // Starts decoding the gzip member at offset in src. False if there's no memory for it
+    bool begin(FileHandler *src, long int offset);
+    // Fills out with up to len bytes. Short only at the end of the data or on an error
+    size_t read(uint8_t *out, size_t len);
+    bool error() const { return _state == STATE_ERROR; }
+
+    // How many of the bytes read() produced last are still in the window
+    size_t history() const { return _history; }
+    // Copies len bytes of output starting back bytes before the next one read() will produce
+    void copy_history(uint8_t *out, size_t back, size_t len) const;
+};
+
+#endif // FN_INFLATE_H
@@ -0,0 +1,177 @@
+#include "fnSMBPool.h"
+
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <smb2/smb2.h>
+#include <smb2/libsmb2.h>
+
+#include "fnSystem.h"
+
+#include "../../include/debug.h"
+
+struct smb_pool_entry
+{
+    std::string key;
+    struct smb2_context *smb;
+    uint64_t idle_since;
+};
+
+static std::vector<smb_pool_entry> _smb_pool_idle;
+// Key of every context that's been handed out
+static std::map<struct smb2_context *, std::string> _smb_pool_busy;
+static std::mutex _smb_pool_mutex;
+
+static void _smb_pool_close(struct smb2_context *smb)
+{
+    if (smb2_get_fd(smb) >= 0)
+        smb2_disconnect_share(smb);
+    smb2_destroy_context(smb);
+}
+
+// URL arguments such as sec= and vers= set up the context, so they're part of the key
+static std::string _smb_pool_key(const struct smb2_url *parsed, const char *url, const char *user, const char *password)
+{
+    std::string key;
+    for (const char *p = parsed->server; p != nullptr && *p != '\0'; p++)
+        key += (char)std::tolower((unsigned char)*p);
+    key += '/';
+    key += parsed->share ? parsed->share : "";
+    key += '\n';
+    key += parsed->domain ? parsed->domain : "";
+    key += '\n';
+    key += user ? user : "";
+    key += '\n';
+    key += password ? password : "";
+    key += '\n';
+    const char *args = strchr(url, '?');
+    key += args ? args : "";
+    return key;
+}
+
+struct smb2_context *smb_pool_connect(const char *url, const char *user, const char *password,
+                                      struct smb2_url **parsed, std::string *error)
+{
+    smb_pool_expire();
+
+    struct smb2_context *smb = smb2_init_context();
+    if (smb == nullptr)
+    {
+        if (error != nullptr)
+            *error = "failed to init SMB2 context";
+        return nullptr;
+    }
+
+    *parsed = smb2_parse_url(smb, url);
+    if (*parsed == nullptr)
+    {
+        if (error != nullptr)
+            *error = smb2_get_error(smb);
+        smb2_destroy_context(smb);
+        return nullptr;
+    }
+
+    if (user == nullptr)
+        user = (*parsed)->user;
+    std::string key = _smb_pool_key(*parsed, url, user, password);
+
+    {
+        std::lock_guard<std::mutex> lock(_smb_pool_mutex);
+        // Prefer the most recently parked session
+        for (auto it = _smb_pool_idle.rbegin(); it != _smb_pool_idle.rend(); ++it)
+        {
+            if (it->key != key)
+                continue;
+
+            struct smb2_context *pooled = it->smb;
+            _smb_pool_idle.erase(std::next(it).base());
+
+            // The URL is parsed again with the context it'll be used with
+            struct smb2_url *reparsed = smb2_parse_url(pooled, url);
+            if (reparsed == nullptr)
+            {
+                _smb_pool_close(pooled);
+                break;
+            }
+            smb2_destroy_url(*parsed);
+            smb2_destroy_context(smb);
+            *parsed = reparsed;
+            _smb_pool_busy[pooled] = key;
+            Debug_printf("smb_pool_connect - reusing session to //%s/%s\n", reparsed->server, reparsed->share);
+            return pooled;
+        }
+    }
+
+    smb2_set_security_mode(smb, SMB2_NEGOTIATE_SIGNING_ENABLED);
+    if (user != nullptr)
+        smb2_set_user(smb, user);
+    if (password != nullptr)
+        smb2_set_password(smb, password);
+
+    if (smb2_connect_share(smb, (*parsed)->server, (*parsed)->share, user) != 0)
+    {
+        if (error != nullptr)
+            *error = smb2_get_error(smb);
+        smb2_destroy_url(*parsed);
+        *parsed = nullptr;
+        smb2_destroy_context(smb);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_smb_pool_mutex);
+    _smb_pool_busy[smb] = key;
+    return smb;
+}
+
+void smb_pool_release(struct smb2_context *smb)
+{
+    if (smb == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(_smb_pool_mutex);
+    auto busy = _smb_pool_busy.find(smb);
+    if (busy == _smb_pool_busy.end() || smb2_get_fd(smb) < 0)
+    {
+        if (busy != _smb_pool_busy.end())
+            _smb_pool_busy.erase(busy);
+        _smb_pool_close(smb);
+        return;
+    }
+
+    if (_smb_pool_idle.size() >= SMB_POOL_MAX_IDLE)
+    {
+        _smb_pool_close(_smb_pool_idle.front().smb);
+        _smb_pool_idle.erase(_smb_pool_idle.begin());
+    }
+    _smb_pool_idle.push_back({busy->second, smb, fnSystem.millis()});
+    _smb_pool_busy.erase(busy);
+}
+
+void smb_pool_expire()
+{
+    std::lock_guard<std::mutex> lock(_smb_pool_mutex);
+    uint64_t now = fnSystem.millis();
+    for (auto it = _smb_pool_idle.begin(); it != _smb_pool_idle.end();)
+    {
+        if (now - it->idle_since > SMB_POOL_IDLE_MS)
+        {
+            _smb_pool_close(it->smb);
+            it = _smb_pool_idle.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+void smb_pool_clear()
+{
+    std::lock_guard<std::mutex> lock(_smb_pool_mutex);
+    // No goodbyes, they'd only wait on a connection that's gone
+    for (smb_pool_entry &entry : _smb_pool_idle)
+        smb2_destroy_context(entry.smb);
+    _smb_pool_idle.clear();
+}
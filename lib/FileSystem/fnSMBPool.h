@@ -0,0 +1,42 @@
+#ifndef FN_SMBPOOL_H
+#define FN_SMBPOOL_H
+
+/*
+ * SMB session pool shared by the SMB file system and the N: SMB protocol.
+ * Connecting a share takes a NEGOTIATE, a signed SESSION_SETUP and a
+ * TREE_CONNECT; when a user is done with its context it's parked here under
+ * its server, share and credentials and handed to the next one that opens
+ * the same share. Parked contexts are closed after SMB_POOL_IDLE_MS, and at
+ * most SMB_POOL_MAX_IDLE are kept. A context belongs to one user at a time.
+ */
+
+#include <string>
+
+// How long a parked session is kept for reuse
+#define SMB_POOL_IDLE_MS 60000
+
+#ifdef ESP_PLATFORM
+#define SMB_POOL_MAX_IDLE 2
+#else
+#define SMB_POOL_MAX_IDLE 8
+#endif
+
+struct smb2_context;
+struct smb2_url;
+
+// Returns a context with url's share connected, a parked one if there is one, and url parsed
+// with it into *parsed for the caller to destroy. user and password are used instead of the
+// URL's when given. Returns nullptr on failure, with the reason in *error if it's given
+struct smb2_context *smb_pool_connect(const char *url, const char *user, const char *password,
+                                      struct smb2_url **parsed, std::string *error = nullptr);
+
+// Hands back a context from smb_pool_connect() for reuse, or closes it if its connection is gone
+void smb_pool_release(struct smb2_context *smb);
+
+// Called from the main service loop, closes sessions parked too long
+void smb_pool_expire();
+
+// Closes every parked session, e.g. once the network has been lost
+void smb_pool_clear();
+
+#endif // FN_SMBPOOL_H
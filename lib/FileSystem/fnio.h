@@ -23,6 +23,13 @@
   #include <cstdio>
   #include <unistd.h>  // for fsync
   typedef std::FILE fnFile;
+
+  // One buffer of a vectored read, as struct iovec
+  struct fnIoVec
+  {
+      void *base;
+      size_t len;
+  };
 #else
   #include "fnFile.h"
   typedef FileHandler fnFile;
@@ -59,6 +66,28 @@ namespace fnio
     static inline int fclose(fnFile *f)
     { return std::fclose(f); }
 
+    // Positional I/O, see FileHandler::pread; the file position ends just past the data
+    static inline size_t pread(fnFile *f, void *ptr, size_t len, long int offset)
+    { return std::fseek(f, offset, SEEK_SET) == 0 ? std::fread(ptr, 1, len, f) : 0; }
+
+    static inline size_t pwrite(fnFile *f, const void *ptr, size_t len, long int offset)
+    { return std::fseek(f, offset, SEEK_SET) == 0 ? std::fwrite(ptr, 1, len, f) : 0; }
+
+    static inline size_t preadv(fnFile *f, const fnIoVec *iov, int iovcnt, long int offset)
+    {
+      if (std::fseek(f, offset, SEEK_SET) != 0)
+        return 0;
+      size_t total = 0;
+      for (int i = 0; i < iovcnt; i++)
+      {
+        size_t got = std::fread(iov[i].base, 1, iov[i].len, f);
+        total += got;
+        if (got < iov[i].len)
+          break;
+      }
+      return total;
+    }
+
 #else
     static inline size_t fread(void *ptr, size_t size, size_t n, fnFile *f) 
     { return f->read(ptr, size, n); }
@@ -81,6 +110,16 @@ namespace fnio
     static inline int fclose(fnFile *f)
     { return f->close(); }
 
+    // Positional I/O, see FileHandler::pread; the file position ends just past the data
+    static inline size_t pread(fnFile *f, void *ptr, size_t len, long int offset)
+    { return f->pread(ptr, len, offset); }
+
+    static inline size_t pwrite(fnFile *f, const void *ptr, size_t len, long int offset)
+    { return f->pwrite(ptr, len, offset); }
+
+    static inline size_t preadv(fnFile *f, const fnIoVec *iov, int iovcnt, long int offset)
+    { return f->preadv(iov, iovcnt, offset); }
+
 #endif
 
 } // namespace fnio
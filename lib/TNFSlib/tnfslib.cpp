@@ -50,9 +50,14 @@ bool _tnfs_send(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t pay
 int _tnfs_recv(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt);
 bool _tnfs_tcp_send(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_size);
 int _tnfs_tcp_recv(tnfsMountInfo *m_info, tnfsPacket &pkt);
-_tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt);
+int _tnfs_tcp_recv_reply(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t &have);
+_tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt, bool retransmit);
 _tnfs_recv_result _tnfs_recv_and_validate(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt);
 uint8_t _tnfs_session_recovery(tnfsMountInfo *m_info, uint8_t command);
+int _tnfs_flush_write_buffer(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI);
+int _tnfs_flush_all_writes(tnfsMountInfo *m_info);
+int _tnfs_resync_position(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI);
+int _tnfs_cache_seek(tnfsFileHandleInfo *pFHI, int32_t position, uint8_t type);
 
 int _tnfs_adjust_with_full_path(tnfsMountInfo *m_info, char *buffer, const char *source, int bufflen);
 
@@ -255,11 +260,16 @@ int tnfs_close(tnfsMountInfo *m_info, int16_t file_handle)
     if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(file_handle))
         return -1;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
     // Find info on this handle
     tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
     if (pFileInf == nullptr)
         return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
 
+    // Get any buffered writes out first; a failure there is still reported after closing
+    int flush_result = _tnfs_flush_write_buffer(m_info, pFileInf);
+
     tnfsPacket packet;
     packet.command = TNFS_CMD_CLOSE;
     packet.payload[0] = file_handle;
@@ -268,12 +278,30 @@ int tnfs_close(tnfsMountInfo *m_info, int16_t file_handle)
     {
         // We're going to go ahead and delete our info even though the server could reject it
         m_info->delete_filehandleinfo(pFileInf);
-        return packet.payload[0];
+        return flush_result != TNFS_RESULT_SUCCESS ? flush_result : packet.payload[0];
     }
 
     return -1;
 }
 
+/*
+ Sends any writes we're still holding for the file to the server
+ returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+*/
+int tnfs_sync(tnfsMountInfo *m_info, int16_t file_handle)
+{
+    if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(file_handle))
+        return -1;
+
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
+    tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
+    if (pFileInf == nullptr)
+        return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
+
+    return _tnfs_flush_write_buffer(m_info, pFileInf);
+}
+
 // #ifdef not needed, the linker optimization includes the code only if called from somewhere
 void _tnfs_cache_dump(const char *title, uint8_t *cache, uint32_t cache_size)
 {
@@ -295,7 +323,7 @@ void _tnfs_cache_dump(const char *title, uint8_t *cache, uint32_t cache_size)
 int _tnfs_read_from_cache(tnfsFileHandleInfo *pFHI, uint8_t *dest, uint16_t dest_size, uint16_t *dest_used)
 {
     #ifdef VERBOSE_TNFS
-    Debug_printf("_tnfs_read_from_cache: buffpos=%lu, cache_start=%lu, cache_avail=%lu, dest_size=%u, dest_used=%u\r\n",
+    Debug_tracef("_tnfs_read_from_cache: buffpos=%lu, cache_start=%lu, cache_avail=%lu, dest_size=%u, dest_used=%u\r\n",
                  pFHI->cached_pos, pFHI->cache_start, pFHI->cache_available, dest_size, *dest_used);
     #endif
 
@@ -332,7 +360,7 @@ int _tnfs_read_from_cache(tnfsFileHandleInfo *pFHI, uint8_t *dest, uint16_t dest
             uint16_t bytes_provided = dest_free > bytes_available ? bytes_available : dest_free;
 
             #ifdef VERBOSE_TNFS
-            Debug_printf("TNFS cache providing %u bytes\r\n", bytes_provided);
+            Debug_tracef("TNFS cache providing %u bytes\r\n", bytes_provided);
             #endif
             memcpy(dest + (*dest_used), pFHI->cache + (pFHI->cached_pos - pFHI->cache_start), bytes_provided);
 
@@ -362,10 +390,10 @@ int _tnfs_read_from_cache(tnfsFileHandleInfo *pFHI, uint8_t *dest, uint16_t dest
 }
 
 /*
- Executes as many READ calls as needed to populate our internal cache
+ Executes as many READ calls as needed to load fill_size bytes into our internal cache, one at a time
  Returns: 0: success; -1: failed to deliver/receive packet; other: TNFS error result code
 */
-int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
+int _tnfs_fill_cache_stop_and_wait(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint32_t fill_size)
 {
     // Note that when we're filling the cache, we're dealing with the "real" file position,
     // not the cached_position we also keep track of on behalf of the client
@@ -379,8 +407,16 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
     pFHI->cache_available = 0;
     pFHI->cache_start = pFHI->file_position;
 
+    // One request at a time, so a seek left pending for us has to go out on its own
+    if (pFHI->seek_pending)
+    {
+        error = _tnfs_resync_position(m_info, pFHI);
+        if (error != TNFS_RESULT_SUCCESS)
+            return error;
+    }
+
     // How many bytes until we finish loading the cache
-    uint32_t bytes_remaining_to_load = sizeof(pFHI->cache);
+    uint32_t bytes_remaining_to_load = fill_size;
 
     // Keep making TNFS READ calls as long as we still have bytes to read
     while (bytes_remaining_to_load > 0)
@@ -396,7 +432,7 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
         packet.payload[2] = TNFS_HIBYTE_FROM_UINT16(bytes_to_read);
 
         #ifdef VERBOSE_TNFS
-        Debug_printf("_tnfs_fill_cache requesting %u bytes\r\n", bytes_to_read);
+        Debug_tracef("_tnfs_fill_cache requesting %u bytes\r\n", bytes_to_read);
         #endif
 
         if (_tnfs_transaction(m_info, packet, 3))
@@ -407,7 +443,7 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
                 // Copy the actual number of bytes returned to us into our cache
                 // (offset by how many bytes we've already put in the cache)
                 uint16_t bytes_read = TNFS_UINT16_FROM_LOHI_BYTEPTR(packet.payload + 1);
-                memcpy(pFHI->cache + (sizeof(pFHI->cache) - bytes_remaining_to_load),
+                memcpy(pFHI->cache + (fill_size - bytes_remaining_to_load),
                        packet.payload + 3, bytes_read);
 
                 // Keep track of our file position
@@ -416,7 +452,7 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
                 bytes_remaining_to_load -= bytes_read;
 
                 #ifdef VERBOSE_TNFS
-                Debug_printf("_tnfs_fill_cache got %u bytes, %lu more bytes needed\r\n", bytes_read, bytes_remaining_to_load);
+                Debug_tracef("_tnfs_fill_cache got %u bytes, %lu more bytes needed\r\n", bytes_read, bytes_remaining_to_load);
                 #endif
             }
             else if(tnfs_result == TNFS_RESULT_END_OF_FILE)
@@ -450,12 +486,12 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
 #ifdef ESP_PLATFORM
     if (error == 0)
     {
-        pFHI->cache_available = sizeof(pFHI->cache) - bytes_remaining_to_load;
+        pFHI->cache_available = fill_size - bytes_remaining_to_load;
 #else
 // TODO review EOF handling
     if (error == 0 || error == TNFS_RESULT_END_OF_FILE)
     {
-        pFHI->cache_available = sizeof(pFHI->cache) - bytes_remaining_to_load;
+        pFHI->cache_available = fill_size - bytes_remaining_to_load;
         if (pFHI->cache_available > 0) error = 0; // neutralize EOF
 #endif
 #ifdef DEBUG
@@ -466,6 +502,300 @@ int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
     return error;
 }
 
+/*
+ Moves the server's file pointer back to where we believe it should be (pFHI->file_position)
+ without touching the cache. Used after a pipelined fill lost track of the server's position,
+ and to send a seek tnfs_lseek left pending when it can't ride along with a fill.
+ Returns: 0: success; -1: failed to deliver/receive packet; other: TNFS error result code
+*/
+int _tnfs_resync_position(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
+{
+    tnfsPacket packet;
+    packet.command = TNFS_CMD_LSEEK;
+    packet.payload[0] = pFHI->handle_id;
+    packet.payload[1] = SEEK_SET;
+    TNFS_UINT32_TO_LOHI_BYTEPTR(pFHI->file_position, packet.payload + 2);
+
+    if (_tnfs_transaction(m_info, packet, 6))
+    {
+        if (packet.payload[0] == TNFS_RESULT_SUCCESS)
+            pFHI->seek_pending = false;
+        return packet.payload[0];
+    }
+    return -1;
+}
+
+/*
+ Loads fill_size bytes into the cache by keeping up to m_info->read_window READ requests in flight at once,
+ each one asking for TNFS_READ_CHUNK_SIZE bytes with its own consecutive sequence number.
+ The server executes the READs in the order it receives them, so the sequence number of a
+ reply tells us which chunk of the cache its data belongs to, even if replies arrive out of order.
+
+ A seek tnfs_lseek left pending goes out first as an LSEEK with the sequence number just
+ before the READs', so a random read costs one round trip instead of two. None of the data
+ counts until that LSEEK is confirmed, as READs that overtook a lost one read the wrong place.
+
+ Over TCP the READs share the stream, which keeps them in order, and each reply is cut out of
+ it by its layout (see _tnfs_tcp_recv_reply). A pending seek is sent on its own first there,
+ as servers differ in what an LSEEK reply holds.
+
+ If a reply goes missing or comes back with anything other than data or EOF, we keep whatever
+ contiguous data we did get, LSEEK the server back to the end of it and let the stop-and-wait
+ path take over. Servers that keep needing this get switched to stop-and-wait for good.
+ Returns: 0: success; -1: failed to deliver/receive packet; other: TNFS error result code
+*/
+int _tnfs_fill_cache_pipelined(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, uint32_t fill_size)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
+    fnUDP udp;
+    const bool tcp = m_info->protocol == TNFS_PROTOCOL_TCP;
+    auto send = [&](tnfsPacket &pkt, uint16_t payload_size) {
+        return tcp ? _tnfs_tcp_send(m_info, pkt, payload_size) : _tnfs_udp_send(&udp, m_info, pkt, payload_size);
+    };
+
+    pFHI->cache_available = 0;
+    pFHI->cache_start = pFHI->file_position;
+
+    if (tcp && pFHI->seek_pending)
+    {
+        int result = _tnfs_resync_position(m_info, pFHI);
+        if (result != TNFS_RESULT_SUCCESS)
+            return result;
+    }
+
+    const int chunks = fill_size / TNFS_READ_CHUNK_SIZE;
+    int window = m_info->read_window < TNFS_MAX_READ_WINDOW ? m_info->read_window : TNFS_MAX_READ_WINDOW;
+    if (window > chunks)
+        window = chunks;
+
+    uint16_t chunk_len[TNFS_MAX_CACHE_CHUNKS] = { 0 };
+    bool chunk_done[TNFS_MAX_CACHE_CHUNKS] = { false };
+
+    // Reserve a run of sequence numbers for this fill, and one before it for a pending seek
+    bool seek_done = !pFHI->seek_pending;
+    uint8_t seek_seq = m_info->current_sequence_num;
+    if (!seek_done)
+        m_info->current_sequence_num++;
+    uint8_t first_seq = m_info->current_sequence_num;
+    m_info->current_sequence_num += chunks;
+
+    int next_to_send = 0; // Next chunk we haven't requested yet
+    int base = 0;         // First chunk we haven't received yet
+    int eof_chunk = chunks; // First chunk that came back short or with EOF
+    bool lost = false;
+
+    tnfsPacket packet;
+    packet.session_idl = TNFS_LOBYTE_FROM_UINT16(m_info->session);
+    packet.session_idh = TNFS_HIBYTE_FROM_UINT16(m_info->session);
+
+    if (!seek_done)
+    {
+        packet.sequence_num = seek_seq;
+        packet.command = TNFS_CMD_LSEEK;
+        packet.payload[0] = pFHI->handle_id;
+        packet.payload[1] = SEEK_SET;
+        TNFS_UINT32_TO_LOHI_BYTEPTR(pFHI->file_position, packet.payload + 2);
+#ifdef DEBUG
+        _tnfs_debug_packet(packet, 6);
+#endif
+        if (!send(packet, 6))
+        {
+            Debug_println("_tnfs_fill_cache_pipelined failed to send LSEEK");
+            lost = true;
+        }
+    }
+
+    packet.command = TNFS_CMD_READ;
+    packet.payload[0] = pFHI->handle_id;
+    packet.payload[1] = TNFS_LOBYTE_FROM_UINT16(TNFS_READ_CHUNK_SIZE);
+    packet.payload[2] = TNFS_HIBYTE_FROM_UINT16(TNFS_READ_CHUNK_SIZE);
+
+    uint64_t ms_first_sent = fnSystem.millis();
+    uint64_t ms_last_progress = ms_first_sent;
+    int rto_ms = m_info->get_rto_ms();
+
+    tnfsPacket res;
+    uint16_t res_have = 0; // Bytes of a TCP reply collected so far
+
+    while ((base < eof_chunk || !seek_done) && !lost)
+    {
+        // Top up the window
+        while (next_to_send < eof_chunk && next_to_send - base < window)
+        {
+            packet.sequence_num = first_seq + next_to_send;
+#ifdef DEBUG
+            _tnfs_debug_packet(packet, 3);
+#endif
+            if (!send(packet, 3))
+            {
+                Debug_println("_tnfs_fill_cache_pipelined failed to send READ");
+                lost = true;
+                break;
+            }
+            next_to_send++;
+        }
+        if (lost)
+            break;
+
+        if (SYSTEM_BUS.getShuttingDown())
+        {
+            Debug_println("TNFS Breakout due to Shutdown");
+            return -1;
+        }
+
+        int l = tcp ? _tnfs_tcp_recv_reply(m_info, res, res_have) : _tnfs_udp_recv(&udp, m_info, res);
+        if (l == -2)
+        {
+            Debug_println("_tnfs_fill_cache_pipelined lost track of the TCP stream");
+            lost = true;
+            break;
+        }
+        if (l < 0)
+        {
+            if ((fnSystem.millis() - ms_last_progress) >= (uint64_t)rto_ms)
+            {
+                Debug_printf("_tnfs_fill_cache_pipelined timeout waiting for chunk %d\r\n", base);
+                m_info->rtt_backoff();
+                lost = true;
+                break;
+            }
+#ifdef ESP_PLATFORM
+            fnSystem.yield();
+#else
+            fnSystem.delay_microseconds(1000);
+#endif
+            continue;
+        }
+#ifdef DEBUG
+        _tnfs_debug_packet(res, l, true);
+#endif
+
+        if (!seek_done && res.sequence_num == seek_seq && res.command == TNFS_CMD_LSEEK)
+        {
+            if (res.payload[0] != TNFS_RESULT_SUCCESS)
+            {
+                Debug_printf("_tnfs_fill_cache_pipelined LSEEK failed with %u\r\n", res.payload[0]);
+                lost = true;
+                break;
+            }
+            seek_done = true;
+            ms_last_progress = fnSystem.millis();
+            while (base < eof_chunk && chunk_done[base])
+                base++;
+            continue;
+        }
+
+        // Work out which chunk this reply belongs to and ignore anything that isn't ours
+        int chunk = (uint8_t)(res.sequence_num - first_seq);
+        if (res.command != TNFS_CMD_READ || chunk >= next_to_send || chunk_done[chunk])
+        {
+            Debug_printf("_tnfs_fill_cache_pipelined ignoring reply seq %x\r\n", res.sequence_num);
+            continue;
+        }
+
+        if (res.payload[0] == TNFS_RESULT_SUCCESS)
+        {
+            uint16_t bytes_read = TNFS_UINT16_FROM_LOHI_BYTEPTR(res.payload + 1);
+            if (bytes_read > TNFS_READ_CHUNK_SIZE)
+                bytes_read = TNFS_READ_CHUNK_SIZE;
+            memcpy(pFHI->cache + chunk * TNFS_READ_CHUNK_SIZE, res.payload + 3, bytes_read);
+            chunk_len[chunk] = bytes_read;
+            // A short read means the file ends inside this chunk
+            if (bytes_read < TNFS_READ_CHUNK_SIZE && chunk < eof_chunk)
+                eof_chunk = chunk + 1;
+        }
+        else if (res.payload[0] == TNFS_RESULT_END_OF_FILE)
+        {
+            if (chunk < eof_chunk)
+                eof_chunk = chunk;
+        }
+        else
+        {
+            // TRY_AGAIN, expired session, etc. are left to _tnfs_transaction to sort out
+            Debug_printf("_tnfs_fill_cache_pipelined unexpected result %u for chunk %d\r\n", res.payload[0], chunk);
+            lost = true;
+            break;
+        }
+        chunk_done[chunk] = true;
+        ms_last_progress = fnSystem.millis();
+        // The first request of the window went out on its own, so its reply is a clean RTT sample
+        if (chunk == 0)
+            m_info->rtt_sample(ms_last_progress - ms_first_sent);
+
+        while (seek_done && base < eof_chunk && chunk_done[base])
+            base++;
+    }
+
+    // Count the contiguous bytes we have from the start of the cache
+    uint32_t valid = 0;
+    for (int i = 0; i < base && i < eof_chunk; i++)
+        valid += chunk_len[i];
+
+    pFHI->file_position = pFHI->cache_start + valid;
+    pFHI->cache_available = valid;
+    if (seek_done)
+        pFHI->seek_pending = false;
+
+    // Replies we never saw may still have moved the server's file pointer
+    if (lost)
+    {
+        // and over TCP may still be on their way, in a stream we can no longer find our place in
+        if (tcp)
+            m_info->tcp_client.stop();
+
+        int result = _tnfs_resync_position(m_info, pFHI);
+        if (result != TNFS_RESULT_SUCCESS)
+        {
+            Debug_printf("_tnfs_fill_cache_pipelined failed to resync file position (%d)\r\n", result);
+            pFHI->cache_available = 0;
+            return result;
+        }
+
+        if (++m_info->read_window_failures >= TNFS_READ_WINDOW_MAX_FAILURES)
+        {
+            Debug_printf("TNFS server %s doesn't cope with pipelined READs - falling back to stop-and-wait\r\n", m_info->hostname);
+            m_info->read_window = 1;
+        }
+        // Nothing usable arrived; do this fill the old way
+        if (valid == 0)
+            return _tnfs_fill_cache_stop_and_wait(m_info, pFHI, fill_size);
+        return 0;
+    }
+
+    m_info->read_window_failures = 0;
+
+    if (valid == 0)
+        return TNFS_RESULT_END_OF_FILE;
+
+    return 0;
+}
+
+/*
+ Populates our internal cache with data starting at the current file position.
+ While the client keeps reading sequentially, each fill doubles in size up to the
+ whole cache so the next stretch of the file is already here when it's asked for.
+ After a jump we go back to loading a single chunk, which is all random access needs.
+ Returns: 0: success; -1: failed to deliver/receive packet; other: TNFS error result code
+*/
+int _tnfs_fill_cache(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI, bool sequential)
+{
+    uint32_t fill_size = TNFS_READ_CHUNK_SIZE;
+    if (sequential && pFHI->readahead > 0)
+        fill_size = pFHI->readahead * 2;
+    if (fill_size > pFHI->cache_size)
+        fill_size = pFHI->cache_size;
+    pFHI->readahead = fill_size;
+
+    // Over UDP a pending seek is worth it even for one chunk, the LSEEK shares the READ's round trip
+    bool udp = m_info->protocol == TNFS_PROTOCOL_UDP;
+    if ((udp || m_info->protocol == TNFS_PROTOCOL_TCP) && m_info->read_window > 1 &&
+        (fill_size > TNFS_READ_CHUNK_SIZE || (udp && pFHI->seek_pending)))
+        return _tnfs_fill_cache_pipelined(m_info, pFHI, fill_size);
+
+    return _tnfs_fill_cache_stop_and_wait(m_info, pFHI, fill_size);
+}
+
 /*
  Reads from an open file.
  Max bufflen is TNFS_PAYLOAD_SIZE - 3; any larger size will return an error
@@ -480,6 +810,8 @@ int tnfs_read(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint1
 
     *resultlen = 0;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
     // Find info on this handle
     tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
     if (pFileInf == nullptr)
@@ -489,12 +821,22 @@ int tnfs_read(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint1
     Debug_printf("tnfs_read fh=%d, len=%d\r\n", file_handle, bufflen);
     #endif
 
+    // The server has to have everything we've written before we can read it back
+    int flush_result = _tnfs_flush_write_buffer(m_info, pFileInf);
+    if (flush_result != TNFS_RESULT_SUCCESS)
+        return flush_result;
+
+    // Reads that pick up where the last one left off grow the readahead
+    bool sequential = pFileInf->cached_pos == pFileInf->last_read_end;
+
     int result = 0;
+    bool filled = false;
     // Try to fulfill the request using our internal cache
     while ((result = _tnfs_read_from_cache(pFileInf, buffer, bufflen, resultlen)) != 0 && result != TNFS_RESULT_END_OF_FILE)
     {
         // Reload the cache if we couldn't fulfill the request
-        result = _tnfs_fill_cache(m_info, pFileInf);
+        filled = true;
+        result = _tnfs_fill_cache(m_info, pFileInf, sequential);
         if (result != 0)
         {
 #ifndef ESP_PLATFORM
@@ -516,14 +858,47 @@ int tnfs_read(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint1
         }
     }
 
+    pFileInf->last_read_end = pFileInf->cached_pos;
+    if (filled)
+        m_info->cache_misses++;
+    else
+        m_info->cache_hits++;
+
     return result;
 }
 
+/*
+ Reads from an open file at offset, leaving the file position just past what was read.
+ The seek is the lazy one tnfs_lseek does, so it costs nothing if offset is cached and
+ otherwise goes out with the cache fill's READs (see _tnfs_fill_cache_pipelined)
+ Max bufflen is TNFS_PAYLOAD_SIZE - 3; any larger size will return an error
+ Bytes actually read will be placed in resultlen
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+ */
+int tnfs_pread(tnfsMountInfo *m_info, int16_t file_handle, uint32_t offset, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen)
+{
+    if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(file_handle))
+        return -1;
+
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
+    int result = tnfs_lseek(m_info, file_handle, offset, SEEK_SET);
+    if (result != TNFS_RESULT_SUCCESS)
+        return result;
+
+    return tnfs_read(m_info, file_handle, buffer, bufflen, resultlen);
+}
 
 /*
  Write to an open file.
  Max bufflen is TNFS_PAYLOAD_SIZE - 3; any larger size will return an error
  Bytes actually written will be placed in resultlen
+
+ Writes are held in a per-handle buffer so runs of small adjacent writes (e.g. 128-byte
+ sectors) go out as a single TNFS WRITE. The buffer is sent when a write doesn't follow
+ on from it or won't fit, when the file is read, seeked elsewhere, synced or closed, and
+ by tnfs_flush_expired_writes() once it's been waiting m_info->write_behind_ms.
+ An error sending buffered data is returned by whichever of those calls sends it.
  Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
  */
 int tnfs_write(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen)
@@ -534,17 +909,98 @@ int tnfs_write(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint
 
     *resultlen = 0;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
     // Find info on this handle
     tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
     if (pFileInf == nullptr)
         return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
 
-    // For now, invalidate our cache and seek to the current position in the file before writing
+    // Our read cache can't be trusted once we write
     pFileInf->cache_available = 0;
-    if(pFileInf->cached_pos != pFileInf->file_position)
+
+    // Send what we have if this write doesn't continue it or won't fit alongside it
+    if (pFileInf->cache_modified &&
+        (pFileInf->cached_pos != pFileInf->write_start + pFileInf->write_buffered ||
+         pFileInf->write_buffered + bufflen > TNFS_MAX_READWRITE_PAYLOAD))
+    {
+        int result = _tnfs_flush_write_buffer(m_info, pFileInf);
+        if (result != TNFS_RESULT_SUCCESS)
+            return result;
+    }
+
+    if (pFileInf->write_buffer == nullptr)
+    {
+        pFileInf->write_buffer = (uint8_t *)malloc(TNFS_MAX_READWRITE_PAYLOAD);
+        if (pFileInf->write_buffer == nullptr)
+            return TNFS_RESULT_OUT_OF_MEMORY;
+    }
+
+    if (pFileInf->cache_modified == false)
+    {
+        pFileInf->write_start = pFileInf->cached_pos;
+        pFileInf->write_buffered = 0;
+        pFileInf->write_time = fnSystem.millis();
+        pFileInf->cache_modified = true;
+    }
+
+    memcpy(pFileInf->write_buffer + pFileInf->write_buffered, buffer, bufflen);
+    pFileInf->write_buffered += bufflen;
+    pFileInf->cached_pos += bufflen;
+    *resultlen = bufflen;
+
+    // No point waiting if the buffer's full or write-behind is turned off
+    if (pFileInf->write_buffered == TNFS_MAX_READWRITE_PAYLOAD || m_info->write_behind_ms == 0)
+        return _tnfs_flush_write_buffer(m_info, pFileInf);
+
+    return TNFS_RESULT_SUCCESS;
+}
+
+/*
+ Writes to an open file at offset, leaving the file position just past what was written.
+ No LSEEK goes out here; the write joins the buffered ones if it carries on from them,
+ and the server is only moved when the buffer is sent, if it isn't already there
+ Max bufflen is TNFS_PAYLOAD_SIZE - 3; any larger size will return an error
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+ */
+int tnfs_pwrite(tnfsMountInfo *m_info, int16_t file_handle, uint32_t offset, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen)
+{
+    // Checked before the position moves, so a rejected write leaves it alone
+    if (m_info == nullptr || false == TNFS_VALID_AS_UINT8(file_handle) ||
+        buffer == nullptr || bufflen > (TNFS_PAYLOAD_SIZE - 3) || resultlen == nullptr)
+        return -1;
+
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
+    tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
+    if (pFileInf == nullptr)
+        return TNFS_RESULT_BAD_FILE_DESCRIPTOR;
+
+    pFileInf->cached_pos = offset;
+    return tnfs_write(m_info, file_handle, buffer, bufflen, resultlen);
+}
+
+/*
+ Sends the contents of the handle's write buffer to the server in a single WRITE,
+ seeking there first if the server's file pointer is somewhere else
+ Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
+*/
+int _tnfs_flush_write_buffer(tnfsMountInfo *m_info, tnfsFileHandleInfo *pFHI)
+{
+    if (pFHI->cache_modified == false)
+        return TNFS_RESULT_SUCCESS;
+
+    // Whatever happens below, this data has had its one chance
+    pFHI->cache_modified = false;
+    uint16_t bufflen = pFHI->write_buffered;
+    pFHI->write_buffered = 0;
+
+    pFHI->cache_available = 0;
+    if (pFHI->seek_pending || pFHI->file_position != pFHI->write_start)
     {
-        int result = tnfs_lseek(m_info, file_handle, pFileInf->cached_pos, SEEK_SET, nullptr, true);
-        if(result != 0)
+        pFHI->file_position = pFHI->write_start;
+        int result = _tnfs_resync_position(m_info, pFHI);
+        if (result != TNFS_RESULT_SUCCESS)
         {
             Debug_print("TNFS seek failed during write\r\n");
             return result;
@@ -553,27 +1009,76 @@ int tnfs_write(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint
 
     tnfsPacket packet;
     packet.command = TNFS_CMD_WRITE;
-    packet.payload[0] = file_handle;
+    packet.payload[0] = pFHI->handle_id;
     packet.payload[1] = TNFS_LOBYTE_FROM_UINT16(bufflen);
     packet.payload[2] = TNFS_HIBYTE_FROM_UINT16(bufflen);
 
-    memcpy(packet.payload + 3, buffer, bufflen);
+    memcpy(packet.payload + 3, pFHI->write_buffer, bufflen);
 
     if (_tnfs_transaction(m_info, packet, bufflen + 3))
     {
         if (packet.payload[0] == TNFS_RESULT_SUCCESS)
         {
-            *resultlen = TNFS_UINT16_FROM_LOHI_BYTEPTR(packet.payload + 1);
+            uint16_t written = TNFS_UINT16_FROM_LOHI_BYTEPTR(packet.payload + 1);
             // Keep track of our file position
-            uint32_t new_pos = pFileInf->file_position + *resultlen;
-            // Debug_printf("tnfs_write prev_pos: %u, read: %u, new_pos: %u\r\n", pFileInf->file_position, *resultlen, new_pos);
-            pFileInf->file_position = pFileInf->cached_pos = new_pos;
+            pFHI->file_position += written;
+            if (pFHI->file_position > pFHI->file_size)
+                pFHI->file_size = pFHI->file_position;
+            // The client was told all of it went through
+            if (written != bufflen)
+            {
+                Debug_printf("TNFS short write: %u of %u bytes\r\n", written, bufflen);
+                return TNFS_RESULT_NO_SPACE_ON_DEVICE;
+            }
         }
         return packet.payload[0];
     }
     return -1;
 }
 
+// Sends the buffered writes of every file open on the mount
+int _tnfs_flush_all_writes(tnfsMountInfo *m_info)
+{
+    int result = TNFS_RESULT_SUCCESS;
+    for (int i = 0; i < TNFS_MAX_FILE_HANDLES; i++)
+    {
+        tnfsFileHandleInfo *pFHI = m_info->get_filehandleinfo_at(i);
+        if (pFHI != nullptr && pFHI->cache_modified)
+        {
+            int r = _tnfs_flush_write_buffer(m_info, pFHI);
+            if (r != TNFS_RESULT_SUCCESS)
+                result = r;
+        }
+    }
+    return result;
+}
+
+/*
+ Sends buffered writes that have been waiting longer than their mount's write_behind_ms.
+ Meant to be called regularly from the main service loop; mounts busy with a transaction
+ on another task are skipped until next time.
+*/
+void tnfs_flush_expired_writes()
+{
+    tnfsMountInfo::for_each_mount([](tnfsMountInfo &m) {
+        std::unique_lock<std::recursive_mutex> lock(m.transaction_mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+            return;
+
+        uint64_t now = fnSystem.millis();
+        for (int i = 0; i < TNFS_MAX_FILE_HANDLES; i++)
+        {
+            tnfsFileHandleInfo *pFHI = m.get_filehandleinfo_at(i);
+            if (pFHI != nullptr && pFHI->cache_modified && now - pFHI->write_time >= m.write_behind_ms)
+            {
+                int result = _tnfs_flush_write_buffer(&m, pFHI);
+                if (result != TNFS_RESULT_SUCCESS)
+                    Debug_printf("tnfs_flush_expired_writes failed to write \"%s\" (%d)\r\n", pFHI->filename, result);
+            }
+        }
+    });
+}
+
 /*
   Try to seek within our internal cache
   Return 0 on success, -1 on failure
@@ -615,6 +1120,8 @@ int _tnfs_cache_seek(tnfsFileHandleInfo *pFHI, int32_t position, uint8_t type)
 
 /*
  Seek to different position in open file
+ SEEK_SET and SEEK_CUR only note the new position; the LSEEK goes out with the next READ
+ or WRITE if the server's pointer isn't there by then. skip_cache sends it right away
  Returns: 0: success, -1: failed to deliver/receive packet, other: TNFS error result code
  */
 int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uint8_t type, uint32_t *new_position, bool skip_cache)
@@ -626,6 +1133,8 @@ int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uin
     if (type != SEEK_SET && type != SEEK_CUR && type != SEEK_END)
         return TNFS_RESULT_INVALID_ARGUMENT;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
     // Find info on this handle
     tnfsFileHandleInfo *pFileInf = m_info->get_filehandleinfo(file_handle);
     if (pFileInf == nullptr)
@@ -635,6 +1144,25 @@ int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uin
     Debug_printf("tnfs_lseek currpos=%d, pos=%d, typ=%d\r\n", pFileInf->cached_pos, position, type);
 #endif
 
+    if (pFileInf->cache_modified)
+    {
+        // Seeking to where we already are keeps the write buffer open for the next write
+        uint32_t buffered_end = pFileInf->write_start + pFileInf->write_buffered;
+        uint32_t size = pFileInf->file_size > buffered_end ? pFileInf->file_size : buffered_end;
+        uint32_t destination_pos = type == SEEK_SET ? position :
+            type == SEEK_CUR ? pFileInf->cached_pos + position : size + position;
+        if (destination_pos == pFileInf->cached_pos)
+        {
+            if (new_position != nullptr)
+                *new_position = pFileInf->cached_pos;
+            return 0;
+        }
+
+        int result = _tnfs_flush_write_buffer(m_info, pFileInf);
+        if (result != TNFS_RESULT_SUCCESS)
+            return result;
+    }
+
     // Try to fulfill the seek within our internal cache
     if (skip_cache == false && _tnfs_cache_seek(pFileInf, position, type) == 0)
     {
@@ -645,6 +1173,31 @@ int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uin
     // Cache seek failed - invalidate the internal cache
     pFileInf->cache_available = 0;
 
+    // Relative to where the client is, which needn't be where the server's pointer is
+    if (type == SEEK_CUR)
+    {
+        position = (int32_t)(pFileInf->cached_pos + position);
+        type = SEEK_SET;
+    }
+
+    // Nothing needs the server's pointer until the next READ or WRITE, so just note where it
+    // should be. The next cache fill or write sends the LSEEK, and only if the server isn't
+    // there already. SEEK_END still goes now, as only the server knows where the file ends
+    if (type == SEEK_SET && skip_cache == false)
+    {
+        if (position < 0)
+            return TNFS_RESULT_INVALID_ARGUMENT;
+        if (pFileInf->file_position != (uint32_t)position)
+        {
+            pFileInf->file_position = position;
+            pFileInf->seek_pending = true;
+        }
+        pFileInf->cached_pos = position;
+        if (new_position != nullptr)
+            *new_position = pFileInf->cached_pos;
+        return 0;
+    }
+
     // Go ahead and execute a new TNFS SEEK request
     tnfsPacket packet;
     packet.command = TNFS_CMD_LSEEK;
@@ -665,6 +1218,7 @@ int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uin
                 pFileInf->file_position = (pFileInf->file_size + position);
 
             pFileInf->cached_pos = pFileInf->file_position;
+            pFileInf->seek_pending = false;
 
             if(new_position != nullptr)
                 *new_position = pFileInf->file_position;
@@ -787,6 +1341,7 @@ int tnfs_readdirx(tnfsMountInfo *m_info, tnfsStat *filestat, char *dir_entry, in
     tnfsDirCacheEntry *pCached = m_info->next_dircache_entry();
     if(pCached != nullptr)
     {
+        m_info->dircache_hits++;
         Debug_print("tnfs_readdirx responding from cached entry\r\n");
         _readdirx_fill_response(pCached, filestat, dir_entry, dir_entry_len);
         return 0;
@@ -795,9 +1350,11 @@ int tnfs_readdirx(tnfsMountInfo *m_info, tnfsStat *filestat, char *dir_entry, in
     // If the cache was empty and the EOF flag was set, just respond with an EOF error
     if(m_info->get_dircache_eof() == true)
     {
+        m_info->dircache_hits++;
         Debug_print("tnfs_readdirx returning EOF based on cached value\r\n");
         return TNFS_RESULT_END_OF_FILE;
     }
+    m_info->dircache_misses++;
 
     // Invalidate the cache before loading more
     m_info->empty_dircache();
@@ -1012,6 +1569,11 @@ int tnfs_stat(tnfsMountInfo *m_info, tnfsStat *filestat, const char *filepath)
     if (m_info == nullptr || filepath == nullptr || filestat == nullptr)
         return -1;
 
+    std::lock_guard<std::recursive_mutex> lock(m_info->transaction_mutex);
+
+    // Make sure the server reports sizes that include what we've written
+    _tnfs_flush_all_writes(m_info);
+
     tnfsPacket packet;
     packet.command = TNFS_CMD_STAT;
 
@@ -1292,6 +1854,8 @@ bool _tnfs_tcp_send(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_siz
             Debug_println("Can't connect to the TCP server");
             return false;
         }
+        // Requests are small and each one is written whole, holding them back for more only adds latency
+        tcp->setNoDelay(true);
     }
     int l = tcp->write(pkt.rawData, payload_size + TNFS_HEADER_SIZE);
     return l == payload_size + TNFS_HEADER_SIZE;
@@ -1352,6 +1916,58 @@ int _tnfs_tcp_recv(tnfsMountInfo *m_info, tnfsPacket &pkt)
     return tcp->read(pkt.rawData, sizeof(pkt.rawData));
 }
 
+/*
+ Collects one reply to a pipelined READ from the TCP stream into pkt, as much as has arrived
+ each call, with have counting what's there so far. TNFS over TCP has no framing of its own,
+ so the reply's length comes from its layout: header and result, then the byte count and
+ data of a successful READ, or the delay of a TRY_AGAIN.
+ Returns the length of the reply once it's complete, -1 while more is to come, and -2 if
+ the stream holds something else, after which it can't be trusted
+*/
+int _tnfs_tcp_recv_reply(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t &have)
+{
+    fnTcpClient *tcp = &m_info->tcp_client;
+    if (!tcp->connected())
+        return -2;
+
+    while (true)
+    {
+        uint16_t need = TNFS_HEADER_SIZE + 1;
+        if (have >= need)
+        {
+            if (pkt.command != TNFS_CMD_READ)
+                return -2;
+            if (pkt.payload[0] == TNFS_RESULT_TRY_AGAIN)
+                need += 2;
+            else if (pkt.payload[0] == TNFS_RESULT_SUCCESS)
+            {
+                need += 2;
+                if (have >= need)
+                {
+                    uint16_t count = TNFS_UINT16_FROM_LOHI_BYTEPTR(pkt.payload + 1);
+                    if (count > TNFS_READ_CHUNK_SIZE)
+                        return -2;
+                    need += count;
+                }
+            }
+        }
+
+        if (have >= need)
+        {
+            int len = have;
+            have = 0;
+            return len;
+        }
+
+        if (!tcp->available())
+            return -1;
+        int l = tcp->read(pkt.rawData + have, need - have);
+        if (l <= 0)
+            return -1;
+        have += l;
+    }
+}
+
 #ifndef TNFS_UDP_SIMULATE_POOR_CONNECTION
 int _tnfs_udp_recv(fnUDP *udp, tnfsMountInfo *m_info, tnfsPacket &pkt)
 {
@@ -1394,7 +2010,9 @@ bool _tnfs_transaction(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_
     // Start a new retry sequence
     for (int retry = 0; retry < m_info->max_retries; retry++)
     {
-        switch(_tnfs_send_recv(udp, m_info, reqPkt, payload_size, pkt))
+        uint64_t ms_sent = fnSystem.millis();
+
+        switch(_tnfs_send_recv(udp, m_info, reqPkt, payload_size, pkt, retry > 0))
         {
             case SUCCESS:
             return true;
@@ -1409,8 +2027,12 @@ bool _tnfs_transaction(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_
             break;
         }
         
-        // Make sure we wait before retrying
-        fnSystem.delay(m_info->min_retry_ms);
+        // The server asks for at least min_retry_ms between attempts; time spent
+        // waiting for the reply counts towards that
+        uint64_t ms_waited = fnSystem.millis() - ms_sent;
+        if (ms_waited < m_info->min_retry_ms)
+            fnSystem.delay(m_info->min_retry_ms - ms_waited);
+        m_info->retransmits++;
     }
 
     Debug_printf("Retry attempts failed for host: %s, path: %s, cwd: %s\r\n", m_info->hostname, m_info->mountpath, m_info->current_working_directory);
@@ -1418,7 +2040,7 @@ bool _tnfs_transaction(tnfsMountInfo *m_info, tnfsPacket &pkt, uint16_t payload_
     return false;
 }
 
-_tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt)
+_tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPacket &req_pkt, uint16_t payload_size, tnfsPacket &res_pkt, bool retransmit)
 {
 #ifdef DEBUG
     _tnfs_debug_packet(req_pkt, payload_size);
@@ -1432,7 +2054,8 @@ _tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPa
         return FAILED;
     }
 
-    // Wait for a response at most TNFS_TIMEOUT milliseconds
+    // Wait for a response for as long as the current retransmit timeout
+    int rto_ms = m_info->get_rto_ms();
 #ifdef ESP_PLATFORM
     int ms_start = fnSystem.millis();
 #else
@@ -1452,6 +2075,9 @@ _tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPa
 #ifndef ESP_PLATFORM
             Debug_printf("_tnfs_transaction completed in %u ms\n", (unsigned)(fnSystem.millis() - ms_start));
 #endif
+            // A reply to a resent request could belong to either copy, so don't learn from it
+            if (!retransmit)
+                m_info->rtt_sample(fnSystem.millis() - ms_start);
             return SUCCESS;
 
             case RESP_TRY_AGAIN:
@@ -1474,7 +2100,7 @@ _tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPa
         fnSystem.delay_microseconds(5000); // wait more time for (remote) data to arrive
 #endif
 
-    } while ((fnSystem.millis() - ms_start) < m_info->timeout_ms); // packet receive loop
+    } while ((fnSystem.millis() - ms_start) < rto_ms); // packet receive loop
 
     if (m_info->protocol == TNFS_PROTOCOL_UNKNOWN)
     {
@@ -1486,7 +2112,9 @@ _tnfs_send_recv_result _tnfs_send_recv(fnUDP &udp, tnfsMountInfo *m_info, tnfsPa
         return RESET;
     }
     
-    Debug_printf("Timeout after %d milliseconds. Retrying\r\n", m_info->timeout_ms);
+    m_info->rtt_backoff();
+    Debug_printf("Timeout after %d milliseconds (srtt=%d, rttvar=%d, next rto=%d). Retrying\r\n",
+        rto_ms, m_info->get_srtt_ms(), m_info->get_rttvar_ms(), m_info->get_rto_ms());
     return FAILED;
 }
 
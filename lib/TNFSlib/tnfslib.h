@@ -192,7 +192,10 @@ int tnfs_free(tnfsMountInfo *m_info, uint32_t *size);
 int tnfs_open(tnfsMountInfo *m_info, const char *filepath, uint16_t open_mode, uint16_t create_perms, int16_t *file_handle);
 int tnfs_read(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen);
 int tnfs_write(tnfsMountInfo *m_info, int16_t file_handle, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen);
+int tnfs_pread(tnfsMountInfo *m_info, int16_t file_handle, uint32_t offset, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen);
+int tnfs_pwrite(tnfsMountInfo *m_info, int16_t file_handle, uint32_t offset, uint8_t *buffer, uint16_t bufflen, uint16_t *resultlen);
 int tnfs_close(tnfsMountInfo *m_info, int16_t file_handle);
+int tnfs_sync(tnfsMountInfo *m_info, int16_t file_handle);
 int tnfs_stat(tnfsMountInfo *m_info, tnfsStat *filestat, const char *filepath);
 int tnfs_lseek(tnfsMountInfo *m_info, int16_t file_handle, int32_t position, uint8_t type, uint32_t *new_position = nullptr, bool skip_cache = false);
 int tnfs_unlink(tnfsMountInfo *m_info, const char *filepath);
@@ -203,6 +206,8 @@ int tnfs_chdir(tnfsMountInfo *m_info, const char *dirpath);
 const char *tnfs_getcwd(tnfsMountInfo *m_info);
 const char *tnfs_filepath(tnfsMountInfo *m_info, int16_t file_handle);
 
+void tnfs_flush_expired_writes();
+
 int tnfs_code_to_errno(int tnfs_code);
 
 #endif //_TNFSLIB_H
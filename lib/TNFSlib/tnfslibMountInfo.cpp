@@ -1,24 +1,93 @@
 
 #include "tnfslibMountInfo.h"
 
+#include <cstdlib>
+#include <vector>
+
 #include "compat_string.h"
 
+#include "fnSystem.h"
+#include "fnArena.h"
+
+#include "../../include/debug.h"
+
+
+tnfsFileHandleInfo::tnfsFileHandleInfo(uint32_t size)
+{
+    // Try for the requested size, settling for less if memory is tight
+    for (; size >= TNFS_MIN_FILE_CACHE_SIZE; size = size / 2 / TNFS_READ_CHUNK_SIZE * TNFS_READ_CHUNK_SIZE)
+    {
+        cache = (uint8_t *)fnArena.malloc(ARENA_NETWORK, size);
+        if (cache != nullptr)
+        {
+            cache_size = size;
+            break;
+        }
+    }
+}
+
+tnfsFileHandleInfo::~tnfsFileHandleInfo()
+{
+    fnArena.free(ARENA_NETWORK, cache);
+    free(write_buffer);
+}
+
+
+// Every live tnfsMountInfo, so the console can report on them
+static std::vector<tnfsMountInfo *> _tnfs_mounts;
+static std::mutex _tnfs_mounts_mutex;
+
+tnfsMountInfo::tnfsMountInfo()
+{
+    _register();
+}
 
 tnfsMountInfo::tnfsMountInfo(const char *host_name, uint16_t host_port)
 {
     strlcpy(hostname, host_name, sizeof(hostname));
     port = host_port;
+    _register();
 }
 
 tnfsMountInfo::tnfsMountInfo(in_addr_t host_address, uint16_t host_port)
     : host_ip(host_address)
     , port(host_port)
 {
+    _register();
+}
+
+void tnfsMountInfo::_register()
+{
+    std::lock_guard<std::mutex> lock(_tnfs_mounts_mutex);
+    _tnfs_mounts.push_back(this);
+}
+
+/*
+ Calls fn for every tnfsMountInfo currently in existence.
+ Mounts can't come or go while this is running, so keep fn short.
+*/
+void tnfsMountInfo::for_each_mount(const std::function<void(tnfsMountInfo &)> &fn)
+{
+    std::lock_guard<std::mutex> lock(_tnfs_mounts_mutex);
+    for (tnfsMountInfo *m : _tnfs_mounts)
+        fn(*m);
 }
 
 // Make sure to clean up any memory we allocated
 tnfsMountInfo::~tnfsMountInfo()
 {
+    {
+        std::lock_guard<std::mutex> lock(_tnfs_mounts_mutex);
+        for (auto it = _tnfs_mounts.begin(); it != _tnfs_mounts.end(); ++it)
+        {
+            if (*it == this)
+            {
+                _tnfs_mounts.erase(it);
+                break;
+            }
+        }
+    }
+
     // Find a matching tnfsFileHandleInfo
     for (int i = 0; i < TNFS_MAX_FILE_HANDLES; i++)
     {
@@ -115,9 +184,15 @@ tnfsFileHandleInfo *tnfsMountInfo::new_filehandleinfo()
     {
         if (_file_handles[i] == nullptr)
         {
-            tnfsFileHandleInfo *p = new tnfsFileHandleInfo;
+            tnfsFileHandleInfo *p = new tnfsFileHandleInfo(get_cache_size());
             if (p != nullptr)
             {
+                if (p->cache == nullptr)
+                {
+                    Debug_println("tnfsMountInfo::new_filehandleinfo failed to allocate file cache");
+                    delete p;
+                    return nullptr;
+                }
                 _file_handles[i] = p;
                 return p;
             }
@@ -126,6 +201,24 @@ tnfsFileHandleInfo *tnfsMountInfo::new_filehandleinfo()
     return nullptr;
 }
 
+/*
+ Returns the read cache size to use for files opened on this mount.
+ Use a larger cache when we have PSRAM (or are running on a PC) since every
+ file handle gets its own.
+*/
+uint32_t tnfsMountInfo::get_cache_size()
+{
+    if (_cache_size == 0)
+    {
+#ifdef ESP_PLATFORM
+        _cache_size = fnSystem.get_psram_size() > 0 ? TNFS_FILE_CACHE_SIZE_PSRAM : TNFS_FILE_CACHE_SIZE;
+#else
+        _cache_size = TNFS_FILE_CACHE_SIZE_PSRAM;
+#endif
+    }
+    return _cache_size;
+}
+
 /*
  Removes any existing tnfsFileHandleInfo with a matching file handle
 */
@@ -160,3 +253,57 @@ void tnfsMountInfo::delete_filehandleinfo(tnfsFileHandleInfo *pFilehandle)
         }
     }
 }
+
+/*
+ Feeds a measured round trip time into the smoothed RTT/RTO estimate.
+ Only samples from requests that weren't retransmitted should be used (Karn's algorithm).
+*/
+void tnfsMountInfo::rtt_sample(uint32_t rtt_ms)
+{
+    int32_t rtt = rtt_ms;
+
+    if (_rto_ms == 0)
+    {
+        // First measurement
+        _srtt = rtt << 3;
+        _rttvar = rtt << 1;
+    }
+    else
+    {
+        // srtt += (rtt - srtt) / 8; rttvar += (|rtt - srtt| - rttvar) / 4
+        int32_t delta = rtt - (_srtt >> 3);
+        _srtt += delta;
+        if (delta < 0)
+            delta = -delta;
+        _rttvar += delta - (_rttvar >> 2);
+    }
+
+    // rto = srtt + 4 * rttvar, kept between TNFS_MIN_RTO and timeout_ms
+    _rto_ms = (_srtt >> 3) + _rttvar;
+    if (_rto_ms < TNFS_MIN_RTO)
+        _rto_ms = TNFS_MIN_RTO;
+    if (_rto_ms > timeout_ms)
+        _rto_ms = timeout_ms;
+}
+
+// A request went unanswered: back off exponentially until we get a fresh sample
+void tnfsMountInfo::rtt_backoff()
+{
+    if (_rto_ms == 0)
+        return;
+    _rto_ms *= 2;
+    if (_rto_ms > timeout_ms)
+        _rto_ms = timeout_ms;
+}
+
+/*
+ How long to wait for a reply before sending the request again.
+ Only UDP gets the adaptive value; over TCP a resend just duplicates the request on the
+ stream, so we stick with the full timeout there.
+*/
+int tnfsMountInfo::get_rto_ms()
+{
+    if (protocol != TNFS_PROTOCOL_UDP || _rto_ms == 0)
+        return timeout_ms;
+    return _rto_ms;
+}
@@ -2,6 +2,7 @@
 #define _TNFSLIB_MOUNTINFO_H
 
 #include <cstdint>
+#include <functional>
 #include <mutex>
 
 #include "fnDNS.h"
@@ -11,12 +12,23 @@
 #define TNFS_DEFAULT_PORT 16384
 #define TNFS_RETRIES 5 // Number of times to retry if we fail to send/receive a packet
 #define TNFS_TIMEOUT 2000 // This is how long we wait for a reply packet from the server before trying again
+#define TNFS_MIN_RTO 40 // Shortest retransmit timeout the RTT estimator will pick (UDP only)
+#define TNFS_WRITE_BEHIND_MS 250 // Longest we'll hold on to written data waiting to merge it with more
 #define TNFS_RETRY_DELAY 1000 // Default delay before retrying. Server will provide a minimum during TNFS_CMD_MOUNT
 #define TNFS_MAX_BACKOFF_DELAY 3000 // Longest we'll wait if server sends us a EAGAIN error
 #define TNFS_MAX_FILE_HANDLES 8 // Max number of file handles we'll open to the server
 #define TNFS_MAX_FILELEN 256
 
-#define TNFS_FILE_CACHE_SIZE 512 // 4 * 128 fits in a single packet when TNFS_MAX_READWRITE_PAYLOAD is 512
+#define TNFS_READ_CHUNK_SIZE 512 // 4 * 128 fits in a single packet when TNFS_MAX_READWRITE_PAYLOAD is 512
+#define TNFS_READ_WINDOW 4 // Default number of READ requests kept in flight while filling the cache (1 = stop-and-wait)
+#define TNFS_MAX_READ_WINDOW 8
+#define TNFS_READ_WINDOW_MAX_FAILURES 3 // Pipelined fills needing recovery in a row before we drop to stop-and-wait
+
+#define TNFS_FILE_CACHE_SIZE (TNFS_READ_CHUNK_SIZE * TNFS_READ_WINDOW) // Default per-handle read cache size
+#define TNFS_FILE_CACHE_SIZE_PSRAM 16384 // Default per-handle read cache size when we have PSRAM (or on PC)
+#define TNFS_MIN_FILE_CACHE_SIZE TNFS_READ_CHUNK_SIZE
+#define TNFS_MAX_FILE_CACHE_SIZE 32768
+#define TNFS_MAX_CACHE_CHUNKS (TNFS_MAX_FILE_CACHE_SIZE / TNFS_READ_CHUNK_SIZE)
 
 #define TNFS_INVALID_HANDLE -1
 #define TNFS_INVALID_SESSION 0 // We're assuming a '0' is never a valid session ID
@@ -42,17 +54,30 @@
 // Some things we need to keep track of for every file we open
 struct tnfsFileHandleInfo
 {
+    tnfsFileHandleInfo(uint32_t size);
+    ~tnfsFileHandleInfo();
+
     uint8_t handle_id = 0;
 
     uint32_t file_position = 0; // Current actual file position
+    bool seek_pending = false; // The server hasn't been told about file_position yet; the next READ or WRITE will
     uint32_t file_size = 0;
     uint32_t cached_pos = 0; // File position the client thinks we're at (usually somewhere in the cached region)
     uint32_t cache_start = 0; // The file position at which the cache starts
     uint32_t cache_available = 0; // Number of valid bytes in the cache
 
-    bool cache_modified = false; // Notes if we've written to the cache
+    bool cache_modified = false; // Notes if write_buffer holds data the server doesn't have yet
+
+    uint8_t *write_buffer = nullptr; // Write-behind buffer, allocated on the first write
+    uint16_t write_buffered = 0; // Bytes waiting in write_buffer
+    uint32_t write_start = 0; // File position of the first byte in write_buffer
+    uint64_t write_time = 0; // When the oldest byte in write_buffer was written
 
-    uint8_t cache[TNFS_FILE_CACHE_SIZE];
+    uint32_t last_read_end = 0; // File position just past the last byte handed to the client
+    uint32_t readahead = 0; // Size of the last cache fill; grows while reads are sequential
+
+    uint8_t *cache = nullptr; // Allocated in PSRAM if we have it
+    uint32_t cache_size = 0;
     char filename[TNFS_MAX_FILELEN];
 };
 
@@ -76,19 +101,38 @@ private:
     uint16_t _dir_cache_current = 0;
     uint16_t _dir_cache_count = 0;
     bool _dir_cache_eof = false;
+    uint32_t _cache_size = 0; // Read cache size for each file opened on this mount (0 until picked)
+
+    // Round trip estimator, Jacobson/Karels style (RFC 6298)
+    int32_t _srtt = 0; // Smoothed RTT in ms, scaled by 8; 0 until we have a sample
+    int32_t _rttvar = 0; // RTT variation in ms, scaled by 4
+    int _rto_ms = 0; // Current retransmit timeout in ms; 0 until we have a sample
+
+    void _register();
 
 public:
     ~tnfsMountInfo();
 
-    tnfsMountInfo(){};
+    tnfsMountInfo();
     tnfsMountInfo(const char *host_name, uint16_t host_port = TNFS_DEFAULT_PORT);
     tnfsMountInfo(in_addr_t host_address, uint16_t host_port = TNFS_DEFAULT_PORT);
 
     tnfsFileHandleInfo * new_filehandleinfo();
     tnfsFileHandleInfo * get_filehandleinfo(uint8_t filehandle);
+    tnfsFileHandleInfo * get_filehandleinfo_at(int index) { return _file_handles[index]; };
     void delete_filehandleinfo(uint8_t filehandle);
     void delete_filehandleinfo(tnfsFileHandleInfo * pFilehandle);
 
+    uint32_t get_cache_size();
+
+    void rtt_sample(uint32_t rtt_ms);
+    void rtt_backoff();
+    int get_rto_ms();
+    int get_srtt_ms() { return _srtt >> 3; };
+    int get_rttvar_ms() { return _rttvar >> 2; };
+
+    static void for_each_mount(const std::function<void(tnfsMountInfo &)> &fn);
+
     tnfsDirCacheEntry * new_dircache_entry();
     tnfsDirCacheEntry * next_dircache_entry();
 
@@ -113,8 +157,16 @@ public:
     uint16_t min_retry_ms = TNFS_RETRY_DELAY; // Updated from server's response to TNFS_MOUNT
     uint16_t server_version = 0;  // Stored from server's response to TNFS_MOUNT
     uint8_t max_retries = TNFS_RETRIES;
-    int timeout_ms = TNFS_TIMEOUT;
+    int timeout_ms = TNFS_TIMEOUT; // Upper bound for the retransmit timeout
+    uint32_t retransmits = 0; // Requests we had to send again after getting no reply
+    uint32_t cache_hits = 0; // tnfs_read() calls answered entirely from a file's read cache
+    uint32_t cache_misses = 0; // tnfs_read() calls that had to fill the cache from the server
+    uint32_t dircache_hits = 0; // tnfs_readdirx() calls answered from the directory cache
+    uint32_t dircache_misses = 0; // tnfs_readdirx() calls that sent a READDIRX
+    uint16_t write_behind_ms = TNFS_WRITE_BEHIND_MS; // 0 sends every write straight away
     uint8_t current_sequence_num = 0; // Updated with each transaction to the server
+    uint8_t read_window = TNFS_READ_WINDOW; // Max READ requests in flight when filling a file cache
+    uint8_t read_window_failures = 0; // Consecutive pipelined cache fills that had to be recovered
 
     int16_t dir_handle = TNFS_INVALID_HANDLE; // Stored from server's response to TNFS_OPENDIR
     uint16_t dir_entries = 0; // Stored from server's response to TNFS_OPENDIRX
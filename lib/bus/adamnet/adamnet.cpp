@@ -8,7 +8,9 @@
 #include "../../include/debug.h"
 
 #include "fnSystem.h"
+#include "fnWiFi.h"
 #include "led.h"
+#include "busStats.h"
 #include <cstring>
 #include "fuji.h"
 
@@ -179,6 +181,8 @@ void virtualDevice::adamnet_response_nack(bool doNotWaitForIdle)
 {
     int64_t t = esp_timer_get_time() - AdamNet.start_time;
 
+    bus_stats.nak(_devnum);
+
     if (!doNotWaitForIdle)
     {
         AdamNet.wait_for_idle();
@@ -197,25 +201,9 @@ void virtualDevice::adamnet_control_ready()
 
 void systemBus::wait_for_idle()
 {
-    bool isIdle = false;
-    int64_t start, current, dur;
-
-    do
-    {
-        // Wait for serial line to quiet down.
-        while (fnUartBUS.available() > 0)
-            fnUartBUS.read();
-
-        start = current = esp_timer_get_time();
-
-        while ((fnUartBUS.available() <= 0) && (isIdle == false))
-        {
-            current = esp_timer_get_time();
-            dur = current - start;
-            if (dur > IDLE_TIME)
-                isIdle = true;
-        }
-    } while (isIdle == false);
+    // Sleeps until each byte of other devices' traffic or the end of the gap,
+    // so a busy bus doesn't keep this core spinning
+    fnUartBUS.wait_rx_quiet(IDLE_TIME);
     fnSystem.yield();
 }
 
@@ -275,14 +263,14 @@ void systemBus::_adamnet_process_cmd()
     uint8_t d = b & 0x0F;
 
     // Find device ID and pass control to it
-    if (_daisyChain.count(d) < 1)
-    {
-    }
-    else if (_daisyChain[d]->device_active == true)
+    virtualDevice *devicep = _deviceMap[d];
+    if (devicep != nullptr && devicep->device_active == true)
     {
         // turn on AdamNet Indicator LED
         fnLedManager.set(eLed::LED_BUS, true);
-        _daisyChain[d]->adamnet_process(b);
+        fnWiFi.note_activity();
+        devicep->adamnet_process(b);
+        bus_stats.command(d, esp_timer_get_time() - start_time);
         // turn off AdamNet Indicator LED
         fnLedManager.set(eLed::LED_BUS, false);
     }
@@ -293,8 +281,10 @@ void systemBus::_adamnet_process_cmd()
 void systemBus::_adamnet_process_queue()
 {
     adamnet_message_t msg;
-    if (xQueueReceive(qAdamNetMessages, &msg, 0) == pdTRUE)
+    uint32_t latency_us;
+    if (qAdamNetMessages.pop(msg, &latency_us))
     {
+        Debug_printf("AdamNet message %u after %luus\n", msg.message_id, (unsigned long)latency_us);
         switch (msg.message_id)
         {
         case ADAMNETMSG_DISKSWAP:
@@ -321,8 +311,6 @@ void systemBus::setup()
 
     // Set up interrupt for RESET line
     reset_evt_queue = xQueueCreate(10, sizeof(uint32_t));
-    // Set up event queue
-    qAdamNetMessages = xQueueCreate(4, sizeof(adamnet_message_t));
 
     // Start card detect task
     xTaskCreate(adamnet_reset_intr_task, "adamnet_reset_intr_task", 2048, this, 10, NULL);
@@ -352,6 +340,8 @@ void systemBus::addDevice(virtualDevice *pDevice, uint8_t device_id)
     Debug_printf("Adding device: %02X\n", device_id);
     pDevice->_devnum = device_id;
     _daisyChain[device_id] = pDevice;
+    if (device_id < 16)
+        _deviceMap[device_id] = pDevice;
 
     switch (device_id)
     {
@@ -386,6 +376,8 @@ void systemBus::remDevice(uint8_t device_id)
     if (deviceExists(device_id))
     {
         _daisyChain.erase(device_id);
+        if (device_id < 16)
+            _deviceMap[device_id] = nullptr;
     }
 }
 
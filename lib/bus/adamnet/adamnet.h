@@ -10,6 +10,8 @@
 
 #include <map>
 
+#include "spsc_queue.h"
+
 enum adamnet_message : uint16_t
 {
     ADAMNETMSG_DISKSWAP  // Rotate disk
@@ -242,6 +244,8 @@ class systemBus
 {
 private:
     std::map<uint8_t, virtualDevice *> _daisyChain;
+    // _daisyChain by the 4 bit device ID of a command, so dispatch doesn't search the map
+    virtualDevice *_deviceMap[16] = {nullptr};
     virtualDevice *_activeDev = nullptr;
     adamFuji *_fujiDev = nullptr;
     adamPrinter *_printerDev = nullptr;
@@ -275,7 +279,8 @@ public:
     virtualDevice *deviceById(uint8_t device_id);
     void changeDeviceId(virtualDevice *pDevice, uint8_t device_id);
     bool deviceEnabled(uint8_t device_id);
-    QueueHandle_t qAdamNetMessages = nullptr;
+    // Events from other tasks (buttons) for the bus loop
+    spsc_queue<adamnet_message_t, 4> qAdamNetMessages;
 
     bool shuttingDown = false;                                  // TRUE if we are in shutdown process
     bool getShuttingDown() { return shuttingDown; };
@@ -0,0 +1,167 @@
+#include "busStats.h"
+
+#include <cstdio>
+#include <sstream>
+
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#else
+#include "fnSystem.h"
+#endif
+
+#if defined(BUILD_ATARI)
+#define BUS_STATS_NAME "sio"
+#elif defined(BUILD_APPLE)
+#define BUS_STATS_NAME "smartport"
+#elif defined(BUILD_MAC)
+#define BUS_STATS_NAME "mac"
+#elif defined(BUILD_ADAM)
+#define BUS_STATS_NAME "adamnet"
+#elif defined(BUILD_COCO)
+#define BUS_STATS_NAME "drivewire"
+#elif defined(BUILD_IEC)
+#define BUS_STATS_NAME "iec"
+#elif defined(BUILD_RS232)
+#define BUS_STATS_NAME "rs232"
+#else
+#define BUS_STATS_NAME "bus"
+#endif
+
+busStats bus_stats;
+
+uint64_t busStats::now()
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    return fnSystem.micros();
+#endif
+}
+
+// Upper bound of the bucket holding the pct'th percentile, or max_us for the open-ended last bucket
+uint32_t bus_device_stats::percentile_us(unsigned pct) const
+{
+    uint32_t timed = 0;
+    for (int b = 0; b < BUS_STATS_BUCKETS; b++)
+        timed += buckets[b];
+    if (timed == 0)
+        return 0;
+
+    uint64_t want = ((uint64_t)timed * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (int b = 0; b < BUS_STATS_BUCKETS - 1; b++)
+    {
+        seen += buckets[b];
+        if (seen >= want)
+        {
+            uint32_t bound = 16U << b;
+            return bound < max_us ? bound : max_us;
+        }
+    }
+    return max_us;
+}
+
+void busStats::command(uint16_t device, uint32_t service_us)
+{
+    int b = 0;
+    while (b < BUS_STATS_BUCKETS - 1 && service_us >= (16U << b))
+        b++;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    bus_device_stats &s = _devices[device];
+    s.commands++;
+    s.buckets[b]++;
+    s.sum_us += service_us;
+    if (service_us > s.max_us)
+        s.max_us = service_us;
+}
+
+void busStats::retry(uint16_t device)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _devices[device].retries++;
+}
+
+void busStats::nak(uint16_t device)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _devices[device].naks++;
+}
+
+void busStats::checksum_error(uint16_t device)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _devices[device].checksum_errors++;
+}
+
+void busStats::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _devices.clear();
+    _isr_checksum_errors = 0;
+}
+
+// Moves ISR checksum errors into the map; the caller holds _mutex
+void busStats::_fold_isr_errors()
+{
+    uint32_t isr_errors = _isr_checksum_errors;
+    if (isr_errors)
+    {
+        _isr_checksum_errors = _isr_checksum_errors - isr_errors;
+        _devices[BUS_STATS_NO_DEVICE].checksum_errors += isr_errors;
+    }
+}
+
+void busStats::print()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _fold_isr_errors();
+
+    printf("%s bus\r\n", BUS_STATS_NAME);
+    printf("device   commands  p50 us  p99 us  max us  avg us retries  naks cksum\r\n");
+    for (const auto &d : _devices)
+    {
+        const bus_device_stats &s = d.second;
+        if (d.first == BUS_STATS_NO_DEVICE)
+            printf("  none ");
+        else
+            printf("  0x%02X ", (unsigned)d.first);
+        printf(" %9lu %7lu %7lu %7lu %7lu %7lu %5lu %5lu\r\n",
+               (unsigned long)s.commands, (unsigned long)s.percentile_us(50), (unsigned long)s.percentile_us(99),
+               (unsigned long)s.max_us, (unsigned long)(s.commands ? s.sum_us / s.commands : 0),
+               (unsigned long)s.retries, (unsigned long)s.naks, (unsigned long)s.checksum_errors);
+    }
+    if (_devices.empty())
+        printf("  no commands yet\r\n");
+}
+
+std::string busStats::to_json(const std::string &extra)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _fold_isr_errors();
+
+    std::ostringstream out;
+    out << "{\"bus\":\"" << BUS_STATS_NAME << "\",\"devices\":[";
+    bool first = true;
+    for (const auto &d : _devices)
+    {
+        const bus_device_stats &s = d.second;
+        out << (first ? "" : ",") << "{\"device\":";
+        if (d.first == BUS_STATS_NO_DEVICE)
+            out << "null";
+        else
+            out << d.first;
+        out << ",\"commands\":" << s.commands << ",\"p50_us\":" << s.percentile_us(50)
+            << ",\"p99_us\":" << s.percentile_us(99) << ",\"max_us\":" << s.max_us
+            << ",\"avg_us\":" << (s.commands ? s.sum_us / s.commands : 0)
+            << ",\"retries\":" << s.retries << ",\"naks\":" << s.naks
+            << ",\"checksum_errors\":" << s.checksum_errors << "}";
+        first = false;
+    }
+    out << "]";
+    if (!extra.empty())
+        out << "," << extra;
+    out << "}\n";
+
+    return out.str();
+}
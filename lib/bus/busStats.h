@@ -0,0 +1,64 @@
+#ifndef BUS_STATS_H
+#define BUS_STATS_H
+
+/*
+ * Per-device command statistics for whichever bus this build talks to.
+ * The bus loop reports each command it hands to a device along with how
+ * long the device took, plus retries, NAKs and checksum errors. A log2
+ * histogram of service times is kept per device so the web UI can show
+ * p50/p99 without storing every sample. Served as JSON on /stats.
+ */
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Bucket n counts commands that took under 2^(n+4) us, the last bucket everything slower
+#define BUS_STATS_BUCKETS 20
+
+// Errors that can't be pinned on a device, e.g. a command frame that failed its checksum
+#define BUS_STATS_NO_DEVICE 0xFFFF
+
+struct bus_device_stats
+{
+    uint32_t commands = 0;
+    uint32_t retries = 0;
+    uint32_t naks = 0;
+    uint32_t checksum_errors = 0;
+    uint32_t max_us = 0;
+    uint64_t sum_us = 0;
+    uint32_t buckets[BUS_STATS_BUCKETS] = {0};
+
+    uint32_t percentile_us(unsigned pct) const;
+};
+
+class busStats
+{
+private:
+    std::map<uint16_t, bus_device_stats> _devices;
+    std::mutex _mutex;
+
+    // Bumped from interrupt handlers, which can't take the mutex; folded in by to_json()
+    volatile uint32_t _isr_checksum_errors = 0;
+    void _fold_isr_errors();
+
+public:
+    static uint64_t now();
+
+    void command(uint16_t device, uint32_t service_us);
+    void retry(uint16_t device);
+    void nak(uint16_t device);
+    void checksum_error(uint16_t device);
+    inline void checksum_error_isr() { _isr_checksum_errors = _isr_checksum_errors + 1; }
+
+    // extra: more top-level members to report alongside, e.g. "\"tls\":{...}"
+    std::string to_json(const std::string &extra = "");
+    // The same numbers as a table on stdout, for the console
+    void print();
+    void clear();
+};
+
+extern busStats bus_stats;
+
+#endif // BUS_STATS_H
@@ -0,0 +1,32 @@
+#include "cmdArena.h"
+
+#include <cstdlib>
+
+cmdArena cmd_arena;
+
+void *cmdArena::alloc(size_t size)
+{
+    size_t aligned = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    if (aligned <= CMD_ARENA_SIZE - _used)
+    {
+        void *ptr = _buf + _used;
+        _used += aligned;
+        if (_used > high_water)
+            high_water = _used;
+        return ptr;
+    }
+
+    overflows++;
+    void *ptr = malloc(size);
+    if (ptr != nullptr)
+        _overflow.push_back(ptr);
+    return ptr;
+}
+
+void cmdArena::reset()
+{
+    _used = 0;
+    for (void *ptr : _overflow)
+        free(ptr);
+    _overflow.clear();
+}
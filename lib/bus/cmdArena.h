@@ -0,0 +1,46 @@
+#ifndef CMD_ARENA_H
+#define CMD_ARENA_H
+
+/*
+ * Scratch memory for the command the bus is handling right now. Handlers
+ * take temporaries with alloc() and never free them; the bus loop calls
+ * reset() once the command is done, which hands all of it back at once
+ * without touching the heap. Anything from alloc() is gone after reset(),
+ * so nothing may keep a pointer into it past the end of the command.
+ *
+ * Requests that don't fit in the fixed buffer come from the heap instead
+ * and are freed by reset(), so a large one still works, just slower.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define CMD_ARENA_SIZE 2048
+
+class cmdArena
+{
+private:
+    alignas(max_align_t) uint8_t _buf[CMD_ARENA_SIZE];
+    size_t _used = 0;
+    std::vector<void *> _overflow;
+
+public:
+    // Most of the buffer used by one command, and commands that didn't fit
+    size_t high_water = 0;
+    uint32_t overflows = 0;
+
+    cmdArena() { _overflow.reserve(4); }
+
+    // Suitably aligned for any type, uninitialized; nullptr only if the heap is exhausted
+    void *alloc(size_t size);
+    template <typename T>
+    T *alloc_array(size_t count) { return (T *)alloc(count * sizeof(T)); }
+
+    // End of a command, everything from alloc() becomes invalid
+    void reset();
+};
+
+extern cmdArena cmd_arena;
+
+#endif // CMD_ARENA_H
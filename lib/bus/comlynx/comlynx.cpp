@@ -10,6 +10,7 @@
 
 #include "fnSystem.h"
 #include "fnDNS.h"
+#include "fnWiFi.h"
 #include "led.h"
 #include <cstring>
 
@@ -182,32 +183,13 @@ void virtualDevice::comlynx_control_ready()
 
 void systemBus::wait_for_idle()
 {
-    bool isIdle = false;
-    int64_t start, current, dur;
-    int trashCount = 0;
+    int trashCount = fnUartBUS.available();
+    if (trashCount > 0)
+        Debug_printf("wait_for_idle() dropped %d bytes\n", trashCount);
 
-    do
-    {
-        // Wait for serial line to quiet down.
-        while (fnUartBUS.available() > 0)
-        {
-            fnUartBUS.read();
-            trashCount++;
-        }
-
-        if (trashCount > 0)
-            Debug_printf("wait_for_idle() dropped %d bytes\n", trashCount);
-
-        start = current = esp_timer_get_time();
-
-        while ((fnUartBUS.available() <= 0) && (isIdle == false))
-        {
-            current = esp_timer_get_time();
-            dur = current - start;
-            if (dur > IDLE_TIME)
-                isIdle = true;
-        }
-    } while (isIdle == false);
+    // Sleeps until each byte of other traffic or the end of the gap, so a
+    // busy bus doesn't keep this core spinning
+    fnUartBUS.wait_rx_quiet(IDLE_TIME);
     fnSystem.yield();
 }
 
@@ -274,6 +256,7 @@ void systemBus::_comlynx_process_cmd()
     {
         // turn on Comlynx Indicator LED
         fnLedManager.set(eLed::LED_BUS, true);
+        fnWiFi.note_activity();
         _daisyChain[d]->comlynx_process(b);
         // turn off Comlynx Indicator LED
         fnLedManager.set(eLed::LED_BUS, false);
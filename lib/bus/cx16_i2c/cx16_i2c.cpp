@@ -1,11 +1,13 @@
 #ifdef BUILD_CX16
 
+#include <algorithm>
 #include <cstring>
 #include "cx16_i2c.h"
 #include "../../include/debug.h"
 #include "driver/i2c.h"
 #include "../../include/pinmap.h"
 #include "led.h"
+#include "esp_timer.h"
 
 uint8_t cx16_checksum(uint8_t *buf, unsigned short len)
 {
@@ -19,16 +21,21 @@ uint8_t cx16_checksum(uint8_t *buf, unsigned short len)
 
 void virtualDevice::bus_to_computer(uint8_t *buf, uint16_t len, bool err)
 {
-    // TODO IMPLEMENT
+    CX16.payload_set(buf, len);
+
+    if (err == true)
+        cx16_error();
+    else
+        cx16_complete();
 }
 
 uint8_t virtualDevice::bus_to_peripheral(uint8_t *buf, unsigned short len)
 {
-    uint8_t ck = 0;
-
-    // TODO IMPLEMENT
+    memset(buf, 0, len);
+    CX16.payload_take(buf, len);
 
-    return ck;
+    // I²C does its own framing, there's no checksum on the wire to compare
+    return cx16_checksum(buf, len);
 }
 
 void virtualDevice::cx16_nak()
@@ -52,7 +59,7 @@ void virtualDevice::cx16_complete()
 void virtualDevice::cx16_error()
 {
     Debug_println("ERROR!");
-    CX16.address_write(5, 'E');
+    CX16.address_write(6, 'E');
 }
 
 systemBus virtualDevice::get_bus()
@@ -65,6 +72,15 @@ void systemBus::address_read(uint8_t addr)
     if (addr < sizeof(i2c_register))
     {
         Debug_printf("address_read(%u) = '%02X'\n", addr, i2c_register[addr]);
+        // Whatever an earlier read left behind would come out ahead of this
+        i2c_reset_tx_fifo(i2c_slave_port);
+
+        if (addr == I2C_REG_PAYLOAD)
+        {
+            payload_read_block();
+            return;
+        }
+
         i2c_buffer[0] = i2c_register[addr];
         i2c_slave_write_buffer(i2c_slave_port, i2c_buffer, 1, 1 / portTICK_PERIOD_MS);
 
@@ -81,14 +97,62 @@ void systemBus::address_write(uint8_t addr, uint8_t val)
         i2c_register[addr] = val;
 
         if (addr == 0x00)
+        {
             memset(&i2c_register[1], 0, 15); // Clear all other registers
+            i2c_payload.clear();
+            i2c_payload_off = 0;
+            payload_bytes = 0;
+        }
     }
 }
 
 void systemBus::payload_add(uint8_t *buf, uint16_t len)
 {
-    std::string newPayload = std::string((const char *)buf, len);
-    i2c_payload += newPayload;
+    i2c_payload.append((const char *)buf, len);
+    payload_count(len);
+}
+
+void systemBus::payload_set(uint8_t *buf, uint16_t len)
+{
+    i2c_payload.assign((const char *)buf, len);
+    i2c_payload_off = 0;
+    payload_bytes = 0;
+    i2c_register[7] = len & 0xFF;
+    i2c_register[8] = len >> 8;
+}
+
+uint16_t systemBus::payload_take(uint8_t *buf, uint16_t len)
+{
+    size_t n = std::min((size_t)len, i2c_payload.size() - i2c_payload_off);
+    memcpy(buf, i2c_payload.data() + i2c_payload_off, n);
+    i2c_payload_off += n;
+    return n;
+}
+
+void systemBus::payload_read_block()
+{
+    size_t n = std::min((size_t)I2C_BLOCK_LEN, i2c_payload.size() - i2c_payload_off);
+    if (n == 0)
+        return;
+
+    // One call queues the whole block, which the driver feeds to the FIFO as the master reads
+    i2c_slave_write_buffer(i2c_slave_port, (uint8_t *)i2c_payload.data() + i2c_payload_off, n,
+                           1 / portTICK_PERIOD_MS);
+    i2c_payload_off += n;
+    payload_count(n);
+}
+
+void systemBus::payload_count(size_t len)
+{
+    uint64_t now = esp_timer_get_time();
+    if (payload_bytes == 0)
+        payload_start_us = now;
+    payload_bytes += len;
+
+    // The last block of a response
+    if (i2c_payload_off > 0 && i2c_payload_off == i2c_payload.size() && now > payload_start_us)
+        Debug_printf("payload %lu bytes, %llu bytes/s\n", payload_bytes,
+                     (unsigned long long)payload_bytes * 1000000 / (now - payload_start_us));
 }
 
 void systemBus::process_cmd()
@@ -143,23 +207,28 @@ void systemBus::service()
     // Get packet
     int l = i2c_slave_read_buffer(i2c_slave_port, i2c_buffer, sizeof(i2c_buffer), 1 / portTICK_PERIOD_MS);
 
-    if (l)
+    if (l <= 0)
+        return;
+
+    uint8_t addr = i2c_buffer[0];
+
+    // 1 byte packet = set address for the READ that follows
+    if (l == 1)
     {
-        for (int i = 0; i < l; i++)
-            Debug_printf("%02x ",i);
+        address_read(addr);
+        return;
+    }
 
-        Debug_printf("\n\n");
+    // Payload blocks go straight on the end of the payload
+    if (addr == I2C_REG_PAYLOAD)
+    {
+        payload_add(&i2c_buffer[1], l - 1);
+        return;
     }
 
-    // // 1 byte packet = READ
-    // if (l == 1)
-    // {
-    //     address_read(i2c_buffer[0]);
-    // }
-    // else if (l == 2) // WRITE
-    // {
-    //     address_write(i2c_buffer[0], i2c_buffer[1]);
-    // }
+    // Registers auto-increment through the rest of the packet
+    for (int i = 1; i < l; i++)
+        address_write(addr++, i2c_buffer[i]);
 
 }
 
@@ -41,9 +41,18 @@
 #define CX16_DEVICEID_CPM 0x5A
 
 #define I2C_SLAVE_TX_BUF_LEN 255 
-#define I2C_SLAVE_RX_BUF_LEN 32
+#define I2C_SLAVE_RX_BUF_LEN 256
 #define I2C_DEVICE_ID 0x70
 
+#define I2C_REG_PAYLOAD 9
+
+/**
+ * Most payload bytes moved by one transaction. A read block is queued in the
+ * slave's TX buffer before the master clocks it out, so the slave only
+ * stretches the clock if the master reads past it.
+ */
+#define I2C_BLOCK_LEN 128
+
 /**
  * | Address | R/W | Description
  * |---      |---  |---
@@ -77,6 +86,13 @@
  * 4. Check ACK/NAK
  * 5. Check COMPLETE/ERROR
  * 6. If payload expected, read Payload Data for as many expected bytes.
+ *
+ * Payload moves in blocks rather than a byte per transaction:
+ *
+ * - A write transaction starting at address 9 may carry up to I2C_BLOCK_LEN
+ *   payload bytes after the address, all appended to the payload.
+ * - Each read transaction from address 9 returns the next I2C_BLOCK_LEN bytes
+ *   of the payload, or what is left of it, and must read all of them.
  */
 
 /**
@@ -289,6 +305,23 @@ private:
     /**
      * @brief I²C payload auto-increment counter.
      */
+    size_t i2c_payload_off = 0;
+
+    /**
+     * @brief Payload throughput, from the first block of a transfer to the last
+     */
+    uint32_t payload_bytes = 0;
+    uint64_t payload_start_us = 0;
+
+    /**
+     * @brief queue the next block of payload for the master to read
+     */
+    void payload_read_block();
+
+    /**
+     * @brief count a block towards the throughput of the current transfer
+     */
+    void payload_count(size_t len);
 
     /**
      * @brief called to process the next command
@@ -321,6 +354,17 @@ public:
      */
     void payload_add(uint8_t *buf, uint16_t len);
 
+    /**
+     * @brief called to replace the payload with a response for the CX16
+     */
+    void payload_set(uint8_t *buf, uint16_t len);
+
+    /**
+     * @brief called to take up to len bytes of payload sent by the CX16
+     * @return number of bytes copied
+     */
+    uint16_t payload_take(uint8_t *buf, uint16_t len);
+
     /**
      * @brief Run one iteration of the bus service loop
      */
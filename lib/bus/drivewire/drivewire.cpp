@@ -1,8 +1,7 @@
 #ifdef BUILD_COCO
 
-#include <queue>
-
 #include "drivewire.h"
+#include "drivewire/dwchannel.h"
 
 #include "../../include/debug.h"
 
@@ -17,8 +16,10 @@
 #include "fnSystem.h"
 #include "fnConfig.h"
 #include "fnDNS.h"
+#include "fnWiFi.h"
 #include "led.h"
 #include "utils.h"
+#include "busStats.h"
 
 #ifdef ESP_PLATFORM
 #include <freertos/queue.h>
@@ -34,9 +35,9 @@ static QueueHandle_t drivewire_evt_queue = NULL;
 
 drivewireDload dload;
 
-// Host & client channel queues
-std::queue<char> outgoingChannel[16];
-std::queue<char> incomingChannel[16];
+// Virtual serial channels, outgoing is FujiNet to host
+drivewireChannel outgoingChannel[DW_VSERIAL_CHANNELS];
+drivewireChannel incomingChannel[DW_VSERIAL_CHANNELS];
 
 #define DEBOUNCE_THRESHOLD_US 50000ULL
 
@@ -193,6 +194,7 @@ void systemBus::op_readex()
         if (c1 != c2)
         {
             Debug_printf("Checksum error: expected %d, got %d\n", c2, c1);
+            bus_stats.checksum_error(OP_READEX);
             rc = 243;
         }
     }
@@ -378,64 +380,61 @@ void systemBus::op_sersetstat()
 
 void systemBus::op_serread()
 {
-    unsigned char vchan = 0;
-    unsigned char response = 0x00;
+    uint8_t reply[2] = {0x00, 0x00};
 
-    // scan client channels for first that has available data    
-    for (int i = 0; i < 16; i++) {
-        if (outgoingChannel[i].empty() == false) {
-            response = outgoingChannel[i].front();
-            outgoingChannel[i].pop();
-            vchan = i;
+    // First channel with data: a single byte comes along right away (1-15),
+    // more are announced with their count (17-31) for the host to OP_SERREADM
+    for (int i = 0; i < DW_VSERIAL_CHANNELS; i++) {
+        size_t avail = outgoingChannel[i].available();
+        if (avail == 1) {
+            reply[0] = i + 1;
+            reply[1] = outgoingChannel[i].read();
+            break;
+        }
+        if (avail > 1) {
+            reply[0] = i + 17;
+            reply[1] = avail < 255 ? avail : 255;
             break;
         }
     }
-    
-    fnDwCom.write(vchan);
-    fnDwCom.write(response);
 
-    Debug_printv("OP_SERREAD: vchan $%02x - response $%02x\n", vchan, response);
+    fnDwCom.write(reply, sizeof(reply));
+
+    Debug_printv("OP_SERREAD: $%02x $%02x\n", reply[0], reply[1]);
 }
 
 void systemBus::op_serreadm()
 {
-    unsigned char vchan = fnDwCom.read();
+    unsigned char vchan = fnDwCom.read() & (DW_VSERIAL_CHANNELS - 1);
     unsigned char count = fnDwCom.read();
-    
-    // scan client channels for first that has available data    
-    for (vchan = 0; vchan < 16; vchan++) {
-        if (outgoingChannel[vchan].empty() == false) {
-            if (outgoingChannel[vchan].size() < count) count = outgoingChannel[vchan].size();
-            for (int i = 0; i < count; i++) {
-                int response = outgoingChannel[vchan].front();
-                outgoingChannel[vchan].pop();
-                fnDwCom.write(response);
-                Debug_printv("OP_SERREADM: vchan $%02x - response $%02x\n", vchan, response);
-            }
-            break;
-        }
-    }
+    uint8_t buf[256];
+
+    // The host asks for what OP_SERREAD announced, so always send count bytes
+    size_t n = outgoingChannel[vchan].read(buf, count);
+    memset(buf + n, 0, count - n);
+    fnDwCom.write(buf, count);
+
+    Debug_printv("OP_SERREADM: vchan $%02x - %u of %u bytes\n", vchan, (unsigned)n, count);
 }
 
 void systemBus::op_serwrite()
 {
-    unsigned char vchan = fnDwCom.read();
+    unsigned char vchan = fnDwCom.read() & (DW_VSERIAL_CHANNELS - 1);
     unsigned char byte = fnDwCom.read();
-    incomingChannel[vchan].push(byte);
+    incomingChannel[vchan].write(byte);
     Debug_printv("OP_SERWRITE: vchan $%02x - byte $%02x\n", vchan, byte);
 }
 
 void systemBus::op_serwritem()
 {
-    unsigned char vchan = fnDwCom.read();
+    unsigned char vchan = fnDwCom.read() & (DW_VSERIAL_CHANNELS - 1);
     unsigned char byte = fnDwCom.read();
     unsigned char count = fnDwCom.read();
-    
-    for (int i = 0; i < count; i++) {
-        int byte = fnDwCom.read();
-        incomingChannel[vchan].push(byte);
-        Debug_printv("OP_SERWRITE: vchan $%02x - byte $%02x\n", vchan, byte);
-    }
+    uint8_t buf[256];
+
+    size_t n = fnDwCom.readBytes(buf, count);
+    incomingChannel[vchan].write(buf, n);
+    Debug_printv("OP_SERWRITEM: vchan $%02x - %u bytes\n", vchan, (unsigned)n);
 }
 
 void systemBus::op_print()
@@ -453,14 +452,18 @@ void systemBus::_drivewire_process_cmd()
         return;
     }
 
+    fnWiFi.note_activity();
     fnLedManager.set(eLed::LED_BUS, true);
 
     if (c >= 0x80 && c <= 0x8F) {
         // handle FASTWRITE here
         int vchan = c & 0xF;
         int byte = fnDwCom.read();
-        incomingChannel[vchan].push(byte);
+        incomingChannel[vchan].write(byte);
     } else {
+        uint64_t start_us = busStats::now();
+        // each op's reply goes out with one port write
+        fnDwCom.begin_reply();
         switch (c)
         {
         case OP_JEFF:
@@ -477,6 +480,11 @@ void systemBus::_drivewire_process_cmd()
         case OP_READEX:
             op_readex();
             break;
+        case OP_REREADEX:
+            // host is retrying a read that failed its checksum
+            bus_stats.retry(OP_READEX);
+            op_readex();
+            break;
         case OP_WRITE:
             op_write();
             break;
@@ -541,6 +549,8 @@ void systemBus::_drivewire_process_cmd()
             op_unhandled(c);
             break;
         }
+        fnDwCom.end_reply();
+        bus_stats.command(c == OP_REREADEX ? OP_READEX : c, busStats::now() - start_us);
     }
     
     fnLedManager.set(eLed::LED_BUS, false);
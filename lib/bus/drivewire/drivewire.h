@@ -33,6 +33,9 @@
 
 #define DRIVEWIRE_BAUDRATE 57600
 
+// Virtual serial channels, a power of two
+#define DW_VSERIAL_CHANNELS 16
+
 /* Operation Codes */
 #define		OP_NOP		0
 #define     OP_JEFF     0xA5
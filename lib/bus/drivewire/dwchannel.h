@@ -0,0 +1,67 @@
+#ifndef DWCHANNEL_H
+#define DWCHANNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Bytes a virtual serial channel holds in each direction
+#define DW_CHANNEL_SIZE 256
+
+/*
+ * One direction of a DriveWire virtual serial channel: a fixed ring buffer,
+ * so bytes moving through it never touch the heap. Bytes that don't fit are
+ * dropped and counted, DriveWire has no way to hold off the host.
+ */
+class drivewireChannel
+{
+private:
+    uint8_t _buf[DW_CHANNEL_SIZE];
+    size_t _head = 0; // next byte to read
+    size_t _count = 0;
+
+public:
+    uint32_t overruns = 0;
+
+    size_t available() const { return _count; }
+    size_t room() const { return DW_CHANNEL_SIZE - _count; }
+    bool empty() const { return _count == 0; }
+    void clear() { _head = _count = 0; }
+
+    // Adds up to len bytes, returns how many fit
+    size_t write(const uint8_t *data, size_t len)
+    {
+        size_t n = len < room() ? len : room();
+        overruns += len - n;
+
+        size_t tail = (_head + _count) % DW_CHANNEL_SIZE;
+        size_t first = n < DW_CHANNEL_SIZE - tail ? n : DW_CHANNEL_SIZE - tail;
+        memcpy(_buf + tail, data, first);
+        memcpy(_buf, data + first, n - first);
+        _count += n;
+        return n;
+    }
+
+    size_t write(uint8_t b) { return write(&b, 1); }
+
+    // Takes up to len bytes, returns how many there were
+    size_t read(uint8_t *data, size_t len)
+    {
+        size_t n = len < _count ? len : _count;
+
+        size_t first = n < DW_CHANNEL_SIZE - _head ? n : DW_CHANNEL_SIZE - _head;
+        memcpy(data, _buf + _head, first);
+        memcpy(data + first, _buf, n - first);
+        _head = (_head + n) % DW_CHANNEL_SIZE;
+        _count -= n;
+        return n;
+    }
+
+    int read()
+    {
+        uint8_t b;
+        return read(&b, 1) ? b : -1;
+    }
+};
+
+#endif // DWCHANNEL_H
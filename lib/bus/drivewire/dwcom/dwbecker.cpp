@@ -308,6 +308,13 @@ void BeckerPort::make_connection()
     }
 #endif
 
+    // Replies are framed into one write each, don't let Nagle hold them back
+    int nodelay = 1;
+    if (setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, (char *)&nodelay, sizeof(nodelay)) < 0)
+    {
+        Debug_printf("BeckerPort warning: failed to set NODELAY on socket\n");
+    }
+
     // Set socket non-blocking
     if (!compat_socket_set_nonblocking(_fd))
     {
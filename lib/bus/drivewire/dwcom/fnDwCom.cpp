@@ -17,9 +17,31 @@ DwCom fnDwCom;
 // ctor
 DwCom::DwCom() : _dw_mode(dw_mode::SERIAL), _dwPort(&_serialDw) {}
 
+// write, or add to the reply being framed
+ssize_t DwCom::_send(const uint8_t *buffer, size_t size)
+{
+    if (!_framing)
+        return _dwPort->write(buffer, size);
+
+    _reply.insert(_reply.end(), buffer, buffer + size);
+    return size;
+}
+
+// send what has been framed so far
+void DwCom::_flush_reply()
+{
+    if (_reply.empty())
+        return;
+
+    _dwPort->write(_reply.data(), _reply.size());
+    _reply.clear();
+}
+
 // read single byte
 int DwCom::read()
 {
+    _flush_reply();
+
     uint8_t byte;
     int result = _dwPort->read(&byte, 1);
     if (result < 1)
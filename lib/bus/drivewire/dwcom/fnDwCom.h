@@ -2,6 +2,7 @@
 #define FNDWCOM_H
 
 #include <string.h>
+#include <vector>
 
 #include "dwport.h"
 #include "dwbecker.h"
@@ -31,7 +32,13 @@ private:
     SerialDwPort _serialDw;
     BeckerPort _beckerDw;
 
+    // reply being assembled between begin_reply() and end_reply()
+    std::vector<uint8_t> _reply;
+    bool _framing = false;
+
     size_t _print_number(unsigned long n, uint8_t base);
+    ssize_t _send(const uint8_t *buffer, size_t size);
+    void _flush_reply();
 
 public:
     DwCom();
@@ -50,31 +57,39 @@ public:
     * ms = milliseconds to wait for "port event"
     * return true if port handling is needed
     */
-    bool poll(int ms) { return _dwPort->poll(ms); }
+    bool poll(int ms) { _flush_reply(); return _dwPort->poll(ms); }
 
     // used only by serial port
     void set_baudrate(uint32_t baud) { _dwPort->set_baudrate(baud); }
     uint32_t get_baudrate() { return _dwPort->get_baudrate(); }
 
-    int available() { return _dwPort->available(); }
+    int available() { _flush_reply(); return _dwPort->available(); }
 
-    void flush() { _dwPort->flush(); }
+    void flush() { _flush_reply(); _dwPort->flush(); }
     void flush_input() {  _dwPort->flush_input(); }
 
+    /*
+    * Reply framing: writes from begin_reply() on are collected and go out
+    * together, with one port write, at end_reply(). The host only answers
+    * once it has the bytes sent so far, so any read sends them first.
+    */
+    void begin_reply() { _framing = true; }
+    void end_reply() { _flush_reply(); _framing = false; }
+
     // read bytes into buffer
-    size_t read(uint8_t *buffer, size_t length) { return _dwPort->read(buffer, length); }
+    size_t read(uint8_t *buffer, size_t length) { _flush_reply(); return _dwPort->read(buffer, length); }
     // alias to read, mimic UARTManager
-    size_t readBytes(uint8_t *buffer, size_t length) { return  _dwPort->read(buffer, length); }
+    size_t readBytes(uint8_t *buffer, size_t length) { return read(buffer, length); }
 
     // write buffer
-    ssize_t write(const uint8_t *buffer, size_t size) { return _dwPort->write(buffer, size); }
+    ssize_t write(const uint8_t *buffer, size_t size) { return _send(buffer, size); }
     // write C-string
-    ssize_t write(const char *str) { return _dwPort->write((const uint8_t *)str, strlen(str)); }
+    ssize_t write(const char *str) { return _send((const uint8_t *)str, strlen(str)); }
 
     // read single byte, mimic UARTManager
     int read();
     // write single byte, mimic UARTManager
-    ssize_t write(uint8_t b) { return _dwPort->write(&b, 1); }
+    ssize_t write(uint8_t b) { return _send(&b, 1); }
 
     // mimic UARTManager overloaded write functions
     size_t write(unsigned long n) { return write((uint8_t)n); }
@@ -281,12 +281,39 @@ static IRAM_ATTR void delayMicrosecondsISafe(uint16_t t)
 #define S_EPYX_HEADER            0x0200  // Read EPYX FastLoad header (drive code transmission)
 #define S_EPYX_LOAD              0x0400  // Detected Epyx "load" request
 #define S_EPYX_SECTOROP          0x0800  // Detected Epyx "sector operation" request
+#define S_FASTSER_ENABLED        0x1000  // C128 fast serial support is enabled
+#define S_FASTSER_DETECTED       0x2000  // Detected fast serial host (SRQ activity under ATN)
+#define S_FASTSER_LOAD           0x4000  // Detected burst FASTLOAD request
 
 #define TC_NONE      0
 #define TC_DATA_LOW  1
 #define TC_DATA_HIGH 2
 #define TC_CLK_LOW   3
 #define TC_CLK_HIGH  4
+#define TC_SRQ_LOW   5
+#define TC_SRQ_HIGH  6
+
+// fast serial bit time (SRQ low+high), the receiving CIA needs at least 4 of its cycles
+#define FASTSER_BIT_US                8
+// data bytes per burst FASTLOAD block, status bytes sent ahead of each block
+#define FASTSER_BLOCK_SIZE          254
+#define FASTSER_ST_OK              0x00
+#define FASTSER_ST_FILE_NOT_FOUND  0x02
+#define FASTSER_ST_EOI             0x1F
+
+#ifdef IEC_ATN_STATS
+// the host waits this long for DATA low after pulling ATN low
+#define IEC_ATN_DEADLINE_US 1000
+#ifdef ESP_PLATFORM
+// micros() is not reliable in interrupt handlers (see atnRequest), the cycle counter is.
+// It is per core but the interrupt handler runs on the core that called begin(), as does task()
+#define atn_stamp()      ((uint32_t) esp_cpu_get_cycle_count())
+#define atn_stamp_us(d)  ((d)/esp_rom_get_cpu_ticks_per_us())
+#else
+#define atn_stamp()      micros()
+#define atn_stamp_us(d)  (d)
+#endif
+#endif
 
 
 IECBusHandler *IECBusHandler::s_bushandler = NULL;
@@ -342,6 +369,21 @@ bool IRAM_ATTR IECBusHandler::readPinRESET()
 }
 
 
+#ifdef SUPPORT_FASTSER
+bool IRAM_ATTR IECBusHandler::readPinSRQ()
+{
+  return digitalReadFastExt(m_pinSRQ, m_regSRQread, m_bitSRQ)!=0;
+}
+
+
+void IRAM_ATTR IECBusHandler::writePinSRQ(bool v)
+{
+  // open collector, same as CLK and DATA
+  pinModeFastExt(m_pinSRQ, m_regSRQmode, m_bitSRQ, v ? INPUT : OUTPUT);
+}
+#endif
+
+
 bool IECBusHandler::waitTimeout(uint16_t timeout, uint8_t cond)
 {
   // This function may be called in code where interrupts are disabled.
@@ -372,6 +414,16 @@ bool IECBusHandler::waitTimeout(uint16_t timeout, uint8_t cond)
         case TC_CLK_HIGH:
           if( readPinCLK()  == HIGH ) return true;
           break;
+
+#ifdef SUPPORT_FASTSER
+        case TC_SRQ_LOW:
+          if( readPinSRQ()  == LOW  ) return true;
+          break;
+
+        case TC_SRQ_HIGH:
+          if( readPinSRQ()  == HIGH ) return true;
+          break;
+#endif
         }
 
       if( ((m_flags & P_ATN)!=0) == readPinATN() )
@@ -506,10 +558,17 @@ void IECBusHandler::sendSRQ()
 {
   if( m_pinSRQ!=0xFF )
     {
+#ifdef SUPPORT_FASTSER
+      // pinMode() would also drop the SRQ interrupt set up in begin()
+      writePinSRQ(LOW);
+      delayMicrosecondsISafe(1);
+      writePinSRQ(HIGH);
+#else
       digitalWrite(m_pinSRQ, LOW);
       pinMode(m_pinSRQ, OUTPUT);
       delayMicrosecondsISafe(1);
       pinMode(m_pinSRQ, INPUT);
+#endif
     }
 }
 
@@ -517,7 +576,15 @@ void IECBusHandler::sendSRQ()
 IECBusHandler::IECBusHandler(uint8_t pinATN, uint8_t pinCLK, uint8_t pinDATA, uint8_t pinRESET, uint8_t pinCTRL, uint8_t pinSRQ)
 #if defined(SUPPORT_DOLPHIN)
 #if defined(SUPPORT_DOLPHIN_XRA1405)
-#if defined(ESP_PLATFORM)
+#if defined(ESP_PLATFORM) && defined(PIN_XRA1405_CS)
+  // FujiNet: expander shares the SD card's SPI bus, pins come from the pinmap
+: m_pinDolphinSCK(PIN_SD_HOST_SCK),
+  m_pinDolphinCOPI(PIN_SD_HOST_MOSI),
+  m_pinDolphinCIPO(PIN_SD_HOST_MISO),
+  m_pinDolphinCS(PIN_XRA1405_CS),
+  m_pinDolphinHandshakeTransmit(PIN_PARALLEL_FLAG2),
+  m_pinDolphinHandshakeReceive(PIN_PARALLEL_PC2)
+#elif defined(ESP_PLATFORM)
   // ESP32
 : m_pinDolphinSCK(18),
   m_pinDolphinCOPI(23),
@@ -587,13 +654,26 @@ IECBusHandler::IECBusHandler(uint8_t pinATN, uint8_t pinCLK, uint8_t pinDATA, ui
   m_pinCTRL      = pinCTRL;
   m_pinSRQ       = pinSRQ;
 
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_EPYX) || defined(SUPPORT_DOLPHIN)
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_EPYX) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_FASTSER)
 #if IEC_DEFAULT_FASTLOAD_BUFFER_SIZE>0
   m_bufferSize = IEC_DEFAULT_FASTLOAD_BUFFER_SIZE;
 #else
   m_buffer = NULL;
   m_bufferSize = 0;
 #endif
+  clearFastLoadStats();
+#endif
+
+#ifdef IEC_ATN_STATS
+  m_atnStamped = false;
+  clearATNStats();
+#endif
+
+#ifdef SUPPORT_FASTSER
+  m_srqSeen      = false;
+  m_fastserFirst = false;
+  m_fastserClk   = HIGH;
+  m_fastserNext  = -1;
 #endif
 
 #ifdef IOREG_TYPE
@@ -609,6 +689,11 @@ IECBusHandler::IECBusHandler(uint8_t pinATN, uint8_t pinCLK, uint8_t pinDATA, ui
   m_regDATAread  = portInputRegister(digitalPinToPort(pinDATA));
   m_regDATAwrite = portOutputRegister(digitalPinToPort(pinDATA));
   m_regDATAmode  = portModeRegister(digitalPinToPort(pinDATA));
+#ifdef SUPPORT_FASTSER
+  m_bitSRQ       = digitalPinToBitMask(pinSRQ);
+  m_regSRQread   = portInputRegister(digitalPinToPort(pinSRQ));
+  m_regSRQmode   = portModeRegister(digitalPinToPort(pinSRQ));
+#endif
 #endif
 
   m_atnInterrupt = digitalPinToInterrupt(m_pinATN);
@@ -628,6 +713,10 @@ void IECBusHandler::begin()
   pinMode(m_pinDATA,  INPUT);
   if( m_pinCTRL<0xFF )  pinMode(m_pinCTRL,  OUTPUT);
   if( m_pinRESET<0xFF ) pinMode(m_pinRESET, INPUT);
+#ifdef SUPPORT_FASTSER
+  // SRQ is driven the same open collector way as CLK and DATA
+  if( m_pinSRQ<0xFF )   { pinMode(m_pinSRQ, OUTPUT); digitalWrite(m_pinSRQ, LOW); }
+#endif
   if( m_pinSRQ<0xFF )   pinMode(m_pinSRQ,   INPUT);
   m_flags = 0;
 
@@ -640,6 +729,12 @@ void IECBusHandler::begin()
     {
       s_bushandler = this;
       attachInterrupt(m_atnInterrupt, atnInterruptFcn, FALLING);
+
+#ifdef SUPPORT_FASTSER
+      // a C128 announces fast serial by clocking a byte out on SRQ under ATN
+      if( m_pinSRQ<0xFF && digitalPinToInterrupt(m_pinSRQ)!=NOT_AN_INTERRUPT )
+        attachInterrupt(digitalPinToInterrupt(m_pinSRQ), srqInterruptFcn, FALLING);
+#endif
     }
 
   // call begin() function for all attached devices
@@ -665,7 +760,7 @@ bool IECBusHandler::attachDevice(IECDevice *dev)
   if( m_numDevices<MAX_DEVICES && findDevice(dev->m_devnr, true)==NULL )
     {
       dev->m_handler = this;
-      dev->m_sflags &= ~(S_JIFFY_DETECTED|S_JIFFY_BLOCK|S_DOLPHIN_DETECTED|S_DOLPHIN_BURST_TRANSMIT|S_DOLPHIN_BURST_RECEIVE|S_EPYX_HEADER|S_EPYX_LOAD|S_EPYX_SECTOROP);
+      dev->m_sflags &= ~(S_JIFFY_DETECTED|S_JIFFY_BLOCK|S_DOLPHIN_DETECTED|S_DOLPHIN_BURST_TRANSMIT|S_DOLPHIN_BURST_RECEIVE|S_EPYX_HEADER|S_EPYX_LOAD|S_EPYX_SECTOROP|S_FASTSER_DETECTED|S_FASTSER_LOAD);
 #ifdef SUPPORT_DOLPHIN
       enableParallelPins();
 #endif
@@ -713,12 +808,84 @@ IECDevice *IECBusHandler::findDevice(uint8_t devnr, bool includeInactive)
 
 void IRAM_ATTR IECBusHandler::atnInterruptFcn(INTERRUPT_FCN_ARG)
 { 
+#ifdef IEC_ATN_STATS
+  // note the time of the edge even if task() is going to pick up the request
+  if( s_bushandler!=NULL ) s_bushandler->stampATN();
+#endif
+
   if( s_bushandler!=NULL && !s_bushandler->m_inTask & ((s_bushandler->m_flags & P_ATN)==0) )
-    s_bushandler->atnRequest();
+    {
+      s_bushandler->atnRequest();
+#ifdef IEC_ATN_STATS
+      if( s_bushandler->m_flags & P_ATN ) s_bushandler->m_atnStats.fromInterrupt++;
+#endif
+    }
+}
+
+
+#ifdef IEC_ATN_STATS
+void IRAM_ATTR IECBusHandler::stampATN()
+{
+  if( (m_flags & P_ATN)==0 )
+    {
+      if( readPinATN() )
+        {
+          // we only got here after the host was done with ATN, it most likely
+          // timed out waiting for us. Nothing left to answer.
+          m_atnStats.missedPulses++;
+          m_atnStamped = false;
+        }
+      else if( !m_atnStamped )
+        {
+          m_atnStamp   = atn_stamp();
+          m_atnStamped = true;
+        }
+    }
+}
+
+
+void IRAM_ATTR IECBusHandler::countATNLatency()
+{
+  // called from atnRequest() right after DATA went low, may be within the interrupt handler
+  ATNStats &s = m_atnStats;
+  s.requests++;
+  if( !m_atnStamped )
+    {
+      // polled (pin is not interrupt capable or interrupts were off since the edge)
+      s.unstamped++;
+      return;
+    }
+
+  uint32_t us = atn_stamp_us(atn_stamp()-m_atnStamp);
+  m_atnStamped = false;
+
+  uint8_t b = 0;
+  while( b<ATN_LATENCY_BUCKETS-1 && (us >> (b+1))!=0 ) b++;
+  s.histogram[b]++;
+  s.totalUS += us;
+  if( us>s.maxUS ) s.maxUS = us;
+  if( us>IEC_ATN_DEADLINE_US ) s.missedDeadlines++;
 }
 
 
-#if (defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)) && !defined(IEC_DEFAULT_FASTLOAD_BUFFER_SIZE)
+void IECBusHandler::clearATNStats()
+{
+  m_atnStats = {};
+}
+#endif
+
+
+#ifdef SUPPORT_FASTSER
+void IRAM_ATTR IECBusHandler::srqInterruptFcn(INTERRUPT_FCN_ARG)
+{
+  // only the host drives SRQ under ATN, our own pulses are never sent then
+  if( s_bushandler!=NULL && !s_bushandler->readPinATN() )
+    s_bushandler->m_srqSeen = true;
+}
+#endif
+
+
+#if (defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_FASTSER)) && !defined(IEC_DEFAULT_FASTLOAD_BUFFER_SIZE)
 void IECBusHandler::setBuffer(uint8_t *buffer, uint8_t bufferSize)
 {
   m_buffer     = bufferSize>0 ? buffer : NULL;
@@ -726,6 +893,41 @@ void IECBusHandler::setBuffer(uint8_t *buffer, uint8_t bufferSize)
 }
 #endif
 
+
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_FASTSER)
+uint8_t IECBusHandler::fastloadBufferSize()
+{
+  // the current device may have picked its own size
+  uint8_t n = m_currentDevice->m_fastloadBufferSize;
+  if( n==0 ) return m_bufferSize;
+#if IEC_DEFAULT_FASTLOAD_BUFFER_SIZE>0
+  return n<sizeof(m_buffer) ? n : sizeof(m_buffer);
+#else
+  return n<m_bufferSize ? n : m_bufferSize;
+#endif
+}
+
+
+void IECBusHandler::countFastLoad(uint8_t protocol, uint8_t n, uint32_t deviceUS, uint32_t busUS)
+{
+  if( n>0 )
+    {
+      FastLoadStats &s = m_fastloadStats[protocol];
+      s.blocks++;
+      s.bytes    += n;
+      s.deviceUS += deviceUS;
+      s.busUS    += busUS;
+    }
+}
+
+
+void IECBusHandler::clearFastLoadStats()
+{
+  for(uint8_t i=0; i<FASTLOAD_NUM_PROTOCOLS; i++)
+    m_fastloadStats[i] = {0, 0, 0, 0};
+}
+#endif
+
 #ifdef SUPPORT_JIFFY
 
 // ------------------------------------  JiffyDos support routines  ------------------------------------  
@@ -1245,7 +1447,7 @@ bool IECBusHandler::enableDolphinDosSupport(IECDevice *dev, bool enable)
       m_pinDolphinParallel[0]!=0xFF && m_pinDolphinParallel[1]!=0xFF &&
       m_pinDolphinParallel[2]!=0xFF && m_pinDolphinParallel[3]!=0xFF &&
       m_pinDolphinParallel[4]!=0xFF && m_pinDolphinParallel[5]!=0xFF &&
-      m_pinDolphinParallel[6]!=0xFF && m_pinDolphinParallel[6]!=0xFF &&
+      m_pinDolphinParallel[6]!=0xFF && m_pinDolphinParallel[7]!=0xFF &&
 #endif
       m_pinDolphinHandshakeTransmit!=0xFF && m_pinDolphinHandshakeReceive!=0xFF && 
       digitalPinToInterrupt(m_pinDolphinHandshakeReceive)!=NOT_AN_INTERRUPT )
@@ -1848,8 +2050,10 @@ bool IECBusHandler::transmitDolphinBurst()
 
   // get data from the device and transmit it
   uint8_t n;
-  while( (n=m_currentDevice->read(m_buffer, m_bufferSize))>0 )
+  uint32_t t = micros();
+  while( (n=m_currentDevice->read(m_buffer, fastloadBufferSize()))>0 )
     {
+      uint32_t tBus = micros();
       startParallelTransaction();
       for(uint8_t i=0; i<n; i++)
         {
@@ -1878,6 +2082,9 @@ bool IECBusHandler::transmitDolphinBurst()
               }
         }
       endParallelTransaction();
+
+      countFastLoad(FASTLOAD_DOLPHIN, n, tBus-t, micros()-tBus);
+      t = micros();
     }
 
   // switch parallel bus back to input
@@ -2282,9 +2489,11 @@ bool IECBusHandler::transmitEpyxBlock()
   m_currentDevice->talk(0);
 
   // get data
+  uint32_t t = micros();
   m_inTask = false;
-  uint8_t n = m_currentDevice->read(m_buffer, m_bufferSize);
+  uint8_t n = m_currentDevice->read(m_buffer, fastloadBufferSize());
   m_inTask = true;
+  uint32_t tBus = micros();
   if( (m_flags & P_ATN) || !readPinATN() ) return false;
 
   noInterrupts();
@@ -2305,6 +2514,8 @@ bool IECBusHandler::transmitEpyxBlock()
 
   interrupts();
 
+  countFastLoad(FASTLOAD_EPYX, n, tBus-t, micros()-tBus);
+
   // the "end transmission" condition for the receiver is receiving
   // a "0" length byte so we keep sending block until we have
   // transmitted a 0-length block (i.e. end-of-file)
@@ -2312,6 +2523,159 @@ bool IECBusHandler::transmitEpyxBlock()
 }
 
 
+#endif
+
+#ifdef SUPPORT_FASTSER
+
+// ------------------------------------  C128 fast serial support routines  ------------------------------------
+
+// The C128 and the 1571/1581 move fast serial bytes through their CIA shift registers,
+// SRQ being the shift clock and DATA the data line, most significant bit first.
+// Bursts (the "U0" commands) add a handshake on top: the host toggles CLK each time
+// it is ready for the next byte.
+
+
+bool IECBusHandler::enableFastSerialSupport(IECDevice *dev, bool enable)
+{
+  // a burst block is 254 bytes (plus one we read ahead) and must fit the buffer
+#if IEC_DEFAULT_FASTLOAD_BUFFER_SIZE>0
+  bool bufferOk = sizeof(m_buffer)>=FASTSER_BLOCK_SIZE+1;
+#else
+  bool bufferOk = m_bufferSize>=FASTSER_BLOCK_SIZE+1;
+#endif
+
+  if( enable && bufferOk && m_pinSRQ!=0xFF )
+    dev->m_sflags |= S_FASTSER_ENABLED;
+  else
+    dev->m_sflags &= ~S_FASTSER_ENABLED;
+
+  // cancel any current requests
+  dev->m_sflags &= ~(S_FASTSER_DETECTED|S_FASTSER_LOAD);
+
+  return (dev->m_sflags & S_FASTSER_ENABLED)!=0;
+}
+
+
+void IECBusHandler::fastSerialLoadRequest(IECDevice *dev)
+{
+  if( dev->m_sflags & S_FASTSER_ENABLED )
+    {
+      dev->m_sflags |= S_FASTSER_LOAD;
+      m_fastserFirst = true;
+      m_fastserNext  = -1;
+
+      // the first toggle asks for the first byte
+      m_fastserClk   = readPinCLK();
+    }
+}
+
+
+bool IRAM_ATTR IECBusHandler::transmitFastSerByte(uint8_t data)
+{
+  timer_init();
+  timer_reset();
+  timer_start();
+
+  for(uint8_t i=0; i<8; i++)
+    {
+      // put the bit on DATA while SRQ is low, receiver shifts it in on the rising edge
+      writePinSRQ(LOW);
+      writePinDATA(data & 0x80);
+      timer_wait_until(FASTSER_BIT_US*i + FASTSER_BIT_US/2);
+      writePinSRQ(HIGH);
+      timer_wait_until(FASTSER_BIT_US*(i+1));
+      data <<= 1;
+    }
+
+  writePinDATA(HIGH);
+
+  // abort if the host pulled ATN low in the meantime
+  return (m_flags & P_ATN) || readPinATN();
+}
+
+
+bool IECBusHandler::receiveFastSerByte(bool canWriteOk)
+{
+  // release DATA to signal "ready-for-data" and give the host some time to start
+  // clocking the byte, if it does not then we'll be back on the next task() call
+  writePinDATA(HIGH);
+  if( !waitTimeout(200, TC_SRQ_LOW) ) return readPinATN();
+
+  // the host sends the whole byte without waiting for us
+  noInterrupts();
+  uint8_t data = 0;
+  for(uint8_t i=0; i<8; i++)
+    {
+      if( i>0 && !waitTimeout(FASTSER_BIT_US*4, TC_SRQ_LOW) ) { interrupts(); return false; }
+      if( !waitTimeout(FASTSER_BIT_US*4, TC_SRQ_HIGH) )       { interrupts(); return false; }
+      data = (data << 1) | (readPinDATA() ? 1 : 0);
+    }
+
+  // signal "not ready" while the device handles the byte
+  writePinDATA(LOW);
+  interrupts();
+
+  // the fast protocol has no EOI, the host ends the transmission with UNLISTEN
+  if( !canWriteOk ) return false;
+  m_currentDevice->write(data, false);
+  return true;
+}
+
+
+bool IECBusHandler::transmitFastSerBurstByte(uint8_t data)
+{
+  // wait for the host to toggle CLK, asking for the next byte
+  m_fastserClk = !m_fastserClk;
+  if( !waitPinCLK(m_fastserClk, 0) ) return false;
+
+  return transmitFastSerByte(data);
+}
+
+
+bool IECBusHandler::transmitFastSerBlock()
+{
+  // set channel number for read() calls below
+  m_currentDevice->talk(0);
+
+  // fill a whole block, then read one byte ahead to find out whether it is the last one
+  uint32_t t = micros();
+  m_inTask = false;
+  uint8_t n = 0, chunk = fastloadBufferSize();
+  if( m_fastserNext>=0 ) m_buffer[n++] = (uint8_t) m_fastserNext;
+  while( n<FASTSER_BLOCK_SIZE )
+    {
+      uint8_t nn = m_currentDevice->read(m_buffer+n, FASTSER_BLOCK_SIZE-n < chunk ? FASTSER_BLOCK_SIZE-n : chunk);
+      if( nn==0 ) break;
+      n += nn;
+    }
+  bool last = n<FASTSER_BLOCK_SIZE || m_currentDevice->read(m_buffer+n, 1)==0;
+  m_fastserNext = last ? -1 : m_buffer[n];
+  m_inTask = true;
+  uint32_t tBus = micros();
+  if( (m_flags & P_ATN) || !readPinATN() ) return false;
+
+  // nothing at all to send means the file could not be opened
+  uint8_t status = FASTSER_ST_OK;
+  if( last ) status = (n==0 && m_fastserFirst) ? FASTSER_ST_FILE_NOT_FOUND : FASTSER_ST_EOI;
+  m_fastserFirst = false;
+
+  noInterrupts();
+
+  // status byte, for the last block followed by its length, then the data
+  bool ok = transmitFastSerBurstByte(status);
+  if( ok && status==FASTSER_ST_EOI ) ok = transmitFastSerBurstByte(n);
+  if( status!=FASTSER_ST_FILE_NOT_FOUND )
+    for(uint8_t i=0; ok && i<n; i++)
+      ok = transmitFastSerBurstByte(m_buffer[i]);
+
+  interrupts();
+  m_srqSeen = false;
+
+  countFastLoad(FASTLOAD_FASTSER, n, tBus-t, micros()-tBus);
+
+  return ok && !last;
+}
+
 #endif
 
 // ------------------------------------  IEC protocol support routines  ------------------------------------  
@@ -2570,6 +2934,10 @@ void IRAM_ATTR IECBusHandler::atnRequest()
   // disable the hardware that allows ATN to pull DATA low
   writePinCTRL(HIGH);
 
+#ifdef IEC_ATN_STATS
+  countATNLatency();
+#endif
+
 #ifdef SUPPORT_JIFFY
   for(uint8_t i=0; i<m_numDevices; i++)
     m_devices[i]->m_sflags &= ~(S_JIFFY_DETECTED|S_JIFFY_BLOCK);
@@ -2582,6 +2950,10 @@ void IRAM_ATTR IECBusHandler::atnRequest()
   for(uint8_t i=0; i<m_numDevices; i++) 
     m_devices[i]->m_sflags &= ~(S_EPYX_HEADER|S_EPYX_LOAD|S_EPYX_SECTOROP);
 #endif
+#ifdef SUPPORT_FASTSER
+  for(uint8_t i=0; i<m_numDevices; i++) 
+    m_devices[i]->m_sflags &= ~(S_FASTSER_DETECTED|S_FASTSER_LOAD);
+#endif
 }
 
 
@@ -2642,6 +3014,13 @@ void IECBusHandler::task()
       m_primary = 0;
       if( receiveIECByteATN(m_primary) && ((m_primary == 0x3f) || (m_primary == 0x5f) || (findDevice((unsigned int) m_primary & 0x1f)!=NULL)) )
         {
+#ifdef SUPPORT_FASTSER
+          // a C128 in fast mode has clocked a byte out on SRQ since it pulled ATN low
+          IECDevice *fdev = findDevice(m_primary & 0x1F);
+          if( m_srqSeen && fdev!=NULL && (fdev->m_sflags & S_FASTSER_ENABLED) )
+            fdev->m_sflags |= S_FASTSER_DETECTED;
+#endif
+
           // this is either UNLISTEN or UNTALK or we were addressed
           // => receive the secondary address, assume 0 if not sent
           if( (m_primary == 0x3f) || (m_primary == 0x5f) || !receiveIECByteATN(m_secondary) ) m_secondary = 0;
@@ -2662,6 +3041,11 @@ void IECBusHandler::task()
 #ifdef SUPPORT_DOLPHIN
               // see comments in function receiveDolphinByte
               if( m_secondary==0x61 ) m_dolphinCtr = 2*DOLPHIN_PREBUFFER_BYTES;
+#endif
+#ifdef SUPPORT_FASTSER
+              // answer a fast host with a fast byte, it then sends us its data in fast mode
+              if( m_currentDevice->m_sflags & S_FASTSER_DETECTED )
+                transmitFastSerByte(0x00);
 #endif
               // set DATA=0 ("I am here")
               writePinDATA(LOW);
@@ -2735,6 +3119,11 @@ void IECBusHandler::task()
 
       interrupts();
 
+#ifdef SUPPORT_FASTSER
+      // done with this ATN sequence (also drops edges from our own fast byte)
+      m_srqSeen = false;
+#endif
+
       if( (m_flags & P_LISTENING)!=0 )
         {
           // a device is supposed to listen, check if it can accept data
@@ -2758,6 +3147,9 @@ void IECBusHandler::task()
     {
       // host has released ATN
       m_flags &= ~P_ATN;
+#ifdef SUPPORT_FASTSER
+      m_srqSeen = false;
+#endif
     }
 
 #ifdef SUPPORT_DOLPHIN
@@ -2877,6 +3269,30 @@ void IECBusHandler::task()
 #endif
 #endif
 
+#ifdef SUPPORT_FASTSER
+  // ------------------ C128 burst FASTLOAD handling -------------------
+
+  for(uint8_t devidx=0; devidx<m_numDevices; devidx++)
+  if( m_devices[devidx]->m_sflags & S_FASTSER_LOAD )
+    {
+      IECDevice *dev = m_devices[devidx];
+      m_currentDevice = dev;
+      if( !transmitFastSerBlock() )
+        {
+          // either end-of-data or transmission error => we are done
+          writePinDATA(HIGH);
+
+          // close the file (was opened for the burst command), m_currentDevice
+          // may have been reset by an ATN request while the block was read
+          dev->listen(0xE0);
+          dev->unlisten();
+
+          // no more data to send
+          dev->m_sflags &= ~S_FASTSER_LOAD;
+        }
+    }
+#endif
+
   // ------------------ receiving data -------------------
 
   if( (m_flags & (P_ATN|P_LISTENING|P_DONE))==P_LISTENING && (m_currentDevice!=NULL) )
@@ -2911,6 +3327,20 @@ void IECBusHandler::task()
             }
           }
 #endif
+#ifdef SUPPORT_FASTSER
+      else if( (m_currentDevice->m_sflags & S_FASTSER_DETECTED)!=0 && numData>=0 )
+        {
+          // receiving from a C128 in fast mode
+          if( !receiveFastSerByte(numData>0) )
+            {
+              // receive failed => release DATA 
+              // and stop listening.  This will signal
+              // an error condition to the sender
+              writePinDATA(HIGH);
+              m_flags |= P_DONE;
+            }
+        }
+#endif
 #ifdef SUPPORT_DOLPHIN
       else if( (m_currentDevice->m_sflags & S_DOLPHIN_DETECTED)!=0 && numData>=0 )
         {
@@ -2950,9 +3380,11 @@ void IECBusHandler::task()
      if( (m_currentDevice->m_sflags & S_JIFFY_BLOCK)!=0 )
        {
          // JiffyDOS block transfer mode
+         uint32_t t = micros();
          m_inTask = false;
-         uint8_t numData = m_currentDevice->read(m_buffer, m_bufferSize);
+         uint8_t numData = m_currentDevice->read(m_buffer, fastloadBufferSize());
          m_inTask = true;
+         uint32_t tBus = micros();
 
          // delay to make sure receiver sees our CLK LOW and enters "new data block" state.
          // If a possible VIC "bad line" occurs right after reading bits 6+7 it may take
@@ -2962,7 +3394,9 @@ void IECBusHandler::task()
          // preventing the receiver from going into "new data block" state
          while( (micros()-m_timeoutStart)<175 );
 
-         if( (m_flags & P_ATN) || !readPinATN() || !transmitJiffyBlock(m_buffer, numData) )
+         bool ok = !(m_flags & P_ATN) && readPinATN() && transmitJiffyBlock(m_buffer, numData);
+         countFastLoad(FASTLOAD_JIFFY, numData, tBus-t, micros()-tBus);
+         if( !ok )
            {
              // either a transmission error, no more data to send or falling edge on ATN
              m_flags |= P_DONE;
@@ -60,12 +60,47 @@ class IECBusHandler
   // ok but bus communication will be slower if called less frequently.
   void task();
 
-#if (defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)) && !defined(IEC_DEFAULT_FASTLOAD_BUFFER_SIZE)
+#if (defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_FASTSER)) && !defined(IEC_DEFAULT_FASTLOAD_BUFFER_SIZE)
   // if IEC_DEFAULT_FASTLOAD_BUFFER_SIZE is set to 0 then the buffer space used
   // by fastload protocols can be set dynamically using the setBuffer function.
   void setBuffer(uint8_t *buffer, uint8_t bufferSize);
 #endif
 
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_FASTSER)
+  // throughput of fastload (LOAD direction) block transfers, split into the time spent
+  // waiting for the device to fill a block and the time spent putting it on the bus
+  enum { FASTLOAD_JIFFY, FASTLOAD_EPYX, FASTLOAD_DOLPHIN, FASTLOAD_FASTSER, FASTLOAD_NUM_PROTOCOLS };
+  struct FastLoadStats
+  {
+    uint32_t blocks, bytes;
+    uint64_t deviceUS, busUS;
+  };
+
+  const FastLoadStats &getFastLoadStats(uint8_t protocol) { return m_fastloadStats[protocol]; }
+  void clearFastLoadStats();
+#endif
+
+#ifdef IEC_ATN_STATS
+  // time from the falling edge on ATN (as seen by the interrupt handler) to DATA being
+  // pulled low in response. The host gives up with "device not present" after 1ms.
+  // histogram[i] counts responses faster than 2^(i+1) us, the last bucket all slower ones
+  enum { ATN_LATENCY_BUCKETS = 12 };
+  struct ATNStats
+  {
+    uint32_t requests;          // ATN requests answered
+    uint32_t fromInterrupt;     // ... of those answered by the interrupt handler itself
+    uint32_t unstamped;         // ... answered without the interrupt having seen the edge
+    uint32_t missedDeadlines;   // answered later than IEC_ATN_DEADLINE_US
+    uint32_t missedPulses;      // interrupt came in after ATN had been released again
+    uint32_t maxUS;
+    uint64_t totalUS;
+    uint32_t histogram[ATN_LATENCY_BUCKETS];
+  };
+
+  const ATNStats &getATNStats() { return m_atnStats; }
+  void clearATNStats();
+#endif
+
 #ifdef SUPPORT_JIFFY 
   bool enableJiffyDosSupport(IECDevice *dev, bool enable);
 #endif
@@ -75,6 +110,11 @@ class IECBusHandler
   void epyxLoadRequest(IECDevice *dev);
 #endif
 
+#ifdef SUPPORT_FASTSER
+  bool enableFastSerialSupport(IECDevice *dev, bool enable);
+  void fastSerialLoadRequest(IECDevice *dev);
+#endif
+
 #ifdef SUPPORT_DOLPHIN
   // call this BEFORE begin() if you do not want to use the default pins for the DolphinDos cable
 #ifdef SUPPORT_DOLPHIN_XRA1405
@@ -119,6 +159,15 @@ class IECBusHandler
   bool receiveIECByte(bool canWriteOk);
   bool transmitIECByte(uint8_t numData);
 
+#ifdef IEC_ATN_STATS
+  inline void stampATN();
+  inline void countATNLatency();
+
+  ATNStats m_atnStats;
+  volatile uint32_t m_atnStamp;
+  volatile bool m_atnStamped;
+#endif
+
   volatile uint16_t m_timeoutDuration; 
   volatile uint32_t m_timeoutStart;
   volatile bool m_inTask;
@@ -190,6 +239,26 @@ class IECBusHandler
 #endif // IOREG_TYPE
 #endif // SUPPORT_DOLPHIN
 
+#ifdef SUPPORT_FASTSER
+  inline bool readPinSRQ();
+  inline void writePinSRQ(bool v);
+  bool transmitFastSerByte(uint8_t data);
+  bool receiveFastSerByte(bool canWriteOk);
+  bool transmitFastSerBurstByte(uint8_t data);
+  bool transmitFastSerBlock();
+
+  volatile bool m_srqSeen;
+  bool m_fastserFirst, m_fastserClk;
+  int16_t m_fastserNext;
+#ifdef IOREG_TYPE
+  volatile IOREG_TYPE *m_regSRQmode;
+  volatile const IOREG_TYPE *m_regSRQread;
+  IOREG_TYPE m_bitSRQ;
+#endif
+
+  static void srqInterruptFcn(INTERRUPT_FCN_ARG);
+#endif
+
 #ifdef SUPPORT_EPYX
   bool receiveEpyxByte(uint8_t &data);
   bool transmitEpyxByte(uint8_t data);
@@ -201,13 +270,17 @@ class IECBusHandler
 #endif
 #endif
   
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_FASTSER)
+  uint8_t fastloadBufferSize();
+  void countFastLoad(uint8_t protocol, uint8_t n, uint32_t deviceUS, uint32_t busUS);
+
+  FastLoadStats m_fastloadStats[FASTLOAD_NUM_PROTOCOLS];
   uint8_t m_bufferSize;
 #if IEC_DEFAULT_FASTLOAD_BUFFER_SIZE>0
 #if defined(SUPPORT_EPYX) && defined(SUPPORT_EPYX_SECTOROPS)
   uint8_t  m_buffer[256];
 #else
-  uint8_t  m_buffer[IEC_DEFAULT_FASTLOAD_BUFFER_SIZE];
+  uint8_t  m_buffer[IEC_MAX_FASTLOAD_BUFFER_SIZE];
 #endif
 #else
   uint8_t *m_buffer;
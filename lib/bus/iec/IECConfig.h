@@ -24,9 +24,17 @@
 // for the corresponding fast-load protocols
 #define SUPPORT_JIFFY
 #define SUPPORT_EPYX
+// DolphinDos needs the parallel cable, which FujiNet boards connect through an
+// XRA1405 SPI port expander. Boards that can have one define its pins in their
+// pinmap (so far the LOLIN D32 Pro, built with IEC_HAS_DOLPHIN_CABLE).
 #if defined(PIN_XRA1405_CS) && defined(PIN_PARALLEL_PC2) && defined(PIN_PARALLEL_FLAG2)
-//#define SUPPORT_DOLPHIN
-//#define SUPPORT_DOLPHIN_XRA1405
+#define SUPPORT_DOLPHIN
+#define SUPPORT_DOLPHIN_XRA1405
+#endif
+// C128 fast serial (the 1571/1581 burst mode) is clocked over the SRQ line,
+// the bus handler only uses it if an SRQ pin is given to its constructor
+#if defined(PIN_IEC_SRQ)
+#define SUPPORT_FASTSER
 #endif
 
 // support Epyx FastLoad sector operations (disk editor, disk copy, file copy)
@@ -34,7 +42,10 @@
 // at least 256 bytes. Note that the "bufferSize" argument is a byte and therefore
 // capped at 255 bytes. Make sure the buffer itself has >=256 bytes and use a 
 // bufferSize argument of 255 or less
-//#define SUPPORT_EPYX_SECTOROPS
+#define SUPPORT_EPYX_SECTOROPS
+
+// keep statistics on how quickly ATN requests are answered, see IECBusHandler::getATNStats()
+#define IEC_ATN_STATS
 
 // defines the maximum number of devices that the bus handler will be
 // able to support - set to 4 by default but can be increased to up to 30 devices
@@ -43,8 +54,13 @@
 // sets the default size of the fastload buffer. If this is set to 0 then fastload
 // protocols can only be used if the IECBusHandler::setBuffer() function is
 // called to define the buffer.
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_FASTSER)
 #define IEC_DEFAULT_FASTLOAD_BUFFER_SIZE 128
+
+// largest size a device can pick for itself with IECDevice::setFastLoadBufferSize().
+// Fastload protocols send block lengths as a single byte so this can not exceed 255.
+// The bus handler reserves this much RAM for the fastload buffer.
+#define IEC_MAX_FASTLOAD_BUFFER_SIZE 255
 #endif
 
 // buffer size for IECFileDevice when receiving data. On channel 15, any command
@@ -30,6 +30,7 @@ IECDevice::IECDevice(uint8_t devnr)
   m_devnr   = devnr; 
   m_handler = NULL;
   m_sflags  = 0;
+  m_fastloadBufferSize = 0;
   //m_isActive = true;
 }
 
@@ -88,10 +89,22 @@ void IECDevice::epyxLoadRequest()
 
 #endif  
 
+#ifdef SUPPORT_FASTSER
+bool IECDevice::enableFastSerialSupport(bool enable)
+{
+  return m_handler ? m_handler->enableFastSerialSupport(this, enable) : false;
+}
+
+void IECDevice::fastSerialLoadRequest()
+{
+  if( m_handler ) m_handler->fastSerialLoadRequest(this);
+}
+#endif
+
 
 // default implementation of "buffer read" function which can/should be overridden
 // (for efficiency) by devices using the JiffyDos, Epyx FastLoad or DolphinDos protocol
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_EPYX) || defined(SUPPORT_DOLPHIN)
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_EPYX) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_FASTSER)
 uint8_t IECDevice::read(uint8_t *buffer, uint8_t bufferSize)
 { 
   uint8_t i;
@@ -55,6 +55,20 @@ class IECDevice
   bool enableEpyxFastLoadSupport(bool enable);
 #endif
 
+#ifdef SUPPORT_FASTSER
+  // call this to enable or disable C128 fast serial (burst mode) support for your device.
+  // this function will fail if no SRQ pin was given to the IECBusHandler constructor
+  bool enableFastSerialSupport(bool enable);
+#endif
+
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_FASTSER)
+  // call this to change how many bytes fastload protocols ask for with each
+  // read(buffer, bufferSize) call. 0 (the default) uses the bus handler's buffer size,
+  // sizes above the buffer available to the bus handler are capped.
+  void setFastLoadBufferSize(uint8_t size) { m_fastloadBufferSize = size; }
+  uint8_t getFastLoadBufferSize() { return m_fastloadBufferSize; }
+#endif
+
 
   /**
    * @brief is device active (turned on?)
@@ -143,7 +157,7 @@ class IECDevice
   virtual uint8_t write(uint8_t *buffer, uint8_t bufferSize, bool eoi);
 #endif
 
-#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX)
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_FASTSER)
   // called when the device is sending data using the JiffyDOS block transfer
   // or DolphinDos burst transfer (LOAD protocols)
   // - should fill the buffer with as much data as possible (up to bufferSize)
@@ -183,6 +197,12 @@ class IECDevice
   void epyxLoadRequest();
 #endif
 
+#ifdef SUPPORT_FASTSER
+  // call this after opening the file named in a C128 burst FASTLOAD command
+  // ("U0" followed by $1F) on channel 0 (the IECFileDevice class handles this automatically)
+  void fastSerialLoadRequest();
+#endif
+
   // send pulse on SRQ line (if SRQ pin was set in IECBusHandler constructor)
   void sendSRQ();
 
@@ -190,6 +210,7 @@ class IECDevice
   //bool       m_isActive;
   uint8_t    m_devnr;
   uint16_t m_sflags;
+  uint8_t  m_fastloadBufferSize;
   IECBusHandler *m_handler;
 };
 
@@ -113,6 +113,12 @@ void IECFileDevice::begin()
 #if DEBUG>0
   Serial.print(F("Epyx FastLoad support ")); Serial.println(ok ? F("enabled") : F("disabled"));
 #endif
+#endif
+#ifdef SUPPORT_FASTSER
+  ok = IECDevice::enableFastSerialSupport(true);
+#if DEBUG>0
+  Serial.print(F("C128 fast serial support ")); Serial.println(ok ? F("enabled") : F("disabled"));
+#endif
 #endif
 
   m_statusBufferPtr = 0;
@@ -260,6 +266,9 @@ uint8_t IECFileDevice::read(uint8_t *buffer, uint8_t bufferSize)
 {
   uint8_t res = 0;
 
+  // invalid channel or OPEN failed (a burst FASTLOAD reports that as "file not found")
+  if( m_channel > 15 || m_readBufferLen[m_channel]==-128 ) return 0;
+
   // get data from our own 2-uint8_t buffer (if any)
   // properly deal with the case where bufferSize==1
   while( m_readBufferLen[m_channel]>0 && res<bufferSize )
@@ -603,6 +612,19 @@ void IECFileDevice::fileTask()
             m_epyxCtr = 0;
           }
 #endif
+#ifdef SUPPORT_FASTSER
+        if( m_writeBufferLen>=3 && cmd[0]=='U' && cmd[1]=='0' && (cmd[2] & 0x1F)==0x1F )
+          {
+            // C128 burst FASTLOAD: "U0", $1F (upper bits are options), file name
+#if DEBUG>0
+            Serial.print(F("BURST FASTLOAD: ")); Serial.println(cmd+3);
+#endif
+            bool ok = open(0, cmd+3);
+            m_readBufferLen[0] = ok ? 0 : -128;
+            fastSerialLoadRequest();
+            handled = true;
+          }
+#endif
 #ifdef SUPPORT_DOLPHIN
         if( strcmp_P(cmd, PSTR("XQ"))==0 )
           { dolphinBurstTransmitRequest(); m_channel = 0; handled = true; m_eoi = false; }
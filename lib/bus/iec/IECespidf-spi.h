@@ -0,0 +1,100 @@
+// -----------------------------------------------------------------------------
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have receikved a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+// -----------------------------------------------------------------------------
+
+// Minimal stand-in for the Arduino SPI class on ESP-IDF, just what the
+// DolphinDos XRA1405 port expander code in IECBusHandler needs.
+
+#ifndef IECESPIDF_SPI_H
+#define IECESPIDF_SPI_H
+
+#include <string.h>
+#include <driver/spi_master.h>
+
+// SPI host the XRA1405 is attached to. The default is the SD card's bus
+// (the XRA1405 gets its own CS line), the bus is set up by whichever of the
+// two starts first.
+#ifndef IEC_XRA1405_SPI_HOST
+#define IEC_XRA1405_SPI_HOST SPI2_HOST
+#endif
+
+#define MSBFIRST  1
+#define SPI_MODE0 0
+
+struct SPISettings
+{
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) : m_clock(clock), m_mode(dataMode) {}
+  uint32_t m_clock;
+  uint8_t  m_mode;
+};
+
+
+class IECespidfSPI
+{
+ public:
+  void begin(uint8_t pinSCK, uint8_t pinCIPO, uint8_t pinCOPI, SPISettings settings)
+  {
+    if( m_device!=NULL ) return;
+
+    spi_bus_config_t bus;
+    memset(&bus, 0, sizeof(bus));
+    bus.sclk_io_num     = pinSCK;
+    bus.miso_io_num     = pinCIPO;
+    bus.mosi_io_num     = pinCOPI;
+    bus.quadwp_io_num   = -1;
+    bus.quadhd_io_num   = -1;
+    bus.max_transfer_sz = 4;
+
+    // ESP_ERR_INVALID_STATE means the bus is already up (e.g. for the SD card)
+    esp_err_t err = spi_bus_initialize(IEC_XRA1405_SPI_HOST, &bus, SPI_DMA_DISABLED);
+    if( err!=ESP_OK && err!=ESP_ERR_INVALID_STATE ) return;
+
+    // CS is driven by IECBusHandler itself
+    spi_device_interface_config_t dev;
+    memset(&dev, 0, sizeof(dev));
+    dev.clock_speed_hz = settings.m_clock;
+    dev.mode           = settings.m_mode;
+    dev.spics_io_num   = -1;
+    dev.queue_size     = 1;
+    if( spi_bus_add_device(IEC_XRA1405_SPI_HOST, &dev, &m_device)!=ESP_OK )
+      m_device = NULL;
+  }
+
+  // holds the bus across a whole block, so transfers don't have to wait
+  // for the SD card driver in between
+  void beginTransaction() { if( m_device ) spi_device_acquire_bus(m_device, portMAX_DELAY); }
+  void endTransaction()   { if( m_device ) spi_device_release_bus(m_device); }
+
+  uint16_t IRAM_ATTR transfer16(uint16_t data)
+  {
+    if( m_device==NULL ) return 0;
+
+    spi_transaction_t t;
+    memset(&t, 0, sizeof(t));
+    t.flags     = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+    t.length    = 16;
+    t.tx_data[0] = data >> 8;
+    t.tx_data[1] = data & 0xFF;
+    spi_device_polling_transmit(m_device, &t);
+    return (t.rx_data[0] << 8) | t.rx_data[1];
+  }
+
+ private:
+  spi_device_handle_t m_device = NULL;
+};
+
+static IECespidfSPI SPI;
+
+#endif
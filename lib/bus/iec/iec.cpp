@@ -5,6 +5,7 @@
 
 #include <cstring>
 #include <memory>
+#include <sstream>
 
 #include "soc/io_mux_reg.h"
 #include "driver/gpio.h"
@@ -39,14 +40,18 @@ systemBus::systemBus() : IECBusHandler(PIN_IEC_ATN, PIN_IEC_CLK_OUT, PIN_IEC_DAT
 #endif
 }
 
-// static void ml_iec_intr_task(void* arg)
-// {
-//     while ( true )
-//     {
-//       IEC.service();
-//       taskYIELD(); // Allow other tasks to run
-//     }
-// }
+#ifdef IEC_DEDICATED_CORE
+static void ml_iec_intr_task(void* arg)
+{
+    // begin() from here so the ATN interrupt is served on this core as well
+    IEC.begin();
+    while ( true )
+    {
+      IEC.task();
+      taskYIELD(); // Allow other tasks to run
+    }
+}
+#endif
 
 // void init_gpio(gpio_num_t _pin)
 // {
@@ -61,7 +66,9 @@ systemBus::systemBus() : IECBusHandler(PIN_IEC_ATN, PIN_IEC_CLK_OUT, PIN_IEC_DAT
 void systemBus::setup()
 {
   Debug_printf("IEC systemBus::setup()\r\n");
+#ifndef IEC_DEDICATED_CORE
   begin();
+#endif
 #ifdef SUPPORT_JIFFY
   Debug_printf("JiffyDOS protocol supported\r\n");
 #endif
@@ -87,17 +94,27 @@ void systemBus::setup()
 #warning intr_type likely needs to be fixed!
 #endif
 
-    // Start task
-    // Create a new high-priority task to handle the main service loop
-    // This is assigned to CPU1; the WiFi task ends up on CPU0
-    //xTaskCreatePinnedToCore(ml_iec_intr_task, "ml_iec_intr_task", MAIN_STACKSIZE, NULL, MAIN_PRIORITY, NULL, MAIN_CPUAFFINITY);
+    // With IEC_DEDICATED_CORE the bus task is started by the first service() call,
+    // once all devices are attached
 
 }
 
 
 void systemBus::service()
 {
+#ifdef IEC_DEDICATED_CORE
+  // Create a new high-priority task to handle the IEC bus, all of it from the ATN
+  // interrupt to the devices' file access. It gets CPU1 to itself, the main loop
+  // runs on CPU0 with WiFi instead (see main.cpp)
+  if( !taskStarted )
+    {
+      taskStarted = true;
+      Debug_printf("IEC bus task on CPU%d\r\n", MAIN_CPUAFFINITY);
+      xTaskCreatePinnedToCore(ml_iec_intr_task, "ml_iec_intr_task", MAIN_STACKSIZE, NULL, MAIN_PRIORITY, NULL, MAIN_CPUAFFINITY);
+    }
+#else
   task();
+#endif
   
   bool error = false, active = false;
   for(int i = 0; i < MAX_DISK_DEVICES; i++)
@@ -128,4 +145,59 @@ void systemBus::shutdown()
 }
 
 
+std::string systemBus::fastload_stats_json()
+{
+  static const char *names[FASTLOAD_NUM_PROTOCOLS] = { "jiffy", "epyx", "dolphin", "fastser" };
+  std::ostringstream out;
+
+  out << "{";
+  for(int i = 0; i < FASTLOAD_NUM_PROTOCOLS; i++)
+    {
+      const FastLoadStats &s = getFastLoadStats(i);
+      uint64_t us = s.deviceUS + s.busUS;
+      // bps is what the computer sees, bus_bps what the bus could do if blocks were always ready
+      out << (i ? "," : "") << "\"" << names[i] << "\":{\"blocks\":" << s.blocks << ",\"bytes\":" << s.bytes
+          << ",\"device_us\":" << s.deviceUS << ",\"bus_us\":" << s.busUS
+          << ",\"bps\":" << (us ? s.bytes * 1000000ULL / us : 0)
+          << ",\"bus_bps\":" << (s.busUS ? s.bytes * 1000000ULL / s.busUS : 0) << "}";
+    }
+  out << "}";
+
+  return out.str();
+}
+
+
+std::string systemBus::atn_stats_json()
+{
+  std::ostringstream out;
+#ifdef IEC_ATN_STATS
+  const ATNStats &s = getATNStats();
+  uint32_t stamped = s.requests - s.unstamped;
+
+  out << "{\"requests\":" << s.requests << ",\"from_interrupt\":" << s.fromInterrupt
+      << ",\"unstamped\":" << s.unstamped << ",\"missed_deadlines\":" << s.missedDeadlines
+      << ",\"missed_pulses\":" << s.missedPulses << ",\"max_us\":" << s.maxUS
+      << ",\"avg_us\":" << (stamped ? s.totalUS / stamped : 0) << ",\"histogram_us\":{";
+  for(int i = 0; i < ATN_LATENCY_BUCKETS; i++)
+    {
+      // keyed by the bucket's upper bound, the last one has none
+      if( i < ATN_LATENCY_BUCKETS-1 )
+        out << (i ? "," : "") << "\"<" << (2 << i) << "\":" << s.histogram[i];
+      else
+        out << ",\">=" << (1 << i) << "\":" << s.histogram[i];
+    }
+  out << "},\"dedicated_core\":";
+#ifdef IEC_DEDICATED_CORE
+  out << "true}";
+#else
+  out << "false}";
+#endif
+#else
+  out << "{}";
+#endif
+
+  return out.str();
+}
+
+
 #endif /* BUILD_IEC */
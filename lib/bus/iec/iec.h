@@ -79,12 +79,29 @@ public:
      */
     bool getShuttingDown() { return shuttingDown; }
 
+    /**
+     * @brief fastload throughput per protocol as JSON, for /stats
+     */
+    std::string fastload_stats_json();
+
+    /**
+     * @brief ATN response latency and missed deadlines as JSON, for /stats
+     */
+    std::string atn_stats_json();
+
  private:
     /**
      * @brief is device shutting down?
      */
     bool shuttingDown = false;
 
+#ifdef IEC_DEDICATED_CORE
+    /**
+     * @brief has the bus task on its own core been started?
+     */
+    bool taskStarted = false;
+#endif
+
 };
 /**
  * @brief Return
@@ -7,6 +7,7 @@
 
 #include "iwm.h"
 #include "fnSystem.h"
+#include "fnWiFi.h"
 
 #ifdef ESP_PLATFORM
 #include "fnHardwareTimer.h"
@@ -25,6 +26,7 @@
 #include "../device/iwm/clock.h"
 
 #include "compat_esp.h" // empty IRAM_ATTR macro for FujiNet-PC
+#include "busStats.h"
 
 /******************************************************************************
 Based on:
@@ -201,6 +203,8 @@ int iwmBus::iwm_send_packet(uint8_t source, iwm_packet_type_t packet_type, uint8
   {
     r = smartport.iwm_send_packet_spi();
     retry--;
+    if (r && retry)
+      bus_stats.retry(source);
   } while (r && retry); // retry if we get an error and haven't tried too many times
 
   return r;
@@ -535,7 +539,10 @@ bool IRAM_ATTR iwmBus::serviceSmartPort()
           memset(command.decoded, 0, sizeof(command.decoded));
           smartport.decode_data_packet(command_packet.data, command.decoded);
           print_packet(command.decoded, 9);
+          fnWiFi.note_activity();
+          uint64_t start_us = busStats::now();
           _activeDev->process(command);
+          bus_stats.command(devicep->_devnum, busStats::now() - start_us);
           break; // we don't need to needlessly keep looping once we find it
         }
       }
@@ -592,6 +599,7 @@ bool IRAM_ATTR iwmBus::serviceDiskII()
       }
     }
     diskii_xface.d2_enable_seen |= diskii_xface.iwm_active_drive();
+    IWM_ACTIVE_DISK2->service_tracks(); // load tracks as the head gets near them
 #ifdef DEBUG
     new_track = IWM_ACTIVE_DISK2->get_track_pos();
     if (old_track != new_track)
@@ -8,6 +8,7 @@
 #include <soc/spi_periph.h>
 
 #include "iwm_ll.h"
+#include "busStats.h"
 #include "iwm.h"
 #include "../device/iwm/disk2.h"
 #include "../device/iwm/fuji.h"
@@ -31,6 +32,14 @@
       blen;                                             \
     })
 
+// Packet bytes put in the SPI buffer before the transmission starts, the
+// rest are encoded while those are on the wire (32 us per packet byte)
+#define SP_SPI_HEAD_BYTES 16
+
+// SPI bytes for each packet byte, one per pair of 4 us bit cells, in the
+// order they go out: bit 7 -> 0x40 and bit 6 -> 0x04 of the first, and so on
+static uint32_t sp_spi_encode[256];
+
 #define PREALLOC_D2W_BUFFER
 #define D2W_MAXSECTORS 1
 #define D2W_MAXBUF (TRACK_LEN * IWM_SAMPLES_PER_CELL(smartport.f_spirx) * D2W_MAXSECTORS / 16)
@@ -102,6 +111,7 @@ void IRAM_ATTR phi_isr_handler(void *arg)
       }
       else if (error == 2) // checksum error
       {
+        bus_stats.checksum_error_isr();
         Debug_printf("\r\nISR Cmd Chksum error, calc %02x, pkt %02x", smartport.calc_checksum, smartport.pkt_checksum);
       }
       // initial Req timeout (error==1) and checksum (error==2) just fall through here and we try again next time
@@ -116,6 +126,7 @@ void IRAM_ATTR phi_isr_handler(void *arg)
       }
       else if (error == 2) // checksum error
       {
+        bus_stats.checksum_error_isr();
         Debug_printf("\r\nISR Data Packet Chksum error, calc %02x, pkt %02x command = %02x", smartport.calc_checksum, smartport.pkt_checksum,IWM.command_packet.command & 0x0f);
         /*We sometimes get garbage data packets with control code 0 commands, accept them as-is and go on*/
         if((IWM.command_packet.command == 0x84) && (IWM.command_packet.data[19] == 0x80)) {
@@ -159,38 +170,30 @@ inline void iwm_ll::iwm_extra_clr()
 #endif
 }
 
-int IRAM_ATTR iwm_sp_ll::encode_spi_packet()
+void iwm_sp_ll::build_encode_table()
 {
-  if (!spi_buffer)
-    return 0;
-
-  // clear out spi buffer
-  memset(spi_buffer, 0, SPI_SP_LEN);
-  // loop through "l" bytes of the buffer "packet_buffer"
-  uint16_t i=0,j=0;
-  while(packet_buffer[i])
+  for (int b = 0; b < 256; b++)
   {
-    // Debug_printf("\nByte %02X: ",packet_buffer[i]);
-    // for each byte, loop through 4 x 2-bit pairs
-    uint8_t mask = 0x80;
+    uint32_t v = 0;
     for (int k = 0; k < 4; k++)
     {
-      if (packet_buffer[i] & mask)
-      {
-        spi_buffer[j] |= 0x40;
-      }
-      mask >>= 1;
-      if (packet_buffer[i] & mask)
-      {
-        spi_buffer[j] |= 0x04;
-      }
-      mask >>= 1;
-      // Debug_printf("%02x",spi_buffer[j]);
-      j++;
+      uint8_t spi_byte = 0;
+      if (b & (0x80 >> (2 * k)))
+        spi_byte |= 0x40;
+      if (b & (0x40 >> (2 * k)))
+        spi_byte |= 0x04;
+      v |= (uint32_t)spi_byte << (8 * k); // lowest address first
     }
-    i++;
+    sp_spi_encode[b] = v;
   }
-  return j - 1;
+}
+
+void IRAM_ATTR iwm_sp_ll::encode_spi_packet(int first, int last)
+{
+  // spi_buffer comes from heap_caps_malloc() so it is word aligned
+  uint32_t *out = (uint32_t *)spi_buffer;
+  for (int i = first; i < last; i++)
+    out[i] = sp_spi_encode[packet_buffer[i]];
 }
 
 
@@ -206,9 +209,15 @@ int IRAM_ATTR iwm_sp_ll::iwm_send_packet_spi()
   //
   //*****************************************************************************
 
+  if (!spi_buffer)
+    return 1;
+
   portDISABLE_INTERRUPTS();
   set_output_to_spi();
-  int spi_len = encode_spi_packet();
+  // the ISR receives into spi_buffer as well, so it can only be filled with interrupts off
+  int head = packet_len < SP_SPI_HEAD_BYTES ? packet_len : SP_SPI_HEAD_BYTES;
+  encode_spi_packet(0, head);
+  int spi_len = packet_len * 4 - 1; // the end marker's last bit cells stay off the wire
 
   // send data stream using SPI
   esp_err_t ret;
@@ -231,7 +240,12 @@ int IRAM_ATTR iwm_sp_ll::iwm_send_packet_spi()
   // send the data
   // TODO - enable / disable output using hasbuffer - no external tristate
   enable_output(); // enable the tri-state buffer
-  ret = spi_device_polling_transmit(spi, &trans);
+  ret = spi_device_polling_start(spi, &trans, portMAX_DELAY);
+  // spi_buffer is DMA capable, so the driver sends it in place and DMA
+  // fetches from it as it goes; encoding stays far ahead of it
+  encode_spi_packet(head, packet_len);
+  if (ret == ESP_OK)
+    ret = spi_device_polling_end(spi, portMAX_DELAY);
   disable_output(); // make rddata hi-z
   iwm_ack_clr();
   assert(ret == ESP_OK);
@@ -248,14 +262,32 @@ int IRAM_ATTR iwm_sp_ll::iwm_send_packet_spi()
   return 0;
 }
 
-#define IWM_NEXT_BIT() ({bool _v = ((src[offset / 8] << (offset % 8)) & 0x80) == 0x80; \
-      offset++; _v;})
+// Number of samples from offset on that are at level, at most max and not past src_bits
+static inline size_t iwm_run_length(const uint8_t *src, size_t src_bits, size_t offset, bool level, size_t max)
+{
+  size_t n = 0;
+  while (n < max && offset + n < src_bits)
+  {
+    size_t pos = offset + n;
+    unsigned left = 8 - pos % 8;
+    // samples matching level are zeros here, so leading zeros are the run
+    uint8_t diff = (uint8_t)((src[pos / 8] ^ (level ? 0xff : 0x00)) << (pos % 8));
+    unsigned same = diff ? __builtin_clz((uint32_t)diff << 24) : left;
+    n += same;
+    if (same < left)
+      break; // edge
+  }
+  return n < max ? n : max;
+}
+
 uint8_t iwm_ll::iwm_decode_byte(uint8_t *src, size_t src_size, unsigned int sample_frequency,
                                 int timeout, size_t *bit_offset, bool *more_avail)
 {
   unsigned int numbits, idx;
   uint8_t byte;
-  bool bit, current_level;
+  bool bit;
+  size_t run;
+  const size_t src_bits = src_size * 8;
   const int spi_samples_per_cell = (CELL_US * sample_frequency) / MHZ;
   const int half_samples = spi_samples_per_cell / 2;
   size_t offset = *bit_offset;
@@ -267,44 +299,43 @@ uint8_t iwm_ll::iwm_decode_byte(uint8_t *src, size_t src_size, unsigned int samp
 
   *more_avail = true;
   for (numbits = 8, byte = 0; numbits; numbits--) {
-    for (idx = bit = 0; idx < spi_samples_per_cell; idx++) {
-      if (offset / 8 >= src_size) {
+    // look through 4 usec worth of samples for an edge, a whole byte of
+    // them at a time; if found, bit = 1 and resync the receiver so it's
+    // halfway through the 4-us period at the edge; otherwise, bit = 0
+    for (idx = bit = 0; idx < spi_samples_per_cell;) {
+      run = iwm_run_length(src, src_bits, offset, prev_level, spi_samples_per_cell - idx);
+      offset += run;
+      idx += run;
+      if (idx >= spi_samples_per_cell)
+        break;
+
+      if (offset >= src_bits) {
         // out of spi data, abort
         numbits = 1;
         *more_avail = false;
         break;
       }
 
-      current_level = IWM_NEXT_BIT();
-
-      // loop through 4 usec worth of samples looking for an edge
-      // if found, jump forward 2 usec and set bit = 1;
-      // otherwise, bit = 0;
-      if (prev_level != current_level) {
-        bit = true;
-        // resync the receiver - must be halfway through 4-us period at an edge
-        idx = half_samples;
-      }
-
-      prev_level = current_level;
+      // the edge sample
+      offset++;
+      prev_level = !prev_level;
+      bit = true;
+      idx = half_samples + 1;
     }
 
     byte <<= 1;
     byte |= bit;
   }
 
-  // See if there are more 1 bits
-  for (; timeout_ctr; timeout_ctr--) {
-    if (offset / 8 >= src_size) {
-      *more_avail = false;
-      break;
-    }
-    current_level = IWM_NEXT_BIT();
-    if (prev_level != current_level)
-      break;
-  }
-  if (!timeout_ctr)
+  // See if there are more 1 bits. The edge is taken but prev_level is left
+  // as it was, so the next byte starts with it
+  run = iwm_run_length(src, src_bits, offset, prev_level, timeout_ctr);
+  offset += run;
+  timeout_ctr -= run;
+  if (!timeout_ctr || offset >= src_bits)
     *more_avail = false;
+  else
+    offset++;
 
   *bit_offset = offset;
   return byte;
@@ -548,6 +579,7 @@ void iwm_sp_ll::setup_spi()
   esp_err_t ret; // used for calling SPI library functions below
 
   spi_buffer = (uint8_t *)heap_caps_malloc(SPI_SP_LEN, MALLOC_CAP_DMA);
+  build_encode_table();
 
   if (!fnSystem.spishared())
     spirx_mosi_pin = SP_RDDATA;
@@ -706,9 +738,6 @@ void iwm_sp_ll::encode_packet(uint8_t source, iwm_packet_type_t packet_type, uin
   int grpbyte, grpcount;
   uint8_t grpmsb;
   uint8_t group_buffer[7];
-                                    // Calculate checksum of sector bytes before we destroy them
-    for (int count = 0; count < num; count++) // xor all the data bytes
-      checksum = checksum ^ data[count];
 
     // Start assembling the packet at the rear and work
     // your way to the front so we don't overwrite data
@@ -725,7 +754,10 @@ void iwm_sp_ll::encode_packet(uint8_t source, iwm_packet_type_t packet_type, uin
       // add group msb byte
       grpmsb = 0;
       for (grpbyte = 0; grpbyte < 7; grpbyte++)
+      {
         grpmsb = grpmsb | ((group_buffer[grpbyte] >> (grpbyte + 1)) & (0x80 >> (grpbyte + 1)));
+        checksum ^= group_buffer[grpbyte]; // xor all the data bytes as they go by
+      }
       // groups start after odd bytes, which is at 13 + numodds + (numodds != 0) + 1
       int grpstart = 13 + numodds + (numodds != 0) + 1;
       packet_buffer[grpstart + (grpcount * 8)] = grpmsb | 0x80; // set msb to one
@@ -743,6 +775,7 @@ void iwm_sp_ll::encode_packet(uint8_t source, iwm_packet_type_t packet_type, uin
       {
         packet_buffer[14] |= (data[oddcnt] & 0x80) >> (1 + oddcnt);
         packet_buffer[15 + oddcnt] = data[oddcnt] | 0x80;
+        checksum ^= data[oddcnt];
       }
     }
   }
@@ -773,6 +806,7 @@ void iwm_sp_ll::encode_packet(uint8_t source, iwm_packet_type_t packet_type, uin
   //end bytes
   packet_buffer[lastidx++] = 0xc8;  //pkt end
   packet_buffer[lastidx] = 0x00;  //mark the end of the packet_buffer
+  packet_len = lastidx;
 }
 
 //*****************************************************************************
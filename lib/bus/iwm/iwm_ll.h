@@ -225,7 +225,7 @@ public:
   spi_device_handle_t spirx;
 
   //uint8_t packet_buffer[BLOCK_PACKET_LEN]; //smartport packet buffer
-  uint16_t packet_len = 0;
+  uint16_t packet_len = 0; // bytes encode_packet() put in packet_buffer
 
 public:
   SemaphoreHandle_t spiMutex;
@@ -237,7 +237,9 @@ public:
   uint8_t iwm_phase_vector() { return IWM_PHASE_COMBINE(); };
 
   // Smartport Bus handling by SPI interface
-  int encode_spi_packet();
+  void build_encode_table();
+  // moves packet_buffer[first..last) to spi_buffer
+  void encode_spi_packet(int first, int last);
   int iwm_send_packet_spi();
   int iwm_read_packet_spi(uint8_t *buffer, int packet_len);
   int iwm_read_packet_spi(int packet_len);
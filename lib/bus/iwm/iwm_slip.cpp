@@ -251,7 +251,7 @@ void iwm_slip::wait_for_requests()
 			// }
 
 			std::lock_guard<std::mutex> lock(queue_mutex_);
-			request_queue_.push(request_data);
+			request_queue_.push(std::move(request_data));
 		}
 	}
 }
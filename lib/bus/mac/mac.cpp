@@ -4,6 +4,7 @@
 #include "../device/mac/fuji.h"
 
 #include "mac_ll.h"
+#include "busStats.h"
 
 
 void macBus::setup(void)
@@ -58,7 +59,9 @@ void macBus::service(void)
   {
     int c=fnUartBUS.read();
     if (c==0) return;
-    else if (c < 'A') // floppy
+    uint64_t start_us = busStats::now();
+    uint16_t device = 4; // the floppy drive lives in disk slot 4
+    if (c < 'A') // floppy
     {
       switch (c - '0')
       {
@@ -85,6 +88,7 @@ void macBus::service(void)
           int track_position = theFuji.get_disks(4)->disk_dev.step();
           if (track_position < 0)
           {
+            bus_stats.nak(device);
             fnUartBUS.write('N');
           }
           else
@@ -134,6 +138,7 @@ void macBus::service(void)
         _active_DCD_disk = c-'A'; // 0, 1, 2, 3
         Debug_printf("\nactive disk %d", _active_DCD_disk);
         break;
+      case 'M':
       case 'R':
       case 'T':
       case 'W':
@@ -142,7 +147,9 @@ void macBus::service(void)
       default:
         break;
       }
+      device = _active_DCD_disk;
     }
+    bus_stats.command(device, busStats::now() - start_us);
   }
   if (track_not_copied && stepper_timeout())
   {
@@ -150,6 +157,8 @@ void macBus::service(void)
     track_not_copied = false;
     fnUartBUS.write('S');
   }
+  else if (!track_not_copied)
+    theFuji.get_disks(4)->disk_dev.prefetch_tracks();
 }
 
 char macBus::num_dcd_mounts()
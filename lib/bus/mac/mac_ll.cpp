@@ -918,6 +918,16 @@ void mac_floppy_ll::setup_rmt()
   track_buffer[1] = (uint8_t *)heap_caps_malloc(TRACK_LEN, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
   if (track_buffer[1] == NULL)
     Debug_println("could not allocate track buffer 1");
+  // spares are optional, without them steps copy the track in
+  for (int i = 0; i < SPARE_TRACKS; i++)
+  {
+    spare_buffer[i] = (uint8_t *)heap_caps_malloc(TRACK_LEN, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (spare_buffer[i] == NULL)
+    {
+      Debug_printf("\nonly %d spare track buffers", i);
+      break;
+    }
+  }
 
   config.rmt_mode = rmt_mode_t::RMT_MODE_TX;
   config.channel = RMT_TX_CHANNEL;
@@ -1000,7 +1010,7 @@ bool IRAM_ATTR mac_floppy_ll::fakebit()
 }
 
 // todo: copy both top and bottom tracks on 800k disk
-void IRAM_ATTR mac_floppy_ll::copy_track(uint8_t *track, int side, size_t tracklen, size_t trackbits, int bitperiod)
+void IRAM_ATTR mac_floppy_ll::copy_track(uint8_t *track, int side, size_t tracklen, size_t trackbits, int bitperiod, int index)
 {
   if (track_buffer[side] == nullptr)
   {
@@ -1030,6 +1040,86 @@ void IRAM_ATTR mac_floppy_ll::copy_track(uint8_t *track, int side, size_t trackl
   track_numbytes[side] = tracklen;
   track_numbits[side] = trackbits;
   track_bit_period = bitperiod;
+  track_index[side] = track != nullptr ? index : -1;
+}
+
+void mac_floppy_ll::drop_tracks()
+{
+  track_index[0] = track_index[1] = -1;
+  for (int i = 0; i < SPARE_TRACKS; i++)
+    spare_index[i] = -1;
+}
+
+bool mac_floppy_ll::has_track(int index)
+{
+  if (track_index[0] == index || track_index[1] == index)
+    return true;
+  for (int i = 0; i < SPARE_TRACKS; i++)
+    if (spare_buffer[i] != nullptr && spare_index[i] == index)
+      return true;
+  return false;
+}
+
+bool mac_floppy_ll::prefetch_track(uint8_t *track, int index, size_t tracklen, size_t trackbits, const int *keep, int nkeep)
+{
+  if (track == nullptr || tracklen > TRACK_LEN)
+    return false;
+
+  int slot = -1;
+  for (int i = 0; i < SPARE_TRACKS && slot < 0; i++)
+  {
+    if (spare_buffer[i] == nullptr)
+      continue;
+    bool wanted = false;
+    for (int k = 0; k < nkeep; k++)
+      wanted |= spare_index[i] == keep[k];
+    if (spare_index[i] < 0 || !wanted)
+      slot = i;
+  }
+  if (slot < 0)
+    return false;
+
+  // the spare isn't used by the RMT until it's swapped in, so no hurry here
+  memcpy(spare_buffer[slot], track, tracklen);
+  spare_numbytes[slot] = tracklen;
+  spare_numbits[slot] = trackbits;
+  spare_index[slot] = index;
+  return true;
+}
+
+bool IRAM_ATTR mac_floppy_ll::swap_track(int index, int side, int bitperiod)
+{
+  static portMUX_TYPE swap_mux = portMUX_INITIALIZER_UNLOCKED;
+
+  if (side != 0 && side != 1)
+    return false;
+
+  for (int i = 0; i < SPARE_TRACKS; i++)
+  {
+    if (spare_buffer[i] == nullptr || spare_index[i] != index)
+      continue;
+
+    // buffers are all TRACK_LEN long, so a bit read mid swap is still in bounds
+    portENTER_CRITICAL_SAFE(&swap_mux);
+    uint8_t *old_buffer = track_buffer[side];
+    size_t old_numbits = track_numbits[side];
+    size_t old_numbytes = track_numbytes[side];
+    track_location[side] = track_location[side] * spare_numbits[i] / old_numbits;
+    track_numbits[side] = spare_numbits[i];
+    track_numbytes[side] = spare_numbytes[i];
+    track_buffer[side] = spare_buffer[i];
+    track_bit_period = bitperiod;
+    portEXIT_CRITICAL_SAFE(&swap_mux);
+
+    // what was under the head is now a spare, a step back finds it there
+    spare_buffer[i] = old_buffer;
+    spare_numbits[i] = old_numbits;
+    spare_numbytes[i] = old_numbytes;
+    spare_index[i] = track_index[side];
+    track_index[side] = index;
+    return true;
+  }
+  return false;
 }
 
 // uint8_t IRAM_ATTR iwm_diskii_ll::iwm_enable_states()
@@ -16,6 +16,7 @@
 
 // // #define SPI_II_LEN 27000        // 200 ms at 1 mbps for disk ii + some extra
 #define TRACK_LEN 10000              // guess for MOOF - should probably read it from MOOF file          
+#define SPARE_TRACKS 4               // both sides of the cylinders either side of the head, ready to swap in
 // #define SPI_SP_LEN 6000         // should be long enough for 20.1 ms (for SoftSP) + some margin - call it 22 ms. 2051282*.022 =  45128.204 bits / 8 = 5641.0255 bytes
 // #define BLOCK_PACKET_LEN    604 //606
 
@@ -178,6 +179,13 @@ private:
   size_t track_numbytes[2] = {TRACK_LEN, TRACK_LEN};
   size_t track_location[2] = {0, 0};
   int track_bit_period = 2000;
+  int track_index[2] = {-1, -1}; // MOOF track in each buffer, -1 if not known
+
+  // tracks read ahead of the head, swapped with track_buffer[] on a step
+  uint8_t *spare_buffer[SPARE_TRACKS] = {};
+  int spare_index[SPARE_TRACKS] = {-1, -1, -1, -1};
+  size_t spare_numbits[SPARE_TRACKS];
+  size_t spare_numbytes[SPARE_TRACKS];
 
   // void set_output_to_rmt();
 
@@ -194,7 +202,15 @@ public:
 
   bool nextbit();
   bool fakebit();
-  void copy_track(uint8_t *track, int side, size_t tracklen, size_t trackbits, int bitperiod);
+  void copy_track(uint8_t *track, int side, size_t tracklen, size_t trackbits, int bitperiod, int index = -1);
+  // Forgets which tracks the buffers hold, for a new disk
+  void drop_tracks();
+  // Whether MOOF track index is in a track or spare buffer
+  bool has_track(int index);
+  // Reads track index into a spare buffer not holding one of the nkeep in keep
+  bool prefetch_track(uint8_t *track, int index, size_t tracklen, size_t trackbits, const int *keep, int nkeep);
+  // Swaps the spare holding track index in for side, returns false if there isn't one
+  bool swap_track(int index, int side, int bitperiod);
 
   // void set_output_to_low();
 };
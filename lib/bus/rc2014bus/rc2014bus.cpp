@@ -8,6 +8,9 @@
 #include "../../include/debug.h"
 #include "driver/spi_slave.h"
 
+#include <algorithm>
+#include <cstring>
+
 
 #include "fnConfig.h"
 #include "fnSystem.h"
@@ -64,13 +67,7 @@ size_t virtualDevice::rc2014_send_buffer(const uint8_t *buf, unsigned short len)
     if (len > buf_len)
         len = buf_len;
 
-    for (int i = 0; i < len; i++) {
-        //Debug_printf("[0x%02x] ", buf[i]);
-        rc2014_send(buf[i]);
-    }
-    //Debug_printf("\n");
-
-    return len;
+    return rc2014Bus.busTxBuffer(buf, len);
 }
 
 size_t virtualDevice::rc2014_send_available()
@@ -395,7 +392,10 @@ void systemBus::setup()
         .post_trans_cb=my_post_trans_cb
     };
 
-    esp_err_t rc = spi_slave_initialize(RC2014_SPI_HOST, &bus_cfg, &slave_cfg, SPI_DMA_DISABLED);
+    // With DMA a transaction isn't limited to the 64 byte FIFO, so a whole
+    // sector moves per CMD_RDY handshake: CMD_RDY goes low once a transaction
+    // is queued and high when the master has clocked all of it
+    esp_err_t rc = spi_slave_initialize(RC2014_SPI_HOST, &bus_cfg, &slave_cfg, SPI_DMA_CH_AUTO);
     if (rc != ESP_OK) {
         Debug_println("RC2014 unable to initialise bus SPI Flush");
     }
@@ -510,10 +510,11 @@ void systemBus::streamDeactivate()
 
 size_t systemBus::busTxBuffer(const uint8_t *buf, unsigned short len)
 {
-    for (unsigned short i = 0; i < len; i++) {
-        _tx_buffer[_tx_buffer_index] = buf[i];
-        _tx_buffer_index++;
-    }
+    if (len > busTxAvail())
+        len = busTxAvail();
+
+    memcpy(&_tx_buffer[_tx_buffer_index], buf, len);
+    _tx_buffer_index += len;
 
     return len;
 }
@@ -531,28 +532,17 @@ size_t systemBus::busTxByte(const uint8_t byte)
     return 1;
 }
 
+// Everything queued goes out in one DMA transaction, as the TX buffer is no
+// larger than the largest transfer
 size_t systemBus::busTxTransfer()
 {
     spi_slave_transaction_t t = {};
 
-    unsigned int i = 0;
-    esp_err_t rc = ESP_OK;
+    t.tx_buffer = _tx_buffer.data();
+    t.rx_buffer = _rx_buffer.data();
+    t.length = _tx_buffer_index * 8;   // bits
 
-    do {
-        t.tx_buffer = &_tx_buffer[i];
-        t.rx_buffer = &_rx_buffer[i];
-
-        if ((_tx_buffer_index - i) > 64) {
-            t.length = 64 * 8;   // bits
-            i += 64;
-        } else {
-            unsigned int len = _tx_buffer_index - i;
-            t.length = len * 8;   // bits
-            i += len;
-        }
-
-        rc = spi_slave_transmit(RC2014_SPI_HOST, &t, portMAX_DELAY);
-    } while ((rc == ESP_OK) && (i < _tx_buffer_index));
+    esp_err_t rc = spi_slave_transmit(RC2014_SPI_HOST, &t, portMAX_DELAY);
 
     _tx_buffer_index = 0;
 
@@ -564,6 +554,8 @@ size_t systemBus::busTxTransfer()
     return t.trans_len / 8;
 }
 
+// Received through the word aligned RX buffer, as DMA can't write to any
+// buffer a caller passes in. A sector fits in one transaction
 size_t systemBus::busRxBuffer(uint8_t *buf, unsigned short len)
 {
     spi_slave_transaction_t t = {};
@@ -571,28 +563,30 @@ size_t systemBus::busRxBuffer(uint8_t *buf, unsigned short len)
     unsigned int i = 0;
     esp_err_t rc = ESP_OK;
 
-    do {
-        t.tx_buffer = &_tx_buffer[i];
-        t.rx_buffer = &buf[i];
-
-        if ((len - i) > 64) {
-            t.length = 64 * 8;   // bits
-            i += 64;
-        } else {
-            unsigned int rlen = len - i;
-            t.length = rlen * 8;   // bits
-            i += rlen;
-        }
+    while (i < len) {
+        unsigned int rlen = std::min((unsigned int)RC2014_RX_BUFFER_SIZE, len - i);
+
+        t.tx_buffer = _tx_buffer.data();
+        t.rx_buffer = _rx_buffer.data();
+        t.length = rlen * 8;   // bits
 
         rc = spi_slave_transmit(RC2014_SPI_HOST, &t, portMAX_DELAY);
-    } while ((rc == ESP_OK) && (i < len));
+        if (rc != ESP_OK)
+            break;
+
+        unsigned int got = t.trans_len / 8;
+        memmove(&buf[i], _rx_buffer.data(), std::min(got, rlen)); // buf may be _rx_buffer itself
+        i += std::min(got, rlen);
+        if (got < rlen)
+            break;
+    }
 
     if (rc != ESP_OK) {
         Debug_printf("systemBus::busRxBuffer rc = %d\n", rc);
         return 0;
     }
 
-    return t.trans_len / 8;
+    return i;
 }
 
 systemBus rc2014Bus;
@@ -374,8 +374,9 @@ private:
     void _rc2014_process_queue();
     bool _rc2014_poll_interrupts();
 
-    std::array<uint8_t, RC2014_RX_BUFFER_SIZE> _rx_buffer;
-    std::array<uint8_t, RC2014_TX_BUFFER_SIZE> _tx_buffer;
+    // SPI DMA reads and writes whole words, so both buffers are word aligned
+    alignas(4) std::array<uint8_t, RC2014_RX_BUFFER_SIZE> _rx_buffer;
+    alignas(4) std::array<uint8_t, RC2014_TX_BUFFER_SIZE> _tx_buffer;
     unsigned int _tx_buffer_index = 0;
 
 public:
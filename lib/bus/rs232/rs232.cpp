@@ -8,10 +8,13 @@
 #include "udpstream.h"
 #include "modem.h"
 #include "siocpm.h"
+#include "busStats.h"
+#include "cmdArena.h"
 
 #include "fnSystem.h"
 #include "fnConfig.h"
 #include "fnDNS.h"
+#include "fnWiFi.h"
 #include "led.h"
 #include "utils.h"
 #include <endian.h>
@@ -61,18 +64,28 @@ void virtualDevice::bus_to_computer(uint8_t *buf, uint16_t len, bool err)
     Debug_print("\n");
 #endif
 
-    // Write ERROR or COMPLETE status
-    if (err == true)
-        rs232_error();
-    else
-        rs232_complete();
+    // Status, data frame and checksum go out in one write, back to back on the line
+    uint8_t *frame = cmd_arena.alloc_array<uint8_t>(len + 2);
+    if (frame == nullptr)
+    {
+        if (err == true)
+            rs232_error();
+        else
+            rs232_complete();
+        fnUartBUS.write(buf, len);
+        fnUartBUS.write(rs232_checksum(buf, len));
+        fnUartBUS.flush();
+        return;
+    }
 
-    // Write data frame
-    fnUartBUS.write(buf, len);
-    // Write checksum
-    fnUartBUS.write(rs232_checksum(buf, len));
+    frame[0] = err ? 'E' : 'C';
+    memcpy(&frame[1], buf, len);
+    frame[len + 1] = rs232_checksum(buf, len);
 
+    fnSystem.delay_microseconds(DELAY_T5);
+    fnUartBUS.write(frame, len + 2);
     fnUartBUS.flush();
+    Debug_println(err ? "ERROR!" : "COMPLETE!");
 }
 
 /*
@@ -90,10 +103,10 @@ uint8_t virtualDevice::bus_to_peripheral(uint8_t *buf, unsigned short len)
     size_t l = fnUartBUS.readBytes(buf, len);
     __END_IGNORE_UNUSEDVARS
 
-    // Wait for checksum
-    while (fnUartBUS.available() <= 0)
-        fnSystem.yield();
-    uint8_t ck_rcv = fnUartBUS.read();
+    // The checksum is normally already in the UART buffer behind the frame
+    uint8_t ck_rcv = 0;
+    if (fnUartBUS.readBytes(&ck_rcv, 1) != 1)
+        Debug_println("Timeout waiting for data frame checksum");
 
     uint8_t ck_tst = rs232_checksum(buf, len);
 
@@ -108,6 +121,7 @@ uint8_t virtualDevice::bus_to_peripheral(uint8_t *buf, unsigned short len)
 
     if (ck_rcv != ck_tst)
     {
+        bus_stats.checksum_error(_devnum);
         rs232_nak();
         return false;
     }
@@ -123,6 +137,7 @@ void virtualDevice::rs232_nak()
     fnUartBUS.write('N');
     fnUartBUS.flush();
     Debug_println("NAK!");
+    bus_stats.nak(_devnum);
 }
 
 // RS232 ACK
@@ -172,12 +187,15 @@ void systemBus::_rs232_process_cmd()
     // Read CMD frame
     cmdFrame_t tempFrame;
     memset(&tempFrame, 0, sizeof(tempFrame));
+    bool handled = false;
 
     if (fnUartBUS.readBytes((uint8_t *)&tempFrame, sizeof(tempFrame)) != sizeof(tempFrame))
     {
         Debug_println("Timeout waiting for data after CMD pin asserted");
         return;
     }
+    uint64_t frame_us = busStats::now();
+
     // Turn on the RS232 indicator LED
     fnLedManager.set(eLed::LED_BUS, true);
 
@@ -192,6 +210,7 @@ void systemBus::_rs232_process_cmd()
     uint8_t ck = rs232_checksum((uint8_t *)&tempFrame, sizeof(tempFrame) - sizeof(tempFrame.cksum)); // Calculate Checksum
     if (ck == tempFrame.cksum)
     {
+        fnWiFi.note_activity();
         if (tempFrame.device == RS232_DEVICEID_DISK && _fujiDev != nullptr && _fujiDev->boot_config)
         {
             _activeDev = _fujiDev->bootdisk();
@@ -199,6 +218,7 @@ void systemBus::_rs232_process_cmd()
             Debug_println("FujiNet CONFIG boot");
             // handle command
             _activeDev->rs232_process(&tempFrame);
+            handled = true;
         }
         else
         {
@@ -212,6 +232,7 @@ void systemBus::_rs232_process_cmd()
                         _activeDev = devicep;
                         // handle command
                         _activeDev->rs232_process(&tempFrame);
+                        handled = true;
                     }
                 }
             }
@@ -220,8 +241,12 @@ void systemBus::_rs232_process_cmd()
     else
     {
         Debug_printf("CHECKSUM_ERROR: Calc checksum: %02x\n",ck);
+        bus_stats.checksum_error(BUS_STATS_NO_DEVICE);
         // Switch to/from hispeed RS232 if we get enough failed frame checksums
     }
+    if (handled)
+        bus_stats.command(tempFrame.device, busStats::now() - frame_us);
+    cmd_arena.reset();
     fnLedManager.set(eLed::LED_BUS, false);
 }
 
@@ -295,9 +320,16 @@ void systemBus::service()
 // Setup RS232 bus
 void systemBus::setup()
 {
-    Debug_printf("RS232 SETUP: Baud rate: %u\n",Config.get_rs232_baud());
-
-    // Set up UART
+    Debug_printf("RS232 SETUP: Baud rate: %u%s\n",Config.get_rs232_baud(),
+                 Config.get_rs232_flowcontrol() ? ", RTS/CTS" : "");
+
+    // Set up UART. With flow control the UART drives CTS low while it has
+    // room, and only sends while the computer holds RTS low
+    fnUartBUS.set_buffer_sizes(RS232_UART_RX_BUFFER_SIZE, RS232_UART_TX_BUFFER_SIZE);
+    if (Config.get_rs232_flowcontrol())
+        fnUartBUS.set_flow_control(PIN_RS232_CTS, PIN_RS232_RTS);
+    else
+        fnUartBUS.set_flow_control(UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
     fnUartBUS.begin(Config.get_rs232_baud());
 
     // // INT PIN
@@ -316,8 +348,12 @@ void systemBus::setup()
     //fnSystem.set_pin_mode(PIN_CKI, PINMODE_OUTPUT);
     // CKO PIN
 
-    fnSystem.set_pin_mode(PIN_RS232_CTS, gpio_mode_t::GPIO_MODE_OUTPUT);
-    fnSystem.digital_write(PIN_RS232_CTS,DIGI_LOW);
+    // CTS belongs to the UART with flow control
+    if (!fnUartBUS.flow_control())
+    {
+        fnSystem.set_pin_mode(PIN_RS232_CTS, gpio_mode_t::GPIO_MODE_OUTPUT);
+        fnSystem.digital_write(PIN_RS232_CTS,DIGI_LOW);
+    }
 
     fnSystem.set_pin_mode(PIN_RS232_DSR,gpio_mode_t::GPIO_MODE_OUTPUT);
     fnSystem.digital_write(PIN_RS232_DSR,DIGI_LOW);
@@ -9,6 +9,10 @@
 #define RS232_BAUDRATE 9600
 //#define RS232_BAUDRATE 115200
 
+// Bus UART driver buffers, so the modem at 115200 baud rides out TCP stalls
+#define RS232_UART_RX_BUFFER_SIZE 4096
+#define RS232_UART_TX_BUFFER_SIZE 2048
+
 #define RS232_DEVICEID_DISK            0x31
 #define RS232_DEVICEID_DISK_LAST       0x3F
 
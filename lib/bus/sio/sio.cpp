@@ -8,15 +8,60 @@
 #include "udpstream.h"
 #include "modem.h"
 #include "siocpm.h"
+#include "sioTrace.h"
+#include "busStats.h"
+#include "cmdArena.h"
 
 #include "fnSystem.h"
 #include "fnConfig.h"
 #include "fnDNS.h"
+#include "fnWiFi.h"
 #include "led.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <iterator>
+
+#ifdef ESP_PLATFORM
+#include <freertos/semphr.h>
+#endif
+
 // Helper functions outside the class defintions
 
+// The OS repeats a command frame after a NAK or ERROR; remember enough to count those as retries
+static uint32_t sio_last_frame = 0;
+static bool sio_last_failed = false;
+
+#ifdef ESP_PLATFORM
+// Given by the CMD rising edge interrupt, taken by whoever waits for the command frame to end
+static SemaphoreHandle_t sio_cmd_released = nullptr;
+
+static void IRAM_ATTR sio_cmd_isr_handler(void *arg)
+{
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(sio_cmd_released, &woken);
+    if (woken)
+        portYIELD_FROM_ISR();
+}
+
+// Sleeps until CMD is back up, false on timeout
+static bool sio_wait_cmd_released(uint32_t timeout_ms)
+{
+    // Drop an edge left over from an earlier frame
+    xSemaphoreTake(sio_cmd_released, 0);
+
+    uint64_t start = fnSystem.millis();
+    while (fnSystem.digital_read(PIN_CMD) == DIGI_LOW)
+    {
+        uint64_t elapsed = fnSystem.millis() - start;
+        if (elapsed >= timeout_ms)
+            return false;
+        xSemaphoreTake(sio_cmd_released, pdMS_TO_TICKS(timeout_ms - elapsed) + 1);
+    }
+    return true;
+}
+#endif
+
 // Get requested buffer length from command frame
 unsigned short virtualDevice::sio_get_aux()
 {
@@ -93,9 +138,7 @@ uint8_t virtualDevice::bus_to_peripheral(uint8_t *buf, unsigned short len)
     size_t l = uart->readBytes(buf, len);
     __END_IGNORE_UNUSEDVARS
 
-    // Wait for checksum
-    while (uart->available() <= 0)
-        fnSystem.yield();
+    // Checksum, read() sleeps until it's in
     uint8_t ck_rcv = uart->read();
 #else
     if (fnSioCom.get_sio_mode() == SioCom::sio_mode::NETSIO)
@@ -122,8 +165,10 @@ uint8_t virtualDevice::bus_to_peripheral(uint8_t *buf, unsigned short len)
 
     fnSystem.delay_microseconds(DELAY_T4);
 
+    SIO.hsio_sample(ck_rcv == ck_tst);
     if (ck_rcv != ck_tst)
     {
+        bus_stats.checksum_error(_devnum);
         sio_nak();
         Debug_printf("bus_to_peripheral() - Data Frame Chksum error, calc %02x, rcv %02x\n", ck_tst, ck_rcv);
         // return false; // apc
@@ -146,6 +191,9 @@ void virtualDevice::sio_nak()
     fnSioCom.flush();
     SIO.set_command_processed(true);
 #endif
+    SIO_TRACE_ACK(true);
+    bus_stats.nak(_devnum);
+    sio_last_failed = true;
     Debug_println("NAK!");
 }
 
@@ -163,6 +211,7 @@ void virtualDevice::sio_ack()
     fnSioCom.flush();
     SIO.set_command_processed(true);
 #endif
+    SIO_TRACE_ACK(false);
     Debug_println("ACK!");
 }
 
@@ -174,6 +223,7 @@ void virtualDevice::sio_late_ack()
     {
         fnSioCom.netsio_late_sync('A');
         SIO.set_command_processed(true);
+        SIO_TRACE_ACK(false);
         Debug_println("ACK+!");
     }
     else
@@ -192,6 +242,7 @@ void virtualDevice::sio_complete()
 #else
     fnSioCom.write('C');
 #endif
+    SIO_TRACE_COMPLETE(false);
     Debug_println("COMPLETE!");
 }
 
@@ -204,6 +255,8 @@ void virtualDevice::sio_error()
 #else
     fnSioCom.write('E');
 #endif
+    SIO_TRACE_COMPLETE(true);
+    sio_last_failed = true;
     Debug_println("ERROR!");
 }
 
@@ -220,7 +273,7 @@ void virtualDevice::sio_high_speed()
     bus_to_computer((uint8_t *)&hsd, 1, false);
 }
 
-systemBus virtualDevice::sio_get_bus() { return SIO; }
+systemBus &virtualDevice::sio_get_bus() { return SIO; }
 
 // Read and process a command frame from SIO
 void systemBus::_sio_process_cmd()
@@ -232,7 +285,7 @@ void systemBus::_sio_process_cmd()
 #endif
     {
         _modemDev->modemActive = false;
-        Debug_println("Modem was active - resetting SIO baud");
+        Debug_tracef("Modem was active - resetting SIO baud\r\n");
 #ifdef ESP_PLATFORM
         SYSTEM_BUS.uart->set_baudrate(_sioBaud);
 #else
@@ -254,63 +307,72 @@ void systemBus::_sio_process_cmd()
 #else
     if (fnSioCom.readBytes((uint8_t *)&tempFrame, sizeof(tempFrame)) != sizeof(tempFrame))
     {
-        Debug_println("Timeout waiting for data after CMD pin asserted");
+        Debug_tracef("Timeout waiting for data after CMD pin asserted\r\n");
         return;
     }
 #endif
+    SIO_TRACE_BEGIN(tempFrame.device, tempFrame.comnd);
+    uint64_t frame_us = busStats::now();
+    bool handled = false;
+
     // Turn on the SIO indicator LED
     fnLedManager.set(eLed::LED_BUS, true);
 
-    Debug_print("\n");
-    Debug_printf("CF: %02x %02x %02x %02x %02x\n",
+    Debug_tracef("\nCF: %02x %02x %02x %02x %02x\n",
                  tempFrame.device, tempFrame.comnd, tempFrame.aux1, tempFrame.aux2, tempFrame.cksum);
 
     // Wait for CMD line to raise again
 #ifdef ESP_PLATFORM
-    while (fnSystem.digital_read(PIN_CMD) == DIGI_LOW)
-        fnSystem.yield();
+    if (!sio_wait_cmd_released(SIO_CMD_DEASSERT_TIMEOUT_MS))
+    {
+        Debug_tracef("Timeout waiting for CMD pin de-assert\r\n");
+        return;
+    }
 #else
-    int i = 0;
-    while (fnSioCom.command_asserted())
+    if (!fnSioCom.wait_command(false, SIO_CMD_DEASSERT_TIMEOUT_MS))
     {
-        fnSystem.delay_microseconds(500);
-        if (++i == 100)
-        {
-            Debug_println("Timeout waiting for CMD pin de-assert");
-            return;
-        }
+        Debug_tracef("Timeout waiting for CMD pin de-assert\r\n");
+        return;
     }
 
     int bytes_pending = fnSioCom.available();
     if (bytes_pending > 0)
     {
-        Debug_printf("!!! Extra bytes pending (%d)\n", bytes_pending);
+        Debug_tracef("!!! Extra bytes pending (%d)\n", bytes_pending);
         // TODO use last 5 received bytes as command frame
         // fnSioCom.flush_input();
     }
 #endif
 
     uint8_t ck = sio_checksum((uint8_t *)&tempFrame.commanddata, sizeof(tempFrame.commanddata)); // Calculate Checksum
+    hsio_sample(ck == tempFrame.checksum);
     if (ck == tempFrame.checksum)
     {
 #ifndef ESP_PLATFORM
         // reset counter if checksum was correct
         _command_frame_counter = 0;
 #endif
+        if (sio_last_failed && tempFrame.commanddata == sio_last_frame)
+            bus_stats.retry(tempFrame.device);
+        sio_last_frame = tempFrame.commanddata;
+        sio_last_failed = false;
+        fnWiFi.note_activity();
+
         if (tempFrame.device == SIO_DEVICEID_DISK && _fujiDev != nullptr && _fujiDev->boot_config)
         {
             _activeDev = _fujiDev->bootdisk();
             if (_activeDev->status_wait_count > 0 && tempFrame.comnd == 'R' && _fujiDev->status_wait_enabled)
             {
-                Debug_printf("Disabling CONFIG boot.\n");
+                Debug_tracef("Disabling CONFIG boot.\n");
                 _fujiDev->boot_config = false;
                 return;
             }
             else
             {
-                Debug_println("FujiNet CONFIG boot");
+                Debug_tracef("FujiNet CONFIG boot\r\n");
                 // handle command
                 _activeDev->sio_process(tempFrame.commanddata, tempFrame.checksum);
+                handled = true;
             }
         }
         else
@@ -318,37 +380,34 @@ void systemBus::_sio_process_cmd()
             // Command SIO_DEVICEID_TYPE3POLL is a Type3 poll - send it to every device that cares
             if (tempFrame.device == SIO_DEVICEID_TYPE3POLL)
             {
-                Debug_println("SIO TYPE3 POLL");
+                Debug_tracef("SIO TYPE3 POLL\r\n");
                 for (auto devicep : _daisyChain)
                 {
                     if (devicep->listen_to_type3_polls)
                     {
-                        Debug_printf("Sending TYPE3 poll to dev %x\n", devicep->_devnum);
+                        Debug_tracef("Sending TYPE3 poll to dev %x\n", devicep->_devnum);
                         _activeDev = devicep;
                         // handle command
                         _activeDev->sio_process(tempFrame.commanddata, tempFrame.checksum);
+                        handled = true;
                     }
                 }
             }
-            else
+            else if (_deviceMap[tempFrame.device] != nullptr)
             {
                 // find device, ack and pass control
-                // or go back to WAIT
-                for (auto devicep : _daisyChain)
-                {
-                    if (tempFrame.device == devicep->_devnum)
-                    {
-                        _activeDev = devicep;
-                        // handle command
-                        _activeDev->sio_process(tempFrame.commanddata, tempFrame.checksum);
-                    }
-                }
+                _activeDev = _deviceMap[tempFrame.device];
+                // handle command
+                _activeDev->sio_process(tempFrame.commanddata, tempFrame.checksum);
+                handled = true;
             }
+            // or go back to WAIT
         }
     } // valid checksum
     else
     {
-        Debug_print("CHECKSUM_ERROR\n");
+        Debug_tracef("CHECKSUM_ERROR\n");
+        bus_stats.checksum_error(BUS_STATS_NO_DEVICE);
         // Switch to/from hispeed SIO if we get enough failed frame checksums
         _command_frame_counter++;
         if (COMMAND_FRAME_SPEED_CHANGE_THRESHOLD == _command_frame_counter)
@@ -357,6 +416,10 @@ void systemBus::_sio_process_cmd()
             toggleBaudrate();
         }
     }
+    if (handled)
+        bus_stats.command(tempFrame.device, busStats::now() - frame_us);
+    cmd_arena.reset();
+    SIO_TRACE_END();
 
 #ifndef ESP_PLATFORM
     if (!_command_processed)
@@ -372,10 +435,11 @@ void systemBus::_sio_process_cmd()
 // Look to see if we have any waiting messages and process them accordingly
 void systemBus::_sio_process_queue()
 {
-#ifdef ESP_PLATFORM
     sio_message_t msg;
-    if (xQueueReceive(qSioMessages, &msg, 0) == pdTRUE)
+    uint32_t latency_us;
+    if (qSioMessages.pop(msg, &latency_us))
     {
+        Debug_printf("SIO message %u after %luus\n", msg.message_id, (unsigned long)latency_us);
         switch (msg.message_id)
         {
         case SIOMSG_DISKSWAP:
@@ -388,7 +452,6 @@ void systemBus::_sio_process_queue()
             break;
         }
     }
-#endif
 }
 
 /*
@@ -526,6 +589,17 @@ void systemBus::service()
     //   true  = SIO port needs handling
     //   false = no SIO "event" ocurred within interval
     } while (fnSioCom.poll(1));
+
+    // Nothing left to do on the bus, the main loop may sleep until the port has something
+    // unless a mode or an open network connection needs checking on every pass
+    bool polled = (_modemDev != nullptr && _modemDev->modemActive && Config.get_modem_enabled()) ||
+                  (_udpDev != nullptr && _udpDev->udpstreamActive) ||
+                  (_cpmDev != nullptr && _cpmDev->cpmActive && Config.get_cpm_enabled()) ||
+                  (_fujiDev->cassette()->is_mounted() && Config.get_cassette_enabled());
+    for (int i = 0; i < 8 && !polled; i++)
+        polled = _netDev[i] != nullptr && _netDev[i]->sio_interrupt_polled();
+    if (!polled)
+        fnSioCom.idle_watch();
 #endif
 }
 
@@ -549,16 +623,15 @@ void systemBus::setup()
     fnSystem.set_pin_mode(PIN_MTR, gpio_mode_t::GPIO_MODE_INPUT);
     // CMD PIN
     //fnSystem.set_pin_mode(PIN_CMD, PINMODE_INPUT | PINMODE_PULLUP); // There's no PULLUP/PULLDOWN on pins 34-39
-    fnSystem.set_pin_mode(PIN_CMD, gpio_mode_t::GPIO_MODE_INPUT);
+    fnSystem.set_pin_mode(PIN_CMD, gpio_mode_t::GPIO_MODE_INPUT, SystemManager::pull_updown_t::PULL_NONE, GPIO_INTR_POSEDGE);
+    sio_cmd_released = xSemaphoreCreateBinary();
+    gpio_isr_handler_add((gpio_num_t)PIN_CMD, sio_cmd_isr_handler, nullptr);
     // CKI PIN
     fnSystem.set_pin_mode(PIN_CKI, gpio_mode_t::GPIO_MODE_OUTPUT_OD);
     fnSystem.digital_write(PIN_CKI, DIGI_HIGH);
     // CKO PIN
     fnSystem.set_pin_mode(PIN_CKO, gpio_mode_t::GPIO_MODE_INPUT);
 
-    // Create a message queue
-    qSioMessages = xQueueCreate(4, sizeof(sio_message_t));
-
     // Set the initial HSIO index
     // First see if Config has read a value
     int i = Config.get_general_hsioindex();
@@ -566,12 +639,14 @@ void systemBus::setup()
         setHighSpeedIndex(i);
     else
         setHighSpeedIndex(_sioHighSpeedIndex);
+    _hsio_setup();
 
     SYSTEM_BUS.uart->flush_input();
 #else
     // Setup SIO ports: serial UART and NetSIO
     fnSioCom.set_serial_port(Config.get_serial_port().c_str(), Config.get_serial_command(), Config.get_serial_proceed()); // UART
     fnSioCom.set_netsio_host(Config.get_boip_host().c_str(), Config.get_boip_port()); // NetSIO
+    fnSioCom.set_netsio_benchmark(Config.get_boip_benchmark());
     fnSioCom.set_sio_mode(Config.get_boip_enabled() ? SioCom::sio_mode::NETSIO : SioCom::sio_mode::SERIAL);
     fnSioCom.begin(_sioBaud);
 
@@ -580,6 +655,7 @@ void systemBus::setup()
 
     // Set the initial HSIO index
     setHighSpeedIndex(Config.get_general_hsioindex());
+    _hsio_setup();
 
     fnSioCom.flush_input();
 #endif
@@ -620,6 +696,7 @@ void systemBus::addDevice(virtualDevice *pDevice, int device_id)
     pDevice->_devnum = device_id;
 
     _daisyChain.push_front(pDevice);
+    _rebuild_device_map();
 }
 
 // Removes device from the SIO bus.
@@ -627,6 +704,19 @@ void systemBus::addDevice(virtualDevice *pDevice, int device_id)
 void systemBus::remDevice(virtualDevice *p)
 {
     _daisyChain.remove(p);
+    _rebuild_device_map();
+}
+
+// Where two devices share an ID, as they can halfway through swapping disks, the one added
+// last wins, as it would searching _daisyChain from the front
+void systemBus::_rebuild_device_map()
+{
+    std::fill(std::begin(_deviceMap), std::end(_deviceMap), nullptr);
+    for (auto devicep : _daisyChain)
+    {
+        if (devicep->_devnum >= 0 && devicep->_devnum < 256 && _deviceMap[devicep->_devnum] == nullptr)
+            _deviceMap[devicep->_devnum] = devicep;
+    }
 }
 
 // Should avoid using this as it requires counting through the list
@@ -647,16 +737,14 @@ void systemBus::changeDeviceId(virtualDevice *p, int device_id)
         if (devicep == p)
             devicep->_devnum = device_id;
     }
+    _rebuild_device_map();
 }
 
 virtualDevice *systemBus::deviceById(int device_id)
 {
-    for (auto devicep : _daisyChain)
-    {
-        if (devicep->_devnum == device_id)
-            return devicep;
-    }
-    return nullptr;
+    if (device_id < 0 || device_id >= 256)
+        return nullptr;
+    return _deviceMap[device_id];
 }
 
 // Give devices an opportunity to clean up before a reboot
@@ -770,6 +858,77 @@ int systemBus::setHighSpeedIndex(int hsio_index)
     return _sioBaudHigh;
 }
 
+// Machine link a calibrated HSIO index belongs to
+std::string systemBus::_hsio_profile()
+{
+#ifdef ESP_PLATFORM
+    return "sio";
+#else
+    int port;
+    if (fnSioCom.get_sio_mode() == SioCom::sio_mode::NETSIO)
+    {
+        const char *host = fnSioCom.get_netsio_host(port);
+        return std::string("netsio:") + host + ":" + std::to_string(port);
+    }
+    int proceed;
+    return std::string("serial:") + fnSioCom.get_serial_port(port, proceed);
+#endif
+}
+
+// Use the index calibrated for this machine, or start calibrating if asked to
+void systemBus::_hsio_setup()
+{
+    if (Config.get_hsio_calibrate())
+    {
+        setHighSpeedIndex(_hsio_tuner.begin_calibration());
+        return;
+    }
+
+    int index = Config.get_hsio_profile_index(_hsio_profile());
+    if (index >= 0)
+    {
+        Debug_printf("Using calibrated HSIO index %d\n", index);
+        setHighSpeedIndex(index);
+    }
+}
+
+void systemBus::hsio_sample(bool ok)
+{
+    // Only frames at the HSIO index tell anything about it
+    if (useUltraHigh || _sioBaud == SIO_STANDARD_BAUDRATE || _sioBaud != _sioBaudHigh)
+        return;
+
+    int index = _hsio_tuner.sample(_sioHighSpeedIndex, ok);
+    if (_hsio_tuner.settled())
+    {
+        Debug_printf("HSIO calibration done, index %d\n", _sioHighSpeedIndex);
+        Config.store_hsio_calibrate(false);
+        Config.store_hsio_profile_index(_hsio_profile(), _sioHighSpeedIndex);
+        // Written by the config save task, not in the middle of a frame
+        Config.save_later();
+    }
+    if (index < 0)
+        return;
+
+    Debug_printf("HSIO stepping down from index %d to %d\n", _sioHighSpeedIndex, index);
+    setHighSpeedIndex(index);
+    if (!_hsio_tuner.calibrating())
+    {
+        Config.store_hsio_profile_index(_hsio_profile(), index);
+        Config.save_later();
+    }
+    // Back to standard speed, the next try there asks for the new index
+    _command_frame_counter = 0;
+    toggleBaudrate();
+}
+
+void systemBus::hsio_forget_calibration()
+{
+    _hsio_tuner.cancel_calibration();
+    Config.store_hsio_calibrate(false);
+    Config.remove_hsio_profile(_hsio_profile());
+}
+
 int systemBus::getHighSpeedIndex()
 {
     return _sioHighSpeedIndex;
@@ -841,6 +1000,8 @@ void systemBus::setUDPHost(const char *hostname, int port)
 
     // Set if server mode or not
     _udpDev->udpstreamIsServer = Config.get_network_udpstream_servermode();
+    if (Config.get_network_udpstream_gap() > 0)
+        _udpDev->udpstream_gap_us = Config.get_network_udpstream_gap();
 
     // Restart UDP Stream mode if needed
     if (_udpDev->udpstreamActive)
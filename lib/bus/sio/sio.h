@@ -3,6 +3,9 @@
 
 #include <forward_list>
 
+#include "spsc_queue.h"
+#include "sioHsioTuner.h"
+
 #ifdef ESP_PLATFORM
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
@@ -62,6 +65,8 @@ FN_HISPEED_INDEX=40 //  18,806 (18,806) baud
 
 #define COMMAND_FRAME_SPEED_CHANGE_THRESHOLD 2
 #define SERIAL_TIMEOUT 300
+// Longest wait for CMD to go back up after the command frame
+#define SIO_CMD_DEASSERT_TIMEOUT_MS 50
 
 #define SIO_DEVICEID_DISK 0x31
 #define SIO_DEVICEID_DISK_LAST 0x3F
@@ -247,7 +252,7 @@ public:
     /**
      * @brief Get the systemBus object that this virtualDevice is attached to.
      */
-    systemBus sio_get_bus();
+    systemBus &sio_get_bus();
 };
 
 enum sio_message : uint16_t
@@ -268,6 +273,10 @@ class systemBus
 {
 private:
     std::forward_list<virtualDevice *> _daisyChain;
+    // The device each command frame device ID goes to, kept in step with _daisyChain so a
+    // frame is dispatched, or found to be for some other device on the bus, without a search
+    virtualDevice *_deviceMap[256] = {nullptr};
+    void _rebuild_device_map();
 
     int _command_frame_counter = 0;
 
@@ -287,6 +296,10 @@ private:
 
     bool useUltraHigh = false; // Use fujinet derived clock.
 
+    sioHsioTuner _hsio_tuner;
+    std::string _hsio_profile();
+    void _hsio_setup();
+
 #ifndef ESP_PLATFORM
     bool _command_processed = false;
 #endif
@@ -312,6 +325,8 @@ public:
     int setHighSpeedIndex(int hsio_index);                      // Set HSIO index. Sets high speed SIO baud and also returns that value.
     int getHighSpeedIndex();                                    // Gets current HSIO index
     int getHighSpeedBaud();                                     // Gets current HSIO baud
+    void hsio_sample(bool ok);                                  // Frame received, ok false on a checksum error; feeds HSIO calibration
+    void hsio_forget_calibration();                             // An index was set by hand, drop the calibrated one for this machine
 
     void setUDPHost(const char *newhost, int port);             // Set new host/ip & port for UDP Stream
     void setUltraHigh(bool _enable, int _ultraHighBaud = 0);    // enable ultrahigh/set baud rate
@@ -329,13 +344,13 @@ public:
     sioCassette *getCassette() { return _cassetteDev; }
     sioPrinter *getPrinter() { return _printerdev; }
     sioCPM *getCPM() { return _cpmDev; }
+    sioUDPStream *getUDPStream() { return _udpDev; }
 
     // I wish this codebase would make up its mind to use camel or snake casing.
     modem *get_modem() { return _modemDev; }
 
-#ifdef ESP_PLATFORM
-    QueueHandle_t qSioMessages = nullptr;
-#endif
+    // Events from other tasks (buttons) for the bus loop
+    spsc_queue<sio_message_t, 4> qSioMessages;
 
     MODEM_UART_T* uart;             // UART manager to use.
     void set_uart(MODEM_UART_T* _uart) { uart = _uart; }
@@ -0,0 +1,81 @@
+#include "sioHsioTuner.h"
+
+#include "../../include/debug.h"
+
+// Indexes calibration goes through, fastest first
+#ifdef ESP_PLATFORM
+static const int hsio_ladder[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+#else
+static const int hsio_ladder[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 16};
+#endif
+#define HSIO_LADDER_SIZE (sizeof(hsio_ladder) / sizeof(hsio_ladder[0]))
+
+int sioHsioTuner::slower(int index)
+{
+    for (size_t i = 0; i < HSIO_LADDER_SIZE; i++)
+    {
+        if (hsio_ladder[i] > index)
+            return hsio_ladder[i];
+    }
+    return index;
+}
+
+int sioHsioTuner::begin_calibration()
+{
+    _calibrating = true;
+    _settled = false;
+    _reset();
+    Debug_printf("HSIO calibration starting at index %d\n", hsio_ladder[0]);
+    return hsio_ladder[0];
+}
+
+int sioHsioTuner::sample(int index, bool ok)
+{
+    _frames++;
+    if (!ok)
+        _errors++;
+
+    if (_calibrating)
+    {
+        if (_errors > HSIO_TUNE_MAX_ERRORS)
+        {
+            int next = slower(index);
+            Debug_printf("HSIO calibration: index %d failed (%u errors in %u frames)\n", index, _errors, _frames);
+            _reset();
+            if (next == index)
+            {
+                // Nothing slower left to try, keep the slowest
+                _calibrating = false;
+                _settled = true;
+                return -1;
+            }
+            return next;
+        }
+        if (_frames >= HSIO_TUNE_SAMPLES)
+        {
+            Debug_printf("HSIO calibration: index %d is stable (%u errors in %u frames)\n", index, _errors, _frames);
+            _calibrating = false;
+            _settled = true;
+            _reset();
+        }
+        return -1;
+    }
+
+    if (_errors > HSIO_DRIFT_MAX_ERRORS)
+    {
+        int next = slower(index);
+        Debug_printf("HSIO drift: %u errors in %u frames at index %d\n", _errors, _frames, index);
+        _reset();
+        return next != index ? next : -1;
+    }
+    if (_frames >= HSIO_DRIFT_WINDOW)
+        _reset();
+    return -1;
+}
+
+bool sioHsioTuner::settled()
+{
+    bool settled = _settled;
+    _settled = false;
+    return settled;
+}
@@ -0,0 +1,52 @@
+#ifndef SIO_HSIO_TUNER_H
+#define SIO_HSIO_TUNER_H
+
+/*
+ * Picks the HSIO index from the error rate of the live machine.
+ *
+ * Calibration starts at the fastest index and judges it on the next
+ * HSIO_TUNE_SAMPLES command and data frames received at high speed. An index
+ * with more than HSIO_TUNE_MAX_ERRORS checksum errors among them is dropped
+ * for the next slower one, the first that passes is kept.
+ *
+ * Outside calibration the same counts make a drift monitor: more than
+ * HSIO_DRIFT_MAX_ERRORS errors within HSIO_DRIFT_WINDOW frames steps the
+ * index down by one.
+ */
+
+#include <stdint.h>
+
+#define HSIO_TUNE_SAMPLES 32
+#define HSIO_TUNE_MAX_ERRORS 1
+#define HSIO_DRIFT_WINDOW 128
+#define HSIO_DRIFT_MAX_ERRORS 4
+
+class sioHsioTuner
+{
+private:
+    bool _calibrating = false;
+    bool _settled = false;
+    uint32_t _frames = 0;
+    uint32_t _errors = 0;
+
+    void _reset() { _frames = 0; _errors = 0; }
+
+public:
+    // Next slower index to try, or index itself if it's the slowest
+    static int slower(int index);
+
+    // Starts over at the fastest index, which is returned
+    int begin_calibration();
+    bool calibrating() { return _calibrating; }
+    // Back to drift monitoring only
+    void cancel_calibration() { _calibrating = false; _settled = false; _reset(); }
+
+    // A frame came in at high speed with the given index, ok is false after a checksum error.
+    // Returns the index to switch to, or -1 to stay.
+    int sample(int index, bool ok);
+
+    // True once after the sample that ended calibration
+    bool settled();
+};
+
+#endif // SIO_HSIO_TUNER_H
@@ -0,0 +1,170 @@
+#ifdef SIO_TRACE
+
+#include "sioTrace.h"
+
+#include <stdio.h>
+#include <sstream>
+
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#else
+#include "fnSystem.h"
+#endif
+
+sioTrace sio_trace;
+
+uint64_t sioTrace::_now()
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    return fnSystem.micros();
+#endif
+}
+
+void sio_trace_histogram::add(uint32_t us)
+{
+    int b = 0;
+    while (b < SIO_TRACE_BUCKETS - 1 && us >= (64U << b))
+        b++;
+    buckets[b]++;
+    count++;
+    sum_us += us;
+    if (us > max_us)
+        max_us = us;
+}
+
+void sioTrace::begin(uint8_t device, uint8_t command)
+{
+    _frame_us = _now();
+    _current = {};
+    _current.device = device;
+    _current.command = command;
+    _active = true;
+}
+
+void sioTrace::ack(bool nak)
+{
+    if (!_active || _current.ack_us != 0)
+        return;
+    _current.ack_us = _now() - _frame_us;
+    _current.nak = nak;
+}
+
+void sioTrace::complete(bool error)
+{
+    if (!_active || _current.complete_us != 0)
+        return;
+    _current.complete_us = _now() - _frame_us;
+    _current.error = error;
+}
+
+void sioTrace::end()
+{
+    if (!_active)
+        return;
+    _current.total_us = _now() - _frame_us;
+    _active = false;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _ring[_recorded % SIO_TRACE_RING] = _current;
+    _recorded++;
+    _by_device[_current.device].add(_current.total_us);
+    _by_command[(_current.device << 8) | _current.command].add(_current.total_us);
+}
+
+void sioTrace::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _recorded = 0;
+    _by_device.clear();
+    _by_command.clear();
+}
+
+static void _histogram_json(std::ostringstream &out, const sio_trace_histogram &h)
+{
+    out << "\"count\":" << h.count << ",\"max_us\":" << h.max_us
+        << ",\"avg_us\":" << (h.count ? h.sum_us / h.count : 0) << ",\"buckets\":[";
+    for (int b = 0; b < SIO_TRACE_BUCKETS; b++)
+        out << (b ? "," : "") << h.buckets[b];
+    out << "]";
+}
+
+std::string sioTrace::to_json()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::ostringstream out;
+
+    out << "{\"recent\":[";
+    uint32_t n = _recorded < SIO_TRACE_RING ? _recorded : SIO_TRACE_RING;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const sio_trace_record &r = _ring[(_recorded - n + i) % SIO_TRACE_RING];
+        out << (i ? "," : "") << "{\"device\":" << (int)r.device << ",\"command\":" << (int)r.command
+            << ",\"ack_us\":" << r.ack_us << ",\"complete_us\":" << r.complete_us
+            << ",\"total_us\":" << r.total_us << ",\"nak\":" << (r.nak ? "true" : "false")
+            << ",\"error\":" << (r.error ? "true" : "false") << "}";
+    }
+
+    out << "],\"devices\":[";
+    bool first = true;
+    for (const auto &d : _by_device)
+    {
+        out << (first ? "" : ",") << "{\"device\":" << (int)d.first << ",";
+        _histogram_json(out, d.second);
+        out << "}";
+        first = false;
+    }
+
+    out << "],\"commands\":[";
+    first = true;
+    for (const auto &c : _by_command)
+    {
+        out << (first ? "" : ",") << "{\"device\":" << (c.first >> 8) << ",\"command\":" << (c.first & 0xFF) << ",";
+        _histogram_json(out, c.second);
+        out << "}";
+        first = false;
+    }
+    out << "]}\n";
+
+    return out.str();
+}
+
+void sioTrace::print()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    printf("Last commands (us from frame):\r\n  dev cmd     ack  complete     total\r\n");
+    uint32_t n = _recorded < SIO_TRACE_RING ? _recorded : SIO_TRACE_RING;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        const sio_trace_record &r = _ring[(_recorded - n + i) % SIO_TRACE_RING];
+        printf("  %02X  %02X  %7lu%c %8lu%c %9lu\r\n", r.device, r.command,
+               (unsigned long)r.ack_us, r.nak ? 'N' : ' ',
+               (unsigned long)r.complete_us, r.error ? 'E' : ' ', (unsigned long)r.total_us);
+    }
+
+    printf("\r\nPer device (buckets: <64us, <128us, ... doubling):\r\n");
+    for (const auto &d : _by_device)
+    {
+        const sio_trace_histogram &h = d.second;
+        printf("  %02X    n=%lu avg=%lu max=%lu :", d.first, (unsigned long)h.count,
+               (unsigned long)(h.count ? h.sum_us / h.count : 0), (unsigned long)h.max_us);
+        for (int b = 0; b < SIO_TRACE_BUCKETS; b++)
+            printf(" %lu", (unsigned long)h.buckets[b]);
+        printf("\r\n");
+    }
+
+    printf("\r\nPer device+command:\r\n");
+    for (const auto &c : _by_command)
+    {
+        const sio_trace_histogram &h = c.second;
+        printf("  %02X %02X n=%lu avg=%lu max=%lu :", c.first >> 8, c.first & 0xFF, (unsigned long)h.count,
+               (unsigned long)(h.count ? h.sum_us / h.count : 0), (unsigned long)h.max_us);
+        for (int b = 0; b < SIO_TRACE_BUCKETS; b++)
+            printf(" %lu", (unsigned long)h.buckets[b]);
+        printf("\r\n");
+    }
+}
+
+#endif // SIO_TRACE
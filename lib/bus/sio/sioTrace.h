@@ -0,0 +1,88 @@
+#ifndef SIO_TRACE_H
+#define SIO_TRACE_H
+
+/*
+ * Optional timing of SIO command handling, enabled with -D SIO_TRACE.
+ * Each command frame is timed from receipt to ACK/NAK, to COMPLETE/ERROR
+ * and to the device's sio_process() returning. The last SIO_TRACE_RING
+ * commands are kept, along with log2 histograms of the total time per
+ * device and per device+command. Without SIO_TRACE the macros compile
+ * to nothing.
+ */
+
+#ifdef SIO_TRACE
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+#define SIO_TRACE_RING 64
+// Bucket n counts commands that took under 2^(n+6) us, the last bucket everything slower
+#define SIO_TRACE_BUCKETS 12
+
+struct sio_trace_record
+{
+    uint8_t device;
+    uint8_t command;
+    bool nak;
+    bool error;
+    uint32_t ack_us;      // frame to ACK/NAK, 0 if neither was sent
+    uint32_t complete_us; // frame to COMPLETE/ERROR, 0 if neither was sent
+    uint32_t total_us;    // frame to sio_process() returning
+};
+
+struct sio_trace_histogram
+{
+    uint32_t count = 0;
+    uint32_t max_us = 0;
+    uint64_t sum_us = 0;
+    uint32_t buckets[SIO_TRACE_BUCKETS] = {0};
+
+    void add(uint32_t us);
+};
+
+class sioTrace
+{
+private:
+    sio_trace_record _ring[SIO_TRACE_RING];
+    uint32_t _recorded = 0;
+
+    sio_trace_record _current;
+    uint64_t _frame_us = 0;
+    bool _active = false;
+
+    std::map<uint8_t, sio_trace_histogram> _by_device;
+    std::map<uint16_t, sio_trace_histogram> _by_command; // device << 8 | command
+    std::mutex _mutex;
+
+    static uint64_t _now();
+
+public:
+    void begin(uint8_t device, uint8_t command);
+    void ack(bool nak);
+    void complete(bool error);
+    void end();
+
+    std::string to_json();
+    void print();
+    void clear();
+};
+
+extern sioTrace sio_trace;
+
+#define SIO_TRACE_BEGIN(device, command) sio_trace.begin(device, command)
+#define SIO_TRACE_ACK(nak) sio_trace.ack(nak)
+#define SIO_TRACE_COMPLETE(error) sio_trace.complete(error)
+#define SIO_TRACE_END() sio_trace.end()
+
+#else
+
+#define SIO_TRACE_BEGIN(device, command) do {} while (0)
+#define SIO_TRACE_ACK(nak) do {} while (0)
+#define SIO_TRACE_COMPLETE(error) do {} while (0)
+#define SIO_TRACE_END() do {} while (0)
+
+#endif // SIO_TRACE
+
+#endif // SIO_TRACE_H
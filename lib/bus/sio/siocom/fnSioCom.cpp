@@ -40,6 +40,11 @@ bool SioCom::poll(int ms)
     return _sioPort->poll(ms); 
 }
 
+void SioCom::idle_watch()
+{
+    _sioPort->idle_watch();
+}
+
 void SioCom::set_baudrate(uint32_t baud) 
 { 
     _sioPort->set_baudrate(baud); 
@@ -55,6 +60,11 @@ bool SioCom::command_asserted()
     return _sioPort->command_asserted();
 }
 
+bool SioCom::wait_command(bool asserted, uint32_t timeout_ms)
+{
+    return _sioPort->wait_command(asserted, timeout_ms);
+}
+
 bool SioCom::motor_asserted() 
 {
     return _sioPort->motor_asserted();
@@ -233,6 +243,16 @@ void SioCom::netsio_write_size(int write_size)
     _netSio.set_sync_write_size(write_size + 1); // data + checksum byte
 }
 
+void SioCom::set_netsio_benchmark(bool enabled)
+{
+    _netSio.set_benchmark(enabled);
+}
+
+std::string SioCom::netsio_stats_json()
+{
+    return _netSio.link_stats_json();
+}
+
 void SioCom::set_sio_mode(sio_mode mode)
 {
     _sio_mode = mode;
@@ -38,11 +38,14 @@ public:
     void begin(int baud = 0);
     void end();
     bool poll(int ms);
+    void idle_watch();
 
     void set_baudrate(uint32_t baud);
     uint32_t get_baudrate();
 
     bool command_asserted();
+    // Waits for the command line to reach the given level, false on timeout
+    bool wait_command(bool asserted, uint32_t timeout_ms);
     bool motor_asserted();
     void set_proceed(bool level);
     void set_interrupt(bool level);
@@ -85,6 +88,8 @@ public:
     void netsio_late_sync(uint8_t c);
     void netsio_empty_sync();
     void netsio_write_size(int write_size);
+    void set_netsio_benchmark(bool enabled);
+    std::string netsio_stats_json();
 
     // get/set SIO mode
     sio_mode get_sio_mode() {return _sio_mode;}
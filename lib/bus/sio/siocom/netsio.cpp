@@ -8,6 +8,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include <sstream>
 #include "compat_string.h"
 #include <sys/time.h>
 #include <unistd.h> // write(), read(), close()
@@ -18,6 +20,7 @@
 
 #include "fnSystem.h"
 #include "fnWiFi.h"
+#include "fnIdleWait.h"
 
 
 /* alive response timeout in seconds
@@ -49,7 +52,14 @@ NetSioPort::NetSioPort() :
     _sync_request_num(-1),
     _sync_write_size(-1),
     _errcount(0),
-    _credit(3)
+    _credit(3),
+    _credit_requested(false),
+    _credit_low(-1),
+    _credit_wait_ms(NETSIO_CREDIT_WAIT_MS),
+    _benchmark(false),
+    _connect_time(0),
+    _rx_bytes(0),
+    _tx_bytes(0)
 {}
 
 NetSioPort::~NetSioPort()
@@ -138,11 +148,17 @@ void NetSioPort::begin(int baud)
         return;
     }
 
+    // Measure the link while the hub has nothing else to send us
+    measure_link();
+    tune_link();
+
     // Connect device
     uint8_t connect = NETSIO_DEVICE_CONNECT;
     send(_fd, (char *)&connect, 1, 0);
 
-    _alive_request = _alive_time = fnSystem.millis();
+    _alive_request = _alive_time = _connect_time = fnSystem.millis();
+    _rx_bytes = _tx_bytes = 0;
+    _credit_requested = false;
 
     Debug_printf("### NetSIO initialized ###\n");
     // Set initialized.
@@ -177,6 +193,21 @@ bool NetSioPort::poll(int ms)
     return false;
 }
 
+void NetSioPort::idle_watch()
+{
+    if (!_initialized)
+    {
+        // suspended, resume_test() only needs a look now and then
+        fnIdle.allow_sleep();
+    }
+    else if (rxbuffer_empty())
+    {
+        // every hub message, including the ALIVE responses, comes in on the socket
+        fnIdle.allow_sleep();
+        fnIdle.watch(_fd);
+    }
+}
+
 void NetSioPort::suspend(int ms)
 {
     Debug_printf("Suspending NetSIO for %d ms\n", ms);
@@ -238,6 +269,119 @@ int NetSioPort::ping(int count, int interval_ms, int timeout_ms, bool fast)
     return ok_count ? rtt_sum / ok_count : -1;
 }
 
+/* Times single pings to the hub for round trip and jitter, plus a burst of them in benchmark mode */
+void NetSioPort::measure_link()
+{
+    int count = _benchmark ? NETSIO_BENCHMARK_PINGS : NETSIO_LINK_PINGS;
+    int timeout_ms = _benchmark ? 500 : 100;
+    int64_t rtt_sum = 0;
+    int64_t delta_sum = 0;
+    int last = -1;
+
+    _link = netsio_link_stats();
+    for (int i = 0; i < count; i++)
+    {
+        int rtt = ping(1, 0, timeout_ms);
+        if (rtt < 0)
+        {
+            _link.lost++;
+            continue;
+        }
+        if (_link.rtt_min < 0 || rtt < _link.rtt_min)
+            _link.rtt_min = rtt;
+        if (rtt > _link.rtt_max)
+            _link.rtt_max = rtt;
+        if (last >= 0)
+            delta_sum += abs(rtt - last);
+        last = rtt;
+        rtt_sum += rtt;
+        _link.samples++;
+    }
+    if (_link.samples > 0)
+        _link.rtt_avg = (int)(rtt_sum / _link.samples);
+    if (_link.samples > 1)
+        _link.jitter = (int)(delta_sum / (_link.samples - 1));
+
+    if (_benchmark)
+        _link.burst_rate = ping_burst(NETSIO_BENCHMARK_BURST, timeout_ms);
+
+    Debug_printf("NetSIO link %s: %d/%d pings, rtt min/avg/max %.3f/%.3f/%.3f ms, jitter %.3f ms",
+        _host, _link.samples, _link.samples + _link.lost,
+        _link.rtt_min / 1000.0, _link.rtt_avg / 1000.0, _link.rtt_max / 1000.0, _link.jitter / 1000.0);
+    if (_benchmark)
+        Debug_printf(", burst %d round trips/s", _link.burst_rate);
+    Debug_print("\n");
+}
+
+/* Sends count pings back to back and returns how many round trips per second came back, 0 if none did */
+int NetSioPort::ping_burst(int count, int timeout_ms)
+{
+    uint8_t ping = NETSIO_PING_REQUEST;
+    int sent = 0;
+    int answered = 0;
+    uint64_t elapsed = 0;
+    uint64_t t1 = fnSystem.micros();
+
+    while (sent < count && send(_fd, (char *)&ping, 1, 0) == 1)
+        sent++;
+
+    while (answered < sent)
+    {
+        int wait_ms = timeout_ms - (int)((fnSystem.micros() - t1) / 1000);
+        if (wait_ms <= 0 || !wait_sock_readable(wait_ms))
+            break;
+        if (recv(_fd, (char *)&ping, 1, 0) == 1 && ping == NETSIO_PING_RESPONSE)
+        {
+            answered++;
+            elapsed = fnSystem.micros() - t1;
+        }
+    }
+    if (answered < sent)
+        Debug_printf("NetSIO ping burst: %d of %d answered\n", answered, sent);
+
+    return elapsed ? (int)(answered * 1000000ULL / elapsed) : 0;
+}
+
+/* Fits the credit handling to the measured link */
+void NetSioPort::tune_link()
+{
+    if (_link.samples == 0)
+    {
+        _credit_wait_ms = NETSIO_CREDIT_WAIT_MS;
+        _credit_low = -1;
+        return;
+    }
+
+    // A credit update is one round trip away, give up on it (and ask again) well after the
+    // slowest one seen, instead of after a fixed half second when a datagram got lost
+    uint32_t wait_ms = (uint32_t)(_link.rtt_max + 2 * _link.jitter) * 4 / 1000;
+    _credit_wait_ms = std::max((uint32_t)NETSIO_CREDIT_WAIT_MIN_MS, std::min(wait_ms, (uint32_t)NETSIO_CREDIT_WAIT_MS));
+
+    // On a slow link ask for more credit while the last message can still be sent,
+    // so the update is usually in before it is needed
+    _credit_low = _link.rtt_avg > NETSIO_SLOW_LINK_US ? 1 : -1;
+
+    Debug_printf("NetSIO credit wait %u ms, %s\n", _credit_wait_ms,
+        _credit_low < 0 ? "credit on demand" : "credit ahead of need");
+}
+
+std::string NetSioPort::link_stats_json()
+{
+    uint64_t ms = _initialized ? fnSystem.millis() - _connect_time : 0;
+
+    std::ostringstream out;
+    out << "{\"connected\":" << (_initialized ? "true" : "false")
+        << ",\"pings\":" << _link.samples << ",\"lost\":" << _link.lost
+        << ",\"rtt_min_us\":" << _link.rtt_min << ",\"rtt_avg_us\":" << _link.rtt_avg
+        << ",\"rtt_max_us\":" << _link.rtt_max << ",\"jitter_us\":" << _link.jitter
+        << ",\"burst_rate\":" << _link.burst_rate
+        << ",\"credit_wait_ms\":" << _credit_wait_ms << ",\"credit_low\":" << _credit_low
+        << ",\"rx_bytes\":" << _rx_bytes << ",\"tx_bytes\":" << _tx_bytes
+        << ",\"rx_rate\":" << (ms ? _rx_bytes * 1000 / ms : 0)
+        << ",\"tx_rate\":" << (ms ? _tx_bytes * 1000 / ms : 0) << "}";
+    return out.str();
+}
+
 bool NetSioPort::rxbuffer_empty()
 {
     return (_rxhead == _rxtail && !_rxfull);
@@ -246,7 +390,7 @@ bool NetSioPort::rxbuffer_empty()
 bool NetSioPort::rxbuffer_put(uint8_t b) 
 {
     _rxbuf[_rxhead++] = b;
-    _rxhead %= sizeof(_rxbuf);
+    _rxhead &= NETSIO_RXBUF_SIZE - 1;
     if (_rxfull) {
         // tail byte was overwritten / lost
         _rxtail = _rxhead;
@@ -256,22 +400,83 @@ bool NetSioPort::rxbuffer_put(uint8_t b)
     return false;
 }
 
+/* Block put, copied in at most two pieces around the end of the ring.
+   Returns true if the oldest bytes were overwritten
+*/
+bool NetSioPort::rxbuffer_put(const uint8_t *buf, size_t len)
+{
+    bool overrun = len > (size_t)(NETSIO_RXBUF_SIZE - rxbuffer_available());
+    if (len > NETSIO_RXBUF_SIZE)
+    {
+        // only the newest bytes fit
+        buf += len - NETSIO_RXBUF_SIZE;
+        len = NETSIO_RXBUF_SIZE;
+    }
+
+    size_t first = std::min(len, (size_t)(NETSIO_RXBUF_SIZE - _rxhead));
+    memcpy(&_rxbuf[_rxhead], buf, first);
+    memcpy(_rxbuf, buf + first, len - first);
+    _rxhead = (_rxhead + len) & (NETSIO_RXBUF_SIZE - 1);
+
+    if (overrun)
+    {
+        // tail bytes were overwritten / lost
+        _rxtail = _rxhead;
+        _rxfull = true;
+    }
+    else if (len > 0)
+        _rxfull = (_rxhead == _rxtail);
+    return overrun;
+}
+
 int NetSioPort::rxbuffer_get() 
 {
     int b;
     if (rxbuffer_empty())
         return -1;
     b = _rxbuf[_rxtail++];
-    _rxtail %= sizeof(_rxbuf);
+    _rxtail &= NETSIO_RXBUF_SIZE - 1;
     _rxfull = false;
     return b;
 }
 
+size_t NetSioPort::rxbuffer_get(uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+    const uint8_t *data;
+    size_t n;
+    while (done < len && (n = rxbuffer_peek(&data)) > 0)
+    {
+        n = std::min(n, len - done);
+        memcpy(buf + done, data, n);
+        rxbuffer_consume(n);
+        done += n;
+    }
+    return done;
+}
+
+size_t NetSioPort::rxbuffer_peek(const uint8_t **data)
+{
+    *data = &_rxbuf[_rxtail];
+    if (rxbuffer_empty())
+        return 0;
+    // up to the head, or to the end of the ring if the data wraps around
+    return (_rxhead > _rxtail) ? _rxhead - _rxtail : NETSIO_RXBUF_SIZE - _rxtail;
+}
+
+void NetSioPort::rxbuffer_consume(size_t len)
+{
+    if (len == 0)
+        return;
+    _rxtail = (_rxtail + len) & (NETSIO_RXBUF_SIZE - 1);
+    _rxfull = false;
+}
+
 int  NetSioPort::rxbuffer_available() 
 {
     int avail = _rxhead - _rxtail;
     if ((avail < 0) || (avail == 0 && _rxfull))
-        avail += sizeof(_rxbuf);
+        avail += NETSIO_RXBUF_SIZE;
     return avail;
 }
 
@@ -366,20 +571,21 @@ int NetSioPort::handle_netsio()
                     b ^= (uint8_t)_baud_peer ^ (uint8_t)_baud; // corrupt byte
                 if (rxbuffer_put(b))
                     Debug_println("NetSIO rxbuffer overrun");
+                _rx_bytes++;
                 break;
 
             case NETSIO_DATA_BLOCK:
                 if (received >= 2)
                 {
-                    for (int i = 1; i < received-1; i++) // TODO received-1, to test packet SNs
-                    // for (int i = 1; i < received; i++)
+                    // TODO received-1, to test packet SNs
+                    if (_baud_peer < _baud * 90 / 100 || _baud_peer > _baud * 110 / 100)
                     {
-                        b = rxbuf[i];
-                        if (_baud_peer < _baud * 90 / 100 || _baud_peer > _baud * 110 / 100)
-                            b ^= (uint8_t)_baud_peer ^ (uint8_t)_baud; // corrupt byte
-                        if (rxbuffer_put(b))
-                            Debug_println("NetSIO rxbuffer overrun");
+                        for (int i = 1; i < received-1; i++)
+                            rxbuf[i] ^= (uint8_t)_baud_peer ^ (uint8_t)_baud; // corrupt byte
                     }
+                    if (rxbuffer_put(&rxbuf[1], received - 2))
+                        Debug_println("NetSIO rxbuffer overrun");
+                    _rx_bytes += received - 2;
                 }
                 break;
 
@@ -418,6 +624,7 @@ int NetSioPort::handle_netsio()
 
             case NETSIO_CREDIT_UPDATE:
                 _credit = rxbuf[1];
+                _credit_requested = false;
                 break;
 
             case NETSIO_COLD_RESET:
@@ -580,11 +787,17 @@ bool NetSioPort::wait_for_credit(int needed)
         // inform HUB we need more credit
         send(_fd, (char *)txbuf, sizeof(txbuf), 0);
         //Debug_printf("waiting for credit %d\n", _credit);
-        wait_sock_readable(500);
+        wait_sock_readable(_credit_wait_ms);
         handle_netsio();
     }
     // consume credit
     _credit -= needed;
+    if (_credit <= _credit_low && !_credit_requested)
+    {
+        txbuf[1] = (uint8_t)_credit;
+        send(_fd, (char *)txbuf, sizeof(txbuf), 0);
+        _credit_requested = true;
+    }
     //Debug_printf("credit %d\n", _credit);
     return true;
 }
@@ -650,6 +863,23 @@ bool NetSioPort::command_asserted(void)
     return _command_asserted;
 }
 
+bool NetSioPort::wait_command(bool asserted, uint32_t timeout_ms)
+{
+    uint64_t start = fnSystem.millis();
+    for (;;)
+    {
+        // The change comes with a COMMAND_ON/OFF message, handle what's queued up to it
+        while (_command_asserted != asserted && handle_netsio() > 0)
+            ;
+        if (_command_asserted == asserted)
+            return true;
+
+        uint64_t elapsed = fnSystem.millis() - start;
+        if (!_initialized || elapsed >= timeout_ms || !wait_sock_readable(timeout_ms - elapsed))
+            return false;
+    }
+}
+
 bool NetSioPort::motor_asserted(void)
 {
     handle_netsio();
@@ -736,26 +966,16 @@ size_t NetSioPort::read(uint8_t *buffer, size_t length)
         // 850 us pre-ACK delay will be added by netsio.atdevice
     }
 
-    int result;
-    int rxbytes;
-    for (rxbytes=0; rxbytes<length;)
+    // whole frames come out of the ring in one or two copies
+    size_t rxbytes = 0;
+    while (rxbytes < length)
     {
-        result = read();
-        // Debug_printf("read: %d\n", result);
-        if (result < 0)
-        {
-            break;
-        }
-        else
-        {
-            buffer[rxbytes++] = (uint8_t)result;
-        }
-
-        if (rxbytes == length)
+        if (!wait_for_data(500))
         {
-            // done
+            Debug_println("NetSIO read() - TIMEOUT");
             break;
         }
+        rxbytes += rxbuffer_get(buffer + rxbytes, length - rxbytes);
     }
     return rxbytes;
 }
@@ -796,6 +1016,8 @@ ssize_t NetSioPort::write(uint8_t c)
     txbuf[0] = NETSIO_DATA_BYTE; // byte command
     txbuf[1] = c;                // value
     ssize_t result = write_sock(txbuf, sizeof(txbuf));
+    if (result > 0)
+        _tx_bytes++;
 
     return (result > 0) ? 1 : 0; // amount of data bytes written
 }
@@ -825,6 +1047,7 @@ ssize_t NetSioPort::write(const uint8_t *buffer, size_t size)
         else if (result < 0)
             break;
     }
+    _tx_bytes += txbytes;
     return txbytes;
 }
 
@@ -874,6 +1097,8 @@ ssize_t NetSioPort::send_sync_response(uint8_t response_type, uint8_t ack_byte,
 
     wait_for_credit(1);
     ssize_t result = write_sock(txbuf, sizeof(txbuf));
+    if (result > 0 && response_type != NETSIO_EMPTY_SYNC)
+        _tx_bytes++;
     return (result > 0 && response_type != NETSIO_EMPTY_SYNC) ? 1 : 0; // amount of data bytes written
 }
 
@@ -2,9 +2,37 @@
 #define NETSIO_H
 
 #include <sys/time.h>
+#include <string>
 #include "sioport.h"
 #include "fnDNS.h"
 
+// Receive ring size, must be a power of two
+#define NETSIO_RXBUF_SIZE 1024
+
+// Pings timed while connecting to the hub, the link timing is tuned from them
+#define NETSIO_LINK_PINGS 8
+// Same in benchmark mode, which also times a burst of pings kept in flight together
+#define NETSIO_BENCHMARK_PINGS 64
+#define NETSIO_BENCHMARK_BURST 16
+
+// Credit wait limits, the default is used until the link has been measured
+#define NETSIO_CREDIT_WAIT_MIN_MS 10
+#define NETSIO_CREDIT_WAIT_MS 500
+// Links with a round trip above this ask the hub for credit before running out
+#define NETSIO_SLOW_LINK_US 1000
+
+// Link measurement taken while connecting to the hub, times in us
+struct netsio_link_stats
+{
+    int samples = 0;    // answered pings
+    int lost = 0;       // pings without a response
+    int rtt_min = -1;
+    int rtt_avg = -1;
+    int rtt_max = -1;
+    int jitter = 0;     // mean difference between consecutive round trips
+    int burst_rate = 0; // ping round trips per second with a burst in flight, benchmark mode only
+};
+
 class NetSioPort : public SioPort
 {
 private:
@@ -19,7 +47,7 @@ private:
     bool _command_asserted;
     bool _motor_asserted;
 
-    uint8_t _rxbuf[1024];
+    uint8_t _rxbuf[NETSIO_RXBUF_SIZE];
     int _rxhead;
     int _rxtail;
     bool _rxfull;
@@ -35,6 +63,16 @@ private:
     uint64_t _alive_request; // when last ALIVE request was sent
     // flow control
     int _credit;
+    bool _credit_requested;  // credit status sent ahead, no update yet
+    int _credit_low;         // credit left when more is asked for ahead of need, -1 to wait until out
+    uint32_t _credit_wait_ms;
+
+    // link measurement and traffic counters
+    bool _benchmark;
+    netsio_link_stats _link;
+    uint64_t _connect_time;
+    uint64_t _rx_bytes;
+    uint64_t _tx_bytes;
 
 protected:
     void suspend(int ms=5000);
@@ -42,6 +80,9 @@ protected:
     bool keep_alive();
 
     int handle_netsio();
+    void measure_link();
+    int ping_burst(int count, int timeout_ms);
+    void tune_link();
     static timeval timeval_from_ms(const uint32_t millis);
 
     bool wait_sock_readable(uint32_t timeout_ms);
@@ -53,7 +94,12 @@ protected:
 
     bool rxbuffer_empty();
     bool rxbuffer_put(uint8_t b);
+    bool rxbuffer_put(const uint8_t *buf, size_t len);
     int rxbuffer_get();
+    size_t rxbuffer_get(uint8_t *buf, size_t len);
+    // Zero-copy access: contiguous received bytes at the tail, then how many of them were used
+    size_t rxbuffer_peek(const uint8_t **data);
+    void rxbuffer_consume(size_t len);
     int rxbuffer_available();
     void rxbuffer_flush();
 
@@ -63,11 +109,13 @@ public:
     virtual void begin(int baud) override;
     virtual void end() override;
     virtual bool poll(int ms) override;
+    virtual void idle_watch() override;
 
     virtual void set_baudrate(uint32_t baud) override;
     virtual uint32_t get_baudrate() override;
 
     virtual bool command_asserted() override;
+    virtual bool wait_command(bool asserted, uint32_t timeout_ms) override;
     virtual bool motor_asserted() override;
     virtual void set_proceed(bool level) override;
     virtual void set_interrupt(bool level) override;
@@ -92,6 +140,11 @@ public:
     void set_host(const char *host, int port);
     const char* get_host(int &port);
     int ping(int count=4, int interval_ms=1000, int timeout_ms=500, bool fast=true);
+    // Longer link measurement on every connect, with a report in the debug log
+    void set_benchmark(bool enabled) { _benchmark = enabled; }
+    const netsio_link_stats &get_link_stats() { return _link; }
+    // Link measurement, tuned timing and traffic since connecting, as a JSON object
+    std::string link_stats_json();
 
     void set_sync_ack_byte(int ack_byte);
     void set_sync_write_size(int write_size);
@@ -4,6 +4,21 @@
 
 #include "sioport.h"
 
+#include "fnSystem.h"
+
+// Ports that can't be told about changes of the line check it at a short interval
+bool SioPort::wait_command(bool asserted, uint32_t timeout_ms)
+{
+    uint64_t start = fnSystem.micros();
+    while (command_asserted() != asserted)
+    {
+        if (fnSystem.micros() - start >= (uint64_t)timeout_ms * 1000)
+            return false;
+        fnSystem.delay_microseconds(SIOPORT_COMMAND_POLL_US);
+    }
+    return true;
+}
+
 #endif // BUILD_ATARI
 
 #endif // !ESP_PLATFORM
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include <sys/types.h>
 
 # define SIOPORT_DEFAULT_BAUD   19200
+// Interval of the command line checks in the polling wait_command()
+# define SIOPORT_COMMAND_POLL_US 50
 
 /*
  * Abstraction of SIO port
@@ -17,11 +19,15 @@ public:
     virtual void begin(int baud) = 0;
     virtual void end() = 0;
     virtual bool poll(int ms) = 0;
+    // Lets the main loop sleep until the port has something, ports which have to be polled don't
+    virtual void idle_watch() {}
 
     virtual void set_baudrate(uint32_t baud) = 0;
     virtual uint32_t get_baudrate() = 0;
 
     virtual bool command_asserted() = 0;
+    // Waits for the command line to reach the given level, false on timeout
+    virtual bool wait_command(bool asserted, uint32_t timeout_ms);
     virtual bool motor_asserted() = 0;
     virtual void set_proceed(bool level) = 0;
     virtual void set_interrupt(bool level) = 0;
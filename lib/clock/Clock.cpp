@@ -2,12 +2,17 @@
 #include <ctime>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 
 #include "../../include/debug.h"
 #include "utils.h"
 
-// Cross-platform function to set environment variable
+// Cross-platform function to set environment variable. Leaves it alone if it's set already,
+// so tzset() only parses the zone's rules when a different zone is asked for
 static void set_timezone_env(const std::string& name, const std::string& value) {
+    const char *current = getenv(name.c_str());
+    if (current != nullptr && value == current)
+        return;
 #ifdef _WIN32
     _putenv_s(name.c_str(), value.c_str());
 #else
@@ -16,6 +21,57 @@ static void set_timezone_env(const std::string& name, const std::string& value)
     tzset();
 }
 
+// Local time for the last few zones asked for. BBS software polls the clock many times a
+// second, so localtime() only runs once a minute for each zone: the offset from UTC can't
+// change within a minute, so until the next one the seconds are counted on from there
+#define CLOCK_ZONES 2
+
+struct zone_time {
+    std::string tz;
+    std::time_t base = -1;
+    std::tm tm;
+};
+
+static zone_time _zones[CLOCK_ZONES];
+static int _next_zone = 0;
+static std::mutex _zones_mutex;
+
+static std::tm get_local_time(const std::string& posixTimeZone) {
+    std::time_t now = std::time(nullptr);
+    std::lock_guard<std::mutex> lock(_zones_mutex);
+
+    // strftime()'s %z takes the offset from TZ on some platforms, so it's kept set even when
+    // the time is not worked out again
+    set_timezone_env("TZ", posixTimeZone);
+
+    zone_time *zone = nullptr;
+    for (zone_time &z : _zones) {
+        if (z.base != -1 && z.tz == posixTimeZone)
+            zone = &z;
+    }
+
+    // An SNTP sync can step the clock back, so that has to start over too
+    if (zone != nullptr && now >= zone->base && now - zone->base < 60 - zone->tm.tm_sec) {
+        std::tm localTime = zone->tm;
+        localTime.tm_sec += now - zone->base;
+        return localTime;
+    }
+
+    if (zone == nullptr) {
+        zone = &_zones[_next_zone];
+        _next_zone = (_next_zone + 1) % CLOCK_ZONES;
+        zone->tz = posixTimeZone;
+    }
+
+#ifdef _WIN32
+    localtime_s(&zone->tm, &now);
+#else
+    localtime_r(&now, &zone->tm);
+#endif
+    zone->base = now;
+    return zone->tm;
+}
+
 // Helper function to format time into ISO 8601 string
 static std::string format_iso8601(const std::tm& time) {
     char buffer[30];
@@ -34,30 +90,26 @@ static std::string format_sos(const std::tm& time) {
 }
 
 std::string Clock::get_current_time_iso(const std::string& posixTimeZone) {
-    set_timezone_env("TZ", posixTimeZone);
-    std::time_t now = std::time(nullptr);
-    std::tm* localTime = std::localtime(&now);
+    std::tm localTime = get_local_time(posixTimeZone);
 
-    std::string isoString = format_iso8601(*localTime);
+    std::string isoString = format_iso8601(localTime);
     // Debug_printf("isoStringTZ time: %s, %s\r\n", isoString.c_str(), posixTimeZone.c_str());
 
     return isoString;
 }
 
 std::vector<uint8_t> Clock::get_current_time_simple(const std::string& posixTimeZone) {
-    set_timezone_env("TZ", posixTimeZone);
-    std::time_t now = std::time(nullptr);
-    std::tm* localTime = std::localtime(&now);
+    std::tm localTime = get_local_time(posixTimeZone);
 
     // A simple binary format in 7 bytes for clients to consume directly into bytes
     std::vector<uint8_t> simpleTime(7);
-    simpleTime[0] = static_cast<uint8_t>((localTime->tm_year)/100 + 19);
-    simpleTime[1] = static_cast<uint8_t>(localTime->tm_year % 100);
-    simpleTime[2] = static_cast<uint8_t>(localTime->tm_mon + 1);
-    simpleTime[3] = static_cast<uint8_t>(localTime->tm_mday);
-    simpleTime[4] = static_cast<uint8_t>(localTime->tm_hour);
-    simpleTime[5] = static_cast<uint8_t>(localTime->tm_min);
-    simpleTime[6] = static_cast<uint8_t>(localTime->tm_sec);
+    simpleTime[0] = static_cast<uint8_t>((localTime.tm_year)/100 + 19);
+    simpleTime[1] = static_cast<uint8_t>(localTime.tm_year % 100);
+    simpleTime[2] = static_cast<uint8_t>(localTime.tm_mon + 1);
+    simpleTime[3] = static_cast<uint8_t>(localTime.tm_mday);
+    simpleTime[4] = static_cast<uint8_t>(localTime.tm_hour);
+    simpleTime[5] = static_cast<uint8_t>(localTime.tm_min);
+    simpleTime[6] = static_cast<uint8_t>(localTime.tm_sec);
 
     // std::string dstring = util_hexdump(simpleTime.data(), 7);
     // Debug_printf("simple time: %s, %s\r\n", dstring.c_str(), posixTimeZone.c_str());
@@ -66,9 +118,7 @@ std::vector<uint8_t> Clock::get_current_time_simple(const std::string& posixTime
 }
 
 std::vector<uint8_t> Clock::get_current_time_prodos(const std::string& posixTimeZone) {
-    set_timezone_env("TZ", posixTimeZone);
-    std::time_t now = std::time(nullptr);
-    std::tm* localTime = std::localtime(&now);
+    std::tm localTime = get_local_time(posixTimeZone);
 
     // Format the time into ProDOS format
     std::vector<uint8_t> prodosTime(4); // ProDOS time uses 4 bytes, see https://prodos8.com/docs/techref/adding-routines-to-prodos/
@@ -82,10 +132,10 @@ std::vector<uint8_t> Clock::get_current_time_prodos(const std::string& posixTime
          TIME:  |    hour       | |    minute     |
                 +-+-+-+-+-+-+-+-+ +-+-+-+-+-+-+-+-+
     */
-    prodosTime[0] = static_cast<uint8_t>(localTime->tm_mday + ((localTime->tm_mon + 1) << 5));
-    prodosTime[1] = static_cast<uint8_t>(((localTime->tm_year % 100) << 1) + ((localTime->tm_mon + 1) >> 3));
-    prodosTime[2] = static_cast<uint8_t>(localTime->tm_min);
-    prodosTime[3] = static_cast<uint8_t>(localTime->tm_hour);
+    prodosTime[0] = static_cast<uint8_t>(localTime.tm_mday + ((localTime.tm_mon + 1) << 5));
+    prodosTime[1] = static_cast<uint8_t>(((localTime.tm_year % 100) << 1) + ((localTime.tm_mon + 1) >> 3));
+    prodosTime[2] = static_cast<uint8_t>(localTime.tm_min);
+    prodosTime[3] = static_cast<uint8_t>(localTime.tm_hour);
 
     // std::string dstring = util_hexdump(prodosTime.data(), 4);
     // Debug_printf("prodos time: %s, %s\r\n", dstring.c_str(), posixTimeZone.c_str());
@@ -94,18 +144,16 @@ std::vector<uint8_t> Clock::get_current_time_prodos(const std::string& posixTime
 }
 
 std::vector<uint8_t> Clock::get_current_time_apetime(const std::string& posixTimeZone) {
-    set_timezone_env("TZ", posixTimeZone);
-    std::time_t now = std::time(nullptr);
-    std::tm* localTime = std::localtime(&now);
+    std::tm localTime = get_local_time(posixTimeZone);
 
     // Format the time into ApeTime Atari format
     std::vector<uint8_t> apeTime(6);
-    apeTime[0] = static_cast<uint8_t>(localTime->tm_mday);
-    apeTime[1] = static_cast<uint8_t>(localTime->tm_mon + 1);    // change to 1 based month from 0
-    apeTime[2] = static_cast<uint8_t>(localTime->tm_year - 100); // add 1900 to the year to get YYYY, so 124 + 1900 = 2024, but 124 - 100 = 24 for just YY
-    apeTime[3] = static_cast<uint8_t>(localTime->tm_hour);
-    apeTime[4] = static_cast<uint8_t>(localTime->tm_min);
-    apeTime[5] = static_cast<uint8_t>(localTime->tm_sec);
+    apeTime[0] = static_cast<uint8_t>(localTime.tm_mday);
+    apeTime[1] = static_cast<uint8_t>(localTime.tm_mon + 1);    // change to 1 based month from 0
+    apeTime[2] = static_cast<uint8_t>(localTime.tm_year - 100); // add 1900 to the year to get YYYY, so 124 + 1900 = 2024, but 124 - 100 = 24 for just YY
+    apeTime[3] = static_cast<uint8_t>(localTime.tm_hour);
+    apeTime[4] = static_cast<uint8_t>(localTime.tm_min);
+    apeTime[5] = static_cast<uint8_t>(localTime.tm_sec);
 
     // std::string dstring = util_hexdump(apeTime.data(), 6);
     // Debug_printf("apetime: %s, %s\r\n", dstring.c_str(), posixTimeZone.c_str());
@@ -114,12 +162,10 @@ std::vector<uint8_t> Clock::get_current_time_apetime(const std::string& posixTim
 }
 
 std::string Clock::get_current_time_sos(const std::string& posixTimeZone) {
-    set_timezone_env("TZ", posixTimeZone);
-    std::time_t now = std::time(nullptr);
-    std::tm* localTime = std::localtime(&now);
+    std::tm localTime = get_local_time(posixTimeZone);
 
     // Format the time into Apple /// SOS set_time format YYYYMMDD0HHMMSS000
-    std::string sosString = format_sos(*localTime);
+    std::string sosString = format_sos(localTime);
     //Debug_printf("SOS set_time format time: %s\r\n", sosString.c_str());
 
     return sosString;
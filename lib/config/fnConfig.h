@@ -1,7 +1,12 @@
 #ifndef _FN_CONFIG_H
 #define _FN_CONFIG_H
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <map>
 
 #include "printer.h"
 #include "../encrypt/crypt.h"
@@ -50,6 +55,26 @@
 
 #define CONFIG_DEFAULT_SNTPSERVER "pool.ntp.org"
 
+// Seconds without bus activity before Wi-Fi drops to modem sleep, 0 never does.
+// The Lynx runs from batteries; everything else is mains powered
+#ifdef BUILD_LYNX
+#define CONFIG_DEFAULT_WIFI_POWERSAVE_IDLE 30
+#else
+#define CONFIG_DEFAULT_WIFI_POWERSAVE_IDLE 0
+#endif
+
+// save_later() writes the file this long after the last change, in ms
+#define CONFIG_SAVE_DELAY 2000
+#define CONFIG_SAVE_POLL 100
+#define CONFIG_SAVE_STACKSIZE 4096
+#define CONFIG_SAVE_PRIORITY 1
+
+// Host and mount slots not in the file yet, so they survive a power cut
+#define CONFIG_NVS_NAMESPACE "fnconfig"
+#define CONFIG_NVS_JOURNAL_KEY "hot"
+// CRC of the file last known to be the same on SD and FLASH
+#define CONFIG_NVS_SYNCED_KEY "synced"
+
 #define PHONEBOOK_CHAR_WIDTH 12
 
 
@@ -113,9 +138,16 @@ public:
     std::string get_network_udpstream_host() { return _network.udpstream_host; };
     int get_network_udpstream_port() { return _network.udpstream_port; };
     bool get_network_udpstream_servermode() { return _network.udpstream_servermode; };
+    int get_network_udpstream_gap() { return _network.udpstream_gap; };
     bool get_general_config_enabled() { return _general.config_enabled; };
     void store_general_devicename(const char *devicename);
     void store_general_hsioindex(int hsio_index);
+    // HSIO calibration; profile names the machine link, the index found for it is kept per profile
+    bool get_hsio_calibrate() { return _hsio.calibrate; };
+    void store_hsio_calibrate(bool calibrate);
+    int get_hsio_profile_index(const std::string &profile); // -1 if the profile hasn't been calibrated
+    void store_hsio_profile_index(const std::string &profile, int hsio_index);
+    void remove_hsio_profile(const std::string &profile);
     void store_general_timezone(const char *timezone);
     void store_general_rotation_sounds(bool rotation_sounds);
     void store_general_config_enabled(bool config_enabled);
@@ -134,6 +166,8 @@ public:
     void store_general_status_wait_enabled(bool status_wait_enabled);
     void store_general_encrypt_passphrase(bool encrypt_passphrase);
     bool get_general_encrypt_passphrase();
+    int get_general_image_cache_mb() { return _general.image_cache_mb; }
+    void store_general_image_cache_mb(int image_cache_mb);
 
     const char * get_network_sntpserver() { return _network.sntpserver; };
 
@@ -175,6 +209,7 @@ public:
     void reset_wifi() { _wifi.ssid.clear(); _wifi.passphrase.clear(); };
     void store_wifi_enabled(bool status);
     bool get_wifi_enabled() { return _wifi.enabled; };
+    int get_wifi_powersave_idle() { return _wifi.powersave_idle; };
 
     std::string get_wifi_stored_ssid(int index) { return _wifi_stored[index].ssid; }
     std::string get_wifi_stored_passphrase(int index) { return _wifi_stored[index].passphrase; }
@@ -270,6 +305,7 @@ public:
     bool get_boip_enabled() { return _boip.boip_enabled; } // used by Atari and CoCo
     std::string get_boip_host() { return _boip.host; }
     int get_boip_port() { return _boip.port; }
+    bool get_boip_benchmark() { return _boip.benchmark; } // Atari NetSIO link benchmark on connect
     void store_boip_enabled(bool enabled);
     void store_boip_host(const char *host);
     void store_boip_port(int port);
@@ -278,6 +314,8 @@ public:
     // RS232
     int get_rs232_baud() { return _rs232.baud; }
     void store_rs232_baud(int baud);
+    bool get_rs232_flowcontrol() { return _rs232.flowcontrol; } // RTS/CTS
+    void store_rs232_flowcontrol(bool flowcontrol);
 #endif
 
 #ifndef ESP_PLATFORM
@@ -302,17 +340,47 @@ public:
 
     void load();
     void save();
+    // save() once changes in quick succession are done, on a task of its own
+    // so the bus isn't held up. Host and mount slots are kept in NVS meanwhile
+    void save_later();
+    // save() now if save_later() is waiting
+    void flush();
 
     void mark_dirty() { _dirty = true; };
 
     fnConfig();
 
 private:
-    bool _dirty = false;
+    std::atomic<bool> _dirty{false};
+
+    std::mutex _save_mutex;
+    std::mutex _slots_mutex;            // host, mount and tape slots and HSIO profiles, changed by the bus while the save task reads them
+    std::atomic<uint64_t> _save_due{0}; // when save_later() is due, 0 for not waiting
+    std::atomic<bool> _save_task_started{false};
+    std::string _last_saved;            // file contents, an unchanged file isn't rewritten
+
+    std::mutex _journal_mutex;
+    std::string _journaled;             // what's in NVS, empty for nothing
+    std::atomic<uint32_t> _journal_gen{0};
+
+    void _start_save_task();
+    static void _save_task(void *param);
+    void _save_loop();
+    void _write_section_hosts(std::stringstream &ss);
+    void _write_section_mounts(std::stringstream &ss);
+    void _read_sections(std::stringstream &ss);
+    void _write_journal();
+    void _clear_journal(uint32_t gen);
+    bool _read_journal();
+#ifdef ESP_PLATFORM
+    uint32_t _read_synced_crc();
+    void _store_synced_crc(uint32_t crc);
+#endif
 
     int _read_line(std::stringstream &ss, std::string &line, char abort_if_starts_with = '\0');
 
     void _read_section_general(std::stringstream &ss);
+    void _read_section_hsio(std::stringstream &ss);
     void _read_section_wifi(std::stringstream &ss);
     void _read_section_wifi_stored(std::stringstream &ss, int index);
     void _read_section_bt(std::stringstream &ss);
@@ -350,6 +418,7 @@ private:
         SECTION_CPM,
         SECTION_DEVICE_ENABLE,
         SECTION_BOIP,
+        SECTION_HSIO,
 #ifndef ESP_PLATFORM
         SECTION_SERIAL,
         SECTION_BOS,
@@ -426,6 +495,7 @@ private:
         std::string ssid;
         std::string passphrase;
         bool enabled = true;
+        int powersave_idle = CONFIG_DEFAULT_WIFI_POWERSAVE_IDLE;
     };
 
     struct bt_info
@@ -441,6 +511,7 @@ private:
         char udpstream_host [64];
         int udpstream_port;
         bool udpstream_servermode;
+        int udpstream_gap = 0; // us of quiet on the bus that end a packet, 0 for the default
     };
 
     struct general_info
@@ -460,6 +531,7 @@ private:
         bool fnconfig_spifs = true;
         bool status_wait_enabled = true;
         bool encrypt_passphrase = false;
+        int image_cache_mb = 64; // SD space for cached network images
 #ifdef BUILD_ADAM
         bool printer_enabled = false; // Not by default.
 #else
@@ -473,6 +545,12 @@ private:
     };
 
     // "bus" over IP
+    struct hsio_info
+    {
+        bool calibrate = false;
+        std::map<std::string, int> profiles;
+    };
+
     struct boip_info
     {
         bool boip_enabled = false;
@@ -485,6 +563,7 @@ private:
         std::string host = "localhost";
 #endif
         int port = CONFIG_DEFAULT_BOIP_PORT;
+        bool benchmark = false;
     };
 
 #ifndef ESP_PLATFORM
@@ -513,6 +592,7 @@ private:
     struct rs232_info
     {
         int baud = 115200;
+        bool flowcontrol = false;
     };
 #endif
 
@@ -569,6 +649,7 @@ private:
     modem_info _modem;
     cassette_info _cassette;
     boip_info _boip;
+    hsio_info _hsio;
 #ifndef ESP_PLATFORM
     serial_info _serial;
     bos_info _bos;
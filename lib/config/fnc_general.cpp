@@ -72,6 +72,15 @@ void fnConfig::store_general_status_wait_enabled(bool status_wait_enabled)
     _dirty = true;
 }
 
+void fnConfig::store_general_image_cache_mb(int image_cache_mb)
+{
+    if (_general.image_cache_mb == image_cache_mb)
+        return;
+
+    _general.image_cache_mb = image_cache_mb;
+    _dirty = true;
+}
+
 void fnConfig::store_general_encrypt_passphrase(bool encrypt_passphrase)
 {
     if (_general.encrypt_passphrase == encrypt_passphrase)
@@ -117,6 +126,41 @@ void fnConfig::store_general_hsioindex(int hsio_index)
     _dirty = true;
 }
 
+void fnConfig::store_hsio_calibrate(bool calibrate)
+{
+    if (_hsio.calibrate == calibrate)
+        return;
+
+    _hsio.calibrate = calibrate;
+    _dirty = true;
+}
+
+int fnConfig::get_hsio_profile_index(const std::string &profile)
+{
+    auto p = _hsio.profiles.find(profile);
+    return p != _hsio.profiles.end() ? p->second : -1;
+}
+
+void fnConfig::store_hsio_profile_index(const std::string &profile, int hsio_index)
+{
+    std::lock_guard<std::mutex> lock(_slots_mutex);
+
+    auto p = _hsio.profiles.find(profile);
+    if (p != _hsio.profiles.end() && p->second == hsio_index)
+        return;
+
+    _hsio.profiles[profile] = hsio_index;
+    _dirty = true;
+}
+
+void fnConfig::remove_hsio_profile(const std::string &profile)
+{
+    std::lock_guard<std::mutex> lock(_slots_mutex);
+
+    if (_hsio.profiles.erase(profile) > 0)
+        _dirty = true;
+}
+
 void fnConfig::store_general_fnconfig_spifs(bool fnconfig_spifs)
 {
     if (_general.fnconfig_spifs == fnconfig_spifs)
@@ -241,6 +285,35 @@ void fnConfig::_read_section_general(std::stringstream &ss)
             {
                 _general.encrypt_passphrase = util_string_value_is_true(value);
             }
+            else if (strcasecmp(name.c_str(), "image_cache_mb") == 0)
+            {
+                _general.image_cache_mb = atoi(value.c_str());
+            }
+        }
+    }
+}
+
+void fnConfig::_read_section_hsio(std::stringstream &ss)
+{
+    std::string line;
+    // Read lines until one starts with '[' which indicates a new section
+    while (_read_line(ss, line, '[') >= 0)
+    {
+        std::string name;
+        std::string value;
+        if (_split_name_value(line, name, value))
+        {
+            if (strcasecmp(name.c_str(), "calibrate") == 0)
+            {
+                _hsio.calibrate = util_string_value_is_true(value);
+            }
+            else
+            {
+                // profile=index
+                int index = atoi(value.c_str());
+                if (index >= 0 && index <= 16)
+                    _hsio.profiles[name] = index;
+            }
         }
     }
 }
@@ -19,6 +19,8 @@ fnConfig::host_type_t fnConfig::get_host_type(uint8_t num)
 
 void fnConfig::store_host(uint8_t num, const char *hostname, host_type_t type)
 {
+    std::lock_guard<std::mutex> lock(_slots_mutex);
+
     if (num < MAX_HOST_SLOTS)
     {
         if (_host_slots[num].type == type && _host_slots[num].name.compare(hostname) == 0)
@@ -31,6 +33,8 @@ void fnConfig::store_host(uint8_t num, const char *hostname, host_type_t type)
 
 void fnConfig::clear_host(uint8_t num)
 {
+    std::lock_guard<std::mutex> lock(_slots_mutex);
+
     if (num < MAX_HOST_SLOTS)
     {
         if (_host_slots[num].type == HOSTTYPE_INVALID && _host_slots[num].name.length() == 0)
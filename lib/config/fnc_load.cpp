@@ -13,6 +13,10 @@
 
 #include "../../include/debug.h"
 
+#ifdef ESP_PLATFORM
+#include <esp_crc.h>
+#endif
+
 /* Load configuration data from FLASH. If no config file exists in FLASH,
    copy it from SD if a copy exists there.
 */
@@ -72,10 +76,12 @@ New behavior: copy from SD first if available, then read FLASH.
 */
     // See if we have a copy on SD load it to check if we should write to flash (only copy from SD if we don't have a local copy)
     FILE *fin = NULL; //declare fin
+    bool from_sd = false;
     if (fnSDFAT.running() && fnSDFAT.exists(CONFIG_FILENAME))
     {
         Debug_println("Load fnconfig.ini from SD");
         fin = fnSDFAT.file_open(CONFIG_FILENAME);
+        from_sd = true;
     }
     else
     {
@@ -135,6 +141,77 @@ New behavior: copy from SD first if available, then read FLASH.
     ss << inibuffer;
     free(inibuffer);
 
+    uint64_t parse_start = fnSystem.millis();
+    _read_sections(ss);
+    Debug_printf("fnConfig::load parsed in %lums\r\n", (unsigned long)(fnSystem.millis() - parse_start));
+
+    _dirty = false;
+    _last_saved = ss.str();
+
+    // Host and mount slots changed since the file was last written
+    if (_read_journal())
+        save_later();
+
+#ifdef ESP_PLATFORM
+    // The copy on FLASH is only read to see if it's behind the one on SD, NVS
+    // has the CRC of the last one known to be on both
+    if (from_sd && fnConfig::get_general_fnconfig_spifs() == true) // Only if flash is enabled
+    {
+        uint32_t crc = esp_crc32_le(0, (const uint8_t *)_last_saved.data(), _last_saved.size());
+        if (crc == _read_synced_crc() && true == fsFlash.exists(CONFIG_FILENAME))
+        {
+            Debug_println("FLASH Config Storage: Enabled, same as SD");
+        }
+        else if (true == fsFlash.exists(CONFIG_FILENAME))
+        {
+            Debug_println("FLASH Config Storage: Enabled");
+            FILE *fin = fsFlash.file_open(CONFIG_FILENAME);
+            char *inibuffer = (char *)malloc(CONFIG_FILEBUFFSIZE);
+            if (inibuffer == nullptr)
+            {
+                Debug_printf("Failed to allocate %d bytes to read config file from FLASH\r\n", CONFIG_FILEBUFFSIZE);
+                return;
+            }
+            int i = fread(inibuffer, 1, CONFIG_FILEBUFFSIZE - 1, fin);
+            fclose(fin);
+            Debug_printf("fnConfig::load read %d bytes from FLASH config file\r\n", i);
+            if (i < 0)
+            {
+                Debug_println("Failed to read data from FLASH configuration file");
+                free(inibuffer);
+                return;
+            }
+            inibuffer[i] = '\0';
+            if (_last_saved != inibuffer) {
+                Debug_println("Copying SD config file to FLASH");
+                if (0 == fnSystem.copy_file(&fnSDFAT, CONFIG_FILENAME, &fsFlash, CONFIG_FILENAME))
+                {
+                    Debug_println("Failed to copy config from SD");
+                }
+                else
+                    _store_synced_crc(crc);
+            }
+            else
+                _store_synced_crc(crc);
+            free(inibuffer);
+        }
+        else
+        {
+            Debug_println("Config file dosn't exist on FLASH");
+            Debug_println("Copying SD config file to FLASH");
+            if (0 == fnSystem.copy_file(&fnSDFAT, CONFIG_FILENAME, &fsFlash, CONFIG_FILENAME))
+            {
+                    Debug_println("Failed to copy config from SD");
+            } 
+            else
+                _store_synced_crc(crc);
+        }
+    }
+#endif // ESP_PLATFORM
+}
+
+void fnConfig::_read_sections(std::stringstream &ss)
+{
     std::string line;
     while (_read_line(ss, line) >= 0)
     {
@@ -187,6 +264,9 @@ New behavior: copy from SD first if available, then read FLASH.
         case SECTION_BOIP:
             _read_section_boip(ss);
             break;
+        case SECTION_HSIO:
+            _read_section_hsio(ss);
+            break;
 #ifndef ESP_PLATFORM
         case SECTION_SERIAL:
             _read_section_serial(ss);
@@ -205,55 +285,4 @@ New behavior: copy from SD first if available, then read FLASH.
             break;
         }
     }
-
-    _dirty = false;
-
-#ifdef ESP_PLATFORM
-    if (fnConfig::get_general_fnconfig_spifs() == true) // Only if flash is enabled
-    {
-        if (true == fsFlash.exists(CONFIG_FILENAME))
-        {
-            Debug_println("FLASH Config Storage: Enabled");
-            FILE *fin = fsFlash.file_open(CONFIG_FILENAME);
-            char *inibuffer = (char *)malloc(CONFIG_FILEBUFFSIZE);
-            if (inibuffer == nullptr)
-            {
-                Debug_printf("Failed to allocate %d bytes to read config file from FLASH\r\n", CONFIG_FILEBUFFSIZE);
-                return;
-            }
-            int i = fread(inibuffer, 1, CONFIG_FILEBUFFSIZE - 1, fin);
-            fclose(fin);
-            Debug_printf("fnConfig::load read %d bytes from FLASH config file\r\n", i);
-            if (i < 0)
-            {
-                Debug_println("Failed to read data from FLASH configuration file");
-                free(inibuffer);
-                return;
-            }
-            inibuffer[i] = '\0';
-            // Put the data in a stringstream
-            std::stringstream ss_ffs;
-            ss_ffs << inibuffer;
-            free(inibuffer);
-            if (ss.str() != ss_ffs.str()) {
-                Debug_println("Copying SD config file to FLASH");
-                if (0 == fnSystem.copy_file(&fnSDFAT, CONFIG_FILENAME, &fsFlash, CONFIG_FILENAME))
-                {
-                    Debug_println("Failed to copy config from SD");
-                }
-            }
-            ss_ffs.str("");
-            ss_ffs.clear(); // freeup some memory ;)
-        }
-        else
-        {
-            Debug_println("Config file dosn't exist on FLASH");
-            Debug_println("Copying SD config file to FLASH");
-            if (0 == fnSystem.copy_file(&fnSDFAT, CONFIG_FILENAME, &fsFlash, CONFIG_FILENAME))
-            {
-                    Debug_println("Failed to copy config from SD");
-            } 
-        }
-    }
-#endif // ESP_PLATFORM
 }
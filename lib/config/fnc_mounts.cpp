@@ -42,6 +42,8 @@ int fnConfig::get_mount_host_slot(uint8_t num, mount_type_t mounttype)
 
 void fnConfig::store_mount(uint8_t num, int hostslot, const char *path, mount_mode_t mode, mount_type_t mounttype)
 {
+    std::lock_guard<std::mutex> lock(_slots_mutex);
+
     // Handle disk slots
     if (mounttype == MOUNTTYPE_DISK && num < MAX_MOUNT_SLOTS)
     {
@@ -71,6 +73,8 @@ void fnConfig::store_mount(uint8_t num, int hostslot, const char *path, mount_mo
 
 void fnConfig::clear_mount(uint8_t num, mount_type_t mounttype)
 {
+    std::lock_guard<std::mutex> lock(_slots_mutex);
+
     // Handle disk slots
     if (mounttype == MOUNTTYPE_DISK && num < MAX_MOUNT_SLOTS)
     {
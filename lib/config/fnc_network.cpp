@@ -1,4 +1,5 @@
 #include "fnConfig.h"
+#include <cstdlib>
 #include <cstring>
 #include "compat_string.h"
 
@@ -31,6 +32,10 @@ void fnConfig::_read_section_network(std::stringstream &ss)
             {
                 strlcpy(_network.sntpserver, value.c_str(), sizeof(_network.sntpserver));
             }
+            else if (strcasecmp(name.c_str(), "udpstream_gap") == 0)
+            {
+                _network.udpstream_gap = atoi(value.c_str());
+            }
         }
     }
 }
@@ -6,6 +6,15 @@
 #include <cstring>
 #include <sstream>
 
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_crc.h>
+#include <nvs.h>
+#else
+#include <thread>
+#endif
+
 #include "../../include/debug.h"
 
 /* Save configuration data to FLASH. If SD is mounted, save a backup copy there.
@@ -20,11 +29,19 @@ void fnConfig::save()
     Debug_printf("fnConfig::save \"%s\"\r\n", _general.config_file_path.c_str());
 #endif
 
+    std::lock_guard<std::mutex> lock(_save_mutex);
+
+    // The text is a snapshot of the slots, a change after this is saved next time
+    std::unique_lock<std::mutex> slots_lock(_slots_mutex);
     if (!_dirty)
     {
         Debug_println("fnConfig::save not dirty, not saving");
         return;
     }
+    _dirty = false;
+
+    // What the journal holds is in the file after this
+    uint32_t gen = _journal_gen;
 
     // We're going to write a stringstream so that we have only one write to file at the end
     std::stringstream ss;
@@ -46,6 +63,7 @@ void fnConfig::save()
     ss << "status_wait_enabled=" << _general.status_wait_enabled << LINETERM;
     ss << "printer_enabled=" << _general.printer_enabled << LINETERM;
     ss << "encrypt_passphrase=" << _general.encrypt_passphrase << LINETERM;
+    ss << "image_cache_mb=" << _general.image_cache_mb << LINETERM;
 
     // ss << LINETERM;
 
@@ -54,6 +72,7 @@ void fnConfig::save()
     ss << "enabled=" << _wifi.enabled << LINETERM;
     ss << "SSID=" << _wifi.ssid << LINETERM;
     ss << "passphrase=" << _wifi.passphrase << LINETERM;
+    ss << "powersave_idle=" << _wifi.powersave_idle << LINETERM;
 
     // WIFI STORED
     for (i = 0; i < MAX_WIFI_STORED; i++)
@@ -77,29 +96,14 @@ void fnConfig::save()
     // NETWORK
     ss << LINETERM << "[Network]" LINETERM;
     ss << "sntpserver=" << _network.sntpserver << LINETERM;
+    if (_network.udpstream_gap > 0)
+        ss << "udpstream_gap=" << _network.udpstream_gap << LINETERM;
 
     // HOSTS
-    for (i = 0; i < MAX_HOST_SLOTS; i++)
-    {
-        if (_host_slots[i].type != HOSTTYPE_INVALID)
-        {
-            ss << LINETERM << "[Host" << (i + 1) << "]" LINETERM;
-            ss << "type=" << _host_type_names[_host_slots[i].type] << LINETERM;
-            ss << "name=" << _host_slots[i].name << LINETERM;
-        }
-    }
+    _write_section_hosts(ss);
 
     // MOUNTS
-    for (i = 0; i < MAX_MOUNT_SLOTS; i++)
-    {
-        if (_mount_slots[i].host_slot >= 0)
-        {
-            ss << LINETERM << "[Mount" << (i + 1) << "]" LINETERM;
-            ss << "hostslot=" << (_mount_slots[i].host_slot + 1) << LINETERM; // Write host slot as 1-based
-            ss << "path=" << _mount_slots[i].path << LINETERM;
-            ss << "mode=" << _mount_mode_names[_mount_slots[i].mode] << LINETERM;
-        }
-    }
+    _write_section_mounts(ss);
 
     // PRINTERS
     for (i = 0; i < MAX_PRINTER_SLOTS; i++)
@@ -177,10 +181,23 @@ void fnConfig::save()
     {
         ss << "port=" << LINETERM;
     }
+    if (_boip.benchmark)
+        ss << "benchmark=1" << LINETERM;
+
+    // HSIO calibration
+    if (_hsio.calibrate || !_hsio.profiles.empty())
+    {
+        ss << LINETERM << "[HSIO]" << LINETERM;
+        if (_hsio.calibrate)
+            ss << "calibrate=1" << LINETERM;
+        for (const auto &p : _hsio.profiles)
+            ss << p.first << "=" << p.second << LINETERM;
+    }
 
 #ifdef BUILD_RS232
     ss << LINETERM << "[RS232]" << LINETERM;
     ss << "baud=" << _rs232.baud << LINETERM;
+    ss << "flowcontrol=" << _rs232.flowcontrol << LINETERM;
 #endif
 
 #ifndef ESP_PLATFORM
@@ -208,6 +225,16 @@ void fnConfig::save()
 #endif
 #endif
 
+    slots_lock.unlock();
+
+    std::string result = ss.str();
+    if (result == _last_saved)
+    {
+        Debug_println("fnConfig::save unchanged, not rewriting");
+        _clear_journal(gen);
+        return;
+    }
+
 #ifdef ESP_PLATFORM
     // Write the results out
     FILE *fout = NULL;
@@ -217,6 +244,7 @@ void fnConfig::save()
         if ( !(fout = fsFlash.file_open(CONFIG_FILENAME, "w")))
         {
             Debug_println("Failed to Open config on FLASH");
+            _dirty = true;
             return;
         }
     }
@@ -226,6 +254,7 @@ void fnConfig::save()
         if ( !(fout = fnSDFAT.file_open(CONFIG_FILENAME, "w")))
         {
             Debug_println("Failed to Open config on SD");
+            _dirty = true;
             return;
         }
     }
@@ -236,27 +265,229 @@ void fnConfig::save()
     if (fout == nullptr)
     {
         Debug_printf("Failed to open config file\r\n");
+        _dirty = true;
         return;
     }
 #endif
-    std::string result = ss.str();
     size_t z = fwrite(result.c_str(), 1, result.length(), fout);
-    (void)z; // Get around unused var
     Debug_printf("fnConfig::save wrote %u bytes\r\n", (unsigned)z);
     fclose(fout);
     
-    _dirty = false;
+    if (z == result.length())
+    {
+        _last_saved = result;
+        _clear_journal(gen);
+    }
+    else
+    {
+        _last_saved.clear();
+        _dirty = true;
+    }
 
 #ifdef ESP_PLATFORM
     // Copy to SD if possible, only when wrote FLASH first 
+    uint32_t synced = 0;
     if (fnSDFAT.running() && fnConfig::get_general_fnconfig_spifs() == true)
     {
         Debug_println("Attempting config copy to SD");
         if (0 == fnSystem.copy_file(&fsFlash, CONFIG_FILENAME, &fnSDFAT, CONFIG_FILENAME))
-        {
             Debug_println("Failed to copy config to SD");
-            return;
+        else if (z == result.length())
+            synced = esp_crc32_le(0, (const uint8_t *)result.data(), result.length());
+    }
+    // Either both copies are this one, or load() has to compare them again
+    _store_synced_crc(synced);
+#endif
+}
+
+void fnConfig::_write_section_hosts(std::stringstream &ss)
+{
+    for (int i = 0; i < MAX_HOST_SLOTS; i++)
+    {
+        if (_host_slots[i].type != HOSTTYPE_INVALID)
+        {
+            ss << LINETERM << "[Host" << (i + 1) << "]" LINETERM;
+            ss << "type=" << _host_type_names[_host_slots[i].type] << LINETERM;
+            ss << "name=" << _host_slots[i].name << LINETERM;
         }
     }
+}
+
+void fnConfig::_write_section_mounts(std::stringstream &ss)
+{
+    for (int i = 0; i < MAX_MOUNT_SLOTS; i++)
+    {
+        if (_mount_slots[i].host_slot >= 0)
+        {
+            ss << LINETERM << "[Mount" << (i + 1) << "]" LINETERM;
+            ss << "hostslot=" << (_mount_slots[i].host_slot + 1) << LINETERM; // Write host slot as 1-based
+            ss << "path=" << _mount_slots[i].path << LINETERM;
+            ss << "mode=" << _mount_mode_names[_mount_slots[i].mode] << LINETERM;
+        }
+    }
+}
+
+/* Mounting, host slot changes and rotation save the config one after another,
+   so the file is written once they settle. Until then the slots are in NVS.
+*/
+void fnConfig::save_later()
+{
+    if (!_dirty)
+        return;
+
+    _write_journal();
+
+    _save_due = fnSystem.millis() + CONFIG_SAVE_DELAY;
+    if (!_save_task_started.exchange(true))
+        _start_save_task();
+}
+
+void fnConfig::flush()
+{
+    if (_save_due.exchange(0) != 0)
+        save();
+}
+
+void fnConfig::_save_loop()
+{
+    while (true)
+    {
+        fnSystem.delay(CONFIG_SAVE_POLL);
+
+        uint64_t due = _save_due;
+        if (due != 0 && fnSystem.millis() >= due)
+            flush();
+    }
+}
+
+void fnConfig::_save_task(void *param)
+{
+    ((fnConfig *)param)->_save_loop();
+}
+
+void fnConfig::_start_save_task()
+{
+#ifdef ESP_PLATFORM
+    if (xTaskCreatePinnedToCore(_save_task, "fnConfigSave", CONFIG_SAVE_STACKSIZE, this,
+                                CONFIG_SAVE_PRIORITY, nullptr, 0) != pdPASS)
+    {
+        Debug_println("fnConfig - no save task, saving now");
+        _save_task_started = false;
+        flush();
+    }
+#else
+    std::thread(_save_task, this).detach();
 #endif
 }
+
+#ifdef ESP_PLATFORM
+void fnConfig::_write_journal()
+{
+    std::stringstream ss;
+    {
+        std::lock_guard<std::mutex> slots_lock(_slots_mutex);
+        _write_section_hosts(ss);
+        _write_section_mounts(ss);
+    }
+    std::string journal = ss.str();
+
+    std::lock_guard<std::mutex> lock(_journal_mutex);
+    _journal_gen++;
+    if (journal == _journaled)
+        return;
+
+    nvs_handle_t h;
+    if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK)
+        return;
+    // An empty journal would read back as no journal, a newline keeps it
+    if (journal.empty())
+        journal = LINETERM;
+    if (nvs_set_blob(h, CONFIG_NVS_JOURNAL_KEY, journal.data(), journal.size()) == ESP_OK &&
+        nvs_commit(h) == ESP_OK)
+        _journaled = journal;
+    else
+        Debug_println("fnConfig - failed to journal slots to NVS");
+    nvs_close(h);
+}
+
+void fnConfig::_clear_journal(uint32_t gen)
+{
+    std::lock_guard<std::mutex> lock(_journal_mutex);
+    // Journaled again while saving, that's newer than the file
+    if (_journaled.empty() || gen != _journal_gen)
+        return;
+
+    nvs_handle_t h;
+    if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK)
+        return;
+    nvs_erase_key(h, CONFIG_NVS_JOURNAL_KEY);
+    nvs_commit(h);
+    nvs_close(h);
+    _journaled.clear();
+}
+
+bool fnConfig::_read_journal()
+{
+    nvs_handle_t h;
+    if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK)
+        return false;
+
+    size_t len = 0;
+    std::string journal;
+    if (nvs_get_blob(h, CONFIG_NVS_JOURNAL_KEY, nullptr, &len) == ESP_OK && len > 0)
+    {
+        journal.resize(len);
+        if (nvs_get_blob(h, CONFIG_NVS_JOURNAL_KEY, &journal[0], &len) != ESP_OK)
+            journal.clear();
+    }
+    nvs_close(h);
+
+    if (journal.empty())
+        return false;
+
+    Debug_printf("fnConfig - %u bytes of host and mount slots from NVS\r\n", (unsigned)journal.size());
+
+    // The journal has all of them, slots that aren't in it were cleared
+    for (int i = 0; i < MAX_HOST_SLOTS; i++)
+        clear_host(i);
+    for (int i = 0; i < MAX_MOUNT_SLOTS; i++)
+        clear_mount(i);
+
+    std::stringstream ss(journal);
+    _read_sections(ss);
+
+    std::lock_guard<std::mutex> lock(_journal_mutex);
+    _journaled = journal;
+    return true;
+}
+
+uint32_t fnConfig::_read_synced_crc()
+{
+    uint32_t crc = 0;
+    nvs_handle_t h;
+    if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK)
+    {
+        nvs_get_u32(h, CONFIG_NVS_SYNCED_KEY, &crc);
+        nvs_close(h);
+    }
+    return crc;
+}
+
+void fnConfig::_store_synced_crc(uint32_t crc)
+{
+    if (crc == _read_synced_crc())
+        return;
+
+    nvs_handle_t h;
+    if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK)
+        return;
+    nvs_set_u32(h, CONFIG_NVS_SYNCED_KEY, crc);
+    nvs_commit(h);
+    nvs_close(h);
+}
+#else
+// !ESP_PLATFORM
+void fnConfig::_write_journal() {}
+void fnConfig::_clear_journal(uint32_t gen) {}
+bool fnConfig::_read_journal() { return false; }
+#endif
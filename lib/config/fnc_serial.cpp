@@ -63,6 +63,10 @@ void fnConfig::_read_section_boip(std::stringstream &ss)
                     port = CONFIG_DEFAULT_BOIP_PORT;
                 _boip.port = port;
             }
+            else if (strcasecmp(name.c_str(), "benchmark") == 0)
+            {
+                _boip.benchmark = util_string_value_is_true(value);
+            }
         }
     }
 }
@@ -87,6 +91,10 @@ void fnConfig::_read_section_rs232(std::stringstream &ss)
                 }
                     _rs232.baud = baud;
             }
+            else if (strcasecmp(name.c_str(),"flowcontrol") == 0)
+            {
+                _rs232.flowcontrol = util_string_value_is_true(value);
+            }
         }
     }
 }
@@ -98,6 +106,14 @@ void fnConfig::store_rs232_baud(int _baud) {
     _rs232.baud = _baud;
     _dirty = true;
 }
+
+void fnConfig::store_rs232_flowcontrol(bool _flowcontrol) {
+    if (_flowcontrol == _rs232.flowcontrol)
+        return;
+
+    _rs232.flowcontrol = _flowcontrol;
+    _dirty = true;
+}
 #endif
 
 #ifndef ESP_PLATFORM
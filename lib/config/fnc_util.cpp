@@ -125,6 +125,10 @@ fnConfig::section_match fnConfig::_find_section_in_line(std::string &line, int &
             {
                 return SECTION_BOIP;
             }
+            else if (strncasecmp("HSIO", s1.c_str(), 4) == 0)
+            {
+                return SECTION_HSIO;
+            }
 #ifdef BUILD_RS232
             else if (strncasecmp("RS232",s1.c_str(),5) == 0)
             {
@@ -86,6 +86,11 @@ void fnConfig::_read_section_wifi(std::stringstream &ss)
                 else
                     _wifi.enabled = false;
             }
+            else if (strcasecmp(name.c_str(), "powersave_idle") == 0)
+            {
+                int idle = atoi(value.c_str());
+                _wifi.powersave_idle = idle < 0 ? 0 : idle;
+            }
         }
     }
 }
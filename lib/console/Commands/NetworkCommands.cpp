@@ -14,6 +14,7 @@
 #include "fnWiFi.h"
 
 #include "string_utils.h"
+#include "tnfslib.h"
 #include "../improv/improv.h"
 
 // static const char *wlstatus2string(wl_status_t status)
@@ -494,6 +495,26 @@ static int improv_c(int argc, char **argv)
     return EXIT_SUCCESS;
 }
 
+static int tnfsstat(int argc, char **argv)
+{
+    int count = 0;
+    tnfsMountInfo::for_each_mount([&count](tnfsMountInfo &m) {
+        if (m.session == TNFS_INVALID_SESSION)
+            return;
+        printf("%s:%hu%s session=0x%04hx %s srtt=%dms rttvar=%dms rto=%dms retransmits=%lu window=%hhu\r\n",
+               m.hostname, m.port, m.mountpath, m.session,
+               m.protocol == TNFS_PROTOCOL_TCP ? "tcp" : "udp",
+               m.get_srtt_ms(), m.get_rttvar_ms(), m.get_rto_ms(),
+               (unsigned long)m.retransmits, m.read_window);
+        count++;
+    });
+
+    if (count == 0)
+        printf("No TNFS servers mounted\r\n");
+
+    return EXIT_SUCCESS;
+}
+
 namespace ESP32Console::Commands
 {
     const ConsoleCommand getPingCommand()
@@ -520,4 +541,9 @@ namespace ESP32Console::Commands
     {
         return ConsoleCommand("improv", &improv_c, "Wifi config via IMPROV protocol");
     }
+
+    const ConsoleCommand getTNFSStatCommand()
+    {
+        return ConsoleCommand("tnfsstat", &tnfsstat, "Show round trip and retransmit timing for mounted TNFS servers");
+    }
 }
\ No newline at end of file
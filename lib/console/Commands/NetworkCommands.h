@@ -13,4 +13,6 @@ namespace ESP32Console::Commands
     const ConsoleCommand getConnectCommand();
 
     const ConsoleCommand getIMPROVCommand();
+
+    const ConsoleCommand getTNFSStatCommand();
 }
\ No newline at end of file
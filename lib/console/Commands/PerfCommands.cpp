@@ -0,0 +1,336 @@
+#include "PerfCommands.h"
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <esp_freertos_hooks.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+#ifdef __XTENSA__
+#include "xtensa_context.h"
+#endif
+
+#include "busStats.h"
+#include "fnArena.h"
+#include "tnfslib.h"
+#include "../device/fuji.h"
+
+#ifdef BUILD_IEC
+#include "meat_media.h"
+#endif
+
+#ifndef configRUN_TIME_COUNTER_TYPE
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#endif
+
+static int perf_tasks(int argc, char **argv)
+{
+    int ms = argc > 2 ? atoi(argv[2]) : PERF_TASKS_DEFAULT_MS;
+    if (ms <= 0)
+        ms = PERF_TASKS_DEFAULT_MS;
+
+    // Room for a few tasks starting while we wait
+    UBaseType_t room = uxTaskGetNumberOfTasks() + 8;
+    std::vector<TaskStatus_t> before(room), after(room);
+    configRUN_TIME_COUNTER_TYPE total;
+
+    UBaseType_t nbefore = uxTaskGetSystemState(before.data(), room, &total);
+    int64_t start = esp_timer_get_time();
+    vTaskDelay(pdMS_TO_TICKS(ms));
+    UBaseType_t nafter = uxTaskGetSystemState(after.data(), room, &total);
+    int64_t elapsed = esp_timer_get_time() - start;
+    if (nbefore == 0 || nafter == 0 || elapsed <= 0)
+    {
+        fprintf(stderr, "Task list unavailable\r\n");
+        return EXIT_FAILURE;
+    }
+    after.resize(nafter);
+
+    // Run time is counted in esp_timer microseconds, so a share is of one core
+    std::vector<std::pair<uint64_t, const TaskStatus_t *>> used;
+    for (const TaskStatus_t &t : after)
+    {
+        uint64_t run = t.ulRunTimeCounter;
+        for (UBaseType_t i = 0; i < nbefore; i++)
+        {
+            if (before[i].xHandle == t.xHandle)
+            {
+                run -= before[i].ulRunTimeCounter;
+                break;
+            }
+        }
+        used.emplace_back(run, &t);
+    }
+    std::sort(used.begin(), used.end(), [](const auto &l, const auto &r) { return l.first > r.first; });
+
+    printf("Over %d ms, %% of one core:\r\n", ms);
+    printf("Task             Core Prio   CPU%%  Free stack\r\n");
+    for (const auto &u : used)
+    {
+        const TaskStatus_t *t = u.second;
+        int core = -1;
+#if configTASKLIST_INCLUDE_COREID
+        core = t->xCoreID;
+#endif
+        char core_str[4] = "*";
+        if (core >= 0 && core < portNUM_PROCESSORS)
+            snprintf(core_str, sizeof(core_str), "%d", core);
+        printf("%-16s %4s %4u %6.2f %10lu\r\n", t->pcTaskName, core_str, (unsigned)t->uxCurrentPriority,
+               (double)u.first * 100.0 / elapsed, (unsigned long)t->usStackHighWaterMark);
+    }
+    return EXIT_SUCCESS;
+}
+
+static int perf_heap(int argc, char **argv)
+{
+    static const struct
+    {
+        const char *name;
+        uint32_t caps;
+    } heaps[] = {
+        {"internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT},
+        {"dma", MALLOC_CAP_DMA},
+        {"32bit", MALLOC_CAP_32BIT},
+        {"exec", MALLOC_CAP_EXEC},
+        {"psram", MALLOC_CAP_SPIRAM},
+    };
+
+    // Fragmentation is the share of free space not in the largest block, so a
+    // big request can fail with plenty free
+    printf("Heap         Free  Largest  Frag  Min free  Blocks\r\n");
+    for (const auto &h : heaps)
+    {
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, h.caps);
+        if (info.total_free_bytes + info.total_allocated_bytes == 0)
+            continue;
+        unsigned frag = info.total_free_bytes ? 100 - (unsigned)((uint64_t)info.largest_free_block * 100 / info.total_free_bytes) : 0;
+        printf("%-8s %8u %8u %4u%% %9u %7u\r\n", h.name, (unsigned)info.total_free_bytes,
+               (unsigned)info.largest_free_block, frag, (unsigned)info.minimum_free_bytes,
+               (unsigned)info.allocated_blocks);
+    }
+    return EXIT_SUCCESS;
+}
+
+static int perf_arenas(int argc, char **argv)
+{
+    fnArena.print();
+    return EXIT_SUCCESS;
+}
+
+static int perf_bus(int argc, char **argv)
+{
+    bus_stats.print();
+    if (argc > 2 && strcmp(argv[2], "clear") == 0)
+        bus_stats.clear();
+    return EXIT_SUCCESS;
+}
+
+static void print_rate(const char *name, uint32_t hits, uint32_t misses)
+{
+    uint32_t total = hits + misses;
+    printf("  %-18s %8lu hits %8lu misses %5.1f%%\r\n", name, (unsigned long)hits, (unsigned long)misses,
+           total ? hits * 100.0 / total : 0.0);
+}
+
+static int perf_cache(int argc, char **argv)
+{
+    bool clear = argc > 2 && strcmp(argv[2], "clear") == 0;
+
+    int mounts = 0;
+    tnfsMountInfo::for_each_mount([&](tnfsMountInfo &m) {
+        if (m.session == TNFS_INVALID_SESSION)
+            return;
+        printf("TNFS %s:%hu%s\r\n", m.hostname, m.port, m.mountpath);
+        print_rate("file read cache", m.cache_hits, m.cache_misses);
+        print_rate("directory cache", m.dircache_hits, m.dircache_misses);
+        if (clear)
+            m.cache_hits = m.cache_misses = m.dircache_hits = m.dircache_misses = 0;
+        mounts++;
+    });
+    if (mounts == 0)
+        printf("No TNFS servers mounted\r\n");
+
+#ifdef BUILD_ATARI
+    printf("Disk sector caches\r\n");
+    for (int i = 0; i < MAX_DISK_DEVICES; i++)
+    {
+        MediaType *media = theFuji.get_disks(i)->disk_dev.media();
+        if (media == nullptr)
+            continue;
+        char name[4];
+        snprintf(name, sizeof(name), "D%d:", i + 1);
+        print_rate(name, media->sector_cache_hits, media->sector_cache_misses);
+        if (clear)
+            media->sector_cache_hits = media->sector_cache_misses = 0;
+    }
+    printf("Directory blocks\r\n");
+    print_rate("block format", theFuji.dir_pages_hits, theFuji.dir_pages_misses);
+    if (clear)
+        theFuji.dir_pages_hits = theFuji.dir_pages_misses = 0;
+#endif
+
+#ifdef BUILD_IEC
+    ImageBroker::print();
+    if (clear)
+        ImageBroker::stats = {};
+#endif
+    return EXIT_SUCCESS;
+}
+
+// The sample buffer is written from the tick interrupt, which also runs while
+// the flash cache is off, so it has to be internal RAM
+static uint32_t *perf_samples = nullptr;
+static uint32_t perf_sample_max = 0;
+static volatile uint32_t perf_sample_count = 0;
+static volatile bool perf_sampling = false;
+static portMUX_TYPE perf_sample_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Runs from the tick interrupt on each core. On the way into the interrupt the
+// task's registers were saved on its stack and pxTopOfStack, the first member
+// of the TCB, was pointed at that frame, so its pc is where the task was.
+static void IRAM_ATTR perf_sample_tick()
+{
+#ifdef __XTENSA__
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    if (task == nullptr)
+        return;
+    const XtExcFrame *frame = *(const XtExcFrame **)task;
+
+    portENTER_CRITICAL_ISR(&perf_sample_mux);
+    if (perf_sampling)
+    {
+        if (perf_sample_count < perf_sample_max)
+            perf_samples[perf_sample_count++] = frame->pc;
+        else
+            perf_sampling = false;
+    }
+    portEXIT_CRITICAL_ISR(&perf_sample_mux);
+#endif
+}
+
+static void perf_sample_stop()
+{
+    // Once this returns no hook is touching the buffer
+    portENTER_CRITICAL(&perf_sample_mux);
+    perf_sampling = false;
+    portEXIT_CRITICAL(&perf_sample_mux);
+    esp_deregister_freertos_tick_hook(perf_sample_tick);
+}
+
+static int perf_sample(int argc, char **argv)
+{
+#ifndef __XTENSA__
+    fprintf(stderr, "PC sampling isn't supported on this chip\r\n");
+    return EXIT_FAILURE;
+#endif
+    const char *action = argc > 2 ? argv[2] : "";
+
+    if (strcmp(action, "start") == 0)
+    {
+        perf_sample_stop();
+        uint32_t count = argc > 3 ? strtoul(argv[3], nullptr, 10) : PERF_SAMPLE_DEFAULT;
+        if (count == 0 || count > PERF_SAMPLE_MAX)
+            count = PERF_SAMPLE_DEFAULT;
+        free(perf_samples);
+        perf_samples = (uint32_t *)heap_caps_malloc(count * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (perf_samples == nullptr)
+        {
+            fprintf(stderr, "Not enough internal memory for %lu samples\r\n", (unsigned long)count);
+            return EXIT_FAILURE;
+        }
+        perf_sample_max = count;
+        perf_sample_count = 0;
+        perf_sampling = true;
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+            esp_register_freertos_tick_hook_for_cpu(perf_sample_tick, core);
+        printf("Sampling at %d Hz per core into %lu samples\r\n", configTICK_RATE_HZ, (unsigned long)count);
+        return EXIT_SUCCESS;
+    }
+
+    if (strcmp(action, "stop") == 0)
+    {
+        perf_sample_stop();
+        printf("%lu samples\r\n", (unsigned long)perf_sample_count);
+        return EXIT_SUCCESS;
+    }
+
+    if (strcmp(action, "top") == 0)
+    {
+        int n = argc > 3 ? atoi(argv[3]) : 20;
+        uint32_t count = perf_sample_count;
+        std::map<uint32_t, uint32_t> hist;
+        for (uint32_t i = 0; i < count; i++)
+            hist[perf_samples[i]]++;
+        std::vector<std::pair<uint32_t, uint32_t>> top(hist.begin(), hist.end());
+        std::sort(top.begin(), top.end(), [](const auto &l, const auto &r) { return l.second > r.second; });
+        printf("%lu samples%s\r\n", (unsigned long)count, perf_sampling ? ", still sampling" : "");
+        for (int i = 0; i < n && i < (int)top.size(); i++)
+            printf("0x%08lx %6lu %5.1f%%\r\n", (unsigned long)top[i].first, (unsigned long)top[i].second,
+                   top[i].second * 100.0 / count);
+        return EXIT_SUCCESS;
+    }
+
+    if (strcmp(action, "dump") == 0)
+    {
+        FILE *out = stdout;
+        if (argc > 3)
+        {
+            out = fopen(argv[3], "w");
+            if (out == nullptr)
+            {
+                fprintf(stderr, "Can't open %s\r\n", argv[3]);
+                return EXIT_FAILURE;
+            }
+        }
+        uint32_t count = perf_sample_count;
+        for (uint32_t i = 0; i < count; i++)
+            fprintf(out, "0x%08lx\n", (unsigned long)perf_samples[i]);
+        if (out != stdout)
+        {
+            fclose(out);
+            printf("%lu samples written to %s\r\n", (unsigned long)count, argv[3]);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    printf("%s, %lu of %lu samples\r\n", perf_sampling ? "Sampling" : "Not sampling",
+           (unsigned long)perf_sample_count, (unsigned long)perf_sample_max);
+    return EXIT_SUCCESS;
+}
+
+static int perf(int argc, char **argv)
+{
+    const char *what = argc > 1 ? argv[1] : "";
+
+    if (strcmp(what, "tasks") == 0)
+        return perf_tasks(argc, argv);
+    if (strcmp(what, "heap") == 0)
+        return perf_heap(argc, argv);
+    if (strcmp(what, "arenas") == 0)
+        return perf_arenas(argc, argv);
+    if (strcmp(what, "bus") == 0)
+        return perf_bus(argc, argv);
+    if (strcmp(what, "cache") == 0)
+        return perf_cache(argc, argv);
+    if (strcmp(what, "sample") == 0)
+        return perf_sample(argc, argv);
+
+    fprintf(stderr, "perf tasks [ms] | heap | arenas | bus [clear] | cache [clear] | sample [start [count] | stop | top [n] | dump [file]]\r\n");
+    return EXIT_FAILURE;
+}
+
+namespace ESP32Console::Commands
+{
+    const ConsoleCommand getPerfCommand()
+    {
+        return ConsoleCommand("perf", &perf, "Shows task CPU use, heap fragmentation, arena usage, bus and cache counters, and samples PCs",
+                              "tasks|heap|arenas|bus|cache|sample ...");
+    }
+}
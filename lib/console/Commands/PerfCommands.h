@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../ConsoleCommand.h"
+
+// perf tasks [ms]           - CPU use per task over the interval (default 1000 ms)
+// perf heap                 - free space, largest block and fragmentation per capability
+// perf bus [clear]          - per-device bus command counts and service times
+// perf cache [clear]        - TNFS read/directory, sector and directory block cache hit rates
+// perf sample start [count] - record the interrupted PC on every tick, on each core
+// perf sample stop|top [n]|dump [file]
+//
+// Sample dumps are one address per line, ready for addr2line against firmware.elf
+
+#define PERF_SAMPLE_DEFAULT 2048
+#define PERF_SAMPLE_MAX 16384
+#define PERF_TASKS_DEFAULT_MS 1000
+
+namespace ESP32Console::Commands
+{
+    const ConsoleCommand getPerfCommand();
+}
@@ -25,6 +25,25 @@
 
 #include "Esp.h"
 
+#include <esp_timer.h>
+#include <mbedtls/aes.h>
+
+#include "hash.h"
+#include "crypt.h"
+
+#if defined(BUILD_ATARI) && defined(SIO_TRACE)
+#include "sio/sioTrace.h"
+#endif
+
+#ifdef BUILD_ATARI
+#include "bus.h"
+#include "udpstream.h"
+#endif
+
+#ifdef BUILD_IEC
+#include "meat_media.h"
+#endif
+
 EspClass ESP;
 
 static std::string mac2String(uint64_t mac)
@@ -164,6 +183,135 @@ static int taskinfo(int argc, char **argv)
     return EXIT_SUCCESS;
 }
 
+#if defined(BUILD_ATARI) && defined(SIO_TRACE)
+static int siotrace(int argc, char **argv)
+{
+    sio_trace.print();
+    if (argc > 1 && strcmp(argv[1], "clear") == 0)
+        sio_trace.clear();
+    return EXIT_SUCCESS;
+}
+#endif
+
+#ifdef BUILD_ATARI
+static int udpstream(int argc, char **argv)
+{
+    sioUDPStream *udp = SIO.getUDPStream();
+    if (udp == nullptr)
+    {
+        fprintf(stderr, "No UDP stream device\r\n");
+        return 1;
+    }
+    printf("UDP stream %s, packet gap %lu us\r\n", udp->udpstreamActive ? "active" : "inactive",
+           (unsigned long)udp->udpstream_gap_us);
+    udp->stats.print();
+    if (argc > 1 && strcmp(argv[1], "clear") == 0)
+        udp->stats = udpstream_stats();
+    return EXIT_SUCCESS;
+}
+#endif
+
+#ifdef BUILD_IEC
+static int imagecache(int argc, char **argv)
+{
+    ImageBroker::print();
+    if (argc > 1 && strcmp(argv[1], "clear") == 0)
+        ImageBroker::stats = {};
+    return EXIT_SUCCESS;
+}
+#endif
+
+#define CRYPTOBENCH_BUFFER_SIZE 4096
+#define CRYPTOBENCH_DEFAULT_KB 1024
+
+static void cryptobench_report(const char *name, size_t bytes, int64_t us)
+{
+    double mbps = us > 0 ? (double)bytes / us : 0; // bytes per us == MB/s
+    printf("%-12s %7.2f MB/s\r\n", name, mbps);
+}
+
+static void cryptobench_hash(const char *name, Hash::Algorithm algorithm, uint8_t *buf, size_t total)
+{
+    Hash h;
+    h.select(algorithm);
+    int64_t start = esp_timer_get_time();
+    for (size_t done = 0; done < total; done += CRYPTOBENCH_BUFFER_SIZE)
+        h.add_data(buf, CRYPTOBENCH_BUFFER_SIZE);
+    h.compute(algorithm, true);
+    cryptobench_report(name, total, esp_timer_get_time() - start);
+}
+
+static void cryptobench_aes(const char *name, unsigned int keybits, uint8_t *buf, size_t total)
+{
+    mbedtls_aes_context ctx;
+    uint8_t key[32] = {0};
+    uint8_t iv[16] = {0};
+
+    mbedtls_aes_init(&ctx);
+    mbedtls_aes_setkey_enc(&ctx, key, keybits);
+    int64_t start = esp_timer_get_time();
+    for (size_t done = 0; done < total; done += CRYPTOBENCH_BUFFER_SIZE)
+        mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, CRYPTOBENCH_BUFFER_SIZE, iv, buf, buf);
+    cryptobench_report(name, total, esp_timer_get_time() - start);
+    mbedtls_aes_free(&ctx);
+}
+
+static int cryptobench(int argc, char **argv)
+{
+    size_t kb = CRYPTOBENCH_DEFAULT_KB;
+    if (argc > 1)
+    {
+        kb = atoi(argv[1]);
+        if (kb < 4)
+        {
+            fprintf(stderr, "Size must be at least 4 KB\r\n");
+            return 1;
+        }
+    }
+    size_t total = kb * 1024 / CRYPTOBENCH_BUFFER_SIZE * CRYPTOBENCH_BUFFER_SIZE;
+
+    uint8_t *buf = (uint8_t *)malloc(CRYPTOBENCH_BUFFER_SIZE);
+    if (buf == nullptr)
+    {
+        fprintf(stderr, "Out of memory\r\n");
+        return 1;
+    }
+    for (size_t i = 0; i < CRYPTOBENCH_BUFFER_SIZE; i++)
+        buf[i] = i * 7;
+
+#ifdef CONFIG_MBEDTLS_HARDWARE_SHA
+    const char *sha_engine = "hardware";
+#else
+    const char *sha_engine = "software";
+#endif
+#ifdef CONFIG_MBEDTLS_HARDWARE_AES
+    const char *aes_engine = "hardware";
+#else
+    const char *aes_engine = "software";
+#endif
+    printf("%u KB per algorithm, SHA %s, AES %s\r\n", (unsigned)(total / 1024), sha_engine, aes_engine);
+
+    cryptobench_hash("MD5", Hash::Algorithm::MD5, buf, total);
+    cryptobench_hash("SHA1", Hash::Algorithm::SHA1, buf, total);
+    cryptobench_hash("SHA256", Hash::Algorithm::SHA256, buf, total);
+    cryptobench_hash("SHA512", Hash::Algorithm::SHA512, buf, total);
+    cryptobench_aes("AES128-CBC", 128, buf, total);
+    cryptobench_aes("AES256-CBC", 256, buf, total);
+
+    // The config passphrase cipher works on short strings it copies to the
+    // stack, so time it on passphrase-sized printable text
+    std::string text(64, 'A');
+    Crypto c;
+    c.setkey("cryptobench");
+    int64_t start = esp_timer_get_time();
+    for (size_t done = 0; done < total; done += text.length())
+        text = c.crypt(text);
+    cryptobench_report("passphrase", total, esp_timer_get_time() - start);
+
+    free(buf);
+    return EXIT_SUCCESS;
+}
+
 static int date(int argc, char **argv)
 {
     bool set_time = false;
@@ -282,4 +430,30 @@ namespace ESP32Console::Commands
     {
         return ConsoleCommand("date", &date, "Shows and modify the system time");
     }
+
+    const ConsoleCommand getCryptoBenchCommand()
+    {
+        return ConsoleCommand("cryptobench", &cryptobench, "Measures hash and cipher throughput in MB/s", "[KB]");
+    }
+
+#if defined(BUILD_ATARI) && defined(SIO_TRACE)
+    const ConsoleCommand getSioTraceCommand()
+    {
+        return ConsoleCommand("siotrace", &siotrace, "Shows SIO command timings, 'siotrace clear' also starts over", "[clear]");
+    }
+#endif
+
+#ifdef BUILD_ATARI
+    const ConsoleCommand getUDPStreamCommand()
+    {
+        return ConsoleCommand("udpstream", &udpstream, "Shows UDP stream latency histograms, 'udpstream clear' resets them", "[clear]");
+    }
+#endif
+
+#ifdef BUILD_IEC
+    const ConsoleCommand getImageCacheCommand()
+    {
+        return ConsoleCommand("imagecache", &imagecache, "Shows the open disk images, * are in use, 'imagecache clear' resets the counters", "[clear]");
+    }
+#endif
 }
\ No newline at end of file
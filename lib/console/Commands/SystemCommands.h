@@ -13,4 +13,18 @@ namespace ESP32Console::Commands
     const ConsoleCommand getTaskInfoCommand();
 
     const ConsoleCommand getDateCommand();
+
+    const ConsoleCommand getCryptoBenchCommand();
+
+#if defined(BUILD_ATARI) && defined(SIO_TRACE)
+    const ConsoleCommand getSioTraceCommand();
+#endif
+
+#ifdef BUILD_ATARI
+    const ConsoleCommand getUDPStreamCommand();
+#endif
+
+#ifdef BUILD_IEC
+    const ConsoleCommand getImageCacheCommand();
+#endif
 };
\ No newline at end of file
@@ -12,7 +12,12 @@
 #include <iostream>
 #include <sstream>
 #include <sys/fcntl.h>
+#include <esp_heap_caps.h>
 
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "fnSystem.h"
 #include "string_utils.h"
 
 #include "../Console.h"
@@ -20,6 +25,102 @@
 
 char *canonicalize_file_name(const char *path);
 
+// Receives into one block while the writer task puts earlier ones on the
+// card, so the sender isn't held up by SD write latency
+class XferWriter
+{
+private:
+    FILE *_file = nullptr;
+    uint8_t *_blocks[XFER_BLOCK_COUNT] = {};
+    size_t _lengths[XFER_BLOCK_COUNT] = {};
+    QueueHandle_t _free = nullptr;
+    QueueHandle_t _full = nullptr;
+    SemaphoreHandle_t _done = nullptr;
+    bool _error = false;
+
+    static void _task(void *param)
+    {
+        XferWriter *w = (XferWriter *)param;
+        int i;
+        while (xQueueReceive(w->_full, &i, portMAX_DELAY) == pdTRUE && i >= 0)
+        {
+            if (!w->_error && fwrite(w->_blocks[i], 1, w->_lengths[i], w->_file) != w->_lengths[i])
+                w->_error = true;
+            xQueueSend(w->_free, &i, portMAX_DELAY);
+        }
+        xSemaphoreGive(w->_done);
+        vTaskDelete(nullptr);
+    }
+
+public:
+    ~XferWriter()
+    {
+        for (int i = 0; i < XFER_BLOCK_COUNT; i++)
+            free(_blocks[i]);
+        if (_free != nullptr)
+            vQueueDelete(_free);
+        if (_full != nullptr)
+            vQueueDelete(_full);
+        if (_done != nullptr)
+            vSemaphoreDelete(_done);
+    }
+
+    bool begin(FILE *file)
+    {
+        _file = file;
+        _free = xQueueCreate(XFER_BLOCK_COUNT, sizeof(int));
+        _full = xQueueCreate(XFER_BLOCK_COUNT + 1, sizeof(int));
+        _done = xSemaphoreCreateBinary();
+        if (_free == nullptr || _full == nullptr || _done == nullptr)
+            return false;
+
+        for (int i = 0; i < XFER_BLOCK_COUNT; i++)
+        {
+            if (fnSystem.get_psram_size() > 0)
+                _blocks[i] = (uint8_t *)heap_caps_malloc(XFER_BLOCK_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+            if (_blocks[i] == nullptr)
+                _blocks[i] = (uint8_t *)malloc(XFER_BLOCK_SIZE);
+            if (_blocks[i] == nullptr)
+                return false;
+            xQueueSend(_free, &i, 0);
+        }
+
+        return xTaskCreatePinnedToCore(_task, "xfer_writer", XFER_WRITER_STACKSIZE, this, XFER_WRITER_PRIORITY, nullptr, 0) == pdPASS;
+    }
+
+    // A free block to receive into, waiting for the writer if they're all queued
+    int get(uint8_t **data)
+    {
+        int i;
+        xQueueReceive(_free, &i, portMAX_DELAY);
+        *data = _blocks[i];
+        return i;
+    }
+
+    void put(int i, size_t len)
+    {
+        _lengths[i] = len;
+        xQueueSend(_full, &i, portMAX_DELAY);
+    }
+
+    // Waits until every block is written; false if any write failed
+    bool finish()
+    {
+        int end = -1;
+        xQueueSend(_full, &end, portMAX_DELAY);
+        xSemaphoreTake(_done, portMAX_DELAY);
+        return !_error;
+    }
+};
+
+// Switches the console UART to another speed once everything already printed has gone out
+static void set_console_baud(uint32_t baud)
+{
+    fflush(stdout);
+    uart_wait_tx_done(CONSOLE_UART, MAX_READ_WAIT_TICKS);
+    uart_set_baudrate(CONSOLE_UART, baud);
+}
+
 std::string read_until(char delimiter)
 {
     uint8_t byte = 0;
@@ -46,63 +147,92 @@ std::string read_until(char delimiter)
 
 int rx(int argc, char **argv)
 {
-    // rx {filename}
-    if (argc != 2)
+    // rx {filename} [baud]
+    if (argc != 2 && argc != 3)
     {
-        fprintf(stderr, "rx {filename}\r\n");
+        fprintf(stderr, "rx {filename} [baud]\r\n");
         return EXIT_SUCCESS;
     }
 
     char filename[PATH_MAX];
     ESP32Console::console_realpath(argv[1], filename);
 
+    uint32_t console_baud = 0;
+    uart_get_baudrate(CONSOLE_UART, &console_baud);
+    uint32_t xfer_baud = argc == 3 ? atoi(argv[2]) : 0;
+    if (xfer_baud > 0)
+    {
+        // Confirm at the old speed, everything after is at the new one
+        fprintf(stdout, "0 BAUD %lu\r\n", (unsigned long)xfer_baud);
+        set_console_baud(xfer_baud);
+    }
+
     // get file size and checksum
     std::string s = read_until(' ');
     int size = atoi(s.c_str());
     std::string src_checksum = read_until('\n');
 
-    FILE *file = fopen(filename, "w");
-    if (file == nullptr)
+    FILE *file = fopen(filename, "wb");
+    XferWriter writer;
+    if (file == nullptr || !writer.begin(file))
     {
+        if (file != nullptr)
+            fclose(file);
         fprintf(stdout, "2 Error: Can't open file!\r\n");
+        if (xfer_baud > 0)
+            set_console_baud(console_baud);
         return 2;
     }
 
-    // Receive File
+    // Receive File a block at a time, the writer task empties blocks as they fill
     int count = 0;
-    uint8_t byte = 0;
     int dest_checksum = 0;
     while (count < size)
     {
-        size_t size = 0;
-        uart_get_buffered_data_len(CONSOLE_UART, &size);
-        if (size > 0)
+        uint8_t *block;
+        int i = writer.get(&block);
+        size_t want = size - count < XFER_BLOCK_SIZE ? size - count : XFER_BLOCK_SIZE;
+        int result = uart_read_bytes(CONSOLE_UART, block, want, MAX_READ_WAIT_TICKS);
+        if (result < 1)
         {
-            int result = uart_read_bytes(CONSOLE_UART, &byte, 1, MAX_READ_WAIT_TICKS);
-            if (result < 1)
-                break;
-
-            fprintf(file, "%c", byte);
-
-            // Calculate checksum
-            dest_checksum = esp_rom_crc32_le(dest_checksum, &byte, 1);
-            count++;
+            writer.put(i, 0);
+            break;
         }
+
+        // Calculate checksum
+        dest_checksum = esp_rom_crc32_le(dest_checksum, block, result);
+        writer.put(i, result);
+        count += result;
     }
+    bool written = writer.finish();
     fclose(file);
 
-    // Check checksum
-    std::ostringstream ss;
-    ss << std::hex << dest_checksum;
-    std::string dest_checksum_str = ss.str();
-    if ( !mstr::compare(dest_checksum_str, src_checksum) )
+    int status = 0;
+    if (!written)
     {
-        fprintf(stdout, "2 Error: Checksum mismatch!\r\n");
-        return 2;
+        fprintf(stdout, "2 Error: Write failed!\r\n");
+        status = 2;
+    }
+    else
+    {
+        // Check checksum
+        std::ostringstream ss;
+        ss << std::hex << dest_checksum;
+        std::string dest_checksum_str = ss.str();
+        if ( !mstr::compare(dest_checksum_str, src_checksum) )
+        {
+            fprintf(stdout, "2 Error: Checksum mismatch!\r\n");
+            status = 2;
+        }
+        else
+        {
+            fprintf(stdout, "0 OK\r\n");
+        }
     }
 
-    fprintf(stdout, "0 OK\r\n");
-    return EXIT_SUCCESS;
+    if (xfer_baud > 0)
+        set_console_baud(console_baud);
+    return status;
 }
 
 int tx(int argc, char **argv)
@@ -146,13 +276,12 @@ int tx(int argc, char **argv)
     // Send size and checksum
     fprintf(stdout, "%d %8x\r\n", size, src_checksum);
 
-    // Send file 256 bytes at a time
+    // Send file 256 bytes at a time, straight to the UART so stdout's
+    // line ending conversion doesn't touch the data
+    fflush(stdout);
     while ((bytesRead = fread(buffer, 1, 256, file)) > 0)
     {
-        // print buffer bytes
-        for (int i = 0; i < bytesRead; i++) {
-            fprintf(stdout, "%c", buffer[i]);
-        }
+        uart_write_bytes(CONSOLE_UART, buffer, bytesRead);
     }
     fclose(file);
 
@@ -176,7 +305,7 @@ namespace ESP32Console::Commands
 {
     const ConsoleCommand getRXCommand()
     {
-        return ConsoleCommand("rx", &rx, "Receive file");
+        return ConsoleCommand("rx", &rx, "Receive file, optionally at another baud rate");
     }
 
     const ConsoleCommand getTXCommand()
@@ -2,7 +2,9 @@
 
 // Meatloaf Serial Transfer Protocol
 //
-// rx "filename" - receive file.  "filename" can include a path to where the file is to be stored.
+// rx "filename" [baud] - receive file.  "filename" can include a path to where the file is to be stored.
+//    With a baud rate the receiver answers '0 BAUD {baud}' and the transfer and its
+//    status run at that speed, then the console goes back to its own.
 // tx "filename" [offset] [length] - transmit file with option to request start from offset and byte range.
 // status [rx|tx] - status of last recieve/transmit
 // mount "filename" /dev/{device id} - mount the file on specified device
@@ -27,6 +29,13 @@
 
 #include "../ConsoleCommand.h"
 
+// rx receives into these while a writer task saves earlier blocks
+#define XFER_BLOCK_SIZE 4096
+#define XFER_BLOCK_COUNT 4
+
+#define XFER_WRITER_STACKSIZE 4096
+#define XFER_WRITER_PRIORITY 5
+
 namespace ESP32Console::Commands
 {
     const ConsoleCommand getRXCommand();
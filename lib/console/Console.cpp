@@ -13,6 +13,7 @@
 #include "Commands/VFSCommands.h"
 #include "Commands/GPIOCommands.h"
 #include "Commands/XFERCommands.h"
+#include "Commands/PerfCommands.h"
 #include "driver/uart.h"
 #include "esp_vfs_dev.h"
 #include "linenoise/linenoise.h"
@@ -46,6 +47,17 @@ namespace ESP32Console
         registerCommand(getMemInfoCommand());
         registerCommand(getTaskInfoCommand());
         registerCommand(getDateCommand());
+        registerCommand(getCryptoBenchCommand());
+        registerCommand(getPerfCommand());
+#if defined(BUILD_ATARI) && defined(SIO_TRACE)
+        registerCommand(getSioTraceCommand());
+#endif
+#ifdef BUILD_ATARI
+        registerCommand(getUDPStreamCommand());
+#endif
+#ifdef BUILD_IEC
+        registerCommand(getImageCacheCommand());
+#endif
     }
 
     void ESP32Console::Console::registerNetworkCommands()
@@ -55,6 +67,7 @@ namespace ESP32Console
         registerCommand(getScanCommand());
         registerCommand(getConnectCommand());
         registerCommand(getIMPROVCommand());
+        registerCommand(getTNFSStatCommand());
     }
 
     void Console::registerVFSCommands()
@@ -168,7 +181,7 @@ namespace ESP32Console
         }
 
         /* Install UART driver for interrupt-driven reads and writes */
-        ESP_ERROR_CHECK(uart_driver_install(channel, 256, 0, 0, NULL, 0));
+        ESP_ERROR_CHECK(uart_driver_install(channel, CONSOLE_RX_BUFFER_SIZE, 0, 0, NULL, 0));
 
         /* Tell VFS to use UART driver */
         esp_vfs_dev_uart_use_driver(channel);
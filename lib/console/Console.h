@@ -12,6 +12,8 @@
 
 #define CONSOLE_UART        0
 #define MAX_READ_WAIT_TICKS 200
+// Room for a file transfer to keep arriving while rx waits on the SD card
+#define CONSOLE_RX_BUFFER_SIZE 2048
 
 namespace ESP32Console
 {
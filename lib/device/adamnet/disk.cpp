@@ -5,11 +5,96 @@
 #include <memory.h>
 #include <string.h>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
 #include "../../include/debug.h"
 
 #include "media.h"
 #include "utils.h"
 
+#define MEDIA_TASK_STACKSIZE 3072
+#define MEDIA_TASK_PRIORITY 5
+#define MEDIA_QUEUE_LEN 4
+// Longest a written block waits in a media's write run before it goes to the file
+#define WRITEBACK_DELAY pdMS_TO_TICKS(250)
+// Drives and the boot disk
+#define MAX_ADAM_DISKS 8
+
+// One task reads ahead and writes back for all the drives. Media move between
+// drives when the disks are rotated, so a single mutex guards every drive's
+// media and the file handle the task shares with the bus
+static SemaphoreHandle_t media_mutex = nullptr;
+static QueueHandle_t media_queue = nullptr;
+// Filled by the constructors, which run before anything else in here
+static adamDisk *all_disks[MAX_ADAM_DISKS];
+
+struct media_request
+{
+    adamDisk *disk;
+    // Block to read ahead, or INVALID_SECTOR_VALUE after a write
+    uint32_t block;
+};
+
+void adamDisk::media_task(void *param)
+{
+    media_request req;
+    bool dirty = false;
+    TickType_t flush_at = 0;
+
+    while (true)
+    {
+        TickType_t wait = portMAX_DELAY;
+        if (dirty)
+        {
+            TickType_t now = xTaskGetTickCount();
+            wait = (int32_t)(flush_at - now) > 0 ? flush_at - now : 0;
+        }
+
+        if (xQueueReceive(media_queue, &req, wait) == pdTRUE)
+        {
+            if (req.block == INVALID_SECTOR_VALUE)
+            {
+                // The oldest unwritten block sets the deadline
+                if (!dirty)
+                    flush_at = xTaskGetTickCount() + WRITEBACK_DELAY;
+                dirty = true;
+                continue;
+            }
+
+            xSemaphoreTake(media_mutex, portMAX_DELAY);
+            if (req.disk->_media != nullptr)
+                req.disk->_media->prefetch(req.block);
+            xSemaphoreGive(media_mutex);
+            continue;
+        }
+
+        xSemaphoreTake(media_mutex, portMAX_DELAY);
+        for (adamDisk *disk : all_disks)
+        {
+            if (disk != nullptr && disk->_media != nullptr)
+                disk->_media->flush();
+        }
+        xSemaphoreGive(media_mutex);
+        dirty = false;
+    }
+}
+
+// Started with the first mount rather than in the constructor, which runs
+// before the scheduler does
+static void media_task_start()
+{
+    if (media_mutex != nullptr)
+        return;
+
+    media_mutex = xSemaphoreCreateMutex();
+    media_queue = xQueueCreate(MEDIA_QUEUE_LEN, sizeof(media_request));
+    xTaskCreatePinnedToCore(adamDisk::media_task, "adam_media", MEDIA_TASK_STACKSIZE, nullptr,
+                            MEDIA_TASK_PRIORITY, nullptr, 0);
+}
+
 adamDisk::adamDisk()
 {
     device_active = false;
@@ -17,15 +102,32 @@ adamDisk::adamDisk()
     status_response[1] = 0x00;
     status_response[2] = 0x04; // 1024 bytes
     status_response[3] = 0x01; // Block device
+
+    for (adamDisk *&disk : all_disks)
+    {
+        if (disk == nullptr)
+        {
+            disk = this;
+            break;
+        }
+    }
 }
 
 // Destructor
 adamDisk::~adamDisk()
 {
+    for (adamDisk *&disk : all_disks)
+    {
+        if (disk == this)
+            disk = nullptr;
+    }
+
     if (_media != nullptr)
     {
+        xSemaphoreTake(media_mutex, portMAX_DELAY);
         delete _media;
         _media = nullptr;
+        xSemaphoreGive(media_mutex);
     }
 }
 
@@ -46,6 +148,9 @@ mediatype_t adamDisk::mount(FILE *f, const char *filename, uint32_t disksize, me
 
     Debug_printf("disk MOUNT %s\n", filename);
 
+    media_task_start();
+    xSemaphoreTake(media_mutex, portMAX_DELAY);
+
     // Destroy any existing MediaType
     if (_media != nullptr)
     {
@@ -83,6 +188,7 @@ mediatype_t adamDisk::mount(FILE *f, const char *filename, uint32_t disksize, me
         break;
     }
 
+    xSemaphoreGive(media_mutex);
     return mt;
 }
 
@@ -92,11 +198,31 @@ void adamDisk::unmount()
 
     if (_media != nullptr)
     {
+        xSemaphoreTake(media_mutex, portMAX_DELAY);
         _media->unmount();
+        xSemaphoreGive(media_mutex);
         device_active = false;
     }
 }
 
+void adamDisk::set_media(MediaType *__media)
+{
+    media_task_start();
+    xSemaphoreTake(media_mutex, portMAX_DELAY);
+    _media = __media;
+    xSemaphoreGive(media_mutex);
+}
+
+void adamDisk::prefetch_next()
+{
+    if (_media == nullptr || blockNum == INVALID_SECTOR_VALUE)
+        return;
+
+    // Nothing waits on it; if the task is behind this one is simply skipped
+    media_request req = {this, (uint32_t)blockNum + 1};
+    xQueueSend(media_queue, &req, 0);
+}
+
 bool adamDisk::write_blank(FILE *fileh, uint32_t numBlocks)
 {
     uint8_t buf[256];
@@ -121,6 +247,7 @@ void adamDisk::adamnet_control_clr()
     if (t < 1500)
     {
         adamnet_response_send();
+        prefetch_next();
     }
 }
 
@@ -129,7 +256,11 @@ void adamDisk::adamnet_control_receive()
     if (_media == nullptr)
         return;
 
-    if (_media->read(blockNum, nullptr))
+    xSemaphoreTake(media_mutex, portMAX_DELAY);
+    bool err = _media->read(blockNum, nullptr);
+    xSemaphoreGive(media_mutex);
+
+    if (err)
         adamnet_response_nack();
     else
         adamnet_response_ack();
@@ -151,7 +282,9 @@ void adamDisk::adamnet_control_send_block_num()
 
     if (blockNum == 0xFACE)
     {
+        xSemaphoreTake(media_mutex, portMAX_DELAY);
         _media->format(NULL);
+        xSemaphoreGive(media_mutex);
     }
 
     AdamNet.start_time=esp_timer_get_time();
@@ -171,7 +304,14 @@ void adamDisk::adamnet_control_send_block_data()
     adamnet_response_ack();
     Debug_printf("Block Data Write\n");
 
+    xSemaphoreTake(media_mutex, portMAX_DELAY);
     _media->write(blockNum, false);
+    xSemaphoreGive(media_mutex);
+
+    // The task writes the run out once it's WRITEBACK_DELAY old. Unlike a
+    // prefetch this can't be dropped, but the queue is never full for long
+    media_request req = {this, INVALID_SECTOR_VALUE};
+    xQueueSend(media_queue, &req, portMAX_DELAY);
 
     blockNum = 0xFFFFFFFF;
     _media->_media_last_block = 0xFFFFFFFE;
@@ -18,6 +18,9 @@ private:
 
     unsigned long blockNum=INVALID_SECTOR_VALUE;
 
+    // Reads the block after the one just sent while the ADAM is busy with it
+    void prefetch_next();
+
     void adamnet_control_clr();
     void adamnet_control_receive();
     void adamnet_control_send();
@@ -36,7 +39,9 @@ public:
     bool write_blank(FILE *f, uint32_t numBlocks);
     virtual void reset() override;
     MediaType *get_media() { return  _media; }
-    void set_media(MediaType *__media) { _media = __media; }
+    // Reads ahead and writes back for every drive, started with the first mount
+    static void media_task(void *param);
+    void set_media(MediaType *__media);
 
     mediatype_t mediatype() { return _media == nullptr ? MEDIATYPE_UNKNOWN : _media->_mediatype; };
 
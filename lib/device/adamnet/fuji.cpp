@@ -12,6 +12,8 @@
 #include "fnConfig.h"
 #include "fnWiFi.h"
 #include "fsFlash.h"
+#include "fujiAppKeys.h"
+#include "fujiCopyTask.h"
 #include "led.h"
 
 #include "utils.h"
@@ -19,8 +21,6 @@
 
 #define ADDITIONAL_DETAILS_BYTES 12
 
-#define COPY_SIZE 532
-
 adamFuji theFuji;         // global fuji device object
 adamNetwork *theNetwork;  // global network device object (temporary)
 adamNetwork *theNetwork2; // another network device
@@ -342,6 +342,12 @@ void adamFuji::adamnet_set_boot_config()
     }
 }
 
+// Let the rest of the bus task run between chunks of a copy
+static void _copy_yield()
+{
+    taskYIELD();
+}
+
 // Do SIO copy
 void adamFuji::adamnet_copy_file()
 {
@@ -350,12 +356,8 @@ void adamFuji::adamnet_copy_file()
     string sourcePath;
     string destPath;
     uint8_t ck;
-    FILE *sourceFile;
-    FILE *destFile;
-    char *dataBuf;
     unsigned char sourceSlot;
     unsigned char destSlot;
-    unsigned long total = 0;
 
     Debug_printf("ADAMNET COPY FILE\n");
 
@@ -370,12 +372,16 @@ void adamFuji::adamnet_copy_file()
     fnUartBUS.write(0x9f); // ACK.
     fnUartBUS.flush();
 
-    dataBuf = (char *)malloc(COPY_SIZE);
-
     copySpec = string((char *)csBuf);
 
     Debug_printf("copySpec: %s\n", copySpec.c_str());
 
+    if (sourceSlot >= MAX_HOSTS || destSlot >= MAX_HOSTS || copySpec.find_first_of("|") == string::npos)
+    {
+        Debug_printf("COPY REJECTED\n");
+        return;
+    }
+
     // Chop up copyspec.
     sourcePath = copySpec.substr(0, copySpec.find_first_of("|"));
     destPath = copySpec.substr(copySpec.find_first_of("|") + 1);
@@ -388,31 +394,10 @@ void adamFuji::adamnet_copy_file()
         destPath += sourceFilename;
     }
 
-    // Mount hosts, if needed.
-    _fnHosts[sourceSlot].mount();
-    _fnHosts[destSlot].mount();
-
-    // Open files...
-    sourceFile = _fnHosts[sourceSlot].file_open(sourcePath.c_str(), (char *)sourcePath.c_str(), sourcePath.size() + 1, "r");
-    destFile = _fnHosts[destSlot].file_open(destPath.c_str(), (char *)destPath.c_str(), destPath.size() + 1, "w");
-
-    size_t count = 0;
-
-    while (!(ferror(sourceFile) || feof(sourceFile)))
-    {
-        count = fread(dataBuf, 1, COPY_SIZE, sourceFile);
-        fwrite(dataBuf, 1, count, destFile);
-        total += count;
-        Debug_printf("Copied: %lu bytes %u %u\n", total, feof(sourceFile), ferror(sourceFile));
-        taskYIELD();
-    }
-
-    // copyEnd:
-    fclose(sourceFile);
-    fclose(destFile);
-    free(dataBuf);
+    fujiCopyTask copy(&_fnHosts[sourceSlot], sourcePath, &_fnHosts[destSlot], destPath);
+    bool ok = copy.run(_copy_yield);
 
-    Debug_printf("COPY DONE\n");
+    Debug_printf("COPY %s\n", ok ? "DONE" : "FAILED");
 }
 
 // Set boot mode
@@ -427,16 +412,8 @@ void adamFuji::adamnet_set_boot_mode()
     adamnet_response_ack();
 }
 
-char *_generate_appkey_filename(appkey *info)
-{
-    static char filenamebuf[30];
-
-    snprintf(filenamebuf, sizeof(filenamebuf), "/FujiNet/%04hx%02hhx%02hhx.key", info->creator, info->app, info->key);
-    return filenamebuf;
-}
-
 /*
- Write an "app key" to SD (ONLY!) storage.
+ Write an "app key" to SD (ONLY!) storage. It reaches the card a little later, see fujiAppKeys
 */
 void adamFuji::adamnet_write_app_key()
 {
@@ -444,29 +421,16 @@ void adamFuji::adamnet_write_app_key()
     uint8_t app = adamnet_recv();
     uint8_t key = adamnet_recv();
     uint8_t data[64];
-    char appkeyfilename[30];
-    FILE *fp;
-
-    snprintf(appkeyfilename, sizeof(appkeyfilename), "/FujiNet/%04hx%02hhx%02hhx.key", creator, app, key);
 
     adamnet_recv_buffer(data, 64);
     adamnet_recv(); // CK
 
-    Debug_printf("Fuji Cmd: WRITE APPKEY %s\n", appkeyfilename);
+    Debug_printf("Fuji Cmd: WRITE APPKEY %s\n", fujiAppKeys::filename(creator, app, key).c_str());
 
     AdamNet.start_time = esp_timer_get_time();
     adamnet_response_ack();
 
-    fp = fnSDFAT.file_open(appkeyfilename, "w");
-
-    if (fp == nullptr)
-    {
-        Debug_printf("Could not open.\n");
-        return;
-    }
-
-    fwrite(data, sizeof(uint8_t), sizeof(data), fp);
-    fclose(fp);
+    fnAppKeys.write(creator, app, key, data, sizeof(data));
 }
 
 /*
@@ -482,24 +446,17 @@ void adamFuji::adamnet_read_app_key()
     AdamNet.start_time = esp_timer_get_time();
     adamnet_response_ack();
 
-    char appkeyfilename[30];
-    FILE *fp;
-
-    snprintf(appkeyfilename, sizeof(appkeyfilename), "/FujiNet/%04hx%02hhx%02hhx.key", creator, app, key);
-
-    fp = fnSDFAT.file_open(appkeyfilename, "r");
-
     memset(response, 0, sizeof(response));
 
-    if (fp == nullptr)
+    int count = fnAppKeys.read(creator, app, key, response, 64);
+    if (count < 0)
     {
         Debug_printf("Could not open key.");
         response_len = 1; // if no file found set return length to 1 or adam hangs waiting for response
         return;
     }
 
-    response_len = fread(response, sizeof(char), 64, fp);
-    fclose(fp);
+    response_len = count;
 }
 
 // DEBUG TAPE
@@ -986,7 +943,7 @@ void adamFuji::adamnet_write_host_slots()
         _fnHosts[i].set_hostname(hostSlots[i]);
     }
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 }
 
 // Store host path prefix
@@ -1068,7 +1025,7 @@ void adamFuji::adamnet_write_device_slots()
 
     // Save the data to disk
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 }
 
 // Temporary(?) function while we move from old config storage to new
@@ -12,6 +12,7 @@
 #include "../../include/debug.h"
 
 #include "utils.h"
+#include "fnDNS.h"
 
 #include "status_error_codes.h"
 #include "TCP.h"
@@ -1011,6 +1012,9 @@ void adamNetwork::create_url_parser()
 {
     std::string url = deviceSpec.substr(deviceSpec.find(":") + 1);
     urlParser = PeoplesUrlParser::parseURL(url);
+
+    if (urlParser->isValidUrl())
+        dns_prefetch(urlParser->host);
 }
 
 void adamNetwork::parse_and_instantiate_protocol(string d)
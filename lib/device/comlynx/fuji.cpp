@@ -12,14 +12,14 @@
 #include "fnConfig.h"
 #include "fnWiFi.h"
 #include "fsFlash.h"
+#include "fujiAppKeys.h"
+#include "fujiCopyTask.h"
 
 #include "utils.h"
 #include "string_utils.h"
 
 #define ADDITIONAL_DETAILS_BYTES 12
 
-#define COPY_SIZE 532
-
 lynxFuji theFuji;        // global fuji device object
 lynxNetwork *theNetwork; // global network device object (temporary)
 lynxPrinter *thePrinter; // global printer
@@ -330,6 +330,12 @@ void lynxFuji::comlynx_set_boot_config()
     comlynx_response_ack();
 }
 
+// Let the rest of the bus task run between chunks of a copy
+static void _copy_yield()
+{
+    taskYIELD();
+}
+
 // Do SIO copy
 void lynxFuji::comlynx_copy_file()
 {
@@ -338,12 +344,8 @@ void lynxFuji::comlynx_copy_file()
     string sourcePath;
     string destPath;
     uint8_t ck;
-    FILE *sourceFile;
-    FILE *destFile;
-    char *dataBuf;
     unsigned char sourceSlot;
     unsigned char destSlot;
-    unsigned long total=0;
 
     Debug_printf("COMLYNX COPY FILE\n");
 
@@ -354,12 +356,16 @@ void lynxFuji::comlynx_copy_file()
     comlynx_recv_buffer(csBuf,sizeof(csBuf));
     ck = comlynx_recv();
 
-    dataBuf = (char *)malloc(COPY_SIZE);
-
     copySpec = string((char *)csBuf);
 
     Debug_printf("copySpec: %s\n", copySpec.c_str());
 
+    if (sourceSlot >= MAX_HOSTS || destSlot >= MAX_HOSTS || copySpec.find_first_of("|") == string::npos)
+    {
+        comlynx_response_nack();
+        return;
+    }
+
     // Chop up copyspec.
     sourcePath = copySpec.substr(0, copySpec.find_first_of("|"));
     destPath = copySpec.substr(copySpec.find_first_of("|") + 1);
@@ -372,33 +378,15 @@ void lynxFuji::comlynx_copy_file()
         destPath += sourceFilename;
     }
 
-    // Mount hosts, if needed.
-    _fnHosts[sourceSlot].mount();
-    _fnHosts[destSlot].mount();
-
-    // Open files...
-    sourceFile = _fnHosts[sourceSlot].file_open(sourcePath.c_str(), (char *)sourcePath.c_str(), sourcePath.size() + 1, "r");
-    destFile = _fnHosts[destSlot].file_open(destPath.c_str(), (char *)destPath.c_str(), destPath.size() + 1, "w");
-
-    size_t count = 0;
+    fujiCopyTask copy(&_fnHosts[sourceSlot], sourcePath, &_fnHosts[destSlot], destPath);
+    bool ok = copy.run(_copy_yield);
 
-    while (!(ferror(sourceFile) || feof(sourceFile)))
-    {
-        count = fread(dataBuf, 1, COPY_SIZE, sourceFile);
-        fwrite(dataBuf, 1, count, destFile);
-        total += count;
-        Debug_printf("Copied: %lu bytes %u %u\n",total,feof(sourceFile),ferror(sourceFile));
-        taskYIELD();
-    }
+    Debug_printf("COPY %s\n", ok ? "DONE" : "FAILED");
 
-    // copyEnd:
-    fclose(sourceFile);
-    fclose(destFile);
-    free(dataBuf);
-
-    Debug_printf("COPY DONE\n");
-
-    comlynx_response_ack();
+    if (ok)
+        comlynx_response_ack();
+    else
+        comlynx_response_nack();
 }
 
 // Mount all
@@ -469,16 +457,8 @@ void lynxFuji::comlynx_set_boot_mode()
     comlynx_response_ack();
 }
 
-char *_generate_appkey_filename(appkey *info)
-{
-    static char filenamebuf[30];
-
-    snprintf(filenamebuf, sizeof(filenamebuf), "/FujiNet/%04hx%02hhx%02hhx.key", info->creator, info->app, info->key);
-    return filenamebuf;
-}
-
 /*
- Write an "app key" to SD (ONLY!) storage.
+ Write an "app key" to SD (ONLY!) storage. It reaches the card a little later, see fujiAppKeys
 */
 void lynxFuji::comlynx_write_app_key()
 {
@@ -486,26 +466,13 @@ void lynxFuji::comlynx_write_app_key()
     uint8_t app = comlynx_recv();
     uint8_t key = comlynx_recv();
     uint8_t data[64];
-    char appkeyfilename[30];
-    FILE *fp;
-
-    snprintf(appkeyfilename, sizeof(appkeyfilename), "/FujiNet/%04hx%02hhx%02hhx.key", creator, app, key);
 
     comlynx_recv_buffer(data, 64);
     comlynx_recv(); // CK
 
-    Debug_printf("Fuji Cmd: WRITE APPKEY %s\n", appkeyfilename);
+    Debug_printf("Fuji Cmd: WRITE APPKEY %s\n", fujiAppKeys::filename(creator, app, key).c_str());
 
-    fp = fnSDFAT.file_open(appkeyfilename, "w");
-
-    if (fp == nullptr)
-    {
-        Debug_printf("Could not open.\n");
-        return;
-    }
-
-    fwrite(data, sizeof(uint8_t), sizeof(data), fp);
-    fclose(fp);
+    fnAppKeys.write(creator, app, key, data, sizeof(data));
 
     comlynx_response_ack();
 }
@@ -521,24 +488,17 @@ void lynxFuji::comlynx_read_app_key()
 
     comlynx_recv(); // CK
 
-    char appkeyfilename[30];
-    FILE *fp;
-
-    snprintf(appkeyfilename, sizeof(appkeyfilename), "/FujiNet/%04hx%02hhx%02hhx.key", creator, app, key);
-
-    fp = fnSDFAT.file_open(appkeyfilename, "r");
-
     memset(response, 0, sizeof(response));
 
-    if (fp == nullptr)
+    int count = fnAppKeys.read(creator, app, key, response, 64);
+    if (count < 0)
     {
         Debug_printf("Could not open key.");
         response_len = 1; // if no file found set return length to 1 or lynx hangs waiting for response
         return;
     }
 
-    response_len = fread(response, sizeof(char), 64, fp);
-    fclose(fp);
+    response_len = count;
 
     comlynx_response_ack();
 }
@@ -933,7 +893,7 @@ void lynxFuji::comlynx_write_host_slots()
         _fnHosts[i].set_hostname(hostSlots[i]);
     }
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 
     comlynx_response_ack();
 }
@@ -1013,7 +973,7 @@ void lynxFuji::comlynx_write_device_slots()
 
     // Save the data to disk
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 
     comlynx_response_ack();
 }
@@ -12,6 +12,8 @@
 #include "../../include/debug.h"
 
 #include "utils.h"
+#include "fnArena.h"
+#include "fnDNS.h"
 
 #include "status_error_codes.h"
 #include "TCP.h"
@@ -46,6 +48,9 @@ lynxNetwork::lynxNetwork()
     specialBuffer->clear();
 
     json.setLineEnding("\x00");
+
+    memset(&rxStats, 0, sizeof(rxStats));
+    memset(&txStats, 0, sizeof(txStats));
 }
 
 /**
@@ -64,6 +69,8 @@ lynxNetwork::~lynxNetwork()
     transmitBuffer = nullptr;
     specialBuffer = nullptr;
 
+    stream_end();
+
     if (protocol != nullptr)
         delete protocol;
 
@@ -164,6 +171,8 @@ void lynxNetwork::close()
 
     statusByte.byte = 0x00;
 
+    stream_end();
+
     if (protocolParser != nullptr)
     {
         delete protocolParser;
@@ -213,6 +222,34 @@ bool lynxNetwork::read_channel(unsigned short num_bytes)
  */
 void lynxNetwork::write(uint16_t num_bytes)
 {
+    if (streamMode & STREAM_MODE_ENABLE)
+    {
+        int64_t started = ComLynx.start_time;
+
+        if (num_bytes > STREAM_FRAME_SIZE)
+        {
+            Debug_printf("stream write of %u bytes too large\n", num_bytes);
+            for (uint32_t i = 0; i <= num_bytes; i++)
+                comlynx_recv(); // Drop the frame and its CK
+            comlynx_response_nack();
+            return;
+        }
+
+        comlynx_recv_buffer(streamBuffer, num_bytes);
+        comlynx_recv(); // CK
+
+        if (!(streamMode & STREAM_MODE_NO_ACK))
+        {
+            ComLynx.start_time = esp_timer_get_time();
+            comlynx_response_ack();
+        }
+
+        transmitBuffer->append((char *)streamBuffer, num_bytes);
+        err = comlynx_write_channel(num_bytes);
+        stream_record(txStats, num_bytes, started);
+        return;
+    }
+
     Debug_printf("!!! WRITE\n");
     memset(response, 0, sizeof(response));
 
@@ -495,6 +532,87 @@ void lynxNetwork::channel_mode()
     comlynx_response_ack();
 }
 
+void lynxNetwork::stream_mode()
+{
+    uint8_t m = comlynx_recv();
+    comlynx_recv(); // CK
+
+    if (m & STREAM_MODE_ENABLE)
+    {
+        if (streamBuffer == nullptr)
+            streamBuffer = (uint8_t *)fnArena.malloc(ARENA_NETWORK, STREAM_FRAME_SIZE);
+        if (streamBuffer == nullptr)
+        {
+            ComLynx.start_time = esp_timer_get_time();
+            comlynx_response_nack();
+            return;
+        }
+        streamMode = m;
+        streamLen = 0;
+        memset(&rxStats, 0, sizeof(rxStats));
+        memset(&txStats, 0, sizeof(txStats));
+    }
+    else
+        stream_end();
+
+    Debug_printf("lynxNetwork::stream_mode(%02x)\n", m);
+    ComLynx.start_time = esp_timer_get_time();
+    comlynx_response_ack();
+}
+
+void lynxNetwork::stream_end()
+{
+    if (rxStats.frames > 0 || txStats.frames > 0)
+        Debug_printf("stream: rx %lu frames %lu bytes, tx %lu frames %lu bytes\n",
+                     rxStats.frames, rxStats.bytes, txStats.frames, txStats.bytes);
+
+    streamMode = 0;
+    streamLen = 0;
+    fnArena.free(ARENA_NETWORK, streamBuffer);
+    streamBuffer = nullptr;
+}
+
+void lynxNetwork::stream_record(_stream_stats &st, uint16_t len, int64_t started)
+{
+    uint32_t us = (uint32_t)(esp_timer_get_time() - started);
+
+    if (st.frames == 0 || us < st.min_us)
+        st.min_us = us;
+    if (us > st.max_us)
+        st.max_us = us;
+    st.sum_us += us;
+    st.bytes += len;
+    st.frames++;
+}
+
+/**
+ * Returns rx then tx stats, each as frames, bytes, min, average and max
+ * latency in microseconds, all 32 bit little endian.
+ */
+void lynxNetwork::stream_stats()
+{
+    comlynx_recv(); // CK
+
+    ComLynx.start_time = esp_timer_get_time();
+    comlynx_response_ack();
+
+    const _stream_stats *all[2] = {&rxStats, &txStats};
+    uint8_t *p = response;
+    for (const _stream_stats *st : all)
+    {
+        uint32_t v[5] = {st->frames, st->bytes, st->min_us,
+                         st->frames ? (uint32_t)(st->sum_us / st->frames) : 0, st->max_us};
+        for (uint32_t x : v)
+        {
+            *p++ = x & 0xFF;
+            *p++ = (x >> 8) & 0xFF;
+            *p++ = (x >> 16) & 0xFF;
+            *p++ = (x >> 24) & 0xFF;
+        }
+    }
+    response_len = p - response;
+}
+
 void lynxNetwork::json_query(unsigned short s)
 {
     uint8_t *c = (uint8_t *)malloc(s);
@@ -704,6 +822,12 @@ void lynxNetwork::comlynx_control_send()
     case 'W':
         write(s);
         break;
+    case 0xFA:
+        stream_stats();
+        break;
+    case 0xFB:
+        stream_mode();
+        break;
     case 0xFC:
         channel_mode();
         break;
@@ -747,6 +871,12 @@ void lynxNetwork::comlynx_control_send()
 
 void lynxNetwork::comlynx_control_clr()
 {
+    if (streamLen > 0)
+    {
+        comlynx_stream_send(ComLynx.start_time);
+        return;
+    }
+
     comlynx_response_send();
 
     if (channelMode == JSON)
@@ -827,8 +957,73 @@ void lynxNetwork::comlynx_control_receive_channel_protocol()
     }
 }
 
+void lynxNetwork::comlynx_stream_receive()
+{
+    NetworkStatus ns;
+    int64_t started = ComLynx.start_time;
+
+    if ((protocol == nullptr) || (receiveBuffer == nullptr))
+        return; // Punch out.
+
+    // A frame from an earlier RECEIVE is still waiting for its CLR
+    if (streamLen > 0)
+    {
+        comlynx_response_ack();
+        return;
+    }
+
+    protocol->status(&ns);
+    if (ns.rxBytesWaiting == 0)
+    {
+        comlynx_response_nack();
+        return;
+    }
+
+    uint16_t len = (ns.rxBytesWaiting > STREAM_FRAME_SIZE) ? STREAM_FRAME_SIZE : ns.rxBytesWaiting;
+
+    if (protocol->read(len)) // protocol adapter returned error
+    {
+        statusByte.bits.client_error = true;
+        err = protocol->error;
+        comlynx_response_nack();
+        return;
+    }
+
+    statusByte.bits.client_error = 0;
+    statusByte.bits.client_data_available = len > 0;
+    memcpy(streamBuffer, receiveBuffer->data(), len);
+    receiveBuffer->erase(0, len);
+    streamLen = len;
+
+    // The frame itself tells the Lynx its RECEIVE worked
+    if (streamMode & STREAM_MODE_NO_ACK)
+        comlynx_stream_send(started);
+    else
+        comlynx_response_ack();
+}
+
+void lynxNetwork::comlynx_stream_send(int64_t started)
+{
+    uint8_t c = comlynx_checksum(streamBuffer, streamLen);
+
+    comlynx_send(0xB0 | _devnum);
+    comlynx_send_length(streamLen);
+    comlynx_send_buffer(streamBuffer, streamLen);
+    comlynx_send(c);
+
+    stream_record(rxStats, streamLen, started);
+    streamLen = 0;
+}
+
 void lynxNetwork::comlynx_control_receive()
 {
+    if ((streamMode & STREAM_MODE_ENABLE) && channelMode == PROTOCOL)
+    {
+        comlynx_stream_receive();
+        ComLynx.start_time = esp_timer_get_time();
+        return;
+    }
+
     ComLynx.start_time = esp_timer_get_time();
 
     // Data is waiting, go ahead and send it off.
@@ -936,6 +1131,9 @@ void lynxNetwork::create_url_parser()
 {
     std::string url = deviceSpec.substr(deviceSpec.find(":") + 1);
     urlParser = PeoplesUrlParser::parseURL(url);
+
+    if (urlParser->isValidUrl())
+        dns_prefetch(urlParser->host);
 }
 
 void lynxNetwork::parse_and_instantiate_protocol(string d)
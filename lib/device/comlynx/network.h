@@ -27,6 +27,20 @@
 #define OUTPUT_BUFFER_SIZE 65535
 #define SPECIAL_BUFFER_SIZE 256
 
+/**
+ * Largest frame in stream mode, in either direction
+ */
+#define STREAM_FRAME_SIZE 4096
+
+/**
+ * Stream mode flags, the payload of command 0xFB.
+ * ENABLE  frames up to STREAM_FRAME_SIZE
+ * NO_ACK  writes aren't acknowledged, and a RECEIVE with data waiting is answered
+ *         with the data frame itself rather than an ACK and a wait for CLR
+ */
+#define STREAM_MODE_ENABLE 0x01
+#define STREAM_MODE_NO_ACK 0x02
+
 class lynxNetwork : public virtualDevice
 {
 
@@ -116,6 +130,16 @@ public:
      */
     void channel_mode();
 
+    /**
+     * @brief set stream mode flags, for low latency game traffic. Cleared by close.
+     */
+    void stream_mode();
+
+    /**
+     * @brief return the stream frame stats, sent on the next CLR
+     */
+    void stream_stats();
+
     /**
      * @brief parse incoming data
      */
@@ -164,6 +188,34 @@ private:
      */
     bool jsonRecvd = false;
 
+    /**
+     * Stream mode flags, 0 for normal packets
+     */
+    uint8_t streamMode = 0;
+
+    /**
+     * Frame buffer for stream mode, from the network arena while stream mode is on
+     */
+    uint8_t *streamBuffer = nullptr;
+
+    /**
+     * Length of the stream frame waiting for CLR
+     */
+    uint16_t streamLen = 0;
+
+    /**
+     * Per-frame stats for stream mode. Latency is from the command byte to the
+     * frame being handed to the protocol (tx) or sent to the Lynx (rx).
+     */
+    struct _stream_stats
+    {
+        uint32_t frames;
+        uint32_t bytes;
+        uint32_t min_us;
+        uint32_t max_us;
+        uint64_t sum_us;
+    } rxStats, txStats;
+
     /**
      * The Receive buffer for this N: device
      */
@@ -340,6 +392,27 @@ private:
      */
     bool read_channel(unsigned short num_bytes);
 
+    /**
+     * Receive a frame in stream mode
+     */
+    void comlynx_stream_receive();
+
+    /**
+     * Send the stream frame to the Lynx
+     * @param started time of the command byte that asked for it
+     */
+    void comlynx_stream_send(int64_t started);
+
+    /**
+     * Add one frame to stream stats
+     */
+    void stream_record(_stream_stats &st, uint16_t len, int64_t started);
+
+    /**
+     * Leave stream mode and free its buffer
+     */
+    void stream_end();
+
     /**
      * Perform the correct write based on value of channelMode
      * @param num_bytes Number of bytes to write.
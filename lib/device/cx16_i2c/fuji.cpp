@@ -15,6 +15,8 @@
 #include "fsFlash.h"
 #include "fnFsSD.h"
 #include "fnWiFi.h"
+#include "fujiAppKeys.h"
+#include "fujiCopyTask.h"
 
 #include "led.h"
 #include "utils.h"
@@ -313,20 +315,9 @@ void cx16Fuji::copy_file()
     string sourcePath;
     string destPath;
     uint8_t ck;
-    FILE *sourceFile;
-    FILE *destFile;
-    char *dataBuf;
     unsigned char sourceSlot;
     unsigned char destSlot;
 
-    dataBuf = (char *)malloc(532);
-
-    if (dataBuf == nullptr)
-    {
-        cx16_error();
-        return;
-    }
-
     memset(&csBuf, 0, sizeof(csBuf));
 
     ck = bus_to_peripheral(csBuf, sizeof(csBuf));
@@ -334,7 +325,6 @@ void cx16Fuji::copy_file()
     if (ck != cx16_checksum(csBuf, sizeof(csBuf)))
     {
         cx16_error();
-        free(dataBuf);
         return;
     }
 
@@ -346,21 +336,18 @@ void cx16Fuji::copy_file()
     if (copySpec.empty() || copySpec.find_first_of("|") == string::npos)
     {
         cx16_error();
-        free(dataBuf);
         return;
     }
 
     if (cmdFrame.aux1 < 1 || cmdFrame.aux1 > 8)
     {
         cx16_error();
-        free(dataBuf);
         return;
     }
 
     if (cmdFrame.aux2 < 1 || cmdFrame.aux2 > 8)
     {
         cx16_error();
-        free(dataBuf);
         return;
     }
 
@@ -381,43 +368,11 @@ void cx16Fuji::copy_file()
         destPath += sourceFilename;
     }
 
-    // Mount hosts, if needed.
-    _fnHosts[sourceSlot].mount();
-    _fnHosts[destSlot].mount();
-
-    // Open files...
-    sourceFile = _fnHosts[sourceSlot].file_open(sourcePath.c_str(), (char *)sourcePath.c_str(), sourcePath.size() + 1, "r");
-
-    if (sourceFile == nullptr)
-    {
-        cx16_error();
-        free(dataBuf);
-        return;
-    }
-
-    destFile = _fnHosts[destSlot].file_open(destPath.c_str(), (char *)destPath.c_str(), destPath.size() + 1, "w");
-
-    if (destFile == nullptr)
-    {
+    fujiCopyTask copy(&_fnHosts[sourceSlot], sourcePath, &_fnHosts[destSlot], destPath);
+    if (copy.run())
+        cx16_complete();
+    else
         cx16_error();
-        free(dataBuf);
-        fclose(sourceFile);
-        return;
-    }
-
-    size_t count = 0;
-    do
-    {
-        count = fread(dataBuf, 1, 532, sourceFile);
-        fwrite(dataBuf, 1, count, destFile);
-    } while (count > 0);
-
-    cx16_complete();
-
-    // copyEnd:
-    fclose(sourceFile);
-    fclose(destFile);
-    free(dataBuf);
 }
 
 // Mount all
@@ -486,14 +441,6 @@ void cx16Fuji::set_boot_mode()
     cx16_complete();
 }
 
-char *_generate_appkey_filename(appkey *info)
-{
-    static char filenamebuf[30];
-
-    snprintf(filenamebuf, sizeof(filenamebuf), "/FujiNet/%04hx%02hhx%02hhx.key", info->creator, info->app, info->key);
-    return filenamebuf;
-}
-
 /*
  Opens an "app key".  This just sets the needed app key parameters (creator, app, key, mode)
  for the subsequent expected read/write command. We could've added this information as part
@@ -532,7 +479,7 @@ void cx16Fuji::open_app_key()
 
     Debug_printf("App key creator = 0x%04hx, app = 0x%02hhx, key = 0x%02hhx, mode = %hhu, filename = \"%s\"\n",
                  _current_appkey.creator, _current_appkey.app, _current_appkey.key, _current_appkey.mode,
-                 _generate_appkey_filename(&_current_appkey));
+                 fujiAppKeys::filename(_current_appkey.creator, _current_appkey.app, _current_appkey.key).c_str());
 
     cx16_complete();
 }
@@ -550,7 +497,7 @@ void cx16Fuji::close_app_key()
 }
 
 /*
- Write an "app key" to SD (ONLY!) storage.
+ Write an "app key" to SD (ONLY!) storage. It reaches the card a little later, see fujiAppKeys
 */
 void cx16Fuji::sio_write_app_key()
 {
@@ -585,35 +532,14 @@ void cx16Fuji::sio_write_app_key()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
+    if (keylen > sizeof(value))
+        keylen = sizeof(value);
+    fnAppKeys.write(_current_appkey.creator, _current_appkey.app, _current_appkey.key, value, keylen);
 
     // Reset the app key data so we require calling APPKEY OPEN before another attempt
     _current_appkey.creator = 0;
     _current_appkey.mode = APPKEYMODE_INVALID;
 
-    Debug_printf("Writing appkey to \"%s\"\n", filename);
-
-    // Make sure we have a "/FujiNet" directory, since that's where we're putting these files
-    fnSDFAT.create_path("/FujiNet");
-
-    FILE *fOut = fnSDFAT.file_open(filename, "w");
-    if (fOut == nullptr)
-    {
-        Debug_printf("Failed to open/create output file: errno=%d\n", errno);
-        cx16_error();
-        return;
-    }
-    size_t count = fwrite(value, 1, keylen, fOut);
-    int e = errno;
-
-    fclose(fOut);
-
-    if (count != keylen)
-    {
-        Debug_printf("Only wrote %u bytes of expected %hu, errno=%d\n", count, keylen, e);
-        cx16_error();
-    }
-
     cx16_complete();
 }
 
@@ -641,18 +567,6 @@ void cx16Fuji::read_app_key()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
-
-    Debug_printf("Reading appkey from \"%s\"\n", filename);
-
-    FILE *fIn = fnSDFAT.file_open(filename, "r");
-    if (fIn == nullptr)
-    {
-        Debug_printf("Failed to open input file: errno=%d\n", errno);
-        cx16_error();
-        return;
-    }
-
     struct
     {
         uint16_t size;
@@ -660,10 +574,15 @@ void cx16Fuji::read_app_key()
     } __attribute__((packed)) response;
     memset(&response, 0, sizeof(response));
 
-    size_t count = fread(response.value, 1, sizeof(response.value), fIn);
-
-    fclose(fIn);
-    Debug_printf("Read %d bytes from input file\n", count);
+    int count = fnAppKeys.read(_current_appkey.creator, _current_appkey.app, _current_appkey.key,
+                               response.value, sizeof(response.value));
+    if (count < 0)
+    {
+        Debug_println("No such app key");
+        cx16_error();
+        return;
+    }
+    Debug_printf("Read %d bytes of app key\n", count);
 
     response.size = count;
 
@@ -1075,7 +994,7 @@ void cx16Fuji::write_host_slots()
             _fnHosts[i].set_hostname(hostSlots[i]);
 
         _populate_config_from_slots();
-        Config.save();
+        Config.save_later();
 
         cx16_complete();
     }
@@ -1220,7 +1139,7 @@ void cx16Fuji::write_device_slots()
 
         // Save the data to disk
         _populate_config_from_slots();
-        Config.save();
+        Config.save_later();
 
         cx16_complete();
     }
@@ -1338,7 +1257,7 @@ void cx16Fuji::set_device_filename()
         return;
     }
 
-    Config.save();
+    Config.save_later();
     cx16_complete();
 }
 
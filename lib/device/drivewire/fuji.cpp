@@ -17,6 +17,9 @@
 #include "fnConfig.h"
 #include "fsFlash.h"
 #include "fnWiFi.h"
+#include "fujiAppKeys.h"
+#include "fujiMountAll.h"
+#include "fujiCopyTask.h"
 
 #include "led.h"
 #include "utils.h"
@@ -349,139 +352,47 @@ void drivewireFuji::set_boot_config()
 }
 
 // Do DRIVEWIRE copy
+// Source host slot and destination host slot (1-8), then "source|dest" in 256 bytes
 void drivewireFuji::copy_file()
 {
-    // uint8_t csBuf[256];
-    // string copySpec;
-    // string sourcePath;
-    // string destPath;
-    // uint8_t ck;
-    // FILE *sourceFile;
-    // FILE *destFile;
-    // char *dataBuf;
-    // unsigned char sourceSlot;
-    // unsigned char destSlot;
+    Debug_println("Fuji cmd: COPY FILE");
 
-    // dataBuf = (char *)malloc(532);
-
-    // if (dataBuf == nullptr)
-    // {
-    //     drivewire_error();
-    //     return;
-    // }
-
-    // memset(&csBuf, 0, sizeof(csBuf));
-
-    // ck = bus_to_peripheral(csBuf, sizeof(csBuf));
-
-    // if (ck != drivewire_checksum(csBuf, sizeof(csBuf)))
-    // {
-    //     drivewire_error();
-    //     return;
-    // }
-
-    // copySpec = string((char *)csBuf);
-
-    // Debug_printf("copySpec: %s\n", copySpec.c_str());
-
-    // // Check for malformed copyspec.
-    // if (copySpec.empty() || copySpec.find_first_of("|") == string::npos)
-    // {
-    //     drivewire_error();
-    //     return;
-    // }
-
-    // if (cmdFrame.aux1 < 1 || cmdFrame.aux1 > 8)
-    // {
-    //     drivewire_error();
-    //     return;
-    // }
-
-    // if (cmdFrame.aux2 < 1 || cmdFrame.aux2 > 8)
-    // {
-    //     drivewire_error();
-    //     return;
-    // }
-
-    // sourceSlot = cmdFrame.aux1 - 1;
-    // destSlot = cmdFrame.aux2 - 1;
-
-    // // All good, after this point...
-
-    // // Chop up copyspec.
-    // sourcePath = copySpec.substr(0, copySpec.find_first_of("|"));
-    // destPath = copySpec.substr(copySpec.find_first_of("|") + 1);
-
-    // // At this point, if last part of dest path is / then copy filename from source.
-    // if (destPath.back() == '/')
-    // {
-    //     Debug_printf("append source file\n");
-    //     string sourceFilename = sourcePath.substr(sourcePath.find_last_of("/") + 1);
-    //     destPath += sourceFilename;
-    // }
-
-    // // Mount hosts, if needed.
-    // _fnHosts[sourceSlot].mount();
-    // _fnHosts[destSlot].mount();
+    struct
+    {
+        unsigned char sourceSlot;
+        unsigned char destSlot;
+        char copySpec[256];
+    } copyFile;
 
-    // // Open files...
-    // sourceFile = _fnHosts[sourceSlot].file_open(sourcePath.c_str(), (char *)sourcePath.c_str(), sourcePath.size() + 1, "r");
+    fnDwCom.readBytes((uint8_t *)&copyFile, sizeof(copyFile));
+    copyFile.copySpec[sizeof(copyFile.copySpec) - 1] = '\0';
 
-    // if (sourceFile == nullptr)
-    // {
-    //     drivewire_error();
-    //     return;
-    // }
+    std::string copySpec = copyFile.copySpec;
+    Debug_printf("copySpec: %s\n", copySpec.c_str());
 
-    // destFile = _fnHosts[destSlot].file_open(destPath.c_str(), (char *)destPath.c_str(), destPath.size() + 1, "w");
+    // Check for malformed copyspec.
+    if (copySpec.empty() || copySpec.find_first_of("|") == std::string::npos ||
+        copyFile.sourceSlot < 1 || copyFile.sourceSlot > MAX_HOSTS ||
+        copyFile.destSlot < 1 || copyFile.destSlot > MAX_HOSTS)
+    {
+        errorCode = 144;
+        return;
+    }
 
-    // if (destFile == nullptr)
-    // {
-    //     drivewire_error();
-    //     return;
-    // }
+    // Chop up copyspec.
+    std::string sourcePath = copySpec.substr(0, copySpec.find_first_of("|"));
+    std::string destPath = copySpec.substr(copySpec.find_first_of("|") + 1);
 
-    // size_t readCount = 0;
-    // size_t readTotal = 0;
-    // size_t writeCount = 0;
-    // size_t expected = _fnHosts[sourceSlot].file_size(sourceFile); // get the filesize
-    // bool err = false;
-    // do
-    // {
-    //     readCount = fread(dataBuf, 1, 532, sourceFile);
-    //     readTotal += readCount;
-    //     // Check if we got enough bytes on the read
-    //     if(readCount < 532 && readTotal != expected)
-    //     {
-    //         err = true;
-    //         break;
-    //     }
-    //     writeCount = fwrite(dataBuf, 1, readCount, destFile);
-    //     // Check if we sent enough bytes on the write
-    //     if (writeCount != readCount)
-    //     {
-    //         err = true;
-    //         break;
-    //     }
-    //     Debug_printf("Copy File: %d bytes of %d\n", readTotal, expected);
-    // } while (readTotal < expected);
-
-    // if (err == true)
-    // {
-    //     // Remove the destination file and error
-    //     _fnHosts[destSlot].file_remove((char *)destPath.c_str());
-    //     drivewire_error();
-    //     Debug_printf("Copy File Error! wCount: %d, rCount: %d, rTotal: %d, Expect: %d\n", writeCount, readCount, readTotal, expected);
-    // }
-    // else
-    // {
-    //     drivewire_complete();
-    // }
+    // At this point, if last part of dest path is / then copy filename from source.
+    if (destPath.back() == '/')
+    {
+        Debug_printf("append source file\n");
+        std::string sourceFilename = sourcePath.substr(sourcePath.find_last_of("/") + 1);
+        destPath += sourceFilename;
+    }
 
-    // // copyEnd:
-    // fclose(sourceFile);
-    // fclose(destFile);
-    // free(dataBuf);
+    fujiCopyTask copy(&_fnHosts[copyFile.sourceSlot - 1], sourcePath, &_fnHosts[copyFile.destSlot - 1], destPath);
+    errorCode = copy.run() ? 1 : 144;
 }
 
 // Mount all
@@ -491,39 +402,29 @@ void drivewireFuji::mount_all()
 
     Debug_printf("drivewireFuji::mount_all()\n");
 
+    fujiSlotOpen opened[4];
+    fuji_open_slots(_fnDisks, 4, _fnHosts, "r", opened);
+
     for (int i = 0; i < 4; i++)
     {
         fujiDisk &disk = _fnDisks[i];
         fujiHost &host = _fnHosts[disk.host_slot];
-        char flag[3] = {'r', 0, 0};
 
-        if (disk.access_mode == DISK_ACCESS_MODE_WRITE)
-            flag[1] = '+';
-
-        if (disk.host_slot != INVALID_HOST_SLOT && strlen(disk.filename) > 0)
+        if (opened[i].wanted)
         {
             nodisks = false; // We have a disk in a slot
 
-            if (host.mount() == false)
-            {
-                return;
-            }
-
-            Debug_printf("Selecting '%s' from host #%u as %s on D%u:\n",
-                         disk.filename, disk.host_slot, flag, i + 1);
-
-            disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), flag);
-
-            if (disk.fileh == nullptr)
+            disk.fileh = opened[i].fileh;
+            if (!opened[i].host_ok || disk.fileh == nullptr)
             {
+                fuji_close_slots(opened, i + 1, 4);
                 return;
             }
 
             // We've gotten this far, so make sure our bootable CONFIG disk is disabled
             boot_config = false;
 
-            // We need the file size for loading XEX files and for CASSETTE, so get that too
-            disk.disk_size = host.file_size(disk.fileh);
+            disk.disk_size = opened[i].size;
 
             // Set the host slot for high score mode
             // TODO: Refactor along with mount disk image.
@@ -552,14 +453,6 @@ void drivewireFuji::set_boot_mode()
     boot_config = true;
 }
 
-char *_generate_appkey_filename(appkey *info)
-{
-    static char filenamebuf[30];
-
-    snprintf(filenamebuf, sizeof(filenamebuf), "/FujiNet/%04hx%02hhx%02hhx.key", info->creator, info->app, info->key);
-    return filenamebuf;
-}
-
 /*
  Opens an "app key".  This just sets the needed app key parameters (creator, app, key, mode)
  for the subsequent expected read/write command. We could've added this information as part
@@ -596,7 +489,7 @@ void drivewireFuji::open_app_key()
 
     Debug_printf("App key creator = 0x%04hx, app = 0x%02hhx, key = 0x%02hhx, mode = %hhu, filename = \"%s\"\n",
                 _current_appkey.creator, _current_appkey.app, _current_appkey.key, _current_appkey.mode,
-                _generate_appkey_filename(&_current_appkey));
+                fujiAppKeys::filename(_current_appkey.creator, _current_appkey.app, _current_appkey.key).c_str());
 }
 
 /*
@@ -612,7 +505,7 @@ void drivewireFuji::close_app_key()
 }
 
 /*
- Write an "app key" to SD (ONLY!) storage.
+ Write an "app key" to SD (ONLY!) storage. It reaches the card a little later, see fujiAppKeys
 */
 void drivewireFuji::write_app_key()
 {
@@ -641,34 +534,14 @@ void drivewireFuji::write_app_key()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
+    if (len > sizeof(value))
+        len = sizeof(value);
+    fnAppKeys.write(_current_appkey.creator, _current_appkey.app, _current_appkey.key, value, len);
 
     // Reset the app key data so we require calling APPKEY OPEN before another attempt
     _current_appkey.creator = 0;
     _current_appkey.mode = APPKEYMODE_INVALID;
 
-    Debug_printf("Writing appkey to \"%s\"\n", filename);
-
-    // Make sure we have a "/FujiNet" directory, since that's where we're putting these files
-    fnSDFAT.create_path("/FujiNet");
-
-    FILE *fOut = fnSDFAT.file_open(filename, "w");
-    if (fOut == nullptr)
-    {
-        Debug_printf("Failed to open/create output file: errno=%d\n", errno);
-        errorCode = 144;
-        return;
-    }
-    size_t count = fwrite(value, 1, len, fOut);
-    int e = errno;
-
-    fclose(fOut);
-
-    if (count != len)
-    {
-        Debug_printf("Only wrote %u bytes of expected %hu, errno=%d\n", count, len, e);
-        errorCode = 144;
-    }
     errorCode = 1;
 }
 
@@ -695,22 +568,16 @@ void drivewireFuji::read_app_key()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
-
-    Debug_printf("Reading appkey from \"%s\"\n", filename);
-
-    FILE *fIn = fnSDFAT.file_open(filename, "r");
-    if (fIn == nullptr)
+    std::vector<uint8_t> buffer(MAX_APPKEY_LEN);
+    int count = fnAppKeys.read(_current_appkey.creator, _current_appkey.app, _current_appkey.key,
+                               buffer.data(), buffer.size());
+    if (count < 0)
     {
-        Debug_printf("Failed to open input file: errno=%d\n", errno);
+        Debug_println("No such app key");
         errorCode = 144;
         return;
     }
-
-    std::vector<uint8_t> buffer(MAX_APPKEY_LEN);
-    size_t count = fread(buffer.data(), 1, buffer.size(), fIn);
-    fclose(fIn);
-    Debug_printf("Read %d bytes from input file\n", count);
+    Debug_printf("Read %d bytes of app key\n", count);
 
     uint16_t sizeNetOrder = htons(count);
 
@@ -1083,7 +950,9 @@ void drivewireFuji::new_disk()
         return;
     }
 
-    disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), "w");
+    // Reserve the whole image in one contiguous run if the host can, and fill it in place
+    bool reserved = !host.file_preallocate(disk.filename, newDisk.numDisks * 315 * 512);
+    disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), reserved ? FILE_READ_WRITE : "w");
     if (disk.fileh == nullptr)
     {
         Debug_printf("drivewire_new_disk Couldn't open file for writing: \"%s\"\n", disk.filename);
@@ -1149,7 +1018,7 @@ void drivewireFuji::write_host_slots()
         _fnHosts[i].set_hostname(hostSlots[i]);
 
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 }
 
 // Send device slot data to computer
@@ -1222,7 +1091,7 @@ void drivewireFuji::write_device_slots()
 
     // Save the data to disk
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 }
 
 // Temporary(?) function while we move from old config storage to new
@@ -1314,7 +1183,7 @@ void drivewireFuji::set_device_filename()
         _populate_config_from_slots();
     }
 
-    Config.save();
+    Config.save_later();
 }
 
 // Get a 256 byte filename from device slot
@@ -1770,6 +1639,9 @@ void drivewireFuji::process()
     case FUJICMD_NEW_DISK:
         new_disk();
         break;
+    case FUJICMD_COPY_FILE:
+        copy_file();
+        break;
     case FUJICMD_SEND_RESPONSE:
         send_response();
         break;
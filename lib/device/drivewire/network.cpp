@@ -14,6 +14,7 @@
 
 #include "fnSystem.h"
 #include "utils.h"
+#include "fnDNS.h"
 
 #include "status_error_codes.h"
 #include "TCP.h"
@@ -317,9 +318,42 @@ void drivewireNetwork::read()
     // And set response buffer.
     response += *receiveBuffer;
  
-    // Remove from receive buffer and shrink.
+    // Remove from receive buffer, keeping its capacity for the next frame; Protocol::close() gives it back
     receiveBuffer->erase(0, num_bytes);
-    receiveBuffer->shrink_to_fit();
+}
+
+/**
+ * DRIVEWIRE Status and Read command
+ */
+void drivewireNetwork::status_read()
+{
+    uint16_t response_len = cmdFrame.aux1 << 8 | cmdFrame.aux2; // big endian
+
+    if (receiveBuffer == nullptr || protocol == nullptr || response_len < STATUS_READ_HEADER_SIZE)
+    {
+        ns.error = receiveBuffer == nullptr ? NETWORK_ERROR_COULD_NOT_ALLOCATE_BUFFERS : NETWORK_ERROR_NOT_CONNECTED;
+        return;
+    }
+
+    // The status call brings in what's waiting, same as before a read
+    status_channel();
+
+    uint16_t len = ns.rxBytesWaiting;
+    if (len > receiveBuffer->length())
+        len = receiveBuffer->length();
+    if (len > response_len - STATUS_READ_HEADER_SIZE)
+        len = response_len - STATUS_READ_HEADER_SIZE;
+    if (channelMode == JSON)
+        read_channel_json(len);
+
+    uint16_t left = ns.rxBytesWaiting - len;
+    response[0] = left >> 8;
+    response[1] = left & 0xFF;
+    response += (char)(len >> 8);
+    response += (char)(len & 0xFF);
+    response.append(*receiveBuffer, 0, len);
+
+    receiveBuffer->erase(0, len);
 }
 
 /**
@@ -1080,6 +1114,9 @@ void drivewireNetwork::create_url_parser()
 {
     std::string url = deviceSpec.substr(deviceSpec.find(":") + 1);
     urlParser = PeoplesUrlParser::parseURL(url);
+
+    if (urlParser->isValidUrl())
+        dns_prefetch(urlParser->host);
 }
 
 void drivewireNetwork::parse_and_instantiate_protocol()
@@ -1165,6 +1202,9 @@ bool drivewireNetwork::parseURL()
     url = deviceSpec.substr(deviceSpec.find(":") + 1);
     urlParser = PeoplesUrlParser::parseURL(url);
 
+    if (urlParser->isValidUrl())
+        dns_prefetch(urlParser->host);
+
     Debug_printf("drivewireNetwork::parseURL transformed to (%s, %s)\n", deviceSpec.c_str(), url.c_str());
 
     return isValidURL(urlParser.get());
@@ -1327,6 +1367,9 @@ void drivewireNetwork::process()
     case 'S':
         status();
         break;
+    case 'G':
+        status_read();
+        break;
     case 0xFF:
         special_inquiry();
         break;
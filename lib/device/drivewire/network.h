@@ -30,6 +30,11 @@
 #define OUTPUT_BUFFER_SIZE 65535
 #define SPECIAL_BUFFER_SIZE 256
 
+/**
+ * Status and length in front of the data in a Status and Read response
+ */
+#define STATUS_READ_HEADER_SIZE 6
+
 class drivewireNetwork : public virtualDevice
 {
 
@@ -101,6 +106,14 @@ public:
      */
     virtual void read();
 
+    /**
+     * DRIVEWIRE Status and Read command
+     * Status, then as much of what's waiting as fits in a response of aux1/aux2 bytes, so a read takes one
+     * command instead of two. The response is the status as for 'S', with bytes waiting being what's left
+     * after this one, then the 16 bit length of the data (both big endian) and the data.
+     */
+    virtual void status_read();
+
     /**
      * DRIVEWIRE Write command
      * Write # of bytes specified by aux1/aux2 from tx_buffer out to DRIVEWIRE. If protocol is unable to return requested
@@ -5,6 +5,7 @@
 #include <cstring>
 #include <sstream>
 #include <unordered_map>
+#include <utility>
 
 //#include "../../include/global_defines.h"
 #include "../../include/debug.h"
@@ -19,6 +20,7 @@
 #include "display.h"
 
 #include "meat_media.h"
+#include "../meatloaf/disk/d64.h"
 
 
 // Buffering data when reading/writing streams because during regular (non-fastloader)
@@ -27,6 +29,20 @@
 // To be safe, BUFFER_SIZE should always be >=256
 #define BUFFER_SIZE 512
 
+// Fastloaders drain a buffer much faster than regular transfers, so reads for them are
+// fetched from the stream in bigger chunks, one chunk ahead of what is being sent
+#define READAHEAD_SIZE 4096
+#define READAHEAD_STACKSIZE 8192
+#define READAHEAD_PRIORITY 5
+// Keep stream reads off the core that bit-bangs the bus
+#define READAHEAD_CPUAFFINITY 0
+
+// Directory listings kept for repeated LOAD"$", the oldest one goes first when full.
+// Writes through the drive drop them all, changes made elsewhere show up after the TTL
+#define DIRCACHE_ENTRIES  8
+#define DIRCACHE_MAX_SIZE 16384
+#define DIRCACHE_TTL_MS   60000
+
 
 #define ST_OK                  0
 #define ST_SCRATCHED           1
@@ -69,8 +85,10 @@ iecChannelHandler::iecChannelHandler(iecDrive *drive)
 { 
   m_drive = drive;
   m_data = new uint8_t[BUFFER_SIZE]; 
+  m_span = nullptr;
   m_len = 0; 
   m_ptr = 0; 
+  m_request = 1;
 }
 
 
@@ -85,8 +103,10 @@ uint8_t iecChannelHandler::read(uint8_t *data, uint8_t n)
   // if buffer is empty then re-fill it
   if( m_ptr >= m_len )
     {
+      m_request = n;
       m_ptr = 0;
       m_len = 0;
+      m_span = nullptr;
 
       uint8_t st = readBufferData();
       if( st!=ST_OK )
@@ -99,17 +119,18 @@ uint8_t iecChannelHandler::read(uint8_t *data, uint8_t n)
   // read data from buffer
   if( m_ptr < m_len )
     {
+      const uint8_t *src = m_span!=nullptr ? m_span : m_data;
       if( n==1 )
         {
           // common case during regular (non-fastloader) load
-          data[0] = m_data[m_ptr++];
+          data[0] = src[m_ptr++];
           return 1;
         }
       else
         {
           // copy as much data as possible
           n = std::min((size_t) n, (size_t) (m_len - m_ptr));
-          memcpy(data, m_data + m_ptr, n);
+          memcpy(data, src + m_ptr, n);
           m_ptr += n;
           return n;
         }
@@ -164,6 +185,15 @@ iecChannelHandlerFile::iecChannelHandlerFile(iecDrive *drive, MStream *stream, i
   m_timeStart = esp_timer_get_time();
   m_byteCount = 0;
   m_transportTimeUS = 0;
+
+  m_next = nullptr;
+  m_nextLen = 0;
+  m_chunkSize = BUFFER_SIZE;
+  m_nextEos = false;
+  m_prefetching = false;
+  m_stopPrefetch = false;
+  m_prefetchTask = nullptr;
+  m_prefetchDone = nullptr;
 }
 
 
@@ -171,6 +201,16 @@ iecChannelHandlerFile::~iecChannelHandlerFile()
 {
   double seconds = (esp_timer_get_time()-m_timeStart) / 1000000.0;
 
+  if( m_prefetchTask!=nullptr )
+    {
+      finishPrefetch();
+      m_stopPrefetch = true;
+      xTaskNotifyGive(m_prefetchTask);
+      xSemaphoreTake(m_prefetchDone, portMAX_DELAY);
+      vSemaphoreDelete(m_prefetchDone);
+    }
+  delete [] m_next;
+
   if( m_stream->mode == std::ios_base::out && m_len>0 )
     writeBufferData();
 
@@ -182,7 +222,7 @@ iecChannelHandlerFile::~iecChannelHandlerFile()
 
   double tseconds = m_transportTimeUS / 1000000.0;
   cps = m_byteCount / (seconds-tseconds);
-  Debug_printv("Transport (network/sd) took %0.3f seconds, pure IEC transfers @ %0.2fcps", tseconds, cps);
+  Debug_printv("Transport (network/sd) stalled IEC for %0.3f seconds, pure IEC transfers @ %0.2fcps", tseconds, cps);
 
 #ifdef ENABLE_DISPLAY
     DISPLAY.idle();
@@ -218,6 +258,81 @@ uint8_t iecChannelHandlerFile::writeBufferData()
 }
 
 
+MStream *iecChannelHandlerFile::getStream()
+{
+  // the caller is about to move the stream, so what was read ahead no longer follows on
+  finishPrefetch();
+  m_nextLen = 0;
+  m_nextEos = false;
+  return m_stream;
+}
+
+
+void iecChannelHandlerFile::prefetchTask(void *arg)
+{
+  iecChannelHandlerFile *h = (iecChannelHandlerFile *) arg;
+
+  while( true )
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      if( h->m_stopPrefetch )
+        break;
+
+      h->m_nextLen = 0;
+      while( h->m_nextLen<h->m_chunkSize && !h->m_stream->eos() )
+        {
+          h->m_nextLen += h->m_stream->read(h->m_next+h->m_nextLen, h->m_chunkSize-h->m_nextLen);
+        }
+      h->m_nextEos = h->m_stream->eos();
+
+      xSemaphoreGive(h->m_prefetchDone);
+    }
+
+  xSemaphoreGive(h->m_prefetchDone);
+  vTaskDelete(NULL);
+}
+
+
+void iecChannelHandlerFile::startPrefetch()
+{
+  if( m_prefetchTask==nullptr )
+    {
+      m_prefetchDone = xSemaphoreCreateBinary();
+      if( m_prefetchDone==nullptr )
+        return;
+
+      if( xTaskCreatePinnedToCore(prefetchTask, "iec_prefetch", READAHEAD_STACKSIZE, this,
+                                  READAHEAD_PRIORITY, &m_prefetchTask, READAHEAD_CPUAFFINITY)!=pdPASS )
+        {
+          Debug_printv("Error: could not start read-ahead task, reading synchronously");
+          vSemaphoreDelete(m_prefetchDone);
+          m_prefetchDone = nullptr;
+          m_prefetchTask = nullptr;
+          return;
+        }
+    }
+
+  // size the next chunk for the protocol draining this one, and for what the
+  // stream likes to be asked for, e.g. bigger for HTTP
+  m_chunkSize = m_request>1 ? READAHEAD_SIZE : std::min((size_t) READAHEAD_SIZE, std::max((size_t) BUFFER_SIZE, (size_t) m_stream->bufferSize()));
+  m_prefetching = true;
+  xTaskNotifyGive(m_prefetchTask);
+}
+
+
+void iecChannelHandlerFile::finishPrefetch()
+{
+  if( m_prefetching )
+    {
+      // only counts the time the bus actually had to wait for the stream
+      uint64_t t = esp_timer_get_time();
+      xSemaphoreTake(m_prefetchDone, portMAX_DELAY);
+      m_transportTimeUS += (esp_timer_get_time()-t);
+      m_prefetching = false;
+    }
+}
+
+
 uint8_t iecChannelHandlerFile::readBufferData()
 {
   /*
@@ -227,6 +342,9 @@ uint8_t iecChannelHandlerFile::readBufferData()
   else
   */
     {
+      // the stream belongs to the read-ahead task until its chunk is in
+      finishPrefetch();
+
       Debug_printv("size[%lu] avail[%lu] pos[%lu]", m_stream->size(), m_stream->available(), m_stream->position());
       if (m_stream->size() == 0)
         return ST_FILE_NOT_FOUND;
@@ -237,30 +355,76 @@ uint8_t iecChannelHandlerFile::readBufferData()
       DISPLAY.progress = percent;
 #endif
 
-      if( m_fixLoadAddress>=0 && m_stream->position()==0 )
+      if( m_nextLen==0 && !m_nextEos && (m_fixLoadAddress<0 || m_stream->position()>0) )
         {
+          // a stream that holds the data already is sent from where it is,
+          // no copy and nothing to read ahead
+          const uint8_t *span;
           uint64_t t = esp_timer_get_time();
-          m_len = m_stream->read(m_data, BUFFER_SIZE);
-          m_transportTimeUS += (esp_timer_get_time()-t);
-          if( m_len>=2 )
+          uint32_t n = m_stream->readSpan(&span, m_request>1 ? READAHEAD_SIZE : BUFFER_SIZE);
+          if( span!=nullptr )
             {
-              m_data[0] = (m_fixLoadAddress & 0x00FF);
-              m_data[1] = (m_fixLoadAddress & 0xFF00) >> 8;
+              m_transportTimeUS += (esp_timer_get_time()-t);
+              m_span = span;
+              m_len = n;
+              m_byteCount += n;
+              return ST_OK;
             }
-          m_fixLoadAddress = -1;
         }
-      else
-        m_len = 0;
 
-      // try to fill buffer
-      while( m_len<BUFFER_SIZE && !m_stream->eos() )
+      if( m_next==nullptr )
         {
-          uint64_t t = esp_timer_get_time();
-          m_len += m_stream->read(m_data+m_len, BUFFER_SIZE-m_len);
-          m_transportTimeUS += (esp_timer_get_time()-t);
+          // reading after all, make room for fastloader sized chunks
+          delete [] m_data;
+          m_data = new uint8_t[READAHEAD_SIZE];
+          m_next = new uint8_t[READAHEAD_SIZE];
+        }
+
+      bool eos;
+      if( m_nextLen>0 || m_nextEos )
+        {
+          // hand over the chunk read ahead
+          std::swap(m_data, m_next);
+          m_len = m_nextLen;
+          eos = m_nextEos;
+          m_nextLen = 0;
+          m_nextEos = false;
+        }
+      else
+        {
+          // first chunk (or one after a seek) is read right away
+          size_t size = m_request>1 ? READAHEAD_SIZE : BUFFER_SIZE;
+
+          if( m_fixLoadAddress>=0 && m_stream->position()==0 )
+            {
+              uint64_t t = esp_timer_get_time();
+              m_len = m_stream->read(m_data, size);
+              m_transportTimeUS += (esp_timer_get_time()-t);
+              if( m_len>=2 )
+                {
+                  m_data[0] = (m_fixLoadAddress & 0x00FF);
+                  m_data[1] = (m_fixLoadAddress & 0xFF00) >> 8;
+                }
+              m_fixLoadAddress = -1;
+            }
+          else
+            m_len = 0;
+
+          // try to fill buffer
+          while( m_len<size && !m_stream->eos() )
+            {
+              uint64_t t = esp_timer_get_time();
+              m_len += m_stream->read(m_data+m_len, size-m_len);
+              m_transportTimeUS += (esp_timer_get_time()-t);
+            }
+          eos = m_stream->eos();
         }
 
       m_byteCount += m_len;
+
+      // fetch the next chunk while this one goes out
+      if( !eos && m_len>0 )
+        startPrefetch();
     }
 
   return ST_OK;
@@ -269,10 +433,68 @@ uint8_t iecChannelHandlerFile::readBufferData()
 // -------------------------------------------------------------------------------------------------
 
 
+struct DirCacheEntry
+{
+  std::string listing;
+  uint64_t    stamp;
+};
+
+static std::unordered_map<std::string, DirCacheEntry> s_dirCache;
+
+
+static std::string dirCacheKey(iecDrive *drive, MFile *dir)
+{
+  return std::to_string(drive->id()) + ":" + dir->url;
+}
+
+
+static DirCacheEntry *dirCacheFind(const std::string &key)
+{
+  auto it = s_dirCache.find(key);
+  if( it==s_dirCache.end() )
+    return nullptr;
+
+  if( esp_timer_get_time()/1000 - it->second.stamp > DIRCACHE_TTL_MS )
+    {
+      s_dirCache.erase(it);
+      return nullptr;
+    }
+
+  return &it->second;
+}
+
+
+bool iecChannelHandlerDir::isCached(iecDrive *drive, MFile *dir)
+{
+  return dirCacheFind(dirCacheKey(drive, dir))!=nullptr;
+}
+
+
+void iecChannelHandlerDir::clearCache()
+{
+  s_dirCache.clear();
+}
+
+
 iecChannelHandlerDir::iecChannelHandlerDir(iecDrive *drive, MFile *dir) : iecChannelHandler(drive)
 {
   m_dir = dir;
   m_headerLine = 1;
+  m_listingPos = 0;
+  m_cacheKey = dirCacheKey(drive, dir);
+
+  // keep the image open while its directory is read
+  if( m_dir->streamFile!=nullptr )
+    ImageBroker::pin(m_dir->streamFile->url);
+
+  DirCacheEntry *e = dirCacheFind(m_cacheKey);
+  m_cached = e!=nullptr;
+  m_recording = !m_cached;
+  if( m_cached )
+    {
+      Debug_printv("Directory listing from cache [%s]", m_cacheKey.c_str());
+      m_listing = e->listing;
+    }
   
   std::string url = m_dir->host;
   url = mstr::toPETSCII2(url);
@@ -304,6 +526,8 @@ iecChannelHandlerDir::iecChannelHandlerDir(iecDrive *drive, MFile *dir) : iecCha
 
 iecChannelHandlerDir::~iecChannelHandlerDir()
 {
+  if( m_dir->streamFile!=nullptr )
+    ImageBroker::unpin(m_dir->streamFile->url);
   delete m_dir;
 
 #ifdef ENABLE_DISPLAY
@@ -333,6 +557,14 @@ uint8_t iecChannelHandlerDir::writeBufferData()
 
 uint8_t iecChannelHandlerDir::readBufferData()
 {
+  if( m_cached )
+    {
+      m_span = (const uint8_t *) m_listing.data()+m_listingPos;
+      m_len = m_listing.size()-m_listingPos;
+      m_listingPos += m_len;
+      return ST_OK;
+    }
+
   if( m_headerLine==1 )
     {
       // main header line
@@ -496,6 +728,37 @@ uint8_t iecChannelHandlerDir::readBufferData()
         }
     }
 
+  if( m_recording && m_len>0 )
+    {
+      if( m_listing.size()+m_len > DIRCACHE_MAX_SIZE )
+        {
+          // too big to keep
+          m_recording = false;
+          m_listing.clear();
+          m_listing.shrink_to_fit();
+        }
+      else
+        {
+          m_listing.append((const char *) m_data, m_len);
+
+          if( m_headerLine==0xFF )
+            {
+              // footer is done => listing complete
+              if( s_dirCache.size()>=DIRCACHE_ENTRIES && s_dirCache.find(m_cacheKey)==s_dirCache.end() )
+                {
+                  auto oldest = s_dirCache.begin();
+                  for( auto it = s_dirCache.begin(); it!=s_dirCache.end(); it++ )
+                    if( it->second.stamp < oldest->second.stamp ) oldest = it;
+                  s_dirCache.erase(oldest);
+                }
+
+              s_dirCache[m_cacheKey] = { std::move(m_listing), (uint64_t) esp_timer_get_time()/1000 };
+              m_listing.clear();
+              m_recording = false;
+            }
+        }
+    }
+
   return ST_OK;
 }
 
@@ -626,8 +889,14 @@ bool iecDrive::open(uint8_t channel, const char *cname)
             {
               // reading directory
               bool isProperDir = false;
-              MFile *entry = f->getNextFileInDir();
-              if( entry==nullptr )
+              bool isCached = iecChannelHandlerDir::isCached(this, f);
+              MFile *entry = nullptr;
+              if( isCached )
+                {
+                  // listed before, no need to ask the file system again
+                  isProperDir = true;
+                }
+              else if( (entry=f->getNextFileInDir())==nullptr )
                 {
                   // if we can't open the file stream then assume this is an empty directory
                   MStream *s = f->getSourceStream(mode);
@@ -643,7 +912,7 @@ bool iecDrive::open(uint8_t channel, const char *cname)
               if( isProperDir )
                 {
                   // regular directory
-                  f->rewindDirectory();
+                  if( !isCached ) f->rewindDirectory();
                   m_channels[channel] = new iecChannelHandlerDir(this, f);
                   m_numOpenChannels++;
                   m_cwd.reset(MFSOwner::File(f->url));
@@ -718,6 +987,7 @@ bool iecDrive::open(uint8_t channel, const char *cname)
               else
                 {
                   Debug_printv("Stream created for file [%s]", f->url.c_str());
+                  if( mode == std::ios_base::out ) iecChannelHandlerDir::clearCache();
                   // new_stream will be deleted in iecChannelHandlerFile destructor
                   m_channels[channel] = new iecChannelHandlerFile(this, new_stream, f->isDirectory() ? 0x0801 : -1);
                   m_numOpenChannels++;
@@ -911,6 +1181,13 @@ void iecDrive::execute(const char *cmd, uint8_t cmdLen)
       setStatusCode(ST_OK);
     }
 #endif  
+#ifdef SUPPORT_FASTSER
+  else if( command=="EF+" || command=="EF-" )
+    {
+      enableFastSerialSupport(command[2]=='+');
+      setStatusCode(ST_OK);
+    }
+#endif  
 #ifdef SUPPORT_DOLPHIN
   else if( command=="ED+" || command=="ED-" )
     {
@@ -925,6 +1202,20 @@ void iecDrive::execute(const char *cmd, uint8_t cmdLen)
       uint8_t data[3] = {0x98, 0, 0x02};
       setStatus((char *) data, 3);
     }
+#endif
+#if defined(SUPPORT_JIFFY) || defined(SUPPORT_DOLPHIN) || defined(SUPPORT_EPYX) || defined(SUPPORT_FASTSER)
+  else if( mstr::startsWith(command, "EB") && command.size()>2 && isdigit(command[2]) )
+    {
+      // EB<n>: bytes per fastload block read for this drive, EB0 goes back to the default
+      int size = atoi(command.c_str()+2);
+      if( size>IEC_MAX_FASTLOAD_BUFFER_SIZE )
+        setStatusCode(ST_SYNTAX_ERROR_31);
+      else
+        {
+          setFastLoadBufferSize(size);
+          setStatusCode(ST_OK);
+        }
+    }
 #endif
   else
     {
@@ -1122,6 +1413,7 @@ void iecDrive::execute(const char *cmd, uint8_t cmdLen)
                     delete dir;
                   }
 
+                if( n>0 ) iecChannelHandlerDir::clearCache();
                 setStatusCode(ST_SCRATCHED, n);
                 return;
             }
@@ -1234,7 +1526,10 @@ void iecDrive::execute(const char *cmd, uint8_t cmdLen)
                   else if( !f->isWritable )
                     setStatusCode(ST_WRITE_PROTECT);
                   else if( f->mkDir() )
-                    setStatusCode(ST_OK);
+                    {
+                      iecChannelHandlerDir::clearCache();
+                      setStatusCode(ST_OK);
+                    }
                   else
                     setStatusCode(ST_WRITE_ERROR);
 
@@ -1259,7 +1554,10 @@ void iecDrive::execute(const char *cmd, uint8_t cmdLen)
                   else if( !f->isWritable )
                     setStatusCode(ST_WRITE_PROTECT);
                   else if( f->rmDir() )
-                    setStatusCode(ST_OK);
+                    {
+                      iecChannelHandlerDir::clearCache();
+                      setStatusCode(ST_OK);
+                    }
                   else
                     setStatusCode(ST_WRITE_ERROR);
 
@@ -1434,6 +1732,48 @@ void iecDrive::reset()
 }
 
 
+#if defined(SUPPORT_EPYX) && defined(SUPPORT_EPYX_SECTOROPS)
+D64MStream *iecDrive::getSectorImage()
+{
+  // sector level tools work on the disk itself, i.e. the image we are cd'ed into
+  if( m_cwd==nullptr || m_cwd->streamFile==nullptr || !m_cwd->isDirectory() )
+    return nullptr;
+
+  std::string url = m_cwd->streamFile->url;
+  if( !MFileSystem::byExtension({".d64", ".d41"}, url) )
+    return nullptr;
+
+  return ImageBroker::obtain<D64MStream>(url);
+}
+
+
+bool iecDrive::epyxReadSector(uint8_t track, uint8_t sector, uint8_t *buffer)
+{
+  D64MStream *image = getSectorImage();
+  if( image==nullptr || !image->readBlock(track, sector, buffer) )
+    {
+      Debug_printv("Epyx sector read failed: track[%d] sector[%d]", track, sector);
+      return false;
+    }
+
+  return true;
+}
+
+
+bool iecDrive::epyxWriteSector(uint8_t track, uint8_t sector, uint8_t *buffer)
+{
+  D64MStream *image = getSectorImage();
+  if( image==nullptr || !image->writeBlock(track, sector, buffer) )
+    {
+      Debug_printv("Epyx sector write failed: track[%d] sector[%d]", track, sector);
+      return false;
+    }
+
+  return true;
+}
+#endif
+
+
 void iecDrive::set_cwd(std::string path)
 {
     // Isolate path
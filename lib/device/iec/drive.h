@@ -8,6 +8,10 @@
 #include <unordered_map>
 #include <esp_rom_crc.h>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
 #include "../../bus/iec/IECFileDevice.h"
 #include "../../media/media.h"
 #include "../meatloaf/meatloaf.h"
@@ -26,6 +30,7 @@
 #define PRODUCT_ID "MEATLOAF CBM"
 
 class iecDrive;
+class D64MStream;
 
 class iecChannelHandler
 {
@@ -43,7 +48,9 @@ class iecChannelHandler
  protected:
   iecDrive *m_drive;
   uint8_t  *m_data;
+  const uint8_t *m_span; // data read from instead of m_data when the stream hands out its own
   size_t    m_len, m_ptr;
+  uint8_t   m_request; // bytes asked for by the last read(), >1 when a fastloader is transferring
 };
 
 
@@ -55,13 +62,24 @@ class iecChannelHandlerFile : public iecChannelHandler
 
   virtual uint8_t readBufferData();
   virtual uint8_t writeBufferData();
-  virtual MStream *getStream() override { return m_stream; };
+  virtual MStream *getStream() override;
 
  private:
+  void startPrefetch();
+  void finishPrefetch();
+  static void prefetchTask(void *arg);
+
   MStream  *m_stream;
   int       m_fixLoadAddress;
   uint32_t  m_byteCount;
   uint64_t  m_timeStart, m_transportTimeUS;
+
+  // Read-ahead: while m_data is sent to the computer a task fills m_next from the stream
+  uint8_t  *m_next;
+  size_t    m_nextLen, m_chunkSize;
+  bool      m_nextEos, m_prefetching, m_stopPrefetch;
+  TaskHandle_t      m_prefetchTask;
+  SemaphoreHandle_t m_prefetchDone;
 };
 
 
@@ -74,12 +92,21 @@ class iecChannelHandlerDir : public iecChannelHandler
   virtual uint8_t readBufferData();
   virtual uint8_t writeBufferData();
 
+  // Rendered listings are kept per drive and directory, so a repeated LOAD"$"
+  // doesn't have to query the file system again
+  static bool isCached(iecDrive *drive, MFile *dir);
+  static void clearCache();
+
  private:
   void addExtraInfo(std::string title, std::string text);
   
   MFile   *m_dir;
   uint8_t  m_headerLine;
   std::vector<std::string> m_headers;
+
+  std::string m_cacheKey, m_listing;
+  size_t      m_listingPos;
+  bool        m_cached, m_recording;
 };
 
 
@@ -270,6 +297,16 @@ class iecDrive : public IECFileDevice
   // called on falling edge of RESET line
   virtual void reset();
 
+#if defined(SUPPORT_EPYX) && defined(SUPPORT_EPYX_SECTOROPS)
+  // called for Epyx FastLoad sector operations (disk editor, disk copy, file copy),
+  // buffer holds 256 bytes
+  virtual bool epyxReadSector(uint8_t track, uint8_t sector, uint8_t *buffer);
+  virtual bool epyxWriteSector(uint8_t track, uint8_t sector, uint8_t *buffer);
+
+  // 1541 disk image in the current directory that sector operations go to, or nullptr
+  D64MStream *getSectorImage();
+#endif
+
   void set_cwd(std::string path);
 
   std::unique_ptr<MFile> m_cwd;   // current working directory
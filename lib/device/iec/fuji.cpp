@@ -19,6 +19,7 @@
 #include "fnConfig.h"
 #include "fsFlash.h"
 #include "fnWiFi.h"
+#include "fujiAppKeys.h"
 #include "network.h"
 #include "led.h"
 #include "siocpm.h"
@@ -1054,14 +1055,6 @@ void iecFuji::set_boot_mode(uint8_t boot_device, bool should_boot_config)
     boot_config = should_boot_config;
 }
 
-char *_generate_appkey_filename(appkey *info)
-{
-    static char filenamebuf[30];
-
-    snprintf(filenamebuf, sizeof(filenamebuf), "/FujiNet/%04hx%02hhx%02hhx.key", info->creator, info->app, info->key);
-    return filenamebuf;
-}
-
 /*
  Opens an "app key".  This just sets the needed app key parameters (creator, app, key, mode)
  for the subsequent expected read/write command. We could've added this information as part
@@ -1144,7 +1137,7 @@ void iecFuji::open_app_key(uint16_t creator, uint8_t app, uint8_t key, appkey_mo
 
     Debug_printf("App key creator = 0x%04hx, app = 0x%02hhx, key = 0x%02hhx, mode = %hhu, filename = \"%s\"\r\n",
                  _current_appkey.creator, _current_appkey.app, _current_appkey.key, _current_appkey.mode,
-                 _generate_appkey_filename(&_current_appkey));
+                 fujiAppKeys::filename(_current_appkey.creator, _current_appkey.app, _current_appkey.key).c_str());
 
 }
 
@@ -1269,28 +1262,16 @@ void iecFuji::write_app_key_raw()
     set_fuji_iec_status(0, "");
 }
 
+// The key reaches the card a little later, see fujiAppKeys
 int iecFuji::write_app_key(std::vector<uint8_t>&& value)
 {
-    char *filename = _generate_appkey_filename(&_current_appkey);
+    fnAppKeys.write(_current_appkey.creator, _current_appkey.app, _current_appkey.key, value.data(), value.size());
 
     // Reset the app key data so we require calling APPKEY OPEN before another attempt
     _current_appkey.creator = 0;
     _current_appkey.mode = APPKEYMODE_INVALID;
 
-    Debug_printf("Writing appkey to \"%s\"\r\n", filename);
-
-    // Make sure we have a "/FujiNet" directory, since that's where we're putting these files
-    fnSDFAT.create_path("/FujiNet");
-
-    FILE *fOut = fnSDFAT.file_open(filename, FILE_WRITE);
-    if (fOut == nullptr)
-    {
-        Debug_printf("Failed to open/create output file: errno=%d\r\n", errno);
-        return -1;
-    }
-    size_t count = fwrite(value.data(), 1, value.size(), fOut);
-    fclose(fOut);
-    return count;
+    return value.size();
 }
 
 /*
@@ -1318,11 +1299,8 @@ void iecFuji::read_app_key_basic()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
-    Debug_printf("Reading appkey from \"%s\"\r\n", filename);
-
     std::vector<uint8_t> response_data;
-    if (read_app_key(filename, response_data) == -1) {
+    if (read_app_key(response_data) == -1) {
         Debug_println("Failed to read appkey file");
         response = "failed to read appkey file";
         set_fuji_iec_status(DEVICE_ERROR, response);
@@ -1356,10 +1334,7 @@ void iecFuji::read_app_key_raw()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
-    Debug_printf("Reading appkey from \"%s\"\r\n", filename);
-
-    if (read_app_key(filename, responseV) == -1) {
+    if (read_app_key(responseV) == -1) {
         Debug_println("Failed to read appkey file");
         set_fuji_iec_status(DEVICE_ERROR, "failed to read appkey file");
         return;
@@ -1373,24 +1348,19 @@ void iecFuji::read_app_key_raw()
     set_fuji_iec_status(0, "");
 }
 
-int iecFuji::read_app_key(char *filename, std::vector<uint8_t>& file_data)
+int iecFuji::read_app_key(std::vector<uint8_t>& file_data)
 {
-    FILE *fIn = fnSDFAT.file_open(filename, "r");
-    if (fIn == nullptr)
+    file_data.resize(appkey_size);
+    int count = fnAppKeys.read(_current_appkey.creator, _current_appkey.app, _current_appkey.key,
+                               file_data.data(), file_data.size());
+    if (count < 0)
     {
-        std::ostringstream oss;
-        oss << "Failed to open input file: errno=" << errno;
-        response = oss.str();
-        set_fuji_iec_status(DEVICE_ERROR, response);
+        file_data.clear();
         return -1;
     }
 
-    file_data.resize(appkey_size);
-    size_t count = fread(file_data.data(), 1, file_data.size(), fIn);
     file_data.resize(count);
-    Debug_printf("Read %u bytes from input file\r\n", (unsigned)count);
-    fclose(fIn);
-
+    Debug_printf("Read %d bytes of app key\r\n", count);
     return count;
 }
 
@@ -1823,7 +1793,7 @@ void iecFuji::write_host_slots_basic()
     _fnHosts[hostSlot].set_hostname(hostname.c_str());
 
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 
     response = "ok";
     set_fuji_iec_status(0, response);
@@ -1845,7 +1815,7 @@ void iecFuji::write_host_slots_raw()
         _fnHosts[i].set_hostname(hostnameBuffer);
     }
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
     set_fuji_iec_status(0, "");
 }
 
@@ -1980,7 +1950,7 @@ void iecFuji::write_device_slots()
 {
     // it is assumed the data has been parsed at this point
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 }
 
 // Temporary(?) function while we move from old config storage to new
@@ -2130,7 +2100,7 @@ void iecFuji::set_device_filename(uint8_t slot, uint8_t host, uint8_t mode, std:
     _fnDisks[slot].access_mode = mode;
     _populate_config_from_slots();
 
-    Config.save();
+    Config.save_later();
 }
 
 void iecFuji::get_device_filename_basic()
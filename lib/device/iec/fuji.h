@@ -292,7 +292,7 @@ protected:
     void write_app_key_raw();
 
     // 0xDD
-    int read_app_key(char *filename, std::vector<uint8_t>& file_data);
+    int read_app_key(std::vector<uint8_t>& file_data);
     void read_app_key_basic();
     void read_app_key_raw();
 
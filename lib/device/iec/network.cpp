@@ -14,6 +14,7 @@
 #include "../../hardware/led.h"
 
 #include "utils.h"
+#include "fnDNS.h"
 
 #include "status_error_codes.h"
 #include "NetworkProtocolFactory.h"
@@ -101,6 +102,9 @@ void iecNetwork::iec_open()
     channel_data.protocol.reset();
     channel_data.urlParser = std::move(PeoplesUrlParser::parseURL(channel_data.deviceSpec));
 
+    if (channel_data.urlParser->isValidUrl())
+        dns_prefetch(channel_data.urlParser->host);
+
     // Convert scheme to uppercase
     std::transform(channel_data.urlParser->scheme.begin(), channel_data.urlParser->scheme.end(), channel_data.urlParser->scheme.begin(), 
                    [](unsigned char c) { return std::toupper(c); });
@@ -244,7 +244,7 @@ void iwmDisk::process(iwm_decoded_cmd_t cmd)
   switch (cmd.command)
   {
   case SP_CMD_STATUS:
-    Debug_printf("\r\nhandling status command");
+    Debug_tracef("\r\nhandling status command");
     status_code = get_status_code(cmd); // (cmd.g7byte3 & 0x7f) | ((cmd.grp7msb << 3) & 0x00); // status codes 00-FF
     // max regular status code is 0x05 to UniDisk
     if (disk_num == '0' && status_code > 0x05) {
@@ -257,13 +257,17 @@ void iwmDisk::process(iwm_decoded_cmd_t cmd)
     }
     break;
   case SP_CMD_READBLOCK:
-    Debug_printf("\r\nhandling read block command");
+    Debug_tracef("\r\nhandling read block command");
     iwm_readblock(cmd);
     break;
   case SP_CMD_WRITEBLOCK:
-    Debug_printf("\r\nhandling write block command");
+    Debug_tracef("\r\nhandling write block command");
     iwm_writeblock(cmd);
     break;
+  case SP_CMD_READ:
+    Debug_tracef("\r\nhandling multi-block read command");
+    iwm_readblocks(cmd);
+    break;
   case SP_CMD_FORMAT:
     iwm_return_noerror();
     break;
@@ -293,7 +297,7 @@ void iwmDisk::iwm_readblock(iwm_decoded_cmd_t cmd)
   // uint8_t source;
 
   // source = cmd.dest; // we are the destination and will become the source // packet_buffer[6];
-  Debug_printf("\r\nDrive %02x ", id());
+  Debug_tracef("\r\nDrive %02x ", id());
   
 
   
@@ -308,26 +312,13 @@ void iwmDisk::iwm_readblock(iwm_decoded_cmd_t cmd)
   // block_num = block_num + (((LBL & 0x7f) | (((unsigned short)LBH << 4) & 0x80)) << 8);
   // block_num = block_num + (((LBT & 0x7f) | (((unsigned short)LBH << 5) & 0x80)) << 16);
   block_num = get_block_number(cmd);
-  Debug_printf(" Read block %06lx\r\n", block_num);
-  if (!(_disk != nullptr))
+  Debug_tracef(" Read block %06lx\r\n", block_num);
+  uint8_t err = read_check(block_num);
+  if (err != SP_ERR_NOERROR)
   {
-    Debug_printf(" - ERROR - No image mounted");
-    send_reply_packet(SP_ERR_OFFLINE);
-    return;
-  }
-  if((!device_active)) {
-    Debug_printf("iwm_readblock while device offline!\r\n");
-    send_reply_packet(SP_ERR_OFFLINE);
-    return;
-  }
-  if((switched) && (block_num > 2)){
-    Debug_printf("iwm_readblock() returning disk switched error\r\n");
-    send_reply_packet(SP_ERR_OFFLINE);
-    switched = false;
+    send_reply_packet(err);
     return;
   }
-  Debug_printf("iwm_readblock NORMAL READ\r\n");
-  switched = false; //if we made it here it's ok to reset switched
 
   sdstato = BLOCK_DATA_LEN;
   if (_disk->read(block_num, &sdstato, data_buffer))
@@ -338,11 +329,71 @@ void iwmDisk::iwm_readblock(iwm_decoded_cmd_t cmd)
   }
   
   // send_data_packet();
-  Debug_printf("\r\nsending block packet ...");
+  Debug_tracef("\r\nsending block packet ...");
   if (IWM.iwm_send_packet(id(), iwm_packet_type_t::data, 0, data_buffer, BLOCK_DATA_LEN))
    ((MediaTypePO*)_disk)->reset_seek_opto();  // force seek next time if send error
 }
 
+// Whether block_num can be read now, SP_ERR_NOERROR or the error to reply with
+uint8_t iwmDisk::read_check(uint32_t block_num)
+{
+  if (!(_disk != nullptr))
+  {
+    Debug_printf(" - ERROR - No image mounted");
+    return SP_ERR_OFFLINE;
+  }
+  if((!device_active)) {
+    Debug_printf("iwm_readblock while device offline!\r\n");
+    return SP_ERR_OFFLINE;
+  }
+  if((switched) && (block_num > 2)){
+    Debug_printf("iwm_readblock() returning disk switched error\r\n");
+    switched = false;
+    return SP_ERR_OFFLINE;
+  }
+  Debug_tracef("iwm_readblock NORMAL READ\r\n");
+  switched = false; //if we made it here it's ok to reset switched
+  return SP_ERR_NOERROR;
+}
+
+void iwmDisk::iwm_readblocks(iwm_decoded_cmd_t cmd)
+{
+  uint16_t numbytes = get_numbytes(cmd);
+  uint32_t block_num = get_address(cmd);
+  uint16_t blocks = numbytes / BLOCK_DATA_LEN;
+
+  Debug_tracef("\r\nDrive %02x Read %u blocks from %06lx\r\n", id(), blocks, block_num);
+  if (blocks == 0 || blocks > IWM_MULTIBLOCK_MAX || numbytes % BLOCK_DATA_LEN != 0)
+  {
+    send_reply_packet(SP_ERR_BADCMD);
+    return;
+  }
+
+  uint8_t err = read_check(block_num);
+  if (err != SP_ERR_NOERROR)
+  {
+    send_reply_packet(err);
+    return;
+  }
+
+  // the run is normally all in the readahead window already, so the packets go out back to back
+  for (uint16_t i = 0; i < blocks; i++)
+  {
+    uint16_t sdstato = BLOCK_DATA_LEN;
+    if (_disk->read(block_num + i, &sdstato, data_buffer))
+    {
+      Debug_printf("\r\nFile Seek or Read err on block %06lx", block_num + i);
+      send_reply_packet(SP_ERR_IOERROR);
+      return;
+    }
+    if (IWM.iwm_send_packet(id(), iwm_packet_type_t::data, 0, data_buffer, BLOCK_DATA_LEN))
+    {
+      ((MediaTypePO*)_disk)->reset_seek_opto();
+      return;
+    }
+  }
+}
+
 void iwmDisk::iwm_writeblock(iwm_decoded_cmd_t cmd)
 {
   uint8_t status = 0;
@@ -350,13 +401,13 @@ void iwmDisk::iwm_writeblock(iwm_decoded_cmd_t cmd)
  
  //  uint8_t source = cmd.dest; // packet_buffer[6];
   // to do - actually we will already know that the cmd.dest == id(), so can just use id() here
-  Debug_printf("\r\nDrive %02x ", id());
+  Debug_tracef("\r\nDrive %02x ", id());
   //Added (unsigned short) cast to ensure calculated block is not underflowing.
   uint32_t block_num = get_block_number(cmd); // (cmd.g7byte3 & 0x7f) | (((unsigned short)cmd.grp7msb << 3) & 0x80);
   // block num second byte
   //Added (unsigned short) cast to ensure calculated block is not underflowing.
   // block_num = block_num + (((cmd.g7byte4 & 0x7f) | (((unsigned short)cmd.grp7msb << 4) & 0x80)) * 256);
-  Debug_printf("Write block %06lx", block_num);
+  Debug_tracef("Write block %06lx", block_num);
   //get write data packet, keep trying until no timeout
   // to do - this blows up - check handshaking
   data_len = BLOCK_DATA_LEN;
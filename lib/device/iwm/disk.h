@@ -5,6 +5,18 @@
 #include "bus.h"
 #include "../media/media.h"
 
+/*
+ * FujiNet multi-block read: a SmartPort READ to a disk with a byte count of
+ * n * 512 and the first block number as the address is answered with n data
+ * packets, one per block, and a status packet in place of the rest if a read
+ * fails. The relay protocol has one reply per request, so n is 1 there.
+ */
+#ifdef DEV_RELAY_SLIP
+#define IWM_MULTIBLOCK_MAX 1
+#else
+#define IWM_MULTIBLOCK_MAX PO_READAHEAD_BLOCKS
+#endif
+
 class iwmDisk : public iwmDevice
 {
 private:
@@ -27,6 +39,8 @@ protected:
     void iwm_ctrl(iwm_decoded_cmd_t cmd) override;
     void iwm_readblock(iwm_decoded_cmd_t cmd) override;
     void iwm_writeblock(iwm_decoded_cmd_t cmd) override;
+    void iwm_readblocks(iwm_decoded_cmd_t cmd);
+    uint8_t read_check(uint32_t block_num);
     uint32_t get_block_number(iwm_decoded_cmd_t cmd) {return cmd.params[2] + (cmd.params[3] << 8) + (cmd.params[4] << 16); };
 
     // void derive_percom_block(uint16_t numSectors);
@@ -13,6 +13,8 @@
 
 #define NS_PER_BIT_TIME 125
 #define BLANK_TRACK_LEN 6400
+// Quarter tracks either side of the head kept loaded, one whole track each way
+#define PREFETCH_QUARTER_TRACKS 4
 
 const int8_t phase2seq[16] = {-1, 0, 2, 1, 4, -1, 3, -1, 6, 7, -1, -1, 5, -1, -1, -1};
 const int8_t seq2steps[8] = {0, 1, 2, 3, 0, -3, -2, -1};
@@ -78,6 +80,7 @@ mediatype_t iwmDisk2::mount_file(fnFile *f, uint32_t disksize, mediatype_t disk_
     }
 
     if (mt == MEDIATYPE_WOZ) {
+        ((MediaTypeWOZ *)_disk)->load_track(track_pos, track_pos);
         change_track(0); // initialize spi buffer
     } else {
         Debug_printf("\nMedia Type UNKNOWN - no mount in disk2.cpp");
@@ -142,14 +145,18 @@ void IRAM_ATTR iwmDisk2::change_track(int indicator)
 #ifndef DEV_RELAY_SLIP
   // need to tell diskii_xface the number of bits in the track
   // and where the track data is located so it can convert it
-  if (((MediaTypeWOZ *)_disk)->trackmap(track_pos) != 255)
+  MediaTypeWOZ *woz = (MediaTypeWOZ *)_disk;
+  TRK_bitstream *bitstream = nullptr;
+  woz->lock_tracks();
+  if (woz->trackmap(track_pos) != 255)
+    bitstream = woz->get_track(track_pos);
+  if (bitstream != nullptr && bitstream->len_bits)
   {
-    TRK_bitstream *bitstream = ((MediaTypeWOZ *)_disk)->get_track(track_pos);
     diskii_xface.copy_track(
         bitstream->data,
         bitstream->len_bytes,
         bitstream->len_bits,
-        NS_PER_BIT_TIME * ((MediaTypeWOZ *)_disk)->optimal_bit_timing);
+        NS_PER_BIT_TIME * woz->optimal_bit_timing);
     // This printf nudges timing too much.
     // Debug_printf("\nCopy track: %d", track_pos);
   }
@@ -158,11 +165,48 @@ void IRAM_ATTR iwmDisk2::change_track(int indicator)
         nullptr, 
         BLANK_TRACK_LEN, 
         BLANK_TRACK_LEN * 8, 
-        NS_PER_BIT_TIME * ((MediaTypeWOZ *)_disk)->optimal_bit_timing);
+        NS_PER_BIT_TIME * woz->optimal_bit_timing);
+  woz->unlock_tracks();
+  // A track that hasn't been read from the image yet reads blank until service_tracks() has it
+  track_pending = woz->trackmap(track_pos) != 255 && bitstream == nullptr;
 #endif // !SLIP
   // Since the empty track has no data, and therefore no length, using a fake length of 51,200 bits (6400 bytes) works very well.
 }
 
+void iwmDisk2::service_tracks()
+{
+  if (!device_active || _disk == nullptr)
+    return;
+
+  MediaTypeWOZ *woz = (MediaTypeWOZ *)_disk;
+  int pos = track_pos;
+
+  // The head is on a track that isn't in memory, get it there now
+  if (!woz->track_loaded(pos))
+  {
+    if (!woz->load_track(pos, pos) && woz->track_loaded(pos) && pos == track_pos)
+      change_track(0);
+    return;
+  }
+  woz->load_track(pos, pos); // keeps it the most recently used
+  if (track_pending && pos == track_pos)
+    change_track(0);
+
+  // Then the quarter tracks either side, nearest first and one per call so
+  // the bus loop isn't held up for long
+  for (int d = 1; d <= PREFETCH_QUARTER_TRACKS; d++)
+  {
+    for (int q : {pos + d, pos - d})
+    {
+      if (q >= 0 && q < MAX_TRACKS && !woz->track_loaded(q))
+      {
+        woz->load_track(q, pos);
+        return;
+      }
+    }
+  }
+}
+
 bool iwmDisk2::write_sector(int track, int sector, uint8_t* buffer)
 {
   return _disk->write_sector(track, sector, buffer);
@@ -25,6 +25,7 @@ protected:
     int track_pos;
     int old_pos;
     uint8_t oldphases;
+    volatile bool track_pending = false; // the head is on a track that isn't loaded yet
 
 public:
     iwmDisk2();
@@ -36,6 +37,8 @@ public:
     bool phases_valid(uint8_t phases);
     bool move_head();
     void change_track(int indicator);
+    // Reads the track under the head and the ones near it from the image; call from the bus loop
+    void service_tracks();
     // void set_disk_number(char c) { disk_num = c; }
     // char get_disk_number() { return disk_num; };
 
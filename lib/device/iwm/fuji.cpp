@@ -14,9 +14,14 @@
 #include "httpService.h"
 #include "fnSystem.h"
 #include "fnConfig.h"
+#include "fnFilePreload.h"
+#include "fnFileWriteback.h"
+#include "fujiCopyTask.h"
+#include "fujiMountAll.h"
 #include "led.h"
 #include "fnWiFi.h"
 #include "fsFlash.h"
+#include "fujiAppKeys.h"
 #include "fnFsTNFS.h"
 #include "utils.h"
 #include "string_utils.h"
@@ -132,6 +137,7 @@ iwmFuji::iwmFuji()
         { FUJICMD_QRCODE_OUTPUT, [this]()              { this->iwm_stat_qrcode_output(); }},                    // 0xBE
         { FUJICMD_STATUS, [this]()                     { this->iwm_stat_fuji_status(); }},                      // 0x53
         { FUJICMD_GET_HEAP, [this]()                   { this->iwm_stat_get_heap(); }},                         // 0xC1
+        { FUJICMD_COPY_FILE_STATUS, [this]()           { this->iwm_stat_copy_file_status(); }},                 // 0xEC
     };
 
 }
@@ -367,7 +373,7 @@ uint8_t iwmFuji::iwm_ctrl_disk_image_mount() // SP CTRL command
 
 	// TODO: Implement FETCH?
 	char flag[4] = {'r', 'b', 0, 0};
-	if (options == DISK_ACCESS_MODE_WRITE)
+	if (options & DISK_ACCESS_MODE_WRITE)
 		flag[2] = '+';
 
 	// A couple of reference variables to make things much easier to read...
@@ -392,12 +398,19 @@ uint8_t iwmFuji::iwm_ctrl_disk_image_mount() // SP CTRL command
 	// We need the file size for loading XEX files and for CASSETTE, so get that too
 	disk.disk_size = host.file_size(disk.fileh);
 
+	// Keep network round trips for writes out of the SmartPort timing window
+	if ((options & DISK_ACCESS_MODE_WRITE) && host.get_type() != HOSTTYPE_LOCAL)
+		disk.fileh = FileHandlerWriteback::wrap(disk.fileh, disk.disk_size);
+
+	if (options & DISK_ACCESS_MODE_PRELOAD)
+		disk.fileh = FileHandlerPreload::wrap(disk.fileh, disk.disk_size);
+
 	// special handling for Disk ][ .woz images
 	// mediatype_t mt = MediaType::discover_mediatype(disk.filename);
 	// if (mt == mediatype_t::MEDIATYPE_PO)
 	// { // And now mount it
 
-	if (options == DISK_ACCESS_MODE_WRITE)
+	if (options & DISK_ACCESS_MODE_WRITE)
 	{
 		disk_dev->readonly = false;
 	}
@@ -424,22 +437,30 @@ void iwmFuji::iwm_ctrl_set_boot_config() // SP CTRL command
 }
 
 // Do SIO copy
+// data_buffer[0] = source host slot, data_buffer[1] = destination host slot. With
+// FUJI_COPY_BACKGROUND set in the destination the copy runs in the background,
+// poll FUJICMD_COPY_FILE_STATUS for progress
 void iwmFuji::iwm_ctrl_copy_file()
 {
 	std::string copySpec;
 	std::string sourcePath;
 	std::string destPath;
-	fnFile *sourceFile;
-	fnFile *destFile;
-	char *dataBuf;
 	unsigned char sourceSlot;
 	unsigned char destSlot;
+	bool background;
 
 	sourceSlot = data_buffer[0];
-	destSlot = data_buffer[1];
+	destSlot = data_buffer[1] & ~FUJI_COPY_BACKGROUND;
+	background = data_buffer[1] & FUJI_COPY_BACKGROUND;
 	copySpec = std::string((char *)&data_buffer[2]);
 	Debug_printf("copySpec: %s\n", copySpec.c_str());
 
+	if (sourceSlot >= MAX_HOSTS || destSlot >= MAX_HOSTS || copySpec.find_first_of("|") == std::string::npos)
+	{
+		err_result = SP_ERR_BADCTL;
+		return;
+	}
+
 	// Chop up copyspec.
 	sourcePath = copySpec.substr(0, copySpec.find_first_of("|"));
 	destPath = copySpec.substr(copySpec.find_first_of("|") + 1);
@@ -452,26 +473,23 @@ void iwmFuji::iwm_ctrl_copy_file()
 		destPath += sourceFilename;
 	}
 
-	// Mount hosts, if needed.
-	_fnHosts[sourceSlot].mount();
-	_fnHosts[destSlot].mount();
-
-	// Open files...
-	sourceFile = _fnHosts[sourceSlot].fnfile_open(sourcePath.c_str(), (char *)sourcePath.c_str(), sourcePath.size() + 1, "rb");
-	destFile = _fnHosts[destSlot].fnfile_open(destPath.c_str(), (char *)destPath.c_str(), destPath.size() + 1, "wb");
-
-	dataBuf = (char *)malloc(532);
-	size_t count = 0;
-	do
+	if (background)
 	{
-		count = fnio::fread(dataBuf, 1, 532, sourceFile);
-		fnio::fwrite(dataBuf, 1, count, destFile);
-	} while (count > 0);
+		if (!fujiCopyTask::submit(&_fnHosts[sourceSlot], sourcePath, &_fnHosts[destSlot], destPath))
+			err_result = SP_ERR_IOERROR;
+		return;
+	}
 
-	// copyEnd:
-	fnio::fclose(sourceFile);
-	fnio::fclose(destFile);
-	free(dataBuf);
+	fujiCopyTask copy(&_fnHosts[sourceSlot], sourcePath, &_fnHosts[destSlot], destPath);
+	if (!copy.run())
+		err_result = SP_ERR_IOERROR;
+}
+
+// State, bytes copied and total bytes of the last copy
+void iwmFuji::iwm_stat_copy_file_status()
+{
+	fujiCopyTask::status_bytes(data_buffer);
+	data_len = FUJI_COPY_STATUS_LEN;
 }
 
 // Mount all
@@ -479,42 +497,40 @@ bool iwmFuji::mount_all()
 {
 	bool nodisks = true; // Check at the end if no disks are in a slot and disable config
 
+	fujiSlotOpen opened[MAX_DISK_DEVICES];
+	fuji_open_slots(_fnDisks, MAX_DISK_DEVICES, _fnHosts, "rb", opened);
+
 	for (int i = 0; i < MAX_DISK_DEVICES; i++)
 	{
 		fujiDisk &disk = _fnDisks[i];
 		fujiHost &host = _fnHosts[disk.host_slot];
 		DEVICE_TYPE *disk_dev = get_disk_dev(i);
-		char flag[4] = {'r', 'b', 0, 0};
-		if (disk.access_mode == DISK_ACCESS_MODE_WRITE)
-			flag[2] = '+';
 
-        if (disk.host_slot != INVALID_HOST_SLOT && strlen(disk.filename) > 0)
+		if (opened[i].wanted)
 		{
 			nodisks = false; // We have a disk in a slot
 
-			if (host.mount() == false)
-			{
-				return true;
-			}
-
-			Debug_printf("Selecting '%s' from host #%u as %s on D%u:\n", disk.filename, disk.host_slot, flag, i + 1);
-
-			disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), flag);
-
-			if (disk.fileh == nullptr)
+			disk.fileh = opened[i].fileh;
+			if (!opened[i].host_ok || disk.fileh == nullptr)
 			{
+				fuji_close_slots(opened, i + 1, MAX_DISK_DEVICES);
 				return true;
 			}
 
 			// We've gotten this far, so make sure our bootable CONFIG disk is disabled
 			boot_config = false;
 
-			// We need the file size for loading XEX files and for CASSETTE, so get that too
-			disk.disk_size = host.file_size(disk.fileh);
+			disk.disk_size = opened[i].size;
+
+			if ((disk.access_mode & DISK_ACCESS_MODE_WRITE) && host.get_type() != HOSTTYPE_LOCAL)
+				disk.fileh = FileHandlerWriteback::wrap(disk.fileh, disk.disk_size);
+
+			if (disk.access_mode & DISK_ACCESS_MODE_PRELOAD)
+				disk.fileh = FileHandlerPreload::wrap(disk.fileh, disk.disk_size);
 
 			// And now mount it
 			disk.disk_type = disk_dev->mount(disk.fileh, disk.filename, disk.disk_size);
-			if (disk.access_mode == DISK_ACCESS_MODE_WRITE)
+			if (disk.access_mode & DISK_ACCESS_MODE_WRITE)
 			{
 				disk_dev->readonly = false;
 			}
@@ -540,29 +556,23 @@ void iwmFuji::iwm_ctrl_set_boot_mode()
 	boot_config = true;
 }
 
-char *_generate_appkey_filename(appkey *info)
-{
-	static char filenamebuf[30];
-
-	snprintf(filenamebuf, sizeof(filenamebuf), "/FujiNet/%04hx%02hhx%02hhx.key", info->creator, info->app, info->key);
-	return filenamebuf;
-}
-
 /*
  Opens an "app key" for reading/writing - stores appkey name for subsequent read/write calls
 */
 void iwmFuji::iwm_ctrl_open_app_key()
 {
 	int idx = 0;
-	FILE *fp;
 	uint8_t creatorL = data_buffer[idx++];
 	uint8_t creatorM = data_buffer[idx++];
 	uint8_t app = data_buffer[idx++];
 	uint8_t key = data_buffer[idx++];
 	uint8_t mode = data_buffer[idx++];
 
-	snprintf(_appkeyfilename, sizeof(_appkeyfilename), "/FujiNet/%02hhx%02hhx%02hhx%02hhx.key", creatorM, creatorL, app, key);
-	Debug_printf("\r\nFuji Cmd: OPEN APPKEY %s in mode %i\n", _appkeyfilename, mode);
+	_current_appkey.creator = (creatorM << 8) | creatorL;
+	_current_appkey.app = app;
+	_current_appkey.key = key;
+	Debug_printf("\r\nFuji Cmd: OPEN APPKEY %s in mode %i\n",
+				 fujiAppKeys::filename(_current_appkey.creator, app, key).c_str(), mode);
 
 	// If reading, we will update the control stat length for the subsequent read_app_key status call
 	if (mode == 1) return;	// write mode
@@ -570,8 +580,8 @@ void iwmFuji::iwm_ctrl_open_app_key()
 	// set the appkey_size according to the mode, if mode is unknown, default to 64
 	appkey_size = get_value_or_default(mode_to_keysize, mode, 64);
 
-	fp = fnSDFAT.file_open(_appkeyfilename, "r");
-	if (fp == nullptr)
+	int count = fnAppKeys.read(_current_appkey.creator, app, key, ctrl_stat_buffer, appkey_size);
+	if (count < 0)
 	{
 		Debug_printf("iwm_ctrl_open_app_key ERROR: Could not read from SD Card.\r\n");
 
@@ -585,35 +595,17 @@ void iwmFuji::iwm_ctrl_open_app_key()
 	// memset(ctrl_stat_buffer, 0, sizeof(ctrl_stat_buffer));
 
 	// Read in the app key file data, to be sent in read_app_key call
-	ctrl_stat_len = fread(ctrl_stat_buffer, sizeof(char), appkey_size, fp);
-	fclose(fp);
-
+	ctrl_stat_len = count;
 }
 
 /*
- Write an "app key" to SD (ONLY!) storage.
+ Write an "app key" to SD (ONLY!) storage. It reaches the card a little later, see fujiAppKeys
 */
 void iwmFuji::iwm_ctrl_write_app_key()
 {
-	FILE *fp;
-    std::vector<uint8_t> data(appkey_size, 0);
-    std::copy(&data_buffer[0], &data_buffer[0] + data_len, data.begin());
-
 	Debug_printf("\r\nFuji Cmd: WRITE APPKEY\n");
 
-
-	// Make sure we have a "/FujiNet" directory, since that's where we're putting these files
-	fnSDFAT.create_path("/FujiNet");
-
-	fp = fnSDFAT.file_open(_appkeyfilename, "w");
-	if (fp == nullptr)
-	{
-		Debug_printf("iwm_ctrl_write_app_key ERROR: Could not write to SD Card.\r\n");
-		return;
-	}
-
-	fwrite(data.data(), sizeof(uint8_t), data_len, fp);
-	fclose(fp);
+	fnAppKeys.write(_current_appkey.creator, _current_appkey.app, _current_appkey.key, data_buffer, data_len);
 }
 
 /*
@@ -1025,7 +1017,10 @@ void iwmFuji::iwm_ctrl_new_disk()
 	disk.access_mode = DISK_ACCESS_MODE_WRITE;
 	strlcpy(disk.filename, (const char *)p, 256);
 
-	disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), "wb");
+	// Reserve a ProDOS image in one contiguous run if the host can, and fill it in place.
+	// DOS 3.3 images are copied from a template of their own size
+	bool reserved = t != 2 && !host.file_preallocate(disk.filename, numBlocks * 512);
+	disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), reserved ? FILE_READ_WRITE : FILE_WRITE);
 
 	Debug_printf("Creating file %s on host slot %u mounting in disk slot %u numblocks: %lu\n", disk.filename, hs, ds, numBlocks);
 
@@ -1038,7 +1033,7 @@ void iwmFuji::iwm_ctrl_new_disk()
 	// Persist slots
 	_populate_config_from_slots();
 	Config.mark_dirty();
-	Config.save();
+	Config.save_later();
 }
 
 // Send host slot data to computer
@@ -1073,7 +1068,7 @@ void iwmFuji::iwm_ctrl_write_host_slots()
 		_fnHosts[i].set_hostname(hostSlots[i]);
 	}
 	_populate_config_from_slots();
-	Config.save();
+	Config.save_later();
 }
 
 // Store host path prefix
@@ -1147,7 +1142,7 @@ void iwmFuji::iwm_ctrl_write_device_slots()
 
 	// Save the data to disk
 	_populate_config_from_slots();
-	Config.save();
+	Config.save_later();
 }
 
 // Temporary(?) function while we move from old config storage to new
@@ -1204,7 +1199,7 @@ void iwmFuji::_populate_config_from_slots()
 			Config.clear_mount(i);
 		else
 			Config.store_mount(i, _fnDisks[i].host_slot, _fnDisks[i].filename,
-							   _fnDisks[i].access_mode == DISK_ACCESS_MODE_WRITE ? fnConfig::mount_modes::MOUNTMODE_WRITE : fnConfig::mount_modes::MOUNTMODE_READ);
+							   (_fnDisks[i].access_mode & DISK_ACCESS_MODE_WRITE) ? fnConfig::mount_modes::MOUNTMODE_WRITE : fnConfig::mount_modes::MOUNTMODE_READ);
 	}
 }
 
@@ -1595,7 +1590,7 @@ void iwmFuji::iwm_ctrl_qrcode_encode()
         url = fnHTTPD.shorten_url(url);
     }
 
-    std::vector<uint8_t> p = QRManager::encode(
+    QRManager::encode(
         url.c_str(),
         url.size(),
         qrManager.version,
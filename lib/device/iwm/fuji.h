@@ -133,7 +133,7 @@ private:
 
     uint8_t _countScannedSSIDs = 0;
 
-    char _appkeyfilename[30]; // Temp storage for appkey filename, populated by open and read by read/write
+    appkey _current_appkey; // populated by open and read by read/write
 
     uint8_t ctrl_stat_buffer[767]; // what is proper length
     size_t ctrl_stat_len = 0; // max payload length is 767
@@ -210,6 +210,7 @@ protected:
     void iwm_stat_hash_output();                  // 0xC5 write response
     void iwm_ctrl_hash_clear();                   // 0xC2
     void iwm_stat_get_heap();                     // 0xC1
+    void iwm_stat_copy_file_status();             // 0xEC
 
     void iwm_ctrl_qrcode_input();                 // 0xBC
     void iwm_ctrl_qrcode_encode();                // 0xBD
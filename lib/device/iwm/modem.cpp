@@ -12,8 +12,6 @@
 #include "fnConfig.h"
 #include "led.h"
 
-#define RECVBUFSIZE 512
-
 #define MODEM_TASK_PRIORITY 10
 #define MODEM_TASK_CPU 0
 
@@ -90,10 +88,28 @@ static void _modem_task(void *arg)
     }
 }
 
+/**
+ * The Apple's side of the modem, through the modem's IWM queues
+ */
+class iwmModemPort : public ModemPort
+{
+private:
+    iwmModem *_modem;
+
+public:
+    iwmModemPort(iwmModem *modem) : _modem(modem) {}
+
+    int available() override { return _modem->modem_available(); }
+    size_t read(uint8_t *buf, size_t len) override { return _modem->modem_read(buf, len); }
+    size_t write(const uint8_t *buf, size_t len) override { return _modem->modem_write((uint8_t *)buf, len); }
+};
+
 iwmModem::iwmModem(FileSystem *_fs, bool snifferEnable)
 {
     activeFS = _fs;
     modemSniffer = new ModemSniffer(activeFS, snifferEnable);
+    modemPort = new iwmModemPort(this);
+    modemCore = new ModemCore(modemPort, modemSniffer);
     set_term_type("dumb");
     telnet = telnet_init(telopts, _telnet_event_handler, 0, this);
 #ifdef ESP_PLATFORM // OS
@@ -105,6 +121,9 @@ iwmModem::iwmModem(FileSystem *_fs, bool snifferEnable)
 
 iwmModem::~iwmModem()
 {
+    delete modemCore;
+    delete modemPort;
+
     if (modemSniffer != nullptr)
     {
         delete modemSniffer;
@@ -179,6 +198,15 @@ unsigned short iwmModem::modem_print(int i)
     return modem_print(out);
 }
 
+unsigned short iwmModem::modem_available()
+{
+#ifdef ESP_PLATFORM // OS
+    return uxQueueMessagesWaiting(mtxq);
+#else
+    return 0;
+#endif
+}
+
 unsigned short iwmModem::modem_read(uint8_t *buf, unsigned short len)
 {
     unsigned short i, l = 0;
@@ -566,7 +594,7 @@ void iwmModem::at_handle_answer()
     if (tcpServer.hasClient())
     {
         tcpClient = tcpServer.available();
-        tcpClient.setNoDelay(true); // try to disable naggle
+        modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
                                     //        tcpServer.stop();
         answerTimer = fnSystem.millis();
         answered = false;
@@ -632,7 +660,7 @@ void iwmModem::at_handle_dial()
 
         if (tcpClient.connect(host.c_str(), portInt))
         {
-            tcpClient.setNoDelay(true); // Try to disable naggle
+            modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
             answered = false;
             answerTimer = fnSystem.millis();
             cmdMode = false;
@@ -1210,97 +1238,24 @@ void iwmModem::handle_modem()
             }
         }
 
-#ifdef ESP_PLATFORM // OS
-        int sioBytesAvail = uxQueueMessagesWaiting(mtxq);
-#else
-        int sioBytesAvail;
-#endif
-        // send from Atari to Fujinet
-        if (sioBytesAvail && tcpClient.connected())
-        {
-            // In telnet in worst case we have to escape every uint8_t
-            // so leave half of the buffer always free
-            // int max_buf_size;
-            // if (telnet == true)
-            //  max_buf_size = TX_BUF_SIZE / 2;
-            // else
-            //  max_buf_size = TX_BUF_SIZE;
-
-            // Read from serial, the amount available up to
-            // maximum size of the buffer
-            int sioBytesRead = modem_read(&txBuf[0], // SIO_UART.readBytes(&txBuf[0],
-                                          (sioBytesAvail > TX_BUF_SIZE) ? TX_BUF_SIZE : sioBytesAvail);
-
-            // Disconnect if going to AT mode with "+++" sequence
-            for (int i = 0; i < (int)sioBytesRead; i++)
-            {
-                if (txBuf[i] == '+')
-                    plusCount++;
-                else
-                    plusCount = 0;
-                if (plusCount >= 3)
-                {
-                    plusTime = fnSystem.millis();
-                }
-                if (txBuf[i] != '+')
-                {
-                    plusCount = 0;
-                }
-            }
-
-            // Write the buffer to TCP finally
-            if (use_telnet == true)
-            {
-                telnet_send(telnet, (const char *)txBuf, sioBytesRead);
-            }
-            else
-                tcpClient.write(&txBuf[0], sioBytesRead);
-
-            // And send it off to the sniffer, if enabled.
-            modemSniffer->dumpOutput(&txBuf[0], sioBytesRead);
+        // send from the computer to Fujinet
+        if (modemCore->toTcp(tcpClient, use_telnet) > 0)
             _lasttime = fnSystem.millis();
-        }
-
-        // read from Fujinet to Atari
-        unsigned char buf[RECVBUFSIZE];
-        int bytesAvail = 0;
-
-        // check to see how many bytes are avail to read
-        while ((bytesAvail = tcpClient.available()) > 0)
-        {
-            // read as many as our buffer size will take (RECVBUFSIZE)
-            unsigned int bytesRead =
-                tcpClient.read(buf, (bytesAvail > RECVBUFSIZE) ? RECVBUFSIZE : bytesAvail);
-
-            if (use_telnet == true)
-            {
-                telnet_recv(telnet, (const char *)buf, bytesRead);
-            }
-            else
-            {
-                modem_write(buf, bytesRead);
-            }
 
-            // And dump to sniffer, if enabled.
-            modemSniffer->dumpInput(buf, bytesRead);
+        // read from Fujinet to the computer
+        if (modemCore->fromTcp(tcpClient, use_telnet ? telnet : nullptr) > 0)
             _lasttime = fnSystem.millis();
-        }
     }
 
     // If we have received "+++" as last bytes from serial port and there
     // has been over a second without any more bytes, go back to command mode.
-    if (plusCount >= 3)
+    if (modemCore->escapeRequested())
     {
-        if (fnSystem.millis() - plusTime > 1000)
-        {
-            Debug_println("Going back to command mode");
+        Debug_println("Going back to command mode");
 
-            at_cmd_println("OK");
-
-            cmdMode = true;
+        at_cmd_println("OK");
 
-            plusCount = 0;
-        }
+        cmdMode = true;
     }
 
     // Go to command mode if TCP disconnected and not in command mode
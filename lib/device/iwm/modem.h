@@ -12,6 +12,7 @@
 #include "fnTcpServer.h"
 #include "fnTcpClient.h"
 #include "modem-sniffer.h"
+#include "modem-core.h"
 #include "../telnet/libtelnet.h"
 
 /* Keep strings under 40 characters, for the benefit of 40-column users! */
@@ -68,7 +69,6 @@
 
 #define RING_INTERVAL 3000 // How often to print RING when having a new incoming connection (ms)
 #define MAX_CMD_LENGTH 256 // Maximum length for AT command
-#define TX_BUF_SIZE 256    // Buffer where to read from serial before writing to TCP (that direction is very blocking by the ESP TCP stack, so we can't do one byte a time.)
 
 #define ANSWER_TIMER_MS 1000 // milliseconds to wait before issuing CONNECT command, to simulate carrier negotiation.
 
@@ -169,9 +169,6 @@ private:
     fnTcpClient tcpClient;         // Modem client
     fnTcpServer tcpServer;         // Modem server
     unsigned long lastRingMs = 0;  // Time of last "RING" message (millis())
-    char plusCount = 0;            // Go to AT mode at "+++" sequence, that has to be counted
-    unsigned long plusTime = 0;    // When did we last receive a "+++" sequence
-    uint8_t txBuf[TX_BUF_SIZE];
     bool cmdOutput=true;            // toggle whether to emit command output
     bool numericResultCode=false;   // Use numeric result codes? (ATV0)
     bool autoAnswer=false;          // Auto answer? (ATS0?)
@@ -181,6 +178,8 @@ private:
     bool answerHack=false;          // ATA answer hack on SIO write.
     FileSystem *activeFS;           // Active Filesystem for ModemSniffer.
     ModemSniffer* modemSniffer;     // ptr to modem sniffer.
+    ModemPort* modemPort;           // computer side of the data path.
+    ModemCore* modemCore;           // data path while connected.
     time_t _lasttime;               // most recent timestamp of data activity.
     telnet_t *telnet;               // telnet FSM state.
     bool use_telnet=false;          // Use telnet mode?
@@ -256,6 +255,7 @@ public:
     unsigned short modem_print(std::string s);
     unsigned short modem_print(int i);
 
+    unsigned short modem_available();
     unsigned short modem_read(uint8_t *buf, unsigned short len);
 
 //  virtual void startup_hack() override {};
@@ -14,6 +14,7 @@
 #include "../../hardware/led.h"
 
 #include "utils.h"
+#include "fnDNS.h"
 #include "string_utils.h"
 
 #include "status_error_codes.h"
@@ -953,6 +954,9 @@ void iwmNetwork::create_url_parser()
     auto& current_network_data = network_data_map[current_network_unit];
     std::string url = current_network_data.deviceSpec.substr(current_network_data.deviceSpec.find(":") + 1);
     current_network_data.urlParser = std::move(PeoplesUrlParser::parseURL(url));
+
+    if (current_network_data.urlParser->isValidUrl())
+        dns_prefetch(current_network_data.urlParser->host);
 }
 
 void iwmNetwork::parse_and_instantiate_protocol(string d)
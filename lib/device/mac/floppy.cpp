@@ -36,6 +36,7 @@ mediatype_t macFloppy::mount(FILE *f, const char *filename, uint32_t disksize, m
     mt = ((MediaTypeMOOF *)_disk)->mount(f);
     track_pos = 0;
     old_pos = 2; // makde different to force change_track buffer copy
+    floppy_ll.drop_tracks(); // buffered tracks are the last disk's
     change_track(0); // initialize rmt buffer
     change_track(1); // initialize rmt buffer
     switch (_disk->num_sides)
@@ -78,6 +79,9 @@ mediatype_t macFloppy::mount(FILE *f, const char *filename, uint32_t disksize, m
     break;
   }
 
+  if (_disk != nullptr)
+    _disk->_mediatype = mt; // disktype() goes by this
+
   return mt;
 }
 
@@ -197,15 +201,21 @@ void IRAM_ATTR macFloppy::change_track(int side)
   if (((MediaTypeMOOF *)_disk)->trackmap(op) == ((MediaTypeMOOF *)_disk)->trackmap(tp))
     return;
 
+  // a prefetched track is swapped in, otherwise
   // need to tell diskii_xface the number of bits in the track
   // and where the track data is located so it can convert it
   if (((MediaTypeMOOF *)_disk)->trackmap(tp) != 255)
-    floppy_ll.copy_track(
-        ((MediaTypeMOOF *)_disk)->get_track(tp), 
-        side,
-        ((MediaTypeMOOF *)_disk)->track_len(tp),
-        ((MediaTypeMOOF *)_disk)->num_bits(tp),
-        NS_PER_BIT_TIME * ((MediaTypeMOOF *)_disk)->optimal_bit_timing);
+  {
+    if (!floppy_ll.swap_track(((MediaTypeMOOF *)_disk)->trackmap(tp), side,
+                              NS_PER_BIT_TIME * ((MediaTypeMOOF *)_disk)->optimal_bit_timing))
+      floppy_ll.copy_track(
+          ((MediaTypeMOOF *)_disk)->get_track(tp), 
+          side,
+          ((MediaTypeMOOF *)_disk)->track_len(tp),
+          ((MediaTypeMOOF *)_disk)->num_bits(tp),
+          NS_PER_BIT_TIME * ((MediaTypeMOOF *)_disk)->optimal_bit_timing,
+          ((MediaTypeMOOF *)_disk)->trackmap(tp));
+  }
   else
     floppy_ll.copy_track(
         nullptr,
@@ -216,6 +226,38 @@ void IRAM_ATTR macFloppy::change_track(int side)
   // Since the empty track has no data, and therefore no length, using a fake length of 51,200 bits (6400 bytes) works very well.
 }
 
+void macFloppy::prefetch_tracks()
+{
+  if (!device_active || disktype() != MEDIATYPE_MOOF)
+    return;
+
+  MediaTypeMOOF *moof = (MediaTypeMOOF *)_disk;
+
+  // both sides of the cylinders either side of the head
+  int wanted[SPARE_TRACKS];
+  int wanted_pos[SPARE_TRACKS];
+  int nwanted = 0;
+  for (int tp : {track_pos + 2, track_pos - 2, track_pos + 3, track_pos - 1})
+  {
+    if (tp >= 0 && tp < MAX_TRACKS && moof->trackmap(tp) != 255 && nwanted < SPARE_TRACKS)
+    {
+      wanted[nwanted] = moof->trackmap(tp);
+      wanted_pos[nwanted++] = tp;
+    }
+  }
+
+  // one per call, the bus loop has commands to answer
+  for (int i = 0; i < nwanted; i++)
+  {
+    if (!floppy_ll.has_track(wanted[i]))
+    {
+      int tp = wanted_pos[i];
+      floppy_ll.prefetch_track(moof->get_track(tp), wanted[i], moof->track_len(tp), moof->num_bits(tp), wanted, nwanted);
+      return;
+    }
+  }
+}
+
 void macFloppy::dcd_status(uint8_t* payload)
 {
    const uint8_t icon[] = {0b11111111, 0b11111110, 0b11111111, 0b11111111,
@@ -350,6 +392,16 @@ void macFloppy::process(mac_cmd_t cmd)
     // todo: error handling
     fnUartBUS.write(buffer, sizeof(buffer));
     break;
+  case 'M':
+    // multi-block read coming: sector and count, no reply. The 'R's for the
+    // sectors that follow are then served from one read of the image
+    fnUartBUS.readBytes(s, 3);
+    sector_num = ((uint32_t)s[0] << 16) + ((uint32_t)s[1] << 8) + (uint32_t)s[2];
+    fnUartBUS.readBytes(s, 1);
+    Debug_printf("\nDCD multi-block request: %06lx x %d", sector_num, (uint8_t)s[0]);
+    if (disktype() == MEDIATYPE_DCD && ((MediaTypeDCD *)_disk)->prefetch(sector_num, (uint8_t)s[0]))
+      Debug_printf("\nError Reading Sectors %06lx", sector_num);
+    break;
   case 'T':
     memset(buffer,0,sizeof(buffer));
     dcd_status(buffer);
@@ -67,6 +67,8 @@ public:
     int step();
     void change_track(int side);
     void update_track_buffers();
+    // Readies the tracks around the head so a step only swaps buffers; call while the head is still
+    void prefetch_tracks();
     void set_disk_number(char c) { disk_num = c; _devnum = c; }
     char get_disk_number() { return disk_num; };
     mediatype_t disktype() { return _disk == nullptr ? MEDIATYPE_UNKNOWN : _disk->_mediatype; };
@@ -9,6 +9,7 @@
 #include "fnFsSPIFFS.h"
 #include "utils.h"
 #include "string_utils.h"
+#include "fujiCopyTask.h"
 
 #include <string>
 
@@ -520,9 +521,6 @@ void iwmFuji::iwm_ctrl_copy_file()
     std::string copySpec;
     std::string sourcePath;
     std::string destPath;
-    FILE *sourceFile;
-    FILE *destFile;
-    char *dataBuf;
     unsigned char sourceSlot;
     unsigned char destSlot;
 
@@ -531,6 +529,12 @@ void iwmFuji::iwm_ctrl_copy_file()
     copySpec = std::string((char *)&data_buffer[2]);
     Debug_printf("copySpec: %s\n", copySpec.c_str());
 
+    if (sourceSlot >= MAX_HOSTS || destSlot >= MAX_HOSTS || copySpec.find_first_of("|") == std::string::npos)
+    {
+        err_result = SP_ERR_BADCTL;
+        return;
+    }
+
     // Chop up copyspec.
     sourcePath = copySpec.substr(0, copySpec.find_first_of("|"));
     destPath = copySpec.substr(copySpec.find_first_of("|") + 1);
@@ -543,26 +547,9 @@ void iwmFuji::iwm_ctrl_copy_file()
         destPath += sourceFilename;
     }
 
-    // Mount hosts, if needed.
-    _fnHosts[sourceSlot].mount();
-    _fnHosts[destSlot].mount();
-
-    // Open files...
-    sourceFile = _fnHosts[sourceSlot].file_open(sourcePath.c_str(), (char *)sourcePath.c_str(), sourcePath.size() + 1, "r");
-    destFile = _fnHosts[destSlot].file_open(destPath.c_str(), (char *)destPath.c_str(), destPath.size() + 1, "w");
-
-    dataBuf = (char *)malloc(532);
-    size_t count = 0;
-    do
-    {
-        count = fread(dataBuf, 1, 532, sourceFile);
-        fwrite(dataBuf, 1, count, destFile);
-    } while (count > 0);
-
-    // copyEnd:
-    fclose(sourceFile);
-    fclose(destFile);
-    free(dataBuf);
+    fujiCopyTask copy(&_fnHosts[sourceSlot], sourcePath, &_fnHosts[destSlot], destPath);
+    if (!copy.run())
+        err_result = SP_ERR_IOERROR;
 }
 
 // Mount all
@@ -1097,7 +1084,7 @@ void iwmFuji::iwm_ctrl_write_host_slots()
         _fnHosts[i].set_hostname(hostSlots[i]);
     }
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 }
 
 // Store host path prefix
@@ -1172,7 +1159,7 @@ void iwmFuji::iwm_ctrl_write_device_slots()
 
     // Save the data to disk
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 }
 
 // Temporary(?) function while we move from old config storage to new
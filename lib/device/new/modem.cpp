@@ -12,8 +12,6 @@
 
 #include "utils.h"
 
-#define RECVBUFSIZE 1024
-
 /* Tested this delay several times on an 800 with Incognito
    using HSIO routines. Anything much lower gave inconsistent
    firmware loading. Delay is unnoticeable when running at
@@ -78,12 +76,17 @@ adamModem::adamModem(FileSystem *_fs, bool snifferEnable)
 {
     activeFS = _fs;
     modemSniffer = new ModemSniffer(activeFS, snifferEnable);
+    modemPort = new ModemUARTPort<UARTManager>(&fnUartBUS);
+    modemCore = new ModemCore(modemPort, modemSniffer);
     set_term_type("dumb");
     telnet = telnet_init(telopts, _telnet_event_handler, 0, this);
 }
 
 adamModem::~adamModem()
 {
+    delete modemCore;
+    delete modemPort;
+
     if (modemSniffer != nullptr)
     {
         delete modemSniffer;
@@ -482,7 +485,7 @@ void adamModem::at_handle_answer()
     if (tcpServer.hasClient())
     {
         tcpClient = tcpServer.available();
-        tcpClient.setNoDelay(true); // try to disable naggle
+        modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
                                     //        tcpServer.stop();
         answerTimer = fnSystem.millis();
         answered = false;
@@ -549,7 +552,7 @@ void adamModem::at_handle_dial()
 
         if (tcpClient.connect(host.c_str(), portInt))
         {
-            tcpClient.setNoDelay(true); // Try to disable naggle
+            modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
             answered = false;
             answerTimer = fnSystem.millis();
             cmdMode = false;
@@ -1123,96 +1126,23 @@ void adamModem::sio_handle_modem()
             }
         }
 
-        //int sioBytesAvail = SIO_UART.available();
-        int sioBytesAvail = std::min(0, fnUartBUS.available());
-
-        // send from Atari to Fujinet
-        if (sioBytesAvail && tcpClient.connected())
-        {
-            // In telnet in worst case we have to escape every uint8_t
-            // so leave half of the buffer always free
-            //int max_buf_size;
-            //if (telnet == true)
-            //  max_buf_size = TX_BUF_SIZE / 2;
-            //else
-            //  max_buf_size = TX_BUF_SIZE;
-
-            // Read from serial, the amount available up to
-            // maximum size of the buffer
-            int sioBytesRead = fnUartBUS.readBytes(&txBuf[0], //SIO_UART.readBytes(&txBuf[0],
-                                                   (sioBytesAvail > TX_BUF_SIZE) ? TX_BUF_SIZE : sioBytesAvail);
-
-            // Disconnect if going to AT mode with "+++" sequence
-            for (int i = 0; i < (int)sioBytesRead; i++)
-            {
-                if (txBuf[i] == '+')
-                    plusCount++;
-                else
-                    plusCount = 0;
-                if (plusCount >= 3)
-                {
-                    plusTime = fnSystem.millis();
-                }
-                if (txBuf[i] != '+')
-                {
-                    plusCount = 0;
-                }
-            }
-
-            // Write the buffer to TCP finally
-            if (use_telnet == true)
-            {
-                telnet_send(telnet, (const char *)txBuf, sioBytesRead);
-            }
-            else
-                tcpClient.write(&txBuf[0], sioBytesRead);
-
-            // And send it off to the sniffer, if enabled.
-            modemSniffer->dumpOutput(&txBuf[0], sioBytesRead);
-            _lasttime = fnSystem.millis();
-        }
-
-        // read from Fujinet to Atari
-        unsigned char buf[RECVBUFSIZE];
-        int bytesAvail = 0;
+        // send from the computer to Fujinet is off on this bus for now,
+        // fnUartBUS carries the bus itself
 
-        // check to see how many bytes are avail to read
-        while ((bytesAvail = tcpClient.available()) > 0)
-        {
-            // read as many as our buffer size will take (RECVBUFSIZE)
-            unsigned int bytesRead =
-                tcpClient.read(buf, (bytesAvail > RECVBUFSIZE) ? RECVBUFSIZE : bytesAvail);
-
-            if (use_telnet == true)
-            {
-                telnet_recv(telnet, (const char *)buf, bytesRead);
-            }
-            else
-            {
-                fnUartBUS.write(buf, bytesRead);
-                fnUartBUS.flush();
-            }
-
-            // And dump to sniffer, if enabled.
-            modemSniffer->dumpInput(buf, bytesRead);
+        // read from Fujinet to the computer
+        if (modemCore->fromTcp(tcpClient, use_telnet ? telnet : nullptr) > 0)
             _lasttime = fnSystem.millis();
-        }
     }
 
     // If we have received "+++" as last bytes from serial port and there
     // has been over a second without any more bytes, go back to command mode.
-    if (plusCount >= 3)
+    if (modemCore->escapeRequested())
     {
-        if (fnSystem.millis() - plusTime > 1000)
-        {
-            Debug_println("Going back to command mode");
+        Debug_println("Going back to command mode");
 
-            at_cmd_println("OK");
-    
-            cmdMode = true;
+        at_cmd_println("OK");
 
-            plusCount = 0;
-        }
+        cmdMode = true;
     }
 
     // Go to command mode if TCP disconnected and not in command mode
@@ -742,7 +742,7 @@ void rc2014Fuji::rc2014_write_host_slots()
         _fnHosts[i].set_hostname(hostSlots[i]);
     }
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 
     rc2014_send_complete();
 }
@@ -826,7 +826,7 @@ void rc2014Fuji::rc2014_write_device_slots()
 
     // Save the data to disk
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 
     rc2014_send_complete();
 }
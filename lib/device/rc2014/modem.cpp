@@ -16,8 +16,6 @@
 #include "utils.h"
 
 
-#define RECVBUFSIZE 1024
-
 /* Tested this delay several times on an 800 with Incognito
    using HSIO routines. Anything much lower gave inconsistent
    firmware loading. Delay is unnoticeable when running at
@@ -84,16 +82,46 @@ static void _telnet_event_handler(telnet_t *telnet, telnet_event_t *ev, void *us
 }
 
 
+/**
+ * The RC2014's side of the modem, through the device's stream FIFOs
+ */
+class rc2014ModemPort : public ModemPort
+{
+private:
+    rc2014Fifo<1024> *_tx; // from the RC2014
+    rc2014Fifo<1024> *_rx; // to the RC2014
+
+public:
+    rc2014ModemPort(rc2014Fifo<1024> *tx, rc2014Fifo<1024> *rx) : _tx(tx), _rx(rx) {}
+
+    int available() override { return _tx->avail(); }
+    size_t read(uint8_t *buf, size_t len) override
+    {
+        _tx->pop(buf, len);
+        return len;
+    }
+    size_t write(const uint8_t *buf, size_t len) override
+    {
+        _rx->push((uint8_t *)buf, len);
+        return len;
+    }
+};
+
 rc2014Modem::rc2014Modem(FileSystem *_fs, bool snifferEnable)
 {
     activeFS = _fs;
     modemSniffer = new ModemSniffer(activeFS, snifferEnable);
+    modemPort = new rc2014ModemPort(&streamFifoTx, &streamFifoRx);
+    modemCore = new ModemCore(modemPort, modemSniffer);
     set_term_type("dumb");
     telnet = telnet_init(telopts, _telnet_event_handler, 0, this);
 }
 
 rc2014Modem::~rc2014Modem()
 {
+    delete modemCore;
+    delete modemPort;
+
     if (modemSniffer != nullptr)
     {
         delete modemSniffer;
@@ -525,7 +553,7 @@ void rc2014Modem::at_handle_answer()
     if (tcpServer.hasClient())
     {
         tcpClient = tcpServer.available();
-        tcpClient.setNoDelay(true); // try to disable naggle
+        modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
                                     //        tcpServer.stop();
         answerTimer = fnSystem.millis();
         answered = false;
@@ -592,7 +620,7 @@ void rc2014Modem::at_handle_dial()
 
         if (tcpClient.connect(host.c_str(), portInt))
         {
-            tcpClient.setNoDelay(true); // Try to disable naggle
+            modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
             answered = false;
             answerTimer = fnSystem.millis();
             cmdMode = false;
@@ -1148,95 +1176,24 @@ void rc2014Modem::rc2014_handle_stream()
             }
         }
 
-        //int sioBytesAvail = SIO_UART.available();
-        int sioBytesAvail = streamFifoTx.avail();
-
-        // send from Atari to Fujinet
-        if (sioBytesAvail && tcpClient.connected())
-        {
-            // In telnet in worst case we have to escape every uint8_t
-            // so leave half of the buffer always free
-            //int max_buf_size;
-            //if (telnet == true)
-            //  max_buf_size = TX_BUF_SIZE / 2;
-            //else
-            //  max_buf_size = TX_BUF_SIZE;
-
-            // Read from serial, the amount available up to
-            // maximum size of the buffer
-            int sioBytesRead = (sioBytesAvail > TX_BUF_SIZE) ? TX_BUF_SIZE : sioBytesAvail;
-            streamFifoTx.pop(&txBuf[0], sioBytesRead);
-
-            // Disconnect if going to AT mode with "+++" sequence
-            for (int i = 0; i < (int)sioBytesRead; i++)
-            {
-                if (txBuf[i] == '+')
-                    plusCount++;
-                else
-                    plusCount = 0;
-                if (plusCount >= 3)
-                {
-                    plusTime = fnSystem.millis();
-                }
-                if (txBuf[i] != '+')
-                {
-                    plusCount = 0;
-                }
-            }
-
-            // Write the buffer to TCP finally
-            if (use_telnet == true)
-            {
-                telnet_send(telnet, (const char *)txBuf, sioBytesRead);
-            }
-            else
-                tcpClient.write(&txBuf[0], sioBytesRead);
-
-            // And send it off to the sniffer, if enabled.
-            modemSniffer->dumpOutput(&txBuf[0], sioBytesRead);
+        // send from the computer to Fujinet
+        if (modemCore->toTcp(tcpClient, use_telnet) > 0)
             _lasttime = fnSystem.millis();
-        }
-
-        // read from Fujinet to Atari
-        unsigned char buf[RECVBUFSIZE];
-        int bytesAvail = 0;
 
-        // check to see how many bytes are avail to read
-        while ((bytesAvail = tcpClient.available()) > 0)
-        {
-            // read as many as our buffer size will take (RECVBUFSIZE)
-            unsigned int bytesRead =
-                tcpClient.read(buf, (bytesAvail > RECVBUFSIZE) ? RECVBUFSIZE : bytesAvail);
-
-            if (use_telnet == true)
-            {
-                telnet_recv(telnet, (const char *)buf, bytesRead);
-            }
-            else
-            {
-                streamFifoRx.push(buf, bytesRead);
-            }
-
-            // And dump to sniffer, if enabled.
-            modemSniffer->dumpInput(buf, bytesRead);
+        // read from Fujinet to the computer
+        if (modemCore->fromTcp(tcpClient, use_telnet ? telnet : nullptr) > 0)
             _lasttime = fnSystem.millis();
-        }
     }
 
     // If we have received "+++" as last bytes from serial port and there
     // has been over a second without any more bytes, go back to command mode.
-    if (plusCount >= 3)
+    if (modemCore->escapeRequested())
     {
-        if (fnSystem.millis() - plusTime > 1000)
-        {
-            Debug_println("Going back to command mode");
+        Debug_println("Going back to command mode");
 
-            at_cmd_println("OK");
-    
-            cmdMode = true;
+        at_cmd_println("OK");
 
-            plusCount = 0;
-        }
+        cmdMode = true;
     }
 
     // Go to command mode if TCP disconnected and not in command mode
@@ -13,6 +13,7 @@
 #include "fnTcpServer.h"
 #include "fnTcpClient.h"
 #include "modem-sniffer.h"
+#include "modem-core.h"
 #include "libtelnet.h"
 
 /* Keep strings under 40 characters, for the benefit of 40-column users! */
@@ -75,8 +76,6 @@
 class rc2014Modem : public virtualDevice
 {
 private:
-    static constexpr int TX_BUF_SIZE = 256;
-
 #define RESULT_CODE_OK              0
 #define RESULT_CODE_CONNECT         1
 #define RESULT_CODE_RING            2
@@ -164,9 +163,6 @@ private:
     fnTcpClient tcpClient;         // Modem client
     fnTcpServer tcpServer;         // Modem server
     unsigned long lastRingMs = 0;  // Time of last "RING" message (millis())
-    char plusCount = 0;            // Go to AT mode at "+++" sequence, that has to be counted
-    unsigned long plusTime = 0;    // When did we last receive a "+++" sequence
-    uint8_t txBuf[TX_BUF_SIZE];
     bool cmdOutput=true;            // toggle whether to emit command output
     bool numericResultCode=false;   // Use numeric result codes? (ATV0)
     bool autoAnswer=false;          // Auto answer? (ATS0?)
@@ -176,6 +172,8 @@ private:
     bool answerHack=false;          // ATA answer hack on SIO write.
     FileSystem *activeFS;           // Active Filesystem for ModemSniffer.
     ModemSniffer* modemSniffer;     // ptr to modem sniffer.
+    ModemPort* modemPort;           // computer side of the data path.
+    ModemCore* modemCore;           // data path while connected.
     time_t _lasttime;               // most recent timestamp of data activity.
     telnet_t *telnet;               // telnet FSM state.
     bool use_telnet=false;          // Use telnet mode?
@@ -12,6 +12,7 @@
 #include "../../include/debug.h"
 
 #include "utils.h"
+#include "fnDNS.h"
 
 #include "status_error_codes.h"
 #include "TCP.h"
@@ -668,6 +669,9 @@ void rc2014Network::create_url_parser()
 {
     std::string url = deviceSpec;
     urlParser = PeoplesUrlParser::parseURL(url);
+
+    if (urlParser->isValidUrl())
+        dns_prefetch(urlParser->host);
 }
 
 void rc2014Network::parse_and_instantiate_protocol(string d)
@@ -49,6 +49,7 @@ void rc2014CPM::rc2014_handle_cpm()
     PC = CCPaddr;                           // Sets CP/M application jump point
     Z80run();                               // Starts simulation
 #endif
+    _console_flush();
     if (Status == 1) // This is set by a call to BIOS 0 - ends CP/M
     {
         cpmActive = false;
@@ -13,6 +13,9 @@
 #include "fnConfig.h"
 #include "fsFlash.h"
 #include "fnWiFi.h"
+#include "fujiAppKeys.h"
+#include "fujiMountAll.h"
+#include "fujiCopyTask.h"
 
 #include "led.h"
 #include "utils.h"
@@ -338,20 +341,9 @@ void rs232Fuji::rs232_copy_file()
     std::string sourcePath;
     std::string destPath;
     uint8_t ck;
-    fnFile *sourceFile;
-    fnFile *destFile;
-    char *dataBuf;
     unsigned char sourceSlot;
     unsigned char destSlot;
 
-    dataBuf = (char *)malloc(532);
-
-    if (dataBuf == nullptr)
-    {
-        rs232_error();
-        return;
-    }
-
     memset(&csBuf, 0, sizeof(csBuf));
 
     ck = bus_to_peripheral(csBuf, sizeof(csBuf));
@@ -359,7 +351,6 @@ void rs232Fuji::rs232_copy_file()
     if (ck != rs232_checksum(csBuf, sizeof(csBuf)))
     {
         rs232_error();
-        free(dataBuf);
         return;
     }
 
@@ -371,21 +362,18 @@ void rs232Fuji::rs232_copy_file()
     if (copySpec.empty() || copySpec.find_first_of("|") == std::string::npos)
     {
         rs232_error();
-        free(dataBuf);
         return;
     }
 
     if (cmdFrame.aux1 < 1 || cmdFrame.aux1 > 8)
     {
         rs232_error();
-        free(dataBuf);
         return;
     }
 
     if (cmdFrame.aux2 < 1 || cmdFrame.aux2 > 8)
     {
         rs232_error();
-        free(dataBuf);
         return;
     }
 
@@ -406,43 +394,11 @@ void rs232Fuji::rs232_copy_file()
         destPath += sourceFilename;
     }
 
-    // Mount hosts, if needed.
-    _fnHosts[sourceSlot].mount();
-    _fnHosts[destSlot].mount();
-
-    // Open files...
-    sourceFile = _fnHosts[sourceSlot].fnfile_open(sourcePath.c_str(), (char *)sourcePath.c_str(), sourcePath.size() + 1, "r");
-
-    if (sourceFile == nullptr)
-    {
-        rs232_error();
-        free(dataBuf);
-        return;
-    }
-
-    destFile = _fnHosts[destSlot].fnfile_open(destPath.c_str(), (char *)destPath.c_str(), destPath.size() + 1, "w");
-
-    if (destFile == nullptr)
-    {
+    fujiCopyTask copy(&_fnHosts[sourceSlot], sourcePath, &_fnHosts[destSlot], destPath);
+    if (copy.run())
+        rs232_complete();
+    else
         rs232_error();
-        fnio::fclose(sourceFile);
-        free(dataBuf);
-        return;
-    }
-
-    size_t count = 0;
-    do
-    {
-        count = fnio::fread(dataBuf, 1, 532, sourceFile);
-        fnio::fwrite(dataBuf, 1, count, destFile);
-    } while (count > 0);
-
-    rs232_complete();
-
-    // copyEnd:
-    fnio::fclose(sourceFile);
-    fnio::fclose(destFile);
-    free(dataBuf);
 }
 
 // Mount all
@@ -450,32 +406,22 @@ void rs232Fuji::mount_all()
 {
     bool nodisks = true; // Check at the end if no disks are in a slot and disable config
 
+    fujiSlotOpen opened[8];
+    fuji_open_slots(_fnDisks, 8, _fnHosts, "r", opened);
+
     for (int i = 0; i < 8; i++)
     {
         fujiDisk &disk = _fnDisks[i];
         fujiHost &host = _fnHosts[disk.host_slot];
-        char flag[3] = {'r', 0, 0};
-
-        if (disk.access_mode == DISK_ACCESS_MODE_WRITE)
-            flag[1] = '+';
 
-        if (disk.host_slot != INVALID_HOST_SLOT && strlen(disk.filename) > 0)
+        if (opened[i].wanted)
         {
             nodisks = false; // We have a disk in a slot
 
-            if (host.mount() == false)
-            {
-                rs232_error();
-                return;
-            }
-
-            Debug_printf("Selecting '%s' from host #%u as %s on D%u:\n",
-                         disk.filename, disk.host_slot, flag, i + 1);
-
-            disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), flag);
-
-            if (disk.fileh == nullptr)
+            disk.fileh = opened[i].fileh;
+            if (!opened[i].host_ok || disk.fileh == nullptr)
             {
+                fuji_close_slots(opened, i + 1, 8);
                 rs232_error();
                 return;
             }
@@ -484,8 +430,7 @@ void rs232Fuji::mount_all()
             boot_config = false;
             status_wait_count = 0;
 
-            // We need the file size for loading XEX files and for CASSETTE, so get that too
-            disk.disk_size = host.file_size(disk.fileh);
+            disk.disk_size = opened[i].size;
 
             // And now mount it
             disk.disk_type = disk.disk_dev.mount(disk.fileh, disk.filename, disk.disk_size);
@@ -508,14 +453,6 @@ void rs232Fuji::rs232_set_boot_mode()
     rs232_complete();
 }
 
-char *_generate_appkey_filename(appkey *info)
-{
-    static char filenamebuf[30];
-
-    snprintf(filenamebuf, sizeof(filenamebuf), "/FujiNet/%04hx%02hhx%02hhx.key", info->creator, info->app, info->key);
-    return filenamebuf;
-}
-
 /*
  Opens an "app key".  This just sets the needed app key parameters (creator, app, key, mode)
  for the subsequent expected read/write command. We could've added this information as part
@@ -554,7 +491,7 @@ void rs232Fuji::rs232_open_app_key()
 
     Debug_printf("App key creator = 0x%04hx, app = 0x%02hhx, key = 0x%02hhx, mode = %hhu, filename = \"%s\"\n",
                  _current_appkey.creator, _current_appkey.app, _current_appkey.key, _current_appkey.mode,
-                 _generate_appkey_filename(&_current_appkey));
+                 fujiAppKeys::filename(_current_appkey.creator, _current_appkey.app, _current_appkey.key).c_str());
 
     rs232_complete();
 }
@@ -572,7 +509,7 @@ void rs232Fuji::rs232_close_app_key()
 }
 
 /*
- Write an "app key" to SD (ONLY!) storage.
+ Write an "app key" to SD (ONLY!) storage. It reaches the card a little later, see fujiAppKeys
 */
 void rs232Fuji::rs232_write_app_key()
 {
@@ -607,35 +544,14 @@ void rs232Fuji::rs232_write_app_key()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
+    if (keylen > sizeof(value))
+        keylen = sizeof(value);
+    fnAppKeys.write(_current_appkey.creator, _current_appkey.app, _current_appkey.key, value, keylen);
 
     // Reset the app key data so we require calling APPKEY OPEN before another attempt
     _current_appkey.creator = 0;
     _current_appkey.mode = APPKEYMODE_INVALID;
 
-    Debug_printf("Writing appkey to \"%s\"\n", filename);
-
-    // Make sure we have a "/FujiNet" directory, since that's where we're putting these files
-    fnSDFAT.create_path("/FujiNet");
-
-    FILE *fOut = fnSDFAT.file_open(filename, "w");
-    if (fOut == nullptr)
-    {
-        Debug_printf("Failed to open/create output file: errno=%d\n", errno);
-        rs232_error();
-        return;
-    }
-    size_t count = fwrite(value, 1, keylen, fOut);
-    int e = errno;
-
-    fclose(fOut);
-
-    if (count != keylen)
-    {
-        Debug_printf("Only wrote %u bytes of expected %hu, errno=%d\n", count, keylen, e);
-        rs232_error();
-    }
-
     rs232_complete();
 }
 
@@ -663,18 +579,6 @@ void rs232Fuji::rs232_read_app_key()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
-
-    Debug_printf("Reading appkey from \"%s\"\n", filename);
-
-    FILE *fIn = fnSDFAT.file_open(filename, "r");
-    if (fIn == nullptr)
-    {
-        Debug_printf("Failed to open input file: errno=%d\n", errno);
-        rs232_error();
-        return;
-    }
-
     struct
     {
         uint16_t size;
@@ -682,10 +586,15 @@ void rs232Fuji::rs232_read_app_key()
     } __attribute__((packed)) response;
     memset(&response, 0, sizeof(response));
 
-    size_t count = fread(response.value, 1, sizeof(response.value), fIn);
-
-    fclose(fIn);
-    Debug_printf("Read %d bytes from input file\n", count);
+    int count = fnAppKeys.read(_current_appkey.creator, _current_appkey.app, _current_appkey.key,
+                               response.value, sizeof(response.value));
+    if (count < 0)
+    {
+        Debug_println("No such app key");
+        rs232_error();
+        return;
+    }
+    Debug_printf("Read %d bytes of app key\n", count);
 
     response.size = count;
 
@@ -1104,7 +1013,7 @@ void rs232Fuji::rs232_write_host_slots()
             _fnHosts[i].set_hostname(hostSlots[i]);
 
         _populate_config_from_slots();
-        Config.save();
+        Config.save_later();
 
         rs232_complete();
     }
@@ -1241,7 +1150,7 @@ void rs232Fuji::rs232_write_device_slots()
 
         // Save the data to disk
         _populate_config_from_slots();
-        Config.save();
+        Config.save_later();
 
         rs232_complete();
     }
@@ -1360,7 +1269,7 @@ void rs232Fuji::rs232_set_device_filename()
         return;
     }
 
-    Config.save();
+    Config.save_later();
     rs232_complete();
 }
 
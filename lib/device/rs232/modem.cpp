@@ -13,8 +13,6 @@
 
 #include "utils.h"
 
-#define RECVBUFSIZE 1024
-
 #define RS232_MODEMCMD_LOAD_RELOCATOR 0x21
 #define RS232_MODEMCMD_LOAD_HANDLER 0x26
 #define RS232_MODEMCMD_TYPE1_POLL 0x3F
@@ -98,12 +96,17 @@ rs232Modem::rs232Modem(FileSystem *_fs, bool snifferEnable)
     listen_to_type3_polls = true;
     activeFS = _fs;
     modemSniffer = new ModemSniffer(activeFS, snifferEnable);
+    modemPort = new ModemUARTPort<UARTManager>(&fnUartBUS);
+    modemCore = new ModemCore(modemPort, modemSniffer);
     set_term_type("dumb");
     telnet = telnet_init(telopts, _telnet_event_handler, 0, this);
 }
 
 rs232Modem::~rs232Modem()
 {
+    delete modemCore;
+    delete modemPort;
+
     if (modemSniffer != nullptr)
     {
         delete modemSniffer;
@@ -1012,7 +1015,7 @@ void rs232Modem::at_handle_answer()
     if (tcpServer.hasClient())
     {
         tcpClient = tcpServer.available();
-        tcpClient.setNoDelay(true); // try to disable naggle
+        modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
                                     //        tcpServer.stop();
         answerTimer = fnSystem.millis();
         answered = false;
@@ -1079,7 +1082,7 @@ void rs232Modem::at_handle_dial()
 
         if (tcpClient.connect(host.c_str(), portInt))
         {
-            tcpClient.setNoDelay(true); // Try to disable naggle
+            modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
             answered = false;
             answerTimer = fnSystem.millis();
             cmdMode = false;
@@ -1656,96 +1659,24 @@ void rs232Modem::rs232_handle_modem()
             }
         }
 
-        int rs232BytesAvail = fnUartBUS.available();
-        //int rs232BytesAvail = std::min(0, fnUartBUS.available());
-
-        // send from Atari to Fujinet
-        if (rs232BytesAvail && tcpClient.connected())
-        {
-            // In telnet in worst case we have to escape every uint8_t
-            // so leave half of the buffer always free
-            //int max_buf_size;
-            //if (telnet == true)
-            //  max_buf_size = TX_BUF_SIZE / 2;
-            //else
-            //  max_buf_size = TX_BUF_SIZE;
-
-            // Read from serial, the amount available up to
-            // maximum size of the buffer
-            int rs232BytesRead = fnUartBUS.readBytes(&txBuf[0], //RS232_UART.readBytes(&txBuf[0],
-                                                   (rs232BytesAvail > TX_BUF_SIZE) ? TX_BUF_SIZE : rs232BytesAvail);
-
-            // Disconnect if going to AT mode with "+++" sequence
-            for (int i = 0; i < (int)rs232BytesRead; i++)
-            {
-                if (txBuf[i] == '+')
-                    plusCount++;
-                else
-                    plusCount = 0;
-                if (plusCount >= 3)
-                {
-                    plusTime = fnSystem.millis();
-                }
-                if (txBuf[i] != '+')
-                {
-                    plusCount = 0;
-                }
-            }
-
-            // Write the buffer to TCP finally
-            if (use_telnet == true)
-            {
-                telnet_send(telnet, (const char *)txBuf, rs232BytesRead);
-            }
-            else
-                tcpClient.write(&txBuf[0], rs232BytesRead);
-
-            // And send it off to the sniffer, if enabled.
-            modemSniffer->dumpOutput(&txBuf[0], rs232BytesRead);
+        // send from the computer to Fujinet
+        if (modemCore->toTcp(tcpClient, use_telnet) > 0)
             _lasttime = fnSystem.millis();
-        }
 
-        // read from Fujinet to Atari
-        unsigned char buf[RECVBUFSIZE];
-        int bytesAvail = 0;
-
-        // check to see how many bytes are avail to read
-        while ((bytesAvail = tcpClient.available()) > 0)
-        {
-            // read as many as our buffer size will take (RECVBUFSIZE)
-            unsigned int bytesRead =
-                tcpClient.read(buf, (bytesAvail > RECVBUFSIZE) ? RECVBUFSIZE : bytesAvail);
-
-            if (use_telnet == true)
-            {
-                telnet_recv(telnet, (const char *)buf, bytesRead);
-            }
-            else
-            {
-                fnUartBUS.write(buf, bytesRead);
-                fnUartBUS.flush();
-            }
-
-            // And dump to sniffer, if enabled.
-            modemSniffer->dumpInput(buf, bytesRead);
+        // read from Fujinet to the computer
+        if (modemCore->fromTcp(tcpClient, use_telnet ? telnet : nullptr) > 0)
             _lasttime = fnSystem.millis();
-        }
     }
 
     // If we have received "+++" as last bytes from serial port and there
     // has been over a second without any more bytes, go back to command mode.
-    if (plusCount >= 3)
+    if (modemCore->escapeRequested())
     {
-        if (fnSystem.millis() - plusTime > 1000)
-        {
-            Debug_println("Going back to command mode");
+        Debug_println("Going back to command mode");
 
-            at_cmd_println("OK");
-    
-            cmdMode = true;
+        at_cmd_println("OK");
 
-            plusCount = 0;
-        }
+        cmdMode = true;
     }
 
     // Go to command mode if TCP disconnected and not in command mode
@@ -5,6 +5,7 @@
 #include "fnTcpClient.h"
 #include "fnTcpServer.h"
 #include "modem-sniffer.h"
+#include "modem-core.h"
 #include "libtelnet.h"
 
 
@@ -157,8 +158,6 @@ private:
     fnTcpClient tcpClient;         // Modem client
     fnTcpServer tcpServer;         // Modem server
     unsigned long lastRingMs = 0;  // Time of last "RING" message (millis())
-    char plusCount = 0;            // Go to AT mode at "+++" sequence, that has to be counted
-    unsigned long plusTime = 0;    // When did we last receive a "+++" sequence
     uint8_t txBuf[TX_BUF_SIZE];
     bool cmdOutput=true;            // toggle whether to emit command output
     bool numericResultCode=false;   // Use numeric result codes? (ATV0)
@@ -169,6 +168,8 @@ private:
     bool answerHack=false;          // ATA answer hack on RS232 write.
     FileSystem *activeFS;           // Active Filesystem for ModemSniffer.
     ModemSniffer* modemSniffer;     // ptr to modem sniffer.
+    ModemPort* modemPort;           // computer side of the data path.
+    ModemCore* modemCore;           // data path while connected.
     time_t _lasttime;               // most recent timestamp of data activity.
     telnet_t *telnet;               // telnet FSM state.
     bool use_telnet=false;          // Use telnet mode?
@@ -15,6 +15,7 @@
 
 #include "fnSystem.h"
 #include "utils.h"
+#include "fnDNS.h"
 
 #include "status_error_codes.h"
 #include "TCP.h"
@@ -747,9 +748,12 @@ void rs232Network::rs232_special_40()
         return;
     }
 
-    bus_to_computer((uint8_t *)receiveBuffer->data(),
-                    SPECIAL_BUFFER_SIZE,
-                    protocol->special_40((uint8_t *)receiveBuffer->data(), SPECIAL_BUFFER_SIZE, &cmdFrame));
+    // The payload gets its own buffer: receiveBuffer is not sized for it and may hold unread data
+    uint8_t spData[SPECIAL_BUFFER_SIZE];
+    memset(spData, 0, SPECIAL_BUFFER_SIZE);
+
+    bool err = protocol->special_40(spData, SPECIAL_BUFFER_SIZE, &cmdFrame);
+    bus_to_computer(spData, SPECIAL_BUFFER_SIZE, err);
 }
 
 /**
@@ -970,6 +974,9 @@ void rs232Network::create_url_parser()
 {
     std::string url = deviceSpec.substr(deviceSpec.find(":") + 1);
     urlParser = PeoplesUrlParser::parseURL(url);
+
+    if (urlParser->isValidUrl())
+        dns_prefetch(urlParser->host);
 }
 
 void rs232Network::parse_and_instantiate_protocol()
@@ -763,7 +763,7 @@ void s100spiFuji::s100spi_write_host_slots()
         _fnHosts[i].set_hostname(hostSlots[i]);
     }
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 }
 
 // Store host path prefix
@@ -845,7 +845,7 @@ void s100spiFuji::s100spi_write_device_slots()
 
     // Save the data to disk
     _populate_config_from_slots();
-    Config.save();
+    Config.save_later();
 }
 
 // Temporary(?) function while we move from old config storage to new
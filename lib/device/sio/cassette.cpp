@@ -4,6 +4,12 @@
 
 #include <cstring>
 
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#endif
+
 #include "../../include/debug.h"
 
 #include "fnSystem.h"
@@ -37,28 +43,32 @@
 #define ESP_INTR_FLAG_DEFAULT 0
 #define BOXLEN 5
 
+// Edges of the FSK signal from the Atari, time stamped as they happen. About
+// 10 a millisecond, so this covers the decoder falling 25 ms behind
+#define CAS_EDGE_QUEUE_LEN 256
+// How long to wait for an edge before taking the line as steady, in ms
+#define CAS_EDGE_TIMEOUT 5
+
 unsigned long last = 0;
 unsigned long delta = 0;
 unsigned long boxcar[BOXLEN];
 uint8_t boxidx = 0;
 
 #ifdef ESP_PLATFORM
+static QueueHandle_t cas_edge_queue = nullptr;
+
+// Only the time goes to the queue, all the arithmetic is done by the
+// decoder, which waits on the queue instead of polling
 static void IRAM_ATTR cas_isr_handler(void *arg)
 {
     uint32_t gpio_num = (uint32_t)arg;
     if (gpio_num == UART2_RX)
     {
-        unsigned long now = fnSystem.micros();
-        boxcar[boxidx++] = now - last; // interval between current and last ISR call
-        if (boxidx > BOXLEN)
-            boxidx = 0; // circular buffer action
-        delta = 0; // accumulator for boxcar filter
-        for (uint8_t i = 0; i < BOXLEN; i++)
-        {
-            delta += boxcar[i]; // accumulate internvals for averaging
-        }
-        delta /= BOXLEN; // normalize accumulator to make mean
-        last = now; // remember when this was (maybe move up to right before if statement?)
+        uint32_t now = (uint32_t)esp_timer_get_time();
+        BaseType_t woken = pdFALSE;
+        xQueueSendFromISR(cas_edge_queue, &now, &woken);
+        if (woken == pdTRUE)
+            portYIELD_FROM_ISR();
     }
 }
 #endif
@@ -81,9 +91,8 @@ uint8_t softUART::read()
     return buffer[index_out++];
 }
 
-int8_t softUART::service(uint8_t b)
+int8_t softUART::service(uint8_t b, unsigned long t)
 {
-    unsigned long t = fnSystem.micros();
     if (state_counter == STARTBIT)
     {
         if (b == 1)
@@ -215,6 +224,14 @@ void sioCassette::sio_enable_cassette()
         open_cassette_file(&fnSDFAT); // hardcode SD card?
         FN_BUS_LINK.end();
 #ifdef ESP_PLATFORM
+        if (cas_edge_queue == nullptr)
+            cas_edge_queue = xQueueCreate(CAS_EDGE_QUEUE_LEN, sizeof(uint32_t));
+        else
+            xQueueReset(cas_edge_queue);
+        last = 0;
+        memset(boxcar, 0, sizeof(boxcar));
+        boxidx = 0;
+
         fnSystem.set_pin_mode(UART2_RX, gpio_mode_t::GPIO_MODE_INPUT, SystemManager::pull_updown_t::PULL_NONE, GPIO_INTR_ANYEDGE);
 
         // hook isr handler for specific gpio pin
@@ -477,8 +494,11 @@ size_t sioCassette::send_FUJI_tape_block(size_t offset)
     while (gap)
     {
 #ifdef ESP_PLATFORM
-        gap--;
-        fnSystem.delay_microseconds(999); // shave off a usec for the MOTOR pin check
+        // Sleep rather than spin, the gap only has to be right to the ms and
+        // the UART sends the block itself
+        uint16_t step = gap > 10 ? 10 : gap;
+        gap -= step;
+        fnSystem.delay(step);
 #else
         int step;
         // FN_BUS_LINK is fnSioCom
@@ -575,7 +595,7 @@ size_t sioCassette::receive_FUJI_tape_block(size_t offset)
     #endif
 
     while (!casUART.available()) // && motor_line()
-        casUART.service(decode_fsk());
+        service_fsk();
     uint16_t irg = fnSystem.millis() - tic - 10000 / casUART.get_baud(); // adjust for first byte
     Debug_printf("irg %u\n", irg);
     offset += fnio::fwrite(&irg, 2, 1, _file);
@@ -584,13 +604,13 @@ size_t sioCassette::receive_FUJI_tape_block(size_t offset)
     Debug_printf("marker 1: %02x\n", b);
 
     while (!casUART.available()) // && motor_line()
-        casUART.service(decode_fsk());
+        service_fsk();
     b = casUART.read(); // should be 0x55
     atari_sector_buffer[idx++] = b;
     Debug_printf("marker 2: %02x\n", b);
 
     while (!casUART.available()) // && motor_line()
-        casUART.service(decode_fsk());
+        service_fsk();
     b = casUART.read(); // control byte
     atari_sector_buffer[idx++] = b;
     Debug_printf("control byte: %02x\n", b);
@@ -599,7 +619,7 @@ size_t sioCassette::receive_FUJI_tape_block(size_t offset)
     while (i < BLOCK_LEN)
     {
         while (!casUART.available()) // && motor_line()
-            casUART.service(decode_fsk());
+            service_fsk();
         b = casUART.read(); // data
         atari_sector_buffer[idx++] = b;
 //        Debug_printf(" %02x", b);
@@ -608,7 +628,7 @@ size_t sioCassette::receive_FUJI_tape_block(size_t offset)
 //    Debug_printf("\n");
 
     while (!casUART.available()) // && motor_line()
-        casUART.service(decode_fsk());
+        service_fsk();
     b = casUART.read(); // checksum
     atari_sector_buffer[idx++] = b;
     Debug_printf("checksum: %02x\n", b);
@@ -627,23 +647,48 @@ size_t sioCassette::receive_FUJI_tape_block(size_t offset)
     return offset;
 }
 
-uint8_t sioCassette::decode_fsk()
+uint8_t sioCassette::decode_fsk(unsigned long interval)
 {
-    // take "delta" set in the IRQ and set the demodulator output
+    // average the last few edge intervals and set the demodulator output
 
     uint8_t out = last_output;
 
+    boxcar[boxidx++] = interval;
+    if (boxidx >= BOXLEN)
+        boxidx = 0; // circular buffer action
+    delta = 0; // accumulator for boxcar filter
+    for (uint8_t i = 0; i < BOXLEN; i++)
+        delta += boxcar[i]; // accumulate intervals for averaging
+    delta /= BOXLEN; // normalize accumulator to make mean
+
     if (delta > 0)
     {
-        Debug_printf("%lu ", delta);
         if (delta > 90 && delta < 97)
             out = 0;
         if (delta > 119 && delta < 130)
             out = 1;
         last_output = out;
     }
-    // Debug_printf("%lu, ", fnSystem.micros());
-    // Debug_printf("%u\n", out);
     return out;
 }
+
+void sioCassette::service_fsk()
+{
+#ifdef ESP_PLATFORM
+    // The soft UART runs on the time of each edge rather than the time it
+    // gets to look, so the bits come out the same however late that is
+    uint32_t edge;
+    if (xQueueReceive(cas_edge_queue, &edge, pdMS_TO_TICKS(CAS_EDGE_TIMEOUT)) == pdTRUE)
+    {
+        uint8_t b = last != 0 ? decode_fsk(edge - last) : last_output;
+        last = edge;
+        casUART.service(b, edge);
+    }
+    else
+    {
+        // No tone, the line stays where it was
+        casUART.service(last_output, (uint32_t)esp_timer_get_time());
+    }
+#endif
+}
 #endif /* BUILD_ATARI */
@@ -58,7 +58,8 @@ public:
     void set_baud(uint16_t b);
     uint16_t get_baud() { return baud; };
     uint8_t read();
-    int8_t service(uint8_t b);
+    // b is the demodulator output at time t, in microseconds
+    int8_t service(uint8_t b, unsigned long t);
 };
 
 class sioCassette : public virtualDevice
@@ -80,7 +81,8 @@ protected:
     uint8_t denoise_counter = 0;
     const uint16_t period_space = 1000000 / 3995;
     const uint16_t period_mark = 1000000 / 5327;
-    uint8_t decode_fsk();
+    uint8_t decode_fsk(unsigned long interval);
+    void service_fsk(); // feed the soft UART the next edge from the Atari
 
     // helper function to read motor pin
 #ifdef ESP_PLATFORM
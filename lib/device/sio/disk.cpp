@@ -88,7 +88,7 @@ void sioDisk::sio_write(bool verify)
 // Status
 void sioDisk::sio_status()
 {
-    Debug_print("disk STATUS\n");
+    Debug_tracef("disk STATUS\n");
 
     /* STATUS BYTES
         #0 - Drive status
@@ -152,7 +152,7 @@ void sioDisk::sio_status()
     if (_disk != nullptr)
         _disk->status(_status);
 
-    Debug_printf("response: 0x%02x, 0x%02x, 0x%02x\n", _status[0], _status[1], _status[2]);
+    Debug_tracef("response: 0x%02x, 0x%02x, 0x%02x\n", _status[0], _status[1], _status[2]);
 
     bus_to_computer(_status, sizeof(_status), false);
 }
@@ -323,7 +323,7 @@ void sioDisk::sio_process(uint32_t commanddata, uint8_t checksum)
         (device_active == false && theFuji.boot_config == false)) // not active and not config boot
         return;
 
-    Debug_printf("disk sio_process(), baud: %d\n", SIO.getBaudrate());
+    Debug_tracef("disk sio_process(), baud: %d\n", SIO.getBaudrate());
 
     switch (cmdFrame.comnd)
     {
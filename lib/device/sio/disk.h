@@ -29,6 +29,7 @@ public:
     bool write_blank(fnFile *f, uint16_t sectorSize, uint16_t numSectors);
 
     mediatype_t disktype() { return _disk == nullptr ? MEDIATYPE_UNKNOWN : _disk->_disktype; };
+    MediaType *media() { return _disk; };
 
     ~sioDisk();
 };
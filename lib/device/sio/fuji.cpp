@@ -7,6 +7,7 @@
 #include "../../../include/PSRAMAllocator.h"
 #endif
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <errno.h>
@@ -27,6 +28,13 @@
 #include "fnConfig.h"
 #include "fsFlash.h"
 #include "fnFsTNFS.h"
+#include "fnFilePreload.h"
+#include "fnFileGzip.h"
+#include "fnFileWriteback.h"
+#include "fnEvents.h"
+#include "fujiCopyTask.h"
+#include "fujiMountAll.h"
+#include "fujiAppKeys.h"
 #include "fnWiFi.h"
 
 #include "led.h"
@@ -425,7 +433,7 @@ void sioFuji::sio_disk_image_mount()
 
     // TODO: Implement FETCH?
     char flag[3] = {'r', 0, 0};
-    if (options == DISK_ACCESS_MODE_WRITE)
+    if (options & DISK_ACCESS_MODE_WRITE)
         flag[1] = '+';
 
     // Make sure we weren't given a bad hostSlot
@@ -466,8 +474,16 @@ void sioFuji::sio_disk_image_mount()
     // We need the file size for loading XEX files and for CASSETTE, so get that too
     disk.disk_size = host.file_size(disk.fileh);
 
+    // Keep network round trips for writes out of the SIO timing window
+    if ((options & DISK_ACCESS_MODE_WRITE) && host.get_type() != HOSTTYPE_LOCAL)
+        disk.fileh = FileHandlerWriteback::wrap(disk.fileh, disk.disk_size);
+
+    if (options & DISK_ACCESS_MODE_PRELOAD)
+        disk.fileh = FileHandlerPreload::wrap(disk.fileh, disk.disk_size);
+
     // And now mount it
     disk.disk_type = disk.disk_dev.mount(disk.fileh, disk.filename, disk.disk_size);
+    fnEvents.publish(fn_event_type::MOUNT, deviceSlot);
 
     sio_complete();
 }
@@ -487,7 +503,7 @@ int sioFuji::sio_disk_image_mount(bool siomode, int slot)
 
     // TODO: Implement FETCH?
     char flag[4] = {'r', 'b', 0, 0};
-    if (options == DISK_ACCESS_MODE_WRITE)
+    if (options & DISK_ACCESS_MODE_WRITE)
         flag[2] = '+';
 
     // Make sure we weren't given a bad hostSlot
@@ -525,8 +541,16 @@ int sioFuji::sio_disk_image_mount(bool siomode, int slot)
     // We need the file size for loading XEX files and for CASSETTE, so get that too
     disk.disk_size = host.file_size(disk.fileh);
 
+    // Keep network round trips for writes out of the SIO timing window
+    if ((options & DISK_ACCESS_MODE_WRITE) && host.get_type() != HOSTTYPE_LOCAL)
+        disk.fileh = FileHandlerWriteback::wrap(disk.fileh, disk.disk_size);
+
+    if (options & DISK_ACCESS_MODE_PRELOAD)
+        disk.fileh = FileHandlerPreload::wrap(disk.fileh, disk.disk_size);
+
     // And now mount it
     disk.disk_type = disk.disk_dev.mount(disk.fileh, disk.filename, disk.disk_size);
+    fnEvents.publish(fn_event_type::MOUNT, deviceSlot);
 
     return _on_ok(siomode);
 }
@@ -539,7 +563,22 @@ void sioFuji::sio_set_boot_config()
     sio_complete();
 }
 
+#ifndef ESP_PLATFORM
+// Keep NetSIO alive while a copy runs in the bus task
+static void _copy_poll_netsio()
+{
+    static uint64_t poll_ts = 0;
+    if (fnSioCom.get_sio_mode() == SioCom::sio_mode::NETSIO && fnSystem.millis() - poll_ts > 1000)
+    {
+        fnSioCom.poll(1);
+        poll_ts = fnSystem.millis();
+    }
+}
+#endif
+
 // Do SIO copy
+// aux1 = source host slot, aux2 = destination host slot (1-8). With FUJI_COPY_BACKGROUND
+// set in aux2 the command completes once the copy has started; poll FUJICMD_COPY_FILE_STATUS
 void sioFuji::sio_copy_file()
 {
     uint8_t csBuf[256];
@@ -547,22 +586,10 @@ void sioFuji::sio_copy_file()
     std::string sourcePath;
     std::string destPath;
     uint8_t ck;
-    fnFile *sourceFile;
-    fnFile *destFile;
-    char *dataBuf;
     unsigned char sourceSlot;
     unsigned char destSlot;
-#ifndef ESP_PLATFORM
-    uint64_t poll_ts = fnSystem.millis();
-#endif
-
-    dataBuf = (char *)malloc(532);
-
-    if (dataBuf == nullptr)
-    {
-        sio_error();
-        return;
-    }
+    bool background = cmdFrame.aux2 & FUJI_COPY_BACKGROUND;
+    uint8_t destAux = cmdFrame.aux2 & ~FUJI_COPY_BACKGROUND;
 
     memset(&csBuf, 0, sizeof(csBuf));
 
@@ -571,7 +598,6 @@ void sioFuji::sio_copy_file()
     if (ck != sio_checksum(csBuf, sizeof(csBuf)))
     {
         sio_error();
-        free(dataBuf);
         return;
     }
 
@@ -583,26 +609,23 @@ void sioFuji::sio_copy_file()
     if (copySpec.empty() || copySpec.find_first_of("|") == std::string::npos)
     {
         sio_error();
-        free(dataBuf);
         return;
     }
 
     if (cmdFrame.aux1 < 1 || cmdFrame.aux1 > 8)
     {
         sio_error();
-        free(dataBuf);
         return;
     }
 
-    if (cmdFrame.aux2 < 1 || cmdFrame.aux2 > 8)
+    if (destAux < 1 || destAux > 8)
     {
         sio_error();
-        free(dataBuf);
         return;
     }
 
     sourceSlot = cmdFrame.aux1 - 1;
-    destSlot = cmdFrame.aux2 - 1;
+    destSlot = destAux - 1;
 
     // All good, after this point...
 
@@ -618,78 +641,34 @@ void sioFuji::sio_copy_file()
         destPath += sourceFilename;
     }
 
-    // Mount hosts, if needed.
-    _fnHosts[sourceSlot].mount();
-    _fnHosts[destSlot].mount();
-
-    // Open files...
-    sourceFile = _fnHosts[sourceSlot].fnfile_open(sourcePath.c_str(), (char *)sourcePath.c_str(), sourcePath.size() + 1, FILE_READ);
-
-    if (sourceFile == nullptr)
+    if (background)
     {
-        sio_error();
-        free(dataBuf);
-        return;
-    }
-
-    destFile = _fnHosts[destSlot].fnfile_open(destPath.c_str(), (char *)destPath.c_str(), destPath.size() + 1, FILE_WRITE);
-
-    if (destFile == nullptr)
-    {
-        sio_error();
-        fnio::fclose(sourceFile);
-        free(dataBuf);
+        if (fujiCopyTask::submit(&_fnHosts[sourceSlot], sourcePath, &_fnHosts[destSlot], destPath))
+            sio_complete();
+        else
+            sio_error();
         return;
     }
 
-    size_t readCount = 0;
-    size_t readTotal = 0;
-    size_t writeCount = 0;
-    size_t expected = _fnHosts[sourceSlot].file_size(sourceFile); // get the filesize
-    bool err = false;
-    do
-    {
-#ifndef ESP_PLATFORM
-        if (fnSioCom.get_sio_mode() == SioCom::sio_mode::NETSIO && fnSystem.millis() - poll_ts > 1000)
-        {
-            fnSioCom.poll(1);
-            poll_ts = fnSystem.millis();
-        }
+    fujiCopyTask copy(&_fnHosts[sourceSlot], sourcePath, &_fnHosts[destSlot], destPath);
+#ifdef ESP_PLATFORM
+    bool ok = copy.run();
+#else
+    bool ok = copy.run(_copy_poll_netsio);
 #endif
-        readCount = fnio::fread(dataBuf, 1, 532, sourceFile);
-        readTotal += readCount;
-        // Check if we got enough bytes on the read
-        if (readCount < 532 && readTotal != expected)
-        {
-            err = true;
-            break;
-        }
-        writeCount = fnio::fwrite(dataBuf, 1, readCount, destFile);
-        // Check if we sent enough bytes on the write
-        if (writeCount != readCount)
-        {
-            err = true;
-            break;
-        }
-        Debug_printf("Copy File: %d bytes of %d\n", readTotal, expected);
-    } while (readTotal < expected);
 
-    if (err == true)
-    {
-        // Remove the destination file and error
-        _fnHosts[destSlot].file_remove((char *)destPath.c_str());
-        sio_error();
-        Debug_printf("Copy File Error! wCount: %d, rCount: %d, rTotal: %d, Expect: %d\n", writeCount, readCount, readTotal, expected);
-    }
-    else
-    {
+    if (ok)
         sio_complete();
-    }
+    else
+        sio_error();
+}
 
-    // copyEnd:
-    fnio::fclose(sourceFile);
-    fnio::fclose(destFile);
-    free(dataBuf);
+// Report on the last copy: state, bytes copied, total bytes
+void sioFuji::sio_copy_file_status()
+{
+    uint8_t status[FUJI_COPY_STATUS_LEN];
+    fujiCopyTask::status_bytes(status);
+    bus_to_computer(status, sizeof(status), false);
 }
 
 // Mount all
@@ -701,36 +680,22 @@ int sioFuji::mount_all(bool siomode)
 {
     bool nodisks = true; // Check at the end if no disks are in a slot and disable config
 
+    fujiSlotOpen opened[8];
+    fuji_open_slots(_fnDisks, 8, _fnHosts, "rb", opened);
+
     for (int i = 0; i < 8; i++)
     {
         fujiDisk &disk = _fnDisks[i];
         fujiHost &host = _fnHosts[disk.host_slot];
-        char flag[4] = {'r', 'b', 0, 0};
-
-        if (disk.access_mode == DISK_ACCESS_MODE_WRITE)
-            flag[2] = '+';
 
-        if (disk.host_slot != INVALID_HOST_SLOT && strlen(disk.filename) > 0)
+        if (opened[i].wanted)
         {
             nodisks = false; // We have a disk in a slot
 
-            if (host.mount() == false)
-            {
-#ifdef ESP_PLATFORM
-                sio_error();
-                return;
-#else
-                return _on_error(siomode);
-#endif
-            }
-
-            Debug_printf("Selecting '%s' from host #%u as %s on D%u:\n",
-                         disk.filename, disk.host_slot, flag, i + 1);
-
-            disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), flag);
-
-            if (disk.fileh == nullptr)
+            disk.fileh = opened[i].fileh;
+            if (!opened[i].host_ok || disk.fileh == nullptr)
             {
+                fuji_close_slots(opened, i + 1, 8);
 #ifdef ESP_PLATFORM
                 sio_error();
                 return;
@@ -743,8 +708,13 @@ int sioFuji::mount_all(bool siomode)
             boot_config = false;
             status_wait_count = 0;
 
-            // We need the file size for loading XEX files and for CASSETTE, so get that too
-            disk.disk_size = host.file_size(disk.fileh);
+            disk.disk_size = opened[i].size;
+
+            if ((disk.access_mode & DISK_ACCESS_MODE_WRITE) && host.get_type() != HOSTTYPE_LOCAL)
+                disk.fileh = FileHandlerWriteback::wrap(disk.fileh, disk.disk_size);
+
+            if (disk.access_mode & DISK_ACCESS_MODE_PRELOAD)
+                disk.fileh = FileHandlerPreload::wrap(disk.fileh, disk.disk_size);
 
             // Set the host slot for high score mode
             // TODO: Refactor along with mount disk image.
@@ -752,6 +722,7 @@ int sioFuji::mount_all(bool siomode)
 
             // And now mount it
             disk.disk_type = disk.disk_dev.mount(disk.fileh, disk.filename, disk.disk_size);
+            fnEvents.publish(fn_event_type::MOUNT, i);
         }
     }
 
@@ -761,6 +732,16 @@ int sioFuji::mount_all(bool siomode)
         boot_config = false;
     }
 
+#if DISK_ROTATION_PRELOAD_SECTORS > 0
+    // image_rotate() cycles the slots up to the first empty one. Everything in them is open and
+    // mounted by now, so all that's left for a swap to wait on is the first reads from its host
+    for (int i = 1; i < 8 && _fnDisks[0].fileh != nullptr && _fnDisks[i].fileh != nullptr; i++)
+    {
+        if (_fnDisks[i].disk_type == MEDIATYPE_ATR)
+            _fnDisks[i].disk_dev.media()->sector_cache_preload(DISK_ROTATION_PRELOAD_SECTORS);
+    }
+#endif
+
 #ifdef ESP_PLATFORM
     sio_complete();
 #else
@@ -776,14 +757,6 @@ void sioFuji::sio_set_boot_mode()
     sio_complete();
 }
 
-char *_generate_appkey_filename(appkey *info)
-{
-    static char filenamebuf[30];
-
-    snprintf(filenamebuf, sizeof(filenamebuf), "/FujiNet/%04hx%02hhx%02hhx.key", info->creator, info->app, info->key);
-    return filenamebuf;
-}
-
 /*
  Opens an "app key".  This just sets the needed app key parameters (creator, app, key, mode)
  for the subsequent expected read/write command. We could've added this information as part
@@ -824,7 +797,7 @@ void sioFuji::sio_open_app_key()
 
     Debug_printf("App key creator = 0x%04hx, app = 0x%02hhx, key = 0x%02hhx, mode = %hhu, filename = \"%s\"\n",
                  _current_appkey.creator, _current_appkey.app, _current_appkey.key, _current_appkey.mode,
-                 _generate_appkey_filename(&_current_appkey));
+                 fujiAppKeys::filename(_current_appkey.creator, _current_appkey.app, _current_appkey.key).c_str());
 
     sio_complete();
 }
@@ -842,7 +815,7 @@ void sioFuji::sio_close_app_key()
 }
 
 /*
- Write an "app key" to SD (ONLY!) storage.
+ Write an "app key" to SD (ONLY!) storage. It reaches the card a little later, see fujiAppKeys
 */
 void sioFuji::sio_write_app_key()
 {
@@ -877,48 +850,16 @@ void sioFuji::sio_write_app_key()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
+    fnAppKeys.write(_current_appkey.creator, _current_appkey.app, _current_appkey.key,
+                    value.data(), std::min((size_t)keylen, value.size()));
 
     // Reset the app key data so we require calling APPKEY OPEN before another attempt
     _current_appkey.creator = 0;
     _current_appkey.mode = APPKEYMODE_INVALID;
 
-    Debug_printf("Writing appkey to \"%s\"\n", filename);
-
-    // Make sure we have a "/FujiNet" directory, since that's where we're putting these files
-    fnSDFAT.create_path("/FujiNet");
-
-    FILE *fOut = fnSDFAT.file_open(filename, FILE_WRITE);
-    if (fOut == nullptr)
-    {
-        Debug_printf("Failed to open/create output file: errno=%d\n", errno);
-        sio_error();
-        return;
-    }
-    size_t count = fwrite(value.data(), 1, keylen, fOut);
-    int e = errno;
-
-    fclose(fOut);
-
-    if (count != keylen)
-    {
-        Debug_printf("Only wrote %u bytes of expected %hu, errno=%d\n", (unsigned)count, keylen, e);
-        sio_error();
-    }
-
     sio_complete();
 }
 
-size_t read_file_into_vector(FILE* fIn, std::vector<uint8_t>& response_data, size_t size) {
-    response_data.resize(size + 2);
-    size_t bytes_read = fread(response_data.data() + 2, 1, size, fIn);
-
-    // Insert the size at the beginning of the vector
-    response_data[0] = static_cast<uint8_t>(bytes_read & 0xFF); // Low byte of the size
-    response_data[1] = static_cast<uint8_t>((bytes_read >> 8) & 0xFF); // High byte of the size
-    return bytes_read;
-}
-
 /*
  Read an "app key" from SD (ONLY!) storage
 */
@@ -943,20 +884,18 @@ void sioFuji::sio_read_app_key()
         return;
     }
 
-    char *filename = _generate_appkey_filename(&_current_appkey);
-    Debug_printf("Reading appkey from \"%s\"\n", filename);
-
-    FILE *fIn = fnSDFAT.file_open(filename, FILE_READ);
-    if (fIn == nullptr)
+    int count = fnAppKeys.read(_current_appkey.creator, _current_appkey.app, _current_appkey.key,
+                               response_data.data() + 2, appkey_size);
+    if (count < 0)
     {
-        Debug_printf("Failed to open input file: errno=%d\n", errno);
         bus_to_computer(response_data.data(), response_data.size(), true);
         return;
     }
+    Debug_printf("Read %d bytes of app key\n", count);
 
-    size_t count = read_file_into_vector(fIn, response_data, appkey_size);
-    Debug_printf("Read %u bytes from input file\n", (unsigned)count);
-    fclose(fIn);
+    // Starts with the size, low byte first
+    response_data[0] = count & 0xFF;
+    response_data[1] = (count >> 8) & 0xFF;
 
 #ifdef DEBUG
 	std::string msg = util_hexdump(response_data.data(), appkey_size);
@@ -1033,6 +972,7 @@ int sioFuji::sio_disk_image_umount(bool siomode, int slot)
         }
         _fnDisks[deviceSlot].disk_dev.device_active = false;
         _fnDisks[deviceSlot].reset();
+        fnEvents.publish(fn_event_type::EJECT, deviceSlot);
     }
     // Handle tape
     // else if (deviceSlot == BASE_TAPE_SLOT)
@@ -1137,6 +1077,7 @@ void sioFuji::sio_open_directory()
         _fnHosts[_current_open_directory_slot].dir_close();
         _current_open_directory_slot = -1;
     }
+    _dir_pages.clear();
 
     // See if there's a search pattern after the directory path
     const char *pattern = nullptr;
@@ -1241,6 +1182,43 @@ void _set_additional_direntry_details(fsdir_entry_t *f, uint8_t *dest, uint8_t m
  * a) There are no more directory entries to process, or
  * b) The next PageGroup would exceed the maximum response size
  */
+// Format every entry of the open directory once, leaving the position where it was
+bool sioFuji::_build_directory_pages()
+{
+    if (_dir_pages.valid)
+    {
+        dir_pages_hits++;
+        return true;
+    }
+    if (_dir_pages.too_large)
+        return false;
+    dir_pages_misses++;
+
+    fujiHost &host = _fnHosts[_current_open_directory_slot];
+    uint16_t pos = host.dir_tell();
+    if (pos == FNFS_INVALID_DIRPOS || !host.dir_seek(0))
+        return false;
+
+    _dir_pages.begin();
+    bool fits = true;
+    fsdir_entry_t *f;
+    while (fits && (f = host.dir_nextfile()) != nullptr)
+        fits = _dir_pages.add_entry(f, DirCache::max_bytes()) && _dir_pages.count() < FNFS_INVALID_DIRPOS;
+    host.dir_seek(pos);
+
+    if (!fits)
+    {
+        Debug_println("Directory too large to keep in block format");
+        _dir_pages.clear();
+        _dir_pages.too_large = true;
+        return false;
+    }
+    _dir_pages.finish();
+    Debug_printf("Directory kept in block format: %u entries, %u bytes\n",
+                 (unsigned)_dir_pages.count(), (unsigned)_dir_pages.data.size());
+    return true;
+}
+
 void sioFuji::sio_read_directory_block()
 {
     Debug_println("Fuji cmd: READ DIRECTORY BLOCK");
@@ -1252,6 +1230,46 @@ void sioFuji::sio_read_directory_block()
     // Debug_printf("Parameters: aux1=$%02X (pages=%d), aux2=$%02X (group_size=%d), max_block_size=%d\n",
     //              cmdFrame.aux1, num_pages, cmdFrame.aux2, group_size, max_block_size);
 
+    // Once the directory is in block format a response is just a few copies
+    if (group_size > 0 && _build_directory_pages())
+    {
+        fujiHost &host = _fnHosts[_current_open_directory_slot];
+        uint16_t count = _dir_pages.count();
+        uint16_t pos = std::min(host.dir_tell(), count);
+
+        std::vector<uint8_t> response(max_block_size, 0);
+        size_t current_pos = 4;
+        uint8_t num_groups = 0;
+        bool is_last_group = false;
+        while (!is_last_group)
+        {
+            // As when reading entry by entry, a group is only the last one if it comes up short
+            uint16_t n = std::min<uint16_t>(group_size, count - pos);
+            is_last_group = n < group_size;
+            size_t size = DirectoryPageGroup::HEADER_SIZE + _dir_pages.entries_size(pos, n);
+            if (current_pos + size > max_block_size)
+                break;
+            current_pos += _dir_pages.write_group(&response[current_pos], pos, n, pos / group_size, is_last_group);
+            pos += n;
+            num_groups++;
+        }
+
+        if (num_groups == 0)
+        {
+            Debug_println("No page groups fit in requested size");
+            sio_error();
+            return;
+        }
+        host.dir_seek(pos);
+
+        response[0] = 'M';
+        response[1] = 'F';
+        response[2] = 4;
+        response[3] = num_groups;
+        bus_to_computer(response.data(), response.size(), false);
+        return;
+    }
+
     // Save current directory position in case we need to rewind
     uint16_t starting_pos = _fnHosts[_current_open_directory_slot].dir_tell();
     // Debug_printf("Starting directory position: %d\n", starting_pos);
@@ -1473,6 +1491,7 @@ void sioFuji::sio_close_directory()
         _fnHosts[_current_open_directory_slot].dir_close();
 
     _current_open_directory_slot = -1;
+    _dir_pages.clear();
     sio_complete();
 }
 
@@ -1593,7 +1612,9 @@ void sioFuji::sio_new_disk()
         return;
     }
 
-    disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), FILE_WRITE);
+    // Reserve the whole image in one contiguous run if the host can, and fill it in place
+    bool reserved = !host.file_preallocate(disk.filename, MediaTypeATR::create_size(newDisk.sectorSize, newDisk.numSectors));
+    disk.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), reserved ? FILE_READ_WRITE : FILE_WRITE);
     if (disk.fileh == nullptr)
     {
         Debug_printf("sio_new_disk Couldn't open file for writing: \"%s\"\n", disk.filename);
@@ -1681,7 +1702,7 @@ void sioFuji::sio_write_host_slots()
             _fnHosts[i].set_hostname(hostSlots[i]);
 
         _populate_config_from_slots();
-        Config.save();
+        Config.save_later();
 
         sio_complete();
     }
@@ -1818,7 +1839,7 @@ void sioFuji::sio_write_device_slots()
 
         // Save the data to disk
         _populate_config_from_slots();
-        Config.save();
+        Config.save_later();
 
         sio_complete();
     }
@@ -1882,7 +1903,7 @@ void sioFuji::_populate_config_from_slots()
             Config.clear_mount(i);
         else
             Config.store_mount(i, _fnDisks[i].host_slot, _fnDisks[i].filename,
-                               _fnDisks[i].access_mode == DISK_ACCESS_MODE_WRITE ? fnConfig::mount_modes::MOUNTMODE_WRITE : fnConfig::mount_modes::MOUNTMODE_READ);
+                               (_fnDisks[i].access_mode & DISK_ACCESS_MODE_WRITE) ? fnConfig::mount_modes::MOUNTMODE_WRITE : fnConfig::mount_modes::MOUNTMODE_READ);
     }
 }
 
@@ -1912,6 +1933,7 @@ void sioFuji::sio_set_hsio_index()
     if (cmdFrame.aux2 & 1)
     {
         Config.store_general_hsioindex(index);
+        SIO.hsio_forget_calibration();
         Config.save();
     }
 
@@ -1967,7 +1989,7 @@ void sioFuji::sio_set_device_filename()
         return;
     }
 
-    Config.save();
+    Config.save_later();
     sio_complete();
 }
 
@@ -2009,6 +2031,25 @@ void sioFuji::sio_set_sio_external_clock()
     sio_complete();
 }
 
+/*
+ Opens a boot image from flash, held in RAM once it's been read. The build stores them
+ gzipped as name.gz to leave flash room for bigger CONFIG images; they're decompressed
+ once, on the way into memory, so boot sectors never go back to flash or the inflater.
+ An uncompressed name is still used if there's no compressed one.
+*/
+static fnFile *_open_flash_boot_image(const char *path)
+{
+    std::string gz_path = std::string(path) + ".gz";
+    fnFile *f = nullptr;
+    if (fsFlash.exists(gz_path.c_str()))
+        f = FileHandlerGzip::wrap(fsFlash.fnfile_open(gz_path.c_str()));
+    if (f == nullptr)
+        f = fsFlash.fnfile_open(path);
+    if (f != nullptr)
+        f = FileHandlerPreload::wrap(f, FileSystem::filesize(f));
+    return f;
+}
+
 // Mounts the desired boot disk number
 void sioFuji::insert_boot_device(uint8_t d)
 {
@@ -2041,11 +2082,11 @@ void sioFuji::insert_boot_device(uint8_t d)
             config_atr = "/autorun-cng.atr";
             Debug_printf("Mounted CONFIG-NG\n");
         }
-        fBoot = fsFlash.fnfile_open(config_atr);
+        fBoot = _open_flash_boot_image(config_atr);
         _bootDisk.mount(fBoot, config_atr, 0);
         break;
     case 1:
-        fBoot = fsFlash.fnfile_open(mount_all_atr);
+        fBoot = _open_flash_boot_image(mount_all_atr);
         _bootDisk.mount(fBoot, mount_all_atr, 0);
         break;
     case 2:
@@ -2087,11 +2128,11 @@ void sioFuji::insert_boot_device(uint8_t d)
             Debug_printf("Mounted CONFIG-NG\n");
         }
         boot_img = config_atr;
-        fBoot = fsFlash.fnfile_open(boot_img);
+        fBoot = _open_flash_boot_image(boot_img);
         break;
     case 1:
         boot_img = mount_all_atr;
-        fBoot = fsFlash.fnfile_open(boot_img);
+        fBoot = _open_flash_boot_image(boot_img);
         break;
     case 2:
         Debug_printf("Mounting lobby server\n");
@@ -2220,7 +2261,7 @@ void sioFuji::sio_qrcode_encode()
         url = fnHTTPD.shorten_url(url);
     }
 
-    std::vector<uint8_t> p = QRManager::encode(
+    QRManager::encode(
         url.c_str(),
         url.size(),
         qrManager.version,
@@ -2328,28 +2369,22 @@ void sioFuji::sio_base64_encode_input()
 
     std::vector<unsigned char> p(len);
     bus_to_peripheral(p.data(), len);
-    base64.base64_buffer += std::string((const char *)p.data(), len);
+    // Encode as the input arrives so only the output is held
+    if (!base64.encoding())
+        base64.encode_begin();
+    base64.encode_update(p.data(), len);
     sio_complete();
 }
 
 void sioFuji::sio_base64_encode_compute()
 {
-    size_t out_len;
-
     Debug_printf("FUJI: BASE64 ENCODE COMPUTE\n");
 
-    std::unique_ptr<char[]> p = Base64::encode(base64.base64_buffer.c_str(), base64.base64_buffer.size(), &out_len);
-    if (!p)
-    {
-        Debug_printf("base64_encode compute failed\n");
-        sio_error();
-        return;
-    }
-
-    base64.base64_buffer.clear();
-    base64.base64_buffer = std::string(p.get(), out_len);
+    if (!base64.encoding())
+        base64.encode_begin();
+    base64.encode_finish();
 
-    Debug_printf("Resulting BASE64 encoded data is: %u bytes\n", out_len);
+    Debug_printf("Resulting BASE64 encoded data is: %u bytes\n", base64.output_length());
     sio_complete();
 }
 
@@ -2357,7 +2392,7 @@ void sioFuji::sio_base64_encode_length()
 {
     Debug_printf("FUJI: BASE64 ENCODE LENGTH\n");
 
-    size_t l = base64.base64_buffer.length();
+    size_t l = base64.output_length();
     uint8_t response[4] = {
         (uint8_t)(l >>  0),
         (uint8_t)(l >>  8),
@@ -2387,9 +2422,9 @@ void sioFuji::sio_base64_encode_output()
         Debug_printf("Refusing to send a zero byte buffer. Aborting\n");
         return;
     }
-    else if (len > base64.base64_buffer.length())
+    else if (len > base64.output_length())
     {
-        Debug_printf("Requested %u bytes, but buffer is only %u bytes, aborting.\n", len, base64.base64_buffer.length());
+        Debug_printf("Requested %u bytes, but buffer is only %u bytes, aborting.\n", len, base64.output_length());
         return;
     }
     else
@@ -2398,9 +2433,7 @@ void sioFuji::sio_base64_encode_output()
     }
 
     std::vector<unsigned char> p(len);
-    std::memcpy(p.data(), base64.base64_buffer.data(), len);
-    base64.base64_buffer.erase(0, len);
-    base64.base64_buffer.shrink_to_fit();
+    base64.output(p.data(), len);
 
     bus_to_computer(p.data(), len, false);
 }
@@ -2426,28 +2459,28 @@ void sioFuji::sio_base64_decode_input()
 
     std::vector<unsigned char> p(len);
     bus_to_peripheral(p.data(), len);
-    base64.base64_buffer += std::string((const char *)p.data(), len);
+    // Decode as the input arrives so only the output is held
+    if (!base64.decoding())
+        base64.decode_begin();
+    base64.decode_update((const char *)p.data(), len);
     sio_complete();
 }
 
 void sioFuji::sio_base64_decode_compute()
 {
-    size_t out_len;
-
     Debug_printf("FUJI: BASE64 DECODE COMPUTE\n");
 
-    std::unique_ptr<unsigned char[]> p = Base64::decode(base64.base64_buffer.c_str(), base64.base64_buffer.size(), &out_len);
-    if (!p)
+    if (!base64.decoding())
+        base64.decode_begin();
+    if (!base64.decode_finish())
     {
-        Debug_printf("base64_encode compute failed\n");
+        Debug_printf("base64_decode compute failed\n");
+        base64.clear_buffer();
         sio_error();
         return;
     }
 
-    base64.base64_buffer.clear();
-    base64.base64_buffer = std::string((const char *)p.get(), out_len);
-
-    Debug_printf("Resulting BASE64 encoded data is: %u bytes\n", out_len);
+    Debug_printf("Resulting BASE64 decoded data is: %u bytes\n", base64.output_length());
     sio_complete();
 }
 
@@ -2455,7 +2488,7 @@ void sioFuji::sio_base64_decode_length()
 {
     Debug_printf("FUJI: BASE64 DECODE LENGTH\n");
 
-    size_t len = base64.base64_buffer.length();
+    size_t len = base64.output_length();
     uint8_t response[4] = {
         (uint8_t)(len >>  0),
         (uint8_t)(len >>  8),
@@ -2487,9 +2520,9 @@ void sioFuji::sio_base64_decode_output()
         sio_error();
         return;
     }
-    else if (len > base64.base64_buffer.length())
+    else if (len > base64.output_length())
     {
-        Debug_printf("Requested %u bytes, but buffer is only %u bytes, aborting.\n", len, base64.base64_buffer.length());
+        Debug_printf("Requested %u bytes, but buffer is only %u bytes, aborting.\n", len, base64.output_length());
         sio_error();
         return;
     }
@@ -2499,9 +2532,7 @@ void sioFuji::sio_base64_decode_output()
     }
 
     std::vector<unsigned char> p(len);
-    memcpy(p.data(), base64.base64_buffer.data(), len);
-    base64.base64_buffer.erase(0, len);
-    base64.base64_buffer.shrink_to_fit();
+    base64.output(p.data(), len);
     bus_to_computer(p.data(), len, false);
 }
 
@@ -2560,6 +2591,54 @@ void sioFuji::sio_hash_clear()
     sio_complete();
 }
 
+/*
+  Hash a file on a host slot without passing it through the Atari.
+  aux1 is the host slot, aux2 the algorithm to run (anything unknown runs
+  all of them). Follow with HASH COMPUTE as for HASH INPUT.
+*/
+void sioFuji::sio_hash_file()
+{
+    Debug_printf("FUJI: HASH FILE\n");
+
+    char path[256];
+    uint8_t hostSlot = cmdFrame.aux1;
+    uint8_t ck = bus_to_peripheral((uint8_t *)&path, sizeof(path));
+
+    if (sio_checksum((uint8_t *)&path, sizeof(path)) != ck)
+    {
+        sio_error();
+        return;
+    }
+    if (!_validate_host_slot(hostSlot, "sio_hash_file"))
+    {
+        sio_error();
+        return;
+    }
+    path[sizeof(path) - 1] = '\0';
+
+    char fullpath[256];
+    fnFile *f = _fnHosts[hostSlot].fnfile_open(path, fullpath, sizeof(fullpath), FILE_READ);
+    if (f == nullptr)
+    {
+        Debug_printf("Couldn't open \"%s\"\n", path);
+        sio_error();
+        return;
+    }
+
+    hasher.select(Hash::to_algorithm(cmdFrame.aux2));
+    long len = hasher.add_stream([f](uint8_t *buf, size_t size) -> int {
+        size_t n = fnio::fread(buf, 1, size, f);
+        return n > 0 || fnio::feof(f) ? (int)n : -1;
+    });
+    fnio::fclose(f);
+
+    Debug_printf("Hashed %ld bytes\n", len);
+    if (len < 0)
+        sio_error();
+    else
+        sio_complete();
+}
+
 void sioFuji::sio_process(uint32_t commanddata, uint8_t checksum)
 {
     cmdFrame.commanddata = commanddata;
@@ -2721,6 +2800,10 @@ void sioFuji::sio_process(uint32_t commanddata, uint8_t checksum)
         sio_late_ack();
         sio_copy_file();
         break;
+    case FUJICMD_COPY_FILE_STATUS:
+        sio_ack();
+        sio_copy_file_status();
+        break;
     case FUJICMD_MOUNT_ALL:
         sio_ack();
         mount_all();
@@ -2805,6 +2888,10 @@ void sioFuji::sio_process(uint32_t commanddata, uint8_t checksum)
         sio_ack();
         sio_hash_clear();
         break;
+    case FUJICMD_HASH_FILE:
+        sio_late_ack();
+        sio_hash_file();
+        break;
     case FUJICMD_RANDOM_NUMBER:
         sio_ack();
         sio_random_number();
@@ -20,6 +20,7 @@
 #include "fujiCmd.h"
 
 #include "hash.h"
+#include "directoryPageGroup.h"
 
 #define MAX_HOSTS 8
 #define MAX_DISK_DEVICES 8
@@ -30,6 +31,10 @@
 
 #define MAX_APPKEY_LEN 64
 
+// Sectors mount_all() reads ahead into the cache of each ATR waiting its turn in a rotation,
+// so a swap doesn't wait on the image's host. 0 turns it off
+#define DISK_ROTATION_PRELOAD_SECTORS 3
+
 #define READ_DEVICE_SLOTS_DISKS1 0x00
 #define READ_DEVICE_SLOTS_TAPE 0x10
 
@@ -94,6 +99,9 @@ private:
     sioCassette _cassetteDev;
 
     int _current_open_directory_slot = -1;
+    // The open directory in block format, built on the first block read
+    DirectoryPageCache _dir_pages;
+    bool _build_directory_pages();
 
     sioDisk _bootDisk; // special disk drive just for configuration
 
@@ -138,6 +146,7 @@ protected:
     void sio_read_device_slots();      // 0xF2
     void sio_write_device_slots();     // 0xF1
     void sio_enable_udpstream();       // 0xF0
+    void sio_copy_file_status();       // 0xEC
     void sio_net_get_wifi_enabled();   // 0xEA
     void sio_set_baudrate();           // 0xEB
 #ifdef ESP_PLATFORM
@@ -178,6 +187,7 @@ protected:
     void sio_hash_output();            // 0xC5
     void sio_get_adapter_config_extended(); // 0xC4
     void sio_hash_clear();             // 0xC2
+    void sio_hash_file();              // 0xC0
     void sio_qrcode_input();           // 0xBC
     void sio_qrcode_encode();          // 0xBD
     void sio_qrcode_length();          // OxBE
@@ -220,6 +230,10 @@ public:
 
     fujiHost *get_hosts(int i) { return &_fnHosts[i]; }
     fujiDisk *get_disks(int i) { return &_fnDisks[i]; }
+
+    // READ DIRECTORY BLOCK requests served from the block format copy, and copies built
+    uint32_t dir_pages_hits = 0;
+    uint32_t dir_pages_misses = 0;
     fujiHost *set_slot_hostname(int host_slot, char *hostname);
 
     void _populate_slots_from_config();
@@ -13,8 +13,6 @@
 
 #include "utils.h"
 
-#define RECVBUFSIZE 1024
-
 #define SIO_MODEMCMD_LOAD_RELOCATOR 0x21
 #define SIO_MODEMCMD_LOAD_HANDLER 0x26
 #define SIO_MODEMCMD_TYPE1_POLL 0x3F
@@ -93,17 +91,33 @@ static void _telnet_event_handler(telnet_t *telnet, telnet_event_t *ev, void *us
     }
 }
 
+/**
+ * The Atari's side of the modem, through whichever UART the SIO bus is using
+ */
+class sioModemPort : public ModemPort
+{
+public:
+    int available() override { return SYSTEM_BUS.uart->available(); }
+    size_t read(uint8_t *buf, size_t len) override { return SYSTEM_BUS.uart->readBytes(buf, len); }
+    size_t write(const uint8_t *buf, size_t len) override { return SYSTEM_BUS.uart->write(buf, len); }
+};
+
 modem::modem(FileSystem *_fs, bool snifferEnable)
 {
     listen_to_type3_polls = true;
     activeFS = _fs;
     modemSniffer = new ModemSniffer(activeFS, snifferEnable);
+    modemPort = new sioModemPort();
+    modemCore = new ModemCore(modemPort, modemSniffer);
     set_term_type("dumb");
     telnet = telnet_init(telopts, _telnet_event_handler, 0, this);
 }
 
 modem::~modem()
 {
+    delete modemCore;
+    delete modemPort;
+
     if (modemSniffer != nullptr)
     {
         delete modemSniffer;
@@ -1059,7 +1073,7 @@ void modem::at_handle_answer()
     if (tcpServer.hasClient())
     {
         tcpClient = tcpServer.available();
-        tcpClient.setNoDelay(true); // try to disable naggle
+        modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
                                     //        tcpServer.stop();
         answerTimer = fnSystem.millis();
         answered = false;
@@ -1126,7 +1140,7 @@ void modem::at_handle_dial()
 
         if (tcpClient.connect(host.c_str(), portInt))
         {
-            tcpClient.setNoDelay(true); // Try to disable naggle
+            modemCore->tune(tcpClient); // bigger socket buffers, and no naggle
             answered = false;
             answerTimer = fnSystem.millis();
             cmdMode = false;
@@ -1735,105 +1749,34 @@ void modem::sio_handle_modem()
             }
         }
 
-        int sioBytesAvail = SYSTEM_BUS.uart->available();
-        //int sioBytesAvail = std::min(0, SYSTEM_BUS.uart->available());
-
         // send from Atari to Fujinet
-        if (sioBytesAvail && tcpClient.connected())
+        if (modemPort->available() && tcpClient.connected())
         {
             fnLedManager.set(eLed::LED_BT,true);
-            
-            // In telnet in worst case we have to escape every uint8_t
-            // so leave half of the buffer always free
-            //int max_buf_size;
-            //if (telnet == true)
-            //  max_buf_size = TX_BUF_SIZE / 2;
-            //else
-            //  max_buf_size = TX_BUF_SIZE;
-
-            // Read from serial, the amount available up to
-            // maximum size of the buffer
-            int sioBytesRead = SYSTEM_BUS.uart->readBytes(&txBuf[0], //SIO_UART.readBytes(&txBuf[0],
-                                                   (sioBytesAvail > TX_BUF_SIZE) ? TX_BUF_SIZE : sioBytesAvail);
-
-            // Disconnect if going to AT mode with "+++" sequence
-            for (int i = 0; i < (int)sioBytesRead; i++)
-            {
-                if (txBuf[i] == '+')
-                    plusCount++;
-                else
-                    plusCount = 0;
-                if (plusCount >= 3)
-                {
-                    plusTime = fnSystem.millis();
-                }
-                if (txBuf[i] != '+')
-                {
-                    plusCount = 0;
-                }
-            }
-
-            // Write the buffer to TCP finally
-            if (use_telnet == true)
-            {
-                telnet_send(telnet, (const char *)txBuf, sioBytesRead);
-            }
-            else
-            {
-                tcpClient.write(&txBuf[0], sioBytesRead);
-            }
-            // And send it off to the sniffer, if enabled.
-            modemSniffer->dumpOutput(&txBuf[0], sioBytesRead);
+            modemCore->toTcp(tcpClient, use_telnet);
             _lasttime = fnSystem.millis();
-
             fnLedManager.set(eLed::LED_BT,false);
         }
 
         // read from Fujinet to Atari
-        unsigned char buf[RECVBUFSIZE];
-        int bytesAvail = 0;
-
-        // check to see how many bytes are avail to read
-        while ((bytesAvail = tcpClient.available()) > 0)
+        if (tcpClient.available() > 0)
         {
             fnLedManager.set(eLed::LED_BT,true);
-
-            // read as many as our buffer size will take (RECVBUFSIZE)
-            unsigned int bytesRead =
-                tcpClient.read(buf, (bytesAvail > RECVBUFSIZE) ? RECVBUFSIZE : bytesAvail);
-
-            if (use_telnet == true)
-            {
-                telnet_recv(telnet, (const char *)buf, bytesRead);
-            }
-            else
-            {
-                SYSTEM_BUS.uart->write(buf, bytesRead);
-                SYSTEM_BUS.uart->flush();
-            }
-
-            fnLedManager.set(eLed::LED_BT,false);
- 
-            // And dump to sniffer, if enabled.
-            modemSniffer->dumpInput(buf, bytesRead);
+            modemCore->fromTcp(tcpClient, use_telnet ? telnet : nullptr);
             _lasttime = fnSystem.millis();
+            fnLedManager.set(eLed::LED_BT,false);
         }
     }
 
     // If we have received "+++" as last bytes from serial port and there
     // has been over a second without any more bytes, go back to command mode.
-    if (plusCount >= 3)
+    if (modemCore->escapeRequested())
     {
-        if (fnSystem.millis() - plusTime > 1000)
-        {
-            Debug_println("Going back to command mode");
+        Debug_println("Going back to command mode");
 
-            at_cmd_println("OK");
-    
-            cmdMode = true;
+        at_cmd_println("OK");
 
-            plusCount = 0;
-        }
+        cmdMode = true;
     }
 
     // Go to command mode if TCP disconnected and not in command mode
@@ -8,6 +8,7 @@
 #include "fnTcpServer.h"
 
 #include "modem-sniffer.h"
+#include "modem-core.h"
 #include "libtelnet.h"
 
 /* Keep strings under 40 characters, for the benefit of 40-column users! */
@@ -163,12 +164,6 @@ private:
     unsigned long lastRingMs = 0;  // Time of last "RING" message (millis())
 #else
     uint64_t lastRingMs = 0;       // Time of last "RING" message (millis())
-#endif
-    char plusCount = 0;            // Go to AT mode at "+++" sequence, that has to be counted
-#ifdef ESP_PLATFORM
-    unsigned long plusTime = 0;    // When did we last receive a "+++" sequence
-#else
-    uint64_t plusTime = 0;         // When did we last receive a "+++" sequence
 #endif
     uint8_t txBuf[TX_BUF_SIZE];
     bool cmdOutput=true;            // toggle whether to emit command output
@@ -180,6 +175,8 @@ private:
     bool answerHack=false;          // ATA answer hack on SIO write.
     FileSystem *activeFS;           // Active Filesystem for ModemSniffer.
     ModemSniffer* modemSniffer;     // ptr to modem sniffer.
+    ModemPort* modemPort;           // Atari side of the data path.
+    ModemCore* modemCore;           // data path while connected.
 #ifdef ESP_PLATFORM
     time_t _lasttime;               // most recent timestamp of data activity.
 #else
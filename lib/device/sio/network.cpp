@@ -17,6 +17,8 @@
 
 #include "fnSystem.h"
 #include "utils.h"
+#include "fnDNS.h"
+#include "cmdArena.h"
 
 #include "status_error_codes.h"
 #include "TCP.h"
@@ -199,6 +201,7 @@ void sioNetwork::sio_open()
     }
 
     // Everything good, start the interrupt timer!
+    coalesceSince = 0;
     timer_start();
 
     // Go ahead and send an interrupt, so Atari knows to get status.
@@ -248,6 +251,11 @@ void sioNetwork::sio_close()
     else
         sio_complete();
 
+    if (protocol->bufferPeak > buffer_peak)
+        buffer_peak = protocol->bufferPeak;
+    Debug_printf("N%d: buffer peak %u bytes this connection, %u overall\n",
+                 id() - SIO_DEVICEID_FN_NETWORK + 1, (unsigned)protocol->bufferPeak, (unsigned)buffer_peak);
+
     // Delete the protocol object
     delete protocol;
     protocol = nullptr;
@@ -309,8 +317,69 @@ void sioNetwork::sio_read()
 
     // And send off to the computer
     bus_to_computer((uint8_t *)receiveBuffer->data(), num_bytes, err);
+    // Keep the capacity for the next frame; Protocol::close() gives it back
     receiveBuffer->erase(0, num_bytes);
-    receiveBuffer->shrink_to_fit();
+}
+
+/**
+ * SIO Status and Read command
+ */
+void sioNetwork::sio_status_read()
+{
+    unsigned short frame_len = sio_get_aux();
+    bool err = false;
+
+    sio_ack();
+
+    if (receiveBuffer == nullptr || protocol == nullptr || frame_len < STATUS_READ_HEADER_SIZE)
+    {
+        status.error = receiveBuffer == nullptr ? NETWORK_ERROR_COULD_NOT_ALLOCATE_BUFFERS : NETWORK_ERROR_NOT_CONNECTED;
+        sio_error();
+        return;
+    }
+
+    // The status call brings in what's waiting, same as before a READ
+    switch (channelMode)
+    {
+    case PROTOCOL:
+        err = protocol->status(&status);
+        break;
+    case JSON:
+        sio_status_channel_json(&status);
+        break;
+    }
+    protocol->forceStatus = false;
+
+    unsigned short len = status.rxBytesWaiting;
+    if (len > receiveBuffer->length())
+        len = receiveBuffer->length();
+    if (len > frame_len - STATUS_READ_HEADER_SIZE)
+        len = frame_len - STATUS_READ_HEADER_SIZE;
+    if (channelMode == JSON)
+        sio_read_channel_json(len);
+
+    unsigned short left = status.rxBytesWaiting - len;
+    uint8_t *frame = cmd_arena.alloc_array<uint8_t>(frame_len);
+    if (frame == nullptr)
+    {
+        sio_error();
+        return;
+    }
+    memset(frame, 0, frame_len);
+    frame[0] = left & 0xFF;
+    frame[1] = left >> 8;
+    frame[2] = status.connected;
+    frame[3] = status.error;
+    frame[4] = len & 0xFF;
+    frame[5] = len >> 8;
+    memcpy(&frame[STATUS_READ_HEADER_SIZE], receiveBuffer->data(), len);
+
+#ifdef VERBOSE_PROTOCOL
+    Debug_printf("sio_status_read() - %u bytes, BW: %u C: %u E: %u\n", len, left, status.connected, status.error);
+#endif
+
+    bus_to_computer(frame, frame_len, err);
+    receiveBuffer->erase(0, len);
 }
 
 /**
@@ -381,7 +450,13 @@ void sioNetwork::sio_write()
 
     // Get the data from the Atari
     bus_to_peripheral(newData.data(), num_bytes); // TODO test checksum
-    *transmitBuffer += string((char *)newData.data(), num_bytes);
+    if (!protocol->buffer_append(transmitBuffer, (char *)newData.data(), num_bytes))
+    {
+        // Over quota; the computer has to let the protocol drain before sending more
+        status.error = NETWORK_ERROR_NO_SPACE_ON_DEVICE;
+        sio_error();
+        return;
+    }
 
     // Do the channel write
     err = sio_write_channel(num_bytes);
@@ -780,6 +855,9 @@ void sioNetwork::do_inquiry(unsigned char inq_cmd)
         case 'Z': // Set interrupt rate
             inq_dstats = 0x00;
             break;
+        case 'z': // Set interrupt coalescing
+            inq_dstats = 0x00;
+            break;
         case 'T': // Set Translation
             inq_dstats = 0x00;
             break;
@@ -822,6 +900,9 @@ void sioNetwork::sio_special_00()
     case 'Z':
         sio_set_timer_rate();
         break;
+    case 'z':
+        sio_set_interrupt_coalescing();
+        break;
     case 0xFB: // JSON parameter wrangling
         sio_set_json_parameters();
         break;
@@ -852,9 +933,12 @@ void sioNetwork::sio_special_40()
         return;
     }
 
-    bus_to_computer((uint8_t *)receiveBuffer->data(),
-                    SPECIAL_BUFFER_SIZE,
-                    protocol->special_40((uint8_t *)receiveBuffer->data(), SPECIAL_BUFFER_SIZE, &cmdFrame));
+    // The payload gets its own buffer: receiveBuffer is not sized for it and may hold unread data
+    uint8_t spData[SPECIAL_BUFFER_SIZE];
+    memset(spData, 0, SPECIAL_BUFFER_SIZE);
+
+    bool err = protocol->special_40(spData, SPECIAL_BUFFER_SIZE, &cmdFrame);
+    bus_to_computer(spData, SPECIAL_BUFFER_SIZE, err);
 }
 
 /**
@@ -943,6 +1027,9 @@ void sioNetwork::sio_process(uint32_t commanddata, uint8_t checksum)
     case 'S':
         sio_status();
         break;
+    case 'G':
+        sio_status_read();
+        break;
     case 0xFF:
         sio_special_inquiry();
         break;
@@ -973,7 +1060,7 @@ void sioNetwork::sio_poll_interrupt()
         protocol->status(&status);
         protocol->fromInterrupt = false;
 
-        if (status.rxBytesWaiting > 0 || status.connected == 0)
+        if (status.connected == 0 || sio_interrupt_due(status.rxBytesWaiting))
             sio_assert_interrupt();
 #ifndef ESP_PLATFORM
         else
@@ -1033,8 +1120,11 @@ void sioNetwork::create_devicespec()
 */
 void sioNetwork::create_url_parser()
 {
-    std::string url = deviceSpec.substr(deviceSpec.find(":") + 1);
-    urlParser = PeoplesUrlParser::parseURL(url);
+    std::string_view url(deviceSpec);
+    urlParser = PeoplesUrlParser::parseURL(url.substr(url.find(':') + 1));
+
+    if (urlParser->isValidUrl())
+        dns_prefetch(urlParser->host);
 }
 
 void sioNetwork::parse_and_instantiate_protocol()
@@ -1113,27 +1203,30 @@ void sioNetwork::timer_stop()
 void sioNetwork::processCommaFromDevicespec()
 {
     size_t comma_pos = deviceSpec.find(",");
-    vector<string> tokens;
 
     if (comma_pos == string::npos)
         return; // no comma
 
-    tokens = util_tokenize(deviceSpec, ',');
-
-    for (vector<string>::iterator it = tokens.begin(); it != tokens.end(); ++it)
+    // Walk the items in place rather than splitting into new strings
+    std::string_view rest(deviceSpec);
+    while (!rest.empty())
     {
-        string item = *it;
+        size_t end = rest.find(',');
+        std::string_view item = rest.substr(0, end);
+        rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+        if (item.empty())
+            continue;
 
         Debug_printf("processCommaFromDeviceSpec() found one.\n");
 
         if (item[0] != 'N')
             continue;                                       // not us.
-        else if (item[1] == ':' && cmdFrame.device != 0x71) // N: but we aren't N1:
+        else if (item.size() > 1 && item[1] == ':' && cmdFrame.device != 0x71) // N: but we aren't N1:
             continue;                                       // also not us.
         else
         {
             // This is our deviceSpec.
-            deviceSpec = item;
+            deviceSpec = std::string(item);
             break;
         }
     }
@@ -1203,31 +1296,30 @@ void sioNetwork::sio_set_json_query()
             in[i] = 0x00;
     }
 
-    std::string in_string(reinterpret_cast<char*>(in));
-    size_t last_colon_pos = in_string.rfind(':');
-
-    std::string inp_string;
-    if (last_colon_pos != std::string::npos) {
+    const char *inp_string = reinterpret_cast<char*>(in);
+    const char *last_colon = strrchr(inp_string, ':');
+    if (last_colon != nullptr) {
         // Skip the device spec. There was a debug message here,
         // but it was removed, because there are cases where
         // removing the devicespec isn't possible, e.g. accessing
         // via CIO (as an XIO). -thom
-        inp_string = in_string.substr(last_colon_pos + 1);
-    } else {
-        inp_string = in_string;
+        inp_string = last_colon + 1;
     }
 
     json->setReadQuery(inp_string, cmdFrame.aux2);
     json_bytes_remaining = json->json_bytes_remaining;
 
-    std::vector<uint8_t> tmp(json_bytes_remaining);
-    json->readValue(tmp.data(), json_bytes_remaining);
+    uint8_t *tmp = cmd_arena.alloc_array<uint8_t>(json_bytes_remaining);
+    if (tmp != nullptr)
+    {
+        json->readValue(tmp, json_bytes_remaining);
 
-    // don't copy past first nul char in tmp
-    auto null_pos = std::find(tmp.begin(), tmp.end(), 0);
-    *receiveBuffer += std::string(tmp.begin(), null_pos);
+        // don't copy past first nul char in tmp
+        const uint8_t *null_pos = (const uint8_t *)memchr(tmp, 0, json_bytes_remaining);
+        receiveBuffer->append((const char *)tmp, null_pos ? null_pos - tmp : json_bytes_remaining);
+    }
 
-    Debug_printf("Query set to >%s<\r\n", inp_string.c_str());
+    Debug_printf("Query set to >%s<\r\n", inp_string);
     sio_complete();
 }
 
@@ -1236,6 +1328,7 @@ void sioNetwork::sio_set_json_parameters()
     // aux1  | aux2    |    meaning
     // 0     | 0/1/2   |  Set the json->_queryParam value, which is the translation value for string processing
     // 1     |   c     |  Set the json->lineEnding = c, convert from char to single byte string
+    // 2     |  0/1    |  Off/on: the next parse keeps only the value at the current query
 
     switch (cmdFrame.aux1)
     {
@@ -1258,6 +1351,15 @@ void sioNetwork::sio_set_json_parameters()
         sio_complete();
         break;
     }
+    case 2:     // PARSE FILTER
+        if (cmdFrame.aux2 > 1)
+        {
+            sio_error();
+            return;
+        }
+        json->setParseFilter(cmdFrame.aux2 == 1);
+        sio_complete();
+        break;
     default:
         sio_error();
         break;
@@ -1278,6 +1380,35 @@ void sioNetwork::sio_set_timer_rate()
     sio_complete();
 }
 
+void sioNetwork::sio_set_interrupt_coalescing()
+{
+    coalesceBytes = cmdFrame.aux1 * 16;
+    coalesceWindow = cmdFrame.aux2 * 10;
+    coalesceSince = 0;
+
+    Debug_printf("sioNetwork::sio_set_interrupt_coalescing(%u bytes, %u ms)\n", coalesceBytes, coalesceWindow);
+
+    sio_complete();
+}
+
+bool sioNetwork::sio_interrupt_due(uint16_t waiting)
+{
+    if (waiting == 0)
+    {
+        coalesceSince = 0;
+        return false;
+    }
+
+    if (coalesceBytes == 0 || waiting >= coalesceBytes)
+        return true;
+
+    // A trickle still gets through once it's waited out the window
+    uint64_t ms = fnSystem.millis();
+    if (coalesceSince == 0)
+        coalesceSince = ms;
+    return ms - coalesceSince >= coalesceWindow;
+}
+
 void sioNetwork::sio_do_idempotent_command_80()
 {
     Debug_printf("sioNetwork::sio_do_idempotent_command_80()\r\n");
@@ -32,6 +32,11 @@
 
 #define NEWDATA_SIZE 65535
 
+/**
+ * Status and length in front of the data in a Status and Read frame
+ */
+#define STATUS_READ_HEADER_SIZE 6
+
 class sioNetwork : public virtualDevice
 {
 
@@ -80,6 +85,14 @@ public:
      */
     virtual void sio_read();
 
+    /**
+     * SIO Status and Read command
+     * Status, then as much of what's waiting as fits in the frame of aux1/aux2 bytes, so a read takes one
+     * command instead of two. The frame is the status as for 'S', with bytes waiting being what's left
+     * after this frame, then the 16 bit length of the data and the data, null padded to the frame size.
+     */
+    virtual void sio_status_read();
+
     /**
      * SIO Write command
      * Write # of bytes specified by aux1/aux2 from tx_buffer out to SIO. If protocol is unable to return requested
@@ -132,6 +145,11 @@ public:
      */
     void sio_poll_interrupt();
 
+    /**
+     * Whether an open protocol has to be checked by sio_poll_interrupt() on every pass
+     */
+    bool sio_interrupt_polled() { return protocol != nullptr && protocol->interruptEnable; }
+
     /**
      * Process incoming SIO command for device 0x7X
      * @param comanddata incoming 4 bytes containing command and aux bytes
@@ -239,6 +257,15 @@ private:
     int timerRate = 20;
 #endif
 
+    /**
+     * Interrupt coalescing, set by SIO call 'z'. PROCEED waits until there
+     * are coalesceBytes waiting, or the first of them has waited
+     * coalesceWindow ms. 0 bytes asserts it for any data, as before
+     */
+    uint16_t coalesceBytes = 0;
+    uint16_t coalesceWindow = 0;
+    uint64_t coalesceSince = 0;
+
     /**
      * The channel mode for the currently open SIO device. By default, it is PROTOCOL, which passes
      * read/write/status commands to the protocol. Otherwise, it's a special mode, e.g. to pass to
@@ -269,6 +296,11 @@ private:
      */
     unsigned short json_bytes_remaining = 0;
 
+    /**
+     * Most bytes any protocol on this device has held in its buffers
+     */
+    size_t buffer_peak = 0;
+
     /**
      * @brief the write buffer
      */
@@ -423,6 +455,16 @@ private:
      */
     void sio_set_timer_rate();
 
+    /**
+     * @brief Set interrupt coalescing, aux1 = bytes / 16, aux2 = window in 10 ms
+     */
+    void sio_set_interrupt_coalescing();
+
+    /**
+     * @brief True if the data waiting should raise PROCEED now
+     */
+    bool sio_interrupt_due(uint16_t waiting);
+
     /**
      * @brief perform ->FujiNet commands on protocols that do not use an explicit OPEN channel.
      */
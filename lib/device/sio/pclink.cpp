@@ -19,7 +19,12 @@
 #include <sys/time.h>
 #include <utime.h>
 
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
 #include "compat_dirent.h"
+#include "compat_string.h"
 
 #include "modem.h"
 #include "utils.h"
@@ -163,12 +168,40 @@ static ulong upper_dir = 0;
 
 static DEVICE device[16];	/* one PCLINK device with 16 units */
 
+/* Directory listings kept per unit, so opening a directory and then
+ * reading it doesn't readdir() and stat() every file more than once.
+ * Anything that changes files drops them; they also go stale on their own,
+ * in case the directory is changed from outside PCLink.
+ */
+# define SNAPSHOT_MAX_AGE_MS 5000
+
+typedef struct
+{
+	char name[13];		/* host name, already checked to be a valid 8.3 name */
+	struct stat sb;
+} SNAPENTRY;
+
+static struct
+{
+	char path[1024];	/* host directory, empty if none */
+	SNAPENTRY *entries;
+	int count;
+	uint64_t taken;		/* fnSystem.millis() when read */
+} dir_snap[16];
+
+/* File data goes over the wire this much at a time */
+# define PCLINK_CHUNK_SIZE 1024
+
 #  define COM_COMD 0
 #  define COM_DATA 1
 
 static void pclink_ack(ushort devno, ushort d, uchar what);
 static uint8_t pclink_read(uint8_t *buf, int len);
+static void pclink_discard(ulong len);
 static void pclink_write(uint8_t *buf, int len);
+static ulong pclink_write_file(FILE *fp, ulong len);
+static void pclink_write_padded(uint8_t *buf, ulong have, ulong len);
+static uchar *xfer_buffer(ulong len);
 
 /* Calculate Atari-style CRC for the given buffer
  */
@@ -491,6 +524,75 @@ check_dos_name(char *newpath, struct dirent *dp, struct stat *sb)
 	return 0;
 }
 
+static void
+dir_snapshot_invalidate(void)
+{
+	int unit;
+
+	for (unit = 0; unit < 16; unit++)
+	{
+		free(dir_snap[unit].entries);
+		dir_snap[unit].entries = NULL;
+		dir_snap[unit].count = 0;
+		dir_snap[unit].path[0] = 0;
+	}
+}
+
+/* Entries of host directory 'path' that SDX can see, read afresh only when needed */
+static SNAPENTRY *
+dir_snapshot(uchar cunit, const char *path, int *count)
+{
+	DIR *dh;
+	struct dirent *dp;
+	struct stat sb;
+	int size = 0;
+
+	if (dir_snap[cunit].path[0] && (strcmp(dir_snap[cunit].path, path) == 0) && \
+		(fnSystem.millis() - dir_snap[cunit].taken < SNAPSHOT_MAX_AGE_MS))
+	{
+		*count = dir_snap[cunit].count;
+		return dir_snap[cunit].entries;
+	}
+
+	free(dir_snap[cunit].entries);
+	dir_snap[cunit].entries = NULL;
+	dir_snap[cunit].count = 0;
+	dir_snap[cunit].path[0] = 0;
+	*count = 0;
+
+	dh = opendir(path);
+	if (dh == NULL)
+		return NULL;
+
+	while ((dp = readdir(dh)) != NULL)
+	{
+		SNAPENTRY *se;
+
+		if (check_dos_name((char *)path, dp, &sb))
+			continue;
+
+		if (dir_snap[cunit].count == size)
+		{
+			size = size ? size * 2 : 32;
+			se = (SNAPENTRY *)realloc(dir_snap[cunit].entries, size * sizeof(SNAPENTRY));
+			if (se == NULL)
+				break;
+			dir_snap[cunit].entries = se;
+		}
+
+		se = &dir_snap[cunit].entries[dir_snap[cunit].count++];
+		strlcpy(se->name, dp->d_name, sizeof(se->name));
+		memcpy(&se->sb, &sb, sizeof(sb));
+	}
+	closedir(dh);
+
+	strlcpy(dir_snap[cunit].path, path, sizeof(dir_snap[cunit].path));
+	dir_snap[cunit].taken = fnSystem.millis();
+
+	*count = dir_snap[cunit].count;
+	return dir_snap[cunit].entries;
+}
+
 static void
 fps_close(int i)
 {
@@ -533,21 +635,12 @@ static ulong
 get_file_len(uchar handle)
 {
 	ulong filelen;
-	struct dirent *dp;
-	struct stat sb;
+	int count;
 
 	if (iodesc[handle].fpmode & 0x10)	/* directory */
 	{
-		rewinddir(iodesc[handle].fps.dir);
-		filelen = sizeof(DIRENTRY);
-
-		while ((dp = readdir(iodesc[handle].fps.dir)) != NULL)
-		{
-			if (check_dos_name(iodesc[handle].pathname, dp, &sb))
-				continue;
-			filelen += sizeof(DIRENTRY);
-		}
-		rewinddir(iodesc[handle].fps.dir);
+		dir_snapshot(iodesc[handle].cunit, iodesc[handle].pathname, &count);
+		filelen = sizeof(DIRENTRY) * (count + 1);
 	}
 	else
 		filelen = iodesc[handle].fpstat.st_size;
@@ -566,8 +659,8 @@ cache_dir(uchar handle)
 	ushort node;
 	ulong dlen, flen, sl, dirlen = iodesc[handle].fpstat.st_size;
 	DIRENTRY *dbuf, *dir;
-	struct dirent *dp;
-	struct stat sb;
+	SNAPENTRY *snap;
+	int count, n;
 
 	if (iodesc[handle].dir_cache != NULL)
 	{
@@ -620,12 +713,12 @@ cache_dir(uchar handle)
 
 	node = 1;
 
-	while ((dp = readdir(iodesc[handle].fps.dir)) != NULL)
+	snap = dir_snapshot(iodesc[handle].cunit, iodesc[handle].pathname, &count);
+
+	for (n = 0; n < count; n++)
 	{
 		ushort map;
-
-		if (check_dos_name(iodesc[handle].pathname, dp, &sb))
-			continue;
+		struct stat &sb = snap[n].sb;
 
 		dlen = sb.st_size;
 		if (dlen > SDX_MAXLEN)
@@ -648,7 +741,7 @@ cache_dir(uchar handle)
 		dir->len_m = (dlen & 0x0000ff00L) >> 8;
 		dir->len_h = (dlen & 0x00ff0000L) >> 16;
 
-		ugefina(dp->d_name, (char *)dir->fname);
+		ugefina(snap[n].name, (char *)dir->fname);
 
 		unix_time_2_sdx(&sb.st_mtime, dir->stamp);
 
@@ -679,7 +772,7 @@ dir_read(uchar *mem, ulong blk_size, uchar handle, int *eof_sig)
 		eof_sig[0] = 1;
 	}
 
-	if (blk_size)
+	if (blk_size && mem)
 		memcpy(mem, db+iodesc[handle].fppos, blk_size);
 
 	return blk_size;
@@ -907,7 +1000,7 @@ timestamp2mtime(uchar *stamp)
 static void
 do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 {
-	uchar ck, sck, fno, ob[7], handle;
+	uchar ck, sck, fno = 0xff, ob[7], handle;
 	ushort cunit = caux2 & 0x0f, parsize;
 	ulong faux;
 	struct stat sb;
@@ -1059,9 +1152,8 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 
 		Debug_printf("handle %d\n", handle);
 
-		//mem = (uchar*)malloc(blk_size + 1);
-		mem = (uchar*)malloc(blk_size);
-
+		/* Data goes out straight from the directory cache or the file, as
+		 * it's read, rather than through a buffer of the whole block */
 		if (device[cunit].status.err == 1)
 		{
 			iodesc[handle].fpread = blk_size;
@@ -1071,7 +1163,8 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 				ulong rdata;
 				int eof_sig;
 
-				rdata = dir_read(mem, blk_size, handle, &eof_sig);
+				mem = (uchar *)iodesc[handle].dir_cache + iodesc[handle].fppos;
+				rdata = dir_read(NULL, blk_size, handle, &eof_sig);
 
 				if (rdata != blk_size)
 				{
@@ -1087,35 +1180,47 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 						device[cunit].status.err = 255;
 					}
 				}
+
+				pclink_ack(devno, cunit, 'C');
+				pclink_write_padded(mem, rdata, blk_size);
+			}
+			else if (fseek(iodesc[handle].fps.file, iodesc[handle].fppos, SEEK_SET))
+			{
+				Debug_printf("FREAD: cannot seek to $%04lx (%ld)\n", iodesc[handle].fppos, iodesc[handle].fppos);
+				device[cunit].status.err = 166;
+				iodesc[handle].fpread = 0;
+
+				pclink_ack(devno, cunit, 'C');
+				pclink_write_padded(NULL, 0, blk_size);
 			}
 			else
 			{
-				if (fseek(iodesc[handle].fps.file, iodesc[handle].fppos, SEEK_SET))
-				{
-					Debug_printf("FREAD: cannot seek to $%04lx (%ld)\n", iodesc[handle].fppos, iodesc[handle].fppos);
-					device[cunit].status.err = 166;
-				}
-				else
-				{
-					long fdata = fread(mem, sizeof(char), blk_size, iodesc[handle].fps.file);
+				ulong fdata;
 
-					if ((ulong)fdata != blk_size)
+				pclink_ack(devno, cunit, 'C');
+				fdata = pclink_write_file(iodesc[handle].fps.file, blk_size);
+
+				if (fdata != blk_size)
+				{
+					Debug_printf("FREAD: cannot read %ld bytes from file\n", blk_size);
+					if (feof(iodesc[handle].fps.file))
 					{
-						Debug_printf("FREAD: cannot read %ld bytes from file\n", blk_size);
-						if (feof(iodesc[handle].fps.file))
-						{
-							iodesc[handle].fpread = fdata;
-							device[cunit].status.err = 136;
-						}
-						else
-						{
-							iodesc[handle].fpread = 0;
-							device[cunit].status.err = 255;
-						}
+						iodesc[handle].fpread = fdata;
+						device[cunit].status.err = 136;
+					}
+					else
+					{
+						iodesc[handle].fpread = 0;
+						device[cunit].status.err = 255;
 					}
 				}
 			}
 		}
+		else
+		{
+			pclink_ack(devno, cunit, 'C');
+			pclink_write_padded(NULL, 0, blk_size);
+		}
 
 		iodesc[handle].fppos += iodesc[handle].fpread;
 
@@ -1129,15 +1234,7 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 
 		set_status_size(devno, cunit, iodesc[handle].fpread);
 
-		Debug_printf("FREAD: send $%04lx (%ld), status $%02x\n", blk_size, blk_size, device[cunit].status.err);
-
-		//sck = calc_checksum(mem, blk_size);
-		//mem[blk_size] = sck;
-		pclink_ack(devno, cunit, 'C');
-		//com_write(mem, blk_size + 1);
-		pclink_write(mem, blk_size); // write data + checksum byte
-
-		free(mem);
+		Debug_printf("FREAD: sent $%04lx (%ld), status $%02x\n", blk_size, blk_size, device[cunit].status.err);
 
 		goto exit;
 	}
@@ -1191,8 +1288,17 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 			}
 		}
 
-		//mem = (uchar*)malloc(blk_size + 1);
-		mem = (uchar*)malloc(blk_size);
+		mem = xfer_buffer(blk_size);
+
+		if (mem == NULL)
+		{
+			/* Still take the whole frame off the wire */
+			Debug_printf("FWRITE: no memory for $%04lx bytes\n", blk_size);
+			pclink_discard(blk_size);
+			pclink_ack(devno, cunit, 'A');
+			device[cunit].status.err = 255;
+			goto complete;
+		}
 
 		sck = pclink_read(mem, blk_size);  // read data + checksum byte
 		ck = calc_checksum(mem, blk_size); // calculate checksum from data
@@ -1203,7 +1309,6 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 		{
 			Debug_printf("FWRITE: block CRC mismatch (sent $%02x, calculated $%02x)\n", sck, ck);
 			device[cunit].status.err = 143;
-			free(mem);
 			goto complete;
 		}
 
@@ -1236,7 +1341,6 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 
 		Debug_printf("FWRITE: received $%04lx (%ld), status $%02x\n", blk_size, blk_size, device[cunit].status.err);
 
-		free(mem);
 		goto complete;
 	}
 
@@ -1495,7 +1599,6 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 		}
 		else	/* ccom not 'P', execution stage */
 		{
-			DIR *dh;
 			uchar i;
 			long sl;
 			struct stat tempstat;
@@ -1562,38 +1665,41 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 				goto complete_fopen;
 			}
 
-			dh = opendir(newpath);
-
 			if (device[cunit].parbuf.fmode & 0x10)
 			{
-				iodesc[i].fps.dir = dh;
+				iodesc[i].fps.dir = opendir(newpath);
 				memcpy(&sb, &tempstat, sizeof(sb));
 			}
 			else
 			{
-				while ((dp = readdir(dh)) != NULL)
+				SNAPENTRY *snap, *found = NULL;
+				int count, n;
+
+				snap = dir_snapshot(cunit, newpath, &count);
+				for (n = 0; n < count; n++)
 				{
-					if (check_dos_name(newpath, dp, &sb))
-						continue;
-		
 					/* convert 8+3 to NNNNNNNNXXX */
-					ugefina(dp->d_name, raw_name);
+					ugefina(snap[n].name, raw_name);
 
 					/* match */
 					if (match_dos_names(raw_name, \
 						(char *)device[cunit].parbuf.name, \
-							device[cunit].parbuf.fatr1, &sb) == 0)
+							device[cunit].parbuf.fatr1, &snap[n].sb) == 0)
+					{
+						found = &snap[n];
+						memcpy(&sb, &found->sb, sizeof(sb));
 						break;
+					}
 				}
 
 				sl = strlen(newpath);
 				if (sl && (newpath[sl-1] != '/'))
 					strcat(newpath, "/");
 
-				if (dp)
+				if (found)
 				{
-					strcat(newpath, dp->d_name);
-					ugefina(dp->d_name, raw_name);
+					strcat(newpath, found->name);
+					ugefina(found->name, raw_name);
 					if ((device[cunit].parbuf.fmode & 0x0c) == 0x08)
 						sb.st_mtime = timestamp2mtime(&device[cunit].parbuf.f1);
 				}
@@ -1603,8 +1709,6 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 					{
 						Debug_printf("FOPEN: file not found\n");
 						device[cunit].status.err = 170;
-						closedir(dh);
-						dp = NULL;
 						goto complete_fopen;
 					}
 					else
@@ -1686,9 +1790,6 @@ do_pclink(uchar devno, uchar ccom, uchar caux1, uchar caux2)
 				}
 				else if ((device[cunit].parbuf.fmode & 0x0d) == 0x0c)
 					iodesc[i].fps.file = fopen(newpath, "r+");
-
-				closedir(dh);
-				dp = NULL;
 			}
 
 			if (iodesc[i].fps.file == NULL)
@@ -2482,6 +2583,12 @@ complete:
 	pclink_ack(devno, cunit, 'C');
 
 exit:
+	/* Drop directory snapshots once anything has been changed */
+	if ((fno == 0x01) || (fno == 0x07) || (fno == 0x08) || \
+		((fno == 0x09) && (device[cunit].parbuf.fmode & 0x08)) || \
+		((fno >= 0x0b) && (fno <= 0x0f)) || (fno == 0x14))
+		dir_snapshot_invalidate();
+
 	old_ccom = ccom;
 
 	return;
@@ -2532,13 +2639,54 @@ pclink_read(uint8_t *buf, int len)
 }
 
 /*
- * PCLink specific version of bus_to_computer(), no C/E is send here
+ * Receive a data frame and throw it away
  */
 static void
-pclink_write(uint8_t *buf, int len)
+pclink_discard(ulong len)
+{
+    uint8_t chunk[64];
+
+    Debug_printf("<-SIO discard (PCLINK) %lu bytes\n", len);
+
+#ifdef ESP_PLATFORM
+    UARTManager *uart = pcLink.sio_get_bus().uart;
+#else
+    if (fnSioCom.get_sio_mode() == SioCom::sio_mode::NETSIO)
+        fnSioCom.netsio_write_size(len); // set hint for NetSIO
+#endif
+
+    // Data plus the checksum byte
+    for (ulong got = 0; got < len + 1; )
+    {
+        ulong n = len + 1 - got;
+        size_t r;
+        if (n > sizeof(chunk))
+            n = sizeof(chunk);
+#ifdef ESP_PLATFORM
+        r = uart->readBytes(chunk, n);
+#else
+        r = fnSioCom.readBytes(chunk, n);
+#endif
+        if (r == 0)
+            break; // timed out
+        got += r;
+    }
+}
+
+/* sio_checksum(), carried on across pieces of one frame */
+static unsigned int
+pclink_checksum(unsigned int chk, const uint8_t *buf, ulong len)
+{
+    for (ulong i = 0; i < len; i++)
+        chk = ((chk + buf[i]) >> 8) + ((chk + buf[i]) & 0xff);
+
+    return chk;
+}
+
+/* Send part of a data frame */
+static void
+pclink_send(uint8_t *buf, int len)
 {
-    // Write data frame to computer
-    Debug_printf("->SIO write (PCLINK) %hu bytes\n", len);
 #ifdef VERBOSE_SIO
     Debug_printf("SEND <%u> BYTES\n\t", len);
     for (int i = 0; i < len; i++)
@@ -2546,23 +2694,133 @@ pclink_write(uint8_t *buf, int len)
     Debug_print("\n");
 #endif
 
-    // Write data frame
 #ifdef ESP_PLATFORM
-    UARTManager *uart = pcLink.sio_get_bus().uart;
-    uart->write(buf, len);
-    // Write checksum
-    uart->write(sio_checksum(buf, len));
-
-    uart->flush();
+    pcLink.sio_get_bus().uart->write(buf, len);
 #else
     fnSioCom.write(buf, len);
-    // Write checksum
-    fnSioCom.write(sio_checksum(buf, len));
+#endif
+}
 
+/* Finish a data frame with its checksum */
+static void
+pclink_send_end(uint8_t ck)
+{
+#ifdef ESP_PLATFORM
+    UARTManager *uart = pcLink.sio_get_bus().uart;
+    uart->write(ck);
+    uart->flush();
+#else
+    fnSioCom.write(ck);
     fnSioCom.flush();
 #endif
 }
 
+/*
+ * PCLink specific version of bus_to_computer(), no C/E is send here
+ */
+static void
+pclink_write(uint8_t *buf, int len)
+{
+    // Write data frame to computer
+    Debug_printf("->SIO write (PCLINK) %hu bytes\n", len);
+
+    pclink_send(buf, len);
+    pclink_send_end(pclink_checksum(0, buf, len));
+}
+
+/*
+ * Send 'len' bytes as one data frame, 'have' of them from buf and the
+ * rest as zeros
+ */
+static void
+pclink_write_padded(uint8_t *buf, ulong have, ulong len)
+{
+    static uint8_t zeros[PCLINK_CHUNK_SIZE];
+    unsigned int chk;
+
+    Debug_printf("->SIO write (PCLINK) %lu bytes\n", len);
+
+    if (have > len)
+        have = len;
+    chk = pclink_checksum(0, buf, have);
+    pclink_send(buf, have);
+
+    for (ulong sent = have; sent < len; )
+    {
+        ulong n = len - sent;
+        if (n > sizeof(zeros))
+            n = sizeof(zeros);
+        chk = pclink_checksum(chk, zeros, n);
+        pclink_send(zeros, n);
+        sent += n;
+    }
+    pclink_send_end(chk);
+}
+
+/*
+ * Send 'len' bytes of an open file as one data frame. It's read a chunk at
+ * a time, so the UART is busy sending one chunk while the next is read.
+ * A short read is padded with zeros; returns how much the file gave.
+ */
+static ulong
+pclink_write_file(FILE *fp, ulong len)
+{
+    static uint8_t chunk[PCLINK_CHUNK_SIZE];
+    unsigned int chk = 0;
+    ulong sent = 0, got = 0;
+    bool more = true;
+
+    Debug_printf("->SIO write (PCLINK) %lu bytes from file\n", len);
+
+    while (sent < len)
+    {
+        ulong n = len - sent, r = 0;
+
+        if (n > sizeof(chunk))
+            n = sizeof(chunk);
+        if (more)
+            r = fread(chunk, sizeof(char), n, fp);
+        if (r < n)
+        {
+            memset(chunk + r, 0, n - r);
+            more = false;
+        }
+        got += r;
+
+        chk = pclink_checksum(chk, chunk, n);
+        pclink_send(chunk, n);
+        sent += n;
+    }
+    pclink_send_end(chk);
+
+    return got;
+}
+
+/*
+ * Shared buffer for received blocks, grown as needed up to the 64K SDX
+ * allows in one go and kept in PSRAM when there is some
+ */
+static uchar *
+xfer_buffer(ulong len)
+{
+    static uchar *buf = NULL;
+    static ulong size = 0;
+
+    if (len <= size)
+        return buf;
+
+    free(buf);
+#ifdef ESP_PLATFORM
+    if (fnSystem.get_psram_size() > 0)
+        buf = (uchar *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    else
+#endif
+        buf = (uchar *)malloc(len);
+    size = buf ? len : 0;
+
+    return buf;
+}
+
 
 static void
 get_device_status(ushort devno, ushort d, uchar *st)
@@ -2661,6 +2919,7 @@ void sioPCLink::unmount(int no)
 
     fps_close(no);
     memset(&device[no].parbuf, 0, sizeof(PARBUF));
+    dir_snapshot_invalidate();
 
     device[no].on = 0;
     device[no].dirname[0]=0;
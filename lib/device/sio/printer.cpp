@@ -9,6 +9,8 @@
 
 #include "fnSystem.h"
 #include "fnConfig.h"
+#include "fnEvents.h"
+#include "httpService.h"
 
 #include "file_printer.h"
 #include "html_printer.h"
@@ -294,6 +296,9 @@ void sioPrinter::sio_process(uint32_t commanddata, uint8_t checksum)
         case SIO_PRINTERCMD_WRITE:
             _lastaux1 = cmdFrame.aux1;
             _lastaux2 = cmdFrame.aux2;
+            // Only the first write after the printer has been idle a while
+            if (fnSystem.millis() - _last_ms >= PRINTER_BUSY_TIME)
+                fnEvents.publish(fn_event_type::PRINTER_OUTPUT);
             _last_ms = fnSystem.millis();
             sio_late_ack();
             sio_write(_lastaux1, _lastaux2);
@@ -48,6 +48,7 @@ void sioCPM::sio_handle_cpm()
     PC = CCPaddr;                           // Sets CP/M application jump point
     Z80run();                               // Starts simulation
 #endif
+    _console_flush();
     if (Status == 1) // This is set by a call to BIOS 0 - ends CP/M
     {
         cpmActive = false;
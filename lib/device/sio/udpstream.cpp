@@ -8,6 +8,10 @@
 #include "fnSystem.h"
 #include "utils.h"
 
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#endif
+
 // TODO: merge/fix this at global level
 #ifdef ESP_PLATFORM
 #include "fnUART.h"
@@ -16,6 +20,49 @@
 #define FN_BUS_LINK fnSioCom
 #endif
 
+static uint64_t udpstream_now()
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    return fnSystem.micros();
+#endif
+}
+
+void udpstream_histogram::add(uint32_t us)
+{
+    int b = 0;
+    while (b < UDPSTREAM_STATS_BUCKETS - 1 && us >= (64U << b))
+        b++;
+    buckets[b]++;
+    count++;
+    sum_us += us;
+    if (us > max_us)
+        max_us = us;
+}
+
+void udpstream_histogram::print(const char *name) const
+{
+    printf("%s: %lu packets, avg %lu us, max %lu us\r\n", name, (unsigned long)count,
+           count ? (unsigned long)(sum_us / count) : 0, (unsigned long)max_us);
+    for (int b = 0; b < UDPSTREAM_STATS_BUCKETS; b++)
+    {
+        if (buckets[b] == 0)
+            continue;
+        if (b < UDPSTREAM_STATS_BUCKETS - 1)
+            printf("  < %6u us: %lu\r\n", 64U << b, (unsigned long)buckets[b]);
+        else
+            printf("  >=%6u us: %lu\r\n", 64U << (b - 1), (unsigned long)buckets[b]);
+    }
+}
+
+void udpstream_stats::print() const
+{
+    bus_to_net.print("Atari to network");
+    net_to_bus.print("Network to Atari");
+    net_gap.print("Network packet gap");
+}
+
 void sioUDPStream::sio_enable_udpstream()
 {
     if (udpstream_port == MIDI_PORT)
@@ -53,6 +100,11 @@ void sioUDPStream::sio_enable_udpstream()
     // Open the UDP connection
     udpStream.begin(udpstream_port);
 
+    stats = udpstream_stats();
+    net_last_us = 0;
+    buf_stream_start = 0;
+    buf_stream_index = 0;
+
     udpstreamActive = true;
     Debug_println("UDPSTREAM mode ENABLED");
     if (udpstreamIsServer)
@@ -66,15 +118,38 @@ void sioUDPStream::sio_enable_udpstream()
         udpStream.endPacket();
         // number the outgoing packet for the server to handle sequencing
         packet_seq = 0;
-        buf_stream_index = 0;
         packet_seq += 1;
         *(uint16_t *)buf_stream = packet_seq;
-        buf_stream_index += 2;
+        buf_stream_start = 2;
+        buf_stream_index = 2;
     }
+
+#ifdef ESP_PLATFORM
+    // Let the UART's receive timeout mark the end of each packet
+    FN_BUS_LINK.set_rx_idle(udpstream_gap_us);
+
+    _task_stop = false;
+    if (xTaskCreatePinnedToCore(udpstream_task, "udpstream", UDPSTREAM_TASK_STACKSIZE, this,
+                                UDPSTREAM_TASK_PRIORITY, &_task, UDPSTREAM_TASK_CPUAFFINITY) != pdPASS)
+    {
+        Debug_println("UDPSTREAM couldn't start its task");
+        _task = nullptr;
+    }
+#endif
 }
 
 void sioUDPStream::sio_disable_udpstream()
 {
+#ifdef ESP_PLATFORM
+    // Wait for the task to finish with the socket and the UART
+    if (_task != nullptr)
+    {
+        _task_stop = true;
+        while (_task != nullptr)
+            vTaskDelay(1);
+    }
+    FN_BUS_LINK.set_rx_idle(0);
+#endif
     udpStream.stop();
     if (udpstream_port == MIDI_PORT)
     {
@@ -91,17 +166,28 @@ void sioUDPStream::sio_disable_udpstream()
     udpstreamActive = false;
     udpstreamIsServer = false;
     Debug_println("UDPSTREAM mode DISABLED");
+#ifdef DEBUG
+    stats.print();
+#endif
 }
 
-void sioUDPStream::sio_handle_udpstream()
+/* Pass a packet from the network, if there is one, on to the Atari
+ */
+void sioUDPStream::sio_receive_net()
 {
     // if there’s data available, read a packet
     int packetSize = udpStream.parsePacket();
     if (packetSize > 0)
     {
+        uint64_t now = udpstream_now();
+        if (net_last_us != 0)
+            stats.net_gap.add(now - net_last_us);
+        net_last_us = now;
+
         udpStream.read(buf_net, UDPSTREAM_BUFFER_SIZE);
         // Send to Atari UART
         FN_BUS_LINK.write(buf_net, packetSize);
+        stats.net_to_bus.add(udpstream_now() - now);
 #ifdef ESP_PLATFORM
         if (udpstreamIsServer)
         {
@@ -114,30 +200,104 @@ void sioUDPStream::sio_handle_udpstream()
         util_dump_bytes(buf_net, packetSize);
 #endif
     }
+}
+
+/* Send what's been collected from the Atari as one packet
+ */
+void sioUDPStream::sio_send_stream()
+{
+    udpStream.beginPacket(udpstream_host_ip, udpstream_port); // remote IP and port
+    udpStream.write(buf_stream, buf_stream_index);
+    udpStream.endPacket();
+    stats.bus_to_net.add(udpstream_now() - packet_first_us);
+
+#ifdef DEBUG_UDPSTREAM
+    Debug_print("UDP-OUT: ");
+    util_dump_bytes(buf_stream, buf_stream_index);
+#endif
+    buf_stream_index = 0;
+    if (udpstreamIsServer)
+    {
+        // number the outgoing packet for the server to handle sequencing
+        packet_seq += 1;
+        *(uint16_t *)buf_stream = packet_seq;
+        buf_stream_index += 2;
+    }
+}
 
 #ifdef ESP_PLATFORM
-/*   // Send a fake keep alive packet if it's taking too long. This isn't working
-    if ((uint32_t)esp_timer_get_time() - start >= UDPSTREAM_KEEPALIVE_TIMEOUT
-        && fnSystem.digital_read(PIN_MTR) == DIGI_HIGH) // only if MTR line is on
+
+void sioUDPStream::udpstream_task(void *param)
+{
+    sioUDPStream *dev = (sioUDPStream *)param;
+
+    while (!dev->_task_stop)
     {
-        fnUartSIO.write(0x00);
-        Debug_println("UDPSTREAM: Fake SIO keep alive packet");
-        start = (uint32_t)esp_timer_get_time();
+        dev->sio_receive_net();
+
+        // COMMAND asserted hands the bus back, fnLoop sees it and stops us
+        if (fnSystem.digital_read(PIN_CMD) == DIGI_LOW)
+        {
+            vTaskDelay(1);
+            continue;
+        }
+        dev->sio_collect_stream();
     }
-*/
-#endif
+
+    dev->_task = nullptr;
+    vTaskDelete(NULL);
+}
+
+/* Collect bytes from the Atari, sending them once the line goes quiet
+ */
+void sioUDPStream::sio_collect_stream()
+{
+    bool idle;
+
+    // Wait for the UART, but no longer than a tick so network packets don't wait
+    FN_BUS_LINK.wait_rx_data(1, idle);
+
+    uint64_t now = esp_timer_get_time();
+    int avail = FN_BUS_LINK.available();
+    if (avail > 0)
+    {
+        if (buf_stream_index == buf_stream_start)
+            packet_first_us = now;
+        stream_last_us = now;
+
+        int room = UDPSTREAM_BUFFER_SIZE - buf_stream_index;
+        buf_stream_index += FN_BUS_LINK.readBytes(buf_stream + buf_stream_index, avail < room ? avail : room);
+        if (buf_stream_index == UDPSTREAM_BUFFER_SIZE)
+        {
+            sio_send_stream();
+            return;
+        }
+    }
+
+    // The hardware flags the gap, the clock catches a burst that ended exactly on a full FIFO
+    if (buf_stream_index > buf_stream_start && (idle || now - stream_last_us >= udpstream_gap_us))
+        sio_send_stream();
+}
+
+void sioUDPStream::sio_handle_udpstream()
+{
+    // udpstream_task does the work on ESP
+}
+
+#else
+
+void sioUDPStream::sio_handle_udpstream()
+{
+    sio_receive_net();
 
     // Read the data until there's a pause in the incoming stream
     if (FN_BUS_LINK.available() > 0)
     {
+        packet_first_us = udpstream_now();
         while (true)
         {
             // Break out of UDPStream mode if COMMAND is asserted
-#ifdef ESP_PLATFORM
-            if (fnSystem.digital_read(PIN_CMD) == DIGI_LOW)
-#else
             if (FN_BUS_LINK.command_asserted())
-#endif
             {
                 Debug_println("CMD Asserted in LOOP, stopping UDPStream");
                 sio_disable_udpstream();
@@ -152,32 +312,18 @@ void sioUDPStream::sio_handle_udpstream()
             }
             else
             {
-                fnSystem.delay_microseconds(UDPSTREAM_PACKET_TIMEOUT);
+                fnSystem.delay_microseconds(udpstream_gap_us);
                 if (FN_BUS_LINK.available() <= 0)
                     break;
             }
         }
 
-        // Send what we've collected
-        udpStream.beginPacket(udpstream_host_ip, udpstream_port); // remote IP and port
-        udpStream.write(buf_stream, buf_stream_index);
-        udpStream.endPacket();
-
-#ifdef DEBUG_UDPSTREAM
-        Debug_print("UDP-OUT: ");
-        util_dump_bytes(buf_stream, buf_stream_index);
-#endif
-        buf_stream_index = 0;
-        if (udpstreamIsServer)
-        {
-            // number the outgoing packet for the server to handle sequencing
-            packet_seq += 1;
-            *(uint16_t *)buf_stream = packet_seq;
-            buf_stream_index += 2;
-        }
+        sio_send_stream();
     }
 }
 
+#endif /* ESP_PLATFORM */
+
 void sioUDPStream::sio_status()
 {
     // Nothing to do here
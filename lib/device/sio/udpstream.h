@@ -21,11 +21,40 @@
 #endif
 
 #define UDPSTREAM_BUFFER_SIZE 8192
-#define UDPSTREAM_PACKET_TIMEOUT 5000
+#define UDPSTREAM_PACKET_TIMEOUT 5000           // Default gap in the bus data that ends a packet, us
 #define UDPSTREAM_KEEPALIVE_TIMEOUT 250000      // MIDI Keep Alive is 300ms
 #define MIDI_PORT 5004
 #define MIDI_BAUDRATE 31250
 
+// The stream gets its own task on ESP, above the main loop so Wi-Fi and
+// web server work in fnLoop doesn't add jitter
+#define UDPSTREAM_TASK_STACKSIZE 4096
+#define UDPSTREAM_TASK_PRIORITY 18
+#define UDPSTREAM_TASK_CPUAFFINITY 1
+
+// Bucket n counts packets under 2^(n+6) us, the last bucket everything slower
+#define UDPSTREAM_STATS_BUCKETS 12
+
+struct udpstream_histogram
+{
+    uint32_t count = 0;
+    uint32_t max_us = 0;
+    uint64_t sum_us = 0;
+    uint32_t buckets[UDPSTREAM_STATS_BUCKETS] = {0};
+
+    void add(uint32_t us);
+    void print(const char *name) const;
+};
+
+struct udpstream_stats
+{
+    udpstream_histogram bus_to_net; // first byte from the Atari to its packet sent
+    udpstream_histogram net_to_bus; // packet received to handed to the UART
+    udpstream_histogram net_gap;    // time between received packets, shows network jitter
+
+    void print() const;
+};
+
 class sioUDPStream : public virtualDevice
 {
 private:
@@ -34,12 +63,23 @@ private:
     uint8_t buf_net[UDPSTREAM_BUFFER_SIZE];
     uint8_t buf_stream[UDPSTREAM_BUFFER_SIZE];
 
-    uint8_t buf_stream_index=0;
+    uint16_t buf_stream_index=0;
+    uint16_t buf_stream_start=0; // where the data starts, after any sequence number
 
     uint16_t packet_seq = 0;
+    uint64_t packet_first_us = 0; // when the first byte of the packet being collected arrived
+    uint64_t net_last_us = 0;
 #ifdef ESP_PLATFORM
     uint32_t start = (uint32_t)esp_timer_get_time(); // Keep alive timer
+    uint64_t stream_last_us = 0;  // when bus data last arrived
+    TaskHandle_t _task = nullptr;
+    volatile bool _task_stop = false;
+
+    static void udpstream_task(void *param);
+    void sio_collect_stream();
 #endif
+    void sio_receive_net();
+    void sio_send_stream();
     void sio_status() override;
     void sio_process(uint32_t commanddata, uint8_t checksum) override;
 
@@ -48,6 +88,9 @@ public:
     bool udpstreamIsServer = false; // If we are connecting to a server
     in_addr_t udpstream_host_ip = IPADDR_NONE;
     int udpstream_port;
+    uint32_t udpstream_gap_us = UDPSTREAM_PACKET_TIMEOUT;
+
+    udpstream_stats stats;
 
     void sio_enable_udpstream();  // setup udpstream
     void sio_disable_udpstream(); // stop udpstream
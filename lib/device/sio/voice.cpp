@@ -114,6 +114,9 @@ void sioVoice::sio_sam_parameters()
         case 0x14: // ^T Throat
             throat = *(++it);
             break;
+        case 0x17: // ^W Warm the cache with this line
+            warm = true;
+            break;
         default:
             if (it != tokens.begin())
                 strcat((char *)samBuffer, " ");
@@ -136,6 +139,7 @@ void sioVoice::sio_sam()
     a[n++] = (char *)("sam");
     a[n++] = (char *)("-debug");
 
+    warm = false;
     sio_sam_parameters();
 
 
@@ -189,7 +193,10 @@ void sioVoice::sio_sam()
     }
 
     a[n++] = (char *)samBuffer;
-    sam(n, a);
+    if (warm)
+        sam_prewarm(n, a);
+    else
+        sam_queue(n, a);
 };
 
 void sioVoice::sio_write()
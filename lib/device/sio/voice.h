@@ -27,6 +27,7 @@ private:
     bool phonetic = false;
     std::string speed;
     std::string throat;
+    bool warm = false; // Render the line into the cache without speaking it
 //    std::string samplerate;
 #ifdef ESP32S3_I2S_OUT
     std::string i2sOut;
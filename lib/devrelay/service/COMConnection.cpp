@@ -24,23 +24,24 @@ void COMConnection::create_read_channel()
 {
 	reading_thread_ = std::thread([self = shared_from_this()]() {
 		std::vector<uint8_t> buffer(1024);
+		std::vector<uint8_t> pending;
 		while (self->is_connected())
 		{
 			int bytes_read = sp_nonblocking_read(self->port_, buffer.data(), buffer.size());
 			if (bytes_read > 0)
 			{
-				std::vector<std::vector<uint8_t>> decoded_packets = SLIP::split_into_packets(buffer.data(), buffer.size());
+				// Frames can straddle reads, so scan what is left over from the last one too
+				pending.insert(pending.end(), buffer.begin(), buffer.begin() + bytes_read);
+				size_t consumed = 0;
+				std::vector<std::vector<uint8_t>> decoded_packets = SLIP::split_into_packets(pending.data(), pending.size(), &consumed);
+				pending.erase(pending.begin(), pending.begin() + consumed);
 				if (!decoded_packets.empty())
 				{
-					for (const auto &packet : decoded_packets)
+					for (auto &packet : decoded_packets)
 					{
 						if (!packet.empty())
 						{
-							{
-								std::lock_guard<std::mutex> lock(self->data_mutex_);
-								self->data_map_[packet[0]] = packet;
-							}
-							self->data_cv_.notify_all();
+							self->add_packet(std::move(packet));
 						}
 					}
 				}
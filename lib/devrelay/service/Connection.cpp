@@ -18,8 +18,9 @@ std::vector<uint8_t> Connection::wait_for_response(uint8_t request_id, std::chro
 	{
 		throw std::runtime_error("Timeout waiting for response");
 	}
-	std::vector<uint8_t> response_data = data_map_[request_id];
-	data_map_.erase(request_id);
+	const auto it = data_map_.find(request_id);
+	std::vector<uint8_t> response_data = std::move(it->second);
+	data_map_.erase(it);
 	return response_data;
 }
 
@@ -27,20 +28,40 @@ std::vector<uint8_t> Connection::wait_for_response(uint8_t request_id, std::chro
 // The codebase is used both sides of the connection.
 std::vector<uint8_t> Connection::wait_for_request()
 {
-	// Use a timeout so we can stop waiting for responses
-	while (is_connected_)
+	// Woken by add_packet() on arrival, or by set_is_connected(false) so we can stop waiting
+	std::unique_lock<std::mutex> lock(data_mutex_);
+	data_cv_.wait(lock, [this]() { return !data_map_.empty() || !is_connected_; });
+	if (data_map_.empty())
 	{
-		std::unique_lock<std::mutex> lock(data_mutex_);
-		if (data_cv_.wait_for(lock, std::chrono::milliseconds(100), [this]() { return !data_map_.empty(); }))
-		{
-			const auto it = data_map_.begin();
-			std::vector<uint8_t> request_data = it->second;
-			data_map_.erase(it);
+		return std::vector<uint8_t>();
+	}
+	const auto it = data_map_.begin();
+	std::vector<uint8_t> request_data = std::move(it->second);
+	data_map_.erase(it);
+	return request_data;
+}
+
+void Connection::add_packet(std::vector<uint8_t> &&packet)
+{
+	{
+		std::lock_guard<std::mutex> lock(data_mutex_);
+		const uint8_t id = packet[0];
+		data_map_[id] = std::move(packet);
+	}
+	data_cv_.notify_all();
+}
 
-			return request_data;
+void Connection::set_is_connected(const bool is_connected)
+{
+	is_connected_ = is_connected;
+	if (!is_connected)
+	{
+		// Taking the lock orders this against a waiter that has just checked is_connected_
+		{
+			std::lock_guard<std::mutex> lock(data_mutex_);
 		}
+		data_cv_.notify_all();
 	}
-	return std::vector<uint8_t>();
 }
 
 void Connection::join()
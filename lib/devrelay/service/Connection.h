@@ -21,7 +21,7 @@ public:
 	virtual void close_connection() = 0;
 
 	bool is_connected() const { return is_connected_; }
-	void set_is_connected(const bool is_connected) { is_connected_ = is_connected; }
+	void set_is_connected(const bool is_connected);
 
 	std::vector<uint8_t> wait_for_response(uint8_t request_id, std::chrono::seconds timeout);
 	std::vector<uint8_t> wait_for_request();
@@ -32,6 +32,9 @@ private:
 	std::atomic<bool> is_connected_{false};
 
 protected:
+	// Called by the reading thread for each decoded packet, keyed on its first byte
+	void add_packet(std::vector<uint8_t> &&packet);
+
 	std::map<uint8_t, std::vector<uint8_t>> data_map_;
 	std::thread reading_thread_;
 
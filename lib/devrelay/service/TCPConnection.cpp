@@ -53,8 +53,37 @@ void TCPConnection::send_data(const std::vector<uint8_t> &data)
 		return;
 	}
 
-	const auto slip_data = SLIP::encode(data);
-	send(socket_, reinterpret_cast<const char *>(slip_data.data()), slip_data.size(), 0);
+	std::unique_lock<std::mutex> lock(send_mutex_);
+	SLIP::encode_into(data.data(), data.size(), send_buffer_);
+	if (sending_)
+	{
+		// The thread that is writing picks this frame up when its write completes
+		return;
+	}
+
+	sending_ = true;
+	std::vector<uint8_t> slip_data;
+	while (!send_buffer_.empty())
+	{
+		slip_data.swap(send_buffer_);
+		lock.unlock();
+
+		size_t sent = 0;
+		while (sent < slip_data.size())
+		{
+			int n = send(socket_, reinterpret_cast<const char *>(slip_data.data() + sent), slip_data.size() - sent, 0);
+			if (n <= 0)
+			{
+				LogFileOutput("TCPConnection: send failed, error code: %d\n", SOCKET_ERROR_CODE);
+				break;
+			}
+			sent += n;
+		}
+		slip_data.clear();
+
+		lock.lock();
+	}
+	sending_ = false;
 }
 
 void TCPConnection::create_read_channel()
@@ -113,24 +142,22 @@ void TCPConnection::create_read_channel()
 
 			if (!complete_data.empty())
 			{
-				std::vector<std::vector<uint8_t>> decoded_packets = SLIP::split_into_packets(complete_data.data(), complete_data.size());
+				size_t consumed = 0;
+				std::vector<std::vector<uint8_t>> decoded_packets = SLIP::split_into_packets(complete_data.data(), complete_data.size(), &consumed);
 				// LogFileOutput("SmartPortOverSlip TCPConnection, packets decoded: %d\n", decoded_packets.size());
 
 				if (!decoded_packets.empty())
 				{
-					for (const auto &packet : decoded_packets)
+					for (auto &packet : decoded_packets)
 					{
 						if (!packet.empty())
 						{
-							{
-								std::lock_guard<std::mutex> lock(self->data_mutex_);
-								self->data_map_[packet[0]] = packet;
-							}
-							self->data_cv_.notify_all();
+							self->add_packet(std::move(packet));
 						}
 					}
 				}
-				complete_data.clear();
+				// Keep a frame that was split across reads for the next pass
+				complete_data.erase(complete_data.begin(), complete_data.begin() + consumed);
 			}
 		}
 		GetCommandListener().connection_closed(self.get());
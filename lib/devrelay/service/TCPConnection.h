@@ -3,7 +3,9 @@
 #if defined(DEV_RELAY_SLIP) && defined(SLIP_PROTOCOL_NET)
 
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "Connection.h"
 
@@ -21,5 +23,10 @@ public:
 
 private:
 	int socket_;
+
+	// Frames queued while another thread is writing go out with its next write
+	std::mutex send_mutex_;
+	std::vector<uint8_t> send_buffer_;
+	bool sending_ = false;
 };
 #endif
@@ -1,5 +1,6 @@
 #ifdef DEV_RELAY_SLIP
 
+#include <cstring>
 #include <iostream>
 
 #include "SLIP.h"
@@ -7,34 +8,71 @@
 std::vector<uint8_t> SLIP::encode(const std::vector<uint8_t> &data)
 {
 	std::vector<uint8_t> encoded_data;
+	encode_into(data.data(), data.size(), encoded_data);
+	return encoded_data;
+}
 
-	// start with SLIP_END
-	encoded_data.push_back(SLIP_END);
+// Returns the first SLIP_END or SLIP_ESC in [p, end), or end. next_end and next_esc
+// cache the last memchr results so each byte is only scanned once per special value.
+static const uint8_t *next_special(const uint8_t *p, const uint8_t *end, const uint8_t *&next_end, const uint8_t *&next_esc)
+{
+	if (next_end < p)
+	{
+		next_end = static_cast<const uint8_t *>(memchr(p, SLIP_END, end - p));
+		if (next_end == nullptr)
+			next_end = end;
+	}
+	if (next_esc < p)
+	{
+		next_esc = static_cast<const uint8_t *>(memchr(p, SLIP_ESC, end - p));
+		if (next_esc == nullptr)
+			next_esc = end;
+	}
+	return next_end < next_esc ? next_end : next_esc;
+}
 
-	// Escape any SLIP special characters in the packet data
-	for (uint8_t byte : data)
+void SLIP::encode_into(const uint8_t *data, size_t len, std::vector<uint8_t> &out)
+{
+	// Worst case every byte is escaped, plus the END bytes either side
+	size_t pos = out.size();
+	out.resize(pos + 2 * len + 2);
+	uint8_t *dst = out.data() + pos;
+
+	// start with SLIP_END
+	*dst++ = SLIP_END;
+
+	// Copy runs of plain bytes and escape any SLIP special characters between them
+	const uint8_t *p = data;
+	const uint8_t *end = data + len;
+	const uint8_t *next_end = nullptr;
+	const uint8_t *next_esc = nullptr;
+	while (p < end)
 	{
-		if (byte == SLIP_END || byte == SLIP_ESC)
-		{
-			encoded_data.push_back(SLIP_ESC);
-			encoded_data.push_back(byte == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC);
-		}
-		else
-		{
-			encoded_data.push_back(byte);
-		}
+		const uint8_t *special = next_special(p, end, next_end, next_esc);
+		memcpy(dst, p, special - p);
+		dst += special - p;
+		if (special == end)
+			break;
+		*dst++ = SLIP_ESC;
+		*dst++ = *special == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+		p = special + 1;
 	}
 
 	// Add the SLIP END byte to the end of the encoded data
-	encoded_data.push_back(SLIP_END);
+	*dst++ = SLIP_END;
 
-	return encoded_data;
+	out.resize(dst - out.data());
 }
 
 std::vector<uint8_t> SLIP::decode(const std::vector<uint8_t> &data)
+{
+	return decode(data.data(), data.size());
+}
+
+std::vector<uint8_t> SLIP::decode(const uint8_t *data, size_t bytes_read)
 {
 	std::vector<uint8_t> decoded_data;
-	auto bytes_read = data.size();
+	decoded_data.reserve(bytes_read);
 
 	size_t i = 0;
 	while (i < bytes_read)
@@ -44,45 +82,44 @@ std::vector<uint8_t> SLIP::decode(const std::vector<uint8_t> &data)
 			// Start of a SLIP packet
 			i++;
 
-			// Decode the SLIP packet data
-			while (i < bytes_read && data[i] != SLIP_END)
+			// Find the end of the packet, then copy the runs between escapes
+			const uint8_t *frame_end = static_cast<const uint8_t *>(memchr(data + i, SLIP_END, bytes_read - i));
+			if (frame_end == nullptr)
+			{
+				// Incomplete SLIP packet
+				return std::vector<uint8_t>();
+			}
+
+			const uint8_t *p = data + i;
+			while (p < frame_end)
 			{
-				if (data[i] == SLIP_ESC)
+				const uint8_t *esc = static_cast<const uint8_t *>(memchr(p, SLIP_ESC, frame_end - p));
+				if (esc == nullptr)
+					esc = frame_end;
+				decoded_data.insert(decoded_data.end(), p, esc);
+				if (esc == frame_end)
+					break;
+
+				// Escaped byte
+				if (esc + 1 < frame_end && esc[1] == SLIP_ESC_END)
 				{
-					// Escaped byte
-					i++;
-
-					if (data[i] == SLIP_ESC_END)
-					{
-						// Escaped END byte
-						decoded_data.push_back(SLIP_END);
-					}
-					else if (data[i] == SLIP_ESC_ESC)
-					{
-						// Escaped ESC byte
-						decoded_data.push_back(SLIP_ESC);
-					}
-					else
-					{
-						// Invalid escape sequence
-						return std::vector<uint8_t>();
-					}
+					// Escaped END byte
+					decoded_data.push_back(SLIP_END);
+				}
+				else if (esc + 1 < frame_end && esc[1] == SLIP_ESC_ESC)
+				{
+					// Escaped ESC byte
+					decoded_data.push_back(SLIP_ESC);
 				}
 				else
 				{
-					// Non-escaped byte
-					decoded_data.push_back(data[i]);
+					// Invalid escape sequence
+					return std::vector<uint8_t>();
 				}
-
-				i++;
+				p = esc + 2;
 			}
 
-			// Check for end of packet
-			if (i == bytes_read || data[i] != SLIP_END)
-			{
-				// Incomplete SLIP packet
-				return std::vector<uint8_t>();
-			}
+			i = frame_end - data;
 		}
 		else
 		{
@@ -98,50 +135,39 @@ std::vector<uint8_t> SLIP::decode(const std::vector<uint8_t> &data)
 
 // This breaks up a vector of data into a list of decoded vectors of serialized objects.
 // The returned data is already "SLIP::decode"d
-std::vector<std::vector<uint8_t>> SLIP::split_into_packets(const uint8_t *data, size_t bytes_read)
+std::vector<std::vector<uint8_t>> SLIP::split_into_packets(const uint8_t *data, size_t bytes_read, size_t *consumed)
 {
 	// The list of decoded SLIP packets
 	std::vector<std::vector<uint8_t>> decoded_packets;
 
-	enum class State
-	{
-		NotParsing,
-		Parsing
-	} state = State::NotParsing;
-
-	// Iterate over the data and find the SLIP packet boundaries
-	size_t i = 0;
-	const uint8_t *packet_start = nullptr; // Keep track of where the packet starts
-	while (i < bytes_read)
+	// Each packet runs from a SLIP_END (which also marks start) to the next one
+	const uint8_t *p = data;
+	const uint8_t *end = data + bytes_read;
+	const uint8_t *done = data;
+	while (p < end)
 	{
-		switch (state)
+		const uint8_t *packet_start = static_cast<const uint8_t *>(memchr(p, SLIP_END, end - p));
+		if (packet_start == nullptr)
 		{
-		case State::NotParsing:
-			// If we are not yet parsing and see a SLIP_END byte (which also marks start), start parsing a new SLIP packet
-			if (data[i] == SLIP_END)
-			{
-				state = State::Parsing;
-				packet_start = data + i; // Mark the start of the packet
-			}
+			// Nothing but noise left
+			done = end;
 			break;
-		case State::Parsing:
-			// If we see another SLIP_END byte, we have reached the end of the SLIP packet
-			if (data[i] == SLIP_END)
-			{
-				// Extract the SLIP packet data
-				std::vector<uint8_t> slip_packet_data(packet_start, data + i + 1); // Include all bytes in the packet
-
-				// Add the data to the list of SLIP decoded packets
-				decoded_packets.push_back(SLIP::decode(slip_packet_data));
-
-				// Transition back to the NotParsing state
-				state = State::NotParsing;
-			}
+		}
+		const uint8_t *packet_end = static_cast<const uint8_t *>(memchr(packet_start + 1, SLIP_END, end - packet_start - 1));
+		if (packet_end == nullptr)
+		{
+			// Keep the partial packet for the caller
+			done = packet_start;
 			break;
 		}
-		i++;
+
+		// Add the data to the list of SLIP decoded packets, including both END bytes
+		decoded_packets.push_back(SLIP::decode(packet_start, packet_end - packet_start + 1));
+		p = done = packet_end + 1;
 	}
 
+	if (consumed)
+		*consumed = done - data;
 	return decoded_packets;
 }
 
@@ -15,5 +15,12 @@ public:
 	// these encode and decode exactly one SLIP frame, and expect it to be sane.
 	static std::vector<uint8_t> encode(const std::vector<uint8_t> &data);
 	static std::vector<uint8_t> decode(const std::vector<uint8_t> &data);
-	static std::vector<std::vector<uint8_t>> split_into_packets(const uint8_t *data, size_t bytes_read);
+	static std::vector<uint8_t> decode(const uint8_t *data, size_t len);
+
+	// Appends one frame to out, so several frames can go out in a single write
+	static void encode_into(const uint8_t *data, size_t len, std::vector<uint8_t> &out);
+
+	// consumed, if given, is set to the length of the complete frames found, so a trailing
+	// partial frame can be kept until the rest of it arrives
+	static std::vector<std::vector<uint8_t>> split_into_packets(const uint8_t *data, size_t bytes_read, size_t *consumed = nullptr);
 };
@@ -148,3 +148,184 @@ std::unique_ptr<unsigned char[]> Base64::decode(const char* src, size_t len, siz
 std::unique_ptr<unsigned char[]> Base64::url_decode(const char* src, size_t len, size_t* out_len) {
     return base64_gen_decode(src, len, out_len, base64_url_table);
 }
+
+// Decode tables for the streaming decoder: 0-63 sextet value, 0x40 for '=',
+// 0x80 for characters that are skipped
+struct Base64DecodeTable {
+    unsigned char t[256];
+    explicit Base64DecodeTable(const char* table) {
+        std::memset(t, 0x80, sizeof(t));
+        for (int i = 0; i < 64; i++)
+            t[(unsigned char) table[i]] = (unsigned char) i;
+        t['='] = 0x40;
+    }
+};
+
+static const Base64DecodeTable base64_dtable("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+static const Base64DecodeTable base64_url_dtable("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_");
+
+void Base64::encode_begin(bool url) {
+    clear_buffer();
+    stream_mode = STREAM_ENCODE;
+    stream_table = url ? base64_url_table : base64_table;
+    stream_pad = !url;
+    stream_len = 0;
+    stream_line_len = 0;
+}
+
+void Base64::encode_block(const unsigned char* in) {
+    uint32_t v = (in[0] << 16) | (in[1] << 8) | in[2];
+    char out[5] = {
+        stream_table[(v >> 18) & 0x3f],
+        stream_table[(v >> 12) & 0x3f],
+        stream_table[(v >> 6) & 0x3f],
+        stream_table[v & 0x3f],
+        '\n'
+    };
+    stream_line_len += 4;
+    if (stream_pad && stream_line_len >= 72) {
+        base64_buffer.append(out, 5);
+        stream_line_len = 0;
+    } else
+        base64_buffer.append(out, 4);
+}
+
+void Base64::encode_update(const void* src, size_t len) {
+    const unsigned char* in = static_cast<const unsigned char*>(src);
+
+    // Complete a block left over from the previous chunk
+    while (stream_len > 0 && stream_len < 3 && len > 0) {
+        stream_block[stream_len++] = *in++;
+        len--;
+    }
+    if (stream_len == 3) {
+        encode_block(stream_block);
+        stream_len = 0;
+    }
+
+    size_t blocks = len / 3;
+    base64_buffer.reserve(base64_buffer.length() + blocks * 4 + blocks * 4 / 72 + 1);
+    for (; blocks > 0; blocks--, in += 3, len -= 3)
+        encode_block(in);
+
+    while (len--)
+        stream_block[stream_len++] = *in++;
+}
+
+void Base64::encode_finish() {
+    if (stream_len) {
+        base64_buffer += stream_table[(stream_block[0] >> 2) & 0x3f];
+        if (stream_len == 1) {
+            base64_buffer += stream_table[((stream_block[0] & 0x03) << 4) & 0x3f];
+            if (stream_pad)
+                base64_buffer += '=';
+        } else {
+            base64_buffer += stream_table[(((stream_block[0] & 0x03) << 4) |
+                    (stream_block[1] >> 4)) & 0x3f];
+            base64_buffer += stream_table[((stream_block[1] & 0x0f) << 2) & 0x3f];
+        }
+        if (stream_pad)
+            base64_buffer += '=';
+        stream_line_len += 4;
+    }
+
+    if (stream_pad && stream_line_len)
+        base64_buffer += '\n';
+
+    stream_len = 0;
+    stream_mode = STREAM_IDLE;
+}
+
+void Base64::decode_begin(bool url) {
+    clear_buffer();
+    stream_mode = STREAM_DECODE;
+    stream_dtable = url ? base64_url_dtable.t : base64_dtable.t;
+    stream_len = 0;
+    stream_pad_count = 0;
+    stream_valid = 0;
+    stream_done = false;
+    stream_error = false;
+}
+
+void Base64::decode_block() {
+    char out[3] = {
+        (char) ((stream_block[0] << 2) | (stream_block[1] >> 4)),
+        (char) ((stream_block[1] << 4) | (stream_block[2] >> 2)),
+        (char) ((stream_block[2] << 6) | stream_block[3])
+    };
+    stream_len = 0;
+    if (stream_pad_count == 0) {
+        base64_buffer.append(out, 3);
+        return;
+    }
+    // Padding ends the data, as in base64_gen_decode()
+    if (stream_pad_count <= 2)
+        base64_buffer.append(out, 3 - stream_pad_count);
+    else
+        stream_error = true; // Invalid padding
+    stream_done = true;
+}
+
+void Base64::decode_update(const char* src, size_t len) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* end = in + len;
+
+    base64_buffer.reserve(base64_buffer.length() + len / 4 * 3);
+    while (in < end && !stream_done) {
+        // Fast path: a whole block of plain sextets on a block boundary
+        if (stream_len == 0 && end - in >= 4) {
+            unsigned char a = stream_dtable[in[0]], b = stream_dtable[in[1]],
+                          c = stream_dtable[in[2]], d = stream_dtable[in[3]];
+            if ((a | b | c | d) < 0x40) {
+                char out[3] = {
+                    (char) ((a << 2) | (b >> 4)),
+                    (char) ((b << 4) | (c >> 2)),
+                    (char) ((c << 6) | d)
+                };
+                base64_buffer.append(out, 3);
+                stream_valid += 4;
+                in += 4;
+                continue;
+            }
+        }
+
+        unsigned char tmp = stream_dtable[*in++];
+        if (tmp == 0x80)
+            continue;
+        stream_valid++;
+        if (tmp == 0x40) {
+            stream_pad_count++;
+            tmp = 0;
+        }
+        stream_block[stream_len++] = tmp;
+        if (stream_len == 4)
+            decode_block();
+    }
+}
+
+bool Base64::decode_finish() {
+    // Pad out a trailing partial block the way base64_gen_decode() does
+    if (!stream_done && stream_len) {
+        static const char pad[3] = {'=', '=', '='};
+        decode_update(pad, 4 - stream_len);
+    }
+    stream_mode = STREAM_IDLE;
+    return stream_valid > 0 && !stream_error;
+}
+
+size_t Base64::output(void* dst, size_t len) {
+    size_t n = output_length();
+    if (len > n)
+        len = n;
+    std::memcpy(dst, base64_buffer.data() + output_pos, len);
+    output_pos += len;
+
+    // Drop what has been handed out once it is worth the move
+    if (output_pos == base64_buffer.length())
+        clear_buffer();
+    else if (output_pos >= 4096 && output_pos * 2 >= base64_buffer.length()) {
+        base64_buffer.erase(0, output_pos);
+        output_pos = 0;
+    }
+    return len;
+}
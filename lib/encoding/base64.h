@@ -50,13 +50,51 @@ public:
     static std::unique_ptr<unsigned char[]> decode(const char* src, size_t len, size_t* out_len);
     static std::unique_ptr<unsigned char[]> url_decode(const char* src, size_t len, size_t* out_len);
 
-    std::string get_buffer() const { return base64_buffer; }
-    void set_buffer(const std::string& buffer) { base64_buffer = buffer; }
-    void clear_buffer() { base64_buffer.clear(); }
+    /**
+     * Streaming encode/decode into base64_buffer. Input may arrive in chunks
+     * of any size; each chunk is converted as it comes in and only a partial
+     * block is carried over to the next call. *_begin() discards anything
+     * left in the buffer, *_finish() flushes the last block and padding.
+     * The encoder produces the same output as encode()/url_encode(), the
+     * decoder the same as decode()/url_decode().
+     */
+    void encode_begin(bool url = false);
+    void encode_update(const void* src, size_t len);
+    void encode_finish();
+    void decode_begin(bool url = false);
+    void decode_update(const char* src, size_t len);
+    bool decode_finish(); // false on invalid padding or no base64 input at all
+    bool encoding() const { return stream_mode == STREAM_ENCODE; }
+    bool decoding() const { return stream_mode == STREAM_DECODE; }
+
+    // Hand out converted data from the front of the buffer
+    size_t output_length() const { return base64_buffer.length() - output_pos; }
+    size_t output(void* dst, size_t len);
+
+    std::string get_buffer() const { return base64_buffer.substr(output_pos); }
+    void set_buffer(const std::string& buffer) { base64_buffer = buffer; output_pos = 0; }
+    void clear_buffer() { base64_buffer.clear(); output_pos = 0; }
     void add_buffer(const std::string& extra) { base64_buffer += extra; }
 
     std::string base64_buffer;
 
+private:
+    enum { STREAM_IDLE, STREAM_ENCODE, STREAM_DECODE } stream_mode = STREAM_IDLE;
+    const char* stream_table = base64_table;
+    const unsigned char* stream_dtable = nullptr;
+    bool stream_pad = true;
+    unsigned char stream_block[4];
+    size_t stream_len = 0;      // bytes (encode) or sextets (decode) held in stream_block
+    int stream_line_len = 0;
+    int stream_pad_count = 0;
+    size_t stream_valid = 0;
+    bool stream_done = false;
+    bool stream_error = false;
+    size_t output_pos = 0;
+
+    void encode_block(const unsigned char* in);
+    void decode_block();
+
 };
 
 extern Base64 base64;
@@ -3,6 +3,35 @@
 
 #include "hash.h"
 
+// Use the newer API that returns a status code where it is available
+#if defined(mbedtls_sha1_starts_ret) && defined(mbedtls_sha1_update_ret) && defined(mbedtls_sha1_finish_ret)
+#define HASH_MD5_STARTS(c)          mbedtls_md5_starts_ret(c)
+#define HASH_MD5_UPDATE(c, d, l)    mbedtls_md5_update_ret(c, d, l)
+#define HASH_MD5_FINISH(c, o)       mbedtls_md5_finish_ret(c, o)
+#define HASH_SHA1_STARTS(c)         mbedtls_sha1_starts_ret(c)
+#define HASH_SHA1_UPDATE(c, d, l)   mbedtls_sha1_update_ret(c, d, l)
+#define HASH_SHA1_FINISH(c, o)      mbedtls_sha1_finish_ret(c, o)
+#define HASH_SHA256_STARTS(c, i)    mbedtls_sha256_starts_ret(c, i)
+#define HASH_SHA256_UPDATE(c, d, l) mbedtls_sha256_update_ret(c, d, l)
+#define HASH_SHA256_FINISH(c, o)    mbedtls_sha256_finish_ret(c, o)
+#define HASH_SHA512_STARTS(c, i)    mbedtls_sha512_starts_ret(c, i)
+#define HASH_SHA512_UPDATE(c, d, l) mbedtls_sha512_update_ret(c, d, l)
+#define HASH_SHA512_FINISH(c, o)    mbedtls_sha512_finish_ret(c, o)
+#else
+#define HASH_MD5_STARTS(c)          mbedtls_md5_starts(c)
+#define HASH_MD5_UPDATE(c, d, l)    mbedtls_md5_update(c, d, l)
+#define HASH_MD5_FINISH(c, o)       mbedtls_md5_finish(c, o)
+#define HASH_SHA1_STARTS(c)         mbedtls_sha1_starts(c)
+#define HASH_SHA1_UPDATE(c, d, l)   mbedtls_sha1_update(c, d, l)
+#define HASH_SHA1_FINISH(c, o)      mbedtls_sha1_finish(c, o)
+#define HASH_SHA256_STARTS(c, i)    mbedtls_sha256_starts(c, i)
+#define HASH_SHA256_UPDATE(c, d, l) mbedtls_sha256_update(c, d, l)
+#define HASH_SHA256_FINISH(c, o)    mbedtls_sha256_finish(c, o)
+#define HASH_SHA512_STARTS(c, i)    mbedtls_sha512_starts(c, i)
+#define HASH_SHA512_UPDATE(c, d, l) mbedtls_sha512_update(c, d, l)
+#define HASH_SHA512_FINISH(c, o)    mbedtls_sha512_finish(c, o)
+#endif
+
 Hash hasher;
 
 Hash::Hash() {}
@@ -41,16 +70,54 @@ Hash::Algorithm Hash::from_string(std::string hash_name)
     }
 }
 
+void Hash::select(Algorithm algorithm) {
+    clear();
+    selected = algorithm_bit(algorithm);
+}
+
+void Hash::add_data(const uint8_t *data, size_t len) {
+    if (active == 0)
+        start();
+    if (active & algorithm_bit(Algorithm::MD5))
+        HASH_MD5_UPDATE(&md5_ctx, data, len);
+    if (active & algorithm_bit(Algorithm::SHA1))
+        HASH_SHA1_UPDATE(&sha1_ctx, data, len);
+    if (active & algorithm_bit(Algorithm::SHA256))
+        HASH_SHA256_UPDATE(&sha256_ctx, data, len);
+    if (active & algorithm_bit(Algorithm::SHA512))
+        HASH_SHA512_UPDATE(&sha512_ctx, data, len);
+}
+
 void Hash::add_data(const std::vector<uint8_t>& data) {
-    accumulated_data.insert(accumulated_data.end(), data.begin(), data.end());
+    add_data(data.data(), data.size());
 }
 
 void Hash::add_data(const std::string& data) {
-    accumulated_data.insert(accumulated_data.end(), data.begin(), data.end());
+    add_data((const uint8_t *)data.data(), data.size());
+}
+
+long Hash::add_stream(const stream_reader &read) {
+    std::vector<uint8_t> buf(HASH_STREAM_BUFFER_SIZE);
+    long total = 0;
+    int n;
+    while ((n = read(buf.data(), buf.size())) > 0) {
+        add_data(buf.data(), n);
+        total += n;
+    }
+    return n < 0 ? -1 : total;
 }
 
 void Hash::clear() {
-    accumulated_data.clear();
+    if (active & algorithm_bit(Algorithm::MD5))
+        mbedtls_md5_free(&md5_ctx);
+    if (active & algorithm_bit(Algorithm::SHA1))
+        mbedtls_sha1_free(&sha1_ctx);
+    if (active & algorithm_bit(Algorithm::SHA256))
+        mbedtls_sha256_free(&sha256_ctx);
+    if (active & algorithm_bit(Algorithm::SHA512))
+        mbedtls_sha512_free(&sha512_ctx);
+    active = 0;
+    selected = 0;
 }
 
 size_t Hash::hash_length(Algorithm algorithm, bool is_hex) const {
@@ -76,18 +143,27 @@ size_t Hash::hash_length(Algorithm algorithm, bool is_hex) const {
 
 void Hash::compute(Algorithm algorithm, bool clear_data) {
     hash_output.clear();
-    switch (algorithm) {
-        case Algorithm::SHA1:
-            compute_sha1();
-            break;
-        case Algorithm::SHA256:
-            compute_sha256();
-            break;
-        case Algorithm::SHA512:
-            compute_sha512();
-            break;
-        default:
-            break;
+    if (active == 0)
+        start();
+    // The running contexts are finished through copies so more data can
+    // still be added when clear_data is false.
+    if (active & algorithm_bit(algorithm)) {
+        switch (algorithm) {
+            case Algorithm::MD5:
+                finish_md5();
+                break;
+            case Algorithm::SHA1:
+                finish_sha1();
+                break;
+            case Algorithm::SHA256:
+                finish_sha256();
+                break;
+            case Algorithm::SHA512:
+                finish_sha512();
+                break;
+            default:
+                break;
+        }
     }
     if (clear_data) {
         clear();
@@ -102,105 +178,74 @@ std::string Hash::output_hex() const {
     return bytes_to_hex(hash_output);
 }
 
-void Hash::compute_sha1() {
-    mbedtls_sha1_context ctx;
-    mbedtls_sha1_init(&ctx);
-    
-    int ret = 0;
-    
-    hash_output.resize(20);
-    
-#if defined(mbedtls_sha1_starts_ret) && defined(mbedtls_sha1_update_ret) && defined(mbedtls_sha1_finish_ret)
-    // Use newer API that returns status code
-    if ((ret = mbedtls_sha1_starts_ret(&ctx)) != 0) {
-        mbedtls_sha1_free(&ctx);
-        return; // Handle error appropriately
+uint8_t Hash::algorithm_bit(Algorithm algorithm) {
+    switch (algorithm) {
+        case Algorithm::MD5:
+            return 0x01;
+        case Algorithm::SHA1:
+            return 0x02;
+        case Algorithm::SHA256:
+            return 0x04;
+        case Algorithm::SHA512:
+            return 0x08;
+        default:
+            return 0;
     }
-    
-    if ((ret = mbedtls_sha1_update_ret(&ctx, accumulated_data.data(), accumulated_data.size())) != 0) {
-        mbedtls_sha1_free(&ctx);
-        return; // Handle error appropriately
+}
+
+void Hash::start() {
+    active = selected ? selected : 0x0F;
+    if (active & algorithm_bit(Algorithm::MD5)) {
+        mbedtls_md5_init(&md5_ctx);
+        HASH_MD5_STARTS(&md5_ctx);
     }
-    
-    if ((ret = mbedtls_sha1_finish_ret(&ctx, hash_output.data())) != 0) {
-        mbedtls_sha1_free(&ctx);
-        return; // Handle error appropriately
+    if (active & algorithm_bit(Algorithm::SHA1)) {
+        mbedtls_sha1_init(&sha1_ctx);
+        HASH_SHA1_STARTS(&sha1_ctx);
     }
-#else
-    // Use legacy API
-    mbedtls_sha1_starts(&ctx);
-    mbedtls_sha1_update(&ctx, accumulated_data.data(), accumulated_data.size());
-    mbedtls_sha1_finish(&ctx, hash_output.data());
-#endif
-    
+    if (active & algorithm_bit(Algorithm::SHA256)) {
+        mbedtls_sha256_init(&sha256_ctx);
+        HASH_SHA256_STARTS(&sha256_ctx, 0);
+    }
+    if (active & algorithm_bit(Algorithm::SHA512)) {
+        mbedtls_sha512_init(&sha512_ctx);
+        HASH_SHA512_STARTS(&sha512_ctx, 0);
+    }
+}
+
+void Hash::finish_md5() {
+    mbedtls_md5_context ctx;
+    mbedtls_md5_init(&ctx);
+    mbedtls_md5_clone(&ctx, &md5_ctx);
+    hash_output.resize(16);
+    HASH_MD5_FINISH(&ctx, hash_output.data());
+    mbedtls_md5_free(&ctx);
+}
+
+void Hash::finish_sha1() {
+    mbedtls_sha1_context ctx;
+    mbedtls_sha1_init(&ctx);
+    mbedtls_sha1_clone(&ctx, &sha1_ctx);
+    hash_output.resize(20);
+    HASH_SHA1_FINISH(&ctx, hash_output.data());
     mbedtls_sha1_free(&ctx);
 }
 
-void Hash::compute_sha256() {
+void Hash::finish_sha256() {
     mbedtls_sha256_context ctx;
     mbedtls_sha256_init(&ctx);
-    
-    int ret = 0;
-    
+    mbedtls_sha256_clone(&ctx, &sha256_ctx);
     hash_output.resize(32);
-    
-#if defined(mbedtls_sha256_starts_ret) && defined(mbedtls_sha256_update_ret) && defined(mbedtls_sha256_finish_ret)
-    // Use newer API that returns status code
-    if ((ret = mbedtls_sha256_starts_ret(&ctx, 0)) != 0) {
-        mbedtls_sha256_free(&ctx);
-        return; // Handle error appropriately
-    }
-    
-    if ((ret = mbedtls_sha256_update_ret(&ctx, accumulated_data.data(), accumulated_data.size())) != 0) {
-        mbedtls_sha256_free(&ctx);
-        return; // Handle error appropriately
-    }
-    
-    if ((ret = mbedtls_sha256_finish_ret(&ctx, hash_output.data())) != 0) {
-        mbedtls_sha256_free(&ctx);
-        return; // Handle error appropriately
-    }
-#else
-    // Use legacy API
-    mbedtls_sha256_starts(&ctx, 0);
-    mbedtls_sha256_update(&ctx, accumulated_data.data(), accumulated_data.size());
-    mbedtls_sha256_finish(&ctx, hash_output.data());
-#endif
-    
+    HASH_SHA256_FINISH(&ctx, hash_output.data());
     mbedtls_sha256_free(&ctx);
 }
 
-void Hash::compute_sha512() {
+void Hash::finish_sha512() {
     mbedtls_sha512_context ctx;
     mbedtls_sha512_init(&ctx);
-    
-    int ret = 0;
-    
+    mbedtls_sha512_clone(&ctx, &sha512_ctx);
     hash_output.resize(64);
-    
-#if defined(mbedtls_sha512_starts_ret) && defined(mbedtls_sha512_update_ret) && defined(mbedtls_sha512_finish_ret)
-    // Use newer API that returns status code
-    if ((ret = mbedtls_sha512_starts_ret(&ctx, 0)) != 0) {
-        mbedtls_sha512_free(&ctx);
-        return; // Handle error appropriately
-    }
-    
-    if ((ret = mbedtls_sha512_update_ret(&ctx, accumulated_data.data(), accumulated_data.size())) != 0) {
-        mbedtls_sha512_free(&ctx);
-        return; // Handle error appropriately
-    }
-    
-    if ((ret = mbedtls_sha512_finish_ret(&ctx, hash_output.data())) != 0) {
-        mbedtls_sha512_free(&ctx);
-        return; // Handle error appropriately
-    }
-#else
-    // Use legacy API
-    mbedtls_sha512_starts(&ctx, 0);
-    mbedtls_sha512_update(&ctx, accumulated_data.data(), accumulated_data.size());
-    mbedtls_sha512_finish(&ctx, hash_output.data());
-#endif
-    
+    HASH_SHA512_FINISH(&ctx, hash_output.data());
     mbedtls_sha512_free(&ctx);
 }
 
@@ -3,22 +3,35 @@
 
 #include <vector>
 #include <string>
+#include <functional>
 #include <mbedtls/md5.h>
 #include <mbedtls/sha1.h>
 #include <mbedtls/sha256.h>
 #include <mbedtls/sha512.h>
 
+#define HASH_STREAM_BUFFER_SIZE 1024
+
 class Hash {
 public:
     enum class Algorithm {
         UNKNOWN = -1, MD5, SHA1, SHA256, SHA512
     };
 
+    // Reads up to len bytes into buf; returns the count, 0 at end of data or < 0 on error
+    typedef std::function<int(uint8_t *buf, size_t len)> stream_reader;
+
     Hash();
     ~Hash();
 
+    // Start over, running only the given algorithm's digest (UNKNOWN runs all
+    // of them). clear() goes back to running all of them.
+    void select(Algorithm algorithm);
+
+    void add_data(const uint8_t *data, size_t len);
     void add_data(const std::vector<uint8_t>& data);
     void add_data(const std::string& data);
+    // Feed everything a reader produces without buffering it; returns the byte count or -1
+    long add_stream(const stream_reader &read);
     void clear();
     size_t hash_length(Algorithm algorithm, bool is_hex) const;
     void compute(Algorithm algorithm, bool clear_data);
@@ -29,15 +42,25 @@ public:
     static Hash::Algorithm from_string(std::string hash_name);
 
 private:
-    std::vector<uint8_t> accumulated_data;
+    // Digests are updated as data arrives so nothing is buffered between
+    // add_data() and compute(). Contexts are started lazily on first use.
+    mbedtls_md5_context md5_ctx;
+    mbedtls_sha1_context sha1_ctx;
+    mbedtls_sha256_context sha256_ctx;
+    mbedtls_sha512_context sha512_ctx;
+    uint8_t selected = 0;
+    uint8_t active = 0;
     std::vector<uint8_t> hash_output;
 
-    void compute_sha1();
-    void compute_sha256();
-    void compute_sha512();
+    static uint8_t algorithm_bit(Algorithm algorithm);
+    void start();
+    void finish_md5();
+    void finish_sha1();
+    void finish_sha256();
+    void finish_sha512();
     std::string bytes_to_hex(const std::vector<uint8_t>& bytes) const;
 };
 
 extern Hash hasher;
 
-#endif // HASH_H
\ No newline at end of file
+#endif // HASH_H
@@ -51,6 +51,7 @@ their original behavior.
 
 #ifdef CONFIG_ESP_HTTP_CLIENT_ENABLE_HTTPS
 #include "esp_transport_ssl.h"
+#include "fn_transport_ssl.h"
 #endif
 
 namespace fujinet
@@ -475,6 +476,21 @@ esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *co
     }
 #ifdef CONFIG_ESP_HTTP_CLIENT_ENABLE_HTTPS
     esp_transport_handle_t ssl;
+#ifdef FN_TRANSPORT_SSL_SESSION_CACHE
+    // Our own transport resumes TLS sessions, but only knows the no-certificates setup FujiNet uses
+    if (!config->use_global_ca_store && !config->cert_pem && !config->client_cert_pem && !config->client_key_pem) {
+        _success = (
+                       (ssl = fn_transport_ssl_init()) &&
+                       (esp_transport_set_default_port(ssl, DEFAULT_HTTPS_PORT) == ESP_OK) &&
+                       (esp_transport_list_add(client->transport_list, ssl, "https") == ESP_OK)
+                   );
+        if (!_success) {
+            ESP_LOGE(TAG, "Error initialize SSL Transport");
+            goto error;
+        }
+        goto ssl_done;
+    }
+#endif
     _success = (
                    (ssl = esp_transport_ssl_init()) &&
                    (esp_transport_set_default_port(ssl, DEFAULT_HTTPS_PORT) == ESP_OK) &&
@@ -504,7 +520,9 @@ esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *co
         esp_transport_ssl_skip_common_name_check(ssl);
         ESP_LOGD(TAG, "esp_transport_ssl_skip_common_name_check() skipped");
     }
-    
+#ifdef FN_TRANSPORT_SSL_SESSION_CACHE
+ssl_done:
+#endif
 #endif
 
     if (_set_config(client, config) != ESP_OK) {
@@ -567,6 +585,47 @@ error:
     return NULL;
 }
 
+esp_err_t esp_http_client_reuse(esp_http_client_handle_t client, const esp_http_client_config_t *config)
+{
+    if (client == NULL || config == NULL || config->url == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Drop everything left over from the previous request, but keep host/scheme/port
+    // so esp_http_client_set_url() below doesn't close the connection
+    http_header_clean(client->request->headers);
+    esp_http_client_set_username(client, NULL);
+    esp_http_client_set_password(client, NULL);
+    free(client->connection_info.path);
+    client->connection_info.path = NULL;
+    free(client->connection_info.query);
+    client->connection_info.query = NULL;
+    _clear_auth_data(client);
+    free(client->location);
+    client->location = NULL;
+    free(client->auth_header);
+    client->auth_header = NULL;
+    client->post_data = NULL;
+    client->post_len = 0;
+    client->redirect_counter = 0;
+    client->process_again = 0;
+
+    client->connection_info.method = config->method;
+    client->connection_info.auth_type = config->auth_type;
+    client->event_handler = config->event_handler;
+    client->user_data = config->user_data;
+    client->timeout_ms = config->timeout_ms ? config->timeout_ms : DEFAULT_TIMEOUT_MS;
+    client->max_redirection_count = config->max_redirection_count ? config->max_redirection_count : DEFAULT_MAX_REDIRECT;
+    client->disable_auto_redirect = config->disable_auto_redirect;
+
+    if (esp_http_client_set_url(client, config->url) != ESP_OK ||
+        esp_http_client_set_header(client, "User-Agent", DEFAULT_HTTP_USER_AGENT) != ESP_OK ||
+        esp_http_client_set_header(client, "Host", client->connection_info.host) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
 {
     if (client == NULL) {
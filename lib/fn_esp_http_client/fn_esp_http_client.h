@@ -261,6 +261,22 @@ typedef struct esp_http_client esp_http_client_t;
  */
 esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config);
 
+/**
+ * @brief      Prepare a client left connected by an earlier request for a new request.
+ *             Request headers, credentials and post data are reset, the callbacks and
+ *             timeouts are taken from config, and the URL is set. When config->url is on
+ *             the same host and port the open connection is kept for keep-alive reuse.
+ *
+ * @param[in]  client   The esp_http_client handle
+ * @param[in]  config   The configurations, url must be set
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_FAIL
+ *     - ESP_ERR_INVALID_ARG
+ */
+esp_err_t esp_http_client_reuse(esp_http_client_handle_t client, const esp_http_client_config_t *config);
+
 /**
  * @brief      Invoke this function after `esp_http_client_init` and all the options calls are made, and will perform the
  *             transfer as described in the options. It must be called with the same esp_http_client_handle_t as input as the esp_http_client_init call returned.
@@ -0,0 +1,240 @@
+#include "fn_transport_ssl.h"
+
+#ifdef FN_TRANSPORT_SSL_SESSION_CACHE
+
+#include <string.h>
+#include <sys/select.h>
+
+#include <mutex>
+#include <string>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+
+#include "httpTlsStats.h"
+
+namespace fujinet
+{
+
+static const char *TAG = "FN_TRANSPORT_SSL";
+
+struct fn_tls_session
+{
+    std::string key; // host:port
+    esp_tls_client_session_t *session = nullptr;
+    int64_t stored_us = 0;
+    int64_t used_us = 0;
+};
+
+static fn_tls_session _sessions[FN_TLS_SESSION_CACHE_SIZE];
+static std::mutex _sessions_mutex;
+
+struct fn_ssl_context
+{
+    esp_tls_t *tls = nullptr;
+    std::string key;
+};
+
+// Caller holds _sessions_mutex
+static void _session_drop(fn_tls_session &s)
+{
+    if (s.session != nullptr)
+        esp_tls_free_client_session(s.session);
+    s.session = nullptr;
+    s.key.clear();
+}
+
+// Caller holds _sessions_mutex
+static fn_tls_session *_session_find(const std::string &key)
+{
+    int64_t now = esp_timer_get_time();
+    for (auto &s : _sessions)
+    {
+        if (s.session == nullptr || s.key != key)
+            continue;
+        if (now - s.stored_us > (int64_t)FN_TLS_SESSION_MAX_AGE_MS * 1000)
+        {
+            _session_drop(s);
+            return nullptr;
+        }
+        s.used_us = now;
+        return &s;
+    }
+    return nullptr;
+}
+
+static void _session_store(const std::string &key, esp_tls_client_session_t *session)
+{
+    std::lock_guard<std::mutex> lock(_sessions_mutex);
+
+    fn_tls_session *slot = nullptr;
+    for (auto &s : _sessions)
+    {
+        if (s.key == key || s.session == nullptr)
+        {
+            slot = &s;
+            break;
+        }
+        if (slot == nullptr || s.used_us < slot->used_us)
+            slot = &s;
+    }
+    _session_drop(*slot);
+    slot->key = key;
+    slot->session = session;
+    slot->stored_us = slot->used_us = esp_timer_get_time();
+}
+
+void fn_transport_ssl_clear_sessions()
+{
+    std::lock_guard<std::mutex> lock(_sessions_mutex);
+    for (auto &s : _sessions)
+        _session_drop(s);
+}
+
+static int _ssl_close(esp_transport_handle_t t)
+{
+    fn_ssl_context *ctx = (fn_ssl_context *)esp_transport_get_context_data(t);
+    if (ctx->tls != nullptr)
+    {
+        esp_tls_conn_destroy(ctx->tls);
+        ctx->tls = nullptr;
+    }
+    return 0;
+}
+
+static int _ssl_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    fn_ssl_context *ctx = (fn_ssl_context *)esp_transport_get_context_data(t);
+    _ssl_close(t);
+
+    ctx->key = std::string(host) + ":" + std::to_string(port);
+    ctx->tls = esp_tls_init();
+    if (ctx->tls == nullptr)
+        return -1;
+
+    esp_tls_cfg_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.timeout_ms = timeout_ms;
+
+    // esp_tls only reads the session during the handshake, so the lock covers the whole connect.
+    // That serializes HTTPS connects, which the single WiFi link does anyway.
+    std::unique_lock<std::mutex> lock(_sessions_mutex);
+    fn_tls_session *cached = _session_find(ctx->key);
+    if (cached != nullptr)
+        cfg.client_session = cached->session;
+
+    int64_t start = esp_timer_get_time();
+    int r = esp_tls_conn_new_sync(host, strlen(host), port, &cfg, ctx->tls);
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+    bool offered = cached != nullptr;
+    if (r != 1 && cached != nullptr)
+        _session_drop(*cached); // don't offer it again
+    lock.unlock();
+
+    tls_stats.handshake(offered, r == 1, ms);
+    if (r != 1)
+    {
+        ESP_LOGE(TAG, "TLS connect to %s failed", ctx->key.c_str());
+        _ssl_close(t);
+        return -1;
+    }
+    ESP_LOGD(TAG, "TLS handshake with %s took %lums%s", ctx->key.c_str(), (unsigned long)ms, offered ? " (cached session)" : "");
+
+    // Remember the (possibly renewed) session for the next connection
+    esp_tls_client_session_t *session = esp_tls_get_client_session(ctx->tls);
+    if (session != nullptr)
+        _session_store(ctx->key, session);
+
+    return 0;
+}
+
+static int _ssl_poll(esp_transport_handle_t t, int timeout_ms, bool for_read)
+{
+    fn_ssl_context *ctx = (fn_ssl_context *)esp_transport_get_context_data(t);
+    if (ctx->tls == nullptr)
+        return -1;
+    if (for_read && esp_tls_get_bytes_avail(ctx->tls) > 0)
+        return 1;
+
+    int sockfd;
+    if (esp_tls_get_conn_sockfd(ctx->tls, &sockfd) != ESP_OK || sockfd < 0)
+        return -1;
+
+    fd_set fds, errset;
+    FD_ZERO(&fds);
+    FD_ZERO(&errset);
+    FD_SET(sockfd, &fds);
+    FD_SET(sockfd, &errset);
+    struct timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+    int r = select(sockfd + 1, for_read ? &fds : nullptr, for_read ? nullptr : &fds, &errset,
+                   timeout_ms < 0 ? nullptr : &timeout);
+    if (r > 0 && FD_ISSET(sockfd, &errset))
+        return -1;
+    return r;
+}
+
+static int _ssl_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return _ssl_poll(t, timeout_ms, true);
+}
+
+static int _ssl_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return _ssl_poll(t, timeout_ms, false);
+}
+
+static int _ssl_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    fn_ssl_context *ctx = (fn_ssl_context *)esp_transport_get_context_data(t);
+    int poll = _ssl_poll_read(t, timeout_ms);
+    if (poll <= 0)
+        return -1; // timed out or error, either way nothing was read
+
+    ssize_t r = esp_tls_conn_read(ctx->tls, buffer, len);
+    if (r == ESP_TLS_ERR_SSL_WANT_READ || r == ESP_TLS_ERR_SSL_WANT_WRITE)
+        return -1;
+    if (r < 0)
+        ESP_LOGE(TAG, "esp_tls_conn_read error %d", (int)r);
+    return (int)r; // 0 means the server closed the connection
+}
+
+static int _ssl_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    fn_ssl_context *ctx = (fn_ssl_context *)esp_transport_get_context_data(t);
+    if (_ssl_poll_write(t, timeout_ms) <= 0)
+        return -1;
+
+    ssize_t r = esp_tls_conn_write(ctx->tls, buffer, len);
+    if (r < 0)
+        ESP_LOGE(TAG, "esp_tls_conn_write error %d", (int)r);
+    return (int)r;
+}
+
+static int _ssl_destroy(esp_transport_handle_t t)
+{
+    // Called by esp_transport_destroy(), which frees the transport itself
+    fn_ssl_context *ctx = (fn_ssl_context *)esp_transport_get_context_data(t);
+    _ssl_close(t);
+    delete ctx;
+    return 0;
+}
+
+esp_transport_handle_t fn_transport_ssl_init()
+{
+    esp_transport_handle_t t = esp_transport_init();
+    if (t == nullptr)
+        return nullptr;
+
+    fn_ssl_context *ctx = new fn_ssl_context;
+    esp_transport_set_context_data(t, ctx);
+    esp_transport_set_func(t, _ssl_connect, _ssl_read, _ssl_write, _ssl_close, _ssl_poll_read, _ssl_poll_write, _ssl_destroy);
+    return t;
+}
+
+} // namespace fujinet
+
+#endif // FN_TRANSPORT_SSL_SESSION_CACHE
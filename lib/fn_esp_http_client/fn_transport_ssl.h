@@ -0,0 +1,41 @@
+#ifndef _FN_TRANSPORT_SSL_H_
+#define _FN_TRANSPORT_SSL_H_
+
+#include "sdkconfig.h"
+#include "esp_transport.h"
+
+/*
+ * SSL transport for fn_esp_http_client that remembers the TLS session of
+ * each host it connects to and offers it on the next connection, so a
+ * reconnect gets an abbreviated handshake instead of a full key exchange.
+ * Needs CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS; without it the stock
+ * esp_transport_ssl is used.
+ */
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+#define FN_TRANSPORT_SSL_SESSION_CACHE 1
+
+// Sessions remembered, least recently used is dropped first
+#define FN_TLS_SESSION_CACHE_SIZE 4
+// Servers rotate ticket keys, don't offer sessions older than this
+#define FN_TLS_SESSION_MAX_AGE_MS (60 * 60 * 1000)
+
+namespace fujinet
+{
+/**
+ * @brief      Create an SSL transport with a TLS session cache shared by all its instances.
+ *             Server certificates are handled as esp_transport_ssl does with no CA configured.
+ *
+ * @return     The transport handle, NULL on failure
+ */
+esp_transport_handle_t fn_transport_ssl_init();
+
+/**
+ * @brief      Forget all cached sessions
+ */
+void fn_transport_ssl_clear_sessions();
+}
+
+#endif // CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+
+#endif // _FN_TRANSPORT_SSL_H_
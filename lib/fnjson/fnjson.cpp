@@ -15,6 +15,17 @@
 #include "string_utils.h"
 #include "../../include/debug.h"
 #include "../utils/utils.h"
+#include "fnArena.h"
+
+static void *_json_malloc(size_t size)
+{
+    return fnArena.malloc(ARENA_JSON, size);
+}
+
+static void _json_free(void *ptr)
+{
+    fnArena.free(ARENA_JSON, ptr);
+}
 
 /**
  * ctor
@@ -24,6 +35,14 @@ FNJSON::FNJSON()
 #ifdef VERBOSE_PROTOCOL
     Debug_printf("FNJSON::ctor()\r\n");
 #endif
+    // Parsed documents come out of the JSON arena. cJSON is only used through
+    // here, so nothing else frees its memory with plain free()
+    static const bool hooked = []() {
+        cJSON_Hooks hooks = {_json_malloc, _json_free};
+        cJSON_InitHooks(&hooks);
+        return true;
+    }();
+    (void)hooked;
     _protocol = nullptr;
     _json = nullptr;
 }
@@ -37,6 +56,7 @@ FNJSON::~FNJSON()
     Debug_printf("FNJSON::dtor()\r\n");
 #endif
     _protocol = nullptr;
+    clearQueryCache();
     if (_json != nullptr)
         cJSON_Delete(_json);
     _json = nullptr;
@@ -69,6 +89,18 @@ void FNJSON::setQueryParam(uint8_t qp)
     _queryParam = qp;
 }
 
+/**
+ * Parse only the value at the current read query, so large documents
+ * need no more memory than the part that's asked for
+ */
+void FNJSON::setParseFilter(bool enable)
+{
+#ifdef VERBOSE_PROTOCOL
+    Debug_printf("FNJSON::setParseFilter(%d)\r\n", enable);
+#endif
+    _filterEnabled = enable;
+}
+
 /**
  * Set read query string
  */
@@ -88,10 +120,88 @@ void FNJSON::setReadQuery(const std::string &queryString, uint8_t queryParam)
  */
 cJSON *FNJSON::resolveQuery()
 {
-    if (_queryString.empty())
+    if (_filterQuery.empty())
+        return resolvePointer(_queryString);
+
+    // _json is just the value at _filterQuery, so only queries at or below it resolve
+    if (_queryString == _filterQuery)
+        return _json;
+    if (_queryString.compare(0, _filterQuery.size(), _filterQuery) == 0 && _queryString[_filterQuery.size()] == '/')
+        return resolvePointer(_queryString.substr(_filterQuery.size()));
+
+    return nullptr;
+}
+
+/**
+ * Forget resolved queries, must be called whenever _json changes
+ */
+void FNJSON::clearQueryCache()
+{
+    _queryCache.clear();
+    _arrayCursors.clear();
+}
+
+/**
+ * Resolve a JSON pointer against _json one level at a time, reusing the
+ * cached parent so sibling lookups don't walk the tree from the root
+ */
+cJSON *FNJSON::resolvePointer(const std::string &pointer)
+{
+    if (pointer.empty() || _json == nullptr)
         return _json;
 
-    return cJSONUtils_GetPointer(_json, _queryString.c_str());
+    auto hit = _queryCache.find(pointer);
+    if (hit != _queryCache.end())
+        return hit->second;
+
+    cJSON *item = nullptr;
+    size_t slash = pointer.rfind('/');
+    if (slash == std::string::npos)
+        item = cJSONUtils_GetPointer(_json, pointer.c_str()); // not a valid pointer, let cJSON decide
+    else
+    {
+        cJSON *parent = resolvePointer(pointer.substr(0, slash));
+        if (cJSON_IsArray(parent))
+            item = arrayElement(parent, pointer.substr(slash + 1));
+        else if (parent != nullptr)
+            item = cJSONUtils_GetPointer(parent, pointer.c_str() + slash);
+    }
+
+    if (_queryCache.size() >= FNJSON_QUERY_CACHE_MAX)
+        _queryCache.clear();
+    _queryCache[pointer] = item;
+    return item;
+}
+
+/**
+ * Array element by pointer token, stepping from the element last returned
+ * for this array when the index is at or after it
+ */
+cJSON *FNJSON::arrayElement(cJSON *array, const std::string &token)
+{
+    // Same rule as cJSON_Utils: digits only, no leading zeros
+    if (token.empty() || token.size() > 9 || (token.size() > 1 && token[0] == '0') ||
+        token.find_first_not_of("0123456789") != std::string::npos)
+        return nullptr;
+    int index = atoi(token.c_str());
+
+    int at = 0;
+    cJSON *item = array->child;
+    auto cursor = _arrayCursors.find(array);
+    if (cursor != _arrayCursors.end() && cursor->second.index <= index)
+    {
+        at = cursor->second.index;
+        item = cursor->second.item;
+    }
+    while (item != nullptr && at < index)
+    {
+        item = item->next;
+        at++;
+    }
+
+    if (item != nullptr)
+        _arrayCursors[array] = {index, item};
+    return item;
 }
 
 /**
@@ -306,6 +416,7 @@ bool FNJSON::parse()
     if (_json != nullptr)
     {
         // delete and set to null. we only set a new _json value if the parsebuffer is not empty
+        clearQueryCache();
         cJSON_Delete(_json);
         _json = nullptr;
     }
@@ -316,10 +427,18 @@ bool FNJSON::parse()
         return false;
     }
     _parseBuffer.clear();
+    _filterQuery.clear();
     _protocol->status(&ns);
 #ifdef VERBOSE_PROTOCOL
     Debug_printf("json parse, initial status: ns.rxBW: %d, ns.conn: %d, ns.err: %d\r\n", ns.rxBytesWaiting, ns.connected, ns.error);
 #endif
+
+    if (_filterEnabled && !_queryString.empty())
+    {
+        parseFiltered(ns);
+        return _json != nullptr;
+    }
+
 #ifdef ESP_PLATFORM
     while (ns.connected)
 #else
@@ -358,6 +477,46 @@ bool FNJSON::parse()
     return true;
 }
 
+/**
+ * Parse data from protocol as it arrives, keeping only the value at _queryString
+ */
+void FNJSON::parseFiltered(NetworkStatus &ns)
+{
+    _filter.begin(_queryString);
+
+#ifdef ESP_PLATFORM
+    while (ns.connected)
+#else
+    while (ns.connected || ns.rxBytesWaiting > 0)
+#endif
+    {
+        // keep reading after the value was found, so the rest of the document is drained
+        if (ns.rxBytesWaiting > 0)
+        {
+            _protocol->read(ns.rxBytesWaiting < FNJSON_FILTER_CHUNK ? ns.rxBytesWaiting : FNJSON_FILTER_CHUNK);
+            _filter.feed(_protocol->receiveBuffer->data(), _protocol->receiveBuffer->size());
+            _protocol->receiveBuffer->clear();
+        }
+        _protocol->status(&ns);
+#ifdef ESP_PLATFORM
+        if (ns.rxBytesWaiting == 0)
+            vTaskDelay(10);
+#endif
+    }
+
+    if (_filter.found())
+    {
+        _json = cJSON_Parse(_filter.value().c_str());
+        if (_json != nullptr)
+            _filterQuery = _queryString;
+    }
+
+#ifdef VERBOSE_PROTOCOL
+    if (_json == nullptr)
+        Debug_printf("FNJSON::parseFiltered() - %s not found or not valid JSON\r\n", _queryString.c_str());
+#endif
+}
+
 bool FNJSON::status(NetworkStatus *s)
 {
     // Debug_printf("FNJSON::status(%u) %s\r\n", json_bytes_remaining, getValue(_item).c_str());
@@ -12,7 +12,16 @@
 #include <cJSON_Utils.h>
 #include <string.h>
 
+#include <unordered_map>
+
 #include "../network-protocol/Protocol.h"
+#include "fnjsonfilter.h"
+
+// Bytes read from the protocol at a time when parsing with the filter on
+#define FNJSON_FILTER_CHUNK 512
+
+// Resolved queries remembered per parsed document; the cache starts over when full
+#define FNJSON_QUERY_CACHE_MAX 128
 
 class FNJSON
 {
@@ -32,6 +41,7 @@ public:
     std::string processString(std::string in);
     int json_bytes_remaining = 0;
     void setQueryParam(uint8_t qp);
+    void setParseFilter(bool enable);
     
 private:
     cJSON *_json = nullptr;
@@ -42,6 +52,25 @@ private:
     std::string lineEnding;
     std::string getValue(cJSON *item);
     std::string _parseBuffer;
+
+    // When on, parse() keeps only the value at the read query set beforehand
+    bool _filterEnabled = false;
+    std::string _filterQuery; // query the current _json was filtered with, empty when it's the whole document
+    FNJSONFilter _filter;
+    void parseFiltered(NetworkStatus &ns);
+
+    // Query results for the current _json, and per array the element last
+    // stepped to, so walking /items/0, /items/1, ... doesn't rescan the array
+    struct arrayCursor
+    {
+        int index;
+        cJSON *item;
+    };
+    std::unordered_map<std::string, cJSON *> _queryCache;
+    std::unordered_map<cJSON *, arrayCursor> _arrayCursors;
+    void clearQueryCache();
+    cJSON *resolvePointer(const std::string &pointer);
+    cJSON *arrayElement(cJSON *array, const std::string &token);
 };
 
 #endif /* JSON_H */
\ No newline at end of file
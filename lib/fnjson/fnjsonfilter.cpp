@@ -0,0 +1,276 @@
+/**
+ * Streaming JSON subtree filter for #FujiNet
+ */
+
+#include "fnjsonfilter.h"
+
+#include <cctype>
+
+/**
+ * Reset, splitting pointer into its unescaped reference tokens
+ */
+void FNJSONFilter::begin(const std::string &pointer)
+{
+    _tokens.clear();
+    _frames.clear();
+    _value.clear();
+    _state = VALUE;
+    _escape = false;
+    _unicode = -1;
+    _collect_key = false;
+    _capturing = false;
+
+    size_t pos = 0;
+    while (pos < pointer.size() && pointer[pos] == '/')
+    {
+        size_t next = pointer.find('/', pos + 1);
+        std::string raw = pointer.substr(pos + 1, next == std::string::npos ? std::string::npos : next - pos - 1);
+        std::string token;
+        for (size_t i = 0; i < raw.size(); i++)
+        {
+            if (raw[i] == '~' && i + 1 < raw.size() && (raw[i + 1] == '0' || raw[i + 1] == '1'))
+                token += raw[++i] == '0' ? '~' : '/';
+            else
+                token += raw[i];
+        }
+        _tokens.push_back(token);
+        if (next == std::string::npos)
+            break;
+        pos = next;
+    }
+}
+
+/**
+ * Whether the path down to the innermost container matches the pointer
+ */
+bool FNJSONFilter::_parent_match()
+{
+    return _frames.empty() || _frames.back().match;
+}
+
+/**
+ * Whether a value starting now is the selected one
+ */
+bool FNJSONFilter::_target()
+{
+    return !_capturing && _frames.size() == _tokens.size() && _parent_match();
+}
+
+void FNJSONFilter::_value_start(char c)
+{
+    if (!_frames.empty() && !_frames.back().object)
+    {
+        // array element, its index is the path token
+        size_t depth = _frames.size();
+        frame &f = _frames.back();
+        f.match = (depth == 1 || _frames[depth - 2].match) && depth <= _tokens.size() &&
+                  _tokens[depth - 1] == std::to_string(f.index);
+    }
+
+    if (_target())
+    {
+        _capturing = true;
+        _capture_depth = _frames.size();
+    }
+    if (_capturing)
+        _value += c;
+
+    switch (c)
+    {
+    case '{':
+    case '[':
+        _frames.push_back({c == '{', false, 0, std::string()});
+        _state = c == '{' ? KEY : VALUE;
+        break;
+    case '"':
+        _state = STRING;
+        break;
+    default:
+        _state = LITERAL;
+        break;
+    }
+}
+
+void FNJSONFilter::_value_end()
+{
+    _state = AFTER_VALUE;
+    if (_capturing && _frames.size() == _capture_depth)
+        _state = DONE;
+}
+
+/**
+ * Collect one (still escaped) character of a key being compared against the pointer
+ */
+void FNJSONFilter::_key_char(char c)
+{
+    std::string &key = _frames.back().key;
+
+    if (_unicode >= 0)
+    {
+        _codepoint = (_codepoint << 4) | (isdigit((unsigned char)c) ? c - '0' : (tolower((unsigned char)c) - 'a' + 10));
+        if (--_unicode > 0)
+            return;
+        _unicode = -1;
+        // UTF-8 encode, surrogate pairs are left as two separate code units
+        if (_codepoint < 0x80)
+            key += (char)_codepoint;
+        else if (_codepoint < 0x800)
+        {
+            key += (char)(0xC0 | (_codepoint >> 6));
+            key += (char)(0x80 | (_codepoint & 0x3F));
+        }
+        else
+        {
+            key += (char)(0xE0 | (_codepoint >> 12));
+            key += (char)(0x80 | ((_codepoint >> 6) & 0x3F));
+            key += (char)(0x80 | (_codepoint & 0x3F));
+        }
+        return;
+    }
+
+    if (!_escape)
+    {
+        key += c;
+        return;
+    }
+
+    _escape = false;
+    switch (c)
+    {
+    case 'b': key += '\b'; break;
+    case 'f': key += '\f'; break;
+    case 'n': key += '\n'; break;
+    case 'r': key += '\r'; break;
+    case 't': key += '\t'; break;
+    case 'u':
+        _unicode = 4;
+        _codepoint = 0;
+        break;
+    default: key += c; break; // \" \\ \/
+    }
+}
+
+void FNJSONFilter::_process(char c)
+{
+    switch (_state)
+    {
+    case DONE:
+        return;
+
+    case STRING:
+    case KEY_STRING:
+        if (_capturing)
+            _value += c;
+        if (_escape && _unicode < 0 && !_collect_key)
+            _escape = false;
+        else if (_unicode >= 0 || _escape)
+            _key_char(c); // only reached while collecting a key
+        else if (c == '\\')
+            _escape = true;
+        else if (c == '"')
+        {
+            if (_state == STRING)
+                _value_end();
+            else
+            {
+                frame &f = _frames.back();
+                size_t depth = _frames.size();
+                f.match = _collect_key && f.key == _tokens[depth - 1];
+                _collect_key = false;
+                _state = COLON;
+            }
+        }
+        else if (_collect_key)
+            _key_char(c);
+        return;
+
+    case LITERAL:
+        if (isalnum((unsigned char)c) || c == '-' || c == '+' || c == '.')
+        {
+            if (_capturing)
+                _value += c;
+            return;
+        }
+        _value_end();
+        _process(c); // the delimiter belongs to the enclosing container
+        return;
+
+    default:
+        break;
+    }
+
+    if (isspace((unsigned char)c))
+    {
+        if (_capturing)
+            _value += c;
+        return;
+    }
+
+    switch (_state)
+    {
+    case VALUE:
+        if (c == ']' && !_frames.empty() && !_frames.back().object)
+            break; // empty array
+        _value_start(c);
+        return;
+
+    case KEY:
+        if (c == '"')
+        {
+            if (_capturing)
+                _value += c;
+            size_t depth = _frames.size();
+            frame &f = _frames.back();
+            f.key.clear();
+            f.match = false;
+            _collect_key = !_capturing && depth <= _tokens.size() && (depth == 1 || _frames[depth - 2].match);
+            _state = KEY_STRING;
+            return;
+        }
+        break; // '}' of an empty object
+
+    case COLON:
+        if (_capturing)
+            _value += c;
+        _state = VALUE;
+        return;
+
+    case AFTER_VALUE:
+        if (c == ',')
+        {
+            if (_capturing)
+                _value += c;
+            if (!_frames.empty())
+            {
+                frame &f = _frames.back();
+                if (f.object)
+                    _state = KEY;
+                else
+                {
+                    f.index++;
+                    _state = VALUE;
+                }
+            }
+            return;
+        }
+        break;
+
+    default:
+        return;
+    }
+
+    // End of a container
+    if ((c == '}' || c == ']') && !_frames.empty())
+    {
+        if (_capturing)
+            _value += c;
+        _frames.pop_back();
+        _value_end();
+    }
+}
+
+void FNJSONFilter::feed(const char *data, size_t len)
+{
+    for (size_t i = 0; i < len && _state != DONE; i++)
+        _process(data[i]);
+}
@@ -0,0 +1,76 @@
+/**
+ * Streaming JSON subtree filter for #FujiNet
+ *
+ * Scans a JSON document as it arrives, chunk by chunk, and keeps only the
+ * text of the value at a JSON pointer (RFC 6901, e.g. "/data/0/name").
+ * Everything else is dropped as soon as it has been scanned, so memory use
+ * follows the size of the selected value rather than the whole document.
+ *
+ * The scanner is lenient: it only tracks enough structure to know where
+ * values start and end. The kept text is validated when it is handed to cJSON.
+ */
+
+#ifndef FNJSONFILTER_H
+#define FNJSONFILTER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class FNJSONFilter
+{
+public:
+    // Start over, keeping the value at pointer from the next document fed in
+    void begin(const std::string &pointer);
+
+    void feed(const char *data, size_t len);
+
+    // The selected value was seen in full
+    bool found() { return _state == DONE; }
+
+    // Text of the selected value, empty until found()
+    const std::string &value() { return _value; }
+
+private:
+    enum state
+    {
+        VALUE,       // expecting a value
+        KEY,         // expecting a key or the end of an object
+        COLON,       // expecting ':' after a key
+        AFTER_VALUE, // expecting ',' or the end of a container
+        STRING,      // inside a string value
+        KEY_STRING,  // inside a key
+        LITERAL,     // inside a number, true, false or null
+        DONE         // selected value is complete, ignore the rest
+    };
+
+    struct frame
+    {
+        bool object;
+        bool match;        // path down to this frame's current key/index matches the pointer
+        size_t index;      // current array index
+        std::string key;   // current object key, only collected while it could match
+    };
+
+    std::vector<std::string> _tokens;
+    std::vector<frame> _frames;
+    std::string _value;
+    state _state = VALUE;
+
+    bool _escape = false;
+    int _unicode = -1;         // hex digits of a \uXXXX escape still to come, -1 when not in one
+    unsigned _codepoint = 0;
+    bool _collect_key = false;
+
+    bool _capturing = false;
+    size_t _capture_depth = 0;
+
+    bool _parent_match();
+    bool _target();
+    void _value_start(char c);
+    void _value_end();
+    void _key_char(char c);
+    void _process(char c);
+};
+
+#endif /* FNJSONFILTER_H */
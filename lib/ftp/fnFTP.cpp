@@ -700,11 +700,15 @@ bool fnFTP::login(const string &_username, const string &_password, const string
         return true;
     }
 
+    // TYPE and FEAT go out with PASS rather than each waiting for the reply
+    // before; should the login fail, they're refused too and it's dropped
     if (is_positive_intermediate_reply() && is_authentication())
     {
         Debug_printf("Sending PASS.\r\n");
         // Send password
         PASS();
+        TYPE();
+        FEAT();
 
         if (parse_response())
         {
@@ -715,12 +719,16 @@ bool fnFTP::login(const string &_username, const string &_password, const string
     else
     {
         Debug_printf("Will not send password. Response was: %s\r\n", controlResponse.c_str());
+        if (is_positive_completion_reply() && is_authentication())
+        {
+            TYPE();
+            FEAT();
+        }
     }
 
     if (is_positive_completion_reply() && is_authentication())
     {
-        Debug_printf("Logged in successfully. Setting type.\r\n");
-        TYPE();
+        Debug_printf("Logged in successfully.\r\n");
     }
     else
     {
@@ -743,9 +751,39 @@ bool fnFTP::login(const string &_username, const string &_password, const string
         Debug_printf("Could not set image type. Ignoring.\r\n");
     }
 
+    if (parse_response())
+    {
+        Debug_printf("Timed out waiting for FEAT reply.\r\n");
+        return true;
+    }
+    parse_features();
+
     return false;
 }
 
+void fnFTP::parse_features()
+{
+    _feat_mlsd = _feat_rest = _feat_size = false;
+    if (!is_positive_completion_reply())
+        return; // No FEAT, so none of them
+
+    std::stringstream features(controlBody);
+    string line;
+    while (getline(features, line))
+    {
+        // Each is a space, the name, and maybe its parameters
+        for (char &c : line)
+            c = toupper((unsigned char)c);
+        if (line.compare(0, 5, " MLST") == 0)
+            _feat_mlsd = true;
+        else if (line.compare(0, 12, " REST STREAM") == 0)
+            _feat_rest = true;
+        else if (line.compare(0, 5, " SIZE") == 0)
+            _feat_size = true;
+    }
+    Debug_printf("fnFTP features:%s%s%s\r\n", _feat_mlsd ? " MLSD" : "", _feat_rest ? " REST" : "", _feat_size ? " SIZE" : "");
+}
+
 bool fnFTP::logout()
 {
     Debug_printf("fnFTP::logout()\r\n");
@@ -781,7 +819,7 @@ bool fnFTP::reconnect()
     return login(username, password, hostname, control_port);
 }
 
-bool fnFTP::open_file(string path, bool stor)
+bool fnFTP::open_file(string path, bool stor, long offset)
 {
     if (!control->connected())
     {
@@ -808,6 +846,32 @@ bool fnFTP::open_file(string path, bool stor)
     {
         STOR(path);
     }
+    else if (offset > 0)
+    {
+        if (!has_rest())
+        {
+            Debug_printf("fnFTP::open_file(%s) can't start at %ld without REST.\r\n", path.c_str(), offset);
+            data->stop();
+            return true;
+        }
+        // The server said REST STREAM is there, so RETR can follow without waiting for 350
+        REST(offset);
+        RETR(path);
+
+        if (parse_response())
+        {
+            Debug_printf("Timed out waiting for 350 response.\r\n");
+            return true;
+        }
+        if (!is_positive_intermediate_reply())
+        {
+            Debug_printf("Server refused REST. Response was: %s\r\n", controlResponse.c_str());
+            // RETR starts at the beginning instead, don't read that
+            _expect_control_response = true;
+            abort_transfer();
+            return true;
+        }
+    }
     else
     {
         RETR(path);
@@ -855,8 +919,13 @@ bool fnFTP::open_directory(string path, string pattern)
         return true;
     }
 
-    // perform LIST
-    LIST(path, pattern);
+    // MLSD says what's a directory and when things were changed in a form
+    // meant for us, but only takes a directory, not a pattern
+    _dir_mlsd = _feat_mlsd && pattern.empty();
+    if (_dir_mlsd)
+        MLSD(path);
+    else
+        LIST(path, pattern);
 
     if (parse_response())
     {
@@ -933,7 +1002,80 @@ bool fnFTP::open_directory(string path, string pattern)
     return false; // all good.
 }
 
-bool fnFTP::read_directory(string &name, long &filesize, bool &is_dir)
+/* MLSD modify=YYYYMMDDHHMMSS[.sss] fact, in UTC, to time_t */
+static time_t _mlsd_time(const string &fact)
+{
+    if (fact.size() < 14)
+        return 0;
+    for (int i = 0; i < 14; i++)
+        if (!isdigit((unsigned char)fact[i]))
+            return 0;
+
+    int year = atoi(fact.substr(0, 4).c_str());
+    int month = atoi(fact.substr(4, 2).c_str());
+    int day = atoi(fact.substr(6, 2).c_str());
+    if (month < 1 || month > 12 || day < 1 || day > 31)
+        return 0;
+
+    // Days since 1970-01-01 of a proleptic Gregorian date
+    int y = year - (month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = (long)era * 146097 + doe - 719468;
+
+    return (time_t)days * 86400 + atoi(fact.substr(8, 2).c_str()) * 3600 +
+           atoi(fact.substr(10, 2).c_str()) * 60 + atoi(fact.substr(12, 2).c_str());
+}
+
+/* One line of MLSD output: "fact=value;fact=value; name" */
+static bool _mlsd_parse(const string &line, string &name, long &filesize, bool &is_dir, time_t &mtime)
+{
+    size_t space = line.find(' ');
+    if (space == string::npos)
+        return false;
+
+    name = line.substr(space + 1);
+    filesize = 0;
+    is_dir = false;
+    mtime = 0;
+
+    size_t pos = 0;
+    while (pos < space)
+    {
+        size_t end = line.find(';', pos);
+        if (end == string::npos || end > space)
+            end = space;
+        string fact = line.substr(pos, end - pos);
+        size_t eq = fact.find('=');
+        if (eq != string::npos)
+        {
+            string key = fact.substr(0, eq);
+            string value = fact.substr(eq + 1);
+            for (char &c : key)
+                c = tolower((unsigned char)c);
+            for (char &c : value)
+                c = tolower((unsigned char)c);
+
+            if (key == "type")
+            {
+                // The directory itself and its parent aren't entries
+                if (value == "cdir" || value == "pdir")
+                    return false;
+                is_dir = value == "dir";
+            }
+            else if (key == "size")
+                filesize = atol(value.c_str());
+            else if (key == "modify")
+                mtime = _mlsd_time(value);
+        }
+        pos = end + 1;
+    }
+    return true;
+}
+
+bool fnFTP::read_directory(string &name, long &filesize, bool &is_dir, time_t *mtime)
 {
     string line;
     struct ftpparse parse;
@@ -943,12 +1085,33 @@ bool fnFTP::read_directory(string &name, long &filesize, bool &is_dir)
     if (line.empty())
         return true;
 
+    if (_dir_mlsd)
+    {
+        if (line.back() == '\r')
+            line.pop_back();
+
+        time_t t;
+        if (!_mlsd_parse(line, name, filesize, is_dir, t))
+        {
+            // Not an entry, go on to the next line
+            if (dirBuffer.eof())
+                return true;
+            return read_directory(name, filesize, is_dir, mtime);
+        }
+        if (mtime != nullptr)
+            *mtime = t;
+        Debug_printf("Name: \"%s\" size: %lu\r\n", name.c_str(), filesize);
+        return dirBuffer.eof();
+    }
+
     //Debug_printf("fnFTP::read_directory - %s\r\n",line.c_str());
     line = line.substr(0, line.size() - 1);
     ftpparse(&parse, (char *)line.c_str(), line.length());
     name = string(parse.name ? parse.name : "???");
     filesize = parse.size;
     is_dir = (parse.flagtrycwd == 1);
+    if (mtime != nullptr)
+        *mtime = parse.mtimetype == FTPPARSE_MTIME_UNKNOWN ? 0 : parse.mtime;
     Debug_printf("Name: \"%s\" size: %lu\r\n", name.c_str(), filesize);
     return dirBuffer.eof();
 }
@@ -964,6 +1127,79 @@ bool fnFTP::read_file(uint8_t *buf, unsigned short len)
     return len != data->read(buf, len);
 }
 
+int fnFTP::read_data(uint8_t *buf, unsigned short len)
+{
+    int total = 0;
+    uint64_t last_data = fnSystem.millis();
+
+    while (total < len)
+    {
+        int available = data->available();
+        if (available > 0)
+        {
+            int num_read = data->read(buf + total, available > len - total ? len - total : available);
+            if (num_read <= 0)
+                break;
+            total += num_read;
+            last_data = fnSystem.millis();
+        }
+        else if (!data->connected())
+        {
+            break; // End of file
+        }
+        else if (fnSystem.millis() - last_data > FTP_TIMEOUT)
+        {
+            Debug_printf("fnFTP::read_data - Timeout\r\n");
+            break;
+        }
+        else
+        {
+            fnSystem.delay(1);
+        }
+    }
+    return total;
+}
+
+bool fnFTP::abort_transfer()
+{
+    Debug_printf("fnFTP::abort_transfer()\r\n");
+
+    bool res = false;
+    if (_expect_control_response)
+    {
+        // Closing our end stops a RETR, no ABOR needed. Its last reply is
+        // 426 once the server notices, or 226 if it had finished already
+        data->stop();
+        do
+        {
+            if (parse_response())
+            {
+                res = true;
+                break;
+            }
+        } while (is_positive_preliminary_reply());
+    }
+    data->stop();
+    _stor = false;
+    _expect_control_response = false;
+    return res;
+}
+
+bool fnFTP::file_size(string path, long &size)
+{
+    if (!_feat_size)
+        return true;
+
+    SIZE(path);
+    if (parse_response())
+        return true;
+    if (_statusCode != 213)
+        return true;
+
+    size = atol(controlResponse.substr(4).c_str());
+    return false;
+}
+
 bool fnFTP::write_file(uint8_t *buf, unsigned short len)
 {
     //Debug_printf("fnFTP::write_file(%p,%u)\r\n", buf, len);
@@ -1024,6 +1260,7 @@ bool fnFTP::parse_response()
     bool multi_line = false;
 
     controlResponse.clear();
+    controlBody.clear();
 
     while(true)
     {
@@ -1048,8 +1285,12 @@ bool fnFTP::parse_response()
                 }
             }
         }
-        if (multi_line) // ignore body of multi-line response
+        if (multi_line) // body of multi-line response
+        {
+            controlBody += string(respBuf, num_read);
+            controlBody += '\n';
             continue;
+        }
         // error - nothing above
         Debug_printf("fnFTP::parse_response() - failed\r\n");
         _statusCode = 501;  //syntax error
@@ -1190,6 +1431,12 @@ void fnFTP::TYPE()
     control->write("TYPE I\r\n");
 }
 
+void fnFTP::FEAT()
+{
+    Debug_printf("fnFTP::FEAT()\r\n");
+    control->write("FEAT\r\n");
+}
+
 void fnFTP::QUIT()
 {
     Debug_printf("fnFTP::QUIT()\r\n");
@@ -1220,6 +1467,24 @@ void fnFTP::LIST(string path, string pattern)
     control->write("LIST " + path + pattern + "\r\n");
 }
 
+void fnFTP::MLSD(string path)
+{
+    Debug_printf("fnFTP::MLSD(%s)\r\n",path.c_str());
+    control->write("MLSD " + path + "\r\n");
+}
+
+void fnFTP::SIZE(string path)
+{
+    Debug_printf("fnFTP::SIZE(%s)\r\n",path.c_str());
+    control->write("SIZE " + path + "\r\n");
+}
+
+void fnFTP::REST(long offset)
+{
+    Debug_printf("fnFTP::REST(%ld)\r\n",offset);
+    control->write("REST " + std::to_string(offset) + "\r\n");
+}
+
 void fnFTP::ABOR()
 {
     Debug_printf("fnFTP::ABOR()\r\n");
@@ -54,9 +54,29 @@ public:
      * Open file on FTP server
      * @param path to file to open.
      * @param stor TRUE means STOR, otherwise RETR
+     * @param offset where RETR starts, needs REST support
      * @return TRUE if error, FALSE if successful.
      */
-    bool open_file(string path, bool stor);
+    bool open_file(string path, bool stor, long offset = 0);
+
+    /**
+     * Stop a RETR part way, leaving the control connection ready for the next command.
+     * @return TRUE if error, FALSE if successful.
+     */
+    bool abort_transfer();
+
+    /**
+     * Ask server for the size of a file.
+     * @param path file to ask about
+     * @param size the size, in bytes
+     * @return TRUE if error, FALSE if successful.
+     */
+    bool file_size(string path, long &size);
+
+    /**
+     * @brief whether the server can start a RETR part way (REST STREAM)
+     */
+    bool has_rest() { return _feat_rest && _feat_size; }
 
     /**
      * Open directory on FTP server, grab it, and return back.
@@ -70,9 +90,10 @@ public:
      * Read and return one parsed line of directory
      * @param name pointer to output name
      * @param filesize pointer to output filesize
+     * @param mtime if given, set to the modification time, 0 if unknown
      * @return TRUE if error, FALSE if successful
      */
-    bool read_directory(string& name, long& filesize, bool &is_dir);
+    bool read_directory(string& name, long& filesize, bool &is_dir, time_t *mtime = nullptr);
 
     /**
      * Read file from data socket into buffer.
@@ -82,6 +103,14 @@ public:
      */
     bool read_file(uint8_t* buf, unsigned short len);
 
+    /**
+     * Read file from data socket into buffer, waiting for all of it to arrive.
+     * @param buf target buffer
+     * @param len bytes wanted
+     * @return bytes read, short at the end of the file or on error
+     */
+    int read_data(uint8_t* buf, unsigned short len);
+
     /**
      * Write file from buffer into data socket.
      * @param buf source buffer
@@ -136,6 +165,14 @@ private:
     /* FTP status code, taken from FTP server response */
     int _statusCode = 0;
 
+    /* What the server's FEAT reply said it supports */
+    bool _feat_mlsd = false;
+    bool _feat_rest = false;
+    bool _feat_size = false;
+
+    /* dirBuffer holds MLSD rather than LIST output */
+    bool _dir_mlsd = false;
+
     /**
      * The port number. (21 by default)
      */
@@ -156,6 +193,11 @@ private:
      */
     string controlResponse;
 
+    /**
+     * Lines between the first and last of a multi-line response, one per line.
+     */
+    string controlBody;
+
     /**
      * Username
      */
@@ -276,6 +318,16 @@ private:
      */
     void TYPE();
 
+    /**
+     * @brief Ask server which extensions it supports (RFC 2389)
+     */
+    void FEAT();
+
+    /**
+     * @brief Take note of what FEAT reply said
+     */
+    void parse_features();
+
     /**
      * @brief Log out.
      */
@@ -305,6 +357,24 @@ private:
      */
     void LIST(string path, string pattern);
 
+    /**
+     * @brief ask server for machine readable directory listing (RFC 3659)
+     * @param path path of directory listing
+     */
+    void MLSD(string path);
+
+    /**
+     * @brief ask server for size of path (RFC 3659)
+     * @param path path of file
+     */
+    void SIZE(string path);
+
+    /**
+     * @brief ask server to start the next RETR at offset (RFC 3659)
+     * @param offset byte to start from
+     */
+    void REST(long offset);
+
     /**
      * @brief ask server to abort current transfer
      */
@@ -0,0 +1,157 @@
+#include "fujiAppKeys.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+
+#include "fnSystem.h"
+#include "fnFsSD.h"
+
+#include "../../include/debug.h"
+
+fujiAppKeys fnAppKeys;
+
+std::string fujiAppKeys::filename(uint16_t creator, uint8_t app, uint8_t key)
+{
+    char filenamebuf[30];
+    snprintf(filenamebuf, sizeof(filenamebuf), "/FujiNet/%04hx%02hhx%02hhx.key", creator, app, key);
+    return filenamebuf;
+}
+
+fujiAppKeys::entry *fujiAppKeys::_find(uint32_t id)
+{
+    for (auto &e : _keys)
+    {
+        if (e.id != id)
+            continue;
+        // A clean copy that's been around a while is read again
+        if (!e.dirty && fnSystem.millis() - e.stamp > APPKEY_CACHE_TTL_MS)
+            return nullptr;
+        e.last_use = ++_use_clock;
+        return &e;
+    }
+    return nullptr;
+}
+
+// A slot for id, reusing its old one or the least recently used clean one if full
+fujiAppKeys::entry *fujiAppKeys::_add(uint32_t id)
+{
+    entry *slot = nullptr;
+    for (auto &e : _keys)
+    {
+        if (e.id == id)
+        {
+            slot = &e;
+            break;
+        }
+        if (!e.dirty && (slot == nullptr || e.last_use < slot->last_use))
+            slot = &e;
+    }
+    if (slot == nullptr || (slot->id != id && _keys.size() < APPKEY_CACHE_ENTRIES))
+    {
+        _keys.push_back({});
+        slot = &_keys.back();
+    }
+
+    slot->id = id;
+    slot->exists = false;
+    slot->dirty = false;
+    slot->stamp = fnSystem.millis();
+    slot->last_use = ++_use_clock;
+    slot->value.clear();
+    return slot;
+}
+
+bool fujiAppKeys::_store(entry &e)
+{
+    std::string name = filename(e.id >> 16, (e.id >> 8) & 0xFF, e.id & 0xFF);
+    Debug_printf("Writing appkey to \"%s\"\n", name.c_str());
+
+    // Make sure we have a "/FujiNet" directory, since that's where we're putting these files
+    fnSDFAT.create_path("/FujiNet");
+
+    FILE *fOut = fnSDFAT.file_open(name.c_str(), FILE_WRITE);
+    if (fOut == nullptr)
+    {
+        Debug_printf("Failed to open/create output file: errno=%d\n", errno);
+        return false;
+    }
+    size_t count = fwrite(e.value.data(), 1, e.value.size(), fOut);
+    int err = errno;
+    fclose(fOut);
+
+    if (count != e.value.size())
+    {
+        Debug_printf("Only wrote %u bytes of expected %u, errno=%d\n", (unsigned)count, (unsigned)e.value.size(), err);
+        return false;
+    }
+    e.dirty = false;
+    return true;
+}
+
+int fujiAppKeys::read(uint16_t creator, uint8_t app, uint8_t key, uint8_t *buf, size_t maxlen)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    uint32_t id = (uint32_t)creator << 16 | app << 8 | key;
+
+    entry *e = _find(id);
+    if (e == nullptr)
+    {
+        std::string name = filename(creator, app, key);
+        Debug_printf("Reading appkey from \"%s\"\n", name.c_str());
+
+        e = _add(id);
+        FILE *fIn = fnSDFAT.file_open(name.c_str(), FILE_READ);
+        if (fIn != nullptr)
+        {
+            // Keys are at most a few hundred bytes, APPKEYMODE_READ_256 being the largest
+            uint8_t data[1024];
+            size_t count = fread(data, 1, sizeof(data), fIn);
+            fclose(fIn);
+            e->value.assign(data, data + count);
+            e->exists = true;
+        }
+        else
+            Debug_printf("Failed to open input file: errno=%d\n", errno);
+    }
+
+    if (!e->exists)
+        return -1;
+    size_t n = e->value.size() < maxlen ? e->value.size() : maxlen;
+    std::copy(e->value.begin(), e->value.begin() + n, buf);
+    return n;
+}
+
+void fujiAppKeys::write(uint16_t creator, uint8_t app, uint8_t key, const uint8_t *data, size_t len)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    uint32_t id = (uint32_t)creator << 16 | app << 8 | key;
+
+    entry *e = _add(id);
+    e->value.assign(data, data + len);
+    e->exists = true;
+    e->dirty = true;
+}
+
+void fujiAppKeys::service()
+{
+    std::unique_lock<std::recursive_mutex> lock(_mutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+
+    uint64_t now = fnSystem.millis();
+    for (auto &e : _keys)
+    {
+        // One that can't be written is tried again after another wait
+        if (e.dirty && now - e.stamp >= APPKEY_WRITE_BEHIND_MS && !_store(e))
+            e.stamp = now;
+    }
+}
+
+void fujiAppKeys::flush()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    for (auto &e : _keys)
+        if (e.dirty)
+            _store(e);
+}
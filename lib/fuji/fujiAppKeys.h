@@ -0,0 +1,61 @@
+#ifndef _FUJI_APPKEYS_
+#define _FUJI_APPKEYS_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A written key goes to SD once it's been left alone this long, so a game saving
+// on every level change costs one file write rather than one per save
+#define APPKEY_WRITE_BEHIND_MS 2000
+// Keys read from SD are read again after this long, in case the file was changed another way
+#define APPKEY_CACHE_TTL_MS 60000
+#define APPKEY_CACHE_ENTRIES 32
+
+/*
+ * fujiAppKeys - app keys on SD, kept in memory by creator/app/key
+ * Reads are served from memory after the first, and writes land in memory
+ * and reach the card through service() when they've settled. flush()
+ * writes anything still waiting and is called before a reboot. The fuji
+ * devices still check the SD is mounted before asking.
+ */
+class fujiAppKeys
+{
+private:
+    struct entry
+    {
+        uint32_t id; // creator << 16 | app << 8 | key
+        bool exists; // false remembers there's no such key
+        bool dirty;
+        uint64_t stamp; // when it was read, or last written while dirty
+        uint32_t last_use;
+        std::vector<uint8_t> value;
+    };
+
+    std::vector<entry> _keys;
+    std::recursive_mutex _mutex;
+    uint32_t _use_clock = 0;
+
+    entry *_find(uint32_t id);
+    entry *_add(uint32_t id);
+    bool _store(entry &e);
+
+public:
+    static std::string filename(uint16_t creator, uint8_t app, uint8_t key);
+
+    // Copies up to maxlen bytes of the key into buf, returning how many, or -1 if there's no such key
+    int read(uint16_t creator, uint8_t app, uint8_t key, uint8_t *buf, size_t maxlen);
+    // Replaces the key with len bytes of data, written to SD a little later
+    void write(uint16_t creator, uint8_t app, uint8_t key, const uint8_t *data, size_t len);
+
+    // Called from the main service loop, writes keys that have settled
+    void service();
+    // Writes every key still waiting
+    void flush();
+};
+
+extern fujiAppKeys fnAppKeys;
+
+#endif // _FUJI_APPKEYS_
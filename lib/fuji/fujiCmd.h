@@ -20,6 +20,7 @@
 #define FUJICMD_READ_DEVICE_SLOTS          0xF2
 #define FUJICMD_WRITE_DEVICE_SLOTS         0xF1
 #define FUJICMD_ENABLE_UDPSTREAM           0xF0
+#define FUJICMD_COPY_FILE_STATUS           0xEC
 #define FUJICMD_GET_WIFI_ENABLED           0xEA
 #define FUJICMD_SET_BAUDRATE               0xEB
 #define FUJICMD_UNMOUNT_IMAGE              0xE9
@@ -63,6 +64,7 @@
 #define FUJICMD_HASH_COMPUTE_NO_CLEAR      0xC3
 #define FUJICMD_HASH_CLEAR                 0xC2
 #define FUJICMD_GET_HEAP                   0xC1
+#define FUJICMD_HASH_FILE                  0xC0
 #define FUJICMD_QRCODE_OUTPUT              0xBF
 #define FUJICMD_QRCODE_LENGTH              0xBE
 #define FUJICMD_QRCODE_ENCODE              0xBD
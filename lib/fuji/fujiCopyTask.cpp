@@ -0,0 +1,226 @@
+#include "fujiCopyTask.h"
+
+#include <cstring>
+#include <stdlib.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+#include "../../include/debug.h"
+
+#include "fnSystem.h"
+#include "fnTaskManager.h"
+
+fujiCopyStatus fujiCopyTask::_status;
+
+fujiCopyTask::fujiCopyTask(fujiHost *source_host, const std::string &source_path,
+                           fujiHost *dest_host, const std::string &dest_path)
+    : _source_host(source_host), _dest_host(dest_host), _source_path(source_path), _dest_path(dest_path)
+{
+    _source_fullpath[0] = '\0';
+    _dest_fullpath[0] = '\0';
+}
+
+fujiCopyTask::~fujiCopyTask()
+{
+    if (_source_file != nullptr)
+        fnio::fclose(_source_file);
+    if (_dest_file != nullptr)
+        fnio::fclose(_dest_file);
+    free(_buffer);
+}
+
+bool fujiCopyTask::submit(fujiHost *source_host, const std::string &source_path,
+                          fujiHost *dest_host, const std::string &dest_path)
+{
+    if (busy())
+    {
+        Debug_println("fujiCopyTask::submit - a copy is already running");
+        return false;
+    }
+
+    fujiCopyTask *task = new fujiCopyTask(source_host, source_path, dest_host, dest_path);
+    if (taskMgr.submit_task(task) == 0)
+    {
+        delete task;
+        return false;
+    }
+    // Report it as running straight away, taskMgr only starts it on its next pass
+    _status.state = FUJI_COPY_RUNNING;
+    _status.copied = 0;
+    _status.total = 0;
+    return true;
+}
+
+bool fujiCopyTask::run(void (*poll)())
+{
+    if (start() < 0)
+        return false;
+    // The caller is waiting on the copy anyway
+    _step_size = _buffer_size;
+
+    int result;
+    do
+    {
+        if (poll != nullptr)
+            poll();
+        result = step();
+    } while (result == 0);
+
+    if (result < 0)
+        abort();
+    return result > 0;
+}
+
+void fujiCopyTask::status_bytes(uint8_t *buf)
+{
+    buf[0] = _status.state;
+    for (int i = 0; i < 4; i++)
+    {
+        buf[1 + i] = (_status.copied >> (i * 8)) & 0xFF;
+        buf[5 + i] = (_status.total >> (i * 8)) & 0xFF;
+    }
+}
+
+// SD and TNFS serialise access themselves (FATFS's volume lock, TNFS's transaction_mutex),
+// so the bus can keep using them while the worker copies. The others can't be shared
+bool fujiCopyTask::worker_safe()
+{
+    auto shareable = [](fujiHost *host) {
+        return host->get_type() == HOSTTYPE_LOCAL || host->get_type() == HOSTTYPE_TNFS;
+    };
+    return shareable(_source_host) && shareable(_dest_host);
+}
+
+int fujiCopyTask::get_progress()
+{
+    if (_status.total == 0)
+        return _status.state == FUJI_COPY_DONE ? 100 : 0;
+    return (int)((uint64_t)_status.copied * 100 / _status.total);
+}
+
+int fujiCopyTask::start()
+{
+    _status.state = FUJI_COPY_RUNNING;
+    _status.copied = 0;
+    _status.total = 0;
+
+    Debug_printf("fujiCopyTask::start \"%s\" -> \"%s\"\n", _source_path.c_str(), _dest_path.c_str());
+
+    _buffer_size = FUJI_COPY_BUFFER_SIZE;
+#ifdef ESP_PLATFORM
+    if (fnSystem.get_psram_size() > 0)
+    {
+        _buffer_size = FUJI_COPY_BUFFER_SIZE_PSRAM;
+        _buffer = (uint8_t *)heap_caps_malloc(_buffer_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (_buffer == nullptr)
+    {
+        _buffer_size = FUJI_COPY_BUFFER_SIZE;
+        _buffer = (uint8_t *)malloc(_buffer_size);
+    }
+#else
+    _buffer_size = FUJI_COPY_BUFFER_SIZE_PSRAM;
+    _buffer = (uint8_t *)malloc(_buffer_size);
+#endif
+    if (_buffer == nullptr)
+    {
+        Debug_println("fujiCopyTask::start - no memory for copy buffer");
+        _finish(false);
+        return -1;
+    }
+
+    // Mount hosts, if needed.
+    if (!_source_host->mount() || !_dest_host->mount())
+    {
+        _finish(false);
+        return -1;
+    }
+
+    _source_file = _source_host->fnfile_open(_source_path.c_str(), _source_fullpath, sizeof(_source_fullpath), FILE_READ);
+    if (_source_file == nullptr)
+    {
+        _finish(false);
+        return -1;
+    }
+
+    _dest_file = _dest_host->fnfile_open(_dest_path.c_str(), _dest_fullpath, sizeof(_dest_fullpath), FILE_WRITE);
+    if (_dest_file == nullptr)
+    {
+        _finish(false);
+        return -1;
+    }
+
+    _status.total = _source_host->file_size(_source_file);
+
+#ifdef ESP_PLATFORM
+    if (worker_safe() && taskMgr.worker_started())
+        _step_size = _buffer_size;
+    else
+#endif
+        _step_size = FUJI_COPY_BUS_STEP_SIZE;
+    return 0;
+}
+
+int fujiCopyTask::step()
+{
+    size_t wanted = _status.total - _status.copied;
+    if (wanted > _step_size)
+        wanted = _step_size;
+
+    if (wanted == 0)
+    {
+        _finish(true);
+        return 1;
+    }
+
+    size_t readCount = fnio::fread(_buffer, 1, wanted, _source_file);
+    if (readCount != wanted)
+    {
+        Debug_printf("fujiCopyTask::step - short read %u of %u at %u\n",
+                     (unsigned)readCount, (unsigned)wanted, (unsigned)_status.copied);
+        return -1;
+    }
+
+    size_t writeCount = fnio::fwrite(_buffer, 1, readCount, _dest_file);
+    if (writeCount != readCount)
+    {
+        Debug_printf("fujiCopyTask::step - short write %u of %u at %u\n",
+                     (unsigned)writeCount, (unsigned)readCount, (unsigned)_status.copied);
+        return -1;
+    }
+
+    _status.copied += writeCount;
+    if (_status.copied % _buffer_size < writeCount || _status.copied == _status.total)
+        Debug_printf("Copy File: %u bytes of %u\n", (unsigned)_status.copied, (unsigned)_status.total);
+    return 0;
+}
+
+int fujiCopyTask::abort()
+{
+    if (_status.state == FUJI_COPY_RUNNING)
+        _finish(false);
+    return 0;
+}
+
+void fujiCopyTask::_finish(bool ok)
+{
+    if (_source_file != nullptr)
+    {
+        fnio::fclose(_source_file);
+        _source_file = nullptr;
+    }
+    if (_dest_file != nullptr)
+    {
+        fnio::fclose(_dest_file);
+        _dest_file = nullptr;
+        // Don't leave half a file behind
+        if (!ok)
+            _dest_host->file_remove(_dest_fullpath);
+    }
+
+    _status.state = ok ? FUJI_COPY_DONE : FUJI_COPY_ERROR;
+    Debug_printf("fujiCopyTask - copy %s, %u of %u bytes\n", ok ? "done" : "failed",
+                 (unsigned)_status.copied, (unsigned)_status.total);
+}
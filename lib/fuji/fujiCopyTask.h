@@ -0,0 +1,89 @@
+#ifndef _FUJI_COPYTASK_
+#define _FUJI_COPYTASK_
+
+#include <stdint.h>
+#include <string>
+
+#include "fnTask.h"
+#include "fujiHost.h"
+
+// How much is read and written per step off the bus loop (on the ESP32 worker, or in run())
+#define FUJI_COPY_BUFFER_SIZE 8192
+#define FUJI_COPY_BUFFER_SIZE_PSRAM 65536
+// How much a step on the bus loop copies, so commands aren't held up behind a big transfer
+#define FUJI_COPY_BUS_STEP_SIZE 1024
+
+// Set in the destination slot of FUJICMD_COPY_FILE to copy in the background
+#define FUJI_COPY_BACKGROUND 0x80
+
+// Size of the reply to FUJICMD_COPY_FILE_STATUS: state, bytes copied, total (little-endian)
+#define FUJI_COPY_STATUS_LEN 9
+
+enum fujiCopyState
+{
+    FUJI_COPY_IDLE = 0,
+    FUJI_COPY_RUNNING,
+    FUJI_COPY_DONE,
+    FUJI_COPY_ERROR
+};
+
+struct fujiCopyStatus
+{
+    fujiCopyState state = FUJI_COPY_IDLE;
+    uint32_t copied = 0;
+    uint32_t total = 0;
+};
+
+/*
+ * fujiCopyTask - copies a file between two host slots in big chunks
+ * Submitted to taskMgr it runs in the background. Between SD and TNFS hosts,
+ * which lock their own access, it runs on the ESP32 worker; otherwise it is
+ * stepped from the bus loop a small piece at a time, so the bus stays free.
+ * run() does the same copy in the caller.
+ * Only one copy runs at a time, its progress is in fujiCopyTask::status().
+ */
+class fujiCopyTask : public fnTask
+{
+public:
+    fujiCopyTask(fujiHost *source_host, const std::string &source_path,
+                 fujiHost *dest_host, const std::string &dest_path);
+    virtual ~fujiCopyTask() override;
+
+    virtual int get_progress() override; // percent
+    virtual bool worker_safe() override;
+
+    // Starts a background copy, returns false if one is already running or it couldn't be submitted
+    static bool submit(fujiHost *source_host, const std::string &source_path,
+                       fujiHost *dest_host, const std::string &dest_path);
+    // Copies in the caller, returns true on success. poll is called between chunks, if given
+    bool run(void (*poll)() = nullptr);
+
+    static fujiCopyStatus status() { return _status; };
+    static bool busy() { return _status.state == FUJI_COPY_RUNNING; };
+    // Fills buf with FUJI_COPY_STATUS_LEN bytes for the bus
+    static void status_bytes(uint8_t *buf);
+
+protected:
+    virtual int start() override;
+    virtual int step() override;
+    virtual int abort() override;
+
+private:
+    void _finish(bool ok);
+
+    fujiHost *_source_host;
+    fujiHost *_dest_host;
+    std::string _source_path;
+    std::string _dest_path;
+    char _source_fullpath[MAX_PATHLEN];
+    char _dest_fullpath[MAX_PATHLEN];
+    fnFile *_source_file = nullptr;
+    fnFile *_dest_file = nullptr;
+    uint8_t *_buffer = nullptr;
+    size_t _buffer_size = 0;
+    size_t _step_size = 0;
+
+    static fujiCopyStatus _status;
+};
+
+#endif // _FUJI_COPYTASK_
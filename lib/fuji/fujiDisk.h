@@ -17,6 +17,7 @@
 
 #define DISK_ACCESS_MODE_READ    0x01
 #define DISK_ACCESS_MODE_WRITE   0x02
+#define DISK_ACCESS_MODE_PRELOAD 0x04 // Hold the whole image in memory while mounted
 #define DISK_ACCESS_MODE_MOUNTED 0x40
 
 #define INVALID_HOST_SLOT 0xFF
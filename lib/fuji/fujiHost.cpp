@@ -10,6 +10,10 @@
 #include "fnFsSMB.h"
 #include "fnFsFTP.h"
 #include "fnFsHTTP.h"
+#include "fnSystem.h"
+#ifndef FNIO_IS_STDIO
+#include "fnFileGzip.h"
+#endif
 
 #include "utils.h"
 
@@ -25,6 +29,8 @@ void fujiHost::cleanup()
     if (_fs != nullptr)
         _fs->dir_close();
 
+    _clear_listings();
+
     // Delete the filesystem if it's not one of the global ones
     if (_fs->is_global() == false)
         delete _fs;
@@ -97,12 +103,99 @@ void fujiHost::set_prefix(const char *prefix)
     Debug_printf("fujiHost::set_prefix new prefix = \"%s\"\n", _prefix);
 }
 
+/* Returns a cached listing of the path that's still good, or nullptr.
+   Listings are dropped once they're older than HOST_DIRLIST_CACHE_TTL_MS or
+   something has been written, renamed or deleted through our FileSystem.
+*/
+fujiHostDirListing *fujiHost::_find_listing(const char *path, const char *pattern, uint16_t options)
+{
+    uint64_t now = fnSystem.millis();
+    const char *pat = pattern ? pattern : "";
+
+    for (auto it = _dir_listings.begin(); it != _dir_listings.end();)
+    {
+        fujiHostDirListing *listing = *it;
+        if (now - listing->listed_at > HOST_DIRLIST_CACHE_TTL_MS || listing->fs_changes != _fs->changes())
+        {
+            delete listing;
+            it = _dir_listings.erase(it);
+            continue;
+        }
+        if (listing->options == options && listing->path == path && listing->pattern == pat)
+        {
+            // Move it to the front as the most recently used
+            _dir_listings.erase(it);
+            _dir_listings.push_front(listing);
+            return listing;
+        }
+        ++it;
+    }
+    return nullptr;
+}
+
+/* Reads the directory the FileSystem just opened into a new cached listing, closing it
+   on the FileSystem side. Returns false, with the FileSystem's directory rewound and
+   still open, if the listing doesn't fit.
+*/
+bool fujiHost::_cache_listing(const char *path, const char *pattern, uint16_t options)
+{
+    fujiHostDirListing *listing = new fujiHostDirListing;
+    listing->path = path;
+    listing->pattern = pattern ? pattern : "";
+    listing->options = options;
+    listing->fs_changes = _fs->changes();
+
+    fsdir_entry_t *entry;
+    while ((entry = _fs->dir_read()) != nullptr)
+    {
+        if (!listing->entries.add_entry(*entry))
+        {
+            Debug_println("::dir_open listing too large to cache");
+            delete listing;
+            _fs->dir_seek(0);
+            return false;
+        }
+    }
+    _fs->dir_close();
+
+    // The FileSystem has already filtered and sorted it
+    listing->entries.apply_no_filter();
+    listing->listed_at = fnSystem.millis();
+
+    // Keep within our limits, dropping the least recently used
+    size_t total = listing->entries.bytes();
+    for (fujiHostDirListing *l : _dir_listings)
+        total += l->entries.bytes();
+    while (!_dir_listings.empty() &&
+        (_dir_listings.size() >= HOST_DIRLIST_CACHE_MAX || total > DirCache::max_bytes()))
+    {
+        total -= _dir_listings.back()->entries.bytes();
+        delete _dir_listings.back();
+        _dir_listings.pop_back();
+    }
+
+    _dir_listings.push_front(listing);
+    _dir_listing = listing;
+    return true;
+}
+
+void fujiHost::_clear_listings()
+{
+    for (fujiHostDirListing *listing : _dir_listings)
+        delete listing;
+    _dir_listings.clear();
+    _dir_listing = nullptr;
+}
+
 uint16_t fujiHost::dir_tell()
 {
     Debug_printf("::dir_tell {%d:%d}\n", slotid, _type);
     if (_fs == nullptr)
         return FNFS_INVALID_DIRPOS;
 
+    if (_dir_listing != nullptr)
+        return _dir_listing->entries.tell();
+
     uint16_t result = FNFS_INVALID_DIRPOS;
     switch (_type)
     {
@@ -125,6 +218,9 @@ bool fujiHost::dir_seek(uint16_t pos)
     if (_fs == nullptr)
         return false;
 
+    if (_dir_listing != nullptr)
+        return _dir_listing->entries.seek(pos);
+
     bool result = false;
     switch (_type)
     {
@@ -157,14 +253,28 @@ bool fujiHost::dir_open(const char *path, const char *pattern, uint16_t options)
 
     Debug_printf("::dir_open actual path = \"%s\"\n", realpath);
 
+    _dir_listing = nullptr;
+
     int result = false;
     switch (_type)
     {
-    case HOSTTYPE_LOCAL:
     case HOSTTYPE_TNFS:
     case HOSTTYPE_SMB:
     case HOSTTYPE_FTP:
     case HOSTTYPE_HTTP:
+        // Network hosts keep recent listings around
+        _dir_listing = _find_listing(realpath, pattern, options);
+        if (_dir_listing != nullptr)
+        {
+            Debug_println("::dir_open using cached listing");
+            _dir_listing->entries.seek(0);
+            return true;
+        }
+        result = _fs->dir_open(realpath, pattern, options);
+        if (result)
+            _cache_listing(realpath, pattern, options);
+        break;
+    case HOSTTYPE_LOCAL:
         result = _fs->dir_open(realpath, pattern, options);
         break;
     case HOSTTYPE_UNINITIALIZED:
@@ -177,6 +287,9 @@ fsdir_entry_t *fujiHost::dir_nextfile()
 {
     Debug_printf("::dir_nextfile {%d:%d}\n", slotid, _type);
 
+    if (_dir_listing != nullptr)
+        return _dir_listing->entries.read();
+
     switch (_type)
     {
     case HOSTTYPE_LOCAL:
@@ -194,6 +307,13 @@ fsdir_entry_t *fujiHost::dir_nextfile()
 
 void fujiHost::dir_close()
 {
+    // Cached listings stay around for the next dir_open()
+    if (_dir_listing != nullptr)
+    {
+        _dir_listing = nullptr;
+        return;
+    }
+
     if (_type != HOSTTYPE_UNINITIALIZED && _fs != nullptr)
         _fs->dir_close();
 }
@@ -213,6 +333,21 @@ bool fujiHost::file_exists(const char *path)
     return _fs->exists(realpath);
 }
 
+/* Creates path as a contiguous file of size bytes, for a new disk image to be written in place.
+ * Returns true on error, including hosts that can't, false on success
+*/
+bool fujiHost::file_preallocate(const char *path, uint32_t size)
+{
+    if (_type == HOSTTYPE_UNINITIALIZED || _fs == nullptr)
+        return true;
+
+    char realpath[MAX_PATHLEN];
+    if( false == util_concat_paths(realpath, _prefix, path, sizeof(realpath)) )
+        return true;
+
+    return !_fs->preallocate(realpath, size);
+}
+
 long fujiHost::file_size(fnFile *filehandle)
 {
     Debug_print("::get_filesize\n");
@@ -245,6 +380,19 @@ fnFile * fujiHost::fnfile_open(const char *path, char *fullpath, int fullpathlen
     }
     Debug_printf("fujiHost #%d opening file path \"%s\"\n", slotid, fullpath);
 
+#ifndef FNIO_IS_STDIO
+    // A compressed image is read through a handler decompressing it as it's read, and can't be written
+    if (util_is_gzip_name(realpath))
+    {
+        if (strpbrk(mode, "wa+") != nullptr)
+        {
+            Debug_println("fujiHost::fnfile_open - compressed images are read-only");
+            return nullptr;
+        }
+        return FileHandlerGzip::wrap(_fs->fnfile_open(realpath, mode));
+    }
+#endif
+
     return _fs->fnfile_open(fullpath, mode);
 }
 
@@ -1,11 +1,19 @@
 #ifndef _FUJI_HOST_
 #define _FUJI_HOST_
 
+#include <list>
+#include <string>
+
 #include "fnFS.h"
+#include "fnDirCache.h"
 
 #define MAX_HOSTNAME_LEN 32
 #define MAX_HOST_PREFIX_LEN 256
 
+// Recently listed directories kept per host so browsing back into them doesn't hit the server
+#define HOST_DIRLIST_CACHE_MAX 4
+#define HOST_DIRLIST_CACHE_TTL_MS 30000
+
 enum fujiHostType
 {
     HOSTTYPE_UNINITIALIZED = 0,
@@ -16,6 +24,17 @@ enum fujiHostType
     HOSTTYPE_HTTP,
 };
 
+// A directory listing fetched by dir_open() and kept for reuse
+struct fujiHostDirListing
+{
+    std::string path;
+    std::string pattern;
+    uint16_t options;
+    uint32_t fs_changes; // FileSystem::changes() when listed
+    uint64_t listed_at;
+    DirCache entries;
+};
+
 class fujiHost
 {
 private:
@@ -37,6 +56,15 @@ private:
     int unmount_local();
     int unmount_fs();
 
+    // Most recently used first
+    std::list<fujiHostDirListing *> _dir_listings;
+    // Listing being read, when dir_open() was answered from the cache
+    fujiHostDirListing *_dir_listing = nullptr;
+
+    fujiHostDirListing *_find_listing(const char *path, const char *pattern, uint16_t options);
+    bool _cache_listing(const char *path, const char *pattern, uint16_t options);
+    void _clear_listings();
+
 public:
     int slotid = -1;
 
@@ -69,6 +97,7 @@ public:
     }
 #endif
     long file_size(fnFile *filehandle);
+    bool file_preallocate(const char *path, uint32_t size);
 
     bool file_remove(char *fullpath);
 
@@ -0,0 +1,156 @@
+#include "fujiMountAll.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+#include "../../include/debug.h"
+
+// Shared by the caller and the tasks helping it for one fuji_open_slots()
+struct mountall_job
+{
+    fujiDisk *disks;
+    int count;
+    fujiHost *hosts;
+    const char *mode;
+    fujiSlotOpen *opened;
+
+    std::vector<uint8_t> host_slots; // Each distinct host in use, in order of first use
+    std::atomic<size_t> next{0};     // Next of them for someone to take
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int running = 0; // Helper tasks not done yet
+};
+
+// Mounts one host and opens the images of the slots using it
+static void _open_host_slots(mountall_job &job, uint8_t host_slot)
+{
+    fujiHost &host = job.hosts[host_slot];
+    bool host_ok = host.mount();
+
+    for (int i = 0; i < job.count; i++)
+    {
+        fujiDisk &disk = job.disks[i];
+        fujiSlotOpen &slot = job.opened[i];
+        if (!slot.wanted || disk.host_slot != host_slot)
+            continue;
+
+        slot.host_ok = host_ok;
+        if (!host_ok)
+            continue;
+
+        char flag[4];
+        snprintf(flag, sizeof(flag), "%s%s", job.mode, (disk.access_mode & DISK_ACCESS_MODE_WRITE) ? "+" : "");
+
+        Debug_printf("Selecting '%s' from host #%u as %s on D%u:\n", disk.filename, disk.host_slot, flag, i + 1);
+
+        slot.fileh = host.fnfile_open(disk.filename, disk.filename, sizeof(disk.filename), flag);
+        // We need the file size for loading XEX files and for CASSETTE, so get that too
+        if (slot.fileh != nullptr)
+            slot.size = host.file_size(slot.fileh);
+    }
+}
+
+static void _work(mountall_job &job)
+{
+    size_t n;
+    while ((n = job.next++) < job.host_slots.size())
+        _open_host_slots(job, job.host_slots[n]);
+}
+
+static void _helper(void *param)
+{
+    mountall_job &job = *(mountall_job *)param;
+    _work(job);
+
+    std::lock_guard<std::mutex> lock(job.mutex);
+    job.running--;
+    job.cv.notify_all();
+}
+
+#ifdef ESP_PLATFORM
+static void _helper_task(void *param)
+{
+    _helper(param);
+    vTaskDelete(nullptr);
+}
+#endif
+
+void fuji_open_slots(fujiDisk *disks, int count, fujiHost *hosts, const char *mode, fujiSlotOpen *opened)
+{
+    mountall_job job;
+    job.disks = disks;
+    job.count = count;
+    job.hosts = hosts;
+    job.mode = mode;
+    job.opened = opened;
+
+    for (int i = 0; i < count; i++)
+    {
+        opened[i] = fujiSlotOpen();
+        if (disks[i].host_slot == INVALID_HOST_SLOT || disks[i].filename[0] == '\0')
+            continue;
+        opened[i].wanted = true;
+
+        bool seen = false;
+        for (uint8_t h : job.host_slots)
+            seen |= h == disks[i].host_slot;
+        if (!seen)
+            job.host_slots.push_back(disks[i].host_slot);
+    }
+
+    // The caller takes a host too, so one host needs no help
+    int helpers = (int)job.host_slots.size() - 1;
+#ifdef ESP_PLATFORM
+    if (helpers > MOUNTALL_TASKS)
+        helpers = MOUNTALL_TASKS;
+#endif
+    for (int i = 0; i < helpers; i++)
+    {
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.running++;
+        }
+#ifdef ESP_PLATFORM
+        if (xTaskCreatePinnedToCore(_helper_task, "mountall", MOUNTALL_TASK_STACKSIZE, &job,
+                                    MOUNTALL_TASK_PRIORITY, nullptr, 0) != pdPASS)
+        {
+            // Whatever it would have taken is left for the rest of us
+            Debug_println("fuji_open_slots - couldn't start a helper task");
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.running--;
+            break;
+        }
+#else
+        std::thread(_helper, &job).detach();
+#endif
+    }
+
+    _work(job);
+
+    // job lives on our stack, so nobody may still be using it when we return
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.cv.wait(lock, [&job] { return job.running == 0; });
+}
+
+void fuji_close_slots(fujiSlotOpen *opened, int from, int count)
+{
+    for (int i = from; i < count; i++)
+    {
+        if (opened[i].fileh != nullptr)
+        {
+            fnio::fclose(opened[i].fileh);
+            opened[i].fileh = nullptr;
+        }
+    }
+}
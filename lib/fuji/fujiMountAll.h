@@ -0,0 +1,41 @@
+#ifndef _FUJI_MOUNTALL_
+#define _FUJI_MOUNTALL_
+
+#include "fujiDisk.h"
+
+#ifdef ESP_PLATFORM
+// Each one mounts a host and opens its images, which for TNFS, SMB or HTTP is a DNS lookup and a
+// few round trips. The calling task does its share, so this is how many more run alongside it
+#define MOUNTALL_TASKS 3
+#define MOUNTALL_TASK_STACKSIZE 8192
+#define MOUNTALL_TASK_PRIORITY 5
+#endif
+
+// What fuji_open_slots() did for one disk slot
+struct fujiSlotOpen
+{
+    bool wanted = false;  // The slot has an image to open
+    bool host_ok = false; // Its host mounted
+    fnFile *fileh = nullptr;
+    long size = 0;
+};
+
+/*
+ * Mounts the hosts of every disk slot that has an image and opens the
+ * images, ahead of mount_all() mounting them in slot order. Each distinct
+ * host is mounted on its own task and opens its slots' images as soon as
+ * it's up, so a boot with drives on several servers waits for the slowest
+ * rather than for all of them one after another. Slots on the same host
+ * are opened in turn, the host would take them one at a time anyway.
+ *
+ * Images are opened with mode ("rb" or "r"), plus '+' for slots mounted
+ * for writing. Returns once every slot is done; the caller owns what was
+ * opened in opened[] and hands back anything it doesn't use with
+ * fuji_close_slots().
+ */
+void fuji_open_slots(fujiDisk *disks, int count, fujiHost *hosts, const char *mode, fujiSlotOpen *opened);
+
+// Closes the images fuji_open_slots() opened for slots from to count - 1
+void fuji_close_slots(fujiSlotOpen *opened, int from, int count);
+
+#endif // _FUJI_MOUNTALL_
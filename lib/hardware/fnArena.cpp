@@ -0,0 +1,290 @@
+#include "fnArena.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#include <esp_memory_utils.h>
+
+#define ARENA_CAPS_PSRAM (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#define ARENA_CAPS_INTERNAL (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#else
+// No way to ask the C library for a block's size everywhere, so keep it in front of the block
+#define ARENA_HEADER_SIZE sizeof(max_align_t)
+#endif
+
+#include "fnSystem.h"
+
+ArenaManager fnArena;
+
+ArenaManager::ArenaManager()
+{
+    _arenas[ARENA_NETWORK] = {"network", true, ARENA_NETWORK_BUDGET};
+    _arenas[ARENA_MEDIA] = {"media", true, ARENA_MEDIA_BUDGET};
+    _arenas[ARENA_JSON] = {"json", true, ARENA_JSON_BUDGET};
+    _arenas[ARENA_PRINTER] = {"printer", true, ARENA_PRINTER_BUDGET};
+}
+
+// Budgets only make sense with PSRAM to send the rest to. Looked up once, as
+// asking the heap walks all of it
+bool ArenaManager::_limited()
+{
+    if (_psram < 0)
+        _psram = fnSystem.get_psram_size() > 0 ? 1 : 0;
+    return _psram == 1;
+}
+
+// Size of a block from the arena, and whether it is in internal RAM
+static size_t _block_size(void *ptr, bool *internal)
+{
+#ifdef ESP_PLATFORM
+    *internal = esp_ptr_internal(ptr);
+    return heap_caps_get_allocated_size(ptr);
+#else
+    *internal = true;
+    return *(size_t *)((uint8_t *)ptr - ARENA_HEADER_SIZE);
+#endif
+}
+
+void ArenaManager::_account(arena_id arena, size_t size, bool internal, bool add)
+{
+    arena_stats &a = _arenas[arena];
+    if (add)
+    {
+        a.used += size;
+        if (internal)
+            a.internal += size;
+        if (a.used > a.peak)
+            a.peak = a.used;
+    }
+    else
+    {
+        // Clamped in case a block from before the arena existed is returned to it
+        a.used -= std::min(size, a.used);
+        if (internal)
+            a.internal -= std::min(size, a.internal);
+    }
+}
+
+// Whether size more bytes fit the arena's budget, and whether they may go to internal RAM.
+// Counts a failure if not even the budget has room. Called with the mutex held
+bool ArenaManager::_admit(arena_id arena, size_t size, bool *internal_ok)
+{
+    arena_stats &a = _arenas[arena];
+    *internal_ok = true;
+    if (!_limited())
+        return true;
+    if (a.budget != 0 && a.used + size > a.budget)
+    {
+        a.failures++;
+        return false;
+    }
+    if (a.prefer_psram)
+        *internal_ok = a.internal + size <= ARENA_INTERNAL_LIMIT;
+    return true;
+}
+
+void *ArenaManager::_alloc(arena_id arena, size_t size, bool zero, bool psram_only)
+{
+    if (size == 0)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    bool internal_ok;
+    if (!_admit(arena, size, &internal_ok))
+        return nullptr;
+
+    arena_stats &a = _arenas[arena];
+    void *ptr = nullptr;
+#ifdef ESP_PLATFORM
+    if (!_limited())
+    {
+        if (!psram_only)
+            ptr = zero ? ::calloc(1, size) : ::malloc(size);
+    }
+    else if (psram_only)
+        ptr = zero ? heap_caps_calloc(1, size, ARENA_CAPS_PSRAM) : heap_caps_malloc(size, ARENA_CAPS_PSRAM);
+    else
+    {
+        uint32_t first = a.prefer_psram ? ARENA_CAPS_PSRAM : ARENA_CAPS_INTERNAL;
+        uint32_t second = a.prefer_psram ? ARENA_CAPS_INTERNAL : ARENA_CAPS_PSRAM;
+        ptr = zero ? heap_caps_calloc(1, size, first) : heap_caps_malloc(size, first);
+        if (ptr == nullptr && (internal_ok || !a.prefer_psram))
+        {
+            ptr = zero ? heap_caps_calloc(1, size, second) : heap_caps_malloc(size, second);
+            if (ptr != nullptr)
+                a.fallbacks++;
+        }
+    }
+#else
+    (void)internal_ok;
+    (void)psram_only;
+    uint8_t *base = (uint8_t *)(zero ? ::calloc(1, size + ARENA_HEADER_SIZE) : ::malloc(size + ARENA_HEADER_SIZE));
+    if (base != nullptr)
+    {
+        *(size_t *)base = size;
+        ptr = base + ARENA_HEADER_SIZE;
+    }
+#endif
+    if (ptr == nullptr)
+    {
+        a.failures++;
+        return nullptr;
+    }
+
+    bool internal;
+    _account(arena, _block_size(ptr, &internal), internal, true);
+    a.allocs++;
+    return ptr;
+}
+
+void *ArenaManager::malloc(arena_id arena, size_t size)
+{
+    return _alloc(arena, size, false);
+}
+
+void *ArenaManager::malloc_psram(arena_id arena, size_t size)
+{
+    return _alloc(arena, size, false, true);
+}
+
+void *ArenaManager::calloc(arena_id arena, size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+        return nullptr;
+    return _alloc(arena, count * size, true);
+}
+
+void *ArenaManager::realloc(arena_id arena, void *ptr, size_t size)
+{
+    if (ptr == nullptr)
+        return malloc(arena, size);
+    if (size == 0)
+    {
+        free(arena, ptr);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    bool old_internal;
+    size_t old_size = _block_size(ptr, &old_internal);
+    bool internal_ok = true;
+    if (size > old_size && !_admit(arena, size - old_size, &internal_ok))
+        return nullptr;
+
+    arena_stats &a = _arenas[arena];
+    void *grown = nullptr;
+#ifdef ESP_PLATFORM
+    if (!_limited())
+        grown = ::realloc(ptr, size);
+    else
+    {
+        uint32_t first = a.prefer_psram ? ARENA_CAPS_PSRAM : ARENA_CAPS_INTERNAL;
+        uint32_t second = a.prefer_psram ? ARENA_CAPS_INTERNAL : ARENA_CAPS_PSRAM;
+        grown = heap_caps_realloc(ptr, size, first);
+        if (grown == nullptr && (internal_ok || !a.prefer_psram))
+        {
+            grown = heap_caps_realloc(ptr, size, second);
+            if (grown != nullptr)
+                a.fallbacks++;
+        }
+    }
+#else
+    uint8_t *base = (uint8_t *)::realloc((uint8_t *)ptr - ARENA_HEADER_SIZE, size + ARENA_HEADER_SIZE);
+    if (base != nullptr)
+    {
+        *(size_t *)base = size;
+        grown = base + ARENA_HEADER_SIZE;
+    }
+#endif
+    if (grown == nullptr)
+    {
+        a.failures++;
+        return nullptr;
+    }
+
+    bool internal;
+    _account(arena, old_size, old_internal, false);
+    _account(arena, _block_size(grown, &internal), internal, true);
+    return grown;
+}
+
+void ArenaManager::free(arena_id arena, void *ptr)
+{
+    if (ptr == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    bool internal;
+    _account(arena, _block_size(ptr, &internal), internal, false);
+#ifdef ESP_PLATFORM
+    ::free(ptr);
+#else
+    ::free((uint8_t *)ptr - ARENA_HEADER_SIZE);
+#endif
+}
+
+size_t ArenaManager::largest_free_internal()
+{
+#ifdef ESP_PLATFORM
+    return heap_caps_get_largest_free_block(ARENA_CAPS_INTERNAL);
+#else
+    return 0;
+#endif
+}
+
+size_t ArenaManager::largest_free_psram()
+{
+#ifdef ESP_PLATFORM
+    return heap_caps_get_largest_free_block(ARENA_CAPS_PSRAM);
+#else
+    return 0;
+#endif
+}
+
+std::string ArenaManager::to_json()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    bool limited = _limited();
+
+    std::ostringstream out;
+    out << "{";
+    for (int i = 0; i < ARENA_COUNT; i++)
+    {
+        const arena_stats &a = _arenas[i];
+        out << "\"" << a.name << "\":{\"prefer\":\"" << (a.prefer_psram ? "psram" : "internal")
+            << "\",\"budget\":" << (limited ? a.budget : 0) << ",\"used\":" << a.used
+            << ",\"peak\":" << a.peak << ",\"internal\":" << a.internal << ",\"allocs\":" << a.allocs
+            << ",\"fallbacks\":" << a.fallbacks << ",\"failures\":" << a.failures << "},";
+    }
+    out << "\"largest_internal\":" << largest_free_internal()
+        << ",\"largest_psram\":" << largest_free_psram() << "}";
+
+    return out.str();
+}
+
+void ArenaManager::print()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    bool limited = _limited();
+
+    printf("arena    prefer      used    peak  budget internal  allocs fallbk  fails\r\n");
+    for (int i = 0; i < ARENA_COUNT; i++)
+    {
+        const arena_stats &a = _arenas[i];
+        printf("  %-7s %-8s %7u %7u ", a.name, a.prefer_psram ? "psram" : "internal",
+               (unsigned)a.used, (unsigned)a.peak);
+        if (limited && a.budget != 0)
+            printf("%7u ", (unsigned)a.budget);
+        else
+            printf("   none ");
+        printf("%8u %7lu %6lu %6lu\r\n", (unsigned)a.internal, (unsigned long)a.allocs,
+               (unsigned long)a.fallbacks, (unsigned long)a.failures);
+    }
+    printf("largest free block: internal %u, psram %u\r\n",
+           (unsigned)largest_free_internal(), (unsigned)largest_free_psram());
+}
@@ -0,0 +1,94 @@
+#ifndef FNARENA_H
+#define FNARENA_H
+
+/*
+ * Named allocation arenas for the big, long lived buffers: network receive
+ * buffers, media caches, parsed JSON and printer output. Each arena prefers
+ * PSRAM or internal RAM and has a budget, so one subsystem filling up
+ * can't starve the others, and the internal RAM that WiFi and TLS need
+ * isn't used up while PSRAM sits empty.
+ *
+ * Memory from an arena is returned to the same arena with free(). Usage,
+ * peak, fallbacks to the other kind of RAM and refusals are counted per
+ * arena; the console shows them with "perf arenas" and /stats serves them
+ * as JSON along with the largest free block of each kind of RAM.
+ *
+ * Budgets and the internal RAM limit only apply on boards with PSRAM.
+ * Without it every arena allocates from the one heap as before and only
+ * the accounting is added.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+
+enum arena_id
+{
+    ARENA_NETWORK = 0,
+    ARENA_MEDIA,
+    ARENA_JSON,
+    ARENA_PRINTER,
+    ARENA_COUNT
+};
+
+// Total budget of each arena on boards with PSRAM, 0 for no limit
+#define ARENA_NETWORK_BUDGET (1024 * 1024)
+#define ARENA_MEDIA_BUDGET (2048 * 1024)
+#define ARENA_JSON_BUDGET (512 * 1024)
+#define ARENA_PRINTER_BUDGET (1280 * 1024)
+
+// How much of a PSRAM preferring arena may land in internal RAM once PSRAM is full
+#define ARENA_INTERNAL_LIMIT (32 * 1024)
+
+struct arena_stats
+{
+    const char *name;
+    bool prefer_psram;
+    size_t budget;
+    size_t used = 0;
+    size_t peak = 0;
+    size_t internal = 0;
+    uint32_t allocs = 0;
+    uint32_t fallbacks = 0;
+    uint32_t failures = 0;
+};
+
+class ArenaManager
+{
+private:
+    arena_stats _arenas[ARENA_COUNT];
+    std::mutex _mutex;
+    int8_t _psram = -1;
+
+    bool _limited();
+    bool _admit(arena_id arena, size_t size, bool *internal_ok);
+    void *_alloc(arena_id arena, size_t size, bool zero, bool psram_only = false);
+    void _account(arena_id arena, size_t size, bool internal, bool add);
+
+public:
+    ArenaManager();
+
+    void *malloc(arena_id arena, size_t size);
+    void *calloc(arena_id arena, size_t count, size_t size);
+    // Only ever from PSRAM, so nullptr on boards without it; for what must not take internal RAM
+    void *malloc_psram(arena_id arena, size_t size);
+    // Grows or shrinks in place where it can, staying within the arena's budget
+    void *realloc(arena_id arena, void *ptr, size_t size);
+    void free(arena_id arena, void *ptr);
+
+    const arena_stats &stats(arena_id arena) const { return _arenas[arena]; }
+
+    // Largest single block that could still be allocated
+    static size_t largest_free_internal();
+    static size_t largest_free_psram();
+
+    // {"network":{...},...,"largest_internal":n,"largest_psram":n}
+    std::string to_json();
+    // The same numbers as a table on stdout, for the console
+    void print();
+};
+
+extern ArenaManager fnArena;
+
+#endif // FNARENA_H
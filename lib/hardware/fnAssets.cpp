@@ -0,0 +1,93 @@
+#include "fnAssets.h"
+
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_partition.h>
+#endif
+
+#include "../../include/debug.h"
+
+AssetPartition fnAssets;
+
+// Maps the partition once, on first use. Without it, or with anything but a sound index, there are no assets
+void AssetPartition::_map()
+{
+#ifdef ESP_PLATFORM
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+        (esp_partition_subtype_t)ASSETS_PARTITION_SUBTYPE, ASSETS_PARTITION_LABEL);
+    if (part == nullptr)
+        return;
+
+    const void *ptr;
+    esp_partition_mmap_handle_t handle;
+    if (esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &ptr, &handle) != ESP_OK)
+    {
+        Debug_println("Assets partition couldn't be mapped");
+        return;
+    }
+
+    const asset_header *header = (const asset_header *)ptr;
+    size_t index_end = sizeof(asset_header) + (size_t)header->count * sizeof(asset_entry);
+    if (header->magic != ASSETS_MAGIC || header->version != ASSETS_VERSION || index_end > part->size)
+    {
+        Debug_println("Assets partition holds no asset image");
+        esp_partition_munmap(handle);
+        return;
+    }
+
+    _base = (const uint8_t *)ptr;
+    _size = part->size;
+    _index = (const asset_entry *)(_base + sizeof(asset_header));
+    _count = header->count;
+    Debug_printf("Assets partition mapped, %u assets\r\n", (unsigned)_count);
+#endif
+}
+
+const uint8_t *AssetPartition::find(const char *name, size_t *size)
+{
+    std::call_once(_mapped, [this]() { _map(); });
+    if (_index == nullptr)
+        return nullptr;
+
+    // Names are stored without the leading '/'
+    while (*name == '/')
+        name++;
+
+    uint32_t lo = 0, hi = _count;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = strncmp(name, _index[mid].name, ASSETS_NAME_LEN);
+        if (cmp == 0)
+        {
+            const asset_entry &e = _index[mid];
+            if (e.offset > _size || e.size > _size - e.offset)
+                return nullptr;
+            if (size != nullptr)
+                *size = e.size;
+            return _base + e.offset;
+        }
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return nullptr;
+}
+
+uint32_t AssetPartition::count()
+{
+    std::call_once(_mapped, [this]() { _map(); });
+    return _count;
+}
+
+FILE *AssetPartition::open(const char *name)
+{
+    size_t size;
+    const uint8_t *data = find(name, &size);
+    if (data == nullptr || size == 0)
+        return nullptr;
+    // A stream straight over the mapping; "r" never writes to the buffer
+    return fmemopen((void *)data, size, "r");
+}
@@ -0,0 +1,74 @@
+#ifndef FNASSETS_H
+#define FNASSETS_H
+
+/*
+ * Read-only files the firmware ships with (web UI pages, printer fonts,
+ * boot images) kept in their own flash partition and mapped into the
+ * address space, so reading one is reading memory: no VFS, no file
+ * handle, no copy.
+ *
+ * The partition is built by tools/pack_assets/pack_assets.py from a
+ * directory laid out like the flash filesystem, and starts with an index
+ * of names sorted for a binary search. find() hands back a pointer into
+ * the mapping; open() wraps it in a read-only memory stream for code that
+ * wants a FILE. Both come back empty when the board has no asset partition
+ * or it holds no valid image.
+ *
+ * The flash filesystem only falls back to an asset when it has no file of
+ * that name itself, so a newer copy from uploadfs, a web upload or a write
+ * at runtime always wins over the one in the partition.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+
+#define ASSETS_PARTITION_LABEL "assets"
+#define ASSETS_PARTITION_SUBTYPE 0x40
+
+#define ASSETS_MAGIC 0x53414E46 // "FNAS"
+#define ASSETS_VERSION 1
+#define ASSETS_NAME_LEN 56
+
+struct asset_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+// Offsets are from the start of the partition
+struct asset_entry
+{
+    char name[ASSETS_NAME_LEN];
+    uint32_t offset;
+    uint32_t size;
+};
+
+class AssetPartition
+{
+private:
+    std::once_flag _mapped;
+    const uint8_t *_base = nullptr;
+    size_t _size = 0;
+    const asset_entry *_index = nullptr;
+    uint32_t _count = 0;
+
+    void _map();
+
+public:
+    // Start of the named asset (a path from the root, as on the flash filesystem) and its size,
+    // or nullptr. The memory stays valid for as long as the firmware runs
+    const uint8_t *find(const char *name, size_t *size);
+
+    // The asset as a read-only FILE for fread/fgets and friends, or nullptr
+    FILE *open(const char *name);
+
+    uint32_t count();
+};
+
+extern AssetPartition fnAssets;
+
+#endif // FNASSETS_H
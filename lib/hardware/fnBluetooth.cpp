@@ -43,6 +43,14 @@ void BluetoothManager::start()
 void BluetoothManager::stop()
 {
     Debug_println("Stopping SIO2BT");
+#ifdef DEBUG
+    const fnBluetoothSPPStats &st = btSpp.stats();
+    Debug_printf("SIO2BT TX %llu bytes in %lu writes, latency avg %lluus max %luus, %lu congested\r\n",
+        (unsigned long long)st.tx_bytes, (unsigned long)st.tx_writes,
+        st.tx_writes ? (unsigned long long)(st.tx_latency_total_us / st.tx_writes) : 0ULL,
+        (unsigned long)st.tx_latency_max_us, (unsigned long)st.congestion_events);
+    Debug_printf("SIO2BT RX %llu bytes, %lu dropped\r\n", (unsigned long long)st.rx_bytes, (unsigned long)st.rx_dropped);
+#endif
     _mActive = false;
 #ifdef BUILD_ATARI
     SIO.setBaudrate(BT_STANDARD_BAUDRATE);
@@ -63,15 +71,23 @@ eBTBaudrate BluetoothManager::toggleBaudrate()
     return _mBTBaudrate;
 }
 
+// Moves everything waiting in each direction, not a byte per pass of the main loop
 void BluetoothManager::service()
 {
-    if (fnUartBUS.available() > 0)
+    uint8_t buf[BT_SERVICE_CHUNK];
+
+    int avail = fnUartBUS.available();
+    if (avail > 0)
     {
-        btSpp.write(fnUartBUS.read());
+        size_t len = fnUartBUS.readBytes(buf, avail < (int)sizeof(buf) ? avail : sizeof(buf));
+        if (len > 0)
+            btSpp.write(buf, len);
     }
-    if (btSpp.available())
+
+    size_t len = btSpp.read(buf, sizeof(buf));
+    if (len > 0)
     {
-        fnUartBUS.write(btSpp.read());
+        fnUartBUS.write(buf, len);
     }
 }
 
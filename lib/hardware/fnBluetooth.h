@@ -1,6 +1,9 @@
 #ifndef BLUETOOTH_H
 #define BLUETOOTH_H
 
+// Bytes moved per direction on each service() pass
+#define BT_SERVICE_CHUNK 256
+
 enum eBTBaudrate
 {
     BT_STANDARD_BAUDRATE = 19200,
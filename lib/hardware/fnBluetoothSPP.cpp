@@ -8,6 +8,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/stream_buffer.h"
 
 #include <esp_log.h>
 
@@ -23,8 +24,13 @@
 
 const char *_spp_server_name = "ESP32SPP";
 
-#define RX_QUEUE_SIZE 512
-#define TX_QUEUE_SIZE 32
+// Both directions are byte streams, so a sector moves as one copy rather
+// than one queue item per byte (RX) or one malloc per write (TX)
+#define RX_BUFFER_SIZE 4096
+#define TX_BUFFER_SIZE 4096
+
+#define SPP_TX_TASK_STACKSIZE 4096
+#define SPP_TX_TASK_PRIORITY 10
 
 #define INQ_LEN 0x10
 #define INQ_NUM_RSPS 20
@@ -37,8 +43,9 @@ const char *_spp_server_name = "ESP32SPP";
 #define SPP_DISCONNECTED 0x08
 
 static uint32_t _spp_client = 0;
-static QueueHandle_t _spp_rx_queue = nullptr;
-static QueueHandle_t _spp_tx_queue = nullptr;
+static StreamBufferHandle_t _spp_rx_stream = nullptr;
+static StreamBufferHandle_t _spp_tx_stream = nullptr;
+static int _spp_rx_peeked = -1;
 static SemaphoreHandle_t _spp_tx_done = nullptr;
 static TaskHandle_t _spp_task_handle = nullptr;
 static EventGroupHandle_t _spp_event_group = nullptr;
@@ -46,9 +53,16 @@ static bool secondConnectionAttempt;
 static esp_spp_cb_t *custom_spp_callback = nullptr;
 static fnBluetoothDataCb custom_data_callback = nullptr;
 
-const uint16_t SPP_TX_MAX = 330;
+// Largest single esp_spp_write(); the batch size defaults to what has always
+// worked with Android SIO2BT apps and can be raised up to this
+const uint16_t SPP_TX_MAX = 990;
+const uint16_t SPP_TX_DEFAULT = 330;
 static uint8_t _spp_tx_buffer[SPP_TX_MAX];
 static uint16_t _spp_tx_buffer_len = 0;
+static uint16_t _spp_tx_batch = SPP_TX_DEFAULT;
+static volatile bool _spp_tx_busy = false;
+
+static fnBluetoothSPPStats _spp_stats;
 
 static esp_bd_addr_t _peer_bd_addr;
 static char _remote_name[ESP_BT_GAP_MAX_BDNAME_LEN + 1];
@@ -60,12 +74,6 @@ static bool _isPinSet;
 static bool _enableSSP;
 
 
-typedef struct
-{
-    size_t len;
-    uint8_t data[];
-} spp_packet_t;
-
 
 bool _btStarted()
 {
@@ -217,45 +225,20 @@ static bool _btSetPin()
     return false;
 }
 
-static esp_err_t _spp_queue_packet(uint8_t *data, size_t len)
-{
-    if (data == nullptr || len == 0)
-        return ESP_OK;
-
-    // OMF This memory seems to get freed in _spp_tx_task(), but it's not clear
-    // how this happens since the xQueueSend function works by making a copy
-    // of the data, not using a reference.
-    spp_packet_t *packet = (spp_packet_t *)malloc(sizeof(spp_packet_t) + len);
-    if (!packet)
-    {
-        Debug_println( "SPP TX packet malloc failed");
-        return ESP_FAIL;
-    }
-
-    packet->len = len;
-    memcpy(packet->data, data, len);
-    if (xQueueSend(_spp_tx_queue, &packet, portMAX_DELAY) != pdPASS)
-    {
-        Debug_println( "SPP TX queue send failed");
-        free(packet);
-        return ESP_FAIL;
-    }
-
-    return ESP_OK;
-}
-
-
 static bool _spp_send_buffer()
 {
     if ((xEventGroupWaitBits(_spp_event_group, SPP_CONGESTED, pdFALSE, pdTRUE, portMAX_DELAY) & SPP_CONGESTED) != 0)
     {
+        uint32_t start = fnSystem.micros();
         esp_err_t e = esp_spp_write(_spp_client, _spp_tx_buffer_len, _spp_tx_buffer);
         if (e != ESP_OK)
         {
             Debug_printf( "SPP write failed (%d): %s\r\n", e, esp_err_to_name(e));
+            _spp_tx_buffer_len = 0;
             return false;
         }
 
+        uint16_t len = _spp_tx_buffer_len;
         _spp_tx_buffer_len = 0;
         if (xSemaphoreTake(_spp_tx_done, portMAX_DELAY) != pdTRUE)
         {
@@ -263,69 +246,36 @@ static bool _spp_send_buffer()
             return false;
         }
 
+        uint32_t latency = (uint32_t)fnSystem.micros() - start;
+        _spp_stats.tx_bytes += len;
+        _spp_stats.tx_writes++;
+        _spp_stats.tx_latency_total_us += latency;
+        if (latency > _spp_stats.tx_latency_max_us)
+            _spp_stats.tx_latency_max_us = latency;
         return true;
     }
 
     return false;
 }
 
+// Sends whatever has been written, up to a batch at a time. While one write
+// is waiting on the stack, more data collects in the stream so the next write
+// goes out fuller; nothing is held back waiting for a batch to fill.
 static void _spp_tx_task(void *arg)
 {
-    spp_packet_t *packet = nullptr;
-    size_t len = 0, to_send = 0;
-    uint8_t *data = nullptr;
-
     while(true)
     {
-        if (_spp_tx_queue != nullptr && 
-            xQueueReceive(_spp_tx_queue, &packet, portMAX_DELAY) == pdTRUE &&
-             packet != nullptr)
-        {
-            if (packet->len <= (SPP_TX_MAX - _spp_tx_buffer_len))
-            {
-                memcpy(_spp_tx_buffer + _spp_tx_buffer_len, packet->data, packet->len);
-                _spp_tx_buffer_len += packet->len;
-                free(packet);
-                packet = nullptr;
-                if (SPP_TX_MAX == _spp_tx_buffer_len || uxQueueMessagesWaiting(_spp_tx_queue) == 0)
-                    _spp_send_buffer();
-            }
-            else
-            {
-                len = packet->len;
-                data = packet->data;
-                to_send = SPP_TX_MAX - _spp_tx_buffer_len;
-                memcpy(_spp_tx_buffer + _spp_tx_buffer_len, data, to_send);
-                _spp_tx_buffer_len = SPP_TX_MAX;
-                data += to_send;
-                len -= to_send;
-                _spp_send_buffer();
-
-                while (len >= SPP_TX_MAX)
-                {
-                    memcpy(_spp_tx_buffer, data, SPP_TX_MAX);
-                    _spp_tx_buffer_len = SPP_TX_MAX;
-                    data += SPP_TX_MAX;
-                    len -= SPP_TX_MAX;
-                    _spp_send_buffer();
-                }
+        size_t len = xStreamBufferReceive(_spp_tx_stream, _spp_tx_buffer, _spp_tx_batch, portMAX_DELAY);
+        if (len == 0)
+            continue;
 
-                if (len)
-                {
-                    memcpy(_spp_tx_buffer, data, len);
-                    _spp_tx_buffer_len += len;
-                    if (uxQueueMessagesWaiting(_spp_tx_queue) == 0)
-                        _spp_send_buffer();
-                }
-
-                free(packet);
-                packet = nullptr;
-            }
-        }
+        _spp_tx_busy = true;
+        _spp_tx_buffer_len = len;
+        if (_spp_client != 0)
+            _spp_send_buffer();
         else
-        {
-            Debug_println( "_spp_tx_task quitting");
-        }
+            _spp_tx_buffer_len = 0;
+        _spp_tx_busy = false;
     }
 
     _spp_task_handle = nullptr;
@@ -379,7 +329,10 @@ static void _esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
 
     case ESP_SPP_CONG_EVT: //connection congestion status changed
         if (param->cong.cong)
+        {
+            _spp_stats.congestion_events++;
             xEventGroupClearBits(_spp_event_group, SPP_CONGESTED);
+        }
         else
             xEventGroupSetBits(_spp_event_group, SPP_CONGESTED);
 
@@ -387,31 +340,31 @@ static void _esp_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t *param)
         break;
 
     case ESP_SPP_WRITE_EVT: //write operation completed
+        // No per-write logging, it costs more than the write at HSIO speeds
         if (param->write.cong)
+        {
+            _spp_stats.congestion_events++;
             xEventGroupClearBits(_spp_event_group, SPP_CONGESTED);
+        }
 
         xSemaphoreGive(_spp_tx_done); //we can try to send another packet
-        Debug_printf( "ESP_SPP_WRITE_EVT: %u %s\r\n", param->write.len, param->write.cong ? "CONGESTED" : "FREE");
         break;
 
     case ESP_SPP_DATA_IND_EVT: //connection received data
-        Debug_printf( "ESP_SPP_DATA_IND_EVT len=%d handle=%d\r\n", param->data_ind.len, param->data_ind.handle);
         //esp_log_buffer_hex("",param->data_ind.data,param->data_ind.len); //for low level debug
-        //ets_printf("r:%u\r\n", param->data_ind.len);
 
+        _spp_stats.rx_bytes += param->data_ind.len;
         if (custom_data_callback)
         {
             custom_data_callback(param->data_ind.data, param->data_ind.len);
         }
-        else if (_spp_rx_queue != nullptr)
+        else if (_spp_rx_stream != nullptr)
         {
-            for (int i = 0; i < param->data_ind.len; i++)
+            size_t sent = xStreamBufferSend(_spp_rx_stream, param->data_ind.data, param->data_ind.len, 0);
+            if (sent < param->data_ind.len)
             {
-                if (xQueueSend(_spp_rx_queue, param->data_ind.data + i, (TickType_t)0) != pdTRUE)
-                {
-                    Debug_printf( "RX Full! Discarding %u bytes\r\n", param->data_ind.len - i);
-                    break;
-                }
+                _spp_stats.rx_dropped += param->data_ind.len - sent;
+                Debug_printf( "RX Full! Discarding %u bytes\r\n", param->data_ind.len - sent);
             }
         }
         break;
@@ -592,22 +545,23 @@ static bool _init_bt(const char *deviceName)
         xEventGroupSetBits(_spp_event_group, SPP_DISCONNECTED);
     }
 
-    if (_spp_rx_queue == nullptr)
+    if (_spp_rx_stream == nullptr)
     {
-        _spp_rx_queue = xQueueCreate(RX_QUEUE_SIZE, sizeof(uint8_t)); //initialize the queue
-        if (_spp_rx_queue == nullptr)
+        _spp_rx_stream = xStreamBufferCreate(RX_BUFFER_SIZE, 1);
+        if (_spp_rx_stream == nullptr)
         {
-            Debug_printf( "RX Queue Create Failed");
+            Debug_printf( "RX Buffer Create Failed");
             return false;
         }
+        _spp_rx_peeked = -1;
     }
 
-    if (_spp_tx_queue == nullptr)
+    if (_spp_tx_stream == nullptr)
     {
-        _spp_tx_queue = xQueueCreate(TX_QUEUE_SIZE, sizeof(spp_packet_t *)); //initialize the queue
-        if (_spp_tx_queue == nullptr)
+        _spp_tx_stream = xStreamBufferCreate(TX_BUFFER_SIZE, 1);
+        if (_spp_tx_stream == nullptr)
         {
-            Debug_printf( "TX Queue Create Failed");
+            Debug_printf( "TX Buffer Create Failed");
             return false;
         }
     }
@@ -625,7 +579,7 @@ static bool _init_bt(const char *deviceName)
 
     if (_spp_task_handle == nullptr)
     {
-        xTaskCreatePinnedToCore(_spp_tx_task, "spp_tx", 4096, nullptr, 2, &_spp_task_handle, 0);
+        xTaskCreatePinnedToCore(_spp_tx_task, "spp_tx", SPP_TX_TASK_STACKSIZE, nullptr, SPP_TX_TASK_PRIORITY, &_spp_task_handle, 0);
         if (_spp_task_handle == nullptr)
         {
             Debug_printf( "Network Event Task Start Failed");
@@ -737,21 +691,18 @@ static bool _stop_bt()
         vEventGroupDelete(_spp_event_group);
         _spp_event_group = nullptr;
     }
-    if (_spp_rx_queue)
+    _spp_tx_busy = false;
+    _spp_tx_buffer_len = 0;
+    if (_spp_rx_stream)
     {
-        vQueueDelete(_spp_rx_queue);
-        //ToDo: clear RX queue when in packet mode
-        _spp_rx_queue = nullptr;
+        vStreamBufferDelete(_spp_rx_stream);
+        _spp_rx_stream = nullptr;
     }
-    if (_spp_tx_queue)
+    _spp_rx_peeked = -1;
+    if (_spp_tx_stream)
     {
-        spp_packet_t *packet = nullptr;
-        while (xQueueReceive(_spp_tx_queue, &packet, 0) == pdTRUE)
-        {
-            free(packet);
-        }
-        vQueueDelete(_spp_tx_queue);
-        _spp_tx_queue = nullptr;
+        vStreamBufferDelete(_spp_tx_stream);
+        _spp_tx_stream = nullptr;
     }
     if (_spp_tx_done)
     {
@@ -799,6 +750,8 @@ bool fnBluetoothSPP::begin(string localName, bool isServer)
     if (localName.length())
         local_name = localName;
 
+    resetStats();
+
     return _init_bt(local_name.c_str());
 }
 
@@ -809,39 +762,48 @@ bool fnBluetoothSPP::hasClient(void)
 
 int fnBluetoothSPP::available(void)
 {
-    if (_spp_rx_queue == nullptr)
+    if (_spp_rx_stream == nullptr)
     {
         return 0;
     }
-    return uxQueueMessagesWaiting(_spp_rx_queue);
+    return xStreamBufferBytesAvailable(_spp_rx_stream) + (_spp_rx_peeked >= 0 ? 1 : 0);
 }
 
 int fnBluetoothSPP::peek(void)
 {
-    uint8_t c;
-    if (_spp_rx_queue && xQueuePeek(_spp_rx_queue, &c, 0))
-        return c;
-        
-    return -1;
+    if (_spp_rx_peeked < 0)
+        _spp_rx_peeked = read();
+
+    return _spp_rx_peeked;
 }
 
 int fnBluetoothSPP::read(void)
 {
-
     uint8_t c = 0;
-    if (_spp_rx_queue && xQueueReceive(_spp_rx_queue, &c, 0))
-        return c;
-
-    return -1;
+    return read(&c, 1) == 1 ? c : -1;
 }
 
+size_t fnBluetoothSPP::read(uint8_t *buffer, size_t size)
+{
+    if (_spp_rx_stream == nullptr || size == 0)
+        return 0;
 
+    size_t count = 0;
+    if (_spp_rx_peeked >= 0)
+    {
+        buffer[count++] = _spp_rx_peeked;
+        _spp_rx_peeked = -1;
+    }
+    return count + xStreamBufferReceive(_spp_rx_stream, buffer + count, size - count, 0);
+}
+
+// Blocks while the TX buffer is full, which is how congestion reaches the writer
 size_t fnBluetoothSPP::write(const uint8_t *buffer, size_t size)
 {
-    if (_spp_client == 0)
+    if (_spp_client == 0 || _spp_tx_stream == nullptr)
         return 0;
 
-    return (_spp_queue_packet((uint8_t *)buffer, size) == ESP_OK) ? size : 0;
+    return xStreamBufferSend(_spp_tx_stream, buffer, size, portMAX_DELAY);
 }
 
 size_t fnBluetoothSPP::write(uint8_t c)
@@ -851,13 +813,35 @@ size_t fnBluetoothSPP::write(uint8_t c)
 
 void fnBluetoothSPP::flush()
 {
-    if (_spp_tx_queue != nullptr)
+    if (_spp_tx_stream != nullptr)
     {
-        while (uxQueueMessagesWaiting(_spp_tx_queue) > 0)
+        while (!xStreamBufferIsEmpty(_spp_tx_stream) || _spp_tx_busy)
             fnSystem.delay(5);
     }
 }
 
+void fnBluetoothSPP::setMTU(uint16_t size)
+{
+    if (size == 0)
+        size = SPP_TX_DEFAULT;
+    _spp_tx_batch = size > SPP_TX_MAX ? SPP_TX_MAX : size;
+}
+
+uint16_t fnBluetoothSPP::getMTU()
+{
+    return _spp_tx_batch;
+}
+
+const fnBluetoothSPPStats &fnBluetoothSPP::stats()
+{
+    return _spp_stats;
+}
+
+void fnBluetoothSPP::resetStats()
+{
+    _spp_stats = fnBluetoothSPPStats();
+}
+
 void fnBluetoothSPP::end()
 {
     _stop_bt();
@@ -26,6 +26,18 @@ using namespace std;
 
 typedef function<void(const uint8_t *buffer, size_t size)> fnBluetoothDataCb;
 
+// Running totals since begin() or resetStats()
+struct fnBluetoothSPPStats
+{
+    uint64_t tx_bytes = 0;
+    uint32_t tx_writes = 0;         // esp_spp_write() calls, tx_bytes / tx_writes is the batch fill
+    uint64_t tx_latency_total_us = 0; // write to ESP_SPP_WRITE_EVT, summed over tx_writes
+    uint32_t tx_latency_max_us = 0;
+    uint64_t rx_bytes = 0;
+    uint32_t rx_dropped = 0;        // bytes lost to a full RX buffer
+    uint32_t congestion_events = 0;
+};
+
 class fnBluetoothSPP
 {
 private:
@@ -40,9 +52,15 @@ public:
     int peek(void);
     bool hasClient(void);
     int read(void);
+    size_t read(uint8_t *buffer, size_t size);
     size_t write(uint8_t c);
     size_t write(const uint8_t *buffer, size_t size);
     void flush();
+    // Most bytes sent in one SPP write; 0 restores the default
+    void setMTU(uint16_t size);
+    uint16_t getMTU();
+    const fnBluetoothSPPStats &stats();
+    void resetStats();
     void end(void);
     void onData(fnBluetoothDataCb cb);
     esp_err_t register_callback(esp_spp_cb_t *callback);
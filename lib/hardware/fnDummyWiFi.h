@@ -76,6 +76,9 @@ public:
     uint8_t scan_networks(uint8_t maxresults = FNWIFI_SCAN_RESULTS_MAX);
     int get_scan_result(uint8_t index, char ssid[32], uint8_t *rssi = NULL,
                         uint8_t *channel = NULL, char bssid[18] = NULL, uint8_t *encryption = NULL);
+
+    // No radio to power save
+    void note_activity() {};
 };
 
 extern DummyWiFiManager fnWiFi;  // global instance
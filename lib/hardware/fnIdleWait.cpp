@@ -0,0 +1,74 @@
+#ifndef ESP_PLATFORM
+
+#include "fnIdleWait.h"
+
+
+fnIdleWait fnIdle;
+
+fnIdleWait::fnIdleWait()
+{
+    FD_ZERO(&_readfds);
+}
+
+void fnIdleWait::watch(int fd)
+{
+    if (fd < 0)
+        return;
+#if !defined(_WIN32)
+    // select() can't take it, keep polling instead
+    if (fd >= FD_SETSIZE)
+    {
+        _busy = true;
+        return;
+    }
+#endif
+    FD_SET(fd, &_readfds);
+    if (fd > _maxfd)
+        _maxfd = fd;
+}
+
+void fnIdleWait::wait()
+{
+    if (!_sleep_allowed || _busy)
+    {
+        _idle_ms = 1;
+    }
+    else
+    {
+        timeval tv;
+        tv.tv_sec = _idle_ms / 1000;
+        tv.tv_usec = (_idle_ms % 1000) * 1000;
+
+        int result;
+#if defined(_WIN32)
+        // Windows select() fails without any socket in the set
+        if (_maxfd < 0)
+        {
+            Sleep(_idle_ms);
+            result = 0;
+        }
+        else
+#endif
+        result = select(_maxfd + 1, &_readfds, nullptr, nullptr, &tv);
+
+        if (result == 0)
+        {
+            // Quiet, sleep longer next time
+            _idle_ms *= 2;
+            if (_idle_ms > IDLE_WAIT_MAX_MS)
+                _idle_ms = IDLE_WAIT_MAX_MS;
+        }
+        else
+        {
+            // Woken up by a socket (or a signal), expect more
+            _idle_ms = 1;
+        }
+    }
+
+    FD_ZERO(&_readfds);
+    _maxfd = -1;
+    _sleep_allowed = false;
+    _busy = false;
+}
+
+#endif // !ESP_PLATFORM
@@ -0,0 +1,57 @@
+#ifndef FNIDLEWAIT_H
+#define FNIDLEWAIT_H
+
+#ifndef ESP_PLATFORM
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include <stdint.h>
+
+// Longest sleep of an idle main loop pass; timers (keep alive, write-behind
+// expiry and such) are only looked at this often while nothing else happens
+#define IDLE_WAIT_MAX_MS 20
+
+/*
+ * fnIdleWait - lets the FujiNet-PC main loop sleep while nothing is going on
+ *
+ * During a main loop pass the bus says it has nothing in progress with
+ * allow_sleep(), and everything that can be woken up by a socket registers it
+ * with watch(). Anything with work that can't wait for a socket calls busy().
+ * wait() at the end of the pass then sleeps in select() until a watched
+ * socket is readable or the idle timeout runs out. The timeout starts at 1 ms
+ * after activity and doubles on every quiet pass up to IDLE_WAIT_MAX_MS.
+ *
+ * A bus which never calls allow_sleep() keeps polling as before.
+ */
+class fnIdleWait
+{
+private:
+    fd_set _readfds;
+    int _maxfd = -1;
+    bool _sleep_allowed = false;
+    bool _busy = false;
+    uint32_t _idle_ms = 1;
+
+public:
+    fnIdleWait();
+
+    // The bus is idle, the pass may end with a sleep
+    void allow_sleep() { _sleep_allowed = true; }
+    // Work is pending that no watched socket would announce, don't sleep this pass
+    void busy() { _busy = true; }
+    // Wake up as soon as fd becomes readable
+    void watch(int fd);
+
+    // End of a main loop pass: sleeps if allowed, then starts the next pass
+    void wait();
+};
+
+extern fnIdleWait fnIdle;
+
+#endif // !ESP_PLATFORM
+
+#endif // FNIDLEWAIT_H
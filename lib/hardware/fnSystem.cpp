@@ -57,6 +57,7 @@
 #include "fsFlash.h"
 #include "fnFsSD.h"
 #include "fnWiFi.h"
+#include "fujiAppKeys.h"
 
 #ifdef BUILD_APPLE
 #define BUS_CLASS IWM
@@ -418,6 +419,7 @@ void SystemManager::yield()
 // TODO: Close open files first
 void SystemManager::reboot()
 {
+    fnAppKeys.flush();
     SYSTEM_BUS.shutdown();
     fnWiFi.stop();
     esp_restart();
@@ -429,6 +431,7 @@ void SystemManager::reboot(uint32_t delay_ms, bool reboot)
     {
         // do cleanup and exit
         Debug_println("SystemManager::reboot - exiting ...");
+        fnAppKeys.flush();
         // FN will be restarted if ended with EXIT_AND_RESTART (75)
         exit(_reboot_code);
     }
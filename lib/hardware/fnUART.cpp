@@ -20,6 +20,34 @@
 #define MAX_WRITE_BYTE_TICKS 100
 #define MAX_WRITE_BUFFER_TICKS 1000
 
+// Receive ring buffer, holds a whole sector frame even if the reader is held up for a while
+#define UART_RX_BUFFER_SIZE 1024
+// Hardware RX FIFO, emptied into the ring buffer by the driver's interrupt
+#define UART_RX_FIFO_SIZE 128
+// How long the FIFO interrupt may be held off (Wi-Fi bursts) before bytes are lost,
+// the FIFO full threshold leaves room for this many microseconds of data
+#define UART_RX_SLACK_US 4000
+#define UART_RX_THRESH_MIN 16
+#define UART_RX_THRESH_MAX 120
+// Idle time, in characters, before a partly filled FIFO is handed over
+#define UART_RX_TIMEOUT_CHARS 2
+// Longest idle time the timeout register holds on every target
+#define UART_RX_TIMEOUT_MAX 100
+// Event type of the wait_rx_quiet() marker, not one the driver uses
+#define UART_QUIET_EVENT UART_EVENT_MAX
+// Driver events (data, overflow) kept for wait_rx_data(), older ones are dropped
+#define UART_EVENT_QUEUE_SIZE 10
+// With flow control, RTS goes high once the FIFO holds this many bytes. The rest
+// of the FIFO takes what the other side still sends after that, a 16550's FIFO worth
+#define UART_RX_FLOW_THRESH 112
+
+// Adam and Lynx set up their own receive interrupts
+#if defined(BUILD_ADAM) || defined(BUILD_LYNX)
+#define UART_RX_TUNING 0
+#else
+#define UART_RX_TUNING 1
+#endif
+
 // Serial "debug port"
 UARTManager fnUartDebug(FN_UART_DEBUG);
 
@@ -29,13 +57,25 @@ UARTManager fnUartBUS(FN_UART_BUS);
 #endif
 
 // Constructor
-UARTManager::UARTManager(uart_port_t uart_num) : _uart_num(uart_num), _uart_q(NULL) {}
+UARTManager::UARTManager(uart_port_t uart_num) : _uart_num(uart_num), _uart_q(NULL), _rx_buffer_size(UART_RX_BUFFER_SIZE) {}
+
+void UARTManager::set_buffer_sizes(int rx_size, int tx_size)
+{
+    // The driver wants more than the hardware FIFO for either, or no TX buffer at all
+    _rx_buffer_size = rx_size > UART_RX_FIFO_SIZE ? rx_size : UART_RX_BUFFER_SIZE;
+    _tx_buffer_size = tx_size > UART_RX_FIFO_SIZE ? tx_size : 0;
+}
+
+void UARTManager::set_flow_control(int rts_pin, int cts_pin)
+{
+    _rts_pin = rts_pin;
+    _cts_pin = cts_pin;
+}
 
 void UARTManager::end()
 {
+    // The driver deletes its event queue along with itself
     uart_driver_delete(_uart_num);
-    if (_uart_q)
-        vQueueDelete(_uart_q);
     _uart_q = NULL;
 }
 
@@ -56,8 +96,8 @@ void UARTManager::begin(int baud)
             .parity = UART_PARITY_DISABLE,
 #endif /* BUILD_LYNX */
             .stop_bits = UART_STOP_BITS_1,
-            .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-            .rx_flow_ctrl_thresh = 122, // No idea what this is for, but shouldn't matter if flow ctrl is disabled?
+            .flow_ctrl = flow_control() ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE,
+            .rx_flow_ctrl_thresh = UART_RX_FLOW_THRESH,
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
             .source_clk = UART_SCLK_DEFAULT
 #else
@@ -105,7 +145,10 @@ void UARTManager::begin(int baud)
         return;
     }
 
-    uart_set_pin(_uart_num, tx, rx, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    if (flow_control())
+        uart_set_pin(_uart_num, tx, rx, _rts_pin, _cts_pin);
+    else
+        uart_set_pin(_uart_num, tx, rx, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
 
 #ifdef BUILD_ADAM
     if (_uart_num == 2)
@@ -122,14 +165,10 @@ void UARTManager::begin(int baud)
 #endif /* BUILD_COCO */
 
 
-    // Arduino default buffer size is 256
-    int uart_buffer_size = 256;
-    int uart_queue_size = 10;
     int intr_alloc_flags = 0;
 
-    // Install UART driver using an event queue here
-    // uart_driver_install(_uart_num, uart_buffer_size, uart_buffer_size, uart_queue_size, &_uart_q, intr_alloc_flags);
-    uart_driver_install(_uart_num, uart_buffer_size, 0, uart_queue_size, NULL, intr_alloc_flags);
+    // Install UART driver using an event queue, only read by wait_rx_data()
+    uart_driver_install(_uart_num, _rx_buffer_size, _tx_buffer_size, UART_EVENT_QUEUE_SIZE, &_uart_q, intr_alloc_flags);
 
 #ifdef BUILD_ADAM
     uart_intr_config_t uart_intr;
@@ -149,6 +188,11 @@ void UARTManager::begin(int baud)
     uart_intr_config(_uart_num, &uart_intr);
 #endif /* BUILD_LYNX */
 
+#if UART_RX_TUNING
+    uart_set_rx_timeout(_uart_num, UART_RX_TIMEOUT_CHARS);
+    tune_rx(baud);
+#endif
+
     // Set initialized.
     _initialized = true;
 }
@@ -203,11 +247,137 @@ void UARTManager::set_baudrate(uint32_t baud)
     uart_get_baudrate(_uart_num, &before);
 #endif
     uart_set_baudrate(_uart_num, baud);
+#if UART_RX_TUNING
+    tune_rx(baud);
+#endif
 #ifdef DEBUG
     Debug_printf("set_baudrate change from %d to %d\r\n", before, baud);
 #endif
 }
 
+/* Sets the RX FIFO full threshold low enough that UART_RX_SLACK_US of data
+   still fit in the FIFO once the interrupt is due; the higher the baud rate
+   the earlier the driver has to move data into the ring buffer
+ */
+void UARTManager::tune_rx(uint32_t baud)
+{
+    // 10 bits per character
+    int slack = (int)(((uint64_t)baud * UART_RX_SLACK_US + 9999999) / 10000000);
+    int thresh = UART_RX_FIFO_SIZE - slack;
+    if (thresh < UART_RX_THRESH_MIN)
+        thresh = UART_RX_THRESH_MIN;
+    else if (thresh > UART_RX_THRESH_MAX)
+        thresh = UART_RX_THRESH_MAX;
+    // Empty the FIFO before RTS would go high, so it only does when the ring buffer is full
+    if (flow_control() && thresh >= UART_RX_FLOW_THRESH)
+        thresh = UART_RX_FLOW_THRESH - 1;
+
+    _rx_thresh = thresh;
+    uart_set_rx_full_threshold(_uart_num, thresh);
+}
+
+void UARTManager::set_rx_idle(uint32_t gap_us)
+{
+    int chars = UART_RX_TIMEOUT_CHARS;
+    if (gap_us)
+    {
+        // 10 bits per character, rounded up
+        chars = (int)(((uint64_t)get_baudrate() * gap_us + 9999999) / 10000000);
+        if (chars > UART_RX_TIMEOUT_MAX)
+            chars = UART_RX_TIMEOUT_MAX;
+    }
+    uart_set_rx_timeout(_uart_num, chars);
+
+    // Nobody waited on the events from before
+    if (_uart_q)
+        xQueueReset(_uart_q);
+}
+
+bool UARTManager::wait_rx_data(TickType_t ticks, bool &idle)
+{
+    uart_event_t event;
+
+    idle = false;
+    if (_uart_q == NULL || xQueueReceive(_uart_q, &event, ticks) != pdTRUE)
+        return false;
+    // Overflows still leave data to read
+    if (event.type == UART_DATA)
+        idle = event.timeout_flag;
+    return true;
+}
+
+// Runs when the line has been quiet for the whole gap, wakes up wait_rx_quiet()
+void IRAM_ATTR UARTManager::_quiet_timeout(void *arg)
+{
+    UARTManager *uart = (UARTManager *)arg;
+    uart_event_t event = {};
+    event.type = UART_QUIET_EVENT;
+    event.size = uart->_quiet_gen;
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(uart->_uart_q, &event, &woken);
+    if (woken)
+        esp_timer_isr_dispatch_need_yield();
+#else
+    xQueueSend(uart->_uart_q, &event, 0);
+#endif
+}
+
+bool UARTManager::wait_rx_quiet(uint32_t gap_us, TickType_t max_ticks)
+{
+    if (_uart_q == NULL)
+        return false;
+
+    if (_quiet_timer == nullptr)
+    {
+        esp_timer_create_args_t tcfg = {};
+        tcfg.callback = _quiet_timeout;
+        tcfg.arg = this;
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+        tcfg.dispatch_method = ESP_TIMER_ISR;
+#else
+        tcfg.dispatch_method = ESP_TIMER_TASK;
+#endif
+        tcfg.name = "uart_quiet";
+        if (esp_timer_create(&tcfg, &_quiet_timer) != ESP_OK)
+            return false;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    for (;;)
+    {
+        // Every byte received so far is discarded and the gap starts over. The
+        // driver queues an event per interrupt, so the next byte wakes us up
+        esp_timer_stop(_quiet_timer);
+        uart_flush_input(_uart_num);
+        xQueueReset(_uart_q);
+        _quiet_gen = _quiet_gen + 1;
+        esp_timer_start_once(_quiet_timer, gap_us);
+
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (max_ticks != portMAX_DELAY && waited >= max_ticks)
+            break;
+
+        uart_event_t event;
+        // A full queue can swallow the marker, so give up waiting for it after a
+        // tick: the line was quiet for far longer than any gap by then
+        if (xQueueReceive(_uart_q, &event, 1) != pdTRUE)
+        {
+            if (available() <= 0)
+            {
+                esp_timer_stop(_quiet_timer);
+                return true;
+            }
+            continue;
+        }
+        if (event.type == UART_QUIET_EVENT && event.size == _quiet_gen && available() <= 0)
+            return true;
+    }
+
+    esp_timer_stop(_quiet_timer);
+    return false;
+}
+
 /* Returns a single byte from the incoming stream
  */
 int UARTManager::read(void)
@@ -239,7 +409,18 @@ int UARTManager::read(void)
  */
 size_t UARTManager::readBytes(uint8_t *buffer, size_t length)
 {
+#if UART_RX_TUNING
+    // A frame shorter than the threshold would only be handed over on the idle timeout,
+    // have the interrupt come when it's complete instead
+    bool short_frame = length > 0 && length < (size_t)_rx_thresh;
+    if (short_frame)
+        uart_set_rx_full_threshold(_uart_num, length);
+#endif
     int result = uart_read_bytes(_uart_num, buffer, length, MAX_READ_WAIT_TICKS);
+#if UART_RX_TUNING
+    if (short_frame)
+        uart_set_rx_full_threshold(_uart_num, _rx_thresh);
+#endif
 #ifdef DEBUG
     if (result < length)
     {
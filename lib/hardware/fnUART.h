@@ -5,6 +5,7 @@
 
 #ifdef ESP_PLATFORM
 #  include <driver/uart.h>
+#  include <esp_timer.h>
 #  define FN_UART_DEBUG   UART_NUM_0
 #  if defined(BUILD_RS232) || defined(PINMAP_COCO_ESP32S3)
 #    define FN_UART_BUS   UART_NUM_1
@@ -30,6 +31,18 @@ private:
 #ifdef ESP_PLATFORM
     uart_port_t _uart_num;
     QueueHandle_t _uart_q;
+    int _rx_thresh = 0; // RX FIFO full interrupt threshold for the current baud rate
+    int _rx_buffer_size;
+    int _tx_buffer_size = 0; // 0 makes write() wait until everything is in the TX FIFO
+    int _rts_pin = UART_PIN_NO_CHANGE; // Hardware flow control pins, unused if either isn't set
+    int _cts_pin = UART_PIN_NO_CHANGE;
+    // One-shot timer for wait_rx_quiet(), it posts a marker event tagged with
+    // _quiet_gen so one from an earlier arming is told apart
+    esp_timer_handle_t _quiet_timer = nullptr;
+    volatile uint32_t _quiet_gen = 0;
+
+    void tune_rx(uint32_t baud);
+    static void _quiet_timeout(void *arg);
 #else
     char _device[64]; // device name or path
     uint32_t _baud;
@@ -61,10 +74,29 @@ public:
 
     void begin(int baud);
     void end();
+    // Driver ring buffer sizes, take effect on the next begin()
+    void set_buffer_sizes(int rx_size, int tx_size);
+    // RTS/CTS flow control on the next begin(): rts_pin is held low while
+    // there's room to receive, output is held while cts_pin is high.
+    // UART_PIN_NO_CHANGE for both turns it off
+    void set_flow_control(int rts_pin, int cts_pin);
+    bool flow_control() { return _rts_pin != UART_PIN_NO_CHANGE && _cts_pin != UART_PIN_NO_CHANGE; }
     uint32_t get_baudrate();
     void set_baudrate(uint32_t baud);
     bool initialized() { return _initialized; }
 
+    // Line idle time, in microseconds at the current baud rate, after which the
+    // hardware hands over a partly filled FIFO and flags the end of a burst.
+    // 0 goes back to the default
+    void set_rx_idle(uint32_t gap_us);
+    // Waits up to ticks for the driver to report received data, idle is set
+    // when the line went quiet after it
+    bool wait_rx_data(TickType_t ticks, bool &idle);
+    // Discards input until the line has been quiet for gap_us, sleeping until
+    // the next byte or the end of the gap rather than polling. False if it
+    // didn't go quiet within max_ticks
+    bool wait_rx_quiet(uint32_t gap_us, TickType_t max_ticks = portMAX_DELAY);
+
     int available();
     int peek();
     void flush();
@@ -9,6 +9,9 @@
 #include <esp_event.h>
 #include <mdns.h>
 #include <esp_crc.h>
+#include <nvs.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pkcs5.h>
 
 #include <cstring>
 #include <algorithm>
@@ -20,12 +23,21 @@
 #include "fnSystem.h"
 #include "fnConfig.h"
 #include "httpService.h"
+#include "fnDNS.h"
+#include "fnEvents.h"
+#include "fnSMBPool.h"
 #include "led.h"
 
 
 // Global object to manage WiFi
 WiFiManager fnWiFi;
 
+// Only WPA/WPA2 personal use a PMK straight from the passphrase
+static bool is_psk(uint8_t authmode)
+{
+    return authmode == WIFI_AUTH_WPA_PSK || authmode == WIFI_AUTH_WPA2_PSK || authmode == WIFI_AUTH_WPA_WPA2_PSK;
+}
+
 WiFiManager::~WiFiManager()
 {
     stop();
@@ -100,8 +112,12 @@ int WiFiManager::start()
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_start());
 
-    // Disable powersave for lower latency
+    // Start without powersave for lower latency; service_power_save() drops to
+    // modem sleep once the bus has been idle for the configured time
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+    _ps_sleeping = false;
+    _ps_idle_ms = Config.get_wifi_powersave_idle() * 1000;
+    _last_activity_ms = esp_timer_get_time() / 1000;
 
     // Set a hostname from our configuration
     esp_netif_set_hostname(_wifi_sta, Config.get_general_devicename().c_str());
@@ -173,9 +189,50 @@ int WiFiManager::connect(const char *ssid, const char *password)
         // Debug_printf("WiFi config double-check: \"%s\", \"%s\"\r\n", (char *)wifi_config.sta.ssid, (char *)wifi_config.sta.password );
 
         wifi_config.sta.pmf_cfg.capable = true;
+
+        // Straight to the AP that worked last time, no scan, and for WPA/WPA2 with
+        // the PMK so the passphrase doesn't have to go through PBKDF2 again
+        _ssid = ssid;
+        _password = password;
+        _fast_connecting = false;
+        _fast_pinned = false;
+        uint32_t key = fast_connect_key(ssid, password);
+        if (!_fast_failed && load_fast_connect(key))
+        {
+            memcpy(wifi_config.sta.bssid, _fast_info.bssid, sizeof(wifi_config.sta.bssid));
+            wifi_config.sta.bssid_set = true;
+            wifi_config.sta.channel = _fast_info.channel;
+            wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+            bool with_pmk = false;
+            if (is_psk(_fast_info.authmode))
+            {
+                std::lock_guard<std::mutex> lock(_pmk_mutex);
+                if (_pmk_valid && _pmk_key == key)
+                {
+                    // 64 hex digits are taken as the PSK itself
+                    static const char hex[] = "0123456789abcdef";
+                    for (int i = 0; i < 32; i++)
+                    {
+                        wifi_config.sta.password[i * 2] = hex[_pmk[i] >> 4];
+                        wifi_config.sta.password[i * 2 + 1] = hex[_pmk[i] & 0x0F];
+                    }
+                    with_pmk = true;
+                }
+            }
+            _fast_connecting = true;
+            _fast_pinned = true;
+            Debug_printf("WiFi fast connect to %02x:%02x:%02x:%02x:%02x:%02x channel %u%s\r\n",
+                         _fast_info.bssid[0], _fast_info.bssid[1], _fast_info.bssid[2],
+                         _fast_info.bssid[3], _fast_info.bssid[4], _fast_info.bssid[5],
+                         _fast_info.channel, with_pmk ? " with cached PMK" : "");
+        }
+
         ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     }
 
+    if (_connect_start == 0)
+        _connect_start = fnSystem.millis();
+
     // Now connect
     _reconnect_attempts = 0;
     esp_err_t e = esp_wifi_connect();
@@ -595,6 +652,186 @@ void WiFiManager::set_hostname(const char *hostname)
     esp_netif_set_hostname(_wifi_sta, hostname);
 }
 
+uint32_t WiFiManager::fast_connect_key(const char *ssid, const char *password)
+{
+    uint32_t key = esp_crc32_le(0, (const uint8_t *)ssid, strlen(ssid) + 1);
+    return esp_crc32_le(key, (const uint8_t *)password, strlen(password));
+}
+
+bool WiFiManager::load_fast_connect(uint32_t key)
+{
+    nvs_handle_t h;
+    if (nvs_open(FNWIFI_FAST_NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK)
+        return false;
+
+    size_t len = sizeof(_fast_info);
+    esp_err_t e = nvs_get_blob(h, FNWIFI_FAST_NVS_KEY, &_fast_info, &len);
+    nvs_close(h);
+
+    return e == ESP_OK && len == sizeof(_fast_info) && _fast_info.key == key;
+}
+
+void WiFiManager::store_fast_connect(const fast_connect_info *info)
+{
+    nvs_handle_t h;
+    if (nvs_open(FNWIFI_FAST_NVS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK)
+    {
+        Debug_println("WiFi fast connect: can't open NVS");
+        return;
+    }
+
+    if (nvs_set_blob(h, FNWIFI_FAST_NVS_KEY, info, sizeof(*info)) == ESP_OK)
+        nvs_commit(h);
+    nvs_close(h);
+}
+
+struct WiFiManager::pmk_job
+{
+    WiFiManager *wifi;
+    uint32_t key;
+    std::string ssid;
+    std::string password;
+};
+
+// Remember where this connection went, called once there's an IP
+void WiFiManager::save_fast_connect()
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+        return;
+
+    uint32_t key = fast_connect_key(_ssid.c_str(), _password.c_str());
+    bool known = load_fast_connect(key);
+
+    if (!known || memcmp(_fast_info.bssid, ap.bssid, sizeof(ap.bssid)) != 0 ||
+        _fast_info.channel != ap.primary || _fast_info.authmode != ap.authmode)
+    {
+        _fast_info.key = key;
+        memcpy(_fast_info.bssid, ap.bssid, sizeof(ap.bssid));
+        _fast_info.channel = ap.primary;
+        _fast_info.authmode = ap.authmode;
+        store_fast_connect(&_fast_info);
+    }
+
+    bool psk = is_psk(ap.authmode) && _password.length() >= 8 && _password.length() < 64;
+    bool have_pmk;
+    {
+        std::lock_guard<std::mutex> lock(_pmk_mutex);
+        have_pmk = _pmk_valid && _pmk_key == key;
+    }
+    if (psk && !have_pmk)
+    {
+        // PBKDF2 takes a while, do it out of the way of the event loop
+        pmk_job *job = new pmk_job{this, key, _ssid, _password};
+        if (xTaskCreate(pmk_task, "wifi_pmk", FNWIFI_PMK_STACKSIZE, job, FNWIFI_PMK_PRIORITY, nullptr) != pdPASS)
+            delete job;
+    }
+}
+
+// The BSSID and channel are only for getting on quickly. Once connected, later
+// reconnects go through the usual scan, so they can roam to another AP
+void WiFiManager::unpin_fast_connect()
+{
+    _fast_pinned = false;
+
+    wifi_config_t wifi_config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_config) != ESP_OK)
+        return;
+    wifi_config.sta.bssid_set = false;
+    memset(wifi_config.sta.bssid, 0, sizeof(wifi_config.sta.bssid));
+    wifi_config.sta.channel = 0;
+    wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    memset(wifi_config.sta.password, 0, sizeof(wifi_config.sta.password));
+    strlcpy((char *)wifi_config.sta.password, _password.c_str(), sizeof(wifi_config.sta.password));
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+}
+
+void WiFiManager::pmk_task(void *arg)
+{
+    pmk_job *job = (pmk_job *)arg;
+
+    uint8_t pmk[32];
+    mbedtls_md_context_t ctx;
+    mbedtls_md_init(&ctx);
+    if (mbedtls_md_setup(&ctx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA1), 1) == 0 &&
+        mbedtls_pkcs5_pbkdf2_hmac(&ctx, (const unsigned char *)job->password.data(), job->password.length(),
+                                  (const unsigned char *)job->ssid.data(), job->ssid.length(),
+                                  4096, sizeof(pmk), pmk) == 0)
+    {
+        std::lock_guard<std::mutex> lock(job->wifi->_pmk_mutex);
+        memcpy(job->wifi->_pmk, pmk, sizeof(pmk));
+        job->wifi->_pmk_key = job->key;
+        job->wifi->_pmk_valid = true;
+        Debug_println("WiFi fast connect: PMK cached");
+    }
+    mbedtls_md_free(&ctx);
+    memset(pmk, 0, sizeof(pmk));
+
+    delete job;
+    vTaskDelete(nullptr);
+}
+
+std::string WiFiManager::time_to_ip_json()
+{
+    char buf[48];
+    snprintf(buf, sizeof(buf), "{\"time_to_ip_ms\":%lu,\"fast\":%s}",
+             (unsigned long)_time_to_ip, _time_to_ip_fast ? "true" : "false");
+    return buf;
+}
+
+void WiFiManager::service_power_save()
+{
+    if (_ps_idle_ms == 0 || !_connected || _ps_sleeping)
+        return;
+
+    int64_t last = _last_activity_ms;
+    if (esp_timer_get_time() / 1000 - last < _ps_idle_ms)
+        return;
+
+    _ps_sleeping = true;
+    esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+
+    // A command arriving while we switched may have woken us before the switch took
+    if (_last_activity_ms != last)
+    {
+        _ps_sleeping = true;
+        wake_from_power_save();
+        return;
+    }
+
+    _ps_sleeps++;
+    Debug_printf("WiFi power save: modem sleep after %lu ms idle\r\n", (unsigned long)_ps_idle_ms);
+}
+
+// The switch itself is what's timed. Frames for us while asleep are held by the AP
+// until the next DTIM beacon, so the first reply can take up to one DTIM interval longer
+void WiFiManager::wake_from_power_save()
+{
+    if (!_ps_sleeping.exchange(false))
+        return;
+
+    int64_t start = esp_timer_get_time();
+    esp_wifi_set_ps(WIFI_PS_NONE);
+    uint32_t took = esp_timer_get_time() - start;
+
+    _ps_wakeups++;
+    _ps_wake_us_last = took;
+    if (took > _ps_wake_us_max)
+        _ps_wake_us_max = took;
+    Debug_tracef("WiFi power save: awake in %lu us\r\n", (unsigned long)took);
+}
+
+std::string WiFiManager::power_save_json()
+{
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             "{\"idle_s\":%lu,\"sleeping\":%s,\"sleeps\":%lu,\"wakeups\":%lu,\"wake_us_last\":%lu,\"wake_us_max\":%lu}",
+             (unsigned long)(_ps_idle_ms / 1000), _ps_sleeping ? "true" : "false",
+             (unsigned long)_ps_sleeps, (unsigned long)_ps_wakeups,
+             (unsigned long)_ps_wake_us_last, (unsigned long)_ps_wake_us_max);
+    return buf;
+}
+
 void WiFiManager::handle_station_stop()
 {
     _connected = false;
@@ -611,6 +848,32 @@ void add_mdns_services()
     mdns_service_add(NULL,"_http","_tcp",80,hti,3);
 }
 
+void WiFiManager::start_services()
+{
+    fnSystem.Net.start_sntp_client();
+    fnHTTPD.start();
+// #ifdef BUILD_APPLE
+//             IWM.startup_hack();
+// #endif
+#ifdef BUILD_ATARI // temporary
+    if (Config.get_general_config_enabled() == false)
+        theFuji.mount_all();
+#endif /* BUILD_ATARI */
+    mdns_init();
+    mdns_hostname_set(Config.get_general_devicename().c_str());
+    add_mdns_services();
+}
+
+void WiFiManager::release_services()
+{
+    _services_held = false;
+    if (_services_pending.exchange(false))
+    {
+        Debug_println("Starting network services held during boot");
+        start_services();
+    }
+}
+
 void WiFiManager::_wifi_event_handler(void *arg, esp_event_base_t event_base,
                                       int32_t event_id, void *event_data)
 {
@@ -628,19 +891,31 @@ void WiFiManager::_wifi_event_handler(void *arg, esp_event_base_t event_base,
             Debug_println("IP_EVENT_STA_GOT_IP");
             Debug_printf("Obtained IP address: %s\r\n", fnSystem.Net.get_ip4_address_str().c_str());
             pFnWiFi->_connected = true;
+            if (pFnWiFi->_connect_start != 0)
+            {
+                pFnWiFi->_time_to_ip = fnSystem.millis() - pFnWiFi->_connect_start;
+                pFnWiFi->_time_to_ip_fast = pFnWiFi->_fast_connecting;
+                pFnWiFi->_connect_start = 0;
+                Debug_printf("WiFi time to IP: %lu ms (%s)\r\n", (unsigned long)pFnWiFi->_time_to_ip,
+                             pFnWiFi->_time_to_ip_fast ? "fast connect" : "scan");
+            }
+            pFnWiFi->_fast_connecting = false;
+            pFnWiFi->_fast_failed = false;
+            pFnWiFi->save_fast_connect();
             fnLedManager.set(eLed::LED_WIFI, true);
-            fnSystem.Net.start_sntp_client();
-            fnHTTPD.start();
-// #ifdef BUILD_APPLE
-//             IWM.startup_hack();
-// #endif
-#ifdef BUILD_ATARI // temporary
-            if (Config.get_general_config_enabled() == false)
-                theFuji.mount_all();
-#endif /* BUILD_ATARI */
-            mdns_init();
-            mdns_hostname_set(Config.get_general_devicename().c_str());
-            add_mdns_services();
+            fnEvents.publish(fn_event_type::WIFI_CONNECTED);
+            // Names may resolve differently on this network
+            dns_cache_clear();
+            // Parked SMB sessions were on the old connection
+            smb_pool_clear();
+            if (pFnWiFi->_services_held)
+            {
+                pFnWiFi->_services_pending = true;
+                // Released in the meantime, one of us starts them
+                if (pFnWiFi->_services_held || !pFnWiFi->_services_pending.exchange(false))
+                    break;
+            }
+            pFnWiFi->start_services();
             break;
         case IP_EVENT_STA_LOST_IP:
             Debug_println("IP_EVENT_STA_LOST_IP");
@@ -709,11 +984,30 @@ void WiFiManager::_wifi_event_handler(void *arg, esp_event_base_t event_base,
             {
                 Debug_println("WIFI_EVENT_STA_DISCONNECTED");
                 pFnWiFi->handle_station_stop();
+                fnEvents.publish(fn_event_type::WIFI_DISCONNECTED);
             }
 
             // if we are currently attempting to disconnect, don't attempt to reconnect
             if (pFnWiFi->_disconnecting) return;
 
+            if (pFnWiFi->_connect_start == 0)
+                pFnWiFi->_connect_start = fnSystem.millis();
+
+            if (pFnWiFi->_fast_connecting)
+            {
+                // The AP moved, or the PSK is stale: do it the long way
+                Debug_println("WiFi fast connect failed, scanning instead");
+                pFnWiFi->_fast_failed = true;
+                std::string ssid = pFnWiFi->_ssid;
+                std::string password = pFnWiFi->_password;
+                pFnWiFi->connect(ssid.c_str(), password.c_str());
+                return;
+            }
+
+            // We got on with the fast connect, reconnects may go to any AP of the network
+            if (pFnWiFi->_fast_pinned)
+                pFnWiFi->unpin_fast_connect();
+
             // Try to reconnect
             if (pFnWiFi->_scan_in_progress == false &&
                 pFnWiFi->_reconnect_attempts < connection_attempts && Config.have_wifi_info())
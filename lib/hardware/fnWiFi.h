@@ -11,13 +11,22 @@
 #include <freertos/event_groups.h>
 #include <esp_netif.h>
 #include <esp_wifi.h>
+#include <esp_timer.h>
 
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #define FNWIFI_RECONNECT_RETRIES 4
 #define FNWIFI_SCAN_RESULTS_MAX 20
 
+// Last good AP and channel, for a directed connect without a scan next time
+#define FNWIFI_FAST_NVS_NAMESPACE "fnwifi"
+#define FNWIFI_FAST_NVS_KEY "fast"
+#define FNWIFI_PMK_STACKSIZE 4096
+#define FNWIFI_PMK_PRIORITY 1
+
 #define WIFI_CONNECTED_BIT    BIT0
 #define WIFI_FAIL_BIT         BIT1
 #define WIFI_NO_IP_YET_BIT    BIT2
@@ -64,6 +73,53 @@ private:
     uint16_t _common_index = 0;
     std::vector<stored_wifi> _matched_wifis;
 
+    struct fast_connect_info
+    {
+        uint32_t key;      // crc32 of the SSID and passphrase it's good for
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint8_t authmode;
+    };
+    fast_connect_info _fast_info;
+    struct pmk_job;
+    bool _fast_connecting = false; // directed connect to _fast_info's AP under way
+    bool _fast_failed = false;     // that didn't work, scan until the next good connection
+    bool _fast_pinned = false;     // the station config is still locked to that AP
+
+    // PBKDF2 of the passphrase, which takes the ESP32 about a second. It's as good as
+    // the passphrase, so it's only ever kept in RAM
+    std::mutex _pmk_mutex;
+    bool _pmk_valid = false;
+    uint32_t _pmk_key = 0;         // fast_connect_key() it was made for
+    uint8_t _pmk[32];
+
+    uint64_t _connect_start = 0;   // when we started trying, 0 once there's an IP
+    uint32_t _time_to_ip = 0;
+    bool _time_to_ip_fast = false;
+
+    static uint32_t fast_connect_key(const char *ssid, const char *password);
+    bool load_fast_connect(uint32_t key);
+    void save_fast_connect();
+    void unpin_fast_connect();
+    static void store_fast_connect(const fast_connect_info *info);
+    static void pmk_task(void *arg);
+
+    // An IP before the bus is set up waits for release_services()
+    std::atomic<bool> _services_held{false};
+    std::atomic<bool> _services_pending{false};
+    void start_services();
+
+    // Power save policy: no power save while there's bus activity, modem sleep once
+    // there's been none for _ps_idle_ms (0 never sleeps)
+    uint32_t _ps_idle_ms = 0;
+    std::atomic<int64_t> _last_activity_ms{0};
+    std::atomic<bool> _ps_sleeping{false};
+    uint32_t _ps_sleeps = 0;
+    uint32_t _ps_wakeups = 0;
+    uint32_t _ps_wake_us_last = 0; // How long the last switch back to WIFI_PS_NONE took
+    uint32_t _ps_wake_us_max = 0;
+    void wake_from_power_save();
+
 public:
     std::vector<std::string> get_network_names();
     std::vector<stored_wifi> get_stored_wifis();
@@ -101,6 +157,27 @@ public:
     std::string get_network_name_by_crc8(uint8_t crc8);
 
     int32_t localIP();
+
+    // ms from the first connect attempt to the last IP address, and whether
+    // the directed connect got it
+    uint32_t get_time_to_ip() { return _time_to_ip; };
+    std::string time_to_ip_json();
+
+    // Hold back SNTP, HTTP, mDNS and mounting on a new IP while Wi-Fi is
+    // brought up alongside the rest of the boot, release starts any held
+    void hold_services() { _services_held = true; };
+    void release_services();
+
+    // Called by the buses for each command; leaves modem sleep straight away
+    void note_activity()
+    {
+        _last_activity_ms = esp_timer_get_time() / 1000;
+        if (_ps_sleeping)
+            wake_from_power_save();
+    };
+    // From the main loop, drops to modem sleep once idle long enough
+    void service_power_save();
+    std::string power_save_json();
 };
 
 extern WiFiManager fnWiFi;
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "fnHttpClient.h"
+#include "httpClientPool.h"
 
 #include "../../include/debug.h"
 
@@ -20,6 +21,27 @@ using namespace fujinet;
 
 const char *webdav_depths[] = {"0", "1", "infinity"};
 
+static void _pool_destroy(esp_http_client_handle_t &handle)
+{
+    esp_http_client_cleanup(handle);
+}
+
+static httpClientPool<esp_http_client_handle_t> http_pool(_pool_destroy);
+
+void http_client_pool_expire()
+{
+    http_pool.expire();
+}
+
+// Origin the handle is currently connected to
+static std::string _handle_pool_key(esp_http_client_handle_t handle)
+{
+    if (handle->connection_info.scheme == nullptr || handle->connection_info.host == nullptr)
+        return std::string();
+    return http_pool_key(std::string(handle->connection_info.scheme) + "://" +
+                         handle->connection_info.host + ":" + std::to_string(handle->connection_info.port));
+}
+
 fnHttpClient::fnHttpClient()
 {
     _buffer = (char *)malloc(DEFAULT_HTTP_BUF_SIZE);
@@ -33,7 +55,17 @@ fnHttpClient::~fnHttpClient()
     Debug_printv("BEFORE free heap/low: %lu/%lu", esp_get_free_heap_size(), esp_get_free_internal_heap_size());
     if (_handle != nullptr)
     {
-        esp_http_client_cleanup(_handle);
+        // close() left the connection open only if it's idle and keep-alive, park it for the next client
+        std::string key = _handle_pool_key(_handle);
+        if (_handle->state == HTTP_STATE_CONNECTED && !key.empty())
+        {
+            // We're going away, so no more events until the next client takes it over
+            _handle->event_handler = nullptr;
+            _handle->user_data = nullptr;
+            http_pool.release(key, _handle);
+        }
+        else
+            esp_http_client_cleanup(_handle);
     }
 
     free(_buffer);
@@ -60,6 +92,24 @@ bool fnHttpClient::begin(const std::string &url)
     // Keep track of the auth type set
     _auth_type = cfg.auth_type;
 
+    // Pick up a kept-alive connection to the same host if there is one
+    esp_http_client_handle_t pooled;
+    std::string key = http_pool_key(url);
+    if (!key.empty() && http_pool.acquire(key, pooled))
+    {
+        if (esp_http_client_reuse(pooled, &cfg) == ESP_OK)
+        {
+#ifdef VERBOSE_HTTP
+            Debug_printf("fnHttpClient::begin reusing connection to %s\r\n", key.c_str());
+#endif
+            _handle = pooled;
+            _reused = true;
+            return true;
+        }
+        esp_http_client_cleanup(pooled);
+    }
+
+    _reused = false;
     _handle = esp_http_client_init(&cfg);
     if (_handle == nullptr)
         return false;
@@ -232,12 +282,16 @@ void fnHttpClient::_flush_response()
 }
 
 // Close connection, but keep request resources
+// A keep-alive connection with the whole response read is left open so it can be reused
 void fnHttpClient::close()
 {
     // Debug_println("::close");
+    bool idle = _handle != nullptr && _taskh_subtask == nullptr && _transaction_done &&
+                _client_err == ESP_OK && _handle->state == HTTP_STATE_CONNECTED;
+
     _delete_subtask_if_running();
 
-    if (_handle != nullptr)
+    if (_handle != nullptr && !idle)
         esp_http_client_close(_handle);
 
     _stored_headers.clear();
@@ -473,6 +527,18 @@ int fnHttpClient::_perform()
     // Debug_printf("%08lx _perform notified\r\n", fnSystem.millis());
     // Debug_printf("Notification of headers loaded\r\n");
 
+    // A pooled connection the server has since closed fails before any response arrives,
+    // retry once on a fresh connection
+    if (_reused && _transaction_done && (_client_err == ESP_ERR_HTTP_WRITE_DATA || _client_err == ESP_ERR_HTTP_FETCH_HEADER))
+    {
+        Debug_printf("fnHttpClient: kept-alive connection went stale, reconnecting\r\n");
+        _reused = false;
+        for (int i = 0; i < 100 && _taskh_subtask != nullptr; i++)
+            vTaskDelay(pdMS_TO_TICKS(1));
+        esp_http_client_close(_handle);
+        return _perform();
+    }
+
     int status;
     switch (_client_err)
     {
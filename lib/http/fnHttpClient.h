@@ -32,8 +32,9 @@ private:
     int _redirect_count = 0;
     int _max_redirects = 0;
     bool connected = false;
+    bool _reused = false; // _handle came from the keep-alive pool
     esp_http_client_auth_type_t _auth_type;
-    esp_err_t _client_err;
+    esp_err_t _client_err = ESP_OK;
 
     uint16_t _port = 80;
     header_map_t _stored_headers;
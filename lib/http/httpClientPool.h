@@ -0,0 +1,128 @@
+#ifndef _HTTP_CLIENT_POOL_H_
+#define _HTTP_CLIENT_POOL_H_
+
+/*
+ * Keep-alive connection pool shared by every HTTP client object.
+ * When a client is destroyed after a complete response on a persistent
+ * connection, its connection is parked here under "scheme://host:port" and
+ * handed to the next client that begins a request to the same origin, so
+ * polling apps skip the TCP/TLS handshake. Idle connections are dropped
+ * after HTTP_POOL_IDLE_MS, and at most HTTP_POOL_MAX_IDLE are kept open.
+ */
+
+#include <cctype>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fnSystem.h"
+
+// Most servers close idle keep-alive connections after 5-15 seconds
+#define HTTP_POOL_IDLE_MS 8000
+
+#ifdef ESP_PLATFORM
+// Each parked TLS session holds tens of KB of heap
+#define HTTP_POOL_MAX_IDLE 2
+#else
+#define HTTP_POOL_MAX_IDLE 8
+#endif
+
+// Origin of a URL, lowercased, with the default port filled in
+inline std::string http_pool_key(const std::string &url)
+{
+    std::string u;
+    for (char c : url)
+        u += (char)std::tolower((unsigned char)c);
+
+    size_t p = u.find("://");
+    if (p == std::string::npos)
+        return std::string();
+    std::string scheme = u.substr(0, p);
+    std::string authority = u.substr(p + 3, u.find_first_of("/?#", p + 3) - (p + 3));
+
+    size_t at = authority.rfind('@');
+    if (at != std::string::npos)
+        authority.erase(0, at + 1);
+
+    size_t colon = authority.rfind(':');
+    if (colon == std::string::npos || authority.find(']', colon) != std::string::npos)
+        authority += scheme == "https" ? ":443" : ":80";
+
+    return scheme + "://" + authority;
+}
+
+template <typename T>
+class httpClientPool
+{
+private:
+    struct entry
+    {
+        std::string key;
+        T conn;
+        uint64_t idle_since;
+    };
+
+    std::vector<entry> _idle;
+    std::mutex _mutex;
+    void (*_destroy)(T &conn);
+
+public:
+    httpClientPool(void (*destroy)(T &conn)) : _destroy(destroy) {}
+
+    // Take an idle connection to key's origin, if one is parked and still fresh
+    bool acquire(const std::string &key, T &conn)
+    {
+        expire();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        // Prefer the most recently parked connection, it's the least likely to have been closed
+        for (auto it = _idle.rbegin(); it != _idle.rend(); ++it)
+        {
+            if (it->key == key)
+            {
+                conn = it->conn;
+                _idle.erase(std::next(it).base());
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Park a connection that's between requests, evicting the oldest if full
+    void release(const std::string &key, T conn)
+    {
+        expire();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_idle.size() >= HTTP_POOL_MAX_IDLE)
+        {
+            _destroy(_idle.front().conn);
+            _idle.erase(_idle.begin());
+        }
+        _idle.push_back({key, conn, fnSystem.millis()});
+    }
+
+    // Close connections that have sat idle too long
+    void expire()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint64_t now = fnSystem.millis();
+        for (auto it = _idle.begin(); it != _idle.end();)
+        {
+            if (now - it->idle_since > HTTP_POOL_IDLE_MS)
+            {
+                _destroy(it->conn);
+                it = _idle.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+};
+
+// Called from the main service loop, closes expired idle connections
+void http_client_pool_expire();
+
+#endif // _HTTP_CLIENT_POOL_H_
@@ -0,0 +1,142 @@
+#include "httpFileWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "../../include/debug.h"
+
+struct uploadBuffer
+{
+    char *data;
+    int len; // data == nullptr marks the end of the upload
+};
+
+struct uploadPipe
+{
+    FILE *f;
+    QueueHandle_t full;
+    QueueHandle_t empty;
+    SemaphoreHandle_t done;
+    volatile int err;
+};
+
+// Writes received buffers to the file and hands them back to the reader
+static void uploadWriterTask(void *arg)
+{
+    uploadPipe *pipe = (uploadPipe *)arg;
+    uploadBuffer b;
+
+    while (xQueueReceive(pipe->full, &b, portMAX_DELAY) == pdTRUE && b.data != nullptr)
+    {
+        if (pipe->err == 0 && fwrite(b.data, 1, b.len, pipe->f) != (size_t)b.len)
+            pipe->err = errno ? errno : EIO;
+        xQueueSend(pipe->empty, &b, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(pipe->done);
+    vTaskDelete(NULL);
+}
+
+bool upload_preallocate(FILE *f, size_t size)
+{
+    if (size == 0)
+        return true;
+    return fseek(f, size - 1, SEEK_SET) == 0 && fputc(0, f) != EOF && fseek(f, 0, SEEK_SET) == 0;
+}
+
+// Whole buffers are written, so writes stay on UPLOAD_BUFFER_SIZE boundaries
+int upload_write_pipelined(FILE *f, size_t remaining, const upload_reader &read)
+{
+    uploadPipe pipe = {f, nullptr, nullptr, nullptr, 0};
+    uploadBuffer pool[UPLOAD_BUFFER_COUNT] = {};
+    int ret = -2;
+
+    // DMA capable memory, the SD driver goes sector by sector through a bounce buffer otherwise
+    for (auto &b : pool)
+        if ((b.data = (char *)heap_caps_malloc(UPLOAD_BUFFER_SIZE, MALLOC_CAP_DMA)) == nullptr)
+            goto cleanup;
+
+    pipe.full = xQueueCreate(UPLOAD_BUFFER_COUNT + 1, sizeof(uploadBuffer));
+    pipe.empty = xQueueCreate(UPLOAD_BUFFER_COUNT, sizeof(uploadBuffer));
+    pipe.done = xSemaphoreCreateBinary();
+    if (!pipe.full || !pipe.empty || !pipe.done)
+        goto cleanup;
+
+    for (auto &b : pool)
+        xQueueSend(pipe.empty, &b, 0);
+
+    if (xTaskCreate(uploadWriterTask, "upload_write", 3072, &pipe, uxTaskPriorityGet(NULL), NULL) != pdPASS)
+        goto cleanup;
+
+    ret = 0;
+    while (remaining > 0 && pipe.err == 0)
+    {
+        uploadBuffer b;
+        xQueueReceive(pipe.empty, &b, portMAX_DELAY);
+
+        b.len = read(b.data, (int)std::min(remaining, (size_t)UPLOAD_BUFFER_SIZE));
+        if (b.len <= 0)
+        {
+            Debug_printf("upload ended with %u bytes to go\n", (unsigned)remaining);
+            xQueueSend(pipe.empty, &b, 0);
+            ret = -1;
+            break;
+        }
+
+        remaining -= b.len;
+        xQueueSend(pipe.full, &b, portMAX_DELAY);
+    }
+
+    {
+        uploadBuffer end = {nullptr, 0};
+        xQueueSend(pipe.full, &end, portMAX_DELAY);
+        xSemaphoreTake(pipe.done, portMAX_DELAY);
+    }
+
+    if (pipe.err != 0)
+    {
+        Debug_printf("upload write failed, errno %d\n", pipe.err);
+        ret = -1;
+    }
+
+cleanup:
+    if (pipe.done)
+        vSemaphoreDelete(pipe.done);
+    if (pipe.empty)
+        vQueueDelete(pipe.empty);
+    if (pipe.full)
+        vQueueDelete(pipe.full);
+    for (auto &b : pool)
+        heap_caps_free(b.data);
+
+    return ret;
+}
+
+int upload_write_sequential(FILE *f, size_t remaining, const upload_reader &read)
+{
+    char *chunk = (char *)malloc(UPLOAD_BUFFER_SIZE);
+    if (!chunk)
+        return -1;
+
+    int ret = 0;
+    while (remaining > 0)
+    {
+        int r = read(chunk, (int)std::min(remaining, (size_t)UPLOAD_BUFFER_SIZE));
+        if (r <= 0 || fwrite(chunk, 1, r, f) != (size_t)r)
+        {
+            ret = -1;
+            break;
+        }
+        remaining -= r;
+    }
+
+    free(chunk);
+    return ret;
+}
@@ -0,0 +1,33 @@
+#ifndef _HTTP_FILE_WRITER_H_
+#define _HTTP_FILE_WRITER_H_
+
+/*
+ * Writing an upload body to a file on the SD card, shared by the WebDAV PUT
+ * handler and the web UI's /upload. The body is received into one buffer
+ * while a writer task puts the one before it on the card.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+
+// Bodies are received into one of these while the SD card writes another
+#define UPLOAD_BUFFER_SIZE 8192
+#define UPLOAD_BUFFER_COUNT 3
+
+// Fills up to len bytes of buf, short only at the end of the body or on error.
+// Returns the count or -1
+typedef std::function<int(char *buf, int len)> upload_reader;
+
+// Claims size bytes for f up front, so FAT clusters aren't allocated one write
+// at a time. f is left at the start
+bool upload_preallocate(FILE *f, size_t size);
+
+// Writes remaining bytes from read to f. Returns 0, -1 on failure or -2 if
+// there's no memory for the pipeline (nothing has been read then)
+int upload_write_pipelined(FILE *f, size_t remaining, const upload_reader &read);
+
+// Receive and write in turn with a single buffer, when the pipeline can't be set up
+int upload_write_sequential(FILE *f, size_t remaining, const upload_reader &read);
+
+#endif // _HTTP_FILE_WRITER_H_
@@ -0,0 +1,81 @@
+#ifndef _HTTP_RANGE_H_
+#define _HTTP_RANGE_H_
+
+/*
+ * Helpers for HTTP byte range requests (RFC 9110 section 14)
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Value for a "Range" request header asking for bytes first..last, inclusive
+inline std::string http_range_value(uint32_t first, uint32_t last)
+{
+    char str[40];
+    snprintf(str, sizeof str, "bytes=%lu-%lu", (unsigned long)first, (unsigned long)last);
+    return std::string(str);
+}
+
+// Complete size from a "Content-Range" response header value such as
+// "bytes 0-4095/174720", or -1 if it isn't given ("bytes 0-4095/*")
+inline long http_content_range_size(const char *value)
+{
+    const char *slash = value != nullptr ? strrchr(value, '/') : nullptr;
+    if (slash == nullptr || slash[1] < '0' || slash[1] > '9')
+        return -1;
+    return strtol(slash + 1, nullptr, 10);
+}
+
+// Parses a "Range" request header for a resource of size bytes into the
+// inclusive first..last. Returns 1 for a usable single range, 0 when the
+// header should be ignored (missing, not bytes or more than one range) and
+// -1 when the range can't be satisfied (answered with a 416)
+inline int http_parse_range(const char *value, long size, long &first, long &last)
+{
+    if (value == nullptr || strncmp(value, "bytes=", 6) != 0 || strchr(value, ',') != nullptr)
+        return 0;
+
+    const char *p = value + 6;
+    char *end;
+    if (*p == '-')
+    {
+        // suffix range, the last n bytes
+        long n = strtol(p + 1, &end, 10);
+        if (end == p + 1 || *end != '\0')
+            return 0;
+        if (n <= 0 || size == 0)
+            return -1;
+        first = n < size ? size - n : 0;
+        last = size - 1;
+        return 1;
+    }
+
+    first = strtol(p, &end, 10);
+    if (end == p || *end != '-')
+        return 0;
+    p = end + 1;
+    if (*p == '\0')
+        last = size - 1;
+    else
+    {
+        last = strtol(p, &end, 10);
+        if (*end != '\0' || last < first)
+            return 0;
+        if (last >= size)
+            last = size - 1;
+    }
+    return first < size ? 1 : -1;
+}
+
+// Value for a "Content-Range" response header, bytes first..last of size
+inline std::string http_content_range_value(long first, long last, long size)
+{
+    char str[64];
+    snprintf(str, sizeof str, "bytes %ld-%ld/%ld", first, last, size);
+    return std::string(str);
+}
+
+#endif // _HTTP_RANGE_H_
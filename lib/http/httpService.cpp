@@ -4,6 +4,10 @@
 
 #include "httpService.h"
 
+#include <algorithm>
+#include <atomic>
+#include <esp_idf_version.h>
+#include <mutex>
 #include <sstream>
 #include <vector>
 
@@ -22,7 +26,18 @@
 #include "printer.h"
 #include "httpServiceConfigurator.h"
 #include "httpServiceParser.h"
+#include "httpServiceApi.h"
+#include "fnEvents.h"
+#include "httpFileWriter.h"
+#include "fnFsSD.h"
 #include "fuji.h"
+#include "fujiCopyTask.h"
+#include "busStats.h"
+#include "httpTlsStats.h"
+#include "fnArena.h"
+#ifdef BUILD_ATARI
+#include "sio/sioTrace.h"
+#endif
 
 using namespace std;
 
@@ -240,21 +255,23 @@ void fnHttpService::send_file_parsed(httpd_req_t *req, const char *filename)
     {
         // Set the response content type
         set_file_content_type(req, filename);
-        // We're going to load the whole thing into memory, so watch out for big files!
-        size_t sz = FileSystem::filesize(fInput) + 1;
-        char *buf = (char *)calloc(sz, 1);
+        // Stream the template out a chunk at a time instead of loading it
+        char *buf = (char *)malloc(FNWS_SEND_BUFF_SIZE);
         if (buf == NULL)
         {
-            Debug_printf("Couldn't allocate %u bytes to load file contents!\n", sz);
+            Debug_printf("Couldn't allocate %u bytes to send file contents!\n", FNWS_SEND_BUFF_SIZE);
             err = fnwserr_memory;
         }
         else
         {
-            fread(buf, 1, sz, fInput);
-            string contents(buf);
-            contents = fnHttpServiceParser::parse_contents(contents);
-
-            httpd_resp_send(req, contents.c_str(), contents.length());
+            if (!fnHttpServiceParser::render(fInput, filename, pState->_FS->modified_time(filename),
+                                             buf, FNWS_SEND_BUFF_SIZE,
+                                             [req](const char *data, size_t len) {
+                                                 return httpd_resp_send_chunk(req, data, len) == ESP_OK;
+                                             }))
+                Debug_printf("Failed sending parsed file '%s'\n", filename);
+            // Ends the chunked response, even a short one
+            httpd_resp_send_chunk(req, nullptr, 0);
         }
         free(buf);
     }
@@ -284,32 +301,166 @@ void fnHttpService::send_file(httpd_req_t *req, const char *filename)
     // Retrieve server state
     serverstate *pState = (serverstate *)httpd_get_global_user_ctx(req->handle);
 
-    FILE *fInput = pState->_FS->file_open(fpath.c_str());
+    /* build_webui.py leaves a gzipped copy of the static assets next to them.
+     The CRC and size of the original in its trailer make a strong ETag, so
+     a reload gets a 304 without sending either file
+    */
+    char etag[32] = "";
+    bool send_gzip = false;
+    FILE *fGzip = pState->_FS->file_open((fpath + ".gz").c_str());
+    if (fGzip != nullptr)
+    {
+        uint8_t trailer[8];
+        if (fseek(fGzip, -8, SEEK_END) == 0 && fread(trailer, 1, sizeof(trailer), fGzip) == sizeof(trailer))
+        {
+            char accept[64] = "";
+            httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept));
+            send_gzip = strstr(accept, "gzip") != nullptr;
+
+            uint32_t crc = trailer[0] | trailer[1] << 8 | trailer[2] << 16 | (uint32_t)trailer[3] << 24;
+            uint32_t isize = trailer[4] | trailer[5] << 8 | trailer[6] << 16 | (uint32_t)trailer[7] << 24;
+            // The two encodings are different bytes, so need different tags
+            snprintf(etag, sizeof(etag), "\"%08lx-%lx%s\"", (unsigned long)crc, (unsigned long)isize,
+                     send_gzip ? "-gz" : "");
+        }
+        if (!send_gzip)
+        {
+            fclose(fGzip);
+            fGzip = nullptr;
+        }
+        else
+            fseek(fGzip, 0, SEEK_SET);
+    }
+
+    if (etag[0] != '\0')
+    {
+        httpd_resp_set_hdr(req, "ETag", etag);
+        // Always check back, as a firmware update can change any file
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+        httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+        char match[sizeof(etag)] = "";
+        if (httpd_req_get_hdr_value_str(req, "If-None-Match", match, sizeof(match)) == ESP_OK &&
+            strcmp(match, etag) == 0)
+        {
+            if (fGzip != nullptr)
+                fclose(fGzip);
+            httpd_resp_set_status(req, "304 Not Modified");
+            httpd_resp_send(req, nullptr, 0);
+            return;
+        }
+    }
+
+    FILE *fInput = send_gzip ? fGzip : pState->_FS->file_open(fpath.c_str());
     if (fInput == nullptr)
     {
         Debug_printf("Failed to open file for sending: '%s'\n", fpath.c_str());
         return_http_error(req, fnwserr_fileopen);
+        return;
     }
-    else
+
+    file_send_job *job = new file_send_job;
+    job->file = fInput;
+    // The content type based on the file extension
+    job->content_type = find_mimetype_str(get_extension(fpath.c_str()));
+    if (etag[0] != '\0')
     {
-        // Set the response content type
-        set_file_content_type(req, fpath.c_str());
-        // Set the expected length of the content
-        char hdrval[10];
-        snprintf(hdrval, 10, "%ld", FileSystem::filesize(fInput));
-        httpd_resp_set_hdr(req, "Content-Length", hdrval);
+        job->headers.emplace_back("ETag", etag);
+        job->headers.emplace_back("Cache-Control", "no-cache");
+        job->headers.emplace_back("Vary", "Accept-Encoding");
+    }
+    if (send_gzip)
+        job->headers.emplace_back("Content-Encoding", "gzip");
+    // The expected length of the content
+    job->headers.emplace_back("Content-Length", std::to_string(FileSystem::filesize(fInput)));
 
-        // Send the file content out in chunks
-        char *buf = (char *)malloc(FNWS_SEND_BUFF_SIZE);
-        size_t count = 0;
+    start_file_send(req, job);
+}
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+#define FNWS_ASYNC_SEND // httpd_req_async_handler_begin() is new in IDF 5.1
+#endif
+
+static std::atomic<int> _async_sends{0};
+
+/* Sends job->file and frees the job, from a task of its own when the file is
+ large and there's room for another, otherwise from this httpd worker
+*/
+void fnHttpService::start_file_send(httpd_req_t *req, file_send_job *job)
+{
+#ifdef FNWS_ASYNC_SEND
+    long size = FileSystem::filesize(job->file);
+    if (size < 0 || size >= FNWS_ASYNC_SEND_MIN)
+    {
+        if (_async_sends.fetch_add(1) < FNWS_MAX_ASYNC_SENDS)
+        {
+            // A copy of req that stays valid after this handler returns
+            if (httpd_req_async_handler_begin(req, &job->req) == ESP_OK)
+            {
+                if (xTaskCreate(file_send_task, "http_send", 3072, job, uxTaskPriorityGet(NULL), NULL) == pdPASS)
+                    return;
+                httpd_req_async_handler_complete(job->req);
+                Debug_println("Failed to start file send task");
+            }
+            else
+                Debug_println("Failed to begin async file send");
+        }
+        _async_sends--;
+    }
+#endif
+
+    job->req = req;
+    run_file_send(job);
+}
+
+void fnHttpService::run_file_send(file_send_job *job)
+{
+    httpd_req_t *req = job->req;
+    // Headers are only set now, on the request they'll be sent with
+    if (job->content_type != nullptr)
+        httpd_resp_set_type(req, job->content_type);
+    for (const auto &h : job->headers)
+        httpd_resp_set_hdr(req, h.first.c_str(), h.second.c_str());
+
+    // Send the file content out in chunks
+    char *buf = (char *)malloc(FNWS_SEND_BUFF_SIZE);
+    size_t count = 0, total = 0;
+    if (buf != nullptr)
+    {
         do
         {
-            count = fread(buf, 1, FNWS_SEND_BUFF_SIZE, fInput);
-            httpd_resp_send_chunk(req, buf, count);
+            count = fread(buf, 1, FNWS_SEND_BUFF_SIZE, job->file);
+            total += count;
+            // Give up on a client that has gone away
+            if (httpd_resp_send_chunk(req, buf, count) != ESP_OK)
+                break;
         } while (count > 0);
-        fclose(fInput);
         free(buf);
     }
+    else
+        Debug_printf("Couldn't allocate %u bytes to send file contents!\n", FNWS_SEND_BUFF_SIZE);
+    fclose(job->file);
+
+#ifdef VERBOSE_HTTP
+    Debug_printf("Sent %u bytes total from file\n", total);
+#endif
+
+    if (job->on_done)
+        job->on_done();
+    delete job;
+}
+
+void fnHttpService::file_send_task(void *arg)
+{
+#ifdef FNWS_ASYNC_SEND
+    file_send_job *job = (file_send_job *)arg;
+    httpd_req_t *req = job->req;
+
+    run_file_send(job);
+    httpd_req_async_handler_complete(req);
+    _async_sends--;
+#endif
+    vTaskDelete(NULL);
 }
 
 void fnHttpService::parse_query(httpd_req_t *req, queryparts *results)
@@ -507,56 +658,44 @@ esp_err_t fnHttpService::get_handler_print(httpd_req_t *req)
         exts = "bin";
     }
 
+    // "/print?page=N" fetches a finished page on its own and leaves the printout going
+    queryparts qp;
+    parse_query(req, &qp);
+    int page = atoi(qp.query_parsed["page"].c_str());
+
     string filename = "printout.";
+    if (page > 0)
+        filename = "printout-" + std::to_string(page) + ".";
     filename += exts;
 
     // Tell printer to finish its output and get a read handle to the file
-    FILE *poutput = currentPrinter->closeOutputAndProvideReadHandle();
+    FILE *poutput = page > 0 ? currentPrinter->providePageReadHandle(page) : currentPrinter->closeOutputAndProvideReadHandle();
     if (poutput == nullptr)
     {
-        fnHTTPD.addToErrMsg("Unable to open printer output.\n");
+        fnHTTPD.addToErrMsg(page > 0 ? "That page isn't available yet.\n" : "Unable to open printer output.\n");
         send_file(req, "error_page.html");
         return ESP_OK;
     }
 
+    file_send_job *job = new file_send_job;
+    job->file = poutput;
     // Set the expected content type based on the filename/extension
-    set_file_content_type(req, filename.c_str());
-
-    char hdrval1[60];
+    job->content_type = find_mimetype_str(get_extension(filename.c_str()));
     if (sendAsAttachment)
     {
         // Add a couple of attchment-specific details
-        snprintf(hdrval1, sizeof(hdrval1), "attachment; filename=\"%s\"", filename.c_str());
-        httpd_resp_set_hdr(req, "Content-Disposition", hdrval1);
+        job->headers.emplace_back("Content-Disposition", "attachment; filename=\"" + filename + "\"");
     }
     // NOTE: Don't set the Content-Length, as it's invalid when using CHUNKED
 
-    // Finally, write the data
-    // Send the file content out in chunks
-    char *buf = (char *)malloc(FNWS_SEND_BUFF_SIZE);
-    size_t count = 0, total = 0;
-    do
-    {
-        count = fread((uint8_t *)buf, 1, FNWS_SEND_BUFF_SIZE, poutput);
-        // count = currentPrinter->readFromOutput((uint8_t *)buf, FNWS_SEND_BUFF_SIZE);
-        total += count;
-
-        // Debug_printf("Read %u bytes from print file\n", count);
-
-        httpd_resp_send_chunk(req, buf, count);
-    } while (count > 0);
-
-#ifdef VERBOSE_HTTP
-    Debug_printf("Sent %u bytes total from print file\n", total);
-#endif
-
-    free(buf);
-    fclose(poutput);
-
-    // Tell the printer it can start writing from the beginning
-    printer->reset_printer(); // destroy,create new printer emulator object of previous type.
+    // Tell the printer it can start writing from the beginning, once it's all sent
+    if (page == 0)
+        job->on_done = [printer]() {
+            printer->reset_printer(); // destroy,create new printer emulator object of previous type.
+            Debug_println("Print request completed");
+        };
 
-    Debug_println("Print request completed");
+    start_file_send(req, job);
 
     return ESP_OK;
 }
@@ -622,6 +761,238 @@ esp_err_t fnHttpService::get_handler_modem_sniffer(httpd_req_t *req)
     return ESP_OK;
 }
 
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+// The live view's session context: closing the session takes its listener off the sniffer
+struct sniffer_ws_ctx
+{
+    ModemSniffer *sniffer;
+    uint32_t session;
+};
+
+static std::mutex _sniffer_ws_mutex;
+static uint32_t _sniffer_ws_session = 0; // the live view the listener writes to
+
+static void sniffer_ws_closed(void *ctx)
+{
+    sniffer_ws_ctx *c = (sniffer_ws_ctx *)ctx;
+    {
+        // A newer live view may have taken over the listener already
+        std::lock_guard<std::mutex> lock(_sniffer_ws_mutex);
+        if (c->session == _sniffer_ws_session)
+            c->sniffer->setListener(nullptr);
+    }
+    Debug_printf("Modem sniffer live view %u closed\n", (unsigned)c->session);
+    delete c;
+}
+
+esp_err_t fnHttpService::get_handler_modem_sniffer_ws(httpd_req_t *req)
+{
+    ModemSniffer *modemSniffer = sioR->get_modem_sniffer();
+
+    if (req->method == HTTP_GET)
+    {
+        // Handshake done, the sniffer writes each block of log text to this
+        // socket from its own task from now on, until the session closes
+        httpd_handle_t hd = req->handle;
+        int fd = httpd_req_to_sockfd(req);
+
+        std::lock_guard<std::mutex> lock(_sniffer_ws_mutex);
+        sniffer_ws_ctx *ctx = new sniffer_ws_ctx{modemSniffer, ++_sniffer_ws_session};
+        req->sess_ctx = ctx;
+        req->free_ctx = sniffer_ws_closed;
+
+        Debug_printf("Modem sniffer live view %u on socket %d\n", (unsigned)ctx->session, fd);
+        modemSniffer->setListener([hd, fd](const char *text, size_t len) {
+            // Gone, or the socket number was reused by a plain HTTP request
+            if (httpd_ws_get_fd_info(hd, fd) != HTTPD_WS_CLIENT_WEBSOCKET)
+                return false;
+            httpd_ws_frame_t ws_pkt;
+            memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+            ws_pkt.type = HTTPD_WS_TYPE_TEXT;
+            ws_pkt.payload = (uint8_t *)text;
+            ws_pkt.len = len;
+            return httpd_ws_send_frame_async(hd, fd, &ws_pkt) == ESP_OK;
+        });
+        return ESP_OK;
+    }
+
+    // Nothing is expected from the browser
+    return ws_drop_frame(req);
+}
+
+// Read and drop a frame the browser sent
+esp_err_t fnHttpService::ws_drop_frame(httpd_req_t *req)
+{
+    httpd_ws_frame_t ws_pkt;
+    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+    esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 0);
+    if (ret != ESP_OK || ws_pkt.len == 0)
+        return ret;
+
+    uint8_t *buf = (uint8_t *)malloc(ws_pkt.len);
+    if (buf == NULL)
+        return ESP_ERR_NO_MEM;
+    ws_pkt.payload = buf;
+    ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
+    free(buf);
+
+    return ret;
+}
+
+static std::mutex _event_clients_mutex;
+static std::vector<int> _event_clients;
+
+// Each event as a JSON text frame to every browser listening on /events
+void fnHttpService::send_event(const fn_event &event)
+{
+    httpd_handle_t hd = fnHTTPD.state.hServer;
+    std::lock_guard<std::mutex> lock(_event_clients_mutex);
+    if (hd == nullptr || _event_clients.empty())
+        return;
+
+    std::string json = fnEventBus::to_json(event);
+    httpd_ws_frame_t ws_pkt;
+    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+    ws_pkt.type = HTTPD_WS_TYPE_TEXT;
+    ws_pkt.payload = (uint8_t *)json.data();
+    ws_pkt.len = json.length();
+
+    for (auto it = _event_clients.begin(); it != _event_clients.end();)
+    {
+        // Gone, or the socket number was reused by a plain HTTP request
+        if (httpd_ws_get_fd_info(hd, *it) != HTTPD_WS_CLIENT_WEBSOCKET ||
+            httpd_ws_send_frame_async(hd, *it, &ws_pkt) != ESP_OK)
+            it = _event_clients.erase(it);
+        else
+            ++it;
+    }
+}
+
+esp_err_t fnHttpService::get_handler_events_ws(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET)
+    {
+        // Handshake done, send_event() writes to this socket from now on
+        int fd = httpd_req_to_sockfd(req);
+        Debug_printf("Event listener on socket %d\n", fd);
+        std::lock_guard<std::mutex> lock(_event_clients_mutex);
+        _event_clients.push_back(fd);
+        return ESP_OK;
+    }
+
+    return ws_drop_frame(req);
+}
+#endif /* CONFIG_HTTPD_WS_SUPPORT */
+
+// /copy?hostslot=N&path=...&desthostslot=M&destpath=... starts a background copy,
+// /copy on its own reports how the last one is going
+esp_err_t fnHttpService::get_handler_copy(httpd_req_t *req)
+{
+    queryparts qp;
+    int result = 0;
+
+    parse_query(req, &qp);
+
+    if (qp.query_parsed.find("path") != qp.query_parsed.end())
+    {
+        int hs = atoi(qp.query_parsed["hostslot"].c_str());
+        int dhs = atoi(qp.query_parsed["desthostslot"].c_str());
+
+        if (hs < 0 || hs >= MAX_HOSTS || dhs < 0 || dhs >= MAX_HOSTS || qp.query_parsed["destpath"].empty())
+            result = -1;
+        else if (!fujiCopyTask::submit(theFuji.get_hosts(hs), qp.query_parsed["path"],
+                                       theFuji.get_hosts(dhs), qp.query_parsed["destpath"]))
+            result = -1;
+    }
+
+    fujiCopyStatus status = fujiCopyTask::status();
+    char response[96];
+    snprintf(response, sizeof(response), "{\"result\": %d, \"state\": %d, \"copied\": %u, \"total\": %u}\n",
+             result, status.state, (unsigned)status.copied, (unsigned)status.total);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, response);
+    return ESP_OK;
+}
+
+// Per-device bus command counts and service times, ?clear=1 starts over after reporting
+esp_err_t fnHttpService::get_handler_stats(httpd_req_t *req)
+{
+    queryparts qp;
+    parse_query(req, &qp);
+
+    std::string extra = "\"tls\":" + tls_stats.to_json();
+    extra += ",\"arenas\":" + fnArena.to_json();
+#ifdef BUILD_IEC
+    extra += ",\"fastload\":" + IEC.fastload_stats_json();
+    extra += ",\"atn\":" + IEC.atn_stats_json();
+#endif
+#ifdef ESP_PLATFORM
+    extra += ",\"wifi\":" + fnWiFi.time_to_ip_json();
+    extra += ",\"wifi_power_save\":" + fnWiFi.power_save_json();
+#endif
+    std::string json = bus_stats.to_json(extra);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json.c_str(), json.length());
+
+    if (qp.query_parsed["clear"] == "1")
+    {
+        bus_stats.clear();
+        tls_stats.clear();
+#ifdef BUILD_IEC
+        IEC.clearFastLoadStats();
+#ifdef IEC_ATN_STATS
+        IEC.clearATNStats();
+#endif
+#endif
+    }
+    return ESP_OK;
+}
+
+// /api/hosts, /api/slots and /api/status as JSON, 304 when the client has it already
+esp_err_t fnHttpService::get_handler_api(httpd_req_t *req)
+{
+    std::string path(req->uri, strcspn(req->uri, "?"));
+    std::string json;
+    if (!fnHttpServiceApi::get(path, json))
+    {
+        httpd_resp_send_404(req);
+        return ESP_OK;
+    }
+
+    std::string etag = fnHttpServiceApi::etag(json);
+    httpd_resp_set_hdr(req, "ETag", etag.c_str());
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    char match[32] = "";
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", match, sizeof(match)) == ESP_OK && etag == match)
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        httpd_resp_send(req, nullptr, 0);
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json.c_str(), json.length());
+    return ESP_OK;
+}
+
+#if defined(BUILD_ATARI) && defined(SIO_TRACE)
+// SIO command timing, ?clear=1 starts over after reporting
+esp_err_t fnHttpService::get_handler_siotrace(httpd_req_t *req)
+{
+    queryparts qp;
+    parse_query(req, &qp);
+
+    std::string json = sio_trace.to_json();
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json.c_str(), json.length());
+
+    if (qp.query_parsed["clear"] == "1")
+        sio_trace.clear();
+    return ESP_OK;
+}
+#endif
+
 esp_err_t fnHttpService::get_handler_mount(httpd_req_t *req)
 {
     queryparts qp;
@@ -713,6 +1084,7 @@ esp_err_t fnHttpService::get_handler_mount(httpd_req_t *req)
                 Config.save();
                 theFuji._populate_slots_from_config(); // otherwise they don't show up in config.
                 disk_dev->device_active = true;
+                fnEvents.publish(fn_event_type::MOUNT, ds);
             }
         }
         else
@@ -776,6 +1148,7 @@ esp_err_t fnHttpService::get_handler_eject(httpd_req_t *req)
     Config.save();
     theFuji._populate_slots_from_config(); // otherwise they don't show up in config.
     disk_dev->device_active = false;
+    fnEvents.publish(fn_event_type::EJECT, ds);
 
     // Finally, scan all device slots, if all empty, and config enabled, enable the config device.
     if (Config.get_general_config_enabled())
@@ -1250,6 +1623,183 @@ esp_err_t fnHttpService::get_handler_shorturl(httpd_req_t *req)
     return ESP_OK;
 }
 
+// Fills up to len bytes of buf from the request body, short only at the end or on error
+static int upload_recv(httpd_req_t *req, char *buf, int len)
+{
+    int got = 0, retries = 0;
+    while (got < len)
+    {
+        int r = httpd_req_recv(req, buf + got, len - got);
+        if (r == HTTPD_SOCK_ERR_TIMEOUT && ++retries <= FNWS_UPLOAD_RETRIES)
+            continue;
+        if (r <= 0)
+            return -1;
+        retries = 0;
+        got += r;
+    }
+    return got;
+}
+
+// Puts the finished upload tmp in place of path. A file already there is only removed once the new one has its name
+static bool upload_replace(const std::string &tmp, const std::string &path)
+{
+    std::string old = path + ".old";
+    bool had_old = fnSDFAT.exists(path.c_str());
+    if (had_old)
+    {
+        fnSDFAT.remove(old.c_str());
+        if (!fnSDFAT.rename(path.c_str(), old.c_str()))
+            return false;
+    }
+    if (!fnSDFAT.rename(tmp.c_str(), path.c_str()))
+    {
+        if (had_old)
+            fnSDFAT.rename(old.c_str(), path.c_str());
+        return false;
+    }
+    if (had_old)
+        fnSDFAT.remove(old.c_str());
+    return true;
+}
+
+/* POST /upload?path=/dir/ with a multipart/form-data body holding one file.
+ The file goes to the SD card as it arrives, never all in memory. The body
+ length and the closing boundary give the file size up front, so the file
+ is preallocated. It's written under a temporary name and only replaces a
+ file of the same name once all of it is in. Replies with the size and how
+ fast it went as JSON
+*/
+esp_err_t fnHttpService::post_handler_upload(httpd_req_t *req)
+{
+    queryparts qp;
+    parse_query(req, &qp);
+
+    std::string dir = qp.query_parsed["path"];
+    if (dir.empty() || dir.back() != '/')
+        dir += '/';
+    if (dir.find("..") != std::string::npos)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad path");
+        return ESP_OK;
+    }
+    if (!fnSDFAT.running())
+    {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No SD card");
+        return ESP_OK;
+    }
+
+    char ctype[160] = "";
+    httpd_req_get_hdr_value_str(req, "Content-Type", ctype, sizeof(ctype));
+    const char *b = strstr(ctype, "boundary=");
+    if (b == nullptr)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected multipart/form-data");
+        return ESP_OK;
+    }
+    std::string boundary(b + 9, strcspn(b + 9, ";"));
+    if (boundary.length() > 1 && boundary.front() == '"')
+        boundary = boundary.substr(1, boundary.length() - 2);
+    // What follows the file: CRLF, the boundary and "--" CRLF
+    std::string delimiter = "\r\n--" + boundary;
+    size_t trailer = delimiter.length() + 4;
+
+    // The part's headers, and maybe the start of the file after them
+    char head[FNWS_UPLOAD_HEAD_MAX + 1];
+    size_t have = 0, header_end = 0;
+    const char *blank = nullptr;
+    while (blank == nullptr && have < FNWS_UPLOAD_HEAD_MAX && have < req->content_len)
+    {
+        int r = httpd_req_recv(req, head + have, std::min((size_t)FNWS_UPLOAD_HEAD_MAX - have, req->content_len - have));
+        if (r == HTTPD_SOCK_ERR_TIMEOUT)
+            continue;
+        if (r <= 0)
+            return ESP_FAIL;
+        have += r;
+        head[have] = '\0';
+        blank = strstr(head, "\r\n\r\n");
+    }
+    const char *fn = blank ? strstr(head, "filename=\"") : nullptr;
+    if (fn == nullptr || fn > blank)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No file in upload");
+        return ESP_OK;
+    }
+    header_end = blank + 4 - head;
+    std::string filename(fn + 10, strcspn(fn + 10, "\""));
+    // Browsers may send a path, only the name is wanted
+    size_t slash = filename.find_last_of("/\\");
+    if (slash != std::string::npos)
+        filename.erase(0, slash + 1);
+    if (filename.empty() || filename == ".." || req->content_len < header_end + trailer)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad upload");
+        return ESP_OK;
+    }
+    size_t file_size = req->content_len - header_end - trailer;
+
+    std::string path = dir + filename;
+    std::string tmp = path + ".part";
+    FILE *f = fnSDFAT.file_open(tmp.c_str(), FILE_WRITE);
+    if (f == nullptr)
+    {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Can't create file");
+        return ESP_OK;
+    }
+    Debug_printf("Uploading %u bytes to SD '%s'\n", (unsigned)file_size, path.c_str());
+
+    // Whatever came in with the headers goes first
+    size_t held = header_end;
+    auto read = [&](char *buf, int len) -> int {
+        int got = std::min((size_t)len, have - held);
+        memcpy(buf, head + held, got);
+        held += got;
+        if (got == len)
+            return got;
+        int r = upload_recv(req, buf + got, len - got);
+        return r < 0 ? -1 : got + r;
+    };
+
+    uint64_t started = fnSystem.millis();
+    int ret = -1;
+    if (upload_preallocate(f, file_size))
+    {
+        ret = upload_write_pipelined(f, file_size, read);
+        if (ret == -2)
+            ret = upload_write_sequential(f, file_size, read);
+    }
+    fclose(f);
+
+    // The rest must be the closing boundary, or the size was worked out wrong
+    if (ret == 0)
+    {
+        std::string rest(trailer, '\0');
+        if (read(&rest[0], trailer) != (int)trailer || rest.compare(0, delimiter.length(), delimiter) != 0)
+            ret = -1;
+    }
+
+    if (ret == 0 && !upload_replace(tmp, path))
+        ret = -1;
+
+    if (ret != 0)
+    {
+        // Don't leave a preallocated file around that looks complete, what was there before stays
+        fnSDFAT.remove(tmp.c_str());
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Upload failed");
+        return ESP_OK;
+    }
+
+    uint64_t ms = fnSystem.millis() - started;
+    unsigned long kbps = ms ? (unsigned long)(file_size / ms) : 0; // bytes per ms is KB/s
+    Debug_printf("Uploaded %u bytes in %lu ms, %lu KB/s\n", (unsigned)file_size, (unsigned long)ms, kbps);
+
+    char json[96];
+    snprintf(json, sizeof(json), "{\"result\":0,\"bytes\":%u,\"ms\":%lu,\"kBps\":%lu}",
+             (unsigned)file_size, (unsigned long)ms, kbps);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json);
+    return ESP_OK;
+}
+
 esp_err_t fnHttpService::post_handler_config(httpd_req_t *req)
 {
 #ifdef VERBOSE_HTTP
@@ -1335,7 +1885,7 @@ esp_err_t fnHttpService::webdav_handler(httpd_req_t *httpd_req)
         break;
     case HTTP_GET:
         ret = server->doGet(req, resp);
-        if ( ret == 200 )
+        if ( ret == 200 || ret == 206 )
             return ESP_OK;
         break;
     case HTTP_HEAD:
@@ -1377,6 +1927,7 @@ esp_err_t fnHttpService::webdav_handler(httpd_req_t *httpd_req)
     if ( (ret > 399) & (httpd_req->method != HTTP_HEAD) )
     {
         // Send error
+        resp.flushHeaders();
         httpd_resp_send(httpd_req, NULL, 0);
     }
     else
@@ -1487,6 +2038,22 @@ httpd_handle_t fnHttpService::start_server(serverstate &state)
          .is_websocket = false,
          .handle_ws_control_frames = false,
          .supported_subprotocol = nullptr},
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+        {.uri = "/modem-sniffer-ws",
+         .method = HTTP_GET,
+         .handler = get_handler_modem_sniffer_ws,
+         .user_ctx = NULL,
+         .is_websocket = true,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
+        {.uri = "/events",
+         .method = HTTP_GET,
+         .handler = get_handler_events_ws,
+         .user_ctx = NULL,
+         .is_websocket = true,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
+#endif
         {.uri = "/favicon.ico",
          .method = HTTP_GET,
          .handler = get_handler_file_in_path,
@@ -1501,6 +2068,29 @@ httpd_handle_t fnHttpService::start_server(serverstate &state)
          .is_websocket = false,
          .handle_ws_control_frames = false,
          .supported_subprotocol = nullptr},
+        {.uri = "/copy",
+         .method = HTTP_GET,
+         .handler = get_handler_copy,
+         .user_ctx = NULL,
+         .is_websocket = false,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
+        {.uri = "/stats",
+         .method = HTTP_GET,
+         .handler = get_handler_stats,
+         .user_ctx = NULL,
+         .is_websocket = false,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
+#if defined(BUILD_ATARI) && defined(SIO_TRACE)
+        {.uri = "/siotrace",
+         .method = HTTP_GET,
+         .handler = get_handler_siotrace,
+         .user_ctx = NULL,
+         .is_websocket = false,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
+#endif
         {.uri = "/unmount",
          .method = HTTP_GET,
          .handler = get_handler_eject,
@@ -1508,6 +2098,13 @@ httpd_handle_t fnHttpService::start_server(serverstate &state)
          .is_websocket = false,
          .handle_ws_control_frames = false,
          .supported_subprotocol = nullptr},
+        {.uri = "/api/*",
+         .method = HTTP_GET,
+         .handler = get_handler_api,
+         .user_ctx = NULL,
+         .is_websocket = false,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
         {.uri = "/hosts",
          .method = HTTP_GET,
          .handler = get_handler_hosts,
@@ -1538,6 +2135,13 @@ httpd_handle_t fnHttpService::start_server(serverstate &state)
          .handle_ws_control_frames = false,
          .supported_subprotocol = nullptr},
 #endif
+        {.uri = "/upload",
+         .method = HTTP_POST,
+         .handler = post_handler_upload,
+         .user_ctx = NULL,
+         .is_websocket = false,
+         .handle_ws_control_frames = false,
+         .supported_subprotocol = nullptr},
         {.uri = "/config",
          .method = HTTP_POST,
          .handler = post_handler_config,
@@ -1605,6 +2209,15 @@ void fnHttpService::start()
     // esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &connect_handler, &(state.hServer));
     // esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disconnect_handler, &(state.hServer));
 
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    static bool events_subscribed = false;
+    if (!events_subscribed)
+    {
+        fnEvents.subscribe(send_event);
+        events_subscribed = true;
+    }
+#endif
+
     // Go ahead and attempt starting the server for the first time
     start_server(state);
 }
@@ -1614,6 +2227,12 @@ void fnHttpService::stop()
     if (state.hServer != nullptr)
     {
         Debug_println("Stopping web service");
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+        {
+            std::lock_guard<std::mutex> lock(_event_clients_mutex);
+            _event_clients.clear();
+        }
+#endif
         httpd_stop(state.hServer);
         state._FS = nullptr;
         state.hServer = nullptr;
@@ -9,18 +9,23 @@ URI: "/" - Forces loading/parsing (see below) of /<FNWS_FILE_ROOT>/index.html
 URI: "/file?<filename>" - Sends static file /<FNWS_FILE_ROOT>/<filename>
 URI: "/favico.ico" - Sends /<FNWS_FILE_ROOT>/favico.ico
 URI: "/print" - Sends current printer output to user
+URI: "/api/hosts", "/api/slots", "/api/status" - JSON, see httpServiceApi.h
+URI: "/upload?path=<dir>" - POST a multipart file upload to the SD card
+URI: "/events" - WebSocket with a JSON text frame per fnEvents event
 
 MIME types are assigned based on file extention.  See/update
     static std::map<string, string> mime_map
 
-Unless parsable, files are sent in FNWS_SEND_BUFF_SIZE blocks.
+Unless parsable, files are sent in FNWS_SEND_BUFF_SIZE blocks. Files and
+printer output larger than FNWS_ASYNC_SEND_MIN are sent from a task of their own
+on ESP, so the httpd worker is free for other requests meanwhile; at most
+FNWS_MAX_ASYNC_SENDS of these run at once, beyond that they're sent directly.
 
 If a file has an extention pre-determined to support parsing (see/update
     fnHttpServiceParser::is_parsable() for a the list) then the
     following happens:
 
-    * The entire file contents are loaded into an in-memory string.
-    * Anything with the pattern <%PARSE_TAG%> is replaced with an
+    * The file is sent a chunk at a time and anything with the pattern <%PARSE_TAG%> is replaced with an
     * appropriate value as determined by the
     *       string substitute_tag(const string &tag)
     * function.
@@ -29,11 +34,13 @@ If a file has an extention pre-determined to support parsing (see/update
 #ifndef HTTPSERVICE_H
 #define HTTPSERVICE_H
 
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
 
 #include "fnFS.h"
+#include "fnEvents.h"
 
 #ifdef ESP_PLATFORM
 #include "webdav/request.h"
@@ -48,6 +55,10 @@ If a file has an extention pre-determined to support parsing (see/update
 #define FNWS_FILE_ROOT "/www/"
 #ifdef ESP_PLATFORM
 #define FNWS_SEND_BUFF_SIZE 512 // Used when sending files in chunks
+#define FNWS_ASYNC_SEND_MIN 8192 // Smaller files are sent by the httpd worker itself
+#define FNWS_MAX_ASYNC_SENDS 2 // Each holds a socket and a task stack until done
+#define FNWS_UPLOAD_HEAD_MAX 1024 // Multipart headers before an uploaded file
+#define FNWS_UPLOAD_RETRIES 3 // Receive timeouts in a row before an upload is dropped
 #define FNWS_RECV_BUFF_SIZE 512 // Used when receiving POST data from client
 #else
 #define FNWS_SEND_BUFF_SIZE 4096 // Used when sending files in chunks
@@ -83,6 +94,14 @@ class fnHttpService
     std::vector<std::string> shortURLs;
 
 #ifdef ESP_PLATFORM
+    // A file to send and the response headers to send it with
+    struct file_send_job {
+        httpd_req_t *req = nullptr;
+        FILE *file = nullptr;
+        const char *content_type = nullptr;
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::function<void()> on_done; // after the file is sent and closed
+    };
     struct queryparts {
         std::string full_uri;
         std::string path;
@@ -99,6 +118,9 @@ class fnHttpService
     static void set_file_content_type(httpd_req_t *req, const char *filepath);
     static void send_file_parsed(httpd_req_t *req, const char *filename);
     static void send_file(httpd_req_t *req, const char *filename);
+    static void start_file_send(httpd_req_t *req, file_send_job *job);
+    static void run_file_send(file_send_job *job);
+    static void file_send_task(void *arg);
     static void parse_query(httpd_req_t *req, queryparts *results);
     static void send_header_footer(httpd_req_t *req, int headfoot);
 
@@ -117,6 +139,7 @@ class fnHttpService
     static void send_file_parsed(struct mg_connection *c, const char *filename);
     static void send_file(struct mg_connection *c, const char *filename);
     static int redirect_or_result(mg_connection *c, mg_http_message *hm, int result);
+    static void send_event(const fn_event &event);
 
     friend class fnHttpServiceBrowser; // allow browser to call above functions
 #endif
@@ -137,7 +160,19 @@ public:
     static esp_err_t get_handler_file_in_path(httpd_req_t *req);
     static esp_err_t get_handler_print(httpd_req_t *req);
     static esp_err_t get_handler_modem_sniffer(httpd_req_t *req);
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    static esp_err_t get_handler_modem_sniffer_ws(httpd_req_t *req);
+    static esp_err_t get_handler_events_ws(httpd_req_t *req);
+    static esp_err_t ws_drop_frame(httpd_req_t *req);
+    static void send_event(const fn_event &event);
+#endif
     static esp_err_t get_handler_mount(httpd_req_t *req);
+    static esp_err_t get_handler_copy(httpd_req_t *req);
+    static esp_err_t get_handler_stats(httpd_req_t *req);
+    static esp_err_t get_handler_api(httpd_req_t *req);
+#if defined(BUILD_ATARI) && defined(SIO_TRACE)
+    static esp_err_t get_handler_siotrace(httpd_req_t *req);
+#endif
     static esp_err_t get_handler_eject(httpd_req_t *req);
     static esp_err_t get_handler_dir(httpd_req_t *req);
     static esp_err_t get_handler_slot(httpd_req_t *req);
@@ -151,15 +186,18 @@ public:
 #endif
 
     static esp_err_t post_handler_config(httpd_req_t *req);
+    static esp_err_t post_handler_upload(httpd_req_t *req);
 #else
 // !ESP_PLATFORM
-    static int get_handler_print(struct mg_connection *c);
+    static int get_handler_print(struct mg_connection *c, struct mg_http_message *hm);
     // static esp_err_t get_handler_modem_sniffer(httpd_req_t *req);
     static int get_handler_swap(struct mg_connection *c, struct mg_http_message *hm);
     static int get_handler_mount(struct mg_connection *c, struct mg_http_message *hm);
+    static int get_handler_copy(struct mg_connection *c, struct mg_http_message *hm);
     static int get_handler_hosts(struct mg_connection *c, struct mg_http_message *hm);
     static int post_handler_hosts(struct mg_connection *c, struct mg_http_message *hm);
     static int get_handler_eject(mg_connection *c, mg_http_message *hm);
+    static int get_handler_api(mg_connection *c, mg_http_message *hm);
 
     static int post_handler_config(struct mg_connection *c, struct mg_http_message *hm);
 
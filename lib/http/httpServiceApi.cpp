@@ -0,0 +1,135 @@
+#include "httpServiceApi.h"
+
+#include <cstdio>
+#include <sstream>
+
+#include "fnSystem.h"
+#include "fnConfig.h"
+#include "fnWiFi.h"
+#include "fnFileWriteback.h"
+#include "fuji.h"
+
+std::string fnHttpServiceApi::json_escape(const std::string &s)
+{
+    std::string out;
+    out.reserve(s.length() + 2);
+    out += '"';
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)c);
+                out += esc;
+            }
+            else
+                out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+bool fnHttpServiceApi::get(const std::string &path, std::string &json)
+{
+    if (path == "/api/hosts")
+        json = hosts_json();
+    else if (path == "/api/slots")
+        json = slots_json();
+    else if (path == "/api/status")
+        json = status_json();
+    else
+        return false;
+    return true;
+}
+
+// [{"slot":1,"type":"tnfs","name":"...","prefix":"..."},...], type null when empty
+std::string fnHttpServiceApi::hosts_json()
+{
+    std::ostringstream out;
+
+    out << "[";
+    for (int hs = 0; hs < MAX_HOST_SLOTS; hs++)
+    {
+        fnConfig::host_type_t type = Config.get_host_type(hs);
+        out << (hs ? "," : "") << "{\"slot\":" << hs + 1 << ",\"type\":";
+        if (type == fnConfig::host_types::HOSTTYPE_INVALID)
+        {
+            out << "null}";
+            continue;
+        }
+        out << (type == fnConfig::host_types::HOSTTYPE_SD ? "\"sd\"" : "\"tnfs\"")
+            << ",\"name\":" << json_escape(Config.get_host_name(hs))
+            << ",\"prefix\":" << json_escape(theFuji.get_host_prefix(hs)) << "}";
+    }
+    out << "]";
+
+    return out.str();
+}
+
+// [{"slot":1,"host":2,"path":"...","mode":"r"},...], host null when empty
+std::string fnHttpServiceApi::slots_json()
+{
+    std::ostringstream out;
+
+    out << "[";
+    for (int ds = 0; ds < MAX_MOUNT_SLOTS; ds++)
+    {
+        int hs = Config.get_mount_host_slot(ds);
+        out << (ds ? "," : "") << "{\"slot\":" << ds + 1 << ",\"host\":";
+        if (hs == HOST_SLOT_INVALID)
+        {
+            out << "null}";
+            continue;
+        }
+        out << hs + 1 << ",\"path\":" << json_escape(Config.get_mount_path(ds))
+            << ",\"mode\":" << (Config.get_mount_mode(ds) == fnConfig::mount_modes::MOUNTMODE_WRITE ? "\"w\"" : "\"r\"")
+            << "}";
+    }
+    out << "]";
+
+    return out.str();
+}
+
+/* Only what changes without a reconfiguration, plus enough to tell devices
+ apart. Uptime is in whole minutes so a steady device still matches its ETag
+ for a while
+*/
+std::string fnHttpServiceApi::status_json()
+{
+    std::ostringstream out;
+
+    out << "{\"hostname\":" << json_escape(fnSystem.Net.get_hostname())
+        << ",\"version\":" << json_escape(fnSystem.get_fujinet_version())
+        << ",\"ip\":" << json_escape(fnSystem.Net.get_ip4_address_str())
+        << ",\"ssid\":" << json_escape(fnWiFi.get_current_ssid())
+        << ",\"uptime_min\":" << (long)(fnSystem.get_uptime() / 60000000)
+        << ",\"writes_pending\":" << FileHandlerWriteback::pending_writes()
+        << "}";
+
+    return out.str();
+}
+
+// FNV-1a of the body and its length
+std::string fnHttpServiceApi::etag(const std::string &body)
+{
+    uint32_t h = 2166136261u;
+    for (char c : body)
+    {
+        h ^= (uint8_t)c;
+        h *= 16777619u;
+    }
+
+    char tag[24];
+    snprintf(tag, sizeof(tag), "\"%08lx-%x\"", (unsigned long)h, (unsigned)body.length());
+    return tag;
+}
@@ -0,0 +1,30 @@
+#ifndef _HTTP_SERVICE_API_H_
+#define _HTTP_SERVICE_API_H_
+
+/*
+ * Compact JSON views of the host slots, mount slots and device status for
+ * tools that poll the device, served on /api/hosts, /api/slots and
+ * /api/status. They're built straight from Config and theFuji rather than
+ * by rendering a page, and carry an ETag so an unchanged poll is a 304.
+ */
+
+#include <string>
+
+class fnHttpServiceApi
+{
+public:
+    // s as a quoted JSON string
+    static std::string json_escape(const std::string &s);
+
+    // The JSON for an /api/... path, false if there's no such endpoint
+    static bool get(const std::string &path, std::string &json);
+
+    static std::string hosts_json();
+    static std::string slots_json();
+    static std::string status_json();
+
+    // Strong ETag (quoted) for a response body
+    static std::string etag(const std::string &body);
+};
+
+#endif // _HTTP_SERVICE_API_H_
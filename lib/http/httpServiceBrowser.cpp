@@ -14,6 +14,7 @@
 
 #include "httpServiceBrowser.h"
 #include "httpService.h"
+#include "httpServiceApi.h"
 
 #include "debug.h"
 
@@ -317,31 +318,82 @@ int fnHttpServiceBrowser::browse_listdir(mg_connection *c, mg_http_message *hm,
         return -1;
     }
 
-    mg_printf(c, "%s\r\n", "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nTransfer-Encoding: chunked\r\n");
-    print_head(c, slot);
-    print_navi(c, slot, esc_path, enc_path);
-    mg_http_printf_chunk(
-        c,
-        "<table cellpadding=\"0\"><thead>"
-        "<tr><th>Size</th><th>Modified</th><th>Name</th></tr>"
-        "<tr><td colspan=\"3\"><hr></td></tr></thead><tbody>\r\n");
+    // "pos" is where a page starts, a dir_tell() value from the page before
+    char pos_str[8] = "", count_str[8] = "", format[8] = "";
+    mg_http_get_var(&hm->query, "pos", pos_str, sizeof(pos_str));
+    mg_http_get_var(&hm->query, "count", count_str, sizeof(count_str));
+    mg_http_get_var(&hm->query, "format", format, sizeof(format));
+    int count = atoi(count_str);
+    if (count <= 0 || count > BROWSE_PAGE_MAX)
+        count = BROWSE_PAGE_SIZE;
+    bool json = strcmp(format, "json") == 0;
+
+    if (pos_str[0] != '\0' && !fs->dir_seek((uint16_t)atoi(pos_str)))
+    {
+        fs->dir_close();
+        mg_http_reply(c, 400, "", "Bad directory position.\n");
+        return -1;
+    }
+
+    if (json)
+    {
+        mg_printf(c, "%s\r\n", "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n");
+        mg_http_printf_chunk(c, "{\"path\":%s,\"entries\":[", fnHttpServiceApi::json_escape(path).c_str());
+    }
+    else
+    {
+        mg_printf(c, "%s\r\n", "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nTransfer-Encoding: chunked\r\n");
+        print_head(c, slot);
+        print_navi(c, slot, esc_path, enc_path);
+        mg_http_printf_chunk(
+            c,
+            "<table cellpadding=\"0\"><thead>"
+            "<tr><th>Size</th><th>Modified</th><th>Name</th></tr>"
+            "<tr><td colspan=\"3\"><hr></td></tr></thead><tbody>\r\n");
+    }
 
-    // list directory
+    // list a page of the directory
     fsdir_entry *dp;
-    while ((dp = fs->dir_read()) != nullptr)
+    int shown = 0;
+    uint16_t next = FNFS_INVALID_DIRPOS;
+    for (;;)
     {
+        uint16_t here = fs->dir_tell();
+        if ((dp = fs->dir_read()) == nullptr)
+            break;
         // Debug_printf("%d %s\t%d\t%lu\n", dp->isDir, dp->filename, (int)dp->size, (unsigned long)dp->modified_time);
         // Do not show current dir and hidden files
         if (!strcmp(dp->filename, ".") || !strcmp(dp->filename, ".."))
             continue;
-        print_dentry(c, dp, slot, enc_path);
+        // One more than fits, the next page starts with it
+        if (shown == count)
+        {
+            next = here;
+            break;
+        }
+        if (json)
+            print_dentry_json(c, dp, shown == 0);
+        else
+            print_dentry(c, dp, slot, enc_path);
+        shown++;
     }
     fs->dir_close();
 
-    mg_http_printf_chunk(
-        c,
-        "</tbody><tfoot><tr><td colspan=\"3\"><hr></td></tr></tfoot>"
-        "</table></body></html>");
+    if (json)
+    {
+        if (next != FNFS_INVALID_DIRPOS)
+            mg_http_printf_chunk(c, "],\"next\":%u}", (unsigned)next);
+        else
+            mg_http_printf_chunk(c, "],\"next\":null}");
+    }
+    else
+    {
+        mg_http_printf_chunk(c, "</tbody><tfoot><tr><td colspan=\"3\"><hr></td></tr>");
+        if (next != FNFS_INVALID_DIRPOS)
+            mg_http_printf_chunk(c, "<tr><td colspan=\"3\"><a href=\"?pos=%u&count=%d\">[ Next page ]</a></td></tr>",
+                                 (unsigned)next, count);
+        mg_http_printf_chunk(c, "</tfoot></table></body></html>");
+    }
     mg_http_write_chunk(c, "", 0);
 
     return 0;
@@ -513,6 +565,12 @@ void fnHttpServiceBrowser::print_dentry(mg_connection *c, fsdir_entry *dp, int s
         size, mod, slot+1, enc_path, sep, enc_filename, form, esc_filename, slash);
 }
 
+void fnHttpServiceBrowser::print_dentry_json(mg_connection *c, fsdir_entry *dp, bool first)
+{
+    mg_http_printf_chunk(c, "%s{\"name\":%s,\"dir\":%s,\"size\":%lu,\"modified\":%lld}",
+        first ? "" : ",", fnHttpServiceApi::json_escape(dp->filename).c_str(),
+        dp->isDir ? "true" : "false", (unsigned long)dp->size, (long long)dp->modified_time);
+}
 
 int fnHttpServiceBrowser::browse_sendfile(mg_connection *c, FileSystem *fs, fnFile *fh, const char *filename, unsigned long filesize)
 {
@@ -5,6 +5,10 @@
 #include "mongoose.h"
 #undef mkdir
 
+// Directory entries per page, unless ?count= asks for another number up to BROWSE_PAGE_MAX
+#define BROWSE_PAGE_SIZE 500
+#define BROWSE_PAGE_MAX 5000
+
 class fnHttpServiceBrowser
 {
     static int browse_url_encode(const char *src, size_t src_len, char *dst, size_t dst_len);
@@ -16,6 +20,7 @@ class fnHttpServiceBrowser
     static void print_head(mg_connection *c, int slot);
     static void print_navi(mg_connection *c, int slot, const char *esc_path, const char*enc_path, bool download = false);
     static void print_dentry(mg_connection *c, fsdir_entry *dp, int slot, const char *enc_path);
+    static void print_dentry_json(mg_connection *c, fsdir_entry *dp, bool first);
 
     static int browse_sendfile(mg_connection *c, FileSystem *fs, fnFile *fh, const char *filename, unsigned long filesize);
 
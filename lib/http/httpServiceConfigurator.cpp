@@ -166,6 +166,7 @@ void fnHttpServiceConfigurator::config_hsio(std::string hsioindex)
     SIO.setHighSpeedIndex(index);
     // Store our change in Config
     Config.store_general_hsioindex(index);
+    SIO.hsio_forget_calibration();
     Config.save();
 #endif /* BUILD_ATARI */
 }
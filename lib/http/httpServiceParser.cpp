@@ -1,6 +1,10 @@
 
 #include "httpServiceParser.h"
 
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
 #include <sstream>
 
 #include "../../include/debug.h"
@@ -9,263 +13,311 @@
 #include "fnConfig.h"
 #include "fnWiFi.h"
 #include "fsFlash.h"
+#include "fnFileWriteback.h"
 #include "httpService.h"
 #include "fuji.h"
 
 using namespace std;
 
 #define MAX_PRINTER_LIST_BUFFER (2048)
+// Longer than any tag name, anything longer can't be one
+#define MAX_TEMPLATE_TAG_LEN (48)
 
-const string fnHttpServiceParser::substitute_tag(const string &tag)
+enum tagids
 {
-    enum tagids
-    {
-        FN_HOSTNAME = 0,
+    FN_HOSTNAME = 0,
 #ifndef ESP_PLATFORM
-        FN_DEVICE_NAME,
-        FN_LABEL,
+    FN_DEVICE_NAME,
+    FN_LABEL,
 #endif
-        FN_VERSION,
-        FN_IPADDRESS,
-        FN_IPMASK,
-        FN_IPGATEWAY,
-        FN_IPDNS,
-        FN_WIFISSID,
-        FN_WIFIBSSID,
-        FN_WIFIMAC,
-        FN_WIFIDETAIL,
+    FN_VERSION,
+    FN_IPADDRESS,
+    FN_IPMASK,
+    FN_IPGATEWAY,
+    FN_IPDNS,
+    FN_WIFISSID,
+    FN_WIFIBSSID,
+    FN_WIFIMAC,
+    FN_WIFIDETAIL,
 #ifndef ESP_PLATFORM
-        FN_UNAME,
+    FN_UNAME,
 #endif
-        FN_SPIFFS_SIZE,
-        FN_SPIFFS_USED,
-        FN_SD_SIZE,
-        FN_SD_USED,
-        FN_UPTIME_STRING,
-        FN_UPTIME,
-        FN_CURRENTTIME,
-        FN_TIMEZONE,
-        FN_ROTATION_SOUNDS,
-        FN_UDPSTREAM_HOST,
-        FN_HEAPSIZE,
-        FN_SYSSDK,
-        FN_SYSCPUREV,
-        FN_BUSVOLTS,
-        FN_SIO_HSINDEX,
-        FN_SIO_HSBAUD,
-        FN_PRINTER1_MODEL,
-        FN_PRINTER1_PORT,
-        FN_PLAY_RECORD,
-        FN_PULLDOWN,
-        FN_CASSETTE_ENABLED,
-        FN_CONFIG_ENABLED,
-        FN_CONFIG_NG,
-        FN_STATUS_WAIT_ENABLED,
-        FN_BOOT_MODE,
-        FN_PRINTER_ENABLED,
-        FN_MODEM_ENABLED,
-        FN_MODEM_SNIFFER_ENABLED,
+    FN_SPIFFS_SIZE,
+    FN_SPIFFS_USED,
+    FN_SD_SIZE,
+    FN_SD_USED,
+    FN_UPTIME_STRING,
+    FN_UPTIME,
+    FN_CURRENTTIME,
+    FN_TIMEZONE,
+    FN_ROTATION_SOUNDS,
+    FN_UDPSTREAM_HOST,
+    FN_HEAPSIZE,
+    FN_DISK_WRITES_PENDING,
+    FN_SYSSDK,
+    FN_SYSCPUREV,
+    FN_BUSVOLTS,
+    FN_SIO_HSINDEX,
+    FN_SIO_HSBAUD,
+    FN_PRINTER1_MODEL,
+    FN_PRINTER1_PORT,
+    FN_PLAY_RECORD,
+    FN_PULLDOWN,
+    FN_CASSETTE_ENABLED,
+    FN_CONFIG_ENABLED,
+    FN_CONFIG_NG,
+    FN_STATUS_WAIT_ENABLED,
+    FN_BOOT_MODE,
+    FN_PRINTER_ENABLED,
+    FN_MODEM_ENABLED,
+    FN_MODEM_SNIFFER_ENABLED,
 #ifndef ESP_PLATFORM
-        FN_SERIAL_PORT,
-        FN_SERIAL_PORT_BAUD,
-        FN_SERIAL_COMMAND,
-        FN_SERIAL_PROCEED,
-        FN_SIO_HSTEXT,
+    FN_SERIAL_PORT,
+    FN_SERIAL_PORT_BAUD,
+    FN_SERIAL_COMMAND,
+    FN_SERIAL_PROCEED,
+    FN_SIO_HSTEXT,
 #endif
-        FN_BOIP_ENABLED,
-        FN_BOIP_HOST,
-        FN_DRIVE1HOST,
-        FN_DRIVE2HOST,
-        FN_DRIVE3HOST,
-        FN_DRIVE4HOST,
-        FN_DRIVE5HOST,
-        FN_DRIVE6HOST,
-        FN_DRIVE7HOST,
-        FN_DRIVE8HOST,
+    FN_BOIP_ENABLED,
+    FN_BOIP_HOST,
+    FN_DRIVE1HOST,
+    FN_DRIVE2HOST,
+    FN_DRIVE3HOST,
+    FN_DRIVE4HOST,
+    FN_DRIVE5HOST,
+    FN_DRIVE6HOST,
+    FN_DRIVE7HOST,
+    FN_DRIVE8HOST,
 #ifndef ESP_PLATFORM
-        FN_DRIVE1BROWSER,
-        FN_DRIVE2BROWSER,
-        FN_DRIVE3BROWSER,
-        FN_DRIVE4BROWSER,
-        FN_DRIVE5BROWSER,
-        FN_DRIVE6BROWSER,
-        FN_DRIVE7BROWSER,
-        FN_DRIVE8BROWSER,
+    FN_DRIVE1BROWSER,
+    FN_DRIVE2BROWSER,
+    FN_DRIVE3BROWSER,
+    FN_DRIVE4BROWSER,
+    FN_DRIVE5BROWSER,
+    FN_DRIVE6BROWSER,
+    FN_DRIVE7BROWSER,
+    FN_DRIVE8BROWSER,
 #endif
-        FN_DRIVE1MOUNT,
-        FN_DRIVE2MOUNT,
-        FN_DRIVE3MOUNT,
-        FN_DRIVE4MOUNT,
-        FN_DRIVE5MOUNT,
-        FN_DRIVE6MOUNT,
-        FN_DRIVE7MOUNT,
-        FN_DRIVE8MOUNT,
-        FN_HOST1,
-        FN_HOST2,
-        FN_HOST3,
-        FN_HOST4,
-        FN_HOST5,
-        FN_HOST6,
-        FN_HOST7,
-        FN_HOST8,
-        FN_DRIVE1DEVICE,
-        FN_DRIVE2DEVICE,
-        FN_DRIVE3DEVICE,
-        FN_DRIVE4DEVICE,
-        FN_DRIVE5DEVICE,
-        FN_DRIVE6DEVICE,
-        FN_DRIVE7DEVICE,
-        FN_DRIVE8DEVICE,
-        FN_HOST1PREFIX,
-        FN_HOST2PREFIX,
-        FN_HOST3PREFIX,
-        FN_HOST4PREFIX,
-        FN_HOST5PREFIX,
-        FN_HOST6PREFIX,
-        FN_HOST7PREFIX,
-        FN_HOST8PREFIX,
-        FN_ERRMSG,
-        FN_HARDWARE_VER,
-        FN_PRINTER_LIST,
-        FN_ENCRYPT_PASSPHRASE_ENABLED,
-        FN_APETIME_ENABLED,
-        FN_CPM_ENABLED,
-        FN_CPM_CCP,
-        FN_ALT_CFG,
-        FN_PCLINK_ENABLED,
-        FN_LASTTAG
-    };
+    FN_DRIVE1MOUNT,
+    FN_DRIVE2MOUNT,
+    FN_DRIVE3MOUNT,
+    FN_DRIVE4MOUNT,
+    FN_DRIVE5MOUNT,
+    FN_DRIVE6MOUNT,
+    FN_DRIVE7MOUNT,
+    FN_DRIVE8MOUNT,
+    FN_HOST1,
+    FN_HOST2,
+    FN_HOST3,
+    FN_HOST4,
+    FN_HOST5,
+    FN_HOST6,
+    FN_HOST7,
+    FN_HOST8,
+    FN_DRIVE1DEVICE,
+    FN_DRIVE2DEVICE,
+    FN_DRIVE3DEVICE,
+    FN_DRIVE4DEVICE,
+    FN_DRIVE5DEVICE,
+    FN_DRIVE6DEVICE,
+    FN_DRIVE7DEVICE,
+    FN_DRIVE8DEVICE,
+    FN_HOST1PREFIX,
+    FN_HOST2PREFIX,
+    FN_HOST3PREFIX,
+    FN_HOST4PREFIX,
+    FN_HOST5PREFIX,
+    FN_HOST6PREFIX,
+    FN_HOST7PREFIX,
+    FN_HOST8PREFIX,
+    FN_ERRMSG,
+    FN_HARDWARE_VER,
+    FN_PRINTER_LIST,
+    FN_ENCRYPT_PASSPHRASE_ENABLED,
+    FN_APETIME_ENABLED,
+    FN_CPM_ENABLED,
+    FN_CPM_CCP,
+    FN_ALT_CFG,
+    FN_PCLINK_ENABLED,
+    FN_LASTTAG
+};
 
-    const char *tagids[FN_LASTTAG] =
-    {
-        "FN_HOSTNAME",
+static const char *tagids[FN_LASTTAG] =
+{
+    "FN_HOSTNAME",
 #ifndef ESP_PLATFORM
-        "FN_DEVICE_NAME",
-        "FN_LABEL",
+    "FN_DEVICE_NAME",
+    "FN_LABEL",
 #endif
-        "FN_VERSION",
-        "FN_IPADDRESS",
-        "FN_IPMASK",
-        "FN_IPGATEWAY",
-        "FN_IPDNS",
-        "FN_WIFISSID",
-        "FN_WIFIBSSID",
-        "FN_WIFIMAC",
-        "FN_WIFIDETAIL",
+    "FN_VERSION",
+    "FN_IPADDRESS",
+    "FN_IPMASK",
+    "FN_IPGATEWAY",
+    "FN_IPDNS",
+    "FN_WIFISSID",
+    "FN_WIFIBSSID",
+    "FN_WIFIMAC",
+    "FN_WIFIDETAIL",
 #ifndef ESP_PLATFORM
-        "FN_UNAME",
+    "FN_UNAME",
 #endif
-        "FN_SPIFFS_SIZE",
-        "FN_SPIFFS_USED",
-        "FN_SD_SIZE",
-        "FN_SD_USED",
-        "FN_UPTIME_STRING",
-        "FN_UPTIME",
-        "FN_CURRENTTIME",
-        "FN_TIMEZONE",
-        "FN_ROTATION_SOUNDS",
-        "FN_UDPSTREAM_HOST",
-        "FN_HEAPSIZE",
-        "FN_SYSSDK",
-        "FN_SYSCPUREV",
-        "FN_BUSVOLTS",
-        "FN_SIO_HSINDEX",
-        "FN_SIO_HSBAUD",
-        "FN_PRINTER1_MODEL",
-        "FN_PRINTER1_PORT",
-        "FN_PLAY_RECORD",
-        "FN_PULLDOWN",
-        "FN_CASSETTE_ENABLED",
-        "FN_CONFIG_ENABLED",
-        "FN_CONFIG_NG",
-        "FN_STATUS_WAIT_ENABLED",
-        "FN_BOOT_MODE",
-        "FN_PRINTER_ENABLED",
-        "FN_MODEM_ENABLED",
-        "FN_MODEM_SNIFFER_ENABLED",
+    "FN_SPIFFS_SIZE",
+    "FN_SPIFFS_USED",
+    "FN_SD_SIZE",
+    "FN_SD_USED",
+    "FN_UPTIME_STRING",
+    "FN_UPTIME",
+    "FN_CURRENTTIME",
+    "FN_TIMEZONE",
+    "FN_ROTATION_SOUNDS",
+    "FN_UDPSTREAM_HOST",
+    "FN_HEAPSIZE",
+    "FN_DISK_WRITES_PENDING",
+    "FN_SYSSDK",
+    "FN_SYSCPUREV",
+    "FN_BUSVOLTS",
+    "FN_SIO_HSINDEX",
+    "FN_SIO_HSBAUD",
+    "FN_PRINTER1_MODEL",
+    "FN_PRINTER1_PORT",
+    "FN_PLAY_RECORD",
+    "FN_PULLDOWN",
+    "FN_CASSETTE_ENABLED",
+    "FN_CONFIG_ENABLED",
+    "FN_CONFIG_NG",
+    "FN_STATUS_WAIT_ENABLED",
+    "FN_BOOT_MODE",
+    "FN_PRINTER_ENABLED",
+    "FN_MODEM_ENABLED",
+    "FN_MODEM_SNIFFER_ENABLED",
 #ifndef ESP_PLATFORM
-        "FN_SERIAL_PORT",
-        "FN_SERIAL_PORT_BAUD",
-        "FN_SERIAL_COMMAND",
-        "FN_SERIAL_PROCEED",
-        "FN_SIO_HSTEXT",
+    "FN_SERIAL_PORT",
+    "FN_SERIAL_PORT_BAUD",
+    "FN_SERIAL_COMMAND",
+    "FN_SERIAL_PROCEED",
+    "FN_SIO_HSTEXT",
 #endif
-        "FN_BOIP_ENABLED",
-        "FN_BOIP_HOST",
-        "FN_DRIVE1HOST",
-        "FN_DRIVE2HOST",
-        "FN_DRIVE3HOST",
-        "FN_DRIVE4HOST",
-        "FN_DRIVE5HOST",
-        "FN_DRIVE6HOST",
-        "FN_DRIVE7HOST",
-        "FN_DRIVE8HOST",
+    "FN_BOIP_ENABLED",
+    "FN_BOIP_HOST",
+    "FN_DRIVE1HOST",
+    "FN_DRIVE2HOST",
+    "FN_DRIVE3HOST",
+    "FN_DRIVE4HOST",
+    "FN_DRIVE5HOST",
+    "FN_DRIVE6HOST",
+    "FN_DRIVE7HOST",
+    "FN_DRIVE8HOST",
 #ifndef ESP_PLATFORM
-        "FN_DRIVE1BROWSER",
-        "FN_DRIVE2BROWSER",
-        "FN_DRIVE3BROWSER",
-        "FN_DRIVE4BROWSER",
-        "FN_DRIVE5BROWSER",
-        "FN_DRIVE6BROWSER",
-        "FN_DRIVE7BROWSER",
-        "FN_DRIVE8BROWSER",
+    "FN_DRIVE1BROWSER",
+    "FN_DRIVE2BROWSER",
+    "FN_DRIVE3BROWSER",
+    "FN_DRIVE4BROWSER",
+    "FN_DRIVE5BROWSER",
+    "FN_DRIVE6BROWSER",
+    "FN_DRIVE7BROWSER",
+    "FN_DRIVE8BROWSER",
 #endif
-        "FN_DRIVE1MOUNT",
-        "FN_DRIVE2MOUNT",
-        "FN_DRIVE3MOUNT",
-        "FN_DRIVE4MOUNT",
-        "FN_DRIVE5MOUNT",
-        "FN_DRIVE6MOUNT",
-        "FN_DRIVE7MOUNT",
-        "FN_DRIVE8MOUNT",
-        "FN_HOST1",
-        "FN_HOST2",
-        "FN_HOST3",
-        "FN_HOST4",
-        "FN_HOST5",
-        "FN_HOST6",
-        "FN_HOST7",
-        "FN_HOST8",
-        "FN_DRIVE1DEVICE",
-        "FN_DRIVE2DEVICE",
-        "FN_DRIVE3DEVICE",
-        "FN_DRIVE4DEVICE",
-        "FN_DRIVE5DEVICE",
-        "FN_DRIVE6DEVICE",
-        "FN_DRIVE7DEVICE",
-        "FN_DRIVE8DEVICE",
-        "FN_HOST1PREFIX",
-        "FN_HOST2PREFIX",
-        "FN_HOST3PREFIX",
-        "FN_HOST4PREFIX",
-        "FN_HOST5PREFIX",
-        "FN_HOST6PREFIX",
-        "FN_HOST7PREFIX",
-        "FN_HOST8PREFIX",
-        "FN_ERRMSG",
-        "FN_HARDWARE_VER",
-        "FN_PRINTER_LIST",
-        "FN_ENCRYPT_PASSPHRASE_ENABLED",
-        "FN_APETIME_ENABLED",
-        "FN_CPM_ENABLED",
-        "FN_CPM_CCP",
-        "FN_ALT_CFG",
-        "FN_PCLINK_ENABLED",
-    };
+    "FN_DRIVE1MOUNT",
+    "FN_DRIVE2MOUNT",
+    "FN_DRIVE3MOUNT",
+    "FN_DRIVE4MOUNT",
+    "FN_DRIVE5MOUNT",
+    "FN_DRIVE6MOUNT",
+    "FN_DRIVE7MOUNT",
+    "FN_DRIVE8MOUNT",
+    "FN_HOST1",
+    "FN_HOST2",
+    "FN_HOST3",
+    "FN_HOST4",
+    "FN_HOST5",
+    "FN_HOST6",
+    "FN_HOST7",
+    "FN_HOST8",
+    "FN_DRIVE1DEVICE",
+    "FN_DRIVE2DEVICE",
+    "FN_DRIVE3DEVICE",
+    "FN_DRIVE4DEVICE",
+    "FN_DRIVE5DEVICE",
+    "FN_DRIVE6DEVICE",
+    "FN_DRIVE7DEVICE",
+    "FN_DRIVE8DEVICE",
+    "FN_HOST1PREFIX",
+    "FN_HOST2PREFIX",
+    "FN_HOST3PREFIX",
+    "FN_HOST4PREFIX",
+    "FN_HOST5PREFIX",
+    "FN_HOST6PREFIX",
+    "FN_HOST7PREFIX",
+    "FN_HOST8PREFIX",
+    "FN_ERRMSG",
+    "FN_HARDWARE_VER",
+    "FN_PRINTER_LIST",
+    "FN_ENCRYPT_PASSPHRASE_ENABLED",
+    "FN_APETIME_ENABLED",
+    "FN_CPM_ENABLED",
+    "FN_CPM_CCP",
+    "FN_ALT_CFG",
+    "FN_PCLINK_ENABLED",
+};
 
-    stringstream resultstream;
+/* Binary search of the tag names, sorted once on first use.
+ Returns FN_LASTTAG for a name that isn't a tag
+*/
+int fnHttpServiceParser::tag_id(const string &tag)
+{
+    static const vector<int> sorted = [] {
+        vector<int> ids(FN_LASTTAG);
+        for (int i = 0; i < FN_LASTTAG; i++)
+            ids[i] = i;
+        std::sort(ids.begin(), ids.end(), [](int a, int b) {
+            return strcmp(tagids[a], tagids[b]) < 0;
+        });
+        return ids;
+    }();
 
-    // Debug_printf("Substituting tag '%s'\n", tag.c_str());
+    auto it = std::lower_bound(sorted.begin(), sorted.end(), tag, [](int id, const string &name) {
+        return name.compare(tagids[id]) > 0;
+    });
+    if (it != sorted.end() && tag.compare(tagids[*it]) == 0)
+        return *it;
+    return FN_LASTTAG;
+}
+
+const string fnHttpServiceParser::substitute_tag(const string &tag)
+{
+    return substitute_tag(tag_id(tag), tag);
+}
 
-    int tagid;
-    for (tagid = 0; tagid < FN_LASTTAG; tagid++)
+/* Tags that take a query of the hardware or filesystem are only worked out
+ once per page, however many times the page uses them
+*/
+const string fnHttpServiceParser::substitute_tag(int tagid, const string &tag, tag_memo &memo)
+{
+    switch (tagid)
     {
-        if (0 == tag.compare(tagids[tagid]))
-        {
-            break;
-        }
+    case FN_WIFIDETAIL:
+    case FN_SPIFFS_SIZE:
+    case FN_SPIFFS_USED:
+    case FN_SD_SIZE:
+    case FN_SD_USED:
+    case FN_BUSVOLTS:
+        break;
+    default:
+        return substitute_tag(tagid, tag);
     }
 
+    auto it = memo.find(tagid);
+    if (it == memo.end())
+        it = memo.emplace(tagid, substitute_tag(tagid, tag)).first;
+    return it->second;
+}
+
+const string fnHttpServiceParser::substitute_tag(int tagid, const string &tag)
+{
+    stringstream resultstream;
+
+    // Debug_printf("Substituting tag '%s'\n", tag.c_str());
+
     int drive_slot, host_slot;
     char disk_id;
 #ifndef ESP_PLATFORM
@@ -364,6 +416,9 @@ const string fnHttpServiceParser::substitute_tag(const string &tag)
     case FN_HEAPSIZE:
         resultstream << fnSystem.get_free_heap_size();
         break;
+    case FN_DISK_WRITES_PENDING:
+        resultstream << FileHandlerWriteback::pending_writes();
+        break;
     case FN_SYSSDK:
         resultstream << fnSystem.get_sdk_version();
         break;
@@ -652,6 +707,7 @@ bool fnHttpServiceParser::is_parsable(const char *extension)
 string fnHttpServiceParser::parse_contents(const string &contents)
 {
     std::stringstream ss;
+    tag_memo memo;
     size_t pos = 0, x, y;
     do
     {
@@ -671,13 +727,162 @@ string fnHttpServiceParser::parse_contents(const string &contents)
         // Now we have starting and ending tags
         if (x > 0)
             ss << contents.substr(pos, x - pos);
-        ss << substitute_tag(contents.substr(x + 2, y - x - 2));
+        string tag = contents.substr(x + 2, y - x - 2);
+        ss << substitute_tag(tag_id(tag), tag, memo);
         pos = y + 2;
     } while (true);
 
     return ss.str();
 }
 
+/* Split the file into the runs of text between <% and %> tags and the tags,
+ as parse_contents() would find them. Unknown tags become a run of their name
+*/
+bool fnHttpServiceParser::compile(FILE *f, compiled_template &compiled)
+{
+    char block[256];
+    std::string name;
+    bool in_tag = false, name_long = false;
+    char prev = 0;
+    uint32_t pos = 0, lit_start = 0, tag_start = 0;
+    size_t n;
+
+    compiled.tokens.clear();
+    if (fseek(f, 0, SEEK_SET) != 0)
+        return false;
+
+    while ((n = fread(block, 1, sizeof(block), f)) > 0)
+    {
+        for (size_t i = 0; i < n; i++, pos++)
+        {
+            char c = block[i];
+            if (!in_tag)
+            {
+                if (prev == '<' && c == '%')
+                {
+                    in_tag = true;
+                    tag_start = pos + 1;
+                    name.clear();
+                    name_long = false;
+                    prev = 0;
+                    continue;
+                }
+            }
+            else if (prev == '%' && c == '>')
+            {
+                // The text up to the "<%", then the tag
+                if (tag_start - 2 > lit_start)
+                    compiled.tokens.push_back({lit_start, tag_start - 2 - lit_start, -1});
+
+                int tagid = FN_LASTTAG;
+                if (!name_long)
+                {
+                    name.pop_back(); // the '%'
+                    tagid = tag_id(name);
+                }
+                if (tagid < FN_LASTTAG)
+                    compiled.tokens.push_back({tag_start - 2, pos + 1 - (tag_start - 2), tagid});
+                else if (pos - 1 > tag_start)
+                    compiled.tokens.push_back({tag_start, pos - 1 - tag_start, -1});
+
+                lit_start = pos + 1;
+                in_tag = false;
+                prev = 0;
+                continue;
+            }
+            else if (name.length() < MAX_TEMPLATE_TAG_LEN)
+                name += c;
+            else
+                name_long = true;
+
+            prev = c;
+        }
+    }
+
+    // An unclosed tag goes out as it is
+    if (pos > lit_start)
+        compiled.tokens.push_back({lit_start, pos - lit_start, -1});
+
+    compiled.size = pos;
+    return true;
+}
+
+/* parse_contents() without holding the file or its result in memory. Files are
+ compiled once and then only read for the runs of text between the tags
+*/
+bool fnHttpServiceParser::render(FILE *f, const std::string &name, time_t mtime, char *buf, size_t bufsize,
+                                 const std::function<bool(const char *, size_t)> &send)
+{
+    static std::map<std::string, compiled_template> templates;
+    static std::mutex templates_mutex;
+
+    std::vector<template_token> tokens;
+    {
+        std::lock_guard<std::mutex> lock(templates_mutex);
+        auto it = templates.find(name);
+        // A file replaced on the filesystem has a new time, if not a new size
+        if (it == templates.end() || it->second.size != FileSystem::filesize(f) || it->second.mtime != mtime)
+        {
+            compiled_template compiled;
+            if (!compile(f, compiled))
+                return false;
+            compiled.mtime = mtime;
+            Debug_printf("Compiled template '%s', %u tokens\n", name.c_str(), (unsigned)compiled.tokens.size());
+            it = templates.insert_or_assign(name, std::move(compiled)).first;
+        }
+        tokens = it->second.tokens;
+    }
+
+    tag_memo memo;
+    size_t used = 0;
+    auto flush_full = [&]() -> bool {
+        if (used < bufsize)
+            return true;
+        used = 0;
+        return send(buf, bufsize);
+    };
+
+    long at = -1;
+    for (const auto &t : tokens)
+    {
+        if (t.tag >= 0)
+        {
+            string value = substitute_tag(t.tag, "", memo);
+            const char *p = value.data();
+            size_t left = value.length();
+            while (left > 0)
+            {
+                if (!flush_full())
+                    return false;
+                size_t z = std::min(left, bufsize - used);
+                memcpy(buf + used, p, z);
+                used += z;
+                p += z;
+                left -= z;
+            }
+            continue;
+        }
+
+        // Straight from the file into the buffer
+        if ((long)t.offset != at && fseek(f, t.offset, SEEK_SET) != 0)
+            return false;
+        uint32_t left = t.length;
+        while (left > 0)
+        {
+            if (!flush_full())
+                return false;
+            size_t z = fread(buf + used, 1, std::min((size_t)left, bufsize - used), f);
+            if (z == 0)
+                return false;
+            used += z;
+            left -= z;
+        }
+        at = t.offset + t.length;
+    }
+
+    return used == 0 || send(buf, used);
+}
+
 long fnHttpServiceParser::uptime_seconds()
 {
     return fnSystem.get_uptime() / 1000000;
@@ -12,6 +12,11 @@ If a file has an extention pre-determined to support parsing (see/update
     *       string substitute_tag(const string &tag)
     * function.
     * 
+    render() does the same without loading the file: the first time a file
+    is sent it is compiled into a list of literal spans of the file and tag
+    IDs, which is kept. The literal spans are then read from the file and
+    sent with the tag values in between, a buffer at a time.
+
 See const fnHttpServiceParser::substitute_tag() for
 currently supported tags.
 
@@ -19,15 +24,46 @@ currently supported tags.
 #ifndef HTTPSERVICEPARSER_H
 #define HTTPSERVICEPARSER_H
 
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <map>
 #include <string>
+#include <vector>
 
 class fnHttpServiceParser
 {
+    // A run of the file sent as it is, or a tag when tag >= 0
+    struct template_token
+    {
+        uint32_t offset;
+        uint32_t length;
+        int tag;
+    };
+    struct compiled_template
+    {
+        // Of the file it was compiled from
+        long size;
+        time_t mtime;
+        std::vector<template_token> tokens;
+    };
+    // Values of the slow tags, kept while one page is sent
+    typedef std::map<int, std::string> tag_memo;
+
     static std::string format_uptime();
     static long uptime_seconds();
+    static int tag_id(const std::string &tag);
     static const std::string substitute_tag(const std::string &tag);
+    static const std::string substitute_tag(int tagid, const std::string &tag);
+    static const std::string substitute_tag(int tagid, const std::string &tag, tag_memo &memo);
+    static bool compile(FILE *f, compiled_template &compiled);
 public:
     static std::string parse_contents(const std::string &contents);
+    // Send the template in f, which is name last modified at mtime, as pieces of up
+    // to bufsize in buf. Stops with false as soon as send does
+    static bool render(FILE *f, const std::string &name, time_t mtime, char *buf, size_t bufsize,
+                       const std::function<bool(const char *, size_t)> &send);
     static bool is_parsable(const char *extension);
 };
 
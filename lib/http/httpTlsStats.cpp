@@ -0,0 +1,47 @@
+#include "httpTlsStats.h"
+
+#include <sstream>
+
+httpTlsStats tls_stats;
+
+void httpTlsStats::handshake(bool cached_session, bool ok, uint32_t ms)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    tls_handshake_stats &s = cached_session ? _cached : _full;
+    if (!ok)
+    {
+        s.failed++;
+        return;
+    }
+    s.count++;
+    s.sum_ms += ms;
+    if (ms > s.max_ms)
+        s.max_ms = ms;
+}
+
+void httpTlsStats::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _full = tls_handshake_stats();
+    _cached = tls_handshake_stats();
+}
+
+static void _handshake_json(std::ostringstream &out, const tls_handshake_stats &s)
+{
+    out << "{\"count\":" << s.count << ",\"failed\":" << s.failed << ",\"avg_ms\":"
+        << (s.count ? s.sum_ms / s.count : 0) << ",\"max_ms\":" << s.max_ms << "}";
+}
+
+std::string httpTlsStats::to_json()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::ostringstream out;
+
+    out << "{\"full\":";
+    _handshake_json(out, _full);
+    out << ",\"cached_session\":";
+    _handshake_json(out, _cached);
+    out << "}";
+
+    return out.str();
+}
@@ -0,0 +1,38 @@
+#ifndef _HTTP_TLS_STATS_H_
+#define _HTTP_TLS_STATS_H_
+
+/*
+ * TLS handshake timing for the HTTP clients, reported on /stats next to the
+ * bus statistics. Handshakes that offered a cached session are counted
+ * separately from full ones so the effect of session resumption shows up.
+ */
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+struct tls_handshake_stats
+{
+    uint32_t count = 0;
+    uint32_t failed = 0;
+    uint32_t max_ms = 0;
+    uint64_t sum_ms = 0;
+};
+
+class httpTlsStats
+{
+private:
+    tls_handshake_stats _full;
+    tls_handshake_stats _cached; // a cached session was offered to the server
+    std::mutex _mutex;
+
+public:
+    void handshake(bool cached_session, bool ok, uint32_t ms);
+
+    std::string to_json();
+    void clear();
+};
+
+extern httpTlsStats tls_stats;
+
+#endif // _HTTP_TLS_STATS_H_
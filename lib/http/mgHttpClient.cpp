@@ -4,6 +4,7 @@
 #include <ctype.h>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sstream>
@@ -37,6 +38,8 @@
 #include "fnSystem.h"
 #include "utils.h"
 #include "mgHttpClient.h"
+#include "httpClientPool.h"
+#include "httpTlsStats.h"
 
 #include "../../include/debug.h"
 
@@ -44,6 +47,132 @@
 
 const char *webdav_depths[] = {"0", "1", "infinity"};
 
+// An idle keep-alive connection travels with the mongoose manager that owns it
+struct mgPooledConnection
+{
+    mg_mgr *mgr;
+    mg_connection *conn;
+};
+
+static void _pool_destroy(mgPooledConnection &pooled)
+{
+    MgMgrDeleter()(pooled.mgr);
+}
+
+static httpClientPool<mgPooledConnection> http_pool(_pool_destroy);
+
+void http_client_pool_expire()
+{
+    http_pool.expire();
+}
+
+#if MG_TLS == MG_TLS_MBED || MG_TLS == MG_TLS_OPENSSL
+// Sessions from earlier TLS connections, keyed by origin. Offering one lets the
+// server resume it with an abbreviated handshake instead of a full key exchange.
+#define MG_TLS_SESSION_CACHE_SIZE 8
+
+#if MG_TLS == MG_TLS_MBED
+typedef mbedtls_ssl_session *mgTlsSessionPtr;
+#else
+typedef SSL_SESSION *mgTlsSessionPtr;
+#endif
+
+struct mgTlsSession
+{
+    std::string key;
+    mgTlsSessionPtr session = nullptr;
+    uint64_t used = 0;
+};
+
+static mgTlsSession tls_sessions[MG_TLS_SESSION_CACHE_SIZE];
+static std::mutex tls_sessions_mutex;
+
+static void _tls_session_free(mgTlsSessionPtr session)
+{
+#if MG_TLS == MG_TLS_MBED
+    mbedtls_ssl_session_free(session);
+    delete session;
+#else
+    SSL_SESSION_free(session);
+#endif
+}
+
+// Hand the cached session for key to a connection that hasn't started its handshake
+static bool _tls_session_offer(struct mg_connection *c, const std::string &key)
+{
+    struct mg_tls *tls = (struct mg_tls *)c->tls;
+    std::lock_guard<std::mutex> lock(tls_sessions_mutex);
+    for (auto &s : tls_sessions)
+    {
+        if (s.session == nullptr || s.key != key)
+            continue;
+        s.used = fnSystem.millis();
+#if MG_TLS == MG_TLS_MBED
+        return mbedtls_ssl_set_session(&tls->ssl, s.session) == 0; // copies the session
+#else
+        return SSL_set_session(tls->ssl, s.session) == 1; // takes a reference
+#endif
+    }
+    return false;
+}
+
+// Forget key's session, e.g. after the server failed a handshake that offered it
+static void _tls_session_forget(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(tls_sessions_mutex);
+    for (auto &s : tls_sessions)
+    {
+        if (s.session != nullptr && s.key == key)
+        {
+            _tls_session_free(s.session);
+            s.session = nullptr;
+            s.key.clear();
+        }
+    }
+}
+
+// Remember the session of a connection that just completed its handshake
+static void _tls_session_save(struct mg_connection *c, const std::string &key)
+{
+    struct mg_tls *tls = (struct mg_tls *)c->tls;
+#if MG_TLS == MG_TLS_MBED
+    mgTlsSessionPtr session = new mbedtls_ssl_session;
+    mbedtls_ssl_session_init(session);
+    if (mbedtls_ssl_get_session(&tls->ssl, session) != 0)
+    {
+        _tls_session_free(session);
+        return;
+    }
+#else
+    mgTlsSessionPtr session = SSL_get1_session(tls->ssl);
+    if (session == nullptr)
+        return;
+#endif
+
+    std::lock_guard<std::mutex> lock(tls_sessions_mutex);
+    mgTlsSession *slot = nullptr;
+    for (auto &s : tls_sessions)
+    {
+        if (s.key == key || s.session == nullptr)
+        {
+            slot = &s;
+            break;
+        }
+        if (slot == nullptr || s.used < slot->used)
+            slot = &s;
+    }
+    if (slot->session != nullptr)
+        _tls_session_free(slot->session);
+    slot->key = key;
+    slot->session = session;
+    slot->used = fnSystem.millis();
+}
+#else
+static bool _tls_session_offer(struct mg_connection *c, const std::string &key) { return false; }
+static void _tls_session_forget(const std::string &key) {}
+static void _tls_session_save(struct mg_connection *c, const std::string &key) {}
+#endif
+
 mgHttpClient::mgHttpClient()
 {
     // Used for cert debugging:
@@ -57,6 +186,32 @@ mgHttpClient::mgHttpClient()
 mgHttpClient::~mgHttpClient()
 {
     close();
+    _release_connection();
+}
+
+// Park an idle keep-alive connection in the pool, or let it close with the manager
+void mgHttpClient::_release_connection()
+{
+    if (_handle != nullptr && _conn != nullptr && _conn_reusable && _transaction_done && !_conn_key.empty())
+    {
+        _conn->fn_data = nullptr;
+        http_pool.release(_conn_key, {_handle.release(), _conn});
+    }
+    _conn = nullptr;
+    _conn_reusable = false;
+    _handle.reset();
+}
+
+// Stop using the current connection, mongoose closes it on the next poll
+void mgHttpClient::_drop_connection()
+{
+    if (_conn != nullptr)
+    {
+        _conn->fn_data = nullptr;
+        _conn->is_closing = 1;
+        _conn = nullptr;
+    }
+    _conn_reusable = false;
 }
 
 void mgHttpClient::load_system_certs() {
@@ -247,15 +402,33 @@ bool mgHttpClient::begin(std::string url)
 
     _post_data = nullptr;
     _post_datalen = 0;
-    
-    _handle.reset(new mg_mgr());
-    if (_handle == nullptr)
-        return false;
+
+    _release_connection();
 
     _url = url;
     // For mongoose, lowercase the first 5 characters of the URL, assuming it starts with http:// or https://
     for (size_t i = 0; i < 5 && i < _url.size(); ++i)
         _url[i] = std::tolower(_url[i]);
+
+    // Pick up a kept-alive connection to the same host if there is one
+    mgPooledConnection pooled;
+    std::string key = http_pool_key(_url);
+    if (!key.empty() && http_pool.acquire(key, pooled))
+    {
+#ifdef VERBOSE_HTTP
+        Debug_printf("mgHttpClient::begin reusing connection to %s\n", key.c_str());
+#endif
+        _handle.reset(pooled.mgr);
+        _conn = pooled.conn;
+        _conn->fn_data = this;
+        _conn_key = key;
+        _conn_reusable = true;
+        return true;
+    }
+
+    _handle.reset(new mg_mgr());
+    if (_handle == nullptr)
+        return false;
     mg_mgr_init(_handle.get());
     return true;
 }
@@ -355,8 +528,6 @@ void mgHttpClient::handle_connect(struct mg_connection *c)
 #ifdef VERBOSE_HTTP
     Debug_printf("mgHttpClient: Connected\n");
 #endif
-    _transaction_done = false;
-
     const char *url = _url.c_str();
     struct mg_str host = mg_url_host(url);
     // If url is https://, tell client connection to use TLS
@@ -375,9 +546,28 @@ void mgHttpClient::handle_connect(struct mg_connection *c)
         // opts.key = mg_file_read(&mg_fs_posix, "tls/private-key.pem");
 #endif
         opts.name = host;
+        // Hold off the handshake mg_tls_init() would start, so a cached session can be offered first
+        c->is_connecting = 1;
         mg_tls_init(c, &opts);
+        c->is_connecting = 0;
+        if (c->tls != nullptr)
+        {
+            _tls_start = fnSystem.millis();
+            _tls_session_offered = _tls_session_offer(c, _conn_key);
+            mg_tls_handshake(c);
+        }
     }
 
+    send_request(c);
+}
+
+void mgHttpClient::send_request(struct mg_connection *c)
+{
+    _transaction_done = false;
+
+    const char *url = _url.c_str();
+    struct mg_str host = mg_url_host(url);
+
     // reset response status code
     _status_code = -1;
 
@@ -407,7 +597,7 @@ void mgHttpClient::handle_connect(struct mg_connection *c)
             // start the request
             mg_printf(c, "%s %s HTTP/1.1\r\n"
                             "Host: %.*s\r\n"
-                            "Connection: close\r\n",
+                            "Connection: keep-alive\r\n",
                             method_str, mg_url_uri(url), (int)host.len, host.ptr);
 
             // send auth header
@@ -485,6 +675,8 @@ void mgHttpClient::handle_read(struct mg_connection *c)
             process_response_headers(c, hm, hdrs_len);
             _transaction_begin = false; // indicate the headers are processed
             _processed = true; // stop polling, headers are available
+            if (!_is_chunked && _body_left == 0)
+                response_complete();
         }
     }
 
@@ -501,6 +693,18 @@ void mgHttpClient::process_response_headers(struct mg_connection *c, struct mg_h
     _content_length = (int)hm.body.len;
     struct mg_str *te;
 
+    // Body length is ~0 without Content-Length, the response then ends when the server closes
+    _body_left = hm.body.len;
+    if (_method == HTTP_HEAD || _status_code < 200 || _status_code == 204 || _status_code == 304)
+        _body_left = 0;
+
+    // HTTP/1.1 connections persist unless the server says otherwise, HTTP/1.0 ones only on request
+    struct mg_str *conn_hdr = mg_http_get_header(&hm, "Connection");
+    if (conn_hdr != nullptr)
+        _keep_alive = mg_vcasecmp(conn_hdr, "keep-alive") == 0;
+    else
+        _keep_alive = mg_vcasecmp(&hm.proto, "HTTP/1.1") == 0;
+
     if ((te = mg_http_get_header(&hm, "Transfer-Encoding")) != nullptr) 
     {
         if (mg_vcasecmp(te, "chunked") == 0) 
@@ -591,14 +795,18 @@ void mgHttpClient::process_body_data(struct mg_connection *c, char *data, int le
     {
         int o = 0, l = 0, pl, dl, cl;
         // Get all complete chunks out of mongoose buffer
+        bool last_chunk = false;
         while ((cl = skip_chunk(data + o, len - o, &pl, &dl)) > 0)
         {
-            // Append chunks data to our buffer
-            if (dl > 0)
+            o += cl;
+            // Zero length chunk ends the body
+            if (dl == 0)
             {
-                _buffer_str.append(data + o + pl, dl);
+                last_chunk = true;
+                break;
             }
-            o += cl;
+            // Append chunks data to our buffer
+            _buffer_str.append(data + o - cl + pl, dl);
         }
         if (o > 0)
         {
@@ -614,6 +822,12 @@ void mgHttpClient::process_body_data(struct mg_connection *c, char *data, int le
             }
             _processed = true; // stop polling, data is available in _buffer_str
         }
+        if (last_chunk)
+        {
+            c->recv.len = 0;
+            response_complete();
+            return;
+        }
         if (cl < 0) 
         {
             Debug_println("mgHttpClient: Invalid chunk");
@@ -625,21 +839,47 @@ void mgHttpClient::process_body_data(struct mg_connection *c, char *data, int le
     else
     {
         // Append entire body data to buffer
-        _buffer_str.append(data, len);
+        size_t n = (size_t)len < _body_left ? (size_t)len : _body_left;
+        _buffer_str.append(data, n);
+        if (_body_left != (size_t)~0)
+            _body_left -= n;
         c->recv.len = 0;   // cleanup mongoose receive buffer
         _processed = true; // stop polling, data is available in _buffer_str
+        if (_body_left == 0)
+            response_complete();
     }
 }
 
+// Whole response is in, the connection can carry the next request if the server agreed to keep it open
+void mgHttpClient::response_complete()
+{
+    _transaction_done = true;
+    _processed = true;
+    if (_keep_alive)
+        _conn_reusable = true;
+    else
+        _drop_connection();
+}
+
+void mgHttpClient::handle_tls_handshake(struct mg_connection *c, bool ok)
+{
+    uint32_t ms = (uint32_t)(fnSystem.millis() - _tls_start);
+    tls_stats.handshake(_tls_session_offered, ok, ms);
+#ifdef VERBOSE_HTTP
+    Debug_printf("mgHttpClient: TLS Handshake %s in %ums%s\n", ok ? "succeeded" : "failed", (unsigned)ms,
+                 _tls_session_offered ? " (cached session)" : "");
+#endif
+    if (ok)
+        _tls_session_save(c, _conn_key);
+    else if (_tls_session_offered)
+        _tls_session_forget(_conn_key); // don't offer it again
+}
+
 void report_unhandled(int ev)
 {
 #ifdef VERBOSE_HTTP
     switch(ev)
     {
-    case MG_EV_TLS_HS:
-        Debug_printf("mgHttpClient: TLS Handshake succeeded\n");
-        break;
-
     case MG_EV_HTTP_HDRS:
         Debug_printf("mgHttpClient: HTTP Headers received\n");
         break;
@@ -681,6 +921,10 @@ void mgHttpClient::_httpevent_handler(struct mg_connection *c, int ev, void *ev_
     // // Our user_data should be a pointer to our mgHttpClient object
     mgHttpClient *client = (mgHttpClient *)c->fn_data;
     bool progress = true;
+
+    // Connection was dropped or is parked in the pool
+    if (client == nullptr)
+        return;
     
     switch (ev)
     {
@@ -688,6 +932,10 @@ void mgHttpClient::_httpevent_handler(struct mg_connection *c, int ev, void *ev_
         client->handle_connect(c);
         break;
 
+    case MG_EV_TLS_HS:
+        client->handle_tls_handshake(c, true);
+        break;
+
     case MG_EV_READ:
         client->handle_read(c);
         break;
@@ -697,10 +945,17 @@ void mgHttpClient::_httpevent_handler(struct mg_connection *c, int ev, void *ev_
         Debug_printf("mgHttpClient: Connection closed\n");
 #endif
         client->_transaction_done = true;
+        if (c == client->_conn)
+        {
+            client->_conn = nullptr;
+            client->_conn_reusable = false;
+        }
         break;
     
     case MG_EV_ERROR:
         Debug_printf("mgHttpClient: Error - %s\n", (const char*)ev_data);
+        if (c->is_tls && c->is_tls_hs)
+            client->handle_tls_handshake(c, false);
         client->_transaction_done = true;
         client->_status_code = 901; // Fake HTTP status code to indicate connection error
         break;
@@ -737,6 +992,14 @@ int mgHttpClient::_perform()
     while (!done)
     {
         _perform_fetch(); // process up until we have all headers
+        // A pooled connection the server has since closed ends before any response arrives,
+        // retry once on a fresh connection
+        if (_reused && _transaction_begin && _transaction_done)
+        {
+            Debug_printf("mgHttpClient: kept-alive connection went stale, reconnecting\n");
+            _perform_connect();
+            continue;
+        }
         // check the response code
         if (_status_code == 301 || _status_code == 302)
             done = !_perform_redirect(); // continue if we're going to redirect
@@ -772,8 +1035,26 @@ void mgHttpClient::_perform_connect()
         _status_code = 900; // Fake HTTP status code to indicate general error
         return;
     }
-    
-    mg_connect(_handle.get(), _url.c_str(), _httpevent_handler, this);  // Create client connection
+
+    std::string key = http_pool_key(_url);
+    if (_conn != nullptr && _conn_reusable && key == _conn_key)
+    {
+        // Keep-alive connection to the same host, send the request right away
+        _reused = true;
+        _conn_reusable = false;
+        send_request(_conn);
+        return;
+    }
+
+    _drop_connection();
+    _reused = false;
+    _conn_key = key;
+    _conn = mg_connect(_handle.get(), _url.c_str(), _httpevent_handler, this);  // Create client connection
+    if (_conn == nullptr)
+    {
+        _transaction_done = true;
+        _status_code = 901; // Fake HTTP status code to indicate connection error
+    }
 }
 
 void mgHttpClient::_perform_fetch()
@@ -64,6 +64,19 @@ private:
     // chunked transfer encoding
     bool _is_chunked = false;
 
+    // keep-alive: body bytes still to come (~0 until the server closes), whether the
+    // server will keep the connection open, and the connection the requests go out on
+    size_t _body_left = 0;
+    bool _keep_alive = false;
+    mg_connection *_conn = nullptr;
+    std::string _conn_key;
+    bool _conn_reusable = false; // _conn is idle between complete responses
+    bool _reused = false;        // current request went out on an already open connection
+
+    // TLS handshake timing, and whether a cached session was offered to the server
+    uint64_t _tls_start = 0;
+    bool _tls_session_offered = false;
+
     // authentication
     std::string _username;
     std::string _password;
@@ -102,6 +115,11 @@ private:
 	// int _perform_stream(esp_http_client_method_t method, uint8_t *write_data, int write_size);
 
     void handle_connect(struct mg_connection *c);
+    void handle_tls_handshake(struct mg_connection *c, bool ok);
+    void send_request(struct mg_connection *c);
+    void response_complete();
+    void _release_connection();
+    void _drop_connection();
     void handle_http_msg(struct mg_connection *c, struct mg_http_message *hm);
     void handle_read(struct mg_connection *c);
 	void process_response_headers(mg_connection *c, mg_http_message &hm, int hdrs_len);
@@ -11,15 +11,26 @@
 #include "fnSystem.h"
 #include "fnConfig.h"
 #include "fnWiFi.h"
+#include "fnIdleWait.h"
 #include "fsFlash.h"
 #include "modem.h"
 #include "printer.h"
 #include "fuji.h"
+#include "fujiCopyTask.h"
+#include "busStats.h"
+#include "httpTlsStats.h"
+#include "fnArena.h"
+#ifdef BUILD_ATARI
+#include "sio/sioTrace.h"
+#include "sio/siocom/fnSioCom.h"
+#endif
 
 #include "mongoose.h"
 #include "httpService.h"
 #include "httpServiceConfigurator.h"
 #include "httpServiceParser.h"
+#include "httpServiceApi.h"
+#include "fnEvents.h"
 #include "httpServiceBrowser.h"
 
 #include "../../include/debug.h"
@@ -242,7 +253,7 @@ int fnHttpService::redirect_or_result(mg_connection *c, mg_http_message *hm, int
     return result;
 }
 
-int fnHttpService::get_handler_print(struct mg_connection *c)
+int fnHttpService::get_handler_print(struct mg_connection *c, struct mg_http_message *hm)
 {
     Debug_println("Print request handler");
 
@@ -297,11 +308,18 @@ int fnHttpService::get_handler_print(struct mg_connection *c)
         exts = "bin";
     }
 
+    // "/print?page=N" fetches a finished page on its own and leaves the printout going
+    char page_str[10] = "";
+    mg_http_get_var(&hm->query, "page", page_str, sizeof(page_str));
+    int page = atoi(page_str);
+
     string filename = "printout.";
+    if (page > 0)
+        filename = "printout-" + std::to_string(page) + ".";
     filename += exts;
 
     // Tell printer to finish its output and get a read handle to the file
-    FILE *poutput = currentPrinter->closeOutputAndProvideReadHandle();
+    FILE *poutput = page > 0 ? currentPrinter->providePageReadHandle(page) : currentPrinter->closeOutputAndProvideReadHandle();
     if (poutput == nullptr)
     {
         Debug_printf("Unable to open printer output\n");
@@ -342,7 +360,8 @@ int fnHttpService::get_handler_print(struct mg_connection *c)
     fclose(poutput);
 
     // Tell the printer it can start writing from the beginning
-    printer->reset_printer(); // destroy,create new printer emulator object of previous type.
+    if (page == 0)
+        printer->reset_printer(); // destroy,create new printer emulator object of previous type.
 
     Debug_println("Print request completed");
 
@@ -423,6 +442,34 @@ int fnHttpService::get_handler_mount(mg_connection *c, mg_http_message *hm)
     return redirect_or_result(c, hm, 0);
 }
 
+// /copy?hostslot=N&path=...&desthostslot=M&destpath=... starts a background copy,
+// /copy on its own reports how the last one is going
+int fnHttpService::get_handler_copy(mg_connection *c, mg_http_message *hm)
+{
+    char hs_str[4] = "", dhs_str[4] = "", path[MAX_PATHLEN] = "", destpath[MAX_PATHLEN] = "";
+    int result = 0;
+
+    if (mg_http_get_var(&hm->query, "path", path, sizeof(path)) > 0)
+    {
+        mg_http_get_var(&hm->query, "hostslot", hs_str, sizeof(hs_str));
+        mg_http_get_var(&hm->query, "desthostslot", dhs_str, sizeof(dhs_str));
+        mg_http_get_var(&hm->query, "destpath", destpath, sizeof(destpath));
+        int hs = atoi(hs_str);
+        int dhs = atoi(dhs_str);
+
+        if (hs < 0 || hs >= MAX_HOSTS || dhs < 0 || dhs >= MAX_HOSTS || destpath[0] == '\0')
+            result = -1;
+        else if (!fujiCopyTask::submit(theFuji.get_hosts(hs), path, theFuji.get_hosts(dhs), destpath))
+            result = -1;
+    }
+
+    fujiCopyStatus status = fujiCopyTask::status();
+    mg_http_reply(c, 200, "Content-Type: application/json\r\n",
+                  "{\"result\": %d, \"state\": %d, \"copied\": %u, \"total\": %u}\n",
+                  result, status.state, (unsigned)status.copied, (unsigned)status.total);
+    return result;
+}
+
 int fnHttpService::get_handler_eject(mg_connection *c, mg_http_message *hm)
 {
     // get "deviceslot" query variable
@@ -455,6 +502,7 @@ int fnHttpService::get_handler_eject(mg_connection *c, mg_http_message *hm)
         Config.save();
         theFuji._populate_slots_from_config(); // otherwise they don't show up in config.
         theFuji.get_disks(ds)->disk_dev.device_active = false;
+        fnEvents.publish(fn_event_type::EJECT, ds);
 
         // Finally, scan all device slots, if all empty, and config enabled, enable the config device.
         if (Config.get_general_config_enabled())
@@ -497,6 +545,30 @@ int fnHttpService::get_handler_hosts(mg_connection *c, mg_http_message *hm)
     return 0;
 }
 
+// /api/hosts, /api/slots and /api/status as JSON, 304 when the client has it already
+int fnHttpService::get_handler_api(mg_connection *c, mg_http_message *hm)
+{
+    std::string path(hm->uri.ptr, hm->uri.len);
+    std::string json;
+    if (!fnHttpServiceApi::get(path, json))
+    {
+        mg_http_reply(c, 404, "", "Not Found");
+        return 0;
+    }
+
+    std::string etag = fnHttpServiceApi::etag(json);
+    struct mg_str *match = mg_http_get_header(hm, "If-None-Match");
+    if (match != nullptr && etag == std::string(match->ptr, match->len))
+    {
+        mg_http_reply(c, 304, ("ETag: " + etag + "\r\n").c_str(), "");
+        return 0;
+    }
+
+    mg_http_reply(c, 200, ("Content-Type: application/json\r\nCache-Control: no-cache\r\nETag: " + etag + "\r\n").c_str(),
+                  "%s", json.c_str());
+    return 0;
+}
+
 int fnHttpService::post_handler_hosts(mg_connection *c, mg_http_message *hm)
 {
     char hostslot[2] = "";
@@ -594,7 +666,7 @@ void fnHttpService::cb(struct mg_connection *c, int ev, void *ev_data)
         else if (mg_http_match_uri(hm, "/print"))
         {
             // print handler
-            get_handler_print(c);
+            get_handler_print(c, hm);
         }
         else if (mg_http_match_uri(hm, "/browse/#"))
         {
@@ -611,6 +683,42 @@ void fnHttpService::cb(struct mg_connection *c, int ev, void *ev_data)
             // browse handler
             get_handler_mount(c, hm);
         }
+        else if (mg_http_match_uri(hm, "/stats"))
+        {
+            // per-device bus statistics, ?clear=1 starts over after reporting
+            char clear[4] = "";
+            std::string extra = "\"tls\":" + tls_stats.to_json();
+            extra += ",\"arenas\":" + fnArena.to_json();
+#ifdef BUILD_ATARI
+            if (fnSioCom.get_sio_mode() == SioCom::sio_mode::NETSIO)
+                extra += ",\"netsio\":" + fnSioCom.netsio_stats_json();
+#endif
+            std::string json = bus_stats.to_json(extra);
+            mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s", json.c_str());
+            mg_http_get_var(&hm->query, "clear", clear, sizeof(clear));
+            if (atoi(clear))
+            {
+                bus_stats.clear();
+                tls_stats.clear();
+            }
+        }
+#if defined(BUILD_ATARI) && defined(SIO_TRACE)
+        else if (mg_http_match_uri(hm, "/siotrace"))
+        {
+            // SIO command timing, ?clear=1 starts over after reporting
+            char clear[4] = "";
+            std::string json = sio_trace.to_json();
+            mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s", json.c_str());
+            mg_http_get_var(&hm->query, "clear", clear, sizeof(clear));
+            if (atoi(clear))
+                sio_trace.clear();
+        }
+#endif
+        else if (mg_http_match_uri(hm, "/copy"))
+        {
+            // background file copy
+            get_handler_copy(c, hm);
+        }
         else if (mg_http_match_uri(hm, "/unmount"))
         {
             // eject handler
@@ -640,6 +748,16 @@ void fnHttpService::cb(struct mg_connection *c, int ev, void *ev_data)
             else
                 get_handler_hosts(c, hm);
         }
+        else if (mg_http_match_uri(hm, "/events"))
+        {
+            // WebSocket, send_event() writes to it from now on
+            mg_ws_upgrade(c, hm, NULL);
+            c->data[0] = 'E';
+        }
+        else if (mg_http_match_uri(hm, "/api/*"))
+        {
+            get_handler_api(c, hm);
+        }
         else if (mg_http_match_uri(hm, "/url/*"))
         {
             get_handler_shorturl(c, hm);
@@ -691,6 +809,23 @@ struct mg_mgr * fnHttpService::start_server(serverstate &srvstate)
 
 /* Set up and start the web server
  */
+// Each event as a JSON text frame to every browser listening on /events
+void fnHttpService::send_event(const fn_event &event)
+{
+    if (fnHTTPD.state.hServer == nullptr)
+        return;
+
+    std::string json;
+    for (struct mg_connection *c = fnHTTPD.state.hServer->conns; c != nullptr; c = c->next)
+    {
+        if (!c->is_websocket || c->data[0] != 'E')
+            continue;
+        if (json.empty())
+            json = fnEventBus::to_json(event);
+        mg_ws_send(c, json.data(), json.length(), WEBSOCKET_OP_TEXT);
+    }
+}
+
 void fnHttpService::start()
 {
     if (state.hServer != nullptr)
@@ -704,6 +839,13 @@ void fnHttpService::start()
     // esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &connect_handler, &(state.hServer));
     // esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &disconnect_handler, &(state.hServer));
 
+    static bool events_subscribed = false;
+    if (!events_subscribed)
+    {
+        fnEvents.subscribe(send_event);
+        events_subscribed = true;
+    }
+
     // Go ahead and attempt starting the server for the first time
     start_server(state);
 }
@@ -722,8 +864,19 @@ void fnHttpService::stop()
 
 void fnHttpService::service()
 {
-    if (state.hServer != nullptr)
-        mg_mgr_poll(state.hServer, 0);
+    if (state.hServer == nullptr)
+        return;
+
+    mg_mgr_poll(state.hServer, 0);
+
+    // Let the main loop sleep until a request comes in, but not while one is being answered
+    for (struct mg_connection *c = state.hServer->conns; c != nullptr; c = c->next)
+    {
+        if (c->send.len > 0 || c->is_resp || c->is_connecting || c->is_resolving || c->is_draining || c->is_closing)
+            fnIdle.busy();
+        else
+            fnIdle.watch((int)(size_t)c->fd);
+    }
 }
 
 #endif // !ESP_PLATFORM
@@ -25,6 +25,10 @@ void Response::setHeader(std::string header, size_t value) {
 
 void Response::flushHeaders() {
     for (const auto &h: headers)
-        writeHeader(h.first.c_str(), h.second.c_str());
+    {
+        auto s = sent.insert(h);
+        if (s.second)
+            writeHeader(s.first->first.c_str(), s.first->second.c_str());
+    }
     headers.clear();
 }
@@ -13,12 +13,39 @@
 #include <iomanip>
 
 #include <esp_http_server.h>
+#include <esp_timer.h>
 
 #include "file-utils.h"
 #include "string_utils.h"
+#include "httpRange.h"
+#include "httpFileWriter.h"
+
+// Receive timeouts tolerated in a row before an upload is dropped
+#define PUT_READ_RETRIES 3
 
 using namespace WebDav;
 
+// Fills up to len bytes of buf from the request body, short only at the end or on error
+static int putReadBody(Request &req, char *buf, int len)
+{
+    int got = 0, retries = 0;
+    while (got < len)
+    {
+        int r = req.readBody(buf + got, len - got);
+        if (r < 0)
+            return -1;
+        if (r == 0)
+        {
+            if (++retries > PUT_READ_RETRIES)
+                return -1;
+            continue;
+        }
+        retries = 0;
+        got += r;
+    }
+    return got;
+}
+
 Server::Server(std::string rootURI, std::string rootPath) : rootURI(rootURI), rootPath(rootPath)  {}
 
 std::string Server::uriToPath(std::string uri)
@@ -66,80 +93,146 @@ std::string Server::formatTime(time_t t)
     return std::string(buf);
 }
 
-static void xmlElement(std::ostringstream &s, const char *name, const char *value)
+// Changes whenever the file is written, without hashing anything
+std::string Server::makeETag(const struct stat &sb)
 {
-    s << "<" << name << ">" << value << "</" << name << ">\r\n";
+    char buf[40];
+    snprintf(buf, sizeof(buf), "\"%lx-%lx\"", (unsigned long)sb.st_mtime, (unsigned long)sb.st_size);
+    return std::string(buf);
 }
 
-void Server::sendMultiStatusResponse(Response &resp, MultiStatusResponse &msr)
+// Whether the client's copy is current; If-None-Match wins over If-Modified-Since
+bool Server::notModified(Request &req, const std::string &etag, const struct stat &sb)
 {
-    std::ostringstream s;
-
-    s << "<D:response>\r\n";
-    xmlElement(s, "D:href", msr.href.c_str());
-    s << "<D:propstat>\r\n";
-    xmlElement(s, "D:status", msr.status.c_str());
+    std::string match = req.getHeader("If-None-Match");
+    if (!match.empty())
+        return match == "*" || match.find(etag) != std::string::npos;
 
-    s << "<D:prop>\r\n";
-    for (const auto &p : msr.props)
-        xmlElement(s, p.first.c_str(), p.second.c_str());
+    // Clients send back the Last-Modified value they got
+    std::string since = req.getHeader("If-Modified-Since");
+    return !since.empty() && since == formatTime(sb.st_mtime);
+}
 
-    xmlElement(s, "D:resourcetype", msr.isCollection ? "<D:collection/>" : "");
-    s << "</D:prop>\r\n";
+static void xmlElement(std::string &s, const char *name, const std::string &value)
+{
+    s += "<"; s += name; s += ">";
+    s += value;
+    s += "</"; s += name; s += ">\r\n";
+}
 
-    s << "</D:propstat>\r\n";
-    s << "</D:response>\r\n";
+void Server::dirCache::clear()
+{
+    path.clear();
+    entries.clear();
+    entries.shrink_to_fit();
+}
 
-    //Debug_printv("[%s]", s.str().c_str());
+// Cached entry for path, if its directory was listed recently enough
+const Server::dirEntry *Server::dirCache::find(const std::string &dir, const std::string &name)
+{
+    if (path.empty() || dir != path || (uint64_t)esp_timer_get_time() - time > PROPFIND_CACHE_US)
+        return nullptr;
 
-    resp.sendChunk(s.str().c_str());
+    for (const auto &e : entries)
+        if (e.name == name)
+            return &e;
+    return nullptr;
 }
 
-int Server::sendPropResponse(Response &resp, std::string path, int recurse)
+// Appends one <D:response> to out, passing out on as a chunk once it has grown enough
+void Server::sendPropEntry(Response &resp, std::string &out, const std::string &path, const dirEntry *e)
 {
-    mstr::replaceAll(path, "//", "/");
-    std::string uri = pathToURI(path);
-    //Debug_printv("uri[%s] path[%s] recurse[%d]", uri.c_str(), path.c_str(), recurse);
+    out += "<D:response>\r\n";
+    xmlElement(out, "D:href", pathToURI(path));
+    out += "<D:propstat>\r\n";
+    xmlElement(out, "D:status", e ? "HTTP/1.1 200 OK" : "HTTP/1.1 404 Not Found");
+
+    out += "<D:prop>\r\n";
+    bool isCollection = false;
+    if (e)
+    {
+        struct stat sb = {};
+        sb.st_mtime = e->mtime;
+        sb.st_size = e->size;
+        isCollection = e->isDir;
 
-    // bool exists = (path == rootPath) ||
-    //               (access(path.c_str(), R_OK) == 0);
+        xmlElement(out, "D:creationdate", formatTime(e->ctime));
+        if (!isCollection)
+        {
+            xmlElement(out, "D:getcontentlength", std::to_string(e->size));
+            xmlElement(out, "D:getcontenttype", HTTPD_TYPE_OCTET);
+        }
+        xmlElement(out, "D:getetag", makeETag(sb));
+        xmlElement(out, "D:getlastmodified", formatTime(e->mtime));
+    }
+    xmlElement(out, "D:resourcetype", isCollection ? "<D:collection/>" : "");
+    out += "</D:prop>\r\n";
+
+    out += "</D:propstat>\r\n";
+    out += "</D:response>\r\n";
+
+    if (out.size() >= PROPFIND_CHUNK_SIZE)
+    {
+        resp.sendChunk(out.c_str(), out.size());
+        out.clear();
+    }
+}
+
+static bool statEntry(const std::string &path, const char *name, Server::dirEntry &e)
+{
     struct stat sb;
-    int i = stat(path.c_str(), &sb);
-    bool exists (i == 0);
+    if (stat(path.c_str(), &sb) != 0)
+        return false;
+
+    e.name = name;
+    e.isDir = (sb.st_mode & S_IFMT) == S_IFDIR;
+    e.size = sb.st_size;
+    e.mtime = sb.st_mtime;
+    e.ctime = sb.st_ctime;
+    return true;
+}
 
-    MultiStatusResponse r;
+// Streams the entries for path and, down to recurse levels, what's below it.
+// Each directory entry goes out as soon as it has been read; Depth 1 listings
+// are also kept for a few seconds, as clients tend to ask for them repeatedly
+int Server::sendPropResponse(Response &resp, std::string &out, std::string path, int recurse)
+{
+    mstr::replaceAll(path, "//", "/");
+    //Debug_printv("path[%s] recurse[%d]", path.c_str(), recurse);
 
-    r.href = uri;
+    size_t slash = path.rfind('/');
+    std::string parent = slash == std::string::npos ? "" : path.substr(0, slash);
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
 
-    if ( exists )
-    {
-        r.status = "HTTP/1.1 200 OK";
+    dirEntry self;
+    const dirEntry *e = cache.find(parent, name);
+    if (e == nullptr && statEntry(path, name.c_str(), self))
+        e = &self;
+    else if (e != nullptr)
+        self = *e;
 
-        r.props["D:creationdate"] = formatTime(sb.st_ctime);
-        r.props["D:getlastmodified"] = formatTime(sb.st_mtime);
-        //r.props["D:displayname"] = mstr::urlEncode(basename(path.c_str()));
+    sendPropEntry(resp, out, path, e);
 
-        std::string s = path + std::to_string(sb.st_mtime);
-        r.props["D:getetag"] = mstr::sha1(s);
+    if (e == nullptr || !self.isDir || recurse <= 0)
+        return 0;
 
-        r.isCollection = ((sb.st_mode & S_IFMT) == S_IFDIR);
-        if ( !r.isCollection )
-        {
-            r.props["D:getcontentlength"] = std::to_string(sb.st_size);
-            r.props["D:getcontenttype"] = HTTPD_TYPE_OCTET;
-        }
-        //Debug_printv("Found!");
+    bool cached = recurse == 1 && !cache.path.empty() && cache.path == path &&
+                  (uint64_t)esp_timer_get_time() - cache.time <= PROPFIND_CACHE_US;
+    if (cached)
+    {
+        for (const auto &c : cache.entries)
+            sendPropEntry(resp, out, path + "/" + c.name, &c);
     }
     else
     {
-        r.status = "HTTP/1.1 404 Not Found";
-        //Debug_printv("Not Found!");
-    }
-
-    sendMultiStatusResponse(resp, r);
+        // Only a Depth 1 listing is worth keeping, and only while it's small
+        bool keep = recurse == 1;
+        if (keep)
+        {
+            cache.clear();
+            cache.time = esp_timer_get_time();
+        }
 
-    if (r.isCollection && recurse > 0)
-    {
         DIR *dir = opendir(path.c_str());
         if (dir)
         {
@@ -152,19 +245,40 @@ int Server::sendPropResponse(Response &resp, std::string path, int recurse)
                     continue;
 
                 std::string rpath = path + "/" + de->d_name;
-                sendPropResponse(resp, rpath, recurse - 1);
+                if (recurse > 1)
+                {
+                    sendPropResponse(resp, out, rpath, recurse - 1);
+                    continue;
+                }
+
+                dirEntry c;
+                bool found = statEntry(rpath, de->d_name, c);
+                sendPropEntry(resp, out, rpath, found ? &c : nullptr);
+
+                if (keep && found)
+                {
+                    if (cache.entries.size() < PROPFIND_CACHE_MAX_ENTRIES)
+                        cache.entries.push_back(c);
+                    else
+                    {
+                        cache.clear();
+                        keep = false;
+                    }
+                }
             }
             closedir(dir);
         }
 
-        // If we are at root and SD card is mounted send entry
-        if (path == "/")
-        {
-            i = stat("/sd", &sb);
-            if (i == 0)
-                sendPropResponse(resp, "/sd", recurse - 1);
-        }
+        if (keep)
+            cache.path = path;
+    }
 
+    // If we are at root and SD card is mounted send entry
+    if (path == "/")
+    {
+        dirEntry sd;
+        if (statEntry("/sd", "sd", sd))
+            sendPropResponse(resp, out, "/sd", recurse - 1);
     }
 
     return 0;
@@ -173,6 +287,8 @@ int Server::sendPropResponse(Response &resp, std::string path, int recurse)
 // http entry points
 int Server::doCopy(Request &req, Response &resp)
 {
+    cache.clear();
+
     if (req.getDestination().empty())
         return 400;
 
@@ -220,6 +336,8 @@ int Server::doCopy(Request &req, Response &resp)
 
 int Server::doDelete(Request &req, Response &resp)
 {
+    cache.clear();
+
     if (req.getDepth() != Request::DEPTH_INFINITY)
         return 400;
 
@@ -249,27 +367,61 @@ int Server::doGet(Request &req, Response &resp)
     if ((sb.st_mode & S_IFMT) == S_IFDIR)
         return 405;
 
+    std::string etag = makeETag(sb);
+    resp.setHeader("ETag", etag);
+    resp.setHeader("Last-Modified", formatTime(sb.st_mtime));
+    resp.setHeader("Accept-Ranges", "bytes");
+
+    if (notModified(req, etag, sb))
+        return 304;
+
+    // Single byte range, ignored if If-Range names another version
+    long first = 0, last = sb.st_size - 1;
+    int status = 200;
+    std::string range = req.getHeader("Range");
+    std::string ifRange = req.getHeader("If-Range");
+    if (!range.empty() && (ifRange.empty() || ifRange == etag))
+    {
+        int r = http_parse_range(range.c_str(), sb.st_size, first, last);
+        if (r < 0)
+        {
+            resp.setHeader("Content-Range", "bytes */" + std::to_string(sb.st_size));
+            return 416;
+        }
+        if (r > 0)
+        {
+            resp.setHeader("Content-Range", http_content_range_value(first, last, sb.st_size));
+            status = 206;
+        }
+        else
+            first = 0, last = sb.st_size - 1;
+    }
+
     // Send File
     FILE *f = fopen(path.c_str(), "r");
     if (!f)
         return 404;
+    if (first > 0 && fseek(f, first, SEEK_SET) != 0)
+    {
+        fclose(f);
+        return 500;
+    }
 
-    std::string s = path + std::to_string(sb.st_mtime);
-
-    resp.setHeader("Content-Length", sb.st_size);
-    resp.setHeader("ETag", mstr::sha1(s));
-    resp.setHeader("Last-Modified", formatTime(sb.st_mtime));
+    resp.setStatus(status);
+    resp.flushHeaders();
 
     ret = 0;
 
     const int chunkSize = 8192;
     char *chunk = (char *)malloc(chunkSize);
+    long left = last - first + 1;
 
-    for (;;)
+    while (left > 0)
     {
-        size_t r = fread(chunk, 1, chunkSize, f);
+        size_t r = fread(chunk, 1, left < chunkSize ? left : chunkSize, f);
         if (r <= 0)
             break;
+        left -= r;
 
         if (!resp.sendChunk(chunk, r))
         {
@@ -285,7 +437,7 @@ int Server::doGet(Request &req, Response &resp)
     if (ret != 0)
         return 500;
 
-    return 200;
+    return status;
 }
 
 int Server::doHead(Request &req, Response &resp)
@@ -299,11 +451,14 @@ int Server::doHead(Request &req, Response &resp)
     if (ret < 0)
         return 404;
 
-    std::string s = path + std::to_string(sb.st_mtime);
-
+    std::string etag = makeETag(sb);
     resp.setHeader("Content-Length", sb.st_size);
-    resp.setHeader("ETag", mstr::sha1(s));
+    resp.setHeader("ETag", etag);
     resp.setHeader("Last-Modified", formatTime(sb.st_mtime));
+    resp.setHeader("Accept-Ranges", "bytes");
+
+    if (notModified(req, etag, sb))
+        return 304;
 
     return 200;
 }
@@ -346,6 +501,8 @@ int Server::doLock(Request &req, Response &resp)
 
 int Server::doMkcol(Request &req, Response &resp)
 {
+    cache.clear();
+
     if (req.getContentLength() != 0)
         return 415;
 
@@ -372,6 +529,8 @@ int Server::doMkcol(Request &req, Response &resp)
 
 int Server::doMove(Request &req, Response &resp)
 {
+    cache.clear();
+
     if (req.getDestination().empty())
         return 400;
 
@@ -450,10 +609,14 @@ int Server::doPropfind(Request &req, Response &resp)
     resp.setContentType("application/xml;charset=utf-8");
     resp.flushHeaders();
 
-    resp.sendChunk("<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n");
-    resp.sendChunk("<D:multistatus xmlns:D=\"DAV:\">\r\n");
-    sendPropResponse(resp, path, recurse);
-    resp.sendChunk("</D:multistatus>\r\n");
+    // Entries are batched into chunks of about PROPFIND_CHUNK_SIZE
+    std::string out;
+    out.reserve(PROPFIND_CHUNK_SIZE + 512);
+    out = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n";
+    out += "<D:multistatus xmlns:D=\"DAV:\">\r\n";
+    sendPropResponse(resp, out, path, recurse);
+    out += "</D:multistatus>\r\n";
+    resp.sendChunk(out.c_str(), out.size());
     resp.closeChunk();
 
     return 207;
@@ -476,6 +639,8 @@ int Server::doProppatch(Request &req, Response &resp)
 
 int Server::doPut(Request &req, Response &resp)
 {
+    cache.clear();
+
     std::string path = uriToPath(req.getPath());
 
     //Debug_printv("req[%s] path[%s]", req.getPath().c_str(), path.c_str());
@@ -497,33 +662,27 @@ int Server::doPut(Request &req, Response &resp)
 
     int remaining = req.getContentLength();
 
-    const int chunkSize = 8192;
-    char *chunk = (char *)malloc(chunkSize);
-
-    int ret = 0;
-
-    while (remaining > 0)
+    // Claim the whole file up front, so FAT clusters aren't allocated one write at a time
+    if (remaining > 0 && !upload_preallocate(f, remaining))
     {
-        int r, w;
-        r = req.readBody(chunk, std::min(remaining, chunkSize));
-        if (r <= 0)
-            break;
-
-        w = fwrite(chunk, 1, r, f);
-        if (w != r)
-        {
-            ret = -errno;
-            break;
-        }
-
-        remaining -= w;
+        fclose(f);
+        unlink(path.c_str());
+        return 507;
     }
 
-    free(chunk);
+    auto read = [&req](char *buf, int len) { return putReadBody(req, buf, len); };
+    int ret = remaining > 0 ? upload_write_pipelined(f, remaining, read) : 0;
+    if (ret == -2)
+        ret = upload_write_sequential(f, remaining, read);
+
     fclose(f);
 
     if (ret < 0)
+    {
+        // Don't leave a preallocated file around that looks complete
+        unlink(path.c_str());
         return 500;
+    }
 
     if (!exists)
         return 201;
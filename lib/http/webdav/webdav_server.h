@@ -1,8 +1,20 @@
 #pragma once
 
+#include <sys/stat.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
 #include "request.h"
 #include "response.h"
 
+// PROPFIND output is sent in chunks of about this size
+#define PROPFIND_CHUNK_SIZE 2048
+// How long a Depth 1 listing is served from memory
+#define PROPFIND_CACHE_US 3000000
+// Larger directories are never cached, to keep the heap free
+#define PROPFIND_CACHE_MAX_ENTRIES 256
+
 namespace WebDav {
 
 class Server {
@@ -26,12 +38,34 @@ public:
         int doPut(Request &req, Response &resp);
         int doUnlock(Request &req, Response &resp);
 
+        struct dirEntry
+        {
+            std::string name;
+            bool isDir;
+            size_t size;
+            time_t mtime;
+            time_t ctime;
+        };
+
 private:
         std::string rootURI, rootPath;
 
         std::string formatTime(time_t t);
-        int sendPropResponse(Response &resp, std::string path, int recurse);
-        void sendMultiStatusResponse(Response &resp, MultiStatusResponse &msr);
+        std::string makeETag(const struct stat &sb);
+        bool notModified(Request &req, const std::string &etag, const struct stat &sb);
+        // Last Depth 1 listing, dropped by anything that changes files
+        struct dirCache
+        {
+            std::string path;
+            uint64_t time = 0;
+            std::vector<dirEntry> entries;
+
+            void clear();
+            const dirEntry *find(const std::string &dir, const std::string &name);
+        } cache;
+
+        int sendPropResponse(Response &resp, std::string &out, std::string path, int recurse);
+        void sendPropEntry(Response &resp, std::string &out, const std::string &path, const dirEntry *e);
 };
 
 } // namespace
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include "../meat_media.h"
 #include "endianness.h"
 
+#include <cstring>
+
 // D64 Utility Functions
 
 bool D64MStream::seekBlock(uint64_t index, uint8_t offset)
@@ -34,7 +36,7 @@ bool D64MStream::seekBlock(uint64_t index, uint8_t offset)
 
     // Debug_printv("track[%d] sector[%d] speedZone[%d] sectorOffset[%d]", track, sector, speedZone(track), sectorOffset);
 
-    return containerStream->seek((index * block_size) + offset);
+    return seekContainer((index * block_size) + offset);
 }
 
 bool D64MStream::seekSector(uint8_t track, uint8_t sector, uint8_t offset)
@@ -82,7 +84,7 @@ bool D64MStream::seekSector(uint8_t track, uint8_t sector, uint8_t offset)
 
     //Debug_printv("track[%d] sector[%d] speedZone[%d] sectorOffset[%d]", track, sector, speedZone(track), sectorOffset);
 
-    return containerStream->seek((sectorOffset * block_size) + offset);
+    return seekContainer((sectorOffset * block_size) + offset);
 }
 
 bool D64MStream::seekSector(std::vector<uint8_t> trackSectorOffset)
@@ -90,56 +92,248 @@ bool D64MStream::seekSector(std::vector<uint8_t> trackSectorOffset)
     return seekSector(trackSectorOffset[0], trackSectorOffset[1], trackSectorOffset[2]);
 }
 
-std::string D64MStream::readBlock(uint8_t track, uint8_t sector)
+bool D64MStream::seek(uint32_t offset)
 {
-    return "";
+    // Straight to the container, the track cache picks up again at the next seekSector()
+    container_pos_known = false;
+    return MMediaStream::seek(offset);
 }
 
-bool D64MStream::writeBlock(uint8_t track, uint8_t sector, std::string data)
+bool D64MStream::seekContainer(uint32_t pos)
 {
+    if (pos > containerStream->size())
+        return false;
+
+    // The container is only seeked when it has to be read or written
+    container_pos = pos;
+    container_pos_known = true;
+    container_synced = false;
     return true;
 }
 
-bool D64MStream::allocateBlock(uint8_t track, uint8_t sector)
+// Read the track holding pos (or the D64_TRACK_CACHE_SECTORS window of it) into the cache
+bool D64MStream::fillTrackCache(uint32_t pos)
 {
-    // int offset;
-    // byte bitmask;
+    uint32_t block = pos / block_size;
+    uint8_t end_track = partitions[partition].block_allocation_map.back().end_track;
 
-    // offset = (track-1) * 4 + 4;							// offset to correct Track-Info
-    // if (bam->GetRawSector()[offset] > 0)
-    // {
-    // 	bam->GetRawSector()[offset] -= 1;				// reduce free Sectors
-    // }
-    // offset++;											// Move to Bitmask
-    // offset += (sector >> 3);							// move to the correct byte (sector div 8)
-    // bitmask = (byte)(1 << (sector % 8));				// generate Bitmask for Sector
-    // if ((bam->GetRawSector()[offset] & bitmask) == 0)	// was already set to 'used' ?
-    // {
-    // 	return false;
-    // }
-    // bitmask ^= 255;										// invert bitmask (0 means "Sector is used")
-    // bam->GetRawSector()[offset] &= bitmask;				// clear bit in BAM
-    // WriteSector(bam);									// Write back to Image
+    uint32_t start = 0;
+    uint16_t count = 0;
+    for (uint16_t t = 1; t <= end_track; t++)
+    {
+        count = getSectorCount(t);
+        if (block < start + count)
+            break;
+        start += count;
+        count = 0;
+    }
+    if (count == 0)
+        return false; // past the last track, e.g. error info
+
+    if (count > D64_TRACK_CACHE_SECTORS)
+    {
+        uint16_t window = (block - start) / D64_TRACK_CACHE_SECTORS;
+        start += window * D64_TRACK_CACHE_SECTORS;
+        count = std::min(count - window * D64_TRACK_CACHE_SECTORS, D64_TRACK_CACHE_SECTORS);
+    }
+
+    uint32_t offset = start * block_size;
+    if (offset >= containerStream->size())
+        return false;
+    uint32_t len = std::min((uint32_t)(count * block_size), containerStream->size() - offset);
+
+    container_synced = false;
+    track_len = 0;
+    if (!containerStream->seek(offset))
+        return false;
+
+    const uint8_t *span;
+    uint32_t n = containerStream->readSpan(&span, len);
+    if (span != nullptr)
+    {
+        track_cache.clear();
+        track_data = span;
+        len = n;
+    }
+    else
+    {
+        track_cache.resize(len);
+        len = containerStream->read(track_cache.data(), len);
+        track_cache.resize(len);
+        track_data = track_cache.data();
+    }
+    track_len = len;
+    track_cache_start = offset;
+
+    return pos >= offset && pos < offset + len;
+}
+
+uint32_t D64MStream::readContainer(uint8_t *buf, uint32_t size)
+{
+    if (!container_pos_known)
+        return MMediaStream::readContainer(buf, size);
+
+    uint32_t bytesRead = 0;
+    while (bytesRead < size)
+    {
+        if (container_pos < track_cache_start || container_pos >= track_cache_start + track_len)
+        {
+            if (!fillTrackCache(container_pos))
+                break;
+        }
+
+        uint32_t n = std::min(size - bytesRead, track_cache_start + track_len - container_pos);
+        memcpy(buf + bytesRead, track_data + (container_pos - track_cache_start), n);
+        bytesRead += n;
+        container_pos += n;
+        container_synced = false;
+    }
+
+    if (bytesRead < size)
+    {
+        // Outside the tracks, read it directly
+        if (!container_synced && !containerStream->seek(container_pos))
+            return bytesRead;
+        uint32_t n = containerStream->read(buf + bytesRead, size - bytesRead);
+        bytesRead += n;
+        container_pos += n;
+        container_synced = true;
+    }
+
+    return bytesRead;
+}
+
+uint32_t D64MStream::writeContainer(uint8_t *buf, uint32_t size)
+{
+    if (!container_pos_known)
+        return MMediaStream::writeContainer(buf, size);
+
+    if (!container_synced && !containerStream->seek(container_pos))
+        return 0;
+
+    uint32_t n = containerStream->write(buf, size);
+
+    // Keep the cached copy of the track current, a span is the container itself
+    uint32_t start = std::max(container_pos, track_cache_start);
+    uint32_t end = std::min(container_pos + n, (uint32_t)(track_cache_start + track_cache.size()));
+    if (start < end && track_data == track_cache.data())
+        memcpy(track_cache.data() + (start - track_cache_start), buf + (start - container_pos), end - start);
+
+    container_pos += n;
+    container_synced = true;
+    return n;
+}
+
+bool D64MStream::readBlock(uint8_t track, uint8_t sector, uint8_t *buf)
+{
+    if (!seekSector(track, sector))
+        return false;
+
+    return readContainer(buf, block_size) == block_size;
+}
+
+bool D64MStream::writeBlock(uint8_t track, uint8_t sector, uint8_t *buf)
+{
+    if (!seekSector(track, sector))
+        return false;
+
+    // This could be a directory or BAM sector
+    invalidateIndex();
+
+    return writeContainer(buf, block_size) == block_size;
+}
+
+bool D64MStream::loadBAM()
+{
+    if (bam_loaded)
+        return true;
+
+    bam_tracks.clear();
+    bam_free = 0;
+
+    auto &maps = partitions[partition].block_allocation_map;
+    for (uint8_t x = 0; x < maps.size(); x++)
+    {
+        auto &m = maps[x];
+        if (bam_tracks.size() <= m.end_track)
+            bam_tracks.resize(m.end_track + 1);
+
+        if (!seekSector(m.track, m.sector, m.offset))
+            return false;
+
+        // One read for all the tracks this map covers
+        std::vector<uint8_t> bam((m.end_track - m.start_track + 1) * m.byte_count);
+        if (readContainer(bam.data(), bam.size()) != bam.size())
+            return false;
+
+        for (uint16_t t = m.start_track; t <= m.end_track; t++)
+        {
+            TrackBAM &tb = bam_tracks[t];
+            tb.map = x;
+            tb.bytes.assign(bam.begin() + (t - m.start_track) * m.byte_count, bam.begin() + (t - m.start_track + 1) * m.byte_count);
+
+            if (m.byte_count > 3)
+            {
+                if (t != partitions[partition].directory_track)
+                    bam_free += tb.bytes[0];
+            }
+            else
+            {
+                // D71 tracks 36 - 70 you have to count the 1 bits (0 is allocated)
+                for (uint8_t b : tb.bytes)
+                    bam_free += std::bitset<8>(b).count();
+            }
+        }
+    }
+
+    bam_loaded = true;
     return true;
 }
 
+bool D64MStream::writeTrackBAM(uint8_t track)
+{
+    TrackBAM &tb = bam_tracks[track];
+    auto &m = partitions[partition].block_allocation_map[tb.map];
+
+    if (!seekSector(m.track, m.sector, m.offset + (track - m.start_track) * m.byte_count))
+        return false;
+
+    return writeContainer(tb.bytes.data(), tb.bytes.size()) == tb.bytes.size();
+}
+
+bool D64MStream::setBlockFree(uint8_t track, uint8_t sector, bool free)
+{
+    if (!loadBAM() || track >= bam_tracks.size() || bam_tracks[track].map == 0xFF)
+        return false;
+
+    TrackBAM &tb = bam_tracks[track];
+    bool counted = tb.bytes.size() > 3;
+    uint16_t byte = (counted ? 1 : 0) + (sector >> 3);
+    uint8_t bitmask = (1 << (sector % 8));
+    if (byte >= tb.bytes.size())
+        return false;
+
+    // 1 means "Sector is free"
+    if (((tb.bytes[byte] & bitmask) != 0) == free)
+        return false; // already in that state
+
+    tb.bytes[byte] ^= bitmask;
+    if (counted)
+        tb.bytes[0] += free ? 1 : -1;
+    if (!counted || track != partitions[partition].directory_track)
+        bam_free += free ? 1 : -1;
+
+    return writeTrackBAM(track);
+}
+
+bool D64MStream::allocateBlock(uint8_t track, uint8_t sector)
+{
+    return setBlockFree(track, sector, false);
+}
+
 bool D64MStream::deallocateBlock(uint8_t track, uint8_t sector)
 {
-    // int offset;
-    // byte bitmask;
-
-    // offset = (track - 1) * 4 + 4;						// offset to correct Track-Info
-    // bam->GetRawSector()[offset] += 1;					// increase free Sectors
-    // offset++;											// Move to Bitmask
-    // offset += (sector >> 3);							// move to the correct byte (sector div 8)
-    // bitmask = (byte)(1 << (sector % 8));				// generate Bitmask for Sector
-    // if ((bam->GetRawSector()[offset] & bitmask) == 1)	// Sector already free ?
-    // {
-    // 	return false;
-    // }
-    // bam->GetRawSector()[offset] |= bitmask;				// clear bit in BAM (1 means "Sector is free")
-    // WriteSector(bam);									// Write back to Image
-    return true;
+    return setBlockFree(track, sector, true);
 }
 
 bool D64MStream::getNextFreeBlock(uint8_t startTrack, uint8_t startSector, uint8_t *foundTrack, uint8_t *foundSector)
@@ -167,7 +361,7 @@ bool D64MStream::getNextFreeBlock(uint8_t startTrack, uint8_t startSector, uint8
                 sector++;
             }
 
-            if (sector > getSectorCount(track))
+            if (sector >= getSectorCount(track))
             {
                 track++;
                 sector = 0;
@@ -190,58 +384,110 @@ bool D64MStream::getNextFreeBlock(uint8_t startTrack, uint8_t startSector, uint8
 
 bool D64MStream::isBlockFree(uint8_t track, uint8_t sector)
 {
-    // int offset;
-    // byte bitmask;
-
-    // offset = (track-1) * 4 + 4;                 // offset to correct Track-Info
-    // offset++;									// Move to Bitmask
-    // offset += (sector >> 3);                    // move to the correct byte (sector div 8)
-    // bitmask = (byte)(1 << (sector % 8));        // generate Bitmask for Sector
-    // return (bam->GetRawSector()[offset] & bitmask) == bitmask;
+    if (!loadBAM() || track >= bam_tracks.size() || bam_tracks[track].map == 0xFF)
+        return false;
+
+    const TrackBAM &tb = bam_tracks[track];
+    uint16_t byte = (tb.bytes.size() > 3 ? 1 : 0) + (sector >> 3);
+    if (byte >= tb.bytes.size())
+        return false;
+
+    uint8_t bitmask = (1 << (sector % 8));
+    return (tb.bytes[byte] & bitmask) == bitmask;
+}
+
+bool D64MStream::buildDirectoryIndex()
+{
+    if (dir_indexed)
+        return true;
+
+    dir_index.clear();
+    dir_lookup.clear();
+
+    uint8_t t = partitions[partition].directory_track;
+    uint8_t s = partitions[partition].directory_sector;
+    uint8_t o = partitions[partition].directory_offset;
+
+    // A broken chain could loop, a directory can't be longer than the image
+    uint32_t max_sectors = containerStream->size() / block_size;
+    uint8_t buf[256];
+
+    for (uint32_t n = 0; t != 0 && n < max_sectors; n++)
+    {
+        uint16_t len = std::min(block_size - o, sizeof(buf));
+        if (!seekSector(t, s, o) || readContainer(buf, len) != len)
+            return false;
+
+        uint8_t next_t = buf[0];
+        uint8_t next_s = buf[1];
+        for (uint16_t e = 0; e + sizeof(Entry) <= len; e += sizeof(Entry))
+        {
+            Entry *entry = (Entry *)(buf + e);
+
+            std::string filename(entry->filename, sizeof(entry->filename));
+            filename = filename.substr(0, filename.find_first_of(std::string("\xA0\0", 2)));
+            filename = mstr::toUTF8(filename);
+
+            dir_lookup.emplace(filename, dir_index.size());
+            dir_index.push_back({filename, entry->file_type, t, s, (uint8_t)(o + e), next_t, next_s});
+        }
+
+        // Only the first sector starts at the partition's directory offset
+        t = next_t;
+        s = next_s;
+        o = 0;
+    }
+
+    Debug_printv("entries[%d]", dir_index.size());
+    dir_indexed = true;
     return true;
 }
 
 bool D64MStream::seekEntry( std::string filename )
 {
     // Read Directory Entries
-    if (filename.size())
+    if (filename.size() && buildDirectoryIndex())
     {
-        uint16_t index = 1;
         mstr::replaceAll(filename, "\\", "/");
         bool wildcard = (mstr::contains(filename, "*") || mstr::contains(filename, "?"));
-        while (seekEntry(index))
-        {
-            std::string entryFilename = entry.filename;
-            uint8_t i = entryFilename.find_first_of(0xA0);
-            entryFilename = entryFilename.substr(0, i);
-            //mstr::rtrimA0(entryFilename);
-            entryFilename = mstr::toUTF8(entryFilename);
-
-            //Debug_printv("index[%d] track[%d] sector[%d] filename[%s] entry.filename[%.16s]", index, track, sector, filename.c_str(), entryFilename.c_str());
-
-            //Debug_printv("filename[%s] entry[%s]", filename.c_str(), entryFilename.c_str());
 
-            if (filename == entryFilename) // Match exact
-            {
-                return true;
-            }
-            else if (wildcard) // Wildcard Match
+        int32_t found = -1;
+        auto it = dir_lookup.find(filename);
+        if (it != dir_lookup.end()) // Match exact
+        {
+            found = it->second;
+        }
+        else if (wildcard) // Wildcard Match
+        {
+            for (uint16_t i = 0; i < dir_index.size() && found < 0; i++)
             {
                 if (filename == "*") // Match first PRG
                 {
-                    if (entry.file_type & 0b00000111)
-                    {
-                        filename = entryFilename;
-                        return true;
-                    }
+                    if (dir_index[i].file_type & 0b00000111)
+                        found = i;
                 }
-                else if (mstr::compare(filename, entryFilename)) // X?XX?X* Wildcard match
+                else if (mstr::compare(filename, dir_index[i].filename)) // X?XX?X* Wildcard match
                 {
-                    return true;
+                    found = i;
                 }
             }
+        }
+
+        if (found >= 0)
+        {
+            IndexEntry &e = dir_index[found];
+            if (seekSector(e.track, e.sector, e.offset) &&
+                readContainer((uint8_t *)&entry, sizeof(entry)) == sizeof(entry))
+            {
+                // Carry on from here with seekEntry(index)
+                next_track = e.next_track;
+                next_sector = e.next_sector;
+                entry_index = found + 1;
 
-            index++;
+                if (filename == "*")
+                    filename = e.filename;
+                return true;
+            }
         }
 
         Debug_printv("File not found!");
@@ -331,6 +577,7 @@ bool D64MStream::readEntry( uint16_t index ) {
     return seekEntry(index);
 }
 bool D64MStream::writeEntry( uint16_t index) {
+    dir_indexed = false;
     if ( seekEntry(index - 1) ) {
         return writeContainer((uint8_t*)&entry, sizeof(entry));
     }
@@ -339,45 +586,10 @@ bool D64MStream::writeEntry( uint16_t index) {
 
 uint16_t D64MStream::blocksFree()
 {
-    uint16_t free_count = 0;
-
-    for (uint8_t x = 0; x < partitions[partition].block_allocation_map.size(); x++)
-    {
-        uint8_t bam[partitions[partition].block_allocation_map[x].byte_count];
-        // Debug_printv("start_track[%d] end_track[%d]", block_allocation_map[x].start_track, block_allocation_map[x].end_track);
-
-        if (!seekSector(
-                partitions[partition].block_allocation_map[x].track,
-                partitions[partition].block_allocation_map[x].sector,
-                partitions[partition].block_allocation_map[x].offset))
-            return 0;
-
-        for (uint8_t i = partitions[partition].block_allocation_map[x].start_track; i <= partitions[partition].block_allocation_map[x].end_track; i++)
-        {
-            readContainer((uint8_t *)&bam, sizeof(bam));
-            if (sizeof(bam) > 3)
-            {
-                if (i != partitions[partition].directory_track)
-                {
-                    // Debug_printv("x[%d] track[%d] count[%d] size[%d]", x, i, bam[0], sizeof(bam));
-                    free_count += bam[0];
-                }
-            }
-            else
-            {
-                // D71 tracks 36 - 70 you have to count the 1 bits (0 is allocated)
-                uint8_t bit_count = 0;
-                bit_count += std::bitset<8>(bam[0]).count();
-                bit_count += std::bitset<8>(bam[1]).count();
-                bit_count += std::bitset<8>(bam[2]).count();
-
-                // Debug_printv("x[%d] track[%d] count[%d] size[%d] bam0[%d] bam1[%d] bam2[%d] (counting 1 bits)", x, i, bit_count, sizeof(bam), bam[0], bam[1], bam[2]);
-                free_count += bit_count;
-            }
-        }
-    }
+    if (!loadBAM())
+        return 0;
 
-    return free_count;
+    return bam_free;
 }
 
 uint32_t D64MStream::readFile(uint8_t *buf, uint32_t size)
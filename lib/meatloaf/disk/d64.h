@@ -18,6 +18,7 @@
 #include "../meatloaf.h"
 
 #include <map>
+#include <unordered_map>
 #include <bitset>
 #include <ctime>
 
@@ -25,6 +26,10 @@
 #include "string_utils.h"
 #include "utils.h"
 
+// Most sectors read into the track cache at once, a whole track on anything
+// up to a 1581 (40 sectors), a window of the track on DNP and D90 images
+#define D64_TRACK_CACHE_SECTORS 40
+
 
 /********************************************************
  * Streams
@@ -223,6 +228,10 @@ public:
     bool seekSector( uint8_t track, uint8_t sector, uint8_t offset = 0 ) override;
     bool seekSector( std::vector<uint8_t> trackSectorOffset ) override;
 
+    // Raw access to a whole block_size sector, for sector level tools (e.g. Epyx FastLoad disk copy)
+    bool readBlock( uint8_t track, uint8_t sector, uint8_t *buf );
+    bool writeBlock( uint8_t track, uint8_t sector, uint8_t *buf );
+
 
     uint16_t getSectorCount( uint16_t track )
     {
@@ -251,6 +260,8 @@ public:
     uint8_t next_sector = 0;
     uint8_t sector_offset = 0;
 
+    bool seek(uint32_t offset) override;
+
 private:
     void sendListing();
 
@@ -282,13 +293,55 @@ private:
     bool readEntry( uint16_t index = 0 ) override;
     bool writeEntry( uint16_t index = 0 ) override;
 
-    std::string readBlock( uint8_t track, uint8_t sector );
-    bool writeBlock( uint8_t track, uint8_t sector, std::string data );
     bool allocateBlock( uint8_t track, uint8_t sector );
     bool deallocateBlock( uint8_t track, uint8_t sector );
     bool getNextFreeBlock(uint8_t startTrack, uint8_t startSector, uint8_t *foundTrack, uint8_t *foundSector);
     bool isBlockFree(uint8_t track, uint8_t sector);
 
+    // Directory index, built by walking the directory chain once instead of on every lookup
+    struct IndexEntry {
+        std::string filename;       // UTF-8, without the 0xA0 padding
+        uint8_t file_type;
+        uint8_t track, sector;      // sector holding the entry
+        uint8_t offset;             // entry offset within that sector
+        uint8_t next_track, next_sector; // directory chain link of that sector
+    };
+    std::vector<IndexEntry> dir_index;
+    std::unordered_map<std::string, uint16_t> dir_lookup; // filename -> first dir_index position
+    bool dir_indexed = false;
+    bool buildDirectoryIndex();
+
+    // BAM copy, read once: free sector bitmap per track and the total blocksFree() reports
+    struct TrackBAM {
+        uint8_t map = 0xFF;         // block_allocation_map entry covering the track, 0xFF for none
+        std::vector<uint8_t> bytes; // as stored: free count (if byte_count > 3) then the bitmap
+    };
+    std::vector<TrackBAM> bam_tracks;   // indexed by track number
+    uint16_t bam_free = 0;
+    bool bam_loaded = false;
+    bool loadBAM();
+    bool writeTrackBAM( uint8_t track );
+    bool setBlockFree( uint8_t track, uint8_t sector, bool free );
+
+    // Anything written to the image may have changed the directory or BAM
+    void invalidateIndex() { dir_indexed = false; bam_loaded = false; }
+
+    // Track cache: seekSector() only records the position and readContainer()
+    // reads a whole track of the container at once, so following a sector chain
+    // over HTTP or TNFS costs one request per track instead of one per sector.
+    // A container in memory isn't copied, the cache just points into it
+    std::vector<uint8_t> track_cache;
+    const uint8_t *track_data = nullptr; // track_cache.data() or the container's own span
+    uint32_t track_len = 0;
+    uint32_t track_cache_start = 0;     // container offset of track_data[0]
+    uint32_t container_pos = 0;         // where the next readContainer()/writeContainer() goes
+    bool container_pos_known = false;   // container_pos set by seekSector()/seekBlock()
+    bool container_synced = false;      // containerStream is actually at container_pos
+    bool seekContainer(uint32_t pos);
+    bool fillTrackCache(uint32_t pos);
+    uint32_t readContainer(uint8_t *buf, uint32_t size) override;
+    uint32_t writeContainer(uint8_t *buf, uint32_t size) override;
+
     // Container
     friend class D8BMFile;
     friend class DFIMFile;
@@ -29,10 +29,11 @@ namespace Meat
         std::unique_ptr<MStream> mstream;
         std::unique_ptr<MFile> mfile;
 
-        static const size_t gbuffer_size = 2048;
-        static const size_t pbuffer_size = 512;
-        char *gbuffer;
-        char *pbuffer;
+        // sized by the stream's bufferSize() when it's opened
+        size_t gbuffer_size = 0;
+        size_t pbuffer_size = 0;
+        char *gbuffer = nullptr;
+        char *pbuffer = nullptr;
 
         std::streampos currBuffStart = 0;
         std::streampos currBuffEnd;
@@ -44,21 +45,18 @@ namespace Meat
         typedef typename traits_type::off_type off_type;
         typedef typename traits_type::pos_type pos_type;
 
-        mfilebuf()
-        {
-            gbuffer = new char[gbuffer_size+1];
-            pbuffer = new char[pbuffer_size+1];
-        };
+        mfilebuf() {};
 
         ~mfilebuf()
         {
+            // sync() may still write out the put buffer
+            close();
+
             if (pbuffer != nullptr)
                 delete[] pbuffer;
 
             if (gbuffer != nullptr)
                 delete[] gbuffer;
-
-            close();
         }
 
         std::filebuf *doOpen(std::ios_base::openmode mode)
@@ -71,9 +69,15 @@ namespace Meat
                 // Debug_println("In filebuf open success!");
                 if (mode == std::ios_base::in) {
                     // initialize get buffer using gbuffer_size
+                    gbuffer_size = mstream->bufferSize();
+                    delete[] gbuffer;
+                    gbuffer = new char[gbuffer_size+1];
                     this->setg(gbuffer, gbuffer, gbuffer);
                 }
                 else if (mode == std::ios_base::out) {
+                    pbuffer_size = mstream->bufferSize();
+                    delete[] pbuffer;
+                    pbuffer = new char[pbuffer_size+1];
                     this->setp(pbuffer, pbuffer + pbuffer_size);
                 }
                 return this;
@@ -175,7 +179,15 @@ namespace Meat
                 // no more characters are available, size == 0.
                 // auto buffer = reader->read();
 
-                int readCount = mstream->read((uint8_t *)gbuffer, gbuffer_size);
+                // where the stream holds the data itself, the get area is just pointed at it
+                const uint8_t *span;
+                int readCount = mstream->readSpan(&span, gbuffer_size);
+                char *base = (char *)span;
+                if (span == nullptr)
+                {
+                    readCount = mstream->read((uint8_t *)gbuffer, gbuffer_size);
+                    base = gbuffer;
+                }
 
                 Debug_printv("meat buffer underflow, readCount=%d", readCount);
 
@@ -202,7 +214,7 @@ namespace Meat
 
                     // Debug_printv("--mfilebuf underflow, read bytes=%d--", readCount);
                     // beg, curr, end <=> eback, gptr, egptr
-                    this->setg(gbuffer, gbuffer, gbuffer + readCount);
+                    this->setg(base, base, base + readCount);
                 }
             }
             // eback = beginning of get area
@@ -319,9 +331,9 @@ namespace Meat
                 // !!!
 
                 std::streampos delta = __pos - currBuffStart;
-                // TODO - check if eback == gbuffer!!!
+                // eback is gbuffer or the stream's span
                 // TODO - check if pbase == pbuffer!!!
-                this->setg(this->eback(), gbuffer + delta, this->egptr());
+                this->setg(this->eback(), this->eback() + delta, this->egptr());
                 this->setp(this->pbase(), pbuffer + delta);
             }
             else if (mstream->seek(__pos))
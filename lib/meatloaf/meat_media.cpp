@@ -1,6 +1,84 @@
 #include "meat_media.h"
 
-std::unordered_map<std::string, MMediaStream*> ImageBroker::image_repo;
+std::unordered_map<std::string, ImageBroker::Entry> ImageBroker::image_repo;
+std::unordered_map<std::string, int> ImageBroker::pins;
+uint32_t ImageBroker::use_clock = 0;
+ImageBroker::Stats ImageBroker::stats = {};
+
+
+// ImageBroker
+
+void ImageBroker::evict(const std::string &keep)
+{
+    while ( image_repo.size() > IMAGE_BROKER_ENTRIES || memoryUsed() > IMAGE_BROKER_BUDGET )
+    {
+        auto oldest = image_repo.end();
+        for ( auto it = image_repo.begin(); it != image_repo.end(); it++ )
+        {
+            if ( it->first == keep || pins.find(it->first) != pins.end() )
+                continue;
+            if ( oldest == image_repo.end() || it->second.lastUse < oldest->second.lastUse )
+                oldest = it;
+        }
+
+        // everything left is in use
+        if ( oldest == image_repo.end() )
+            break;
+
+        Debug_printv("evicting url[%s]", oldest->first.c_str());
+        stats.evictions++;
+        dispose(oldest->first);
+    }
+}
+
+void ImageBroker::unpin(std::string url)
+{
+    auto it = pins.find(url);
+    if ( it != pins.end() && --it->second <= 0 )
+        pins.erase(it);
+}
+
+void ImageBroker::dispose(std::string url)
+{
+    auto it = image_repo.find(url);
+    if ( it != image_repo.end() )
+    {
+        Entry e = it->second;
+        image_repo.erase(it);
+        delete e.stream;
+        delete e.file;
+    }
+    Debug_printv("streams[%d]", image_repo.size());
+}
+
+void ImageBroker::clear()
+{
+    for ( auto &pair : image_repo )
+    {
+        delete pair.second.stream;
+        delete pair.second.file;
+    }
+    image_repo.clear();
+}
+
+uint32_t ImageBroker::memoryUsed()
+{
+    uint32_t total = 0;
+    for ( auto &pair : image_repo )
+        total += pair.second.stream->memoryUsed();
+    return total;
+}
+
+void ImageBroker::print()
+{
+    printf("images[%u] memory[%lu] budget[%u] hits[%lu] misses[%lu] evictions[%lu]\r\n",
+           (unsigned) image_repo.size(), (unsigned long) memoryUsed(), (unsigned) IMAGE_BROKER_BUDGET,
+           (unsigned long) stats.hits, (unsigned long) stats.misses, (unsigned long) stats.evictions);
+    for ( auto &pair : image_repo )
+        printf("  %c %7lu %s\r\n", pins.find(pair.first) != pins.end() ? '*' : ' ',
+               (unsigned long) pair.second.stream->memoryUsed(), pair.first.c_str());
+}
+
 
 // Utility Functions
 
@@ -164,7 +242,7 @@ uint32_t MMediaStream::readContainer(uint8_t *buf, uint32_t size)
 }
 uint32_t MMediaStream::writeContainer(uint8_t *buf, uint32_t size)
 {
-    return containerStream->read(buf, size);
+    return containerStream->write(buf, size);
 }
 
 uint8_t MMediaStream::read() 
@@ -13,6 +13,7 @@
 #include "../../include/debug.h"
 
 #include "string_utils.h"
+#include "wrappers/memory_stream.h"
 
 
 /********************************************************
@@ -23,7 +24,8 @@ class MMediaStream: public MStream {
 
 public:
     MMediaStream(std::shared_ptr<MStream> is) {
-        containerStream = is;
+        // Small containers are read into memory in the background while the image is parsed
+        containerStream = MemoryMStream::materialize(is);
         _is_open = true;
         has_subdirs = false;
     }
@@ -49,6 +51,11 @@ public:
     bool isBrowsable() override { return false; };
     // Random access streams might call seekPath to jump to a specific file
     bool isRandomAccess() override { return true; };
+    // An image inside an image that is in memory is in memory as well
+    bool isMemory() override { return containerStream->isMemory(); };
+    uint32_t memoryUsed() override { return containerStream->memoryUsed(); };
+    // Files come out a sector at a time
+    uint32_t bufferSize() override { return block_size; };
 
     bool open(std::ios_base::openmode mode) override;
     void close() override;
@@ -163,20 +170,54 @@ private:
 /********************************************************
  * Utility implementations
  ********************************************************/
+
+// Images kept open for listings and sector access. Those no channel has pinned are
+// closed least recently used first, when there are more than IMAGE_BROKER_ENTRIES or
+// their copies in memory add up to more than IMAGE_BROKER_BUDGET. The budget leaves
+// room for one more copy, so the next image opened can be read into memory too
+#define IMAGE_BROKER_ENTRIES 8
+#ifndef IMAGE_BROKER_BUDGET
+#define IMAGE_BROKER_BUDGET (MEMORY_STREAM_TOTAL_SIZE - MEMORY_STREAM_MAX_SIZE)
+#endif
+
 class ImageBroker {
-    static std::unordered_map<std::string, MMediaStream*> image_repo;
+    struct Entry {
+        MMediaStream* stream;
+        MFile* file;
+        uint32_t lastUse;
+    };
+
+    static std::unordered_map<std::string, Entry> image_repo;
+    static std::unordered_map<std::string, int> pins;
+    static uint32_t use_clock;
+
+    static void evict(const std::string &keep);
+
 public:
+    struct Stats {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t evictions;
+    };
+    static Stats stats;
+
     template<class T> static T* obtain(std::string url) 
     {
         //Debug_printv("streams[%d] url[%s]", image_repo.size(), url.c_str());
 
         // obviously you have to supply STREAMFILE.url to this function!
-        if(image_repo.find(url)!=image_repo.end()) {
-            return (T*)image_repo.at(url);
+        auto found = image_repo.find(url);
+        if(found!=image_repo.end()) {
+            stats.hits++;
+            found->second.lastUse = ++use_clock;
+            return (T*)found->second.stream;
         }
+        stats.misses++;
 
         // create and add stream to broker if not found
         auto newFile = MFSOwner::File(url);
+        if ( newFile == nullptr )
+            return nullptr;
 
         T* newStream = (T*)newFile->getSourceStream();
 
@@ -192,7 +233,8 @@ public:
                 Debug_printv("SINGLE FILE [%s]", url.c_str());
             }
 
-            image_repo.insert(std::make_pair(url, newStream));
+            image_repo[url] = { newStream, newFile, ++use_clock };
+            evict(url);
             return newStream;
         }
 
@@ -204,25 +246,21 @@ public:
         return obtain<MMediaStream>(url);
     }
 
-    static void dispose(std::string url) {
-        if(image_repo.find(url)!=image_repo.end()) {
-            auto toDelete = image_repo.at(url);
-            image_repo.erase(url);
-            delete toDelete;
-        }
-        Debug_printv("streams[%d]", image_repo.size());
-    }
+    // A pinned image stays open, e.g. while a channel is reading its directory
+    static void pin(std::string url) { pins[url]++; }
+    static void unpin(std::string url);
+
+    static void dispose(std::string url);
 
     static void validate() {
         
     }
 
-    static void clear() {
-        std::for_each(image_repo.begin(), image_repo.end(), [](auto& pair) {
-            delete pair.second;
-        });
-        image_repo.clear();
-    }
+    static void clear();
+
+    static size_t size() { return image_repo.size(); }
+    static uint32_t memoryUsed();
+    static void print();
 };
 
 #endif // MEATLOAF_MEDIA
@@ -113,6 +113,12 @@ public:
     virtual bool isOpen() = 0;
     virtual bool isBrowsable() { return false; };
     virtual bool isRandomAccess() { return false; };
+    // All of it is in memory already, nothing to gain from copying it
+    virtual bool isMemory() { return false; };
+    // Bytes of buffers held for the stream's data, for the brokers' budget
+    virtual uint32_t memoryUsed() { return 0; };
+    // How much a buffer over this stream should ask for at a time
+    virtual uint32_t bufferSize() { return 2048; };
 
     virtual bool open(std::ios_base::openmode mode) = 0;
     virtual void close() = 0;
@@ -120,6 +126,14 @@ public:
     virtual uint32_t read(uint8_t* buf, uint32_t size) = 0;
     virtual uint32_t write(const uint8_t *buf, uint32_t size) = 0;
 
+    // Like read(), but points span at up to size bytes the stream already holds
+    // instead of copying them. They stay valid while the stream is open and not
+    // written to. Streams that can't do it leave span nullptr, then use read()
+    virtual uint32_t readSpan(const uint8_t **span, uint32_t size) {
+        *span = nullptr;
+        return 0;
+    };
+
     virtual bool seek(uint32_t pos, int mode) {
         if(mode == SEEK_SET) {
             _position = pos;
@@ -3,6 +3,7 @@
 #include <esp_idf_version.h>
 
 #include "meatloaf.h"
+#include "httpRange.h"
 
 #include "../../../include/debug.h"
 //#include "../../../include/global_defines.h"
@@ -410,10 +411,9 @@ int MeatHttpClient::openAndFetchHeaders(esp_http_client_method_t method, uint32_
     }
 
     // Set Range Header
-    char str[40];
-    snprintf(str, sizeof str, "bytes=%lu-%lu", position, (position + size + 5));
-    esp_http_client_set_header(_http, "Range", str);
-    //Debug_printv("seeking range[%s] url[%s]", str, url.c_str());
+    std::string range = http_range_value(position, position + size + 5);
+    esp_http_client_set_header(_http, "Range", range.c_str());
+    //Debug_printv("seeking range[%s] url[%s]", range.c_str(), url.c_str());
 
     // POST
     // const char *post_data = "{\"field1\":\"value1\"}";
@@ -489,9 +489,9 @@ esp_err_t MeatHttpClient::_http_event_handler(esp_http_client_event_t *evt)
                 //Debug_printv("Content-Range: %s",evt->header_value);
                 if(meatClient != nullptr) {
                     meatClient->isFriendlySkipper = true;
-                    auto cr = util_tokenize(evt->header_value, '/');
-                    if( cr.size() > 1 )
-                        meatClient->_range_size = std::stoi(cr[1]);
+                    long range_size = http_content_range_size(evt->header_value);
+                    if( range_size >= 0 )
+                        meatClient->_range_size = range_size;
                 }
                 //Debug_printv("size[%lu] isFriendlySkipper[%d]", meatClient->_range_size, meatClient->isFriendlySkipper);
             }
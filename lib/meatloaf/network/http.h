@@ -177,6 +177,8 @@ protected:
     bool isOpen() override;
     bool isBrowsable() override { return false; };
     bool isRandomAccess() override { return true; };
+    // Every request has a round trip to pay for
+    uint32_t bufferSize() override { return 8192; };
 
     bool open(std::ios_base::openmode mode) override;
     void close() override;
@@ -52,10 +52,21 @@ public:
 
         if (err != 0) {
             Debug_printv("Socket unable to connect: errno %d", errno);
+            close();
             return false;
         }
         //Debug_printv("After connect for socet");
 
+        // Long lived sessions find out about a dead server from the keepalives
+        int keepAlive = 1;
+        int keepIdle = 10;
+        int keepInterval = 5;
+        int keepCount = 5;
+        setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepIdle, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
+        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
+
         return true;
     }
 
@@ -94,6 +105,17 @@ public:
     bool isOpen() {
         return sock != -1;
     }
+
+    // Waits up to timeout_ms for something to read, or for the other end to close
+    bool waitReadable(int timeout_ms) {
+        if(!isOpen())
+            return false;
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(sock, &readfds);
+        struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+        return select(sock + 1, &readfds, nullptr, nullptr, &tv) > 0;
+    }
 };
 
 //
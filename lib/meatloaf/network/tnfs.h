@@ -122,6 +122,7 @@ public:
     bool isOpen();
     bool isBrowsable() override { return false; };
     bool isRandomAccess() override { return true; };
+    uint32_t bufferSize() override { return 4096; };
 
     bool open(std::ios_base::openmode mode) override;
     void close() override;
@@ -15,6 +15,8 @@ CSIPMSessionMgr CSIPMFileSystem::session;
 bool CSIPMSessionMgr::establishSession() {
     if(!buf.is_open()) {
         currentDir = "cs:/";
+        // Send the first traversal back to the root
+        pathKnown = false;
         buf.open();
     }
     
@@ -22,12 +24,14 @@ bool CSIPMSessionMgr::establishSession() {
 }
 
 std::string CSIPMSessionMgr::readLn() {
-    char buffer[80];
+    std::string line;
+    // A timed out reply leaves the stream failed, the next command starts afresh
+    clear();
     // telnet line ends with 10;
-    getline(buffer, 80, 10);
+    std::getline(*this, line, (char)10);
 
-    Debug_printv("Inside readln got: '%s'", buffer);
-    return std::string((char *)buffer);
+    Debug_printv("Inside readln got: '%s'", line.c_str());
+    return line;
 }
 
 bool CSIPMSessionMgr::sendCommand(std::string command) {
@@ -44,90 +48,107 @@ bool CSIPMSessionMgr::sendCommand(std::string command) {
 }
 
 bool CSIPMSessionMgr::isOK() {
-    // auto a = readLn();
-
     auto reply = readLn();
     // for(int i = 0 ; i<reply.length(); i++)
     //     Debug_printv("'%d'", reply[i]);
 
-    bool equals = strncmp("00 - OK\x0d", reply.c_str(), 7);
+    // "00 - OK", errors look like "?500 - DISK NOT FOUND."
+    bool ok = !reply.empty() && reply[0] != '?';
 
-    //Debug_printv("Testing of OK, got:'%s', %d", reply.c_str(), equals);
+    //Debug_printv("Testing of OK, got:'%s', %d", reply.c_str(), ok);
 
-    return equals;
+    return ok;
 }
 
-bool CSIPMSessionMgr::traversePath(MFile* path) {
-    // tricky. First we have to
-    // CF / - to go back to root
-
-    //Debug_printv("Traversing path: [%s]", path->path.c_str());
-
-    if(buf.is_open()) {
-        // if we are still connected we can smart change dir by just going up or down
-        // but for time being, we stick to traversing from root
-        if(!sendCommand("cf /"))
-            return false;
-    }
-    else {
-        // if we aren't, change dir to root (alos connects the session);
-        if(!sendCommand("cf /"))
-            return false;
+std::shared_ptr<CSIPMSessionMgr::DirListing> CSIPMSessionMgr::findListing(const std::string &url) {
+    auto it = dirCache.find(url);
+    if(it == dirCache.end())
+        return nullptr;
+    if(fnSystem.millis() - it->second->stamp > CSIP_DIRCACHE_TTL_MS) {
+        dirCache.erase(it);
+        return nullptr;
     }
+    return it->second;
+}
 
-    Debug_printv("here");
-    if(isOK()) {
-        Debug_printv("path[%s]", path->path.c_str());
-        if(path->path.compare("/") == 0) {
-            currentDir = path->url;
-            return true;
-        }
-
-        std::vector<std::string> chopped = mstr::split(path->path, '/');
+void CSIPMSessionMgr::storeListing(const std::string &url, std::shared_ptr<DirListing> listing) {
+    listing->stamp = fnSystem.millis();
+    if(dirCache.size() >= CSIP_DIRCACHE_ENTRIES && dirCache.find(url) == dirCache.end()) {
+        // Make room by dropping the oldest
+        auto oldest = dirCache.begin();
+        for(auto it = dirCache.begin(); it != dirCache.end(); ++it)
+            if(it->second->stamp < oldest->second->stamp)
+                oldest = it;
+        dirCache.erase(oldest);
+    }
+    dirCache[url] = listing;
+}
 
-        //MFile::parsePath(&chopped, path->path); - nope this doessn't work and crases in the loop!
+bool CSIPMSessionMgr::traversePath(MFile* path) {
+    //Debug_printv("Traversing path: [%s]", path->path.c_str());
 
-        Debug_printv("Before loop");
-        //Debug_printv("Chopped size:%d\r\n", chopped.size());
-        fnSystem.delay(500);
+    // Replies an abandoned listing left behind would be taken for ours
+    buf.discard();
+    if(!establishSession())
+        return false;
 
-        for(size_t i = 1; i < chopped.size(); i++) {
-            //Debug_printv("Before chopped deref");
+    // Directories down from the root, up to and including a disk image
+    std::vector<std::string> target;
+    for(auto &part : mstr::split(path->path, '/')) {
+        if(part.empty())
+            continue;
+        target.push_back(part);
+        if(mstr::endsWith(part, ".d64", false))
+            break;
+    }
 
-            auto part = chopped[i];
-            
-            //Debug_printv("traverse path part: [%s]\r\n", part.c_str());
-            if(mstr::endsWith(part, ".d64", false)) 
-            {
-                // THEN we have to mount the image INSERT image_name
-                sendCommand("insert "+part);
-
-                // disk image is the end, so return
-                if(isOK()) {
-                    currentDir = path->url;
-                    return true;
-                }
-                else {
-                    // or: ?500 - DISK NOT FOUND.
-                    return false;
-                }
-            }
-            else 
-            {
-                // CF xxx - to browse into subsequent dirs
-                sendCommand("cf "+part);
-                if(!isOK()) {
-                    // or: ?500 - CANNOT CHANGE TO dupa
-                    return false;
-                }
-            }
-        }
-        
+    if(pathKnown && target == currentPath) {
         currentDir = path->url;
         return true;
     }
+
+    // Carry on down from where the session is when that's on the way there,
+    // otherwise start from the root. There's no leaving an image but by CF /
+    std::vector<std::string> commands;
+    size_t from = 0;
+    if(pathKnown && currentPath.size() < target.size() &&
+       std::equal(currentPath.begin(), currentPath.end(), target.begin()) &&
+       (currentPath.empty() || !mstr::endsWith(currentPath.back(), ".d64", false)))
+        from = currentPath.size();
     else
-        return false; // shouldn't really happen, right?
+        commands.push_back("cf /");
+
+    for(size_t i = from; i < target.size(); i++) {
+        // INSERT mounts the image, CF browses into a directory
+        if(mstr::endsWith(target[i], ".d64", false))
+            commands.push_back("insert " + target[i]);
+        else
+            commands.push_back("cf " + target[i]);
+    }
+
+    // All the commands go out together and the replies are read after,
+    // one round trip instead of one per directory
+    for(auto &c : commands) {
+        printf("CSIP: send command: %s\r\n", c.c_str());
+        (*this) << (mstr::toPETSCII2(c) + '\r');
+    }
+    (*this).flush();
+
+    // Every command gets its reply read, even after one fails, to keep them in step.
+    // Those after a failure ran in the wrong directory, so where we are isn't known
+    // or: ?500 - DISK NOT FOUND. / ?500 - CANNOT CHANGE TO dupa
+    bool ok = true;
+    for(size_t i = 0; i < commands.size(); i++)
+        if(!isOK())
+            ok = false;
+
+    pathKnown = ok;
+    if(!ok)
+        return false;
+
+    currentPath = target;
+    currentDir = path->url;
+    return true;
 }
 
 /********************************************************
@@ -346,6 +367,20 @@ bool CSIPMFile::rewindDirectory() {
     if(!isDirectory())
         return false;
 
+    listing = CSIPMFileSystem::session.findListing(url);
+    listingCached = listing != nullptr;
+    listingPos = 0;
+    if(listingCached)
+    {
+        Debug_printv("Listing from cache [%s]", url.c_str());
+        dirIsImage = mstr::endsWith(path, ".d64", false);
+        media_image = listing->media_image;
+        media_header = listing->media_header;
+        media_id = listing->media_id;
+        dirIsOpen = true;
+        return true;
+    }
+    listing = std::make_shared<CSIPMSessionMgr::DirListing>();
 
     Debug_printv("pre traverse path");
 
@@ -366,6 +401,9 @@ bool CSIPMFile::rewindDirectory() {
             line = CSIPMFileSystem::session.readLn(); // dir header
             media_header = line.substr(2, line.find_last_of("\""));
             media_id = line.substr(line.find_last_of("\"")+2);
+            listing->media_image = media_image;
+            listing->media_header = media_header;
+            listing->media_id = media_id;
             return true;
         }
         else
@@ -381,6 +419,9 @@ bool CSIPMFile::rewindDirectory() {
         if(CSIPMFileSystem::session.is_open()) {
             media_header = line.substr(2, line.find_last_of("]")-1);
             media_id = "C=SVR";
+            listing->media_image = media_image;
+            listing->media_header = media_header;
+            listing->media_id = media_id;
             dirIsOpen = true;
 
             return true;
@@ -409,6 +450,16 @@ MFile* CSIPMFile::getNextFileInDir() {
     if(url.size()>4) // If we are not at root then add additional "/"
         new_url += "/";
 
+    if(listingCached) {
+        if(listingPos < listing->entries.size()) {
+            auto &e = listing->entries[listingPos++];
+            return new CSIPMFile(new_url + e.first, e.second);
+        }
+        media_blocks_free = listing->blocks_free;
+        dirIsOpen = false;
+        return nullptr;
+    }
+
     Debug_printv("pre dir is image");
 
     if(dirIsImage) {
@@ -429,6 +480,8 @@ MFile* CSIPMFile::getNextFileInDir() {
         }
         if(line.find("BLOCKS FREE.")!=std::string::npos) {
             media_blocks_free = atoi(line.substr(0, line.find_first_of(" ")).c_str());
+            listing->blocks_free = media_blocks_free;
+            CSIPMFileSystem::session.storeListing(url, listing);
             dirIsOpen = false;
             return nullptr;
         }
@@ -438,6 +491,7 @@ MFile* CSIPMFile::getNextFileInDir() {
             mstr::rtrim(name);
             Debug_printv("xx: %s -- %s %d", line.c_str(), name.c_str(), size);
             //return new CSIPMFile(path() +"/"+ name);
+            listing->entries.push_back({name, size});
             new_url += name;
             return new CSIPMFile(new_url, size);
         }
@@ -461,6 +515,8 @@ MFile* CSIPMFile::getNextFileInDir() {
 
         if(line.find('\x04')!=std::string::npos) {
             Debug_printv("No more!");
+            listing->blocks_free = media_blocks_free;
+            CSIPMFileSystem::session.storeListing(url, listing);
             dirIsOpen = false;
             return nullptr;
         }
@@ -478,6 +534,7 @@ MFile* CSIPMFile::getNextFileInDir() {
             // Debug_printv("\nurl[%s] name[%s] size[%d]\r\n", url.c_str(), name.c_str(), size);
             if(name.size() > 0)
             {
+                listing->entries.push_back({name, size});
                 new_url += name;
                 return new CSIPMFile(new_url, size);                
             }
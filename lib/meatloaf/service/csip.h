@@ -16,14 +16,23 @@
 
 #include <streambuf>
 #include <istream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// How long a command's reply may take to start arriving
+#define CSIP_REPLY_TIMEOUT_MS 4000
+// Directory and image listings are reused for this long, CommodoreServer is read-only to us
+#define CSIP_DIRCACHE_TTL_MS 60000
+#define CSIP_DIRCACHE_ENTRIES 8
 
 /********************************************************
  * Telnet buffer
  ********************************************************/
 
 class csstreambuf : public std::streambuf {
-    char* gbuf;
-    char* pbuf;
+    char* gbuf = nullptr;
+    char* pbuf = nullptr;
 
 protected:
     MeatSocket m_wifi;
@@ -67,6 +76,21 @@ public:
             delete[] gbuf;
         if(pbuf != nullptr)
             delete[] pbuf;
+        gbuf = pbuf = nullptr;
+        setg(nullptr, nullptr, nullptr);
+        setp(nullptr, nullptr);
+    }
+
+    // Drops anything a command before left unread, and the connection if the server closed it
+    void discard() {
+        setg(gbuf, gbuf, gbuf);
+        uint8_t stale[64];
+        while(m_wifi.isOpen() && m_wifi.waitReadable(0)) {
+            if(m_wifi.read(stale, sizeof(stale)) <= 0) {
+                Debug_printv("Session closed by server");
+                close();
+            }
+        }
     }
 
     int underflow() override {
@@ -77,18 +101,19 @@ public:
             return std::char_traits<char>::eof();
         }
         else if (this->gptr() == this->egptr()) {
-            int readCount = 0;
-            int attempts = 5;
-            int wait = 500;
-            
-            readCount = m_wifi.read((uint8_t*)gbuf, 512);
-
-            while( readCount <= 0 && (attempts--)>0 && m_wifi.isOpen()) {
-                Debug_printv("got rc: %d, retrying", readCount);
-                fnSystem.delay(wait);
-                wait+=100;
-                readCount = m_wifi.read((uint8_t*)gbuf, 512);
-            } 
+            // The reply is taken as soon as it arrives
+            if (!m_wifi.waitReadable(CSIP_REPLY_TIMEOUT_MS)) {
+                Debug_printv("No reply");
+                return std::char_traits<char>::eof();
+            }
+
+            int readCount = m_wifi.read((uint8_t*)gbuf, 512);
+            if (readCount <= 0) {
+                // Readable with nothing to read means the server hung up
+                Debug_printv("Session closed by server");
+                close();
+                return std::char_traits<char>::eof();
+            }
             Debug_printv("read success: %d", readCount);
             this->setg(gbuf, gbuf, gbuf + readCount);
         }
@@ -160,6 +185,22 @@ class CSIPMSessionMgr : public std::iostream {
 
 protected:
     std::string currentDir;
+    // Where the session is on the server, directories from the root up to any inserted image
+    std::vector<std::string> currentPath;
+    bool pathKnown = false;
+
+    // A listing as CSIPMFile hands it out, kept per url
+    struct DirListing {
+        std::string media_image;
+        std::string media_header;
+        std::string media_id;
+        uint16_t blocks_free = 65535;
+        std::vector<std::pair<std::string, size_t>> entries; // name, size in blocks
+        uint64_t stamp = 0;
+    };
+    std::unordered_map<std::string, std::shared_ptr<DirListing>> dirCache;
+    std::shared_ptr<DirListing> findListing(const std::string &url);
+    void storeListing(const std::string &url, std::shared_ptr<DirListing> listing);
 
     bool establishSession();
 
@@ -181,10 +222,15 @@ public:
 
     // read/write are used only by MStream
     size_t receive(uint8_t* buffer, size_t size) {
-        if(buf.is_open())
-            return buf.m_wifi.read(buffer, size);
-        else
+        // Whatever the last reply read ahead comes first
+        std::streamsize buffered = buf.in_avail();
+        if(buffered > 0)
+            return buf.sgetn((char*)buffer, std::min((std::streamsize)size, buffered));
+
+        if(!buf.m_wifi.waitReadable(CSIP_REPLY_TIMEOUT_MS))
             return 0;
+        int n = buf.m_wifi.read(buffer, size);
+        return n > 0 ? n : 0;
     }
 
     // read/write are used only by MStream
@@ -240,6 +286,11 @@ public:
 private:
     bool dirIsImage = false;
     size_t m_size;
+
+    // The listing being read from the server, or the cached one being handed out
+    std::shared_ptr<CSIPMSessionMgr::DirListing> listing;
+    bool listingCached = false;
+    size_t listingPos = 0;
 };
 
 /********************************************************
@@ -3,6 +3,8 @@
 //#include "meat_broker.h"
 #include "endianness.h"
 
+#include <cstring>
+
 /********************************************************
  * Streams
  ********************************************************/
@@ -22,44 +24,76 @@ std::string T64MStream::decodeType(uint8_t file_type, bool show_hidden)
     return " " + type;
 }
 
+bool T64MStream::buildDirectoryIndex()
+{
+    if (dir_indexed)
+        return true;
+
+    dir_index.clear();
+    dir_lookup.clear();
+
+    // The directory ends at the first free slot; a bad image can't run it past the end of the file
+    uint32_t max_entries = containerStream->size() > 0x40 ? (containerStream->size() - 0x40) / sizeof(Entry) : 0;
+    if (!containerStream->seek(0x40))
+        return false;
+
+    Entry e;
+    for (uint32_t n = 0; n < max_entries; n++)
+    {
+        if (containerStream->read((uint8_t *)&e, sizeof(e)) != sizeof(e))
+            return false;
+        if (e.file_type == 0x00)
+            break;
+
+        // In PETASCII, padded with $20, not $A0
+        std::string name(e.filename, sizeof(e.filename));
+        name = name.substr(0, name.find_last_not_of(std::string(" \0", 2)) + 1);
+        std::string filename = mstr::toUTF8(name);
+
+        dir_lookup.emplace(filename, dir_index.size());
+        dir_index.push_back({name, filename, e});
+    }
+
+    Debug_printv("entries[%d]", dir_index.size());
+    dir_indexed = true;
+    return true;
+}
+
 bool T64MStream::seekEntry( std::string filename )
 {
     // Read Directory Entries
-    if ( filename.size() )
+    if ( filename.size() && buildDirectoryIndex() )
     {
-        size_t index = 1;
         mstr::replaceAll(filename, "\\", "/");
         bool wildcard =  ( mstr::contains(filename, "*") || mstr::contains(filename, "?") );
-        while ( seekEntry( index ) )
-        {
-            std::string entryFilename = entry.filename;
-            uint8_t i = entryFilename.find_first_of(0x20); // (in PETASCII, padded with $20, not $A0)
-            entryFilename = entryFilename.substr(0, (i > 16 ? 16 : i));
-            //mstr::rtrimA0(entryFilename);
-            entryFilename = mstr::toUTF8(entryFilename);
-
-            Debug_printv("filename[%s] entry.filename[%s]", filename.c_str(), entryFilename.c_str());
 
-            if ( filename == entryFilename ) // Match exact
-            {
-                return true;
-            }
-            else if ( wildcard ) // Wildcard Match
+        int32_t found = -1;
+        auto it = dir_lookup.find(filename);
+        if ( it != dir_lookup.end() ) // Match exact
+        {
+            found = it->second;
+        }
+        else if ( wildcard && dir_index.size() ) // Wildcard Match
+        {
+            if (filename == "*") // Match first entry
+                found = 0;
+            for (uint16_t i = 0; i < dir_index.size() && found < 0; i++)
             {
-                if (filename == "*") // Match first entry
-                {
-                    filename = entryFilename;
-                    return true;
-                }
-                else if ( mstr::compare(filename, entryFilename) ) // X?XX?X* Wildcard match
+                if ( mstr::compare(filename, dir_index[i].filename) ) // X?XX?X* Wildcard match
                 {
-                    // Set filename to this filename
-                    Debug_printv( "Found! file[%s] -> entry[%s]", filename.c_str(), entryFilename.c_str() );
-                    return true;
+                    Debug_printv( "Found! file[%s] -> entry[%s]", filename.c_str(), dir_index[i].filename.c_str() );
+                    found = i;
                 }
             }
+        }
 
-            index++;
+        if ( found >= 0 )
+        {
+            entry = dir_index[found].entry;
+            entry_index = found + 1;
+            if (filename == "*")
+                filename = dir_index[found].filename;
+            return true;
         }
     }
 
@@ -70,24 +104,16 @@ bool T64MStream::seekEntry( std::string filename )
 
 bool T64MStream::seekEntry( uint16_t index )
 {
-    // Calculate Sector offset & Entry offset
-    index--;
-    uint16_t entryOffset = 0x40 + (index * sizeof(entry));
-
-    //Debug_printv("----------");
-    //Debug_printv("index[%d] sectorOffset[%d] entryOffset[%d] entry_index[%d]", index, sectorOffset, entryOffset, entry_index);
-
-    containerStream->seek(entryOffset);
-    containerStream->read((uint8_t *)&entry, sizeof(entry));
-
-    //Debug_printv("r[%d] file_type[%02X] file_name[%.16s]", r, entry.file_type, entry.filename);
-
-    //if ( next_track == 0 && next_sector == 0xFF )
-    entry_index = index + 1;    
-    if ( entry.file_type == 0x00 )
+    entry_index = index;
+    if ( index == 0 || !buildDirectoryIndex() || index > dir_index.size() )
+    {
+        // As the free slot that ends the directory
+        memset(&entry, 0, sizeof(entry));
         return false;
-    else
-        return true;
+    }
+
+    entry = dir_index[index - 1].entry;
+    return true;
 }
 
 
@@ -205,10 +231,7 @@ MFile* T64MFile::getNextFileInDir() {
 
     if ( image->getNextImageEntry() )
     {
-        std::string filename = image->entry.filename;
-        uint8_t i = filename.find_first_of(0x20); // (in PETASCII, padded with $20, not $A0)
-        filename = filename.substr(0, (i > 16 ? 16 : i));
-        // mstr::rtrimA0(filename);
+        std::string filename = image->dir_index[image->entry_index - 1].name;
         mstr::replaceAll(filename, "/", "\\");
         //Debug_printv( "entry[%s]", (streamFile->url + "/" + filename).c_str() );
         auto file = MFSOwner::File(streamFile->url + "/" + filename);
@@ -2,6 +2,8 @@
 
 //#include "meat_broker.h"
 
+#include <cstring>
+
 /********************************************************
  * Streams
  ********************************************************/
@@ -58,45 +60,78 @@ std::string TCRTMStream::decodeType(uint8_t file_type, bool show_hidden)
     return " " + type;
 }
 
+bool TCRTMStream::buildDirectoryIndex()
+{
+    if (dir_indexed)
+        return true;
+
+    dir_index.clear();
+    dir_lookup.clear();
+
+    // The directory ends at the first free entry; a bad image can't run it past the end of the file
+    uint32_t max_entries = containerStream->size() > 0xE7 ? (containerStream->size() - 0xE7) / 32 : 0;
+    if (!containerStream->seek(0xE7))
+        return false;
+
+    Entry e;
+    for (uint32_t n = 0; n < max_entries; n++)
+    {
+        if (containerStream->read((uint8_t *)&e, sizeof(e)) != sizeof(e))
+            return false;
+        if (e.file_type == 0xFF)
+            break;
+
+        // Padded with NUL (0x00)
+        std::string name(e.filename, sizeof(e.filename));
+        name = name.substr(0, name.find_first_of('\0'));
+        std::string filename = mstr::toUTF8(name);
+
+        dir_lookup.emplace(filename, dir_index.size());
+        dir_index.push_back({name, filename, e});
+    }
+
+    Debug_printv("entries[%d]", dir_index.size());
+    dir_indexed = true;
+    return true;
+}
+
 bool TCRTMStream::seekEntry( std::string filename )
 {
     // Read Directory Entries
-    if ( filename.size() )
+    if ( filename.size() && buildDirectoryIndex() )
     {
-        size_t index = 1;
         mstr::replaceAll(filename, "\\", "/");
         bool wildcard =  ( mstr::contains(filename, "*") || mstr::contains(filename, "?") );
-        while ( seekEntry( index ) )
-        {
-            std::string entryFilename = entry.filename;
-            //uint8_t i = entryFilename.find_first_of(0x00); // padded with NUL (0x00)
-            entryFilename = entryFilename.substr(0, 16);
-            //mstr::rtrimA0(entryFilename);
-            entryFilename = mstr::toUTF8(entryFilename);
-
-            //Debug_printv("index[%d] filename[%s] entry.filename[%s] entry.file_type[%d]", index, filename.c_str(), entryFilename.c_str(), entry.file_type);
 
-            if ( filename == entryFilename ) // Match exact
-            {
-                return true;
-            }
-            else if ( wildcard ) // Wildcard Match
+        int32_t found = -1;
+        auto it = dir_lookup.find(filename);
+        if ( it != dir_lookup.end() ) // Match exact
+        {
+            found = it->second;
+        }
+        else if ( wildcard ) // Wildcard Match
+        {
+            for (uint16_t i = 0; i < dir_index.size() && found < 0; i++)
             {
                 if (filename == "*") // Match first PRG
                 {
-                    if (entry.file_type < 0xFE) // Skip system files
-                    {
-                        filename = entryFilename;
-                        return true;
-                    }
+                    if (dir_index[i].entry.file_type < 0xFE) // Skip system files
+                        found = i;
                 }
-                else if ( mstr::compare(filename, entryFilename) ) // X?XX?X* Wildcard match
+                else if ( mstr::compare(filename, dir_index[i].filename) ) // X?XX?X* Wildcard match
                 {
-                    return true;
+                    found = i;
                 }
             }
+        }
 
-            index++;
+        if ( found >= 0 )
+        {
+            entry = dir_index[found].entry;
+            entry_index = found + 1;
+            if (filename == "*")
+                filename = dir_index[found].filename;
+            return true;
         }
     }
 
@@ -107,27 +142,17 @@ bool TCRTMStream::seekEntry( std::string filename )
 
 bool TCRTMStream::seekEntry( uint16_t index )
 {
-    // Calculate Sector offset & Entry offset
-    index--;
-    uint16_t entryOffset = 0xE7 + (index * 32);
-
-    //Debug_printv("----------");
-    //Debug_printv("index[%d] entryOffset[%d] entry_index[%d]", (index + 1), entryOffset, entry_index);
-
-    containerStream->seek(entryOffset);
-    containerStream->read((uint8_t *)&entry, sizeof(entry));
-
-    //uint32_t file_start_address = (0xD8 + (entry.file_start_address[0] << 8 | entry.file_start_address[1] << 16));
-    //uint32_t file_size = (entry.file_size[0] | (entry.file_size[1] << 8) | (entry.file_size[2] << 16)) + 2; // 2 bytes for load address
-    //uint32_t file_load_address = entry.file_load_address[0] | entry.file_load_address[1] << 8;
-
-    //Debug_printv("file_name[%.16s] file_type[%02X] data_offset[%X] file_size[%d] load_address[%04X]", entry.filename, entry.file_type, file_start_address, file_size, file_load_address);
-
-    entry_index = index + 1;    
-    if ( entry.file_type == 0xFF )
+    entry_index = index;
+    if ( index == 0 || !buildDirectoryIndex() || index > dir_index.size() )
+    {
+        // As the free entry marker that ends the directory
+        memset(&entry, 0, sizeof(entry));
+        entry.file_type = 0xFF;
         return false;
-    else
-        return true;
+    }
+
+    entry = dir_index[index - 1].entry;
+    return true;
 }
 
 uint32_t TCRTMStream::readFile(uint8_t* buf, uint32_t size) {
@@ -248,10 +273,7 @@ MFile* TCRTMFile::getNextFileInDir()
     
     if ( r )
     {
-        std::string filename = image->entry.filename;
-        //uint8_t i = filename.find_first_of(0x00); // padded with NUL (0x00)
-        filename = filename.substr(0, 16);
-        // mstr::rtrimA0(filename);
+        std::string filename = image->dir_index[image->entry_index - 1].name;
         mstr::replaceAll(filename, "/", "\\");
         //Debug_printv( "entry[%s]", (streamFile->url + "/" + filename).c_str() );
         auto file = MFSOwner::File(streamFile->url + "/" + filename);
@@ -56,6 +56,17 @@ protected:
     Header header;
     Entry entry;
 
+    // Directory index, parsed once instead of on every lookup and listing
+    struct IndexEntry {
+        std::string name;     // as stored, without the padding
+        std::string filename; // UTF-8, for lookups
+        Entry entry;
+    };
+    std::vector<IndexEntry> dir_index;
+    std::unordered_map<std::string, uint16_t> dir_lookup; // filename -> first dir_index position
+    bool dir_indexed = false;
+    bool buildDirectoryIndex();
+
     std::string decodeType(uint8_t file_type, bool show_hidden = false) override;
 
 private:
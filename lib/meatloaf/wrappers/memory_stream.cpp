@@ -0,0 +1,250 @@
+#include "memory_stream.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include <esp_heap_caps.h>
+
+#include "../../../include/debug.h"
+
+std::atomic<uint32_t> MemoryMStream::s_totalSize{0};
+
+
+std::shared_ptr<MStream> MemoryMStream::materialize(std::shared_ptr<MStream> src)
+{
+    if ( src == nullptr || !src->isOpen() || src->isMemory() )
+        return src;
+
+    // Sequential sources can only be copied from where they are at
+    if ( !src->isRandomAccess() && src->position() != 0 )
+        return src;
+
+    uint32_t size = src->size();
+    if ( size == 0 || size > MEMORY_STREAM_MAX_SIZE || s_totalSize + size > MEMORY_STREAM_TOTAL_SIZE )
+        return src;
+
+    // PSRAM only, internal RAM is too precious for this
+    uint8_t *data = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if ( data == nullptr )
+        return src;
+
+    auto m = new MemoryMStream(src, data);
+    if ( !m->startFill() )
+    {
+        delete m;
+        return src;
+    }
+
+    Debug_printv("Reading container into memory url[%s] size[%lu]", src->url.c_str(), size);
+    return std::shared_ptr<MStream>(m);
+}
+
+
+MemoryMStream::MemoryMStream(std::shared_ptr<MStream> src, uint8_t *data)
+{
+    m_source = src;
+    m_data = data;
+
+    url = src->url;
+    mode = std::ios_base::in;
+    block_size = src->block_size;
+    _size = src->size();
+    _position = 0;
+
+    m_chunks = (_size + MEMORY_STREAM_CHUNK_SIZE - 1) / MEMORY_STREAM_CHUNK_SIZE;
+    m_filled.reset(new std::atomic<bool>[m_chunks]);
+    for ( uint32_t c = 0; c < m_chunks; c++ )
+        m_filled[c] = false;
+    m_want = m_chunks;
+    m_stop = false;
+    m_done = false;
+
+    m_fillTask = nullptr;
+    m_reader = nullptr;
+    m_fillDone = nullptr;
+
+    s_totalSize += _size;
+}
+
+
+MemoryMStream::~MemoryMStream()
+{
+    if ( m_fillTask != nullptr )
+    {
+        m_stop = true;
+        xSemaphoreTake(m_fillDone, portMAX_DELAY);
+    }
+    if ( m_fillDone != nullptr )
+        vSemaphoreDelete(m_fillDone);
+
+    heap_caps_free(m_data);
+    s_totalSize -= _size;
+}
+
+
+bool MemoryMStream::startFill()
+{
+    m_fillDone = xSemaphoreCreateBinary();
+    if ( m_fillDone == nullptr )
+        return false;
+
+    if ( xTaskCreatePinnedToCore(fillTask, "ml_memfill", MEMORY_STREAM_STACKSIZE, this,
+                                 MEMORY_STREAM_PRIORITY, &m_fillTask, MEMORY_STREAM_CPUAFFINITY) != pdPASS )
+    {
+        m_fillTask = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+
+void MemoryMStream::fillTask(void *arg)
+{
+    MemoryMStream *m = (MemoryMStream *)arg;
+
+    m->fill();
+
+    m->m_done = true;
+    TaskHandle_t reader = m->m_reader;
+    if ( reader != nullptr )
+        xTaskNotifyGive(reader);
+    xSemaphoreGive(m->m_fillDone);
+    vTaskDelete(nullptr);
+}
+
+
+void MemoryMStream::fill()
+{
+    uint32_t next = 0;
+    uint32_t sourcePos = m_source->position();
+    bool canSeek = m_source->isRandomAccess();
+
+    while ( !m_stop )
+    {
+        // The chunk a reader is waiting for first, then on from the last one
+        uint32_t c = canSeek ? (uint32_t) m_want : m_chunks;
+        if ( c >= m_chunks || m_filled[c] )
+        {
+            while ( next < m_chunks && m_filled[next] )
+                next++;
+            if ( next >= m_chunks )
+                break;
+            c = next;
+        }
+
+        uint32_t offset = c * MEMORY_STREAM_CHUNK_SIZE;
+        uint32_t len = std::min((uint32_t) MEMORY_STREAM_CHUNK_SIZE, _size - offset);
+        if ( offset != sourcePos && !m_source->seek(offset) )
+        {
+            Debug_printv("seek failed url[%s] offset[%lu]", url.c_str(), offset);
+            break;
+        }
+
+        uint32_t n = 0;
+        while ( n < len )
+        {
+            uint32_t r = m_source->read(m_data + offset + n, len - n);
+            if ( r == 0 )
+                break;
+            n += r;
+        }
+        sourcePos = offset + n;
+
+        if ( n < len )
+        {
+            Debug_printv("read failed url[%s] offset[%lu] got[%lu] of [%lu]", url.c_str(), offset, n, len);
+            break;
+        }
+
+        m_filled[c] = true;
+        TaskHandle_t reader = m_reader;
+        if ( reader != nullptr && c == m_want )
+            xTaskNotifyGive(reader);
+    }
+}
+
+
+bool MemoryMStream::waitFor(uint32_t chunk)
+{
+    if ( m_filled[chunk] )
+        return true;
+
+    m_reader = xTaskGetCurrentTaskHandle();
+    m_want = chunk;
+    while ( !m_filled[chunk] && !m_done )
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+    m_want = m_chunks;
+
+    return m_filled[chunk];
+}
+
+
+uint32_t MemoryMStream::read(uint8_t* buf, uint32_t size)
+{
+    const uint8_t *span;
+    size = readSpan(&span, size);
+    if ( size > 0 )
+        memcpy(buf, span, size);
+    return size;
+}
+
+
+uint32_t MemoryMStream::readSpan(const uint8_t **span, uint32_t size)
+{
+    *span = m_data + _position;
+    if ( !isOpen() || _position >= _size || size == 0 )
+        return 0;
+
+    size = std::min(size, _size - _position);
+
+    uint32_t first = _position / MEMORY_STREAM_CHUNK_SIZE;
+    uint32_t last = (_position + size - 1) / MEMORY_STREAM_CHUNK_SIZE;
+    for ( uint32_t c = first; c <= last; c++ )
+    {
+        if ( !waitFor(c) )
+        {
+            // the source failed, hand over what there is
+            _error = 1;
+            size = c > first ? c * MEMORY_STREAM_CHUNK_SIZE - _position : 0;
+            break;
+        }
+    }
+
+    _position += size;
+    return size;
+}
+
+
+uint32_t MemoryMStream::write(const uint8_t *buf, uint32_t size)
+{
+    if ( !isOpen() || _position >= _size || size == 0 )
+        return 0;
+
+    // The task owns the source until it is done and a chunk still to come
+    // would overwrite what is written here
+    if ( m_fillTask != nullptr && !m_done )
+    {
+        xSemaphoreTake(m_fillDone, portMAX_DELAY);
+        xSemaphoreGive(m_fillDone);
+    }
+
+    size = std::min(size, _size - _position);
+    if ( !m_source->seek(_position) )
+        return 0;
+
+    uint32_t n = m_source->write(buf, size);
+    memcpy(m_data + _position, buf, n);
+    _position += n;
+    return n;
+}
+
+
+bool MemoryMStream::seek(uint32_t pos)
+{
+    if ( pos > _size )
+        return false;
+
+    _position = pos;
+    return true;
+}
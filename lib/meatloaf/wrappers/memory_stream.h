@@ -0,0 +1,82 @@
+#ifndef MEATLOAF_WRAPPER_MEMORY_STREAM
+#define MEATLOAF_WRAPPER_MEMORY_STREAM
+
+#include <atomic>
+#include <memory>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#include "meatloaf.h"
+
+// Containers up to this size are copied into PSRAM when an image stream is opened on
+// them, so the image's parser reads memory instead of the host. 0 turns it off
+#ifndef MEMORY_STREAM_MAX_SIZE
+#define MEMORY_STREAM_MAX_SIZE (1024 * 1024)
+#endif
+// All copies together, the ImageBroker keeps images open until the drive is reset
+#ifndef MEMORY_STREAM_TOTAL_SIZE
+#define MEMORY_STREAM_TOTAL_SIZE (2 * 1024 * 1024)
+#endif
+#define MEMORY_STREAM_CHUNK_SIZE 4096
+#define MEMORY_STREAM_STACKSIZE 4096
+#define MEMORY_STREAM_PRIORITY 5
+// Keep container reads off the core that bit-bangs the bus
+#define MEMORY_STREAM_CPUAFFINITY 0
+
+
+/********************************************************
+ * MemoryMStream
+ *
+ * A copy of a container in memory, filled from the source stream by a task
+ * while the image on top of it is already being parsed. A read of a part
+ * that isn't there yet moves the task to it and waits for just that chunk,
+ * the rest keeps coming in the background.
+ ********************************************************/
+
+class MemoryMStream : public MStream {
+public:
+    // src itself, or a MemoryMStream on it when src is small enough and there's room
+    static std::shared_ptr<MStream> materialize(std::shared_ptr<MStream> src);
+
+    ~MemoryMStream();
+
+    bool isOpen() override { return m_data!=nullptr; };
+    bool isRandomAccess() override { return true; };
+    bool isMemory() override { return true; };
+    uint32_t memoryUsed() override { return _size; };
+    uint32_t bufferSize() override { return MEMORY_STREAM_CHUNK_SIZE; };
+
+    bool open(std::ios_base::openmode mode) override { return isOpen(); };
+    void close() override {};
+
+    uint32_t read(uint8_t* buf, uint32_t size) override;
+    uint32_t readSpan(const uint8_t **span, uint32_t size) override;
+    // Written through to the source, once the copy is complete
+    uint32_t write(const uint8_t *buf, uint32_t size) override;
+
+    bool seek(uint32_t pos) override;
+
+private:
+    MemoryMStream(std::shared_ptr<MStream> src, uint8_t *data);
+
+    bool startFill();
+    static void fillTask(void *arg);
+    void fill();
+    bool waitFor(uint32_t chunk);
+
+    std::shared_ptr<MStream> m_source; // only touched by the task until m_done
+    uint8_t  *m_data;
+    uint32_t  m_chunks;
+    std::unique_ptr<std::atomic<bool>[]> m_filled;
+    std::atomic<uint32_t> m_want;      // chunk a reader is waiting for, m_chunks for none
+    std::atomic<bool>     m_stop, m_done;
+
+    TaskHandle_t      m_fillTask, m_reader;
+    SemaphoreHandle_t m_fillDone;
+
+    static std::atomic<uint32_t> s_totalSize;
+};
+
+#endif // MEATLOAF_WRAPPER_MEMORY_STREAM
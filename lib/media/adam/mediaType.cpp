@@ -26,8 +26,42 @@ bool MediaType::write(uint32_t blockNum, bool verify)
     return true;
 }
 
+bool MediaType::read_block(uint32_t blockNum, uint8_t *buf)
+{
+    return true;
+}
+
+bool MediaType::flush()
+{
+    return false;
+}
+
+void MediaType::prefetch(uint32_t blockNum)
+{
+    if (_media_fileh == nullptr || blockNum >= _media_num_blocks)
+        return;
+    if (blockNum == _prefetch_block || blockNum == _media_last_block)
+        return;
+
+    _prefetch_block = INVALID_SECTOR_VALUE;
+    if (read_block(blockNum, _prefetch_buff) == false)
+        _prefetch_block = blockNum;
+}
+
+bool MediaType::_prefetch_take(uint32_t blockNum)
+{
+    if (blockNum != _prefetch_block)
+        return false;
+
+    memcpy(_media_blockbuff, _prefetch_buff, MEDIA_BLOCK_SIZE);
+    _media_last_block = blockNum;
+    _prefetch_block = INVALID_SECTOR_VALUE;
+    return true;
+}
+
 void MediaType::unmount()
 {
+    _prefetch_block = INVALID_SECTOR_VALUE;
     if (_media_fileh != nullptr)
     {
         fclose(_media_fileh);
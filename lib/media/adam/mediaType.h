@@ -34,6 +34,13 @@ protected:
     uint32_t _media_num_blocks = 256;
     uint16_t _media_sector_size = DISK_BYTES_PER_SECTOR_SINGLE;
 
+    // The block the ADAM is expected to ask for next, read in the background
+    uint8_t _prefetch_buff[MEDIA_BLOCK_SIZE];
+    uint32_t _prefetch_block = INVALID_SECTOR_VALUE;
+
+    // Moves the prefetched block into _media_blockbuff if it's blockNum
+    bool _prefetch_take(uint32_t blockNum);
+
 public:
     struct
     {
@@ -73,6 +80,14 @@ public:
     virtual bool read(uint32_t blockNum, uint16_t *readcount) = 0;
     // Returns TRUE if an error condition occurred
     virtual bool write(uint32_t blockNum, bool verify);
+
+    // Reads a block into buf without touching _media_blockbuff. Returns TRUE if an
+    // error condition occurred, which is all media that can't read ahead return
+    virtual bool read_block(uint32_t blockNum, uint8_t *buf);
+    // Reads blockNum ahead of time so a later read() is served from RAM
+    void prefetch(uint32_t blockNum);
+    // Writes out anything write() held back. Returns TRUE if an error condition occurred
+    virtual bool flush();
     
     virtual uint8_t status() = 0;
 
@@ -3,6 +3,7 @@
 #include "mediaTypeDDP.h"
 
 #include <cstdint>
+#include <cerrno>
 #include <cstring>
 
 #ifdef ESP_PLATFORM
@@ -11,6 +12,8 @@
 
 #include "../../include/debug.h"
 
+#include "fnArena.h"
+
 
 // Returns byte offset of given sector number
 uint32_t MediaTypeDDP::_block_to_offset(uint32_t blockNum)
@@ -34,19 +37,16 @@ bool MediaTypeDDP::read(uint32_t blockNum, uint16_t *readcount)
         return true;
     }
 
-    memset(_media_blockbuff, 0, sizeof(_media_blockbuff));
+    if (_prefetch_take(blockNum))
+    {
+        _media_controller_status = 0;
+        return false;
+    }
 
-    bool err = false;
-    // // Perform a seek if we're not reading the sector after the last one we read
-    // if (blockNum != _media_last_block + 1)
-    // {
-        uint32_t offset = _block_to_offset(blockNum);
-        err = fseek(_media_fileh, offset, SEEK_SET) != 0;
-        _media_last_block = INVALID_SECTOR_VALUE;
-    // }
+    memset(_media_blockbuff, 0, sizeof(_media_blockbuff));
 
-    if (err == false)
-        err = fread(_media_blockbuff, 1, 1024, _media_fileh) != 1024;
+    _media_last_block = INVALID_SECTOR_VALUE;
+    bool err = read_block(blockNum, _media_blockbuff);
 
     if (err == false)
     {
@@ -64,70 +64,142 @@ bool MediaTypeDDP::read(uint32_t blockNum, uint16_t *readcount)
     return err;
 }
 
+// Returns TRUE if an error condition occurred
+bool MediaTypeDDP::read_block(uint32_t blockNum, uint8_t *buf)
+{
+    // Blocks waiting to be written are newer than the file
+    if (_run_count > 0 && blockNum >= _run_start && blockNum < _run_start + _run_count)
+    {
+        memcpy(buf, &_run_buff[(blockNum - _run_start) * MEDIA_BLOCK_SIZE], MEDIA_BLOCK_SIZE);
+        return false;
+    }
+
+    if (fseek(_media_fileh, _block_to_offset(blockNum), SEEK_SET) != 0)
+        return true;
+
+    return fread(buf, 1, 1024, _media_fileh) != 1024;
+}
+
 // Returns TRUE if an error condition occurred
 bool MediaTypeDDP::write(uint32_t blockNum, bool verify)
 {
     Debug_printf("DDP WRITE [%lu/%lu]\r\n", blockNum, _media_num_blocks);
 
-    uint32_t offset = _block_to_offset(blockNum);
-
     _media_last_block = INVALID_SECTOR_VALUE;
+    if (blockNum == _prefetch_block)
+        _prefetch_block = INVALID_SECTOR_VALUE;
 
     if (_media_fileh->_flags == 0x1484) // mounted R/O, attempt HS R/W
+        return _write_high_score(blockNum);
+
+    // A block that doesn't continue the run ends it
+    if (_run_count > 0 && (blockNum < _run_start || blockNum > _run_start + _run_count))
     {
-        Debug_printf("High score mode activated, attempting write open\r\n");
-        
-        oldFileh = _media_fileh;
-        hsFileh = _media_host->file_open(_disk_filename, _disk_filename, strlen(_disk_filename) + 1, "r+");
-        _media_fileh = hsFileh;   
+        if (flush())
+            return true;
     }
 
-    // Perform a seek if we're writing to the sector after the last one
-    int e;
-//    if (blockNum != _media_last_block + 1)
-//    {
-        e = fseek(_media_fileh, offset, SEEK_SET);
-        if (e != 0)
+    if (_run_buff == nullptr)
+    {
+        _run_buff = (uint8_t *)fnArena.malloc(ARENA_MEDIA, DDP_WRITE_RUN_BLOCKS * MEDIA_BLOCK_SIZE);
+        if (_run_buff == nullptr)
         {
-            Debug_printf("::write seek error %d\r\n", e);
-            _media_controller_status=2;
+            _media_controller_status = 2;
             return true;
         }
-//    }
-    // Write the data
-    e = fwrite(&_media_blockbuff[0], 1, 256, _media_fileh);
-    e += fwrite(&_media_blockbuff[256], 1, 256, _media_fileh);
-    e += fwrite(&_media_blockbuff[512], 1, 256, _media_fileh);
-    e += fwrite(&_media_blockbuff[768], 1, 256, _media_fileh);
-    
-    if (e != 1024)
+    }
+
+    if (_run_count == 0)
+        _run_start = blockNum;
+
+    // Rewriting a block still in the run just replaces it
+    uint32_t slot = blockNum - _run_start;
+    memcpy(&_run_buff[slot * MEDIA_BLOCK_SIZE], _media_blockbuff, MEDIA_BLOCK_SIZE);
+    if (slot == _run_count)
+        _run_count++;
+
+    _media_controller_status = 0;
+
+    if (_run_count == DDP_WRITE_RUN_BLOCKS)
+        return flush();
+
+    return false;
+}
+
+// Writes the run of blocks waiting in _run_buff with one call and syncs the file.
+// Returns TRUE if an error condition occurred
+bool MediaTypeDDP::flush()
+{
+    if (_run_count == 0)
+        return false;
+
+    size_t len = _run_count * MEDIA_BLOCK_SIZE;
+    bool err = fseek(_media_fileh, _block_to_offset(_run_start), SEEK_SET) != 0;
+    if (err == false)
+        err = fwrite(_run_buff, 1, len, _media_fileh) != len;
+    if (err)
+        Debug_printf("DDP::flush error writing %lu blocks at %lu, %d\r\n", _run_count, _run_start, errno);
+
+    fflush(_media_fileh);
+    int ret = fsync(fileno(_media_fileh)); // Since we might get reset at any moment, go ahead and sync the file
+    Debug_printf("DDP::flush %lu blocks fsync:%d\r\n", _run_count, ret);
+
+    _run_count = 0;
+    if (err)
+        _media_controller_status = 2;
+    return err;
+}
+
+// Writes one block through a R/W handle opened just for it, as the image is
+// mounted read only. Returns TRUE if an error condition occurred
+bool MediaTypeDDP::_write_high_score(uint32_t blockNum)
+{
+    if (flush())
+        return true;
+
+    Debug_printf("High score mode activated, attempting write open\r\n");
+
+    oldFileh = _media_fileh;
+    hsFileh = _media_host->file_open(_disk_filename, _disk_filename, strlen(_disk_filename) + 1, "r+");
+    if (hsFileh == nullptr)
     {
-        Debug_printf("::write error %d, %d\r\n", e, errno);
+        Debug_printf("::write high score open failed\r\n");
+        _media_controller_status = 2;
         return true;
     }
 
-    int ret = fflush(_media_fileh);    // This doesn't seem to be connected to anything in ESP-IDF VF, so it may not do anything
-    ret = fsync(fileno(_media_fileh)); // Since we might get reset at any moment, go ahead and sync the file (not clear if fflush does this)
-    Debug_printf("DDP::write fsync:%d\r\n", ret);
+    bool err = fseek(hsFileh, _block_to_offset(blockNum), SEEK_SET) != 0;
+    if (err == false)
+        err = fwrite(_media_blockbuff, 1, MEDIA_BLOCK_SIZE, hsFileh) != MEDIA_BLOCK_SIZE;
+    if (err)
+        Debug_printf("::write error %d\r\n", errno);
 
-    Debug_printv("media flags %x\n",_media_fileh->_flags);
-    
-    if (_media_fileh->_flags == 0x1484)
-    {
-        Debug_printf("Closing high score sector.\r\n");
+    fflush(hsFileh);
+    fsync(fileno(hsFileh));
 
-        if (hsFileh != nullptr)
-            fclose(hsFileh);
+    Debug_printf("Closing high score sector.\r\n");
+    fclose(hsFileh);
+    hsFileh = nullptr;
+    _media_fileh = oldFileh;
 
-        _media_fileh = oldFileh;
-        _media_last_block = INVALID_SECTOR_VALUE; // force a cache invalidate.
-    }
-    else
-        _media_last_block = blockNum;
+    _media_controller_status = err ? 2 : 0;
+    return err;
+}
 
-    _media_last_block = INVALID_SECTOR_VALUE;
-    _media_controller_status=0;
-    return false;
+void MediaTypeDDP::unmount()
+{
+    if (_media_fileh != nullptr)
+        flush();
+    fnArena.free(ARENA_MEDIA, _run_buff);
+    _run_buff = nullptr;
+    _run_count = 0;
+
+    MediaType::unmount();
+}
+
+MediaTypeDDP::~MediaTypeDDP()
+{
+    unmount();
 }
 
 uint8_t MediaTypeDDP::status()
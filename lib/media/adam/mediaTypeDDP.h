@@ -5,22 +5,37 @@
 
 #include "mediaType.h"
 
+// Consecutive block writes held back and written as one
+#define DDP_WRITE_RUN_BLOCKS 4
+
 class MediaTypeDDP : public MediaType
 {
 private:
     uint32_t _block_to_offset(uint32_t blockNum);
 
+    // Blocks _run_start onward, written but not yet on the file
+    uint8_t *_run_buff = nullptr;
+    uint32_t _run_start = 0;
+    uint32_t _run_count = 0;
+
+    bool _write_high_score(uint32_t blockNum);
+
 public:
     virtual bool read(uint32_t blockNum, uint16_t *readcount) override;
     virtual bool write(uint32_t blockNum, bool verify) override;
+    virtual bool read_block(uint32_t blockNum, uint8_t *buf) override;
+    virtual bool flush() override;
 
     virtual bool format(uint16_t *responsesize) override;
 
     virtual mediatype_t mount(FILE *f, uint32_t disksize) override;
+    virtual void unmount() override;
 
     virtual uint8_t status() override;
 
     static bool create(FILE *f, uint32_t numBlock);
+
+    virtual ~MediaTypeDDP();
 };
 
 
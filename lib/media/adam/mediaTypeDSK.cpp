@@ -43,30 +43,42 @@ bool MediaTypeDSK::read(uint32_t blockNum, uint16_t *readcount)
         return true;
     }
 
+    if (_prefetch_take(blockNum))
+    {
+        _media_controller_status = 0;
+        return false;
+    }
+
     memset(_media_blockbuff, 0, sizeof(_media_blockbuff));
 
-    bool err = false;
+    bool err = read_block(blockNum, _media_blockbuff);
 
+    if (err == false)
+        _media_last_block = blockNum;
+    else
+        _media_last_block = INVALID_SECTOR_VALUE;
+
+    _media_controller_status = 0;
+
+    return err;
+}
+
+// Returns TRUE if an error condition occurred
+bool MediaTypeDSK::read_block(uint32_t blockNum, uint8_t *buf)
+{
     // Read lower part of block
     std::pair<uint32_t, uint32_t> offsets = _block_to_offsets(blockNum);
-    err = fseek(_media_fileh, offsets.first, SEEK_SET) != 0;
+    bool err = fseek(_media_fileh, offsets.first, SEEK_SET) != 0;
 
     if (err == false)
-        err = fread(_media_blockbuff, 1, 512, _media_fileh) != 512;
+        err = fread(buf, 1, 512, _media_fileh) != 512;
 
     // Read upper part of block
     if (err == false)
         err = fseek(_media_fileh, offsets.second, SEEK_SET) != 0;
 
     if (err == false)
-        err = fread(&_media_blockbuff[512], 1, 512, _media_fileh) != 512;
-
-    if (err == false)
-        _media_last_block = blockNum;
-    else
-        _media_last_block = INVALID_SECTOR_VALUE;
-
-    _media_controller_status = 0;
+        err = fread(&buf[512], 1, 512, _media_fileh) != 512;
 
     return err;
 }
@@ -77,6 +89,9 @@ bool MediaTypeDSK::write(uint32_t blockNum, bool verify)
     bool err = false;
     Debug_println("DSK WRITE");
 
+    if (blockNum == _prefetch_block)
+        _prefetch_block = INVALID_SECTOR_VALUE;
+
     // Return an error if we're trying to write beyond the end of the disk
     if (blockNum > _media_num_blocks)
     {
@@ -15,6 +15,7 @@ private:
 public:
     virtual bool read(uint32_t blockNum, uint16_t *readcount) override;
     virtual bool write(uint32_t blockNum, bool verify) override;
+    virtual bool read_block(uint32_t blockNum, uint8_t *buf) override;
 
     virtual bool format(uint16_t *responsesize) override;
 
@@ -38,6 +38,9 @@ void MediaType::unmount()
 
 mediatype_t MediaType::discover_mediatype(const char *filename)
 {
+    std::string name = util_strip_gzip_ext(filename);
+    filename = name.c_str();
+
     //should probably look inside the file to help figure it out
     int l = strlen(filename);
     if (l > 4 && filename[l - 4] == '.')
@@ -39,10 +39,7 @@ bool MediaTypeDO::read_sector(int track, int sector, uint8_t* buffer)
     bool err = false;
     uint32_t offset = (track * BYTES_PER_TRACK) + (sector * BYTES_PER_SECTOR);
 
-    err = fnio::fseek(_media_fileh, offset, SEEK_SET) != 0;
-
-    if (!err)
-        err = fnio::fread(buffer, 1, BYTES_PER_SECTOR, _media_fileh) != BYTES_PER_SECTOR;
+    err = fnio::pread(_media_fileh, buffer, BYTES_PER_SECTOR, offset) != BYTES_PER_SECTOR;
 
     return err;
 }
@@ -1,9 +1,7 @@
 #ifdef BUILD_APPLE
 
-#ifndef DEV_RELAY_SLIP
-#include "esp_heap_caps.h"
-#endif
 #include "mediaTypeDSK.h"
+#include "fnArena.h"
 #include "../../include/debug.h"
 #include <string.h>
 
@@ -96,22 +94,21 @@ mediatype_t MediaTypeDSK::mount(fnFile *f, uint32_t disksize)
 
     // allocated SPRAM
     const size_t dsk_image_size = num_tracks * BYTES_PER_TRACK;
-#ifdef ESP_PLATFORM
-    uint8_t *dsk = (uint8_t*)heap_caps_malloc(dsk_image_size, MALLOC_CAP_SPIRAM);
-#else
-	uint8_t *dsk = (uint8_t*)malloc(dsk_image_size);
-#endif
-    if (fnio::fseek(f, 0, SEEK_SET) != 0)
+    uint8_t *dsk = (uint8_t*)fnArena.malloc(ARENA_MEDIA, dsk_image_size);
+    if (dsk == nullptr)
         return MEDIATYPE_UNKNOWN;
-    size_t bytes_read = fnio::fread(dsk, 1, dsk_image_size, f);
-    if (bytes_read != dsk_image_size)
+    if (fnio::fseek(f, 0, SEEK_SET) != 0 ||
+        fnio::fread(dsk, 1, dsk_image_size, f) != dsk_image_size)
+    {
+        fnArena.free(ARENA_MEDIA, dsk);
         return MEDIATYPE_UNKNOWN;
+    }
 
     dsk2woz_info();
     dsk2woz_tmap();
 	dsk2woz_tracks(dsk);
 
-    free(dsk);
+    fnArena.free(ARENA_MEDIA, dsk);
     return MEDIATYPE_WOZ;
 }
 
@@ -170,11 +167,7 @@ bool MediaTypeDSK::dsk2woz_tracks(uint8_t *dsk)
 	// Write out all tracks.
 	for (size_t c = 0; c < num_tracks; c++)
 	{
-#ifdef ESP_PLATFORM
-		TRK_bitstream *bitstream = (TRK_bitstream *) heap_caps_malloc(BITSTREAM_ALLOC_SIZE(WOZ1_TRACK_LEN), MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
-#else
-		TRK_bitstream *bitstream = (TRK_bitstream *)malloc(BITSTREAM_ALLOC_SIZE(WOZ1_TRACK_LEN));
-#endif
+		TRK_bitstream *bitstream = (TRK_bitstream *)fnArena.malloc(ARENA_MEDIA, BITSTREAM_ALLOC_SIZE(WOZ1_TRACK_LEN));
 		if (bitstream != nullptr)
 		{
 			trk_data[c] = bitstream;
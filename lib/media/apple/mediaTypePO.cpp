@@ -2,12 +2,301 @@
 
 #include "mediaTypePO.h"
 
+#include <cstdlib>
 #include <cstring>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
 #include "utils.h"
 #include "../../include/debug.h"
 
+std::mutex MediaTypePO::_mutex;
+std::condition_variable MediaTypePO::_cv;
+std::deque<std::pair<MediaTypePO *, MediaTypePO::ra_window *>> MediaTypePO::_prefetch_queue;
+MediaTypePO *MediaTypePO::_prefetching = nullptr;
+bool MediaTypePO::_task_started = false;
+
+MediaTypePO::~MediaTypePO()
+{
+    free_cache();
+}
+
+void MediaTypePO::unmount()
+{
+    free_cache();
+    MediaType::unmount();
+}
+
+// Called with _mutex held. The task lives for the rest of the run once started.
+void MediaTypePO::_start_task()
+{
+    if (_task_started)
+        return;
+#ifdef ESP_PLATFORM
+    if (xTaskCreatePinnedToCore(_prefetch_task, "po_prefetch", PO_PREFETCH_STACKSIZE, nullptr,
+                                PO_PREFETCH_PRIORITY, nullptr, 0) != pdPASS)
+    {
+        Debug_println("MediaTypePO - failed to start prefetch task, reading on demand");
+        return;
+    }
+#else
+    std::thread(_task_loop).detach();
+#endif
+    _task_started = true;
+}
+
+#ifdef ESP_PLATFORM
+void MediaTypePO::_prefetch_task(void *param)
+{
+    _task_loop();  // Never returns
+    vTaskDelete(nullptr);
+}
+#endif
+
+void MediaTypePO::_task_loop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        if (_prefetch_queue.empty())
+        {
+            _cv.wait(lock);
+            continue;
+        }
+
+        // The image can't go away while _prefetching points at it
+        auto job = _prefetch_queue.front();
+        _prefetch_queue.pop_front();
+        _prefetching = job.first;
+        lock.unlock();
+
+        job.first->fill(job.second);
+
+        lock.lock();
+        _prefetching = nullptr;
+        _cv.notify_all();
+    }
+}
+
+bool MediaTypePO::alloc_cache()
+{
+    if (_blocks != nullptr)
+        return true;
+
+    _blocks = new (std::nothrow) cached_block[PO_BLOCK_CACHE_BLOCKS];
+    for (ra_window &w : _windows)
+        w.data = (uint8_t *)malloc(PO_READAHEAD_BLOCKS * DISK_SECTORBUF_SIZE);
+
+    for (ra_window &w : _windows)
+    {
+        if (_blocks == nullptr || w.data == nullptr)
+        {
+            for (ra_window &f : _windows)
+            {
+                free(f.data);
+                f.data = nullptr;
+            }
+            delete[] _blocks;
+            _blocks = nullptr;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Drops a queued prefetch of this image and waits out a running one
+void MediaTypePO::cancel_prefetch(std::unique_lock<std::mutex> &lock)
+{
+    for (auto it = _prefetch_queue.begin(); it != _prefetch_queue.end();)
+        it = it->first == this ? _prefetch_queue.erase(it) : it + 1;
+    while (_prefetching == this)
+        _cv.wait(lock);
+}
+
+void MediaTypePO::free_cache()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    cancel_prefetch(lock);
+
+    for (ra_window &w : _windows)
+    {
+        free(w.data);
+        w = ra_window();
+    }
+    delete[] _blocks;
+    _blocks = nullptr;
+    _last_read = UINT32_MAX;
+}
+
+// Copies blockNum out of the cache if it's there
+bool MediaTypePO::lookup(uint32_t blockNum, uint8_t *buffer)
+{
+    for (int i = 0; i < PO_BLOCK_CACHE_BLOCKS; i++)
+    {
+        if (_blocks[i].block == blockNum)
+        {
+            memcpy(buffer, _blocks[i].data, DISK_SECTORBUF_SIZE);
+            _blocks[i].used = ++_tick;
+            return true;
+        }
+    }
+
+    for (ra_window &w : _windows)
+    {
+        if (w.state == ra_window::READY && blockNum >= w.first && blockNum < w.first + w.count)
+        {
+            memcpy(buffer, w.data + (blockNum - w.first) * DISK_SECTORBUF_SIZE, DISK_SECTORBUF_SIZE);
+            w.used = ++_tick;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Once a read is half way through a window, start reading the run after it into the other one
+void MediaTypePO::schedule_prefetch(uint32_t blockNum)
+{
+    ra_window *cur = nullptr;
+    for (ra_window &w : _windows)
+        if (w.state == ra_window::READY && blockNum >= w.first && blockNum < w.first + w.count)
+            cur = &w;
+    if (cur == nullptr || blockNum < cur->first + cur->count / 2)
+        return;
+
+    uint32_t next = cur->first + cur->count;
+    if (next >= num_blocks || high_score_block(next))
+        return;
+
+    ra_window *spare = nullptr;
+    for (ra_window &w : _windows)
+    {
+        if (w.state != ra_window::EMPTY && w.first == next)
+            return; // already there or on its way
+        if (&w != cur && w.state != ra_window::FILLING && (spare == nullptr || w.used < spare->used))
+            spare = &w;
+    }
+    if (spare == nullptr)
+        return;
+
+    _start_task();
+    if (!_task_started)
+        return;
+
+    spare->state = ra_window::FILLING;
+    spare->first = next;
+    spare->count = 0;
+    _prefetch_queue.push_back({this, spare});
+    _cv.notify_all();
+}
+
+// Reads the run starting at w->first, which has been marked FILLING; returns TRUE on error
+bool MediaTypePO::fill(ra_window *w)
+{
+    std::lock_guard<std::mutex> io_lock(_io_mutex);
+
+    uint32_t blocks = num_blocks - w->first < PO_READAHEAD_BLOCKS ? num_blocks - w->first : PO_READAHEAD_BLOCKS;
+
+    // the file position moves, so the next plain read or write has to seek
+    reset_seek_opto();
+    size_t got = fnio::pread(_media_fileh, w->data, blocks * DISK_SECTORBUF_SIZE, (w->first * DISK_SECTORBUF_SIZE) + offset);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    w->count = got / DISK_SECTORBUF_SIZE;
+    w->state = w->count != 0 ? ra_window::READY : ra_window::EMPTY;
+    w->used = ++_tick;
+    _cv.notify_all();
+    return w->count == 0;
+}
+
 bool MediaTypePO::read(uint32_t blockNum, uint16_t *count, uint8_t* buffer)
 {
+    // High score blocks are always read fresh from the image
+    if (*count != DISK_SECTORBUF_SIZE || high_score_block(blockNum) || blockNum >= num_blocks)
+        return read_direct(blockNum, count, buffer);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!alloc_cache())
+    {
+        lock.unlock();
+        return read_direct(blockNum, count, buffer);
+    }
+
+    bool sequential = blockNum == _last_read + 1;
+    _last_read = blockNum;
+
+    bool hit;
+    while (!(hit = lookup(blockNum, buffer)))
+    {
+        // Wait for a prefetch that is bringing the block in
+        bool coming = false;
+        for (ra_window &w : _windows)
+            if (w.state == ra_window::FILLING && blockNum >= w.first && blockNum < w.first + PO_READAHEAD_BLOCKS)
+                coming = true;
+        if (!coming)
+            break;
+        _cv.wait(lock);
+    }
+
+    if (hit)
+        cache_hits++;
+    else
+        cache_misses++;
+
+    if (!hit)
+    {
+        // Miss, read the run starting here into the least recently used window
+        ra_window *w = nullptr;
+        for (ra_window &c : _windows)
+            if (c.state != ra_window::FILLING && (w == nullptr || c.used < w->used))
+                w = &c;
+        if (w == nullptr)
+        {
+            lock.unlock();
+            return read_direct(blockNum, count, buffer);
+        }
+
+        w->state = ra_window::FILLING;
+        w->first = blockNum;
+        lock.unlock();
+        bool err = fill(w);
+        lock.lock();
+        if (err || !lookup(blockNum, buffer))
+            return true;
+    }
+
+    // Blocks read out of sequence are the ones ProDOS keeps coming back to
+    if (!sequential)
+    {
+        cached_block *b = &_blocks[0];
+        bool present = false;
+        for (int i = 0; i < PO_BLOCK_CACHE_BLOCKS; i++)
+        {
+            if (_blocks[i].block == blockNum)
+                present = true;
+            if (_blocks[i].used < b->used)
+                b = &_blocks[i];
+        }
+        if (!present)
+        {
+            b->block = blockNum;
+            b->used = ++_tick;
+            memcpy(b->data, buffer, DISK_SECTORBUF_SIZE);
+        }
+    }
+
+    schedule_prefetch(blockNum);
+    return false;
+}
+
+// Straight from the image, for reads the cache doesn't handle
+bool MediaTypePO::read_direct(uint32_t blockNum, uint16_t *count, uint8_t* buffer)
+{
+    std::lock_guard<std::mutex> io_lock(_io_mutex);
     size_t readsize = *count;
 if (blockNum == 0 || blockNum != last_block_num + 1) // example optimization, only do seek if not reading next block -tschak
   {
@@ -29,6 +318,7 @@ if (blockNum == 0 || blockNum != last_block_num + 1) // example optimization, on
 
 bool MediaTypePO::write(uint32_t blockNum, uint16_t *count, uint8_t* buffer)
 {
+    std::unique_lock<std::mutex> io_lock(_io_mutex);
     size_t writesize = *count;
 
     if (high_score_enabled && blockNum >= _high_score_block_lb && blockNum <= _high_score_block_ub)
@@ -49,11 +339,33 @@ bool MediaTypePO::write(uint32_t blockNum, uint16_t *count, uint8_t* buffer)
     }
     last_block_num = blockNum;
     writesize = fnio::fwrite((unsigned char *)buffer, 1, writesize, _media_fileh);
-    if (writesize != *count)
-    {
+    bool err = writesize != *count;
+    if (err)
        reset_seek_opto();
-       return true;
+
+    {
+        // Keep cached copies in step, or drop them if the image may not match any more
+        std::lock_guard<std::mutex> lock(_mutex);
+        bool drop = err || *count != DISK_SECTORBUF_SIZE;
+        for (ra_window &w : _windows)
+        {
+            if (w.state != ra_window::READY)
+                continue;
+            if (drop)
+                w.state = ra_window::EMPTY;
+            else if (blockNum >= w.first && blockNum < w.first + w.count)
+                memcpy(w.data + (blockNum - w.first) * DISK_SECTORBUF_SIZE, buffer, DISK_SECTORBUF_SIZE);
+        }
+        for (int i = 0; _blocks != nullptr && i < PO_BLOCK_CACHE_BLOCKS; i++)
+        {
+            if (drop)
+                _blocks[i].block = UINT32_MAX;
+            else if (_blocks[i].block == blockNum)
+                memcpy(_blocks[i].data, buffer, DISK_SECTORBUF_SIZE);
+        }
     }
+    if (err)
+       return true;
 
     if (high_score_enabled && blockNum >= _high_score_block_lb && blockNum <= _high_score_block_ub)
     {
@@ -81,6 +393,7 @@ bool MediaTypePO::format(uint16_t *responsesize)
 
 mediatype_t MediaTypePO::mount(fnFile *f, uint32_t disksize)
 {
+    free_cache();
     diskiiemulation = false;
     char hdr[64];
     fnio::fread(&hdr,sizeof(char),64,f);
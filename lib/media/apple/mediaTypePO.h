@@ -2,15 +2,86 @@
 #define _MEDIATYPE_PO_
 
 #include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 
 #include "mediaType.h"
 
+// 512 byte blocks read from the image in one go, the rest of a run of
+// reads is then served from memory
+#define PO_READAHEAD_BLOCKS 16
+// While one window is being read from, the next run is read into the other
+#define PO_READAHEAD_WINDOWS 2
+// Recently used blocks outside of a sequential run (volume directory, bitmap)
+#define PO_BLOCK_CACHE_BLOCKS 8
+
+// Reads the next window in the background, on the core the bus loop isn't on
+#define PO_PREFETCH_STACKSIZE 4096
+#define PO_PREFETCH_PRIORITY 5
+
 class MediaTypePO : public MediaType
 {
 private:
     uint32_t last_block_num = 0xFFFFFFFF;
     uint32_t offset = 0;
+
+    struct ra_window
+    {
+        enum { EMPTY, FILLING, READY } state = EMPTY;
+        uint8_t *data = nullptr;
+        uint32_t first = 0;
+        uint32_t count = 0;
+        uint32_t used = 0;
+    };
+
+    struct cached_block
+    {
+        uint32_t block = UINT32_MAX;
+        uint32_t used = 0;
+        uint8_t data[DISK_SECTORBUF_SIZE];
+    };
+
+    ra_window _windows[PO_READAHEAD_WINDOWS];
+    cached_block *_blocks = nullptr;
+    uint32_t _tick = 0;
+    uint32_t _last_read = UINT32_MAX;
+
+    // Keeps the bus loop and the prefetch task off the image file at the same time
+    std::mutex _io_mutex;
+
+    // Guards every image's windows and blocks and the prefetch queue. Taken
+    // after _io_mutex when both are needed
+    static std::mutex _mutex;
+    static std::condition_variable _cv;
+    static std::deque<std::pair<MediaTypePO *, ra_window *>> _prefetch_queue;
+    static MediaTypePO *_prefetching;
+    static bool _task_started;
+
+    static void _start_task();
+    static void _task_loop();
+#ifdef ESP_PLATFORM
+    static void _prefetch_task(void *param);
+#endif
+
+    // These are called with _mutex held
+    bool alloc_cache();
+    bool lookup(uint32_t blockNum, uint8_t *buffer);
+    void schedule_prefetch(uint32_t blockNum);
+    void cancel_prefetch(std::unique_lock<std::mutex> &lock);
+
+    bool fill(ra_window *w);
+    void free_cache();
+    bool read_direct(uint32_t blockNum, uint16_t *count, uint8_t* buffer);
+    bool high_score_block(uint32_t blockNum) { return high_score_enabled && blockNum >= _high_score_block_lb && blockNum <= _high_score_block_ub; }
 public:
+    // Block reads answered from the windows or the block cache, and ones that went to the image
+    uint32_t cache_hits = 0;
+    uint32_t cache_misses = 0;
+
+    virtual ~MediaTypePO();
+    virtual void unmount() override;
+
     virtual bool read(uint32_t blockNum, uint16_t *count, uint8_t* buffer) override;
     virtual bool write(uint32_t blockNum, uint16_t *count, uint8_t* buffer) override;
     virtual bool write_sector(int track, int sector, uint8_t *buffer) override;
@@ -1,15 +1,22 @@
 #ifdef BUILD_APPLE
 
-#ifndef DEV_RELAY_SLIP
-#include "esp_heap_caps.h"
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
 #endif
 #include "mediaTypeWOZ.h"
+#include "compat_esp.h"
+#include "fnArena.h"
 #include "../../include/debug.h"
 #include <string.h>
 
 #define WOZ1 '1'
 #define WOZ2 '2'
 
+#ifdef ESP_PLATFORM
+// Shared by all drives, the ISR holds it only for the length of a track copy
+static portMUX_TYPE trk_mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
 bool MediaTypeWOZ::write_sector(int track, int sector, uint8_t *buffer)
 {
   Debug_printf("\r\nWOZ disk needs to write sector!");
@@ -47,17 +54,30 @@ mediatype_t MediaTypeWOZ::mount(fnFile *f, uint32_t disksize)
         return MEDIATYPE_UNKNOWN;
     }
 
+    // Have the boot track ready, the rest follow the head
+    load_track(0, 0);
+
     return MEDIATYPE_WOZ;
 }
 
 void MediaTypeWOZ::unmount()
 {
     MediaType::unmount();
+
+    TRK_bitstream *tracks[MAX_TRACKS];
+    lock_tracks();
+    for (int i = 0; i < MAX_TRACKS; i++)
+    {
+        tracks[i] = trk_data[i];
+        trk_data[i] = nullptr;
+    }
+    unlock_tracks();
     for (int i = 0; i < MAX_TRACKS; i++)
     {
-        if (trk_data[i] != nullptr)
-            free(trk_data[i]);
+        if (tracks[i] != nullptr)
+            fnArena.free(ARENA_MEDIA, tracks[i]);
     }
+    trk_loaded = 0;
 }
 
 bool MediaTypeWOZ::wozX_check_header()
@@ -161,68 +181,27 @@ bool MediaTypeWOZ::wozX_read_tmap()
 
 bool MediaTypeWOZ::woz1_read_tracks()
 {    // depend upon little endian-ness
-    fnio::fseek(_media_fileh, 256, SEEK_SET);
-
-    Debug_printf("\nStart Block, Block Count, Bit Count");
-    
-#ifdef ESP_PLATFORM
-    TRK_bitstream *bitstream = (TRK_bitstream *) heap_caps_malloc(BITSTREAM_ALLOC_SIZE(WOZ1_TRACK_LEN), MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL);
-#else
-    TRK_bitstream *bitstream = (TRK_bitstream *) malloc(BITSTREAM_ALLOC_SIZE(WOZ1_TRACK_LEN));
-#endif
-    uint16_t bytes_used;
-    uint16_t bit_count;
-    uint8_t data[WOZ1_TRACK_LEN];
+    // woz1 track data organized as:
+    // Offset  Size        Name              Usage
+    // +0      6646 bytes  Bitstream         The bitstream data padded out to 6646 bytes
+    // +6646   uint16      Bytes Used        The actual byte count for the bitstream.
+    // +6648   uint16      Bit Count         The number of bits in the bitstream.
+    // +6650   uint16      Splice Point      Index of first bit after track splice
+    //                                       (write hint). If no splice information is
+    //                                       provided, then will be 0xFFFF.
+    // +6652   uint8       Splice Nibble     Nibble value to use for splice (write hint).
+    // +6653   uint8       Splice Bit Count  Bit count of splice nibble (write hint).
+    // +6654   uint16      Reserved for future use.
 
+    // Tracks are read as the head gets to them, only note where they are
     for (int i = 0; i < MAX_TRACKS; i++)
     {
-
-        // woz1 track data organized as:
-        // Offset  Size        Name              Usage
-        // +0      6646 bytes  Bitstream         The bitstream data padded out to 6646 bytes
-        // +6646   uint16      Bytes Used        The actual byte count for the bitstream.
-        // +6648   uint16      Bit Count         The number of bits in the bitstream.
-        // +6650   uint16      Splice Point      Index of first bit after track splice
-        //                                       (write hint). If no splice information is
-        //                                       provided, then will be 0xFFFF.
-        // +6652   uint8       Splice Nibble     Nibble value to use for splice (write hint).
-        // +6653   uint8       Splice Bit Count  Bit count of splice nibble (write hint).
-        // +6654   uint16      Reserved for future use.
-
-        fnio::fread(data, 1, WOZ1_TRACK_LEN, _media_fileh);
-        fnio::fread(&bytes_used, sizeof(bytes_used), 1, _media_fileh);
-        fnio::fread(&bit_count, sizeof(bit_count), 1, _media_fileh);
-        if (bit_count > 0)
-        {
-#ifdef ESP_PLATFORM
-            TRK_bitstream *bitstream = (TRK_bitstream *) heap_caps_malloc(BITSTREAM_ALLOC_SIZE(WOZ1_TRACK_LEN), MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
-#else
-            TRK_bitstream *bitstream = (TRK_bitstream *) malloc(BITSTREAM_ALLOC_SIZE(WOZ1_TRACK_LEN));
-#endif
-            if (bitstream != nullptr)
-            {
-                memset(bitstream, 0, BITSTREAM_ALLOC_SIZE(WOZ1_TRACK_LEN));
-                bitstream->len_bytes = bytes_used;
-                bitstream->len_bits = bit_count;
-                bitstream->len_blocks = (bitstream->len_bytes + 511) / 512;
-                trk_data[i] = bitstream;
-                Debug_printf("\nStoring %d bytes of track %d into location %lx", bytes_used, i, trk_data[i]);
-                memcpy(bitstream->data, data, bytes_used);
-            }
-            else
-            {
-                Debug_printf("\nNo RAM allocated!");
-                return true;
-            }
-        }
-        else
-        {
-            trk_data[i] = nullptr;
-            Debug_printf("\nTrack %d is blank!",i);
-        }
-        fnio::fread(bitstream, 1, 6, _media_fileh); // read through rest of bytes in track
+        trk_loc[i].offset = 256 + i * WOZ1_TRACK_RECORD_LEN;
+        trk_loc[i].len_bytes = WOZ1_TRACK_LEN;
+        trk_loc[i].len_blocks = 0;
+        trk_loc[i].len_bits = 0;
     }
-    free(bitstream);
+    lazy_tracks = true;
     return false;
 }
 
@@ -239,42 +218,125 @@ bool MediaTypeWOZ::woz2_read_tracks()
 
 
     fnio::fseek(_media_fileh, 256, SEEK_SET);
-    fnio::fread(trks, sizeof(WOZ2_TRK_t), MAX_TRACKS, _media_fileh);
+    if (fnio::fread(trks, sizeof(WOZ2_TRK_t), MAX_TRACKS, _media_fileh) != MAX_TRACKS)
+    {
+        Debug_printf("\nError reading TRKS chunk");
+        return true;
+    }
 #ifdef DEBUG
     Debug_printf("\nStart Block, Block Count, Bit Count");
     for (int i=0; i<MAX_TRACKS; i++)
         Debug_printf("\n%d, %d, %lu", trks[i].start_block, trks[i].block_count, trks[i].bit_count);
 #endif
-    // read WOZ tracks into RAM
+    // Tracks are read as the head gets to them, only note where they are
     for (int i=0; i<MAX_TRACKS; i++)
     {
-        size_t s = std::max(trks[i].block_count * 512, WOZ1_TRACK_LEN);
-        if (s != 0)
+        trk_loc[i].offset = trks[i].start_block * 512;
+        trk_loc[i].len_bytes = std::max(trks[i].block_count * 512, WOZ1_TRACK_LEN);
+        trk_loc[i].len_blocks = trks[i].block_count;
+        trk_loc[i].len_bits = trks[i].bit_count;
+    }
+    lazy_tracks = true;
+    return false;
+}
+
+// Reads track index from the image into a new bitstream
+TRK_bitstream *MediaTypeWOZ::read_track(uint8_t index)
+{
+    const TRK_location &loc = trk_loc[index];
+    TRK_bitstream *bitstream = (TRK_bitstream *) fnArena.malloc(ARENA_MEDIA, BITSTREAM_ALLOC_SIZE(loc.len_bytes));
+    if (bitstream == nullptr)
+    {
+        Debug_printf("\nNo RAM allocated!");
+        return nullptr;
+    }
+
+    memset(bitstream, 0, BITSTREAM_ALLOC_SIZE(loc.len_bytes));
+    if (fnio::fseek(_media_fileh, loc.offset, SEEK_SET) != 0 ||
+        fnio::fread(bitstream->data, 1, loc.len_bytes, _media_fileh) == 0)
+    {
+        Debug_printf("\nError reading track %d", index);
+        fnArena.free(ARENA_MEDIA, bitstream);
+        return nullptr;
+    }
+
+    if (woz_version == WOZ1)
+    {
+        uint16_t bytes_used = 0;
+        uint16_t bit_count = 0;
+        fnio::fread(&bytes_used, sizeof(bytes_used), 1, _media_fileh);
+        fnio::fread(&bit_count, sizeof(bit_count), 1, _media_fileh);
+        bitstream->len_bytes = bytes_used;
+        bitstream->len_bits = bit_count; // 0 is a blank track
+        bitstream->len_blocks = (bitstream->len_bytes + 511) / 512;
+        if (bit_count == 0)
+            Debug_printf("\nTrack %d is blank!", index);
+    }
+    else
+    {
+        bitstream->len_blocks = loc.len_blocks;
+        bitstream->len_bytes = loc.len_bytes;
+        bitstream->len_bits = loc.len_bits;
+    }
+    return bitstream;
+}
+
+bool MediaTypeWOZ::load_track(int t, int keep)
+{
+    uint8_t index = tmap[t];
+    if (!lazy_tracks || index == 255 || index >= MAX_TRACKS)
+        return false;
+
+    if (trk_data[index] != nullptr)
+    {
+        trk_used[index] = ++trk_tick;
+        return false;
+    }
+
+    TRK_bitstream *bitstream = read_track(index);
+    if (bitstream == nullptr)
+        return true;
+
+    int victim = -1;
+    if (trk_loaded >= WOZ_TRACK_CACHE_TRACKS)
+    {
+        for (int i = 0; i < MAX_TRACKS; i++)
         {
-#ifdef ESP_PLATFORM
-            TRK_bitstream *bitstream = (TRK_bitstream *) heap_caps_malloc(BITSTREAM_ALLOC_SIZE(s), MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
-#else
-            TRK_bitstream *bitstream = (TRK_bitstream *) malloc(BITSTREAM_ALLOC_SIZE(s));
-#endif
-            if (bitstream != nullptr)
-            {
-                Debug_printf("\nReading %d bytes of track %d into location %lx", s, i, trk_data[i]);
-                fnio::fseek(_media_fileh, trks[i].start_block * 512, SEEK_SET);
-                fnio::fread(bitstream->data, 1, s, _media_fileh);
-                bitstream->len_blocks = trks[i].block_count;
-                bitstream->len_bytes = s;
-                bitstream->len_bits = trks[i].bit_count;
-                trk_data[i] = bitstream;
-                Debug_printf("\n%d, %d, %lu", trks[i].start_block, trks[i].block_count, trks[i].bit_count);
-            }
-            else
-            {
-                Debug_printf("\nNo RAM allocated!");
-                return true;
-            }
+            if (trk_data[i] != nullptr && i != tmap[keep] && (victim < 0 || trk_used[i] < trk_used[victim]))
+                victim = i;
         }
     }
+
+    TRK_bitstream *old = nullptr;
+    lock_tracks();
+    if (victim >= 0)
+    {
+        old = trk_data[victim];
+        trk_data[victim] = nullptr;
+    }
+    trk_data[index] = bitstream;
+    unlock_tracks();
+
+    if (old != nullptr)
+        fnArena.free(ARENA_MEDIA, old);
+    else
+        trk_loaded++;
+    trk_used[index] = ++trk_tick;
     return false;
 }
 
+void IRAM_ATTR MediaTypeWOZ::lock_tracks()
+{
+#ifdef ESP_PLATFORM
+    portENTER_CRITICAL_SAFE(&trk_mux);
+#endif
+}
+
+void IRAM_ATTR MediaTypeWOZ::unlock_tracks()
+{
+#ifdef ESP_PLATFORM
+    portEXIT_CRITICAL_SAFE(&trk_mux);
+#endif
+}
+
 #endif // BUILD_APPLE
@@ -9,6 +9,11 @@
 #define WOZ1_TRACK_LEN 6646
 #define WOZ1_NUM_BLKS 13
 #define WOZ1_BIT_TIME 32
+// WOZ1 TRKS entries are the padded bitstream plus a 10 byte trailer
+#define WOZ1_TRACK_RECORD_LEN 6656
+// Tracks kept in memory, they are read from the image as the head gets to
+// them and the least recently used one is dropped first
+#define WOZ_TRACK_CACHE_TRACKS 16
 struct TRK_bitstream
 {
     uint16_t len_blocks;
@@ -19,20 +24,37 @@ struct TRK_bitstream
 
 #define BITSTREAM_ALLOC_SIZE(x) (sizeof(TRK_bitstream) + x)
 
+// Where a track is in the image
+struct TRK_location
+{
+    uint32_t offset;
+    uint32_t len_bytes; // read from offset
+    uint16_t len_blocks;
+    uint32_t len_bits;  // 0 for WOZ1, which keeps it after the bitstream
+};
+
 class MediaTypeWOZ : public MediaType
 {
 private:
     char woz_version;
 
+    // Track data is read on demand, rather than all of it at mount
+    bool lazy_tracks = false;
+    TRK_location trk_loc[MAX_TRACKS];
+    uint32_t trk_used[MAX_TRACKS];
+    uint32_t trk_tick = 0;
+    int trk_loaded = 0;
+
     bool wozX_check_header();
     bool wozX_read_info();
     bool wozX_read_tmap();
     bool woz1_read_tracks();
     bool woz2_read_tracks();
+    TRK_bitstream *read_track(uint8_t index);
 
 protected:
     uint8_t tmap[MAX_TRACKS];
-    TRK_bitstream *trk_data[MAX_TRACKS];
+    TRK_bitstream *trk_data[MAX_TRACKS] = {};
 
 public:
     virtual bool read(uint32_t blockNum, uint16_t *count, uint8_t* buffer) override { return false; };
@@ -47,7 +69,15 @@ public:
     virtual bool status() override {return (_media_fileh != nullptr);}
 
     uint8_t trackmap(uint8_t t) { return tmap[t]; };
+    // nullptr while quarter track t hasn't been loaded yet
     TRK_bitstream *get_track(int t) { return trk_data[tmap[t]]; };
+    bool track_loaded(int t) { return tmap[t] == 255 || trk_data[tmap[t]] != nullptr; };
+    // Reads quarter track t from the image if it isn't in memory, dropping the
+    // least recently used track other than keep's. Not for ISRs
+    bool load_track(int t, int keep);
+    // Held while copying out of a track, so a load can't free it meanwhile
+    void lock_tracks();
+    void unlock_tracks();
     uint8_t optimal_bit_timing;
     // static bool create(FILE *f, uint32_t numBlock);
 };
@@ -3,9 +3,13 @@
 #include "diskType.h"
 
 #include <string.h>
+#include <stdlib.h>
 
 #include "../../include/debug.h"
 
+#include "fnSystem.h"
+#include "fnArena.h"
+
 #include "utils.h"
 
 
@@ -141,10 +145,119 @@ void MediaType::unmount()
         fnio::fclose(_disk_fileh);
         _disk_fileh = nullptr;
     }
+
+    if (_sector_cache_slots != nullptr)
+        Debug_printf("Sector cache hits: %lu, misses: %lu\r\n", (unsigned long)sector_cache_hits, (unsigned long)sector_cache_misses);
+    sector_cache_free();
+}
+
+void MediaType::set_sector_cache_size(uint16_t sectors)
+{
+    sector_cache_free();
+    _sector_cache_sectors = sectors;
+}
+
+void MediaType::sector_cache_free()
+{
+    free(_sector_cache_slots);
+    fnArena.free(ARENA_MEDIA, _sector_cache_data);
+    _sector_cache_slots = nullptr;
+    _sector_cache_data = nullptr;
+}
+
+void MediaType::sector_cache_clear()
+{
+    if (_sector_cache_slots != nullptr)
+        memset(_sector_cache_slots, 0, _sector_cache_sectors * sizeof(sector_cache_slot));
+}
+
+void MediaType::sector_cache_preload(uint16_t sectors)
+{
+    // Keep the counts to what the computer asked for
+    uint32_t hits = sector_cache_hits, misses = sector_cache_misses;
+
+    uint16_t readcount;
+    for (uint16_t n = 1; n <= sectors && n <= _disk_num_sectors; n++)
+    {
+        if (read(n, &readcount) || _sector_cache_slots == nullptr)
+            break;
+    }
+
+    sector_cache_hits = hits;
+    sector_cache_misses = misses;
+}
+
+bool MediaType::sector_cache_read(uint16_t sectornum, uint16_t size)
+{
+    if (_sector_cache_slots == nullptr)
+        return false;
+
+    for (int i = 0; i < _sector_cache_sectors; i++)
+    {
+        sector_cache_slot &slot = _sector_cache_slots[i];
+        if (slot.sectornum == sectornum && slot.size == size)
+        {
+            memcpy(_disk_sectorbuff, _sector_cache_data + i * DISK_SECTORBUF_SIZE, size);
+            slot.last_used = ++_sector_cache_clock;
+            sector_cache_hits++;
+            return true;
+        }
+    }
+    sector_cache_misses++;
+    return false;
+}
+
+void MediaType::sector_cache_store(uint16_t sectornum, uint16_t size)
+{
+    if (_sector_cache_slots == nullptr)
+    {
+        // Set up on first use so drives that never read don't hold memory
+        if (_sector_cache_sectors < 0)
+#ifdef ESP_PLATFORM
+            _sector_cache_sectors = fnSystem.get_psram_size() > 0 ? DISK_SECTOR_CACHE_SECTORS_PSRAM : DISK_SECTOR_CACHE_SECTORS;
+#else
+            _sector_cache_sectors = DISK_SECTOR_CACHE_SECTORS_PSRAM;
+#endif
+        if (_sector_cache_sectors == 0)
+            return;
+
+        _sector_cache_slots = (sector_cache_slot *)calloc(_sector_cache_sectors, sizeof(sector_cache_slot));
+        _sector_cache_data = (uint8_t *)fnArena.malloc(ARENA_MEDIA, _sector_cache_sectors * DISK_SECTORBUF_SIZE);
+        if (_sector_cache_slots == nullptr || _sector_cache_data == nullptr)
+        {
+            Debug_printf("Couldn't allocate %d sector cache\r\n", _sector_cache_sectors);
+            sector_cache_free();
+            _sector_cache_sectors = 0;
+            return;
+        }
+    }
+
+    // Reuse the sector's own slot, otherwise take an empty or the least recently used one
+    int victim = 0;
+    for (int i = 0; i < _sector_cache_sectors; i++)
+    {
+        sector_cache_slot &slot = _sector_cache_slots[i];
+        if (slot.sectornum == sectornum)
+        {
+            victim = i;
+            break;
+        }
+        if (slot.last_used < _sector_cache_slots[victim].last_used)
+            victim = i;
+    }
+
+    sector_cache_slot &slot = _sector_cache_slots[victim];
+    slot.sectornum = sectornum;
+    slot.size = size;
+    slot.last_used = ++_sector_cache_clock;
+    memcpy(_sector_cache_data + victim * DISK_SECTORBUF_SIZE, _disk_sectorbuff, size);
 }
 
 mediatype_t MediaType::discover_disktype(const char *filename)
 {
+    std::string name = util_strip_gzip_ext(filename);
+    filename = name.c_str();
+
     int l = strlen(filename);
     if (l > 4 && filename[l - 4] == '.')
     {
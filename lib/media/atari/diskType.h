@@ -9,6 +9,10 @@
 
 #define DISK_SECTORBUF_SIZE 512
 
+// Sectors each drive keeps in its read cache by default; 0 turns it off
+#define DISK_SECTOR_CACHE_SECTORS 0
+#define DISK_SECTOR_CACHE_SECTORS_PSRAM 64
+
 #define DISK_BYTES_PER_SECTOR_SINGLE 128
 #define DISK_BYTES_PER_SECTOR_DOUBLE 256
 #define DISK_BYTES_PER_SECTOR_DOUBLE_DOUBLE 512
@@ -53,8 +57,36 @@ protected:
     bool _disk_readonly = true;
     uint16_t _high_score_sector = 0; /* High score sector to allow write. 1-65535 */
     uint8_t _high_score_num_sectors = 0;
-    
+
+    // Least recently used sector cache, slots are DISK_SECTORBUF_SIZE bytes
+    struct sector_cache_slot
+    {
+        uint16_t sectornum; // 0 if the slot is empty
+        uint16_t size;
+        uint32_t last_used;
+    };
+    sector_cache_slot *_sector_cache_slots = nullptr;
+    uint8_t *_sector_cache_data = nullptr;
+    int _sector_cache_sectors = -1; // -1 until set, then the default is used
+    uint32_t _sector_cache_clock = 0;
+
+    // Returns true and fills _disk_sectorbuff if the sector is in the cache
+    bool sector_cache_read(uint16_t sectornum, uint16_t size);
+    // Keeps a copy of _disk_sectorbuff as the given sector's contents
+    void sector_cache_store(uint16_t sectornum, uint16_t size);
+    void sector_cache_free();
+
 public:
+    uint32_t sector_cache_hits = 0;
+    uint32_t sector_cache_misses = 0;
+
+    // Number of sectors to cache for this drive, 0 to turn the cache off
+    void set_sector_cache_size(uint16_t sectors);
+    void sector_cache_clear();
+    // Reads sectors 1 to sectors into the cache ahead of the computer asking for them.
+    // Does nothing with the cache off
+    void sector_cache_preload(uint16_t sectors);
+
     struct
     {
         uint8_t num_tracks;
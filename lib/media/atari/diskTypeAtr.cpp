@@ -54,14 +54,14 @@ uint32_t MediaTypeATR::_sector_to_offset(uint16_t sectorNum)
 // Returns TRUE if an error condition occurred
 bool MediaTypeATR::read(uint16_t sectornum, uint16_t *readcount)
 {
-    Debug_printf("ATR READ %d / %lu\r\n", sectornum, _disk_num_sectors);
+    Debug_tracef("ATR READ %d / %lu\r\n", sectornum, _disk_num_sectors);
 
     *readcount = 0;
 
     // Return an error if we're trying to read beyond the end of the disk
     if (sectornum > _disk_num_sectors)
     {
-        Debug_printf("::read sector %d > %lu\r\n", sectornum, _disk_num_sectors);
+        Debug_tracef("::read sector %d > %lu\r\n", sectornum, _disk_num_sectors);
         return true;
     }
 
@@ -69,19 +69,26 @@ bool MediaTypeATR::read(uint16_t sectornum, uint16_t *readcount)
 
     memset(_disk_sectorbuff, 0, sizeof(_disk_sectorbuff));
 
-    bool err = false;
-    // Perform a seek if we're not reading the sector after the last one we read
-    if (sectornum != _disk_last_sector + 1)
+    // The file position doesn't move on a cache hit, so _disk_last_sector is left alone
+    if (sector_cache_read(sectornum, sectorSize))
     {
-        uint32_t offset = _sector_to_offset(sectornum);
-        err = fnio::fseek(_disk_fileh, offset, SEEK_SET) != 0;
+        *readcount = sectorSize;
+        return false;
     }
 
-    if (err == false)
+    bool err;
+    // Read from where we are if it's the sector after the last one we read,
+    // otherwise hand the offset to the backend along with the read
+    if (sectornum != _disk_last_sector + 1)
+        err = fnio::pread(_disk_fileh, _disk_sectorbuff, sectorSize, _sector_to_offset(sectornum)) != sectorSize;
+    else
         err = fnio::fread(_disk_sectorbuff, 1, sectorSize, _disk_fileh) != sectorSize;
 
     if (err == false)
+    {
         _disk_last_sector = sectornum;
+        sector_cache_store(sectornum, sectorSize);
+    }
     else
         _disk_last_sector = INVALID_SECTOR_VALUE;
 
@@ -103,12 +110,12 @@ bool MediaTypeATR::write(uint16_t sectornum, bool verify)
     oldFileh = nullptr;
     hsFileh = nullptr;
 
-    Debug_printf("ATR WRITE %d / %lu\r\n", sectornum, _disk_num_sectors);
+    Debug_tracef("ATR WRITE %d / %lu\r\n", sectornum, _disk_num_sectors);
 
     // Return an error if we're trying to write beyond the end of the disk
     if (sectornum > _disk_num_sectors)
     {
-        Debug_printf("::write sector %d > %lu\r\n", sectornum, _disk_num_sectors);
+        Debug_tracef("::write sector %d > %lu\r\n", sectornum, _disk_num_sectors);
         return true;
     }
 
@@ -147,11 +154,20 @@ bool MediaTypeATR::write(uint16_t sectornum, bool verify)
     if (e != sectorSize)
     {
         Debug_printf("::write error %d, %d\r\n", e, errno);
+        // We don't know what made it to the image
+        sector_cache_clear();
         return true;
     }
+    // Write-through: the cache now holds what was written
+    sector_cache_store(sectornum, sectorSize);
 
-    int ret = fnio::fflush(_disk_fileh); // Since we might get reset at any moment, go ahead and sync the file
-    Debug_printf("ATR::write fflush:%d\r\n", ret);
+    // Since we might get reset at any moment, go ahead and sync the file. Network hosts hold
+    // plain PUTs back (write-behind/writeback); a write with verify still goes out immediately
+    if (verify || _disk_host == nullptr || _disk_host->get_type() == HOSTTYPE_LOCAL)
+    {
+        int ret = fnio::fflush(_disk_fileh);
+        Debug_printf("ATR::write fflush:%d\r\n", ret);
+    }
 
     if (_high_score_sector != 0)
     {
@@ -281,6 +297,15 @@ mediatype_t MediaTypeATR::mount(fnFile *f, uint32_t disksize)
     return _disktype;
 }
 
+uint32_t MediaTypeATR::create_size(uint16_t sectorSize, uint16_t numSectors)
+{
+    uint32_t total_size = numSectors * sectorSize;
+    // The first 3 sectors of a double density disk are single density
+    if (sectorSize == 256)
+        total_size -= 384;
+    return total_size + 16; // ATR header
+}
+
 // Returns FALSE on error
 bool MediaTypeATR::create(fnFile *f, uint16_t sectorSize, uint16_t numSectors)
 {
@@ -19,6 +19,8 @@ public:
     virtual void status(uint8_t statusbuff[4]) override;
 
     static bool create(fnFile *f, uint16_t sectorSize, uint16_t numSectors);
+    // Size of the file create() makes, header included
+    static uint32_t create_size(uint16_t sectorSize, uint16_t numSectors);
 };
 
 
@@ -4,8 +4,13 @@
 
 #include <memory.h>
 #include <string.h>
+#include <stdlib.h>
+#include <algorithm>
 #ifdef ESP_PLATFORM
+  #include <esp_heap_caps.h>
   #include <esp_timer.h>
+  #include <freertos/FreeRTOS.h>
+  #include <freertos/task.h>
   #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
   #include <esp_random.h>
   #endif
@@ -37,16 +42,6 @@
   0.20833... / 26042 = 0.0000079998976013... = 8 microseconds per angular position
 
 */
-/*
- Frequency with which to update the angular position counter.
- Counter is updated every 
- US_ANGULAR_UNIT_TIME * ANGULAR_POSITION_UPDATE_FREQ microseconds.
- ANGULAR_POSITION_UPDATE_FREQ must be at least '8' (updates every
- 8*8 = 64 microseconds) because the ESP timer fucntion won't allow
- frequencies lower than every 50 microseconds.
- "29" evenly divides 26042
-*/
-#define ANGULAR_POSITION_UPDATE_FREQ 29
 #define ANGULAR_POSITION_INVALID 65535
 
 // Most of the following timing constants come from S-Drive Max sources atx.c
@@ -56,6 +51,11 @@
 #define ANGULAR_UNIT_TOTAL 26042
 // Number of microseconds for each angular unit
 #define US_ANGULAR_UNIT_TIME 8
+// Number of microseconds for a full disk rotation
+#define US_ROTATION_TIME (ANGULAR_UNIT_TOTAL * US_ANGULAR_UNIT_TIME)
+// Waits longer than this give the CPU back to other tasks for all but the
+// last scheduler tick, which is spun so the wait still ends to the microsecond
+#define US_WAIT_YIELD_MIN (2 * 1000 * portTICK_PERIOD_MS)
 // Number of microseconds drive takes to process a request
 #define US_DRIVE_REQUEST_DELAY_810 3220
 #define US_DRIVE_REQUEST_DELAY_1050 3220
@@ -74,10 +74,6 @@
 
 AtxTrack::~AtxTrack()
 {
-    if (data != nullptr)
-        delete[] data;
-
-    data = nullptr;
 };
 
 AtxTrack::AtxTrack(){
@@ -98,14 +94,16 @@ AtxSector::AtxSector(sector_header_t &header)
 
 MediaTypeATX::~MediaTypeATX()
 {
-#ifdef ESP_PLATFORM
-    // Destory any timer we may have
-    if (_atx_timer != nullptr)
-    {
-        esp_timer_stop(_atx_timer);
-        esp_timer_delete(_atx_timer);
-    }
-#endif
+    _free_atx_data();
+}
+
+void MediaTypeATX::_free_atx_data()
+{
+    free(_atx_arena);
+    _atx_arena = nullptr;
+    _atx_arena_size = 0;
+    _atx_arena_used = 0;
+    _sectors.clear();
 }
 
 // Constructor initializes the AtxTrack vector to assume we have 40 tracks
@@ -119,23 +117,18 @@ MediaTypeATX::MediaTypeATX()
     // Disallow HSIO
     _allow_hsio = false;
 
-#ifdef ESP_PLATFORM
-    // Create a timer to track our fake disk rotating
-    esp_timer_create_args_t tcfg;
-    tcfg.arg = this;
-    tcfg.callback = on_timer;
-    tcfg.dispatch_method = esp_timer_dispatch_t::ESP_TIMER_TASK;
-    tcfg.name = nullptr;
-    esp_timer_create(&tcfg, &_atx_timer);
-    ESP_ERROR_CHECK(esp_timer_start_periodic(_atx_timer,
-        US_ANGULAR_UNIT_TIME * ANGULAR_POSITION_UPDATE_FREQ));
-#else
+#ifndef ESP_PLATFORM
     srand((unsigned)time(0));
-    __atx_position_time = fnSystem.micros();
 #endif
+    // The fake disk starts spinning now, at angular position 0
+    __atx_position_time = _get_time();
 }
 
 /*
+    The head position is worked out from the microsecond clock whenever it's
+    needed, rather than counted up by a periodic timer, so it's as exact as
+    the clock and costs nothing while no ATX is being read.
+
     Some notes on esp_timer_get_time() from:
     https://github.com/espressif/arduino-esp32/pull/1424
     * returns monotonic time in microseconds
@@ -144,85 +137,43 @@ MediaTypeATX::MediaTypeATX()
     * is thread safe
     * takes less than 1 microsecond to execute
 */
-#ifdef ESP_PLATFORM
-void MediaTypeATX::on_timer(void *info)
+uint64_t MediaTypeATX::_get_time()
 {
-    MediaTypeATX *pAtx = (MediaTypeATX *)info;
-
-    portENTER_CRITICAL(&pAtx->__atx_timerMux);
-
-    pAtx->__atx_position_time = esp_timer_get_time();
-    pAtx->__atx_current_angular_pos += ANGULAR_POSITION_UPDATE_FREQ;
-
-    if (pAtx->__atx_current_angular_pos >= ANGULAR_UNIT_TOTAL)
-    {
-        pAtx->__atx_current_angular_pos -= ANGULAR_UNIT_TOTAL;
-        pAtx->_atx_total_rotations++;
-    }
-
-    portEXIT_CRITICAL(&pAtx->__atx_timerMux);
-}
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    return fnSystem.micros();
 #endif
+}
 
-#ifdef ESP_PLATFORM
 uint16_t MediaTypeATX::_get_head_position()
 {
-    uint64_t us_now = esp_timer_get_time();
-
-    portENTER_CRITICAL(&__atx_timerMux);
-    uint64_t us_then = __atx_position_time;
-    uint16_t pos = __atx_current_angular_pos;
-    portEXIT_CRITICAL(&__atx_timerMux);
-
-    /*
-     Adjust the recorded angular position by the number of microseconds passed since
-     it was recorded.
-    */
-    uint64_t us_diff;
-
-    // Handle the rare case of a timer roll-over
-    if (us_now > us_then)
-    {
-        us_diff = us_now - us_then;
-    }
-    else
-    {
-        us_diff = UINT64_MAX - us_now + us_then;
-    }
+    uint64_t us_diff = _get_time() - __atx_position_time;
+    _atx_total_rotations = us_diff / US_ROTATION_TIME;
+    return (us_diff % US_ROTATION_TIME) / US_ANGULAR_UNIT_TIME;
+}
 
-    pos += us_diff / US_ANGULAR_UNIT_TIME;
-    if (pos >= ANGULAR_UNIT_TOTAL)
-        pos -= ANGULAR_UNIT_TOTAL;
+void MediaTypeATX::_wait_until(uint64_t us_then)
+{
+#ifdef ESP_PLATFORM
+    // Sleep through most of a long wait, the scheduler's tick is too coarse
+    // to end it on time so the rest is spun
+    int64_t us_left = us_then - esp_timer_get_time();
+    if (us_left > US_WAIT_YIELD_MIN)
+        vTaskDelay((us_left - 1000 * portTICK_PERIOD_MS) / (1000 * portTICK_PERIOD_MS));
 
-    return pos;
-}
+    while ((int64_t)(us_then - esp_timer_get_time()) > 0)
+        NOP();
 #else
-uint16_t MediaTypeATX::_get_head_position()
-{
     uint64_t us_now = fnSystem.micros();
-    uint64_t us_diff = us_now - __atx_position_time;
-    uint64_t unit = us_diff / US_ANGULAR_UNIT_TIME;
-    uint16_t pos = unit % ANGULAR_UNIT_TOTAL;
-    _atx_total_rotations = unit / ANGULAR_UNIT_TOTAL;
-    return pos;
-}
+    if (us_then > us_now)
+        fnSystem.delay_microseconds(us_then - us_now);
 #endif
+}
 
 void MediaTypeATX::_wait_full_rotation()
 {
-    uint32_t pos = _get_head_position();
-
-    // Wait for a roll-over to occur
-    do
-    {
-        NOP();
-    } while (pos <= _get_head_position());
-
-    // Wait for the head to be over the previous position
-    do
-    {
-        NOP();
-    } while (pos > _get_head_position());
+    _wait_until(_get_time() + US_ROTATION_TIME);
 }
 
 void MediaTypeATX::_wait_head_position(uint16_t pos, uint16_t extra_delay)
@@ -231,17 +182,17 @@ void MediaTypeATX::_wait_head_position(uint16_t pos, uint16_t extra_delay)
     if (pos >= ANGULAR_UNIT_TOTAL)
         pos -= ANGULAR_UNIT_TOTAL;
 
-    uint16_t current = _get_head_position();
+    // Time until the head is over pos, going round if it's just gone by
+    uint64_t us_now = _get_time();
+    uint32_t us_into_rotation = (us_now - __atx_position_time) % US_ROTATION_TIME;
+    uint32_t us_wait = (pos * US_ANGULAR_UNIT_TIME + US_ROTATION_TIME - us_into_rotation) % US_ROTATION_TIME;
 
-    if (current == pos)
-    {
+    // Close enough either side and there's no wait
+    if (us_wait <= HEAD_TOLERANCE * US_ANGULAR_UNIT_TIME ||
+        us_wait >= US_ROTATION_TIME - HEAD_TOLERANCE * US_ANGULAR_UNIT_TIME)
         return;
-    }
 
-    while (abs(_get_head_position() - pos) > HEAD_TOLERANCE)
-    {
-        NOP();
-    }
+    _wait_until(us_now + us_wait);
 }
 
 void MediaTypeATX::_process_sector(AtxTrack &track, AtxSector *psector, uint16_t sectorsize)
@@ -333,33 +284,21 @@ bool MediaTypeATX::_copy_track_sector_data(uint8_t tracknum, uint8_t sectornum,
     {
         retries--;
 
-        // Iterate through every sector stored for this track and find the one closest to the current drive head position
+        // Of the sectors stored for this track with this number, in order of angular position, take the
+        // first one at or ahead of the current drive head position, or the first one after the roll-over
         uint16_t current_pos = _get_head_position();
         AtxSector *pSector = nullptr;
-        for (auto &it : track.sectors)
+        if (sectornum <= ATX_SECTORS_PER_TRACK_ENHANCED)
         {
-            if (it.number == sectornum)
+            for (int i = track.by_number[sectornum]; i < track.by_number[sectornum + 1]; i++)
             {
+                AtxSector *it = &_sectors[track.first_sector + i];
                 if (pSector == nullptr)
+                    pSector = it;
+                if (it->position >= current_pos)
                 {
-                    pSector = &it;
-                }
-                else
-                // Compare the distance from the head to this sector and the head to the previous matching sector
-                {
-                    int diff_this = it.position - current_pos;
-                    int diff_last = pSector->position - current_pos;
-
-                    // Conditions under which to replace the last matching sector:
-                    if (
-                        (diff_this == 0) ||                                          // We're currently over the right sector
-                        (diff_this > 0 && diff_last < 0) ||                          // This sector is ahead of the current pos and the last was behind
-                        (diff_this > 0 && diff_last > 0 && diff_this < diff_last) || // Both are ahead but this one is closer
-                        (diff_this < 0 && diff_last < 0 && diff_this < diff_last)    // Both are behind but this one is closer
-                    )
-                    {
-                        pSector = &it;
-                    }
+                    pSector = it;
+                    break;
                 }
             }
         }
@@ -383,7 +322,7 @@ bool MediaTypeATX::_copy_track_sector_data(uint8_t tracknum, uint8_t sectornum,
     }
 
     // Delay for the CRC calculation
-    fnSystem.delay_microseconds(_atx_drive_model == ATX_DRIVE_MODEL_810 ? US_CRC_CALCULATION_810 : US_CRC_CALCULATION_1050);
+    _wait_until(_get_time() + (_atx_drive_model == ATX_DRIVE_MODEL_810 ? US_CRC_CALCULATION_810 : US_CRC_CALCULATION_1050));
 
     // Return error condition if our controller status isn't clear
     return _disk_controller_status != DISK_CTRL_STATUS_CLEAR;
@@ -392,12 +331,8 @@ bool MediaTypeATX::_copy_track_sector_data(uint8_t tracknum, uint8_t sectornum,
 // Returns TRUE if an error condition occurred
 bool MediaTypeATX::read(uint16_t sectornum, uint16_t *readcount)
 {
-#ifdef ESP_PLATFORM
-    Debug_printf("ATX READ (%d) rots=%lu\r\n", sectornum, _atx_total_rotations);
-#else
     unsigned int pos = _get_head_position();
     Debug_printf("ATX READ (%d) rots=%lu pos=%u\r\n", sectornum, _atx_total_rotations, pos);
-#endif
 
     *readcount = 0;
 
@@ -419,12 +354,12 @@ bool MediaTypeATX::read(uint16_t sectornum, uint16_t *readcount)
     if (trackdiff > 0)
     {
         uint32_t us_delay = _atx_drive_model == ATX_DRIVE_MODEL_810 ? US_TRACK_STEP_810 * trackdiff + US_HEAD_SETTLE_810 : US_TRACK_STEP_1050 * trackdiff + US_HEAD_SETTLE_1050;
-        fnSystem.delay_microseconds(us_delay);
+        _wait_until(_get_time() + us_delay);
     }
 
     // Add a fake drive CPU request handling delay
-    fnSystem.delay_microseconds(
-        _atx_drive_model == ATX_DRIVE_MODEL_810 ? US_DRIVE_REQUEST_DELAY_810 : US_DRIVE_REQUEST_DELAY_1050);
+    _wait_until(_get_time() +
+        (_atx_drive_model == ATX_DRIVE_MODEL_810 ? US_DRIVE_REQUEST_DELAY_810 : US_DRIVE_REQUEST_DELAY_1050));
 
     *readcount = sectorSize;
 
@@ -462,12 +397,12 @@ bool MediaTypeATX::_load_atx_chunk_weak_sector(chunk_header_t &chunk_hdr, AtxTra
                  chunk_hdr.sector_index, chunk_hdr.header_data);
     #endif
 
-    if (chunk_hdr.sector_index >= track.sector_count)
+    if (chunk_hdr.sector_index >= _sectors.size() - track.first_sector)
     {
         Debug_println("ERROR: _load_atx_chunk_weak_sector sector index > sector_count");
         return false;
     }
-    track.sectors[chunk_hdr.sector_index].weakoffset = chunk_hdr.header_data;
+    _sectors[track.first_sector + chunk_hdr.sector_index].weakoffset = chunk_hdr.header_data;
     return true;
 }
 
@@ -478,7 +413,7 @@ bool MediaTypeATX::_load_atx_chunk_extended_sector(chunk_header_t &chunk_hdr, At
                  chunk_hdr.sector_index, chunk_hdr.header_data);
     #endif
 
-    if (chunk_hdr.sector_index >= track.sector_count)
+    if (chunk_hdr.sector_index >= _sectors.size() - track.first_sector)
     {
         Debug_println("ERROR: _load_atx_chunk_extended_sector sector index > sector_count");
         return false;
@@ -503,7 +438,7 @@ bool MediaTypeATX::_load_atx_chunk_extended_sector(chunk_header_t &chunk_hdr, At
         Debug_println("WARNING: Invalid extended sector value");
         return false;
     }
-    track.sectors[chunk_hdr.sector_index].extendedsize = xsize;
+    _sectors[track.first_sector + chunk_hdr.sector_index].extendedsize = xsize;
     return true;
 }
 
@@ -513,32 +448,32 @@ bool MediaTypeATX::_load_atx_chunk_sector_data(chunk_header_t &chunk_hdr, AtxTra
     Debug_print("::_load_atx_chunk_sector_data\r\n");
     #endif
 
-    // Just in case we already read data for this track
-    if (track.data != nullptr)
-        delete[] track.data;
-
     // We take the number of bytes to read from the chunk length header value
     int data_size = chunk_hdr.length - sizeof(chunk_hdr);
 
     // Skip if there's nothing to do
     if (data_size == 0)
         return true;
-    
+
+    // The data chunk is part of the records the arena was sized for, so it
+    // can only not fit if the image is bad
+    if (data_size < 0 || (uint32_t)data_size > _atx_arena_size - _atx_arena_used)
+    {
+        Debug_printf("sector data chunk of %d bytes is bigger than the ATX records\r\n", data_size);
+        return false;
+    }
+
     // Attempt to the sector data
-#ifdef ESP_PLATFORM
-    track.data = (uint8_t *)heap_caps_malloc(data_size * sizeof(uint8_t), MALLOC_CAP_DEFAULT);
-#else
-    track.data = new uint8_t[data_size];
-#endif
+    track.data = _atx_arena + _atx_arena_used;
 
     int i;
     if ((i = fnio::fread(track.data, 1, data_size, _disk_fileh)) != data_size)
     {
         Debug_printf("failed reading %d sector data chunk bytes (%d, %d)\r\n", data_size, i, errno);
-        delete[] track.data;
         track.data = nullptr;
         return false;
     }
+    _atx_arena_used += data_size;
 
     /*
     The start_data value in each sector header is an offset into the overall Track Record,
@@ -574,18 +509,19 @@ bool MediaTypeATX::_load_atx_chunk_sector_list(chunk_header_t &chunk_hdr, AtxTra
         Debug_printf("WARNING: Chunk length %lu != expected\r\n", chunk_hdr.length);
     }
 
-    // Attempt to read sector_header * sector_count
-#ifdef ESP_PLATFORM
-    sector_header_t *sector_list = (sector_header_t *)heap_caps_malloc(track.sector_count * sizeof(sector_header_t), MALLOC_CAP_DEFAULT);
-#else
-    sector_header_t *sector_list = new sector_header_t[track.sector_count];
-#endif
+    // Attempt to read sector_header * sector_count, into the free end of the
+    // arena as it's part of the records too and only needed until they're copied
+    if ((uint32_t)readz > _atx_arena_size - _atx_arena_used)
+    {
+        Debug_printf("sector list of %d bytes is bigger than the ATX records\r\n", readz);
+        return false;
+    }
+    sector_header_t *sector_list = (sector_header_t *)(_atx_arena + _atx_arena_used);
     int i;
 
     if ((i = fnio::fread(sector_list, 1, readz, _disk_fileh)) != readz)
     {
         Debug_printf("failed reading sector list chunk bytes (%d, %d)\r\n", i, errno);
-        delete[] sector_list;
         return false;
     }
 
@@ -593,19 +529,19 @@ bool MediaTypeATX::_load_atx_chunk_sector_list(chunk_header_t &chunk_hdr, AtxTra
     track.record_bytes_read += readz;
 
     // Stuff the data into our sector objects
-    track.sectors.reserve(track.sector_count);
+    _sectors.erase(_sectors.begin() + track.first_sector, _sectors.end());
     for (i = 0; i < track.sector_count; i++)
     {
-        if (sector_list[i].position >= ANGULAR_UNIT_TOTAL)
+        sector_header_t hdr;
+        memcpy(&hdr, &sector_list[i], sizeof(hdr));
+        if (hdr.position >= ANGULAR_UNIT_TOTAL)
         {
-            Debug_printf("WARNING: sector position = %hu\r\n", sector_list[i].position);
-            sector_list[i].position = 0;
+            Debug_printf("WARNING: sector position = %hu\r\n", hdr.position);
+            hdr.position = 0;
         }
-        track.sectors.emplace_back(sector_list[i]);
+        _sectors.emplace_back(hdr);
     }
 
-    delete[] sector_list;
-
     return true;
 }
 
@@ -762,16 +698,40 @@ bool MediaTypeATX::_load_atx_track_record(uint32_t length)
         track.record_bytes_read += chunk_start_offset;
     }
 
-    // Reserve space for the sectors we're eventually going to read for this track
-    track.sectors.reserve(track.sector_count);
+    // This track's sectors follow the last track's in the sector table
+    track.first_sector = _sectors.size();
 
     // Read the chunks in the track
     while ((i = _load_atx_track_chunk(trk_hdr, track)) == 0)
         ;
 
+    // The weak and extended chunks refer to the sectors in file order, so
+    // they can only be rearranged now
+    if (i == 1)
+        _index_track_sectors(track);
+
     return i == 1; // Return FALSE on error condition
 }
 
+void MediaTypeATX::_index_track_sectors(AtxTrack &track)
+{
+    // Without a sector list there are no sectors, whatever the header said
+    track.sector_count = _sectors.size() - track.first_sector;
+
+    auto first = _sectors.begin() + track.first_sector;
+    std::sort(first, _sectors.end(), [](const AtxSector &a, const AtxSector &b) {
+        return a.number != b.number ? a.number < b.number : a.position < b.position;
+    });
+
+    int i = 0;
+    for (int n = 0; n < ATX_SECTORS_PER_TRACK_ENHANCED + 2; n++)
+    {
+        while (i < track.sector_count && first[i].number < n)
+            i++;
+        track.by_number[n] = i;
+    }
+}
+
 /*
   Each record consists of an 8 byte header followed by the actual data
   Since there's only one type of record we care about (RECORD), all we need is the length
@@ -825,6 +785,22 @@ bool MediaTypeATX::_load_atx_data(atx_header_t &atx_hdr)
 {
     Debug_println("MediaTypeATX::_load_atx_data starting read");
 
+    // All the track data lives inside the records, so one allocation that
+    // size holds it. Most images have 18 or 26 sectors on each of 40 tracks
+    _free_atx_data();
+    _atx_arena_size = atx_hdr.end > atx_hdr.start ? atx_hdr.end - atx_hdr.start : 0;
+#ifdef ESP_PLATFORM
+    _atx_arena = (uint8_t *)heap_caps_malloc(_atx_arena_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (_atx_arena == nullptr)
+#endif
+    _atx_arena = (uint8_t *)malloc(_atx_arena_size);
+    if (_atx_arena == nullptr)
+    {
+        Debug_printf("failed allocating %lu bytes for ATX data\r\n", (unsigned long)_atx_arena_size);
+        return false;
+    }
+    _sectors.reserve(ATX_DEFAULT_NUMTRACKS * _atx_sectors_per_track);
+
     // Seek to the start of the ATX record data
     int i;
     if ((i = fnio::fseek(_disk_fileh, atx_hdr.start, SEEK_SET)) < 0)
@@ -913,6 +889,7 @@ mediatype_t MediaTypeATX::mount(fnFile *f, uint32_t disksize)
     {
         _disk_fileh = nullptr;
         _tracks.clear();
+        _free_atx_data();
         return MEDIATYPE_UNKNOWN;
     }
 
@@ -153,15 +153,14 @@ public:
     uint32_t record_bytes_read = 0;
     uint32_t offset_to_data_start = 0;
 
-    // Actual sector data
+    // Actual sector data, in the image's arena
     uint8_t * data = nullptr;
 
-    // Actual sectors
-#ifdef ESP_PLATFORM
-    std::vector<AtxSector,PSRAMAllocator<AtxSector>> sectors;
-#else
-    std::vector<AtxSector> sectors;
-#endif
+    // Actual sectors, sector_count of them in the image's sector table
+    // from here on. Once the track is loaded they're sorted by number, then
+    // by angular position, and by_number gives where each number's run starts
+    uint16_t first_sector = 0;
+    uint16_t by_number[ATX_SECTORS_PER_TRACK_ENHANCED + 2];
 
     ~AtxTrack();
     AtxTrack();
@@ -181,24 +180,24 @@ private:
 
     uint8_t _atx_drive_model = ATX_DRIVE_MODEL_810;
 
-#ifdef ESP_PLATFORM
-    portMUX_TYPE __atx_timerMux = portMUX_INITIALIZER_UNLOCKED;
-#endif
-
+    // When the fake disk was at angular position 0, in microseconds
     uint64_t __atx_position_time;
-    uint16_t __atx_current_angular_pos = 0;
     uint32_t _atx_total_rotations = 0;
 
-#ifdef ESP_PLATFORM
-    esp_timer_handle_t _atx_timer = nullptr;
-#endif
-
 #ifdef ESP_PLATFORM
     std::vector<AtxTrack,PSRAMAllocator<AtxTrack>> _tracks;
+    std::vector<AtxSector,PSRAMAllocator<AtxSector>> _sectors;
 #else
     std::vector<AtxTrack> _tracks;
+    std::vector<AtxSector> _sectors;
 #endif
 
+    // Every track's sector data, one allocation the size of the image's
+    // records handed out in order as the tracks are read
+    uint8_t *_atx_arena = nullptr;
+    uint32_t _atx_arena_size = 0;
+    uint32_t _atx_arena_used = 0;
+
     // ATX header.density
     uint8_t _atx_density = ATX_DENSITY_SINGLE;
     // ATX header.end - normally the size of the entire ATX file
@@ -214,11 +213,16 @@ private:
     bool _load_atx_chunk_weak_sector(chunk_header_t &chunk_hdr, AtxTrack &track);
     bool _load_atx_chunk_extended_sector(chunk_header_t &chunk_hdr, AtxTrack &track);
     bool _load_atx_chunk_unknown(chunk_header_t &chunk_hdr, AtxTrack &track);
+    void _index_track_sectors(AtxTrack &track);
+    void _free_atx_data();
 
     bool _copy_track_sector_data(uint8_t tracknum, uint8_t sectornum, uint16_t sectorsize);
     void _process_sector(AtxTrack &track, AtxSector *sectorp, uint16_t sectorsize);
 
+    static uint64_t _get_time();
     uint16_t _get_head_position();
+    // Returns once the clock reaches us_then, letting other tasks run meanwhile
+    void _wait_until(uint64_t us_then);
     void _wait_full_rotation();
     void _wait_head_position(uint16_t pos, uint16_t extra_delay);
 
@@ -230,8 +234,6 @@ public:
 
     virtual void status(uint8_t statusbuff[4]) override;
 
-    static void on_timer(void *info);
-
     MediaTypeATX();
     ~MediaTypeATX();
 };
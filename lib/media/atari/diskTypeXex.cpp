@@ -9,6 +9,7 @@
 #include "../../include/debug.h"
 
 #include "fnSystem.h"
+#include "fnArena.h"
 
 #include "utils.h"
 
@@ -31,6 +32,10 @@
 
 #define SECTOR_LINK_SIZE 3
 
+// More than this many load segments and the rest of the file is taken as
+// not being one
+#define MAX_XEX_SEGMENTS 256
+
 /*
     The bootloader expects to find a file named "AUTORUN", so fake a directory
     with only that file.
@@ -52,9 +57,7 @@
 
 void MediaTypeXEX::_fake_vtoc()
 {
-    uint16_t data_per_sector = _disk_sector_size - SECTOR_LINK_SIZE;
-    uint16_t numsectors = _disk_image_size / data_per_sector;
-    numsectors += _disk_image_size % data_per_sector > 0 ? 1 : 0;
+    uint16_t numsectors = _xex_sectors.size();
 
     uint16_t freesectors = 0x2D0 - numsectors;
 
@@ -87,10 +90,8 @@ void MediaTypeXEX::_fake_vtoc()
 
 void MediaTypeXEX::_fake_directory_entry()
 {
-    // Calculate the number of sectors required for XEX file
-    uint16_t data_per_sector = _disk_sector_size - SECTOR_LINK_SIZE;
-    uint16_t numsectors = _disk_image_size / data_per_sector;
-    numsectors += _disk_image_size % data_per_sector > 0 ? 1 : 0;
+    // The number of sectors required for XEX file
+    uint16_t numsectors = _xex_sectors.size();
 
     Debug_printf("num XEX sectors = %d\r\n", numsectors);
 
@@ -168,49 +169,147 @@ bool MediaTypeXEX::read(uint16_t sectornum, uint16_t *readcount)
         return false;
     }
 
-    int data_bytes = _disk_sector_size - SECTOR_LINK_SIZE;
-    // This is the number of bytes into the XEX file we should be reading
-    int xex_offset = data_bytes * (sectornum - FIRST_XEX_SECTOR);
+    // Nothing between the bootloader and the VTOC
+    if (sectornum < FIRST_XEX_SECTOR)
+    {
+        _disk_last_sector = INVALID_SECTOR_VALUE;
+        return true;
+    }
 
-    // Perform a seek if we're not reading the sector after the last one we read
-    if (sectornum != _disk_last_sector + 1)
+    // Past the end of the file, an empty sector as reading it would give
+    if ((size_t)(sectornum - FIRST_XEX_SECTOR) >= _xex_sectors.size())
     {
-        Debug_printf("seeking to offset %d in XEX\r\n", xex_offset);
-        err = fnio::fseek(_disk_fileh, xex_offset, SEEK_SET) != 0;
+        _disk_last_sector = INVALID_SECTOR_VALUE;
+        return false;
     }
 
-    if (err == false)
+    const xex_sector &xs = _xex_sectors[sectornum - FIRST_XEX_SECTOR];
+
+    if (_xex_image != nullptr)
+    {
+        memcpy(_disk_sectorbuff, _xex_image + xs.offset, xs.count);
+    }
+    else
     {
-        Debug_printf("requesting %d bytes from XEX\r\n", data_bytes);
-        int read = fnio::fread(_disk_sectorbuff, 1, data_bytes, _disk_fileh);
-        Debug_printf("received %d bytes\r\n", read);
+        // Sectors built from the file itself can come from the cache
+        if (sector_cache_read(sectornum, _disk_sector_size))
+            return false;
 
-        // Fill in the sector link data pointing to the next sector
-        if(read >= 0)
+        // Perform a seek if we're not reading the sector after the last one we read
+        if (sectornum != _disk_last_sector + 1)
         {
-            // Provide number of bytes read
-            _disk_sectorbuff[_disk_sector_size - 1] = read;
-
-            // Only provide a next sector pointer if we read a full sector of data
-            if(read == data_bytes)
-            {
-                uint16_t next_sector = sectornum + 1;
-                _disk_sectorbuff[_disk_sector_size - 2] = LOBYTE_FROM_UINT16(next_sector);
-                _disk_sectorbuff[_disk_sector_size - 3] = HIBYTE_FROM_UINT16(next_sector);
-            }
+            Debug_printf("seeking to offset %lu in XEX\r\n", (unsigned long)xs.offset);
+            err = fnio::fseek(_disk_fileh, xs.offset, SEEK_SET) != 0;
         }
-        else
+
+        if (err == false && fnio::fread(_disk_sectorbuff, 1, xs.count, _disk_fileh) != xs.count)
             err = true;
+
+        if (err == true)
+        {
+            _disk_last_sector = INVALID_SECTOR_VALUE;
+            return err;
+        }
     }
 
-    if (err == false)
-        _disk_last_sector = sectornum;
-    else
-        _disk_last_sector = INVALID_SECTOR_VALUE;
+    // Fill in the sector link data: the number of bytes, and a pointer to
+    // the next sector only if this one is a full sector of data
+    _disk_sectorbuff[_disk_sector_size - 1] = xs.count;
+    if (xs.count == _disk_sector_size - SECTOR_LINK_SIZE)
+    {
+        uint16_t next_sector = sectornum + 1;
+        _disk_sectorbuff[_disk_sector_size - 2] = LOBYTE_FROM_UINT16(next_sector);
+        _disk_sectorbuff[_disk_sector_size - 3] = HIBYTE_FROM_UINT16(next_sector);
+    }
+
+    _disk_last_sector = sectornum;
+    if (_xex_image == nullptr)
+        sector_cache_store(sectornum, _disk_sector_size);
 
     return err;
 }
 
+void MediaTypeXEX::_build_sector_map()
+{
+    uint16_t data_per_sector = _disk_sector_size - SECTOR_LINK_SIZE;
+
+    // Sector numbers are 16 bits, anything past the last one can't be reached
+    uint32_t numsectors = _disk_image_size / data_per_sector;
+    numsectors += _disk_image_size % data_per_sector > 0 ? 1 : 0;
+    if (numsectors > 0xFFFF - FIRST_XEX_SECTOR)
+        numsectors = 0xFFFF - FIRST_XEX_SECTOR;
+
+    _xex_sectors.clear();
+    _xex_sectors.reserve(numsectors);
+    for (uint32_t i = 0; i < numsectors; i++)
+    {
+        uint32_t offset = i * data_per_sector;
+        uint32_t remain = _disk_image_size - offset;
+        _xex_sectors.push_back({offset, (uint16_t)(remain > data_per_sector ? data_per_sector : remain)});
+    }
+}
+
+void MediaTypeXEX::_load_image()
+{
+    // Only worth the memory when there's PSRAM to spare
+#ifdef ESP_PLATFORM
+    if (fnSystem.get_psram_size() == 0)
+        return;
+#endif
+    if (_disk_image_size == 0 || _disk_image_size > XEX_RAM_IMAGE_MAX)
+        return;
+    _xex_image = (uint8_t *)fnArena.malloc(ARENA_MEDIA, _disk_image_size);
+    if (_xex_image == nullptr)
+        return;
+
+    if (fnio::fseek(_disk_fileh, 0, SEEK_SET) != 0 ||
+        fnio::fread(_xex_image, 1, _disk_image_size, _disk_fileh) != _disk_image_size)
+    {
+        Debug_printf("couldn't read XEX into memory, reading sectors from the file\r\n");
+        fnArena.free(ARENA_MEDIA, _xex_image);
+        _xex_image = nullptr;
+    }
+}
+
+void MediaTypeXEX::_scan_segments()
+{
+    _xex_segments.clear();
+
+    uint32_t pos = 0;
+    uint8_t hdr[4];
+    while (pos + 4 <= _disk_image_size && _xex_segments.size() < MAX_XEX_SEGMENTS)
+    {
+        if (_xex_image != nullptr)
+            memcpy(hdr, _xex_image + pos, 4);
+        else if (fnio::fseek(_disk_fileh, pos, SEEK_SET) != 0 || fnio::fread(hdr, 1, 4, _disk_fileh) != 4)
+            break;
+
+        // Any segment can start with the $FFFF marker, the first one must
+        if (hdr[0] == 0xFF && hdr[1] == 0xFF)
+        {
+            pos += 2;
+            continue;
+        }
+        if (_xex_segments.empty() && pos != 2)
+            break;
+
+        xex_segment seg = {static_cast<uint16_t>(UINT16_FROM_HILOBYTES(hdr[1], hdr[0])),
+                           static_cast<uint16_t>(UINT16_FROM_HILOBYTES(hdr[3], hdr[2])), pos + 4};
+        if (seg.end < seg.start)
+            break;
+        _xex_segments.push_back(seg);
+        pos = seg.offset + seg.end - seg.start + 1;
+    }
+
+    for (const xex_segment &seg : _xex_segments)
+        Debug_printf("XEX segment $%04X-$%04X at %lu\r\n", seg.start, seg.end, (unsigned long)seg.offset);
+    if (pos != _disk_image_size)
+        Debug_printf("XEX segments end at %lu of %lu bytes\r\n", (unsigned long)pos, (unsigned long)_disk_image_size);
+
+    // Back to where the first sector read expects the file to be
+    _disk_last_sector = INVALID_SECTOR_VALUE;
+}
+
 void MediaTypeXEX::status(uint8_t statusbuff[4])
 {
     statusbuff[0] |= DISK_DRIVE_STATUS_DOUBLE_DENSITY;
@@ -218,6 +317,11 @@ void MediaTypeXEX::status(uint8_t statusbuff[4])
 
 void MediaTypeXEX::unmount()
 {
+    fnArena.free(ARENA_MEDIA, _xex_image);
+    _xex_image = nullptr;
+    _xex_sectors.clear();
+    _xex_segments.clear();
+
     // Call the parent unmount
     this->MediaType::unmount();
 }
@@ -247,16 +351,19 @@ mediatype_t MediaTypeXEX::mount(fnFile *f, uint32_t disksize)
     _disk_last_sector = INVALID_SECTOR_VALUE;
     _disktype = MEDIATYPE_XEX;
 
-    // Calculate the number of fake disk sectors
-    uint16_t data_per_sector = _disk_sector_size - SECTOR_LINK_SIZE;
-    _disk_num_sectors = FIRST_XEX_SECTOR + _disk_image_size / data_per_sector;
-    _disk_num_sectors += _disk_image_size % data_per_sector > 0 ? 1 : 0;
+    // Lay out the fake disk sectors once, rather than on every read, and
+    // keep the whole file in memory if it fits so reads don't seek
+    _build_sector_map();
+    _load_image();
+    _scan_segments();
+
+    _disk_num_sectors = FIRST_XEX_SECTOR + _xex_sectors.size();
 
     if (_disk_num_sectors < 720)
         _disk_num_sectors = 720;
 
     Debug_printf("mounted XEX with %d-byte bootloader; XEX size=%lu\r\n", _xex_bootloadersize, _disk_image_size);
-    Debug_printf("disk sectors = %lu\r\n", _disk_num_sectors);
+    Debug_printf("disk sectors = %lu, %s\r\n", _disk_num_sectors, _xex_image != nullptr ? "in memory" : "read from file");
 
     return _disktype;
 }
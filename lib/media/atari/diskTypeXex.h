@@ -1,17 +1,47 @@
 #ifndef _MEDIATYPE_XEX_
 #define _MEDIATYPE_XEX_
 
+#include <vector>
+
 #include "diskType.h"
 
+// Largest XEX read into RAM at mount, only when there's PSRAM
+#define XEX_RAM_IMAGE_MAX (1024 * 1024)
+
 class MediaTypeXEX : public MediaType
 {
 private:
     uint8_t _xex_bootloader[384];
     int _xex_bootloadersize = 0;
 
+    // Where each pseudo sector after FIRST_XEX_SECTOR comes from in the file,
+    // worked out once at mount
+    struct xex_sector
+    {
+        uint32_t offset;
+        uint16_t count; // data bytes, a full sector's worth links to the next one
+    };
+    std::vector<xex_sector> _xex_sectors;
+
+    // Load and run segments found in the file, for the log
+    struct xex_segment
+    {
+        uint16_t start;
+        uint16_t end;
+        uint32_t offset; // of the segment's data in the file
+    };
+    std::vector<xex_segment> _xex_segments;
+
+    // The whole file, if it fit, otherwise sectors are read from _disk_fileh
+    uint8_t *_xex_image = nullptr;
+
     void _fake_vtoc();
     void _fake_directory_entry();
 
+    void _build_sector_map();
+    void _load_image();
+    void _scan_segments();
+
 public:
     virtual bool read(uint16_t sectornum, uint16_t *readcount) override;
 
@@ -3,8 +3,11 @@
 #include "mediaType.h"
 
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 
+#include "utils.h"
+
 
 MediaType::~MediaType()
 {
@@ -32,8 +35,86 @@ void MediaType::get_block_buffer(uint8_t **p_buffer, uint16_t *p_blk_size)
     *p_blk_size = MEDIA_BLOCK_SIZE;
 }
 
+bool MediaType::_cache_read(uint32_t offset, uint8_t *buf, uint32_t len)
+{
+    for (cache_window &w : _cache)
+    {
+        if (w.len != 0 && offset >= w.offset && offset + len <= w.offset + w.len)
+        {
+            memcpy(buf, w.data + (offset - w.offset), len);
+            w.used = ++_cache_tick;
+            return false;
+        }
+    }
+
+    // Refill the least recently used window, starting at the block asked for
+    cache_window *w = &_cache[0];
+    for (cache_window &c : _cache)
+        if (c.used < w->used)
+            w = &c;
+
+    if (len <= MEDIA_CACHE_SIZE && w->data == nullptr)
+        w->data = (uint8_t *)malloc(MEDIA_CACHE_SIZE);
+
+    if (len > MEDIA_CACHE_SIZE || w->data == nullptr)
+    {
+        // Too big to be worth caching, or no memory for it
+        if (fnio::fseek(_media_fileh, offset, SEEK_SET) != 0)
+            return true;
+        return fnio::fread(buf, 1, len, _media_fileh) != len;
+    }
+
+    w->len = 0;
+    uint32_t to_read = MEDIA_CACHE_SIZE;
+    if (_media_image_size > offset && _media_image_size - offset < to_read)
+        to_read = _media_image_size - offset;
+
+    if (fnio::fseek(_media_fileh, offset, SEEK_SET) != 0)
+        return true;
+    uint32_t got = fnio::fread(w->data, 1, to_read, _media_fileh);
+    if (got < len)
+        return true;
+
+    w->offset = offset;
+    w->len = got;
+    w->used = ++_cache_tick;
+    memcpy(buf, w->data, len);
+    return false;
+}
+
+void MediaType::_cache_update(uint32_t offset, const uint8_t *buf, uint32_t len)
+{
+    for (cache_window &w : _cache)
+    {
+        if (w.len == 0 || offset >= w.offset + w.len || offset + len <= w.offset)
+            continue;
+
+        uint32_t start = offset > w.offset ? offset : w.offset;
+        uint32_t end = offset + len < w.offset + w.len ? offset + len : w.offset + w.len;
+        memcpy(w.data + (start - w.offset), buf + (start - offset), end - start);
+    }
+}
+
+void MediaType::_cache_invalidate()
+{
+    for (cache_window &w : _cache)
+        w.len = 0;
+}
+
+void MediaType::_cache_free()
+{
+    for (cache_window &w : _cache)
+    {
+        free(w.data);
+        w.data = nullptr;
+        w.len = 0;
+    }
+}
+
 void MediaType::unmount()
 {
+    _cache_free();
+
     if (_media_fileh != nullptr)
     {
         fnio::fclose(_media_fileh);
@@ -43,6 +124,9 @@ void MediaType::unmount()
 
 mediatype_t MediaType::discover_mediatype(const char *filename)
 {
+    std::string name = util_strip_gzip_ext(filename);
+    filename = name.c_str();
+
     int l = strlen(filename);
     if (l > 4 && filename[l - 4] == '.')
     {
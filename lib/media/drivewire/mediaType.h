@@ -8,6 +8,12 @@
 
 #define MEDIA_BLOCK_SIZE 256
 
+// Reads of up to this many bytes are served from readahead windows, so a run
+// of nearby LSNs costs one image read per window
+#define MEDIA_CACHE_SIZE (16 * MEDIA_BLOCK_SIZE)
+// Windows kept per drive, e.g. one on a directory and one on the file being loaded
+#define MEDIA_CACHE_WINDOWS 2
+
 #define DISK_CTRL_STATUS_CLEAR 0x00
 
 enum mediatype_t 
@@ -26,6 +32,23 @@ protected:
     uint32_t _media_num_blocks = 256;
     uint16_t _media_sector_size = MEDIA_BLOCK_SIZE;
 
+    struct cache_window
+    {
+        uint8_t *data = nullptr;
+        uint32_t offset = 0;
+        uint32_t len = 0; // 0 while empty
+        uint32_t used = 0;
+    };
+    cache_window _cache[MEDIA_CACHE_WINDOWS];
+    uint32_t _cache_tick = 0;
+
+    // Reads len bytes at offset of the image through the cache, returns TRUE on error
+    bool _cache_read(uint32_t offset, uint8_t *buf, uint32_t len);
+    // Keeps cached copies in step with len bytes just written at offset
+    void _cache_update(uint32_t offset, const uint8_t *buf, uint32_t len);
+    void _cache_invalidate();
+    void _cache_free();
+
 public:
     struct
     {
@@ -33,16 +33,7 @@ bool MediaTypeDSK::read(uint32_t blockNum, uint16_t *readcount)
 
     memset(_media_blockbuff, 0, sizeof(_media_blockbuff));
 
-    bool err = false;
-    // Perform a seek if we're not reading the sector after the last one we read
-    if (blockNum != _media_last_block + 1)
-    {
-        uint32_t offset = _block_to_offset(blockNum);
-        err = fnio::fseek(_media_fileh, offset, SEEK_SET) != 0;
-    }
-    
-    if (err == false)
-        err = fnio::fread(_media_blockbuff, 1, MEDIA_BLOCK_SIZE, _media_fileh) != MEDIA_BLOCK_SIZE;
+    bool err = _cache_read(_block_to_offset(blockNum), _media_blockbuff, MEDIA_BLOCK_SIZE);
 
     if (err == false)
         _media_last_block = blockNum;
@@ -78,8 +69,10 @@ bool MediaTypeDSK::write(uint32_t blockNum, bool verify)
     if (e != MEDIA_BLOCK_SIZE)
     {
         Debug_printf("::write error %d, %d\n", e, errno);
+        _cache_invalidate();
         return true;
     }
+    _cache_update(offset, _media_blockbuff, MEDIA_BLOCK_SIZE);
 
     int ret = fnio::fflush(_media_fileh);    // This doesn't seem to be connected to anything in ESP-IDF VF, so it may not do anything
     
@@ -111,6 +104,8 @@ mediatype_t MediaTypeDSK::mount(fnFile *f, uint32_t disksize)
     Debug_print("DSK MOUNT\n");
 
     _media_fileh = f;
+    _media_image_size = disksize;
+    _cache_invalidate();
     _mediatype = MEDIATYPE_DSK;
     _media_num_blocks = disksize / MEDIA_BLOCK_SIZE;
 
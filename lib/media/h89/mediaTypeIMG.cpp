@@ -13,6 +13,8 @@
 
 #include "../../include/debug.h"
 
+#include "fnArena.h"
+
 // From https://github.com/wwarthen/RomWBW/blob/master/Source/CPM3/biosldr.z80
 
 const std::map<mediatype_t, MediaTypeIMG::CpmDiskImageDetails> disk_paramater_blocks =
@@ -151,6 +153,38 @@ uint32_t MediaTypeIMG::_sector_to_offset(uint16_t sectorNum)
     return (uint32_t )sectorNum * DISK_BYTES_PER_SECTOR_SINGLE;
 }
 
+// Reads the track holding sectornum and the one after it with one access.
+// Returns TRUE if the tracks couldn't be cached
+bool MediaTypeIMG::_cache_load(uint16_t sectornum)
+{
+    if (_track_sectors == 0)
+        return true;
+
+    size_t cache_sectors = (size_t)_track_sectors * IMG_CACHE_TRACKS;
+    if (_cache_buff == nullptr)
+    {
+        _cache_buff = (uint8_t *)fnArena.malloc(ARENA_MEDIA, cache_sectors * DISK_BYTES_PER_SECTOR_BLOCK);
+        if (_cache_buff == nullptr)
+            return true;
+    }
+
+    uint32_t first = sectornum - (sectornum % _track_sectors);
+    _cache_first = INVALID_SECTOR_VALUE;
+    _media_last_sector = INVALID_SECTOR_VALUE;
+
+    if (fseek(_media_fileh, _sector_to_offset(first), SEEK_SET) != 0)
+        return true;
+
+    // The last track of the image has no next one to read ahead
+    size_t got = fread(_cache_buff, DISK_BYTES_PER_SECTOR_BLOCK, cache_sectors, _media_fileh);
+    if (got == 0)
+        return true;
+
+    _cache_first = first;
+    _cache_count = got;
+    return false;
+}
+
 // Returns TRUE if an error condition occurred
 bool MediaTypeIMG::read(uint16_t sectornum, uint16_t *readcount)
 {
@@ -169,6 +203,20 @@ bool MediaTypeIMG::read(uint16_t sectornum, uint16_t *readcount)
 
     memset(_media_sectorbuff, 0, sizeof(_media_sectorbuff));
 
+    // Serve the sector from the cached tracks, loading them if the head has moved off them
+    bool cached = _cache_first != INVALID_SECTOR_VALUE && sectornum >= _cache_first &&
+                  sectornum < _cache_first + _cache_count;
+    if (!cached)
+        cached = _cache_load(sectornum) == false && sectornum >= _cache_first &&
+                 sectornum < _cache_first + _cache_count;
+    if (cached)
+    {
+        memcpy(_media_sectorbuff, &_cache_buff[(sectornum - _cache_first) * DISK_BYTES_PER_SECTOR_BLOCK],
+               sectorSize);
+        *readcount = sectorSize;
+        return false;
+    }
+
     bool err = false;
     // Perform a seek if we're not reading the sector after the last one we read
     if (sectornum != _media_last_sector + 1)
@@ -207,6 +255,12 @@ bool MediaTypeIMG::write(uint16_t sectornum, bool verify)
 
     _media_last_sector = INVALID_SECTOR_VALUE;
 
+    // Written through, and kept in the cached tracks so later reads see it
+    if (_cache_first != INVALID_SECTOR_VALUE && sectornum >= _cache_first &&
+        sectornum < _cache_first + _cache_count)
+        memcpy(&_cache_buff[(sectornum - _cache_first) * DISK_BYTES_PER_SECTOR_BLOCK], _media_sectorbuff,
+               DISK_BYTES_PER_SECTOR_BLOCK);
+
     // Perform a seek if we're writing to the sector after the last one
     int e;
     if (sectornum != _media_last_sector + 1)
@@ -270,9 +324,30 @@ mediatype_t MediaTypeIMG::mount(FILE *f, uint32_t disksize, mediatype_t disk_typ
     _media_num_sectors = disksize / 512;
     _mediatype = disk_type;
 
+    // spt counts 128 byte records, psh is the shift up to physical sectors
+    _track_sectors = 0;
+    auto dpb = disk_paramater_blocks.find(disk_type);
+    if (dpb != disk_paramater_blocks.end())
+        _track_sectors = dpb->second.dpb.spt >> dpb->second.dpb.psh;
+    _cache_first = INVALID_SECTOR_VALUE;
+
     return _mediatype;
 }
 
+void MediaTypeIMG::unmount()
+{
+    fnArena.free(ARENA_MEDIA, _cache_buff);
+    _cache_buff = nullptr;
+    _cache_first = INVALID_SECTOR_VALUE;
+
+    MediaType::unmount();
+}
+
+MediaTypeIMG::~MediaTypeIMG()
+{
+    unmount();
+}
+
 // Returns FALSE on error
 bool MediaTypeIMG::create(FILE *f, uint16_t sectorSize, uint16_t numSectors)
 {
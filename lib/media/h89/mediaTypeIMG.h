@@ -22,11 +22,22 @@
 
 
 
+// Tracks read per filesystem access, the one the head is on and the one it steps to next
+#define IMG_CACHE_TRACKS 2
+
 class MediaTypeIMG : public MediaType
 {
 private:
     uint32_t _sector_to_offset(uint16_t sectorNum);
 
+    // Sectors of whole tracks starting at _cache_first, from the media arena
+    uint8_t *_cache_buff = nullptr;
+    uint32_t _cache_first = INVALID_SECTOR_VALUE;
+    uint32_t _cache_count = 0;
+    uint16_t _track_sectors = 0;
+
+    bool _cache_load(uint16_t sectornum);
+
 public:
     struct CpmDiskImageDetails {
         std::string file_extension;
@@ -44,7 +55,11 @@ public:
 
     virtual void status(uint8_t statusbuff[4]) override;
 
+    virtual void unmount() override;
+
     static bool create(FILE *f, uint16_t sectorSize, uint16_t numSectors);
+
+    virtual ~MediaTypeIMG();
 };
 
 
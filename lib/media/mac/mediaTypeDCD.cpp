@@ -2,12 +2,79 @@
 
 #include "mediaTypeDCD.h"
 
+#include <cstdlib>
 #include <cstring>
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
 #include "utils.h"
 #include "../../include/debug.h"
 
+MediaTypeDCD::cache_window *MediaTypeDCD::cached(uint32_t blockNum)
+{
+    for (cache_window &w : _cache)
+    {
+        if (w.count != 0 && blockNum >= w.first && blockNum < w.first + w.count)
+        {
+            w.used = ++_cache_tick;
+            return &w;
+        }
+    }
+    return nullptr;
+}
+
+MediaTypeDCD::cache_window *MediaTypeDCD::fill(uint32_t blockNum)
+{
+    cache_window *w = &_cache[0];
+    for (cache_window &c : _cache)
+        if (c.used < w->used)
+            w = &c;
+
+    if (w->data == nullptr)
+#ifdef ESP_PLATFORM
+        w->data = (uint8_t *)heap_caps_malloc(DCD_CACHE_BLOCKS * DISK_SECTORBUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+        w->data = (uint8_t *)malloc(DCD_CACHE_BLOCKS * DISK_SECTORBUF_SIZE);
+#endif
+    if (w->data == nullptr || blockNum >= num_blocks)
+        return nullptr;
+
+    uint32_t count = num_blocks - blockNum < DCD_CACHE_BLOCKS ? num_blocks - blockNum : DCD_CACHE_BLOCKS;
+    w->count = 0;
+    // the file position moves on, the next uncached write has to seek
+    reset_seek_opto();
+    if (fseek(_media_fileh, (blockNum * DISK_SECTORBUF_SIZE) + offset, SEEK_SET))
+        return nullptr;
+    size_t got = fread(w->data, DISK_SECTORBUF_SIZE, count, _media_fileh); // one SD card read for the run
+    if (got == 0)
+        return nullptr;
+
+    w->first = blockNum;
+    w->count = got;
+    w->used = ++_cache_tick;
+    return w;
+}
+
+bool MediaTypeDCD::prefetch(uint32_t blockNum, uint32_t count)
+{
+    // only if the start isn't in already, a window reads as much as it holds
+    if (count == 0 || cached(blockNum) != nullptr)
+        return false;
+    return fill(blockNum) == nullptr;
+}
+
 bool MediaTypeDCD::read(uint32_t blockNum, uint8_t* buffer)
 {
+    cache_window *w = cached(blockNum);
+    if (w == nullptr)
+        w = fill(blockNum);
+
+    if (w != nullptr)
+    {
+        memcpy(buffer, w->data + (blockNum - w->first) * DISK_SECTORBUF_SIZE, DISK_SECTORBUF_SIZE);
+        return false;
+    }
+
     size_t readsize = 512;//_media_sector_size;
 if ((blockNum == 0) || (blockNum != last_block_num + 1)) // example optimization, only do seek if not reading next block -tschak
   {
@@ -49,6 +116,18 @@ bool MediaTypeDCD::write(uint32_t blockNum, uint8_t* buffer)
     }
     last_block_num = blockNum;
     writesize = fwrite((unsigned char *)buffer, 1, writesize, _media_fileh);
+
+    // keep cached copies in step, or drop them if the image may not match
+    for (cache_window &w : _cache)
+    {
+        if (w.count == 0 || blockNum < w.first || blockNum >= w.first + w.count)
+            continue;
+        if (writesize != _media_sector_size)
+            w.count = 0;
+        else
+            memcpy(w.data + (blockNum - w.first) * DISK_SECTORBUF_SIZE, buffer, DISK_SECTORBUF_SIZE);
+    }
+
     if (writesize != _media_sector_size)
     {
        reset_seek_opto();
@@ -73,6 +152,16 @@ bool MediaTypeDCD::format(uint16_t *responsesize)
     return false;
 }
 
+void MediaTypeDCD::unmount()
+{
+    for (cache_window &w : _cache)
+    {
+        free(w.data);
+        w = cache_window();
+    }
+    MediaType::unmount();
+}
+
 mediatype_t MediaTypeDCD::mount(FILE *f, uint32_t disksize)
 {
     // diskiiemulation = false;
@@ -5,14 +5,37 @@
 
 #include "mediaType.h"
 
+// Blocks read from the image in one go; a multi-block HD20 read or a run of
+// single block ones is then answered from memory
+#define DCD_CACHE_BLOCKS 32
+#define DCD_CACHE_WINDOWS 2
+
 class MediaTypeDCD : public MediaType
 {
 private:
     uint32_t last_block_num = 0xFFFFFFFF;
     uint32_t offset = 0;
+
+    struct cache_window
+    {
+        uint8_t *data = nullptr;
+        uint32_t first = 0;
+        uint32_t count = 0;
+        uint32_t used = 0;
+    };
+    cache_window _cache[DCD_CACHE_WINDOWS];
+    uint32_t _cache_tick = 0;
+
+    cache_window *cached(uint32_t blockNum);
+    // Reads blocks from blockNum on into the least recently used window
+    cache_window *fill(uint32_t blockNum);
 public:
     virtual bool read(uint32_t blockNum, uint8_t* buffer) override;
     virtual bool write(uint32_t blockNum,  uint8_t* buffer) override;
+    // Reads count blocks from blockNum on ahead of the requests for them,
+    // returns TRUE if an error condition occurred
+    bool prefetch(uint32_t blockNum, uint32_t count);
+    virtual void unmount() override;
 
     virtual bool format(uint16_t *responsesize) override;
 
@@ -28,6 +51,7 @@ public:
     void reset_seek_opto() {last_block_num = 0xFFFFFFFF;};
 
     MediaTypeDCD(int x = 0) : offset(x) {}
+    virtual ~MediaTypeDCD() { unmount(); }
 };
 
 
@@ -0,0 +1,257 @@
+#ifndef MEDIA_BLOCK_CACHE_H
+#define MEDIA_BLOCK_CACHE_H
+
+/*
+ * Least recently used cache of fixed size blocks of a disk image, for the
+ * media types to put in front of their file reads and writes instead of
+ * each remembering the last sector it read.
+ *
+ * The block size, number of blocks and write policy are fixed when the
+ * cache is declared. The media type hands it a function that reads one
+ * block from the image and one that writes one; the cache calls them on a
+ * miss and, if the cache is write back, when it evicts or flushes a
+ * changed block. Write through caches pass every write straight on.
+ *
+ * After a miss the cache can read ahead the blocks that follow, so a
+ * sequential reader finds them waiting. The block memory comes from the
+ * media arena on first use; if that fails reads and writes go straight to
+ * the image and nothing is cached.
+ *
+ * So far only RC2014's IMG media uses it. The others keep their own
+ * caches: H89's reads whole tracks, and Atari's sectors vary in size.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <functional>
+
+#include "fnArena.h"
+
+enum media_cache_policy
+{
+    MEDIA_CACHE_WRITE_THROUGH = 0,
+    MEDIA_CACHE_WRITE_BACK
+};
+
+template <size_t BlockSize, size_t Capacity, media_cache_policy Policy = MEDIA_CACHE_WRITE_THROUGH>
+class MediaBlockCache
+{
+    static_assert(BlockSize > 0 && Capacity > 0, "the cache needs at least one block");
+
+public:
+    // Both return TRUE if an error condition occurred
+    using reader_t = std::function<bool(uint32_t block, uint8_t *data)>;
+    using writer_t = std::function<bool(uint32_t block, const uint8_t *data)>;
+
+    static constexpr uint32_t NO_BLOCK = 0xFFFFFFFF;
+
+private:
+    struct slot
+    {
+        uint32_t block = NO_BLOCK;
+        uint32_t last_used = 0;
+        bool dirty = false;
+    };
+
+    slot _slots[Capacity];
+    uint8_t *_data = nullptr;
+    bool _no_memory = false;
+    uint32_t _clock = 0;
+    uint32_t _block_count = NO_BLOCK;
+    uint16_t _readahead = 0;
+
+    reader_t _reader;
+    writer_t _writer;
+
+    uint8_t *_slot_data(size_t i) { return _data + i * BlockSize; }
+
+    int _find(uint32_t block)
+    {
+        for (size_t i = 0; i < Capacity; i++)
+            if (_slots[i].block == block)
+                return i;
+        return -1;
+    }
+
+    // Whether the block memory is there, allocating it on first use
+    bool _ready()
+    {
+        if (_data == nullptr && !_no_memory)
+        {
+            _data = (uint8_t *)fnArena.malloc(ARENA_MEDIA, BlockSize * Capacity);
+            _no_memory = _data == nullptr;
+        }
+        return _data != nullptr;
+    }
+
+    // An empty or the least recently used slot, written out first if it holds a changed block.
+    // Returns -1 if that write failed
+    int _victim()
+    {
+        size_t victim = 0;
+        for (size_t i = 0; i < Capacity; i++)
+        {
+            if (_slots[i].block == NO_BLOCK)
+            {
+                victim = i;
+                break;
+            }
+            if (_slots[i].last_used < _slots[victim].last_used)
+                victim = i;
+        }
+
+        slot &s = _slots[victim];
+        if (s.dirty)
+        {
+            if (_writer(s.block, _slot_data(victim)))
+                return -1;
+            s.dirty = false;
+            writebacks++;
+        }
+        s.block = NO_BLOCK;
+        return victim;
+    }
+
+    // Reads the blocks after block that aren't cached yet, stopping at the end of the image
+    void _read_ahead(uint32_t block)
+    {
+        for (uint32_t next = block + 1; next <= block + _readahead && next < _block_count; next++)
+        {
+            if (_find(next) >= 0)
+                continue;
+            int i = _victim();
+            if (i < 0 || _reader(next, _slot_data(i)))
+                return;
+            // As old as the block that was asked for, so read ahead blocks don't push each other out
+            _slots[i] = {next, _clock, false};
+            readaheads++;
+        }
+    }
+
+public:
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t readaheads = 0;
+    uint32_t writebacks = 0;
+
+    MediaBlockCache(reader_t reader, writer_t writer) : _reader(reader), _writer(writer) {}
+
+    ~MediaBlockCache() { release(); }
+
+    // Blocks to read ahead after a miss, and the number of blocks in the image to stop at
+    void set_readahead(uint16_t blocks) { _readahead = blocks < Capacity ? blocks : Capacity - 1; }
+    void set_block_count(uint32_t blocks) { _block_count = blocks; }
+
+    // Returns TRUE if an error condition occurred
+    bool read(uint32_t block, uint8_t *data)
+    {
+        int i = _find(block);
+        if (i >= 0)
+        {
+            memcpy(data, _slot_data(i), BlockSize);
+            _slots[i].last_used = ++_clock;
+            hits++;
+            return false;
+        }
+
+        misses++;
+        if (!_ready())
+            return _reader(block, data);
+
+        i = _victim();
+        if (i < 0 || _reader(block, _slot_data(i)))
+            return true;
+        _slots[i] = {block, ++_clock, false};
+        memcpy(data, _slot_data(i), BlockSize);
+
+        if (_readahead != 0)
+            _read_ahead(block);
+        return false;
+    }
+
+    // Returns TRUE if an error condition occurred
+    bool write(uint32_t block, const uint8_t *data)
+    {
+        if (Policy == MEDIA_CACHE_WRITE_THROUGH || !_ready())
+        {
+            if (_writer(block, data))
+                return true;
+            // Keep a cached copy current, but don't take a slot for a block nobody has read
+            int i = _find(block);
+            if (i >= 0)
+                memcpy(_slot_data(i), data, BlockSize);
+            return false;
+        }
+
+        int i = _find(block);
+        if (i < 0)
+            i = _victim();
+        if (i < 0)
+            return true;
+        memcpy(_slot_data(i), data, BlockSize);
+        _slots[i] = {block, ++_clock, true};
+        return false;
+    }
+
+    // Writes every changed block in block order, so the image is written front to back.
+    // Returns TRUE if any of them failed and is still waiting
+    bool flush()
+    {
+        if (Policy == MEDIA_CACHE_WRITE_THROUGH)
+            return false;
+
+        bool err = false;
+        uint32_t from = 0;
+        while (true)
+        {
+            int next = -1;
+            for (size_t i = 0; i < Capacity; i++)
+                if (_slots[i].dirty && _slots[i].block >= from &&
+                    (next < 0 || _slots[i].block < _slots[next].block))
+                    next = i;
+            if (next < 0)
+                break;
+
+            slot &s = _slots[next];
+            if (_writer(s.block, _slot_data(next)))
+                err = true;
+            else
+            {
+                s.dirty = false;
+                writebacks++;
+            }
+            if (s.block == NO_BLOCK - 1)
+                break;
+            from = s.block + 1;
+        }
+        return err;
+    }
+
+    bool dirty() const
+    {
+        for (size_t i = 0; i < Capacity; i++)
+            if (_slots[i].dirty)
+                return true;
+        return false;
+    }
+
+    // Forgets every block without writing anything, for when the image changes underneath
+    void invalidate()
+    {
+        for (size_t i = 0; i < Capacity; i++)
+            _slots[i] = slot();
+    }
+
+    // Writes back what's changed and hands the block memory back, as on unmount
+    void release()
+    {
+        flush();
+        invalidate();
+        fnArena.free(ARENA_MEDIA, _data);
+        _data = nullptr;
+        _no_memory = false;
+    }
+};
+
+#endif // MEDIA_BLOCK_CACHE_H
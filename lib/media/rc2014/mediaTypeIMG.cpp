@@ -151,6 +151,63 @@ uint32_t MediaTypeIMG::_sector_to_offset(uint16_t sectorNum)
     return (uint32_t )sectorNum * DISK_BYTES_PER_SECTOR_SINGLE;
 }
 
+MediaTypeIMG::MediaTypeIMG()
+    : _cache([this](uint32_t sectornum, uint8_t *data) { return _read_sector(sectornum, data); },
+             [this](uint32_t sectornum, const uint8_t *data) { return _write_sector(sectornum, data); })
+{
+    _cache.set_readahead(IMG_READAHEAD_SECTORS);
+}
+
+// Reads one sector from the image for the cache. Returns TRUE if an error condition occurred
+bool MediaTypeIMG::_read_sector(uint32_t sectornum, uint8_t *data)
+{
+    bool err = false;
+    // Perform a seek if we're not reading the sector after the last one we read
+    if (sectornum != _media_last_sector + 1)
+    {
+        uint32_t offset = _sector_to_offset(sectornum);
+        err = fseek(_media_fileh, offset, SEEK_SET) != 0;
+    }
+
+    if (err == false)
+        err = fread(data, 1, DISK_BYTES_PER_SECTOR_BLOCK, _media_fileh) != DISK_BYTES_PER_SECTOR_BLOCK;
+
+    if (err == false)
+        _media_last_sector = sectornum;
+    else
+        _media_last_sector = INVALID_SECTOR_VALUE;
+
+    return err;
+}
+
+// Writes one sector to the image for the cache. Returns TRUE if an error condition occurred
+bool MediaTypeIMG::_write_sector(uint32_t sectornum, const uint8_t *data)
+{
+    // Always seek, as the stream may have been reading up to now
+    int e = fseek(_media_fileh, _sector_to_offset(sectornum), SEEK_SET);
+    if (e != 0)
+    {
+        Debug_printf("::write seek error %d\r\n", e);
+        _media_last_sector = INVALID_SECTOR_VALUE;
+        return true;
+    }
+    // Write the data
+    e = fwrite(data, 1, DISK_BYTES_PER_SECTOR_BLOCK, _media_fileh);
+    if (e != DISK_BYTES_PER_SECTOR_BLOCK)
+    {
+        Debug_printf("::write error %d, %d\r\n", e, errno);
+        _media_last_sector = INVALID_SECTOR_VALUE;
+        return true;
+    }
+
+    int ret = fflush(_media_fileh);    // This doesn't seem to be connected to anything in ESP-IDF VF, so it may not do anything
+    ret = fsync(fileno(_media_fileh)); // Since we might get reset at any moment, go ahead and sync the file (not clear if fflush does this)
+    Debug_printf("IMG::write fsync:%d\r\n", ret);
+
+    _media_last_sector = sectornum;
+    return false;
+}
+
 // Returns TRUE if an error condition occurred
 bool MediaTypeIMG::read(uint16_t sectornum, uint16_t *readcount)
 {
@@ -169,21 +226,7 @@ bool MediaTypeIMG::read(uint16_t sectornum, uint16_t *readcount)
 
     memset(_media_sectorbuff, 0, sizeof(_media_sectorbuff));
 
-    bool err = false;
-    // Perform a seek if we're not reading the sector after the last one we read
-    if (sectornum != _media_last_sector + 1)
-    {
-        uint32_t offset = _sector_to_offset(sectornum);
-        err = fseek(_media_fileh, offset, SEEK_SET) != 0;
-    }
-
-    if (err == false)
-        err = fread(_media_sectorbuff, 1, sectorSize, _media_fileh) != sectorSize;
-
-    if (err == false)
-        _media_last_sector = sectornum;
-    else
-        _media_last_sector = INVALID_SECTOR_VALUE;
+    bool err = _cache.read(sectornum, _media_sectorbuff);
 
     *readcount = sectorSize;
 
@@ -203,34 +246,9 @@ bool MediaTypeIMG::write(uint16_t sectornum, bool verify)
         return true;
     }
 
-    uint32_t offset = _sector_to_offset(sectornum);
-
-    _media_last_sector = INVALID_SECTOR_VALUE;
-
-    // Perform a seek if we're writing to the sector after the last one
-    int e;
-    if (sectornum != _media_last_sector + 1)
-    {
-        e = fseek(_media_fileh, offset, SEEK_SET);
-        if (e != 0)
-        {
-            Debug_printf("::write seek error %d\r\n", e);
-            return true;
-        }
-    }
-    // Write the data
-    e = fwrite(_media_sectorbuff, 1, DISK_BYTES_PER_SECTOR_BLOCK, _media_fileh);
-    if (e != DISK_BYTES_PER_SECTOR_BLOCK)
-    {
-        Debug_printf("::write error %d, %d\r\n", e, errno);
+    if (_cache.write(sectornum, _media_sectorbuff))
         return true;
-    }
-
-    int ret = fflush(_media_fileh);    // This doesn't seem to be connected to anything in ESP-IDF VF, so it may not do anything
-    ret = fsync(fileno(_media_fileh)); // Since we might get reset at any moment, go ahead and sync the file (not clear if fflush does this)
-    Debug_printf("IMG::write fsync:%d\r\n", ret);
 
-    _media_last_sector = sectornum;
     _media_controller_status=0;
 
     return false;
@@ -270,9 +288,24 @@ mediatype_t MediaTypeIMG::mount(FILE *f, uint32_t disksize, mediatype_t disk_typ
     _media_num_sectors = disksize / 512;
     _mediatype = disk_type;
 
+    _cache.invalidate();
+    _cache.set_block_count(_media_num_sectors);
+
     return _mediatype;
 }
 
+void MediaTypeIMG::unmount()
+{
+    _cache.release();
+
+    MediaType::unmount();
+}
+
+MediaTypeIMG::~MediaTypeIMG()
+{
+    unmount();
+}
+
 // Returns FALSE on error
 bool MediaTypeIMG::create(FILE *f, uint16_t sectorSize, uint16_t numSectors)
 {
@@ -6,6 +6,7 @@
 #include <utility>
 
 #include "mediaType.h"
+#include "../mediaBlockCache.h"
 
 /**
  * This describes an 8MB "slice" used in RC2014 CF modules
@@ -22,11 +23,20 @@
 
 
 
+// Sectors each drive caches, and how many after a missed one are read with it
+#define IMG_CACHE_SECTORS 16
+#define IMG_READAHEAD_SECTORS 7
+
 class MediaTypeIMG : public MediaType
 {
 private:
     uint32_t _sector_to_offset(uint16_t sectorNum);
 
+    MediaBlockCache<DISK_BYTES_PER_SECTOR_BLOCK, IMG_CACHE_SECTORS> _cache;
+
+    bool _read_sector(uint32_t sectornum, uint8_t *data);
+    bool _write_sector(uint32_t sectornum, const uint8_t *data);
+
 public:
     struct CpmDiskImageDetails {
         std::string file_extension;
@@ -35,6 +45,8 @@ public:
     };
 
 public:
+    MediaTypeIMG();
+
     virtual bool read(uint16_t sectornum, uint16_t *readcount) override;
     virtual bool write(uint16_t sectornum, bool verify) override;
 
@@ -44,7 +56,11 @@ public:
 
     virtual void status(uint8_t statusbuff[4]) override;
 
+    virtual void unmount() override;
+
     static bool create(FILE *f, uint16_t sectorSize, uint16_t numSectors);
+
+    virtual ~MediaTypeIMG();
 };
 
 
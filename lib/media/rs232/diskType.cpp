@@ -59,6 +59,9 @@ void MediaType::unmount()
 
 mediatype_t MediaType::discover_disktype(const char *filename)
 {
+    std::string name = util_strip_gzip_ext(filename);
+    filename = name.c_str();
+
     int l = strlen(filename);
     if (l > 4 && filename[l - 4] == '.')
     {
@@ -0,0 +1,147 @@
+/**
+ * modem core library for FujiNet
+ * the connected-mode data path shared by the MODEM devices of every bus.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+#include "modem-core.h"
+
+#include "fnSystem.h"
+
+#include "../../include/debug.h"
+
+static uint8_t *_alloc_buffer(size_t size)
+{
+#ifdef ESP_PLATFORM
+    uint8_t *buf = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buf != nullptr)
+        return buf;
+#endif
+    return (uint8_t *)malloc(size);
+}
+
+ModemCore::ModemCore(ModemPort *_port, ModemSniffer *_sniffer)
+{
+    port = _port;
+    sniffer = _sniffer;
+
+    txBuf = _alloc_buffer(MODEM_CORE_TX_SIZE);
+    escBuf = _alloc_buffer(MODEM_CORE_TX_SIZE * 2);
+    rxBuf = _alloc_buffer(MODEM_CORE_RX_SIZE);
+}
+
+ModemCore::~ModemCore()
+{
+    free(txBuf);
+    free(escBuf);
+    free(rxBuf);
+}
+
+void ModemCore::tune(fnTcpClient &client)
+{
+    if (client.setBufferSizes(MODEM_CORE_SOCKET_RX_SIZE, MODEM_CORE_SOCKET_TX_SIZE) < 0)
+        Debug_printf("ModemCore::tune - socket buffers left at the stack's defaults\n");
+    client.setNoDelay(true);
+}
+
+void ModemCore::scanEscape(size_t len)
+{
+    // Only the run of '+' at the end of the batch can still count towards
+    // "+++", it carries on the one from the last batch if that's all there is
+    size_t run = 0;
+    while (run < len && txBuf[len - 1 - run] == '+')
+        run++;
+
+    if (run == len)
+        plusCount += run;
+    else
+        plusCount = run;
+    if (plusCount > 3)
+        plusCount = 3;
+
+    if (plusCount == 3)
+        plusTime = fnSystem.millis();
+}
+
+size_t ModemCore::toTcp(fnTcpClient &client, bool telnet)
+{
+    int avail = port->available();
+    if (avail <= 0 || !client.connected() || txBuf == nullptr || escBuf == nullptr)
+        return 0;
+
+    size_t len = port->read(txBuf, (size_t)avail > MODEM_CORE_TX_SIZE ? MODEM_CORE_TX_SIZE : avail);
+    if (len == 0)
+        return 0;
+
+    scanEscape(len);
+
+    // A single socket write per batch. For telnet, IAC bytes are doubled
+    // here rather than by telnet_send(), which would hand each run between
+    // them to the socket separately. No MCCP is built, so that's all it does
+    if (telnet && memchr(txBuf, TELNET_IAC, len) != nullptr)
+    {
+        size_t escLen = 0;
+        for (size_t i = 0; i < len; i++)
+        {
+            escBuf[escLen++] = txBuf[i];
+            if (txBuf[i] == TELNET_IAC)
+                escBuf[escLen++] = TELNET_IAC;
+        }
+        client.write(escBuf, escLen);
+    }
+    else
+    {
+        client.write(txBuf, len);
+    }
+
+    // And send it off to the sniffer, if enabled, once the data is on its way
+    if (sniffer != nullptr)
+        sniffer->dumpOutput(txBuf, len);
+
+    return len;
+}
+
+size_t ModemCore::fromTcp(fnTcpClient &client, telnet_t *telnet)
+{
+    size_t total = 0;
+    int avail;
+
+    if (rxBuf == nullptr)
+        return 0;
+
+    while ((avail = client.available()) > 0)
+    {
+        int len = client.read(rxBuf, (size_t)avail > MODEM_CORE_RX_SIZE ? MODEM_CORE_RX_SIZE : avail);
+        if (len <= 0)
+            break;
+
+        // libtelnet hands each run of plain data to the modem's event
+        // handler in one piece. No flush, the computer's side drains this
+        // while the next batch is read
+        if (telnet != nullptr)
+            telnet_recv(telnet, (const char *)rxBuf, len);
+        else
+            port->write(rxBuf, len);
+
+        if (sniffer != nullptr)
+            sniffer->dumpInput(rxBuf, len);
+        total += len;
+    }
+
+    return total;
+}
+
+bool ModemCore::escapeRequested()
+{
+    if (plusCount < 3 || fnSystem.millis() - plusTime <= MODEM_CORE_ESCAPE_GUARD)
+        return false;
+
+    plusCount = 0;
+    return true;
+}
@@ -0,0 +1,136 @@
+/**
+ * modem core library for FujiNet
+ * the connected-mode data path shared by the MODEM devices of every bus.
+ */
+
+#ifndef MODEM_CORE_H
+#define MODEM_CORE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "fnTcpClient.h"
+#include "libtelnet.h"
+#include "modem-sniffer.h"
+
+// Most bytes moved from the computer to TCP per batch
+#ifndef MODEM_CORE_TX_SIZE
+#define MODEM_CORE_TX_SIZE 1024
+#endif
+// Most bytes moved from TCP to the computer per batch
+#ifndef MODEM_CORE_RX_SIZE
+#define MODEM_CORE_RX_SIZE 4096
+#endif
+// Socket buffers asked for on a connection, enough to ride out Wi-Fi
+// stalls of a few hundred ms at 115200 baud
+#ifndef MODEM_CORE_SOCKET_RX_SIZE
+#define MODEM_CORE_SOCKET_RX_SIZE 8192
+#endif
+#ifndef MODEM_CORE_SOCKET_TX_SIZE
+#define MODEM_CORE_SOCKET_TX_SIZE 8192
+#endif
+// Quiet time after "+++" before going back to command mode, in ms
+#define MODEM_CORE_ESCAPE_GUARD 1000
+
+/**
+ * The computer's side of a modem, as seen by the bus it's on
+ */
+class ModemPort
+{
+public:
+    virtual ~ModemPort() {}
+
+    /**
+     * Bytes from the computer waiting to be read
+     */
+    virtual int available() = 0;
+
+    /**
+     * Take up to len bytes from the computer, returns how many there were
+     */
+    virtual size_t read(uint8_t *buf, size_t len) = 0;
+
+    /**
+     * Hand len bytes to the computer, returns how many were taken
+     */
+    virtual size_t write(const uint8_t *buf, size_t len) = 0;
+};
+
+/**
+ * ModemPort for a bus that talks to the computer through a UART-like class
+ * with available(), readBytes() and write()
+ */
+template <class T>
+class ModemUARTPort : public ModemPort
+{
+private:
+    T *_uart;
+
+public:
+    ModemUARTPort(T *uart) : _uart(uart) {}
+
+    int available() override { return _uart->available(); }
+    size_t read(uint8_t *buf, size_t len) override { return _uart->readBytes(buf, len); }
+    size_t write(const uint8_t *buf, size_t len) override { return _uart->write(buf, len); }
+};
+
+class ModemCore
+{
+public:
+    /**
+     * @param _port the computer's side of the modem
+     * @param _sniffer the modem's sniffer, or nullptr
+     */
+    ModemCore(ModemPort *_port, ModemSniffer *_sniffer = nullptr);
+
+    virtual ~ModemCore();
+
+    /**
+     * Set the sniffer both directions are logged to
+     */
+    void setSniffer(ModemSniffer *_sniffer) { sniffer = _sniffer; }
+
+    /**
+     * Size client's socket buffers for a modem connection; call once it's
+     * connected or accepted
+     */
+    void tune(fnTcpClient &client);
+
+    /**
+     * Move one batch from the computer to client, escaping IAC bytes when
+     * telnet is set. Returns the bytes taken from the computer.
+     */
+    size_t toTcp(fnTcpClient &client, bool telnet);
+
+    /**
+     * Move everything client has to the computer, through telnet unless it's
+     * nullptr. Returns the bytes read from client.
+     */
+    size_t fromTcp(fnTcpClient &client, telnet_t *telnet);
+
+    /**
+     * True once "+++" was the last thing the computer sent, followed by
+     * MODEM_CORE_ESCAPE_GUARD of quiet, then the escape is cleared
+     */
+    bool escapeRequested();
+
+protected:
+    ModemPort *port;
+    ModemSniffer *sniffer;
+
+    // In PSRAM where there is some
+    uint8_t *txBuf;
+    // txBuf with IAC bytes doubled, at worst every byte is one
+    uint8_t *escBuf;
+    uint8_t *rxBuf;
+
+    int plusCount = 0;   // '+' at the end of what the computer sent, up to 3
+    uint64_t plusTime = 0; // when the third one came
+
+    /**
+     * Count the '+' run at the end of len bytes of txBuf
+     */
+    void scanEscape(size_t len);
+};
+
+#endif /* MODEM_CORE_H */
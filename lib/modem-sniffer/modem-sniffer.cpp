@@ -4,12 +4,25 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 #include <errno.h>
 
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
 #include "modem-sniffer.h"
 
+#include "fnSystem.h"
+
 #include "../../include/debug.h"
 
+#define SNIFFER_RING_MASK (SNIFFER_RING_SIZE - 1)
+// direction byte and 16 bit length in front of each batch
+#define SNIFFER_RECORD_HEADER 3
+
 ModemSniffer::ModemSniffer(FileSystem *_fs, bool _enable)
 {
     // if (_fs == nullptr)
@@ -26,16 +39,30 @@ ModemSniffer::~ModemSniffer()
 {
     Debug_printf("ModemSniffer::~ModemSniffer()\n");
 
+    // The task drains what's left on its way out
+    taskStop = true;
+#ifdef ESP_PLATFORM
+    while (taskRunning)
+        fnSystem.delay(10);
+#else
+    if (task.joinable())
+        task.join();
+#endif
+
     if (_file != nullptr)
     {
         Debug_printf("Closing" SNIFFER_OUTPUT_FILE "\n");
         fclose(_file);
         _file = nullptr;
     }
+
+    free(ring);
 }
 
 size_t ModemSniffer::getOutputSize()
 {
+    std::lock_guard<std::mutex> lock(fileMutex);
+
     if (_file != nullptr)
         return FileSystem::filesize(_file);
 
@@ -48,6 +75,8 @@ void ModemSniffer::closeOutput()
 {
     Debug_print("ModemSniffer::closeOutput\n");
 
+    std::lock_guard<std::mutex> lock(fileMutex);
+
 #ifdef ESP_PLATFORM
 // jk: why?
     if (_file == nullptr)
@@ -77,6 +106,9 @@ FILE *ModemSniffer::closeOutputAndProvideReadHandle()
 {
     Debug_print("ModemSniffer::closeOutputAndProvideReadHandle()\n");
 
+    // Let the file catch up with what's been captured so far
+    waitDrained();
+
     closeOutput();
     FILE *result = activeFS->file_open(SNIFFER_OUTPUT_FILE); // read-only.
     if (result == nullptr)
@@ -87,6 +119,13 @@ FILE *ModemSniffer::closeOutputAndProvideReadHandle()
     return result;
 }
 
+void ModemSniffer::setListener(std::function<bool(const char *, size_t)> _listener)
+{
+    std::lock_guard<std::mutex> lock(fileMutex);
+    listener = _listener;
+}
+
+// Called with fileMutex held
 void ModemSniffer::restartOutput()
 {
     if (_file != nullptr)
@@ -97,74 +136,190 @@ void ModemSniffer::restartOutput()
     Debug_printf("ModemSniffer::restartOutput(%p)\n", _file);
 }
 
-void ModemSniffer::dumpInput(uint8_t *buf, unsigned short len)
+void ModemSniffer::startTask()
 {
-    if (enable == false)
+#ifdef ESP_PLATFORM
+    ring = (uint8_t *)heap_caps_malloc(SNIFFER_RING_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+    if (ring == nullptr)
+        ring = (uint8_t *)malloc(SNIFFER_RING_SIZE);
+    if (ring == nullptr)
+    {
+        Debug_println("ModemSniffer - no memory for the capture ring");
         return;
+    }
 
-    if (_file == nullptr)
+    taskRunning = true;
+#ifdef ESP_PLATFORM
+    if (xTaskCreatePinnedToCore(drainTask, "sniffer_task", SNIFFER_TASK_STACKSIZE, this,
+                                SNIFFER_TASK_PRIORITY, nullptr, 0) != pdPASS)
     {
-        restartOutput();
+        Debug_println("ModemSniffer - failed to start drain task");
+        taskRunning = false;
+        free(ring);
+        ring = nullptr;
     }
+#else
+    task = std::thread(&ModemSniffer::taskLoop, this);
+#endif
+}
+
+#ifdef ESP_PLATFORM
+void ModemSniffer::drainTask(void *param)
+{
+    ((ModemSniffer *)param)->taskLoop();
+    vTaskDelete(nullptr);
+}
+#endif
 
-    if (direction != INPUT)
+void ModemSniffer::taskLoop()
+{
+    // Big, infrequent writes rather than one per modem batch, at a priority
+    // below everything that moves the data
+    while (!taskStop)
     {
-        fprintf(_file, "\n\nINCOMING: ");
-        Debug_printf("\n\nINCOMING: ");
+        if (!drain())
+            fnSystem.delay(SNIFFER_DRAIN_INTERVAL);
     }
+    drain();
 
-    direction = INPUT;
+    taskRunning = false;
+}
 
-    for (int i = 0; i < len; i++)
+void ModemSniffer::waitDrained()
+{
+    if (!taskRunning)
+        return;
+
+    for (int i = 0; i < 1000 / SNIFFER_DRAIN_INTERVAL; i++)
     {
-        if (buf[i] > 0x20 && buf[i] < 0x7F)
-        {
-            // Printable ASCII character.
-            fprintf(_file, "'%c' ", buf[i]);
-            Debug_printf("'%c' ", buf[i]);
-        }
-        else
-        {
-            // non-printable ASCII character.
-            fprintf(_file, "%02x ", buf[i]);
-            Debug_printf("%02x ", buf[i]);
-        }
+        if (ringTail.load(std::memory_order_acquire) == ringHead.load(std::memory_order_acquire))
+            return;
+        fnSystem.delay(SNIFFER_DRAIN_INTERVAL / 2);
     }
-    fflush(_file);
 }
 
-void ModemSniffer::dumpOutput(uint8_t *buf, unsigned short len)
+void ModemSniffer::capture(enum _direction dir, uint8_t *buf, unsigned short len)
 {
-    if (enable == false)
+    if (enable == false || len == 0)
         return;
 
-    if (_file == nullptr)
+    if (ring == nullptr)
     {
-        restartOutput();
+        // First capture, only the modem gets here so it's started once
+        startTask();
+        if (ring == nullptr)
+            return;
     }
 
-    if (direction != OUTPUT)
+    // Never wait on the drain task, if there's no room the batch is
+    // counted and left out of the log
+    size_t head = ringHead.load(std::memory_order_relaxed);
+    size_t tail = ringTail.load(std::memory_order_acquire);
+    size_t need = SNIFFER_RECORD_HEADER + len;
+    if (SNIFFER_RING_SIZE - (head - tail) < need)
     {
-        fprintf(_file, "\n\nOUTGOING: ");
-        Debug_printf("\n\nOUTGOING: ");
+        overruns.fetch_add(len, std::memory_order_relaxed);
+        return;
     }
 
-    direction = OUTPUT;
+    ring[head & SNIFFER_RING_MASK] = dir;
+    ring[(head + 1) & SNIFFER_RING_MASK] = len & 0xFF;
+    ring[(head + 2) & SNIFFER_RING_MASK] = len >> 8;
+
+    size_t start = (head + SNIFFER_RECORD_HEADER) & SNIFFER_RING_MASK;
+    size_t first = SNIFFER_RING_SIZE - start;
+    if (first > len)
+        first = len;
+    memcpy(&ring[start], buf, first);
+    memcpy(ring, buf + first, len - first);
+
+    ringHead.store(head + need, std::memory_order_release);
+}
+
+bool ModemSniffer::drain()
+{
+    if (ring == nullptr)
+        return false;
 
-    for (int i = 0; i < len; i++)
+    size_t tail = ringTail.load(std::memory_order_relaxed);
+    size_t head = ringHead.load(std::memory_order_acquire);
+    uint32_t dropped = overruns.load(std::memory_order_relaxed);
+    if (tail == head && dropped == overrunsLogged)
+        return false;
+
+    // Format everything there is, so it goes out in one write instead of
+    // a file and a debug print per batch
+    outputBuffer.clear();
+    if (dropped != overrunsLogged)
     {
-        if (buf[i] > 0x20 && buf[i] < 0x7F)
+        char note[48];
+        snprintf(note, sizeof(note), "\n\n[%lu BYTES NOT CAPTURED]", (unsigned long)(dropped - overrunsLogged));
+        outputBuffer += note;
+        overrunsLogged = dropped;
+        direction = INIT;
+    }
+
+    while (tail != head)
+    {
+        enum _direction dir = (enum _direction)ring[tail & SNIFFER_RING_MASK];
+        size_t len = ring[(tail + 1) & SNIFFER_RING_MASK] | (ring[(tail + 2) & SNIFFER_RING_MASK] << 8);
+        tail += SNIFFER_RECORD_HEADER;
+
+        const char *hex = dir == INPUT ? "0123456789abcdef" : "0123456789ABCDEF";
+        if (direction != dir)
+            outputBuffer += dir == INPUT ? "\n\nINCOMING: " : "\n\nOUTGOING: ";
+
+        direction = dir;
+
+        for (size_t i = 0; i < len; i++, tail++)
         {
-            // Printable ASCII character.
-            fprintf(_file, "'%c' ", buf[i]);
-            Debug_printf("'%c' ", buf[i]);
+            uint8_t b = ring[tail & SNIFFER_RING_MASK];
+            if (b > 0x20 && b < 0x7F)
+            {
+                // Printable ASCII character.
+                outputBuffer += '\'';
+                outputBuffer += (char)b;
+                outputBuffer += "' ";
+            }
+            else
+            {
+                // non-printable ASCII character.
+                outputBuffer += hex[b >> 4];
+                outputBuffer += hex[b & 0x0F];
+                outputBuffer += ' ';
+            }
         }
-        else
+    }
+
+    // The room is the modem's again
+    ringTail.store(tail, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+
+        if (_file == nullptr)
+            restartOutput();
+        if (_file != nullptr)
         {
-            // non-printable ASCII character.
-            fprintf(_file, "%02X ", buf[i]);
-            Debug_printf("%02X ", buf[i]);
+            fwrite(outputBuffer.data(), 1, outputBuffer.size(), _file);
+            fflush(_file);
         }
+
+        if (listener && !listener(outputBuffer.data(), outputBuffer.size()))
+            listener = nullptr;
     }
-    fflush(_file);
+
+    Debug_printf("%s", outputBuffer.c_str());
+    return true;
+}
+
+void ModemSniffer::dumpInput(uint8_t *buf, unsigned short len)
+{
+    capture(INPUT, buf, len);
+}
+
+void ModemSniffer::dumpOutput(uint8_t *buf, unsigned short len)
+{
+    capture(OUTPUT, buf, len);
 }
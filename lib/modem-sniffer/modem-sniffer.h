@@ -6,11 +6,18 @@
 #ifndef MODEM_SNIFFER_H
 #define MODEM_SNIFFER_H
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <mutex>
 #include <string>
 
 #include <stdio.h>
 
+#ifndef ESP_PLATFORM
+#include <thread>
+#endif
+
 #include "fnFS.h"
 
 
@@ -18,6 +25,13 @@
 
 #define SNIFFER_OUTPUT_FILE "/rs232dump"
 
+// Captured bytes waiting for the drain task, a power of 2
+#define SNIFFER_RING_SIZE 16384
+// How often the drain task empties the ring into the file, in ms
+#define SNIFFER_DRAIN_INTERVAL 100
+#define SNIFFER_TASK_STACKSIZE 4096
+#define SNIFFER_TASK_PRIORITY 1
+
 class ModemSniffer
 {
 
@@ -74,6 +88,17 @@ public:
      */
     void setActiveFS(FileSystem *_fs) { activeFS = _fs; }
 
+    /**
+     * Also hand each block of log text to listener, as it goes to the file,
+     * e.g. for a live view. An empty listener stops it
+     */
+    void setListener(std::function<bool(const char *, size_t)> _listener);
+
+    /**
+     * Bytes dropped because the ring was full
+     */
+    uint32_t getOverruns() { return overruns; }
+
 private:
     /**
      * Is sniffer enabled?
@@ -107,11 +132,55 @@ protected:
      */
     std::string outputBuffer;
 
+    /**
+     * Captured bytes, as records of a direction byte, a 16 bit length and
+     * the data. Filled by the modem, emptied by the drain task, so head and
+     * tail are the only shared state. In PSRAM where there is some
+     */
+    uint8_t *ring = nullptr;
+    std::atomic<size_t> ringHead{0}; // next byte to fill, only the modem moves it
+    std::atomic<size_t> ringTail{0}; // next byte to drain, only the task moves it
+    std::atomic<uint32_t> overruns{0};
+    uint32_t overrunsLogged = 0;
+
+    /**
+     * Guards _file and listener between the drain task and the web interface
+     */
+    std::mutex fileMutex;
+    std::function<bool(const char *, size_t)> listener;
+
+    std::atomic<bool> taskRunning{false};
+    std::atomic<bool> taskStop{false};
+#ifndef ESP_PLATFORM
+    std::thread task;
+#endif
+
     /**
      * Recreate SNIFFER_OUTPUT_FILE
      */
     void restartOutput();
 
+    /**
+     * Queue a batch of bytes going in direction dir for the drain task
+     */
+    void capture(enum _direction dir, uint8_t *buf, unsigned short len);
+
+    void startTask();
+    void taskLoop();
+#ifdef ESP_PLATFORM
+    static void drainTask(void *param);
+#endif
+
+    /**
+     * Format everything in the ring and write it out in one go. Returns
+     * false if there was nothing to drain
+     */
+    bool drain();
+
+    /**
+     * Wait a while for the drain task to catch up
+     */
+    void waitDrained();
 };
 
-#endif /* MODEM_SNIFFER_H */
\ No newline at end of file
+#endif /* MODEM_SNIFFER_H */
@@ -209,25 +209,24 @@ bool NetworkProtocolFS::read(unsigned short len)
 
 bool NetworkProtocolFS::read_file(unsigned short len)
 {
-    std::vector<uint8_t> buf = std::vector<uint8_t>(len);
-
 #ifdef VERBOSE_HTTP
     Debug_printf("NetworkProtocolFS::read_file(%u)\r\n", len);
 #endif
 
     if (receiveBuffer->length() == 0)
     {
-        // Do block read.
-        if (read_file_handle(buf.data(), len) == true)
+        // Do block read, straight into the receive buffer. It's empty, and
+        // keeps its capacity from one read to the next
+        receiveBuffer->resize(len);
+        if (read_file_handle((uint8_t *)&(*receiveBuffer)[0], len) == true)
         {
+            receiveBuffer->clear();
 #ifdef VERBOSE_PROTOCOL
             Debug_printf("Nothing new from adapter, bailing.\n");
 #endif
             return true;
         }
 
-        // Append to receive buffer.
-        receiveBuffer->insert(receiveBuffer->end(), buf.begin(), buf.end());
         fileSize -= len;
     }
     else
@@ -193,7 +193,7 @@ bool NetworkProtocolHTTP::open_dir_handle()
     }
 
     // Setup XML WebDAV parser
-    if (webDAV.begin_parser())
+    if (webDAV.begin_parser(&davEntries))
     {
 #ifdef VERBOSE_PROTOCOL
         Debug_printf("Failed to setup parser.\r\n");
@@ -202,7 +202,8 @@ bool NetworkProtocolHTTP::open_dir_handle()
         return true;
     }
 
-    std::vector<uint8_t> buf;
+    // Each piece is parsed as it arrives, however long the listing is
+    std::vector<uint8_t> buf(WEBDAV_READ_CHUNK_SIZE);
 
     // Process all response chunks
     while ( !client->is_transaction_done() || client->available() > 0)
@@ -213,9 +214,8 @@ bool NetworkProtocolHTTP::open_dir_handle()
 #ifdef VERBOSE_PROTOCOL
             Debug_printf("data available %d ...\n", len);
 #endif
-            // increase chunk buffer if necessary
-            if (len >= buf.size())
-                buf.resize(len+1); // +1 for '\0'
+            if (len > WEBDAV_READ_CHUNK_SIZE)
+                len = WEBDAV_READ_CHUNK_SIZE;
 
             // Grab the buffer
             actual_len = client->read(buf.data(), len);
@@ -228,8 +228,6 @@ bool NetworkProtocolHTTP::open_dir_handle()
                 error = NETWORK_ERROR_GENERAL;
                 break;
             }
-            buf[len] = '\0'; // make buffer C string compatible for Debug_printf()
-
             // Parse the buffer
             if (webDAV.parse((char *)buf.data(), len, false))
             {
@@ -275,7 +273,7 @@ bool NetworkProtocolHTTP::open_dir_handle()
     webDAV.end_parser();
 
     // Scoot to beginning of directory entries.
-    dirEntryCursor = webDAV.rewind();
+    davEntries.apply_no_filter();
 
     if (client != nullptr)
     {
@@ -530,12 +528,12 @@ bool NetworkProtocolHTTP::read_dir_entry(char *buf, unsigned short len)
     Debug_printf("NetworkProtocolHTTP::read_dir_entry(%p,%u)\r\n", buf, len);
 #endif
 
-    if (dirEntryCursor != webDAV.entries.end())
+    fsdir_entry *entry = davEntries.read();
+    if (entry != nullptr)
     {
-        strlcpy(buf, dirEntryCursor->filename.c_str(), len);
-        fileSize = atoi(dirEntryCursor->fileSize.c_str());
-        is_directory = dirEntryCursor->isDir;
-        ++dirEntryCursor;
+        strlcpy(buf, entry->filename, len);
+        fileSize = entry->size;
+        is_directory = entry->isDir;
 #ifdef VERBOSE_PROTOCOL
         Debug_printf("Returning: %s, %u, %s\r\n", buf, fileSize, is_directory ? "DIR" : "FILE");
 #endif
@@ -572,7 +570,7 @@ bool NetworkProtocolHTTP::close_dir_handle()
 #ifdef VERBOSE_PROTOCOL
     Debug_printf("NetworkProtocolHTTP::close_dir_handle()\r\n");
 #endif
-    webDAV.clear(); // release directory entries
+    davEntries.clear(); // release directory entries
     return false;
 }
 
@@ -669,7 +667,11 @@ bool NetworkProtocolHTTP::write_file_handle_send_post_data(uint8_t *buf, unsigne
         return true;
     }
 
-    postData += std::string((char *)buf, len);
+    if (!buffer_append(&postData, (char *)buf, len))
+    {
+        error = NETWORK_ERROR_NO_SPACE_ON_DEVICE;
+        return true;
+    }
     return false;
 }
 
@@ -681,7 +683,11 @@ bool NetworkProtocolHTTP::write_file_handle_data(uint8_t *buf, unsigned short le
         return true;
     }
 
-    postData += std::string((char *)buf, len);
+    if (!buffer_append(&postData, (char *)buf, len))
+    {
+        error = NETWORK_ERROR_NO_SPACE_ON_DEVICE;
+        return true;
+    }
     return false; // come back here later.
 }
 
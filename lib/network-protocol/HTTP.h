@@ -28,9 +28,17 @@
 #define OPEN_MODE_HTTP_DELETE   (0x05)
 #define OPEN_MODE_HTTP_DELETE_H (0x09)
 
+// Most of a PROPFIND response read and parsed at a time
+#define WEBDAV_READ_CHUNK_SIZE 1024
+
 class NetworkProtocolHTTP : public NetworkProtocolFS
 {
 public:
+    /**
+     * @brief POST/PUT bodies count against the buffer quota too
+     */
+    size_t buffered_bytes() override { return NetworkProtocolFS::buffered_bytes() + postData.size(); }
+
     /**
      * @brief ctor
      * @param rx_buf pointer to receive buffer
@@ -245,9 +253,9 @@ private:
     WebDAV webDAV;
 
     /**
-     * Current Directory entry cursor
+     * Directory entries from the last PROPFIND, read back in the order the server gave them
      */
-    std::vector<WebDAV::DAVEntry>::iterator dirEntryCursor;
+    DirCache davEntries;
 
     /**
      * Do HTTP transaction
@@ -6,9 +6,12 @@
 
 #include <algorithm>
 #include <errno.h>
+#include <string.h>
 
 #include "../../include/debug.h"
 
+#include "fnSystem.h"
+
 #include "compat_inet.h"
 #include "status_error_codes.h"
 #include "utils.h"
@@ -29,16 +32,116 @@ using namespace std;
 #define ATASCII_TAB 0x7F
 #define ATASCII_BUZZER 0xFD
 
-#define STR_ASCII_BELL "\x07"
-#define STR_ASCII_BACKSPACE "\x08"
-#define STR_ASCII_TAB "\x09"
-#define STR_ASCII_LF "\x0a"
-#define STR_ASCII_CR "\x0d"
-#define STR_ASCII_CRLF "\x0d\x0a"
-#define STR_ATASCII_EOL "\x9b"
-#define STR_ATASCII_DEL "\x7e"
-#define STR_ATASCII_TAB "\x7f"
-#define STR_ATASCII_BUZZER "\xfd"
+// Translation works a word at a time, bytes not being translated are only
+// looked at as part of a word
+typedef uintptr_t translation_word;
+#define TRANSLATION_ONES (~(translation_word)0 / 0xFF)
+#define TRANSLATION_HIGHS (TRANSLATION_ONES << 7)
+
+// Non-zero if any byte of w is b
+static inline translation_word translation_has(translation_word w, uint8_t b)
+{
+    translation_word x = w ^ (TRANSLATION_ONES * b);
+    return (x - TRANSLATION_ONES) & ~x & TRANSLATION_HIGHS;
+}
+
+/**
+ * Byte for byte translation, with at most one byte value dropped altogether
+ */
+class translation_map
+{
+private:
+    uint8_t _to[256];
+    uint8_t _special[8];
+    int _specials = 0;
+    int _drop = -1;
+
+    bool special(translation_word w)
+    {
+        translation_word found = 0;
+        for (int i = 0; i < _specials; i++)
+            found |= translation_has(w, _special[i]);
+        return found != 0;
+    }
+
+public:
+    translation_map()
+    {
+        for (int i = 0; i < 256; i++)
+            _to[i] = i;
+    }
+
+    void set(uint8_t from, uint8_t to)
+    {
+        _to[from] = to;
+        _special[_specials++] = from;
+    }
+
+    void drop(uint8_t from)
+    {
+        _drop = from;
+        _special[_specials++] = from;
+    }
+
+    uint8_t to(uint8_t c) { return _to[c]; }
+
+    /**
+     * Translate len bytes of buf in place, returns the length left
+     */
+    size_t apply(uint8_t *buf, size_t len)
+    {
+        size_t r = 0, w = 0;
+
+        while (r < len)
+        {
+            if ((((uintptr_t)&buf[r]) & (sizeof(translation_word) - 1)) == 0 && len - r >= sizeof(translation_word))
+            {
+                translation_word v;
+                memcpy(&v, __builtin_assume_aligned(&buf[r], sizeof(v)), sizeof(v));
+                if (!special(v))
+                {
+                    // Only moved once something before it was dropped
+                    if (w != r)
+                        memcpy(&buf[w], &v, sizeof(v));
+                    r += sizeof(v);
+                    w += sizeof(v);
+                    continue;
+                }
+            }
+
+            uint8_t c = buf[r++];
+            if (c != _drop)
+                buf[w++] = _to[c];
+        }
+
+        return w;
+    }
+};
+
+// Count of bytes in buf that are b
+static size_t translation_count(const uint8_t *buf, size_t len, uint8_t b)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i < len)
+    {
+        if ((((uintptr_t)&buf[i]) & (sizeof(translation_word) - 1)) == 0 && len - i >= sizeof(translation_word))
+        {
+            translation_word v;
+            memcpy(&v, __builtin_assume_aligned(&buf[i], sizeof(v)), sizeof(v));
+            if (!translation_has(v, b))
+            {
+                i += sizeof(translation_word);
+                continue;
+            }
+        }
+        if (buf[i++] == b)
+            count++;
+    }
+
+    return count;
+}
 
 /**
  * NWD
@@ -159,6 +262,7 @@ bool NetworkProtocol::read(unsigned short len)
     Debug_printf("NetworkProtocol::read(%u)\r\n", len);
 #endif
     translate_receive_buffer();
+    track_buffer_peak();
     error = 1;
     return false;
 }
@@ -173,6 +277,45 @@ bool NetworkProtocol::write(unsigned short len)
     return false;
 }
 
+size_t NetworkProtocol::buffer_quota()
+{
+#ifdef ESP_PLATFORM
+    return fnSystem.get_psram_size() > 0 ? NETWORK_BUFFER_QUOTA_PSRAM : NETWORK_BUFFER_QUOTA;
+#else
+    return NETWORK_BUFFER_QUOTA_PSRAM;
+#endif
+}
+
+bool NetworkProtocol::buffer_append(std::string *buf, const char *data, size_t len)
+{
+    if (buffered_bytes() + len > buffer_quota())
+    {
+        Debug_printf("NetworkProtocol::buffer_append(%u) would exceed quota of %u bytes\r\n", (unsigned)len, (unsigned)buffer_quota());
+        return false;
+    }
+
+    size_t needed = buf->size() + len;
+    if (needed > buf->capacity())
+    {
+        // Grow by at least half again so runs of small appends don't copy every time
+        size_t grow = buf->capacity() + buf->capacity() / 2;
+        if (grow > needed)
+            needed = grow;
+        buf->reserve((needed + NETWORK_BUFFER_CHUNK_SIZE - 1) / NETWORK_BUFFER_CHUNK_SIZE * NETWORK_BUFFER_CHUNK_SIZE);
+    }
+    buf->append(data, len);
+
+    track_buffer_peak();
+    return true;
+}
+
+void NetworkProtocol::track_buffer_peak()
+{
+    size_t held = buffered_bytes();
+    if (held > bufferPeak)
+        bufferPeak = held;
+}
+
 /**
  * @brief Return protocol status information in provided NetworkStatus object.
  * @param status a pointer to a NetworkStatus object to receive status information
@@ -206,36 +349,40 @@ void NetworkProtocol::translate_receive_buffer()
     if (translation_mode == 0)
         return;
 
+    if (translation_mode == TRANSLATION_MODE_PETSCII)
+    {
+#ifdef VERBOSE_PROTOCOL
+        Debug_printf("!!! PETSCII !!!\r\n");
+#endif
+        *receiveBuffer = mstr::toUTF8(*receiveBuffer);
+        return;
+    }
+
+    translation_map map;
     #ifdef BUILD_ATARI
-    replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_BELL, ATASCII_BUZZER);
-    replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_BACKSPACE, ATASCII_DEL);
-    replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_TAB, ATASCII_TAB);
-    #endif   
+    map.set(ASCII_BELL, ATASCII_BUZZER);
+    map.set(ASCII_BACKSPACE, ATASCII_DEL);
+    map.set(ASCII_TAB, ATASCII_TAB);
+    #endif
 
     switch (translation_mode)
     {
     case TRANSLATION_MODE_CR:
-        replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_CR, EOL);
+        map.set(ASCII_CR, EOL);
         break;
     case TRANSLATION_MODE_LF:
-        replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_LF, EOL);
+        map.set(ASCII_LF, EOL);
         break;
     case TRANSLATION_MODE_CRLF:
     #ifndef BUILD_APPLE
         // With Apple2, we would be translating CR to CR; a waste of CPU
-        replace(receiveBuffer->begin(), receiveBuffer->end(), ASCII_CR, EOL);
+        map.set(ASCII_CR, EOL);
     #endif
-        break;
-    case TRANSLATION_MODE_PETSCII:
-#ifdef VERBOSE_PROTOCOL
-        Debug_printf("!!! PETSCII !!!\r\n");
-#endif
-        *receiveBuffer = mstr::toUTF8(*receiveBuffer);
+        map.drop(ASCII_LF);
         break;
     }
 
-    if (translation_mode == TRANSLATION_MODE_CRLF)
-        receiveBuffer->erase(std::remove(receiveBuffer->begin(), receiveBuffer->end(), '\n'), receiveBuffer->end());
+    receiveBuffer->resize(map.apply((uint8_t *)&(*receiveBuffer)[0], receiveBuffer->size()));
 }
 
 /**
@@ -250,28 +397,58 @@ unsigned short NetworkProtocol::translate_transmit_buffer()
     if (translation_mode == 0)
         return transmitBuffer->length();
 
+    if (translation_mode == TRANSLATION_MODE_PETSCII)
+    {
+        *transmitBuffer = mstr::toUTF8(*transmitBuffer);
+        return transmitBuffer->length();
+    }
+
+    translation_map map;
     #ifdef BUILD_ATARI
-    util_replaceAll(*transmitBuffer, STR_ATASCII_BUZZER, STR_ASCII_BELL);
-    util_replaceAll(*transmitBuffer, STR_ATASCII_DEL, STR_ASCII_BACKSPACE);
-    util_replaceAll(*transmitBuffer, STR_ATASCII_TAB, STR_ASCII_TAB);
+    map.set(ATASCII_BUZZER, ASCII_BELL);
+    map.set(ATASCII_DEL, ASCII_BACKSPACE);
+    map.set(ATASCII_TAB, ASCII_TAB);
     #endif
 
     switch (translation_mode)
     {
     case TRANSLATION_MODE_CR:
-        util_replaceAll(*transmitBuffer, STR_EOL, STR_ASCII_CR);
+        map.set(EOL, ASCII_CR);
         break;
     case TRANSLATION_MODE_LF:
-        util_replaceAll(*transmitBuffer, STR_EOL, STR_ASCII_LF);
+        map.set(EOL, ASCII_LF);
         break;
     case TRANSLATION_MODE_CRLF:
-        util_replaceAll(*transmitBuffer, STR_EOL, STR_ASCII_CRLF);
-        break;
-    case TRANSLATION_MODE_PETSCII:
-        *transmitBuffer = mstr::toUTF8(*transmitBuffer);
-        break;
+        {
+            // Each EOL becomes two bytes, so grow once and fill in from the
+            // end rather than insert at every line
+            size_t len = transmitBuffer->size();
+            size_t lines = translation_count((const uint8_t *)transmitBuffer->data(), len, EOL);
+            size_t r = len;
+            if (lines > 0)
+            {
+                transmitBuffer->resize(len + lines);
+                uint8_t *buf = (uint8_t *)&(*transmitBuffer)[0];
+                size_t w = len + lines;
+                while (w > r)
+                {
+                    uint8_t c = buf[--r];
+                    if (c == EOL)
+                    {
+                        buf[--w] = ASCII_LF;
+                        buf[--w] = ASCII_CR;
+                    }
+                    else
+                        buf[--w] = map.to(c);
+                }
+            }
+            // Everything before the first EOL is still where it was
+            map.apply((uint8_t *)&(*transmitBuffer)[0], r);
+            return transmitBuffer->length();
+        }
     }
 
+    map.apply((uint8_t *)&(*transmitBuffer)[0], transmitBuffer->size());
     return transmitBuffer->length();
 }
 
@@ -7,6 +7,17 @@
 #include "networkStatus.h"
 #include "peoples_url_parser.h"
 
+/**
+ * Network buffers grow in whole chunks of this size, so freed blocks suit the next buffer
+ */
+#define NETWORK_BUFFER_CHUNK_SIZE 512
+
+/**
+ * Most bytes one device's protocol may hold in its buffers at once
+ */
+#define NETWORK_BUFFER_QUOTA (32 * 1024)
+#define NETWORK_BUFFER_QUOTA_PSRAM (1024 * 1024)
+
 enum {
     PROTOCOL_OPEN_READ          = 4,
     PROTOCOL_OPEN_HTTP_DELETE   = 5,
@@ -229,6 +240,32 @@ public:
 
     virtual off_t seek(off_t offset, int whence);
 
+    /**
+     * @brief Append data to a protocol buffer, growing it in NETWORK_BUFFER_CHUNK_SIZE steps.
+     * Refuses data that would take buffered_bytes() past buffer_quota(); the caller should
+     * report NETWORK_ERROR_NO_SPACE_ON_DEVICE so the computer backs off and drains.
+     * @param buf the buffer to append to
+     * @param data the bytes to add
+     * @param len number of bytes to add
+     * @return true if the data was added, false if it would exceed the quota.
+     */
+    bool buffer_append(std::string *buf, const char *data, size_t len);
+
+    /**
+     * @brief Bytes currently held for this device. Protocols with buffers of their own add them in.
+     */
+    virtual size_t buffered_bytes() { return receiveBuffer->size() + transmitBuffer->size(); }
+
+    /**
+     * @brief Most bytes a device's protocol may hold in its buffers
+     */
+    static size_t buffer_quota();
+
+    /**
+     * @brief Most bytes buffered_bytes() has reached since the protocol was created
+     */
+    size_t bufferPeak = 0;
+
     /**
      * Pointer to current login;
      */
@@ -262,6 +299,11 @@ protected:
      */
     unsigned short translate_transmit_buffer();
 
+    /**
+     * Update bufferPeak with what we're currently holding
+     */
+    void track_buffer_peak();
+
 };
 
 #endif /* NETWORKPROTOCOL_H */
@@ -18,6 +18,7 @@
 
 #include "status_error_codes.h"
 #include "utils.h"
+#include "fnSMBPool.h"
 
 #include <vector>
 
@@ -29,13 +30,15 @@ NetworkProtocolSMB::NetworkProtocolSMB(std::string *rx_buf, std::string *tx_buf,
     mkdir_implemented = true;
     rmdir_implemented = true;
     Debug_printf("NetworkProtocolSMB::ctor\r\n");
-    smb = smb2_init_context();
 }
 
 NetworkProtocolSMB::~NetworkProtocolSMB()
 {
     Debug_printf("NetworkProtocolSMB::dtor\r\n");
-    smb2_destroy_context(smb);
+    delete readahead;
+    if (smb_url != nullptr)
+        smb2_destroy_url(smb_url);
+    smb_pool_release(smb);
 }
 
 bool NetworkProtocolSMB::open_file_handle()
@@ -77,6 +80,7 @@ bool NetworkProtocolSMB::open_file_handle()
     }
 
     offset = 0;
+    readahead = new SMBReadahead(smb, fh);
 
     Debug_printf("DO WE FUCKING GET HERE?!\r\n");
 
@@ -113,38 +117,19 @@ bool NetworkProtocolSMB::mount(PeoplesUrlParser *url)
 #endif
 
     Debug_printf("NetworkProtocolSMB::mount() - openURL: %s\r\n", openURL.c_str());
-    smb_url = smb2_parse_url(smb, openURL.c_str());
-    if (smb_url == nullptr) 
+
+    // A session left by an earlier open of the share saves connecting it again
+    std::string smb_error_text;
+    smb = smb_pool_connect(openURL.c_str(), login != nullptr ? login->c_str() : nullptr,
+                           login != nullptr ? password->c_str() : nullptr, &smb_url, &smb_error_text);
+    if (smb == nullptr)
     {
-        Debug_printf("aNetworkProtocolSMB::mount(%s) - failed to parse URL, SMB2 error: %s\n", openURL.c_str(), smb2_get_error(smb));
+        Debug_printf("aNetworkProtocolSMB::mount(%s) - could not mount, SMB2 error: %s\r\n", openURL.c_str(), smb_error_text.c_str());
+        smb_error = -1;
         fserror_to_error();
         return true;
     }
 
-    smb2_set_security_mode(smb, SMB2_NEGOTIATE_SIGNING_ENABLED);
-
-    if (login != nullptr)
-    {
-        smb2_set_user(smb, login->c_str());
-        smb2_set_password(smb, password->c_str());
-
-        if ((smb_error = smb2_connect_share(smb, smb_url->server, smb_url->share, login->c_str())) != 0)
-        {
-            Debug_printf("aNetworkProtocolSMB::mount(%s) - could not mount, SMB2 error: %s\r\n", openURL.c_str(), smb2_get_error(smb));
-            fserror_to_error();
-            return true;
-        }
-    }
-    else // no u/p
-    {
-        if ((smb_error = smb2_connect_share(smb, smb_url->server, smb_url->share, smb_url->user)) != 0)
-        {
-            Debug_printf("aNetworkProtocolSMB::mount(%s) - could not mount, SMB2 error: %s\r\n", openURL.c_str(), smb2_get_error(smb));
-            fserror_to_error();
-            return true;
-        }
-    }
-
     return false;
 }
 
@@ -153,12 +138,17 @@ bool NetworkProtocolSMB::umount()
     if (smb == nullptr)
         return true;
 
-    smb2_disconnect_share(smb);
+    // Parked, still connected, for the next open of the share
+    delete readahead;
+    readahead = nullptr;
+    smb_pool_release(smb);
+    smb = nullptr;
 
     if (smb_url == nullptr)
         return true;
 
     smb2_destroy_url(smb_url);
+    smb_url = nullptr;
     return false;
 }
 
@@ -176,7 +166,7 @@ bool NetworkProtocolSMB::read_file_handle(uint8_t *buf, unsigned short len)
 {
     int actual_len;
 
-    if ((actual_len = smb2_pread(smb, fh, buf, len, offset)) != len)
+    if ((actual_len = readahead->pread(buf, len, offset)) != len)
     {
         fserror_to_error();
         return true;
@@ -209,6 +199,8 @@ bool NetworkProtocolSMB::read_dir_entry(char *buf, unsigned short len)
 
 bool NetworkProtocolSMB::close_file_handle()
 {
+    delete readahead;
+    readahead = nullptr;
     smb2_close(smb, fh);
     return false;
 }
@@ -223,6 +215,8 @@ bool NetworkProtocolSMB::write_file_handle(uint8_t *buf, unsigned short len)
 {
     int actual_len;
 
+    readahead->invalidate();
+
     if ((actual_len = smb2_pwrite(smb, fh, buf, len, offset)) != len)
     {
         fserror_to_error();
@@ -266,7 +260,8 @@ bool NetworkProtocolSMB::del(PeoplesUrlParser *url, cmdFrame_t *cmdFrame)
 
 bool NetworkProtocolSMB::mkdir(PeoplesUrlParser *url, cmdFrame_t *cmdFrame)
 {
-    mount(url);
+    if (mount(url))
+        return true;
 
     if (smb2_mkdir(smb, smb_url->path) != 0)
     {
@@ -281,7 +276,8 @@ bool NetworkProtocolSMB::mkdir(PeoplesUrlParser *url, cmdFrame_t *cmdFrame)
 
 bool NetworkProtocolSMB::rmdir(PeoplesUrlParser *url, cmdFrame_t *cmdFrame)
 {
-    mount(url);
+    if (mount(url))
+        return true;
 
     if (smb2_rmdir(smb, smb_url->path) != 0)
     {
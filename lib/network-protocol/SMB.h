@@ -2,6 +2,7 @@
 #define NETWORKPROTOCOLSMB_H
 
 #include "FS.h"
+#include "fnFileSMB.h"
 
 
 class NetworkProtocolSMB : public NetworkProtocolFS
@@ -223,6 +224,11 @@ private:
      */
     uint64_t offset = 0;
 
+    /**
+     * READs sent ahead of the open file's reader
+     */
+    SMBReadahead *readahead = nullptr;
+
     /**
      * @brief get status of file, filling in filesize. mount() must have already been called.
      */
@@ -6,8 +6,16 @@
 
 #include "../../include/debug.h"
 
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
 #include "status_error_codes.h"
+#include "fnArena.h"
+#include "fnSystem.h"
 
+#include <algorithm>
 #include <vector>
 
 #define RXBUF_SIZE 65535
@@ -16,21 +24,14 @@ NetworkProtocolSSH::NetworkProtocolSSH(std::string *rx_buf, std::string *tx_buf,
     : NetworkProtocol(rx_buf, tx_buf, sp_buf)
 {
     Debug_printf("NetworkProtocolSSH::NetworkProtocolSSH(%p,%p,%p)\r\n", rx_buf, tx_buf, sp_buf);
-#ifdef ESP_PLATFORM
-    rxbuf = (char *)heap_caps_malloc(RXBUF_SIZE, MALLOC_CAP_SPIRAM);
-#else
-    rxbuf = (char *)malloc(RXBUF_SIZE);
-#endif
+    rxbuf = (char *)fnArena.malloc(ARENA_NETWORK, RXBUF_SIZE);
 }
 
 NetworkProtocolSSH::~NetworkProtocolSSH()
 {
     Debug_printf("NetworkProtocolSSH::~NetworkProtocolSSH()\r\n");
-#ifdef ESP_PLATFORM
-    heap_caps_free(rxbuf);
-#else
-    free(rxbuf);
-#endif
+    stop_poller();
+    fnArena.free(ARENA_NETWORK, rxbuf);
 }
 
 bool NetworkProtocolSSH::open(PeoplesUrlParser *urlParser, cmdFrame_t *cmdFrame)
@@ -82,6 +83,10 @@ bool NetworkProtocolSSH::open(PeoplesUrlParser *urlParser, cmdFrame_t *cmdFrame)
     ssh_options_set(session, SSH_OPTIONS_PORT, &port);
 #ifdef ESP_PLATFORM // apc: access to private member!
     session->opts.config_processed = true;
+    // AES runs on the ESP32's crypto hardware, ChaCha20 would be all software
+    const char *ciphers = "aes128-ctr,aes128-gcm@openssh.com,aes256-ctr,aes256-gcm@openssh.com";
+    ssh_options_set(session, SSH_OPTIONS_CIPHERS_C_S, ciphers);
+    ssh_options_set(session, SSH_OPTIONS_CIPHERS_S_C, ciphers);
 #endif
 
     ret = ssh_connect(session);
@@ -210,11 +215,14 @@ bool NetworkProtocolSSH::open(PeoplesUrlParser *urlParser, cmdFrame_t *cmdFrame)
     // At this point, we should be able to talk to the shell.
     Debug_printf("Shell opened.\r\n");
 
+    start_poller();
+
     return false;
 }
 
 bool NetworkProtocolSSH::close()
 {
+    stop_poller();
     ssh_disconnect(session);
     ssh_free(session);
     return false;
@@ -231,7 +239,10 @@ bool NetworkProtocolSSH::write(unsigned short len)
     bool err = false;
 
     len = translate_transmit_buffer();
-    ssh_channel_write(channel, transmitBuffer->data(), len);
+    {
+        std::lock_guard<std::mutex> lock(sshMutex);
+        ssh_channel_write(channel, transmitBuffer->data(), len);
+    }
 
     // Return success - WTF?
     error = 1;
@@ -243,7 +254,11 @@ bool NetworkProtocolSSH::write(unsigned short len)
 bool NetworkProtocolSSH::status(NetworkStatus *status)
 {
     status->rxBytesWaiting = available();
-    bool isEOF = ssh_channel_is_eof(channel) == 0;
+    bool isEOF;
+    {
+        std::lock_guard<std::mutex> lock(sshMutex);
+        isEOF = ssh_channel_is_eof(channel) == 0;
+    }
     status->connected = isEOF ? 1 : 0;
     status->error = isEOF ? 1 : NETWORK_ERROR_END_OF_FILE;
     NetworkProtocol::status(status);
@@ -274,16 +289,84 @@ unsigned short NetworkProtocolSSH::available()
 {
     if (receiveBuffer->length() == 0)
     {
-        if (ssh_channel_is_eof(channel) == 0)
         {
-            int len = ssh_channel_read(channel, rxbuf, RXBUF_SIZE, 0);
-            if (len != SSH_AGAIN)
+            std::lock_guard<std::mutex> lock(sshMutex);
+            receiveBuffer->swap(rxStage);
+        }
+        if (receiveBuffer->length() > 0)
+            translate_receive_buffer();
+    }
+
+    return receiveBuffer->length();
+}
+
+void NetworkProtocolSSH::start_poller()
+{
+    stop_poller();
+
+    taskStop = false;
+    taskRunning = true;
+#ifdef ESP_PLATFORM
+    if (xTaskCreatePinnedToCore(poll_task, "ssh_rx", SSH_TASK_STACKSIZE, this,
+                                SSH_TASK_PRIORITY, nullptr, 0) != pdPASS)
+    {
+        Debug_printf("NetworkProtocolSSH - failed to start poller\r\n");
+        taskRunning = false;
+    }
+#else
+    task = std::thread(&NetworkProtocolSSH::poll_loop, this);
+#endif
+}
+
+void NetworkProtocolSSH::stop_poller()
+{
+    taskStop = true;
+#ifdef ESP_PLATFORM
+    while (taskRunning)
+        fnSystem.delay(10);
+#else
+    if (task.joinable())
+        task.join();
+#endif
+
+    std::lock_guard<std::mutex> lock(sshMutex);
+    rxStage.clear();
+}
+
+#ifdef ESP_PLATFORM
+void NetworkProtocolSSH::poll_task(void *param)
+{
+    ((NetworkProtocolSSH *)param)->poll_loop();
+    vTaskDelete(nullptr);
+}
+#endif
+
+void NetworkProtocolSSH::poll_loop()
+{
+    // Reading only when the computer asked left the channel idle between its
+    // polls; draining it as data comes keeps the window libssh advertises open
+    while (rxbuf != nullptr && !taskStop)
+    {
+        int len = 0;
+        {
+            std::lock_guard<std::mutex> lock(sshMutex);
+            if (ssh_channel_is_eof(channel) != 0 || !ssh_channel_is_open(channel))
+                break;
+
+            size_t room = SSH_RX_STAGE_MAX - std::min(rxStage.length(), (size_t)SSH_RX_STAGE_MAX);
+            if (room > 0)
             {
-                receiveBuffer->append(rxbuf, len);
-                translate_receive_buffer();
+                len = ssh_channel_read_nonblocking(channel, rxbuf, std::min(room, (size_t)RXBUF_SIZE), 0);
+                if (len > 0)
+                    rxStage.append(rxbuf, len);
             }
         }
+
+        if (len == SSH_ERROR)
+            break;
+        if (len <= 0)
+            fnSystem.delay(SSH_POLL_INTERVAL);
     }
 
-    return receiveBuffer->length();
+    taskRunning = false;
 }
@@ -9,8 +9,14 @@
 #include <lwip/sockets.h>
 #endif
 
+#include <atomic>
+#include <mutex>
 #include <string>
 
+#ifndef ESP_PLATFORM
+#include <thread>
+#endif
+
 #include "Protocol.h"
 
 #include "fnTcpClient.h"
@@ -20,6 +26,17 @@
 #include "libssh/session.h"
 #endif
 
+// Bytes the poller holds for the computer before it stops reading and lets the channel window fill
+#ifdef ESP_PLATFORM
+#define SSH_RX_STAGE_MAX 16384
+#else
+#define SSH_RX_STAGE_MAX 65536
+#endif
+// How long the poller sleeps when the channel had nothing, in ms
+#define SSH_POLL_INTERVAL 10
+#define SSH_TASK_STACKSIZE 6144
+#define SSH_TASK_PRIORITY 5
+
 // using namespace std;
 
 class NetworkProtocolSSH : public NetworkProtocol
@@ -129,6 +146,32 @@ private:
      */
     char *rxbuf = nullptr;
 
+    /**
+     * What the poller has read off the channel and the computer hasn't been given yet
+     */
+    std::string rxStage;
+
+    /**
+     * Held for every libssh call on the session, which isn't safe to use from two tasks at once, and for rxStage
+     */
+    std::mutex sshMutex;
+
+    std::atomic<bool> taskRunning{false};
+    std::atomic<bool> taskStop{false};
+#ifndef ESP_PLATFORM
+    std::thread task;
+#endif
+
+    /**
+     * Start and stop the poller that drains the channel into rxStage while the shell is open
+     */
+    void start_poller();
+    void stop_poller();
+    void poll_loop();
+#ifdef ESP_PLATFORM
+    static void poll_task(void *param);
+#endif
+
     /**
      * Return if bytes available by injecting into RX buffer.
      * @return number of bytes available
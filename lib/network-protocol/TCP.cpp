@@ -92,6 +92,10 @@ bool NetworkProtocolTCP::close()
 
     NetworkProtocol::close();
 
+    for (uint8_t line = 0; line < clients.size(); line++)
+        drop_client(line);
+    clients.clear();
+
     if (client.connected())
     {
         Debug_printf("Closing client socket.\r\n");
@@ -115,7 +119,6 @@ bool NetworkProtocolTCP::close()
 bool NetworkProtocolTCP::read(unsigned short len)
 {
     unsigned short actual_len = 0;
-    std::vector<uint8_t> newData = std::vector<uint8_t>(len);
 
     Debug_printf("NetworkProtocolTCP::read(%u)\r\n", len);
 
@@ -128,24 +131,25 @@ bool NetworkProtocolTCP::read(unsigned short len)
             return true; // error
         }
 
-        // Do the read from client socket.
-        actual_len = client.read(newData.data(), len);
+        // Do the read from client socket straight into the buffer; its capacity
+        // is kept between reads so this normally doesn't allocate.
+        receiveBuffer->resize(len);
+        actual_len = client.read((uint8_t *)&(*receiveBuffer)[0], len);
 
         // bail if the connection is reset.
         if (errno == ECONNRESET)
         {
+            receiveBuffer->clear();
             error = NETWORK_ERROR_CONNECTION_RESET;
             return true;
         }
         else if (actual_len != len) // Read was short and timed out.
         {
             Debug_printf("Short receive. We got %u bytes, returning %u bytes and ERROR\r\n", actual_len, len);
+            receiveBuffer->clear();
             error = NETWORK_ERROR_SOCKET_TIMEOUT;
             return true;
         }
-
-        // Add new data to buffer.
-        receiveBuffer->insert(receiveBuffer->end(), newData.begin(), newData.end());
     }    
     error = 1;
     return NetworkProtocol::read(len);
@@ -221,6 +225,31 @@ void NetworkProtocolTCP::status_client(NetworkStatus *status)
 
 void NetworkProtocolTCP::status_server(NetworkStatus *status)
 {
+    if (!clients.empty())
+    {
+        poll_clients();
+
+        if (selected_client != TCP_NO_CLIENT)
+        {
+            status_client(status);
+            clients[selected_client].waiting = status->rxBytesWaiting;
+            return;
+        }
+
+        // Without a selected line, report every line's data so the interrupt still fires
+        unsigned long waiting = 0;
+        bool connected = false;
+        for (server_client &c : clients)
+        {
+            waiting += c.waiting;
+            connected |= c.client.fd() >= 0;
+        }
+        status->rxBytesWaiting = waiting > 65535 ? 65535 : waiting;
+        status->connected = connected;
+        status->error = error;
+        return;
+    }
+
     if (client.connected())
         status_client(status);
     else
@@ -245,6 +274,12 @@ uint8_t NetworkProtocolTCP::special_inquiry(uint8_t cmd)
         return 0x00;
     case 'c':
         return 0x00;
+    case 'M':
+        return 0x00;
+    case 'L':
+        return 0x00;
+    case 'B':
+        return 0x40;
     }
 
     return 0xFF;
@@ -268,6 +303,10 @@ bool NetworkProtocolTCP::special_00(cmdFrame_t *cmdFrame)
         Debug_printf("CLOSING CLIENT CONNECTION!!!\n");
         return special_close_client_connection();
         break;
+    case 'M':
+        return special_multi_client(cmdFrame->aux1);
+    case 'L':
+        return special_select_client(cmdFrame->aux1);
     }
     return true; // error
 }
@@ -280,6 +319,11 @@ bool NetworkProtocolTCP::special_00(cmdFrame_t *cmdFrame)
  */
 bool NetworkProtocolTCP::special_40(uint8_t *sp_buf, unsigned short len, cmdFrame_t *cmdFrame)
 {
+    switch (cmdFrame->comnd)
+    {
+    case 'B':
+        return special_clients_status(sp_buf, len);
+    }
     return false;
 }
 
@@ -356,6 +400,18 @@ bool NetworkProtocolTCP::special_accept_connection()
         return true; // Error
     }
 
+    // In multi-client mode callers are accepted into lines; take the newest one
+    if (!clients.empty())
+    {
+        uint8_t line = poll_clients();
+        if (line == TCP_NO_CLIENT)
+        {
+            error = NETWORK_ERROR_NO_CONNECTION_WAITING;
+            return true;
+        }
+        return special_select_client(line);
+    }
+
     if (server->hasClient())
     {
         in_addr_t remoteIP;
@@ -401,6 +457,13 @@ bool NetworkProtocolTCP::special_close_client_connection()
         return false;
     }
 
+    // A selected line whose caller already hung up still needs freeing
+    if (selected_client != TCP_NO_CLIENT && !client.connected())
+    {
+        drop_client(selected_client);
+        return false;
+    }
+
     if (!client.connected())
     {
         Debug_printf("Attempted close client with no client connected.\r\n");
@@ -419,7 +482,199 @@ bool NetworkProtocolTCP::special_close_client_connection()
     transmitBuffer->clear();
     specialBuffer->clear();
 
+    if (selected_client != TCP_NO_CLIENT)
+        drop_client(selected_client);
     client.stop();
 
     return false;
+}
+
+/**
+ * Special: Switch the server to multi-client mode.
+ */
+bool NetworkProtocolTCP::special_multi_client(uint8_t lines)
+{
+    if (server == nullptr)
+    {
+        Debug_printf("Attempted multi-client mode on NULL server socket. Aborting.\r\n");
+        error = NETWORK_ERROR_SERVER_NOT_RUNNING;
+        return true;
+    }
+
+    if (lines == 0 || lines > TCP_SERVER_MAX_CLIENTS)
+        lines = TCP_SERVER_MAX_CLIENTS;
+    if (!clients.empty())
+    {
+        error = NETWORK_ERROR_INVALID_COMMAND;
+        return true;
+    }
+
+    Debug_printf("TCP server now holding up to %u clients\r\n", lines);
+    clients.resize(lines);
+
+    // A client accepted the single client way becomes line 0
+    if (client.connected())
+    {
+        clients[0].client = client;
+        selected_client = 0;
+    }
+    return false;
+}
+
+/**
+ * Special: Select the client line later reads and writes go to.
+ */
+bool NetworkProtocolTCP::special_select_client(uint8_t line)
+{
+    if (clients.empty())
+    {
+        error = NETWORK_ERROR_INVALID_COMMAND;
+        return true;
+    }
+
+    poll_clients();
+
+    if (line == TCP_NO_CLIENT)
+    {
+        // Round robin from the line after the selected one, so no caller is starved
+        uint8_t start = selected_client == TCP_NO_CLIENT ? 0 : selected_client + 1;
+        for (uint8_t i = 0; i < clients.size(); i++)
+        {
+            uint8_t l = (start + i) % clients.size();
+            if (clients[l].waiting > 0)
+            {
+                line = l;
+                break;
+            }
+        }
+        if (line == TCP_NO_CLIENT)
+        {
+            error = NETWORK_ERROR_NO_CONNECTION_WAITING;
+            return true;
+        }
+    }
+
+    if (line >= clients.size() || clients[line].client.fd() < 0)
+    {
+        error = NETWORK_ERROR_NOT_CONNECTED;
+        return true;
+    }
+
+    if (line != selected_client)
+    {
+        // Whatever was read ahead for the last line belongs to it
+        receiveBuffer->clear();
+        transmitBuffer->clear();
+    }
+    selected_client = line;
+    client = clients[line].client;
+    return false;
+}
+
+/**
+ * Special: Fill sp_buf with the status frame of every line: the number of lines, the selected
+ * line (or $FF), whether a caller is waiting for a free line, then for each line its connected
+ * flag and bytes waiting (LO/HI).
+ */
+bool NetworkProtocolTCP::special_clients_status(uint8_t *sp_buf, unsigned short len)
+{
+    if (clients.empty() || len < 3 + 3 * clients.size())
+    {
+        error = NETWORK_ERROR_INVALID_COMMAND;
+        return true;
+    }
+
+    poll_clients();
+
+    sp_buf[0] = clients.size();
+    sp_buf[1] = selected_client;
+    sp_buf[2] = server->hasClient();
+    for (uint8_t line = 0; line < clients.size(); line++)
+    {
+        uint8_t *p = &sp_buf[3 + 3 * line];
+        p[0] = clients[line].client.fd() >= 0;
+        p[1] = clients[line].waiting & 0xFF;
+        p[2] = clients[line].waiting >> 8;
+    }
+    return false;
+}
+
+/**
+ * Multi-client mode: accept waiting callers into free lines, then check every line for new
+ * data or a hang up with a single select().
+ */
+uint8_t NetworkProtocolTCP::poll_clients()
+{
+    uint8_t accepted = TCP_NO_CLIENT;
+
+    for (uint8_t line = 0; line < clients.size(); line++)
+    {
+        if (clients[line].client.fd() >= 0)
+            continue;
+        if (!server->hasClient())
+            break;
+
+        clients[line].client = server->available();
+        clients[line].waiting = 0;
+        if (clients[line].client.connected())
+        {
+            Debug_printf("Accepted connection from %s:%u on line %u\r\n",
+                         compat_inet_ntoa(clients[line].client.remoteIP()), clients[line].client.remotePort(), line);
+            accepted = line;
+        }
+    }
+
+    fd_set readable;
+    FD_ZERO(&readable);
+    int max_fd = -1;
+    for (server_client &c : clients)
+    {
+        int fd = c.client.fd();
+        if (fd < 0)
+            continue;
+        FD_SET(fd, &readable);
+        if (fd > max_fd)
+            max_fd = fd;
+    }
+    if (max_fd < 0)
+        return accepted;
+
+    struct timeval tv = {0, 0};
+    if (select(max_fd + 1, &readable, nullptr, nullptr, &tv) < 0)
+        return accepted;
+
+    // Readable with nothing to read is a hang up. The selected line is being read from,
+    // so what it has waiting changes without it being readable
+    for (uint8_t line = 0; line < clients.size(); line++)
+    {
+        server_client &c = clients[line];
+        if (c.client.fd() < 0 || (!FD_ISSET(c.client.fd(), &readable) && line != selected_client))
+            continue;
+
+        int waiting = c.client.available();
+        if (waiting == 0 && !c.client.connected())
+        {
+            Debug_printf("Client on line %u disconnected\r\n", line);
+            drop_client(line);
+            continue;
+        }
+        c.waiting = waiting > 65535 ? 65535 : waiting;
+    }
+
+    return accepted;
+}
+
+/**
+ * Multi-client mode: hang up a line, deselecting it if it was selected.
+ */
+void NetworkProtocolTCP::drop_client(uint8_t line)
+{
+    // The selected client is a copy sharing the socket, which closes when both let go
+    if (line == selected_client)
+    {
+        client.stop();
+        selected_client = TCP_NO_CLIENT;
+    }
+    clients[line].client.stop();
+    clients[line].waiting = 0;
 }
\ No newline at end of file
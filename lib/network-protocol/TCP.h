@@ -7,9 +7,21 @@
 
 #include "Protocol.h"
 
+#include <vector>
+
 #include "fnTcpClient.h"
 #include "fnTcpServer.h"
 
+/**
+ * Most callers a server in multi-client mode holds at once
+ */
+#define TCP_SERVER_MAX_CLIENTS 8
+
+/**
+ * selected_client when no client is selected, and the 'L' aux1 asking for the next one with data
+ */
+#define TCP_NO_CLIENT 0xFF
+
 class NetworkProtocolTCP : public NetworkProtocol
 {
 public:
@@ -93,9 +105,29 @@ protected:
 
     /**
      * a fnTcpClient object representing a client TCP socket.
+     * In multi-client mode, a copy of the selected client, sharing its socket and receive buffer.
      */
     fnTcpClient client;
 
+    /**
+     * A caller held by a server in multi-client mode, and what it had waiting when last polled.
+     */
+    struct server_client
+    {
+        fnTcpClient client;
+        unsigned short waiting = 0;
+    };
+
+    /**
+     * Multi-client mode: one entry per line, empty unless the server was switched to it with 'M'.
+     */
+    std::vector<server_client> clients;
+
+    /**
+     * The line read(), write() and status() act on in multi-client mode, or TCP_NO_CLIENT.
+     */
+    uint8_t selected_client = TCP_NO_CLIENT;
+
 
     /**
      * Open a server (listening) connection.
@@ -122,6 +154,37 @@ protected:
      */
     bool special_close_client_connection();
 
+    /**
+     * Special: Switch the server to multi-client mode.
+     * @param lines Most clients to hold at once, 0 for TCP_SERVER_MAX_CLIENTS.
+     */
+    bool special_multi_client(uint8_t lines);
+
+    /**
+     * Special: Select the client line later reads and writes go to.
+     * @param line The line, or TCP_NO_CLIENT for the next line after the selected one with data waiting.
+     */
+    bool special_select_client(uint8_t line);
+
+    /**
+     * Special: Fill sp_buf with the status frame of every line.
+     * @param sp_buf destination buffer
+     * @param len size of sp_buf
+     */
+    bool special_clients_status(uint8_t *sp_buf, unsigned short len);
+
+    /**
+     * Multi-client mode: accept waiting callers into free lines, then check every line for
+     * new data or a hang up with a single select().
+     * @return the last line a caller was accepted into, or TCP_NO_CLIENT.
+     */
+    uint8_t poll_clients();
+
+    /**
+     * Multi-client mode: hang up a line, deselecting it if it was selected.
+     */
+    void drop_client(uint8_t line);
+
     /**
      * Return status of client connection
      * @param status pointer to destination NetworkStatus object
@@ -16,8 +16,6 @@
 #include "libtelnet.h"
 #include "status_error_codes.h"
 
-#include <vector>
-
 
 static const telnet_telopt_t telopts[] = {
     {TELNET_TELOPT_ECHO, TELNET_WONT, TELNET_DO},
@@ -43,7 +41,7 @@ static void _event_handler(telnet_t *telnet, telnet_event_t *ev, void *user_data
     switch (ev->type)
     {
     case TELNET_EV_DATA: // Received Data
-        *receiveBuffer += std::string(ev->data.buffer, ev->data.size);
+        receiveBuffer->append(ev->data.buffer, ev->data.size);
         protocol->newRxLen = receiveBuffer->size();
         break;
     case TELNET_EV_SEND:
@@ -104,8 +102,6 @@ NetworkProtocolTELNET::~NetworkProtocolTELNET()
  */
 bool NetworkProtocolTELNET::read(unsigned short len)
 {
-    std::vector<uint8_t> newData = std::vector<uint8_t>(len);
-
     Debug_printf("NetworkProtocolTELNET::read(%u)\r\n", len);
 
     if (receiveBuffer->length() == 0)
@@ -117,10 +113,14 @@ bool NetworkProtocolTELNET::read(unsigned short len)
             return true; // error
         }
 
-        // Do the read from client socket.
-        client.read(newData.data(), len);
+        // Do the read from client socket into a buffer kept between reads, and
+        // hand libtelnet only what actually arrived.
+        if (netBuffer.size() < len)
+            netBuffer.resize(len);
+        int actual_len = client.read(netBuffer.data(), len);
 
-        telnet_recv(telnet, (char *)newData.data(), len);
+        if (actual_len > 0)
+            telnet_recv(telnet, (char *)netBuffer.data(), actual_len);
 
         // bail if the connection is reset.
         if (errno == ECONNRESET)
@@ -5,6 +5,8 @@
 #ifndef NETWORKPROTOCOL_TELNET
 #define NETWORKPROTOCOL_TELNET
 
+#include <vector>
+
 #include "TCP.h"
 
 
@@ -56,7 +58,12 @@ public:
     int newRxLen;
 
     char ttype[32]="dumb";
-    
+
+private:
+    /**
+     * Raw bytes from the socket on their way to libtelnet, grown to the largest read and kept
+     */
+    std::vector<uint8_t> netBuffer;
 };
 
 #endif /* NETWORKPROTOCOL_TELNET */
\ No newline at end of file
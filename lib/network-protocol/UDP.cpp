@@ -7,6 +7,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
 #include "compat_inet.h"
 #include "compat_string.h"
 
@@ -14,9 +20,7 @@
 
 #include "status_error_codes.h"
 #include "fnDNS.h"
-
-#include <vector>
-
+#include "fnSystem.h"
 
 
 NetworkProtocolUDP::NetworkProtocolUDP(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf)
@@ -28,6 +32,7 @@ NetworkProtocolUDP::NetworkProtocolUDP(std::string *rx_buf, std::string *tx_buf,
 NetworkProtocolUDP::~NetworkProtocolUDP()
 {
     Debug_printf("NetworkProtocolUDP::dtor\r\n");
+    stop_receiver();
 }
 
 bool NetworkProtocolUDP::open(PeoplesUrlParser *urlParser, cmdFrame_t *cmdFrame)
@@ -77,6 +82,8 @@ bool NetworkProtocolUDP::open(PeoplesUrlParser *urlParser, cmdFrame_t *cmdFrame)
         Debug_printf("After begin: %s:%u\r\n", dest.c_str(), port);
     }
 
+    start_receiver();
+
     // call base class
     NetworkProtocol::open(urlParser, cmdFrame);
 
@@ -88,31 +95,127 @@ bool NetworkProtocolUDP::close()
     // Call base class.
     NetworkProtocol::close();
 
-    // unbind.
+    // unbind, once nothing's waiting on the socket
+    stop_receiver();
     udp.stop();
 
     return false; // all good.
 }
 
-bool NetworkProtocolUDP::read(unsigned short len)
+void NetworkProtocolUDP::start_receiver()
+{
+    stop_receiver();
+
+    taskStop = false;
+    taskRunning = true;
+#ifdef ESP_PLATFORM
+    if (xTaskCreatePinnedToCore(receive_task, "udp_rx", UDP_TASK_STACKSIZE, this,
+                                UDP_TASK_PRIORITY, nullptr, 0) != pdPASS)
+    {
+        Debug_printf("NetworkProtocolUDP - failed to start receiver\r\n");
+        taskRunning = false;
+    }
+#else
+    task = std::thread(&NetworkProtocolUDP::receive_loop, this);
+#endif
+}
+
+void NetworkProtocolUDP::stop_receiver()
 {
-    std::vector<uint8_t> newData = std::vector<uint8_t>(len);
+    taskStop = true;
+#ifdef ESP_PLATFORM
+    while (taskRunning)
+        fnSystem.delay(10);
+#else
+    if (task.joinable())
+        task.join();
+#endif
+
+    std::lock_guard<std::mutex> lock(rxQueueMutex);
+    rxQueue.clear();
+}
+
+#ifdef ESP_PLATFORM
+void NetworkProtocolUDP::receive_task(void *param)
+{
+    ((NetworkProtocolUDP *)param)->receive_loop();
+    vTaskDelete(nullptr);
+}
+#endif
+
+void NetworkProtocolUDP::receive_loop()
+{
+    uint8_t *buf = (uint8_t *)malloc(UDP_DATAGRAM_MAX);
+
+    // Between polls from the computer a burst of datagrams would otherwise
+    // overrun the socket, so take each off as it comes, as it came
+    while (buf != nullptr && !taskStop)
+    {
+        in_addr_t ip;
+        uint16_t from;
+        int len = udp.receive(buf, UDP_DATAGRAM_MAX, &ip, &from, UDP_RECEIVE_TIMEOUT);
+        if (len < 0)
+        {
+            fnSystem.delay(UDP_RECEIVE_TIMEOUT);
+            continue;
+        }
+        if (len == 0)
+            continue;
 
+        std::lock_guard<std::mutex> lock(rxQueueMutex);
+        if (rxQueue.size() >= UDP_QUEUE_DEPTH)
+        {
+            rxQueue.pop_front();
+            rxDropped++;
+        }
+        rxQueue.push_back({std::string((const char *)buf, len), ip, from});
+    }
+
+    free(buf);
+    taskRunning = false;
+}
+
+bool NetworkProtocolUDP::next_datagram()
+{
+    {
+        std::lock_guard<std::mutex> lock(rxQueueMutex);
+        if (rxQueue.empty())
+            return false;
+
+        receiveBuffer->swap(rxQueue.front().data);
+        remote_ip = rxQueue.front().ip;
+        remote_port = rxQueue.front().port;
+        rxQueue.pop_front();
+    }
+
+    // Replies go to whoever sent it
+    dest = std::string(compat_inet_ntoa(remote_ip));
+    port = remote_port;
+    return true;
+}
+
+size_t NetworkProtocolUDP::datagrams_waiting()
+{
+    std::lock_guard<std::mutex> lock(rxQueueMutex);
+    return rxQueue.size() + (receiveBuffer->empty() ? 0 : 1);
+}
+
+bool NetworkProtocolUDP::read(unsigned short len)
+{
     Debug_printf("NetworkProtocolUDP::read(%u)\r\n", len);
 
+    // One datagram at a time, so the computer sees where each one ends
     if (receiveBuffer->length() == 0)
     {
-        if (udp.available() == 0)
+        if (!next_datagram())
         {
             errno_to_error();
             return true;
         }
 
-        // Do the read.
-        udp.read(newData.data(), len);
-
-        // Add new data to buffer.
-        receiveBuffer->insert(receiveBuffer->end(),newData.begin(),newData.end());
+        // Null padded out to what was asked for
+        if (receiveBuffer->length() < len)
+            receiveBuffer->resize(len);
     }
 
     // Return success
@@ -165,27 +268,20 @@ bool NetworkProtocolUDP::status(NetworkStatus *status)
         status->rxBytesWaiting = receiveBuffer->length();
     else
     {
-        in_addr_t addr = udp.remoteIP();
-
-        status->rxBytesWaiting = udp.parsePacket();
-        
-        // Only change dest if we need to.
-#ifdef ESP_PLATFORM
-        if (udp.remoteIP() != IPADDR_NONE)
-#else
-        if (status->rxBytesWaiting > 0 && addr != IPADDR_NONE)
-#endif
-        {
-            dest = std::string(compat_inet_ntoa(addr));
-            port = udp.remotePort();
-        }
+        // The size of the next datagram, the base class reads it in
+        std::lock_guard<std::mutex> lock(rxQueueMutex);
+        status->rxBytesWaiting = rxQueue.empty() ? 0 : rxQueue.front().data.size();
     }
 
-    status->connected = 1; // Always 'connected'
     status->error = error;
 
     NetworkProtocol::status(status);
 
+    // Always 'connected', and how many datagrams are waiting when there's
+    // more than one, so they can all be read without asking again
+    size_t waiting = datagrams_waiting();
+    status->connected = waiting > 1 ? (waiting > 255 ? 255 : waiting) : 1;
+
     return false;
 }
 
@@ -197,10 +293,8 @@ uint8_t NetworkProtocolUDP::special_inquiry(uint8_t cmd)
     {
     case 'D':           // set destination
         return 0x80;
-#ifndef ESP_PLATFORM
     case 'r':           // get remote
         return 0x40;
-#endif
     }
 
     return 0xFF;
@@ -213,9 +307,6 @@ bool NetworkProtocolUDP::special_00(cmdFrame_t *cmdFrame)
 
 bool NetworkProtocolUDP::special_40(uint8_t *sp_buf, unsigned short len, cmdFrame_t *cmdFrame)
 {
-#ifdef ESP_PLATFORM
-    return true; // none implemented.
-#else
     switch (cmdFrame->comnd)
     {
     case 'r':
@@ -223,7 +314,6 @@ bool NetworkProtocolUDP::special_40(uint8_t *sp_buf, unsigned short len, cmdFram
     default:
         return true;
     }
-#endif
 }
 
 bool NetworkProtocolUDP::special_80(uint8_t *sp_buf, unsigned short len, cmdFrame_t *cmdFrame)
@@ -271,19 +361,18 @@ bool NetworkProtocolUDP::set_destination(uint8_t *sp_buf, unsigned short len)
     return false; // no error.
 }
 
-#ifndef ESP_PLATFORM
 bool NetworkProtocolUDP::get_remote(uint8_t *sp_buf, unsigned short len)
 {
     char port_part[8];
 
-    snprintf(port_part, sizeof port_part, ":%d\x9b", udp.remotePort());
-    strlcpy((char *)sp_buf, compat_inet_ntoa(udp.remoteIP()), len);
+    // The sender of the datagram being read
+    snprintf(port_part, sizeof port_part, ":%d\x9b", remote_port);
+    strlcpy((char *)sp_buf, compat_inet_ntoa(remote_ip), len);
     strlcat((char *)sp_buf, port_part, len);
     Debug_printf("UDP remote is %s\n", sp_buf);
 
     return false; // no error.
 }
-#endif
 
 bool NetworkProtocolUDP::is_multicast()
 {
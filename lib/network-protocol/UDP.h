@@ -5,9 +5,42 @@
 #ifndef NETWORKPROTOCOL_UDP
 #define NETWORKPROTOCOL_UDP
 
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+#ifndef ESP_PLATFORM
+#include <thread>
+#endif
+
 #include "Protocol.h"
 #include "fnUDP.h"
 
+// Datagrams held between reads, the oldest goes when another comes
+#ifndef UDP_QUEUE_DEPTH
+#ifdef ESP_PLATFORM
+#define UDP_QUEUE_DEPTH 16
+#else
+#define UDP_QUEUE_DEPTH 64
+#endif
+#endif
+// Largest datagram kept whole, the rest of a bigger one is lost
+#define UDP_DATAGRAM_MAX 1472
+// How long the receiver waits on the socket before checking it should stop, in ms
+#define UDP_RECEIVE_TIMEOUT 100
+#define UDP_TASK_STACKSIZE 3072
+#define UDP_TASK_PRIORITY 5
+
+/**
+ * A received datagram and who sent it
+ */
+struct udp_datagram
+{
+    std::string data;
+    in_addr_t ip;
+    uint16_t port;
+};
+
 class NetworkProtocolUDP : public NetworkProtocol
 {
 public:
@@ -105,6 +138,25 @@ protected:
      */
     bool multicast_write = false;
 
+    /**
+     * Datagrams the receiver has taken off the socket, oldest first
+     */
+    std::deque<udp_datagram> rxQueue;
+    std::mutex rxQueueMutex;
+    std::atomic<uint32_t> rxDropped{0};
+
+    /**
+     * Who sent the datagram in the receive buffer
+     */
+    in_addr_t remote_ip = IPADDR_NONE;
+    uint16_t remote_port = 0;
+
+    std::atomic<bool> taskRunning{false};
+    std::atomic<bool> taskStop{false};
+#ifndef ESP_PLATFORM
+    std::thread task;
+#endif
+
     /**
      * @brief Set destination address
      * @param sp_buf pointer to received special buffer.
@@ -112,15 +164,34 @@ protected:
      */
     bool set_destination(uint8_t *sp_buf, unsigned short len);
 
-#ifndef ESP_PLATFORM
     /**
      * @brief Get remote address
      * @param sp_buf pointer to transmit special buffer.
      * @param len of special transmit buffer
      */
     bool get_remote(uint8_t *sp_buf, unsigned short len);
+
+    /**
+     * Start and stop the receiver that fills rxQueue while the channel is open
+     */
+    void start_receiver();
+    void stop_receiver();
+    void receive_loop();
+#ifdef ESP_PLATFORM
+    static void receive_task(void *param);
 #endif
 
+    /**
+     * Move the oldest queued datagram into the receive buffer, and reply to
+     * whoever sent it. Returns false if there wasn't one
+     */
+    bool next_datagram();
+
+    /**
+     * Datagrams waiting, counting the one in the receive buffer
+     */
+    size_t datagrams_waiting();
+
 private:
     /**
      * Is current destination multicast?
@@ -6,6 +6,10 @@
 
 #include "utils.h"
 
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
 void pdfPrinter::pdf_header()
 {
     Debug_println("pdf header");
@@ -250,6 +254,7 @@ void pdfPrinter::pdf_end_page()
     idx_stream_stop = ftell(_file);
     fprintf(_file, "endstream\nendobj\n");
     size_t idx_temp = ftell(_file);
+    pageEnds[pdf_pageCounter] = idx_temp;
     fflush(_file);
     fseek(_file, idx_stream_length, SEEK_SET);
     fprintf(_file, "%10u", (unsigned)(idx_stream_stop - idx_stream_start));
@@ -270,7 +275,10 @@ void pdfPrinter::pdf_xref()
     fprintf(_file, "0000000000 65535 f\n");
     for (int i = 1; i < pdf_objCtr; i++)
     {
-        fprintf(_file, "%010u 00000 n\n", (unsigned)objLocations[i]);
+        if (objLocations[i] == 0) // not in this file (single page copy)
+            fprintf(_file, "0000000000 65535 f\n");
+        else
+            fprintf(_file, "%010u 00000 n\n", (unsigned)objLocations[i]);
     }
     fprintf(_file, "trailer <</Size %d/Root 1 0 R>>\n", pdf_objCtr);
     fprintf(_file, "startxref\n");
@@ -408,6 +416,70 @@ bool pdfPrinter::process_buffer(uint8_t n, uint8_t aux1, uint8_t aux2)
     return true;
 }
 
+// A finished page on its own: its page and content stream objects copied out of
+// the output with their object numbers, and a catalog, page tree, fonts and xref
+// of its own around them
+FILE *pdfPrinter::providePageReadHandle(int page)
+{
+    // Only between buffers, and only pages that are complete
+    if (_file != nullptr || page < 1 || page > pdf_pageCounter)
+        return nullptr;
+
+    FILE *in = open_output_read();
+    if (in == nullptr)
+        return nullptr;
+    FILE *out = open_scratch();
+    if (out == nullptr)
+    {
+        fclose(in);
+        return nullptr;
+    }
+
+    int pageObj = pageObjects[page - 1];
+    size_t start = objLocations[pageObj];
+    size_t contents = objLocations[pageObj + 1];
+    size_t len = pageEnds[page - 1] - start;
+
+    // The font and xref code works on _file and the object table, borrow them
+    std::vector<size_t> savedLocations(objLocations, objLocations + 256);
+    int savedObjCtr = pdf_objCtr;
+    memset(objLocations, 0, sizeof(objLocations));
+    _file = out;
+
+    fprintf(_file, "%%PDF-1.4\n");
+    objLocations[1] = ftell(_file);
+    fprintf(_file, "1 0 obj\n<</Type /Catalog /Pages 2 0 R>>\nendobj\n");
+    objLocations[2] = ftell(_file);
+    fprintf(_file, "2 0 obj\n<</Type /Pages /Kids [ %d 0 R ] /Count 1>>\nendobj\n", pageObj);
+
+    objLocations[pageObj] = ftell(_file);
+    objLocations[pageObj + 1] = objLocations[pageObj] + (contents - start);
+    fseek(in, start, SEEK_SET);
+    char buf[256];
+    while (len > 0)
+    {
+        size_t n = fread(buf, 1, std::min(len, sizeof(buf)), in);
+        if (n == 0)
+            break;
+        fwrite(buf, 1, n, _file);
+        len -= n;
+    }
+    fclose(in);
+
+    pdf_objCtr = pageObj + 1;
+    pdf_font_resource();
+    pdf_add_fonts();
+    pdf_xref();
+
+    fflush(_file);
+    fseek(_file, 0, SEEK_SET);
+    _file = nullptr;
+    std::copy(savedLocations.begin(), savedLocations.end(), objLocations);
+    pdf_objCtr = savedObjCtr;
+
+    return out;
+}
+
 void pdfPrinter::pre_close_file()
 {
     if (TOPflag && pdf_pageCounter == 0)
@@ -50,6 +50,7 @@ protected:
     int pageObjects[256];
     int pdf_pageCounter = 0.;
     size_t objLocations[256]; // reference table storage
+    size_t pageEnds[256];     // file location just past each finished page's content stream
     int pdf_objCtr = 0;       // count the objects
 
     void pdf_header();
@@ -79,6 +80,8 @@ public:
     // virtual const char *modelname(void) = 0;
     pdfPrinter() { _paper_type = PDF; };
 
+    FILE *providePageReadHandle(int page) override;
+
 };
 
 #endif // guard
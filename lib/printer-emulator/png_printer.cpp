@@ -1,12 +1,13 @@
 #include "png_printer.h"
 
+#include <string.h>
+#include <algorithm>
+
 #include "../../include/debug.h"
 
 
 // rewrite of TinyPngOut https://www.nayuki.io/page/tiny-png-output
 
-#define DEFLATE_MAX_BLOCK_SIZE 0xFFFF
-
 void pngPrinter::uint32_to_array(uint32_t src, uint8_t dest[4])
 {
     dest[0] = (uint8_t)((src >> 24) & 0xff);
@@ -15,17 +16,25 @@ void pngPrinter::uint32_to_array(uint32_t src, uint8_t dest[4])
     dest[3] = (uint8_t)(src & 0xff);
 }
 
-uint32_t pngPrinter::update_adler32(uint32_t adler, uint8_t data)
+uint32_t pngPrinter::update_adler32(uint32_t adler, const uint8_t *buf, size_t len)
 {
     // https://gist.github.com/kornelski/710db9d30a64db0807c5bfbdbdecf85e
     unsigned s1 = adler & 0xffff;
     unsigned s2 = (adler >> 16) & 0xffff;
 
-    s1 += data;
-    s1 %= 65521;
-
-    s2 += s1;
-    s2 %= 65521;
+    while (len > 0)
+    {
+        // 5552 bytes is the most that can be summed before s2 could overflow
+        size_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n-- > 0)
+        {
+            s1 += *buf++;
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+    }
 
     return (s2 << 16) | s1;
 }
@@ -219,32 +228,148 @@ void pngPrinter::png_data()
     significance and can occur at any point in the compressed datastream
 */
     Debug_println("Starting PNG Image Data...");
+    // The compressed size isn't known up front, so the data goes out in
+    // PNG_IDAT_CHUNK_SIZE IDAT chunks as it is produced
+    img_pos = 0;
+    Xpos = 0;
+    Ypos = 0;
+    adler_value = 1;
+    have_prev_line = false;
+    bit_buffer = 0;
+    bit_count = 0;
+    idat_len = 0;
+}
+
+void pngPrinter::png_idat_put(uint8_t c)
+{
+    idat_buffer[idat_len++] = c;
+    if (idat_len == PNG_IDAT_CHUNK_SIZE)
+        png_idat_flush();
+}
+
+void pngPrinter::png_idat_flush()
+{
+    if (idat_len == 0)
+        return;
+
     uint8_t data[] = {
         // IDAT chunk
-        0x00, 0x00, 0x00, 0x00, // 0-3      size placeholder
+        0x00, 0x00, 0x00, 0x00, // 0-3      size
         'I', 'D', 'A', 'T',     // 4-7      IDAT
     };
-    crc_value = rc_crc32(0, &data[4], 4); // begin CRC calculation
+    uint8_t ccc[] = {0, 0, 0, 0};
+    uint32_to_array(idat_len, &data[0]);
+    crc_value = rc_crc32(0, &data[4], 4);
+    crc_value = rc_crc32(crc_value, idat_buffer, idat_len);
+    uint32_to_array(crc_value, &ccc[0]);
+
+    fwrite(data, 1, 8, _file);
+    fwrite(idat_buffer, 1, idat_len, _file);
+    fwrite(ccc, 1, 4, _file);
+    idat_len = 0;
+}
+
+// deflate packs bits starting at the least significant bit of each byte
+void pngPrinter::deflate_bits(uint32_t bits, uint8_t count)
+{
+    bit_buffer |= bits << bit_count;
+    bit_count += count;
+    while (bit_count >= 8)
+    {
+        png_idat_put(bit_buffer & 0xFF);
+        bit_buffer >>= 8;
+        bit_count -= 8;
+    }
+}
+
+// Huffman codes go out most significant bit first
+void pngPrinter::deflate_huffman(uint16_t code, uint8_t len)
+{
+    uint16_t reversed = 0;
+    for (uint8_t i = 0; i < len; i++)
+        reversed |= ((code >> i) & 1) << (len - 1 - i);
+    deflate_bits(reversed, len);
+}
+
+void pngPrinter::deflate_literal(uint16_t value)
+{
+    // https://tools.ietf.org/html/rfc1951#page-12 fixed Huffman codes
+    if (value < 144)
+        deflate_huffman(0x30 + value, 8);
+    else if (value < 256)
+        deflate_huffman(0x190 + value - 144, 9);
+    else if (value < 280)
+        deflate_huffman(value - 256, 7);
+    else
+        deflate_huffman(0xC0 + value - 280, 8);
+}
 
-    // Compute data size
-    // imgSize = (width + 1) * height; // +1 per line for filter 0's
-    uint32_t numBlocks = imgSize / DEFLATE_MAX_BLOCK_SIZE;
-    if (imgSize % DEFLATE_MAX_BLOCK_SIZE != 0)
-        numBlocks++; // Round up
+void pngPrinter::deflate_match(uint16_t length, uint16_t distance)
+{
+    // https://tools.ietf.org/html/rfc1951#page-11
+    static const uint16_t len_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                          35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const uint8_t len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const uint16_t dist_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                           257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                           7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    uint8_t code = 28;
+    while (len_base[code] > length)
+        code--;
+    deflate_literal(257 + code);
+    deflate_bits(length - len_base[code], len_extra[code]);
+
+    code = 29;
+    while (dist_base[code] > distance)
+        code--;
+    deflate_huffman(code, 5); // fixed 5 bit distance codes
+    deflate_bits(distance - dist_base[code], dist_extra[code]);
+}
 
-    dataSize += numBlocks * 5; // 5 bytes per DEFLATE uncompressed block header
-    dataSize += 2;             // 2 bytes for zlib header
-    dataSize += 4;             // 4 bytes for zlib Adler-32 checksum
-    dataSize += imgSize;       // plus the image data
+void pngPrinter::deflate_line()
+{
+    // printer output is mostly runs of one color and lines repeated from the one above
+    const uint16_t len = width + 1;
+    uint16_t i = 0;
+    while (i < len)
+    {
+        uint16_t run = 0;
+        if (i > 0)
+            while (i + run < len && run < 258 && cur_line[i + run] == cur_line[i + run - 1])
+                run++;
 
-    uint32_to_array(dataSize, &data[0]); // store the computed size
+        uint16_t above = 0;
+        if (have_prev_line)
+            while (i + above < len && above < 258 && cur_line[i + above] == prev_line[i + above])
+                above++;
 
-    fwrite(data, 1, 8, _file); // write out the IDAT header
+        if (above >= 3 && above >= run)
+        {
+            deflate_match(above, len);
+            i += above;
+        }
+        else if (run >= 3)
+        {
+            deflate_match(run, 1);
+            i += run;
+        }
+        else
+        {
+            deflate_literal(cur_line[i]);
+            i++;
+        }
+    }
+
+    adler_value = update_adler32(adler_value, cur_line, len);
+    memcpy(prev_line, cur_line, len);
+    have_prev_line = true;
 }
 
 void pngPrinter::png_add_data(uint8_t *buf, uint32_t n)
 {
-    uint8_t c = 0;
     // Deflate-compressed datastreams within PNG are stored in the “zlib” format
     // https://tools.ietf.org/html/rfc1950#page-4
 
@@ -253,105 +378,57 @@ void pngPrinter::png_add_data(uint8_t *buf, uint32_t n)
         Debug_println("Writing ZLIB header.");
         // write out a ZLIB header
         // Compression method/flags code: 1 byte (For PNG compression method 0, the zlib compression method/flags code must specify method code 8 (“deflate” compression))
-        c = 0x08; // ZLIB "Deflate" compression scheme
-        crc_value = rc_crc32(crc_value, c);
-        fputc(c, _file);
+        png_idat_put(0x18); // ZLIB "Deflate" compression scheme, 512 byte window (matches reach back one line)
         //  Additional flags/check bits: 1 byte (must be such that method + flags, when viewed as a 16-bit unsigned integer stored in MSB order (CMF*256 + FLG), is a multiple of 31.)
-        c = 0x1D; // precompute so that 0x081D is divisible by 31 [ (0x800 / 31 + 1) * 31 - 0x800 ]
-        crc_value = rc_crc32(crc_value, c);
-        fputc(c, _file);
+        png_idat_put(0x19); // precompute so that 0x1819 is divisible by 31
 
-        //printf("new image\r\n");
+        // the whole image is one final block with fixed Huffman codes
+        deflate_bits(1, 1); // BFINAL
+        deflate_bits(1, 2); // BTYPE 01
     }
 
     uint32_t idx = 0;
-    while (idx < n)
+    while (idx < n && img_pos < imgSize)
     {
-        // at beginning of block?
-        if (blk_pos == 0)
-        {
-            blkSize = DEFLATE_MAX_BLOCK_SIZE;
-            uint8_t c = 0;
-            if (imgSize - img_pos <= (uint32_t)blkSize)
-            {
-                c = 1; // final block
-                blkSize = (uint16_t)(imgSize - img_pos);
-            }
-
-            Debug_println("Writing ZLIB block header.");
-            // write out block header
-            crc_value = rc_crc32(crc_value, c);
-            fputc(c, _file);
-
-            // write out block size
-            c = (uint8_t)(blkSize >> 0);
-            crc_value = rc_crc32(crc_value, c);
-            fputc(c, _file);
-            c = (uint8_t)(blkSize >> 8);
-            crc_value = rc_crc32(crc_value, c);
-            fputc(c, _file);
-            c = (uint8_t)((blkSize >> 0) ^ 0xFF);
-            crc_value = rc_crc32(crc_value, c);
-            fputc(c, _file);
-            c = (uint8_t)((blkSize >> 8) ^ 0xFF);
-            crc_value = rc_crc32(crc_value, c);
-            fputc(c, _file);
-
-            //printf("new block\r\n");
-        }
-
         //at beginning of a line?
         if (Xpos == 0)
         {
             Debug_printf("Starting PNG line %d ... ",Ypos);
-            c = 0;
-            crc_value = rc_crc32(crc_value, c);
-            adler_value = update_adler32(adler_value, c);
-            fputc(c, _file);
-            //printf("\nnew line %d ", c);
-
+            cur_line[0] = 0; // filter type 0
             img_pos++;
-            blk_pos++;
         }
 
-        // put byte from buffer
-        c = buf[idx];
-        crc_value = rc_crc32(crc_value, c);
-        adler_value = update_adler32(adler_value, c);
-        fputc(c, _file);
-        //printf("%d ", c);
-
-        Xpos++;
-        idx++;
-        img_pos++;
-        blk_pos++;
+        // copy as much of the line as the buffer holds
+        uint32_t count = std::min(n - idx, (uint32_t)(width - Xpos));
+        memcpy(&cur_line[1 + Xpos], &buf[idx], count);
+        Xpos += count;
+        idx += count;
+        img_pos += count;
 
         // check for end of's
         if (Xpos == width)
         {
             Debug_println("Finished PNG line.");
+            deflate_line();
             Xpos = 0;
             Ypos++;
         }
-        if (blk_pos == blkSize)
-        {
-            Debug_println("End of ZLIB block.");
-            blk_pos = 0;
-        }
     };
 
     if (img_pos == imgSize)
     {
         Debug_println("Writing ZLIB Adler checksum and PNG data CRC.");
+        deflate_literal(256); // end of block
+        if (bit_count > 0)
+            deflate_bits(0, 8 - bit_count); // pad to a byte
+
         uint8_t data[] = {
             0, 0, 0, 0, // Adler32 Check value: 4 bytes
-            0, 0, 0, 0  // CRC32: 4 bytes
         };
         uint32_to_array(adler_value, &data[0]);
         for (int i = 0; i < 4; i++)
-            crc_value = rc_crc32(crc_value, data[i]); // crc_value = rc_crc32(crc_value, data[0],4); ?????????
-        uint32_to_array(crc_value, &data[4]);
-        fwrite(data, 1, 8, _file);
+            png_idat_put(data[i]);
+        png_idat_flush();
         png_end();
     }
 }
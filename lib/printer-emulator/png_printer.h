@@ -5,7 +5,8 @@
 
 #include "printer_emulator.h"
 
-#define DEFLATE_MAX_BLOCK_SIZE 0xFFFF
+// Size of each IDAT chunk the compressed image is split into
+#define PNG_IDAT_CHUNK_SIZE 4096
 
 class pngPrinter : public printer_emu
 {
@@ -18,20 +19,27 @@ protected:
     uint32_t img_pos = 0;                    // serial position within image data including BOL filter p's
     uint16_t Xpos = 0;                       // current position within image line
     uint16_t Ypos = 0;                       // current image line number
-    uint32_t dataSize = 0;                   // size of data for IDAT chunk
-    uint16_t blkSize = 0;                    // size of zlib block
-    uint16_t blk_pos = 0;                    // serial position within zlib block
     uint32_t crc_value = 0;                  // running crc32 value
     uint32_t adler_value = 1;                // running checksum (initilize to 1 https://en.wikipedia.org/wiki/Adler-32)
 
     uint8_t line_buffer[320];
 
+    // deflate encoder: fixed Huffman codes, matches only against the previous
+    // byte (runs) and the same spot on the previous line
+    uint8_t cur_line[321];                   // filter byte + pixels of the line being built
+    uint8_t prev_line[321];                  // last line compressed
+    bool have_prev_line = false;
+    uint32_t bit_buffer = 0;                 // deflate bits not yet in idat_buffer
+    uint8_t bit_count = 0;
+    uint8_t idat_buffer[PNG_IDAT_CHUNK_SIZE]; // compressed data of the next IDAT chunk
+    uint16_t idat_len = 0;
+
     bool BOLflag = true;
     uint16_t line_index = 0;
     uint8_t rep_code = 0;
 
     void uint32_to_array(uint32_t src, uint8_t dest[4]);
-    uint32_t update_adler32(uint32_t adler, uint8_t data);
+    uint32_t update_adler32(uint32_t adler, const uint8_t *buf, size_t len);
     uint32_t rc_crc32(uint32_t crc, const uint8_t *buf, size_t len);
     uint32_t rc_crc32(uint32_t crc, uint8_t c) { return rc_crc32(crc, &c, 1); }
 
@@ -40,6 +48,13 @@ protected:
     void png_palette();
     void png_data();
     void png_add_data(uint8_t *buf, uint32_t n);
+    void png_idat_put(uint8_t c);
+    void png_idat_flush();
+    void deflate_bits(uint32_t bits, uint8_t count);
+    void deflate_huffman(uint16_t code, uint8_t len);
+    void deflate_literal(uint16_t value);
+    void deflate_match(uint16_t length, uint16_t distance);
+    void deflate_line();
     void png_end();
 
     virtual void post_new_file() override;
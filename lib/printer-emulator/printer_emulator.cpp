@@ -3,8 +3,12 @@
 #include "../../include/debug.h"
 
 #include "fsFlash.h"
+#include "fnArena.h"
 
 #define PRINTER_OUTFILE "/paper"
+#define PRINTER_SCRATCHFILE "/paperpage"
+// Output collected in RAM before it is written out
+#define PRINTER_OUTPUT_BUFLEN 4096
 
 // initialzie printer by creating an output file
 void printer_emu::initPrinter(FileSystem *fs)
@@ -22,6 +26,60 @@ printer_emu::~printer_emu()
         fclose(_file);
         _file = nullptr;
     }
+#ifdef PRINTER_SPOOL
+    delete _spool;
+    delete _scratch_spool;
+#endif
+    fnArena.free(ARENA_PRINTER, _output_buffer);
+}
+
+// Open the output file with a large stdio buffer, flushed in full blocks and when it is closed
+bool printer_emu::open_output(const char *mode)
+{
+#ifdef PRINTER_SPOOL
+    // A new printout starts a new spool
+    if (mode[0] == 'w')
+    {
+        delete _spool;
+        _spool = printerSpool::available() ? new printerSpool(_FS, PRINTER_OUTFILE) : nullptr;
+    }
+    if (_spool != nullptr)
+        _file = _spool->open();
+    else
+#endif
+    _file = _FS->file_open(PRINTER_OUTFILE, mode);
+    if (_file == nullptr)
+        return false;
+
+    if (_output_buffer == nullptr)
+        _output_buffer = (char *)fnArena.malloc(ARENA_PRINTER, PRINTER_OUTPUT_BUFLEN);
+    if (_output_buffer != nullptr)
+        setvbuf(_file, _output_buffer, _IOFBF, PRINTER_OUTPUT_BUFLEN);
+
+    return true;
+}
+
+FILE *printer_emu::open_output_read()
+{
+#ifdef PRINTER_SPOOL
+    if (_spool != nullptr)
+        return _spool->open();
+#endif
+    return _FS->file_open(PRINTER_OUTFILE, "rb");
+}
+
+FILE *printer_emu::open_scratch()
+{
+#ifdef PRINTER_SPOOL
+    if (printerSpool::available())
+    {
+        // The handle from the previous call has been closed by now
+        delete _scratch_spool;
+        _scratch_spool = new printerSpool(_FS, PRINTER_SCRATCHFILE);
+        return _scratch_spool->open();
+    }
+#endif
+    return _FS->file_open(PRINTER_SCRATCHFILE, "wb+");
 }
 
 // virtual void flushOutput(); // do this in pageEject
@@ -61,6 +119,11 @@ size_t printer_emu::getOutputSize()
     if(_file != nullptr)
         return FileSystem::filesize(_file);
 
+#ifdef PRINTER_SPOOL
+    if (_spool != nullptr)
+        return _spool->size();
+#endif
+
     long result = _FS->filesize(PRINTER_OUTFILE);
 
     return result == -1 ? 0 : result;
@@ -80,7 +143,7 @@ bool printer_emu::process(uint8_t linelen, uint8_t aux1, uint8_t aux2)
     }
 
     // Open output file for appending
-    _file = _FS->file_open(PRINTER_OUTFILE, "rb+"); // This is supposed to open the file for writing at the end, but reading at the beginnig
+    open_output("rb+"); // This is supposed to open the file for writing at the end, but reading at the beginnig
     fseek(_file, 0, SEEK_END); // Make sure we're at the end of the file for reading in case the emaulator code expects that
 
     bool result = process_buffer(linelen, aux1, aux2);
@@ -97,6 +160,11 @@ bool printer_emu::process(uint8_t linelen, uint8_t aux1, uint8_t aux2)
 FILE * printer_emu::closeOutputAndProvideReadHandle()
 {
     closeOutput();
+#ifdef PRINTER_SPOOL
+    // Straight from RAM, unless the printout got too big and went to flash
+    if (_spool != nullptr)
+        return _spool->open();
+#endif
     return _FS->file_open(PRINTER_OUTFILE);
 }
 
@@ -110,7 +178,7 @@ void printer_emu::closeOutput()
     // Give printer emulator chance to finish output
     if(_file == nullptr)
     {
-        _file = _FS->file_open(PRINTER_OUTFILE, "rb+"); // Seeks don't work right if we use "append" mode - use "rb+"
+        open_output("rb+"); // Seeks don't work right if we use "append" mode - use "rb+"
         fseek(_file, 0, SEEK_END);
     }
 
@@ -128,7 +196,7 @@ void printer_emu::restart_output()
     _output_started = false;
     if(_file != nullptr)
         fclose(_file);
-    _file = _FS->file_open(PRINTER_OUTFILE, "wb"); // This should create/truncate the file
+    open_output("wb"); // This should create/truncate the file
 #ifdef DEBUG
     if (_file != nullptr)
     {
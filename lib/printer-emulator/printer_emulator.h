@@ -4,6 +4,7 @@
 //#include "../../include/atascii.h"
 
 #include "fnFsSD.h"
+#include "printer_spool.h"
 
 // TODO: Combine html_printer.cpp/h and file_printer.cpp/h
 
@@ -51,6 +52,21 @@ protected:
 
     size_t copy_file_to_output(const char *filename);
     void restart_output();
+
+    // RAM buffer _file is given, so the emulators' many small writes reach flash in large blocks
+    char *_output_buffer = nullptr;
+    bool open_output(const char *mode);
+
+    // Read handle on the output so far
+    FILE *open_output_read();
+    // Empty read/write file to build a document to hand out in, replaced on each call
+    FILE *open_scratch();
+
+#ifdef PRINTER_SPOOL
+    // Output of the current printout when it is kept in RAM instead of the file
+    printerSpool *_spool = nullptr;
+    printerSpool *_scratch_spool = nullptr;
+#endif
     
 public:
 
@@ -64,6 +80,10 @@ public:
     void closeOutput();
     FILE * closeOutputAndProvideReadHandle();
 
+    // Read handle on a finished page (from 1) as a document of its own, while the
+    // printout goes on. Null if the emulator can't do that or the page isn't done yet
+    virtual FILE *providePageReadHandle(int page) { return nullptr; };
+
     bool process(uint8_t linelen, uint8_t aux1, uint8_t aux2);
 
     paper_t getPaperType() { return _paper_type; };
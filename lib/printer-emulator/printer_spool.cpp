@@ -0,0 +1,186 @@
+#include "printer_spool.h"
+
+#ifdef PRINTER_SPOOL
+
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef ESP_PLATFORM
+#include "fnSystem.h"
+#endif
+#include "fnArena.h"
+
+#include "../../include/debug.h"
+
+
+printerSpool::printerSpool(FileSystem *fs, const char *path)
+    : _fs(fs), _path(path)
+{
+}
+
+printerSpool::~printerSpool()
+{
+    for (uint8_t *page : _pages)
+        fnArena.free(ARENA_PRINTER, page);
+    if (_flash != nullptr)
+        fclose(_flash);
+}
+
+bool printerSpool::available()
+{
+#ifdef ESP_PLATFORM
+    return fnSystem.get_psram_size() > 0;
+#else
+    return true;
+#endif
+}
+
+FILE *printerSpool::open()
+{
+    cookie_io_functions_t funcs = {cookie_read, cookie_write, cookie_seek, cookie_close};
+    return fopencookie(new handle{this, 0}, "rb+", funcs);
+}
+
+// Too big for RAM, move everything so far to the output file and keep it there
+bool printerSpool::spill()
+{
+    Debug_printf("printerSpool - %u bytes, moving to flash\r\n", (unsigned)_size);
+    _flash = _fs->file_open(_path.c_str(), "wb+");
+    if (_flash == nullptr)
+        return false;
+
+    for (size_t i = 0; i < _pages.size(); i++)
+    {
+        size_t len = std::min((size_t)PRINTER_SPOOL_PAGE_SIZE, _size - i * PRINTER_SPOOL_PAGE_SIZE);
+        fwrite(_pages[i], 1, len, _flash);
+        fnArena.free(ARENA_PRINTER, _pages[i]);
+    }
+    _pages.clear();
+    return true;
+}
+
+size_t printerSpool::read_at(size_t pos, char *buf, size_t size)
+{
+    if (_flash != nullptr)
+    {
+        if (fseek(_flash, pos, SEEK_SET) != 0)
+            return 0;
+        return fread(buf, 1, size, _flash);
+    }
+
+    if (pos >= _size)
+        return 0;
+    size = std::min(size, _size - pos);
+    size_t done = 0;
+    while (done < size)
+    {
+        size_t offset = (pos + done) % PRINTER_SPOOL_PAGE_SIZE;
+        size_t len = std::min(size - done, PRINTER_SPOOL_PAGE_SIZE - offset);
+        memcpy(buf + done, _pages[(pos + done) / PRINTER_SPOOL_PAGE_SIZE] + offset, len);
+        done += len;
+    }
+    return done;
+}
+
+size_t printerSpool::write_at(size_t pos, const char *buf, size_t size)
+{
+    if (_flash == nullptr && (pos + size + PRINTER_SPOOL_PAGE_SIZE - 1) / PRINTER_SPOOL_PAGE_SIZE > PRINTER_SPOOL_MAX_PAGES)
+    {
+        if (!spill())
+            return 0;
+    }
+
+    if (_flash != nullptr)
+    {
+        if (fseek(_flash, pos, SEEK_SET) != 0)
+            return 0;
+        size_t n = fwrite(buf, 1, size, _flash);
+        _size = std::max(_size, pos + n);
+        return n;
+    }
+
+    size_t done = 0;
+    while (done < size)
+    {
+        size_t index = (pos + done) / PRINTER_SPOOL_PAGE_SIZE;
+        while (_pages.size() <= index)
+        {
+            uint8_t *page = (uint8_t *)fnArena.calloc(ARENA_PRINTER, 1, PRINTER_SPOOL_PAGE_SIZE);
+            if (page == nullptr)
+            {
+                // Out of RAM, carry on from flash
+                if (!spill())
+                    return done;
+                return done + write_at(pos + done, buf + done, size - done);
+            }
+            _pages.push_back(page);
+        }
+
+        size_t offset = (pos + done) % PRINTER_SPOOL_PAGE_SIZE;
+        size_t len = std::min(size - done, PRINTER_SPOOL_PAGE_SIZE - offset);
+        memcpy(_pages[index] + offset, buf + done, len);
+        done += len;
+        _size = std::max(_size, pos + done);
+    }
+    return done;
+}
+
+ssize_t printerSpool::cookie_read(void *cookie, char *buf, size_t size)
+{
+    handle *h = (handle *)cookie;
+    size_t n = h->spool->read_at(h->pos, buf, size);
+    h->pos += n;
+    return n;
+}
+
+ssize_t printerSpool::cookie_write(void *cookie, const char *buf, size_t size)
+{
+    handle *h = (handle *)cookie;
+    size_t n = h->spool->write_at(h->pos, buf, size);
+    h->pos += n;
+    if (n == 0 && size > 0)
+    {
+        errno = ENOSPC;
+        return -1;
+    }
+    return n;
+}
+
+template <typename T>
+int printerSpool::cookie_seek(void *cookie, T *offset, int whence)
+{
+    handle *h = (handle *)cookie;
+    long long pos;
+    switch (whence)
+    {
+    case SEEK_SET:
+        pos = *offset;
+        break;
+    case SEEK_CUR:
+        pos = h->pos + *offset;
+        break;
+    case SEEK_END:
+        pos = h->spool->_size + *offset;
+        break;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+    if (pos < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    h->pos = pos;
+    *offset = pos;
+    return 0;
+}
+
+int printerSpool::cookie_close(void *cookie)
+{
+    delete (handle *)cookie;
+    return 0;
+}
+
+#endif // PRINTER_SPOOL
@@ -0,0 +1,71 @@
+#ifndef PRINTER_SPOOL_H
+#define PRINTER_SPOOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "fnFS.h"
+
+// Printer output is spooled to RAM where the C library can wrap it in a FILE
+#ifdef ESP_PLATFORM
+#define PRINTER_SPOOL
+#endif
+
+#define PRINTER_SPOOL_PAGE_SIZE 4096
+// Most RAM a printout takes (1MB) before it is moved to the output file on flash
+#define PRINTER_SPOOL_MAX_PAGES 256
+
+#ifdef PRINTER_SPOOL
+
+/*
+ * printerSpool - printer output held in RAM pages (PSRAM on ESP32)
+ * open() hands out stdio handles onto it, so the emulators and the web
+ * /print handler use it like the output file. Output that outgrows
+ * PRINTER_SPOOL_MAX_PAGES is moved to the file on flash and carries on there;
+ * smaller printouts never touch flash.
+ */
+class printerSpool
+{
+public:
+    printerSpool(FileSystem *fs, const char *path);
+    ~printerSpool();
+
+    // RAM for a spool is there (PSRAM fitted)
+    static bool available();
+
+    // New read/write handle positioned at the start, close it with fclose()
+    FILE *open();
+
+    size_t size() { return _size; };
+    bool on_flash() { return _flash != nullptr; };
+
+private:
+    struct handle
+    {
+        printerSpool *spool;
+        size_t pos;
+    };
+
+    FileSystem *_fs;
+    std::string _path;
+    std::vector<uint8_t *> _pages;
+    size_t _size = 0;
+    FILE *_flash = nullptr;
+
+    bool spill();
+    size_t read_at(size_t pos, char *buf, size_t size);
+    size_t write_at(size_t pos, const char *buf, size_t size);
+
+    static ssize_t cookie_read(void *cookie, char *buf, size_t size);
+    static ssize_t cookie_write(void *cookie, const char *buf, size_t size);
+    // The offset type differs between C libraries
+    template <typename T>
+    static int cookie_seek(void *cookie, T *offset, int whence);
+    static int cookie_close(void *cookie);
+};
+
+#endif // PRINTER_SPOOL
+
+#endif // PRINTER_SPOOL_H
@@ -1,8 +1,32 @@
 #include "svg_plotter.h"
 
+#include <cmath>
+
 #include "../../include/debug.h"
 #include "../../include/atascii.h"
 
+// Keeps each path's data, and the RAM we hold it in, to a few KB
+#define SVG_PATH_MAX_SEGMENTS 256
+
+static long svg_tenths(double v)
+{
+    return lround(v * 10.);
+}
+
+// A coordinate in tenths, with no more digits than it needs
+static void svg_append_num(std::string &d, long t)
+{
+    char num[24];
+    if (t % 10 == 0)
+        snprintf(num, sizeof(num), "%ld", t / 10);
+    else
+        snprintf(num, sizeof(num), "%s%ld.%ld", t < 0 ? "-" : "", labs(t) / 10, labs(t) % 10);
+    // A minus sign separates numbers as well as a space does
+    if (num[0] != '-' && !d.empty() && d.back() != 'm' && d.back() != 'l' && d.back() != 'M')
+        d += ' ';
+    d += num;
+}
+
 
 void svgPlotter::svg_update_bounds()
 {
@@ -23,6 +47,32 @@ int svgPlotter::svg_compute_weight(double fsize)
     return 300;
 }
 
+void svgPlotter::svg_path_add(char cmd, long dx, long dy)
+{
+    // A command letter repeats by itself
+    if (cmd != svg_path_cmd)
+        svg_path_d += cmd;
+    svg_path_cmd = cmd;
+    svg_append_num(svg_path_d, dx);
+    svg_append_num(svg_path_d, dy);
+    svg_path_X += dx;
+    svg_path_Y += dy;
+}
+
+void svgPlotter::svg_path_close()
+{
+    if (!svg_path_open)
+        return;
+    double dash = (double)svg_path_line_type;
+    fprintf(_file, "<path fill=\"none\" stroke=\"%s\" ", svg_colors[svg_path_color_idx].c_str());
+    fprintf(_file, "stroke-width=\"1.5\" stroke-linecap=\"round\" stroke-linejoin=\"round\" ");
+    fprintf(_file, "stroke-dasharray=\"%g,%g\" d=\"", dash, dash);
+    fwrite(svg_path_d.data(), 1, svg_path_d.size(), _file);
+    fprintf(_file, "\"/>\r\n");
+    svg_path_d.clear();
+    svg_path_open = false;
+}
+
 void svgPlotter::svg_new_line()
 {
     // http://scruss.com/blog/2016/04/23/fifteentwenty-commodore-1520-plotter-font/
@@ -35,6 +85,7 @@ void svgPlotter::svg_new_line()
     }
     svg_Y += lineHeight;
     svg_update_bounds();
+    svg_path_close();
     //svg_X = 0; // always start at left margin? not sure of behavior
     int fontWeight = svg_compute_weight(fontSize);
     fprintf(_file, "<text x=\"%g\" y=\"%g\" ", svg_X, svg_Y + svg_text_y_offset);
@@ -55,13 +106,30 @@ void svgPlotter::svg_end_line()
 
 void svgPlotter::svg_plot_line(double x1, double x2, double y1, double y2)
 {
-    double dash = (double)svg_line_type;
-    fprintf(_file, "<line ");
-    fprintf(_file, "stroke=\"%s\" ", svg_colors[svg_color_idx].c_str());
-    fprintf(_file, "stroke-width=\"1.5\" stroke-linecap=\"round\" ");
-    fprintf(_file, "stroke-dasharray=\"%g,%g\" ", dash, dash);
-    fprintf(_file, "x1=\"%g\" x2=\"%g\" y1=\"%g\" y2=\"%g\" ", x1, x2, y1, y2);
-    fprintf(_file, "/>\r\n");
+    if (svg_path_open && (svg_path_color_idx != svg_color_idx || svg_path_line_type != svg_line_type ||
+                          svg_path_segments >= SVG_PATH_MAX_SEGMENTS))
+        svg_path_close();
+
+    long tx1 = svg_tenths(x1), ty1 = svg_tenths(y1);
+    if (!svg_path_open)
+    {
+        svg_path_open = true;
+        svg_path_color_idx = svg_color_idx;
+        svg_path_line_type = svg_line_type;
+        svg_path_segments = 0;
+        svg_path_d = "M";
+        svg_path_cmd = 'M';
+        svg_append_num(svg_path_d, tx1);
+        svg_append_num(svg_path_d, ty1);
+        svg_path_X = tx1;
+        svg_path_Y = ty1;
+    }
+    else if (tx1 != svg_path_X || ty1 != svg_path_Y)
+        svg_path_add('m', tx1 - svg_path_X, ty1 - svg_path_Y); // the pen was moved up
+
+    // Relative to where the path's pen is, so rounding doesn't add up along the path
+    svg_path_add('l', svg_tenths(x2) - svg_path_X, svg_tenths(y2) - svg_path_Y);
+    svg_path_segments++;
 }
 
 void svgPlotter::svg_abs_plot_line()
@@ -237,6 +305,7 @@ CHAR. SCALE		S(0-63)			      GRAPHICS
 
 void svgPlotter::svg_put_text(std::string S)
 {
+    svg_path_close();
     int fontWeight = svg_compute_weight(fontSize);
     fprintf(_file, "<text x=\"%g\" y=\"%g\" ", svg_X, svg_Y);
     fprintf(_file, "font-size=\"%g\" font-family=\"FifteenTwenty\" font-weight=\"%d\" fill=\"%s\" ", fontSize, fontWeight, svg_colors[svg_color_idx].c_str());
@@ -299,10 +368,13 @@ void svgPlotter::svg_header()
     svg_filepos[2] = ftell(_file);
     fprintf(_file, "  2000\" xmlns=\"http://www.w3.org/2000/svg\">\r\n");
     svg_home_flag = true;
+    svg_path_open = false;
+    svg_path_d.clear();
 }
 
 void svgPlotter::svg_footer()
 {
+    svg_path_close();
     size_t here = ftell(_file);
     // go back and rewrite the Y extent
     fseek(_file, svg_filepos[0], 0);
@@ -44,6 +44,20 @@ protected:
 
     std::string shortname;
 
+    // Lines drawn one after another in the same color and line type go into one
+    // <path>, as relative moves in tenths, written out when it's closed
+    bool svg_path_open = false;
+    long svg_path_X = 0; // where the path's pen is, in tenths
+    long svg_path_Y = 0;
+    int svg_path_color_idx = 0;
+    int svg_path_line_type = 0;
+    int svg_path_segments = 0;
+    char svg_path_cmd = 0; // last command letter in the path data
+    std::string svg_path_d;
+
+    void svg_path_add(char cmd, long dx, long dy);
+    void svg_path_close();
+
     void svg_update_bounds();
     int svg_compute_weight(double fsize);
     void svg_new_line();
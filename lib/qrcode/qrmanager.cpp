@@ -10,11 +10,40 @@
 
 QRManager qrManager;
 
-std::vector<uint8_t> QRManager::encode(const void* src, size_t len, size_t version, size_t ecc, size_t *out_len) {
+int QRManager::_encode(const char *text, size_t len, uint8_t version, uint8_t ecc) {
+    int victim = 0;
+    for (int i = 0; i < QR_CACHE_ENTRIES; i++) {
+        qr_cached &c = _cache[i];
+        if (!c.modules.empty() && c.version == version && c.ecc == ecc && c.text.compare(0, std::string::npos, text, len) == 0) {
+            c.last_used = ++_clock;
+            return i;
+        }
+        if (c.last_used < _cache[victim].last_used) victim = i;
+    }
+
+    qr_cached &c = _cache[victim];
+    c.modules.resize(qrcode_getBufferSize(version));
+
+    QRCode qr_code;
+    if (qrcode_initText(&qr_code, c.modules.data(), version, ecc, text) != 0) {
+        c = qr_cached();
+        return -1;
+    }
+
+    c.text.assign(text, len);
+    c.version = version;
+    c.ecc = ecc;
+    c.size = qr_code.size;
+    c.last_used = ++_clock;
+    return victim;
+}
+
+const std::vector<uint8_t> &QRManager::encode(const void* src, size_t len, size_t version, size_t ecc, size_t *out_len) {
     qrManager.version = version;
     qrManager.ecc_mode = ecc;
+    qrManager._current = -1;
 
-    *out_len = 0;
+    if (out_len) *out_len = 0;
     qrManager.out_buf.clear();
     qrManager.out_buf.shrink_to_fit();
 
@@ -22,84 +51,28 @@ std::vector<uint8_t> QRManager::encode(const void* src, size_t len, size_t versi
         return qrManager.out_buf;
     }
 
-    QRCode qr_code;
-    uint8_t qr_bytes[qrcode_getBufferSize(version)];
-
-    uint8_t err = qrcode_initText(&qr_code, qr_bytes, version, ecc, (const char*)src);
-
-    qrManager.out_buf.push_back(qrManager.size());
-
-    if (err == 0) {
-        size_t size = qr_code.size;
-        *out_len = size*size;
-
-        for (uint8_t x = 0; x < size; x++) {
-            for (uint8_t y = 0; y < size; y++) {
-                uint8_t on = qrcode_getModule(&qr_code, x, y);
-                qrManager.out_buf.push_back(on);
-            }
-        }
+    qrManager._current = qrManager._encode((const char*)src, len, version, ecc);
+    if (qrManager._current < 0) {
+        qrManager.out_buf.push_back(qrManager.size());
+        return qrManager.out_buf;
     }
 
+    qrManager._render(QR_OUTPUT_MODE_BYTES);
+    if (out_len) *out_len = qrManager.out_buf.size() - 1;
+
     return qrManager.out_buf;
 }
 
 void QRManager::to_binary(void) {
-    auto bytes = qrManager.out_buf;
-    size_t len = bytes.size();
-    std::vector<uint8_t> out;
-
-    out.push_back(qrManager.size());
-
-    uint8_t val = 0;
-    for (auto i = 0; i < len; i++) {
-        auto bit = i % 8;
-        if (bit == 0 && i > 0) {
-            out.push_back(val);
-            val = 0;
-        }
-        val |= bytes[1+i+bit] << bit;
-    }
-    out.push_back(val);
-
-    qrManager.out_buf = out;
+    _render(QR_OUTPUT_MODE_BINARY);
 }
 
 void QRManager::to_bitmap(void) {
-    auto bytes = qrManager.out_buf;
-    size_t size = qrManager.size();
-    size_t len = bytes.size();
-    size_t bytes_per_row = ceil(size / 8.0);
-    std::vector<uint8_t> out;
-
-    out.push_back(size);
-
-    uint8_t val = 0;
-    uint8_t x = 0;
-    uint8_t y = 0;
-    for (auto i = 0; i < len; i++) {
-        val |= bytes[1+i];
-        x++;
-        if (x == size) {
-            val = val << (bytes_per_row * 8 - x);
-            out.push_back(val);
-            val = 0;
-            x = 0;
-            y++;
-        }
-        else if (x % 8 == 0 && i > 0) {
-            out.push_back(val);
-            val = 0;
-        }
-        else {
-            val = val << 1;
-        }
-        if (y == size) {
-            break;
-        }
-    }
+    _render(QR_OUTPUT_MODE_BITMAP);
+}
 
-    qrManager.out_buf = out;
+void QRManager::to_atascii(void) {
+    _render(QR_OUTPUT_MODE_ATASCII);
 }
 
 /*
@@ -117,28 +90,6 @@ in most cases, but for best results you may want to use custom characters for th
 //                     0    1    2    3    4    5    6    7    8    9    10   11   12   13   14   15
 uint8_t atascii[16] = {32,  12,  11,  149, 15,  25,  6,   137, 9,   7,   153, 143, 21,  139, 140, 160};
 
-void QRManager::to_atascii(void) {
-    auto bytes = qrManager.out_buf;
-    size_t size = qrManager.size();
-    std::vector<uint8_t> out;
-
-    out.push_back(size);
-
-    for (auto y = 0; y < size; y += 2) {
-        for (auto x = 0; x < size; x += 2) {
-            uint8_t val = bytes[1+y*size+x];
-            // QR Codes have odd number of rows/columns, so last ATASCII char is only half full
-            if (x+1 < size) val |= bytes[1+y*size+x+1] << 1;
-            if (y+1 < size) val |= bytes[1+(y+1)*size+x] << 2;
-            if (y+1 < size && x+1 < size) val |= bytes[1+(y+1)*size+x+1] << 3;
-            out.push_back(atascii[val]);
-        }
-        out.push_back(155); // Atari newline
-    }
-
-    qrManager.out_buf = out;
-}
-
 /*
 This collapses each 2x2 groups of modules (pixels) into a single PETSCII character.
 Values for PETSCII look up are as calculated as follows. Some characters need to be
@@ -159,28 +110,84 @@ uint8_t petscii[2][16] = {
 };
 
 void QRManager::to_petscii(void) {
-    auto bytes = qrManager.out_buf;
-    size_t size = qrManager.size();
-    std::vector<uint8_t> out;
-    bool reverse = false;
-
-    out.push_back(size);
-
-    for (auto y = 0; y < size; y += 2) {
-        for (auto x = 0; x < size; x += 2) {
-            uint8_t val = bytes[1+y*size+x];
-            // QR Codes have odd number of rows/columns, so last PETSCII char is only half full
-            if (x+1 < size) val |= bytes[1+y*size+x+1] << 1;
-            if (y+1 < size) val |= bytes[1+(y+1)*size+x] << 2;
-            if (y+1 < size && x+1 < size) val |= bytes[1+(y+1)*size+x+1] << 3;
-            if (reverse != petscii[1][val]) {
-                reverse = !reverse;
-                out.push_back(((reverse) ? 18 : 146)); // 18 Reverse On / 146 Reverse Off
+    _render(QR_OUTPUT_MODE_PETSCII);
+}
+
+void QRManager::_render(uint8_t mode) {
+    if (_current < 0) {
+        return;
+    }
+
+    const qr_cached &qr = _cache[_current];
+    size_t size = qr.size;
+    size_t cells = (size + 1) / 2; // 2x2 modules per ATASCII or PETSCII character
+    uint8_t *out;
+
+    switch (mode) {
+    case QR_OUTPUT_MODE_BYTES:
+        out_buf.resize(1 + size * size);
+        out = &out_buf[1];
+        for (size_t row = 0; row < size; row++) {
+            for (size_t col = 0; col < size; col++) {
+                *out++ = _module(qr, row, col);
             }
-            out.push_back(petscii[0][val]);
         }
-        out.push_back(13); // Carriage return
+        break;
+
+    case QR_OUTPUT_MODE_BINARY:
+        // Every module in turn, LSB first
+        out_buf.assign(1 + (size * size + 7) / 8, 0);
+        for (size_t i = 0; i < size * size; i++) {
+            out_buf[1 + i / 8] |= _module(qr, i / size, i % size) << (i % 8);
+        }
+        break;
+
+    case QR_OUTPUT_MODE_BITMAP: {
+        // Each row MSB first, padded out to a whole byte
+        size_t bytes_per_row = (size + 7) / 8;
+        out_buf.assign(1 + size * bytes_per_row, 0);
+        out = &out_buf[1];
+        for (size_t row = 0; row < size; row++, out += bytes_per_row) {
+            for (size_t col = 0; col < size; col++) {
+                out[col / 8] |= _module(qr, row, col) << (7 - col % 8);
+            }
+        }
+        break;
+    }
+
+    case QR_OUTPUT_MODE_ATASCII:
+        out_buf.resize(1 + cells * (cells + 1));
+        out = &out_buf[1];
+        for (size_t y = 0; y < size; y += 2) {
+            for (size_t x = 0; x < size; x += 2) {
+                *out++ = atascii[_quad(qr, y, x)];
+            }
+            *out++ = 155; // Atari newline
+        }
+        break;
+
+    case QR_OUTPUT_MODE_PETSCII: {
+        bool reverse = false;
+        out_buf.resize(1);
+        // At most a reverse on or off ahead of every character
+        out_buf.reserve(1 + cells * (2 * cells + 1));
+        for (size_t y = 0; y < size; y += 2) {
+            for (size_t x = 0; x < size; x += 2) {
+                uint8_t val = _quad(qr, y, x);
+                if (reverse != petscii[1][val]) {
+                    reverse = !reverse;
+                    out_buf.push_back(((reverse) ? 18 : 146)); // 18 Reverse On / 146 Reverse Off
+                }
+                out_buf.push_back(petscii[0][val]);
+            }
+            out_buf.push_back(13); // Carriage return
+        }
+        break;
+    }
+
+    default:
+        return;
     }
 
-    qrManager.out_buf = out;
+    out_buf[0] = size;
 }
@@ -19,8 +19,50 @@
 #define QR_OUTPUT_MODE_BINARY  1
 #define QR_OUTPUT_MODE_ATASCII 2
 #define QR_OUTPUT_MODE_BITMAP  3
+#define QR_OUTPUT_MODE_PETSCII 4
+
+// Codes kept encoded, so asking for the same one again skips the Reed-Solomon and mask passes
+#define QR_CACHE_ENTRIES 4
 
 class QRManager {
+    struct qr_cached
+    {
+        std::string text;
+        uint8_t version = 0;
+        uint8_t ecc = 0;
+        uint8_t size = 0;
+        std::vector<uint8_t> modules; // The qrcode library's bit grid
+        uint32_t last_used = 0;
+    };
+
+    qr_cached _cache[QR_CACHE_ENTRIES];
+    uint32_t _clock = 0;
+    int _current = -1; // Cache entry of the last code encoded, -1 if it failed
+
+    // Module at row, col of the output, which runs down the library's columns
+    static bool _module(const qr_cached &qr, size_t row, size_t col)
+    {
+        size_t offset = col * qr.size + row;
+        return (qr.modules[offset >> 3] >> (7 - (offset & 7))) & 1;
+    }
+
+    // The 2x2 modules from row, col as a 4 bit character index. QR Codes have odd
+    // number of rows/columns, so the last character of a row or column is only half full
+    static uint8_t _quad(const qr_cached &qr, size_t row, size_t col)
+    {
+        bool right = col + 1 < qr.size, below = row + 1 < qr.size;
+        uint8_t val = _module(qr, row, col);
+        if (right) val |= _module(qr, row, col + 1) << 1;
+        if (below) val |= _module(qr, row + 1, col) << 2;
+        if (right && below) val |= _module(qr, row + 1, col + 1) << 3;
+        return val;
+    }
+
+    // The cache entry for a code, encoding it into the least recently used one if it isn't there.
+    // Returns -1 if it can't be encoded
+    int _encode(const char *text, size_t len, uint8_t version, uint8_t ecc);
+    void _render(uint8_t mode);
+
 public:
     /**
     * encode - generate QR code as bytes
@@ -29,18 +71,22 @@ public:
     * @version: 1-40 (Size=17+4*Version)
     * @ecc: Error correction level (0=Low, 1=Medium, 2=Quartile, 3=High)
     * @out_len: Pointer to output length variable, or %NULL if not used
-    * Returns: Allocated buffer of out_len bytes of encoded data,
-    * or nullptr on failure
+    * Returns: out_buf, holding the size followed by out_len bytes of
+    * encoded data, or just the size on failure
     *
     * Returned buffer consists of a 1 or 0 for each QR module, indicating
-    * whether it is on (black) or off (white).
+    * whether it is on (black) or off (white). The last QR_CACHE_ENTRIES
+    * codes are remembered, and one of them is not encoded again.
     */
-    static std::vector<uint8_t> encode(const void* src, size_t len, size_t version, size_t ecc, size_t* out_len);
+    static const std::vector<uint8_t> &encode(const void* src, size_t len, size_t version, size_t ecc, size_t* out_len);
+
+    // The to_ functions render the last code encoded straight into out_buf,
+    // whatever format out_buf was left in
 
     /**
     * to_binary - Convert QR code in out_buf to compact binary format
     *
-    * Replaces data in out_buf, where each byte is 0x00 or 0x01 with, with
+    * Replaces data in out_buf, where each byte is 0x00 or 0x01, with
     * compact data where each bit represents a single QR module (pixel).
     * So a 21x21 QR code will be 56 bytes (21*21/8). Data is returned LSB->MSB.
     */
@@ -60,6 +60,51 @@ fnTcpServer *server;
 bool teeMode = false;
 unsigned short portActive = 0;
 
+/* Console output is collected and sent in bursts, since a screen redraw is
+   thousands of single characters and each write() has its own overhead.
+   Pending output goes out when the buffer fills, when the program looks for
+   input, or once it has waited CPM_CONSOLE_DEADLINE_MS. Input is read in
+   bulk for the same reason. */
+#define CPM_CONSOLE_OUTSIZE 256
+#define CPM_CONSOLE_INSIZE 64
+#define CPM_CONSOLE_DEADLINE_MS 10
+
+uint8_t con_out[CPM_CONSOLE_OUTSIZE];
+size_t con_out_len = 0;
+uint64_t con_out_since = 0;
+uint8_t con_in[CPM_CONSOLE_INSIZE];
+size_t con_in_pos = 0;
+size_t con_in_len = 0;
+
+void _console_flush(void)
+{
+	if (con_out_len == 0)
+		return;
+	FN_CPM_LINK.write(con_out, con_out_len);
+	if (teeMode == true)
+		client.write(con_out, con_out_len);
+	con_out_len = 0;
+}
+
+void _console_poll(void)
+{
+	if (con_out_len > 0 && fnSystem.millis() - con_out_since >= CPM_CONSOLE_DEADLINE_MS)
+		_console_flush();
+}
+
+// Bytes of console input ready, refilling the input buffer from the link when it's empty
+size_t _console_fill(void)
+{
+	if (con_in_pos >= con_in_len)
+	{
+		con_in_pos = con_in_len = 0;
+		int avail = FN_CPM_LINK.available();
+		if (avail > 0)
+			con_in_len = FN_CPM_LINK.readBytes(con_in, avail < CPM_CONSOLE_INSIZE ? avail : CPM_CONSOLE_INSIZE);
+	}
+	return con_in_len - con_in_pos;
+}
+
 char *full_path(char *fn)
 {
 	memset(full_filename, 0, sizeof(full_filename));
@@ -110,8 +155,73 @@ bool _RamLoad(char *fn, uint16_t address)
 FILE *rootdir;
 FILE *userdir;
 
+// Record reads and writes go through one host file kept open between calls,
+// with a bigger stdio buffer, so each 128 byte record no longer costs an
+// fopen, fseek and fclose. Writes stay in the buffer until another file is
+// used, the file is looked at some other way or the console waits for a key.
+#define CPM_FILE_BUFSIZE 4096
+
+struct
+{
+	char path[128];
+	FILE *f = nullptr;
+	bool writable = false;
+	bool dirty = false;
+} cpm_file;
+
+void _cpm_file_flush()
+{
+	if (cpm_file.f != nullptr && cpm_file.dirty)
+	{
+		fflush(cpm_file.f);
+		cpm_file.dirty = false;
+	}
+}
+
+void _cpm_file_close()
+{
+	if (cpm_file.f != nullptr)
+		fclose(cpm_file.f);
+	cpm_file.f = nullptr;
+	cpm_file.path[0] = '\0';
+	cpm_file.writable = false;
+	cpm_file.dirty = false;
+}
+
+// The open handle for fn, creating the file when writing to one that isn't there
+FILE *_cpm_file_get(uint8_t *fn, bool write)
+{
+	char *path = full_path((char *)fn);
+
+	if (cpm_file.f != nullptr && strcmp(cpm_file.path, path) == 0 && (cpm_file.writable || !write))
+		return cpm_file.f;
+
+	_cpm_file_close();
+	// Opening a file can take a while, don't leave the screen behind
+	_console_flush();
+
+	FILE *f = fnSDFAT.file_open(path, "r+");
+	bool writable = f != nullptr;
+	if (f == nullptr && write && !fnSDFAT.exists(path))
+	{
+		f = fnSDFAT.file_open(path, "w+");
+		writable = f != nullptr;
+	}
+	if (f == nullptr && !write)
+		f = fnSDFAT.file_open(path, "r");
+	if (f == nullptr)
+		return nullptr;
+
+	setvbuf(f, nullptr, _IOFBF, CPM_FILE_BUFSIZE);
+	strlcpy(cpm_file.path, path, sizeof(cpm_file.path));
+	cpm_file.f = f;
+	cpm_file.writable = writable;
+	return f;
+}
+
 bool _sys_exists(uint8* filename)
 {
+	_cpm_file_flush();
 	return fnSDFAT.exists(full_path((char *)filename));
 }
 
@@ -137,6 +247,8 @@ int _sys_select(uint8_t *disk)
 
 long _sys_filesize(uint8_t *fn)
 {
+	_cpm_file_close();
+
 	unsigned long fs = -1;
 	FILE *fp = fnSDFAT.file_open(full_path((char *)fn), "r");
 
@@ -152,6 +264,8 @@ long _sys_filesize(uint8_t *fn)
 
 int _sys_openfile(uint8_t *fn)
 {
+	_cpm_file_close();
+
 	FILE *fp = fnSDFAT.file_open(full_path((char *)fn), "r");
 	if (fp)
 	{
@@ -164,6 +278,8 @@ int _sys_openfile(uint8_t *fn)
 
 int _sys_makefile(uint8_t *fn)
 {
+	_cpm_file_close();
+
 	FILE *fp = fnSDFAT.file_open(full_path((char *)fn), "w");
 	if (fp)
 	{
@@ -176,6 +292,7 @@ int _sys_makefile(uint8_t *fn)
 
 int _sys_deletefile(uint8_t *fn)
 {
+	_cpm_file_close();
 	return fnSDFAT.remove(full_path((char *)fn));
 }
 
@@ -183,6 +300,7 @@ int _sys_renamefile(uint8_t *fn, uint8_t *newname)
 {
 	std::string from, to;
 
+	_cpm_file_close();
 	from = std::string(full_path((char *)fn));
 	to = std::string(full_path((char *)newname));
 
@@ -194,32 +312,6 @@ void _sys_logbuffer(uint8_t *buffer)
 	// not implemented at present.
 }
 
-bool _sys_extendfile(char *fn, unsigned long fpos)
-{
-	FILE *fp = fnSDFAT.file_open(full_path((char *)fn), "a");
-
-	if (!fp)
-		return false;
-
-	long origSize = fnSDFAT.filesize(full_path(fn));
-
-	// This was patterned after the arduino abstraction, and I do not like how this works.
-
-	if (fpos > origSize)
-	{
-		for (long i = 0; i < (origSize - fpos); ++i)
-		{
-			if (fwrite("\0", sizeof(uint8_t), 1, fp) != 1)
-			{
-				fclose(fp);
-				return false;
-			}
-		}
-	}
-	fclose(fp);
-	return true;
-}
-
 uint8_t _sys_readseq(uint8_t *fn, long fpos)
 {
 	uint8_t result = 0xff;
@@ -228,35 +320,27 @@ uint8_t _sys_readseq(uint8_t *fn, long fpos)
 	uint8_t dmabuf[BlkSZ];
 	int seekErr;
 
-	f = fnSDFAT.file_open(full_path((char *)fn), "r");
+	f = _cpm_file_get(fn, false);
 	if (!f)
 	{
 		result = 0x10;
 		return result;
 	}
 	seekErr = fseek(f, fpos, SEEK_SET);
-	if (f)
+	if (fpos > 0 && seekErr != 0)
 	{
-		if (fpos > 0 && seekErr != 0)
-		{
-			// EOF
-			result = 0x01;
-		}
-		else
-		{
-			// set DMA buffer to EOF
-			memset(dmabuf, 0x1a, BlkSZ);
-			bytesread = fread(&dmabuf[0], BlkSZ, sizeof(uint8_t), f);
-			if (bytesread)
-				memcpy((uint8_t *)&RAM[dmaAddr], dmabuf, BlkSZ);
-			result = bytesread ? 0x00 : 0x01;
-		}
+		// EOF
+		result = 0x01;
 	}
 	else
 	{
-		result = 0x10;
+		// set DMA buffer to EOF
+		memset(dmabuf, 0x1a, BlkSZ);
+		bytesread = fread(&dmabuf[0], BlkSZ, sizeof(uint8_t), f);
+		if (bytesread)
+			memcpy((uint8_t *)&RAM[dmaAddr], dmabuf, BlkSZ);
+		result = bytesread ? 0x00 : 0x01;
 	}
-	fclose(f);
 	return (result);
 }
 
@@ -265,17 +349,14 @@ uint8_t _sys_writeseq(uint8_t *fn, long fpos)
 	uint8_t result = 0xff;
 	FILE *f;
 
-	if (_sys_extendfile((char *)fn, fpos))
-		f = fnSDFAT.file_open(full_path((char *)fn), "r+");
-	else
-		return result;
-
+	f = _cpm_file_get(fn, true);
 	if (f)
 	{
 		if (fseek(f, fpos, SEEK_SET) == 0)
 		{
 			if (fwrite(_RamSysAddr(dmaAddr), BlkSZ, sizeof(uint8_t), f))
 				result = 0x00;
+			cpm_file.dirty = true;
 		}
 		else
 		{
@@ -286,7 +367,6 @@ uint8_t _sys_writeseq(uint8_t *fn, long fpos)
 	{
 		result = 0x10;
 	}
-	fclose(f);
 	return (result);
 }
 
@@ -298,7 +378,7 @@ uint8_t _sys_readrand(uint8_t *fn, long fpos)
 	uint8 dmabuf[BlkSZ];
 	long extSize;
 
-	f = fnSDFAT.file_open(full_path((char *)fn), "r+");
+	f = _cpm_file_get(fn, false);
 	if (f)
 	{
 		if (fseek(f, fpos, SEEK_SET) == 0)
@@ -317,7 +397,7 @@ uint8_t _sys_readrand(uint8_t *fn, long fpos)
 			}
 			else
 			{
-				extSize = _sys_filesize((uint8_t *)full_path((char *)fn));
+				extSize = _sys_filesize(fn);
 
 				// round file size up to next full logical extent
 				extSize = ExtSZ * ((extSize / ExtSZ) + ((extSize % ExtSZ) ? 1 : 0));
@@ -332,7 +412,6 @@ uint8_t _sys_readrand(uint8_t *fn, long fpos)
 	{
 		result = 0x10;
 	}
-	fclose(f);
 	return (result);
 }
 
@@ -341,19 +420,14 @@ uint8_t _sys_writerand(uint8_t *fn, long fpos)
 	uint8 result = 0xff;
 	FILE *f;
 
-	if (_sys_extendfile((char *)fn, fpos))
-	{
-		f = fnSDFAT.file_open(full_path((char *)fn), "r+");
-	}
-	else
-		return result;
-
+	f = _cpm_file_get(fn, true);
 	if (f)
 	{
 		if (fseek(f, fpos, SEEK_SET) == 0)
 		{
 			if (fwrite(_RamSysAddr(dmaAddr), BlkSZ, sizeof(uint8_t), f))
 				result = 0x00;
+			cpm_file.dirty = true;
 		}
 		else
 		{
@@ -364,7 +438,6 @@ uint8_t _sys_writerand(uint8_t *fn, long fpos)
 	{
 		result = 0x10;
 	}
-	fclose(f);
 	return (result);
 }
 
@@ -434,6 +507,7 @@ uint8_t _findfirst(uint8_t isdir)
 	uint8 path[4] = {'?', FOLDERCHAR, '?', 0};
 	path[0] = filename[0];
 	path[2] = filename[2];
+	_cpm_file_flush();
 	fnSDFAT.dir_close();
 	fnSDFAT.dir_open(full_path((char *)path), "*", 0);
 	_HostnameToFCBname(filename, pattern);
@@ -512,49 +586,48 @@ uint8_t _sys_makedisk(uint8_t drive)
 
 int _kbhit(void)
 {
-	return FN_CPM_LINK.available();
+	_console_poll();
+	return _console_fill();
 }
 
 uint8_t _getch(void)
 {
-	if (teeMode == true)
+	// Nothing more is coming until the user answers
+	_console_flush();
+	// Waiting on the user is a good time to get writes onto the card
+	_cpm_file_flush();
+	while (true)
 	{
-		while (FN_CPM_LINK.available() > 0)
+		if (teeMode == true && client.available())
 		{
-			if (client.available())
-			{
-				uint8_t ch;
-				client.read(&ch, 1);
-				return ch & 0x7F;
-			}
+			uint8_t ch;
+			client.read(&ch, 1);
+			return ch & 0x7F;
 		}
-		return FN_CPM_LINK.read() & 0x7F;
+		if (_console_fill() > 0)
+			return con_in[con_in_pos++] & 0x7f;
 	}
+}
+
+void _putch(uint8_t ch)
+{
+	if (con_out_len == 0)
+		con_out_since = fnSystem.millis();
+	con_out[con_out_len++] = ch & 0x7f;
+	if (con_out_len == sizeof(con_out))
+		_console_flush();
 	else
-	{
-		while (FN_CPM_LINK.available() <= 0)
-		{
-		}
-		return FN_CPM_LINK.read() & 0x7f;
-	}
+		_console_poll();
 }
 
 uint8_t _getche(void)
 {
 	uint8_t ch = _getch() & 0x7f;
-	FN_CPM_LINK.write(ch);
-	if (teeMode == true)
-		client.write(ch);
+	_putch(ch);
+	_console_flush();
 	return ch;
 }
 
-void _putch(uint8_t ch)
-{
-	FN_CPM_LINK.write(ch & 0x7f);
-	if (teeMode == true)
-		client.write(ch);
-}
-
 void _clrscr(void)
 {
 }
@@ -1,8 +1,15 @@
 
 #include "samlib.h"
 
+#include <list>
+#include <string>
+
 #ifdef ESP_PLATFORM
+  #include <vector>
+  #include <esp_heap_caps.h>
   #include <freertos/FreeRTOS.h>
+  #include <freertos/queue.h>
+  #include <freertos/task.h>
   #include <freertos/timers.h>
   #include <driver/gpio.h>
   #ifndef CONFIG_IDF_TARGET_ESP32S3
@@ -20,6 +27,9 @@
 #ifdef __cplusplus
 extern char input[256];
 extern char *buffer;
+extern int bufferpos;
+extern unsigned char speed, pitch, mouth, throat;
+extern int singmode;
 #endif
 
 int debug = 0;
@@ -428,7 +438,97 @@ void OutputSound()
 
 #endif //USESDL
 
-int sam(int argc, char **argv)
+// Rendered utterances are kept so a phrase that comes around again plays
+// straight away, without going through the reciter and renderer
+#define SAM_CACHE_BYTES_PSRAM (512 * 1024)
+#define SAM_CACHE_BYTES_HOST (4 * 1024 * 1024)
+
+struct sam_cache_entry
+{
+    std::string key;
+    char *pcm;
+    int length; // As bufferpos, in 1/50ths of a sample
+};
+
+// Most recently used first
+static std::list<sam_cache_entry> sam_cache;
+static size_t sam_cache_used = 0;
+
+static size_t sam_cache_budget()
+{
+#ifdef ESP_PLATFORM
+    return fnSystem.get_psram_size() > 0 ? SAM_CACHE_BYTES_PSRAM : 0;
+#else
+    return SAM_CACHE_BYTES_HOST;
+#endif
+}
+
+// Everything the render depends on: the text as given and the voice settings
+static std::string sam_cache_key(int phonetic)
+{
+    std::string key(input);
+    key.push_back('\0');
+    key.push_back(phonetic ? 1 : 0);
+    key.push_back(singmode ? 1 : 0);
+    key.push_back(speed);
+    key.push_back(pitch);
+    key.push_back(mouth);
+    key.push_back(throat);
+    return key;
+}
+
+// Play a cached render if there is one, returning false if not
+static bool sam_cache_play(const std::string &key, bool play)
+{
+    for (auto it = sam_cache.begin(); it != sam_cache.end(); ++it)
+    {
+        if (it->key != key)
+            continue;
+
+        sam_cache.splice(sam_cache.begin(), sam_cache, it);
+        if (play)
+        {
+            // Output reads the global buffer, so lend it the cached copy
+            buffer = it->pcm;
+            bufferpos = it->length;
+            OutputSound();
+            buffer = NULL;
+            bufferpos = 0;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Keep a copy of the render just made, dropping the least recently used to make room
+static void sam_cache_add(const std::string &key)
+{
+    size_t budget = sam_cache_budget();
+    size_t size = bufferpos / 50;
+    if (size == 0 || size > budget / 4)
+        return;
+
+    while (!sam_cache.empty() && sam_cache_used + size > budget)
+    {
+        sam_cache_entry &oldest = sam_cache.back();
+        sam_cache_used -= oldest.length / 50;
+        free(oldest.pcm);
+        sam_cache.pop_back();
+    }
+
+#ifdef ESP_PLATFORM
+    char *pcm = (char *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+    char *pcm = (char *)malloc(size);
+#endif
+    if (pcm == nullptr)
+        return;
+    memcpy(pcm, buffer, size);
+    sam_cache.push_front({key, pcm, bufferpos});
+    sam_cache_used += size;
+}
+
+static int sam_run(int argc, char **argv, bool play)
 {
     int i;
     int phonetic = 0;
@@ -539,6 +639,10 @@ int sam(int argc, char **argv)
             printf("text input: %s\r\n", input);
     }
 
+    std::string key = sam_cache_key(phonetic);
+    if (sam_cache_play(key, play))
+        return 0;
+
     if (!phonetic)
     {
         strlcat(input, "[", sizeof(input) - strlen(input));
@@ -582,8 +686,91 @@ int sam(int argc, char **argv)
 //         WriteWav(wavfilename, GetBuffer(), GetBufferLength() / 50);
 //     else
 // #endif // ESP_PLATFORM
+    sam_cache_add(key);
+    if (play)
         OutputSound();
 
     FreeBuffer();
     return 0;
 }
+
+int sam(int argc, char **argv)
+{
+    return sam_run(argc, argv, true);
+}
+
+#ifdef ESP_PLATFORM
+// Rendering and playing an utterance takes seconds, so it's kept off the bus
+// task. Core 0 keeps the DAC output's busy waits away from the bus, below the
+// WiFi and lwIP tasks.
+#define SAM_QUEUE_LENGTH 8
+#define SAM_QUEUE_WAIT_MS 10000 // Less than the 15s the voice device tells the computer to wait
+#define SAM_TASK_STACKSIZE 8192
+#define SAM_TASK_PRIORITY 10
+#define SAM_TASK_CPUAFFINITY 0
+
+// Each queued item owns a copy of its arguments
+struct sam_job
+{
+    std::vector<std::string> args;
+    bool play;
+};
+
+static QueueHandle_t sam_queue_handle = nullptr;
+
+static void sam_task(void *param)
+{
+    sam_job *job;
+    while (true)
+    {
+        if (xQueueReceive(sam_queue_handle, &job, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        std::vector<char *> argv;
+        for (std::string &arg : job->args)
+            argv.push_back(&arg[0]);
+        sam_run(argv.size(), argv.data(), job->play);
+        delete job;
+    }
+}
+
+static void sam_enqueue(int argc, char **argv, bool play)
+{
+    if (sam_queue_handle == nullptr)
+    {
+        sam_queue_handle = xQueueCreate(SAM_QUEUE_LENGTH, sizeof(sam_job *));
+        if (xTaskCreatePinnedToCore(sam_task, "sam", SAM_TASK_STACKSIZE, nullptr,
+                                    SAM_TASK_PRIORITY, nullptr, SAM_TASK_CPUAFFINITY) != pdPASS)
+        {
+            printf("sam_queue couldn't start its task, speaking in place\r\n");
+            vQueueDelete(sam_queue_handle);
+            sam_queue_handle = nullptr;
+            sam_run(argc, argv, play);
+            return;
+        }
+    }
+
+    sam_job *job = new sam_job{std::vector<std::string>(argv, argv + argc), play};
+    // A full queue holds the caller back rather than dropping speech
+    if (xQueueSend(sam_queue_handle, &job, pdMS_TO_TICKS(SAM_QUEUE_WAIT_MS)) != pdTRUE)
+    {
+        printf("sam_queue full, dropping utterance\r\n");
+        delete job;
+    }
+}
+#else
+static void sam_enqueue(int argc, char **argv, bool play)
+{
+    sam_run(argc, argv, play);
+}
+#endif
+
+void sam_queue(int argc, char **argv)
+{
+    sam_enqueue(argc, argv, true);
+}
+
+void sam_prewarm(int argc, char **argv)
+{
+    sam_enqueue(argc, argv, false);
+}
@@ -34,3 +34,9 @@ void OutputSound();
 #endif
 
 int sam(int argc, char **argv);
+
+// Like sam(), but returns as soon as the arguments are copied. Utterances are
+// rendered and played one after another by a task of their own on ESP
+void sam_queue(int argc, char **argv);
+// Render into the cache without playing, so the phrase is ready when it's next spoken
+void sam_prewarm(int argc, char **argv);
@@ -1,5 +1,3 @@
-#ifndef ESP_PLATFORM
-
 #include "fnTask.h"
 #include "debug.h"
 
@@ -9,6 +7,9 @@ fnTask::fnTask()
     _id = 0;
     _state = TASK_READY;
     _reason = TASK_COMPLETED;
+    _priority = TASK_PRIORITY_NORMAL;
+    _cancel_requested = false;
+    _busy = false;
     _callback = nullptr;
 }
 
@@ -75,5 +76,3 @@ int fnTestTask::step()
         return 0;   // continue
     return 1;       // done
 }
-
-#endif // !ESP_PLATFORM
\ No newline at end of file
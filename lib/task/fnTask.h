@@ -22,6 +22,14 @@ public:
         TASK_ABORTED
     };
 
+    // higher priority tasks are stepped first and get whatever is left of the time slice
+    enum task_priority
+    {
+        TASK_PRIORITY_LOW = 0,
+        TASK_PRIORITY_NORMAL,
+        TASK_PRIORITY_HIGH
+    };
+
     fnTask();
     virtual ~fnTask() = 0;
 
@@ -31,6 +39,20 @@ public:
     virtual int get_progress() {return 0;};         // optional
     virtual void * get_result() {return nullptr;};  // optional
 
+    // scheduling, set before the task is submitted
+    task_priority get_priority() {return _priority;};
+    void set_priority(task_priority priority) {_priority = priority;};
+    // called on every state change, e.g. to pick up the result before the task is deleted
+    void set_callback(void (*callback)(fnTask *t, task_state new_state)) {_callback = callback;};
+
+    // ask the task to stop; it is aborted before its next step
+    void cancel() {_cancel_requested = true;};
+    bool cancel_requested() {return _cancel_requested;};
+
+    // true if the task may run on the ESP32 worker task instead of the bus loop,
+    // i.e. it doesn't touch anything bus devices use without locking
+    virtual bool worker_safe() {return false;};
+
 protected:
     // task state management
     // READY -> RUNNING
@@ -49,6 +71,9 @@ protected:
     uint8_t _id;                                    // task ID 1..255, 0 is invalid / not yet assigned ID
     task_state _state;
     done_reason _reason;
+    task_priority _priority;
+    volatile bool _cancel_requested;
+    bool _busy;                                     // being started/stepped outside the manager's lock
     void (*_callback)(fnTask *t, task_state new_state);
 };
 
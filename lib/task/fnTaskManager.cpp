@@ -1,8 +1,14 @@
-#ifndef ESP_PLATFORM
-
+#include <algorithm>
 #include <list>
+#include <vector>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
 
 #include "fnTaskManager.h"
+#include "fnSystem.h"
 #include "debug.h"
 
 // global task manager object
@@ -14,6 +20,9 @@ fnTaskManager::fnTaskManager()
     // Debug_println("fnTaskManager::fnTaskManager");
     _next_tid = 1;
     _task_count = 0;
+#ifdef ESP_PLATFORM
+    _worker_started = false;
+#endif
 }
 
 fnTaskManager::~fnTaskManager()
@@ -24,6 +33,7 @@ fnTaskManager::~fnTaskManager()
 
 void fnTaskManager::shutdown()
 {
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
     // abort tasks, if any
     for (auto it = _task_map.begin(); it != _task_map.end(); ++it)
     {
@@ -38,6 +48,7 @@ void fnTaskManager::shutdown()
 int fnTaskManager::submit_task(fnTask * t)
 {
     Debug_println("submit_task");
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
 
     for (auto it = _task_map.begin(); it != _task_map.end(); ++it)
     {
@@ -60,7 +71,11 @@ int fnTaskManager::submit_task(fnTask * t)
         _task_count += 1;
         _task_map[tid] = t;
         _next_tid = tid+1;
-        Debug_printf(" submitted #%d\n", tid);
+        Debug_printf(" submitted #%d, priority %d\n", tid, t->_priority);
+#ifdef ESP_PLATFORM
+        if (t->worker_safe())
+            start_worker();
+#endif
     }
     return tid;
 }
@@ -85,51 +100,84 @@ uint8_t fnTaskManager::get_free_tid()
 
 fnTask * fnTaskManager::get_task(uint8_t tid)
 {
-    Debug_printf("get_task %d\n", tid);
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
     std::map<uint8_t, fnTask *>::iterator it = _task_map.find(tid);
     if (it == _task_map.end())
         return nullptr;
     return it->second;
 }
 
+int fnTaskManager::get_progress(uint8_t tid)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    fnTask *task = get_task(tid);
+    if (task == nullptr)
+        return -1;
+    return task->get_progress();
+}
+
+void fnTaskManager::set_state(fnTask *task, fnTask::task_state state)
+{
+    task->_state = state;
+    if (task->_callback != nullptr)
+        task->_callback(task, state);
+}
+
 int fnTaskManager::pause_task(uint8_t tid)
 {
     Debug_printf("pause_task %d\n", tid);
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
     fnTask *task = get_task(tid);
     if (task == nullptr)
         return -1;
     if (task->_state != fnTask::TASK_RUNNING)
         return -1;
     int result = task->pause();
-    task->_state = fnTask::TASK_PAUSED;
-    // TODO callback
+    set_state(task, fnTask::TASK_PAUSED);
     return result;
 }
 
 int fnTaskManager::resume_task(uint8_t tid)
 {
     Debug_printf("resume_task %d\n", tid);
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
     fnTask *task = get_task(tid);
     if (task == nullptr)
         return -1;
     if (task->_state != fnTask::TASK_PAUSED)
         return -1;
     int result = task->resume();
-    task->_state = fnTask::TASK_RUNNING;
-    // TODO callback
+    set_state(task, fnTask::TASK_RUNNING);
     return result;
 }
 
+int fnTaskManager::cancel_task(uint8_t tid)
+{
+    Debug_printf("cancel_task %d\n", tid);
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    fnTask *task = get_task(tid);
+    if (task == nullptr)
+        return -1;
+    task->cancel();
+    return 0;
+}
+
 int fnTaskManager::abort_task(uint8_t tid)
 {
     Debug_printf("abort_task %d\n", tid);
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
     fnTask *task = get_task(tid);
     if (task == nullptr)
         return -1;
+    if (task->_busy)
+    {
+        // It's in the middle of a step on the other side, have it stop when that's done
+        task->cancel();
+        return 0;
+    }
     int result = task->abort();
-    task->_state = fnTask::TASK_DONE;
     task->_reason = fnTask::TASK_ABORTED;
-    // TODO callback
+    set_state(task, fnTask::TASK_DONE);
     // remove aborted task
     _task_count -= 1;
     _task_map.erase(tid);
@@ -143,9 +191,8 @@ int fnTaskManager::complete_task(uint8_t tid)
     fnTask *task = get_task(tid);
     if (task == nullptr)
         return -1;
-    task->_state = fnTask::TASK_DONE;
     task->_reason = fnTask::TASK_COMPLETED;
-    // TODO callback
+    set_state(task, fnTask::TASK_DONE);
     // remove completed task
     _task_count -= 1;
     _task_map.erase(tid);
@@ -153,61 +200,136 @@ int fnTaskManager::complete_task(uint8_t tid)
     return 0;
 }
 
+// READY -> start(), RUNNING -> step(); returns <0 on failure, >0 once the task is done
+int fnTaskManager::step_task(fnTask *task)
+{
+    if (task->_cancel_requested)
+        return -1;
+
+    if (task->_state == fnTask::TASK_READY)
+    {
+        int result = task->start();
+        if (result < 0)
+            return result; // failed to start task
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        set_state(task, fnTask::TASK_RUNNING);
+        return 0;
+    }
+    return task->step();
+}
+
 bool fnTaskManager::service()
 {
-    if (_task_count == 0)
+    return service_tasks(false, TASKMGR_SLICE_US);
+}
+
+// Steps every eligible task once, highest priority first, then keeps going round
+// for as long as the slice lasts. worker picks the worker_safe() tasks on ESP32;
+// elsewhere everything runs from the bus loop.
+bool fnTaskManager::service_tasks(bool worker, uint32_t slice_us)
+{
+    std::vector<fnTask *> runnable;
+    {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        if (_task_count == 0)
+            return true; // idle
+
+        for (auto it = _task_map.begin(); it != _task_map.end(); ++it)
+        {
+            fnTask *task = it->second;
+#ifdef ESP_PLATFORM
+            // Without a worker, everything falls back to the bus loop
+            if ((task->worker_safe() && _worker_started) != worker)
+                continue;
+#endif
+            if (task->_busy)
+                continue;
+            if (task->_state == fnTask::TASK_READY || task->_state == fnTask::TASK_RUNNING)
+            {
+                task->_busy = true;
+                runnable.push_back(task);
+            }
+        }
+    }
+    if (runnable.empty())
         return true; // idle
 
-    bool idle = true; // was service() idle?
-    int result;
-    fnTask *task;
+    std::stable_sort(runnable.begin(), runnable.end(), [](fnTask *a, fnTask *b) {
+        return a->_priority > b->_priority;
+    });
+
     std::list <uint8_t> failed;
     std::list <uint8_t> completed;
+    uint64_t started = fnSystem.micros();
+    bool first_round = true;
 
-    // update READY and RUNNING tasks
-    for (auto it = _task_map.begin(); it != _task_map.end(); ++it)
+    while (!runnable.empty())
     {
-        task = it->second;
-        switch (task->_state)
+        for (auto it = runnable.begin(); it != runnable.end();)
         {
-        case fnTask::TASK_READY:
-            idle = false;
-            result = task->start();
-            if (result < 0)
-                // failed to start task
-                failed.push_back(it->first);
-            else
-                task->_state = fnTask::TASK_RUNNING;
-            break;
+            fnTask *task = *it;
+            if (!first_round && fnSystem.micros() - started >= slice_us)
+                break;
 
-        case fnTask::TASK_RUNNING:
-            idle = false;
-            result = task->step();
-            if (result < 0)
-                // failure in task execution
-                failed.push_back(it->first);
-            else if (result > 0)
+            // A task paused from elsewhere stays put until resumed
+            int result = task->_state == fnTask::TASK_PAUSED ? 1 : step_task(task);
+            if (result == 0)
             {
-                // task completed
-                completed.push_back(it->first);
+                ++it;
+                continue;
             }
-            break;
-        default:
-            ;
+
+            if (task->_state != fnTask::TASK_PAUSED)
+            {
+                if (result < 0)
+                    failed.push_back(task->_id);   // failure in task execution
+                else
+                    completed.push_back(task->_id); // task completed
+            }
+            std::lock_guard<std::recursive_mutex> lock(_mutex);
+            task->_busy = false;
+            it = runnable.erase(it);
         }
+        first_round = false;
+        if (fnSystem.micros() - started >= slice_us)
+            break;
     }
 
-    if (!idle)
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    for (fnTask *task : runnable)
+        task->_busy = false;
+    // handle failed tasks, if any
+    for (auto it = failed.begin(); it != failed.end(); ++it)
+        abort_task(*it);
+    // handle completed tasks, if any
+    for (auto it = completed.begin(); it != completed.end(); ++it)
+        complete_task(*it);
+
+    return false;
+}
+
+#ifdef ESP_PLATFORM
+// Called with _mutex held
+void fnTaskManager::start_worker()
+{
+    if (_worker_started)
+        return;
+    if (xTaskCreatePinnedToCore(worker_task, "fnTaskWorker", TASKMGR_WORKER_STACKSIZE, this,
+                                TASKMGR_WORKER_PRIORITY, nullptr, TASKMGR_WORKER_CPUAFFINITY) != pdPASS)
     {
-        // handle failed tasks, if any
-        for (auto it = failed.begin(); it != failed.end(); ++it)
-            abort_task(*it);
-        // handle completed tasks, if any
-        for (auto it = completed.begin(); it != completed.end(); ++it)
-            complete_task(*it);
+        Debug_println("fnTaskManager: failed to start worker task");
+        return;
     }
-
-    return idle;
+    _worker_started = true;
 }
 
-#endif // !ESP_PLATFORM
\ No newline at end of file
+void fnTaskManager::worker_task(void *param)
+{
+    fnTaskManager *mgr = (fnTaskManager *)param;
+    while (true)
+    {
+        bool idle = mgr->service_tasks(true, TASKMGR_SLICE_US);
+        vTaskDelay(idle ? pdMS_TO_TICKS(TASKMGR_WORKER_IDLE_MS) : 1);
+    }
+}
+#endif
@@ -3,9 +3,22 @@
 
 #include <stdint.h>
 #include <map>
+#include <mutex>
 
 #include "fnTask.h"
 
+// How long one service() call may spend stepping tasks, in microseconds. Every task
+// gets one step per call even past that, so tasks on the bus loop keep their steps short
+#define TASKMGR_SLICE_US 2000
+
+#ifdef ESP_PLATFORM
+// Worker for worker_safe() tasks, on the core the bus loop (fnLoop) isn't on
+#define TASKMGR_WORKER_STACKSIZE 8192
+#define TASKMGR_WORKER_PRIORITY 5
+#define TASKMGR_WORKER_CPUAFFINITY 0
+#define TASKMGR_WORKER_IDLE_MS 20
+#endif
+
 
 class fnTaskManager
 {
@@ -15,19 +28,36 @@ public:
     ~fnTaskManager();
     int submit_task(fnTask * t);
     fnTask * get_task(uint8_t tid);
+    int get_progress(uint8_t tid);                  // -1 if there's no such task
     int pause_task(uint8_t tid);
     int resume_task(uint8_t tid);
     int abort_task(uint8_t tid);
+    int cancel_task(uint8_t tid);                   // abort at the task's next step boundary
+    // Step the tasks that run on the bus loop; returns true if there was nothing to do
     bool service();
+#ifdef ESP_PLATFORM
+    // Whether worker_safe() tasks are being run by the worker rather than the bus loop
+    bool worker_started() { return _worker_started; };
+#endif
 
 private:
+    bool service_tasks(bool worker, uint32_t slice_us);
+    int step_task(fnTask *task);
+    void set_state(fnTask *task, fnTask::task_state state);
     int complete_task(uint8_t tid);
     uint8_t get_free_tid();
     void shutdown();
+#ifdef ESP_PLATFORM
+    void start_worker();
+    static void worker_task(void *param);
+    bool _worker_started;
+#endif
 
     std::map<uint8_t, fnTask *> _task_map;
     uint8_t _next_tid;
     uint8_t _task_count;
+    // submit/abort may come from the bus loop, HTTP handlers and the worker
+    std::recursive_mutex _mutex;
 };
 
 // global task manager
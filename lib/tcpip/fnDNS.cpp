@@ -1,11 +1,42 @@
 #include "fnDNS.h"
 
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+#include "fnSystem.h"
+
 #include "../../include/debug.h"
 
 
-// Return a single IP4 address given a hostname
-in_addr_t get_ip4_addr_by_name(const char *hostname)
+struct dns_cache_entry
 {
+    in_addr_t addr;
+    uint64_t expires;
+    bool pending; // a lookup is under way, wait for it
+};
+
+static std::mutex _dns_mutex;
+static std::condition_variable _dns_cv;
+static std::map<std::string, dns_cache_entry> _dns_cache;
+static std::deque<std::string> _dns_queue;
+static bool _dns_task_started = false;
+
+// gethostbyname() hands back a static buffer, so only one lookup at a time
+static std::mutex _dns_lookup_mutex;
+
+static in_addr_t _lookup(const char *hostname)
+{
+    std::lock_guard<std::mutex> lock(_dns_lookup_mutex);
+
     in_addr_t result = IPADDR_NONE;
 
     Debug_printf("Resolving hostname \"%s\"\r\n", hostname);
@@ -24,4 +55,141 @@ in_addr_t get_ip4_addr_by_name(const char *hostname)
         }
     }
     return result;
-}
\ No newline at end of file
+}
+
+// Called with _dns_mutex held. Makes room by dropping whichever settled
+// entry runs out first
+static void _make_room()
+{
+    if (_dns_cache.size() < DNS_CACHE_SIZE)
+        return;
+
+    auto oldest = _dns_cache.end();
+    for (auto it = _dns_cache.begin(); it != _dns_cache.end(); ++it)
+        if (!it->second.pending && (oldest == _dns_cache.end() || it->second.expires < oldest->second.expires))
+            oldest = it;
+    if (oldest != _dns_cache.end())
+        _dns_cache.erase(oldest);
+}
+
+// Look hostname up and file the answer. Called with lock held on _dns_mutex,
+// which is let go for the lookup itself
+static in_addr_t _resolve(std::unique_lock<std::mutex> &lock, const std::string &hostname)
+{
+    _make_room();
+    _dns_cache[hostname] = {IPADDR_NONE, 0, true};
+
+    lock.unlock();
+    in_addr_t addr = _lookup(hostname.c_str());
+    lock.lock();
+
+    uint64_t ttl = addr == IPADDR_NONE ? DNS_CACHE_NEGATIVE_TTL : DNS_CACHE_TTL;
+    _dns_cache[hostname] = {addr, fnSystem.millis() + ttl, false};
+    _dns_cv.notify_all();
+
+    return addr;
+}
+
+static void _task_loop()
+{
+    std::unique_lock<std::mutex> lock(_dns_mutex);
+    while (true)
+    {
+        _dns_cv.wait(lock, [] { return !_dns_queue.empty(); });
+
+        std::string hostname = _dns_queue.front();
+        _dns_queue.pop_front();
+
+        // Someone may have looked it up meanwhile
+        auto it = _dns_cache.find(hostname);
+        if (it != _dns_cache.end() && (it->second.pending || it->second.expires > fnSystem.millis()))
+            continue;
+
+        _resolve(lock, hostname);
+    }
+}
+
+#ifdef ESP_PLATFORM
+static void _dns_task(void *param)
+{
+    _task_loop(); // Never returns
+    vTaskDelete(nullptr);
+}
+#endif
+
+// Called with _dns_mutex held. The task lives for the rest of the run once started.
+static void _start_task()
+{
+    if (_dns_task_started)
+        return;
+#ifdef ESP_PLATFORM
+    if (xTaskCreatePinnedToCore(_dns_task, "dns_task", DNS_TASK_STACKSIZE, nullptr,
+                                DNS_TASK_PRIORITY, nullptr, 0) != pdPASS)
+    {
+        Debug_println("fnDNS - failed to start resolver task, names resolve on demand");
+        return;
+    }
+#else
+    std::thread(_task_loop).detach();
+#endif
+    _dns_task_started = true;
+}
+
+in_addr_t get_ip4_addr_by_name(const char *hostname)
+{
+    // Nothing to look up for a dotted address
+    in_addr_t numeric = inet_addr(hostname);
+    if (numeric != IPADDR_NONE)
+        return numeric;
+
+    std::unique_lock<std::mutex> lock(_dns_mutex);
+
+    auto it = _dns_cache.find(hostname);
+    while (it != _dns_cache.end() && it->second.pending)
+    {
+        _dns_cv.wait(lock);
+        it = _dns_cache.find(hostname);
+    }
+
+    if (it != _dns_cache.end() && it->second.expires > fnSystem.millis())
+    {
+        Debug_printf("Resolved \"%s\" from cache: %s\r\n", hostname,
+                     it->second.addr == IPADDR_NONE ? "not found" : compat_inet_ntoa(it->second.addr));
+        return it->second.addr;
+    }
+
+    return _resolve(lock, hostname);
+}
+
+void dns_prefetch(const std::string &hostname)
+{
+    if (hostname.empty() || inet_addr(hostname.c_str()) != IPADDR_NONE)
+        return;
+
+    std::lock_guard<std::mutex> lock(_dns_mutex);
+
+    auto it = _dns_cache.find(hostname);
+    if (it != _dns_cache.end() && (it->second.pending || it->second.expires > fnSystem.millis()))
+        return;
+
+    _start_task();
+    if (!_dns_task_started)
+        return;
+
+    _dns_queue.push_back(hostname);
+    _dns_cv.notify_all();
+}
+
+void dns_cache_clear()
+{
+    std::lock_guard<std::mutex> lock(_dns_mutex);
+
+    // Lookups under way still finish and file their answer
+    for (auto it = _dns_cache.begin(); it != _dns_cache.end();)
+    {
+        if (it->second.pending)
+            ++it;
+        else
+            it = _dns_cache.erase(it);
+    }
+}
@@ -1,8 +1,31 @@
 #ifndef _FN_DNS_
 #define _FN_DNS_
 
+#include <string>
+
 #include "compat_inet.h"
 
+// How long a resolved name is kept, in ms. The resolver doesn't tell us the
+// record's TTL, so one figure covers everything
+#define DNS_CACHE_TTL (5 * 60 * 1000)
+// How long a name that failed to resolve is remembered, in ms
+#define DNS_CACHE_NEGATIVE_TTL (15 * 1000)
+#define DNS_CACHE_SIZE 16
+
+#define DNS_TASK_STACKSIZE 4096
+#define DNS_TASK_PRIORITY 5
+
+// Return a single IP4 address given a hostname, from the cache if it's there.
+// Waits for a lookup of the same name dns_prefetch() already started
 in_addr_t get_ip4_addr_by_name(const char *hostname);
 
+// Start looking hostname up in the background, so a get_ip4_addr_by_name()
+// for it later finds the answer ready or on its way. The network devices call
+// it as soon as they've parsed a URL, to overlap the lookup with setting up
+// the protocol
+void dns_prefetch(const std::string &hostname);
+
+// Forget everything, e.g. after the network changes
+void dns_cache_clear();
+
 #endif // _FN_DNS_
@@ -131,6 +131,19 @@ public:
 
     bool failed() { return _failed; }
 
+    // Change the buffer size, only while nothing is buffered
+    bool resize(size_t size)
+    {
+        if (_pos != _fill)
+            return false;
+
+        free(_buffer);
+        _buffer = NULL;
+        _pos = _fill = 0;
+        _size = size;
+        return true;
+    }
+
     // Read data and return how many bytes were read
     int read(uint8_t *dst, size_t len)
     {
@@ -428,6 +441,19 @@ int fnTcpClient::setNoDelay(bool nodelay)
     return setOption(TCP_NODELAY, &flag);
 }
 
+int fnTcpClient::setBufferSizes(int rx_size, int tx_size)
+{
+    if (_rxBuffer)
+        _rxBuffer->resize(rx_size);
+
+    // lwIP only has SO_RCVBUF if built with LWIP_SO_RCVBUF, and SO_SNDBUF
+    // not at all, its send buffer is fixed at build time
+    int res = setSocketOption(SO_RCVBUF, (char *)&rx_size, sizeof(int));
+    if (setSocketOption(SO_SNDBUF, (char *)&tx_size, sizeof(int)) < 0)
+        res = -1;
+    return res;
+}
+
 bool fnTcpClient::getNoDelay()
 {
     int flag = 0;
@@ -48,6 +48,9 @@ public:
     int getOption(int option, int *value);
     int setTimeout(uint32_t seconds);
     int setNoDelay(bool nodelay);
+    // Sizes the local receive buffer and the socket's buffers, returns -1 if
+    // the stack turned down either socket buffer
+    int setBufferSizes(int rx_size, int tx_size);
     bool getNoDelay();
 
     in_addr_t remoteIP() const;
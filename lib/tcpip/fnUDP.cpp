@@ -310,6 +310,44 @@ int fnUDP::available()
     return rx_buffer->available();
 }
 
+int fnUDP::receive(uint8_t *buffer, size_t len, in_addr_t *ip, uint16_t *port, int timeout)
+{
+    if (udp_server < 0)
+        return -1;
+
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(udp_server, &fdset);
+
+    struct timeval tv;
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout - tv.tv_sec * 1000) * 1000;
+
+    int res = select(udp_server + 1, &fdset, nullptr, nullptr, &tv);
+    if (res <= 0)
+        return res;
+
+    struct sockaddr_in si_other;
+    int slen = sizeof(si_other);
+    int n = recvfrom(udp_server, (char *)buffer, len, MSG_DONTWAIT, (struct sockaddr *)&si_other, (socklen_t *)&slen);
+    if (n < 0)
+    {
+        int err = compat_getsockerr();
+#if defined(_WIN32)
+        if (err == WSAEWOULDBLOCK)
+#else
+        if (err == EWOULDBLOCK)
+#endif
+            return 0;
+        Debug_printf("could not receive data: %d\r\n", err);
+        return -1;
+    }
+
+    *ip = si_other.sin_addr.s_addr;
+    *port = ntohs(si_other.sin_port);
+    return n;
+}
+
 int fnUDP::peek()
 {
     if (!rx_buffer)
@@ -47,6 +47,14 @@ public:
     int read(unsigned char* buffer, size_t len);
     int read(char* buffer, size_t len);
 
+    /**
+     * Wait up to timeout ms for a datagram and take it straight off the
+     * socket into buffer, with who sent it. Leaves what parsePacket() and
+     * beginPacket() keep alone, so one thread can do this while another
+     * sends. Returns its length, 0 if none came, or -1 on error
+     */
+    int receive(uint8_t *buffer, size_t len, in_addr_t *ip, uint16_t *port, int timeout);
+
     int peek();
     int available();
     void flush();
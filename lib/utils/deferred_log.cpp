@@ -0,0 +1,219 @@
+#include "deferred_log.h"
+
+#include <cstdio>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+#include "../../include/debug.h"
+
+// Release builds, and DEBUG builds that don't defer, don't need the ring
+#if defined(DEBUG) && DEBUG_TRACE_LEVEL == 1
+
+deferredLog deferred_log;
+
+deferredLog::deferredLog()
+{
+    for (uint32_t i = 0; i < DEFERRED_LOG_ENTRIES; i++)
+        _cells[i].seq.store(i, std::memory_order_relaxed);
+}
+
+// A cell whose seq equals the position claiming it is free; once written it's position + 1,
+// and the task sets it to position + DEFERRED_LOG_ENTRIES when it has printed it
+deferredLog::cell *deferredLog::_claim()
+{
+    uint32_t pos = _head.load(std::memory_order_relaxed);
+    while (true)
+    {
+        cell *c = &_cells[pos & (DEFERRED_LOG_ENTRIES - 1)];
+        int32_t diff = (int32_t)(c->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                return c;
+        }
+        else if (diff < 0)
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        else
+            pos = _head.load(std::memory_order_relaxed);
+    }
+}
+
+void deferredLog::_start_task()
+{
+    bool expected = false;
+    if (!_task_started.compare_exchange_strong(expected, true))
+        return;
+#ifdef ESP_PLATFORM
+    if (xTaskCreatePinnedToCore(_task, "deferred_log", DEFERRED_LOG_TASK_STACKSIZE, this,
+                                DEFERRED_LOG_TASK_PRIORITY, nullptr, 0) != pdPASS)
+        Debug_println("deferredLog - couldn't start the task, traces won't be printed");
+#else
+    std::thread(&deferredLog::_task_loop, this).detach();
+#endif
+}
+
+#ifdef ESP_PLATFORM
+void deferredLog::_task(void *param)
+{
+    ((deferredLog *)param)->_task_loop(); // Never returns
+    vTaskDelete(nullptr);
+}
+#endif
+
+bool deferredLog::_print_one()
+{
+    cell &c = _cells[_tail & (DEFERRED_LOG_ENTRIES - 1)];
+    if (c.seq.load(std::memory_order_acquire) != _tail + 1)
+        return false;
+
+    char line[DEFERRED_LOG_LINE];
+    format(c.e, line, sizeof(line));
+    c.seq.store(_tail + DEFERRED_LOG_ENTRIES, std::memory_order_release);
+    _tail++;
+
+    Debug_printf("%s", line);
+    return true;
+}
+
+void deferredLog::_task_loop()
+{
+    uint32_t reported = 0;
+    while (true)
+    {
+        while (_print_one())
+            ;
+
+        uint32_t dropped = _dropped.load(std::memory_order_relaxed);
+        if (dropped != reported)
+        {
+            Debug_printf("deferredLog - %lu traces dropped\r\n", (unsigned long)(dropped - reported));
+            reported = dropped;
+        }
+
+#ifdef ESP_PLATFORM
+        vTaskDelay(pdMS_TO_TICKS(10));
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+#endif
+    }
+}
+
+void deferredLog::format(const entry &e, char *out, size_t len)
+{
+    size_t used = 0;
+    int next = 0;
+    auto put = [&](int n) {
+        if (n > 0)
+            used += n;
+        if (used >= len)
+            used = len - 1;
+    };
+
+    const char *p = e.fmt;
+    while (*p != '\0' && used < len - 1)
+    {
+        if (*p != '%')
+        {
+            out[used++] = *p++;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out[used++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // Rebuild the conversion with the widths the arguments were recorded at,
+        // dropping its own length modifier
+        char spec[40];
+        size_t s = 0;
+        spec[s++] = *p++;
+        while (*p != '\0' && strchr("-+ #0123456789.*", *p) != nullptr && s < 24)
+        {
+            if (*p == '*')
+                s += snprintf(spec + s, sizeof(spec) - s, "%d", next < e.nargs ? (int)e.args[next++] : 0);
+            else
+                spec[s++] = *p;
+            p++;
+        }
+        while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr)
+            p++;
+        char conv = *p;
+        if (conv == '\0')
+            break;
+        p++;
+
+        if (next >= e.nargs)
+        {
+            put(snprintf(out + used, len - used, "?"));
+            continue;
+        }
+        uint64_t arg = e.args[next];
+        deferredLog::arg_kind kind = e.kinds[next++];
+
+        switch (conv)
+        {
+        case 'd':
+        case 'i':
+        {
+            long long v = kind == ARG_INT32 ? (long long)(int32_t)arg : (long long)arg;
+            memcpy(spec + s, "lld", 4);
+            put(snprintf(out + used, len - used, spec, v));
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        {
+            unsigned long long v = kind == ARG_INT32 ? (unsigned long long)(uint32_t)arg : (unsigned long long)arg;
+            snprintf(spec + s, sizeof(spec) - s, "ll%c", conv);
+            put(snprintf(out + used, len - used, spec, v));
+            break;
+        }
+        case 'c':
+            memcpy(spec + s, "c", 2);
+            put(snprintf(out + used, len - used, spec, (int)arg));
+            break;
+        case 'p':
+            memcpy(spec + s, "p", 2);
+            put(snprintf(out + used, len - used, spec, (void *)(uintptr_t)arg));
+            break;
+        case 's':
+            memcpy(spec + s, "s", 2);
+            put(snprintf(out + used, len - used, spec,
+                         kind == ARG_STRING && arg < DEFERRED_LOG_STRINGS ? e.strings + arg : ""));
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        {
+            double v;
+            memcpy(&v, &arg, sizeof(v));
+            spec[s] = conv;
+            spec[s + 1] = '\0';
+            put(snprintf(out + used, len - used, spec, v));
+            break;
+        }
+        default:
+            put(snprintf(out + used, len - used, "?"));
+            break;
+        }
+    }
+    out[used] = '\0';
+}
+
+#endif // DEBUG && DEBUG_TRACE_LEVEL == 1
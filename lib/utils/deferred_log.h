@@ -0,0 +1,153 @@
+#ifndef _DEFERRED_LOG_H
+#define _DEFERRED_LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+ * deferred_log - Debug_tracef() for bus hot paths
+ * Formatting a message and pushing it out the debug UART takes long enough
+ * to change bus timing, so Debug_tracef() only records the format string's
+ * address, which stands in as its ID, and its arguments as they are, into
+ * a lock-free ring any task can write to. A low priority task formats and
+ * prints them later. Strings passed for %s are copied, as they're usually
+ * gone by then. If the ring is full the entry is dropped and counted.
+ *
+ * DEBUG_TRACE_LEVEL in debug.h decides at compile time what Debug_tracef()
+ * does in a DEBUG build; release builds compile it to nothing.
+ */
+
+#define DEFERRED_LOG_ENTRIES 64 // Must be a power of two
+#define DEFERRED_LOG_ARGS 6
+#define DEFERRED_LOG_STRINGS 40 // Room for copies of %s arguments in each entry
+#define DEFERRED_LOG_LINE 256
+
+#ifdef ESP_PLATFORM
+#define DEFERRED_LOG_TASK_STACKSIZE 3072
+#define DEFERRED_LOG_TASK_PRIORITY 1
+#endif
+
+class deferredLog
+{
+    static_assert((DEFERRED_LOG_ENTRIES & (DEFERRED_LOG_ENTRIES - 1)) == 0, "DEFERRED_LOG_ENTRIES must be a power of two");
+
+public:
+    enum arg_kind : uint8_t
+    {
+        ARG_INT32 = 0,
+        ARG_INT64,
+        ARG_DOUBLE,
+        ARG_POINTER,
+        ARG_STRING // args[] holds the offset of the copy in strings[]
+    };
+
+    struct entry
+    {
+        const char *fmt;
+        uint8_t nargs;
+        uint8_t strings_used;
+        arg_kind kinds[DEFERRED_LOG_ARGS];
+        uint64_t args[DEFERRED_LOG_ARGS];
+        char strings[DEFERRED_LOG_STRINGS];
+    };
+
+private:
+    struct cell
+    {
+        std::atomic<uint32_t> seq;
+        entry e;
+    };
+
+    cell _cells[DEFERRED_LOG_ENTRIES];
+    std::atomic<uint32_t> _head{0}; // Next cell for a writer to claim
+    uint32_t _tail = 0;             // Next cell to print, only the task touches it
+    std::atomic<uint32_t> _dropped{0};
+    std::atomic<bool> _task_started{false};
+
+    cell *_claim();
+    void _start_task();
+    bool _print_one();
+    void _task_loop();
+#ifdef ESP_PLATFORM
+    static void _task(void *param);
+#endif
+
+    static void _add(entry &e, const char *s)
+    {
+        if (s == nullptr)
+            s = "(null)";
+        size_t room = DEFERRED_LOG_STRINGS - e.strings_used;
+        size_t len = room ? strnlen(s, room - 1) : 0;
+        e.kinds[e.nargs] = ARG_STRING;
+        e.args[e.nargs++] = e.strings_used;
+        if (room)
+        {
+            memcpy(e.strings + e.strings_used, s, len);
+            e.strings[e.strings_used + len] = '\0';
+            e.strings_used += len + 1;
+        }
+    }
+    static void _add(entry &e, char *s) { _add(e, (const char *)s); }
+
+    template <typename T>
+    static void _add(entry &e, T *p)
+    {
+        e.kinds[e.nargs] = ARG_POINTER;
+        e.args[e.nargs++] = (uintptr_t)p;
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type
+    _add(entry &e, T v)
+    {
+        if constexpr (std::is_floating_point<T>::value)
+        {
+            double d = (double)v;
+            e.kinds[e.nargs] = ARG_DOUBLE;
+            memcpy(&e.args[e.nargs++], &d, sizeof(d));
+        }
+        else
+        {
+            // Signed values are sign extended; the format's conversion decides how they're read back
+            e.kinds[e.nargs] = sizeof(T) > 4 ? ARG_INT64 : ARG_INT32;
+            e.args[e.nargs++] = (uint64_t)(int64_t)v;
+        }
+    }
+
+public:
+    deferredLog();
+
+    template <typename... Args>
+    void record(const char *fmt, Args... args)
+    {
+        static_assert(sizeof...(Args) <= DEFERRED_LOG_ARGS, "too many arguments for Debug_tracef()");
+
+        if (!_task_started.load(std::memory_order_relaxed))
+            _start_task();
+
+        cell *c = _claim();
+        if (c == nullptr)
+            return;
+
+        entry &e = c->e;
+        e.fmt = fmt;
+        e.nargs = 0;
+        e.strings_used = 0;
+        (_add(e, args), ...);
+
+        // Hand the cell to the task
+        c->seq.store(c->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Formats an entry the way printf() would have, into a buffer of len bytes
+    static void format(const entry &e, char *out, size_t len);
+
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+};
+
+extern deferredLog deferred_log;
+
+#endif // _DEFERRED_LOG_H
@@ -0,0 +1,67 @@
+#include "fnEvents.h"
+
+#include <sstream>
+
+fnEventBus fnEvents;
+
+void fnEventBus::publish(fn_event_type type, int slot)
+{
+    std::lock_guard<std::mutex> lock(_queue_mutex);
+    if (_head - _tail >= EVENT_QUEUE_SIZE)
+        _tail++; // drop the oldest
+    _queue[_head++ % EVENT_QUEUE_SIZE] = {type, (int8_t)slot};
+    _pending.store(true, std::memory_order_release);
+}
+
+int fnEventBus::subscribe(subscriber fn)
+{
+    std::lock_guard<std::mutex> lock(_subscribers_mutex);
+    _subscribers.emplace_back(_next_id, std::move(fn));
+    return _next_id++;
+}
+
+void fnEventBus::unsubscribe(int id)
+{
+    std::lock_guard<std::mutex> lock(_subscribers_mutex);
+    for (auto it = _subscribers.begin(); it != _subscribers.end(); ++it)
+    {
+        if (it->first == id)
+        {
+            _subscribers.erase(it);
+            break;
+        }
+    }
+}
+
+void fnEventBus::dispatch()
+{
+    // Nearly always nothing to do
+    if (!_pending.load(std::memory_order_acquire))
+        return;
+
+    fn_event events[EVENT_QUEUE_SIZE];
+    int count = 0;
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        while (_tail != _head)
+            events[count++] = _queue[_tail++ % EVENT_QUEUE_SIZE];
+        _pending.store(false, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(_subscribers_mutex);
+    for (int i = 0; i < count; i++)
+        for (auto &s : _subscribers)
+            s.second(events[i]);
+}
+
+std::string fnEventBus::to_json(const fn_event &event)
+{
+    static const char *names[] = {"mount", "eject", "wifi_connected", "wifi_disconnected", "printer_output"};
+
+    std::ostringstream out;
+    out << "{\"event\":\"" << names[(int)event.type] << "\"";
+    if (event.slot >= 0)
+        out << ",\"slot\":" << event.slot + 1;
+    out << "}";
+    return out.str();
+}
@@ -0,0 +1,70 @@
+#ifndef _FN_EVENTS_H
+#define _FN_EVENTS_H
+
+/*
+ * fnEvents - device state changes for whoever wants to hear about them,
+ * such as the web server pushing them to browsers over a WebSocket.
+ *
+ * publish() only copies the event into a small ring under a lock, so it's
+ * cheap to call from bus command handlers. The main service loop calls
+ * dispatch(), which hands what has queued up to the subscribers. If more
+ * than EVENT_QUEUE_SIZE pile up between dispatches the oldest are lost.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define EVENT_QUEUE_SIZE 16
+
+enum class fn_event_type : uint8_t
+{
+    MOUNT = 0,
+    EJECT,
+    WIFI_CONNECTED,
+    WIFI_DISCONNECTED,
+    PRINTER_OUTPUT,
+};
+
+struct fn_event
+{
+    fn_event_type type;
+    int8_t slot; // disk slot for MOUNT and EJECT, -1 otherwise
+};
+
+class fnEventBus
+{
+public:
+    typedef std::function<void(const fn_event &)> subscriber;
+
+private:
+    fn_event _queue[EVENT_QUEUE_SIZE];
+    uint32_t _head = 0;
+    uint32_t _tail = 0;
+    std::atomic<bool> _pending{false};
+    std::mutex _queue_mutex;
+
+    std::vector<std::pair<int, subscriber>> _subscribers;
+    int _next_id = 0;
+    std::mutex _subscribers_mutex;
+
+public:
+    void publish(fn_event_type type, int slot = -1);
+
+    // Returns an id for unsubscribe()
+    int subscribe(subscriber fn);
+    void unsubscribe(int id);
+
+    // From the main service loop; subscribers are called from here
+    void dispatch();
+
+    // {"event":"mount","slot":1} with the slot counted from 1
+    static std::string to_json(const fn_event &event);
+};
+
+extern fnEventBus fnEvents;
+
+#endif // _FN_EVENTS_H
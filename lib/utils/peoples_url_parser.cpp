@@ -30,67 +30,86 @@
 
 #include "string_utils.h"
 
-void PeoplesUrlParser::processHostPort(std::string hostPort) {
-    auto byColon = mstr::split(hostPort,':',2);
-    host = byColon[0];
-    if(byColon.size()>1) {
-        port = byColon[1];
+void PeoplesUrlParser::processHostPort(std::string_view hostPort) {
+    auto colon = hostPort.find(':');
+    host = hostPort.substr(0, colon);
+    if(colon != std::string_view::npos) {
+        port = hostPort.substr(colon + 1);
     }
 }
 
-void PeoplesUrlParser::processAuthorityPath(std::string authorityPath) {
+void PeoplesUrlParser::processAuthorityPath(std::string_view authorityPath) {
     //             /path
     // authority:80/path
     // authority:100
     // authority
     auto pos = authorityPath.find('/');
-    if (pos == std::string::npos) {
+    if (pos == std::string_view::npos) {
         pos = authorityPath.find('?');
-        if (pos == std::string::npos) {
+        if (pos == std::string_view::npos) {
             pos = authorityPath.find('#');
         }
     }
 
     processHostPort(authorityPath.substr(0, pos));
-    if(pos != std::string::npos) {
+    if(pos != std::string_view::npos) {
         // keep the rest (incl. query) in path, it will be processed by processPath()
         path = authorityPath.substr(pos);
     }
 }
 
-void PeoplesUrlParser::processUserPass(std::string userPass) {
+void PeoplesUrlParser::processUserPass(std::string_view userPass) {
     // user:pass
-    auto byColon = mstr::split(userPass,':',2);
-    if(byColon.size()==1) {
-        user = byColon[0];
-    }
-    else {
-        user = byColon[0];
-        password = byColon[1];
+    auto colon = userPass.find(':');
+    user = userPass.substr(0, colon);
+    if(colon != std::string_view::npos) {
+        password = userPass.substr(colon + 1);
     }
 }
 
-void PeoplesUrlParser::processAuthority(std::string pastTheColon) {
+void PeoplesUrlParser::processAuthority(std::string_view pastTheColon) {
     // //user:password@/path
     // //user:password@host:80/path
     // //          host:100
     // //          host:30/path            
-    auto byAtSign = mstr::split(pastTheColon,'@', 2);
+    auto atSign = pastTheColon.find('@');
 
-    if(byAtSign.size()==1) {
+    if(atSign == std::string_view::npos) {
         // just address, port, path
-        processAuthorityPath(mstr::drop(byAtSign[0],2));
+        processAuthorityPath(pastTheColon.substr(2));
     }
     else {
         // user:password
-        processUserPass(mstr::drop(byAtSign[0],2));
+        processUserPass(pastTheColon.substr(2, atSign - 2));
         // address, port, path
-        processAuthorityPath(byAtSign[1]);
+        processAuthorityPath(pastTheColon.substr(atSign + 1));
     }
 }
 
+// Whether util_get_canonical_path() would hand path back unchanged: no empty, "." or ".."
+// segments and nothing it would take for a scheme. That's nearly every path, and saves
+// splitting it into a stack of strings each time a URL is parsed or rebuilt
+static bool _path_is_canonical(std::string_view path)
+{
+    if (path.find("//") != std::string_view::npos || path.find("://") != std::string_view::npos)
+        return false;
+
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find('/', start);
+        if (end == std::string_view::npos)
+            end = path.size();
+        std::string_view segment = path.substr(start, end - start);
+        if (segment == "." || segment == "..")
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
 void PeoplesUrlParser::cleanPath() {
-    if(path.size() == 0)
+    if(path.size() == 0 || _path_is_canonical(path))
         return;
 
     // apc: keep trailing '/'
@@ -117,32 +136,32 @@ void PeoplesUrlParser::processPath()
         // ?query#fragment
         // ?query
         // #fragment
-        auto queryParts = mstr::split(path.substr(pos), '?', 2);
-        auto fragmentParts = mstr::split(*(--queryParts.end()), '#', 2);
+        std::string_view rest = std::string_view(path).substr(pos);
+        auto queryPos = rest.find('?');
+        if (queryPos != std::string_view::npos)
+            rest = rest.substr(queryPos + 1);
+        auto fragmentPos = rest.find('#');
 
         // query
-        if(queryParts.size() > 1)
-            query = fragmentParts[0];
-        
+        if (queryPos != std::string_view::npos)
+            query = rest.substr(0, fragmentPos);
+
         // fragment
-        if(fragmentParts.size() > 1)
-            fragment = fragmentParts[1];
-    }
+        if (fragmentPos != std::string_view::npos)
+            fragment = rest.substr(fragmentPos + 1);
 
-    // remove query and fragment part from path
-    path = path.substr(0, pos);
+        // remove query and fragment part from path
+        path.erase(pos);
+    }
 
     // file name (without path), empty for directory
-    auto pathParts = mstr::split(path, '/');
-    if(pathParts.size() > 1)
-        name = *(--pathParts.end());
-    else
-        name = path;
+    auto slash = path.rfind('/');
+    name = slash == std::string::npos ? path : path.substr(slash + 1);
 
     // file extension
-    auto nameParts = mstr::split(name, '.');
-    if(nameParts.size() > 1)
-        extension = *(--nameParts.end());
+    auto dot = name.rfind('.');
+    if(dot != std::string::npos)
+        extension = name.substr(dot + 1);
 
     // file base name
     if (extension.size() > 0)
@@ -160,28 +179,33 @@ std::string PeoplesUrlParser::pathToFile(void)
         return path;
 }
 
-std::string PeoplesUrlParser::root(void)
+void PeoplesUrlParser::appendRoot(std::string &out)
 {
-    // set root URL
-    std::string root;
     if ( scheme.size() )
-        root = scheme + ":";
+        out.append(scheme).append(1, ':');
 
     if ( host.size() )
-        root += "//";
+        out.append("//");
 
     if ( user.size() )
     {
-        root += user;
+        out.append(user);
         if ( password.size() )
-            root += ':' + password;
-        root += '@';
+            out.append(1, ':').append(password);
+        out.append(1, '@');
     }
 
-    root += host;
+    out.append(host);
 
     if ( port.size() )
-        root += ':' + port;
+        out.append(1, ':').append(port);
+}
+
+std::string PeoplesUrlParser::root(void)
+{
+    // set root URL
+    std::string root;
+    appendRoot(root);
 
     //Debug_printv("root[%s]", root.c_str());
     return root;
@@ -192,7 +216,7 @@ std::string PeoplesUrlParser::base(void)
     // set base URL
     //Debug_printv("base[%s]", (root() + "/" + path).c_str());
     if ( !mstr::startsWith(path, "/") )
-        path = "/" + path;
+        path.insert(0, 1, '/');
 
     cleanPath();
 
@@ -206,7 +230,7 @@ uint16_t PeoplesUrlParser::getPort() {
 }
 
 
-std::unique_ptr<PeoplesUrlParser> PeoplesUrlParser::parseURL(const std::string &u) {
+std::unique_ptr<PeoplesUrlParser> PeoplesUrlParser::parseURL(std::string_view u) {
     // Directly creating a unique_ptr using a private constructor workaround. If direct constructor was available, this wouldn't be needed
     struct MakeUniqueEnabler : public PeoplesUrlParser {};
     auto parser = std::make_unique<MakeUniqueEnabler>();
@@ -214,43 +238,39 @@ std::unique_ptr<PeoplesUrlParser> PeoplesUrlParser::parseURL(const std::string &
     return parser;
 }
 
-void PeoplesUrlParser::resetURL(const std::string u) {
+void PeoplesUrlParser::resetURL(std::string_view u) {
 
     if ( u.empty() )
         return;
 
-    //Debug_printv("u[%s]", u.c_str());
-
+    // u may point into one of our own fields, so copy it before clearing them
     url = u;
-    mRawUrl = u;
+    mRawUrl = url;
 
     //Debug_printv("Before [%s]", url.c_str());
 
-    auto byColon = mstr::split(url, ':', 2);
-
-    scheme = "";
-    path = "";
-    user = "";
-    password = "";
-    host = "";
-    port = "";
-    name = "";
-    base_name = "";
-    extension = "";
-    query = "";
-    fragment = "";
-
-    std::string pastTheScheme;
-    if(byColon.size()==1) {
-        // no scheme
-        pastTheScheme = byColon[0];
-    }
-    else {
-        scheme = byColon[0];
-        pastTheScheme = byColon[1];
+    // Cleared rather than reassigned, so a parser that's reset keeps its fields' memory
+    scheme.clear();
+    path.clear();
+    user.clear();
+    password.clear();
+    host.clear();
+    port.clear();
+    name.clear();
+    base_name.clear();
+    extension.clear();
+    query.clear();
+    fragment.clear();
+
+    // url isn't touched again until rebuildUrl(), so views into it stay valid
+    std::string_view pastTheScheme(url);
+    auto colon = pastTheScheme.find(':');
+    if(colon != std::string_view::npos) {
+        scheme = pastTheScheme.substr(0, colon);
+        pastTheScheme = pastTheScheme.substr(colon + 1);
     }
 
-    if(pastTheScheme[0]=='/' && pastTheScheme[1]=='/') {
+    if(pastTheScheme.size() > 1 && pastTheScheme[0]=='/' && pastTheScheme[1]=='/') {
         // //user:pass@/path
         // //user:pass@authority:80/path
         // //authority:100
@@ -281,18 +301,21 @@ std::string PeoplesUrlParser::rebuildUrl(void)
 {
     // set full URL
     if ( !mstr::startsWith(path, "/") )
-        path = "/" + path;
+        path.insert(0, 1, '/');
 
     cleanPath();
 
-    url = root() + path;
+    // Built in place, url keeps its memory from one rebuild to the next
+    url.clear();
+    appendRoot(url);
+    url.append(path);
     //Debug_printv("url[%s]", url.c_str());
     // url += name;
     // Debug_printv("url[%s]", url.c_str());
     if ( query.size() )
-        url += '?' + query;
+        url.append(1, '?').append(query);
     if ( fragment.size() )
-        url += '#' + fragment;
+        url.append(1, '#').append(fragment);
 
     return url;
 }
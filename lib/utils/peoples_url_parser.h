@@ -22,16 +22,19 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
 
 class PeoplesUrlParser
 {
 private:
-    void processHostPort(std::string hostPort);
-    void processAuthorityPath(std::string authorityPath);
-    void processUserPass(std::string userPass);
-    void processAuthority(std::string pastTheColon);
+    // The pieces are views into url, only the fields they end up in are copied
+    void processHostPort(std::string_view hostPort);
+    void processAuthorityPath(std::string_view authorityPath);
+    void processUserPass(std::string_view userPass);
+    void processAuthority(std::string_view pastTheColon);
     void cleanPath();
     void processPath();
+    void appendRoot(std::string &out);
 
 protected:
     PeoplesUrlParser() {};
@@ -59,8 +62,8 @@ public:
 
     uint16_t getPort();
 
-    static std::unique_ptr<PeoplesUrlParser> parseURL(const std::string &u);
-    void resetURL(const std::string u);
+    static std::unique_ptr<PeoplesUrlParser> parseURL(std::string_view u);
+    void resetURL(std::string_view u);
     std::string rebuildUrl(void);
     bool isValidUrl();
 
@@ -0,0 +1,79 @@
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "fnSystem.h"
+
+/*
+ * spsc_queue - fixed size lock-free queue for one producer and one consumer
+ * Meant for handing command frames and events from a bus ISR/task to the
+ * service loop. Each entry carries the time it was pushed, so pop() can
+ * report how long it waited; the longest wait seen is kept for debugging.
+ * N must be a power of two; the queue holds up to N entries.
+ */
+template <typename T, size_t N>
+class spsc_queue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "spsc_queue size must be a power of two");
+
+private:
+    struct entry
+    {
+        T value;
+        uint32_t queued_us;
+    };
+
+    entry _entries[N];
+    // Free-running counters, only the producer writes _head and only the consumer writes _tail
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+    std::atomic<uint32_t> _dropped{0};
+    uint32_t _max_latency_us = 0;
+
+public:
+    // Producer side. Returns false (and counts a drop) if the queue is full
+    bool push(const T &value)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= N)
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        entry &e = _entries[head & (N - 1)];
+        e.value = value;
+        e.queued_us = (uint32_t)fnSystem.micros();
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if there's nothing waiting.
+    // latency_us, if given, gets how long the entry sat in the queue
+    bool pop(T &value, uint32_t *latency_us = nullptr)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+            return false;
+        entry &e = _entries[tail & (N - 1)];
+        value = e.value;
+        uint32_t latency = (uint32_t)fnSystem.micros() - e.queued_us;
+        _tail.store(tail + 1, std::memory_order_release);
+
+        if (latency > _max_latency_us)
+            _max_latency_us = latency;
+        if (latency_us != nullptr)
+            *latency_us = latency;
+        return true;
+    }
+
+    bool empty() const { return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire); }
+    size_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+    // Consumer side only
+    uint32_t max_latency_us() const { return _max_latency_us; }
+};
+
+#endif // _SPSC_QUEUE_H
@@ -12,6 +12,7 @@
 //#include "../../include/petscii.h"
 #include "../../include/debug.h"
 #include "U8Char.h"
+#include "utils.h"
 
 
 #if defined(_WIN32)
@@ -266,32 +267,90 @@ namespace mstr {
     //                 [](unsigned char c) { return ascii2petscii(c); });
     // }
 
+    // UTF8 for every PETSCII code, worked out once from U8Char's table
+    struct petscii_utf8
+    {
+        uint8_t len;
+        char bytes[3];
+    };
+
+    static const petscii_utf8 *petscii_utf8_table()
+    {
+        static const struct table_t {
+            petscii_utf8 entry[256];
+            table_t()
+            {
+                for (int i = 0; i < 256; i++)
+                {
+                    std::string utf8 = U8Char((char)i).toUtf8();
+                    entry[i].len = utf8.size();
+                    memcpy(entry[i].bytes, utf8.data(), utf8.size());
+                }
+            }
+        } table;
+        return table.entry;
+    }
+
     // convert PETSCII to UTF8, using methods from U8Char
     std::string toUTF8(const std::string &petsciiInput)
     {
         std::string utf8string;
-        for(char petscii : petsciiInput) {
-            if(petscii > 0)
-            {
-                U8Char u8char(petscii);
-                utf8string+=u8char.toUtf8();
-            }
-        }
+        utf8string.reserve(petsciiInput.size());
+        toUTF8(petsciiInput.data(), petsciiInput.size(), utf8string);
         return utf8string;
     }
 
-    // convert UTF8 to PETSCII, using methods from U8Char
+    void toUTF8(const char *petscii, size_t len, std::string &out, int from, char to)
+    {
+        const petscii_utf8 *table = petscii_utf8_table();
+        for (size_t i = 0; i < len; i++)
+        {
+            char c = (uint8_t)petscii[i] == from ? to : petscii[i];
+            if (c > 0)
+                out.append(table[(uint8_t)c].bytes, table[(uint8_t)c].len);
+        }
+    }
+
+    // convert UTF8 to PETSCII, decoding as U8Char does in one pass
     std::string toPETSCII2(const std::string &utfInputString)
     {
         std::string petsciiString;
-        char* utfInput = (char*)utfInputString.c_str();
-        auto end = utfInput + utfInputString.length();
-
-        while(utfInput<end) {
-            U8Char u8char(' ');
-            size_t skip = u8char.fromCharArray(utfInput);
-            petsciiString+=u8char.toPetscii();
-            utfInput+=skip;
+        petsciiString.reserve(utfInputString.length());
+
+        const uint8_t *in = (const uint8_t *)utfInputString.c_str();
+        size_t len = utfInputString.length();
+        // A sequence cut short by the end of the string reads the terminator, and then zeros
+        auto at = [in, len](size_t n) -> uint8_t { return n < len ? in[n] : 0; };
+
+        size_t i = 0;
+        while (i < len)
+        {
+            uint8_t byte = in[i];
+            uint16_t ch;
+            if (byte <= 0x7f)
+            {
+                ch = byte;
+                i += 1;
+            }
+            else if ((byte & 0b11100000) == 0b11000000)
+            {
+                ch = ((uint16_t)(byte & 0b1111)) << 6 | (at(i + 1) & 0b111111);
+                i += 2;
+            }
+            else if ((byte & 0b11110000) == 0b11100000)
+            {
+                ch = ((uint16_t)(byte & 0b111)) << 12 | ((uint16_t)(at(i + 1) & 0b111111)) << 6 | (at(i + 2) & 0b111111);
+                i += 3;
+            }
+            else
+            {
+                ch = 0;
+                i += 1;
+            }
+
+            // Only codes up to 255 have a PETSCII equivalent. U8Char::toPetscii() swaps
+            // the cases the same way util_petscii_to_ascii() does
+            petsciiString += ch > 255 ? '?' : util_petscii_to_ascii((char)ch);
         }
         return petsciiString;
     }
@@ -60,6 +60,8 @@ namespace mstr {
     // void toASCII(std::string &s);
     // void toPETSCII(std::string &s);
     std::string toUTF8(const std::string &petsciiInput);
+    // Appends len PETSCII bytes to out as UTF8, with any byte from read as to first
+    void toUTF8(const char *petscii, size_t len, std::string &out, int from = -1, char to = 0);
     std::string toPETSCII2(const std::string &utfInputString);
     std::string toHex(const uint8_t *input, size_t size);
     std::string toHex(const std::string &input);
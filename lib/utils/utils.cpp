@@ -492,56 +492,114 @@ bool util_wildcard_match(const char *str, const char *pattern)
     if (str == nullptr || pattern == nullptr)
         return false;
 
-    int m = strlen(pattern);
-    int n = strlen(str);
-
-    // Empty pattern can only match with empty string
-    if (m == 0)
-        return (n == 0);
+    return util_wildcard(pattern).match(str);
+}
 
-    // Lookup table for storing results of subproblems
-    bool lookup[n + 1][m + 1];
+// Folds A-Z to a-z and leaves every other byte alone, as tolower() does in the C locale
+static inline uint8_t _wildcard_fold(char c)
+{
+    uint8_t u = (uint8_t)c;
+    return (u >= 'A' && u <= 'Z') ? u + ('a' - 'A') : u;
+}
 
-    // Initailze lookup table to false
-    memset(lookup, false, sizeof(lookup));
+util_wildcard::util_wildcard(const char *pattern)
+{
+    size_t m = strlen(pattern);
+    _folded.reserve(m);
+    for (size_t j = 0; j < m; j++)
+        _folded.push_back(_wildcard_fold(pattern[j]));
 
-    // Empty pattern can match with empty string
-    lookup[0][0] = true;
+    size_t start = 0;
+    for (size_t j = 0; j <= m; j++)
+    {
+        if (j < m && _folded[j] != '*')
+            continue;
+        if (j > start)
+        {
+            _pieces.push_back({(uint16_t)start, (uint16_t)(j - start)});
+            _min_len += j - start;
+        }
+        start = j + 1;
+    }
+    _leading_star = m > 0 && _folded[0] == '*';
+    _trailing_star = m > 0 && _folded[m - 1] == '*';
+}
 
-    // Only '*' can match with empty string
-    for (int j = 1; j <= m; j++)
-        if (pattern[j - 1] == '*')
-            lookup[0][j] = lookup[0][j - 1];
+bool util_wildcard::_piece_at(const char *str, const std::pair<uint16_t, uint16_t> &piece) const
+{
+    const char *p = _folded.data() + piece.first;
+    for (uint16_t k = 0; k < piece.second; k++)
+        if (p[k] != '?' && (uint8_t)p[k] != _wildcard_fold(str[k]))
+            return false;
+    return true;
+}
 
-    // Fill the table in bottom-up fashion
-    for (int i = 1; i <= n; i++)
+// Leftmost place from from up to last where the piece matches, nullptr if there's none
+const char *util_wildcard::_find_piece(const char *from, const char *last, const std::pair<uint16_t, uint16_t> &piece) const
+{
+    char first = _folded[piece.first];
+    bool letter = first >= 'a' && first <= 'z';
+    while (from <= last)
     {
-        for (int j = 1; j <= m; j++)
+        // Anything but a letter or '?' can only be where memchr finds it
+        if (first != '?' && !letter)
         {
-            // Two cases if we see a '*':
-            // a) We ignore '*' character and move to next character in the pattern,
-            //     i.e., '*' indicates an empty sequence.
-            // b) '*' character matches with i-th character in input
-            if (pattern[j - 1] == '*')
-            {
-                lookup[i][j] = lookup[i][j - 1] || lookup[i - 1][j];
-            }
-            // Current characters are considered as matching in two cases:
-            // (a) Current character of pattern is '?'
-            // (b) Characters actually match (case-insensitive)
-            else if (pattern[j - 1] == '?' ||
-                     str[i - 1] == pattern[j - 1] ||
-                     tolower(str[i - 1]) == tolower(pattern[j - 1]))
-            {
-                lookup[i][j] = lookup[i - 1][j - 1];
-            }
-            // If characters don't match
-            else
-                lookup[i][j] = false;
+            from = (const char *)memchr(from, first, last - from + 1);
+            if (from == nullptr)
+                return nullptr;
         }
+        if (_piece_at(from, piece))
+            return from;
+        from++;
+    }
+    return nullptr;
+}
+
+bool util_wildcard::match(const char *str) const
+{
+    size_t n = strlen(str);
+
+    // No stars: the name is the one piece, or empty for an empty pattern
+    if (!_leading_star && !_trailing_star && _pieces.size() <= 1)
+        return n == _min_len && (_pieces.empty() || _piece_at(str, _pieces[0]));
+
+    if (n < _min_len)
+        return false;
+
+    size_t first = 0, count = _pieces.size();
+    const char *pos = str;
+    const char *end = str + n;
+
+    // Fixed pieces at the ends first, they're where most names fail
+    if (!_leading_star)
+    {
+        if (!_piece_at(str, _pieces[0]))
+            return false;
+        pos += _pieces[0].second;
+        first++;
+        count--;
+    }
+    if (!_trailing_star)
+    {
+        const std::pair<uint16_t, uint16_t> &last = _pieces[_pieces.size() - 1];
+        if (end - pos < last.second || !_piece_at(end - last.second, last))
+            return false;
+        end -= last.second;
+        count--;
     }
 
-    return lookup[n][m];
+    // Each piece in between goes at its leftmost place after the one before
+    for (size_t i = first; i < first + count; i++)
+    {
+        const std::pair<uint16_t, uint16_t> &piece = _pieces[i];
+        if (end - pos < piece.second)
+            return false;
+        const char *at = _find_piece(pos, end - piece.second, piece);
+        if (at == nullptr)
+            return false;
+        pos = at + piece.second;
+    }
+    return true;
 }
 
 bool util_starts_with(std::string s, const char *pattern)
@@ -553,6 +611,19 @@ bool util_starts_with(std::string s, const char *pattern)
     return ss.compare(pattern) == 0;
 }
 
+bool util_is_gzip_name(const char *filename)
+{
+    size_t l = strlen(filename);
+    return l > 3 && strcasecmp(filename + l - 3, ".gz") == 0;
+}
+
+std::string util_strip_gzip_ext(const char *filename)
+{
+    if (util_is_gzip_name(filename))
+        return std::string(filename, strlen(filename) - 3);
+    return filename;
+}
+
 /*
  Concatenates two paths by taking the parent and adding the child at the end.
  If parent is not empty, then a '/' is confirmed to separate the parent and child.
@@ -680,33 +751,29 @@ void util_devicespec_fix_9b(uint8_t *buf, unsigned short len)
 // 2. removes final 0x9b chars that may be coming out the host because of x-platform code
 // 3. converts petscii to ascii
 void clean_transform_petscii_to_ascii(std::string& data) {
-    // 1. Replace all chars of value 0xa4 to 0x5f (the dreaded underscore)
-    std::transform(data.begin(), data.end(), data.begin(), [](unsigned char c) {
-        return c == 0xa4 ? 0x5f : c;
-    });
-
-    // 2. Remove any trailing 0x9b chars
-    while (!data.empty() && static_cast<unsigned char>(data.back()) == 0x9b) {
-        data.pop_back();
-    }
-
-    // 3. Convert the characters from PETSCII to UTF8
-    data = mstr::toUTF8(data);
+    // 1. Drop any trailing 0x9b chars, so they're never looked at again
+    size_t len = data.size();
+    while (len > 0 && static_cast<unsigned char>(data[len - 1]) == 0x9b)
+        len--;
+
+    // 2. Convert the characters from PETSCII to UTF8, 0xa4 going to 0x5f (the dreaded underscore) on the way
+    std::string utf8;
+    utf8.reserve(len);
+    mstr::toUTF8(data.data(), len, utf8, 0xa4, 0x5f);
+    data.swap(utf8);
 }
 
 // Non-mutating
-std::string util_devicespec_fix_for_parsing(std::string deviceSpec, std::string prefix, bool is_directory_read, bool process_fs_dot)
+std::string util_devicespec_fix_for_parsing(std::string deviceSpec, const std::string &prefix, bool is_directory_read, bool process_fs_dot)
 {
     if (deviceSpec.length() == 0) {
         Debug_printv("ERROR: deviceSpec is empty, returning empty string");
         return "";
     }
 
-    string unit = deviceSpec.substr(0, deviceSpec.find_first_of(":") + 1);
-    string path = deviceSpec.substr(unit.length());
-
-    // if prefix is empty, the concatenation is still valid
-    deviceSpec = unit + prefix + path;
+    // Everything below works on deviceSpec in place, without temporaries.
+    // The prefix goes after the unit, or at the start if there's no unit
+    deviceSpec.insert(deviceSpec.find_first_of(":") + 1, prefix);
 
 #ifdef VERBOSE_PROTOCOL
     Debug_printf("util_devicespec_fix_for_parsing, spec: >%s<, prefix: >%s<, dir_read?: %s, fs_dot?: %s)\n", deviceSpec.c_str(), prefix.c_str(), is_directory_read ? "true" : "false", process_fs_dot ? "true" : "false");
@@ -720,13 +787,13 @@ std::string util_devicespec_fix_for_parsing(std::string deviceSpec, std::string
     }
 
     // Some FMSes add a dot at the end, remove it if required to. Only seems to be SIO that uses this code, but we'll control its use through a default parameter
-    if (process_fs_dot && deviceSpec.substr(deviceSpec.length() - 1) == ".")
+    if (process_fs_dot && deviceSpec.back() == '.')
     {
-        deviceSpec.erase(deviceSpec.length() - 1, string::npos);
+        deviceSpec.pop_back();
     }
 
     // Remove any spurious spaces
-    deviceSpec = util_remove_spaces(deviceSpec);
+    deviceSpec.erase(deviceSpec.find_last_not_of(' ') + 1);
 
     return deviceSpec;
 }
@@ -810,7 +877,7 @@ void util_sam_say(const char *p,
 
     // Append the phrase to say.
     a[n++] = (char *)p;
-    sam(n, a);
+    sam_queue(n, a);
 }
 
 /**
@@ -986,38 +1053,59 @@ std::string util_get_canonical_path(std::string path)
     return res;
 }
 
-char util_petscii_to_ascii(char c)
+// A byte for byte table, built at compile time, for each direction. Each moves the two
+// runs of letters by 0x20: upper_shift for 0x41-0x5A and the opposite for 0x61-0x7A
+struct petscii_case_table
 {
-    if ((c > 0x40) && (c < 0x5B))
-        c += 0x20;
-    else if ((c > 0x60) && (c < 0x7B))
-        c -= 0x20;
+    uint8_t map[256];
 
-    return c;
+    constexpr petscii_case_table(int upper_shift) : map()
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            if ((c > 0x40) && (c < 0x5B))
+                map[c] = c + upper_shift;
+            else if ((c > 0x60) && (c < 0x7B))
+                map[c] = c - upper_shift;
+            else
+                map[c] = c;
+        }
+    }
+};
+
+static constexpr petscii_case_table _petscii_to_ascii(0x20);
+static constexpr petscii_case_table _ascii_to_petscii(-0x20);
+
+char util_petscii_to_ascii(char c)
+{
+    return _petscii_to_ascii.map[(uint8_t)c];
 }
 
 char util_ascii_to_petscii(char c)
 {
-    if ((c > 0x40) && (c < 0x5B))
-        c -= 0x20;
-    else if ((c > 0x60) && (c < 0x7B))
-        c += 0x20;
+    return _ascii_to_petscii.map[(uint8_t)c];
+}
 
-    return c;
+void util_petscii_to_ascii_buf(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        buf[i] = _petscii_to_ascii.map[buf[i]];
+}
+
+void util_ascii_to_petscii_buf(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        buf[i] = _ascii_to_petscii.map[buf[i]];
 }
 
 void util_petscii_to_ascii_str(std::string &s)
 {
-    std::transform(s.begin(), s.end(), s.begin(),
-                   [](unsigned char c)
-                   { return util_petscii_to_ascii(c); });
+    util_petscii_to_ascii_buf((uint8_t *)&s[0], s.size());
 }
 
 void util_ascii_to_petscii_str(std::string &s)
 {
-    std::transform(s.begin(), s.end(), s.begin(),
-                   [](unsigned char c)
-                   { return util_ascii_to_petscii(c); });
+    util_ascii_to_petscii_buf((uint8_t *)&s[0], s.size());
 }
 
 std::string util_hexdump(const void *buf, size_t len)
@@ -62,7 +62,36 @@ std::string util_long_entry_apple2_80col(std::string filename, size_t fileSize,
 int util_ellipsize(const char* src, char *dst, int dstsize);
 std::string util_ellipsize_string(const std::string& src, size_t maxSize);
 bool util_wildcard_match(const char *str, const char *pattern);
+
+/*
+ A wildcard pattern ('*' and '?', letters matched without regard to case) taken apart
+ once, for matching a whole listing against it. The pieces between the stars are
+ matched with the fixed ones at either end checked first, so "*.ATR" only looks at
+ the last four characters of each name.
+*/
+class util_wildcard
+{
+private:
+    std::string _folded; // The pattern, in lower case
+    // Each run of characters between stars, as an offset into _folded and a length
+    std::vector<std::pair<uint16_t, uint16_t>> _pieces;
+    bool _leading_star = false;
+    bool _trailing_star = false;
+    size_t _min_len = 0; // Shortest name that could match
+
+    bool _piece_at(const char *str, const std::pair<uint16_t, uint16_t> &piece) const;
+    const char *_find_piece(const char *from, const char *last, const std::pair<uint16_t, uint16_t> &piece) const;
+
+public:
+    explicit util_wildcard(const char *pattern);
+    bool match(const char *str) const;
+};
 bool util_starts_with(std::string s, const char *pattern);
+// Whether filename ends in ".gz"
+bool util_is_gzip_name(const char *filename);
+// filename less any ".gz", so a compressed image's type can be told from its name.
+// fujiHost opens such images decompressed
+std::string util_strip_gzip_ext(const char *filename);
 
 bool util_concat_paths(char *dest, const char *parent, const char *child, int dest_size);
 
@@ -74,7 +103,7 @@ std::string util_remove_spaces(const std::string &s);
 
 void util_strip_nonascii(std::string &s);
 void util_devicespec_fix_9b(uint8_t* buf, unsigned short len);
-std::string util_devicespec_fix_for_parsing(std::string deviceSpec, std::string prefix, bool is_directory_read, bool process_fs_dot);
+std::string util_devicespec_fix_for_parsing(std::string deviceSpec, const std::string &prefix, bool is_directory_read, bool process_fs_dot);
 
 void clean_transform_petscii_to_ascii(std::string& data);
 
@@ -101,6 +130,9 @@ char util_petscii_to_ascii(char c);
 char util_ascii_to_petscii(char c);
 void util_petscii_to_ascii_str(std::string &s);
 void util_ascii_to_petscii_str(std::string &s);
+// The same, in place over len bytes at buf
+void util_petscii_to_ascii_buf(uint8_t *buf, size_t len);
+void util_ascii_to_petscii_buf(uint8_t *buf, size_t len);
 
 // generic hex dump for debug output
 std::string util_hexdump(const void *buf, size_t len);
@@ -4,6 +4,7 @@
 
 #include "WebDAV.h"
 
+#include <cstdlib>
 #include <cstring>
 
 #include "../../include/debug.h"
@@ -50,8 +51,10 @@ void call_char(void *data, const XML_Char *s, int len)
     handler->Char(s, len);
 }
 
-bool WebDAV::begin_parser()
+bool WebDAV::begin_parser(DirCache *sink)
 {
+    entries = sink;
+
     // Create XML parser
     parser = XML_ParserCreate(NULL);
     if (parser == nullptr)
@@ -68,6 +71,7 @@ bool WebDAV::begin_parser()
     insideDisplayName = false;
     insideGetContentLength = false;
     entriesCounter = 0;
+    entriesFull = false;
 
     // Clear result storage
     clear();
@@ -93,11 +97,6 @@ bool WebDAV::parse(const char *buf, int len, int isFinal)
         return true;
     }
 
-    // Put PROPFIND data to debug console
-    Debug_printf("WebDAV::parse data (%d bytes):\r\n", len);
-    if (len > 0)
-        Debug_printf("%s\r\n", buf);
-
     // Parse the damned buffer
     XML_Status xs = XML_Parse(parser, buf, len, isFinal);
 
@@ -112,8 +111,8 @@ bool WebDAV::parse(const char *buf, int len, int isFinal)
 
 void WebDAV::clear()
 {
-    entries.clear();
-    entries.shrink_to_fit();
+    if (entries != nullptr)
+        entries->clear();
     currentEntry.filename.clear();
     currentEntry.fileSize.clear();
     currentEntry.isDir = false;
@@ -129,9 +128,15 @@ void WebDAV::Start(const XML_Char *el, const XML_Char **attr)
         insideResponse = true;
     }
     else if (IS_ANYNS_ELEMENT("displayname", el, el_len))
+    {
         insideDisplayName = true;
+        currentEntry.filename.clear();
+    }
     else if (IS_ANYNS_ELEMENT("getcontentlength", el, el_len))
+    {
         insideGetContentLength = true;
+        currentEntry.fileSize.clear();
+    }
 }
 
 void WebDAV::End(const XML_Char *el)
@@ -145,20 +150,20 @@ void WebDAV::End(const XML_Char *el)
         // skip first entry (current directory)
         if (entriesCounter++ == 0) 
             store = false;
-        // skip entries over limit
-        else if (entriesCounter >= 1000)
-        {
+        // skip entries once the cache is full
+        else if (entriesFull || entries == nullptr)
             store = false;
-            if (entriesCounter == 1000)
-                Debug_printf("Too many directory entries");
-        }
         // skip noname entries
         else if (currentEntry.filename.empty())
             store = false;
 
         // store directory entry
-        if (store)
-            entries.push_back(currentEntry);
+        if (store && !entries->add_entry(currentEntry.filename.c_str(), currentEntry.isDir,
+                                         strtoul(currentEntry.fileSize.c_str(), nullptr, 10), 0))
+        {
+            Debug_printf("Too many directory entries, listing truncated\r\n");
+            entriesFull = true;
+        }
 
         // reset currentEntry
         currentEntry.filename.clear();
@@ -177,15 +182,10 @@ void WebDAV::Char(const XML_Char *s, int len)
 {
     if (insideResponse == true)
     {
+        // expat hands over text in pieces wherever a chunk of the response happened to end
         if (insideDisplayName == true)
-        {
-            currentEntry.filename = std::string(s, len);
-            Debug_printf("  filename = %s\n", currentEntry.filename.c_str());
-        }
+            currentEntry.filename.append(s, len);
         else if (insideGetContentLength == true)
-        {
-            currentEntry.fileSize = std::string(s, len);
-            Debug_printf("  fileSize = %s\n", currentEntry.fileSize.c_str());
-        }
+            currentEntry.fileSize.append(s, len);
     }
 }
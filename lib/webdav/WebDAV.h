@@ -7,7 +7,8 @@
 
 #include <expat.h>
 #include <string>
-#include <vector>
+
+#include "fnDirCache.h"
 
 // using namespace std;
 
@@ -39,8 +40,10 @@ public:
 
     /**
      * @brief Called to setup everything before processing XML
+     * @param sink where each directory entry goes as soon as its D:response closes, so the
+     *        listing never has to be held as XML or as a second list
      */
-    bool begin_parser();
+    bool begin_parser(DirCache *sink);
 
     /**
      * @brief Called to release XML parser resources
@@ -53,11 +56,6 @@ public:
      */
     bool parse(const char *buf, int len, int isFinal);
 
-    /**
-     * @brief Called to scoot to beginning of directory entries
-     */
-    std::vector<WebDAV::DAVEntry>::iterator rewind() {return entries.begin();};
-
     /**
      * @brief Called to remove all stored directory entries
      */
@@ -83,12 +81,17 @@ public:
      */
     void Char(const XML_Char *s, int len);
 
+protected:
     /**
-     * @brief collection of DAV entries.
+     * @brief where finished entries go
      */
-    std::vector<DAVEntry> entries;
+    DirCache *entries = nullptr;
+
+    /**
+     * @brief set once the sink is out of room, the rest of the listing is skipped
+     */
+    bool entriesFull;
 
-protected:
     /**
      * @brief the current entry
      */
@@ -112,7 +115,7 @@ protected:
     /**
      * Expat XML parser
      */
-    XML_Parser parser;
+    XML_Parser parser = nullptr;
 
     /*
      * Parsed entries counter
@@ -893,6 +893,16 @@ void dcd_read(uint8_t ntx)
   while(uart_is_readable(UART_ID))
     uart_getc(UART_ID);
 
+  // let the FujiNet read the whole run from the image in one go
+  if (num_sectors > 1)
+  {
+    uart_putc_raw(UART_ID, 'M');
+    uart_putc_raw(UART_ID, (sector >> 16) & 0xff);
+    uart_putc_raw(UART_ID, (sector >> 8) & 0xff);
+    uart_putc_raw(UART_ID, sector & 0xff);
+    uart_putc_raw(UART_ID, num_sectors);
+  }
+
   for (uint8_t i=0; i<num_sectors; i++)
   {
     // printf("sending sector %06x in %d groups\n", sector, ntx);
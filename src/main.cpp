@@ -25,6 +25,12 @@
 
 #include "fsFlash.h"
 #include "fnFsSD.h"
+#include "tnfslib.h"
+#include "fnFilePreload.h"
+#include "fujiAppKeys.h"
+#include "fnFileHTTP.h"
+#include "httpClientPool.h"
+#include "fnSMBPool.h"
 
 #include "httpService.h"
 
@@ -38,8 +44,11 @@ Console console;
 #include "display.h"
 #endif
 
-#ifndef ESP_PLATFORM
 #include "fnTaskManager.h"
+#include "fnEvents.h"
+#include "fnIdleWait.h"
+
+#ifndef ESP_PLATFORM
 #include "version.h"
 #include "build_version.h"
 #endif
@@ -101,8 +110,60 @@ void main_shutdown_handler()
     // Give devices an opportunity to clean up before rebooting
 
     SYSTEM_BUS.shutdown();
+
+    // Changes save_later() is still sitting on
+    Config.flush();
 }
 
+// Each boot stage's time from the end of the one before
+static unsigned long boot_stage_ms = 0;
+
+static void boot_stage(const char *stage)
+{
+    unsigned long now = fnSystem.millis();
+    Debug_printf("Boot stage %s: %lums\r\n", stage, now - boot_stage_ms);
+    boot_stage_ms = now;
+}
+
+// Set once the network is on its way, otherwise the service loop starts it
+static bool boot_network_started = false;
+
+static void main_network_start()
+{
+    // Try connecting to WiFi or BlueTooth
+    if (Config.get_bt_status())
+    {
+#ifdef BLUETOOTH_SUPPORT
+        // Start SIO2BT mode if we were in it last shutdown
+        fnLedManager.set(eLed::LED_BT, true); // BT LED ON
+        fnBtManager.start();
+#endif
+    }
+    else if (Config.get_wifi_enabled())
+    {
+        // Set up the WiFi adapter if enabled in config
+        fnWiFi.start();
+        // Go ahead and try reconnecting to WiFi
+        fnWiFi.connect();
+    }
+}
+
+#ifdef ESP_PLATFORM
+// WiFi is brought up on CPU0 while the bus is set up on the main task's CPU.
+// SNTP, HTTP and mDNS follow its IP, once the bus is ready
+#define BOOT_NETWORK_STACKSIZE 8192
+#define BOOT_NETWORK_PRIORITY 5
+#define BOOT_NETWORK_CPUAFFINITY 0
+
+static void boot_network_task(void *param)
+{
+    unsigned long startms = fnSystem.millis();
+    main_network_start();
+    Debug_printf("Boot stage network: %lums\r\n", fnSystem.millis() - startms);
+    vTaskDelete(nullptr);
+}
+#endif
+
 // Initial setup
 #ifdef ESP_PLATFORM
 void main_setup()
@@ -139,6 +200,7 @@ void main_setup(int argc, char *argv[])
 #ifdef ESP_PLATFORM
 
     unsigned long startms = fnSystem.millis();
+    boot_stage_ms = startms;
 
 #ifdef ENABLE_CONSOLE
     //You can change the console prompt before calling begin(). By default it is "ESP32>"
@@ -164,6 +226,7 @@ void main_setup(int argc, char *argv[])
 #else
 // !ESP_PLATFORM
     unsigned long startms = fnSystem.millis();
+    boot_stage_ms = startms;
     Debug_print("\n");
     Debug_print("\n");
     Debug_print("--~--~--~--\n");
@@ -185,6 +248,7 @@ void main_setup(int argc, char *argv[])
 
     // Enable GPIO Interrupt Service Routine
     gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+    boot_stage("nvs");
 #else
 // !ESP_PLATFORM
     atexit(main_shutdown_handler);
@@ -216,21 +280,33 @@ void main_setup(int argc, char *argv[])
     fnKeyManager.setup();
 #endif
     fnLedManager.setup();
+    boot_stage("hardware");
 
     fsFlash.start();
+    boot_stage("flash");
 #ifdef ESP_PLATFORM
     fnSDFAT.start();
 #else
     fnSDFAT.start(Config.get_general_SD_path().c_str());
 #endif
+    boot_stage("sd");
 
     // setup crypto key - must be done before loading the config
     crypto.setkey("FNK" + fnWiFi.get_mac_str());
 
     // Load our stored configuration
     Config.load();
+    boot_stage("config");
 
-    // WiFi/BT auto connect moved to app_main()
+    // WiFi/BT auto connect runs alongside the bus setup below
+#ifdef ESP_PLATFORM
+    fnWiFi.hold_services();
+    if (xTaskCreatePinnedToCore(boot_network_task, "fnBootNet", BOOT_NETWORK_STACKSIZE, nullptr,
+                                BOOT_NETWORK_PRIORITY, nullptr, BOOT_NETWORK_CPUAFFINITY) == pdPASS)
+        boot_network_started = true;
+    else
+        Debug_println("Boot: no network task, starting the network after setup");
+#endif
 
 #ifdef BUILD_ATARI
     theFuji.setup(&SIO);
@@ -463,7 +539,11 @@ void main_setup(int argc, char *argv[])
     CX16.setup();
 #endif
 
+    boot_stage("bus");
 #ifdef ESP_PLATFORM
+    // The bus is ready for whatever an IP brings with it
+    fnWiFi.release_services();
+
   #ifdef DEBUG
     unsigned long endms = fnSystem.millis();
     Debug_printf("\r\nAvailable heap: %lu\r\nSetup complete @ %lu (%lums)\r\n", fnSystem.get_free_heap_size(), endms, endms - startms);
@@ -516,22 +596,9 @@ void fn_service_loop(void *param)
     }
 #endif
 
-    // Now that our main service is running, try connecting to WiFi or BlueTooth
-    if (Config.get_bt_status())
-    {
-#ifdef BLUETOOTH_SUPPORT
-        // Start SIO2BT mode if we were in it last shutdown
-        fnLedManager.set(eLed::LED_BT, true); // BT LED ON
-        fnBtManager.start();
-#endif
-    }
-    else if (Config.get_wifi_enabled())
-    {
-        // Set up the WiFi adapter if enabled in config
-        fnWiFi.start();
-        // Go ahead and try reconnecting to WiFi
-        fnWiFi.connect();
-    }
+    // Now that our main service is running, unless it's already on its way
+    if (!boot_network_started)
+        main_network_start();
 
     // Main service loop
 #ifdef ESP_PLATFORM
@@ -557,13 +624,49 @@ void fn_service_loop(void *param)
 #endif
         SYSTEM_BUS.service();
 
+        // Send TNFS writes that have been sitting in write-behind buffers long enough
+        tnfs_flush_expired_writes();
+        // App keys written a little while ago
+        fnAppKeys.service();
+        FileHandlerPreload::service();
+#ifndef FNIO_IS_STDIO
+        // Keep HTTP image downloads going
+        FileHandlerHTTP::service();
+#endif
+
+        // Close kept-alive HTTP connections nobody has reused in time
+        http_client_pool_expire();
+        smb_pool_expire();
+
+        // Hand state changes to the web server's event listeners
+        fnEvents.dispatch();
+
+#ifdef ESP_PLATFORM
+        // Modem sleep once the bus has been idle long enough
+        fnWiFi.service_power_save();
+#endif
+
+        // Background jobs such as file copies
+#ifdef ESP_PLATFORM
+        taskMgr.service();
+#else
+        if (!taskMgr.service())
+            fnIdle.busy();
+#endif
+
 #ifdef ESP_PLATFORM
         taskYIELD(); // Allow other tasks to run
 #else
 // !ESP_PLATFORM
         fnHTTPD.service();
 
-        taskMgr.service();
+        // Background loading and downloads aren't announced by a socket
+        if (FileHandlerPreload::busy())
+            fnIdle.busy();
+#ifndef FNIO_IS_STDIO
+        if (FileHandlerHTTP::busy())
+            fnIdle.busy();
+#endif
 
         if (fnSystem.check_deferred_reboot())
         {
@@ -574,6 +677,9 @@ void fn_service_loop(void *param)
             // indicate to the controlling script (run-fujinet) that this program (fujinet) should be started again
             fnSystem.reboot(); // calls exit(75)
         }
+
+        // Sleep while nothing is going on
+        fnIdle.wait();
 #endif
     }
 }
@@ -599,7 +705,12 @@ extern "C"
 #else
 #define MAIN_PRIORITY 17
 #endif
+#if defined(BUILD_IEC) && defined(IEC_DEDICATED_CORE)
+// CPU1 is left to the IEC bus task (see iec.cpp)
+#define MAIN_CPUAFFINITY 0
+#else
 #define MAIN_CPUAFFINITY 1
+#endif
 
         xTaskCreatePinnedToCore(fn_service_loop, "fnLoop",
                                 MAIN_STACKSIZE, nullptr, MAIN_PRIORITY, nullptr, MAIN_CPUAFFINITY);
@@ -618,6 +729,7 @@ int main(int argc, char *argv[])
     main_setup(argc, argv);
     // Enter service loop
     fn_service_loop(nullptr);
+    fnAppKeys.flush();
 
     if (exit_for_restart)
         fnSystem.reboot(); // calls exit(75)
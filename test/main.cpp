@@ -6,6 +6,8 @@
 #include <esp32/rom/ets_sys.h>
 #include "test_pass.h"
 #include "test_networkprotocol_translation.h"
+#include "test_media_block_cache.h"
+#include "test_devrelay_connection.h"
 #include "../lib/hardware/fnSystem.h"
 
 extern "C"
@@ -24,6 +26,8 @@ void app_main()
 
     test_pass_run();
     tests_networkprotocol_translation();
+    tests_media_block_cache();
+    tests_devrelay_connection();
 
     UNITY_END();
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+/**
+ * #FujiNet Tests - Dev-relay Connection
+ *
+ * This set of tests exercise the waits on a Connection, which sleep on its
+ * condition variable until a packet arrives or the connection closes.
+ */
+
+#include "test_devrelay_connection.h"
+
+#ifdef DEV_RELAY_SLIP
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../lib/devrelay/service/Connection.h"
+
+/**
+ * A Connection packets are handed to directly, as its read thread would
+ */
+class TestConnection : public Connection
+{
+public:
+    void send_data(const std::vector<uint8_t> &) override {}
+    void create_read_channel() override {}
+    void close_connection() override { set_is_connected(false); }
+
+    void deliver(std::vector<uint8_t> packet) { add_packet(std::move(packet)); }
+};
+
+/**
+ * Hands packets to the connection from another thread once the caller has had time to wait
+ */
+static std::thread deliver_later(TestConnection &connection, std::vector<std::vector<uint8_t>> packets)
+{
+    return std::thread([&connection, packets]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        for (const auto &packet : packets)
+            connection.deliver(packet);
+    });
+}
+
+/**
+ * Tests entrypoint
+ */
+void tests_devrelay_connection()
+{
+    RUN_TEST(tests_devrelay_connection_response);
+    RUN_TEST(tests_devrelay_connection_request);
+}
+
+/**
+ * Test a waiting wait_for_response() is woken by its response, not another one
+ */
+void tests_devrelay_connection_response()
+{
+    TestConnection connection;
+    connection.set_is_connected(true);
+
+    std::thread sender = deliver_later(connection, {{7, 0xAA}, {3, 1, 2, 3}});
+    std::vector<uint8_t> response = connection.wait_for_response(3, std::chrono::seconds(5));
+    sender.join();
+
+    TEST_ASSERT_EQUAL(4, response.size());
+    TEST_ASSERT_EQUAL(3, response[0]);
+    TEST_ASSERT_EQUAL(3, response[3]);
+
+    // The other one is still there for whoever waits on it
+    response = connection.wait_for_response(7, std::chrono::seconds(1));
+    TEST_ASSERT_EQUAL(2, response.size());
+    TEST_ASSERT_EQUAL(0xAA, response[1]);
+}
+
+/**
+ * Test a waiting wait_for_request() is woken by a request, and by the connection closing
+ */
+void tests_devrelay_connection_request()
+{
+    TestConnection connection;
+    connection.set_is_connected(true);
+
+    std::thread sender = deliver_later(connection, {{5, 0x55}});
+    std::vector<uint8_t> request = connection.wait_for_request();
+    sender.join();
+
+    TEST_ASSERT_EQUAL(2, request.size());
+    TEST_ASSERT_EQUAL(5, request[0]);
+
+    std::thread closer([&connection]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        connection.close_connection();
+    });
+    request = connection.wait_for_request();
+    closer.join();
+
+    TEST_ASSERT_TRUE(request.empty());
+}
+
+#else
+
+void tests_devrelay_connection()
+{
+    RUN_TEST(tests_devrelay_connection_response);
+    RUN_TEST(tests_devrelay_connection_request);
+}
+
+void tests_devrelay_connection_response()
+{
+    TEST_IGNORE_MESSAGE("dev-relay is only built with DEV_RELAY_SLIP");
+}
+
+void tests_devrelay_connection_request()
+{
+    TEST_IGNORE_MESSAGE("dev-relay is only built with DEV_RELAY_SLIP");
+}
+
+#endif /* DEV_RELAY_SLIP */
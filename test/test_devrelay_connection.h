@@ -0,0 +1,36 @@
+/**
+ * #FujiNet Tests - Dev-relay Connection
+ *
+ * This set of tests exercise the waits on a Connection, which sleep on its
+ * condition variable until a packet arrives or the connection closes.
+ */
+
+#ifndef TEST_DEVRELAY_CONNECTION_H
+#define TEST_DEVRELAY_CONNECTION_H
+
+#include <unity.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+
+extern "C"
+{
+    /**
+     * Tests entrypoint
+     */
+    void tests_devrelay_connection();
+
+    /**
+     * Test a waiting wait_for_response() is woken by its response, not another one
+     */
+    void tests_devrelay_connection_response();
+
+    /**
+     * Test a waiting wait_for_request() is woken by a request, and by the connection closing
+     */
+    void tests_devrelay_connection_request();
+}
+
+#endif /* __cplusplus */
+
+#endif /* TEST_DEVRELAY_CONNECTION_H */
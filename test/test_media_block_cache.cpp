@@ -0,0 +1,184 @@
+/**
+ * #FujiNet Tests - Media block cache
+ *
+ * This set of tests exercise the block cache the media types put in front of their disk images.
+ */
+
+#include <string.h>
+#include <vector>
+#include "../lib/media/mediaBlockCache.h"
+#include "test_media_block_cache.h"
+
+/**
+ * Image geometry
+ */
+#define TEST_BLOCK_SIZE 16
+#define TEST_BLOCKS 64
+
+/**
+ * A disk image in memory, each block filled with its own number
+ */
+static uint8_t image[TEST_BLOCKS * TEST_BLOCK_SIZE];
+static std::vector<uint32_t> image_reads;
+static std::vector<uint32_t> image_writes;
+
+static bool image_read(uint32_t block, uint8_t *data)
+{
+    image_reads.push_back(block);
+    memcpy(data, &image[block * TEST_BLOCK_SIZE], TEST_BLOCK_SIZE);
+    return false;
+}
+
+static bool image_write(uint32_t block, const uint8_t *data)
+{
+    image_writes.push_back(block);
+    memcpy(&image[block * TEST_BLOCK_SIZE], data, TEST_BLOCK_SIZE);
+    return false;
+}
+
+static void image_setup()
+{
+    for (uint32_t i = 0; i < TEST_BLOCKS; i++)
+        memset(&image[i * TEST_BLOCK_SIZE], i, TEST_BLOCK_SIZE);
+    image_reads.clear();
+    image_writes.clear();
+}
+
+/**
+ * Tests entrypoint
+ */
+void tests_media_block_cache()
+{
+    RUN_TEST(tests_media_block_cache_hit);
+    RUN_TEST(tests_media_block_cache_readahead);
+    RUN_TEST(tests_media_block_cache_evict_lru);
+    RUN_TEST(tests_media_block_cache_write_through);
+    RUN_TEST(tests_media_block_cache_write_back);
+}
+
+/**
+ * Test a second read of a block comes from the cache
+ */
+void tests_media_block_cache_hit()
+{
+    MediaBlockCache<TEST_BLOCK_SIZE, 4> cache(image_read, image_write);
+    uint8_t buf[TEST_BLOCK_SIZE];
+
+    image_setup();
+
+    TEST_ASSERT_FALSE(cache.read(5, buf));
+    TEST_ASSERT_FALSE(cache.read(5, buf));
+
+    TEST_ASSERT_EQUAL_UINT8(5, buf[0]);
+    TEST_ASSERT_EQUAL_INT(1, image_reads.size());
+    TEST_ASSERT_EQUAL_UINT32(1, cache.hits);
+    TEST_ASSERT_EQUAL_UINT32(1, cache.misses);
+}
+
+/**
+ * Test a miss reads the following blocks ahead, but not past the end of the image
+ */
+void tests_media_block_cache_readahead()
+{
+    MediaBlockCache<TEST_BLOCK_SIZE, 8> cache(image_read, image_write);
+    uint8_t buf[TEST_BLOCK_SIZE];
+
+    image_setup();
+    cache.set_block_count(TEST_BLOCKS);
+    cache.set_readahead(3);
+
+    cache.read(10, buf);
+    TEST_ASSERT_EQUAL_INT(4, image_reads.size());
+    for (uint32_t b = 11; b <= 13; b++)
+    {
+        TEST_ASSERT_FALSE(cache.read(b, buf));
+        TEST_ASSERT_EQUAL_UINT8(b, buf[0]);
+    }
+    TEST_ASSERT_EQUAL_INT(4, image_reads.size());
+
+    image_reads.clear();
+    cache.read(TEST_BLOCKS - 2, buf);
+    TEST_ASSERT_EQUAL_INT(2, image_reads.size());
+}
+
+/**
+ * Test the least recently used block is the one evicted
+ */
+void tests_media_block_cache_evict_lru()
+{
+    MediaBlockCache<TEST_BLOCK_SIZE, 2> cache(image_read, image_write);
+    uint8_t buf[TEST_BLOCK_SIZE];
+
+    image_setup();
+
+    cache.read(1, buf);
+    cache.read(2, buf);
+    cache.read(1, buf);
+    cache.read(3, buf); // pushes out 2
+
+    image_reads.clear();
+    cache.read(1, buf);
+    TEST_ASSERT_EQUAL_INT(0, image_reads.size());
+    cache.read(2, buf);
+    TEST_ASSERT_EQUAL_INT(1, image_reads.size());
+}
+
+/**
+ * Test write through writes at once and keeps a cached copy current
+ */
+void tests_media_block_cache_write_through()
+{
+    MediaBlockCache<TEST_BLOCK_SIZE, 4> cache(image_read, image_write);
+    uint8_t buf[TEST_BLOCK_SIZE];
+
+    image_setup();
+
+    cache.read(7, buf);
+    memset(buf, 0xAA, sizeof(buf));
+    TEST_ASSERT_FALSE(cache.write(7, buf));
+    TEST_ASSERT_EQUAL_INT(1, image_writes.size());
+    TEST_ASSERT_EQUAL_UINT8(0xAA, image[7 * TEST_BLOCK_SIZE]);
+
+    memset(buf, 0, sizeof(buf));
+    cache.read(7, buf);
+    TEST_ASSERT_EQUAL_UINT8(0xAA, buf[0]);
+    TEST_ASSERT_EQUAL_INT(1, image_reads.size());
+    TEST_ASSERT_FALSE(cache.dirty());
+}
+
+/**
+ * Test write back holds writes until eviction or flush, and flushes in block order
+ */
+void tests_media_block_cache_write_back()
+{
+    MediaBlockCache<TEST_BLOCK_SIZE, 4, MEDIA_CACHE_WRITE_BACK> cache(image_read, image_write);
+    uint8_t buf[TEST_BLOCK_SIZE];
+
+    image_setup();
+
+    memset(buf, 0xAA, sizeof(buf));
+    cache.write(9, buf);
+    cache.write(4, buf);
+    cache.write(6, buf);
+    TEST_ASSERT_EQUAL_INT(0, image_writes.size());
+    TEST_ASSERT_TRUE(cache.dirty());
+
+    cache.read(9, buf);
+    TEST_ASSERT_EQUAL_UINT8(0xAA, buf[0]);
+    TEST_ASSERT_EQUAL_INT(0, image_reads.size());
+
+    TEST_ASSERT_FALSE(cache.flush());
+    TEST_ASSERT_EQUAL_INT(3, image_writes.size());
+    TEST_ASSERT_EQUAL_UINT32(4, image_writes[0]);
+    TEST_ASSERT_EQUAL_UINT32(6, image_writes[1]);
+    TEST_ASSERT_EQUAL_UINT32(9, image_writes[2]);
+    TEST_ASSERT_FALSE(cache.dirty());
+
+    // A changed block is written out before its slot is reused
+    image_writes.clear();
+    cache.write(20, buf);
+    for (uint32_t b = 30; b < 34; b++)
+        cache.read(b, buf);
+    TEST_ASSERT_EQUAL_INT(1, image_writes.size());
+    TEST_ASSERT_EQUAL_UINT32(20, image_writes[0]);
+}
@@ -0,0 +1,50 @@
+/**
+ * #FujiNet Tests - Media block cache
+ *
+ * This set of tests exercise the block cache the media types put in front of their disk images.
+ */
+
+#ifndef TEST_MEDIA_BLOCK_CACHE_H
+#define TEST_MEDIA_BLOCK_CACHE_H
+
+#include <unity.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+
+extern "C"
+{
+    /**
+     * Tests entrypoint
+     */
+    void tests_media_block_cache();
+
+    /**
+     * Test a second read of a block comes from the cache
+     */
+    void tests_media_block_cache_hit();
+
+    /**
+     * Test a miss reads the following blocks ahead, but not past the end of the image
+     */
+    void tests_media_block_cache_readahead();
+
+    /**
+     * Test the least recently used block is the one evicted
+     */
+    void tests_media_block_cache_evict_lru();
+
+    /**
+     * Test write through writes at once and keeps a cached copy current
+     */
+    void tests_media_block_cache_write_through();
+
+    /**
+     * Test write back holds writes until eviction or flush, and flushes in block order
+     */
+    void tests_media_block_cache_write_back();
+}
+
+#endif /* __cplusplus */
+
+#endif /* TEST_MEDIA_BLOCK_CACHE_H */
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+#
+# DriveWire Becker port microbenchmark
+#
+# Plays the emulator side of a Becker port connection and measures how many
+# DriveWire ops per second FujiNet answers:
+#   time   - OP_TIME, a 6 byte reply
+#   readex - OP_READEX of a 256 byte sector, checksum exchange included
+#
+# FujiNet-PC listens on port 65504 by default:
+#   tools/becker_bench.py localhost
+# or, with FujiNet set up to connect out to the emulator:
+#   tools/becker_bench.py --listen
+
+import argparse
+import socket
+import struct
+import time
+
+BECKER_DEFAULT_PORT = 65504
+
+OP_TIME = ord('#')
+OP_READEX = ord('R') + 128
+
+
+def build_argparser():
+  parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+  parser.add_argument("host", nargs="?", default="localhost", help="FujiNet to connect to")
+  parser.add_argument("--port", type=int, default=BECKER_DEFAULT_PORT)
+  parser.add_argument("--listen", action="store_true", help="wait for FujiNet to connect instead")
+  parser.add_argument("--count", type=int, default=1000, help="ops per test")
+  parser.add_argument("--drive", type=int, default=0, help="drive for readex")
+  parser.add_argument("--lsn", type=int, default=0, help="first LSN for readex, consecutive sectors are read")
+  return parser
+
+
+def recv_exact(sock, size):
+  data = b""
+  while len(data) < size:
+    chunk = sock.recv(size - len(data))
+    if not chunk:
+      raise ConnectionError("connection closed")
+    data += chunk
+  return data
+
+
+def op_time(sock, args, i):
+  sock.sendall(bytes([OP_TIME]))
+  recv_exact(sock, 6)
+
+
+def op_readex(sock, args, i):
+  lsn = args.lsn + i
+  sock.sendall(bytes([OP_READEX, args.drive]) + lsn.to_bytes(3, "big"))
+  sector = recv_exact(sock, 256)
+  sock.sendall(struct.pack(">H", sum(sector)))
+  status = recv_exact(sock, 1)[0]
+  if status != 0:
+    raise RuntimeError("LSN %d read failed, status %d" % (lsn, status))
+
+
+def run(sock, name, op, args):
+  start = time.perf_counter()
+  for i in range(args.count):
+    op(sock, args, i)
+  elapsed = time.perf_counter() - start
+  print("%-8s %6d ops  %8.1f ops/s  %7.3f ms/op" % (name, args.count, args.count / elapsed,
+                                                   elapsed * 1000 / args.count))
+
+
+def main():
+  args = build_argparser().parse_args()
+
+  if args.listen:
+    server = socket.create_server(("", args.port))
+    print("Waiting for FujiNet on port %d" % args.port)
+    sock, addr = server.accept()
+    server.close()
+  else:
+    sock = socket.create_connection((args.host, args.port))
+  sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+  run(sock, "time", op_time, args)
+  run(sock, "readex", op_readex, args)
+  sock.close()
+  return
+
+
+if __name__ == "__main__":
+  exit(main() or 0)
@@ -0,0 +1,542 @@
+#!/usr/bin/env python3
+#
+# FujiNet-PC bus benchmark
+#
+# Plays the computer on one of FujiNet-PC's emulator links and times
+# scripted workloads through the whole firmware, bus handling included, so
+# a caching or pipelining change can be measured from the computer's side.
+#
+# Atari, over NetSIO. FujiNet connects to us as its hub (port 9997), so set
+# the NetSIO host in its config to the machine running this:
+#   boot - sector reads from a D: drive, as when booting DOS from an ATR
+#   json - N: polling an HTTP JSON API: open, parse, query, read, close
+#   dir  - listing a host directory through the Fuji device
+#   copy - reading a large file through N: a chunk at a time
+#
+# Apple, over the dev-relay SLIP connector. FujiNet connects to us as it
+# would to AppleWin (port 1985):
+#   boot - SmartPort block reads from a FUJINET_DISK
+#
+# The image for boot can already be mounted, or --image mounts it (Atari).
+# Run a workload once per backend to compare them, e.g.:
+#   tools/bus_bench.py boot --image 1:/DOS25.ATR --label tnfs
+#   tools/bus_bench.py json --url "N:HTTP://api.example.com/status" --query /time
+#   tools/bus_bench.py dir --host-slot 1 --path /big --label tnfs
+#   tools/bus_bench.py copy --url "N:TNFS://server/big.bin" --json results.jsonl
+#   tools/bus_bench.py --bus slip boot --blocks 280
+#
+# Every workload prints ops/s, bytes/s and latency percentiles, and with
+# --json appends the same as one JSON object per line for comparing runs.
+# --populate makes a folder of empty files for the dir workload to list.
+
+import argparse
+import json
+import os
+import socket
+import sys
+import time
+
+NETSIO_DEFAULT_PORT = 9997
+SLIP_DEFAULT_PORT = 1985
+
+# NetSIO messages, as in lib/bus/sio/siocom/netsio_proto.h
+NETSIO_DATA_BYTE = 0x01
+NETSIO_DATA_BLOCK = 0x02
+NETSIO_DATA_BYTE_SYNC = 0x09
+NETSIO_COMMAND_OFF = 0x10
+NETSIO_COMMAND_ON = 0x11
+NETSIO_COMMAND_OFF_SYNC = 0x18
+NETSIO_SPEED_CHANGE = 0x80
+NETSIO_SYNC_RESPONSE = 0x81
+NETSIO_DEVICE_DISCONNECT = 0xC0
+NETSIO_DEVICE_CONNECT = 0xC1
+NETSIO_PING_REQUEST = 0xC2
+NETSIO_PING_RESPONSE = 0xC3
+NETSIO_ALIVE_REQUEST = 0xC4
+NETSIO_ALIVE_RESPONSE = 0xC5
+NETSIO_CREDIT_STATUS = 0xC6
+NETSIO_CREDIT_UPDATE = 0xC7
+NETSIO_EMPTY_SYNC = 0x00
+
+NETSIO_CREDIT = 64
+NETSIO_BLOCK_MAX = 511  # data bytes per DATA_BLOCK, FujiNet reads 514 byte datagrams
+SIO_BAUD = 19200
+
+SIO_DEVICE_DISK = 0x31
+SIO_DEVICE_FUJI = 0x70
+SIO_DEVICE_NETWORK = 0x71
+
+FUJICMD_SET_DEVICE_FULLPATH = 0xE2
+FUJICMD_CLOSE_DIRECTORY = 0xF5
+FUJICMD_READ_DIR_ENTRY = 0xF6
+FUJICMD_OPEN_DIRECTORY = 0xF7
+FUJICMD_MOUNT_IMAGE = 0xF8
+FUJICMD_MOUNT_HOST = 0xF9
+
+NETWORK_ERROR_END_OF_FILE = 136
+
+# dev-relay requests, as in lib/devrelay/types/Command.h
+CMD_STATUS = 0
+CMD_READ_BLOCK = 1
+CMD_INIT = 5
+SP_STATUS_DIB = 3
+
+SLIP_END = 0xC0
+SLIP_ESC = 0xDB
+SLIP_ESC_END = 0xDC
+SLIP_ESC_ESC = 0xDD
+
+
+class BusError(Exception):
+  pass
+
+
+def build_argparser():
+  parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+  parser.add_argument("workloads", nargs="*", default=["boot"], choices=["boot", "json", "dir", "copy"],
+                      help="workloads to run, in order")
+  parser.add_argument("--bus", choices=["netsio", "slip"], default="netsio")
+  parser.add_argument("--port", type=int, help="port to listen on, 9997 for netsio, 1985 for slip")
+  parser.add_argument("--timeout", type=float, default=5.0, help="seconds to wait for any one reply")
+  parser.add_argument("--label", default="", help="backend name to print and record with the results")
+  parser.add_argument("--json", metavar="FILE", help="append results as JSON lines, - for stdout")
+  # boot
+  parser.add_argument("--drive", type=int, default=1, help="boot: D: drive, or Nth FUJINET_DISK on slip")
+  parser.add_argument("--image", metavar="HOSTSLOT:PATH", help="boot: mount this image first (netsio)")
+  parser.add_argument("--first", type=int, help="boot: first sector, 1, or block on slip, 0")
+  parser.add_argument("--sectors", type=int, default=360, help="boot: sectors read, consecutively")
+  parser.add_argument("--blocks", type=int, default=280, help="boot: blocks read on slip")
+  # json and copy
+  parser.add_argument("--url", help="json, copy: N: devicespec to open")
+  parser.add_argument("--query", default="/", help="json: query for each poll")
+  parser.add_argument("--polls", type=int, default=50, help="json: polls")
+  parser.add_argument("--chunk", type=int, default=512, help="copy: bytes per N: read")
+  # dir
+  parser.add_argument("--host-slot", type=int, default=0, help="dir: host slot, 0-7")
+  parser.add_argument("--path", default="/", help="dir: directory to list")
+  parser.add_argument("--entry-len", type=int, default=36, help="dir: bytes per entry asked for")
+  parser.add_argument("--passes", type=int, default=3, help="dir: times the directory is listed")
+  parser.add_argument("--populate", nargs=2, metavar=("DIR", "COUNT"),
+                      help="create COUNT empty files in local DIR and exit")
+  return parser
+
+
+def sio_checksum(data):
+  ck = 0
+  for b in data:
+    ck += b
+    ck = (ck >> 8) + (ck & 0xFF)
+  return ck
+
+
+def spec_bytes(text, size=256):
+  data = text.encode("latin-1")[:size - 1]
+  return data + bytes(size - len(data))
+
+
+class Result:
+  def __init__(self, bus, workload, label):
+    self.bus = bus
+    self.workload = workload
+    self.label = label
+    self.latencies = []
+    self.bytes = 0
+    self.start = time.perf_counter()
+    self.elapsed = 0.0
+
+  def op(self, start, size=0):
+    self.latencies.append(time.perf_counter() - start)
+    self.bytes += size
+
+  def finish(self):
+    self.elapsed = time.perf_counter() - self.start
+
+  def percentile(self, p):
+    if not self.latencies:
+      return 0.0
+    ordered = sorted(self.latencies)
+    return ordered[min(len(ordered) - 1, int(p / 100.0 * len(ordered)))] * 1000
+
+  def as_dict(self):
+    ops = len(self.latencies)
+    latency = {p: round(self.percentile(v), 3) for p, v in (("p50", 50), ("p90", 90), ("p99", 99))}
+    latency["max"] = round(max(self.latencies, default=0) * 1000, 3)
+    return {
+      "bus": self.bus,
+      "workload": self.workload,
+      "label": self.label,
+      "ops": ops,
+      "bytes": self.bytes,
+      "seconds": round(self.elapsed, 6),
+      "ops_per_sec": round(ops / self.elapsed, 2) if self.elapsed else 0,
+      "bytes_per_sec": round(self.bytes / self.elapsed, 1) if self.elapsed else 0,
+      "latency_ms": latency,
+    }
+
+  def report(self, json_out):
+    d = self.as_dict()
+    lat = d["latency_ms"]
+    print("%-5s %-8s %6d ops  %8.1f ops/s  %8.1f KB/s  p50 %7.3f  p90 %7.3f  p99 %7.3f  max %7.3f ms" % (
+      d["workload"], d["label"], d["ops"], d["ops_per_sec"], d["bytes_per_sec"] / 1024,
+      lat["p50"], lat["p90"], lat["p99"], lat["max"]))
+    if json_out is not None:
+      json_out.write(json.dumps(d) + "\n")
+      json_out.flush()
+
+
+class NetSioHub:
+  """The hub end of NetSIO: answers FujiNet's pings, alive requests and credit
+  requests, and sends SIO commands as the Atari would."""
+
+  def __init__(self, port, timeout):
+    self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    self.sock.bind(("", port))
+    self.timeout = timeout
+    self.peer = None
+    self.rx = bytearray()
+    self.sync = None
+    self.sync_num = 0
+
+  def _send(self, data, addr=None):
+    self.sock.sendto(bytes(data), addr or self.peer)
+
+  def _handle(self, msg, addr):
+    kind = msg[0]
+    if kind == NETSIO_PING_REQUEST:
+      self._send([NETSIO_PING_RESPONSE], addr)
+    elif kind == NETSIO_ALIVE_REQUEST:
+      self._send([NETSIO_ALIVE_RESPONSE], addr)
+    elif kind == NETSIO_DEVICE_CONNECT:
+      self.peer = addr
+      self._send([NETSIO_SPEED_CHANGE] + list(SIO_BAUD.to_bytes(4, "little")))
+      self._send([NETSIO_CREDIT_UPDATE, NETSIO_CREDIT])
+    elif kind == NETSIO_DEVICE_DISCONNECT:
+      self.peer = None
+    elif self.peer is None or addr != self.peer:
+      return
+    elif kind == NETSIO_CREDIT_STATUS:
+      self._send([NETSIO_CREDIT_UPDATE, NETSIO_CREDIT])
+    elif kind == NETSIO_DATA_BYTE and len(msg) >= 2:
+      self.rx.append(msg[1])
+    elif kind == NETSIO_DATA_BLOCK:
+      self.rx += msg[1:]
+    elif kind == NETSIO_SYNC_RESPONSE and len(msg) >= 6:
+      self.sync = (msg[1], msg[2], msg[3], msg[4] | (msg[5] << 8))
+
+  def _pump(self, deadline):
+    remaining = deadline - time.monotonic()
+    if remaining <= 0:
+      raise BusError("timed out waiting for FujiNet")
+    self.sock.settimeout(remaining)
+    try:
+      msg, addr = self.sock.recvfrom(1024)
+    except socket.timeout:
+      raise BusError("timed out waiting for FujiNet")
+    if msg:
+      self._handle(msg, addr)
+
+  def wait_connect(self):
+    print("Waiting for FujiNet on NetSIO port %d" % self.sock.getsockname()[1])
+    while self.peer is None:
+      self._pump(time.monotonic() + 3600)
+
+  def _recv(self, size, deadline):
+    while len(self.rx) < size:
+      self._pump(deadline)
+    data = bytes(self.rx[:size])
+    del self.rx[:size]
+    return data
+
+  def _send_block(self, data):
+    for i in range(0, len(data), NETSIO_BLOCK_MAX):
+      # the trailing byte is a sequence number FujiNet skips
+      self._send(bytes([NETSIO_DATA_BLOCK]) + data[i:i + NETSIO_BLOCK_MAX] + b"\0")
+
+  def command(self, device, comnd, aux1=0, aux2=0, data=None, reply_len=0, allow_error=False):
+    """Sends one SIO command and returns the data frame, if reply_len, else b"" """
+    deadline = time.monotonic() + self.timeout
+    frame = bytes([device, comnd, aux1, aux2])
+    self.rx.clear()
+    self.sync = None
+    self.sync_num = (self.sync_num + 1) & 0xFF
+
+    self._send([NETSIO_COMMAND_ON])
+    self._send_block(frame + bytes([sio_checksum(frame)]))
+    self._send([NETSIO_COMMAND_OFF_SYNC, self.sync_num])
+
+    while self.sync is None or self.sync[0] != self.sync_num:
+      self._pump(deadline)
+    _, kind, ack, write_size = self.sync
+    if kind == NETSIO_EMPTY_SYNC:
+      raise BusError("no device 0x%02X" % device)
+    if ack != ord("A"):
+      raise BusError("device 0x%02X NAKed command 0x%02X" % (device, comnd))
+
+    if write_size > 0:
+      payload = (data or b"")[:write_size - 1]
+      payload += bytes(write_size - 1 - len(payload))
+      self._send_block(payload + bytes([sio_checksum(payload)]))
+      if self._recv(1, deadline) != b"A":
+        raise BusError("device 0x%02X NAKed the data for 0x%02X" % (device, comnd))
+
+    status = self._recv(1, deadline)
+    if status == b"E" and not (allow_error and reply_len):
+      raise BusError("device 0x%02X command 0x%02X failed" % (device, comnd))
+    if status not in (b"C", b"E"):
+      raise BusError("device 0x%02X command 0x%02X: unexpected 0x%02X" % (device, comnd, status[0]))
+    if not reply_len:
+      return b""
+    reply = self._recv(reply_len + 1, deadline)
+    if sio_checksum(reply[:-1]) != reply[-1]:
+      raise BusError("device 0x%02X command 0x%02X: bad checksum" % (device, comnd))
+    return reply[:-1]
+
+
+class SlipHost:
+  """The emulator end of the dev-relay SLIP connector, sending SmartPort
+  requests as AppleWin would."""
+
+  def __init__(self, port, timeout):
+    server = socket.create_server(("", port))
+    print("Waiting for FujiNet on SLIP port %d" % port)
+    self.sock, _ = server.accept()
+    server.close()
+    self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    self.sock.settimeout(timeout)
+    self.rx = bytearray()
+    self.seq = 0
+    self.units = {}
+
+  def _request(self, cmd, params, dest, extra=b""):
+    self.seq = (self.seq + 1) & 0xFF
+    packet = bytearray([self.seq, cmd, params, dest, 0, 0]) + extra
+    packet += bytes(max(0, 11 - len(packet)))
+    out = bytearray([SLIP_END])
+    for b in packet:
+      if b == SLIP_END:
+        out += bytes([SLIP_ESC, SLIP_ESC_END])
+      elif b == SLIP_ESC:
+        out += bytes([SLIP_ESC, SLIP_ESC_ESC])
+      else:
+        out.append(b)
+    out.append(SLIP_END)
+    self.sock.sendall(out)
+
+    while True:
+      reply = self._packet()
+      if reply[0] == self.seq:
+        return reply[1], bytes(reply[2:])
+
+  def _packet(self):
+    while True:
+      # Packets are framed by END at both ends, so empty ones between them are skipped
+      while self.rx[:1] == bytes([SLIP_END]):
+        del self.rx[0]
+      end = self.rx.find(SLIP_END)
+      if end > 0:
+        packet = bytearray()
+        escaped = False
+        for b in self.rx[:end]:
+          if escaped:
+            packet.append(SLIP_END if b == SLIP_ESC_END else SLIP_ESC)
+            escaped = False
+          elif b == SLIP_ESC:
+            escaped = True
+          else:
+            packet.append(b)
+        del self.rx[:end + 1]
+        return packet
+      try:
+        chunk = self.sock.recv(4096)
+      except socket.timeout:
+        raise BusError("timed out waiting for FujiNet")
+      if not chunk:
+        raise BusError("FujiNet closed the connection")
+      self.rx += chunk
+
+  def init(self):
+    """Gives each device on the chain a unit number, then reads their names"""
+    unit = 1
+    while unit < 127:
+      status, _ = self._request(CMD_INIT, 2, unit)
+      name = self.dib_name(unit)
+      self.units[unit] = name
+      if status == 0xFF:
+        break
+      unit += 1
+    print("SmartPort units: " + ", ".join("%d %s" % u for u in self.units.items()))
+
+  def dib_name(self, unit):
+    status, dib = self._request(CMD_STATUS, 3, unit, bytes([SP_STATUS_DIB, 0]))
+    if status != 0 or len(dib) < 5:
+      return "?"
+    return dib[5:5 + dib[4]].decode("latin-1").strip()
+
+  def read_block(self, unit, block):
+    status, data = self._request(CMD_READ_BLOCK, 3, unit, block.to_bytes(3, "little"))
+    if status != 0:
+      raise BusError("unit %d block %d: status 0x%02X" % (unit, block, status))
+    if len(data) != 512:
+      raise BusError("unit %d block %d: %d of 512 bytes" % (unit, block, len(data)))
+    return data
+
+
+def atari_mount(bus, args):
+  host_slot, path = args.image.split(":", 1)
+  host_slot = int(host_slot)
+  slot = args.drive - 1
+  bus.command(SIO_DEVICE_FUJI, FUJICMD_MOUNT_HOST, host_slot)
+  bus.command(SIO_DEVICE_FUJI, FUJICMD_SET_DEVICE_FULLPATH, slot, (host_slot << 4) | 1, spec_bytes(path))
+  bus.command(SIO_DEVICE_FUJI, FUJICMD_MOUNT_IMAGE, slot, 1)
+
+
+def atari_boot(bus, args, result):
+  if args.image:
+    atari_mount(bus, args)
+  device = SIO_DEVICE_DISK + args.drive - 1
+  status = bus.command(device, ord("S"), reply_len=4)
+  sector_size = 256 if status[0] & 0x20 else 128
+
+  result.start = time.perf_counter()
+  for sector in range(args.first, args.first + args.sectors):
+    size = 128 if sector <= 3 else sector_size
+    start = time.perf_counter()
+    bus.command(device, ord("R"), sector & 0xFF, sector >> 8, reply_len=size)
+    result.op(start, size)
+
+
+def network_status(bus):
+  status = bus.command(SIO_DEVICE_NETWORK, ord("S"), reply_len=4)
+  return status[0] | (status[1] << 8), status[2], status[3]
+
+
+def atari_json(bus, args, result):
+  if not args.url:
+    raise BusError("json needs --url")
+  for _ in range(args.polls):
+    start = time.perf_counter()
+    bus.command(SIO_DEVICE_NETWORK, ord("O"), 4, 0, spec_bytes(args.url))
+    bus.command(SIO_DEVICE_NETWORK, 0xFC, 0, 1)
+    bus.command(SIO_DEVICE_NETWORK, ord("P"))
+    bus.command(SIO_DEVICE_NETWORK, ord("Q"), 0, 0, spec_bytes(args.query))
+    waiting, _, _ = network_status(bus)
+    if waiting:
+      bus.command(SIO_DEVICE_NETWORK, ord("R"), waiting & 0xFF, waiting >> 8, reply_len=waiting,
+                  allow_error=True)
+    bus.command(SIO_DEVICE_NETWORK, ord("C"))
+    result.op(start, waiting)
+
+
+def atari_dir(bus, args, result):
+  bus.command(SIO_DEVICE_FUJI, FUJICMD_MOUNT_HOST, args.host_slot)
+  path = args.path.encode("latin-1") + b"\0"
+  result.start = time.perf_counter()
+  for _ in range(args.passes):
+    start = time.perf_counter()
+    bus.command(SIO_DEVICE_FUJI, FUJICMD_OPEN_DIRECTORY, args.host_slot, 0, path + bytes(256 - len(path)))
+    result.op(start)
+    while True:
+      start = time.perf_counter()
+      entry = bus.command(SIO_DEVICE_FUJI, FUJICMD_READ_DIR_ENTRY, args.entry_len, 0, reply_len=args.entry_len)
+      result.op(start, args.entry_len)
+      if entry[0] == 0x7F and entry[1] == 0x7F:
+        break
+    bus.command(SIO_DEVICE_FUJI, FUJICMD_CLOSE_DIRECTORY)
+
+
+def atari_copy(bus, args, result):
+  if not args.url:
+    raise BusError("copy needs --url")
+  bus.command(SIO_DEVICE_NETWORK, ord("O"), 4, 0, spec_bytes(args.url))
+  result.start = time.perf_counter()
+  idle_since = time.monotonic()
+  try:
+    while True:
+      start = time.perf_counter()
+      waiting, connected, error = network_status(bus)
+      if waiting == 0:
+        if error == NETWORK_ERROR_END_OF_FILE or not connected:
+          break
+        if time.monotonic() - idle_since > args.timeout:
+          raise BusError("no data for %.1f s" % args.timeout)
+        continue
+      idle_since = time.monotonic()
+      size = min(waiting, args.chunk)
+      bus.command(SIO_DEVICE_NETWORK, ord("R"), size & 0xFF, size >> 8, reply_len=size, allow_error=True)
+      result.op(start, size)
+  finally:
+    bus.command(SIO_DEVICE_NETWORK, ord("C"))
+
+
+def apple_boot(bus, args, result):
+  if not bus.units:
+    bus.init()
+  disks = [u for u, name in sorted(bus.units.items()) if name.startswith("FUJINET_DISK")]
+  if len(disks) < args.drive:
+    raise BusError("no FUJINET_DISK number %d" % args.drive)
+  unit = disks[args.drive - 1]
+
+  result.start = time.perf_counter()
+  for block in range(args.first, args.first + args.blocks):
+    start = time.perf_counter()
+    bus.read_block(unit, block)
+    result.op(start, 512)
+
+
+WORKLOADS = {
+  "netsio": {"boot": atari_boot, "json": atari_json, "dir": atari_dir, "copy": atari_copy},
+  "slip": {"boot": apple_boot},
+}
+
+
+def populate(directory, count):
+  os.makedirs(directory, exist_ok=True)
+  for i in range(count):
+    open(os.path.join(directory, "FILE%05d.DAT" % i), "w").close()
+  print("Created %d files in %s" % (count, directory))
+
+
+def main():
+  args = build_argparser().parse_args()
+
+  if args.populate:
+    populate(args.populate[0], int(args.populate[1]))
+    return
+
+  if args.bus == "netsio":
+    bus = NetSioHub(args.port or NETSIO_DEFAULT_PORT, args.timeout)
+    bus.wait_connect()
+  else:
+    bus = SlipHost(args.port or SLIP_DEFAULT_PORT, args.timeout)
+  if args.first is None:
+    args.first = 1 if args.bus == "netsio" else 0
+
+  json_out = None
+  if args.json == "-":
+    json_out = sys.stdout
+  elif args.json:
+    json_out = open(args.json, "a")
+
+  failed = 0
+  for name in args.workloads:
+    workload = WORKLOADS[args.bus].get(name)
+    if workload is None:
+      print("%-5s not available on the %s bus" % (name, args.bus))
+      continue
+    result = Result(args.bus, name, args.label)
+    try:
+      workload(bus, args, result)
+    except BusError as e:
+      print("%-5s failed after %d ops: %s" % (name, len(result.latencies), e))
+      failed += 1
+      continue
+    result.finish()
+    result.report(json_out)
+
+  if json_out is not None and json_out is not sys.stdout:
+    json_out.close()
+  return 1 if failed else 0
+
+
+if __name__ == "__main__":
+  exit(main() or 0)
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+#
+# Mac DCD (HD20) read throughput benchmark
+#
+# Plays the RP2040 side of the Mac bus UART and measures how fast FujiNet
+# returns the blocks of the DCD image mounted in the given slot:
+#   single - one 'R' per block, as a run of single block requests
+#   multi  - an 'M' hint for each run of --run blocks, then its 'R's, as
+#            an HD20 multi-block read
+#
+# Run it once with the image on the SD card and once with it on a TNFS
+# host to compare the two, e.g.:
+#   tools/dcd_bench.py /dev/ttyUSB0 --label sd
+#   tools/dcd_bench.py /dev/ttyUSB0 --label tnfs
+
+import argparse
+import time
+
+import serial
+
+MAC_BAUD_RATE = 2000000
+BLOCK_SIZE = 512
+
+
+def build_argparser():
+  parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+  parser.add_argument("port", help="serial port wired to the FujiNet Mac bus UART")
+  parser.add_argument("--baud", type=int, default=MAC_BAUD_RATE)
+  parser.add_argument("--disk", type=int, default=0, help="DCD slot, 0-3")
+  parser.add_argument("--blocks", type=int, default=2048, help="blocks read per test")
+  parser.add_argument("--first", type=int, default=0, help="first block, consecutive blocks are read")
+  parser.add_argument("--run", type=int, default=32, help="blocks per multi-block request")
+  parser.add_argument("--label", default="", help="backend name to print with the results")
+  return parser
+
+
+def read_block(port, block):
+  port.write(b"R" + block.to_bytes(3, "big"))
+  data = port.read(BLOCK_SIZE)
+  if len(data) != BLOCK_SIZE:
+    raise TimeoutError("block %d: %d of %d bytes" % (block, len(data), BLOCK_SIZE))
+  return data
+
+
+def test_single(port, args):
+  for i in range(args.blocks):
+    read_block(port, args.first + i)
+
+
+def test_multi(port, args):
+  for start in range(0, args.blocks, args.run):
+    count = min(args.run, args.blocks - start)
+    port.write(b"M" + (args.first + start).to_bytes(3, "big") + bytes([count]))
+    for i in range(count):
+      read_block(port, args.first + start + i)
+
+
+def run(port, name, test, args):
+  start = time.perf_counter()
+  test(port, args)
+  elapsed = time.perf_counter() - start
+  print("%-6s %-6s %6d blocks  %8.1f KB/s  %7.3f ms/block" % (args.label, name, args.blocks,
+                                                             args.blocks * BLOCK_SIZE / 1024 / elapsed,
+                                                             elapsed * 1000 / args.blocks))
+
+
+def main():
+  args = build_argparser().parse_args()
+
+  port = serial.Serial(args.port, args.baud, timeout=2)
+  port.reset_input_buffer()
+  port.write(bytes([ord('A') + args.disk]))
+
+  # Different blocks for each test, so the second isn't served from the first's cache
+  run(port, "single", test_single, args)
+  args.first += args.blocks
+  run(port, "multi", test_multi, args)
+  port.close()
+  return
+
+
+if __name__ == "__main__":
+  exit(main() or 0)
@@ -0,0 +1,135 @@
+/*
+ * FujiNet-PC dev-relay connection benchmark
+ *
+ * Round trip latency of a request and its response through a pair of
+ * looped back Connections with SLIP framing, the path SmartPort requests
+ * take between AppleWin and FujiNet-PC minus the socket. The functional
+ * tests for the same code are in test/test_devrelay_connection.cpp.
+ *
+ * Built from a FujiNet-PC build directory with
+ *   cmake --build . --target devrelay_bench
+ *
+ *   devrelay_bench [-n roundtrips] [payload bytes ...]
+ *
+ * Each payload size (default 16, 528 and 4096) is sent roundtrips times
+ * (default 2000) and the median, p99 and max round trip are reported.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "Connection.h"
+#include "SLIP.h"
+
+// Hands whatever it sends to its peer through SLIP framing, as a socket read loop would
+class LoopbackConnection : public Connection
+{
+public:
+    LoopbackConnection *peer = nullptr;
+
+    void send_data(const std::vector<uint8_t> &data) override
+    {
+        const auto slip_data = SLIP::encode(data);
+        auto packets = SLIP::split_into_packets(slip_data.data(), slip_data.size());
+        for (auto &packet : packets)
+        {
+            if (!packet.empty())
+                peer->add_packet(std::move(packet));
+        }
+    }
+
+    void create_read_channel() override {}
+    void close_connection() override { set_is_connected(false); }
+};
+
+// Returns false if a response went missing or came back the wrong size
+static bool bench_roundtrip(size_t payload, int roundtrips)
+{
+    LoopbackConnection host, device;
+    host.peer = &device;
+    device.peer = &host;
+    host.set_is_connected(true);
+    device.set_is_connected(true);
+
+    // Device side echoes each request back as its response
+    std::thread responder([&device]() {
+        while (device.is_connected())
+        {
+            auto request = device.wait_for_request();
+            if (!request.empty())
+                device.send_data(request);
+        }
+    });
+
+    std::vector<uint8_t> request(payload, 0x5A);
+    std::vector<uint64_t> times;
+    times.reserve(roundtrips);
+    bool ok = true;
+    for (int i = 0; i < roundtrips && ok; i++)
+    {
+        request[0] = (uint8_t)i;
+        auto start = std::chrono::steady_clock::now();
+        host.send_data(request);
+        try
+        {
+            auto response = host.wait_for_response(request[0], std::chrono::seconds(5));
+            ok = response.size() == payload;
+        }
+        catch (const std::runtime_error &)
+        {
+            ok = false;
+        }
+        times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start).count());
+    }
+
+    device.close_connection();
+    responder.join();
+
+    if (!ok)
+    {
+        fprintf(stderr, "devrelay_bench: %u byte payload, round trip %u failed\n", (unsigned)payload, (unsigned)times.size());
+        return false;
+    }
+
+    std::sort(times.begin(), times.end());
+    printf("%5u byte payload: median %lu ns, p99 %lu ns, max %lu ns\n",
+           (unsigned)payload, (unsigned long)times[times.size() / 2],
+           (unsigned long)times[times.size() * 99 / 100], (unsigned long)times.back());
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    int roundtrips = 2000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        if (opt != 'n')
+        {
+            fprintf(stderr, "usage: devrelay_bench [-n roundtrips] [payload bytes ...]\n");
+            return 1;
+        }
+        roundtrips = atoi(optarg);
+    }
+    if (roundtrips < 1)
+        roundtrips = 1;
+
+    std::vector<size_t> payloads;
+    for (int i = optind; i < argc; i++)
+        payloads.push_back(std::max(1ul, strtoul(argv[i], nullptr, 0)));
+    if (payloads.empty())
+        payloads = {16, 512 + 16, 4096};
+
+    bool ok = true;
+    for (size_t payload : payloads)
+        ok = bench_roundtrip(payload, roundtrips) && ok;
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,248 @@
+/*
+ * FujiNet-PC media layer benchmark
+ *
+ * Mounts a disk image through the same fujiHost and fnFile backends the
+ * firmware uses (SD/local, TNFS, SMB, HTTP) and replays an access trace
+ * against its media type, with no bus or computer in the way. Reports
+ * reads per second, latency percentiles and the media type's cache hits,
+ * so a caching change can be measured on its own.
+ *
+ * Built from a FujiNet-PC build directory with
+ *   cmake --build . --target media_bench
+ *
+ *   media_bench [-s sd_dir] [-n repeat] [-w] <host> <image path> <trace>
+ *
+ * host is "SD" for a file under sd_dir, otherwise a TNFS host name or an
+ * smb:// or http:// URL, as in a host slot. The image is read as an ATR on
+ * the Atari build and a ProDOS order image on the Apple build.
+ *
+ * The trace is a text file with one access per line: "R <n>" or "W <n>",
+ * or just the number for a read. n is the sector (Atari, 1-based) or block
+ * (Apple). Blank lines and lines starting with # are skipped. Instead of a
+ * file, "seq:<first>:<count>" reads count consecutive sectors. Writes put
+ * back whatever the last read left in the buffer and are only replayed
+ * with -w, so point it at a scratch copy of the image.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "fujiHost.h"
+#include "fnFsSD.h"
+#include "media.h"
+
+struct trace_access
+{
+    bool write;
+    uint32_t n;
+};
+
+static bool load_trace(const char *spec, std::vector<trace_access> &trace)
+{
+    unsigned long first, count;
+    if (sscanf(spec, "seq:%lu:%lu", &first, &count) == 2)
+    {
+        for (unsigned long i = 0; i < count; i++)
+            trace.push_back({false, (uint32_t)(first + i)});
+        return true;
+    }
+
+    FILE *f = fopen(spec, "r");
+    if (f == nullptr)
+        return false;
+
+    char line[128];
+    while (fgets(line, sizeof(line), f) != nullptr)
+    {
+        const char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\r' || *p == '\n' || *p == '\0')
+            continue;
+
+        bool write = false;
+        if (*p == 'R' || *p == 'r' || *p == 'W' || *p == 'w')
+        {
+            write = *p == 'W' || *p == 'w';
+            p++;
+        }
+        trace.push_back({write, (uint32_t)strtoul(p, nullptr, 0)});
+    }
+    fclose(f);
+    return true;
+}
+
+// The media type under test, behind the same three calls for each platform
+class bench_media
+{
+public:
+#if defined(BUILD_ATARI)
+    MediaTypeATR media;
+
+    bool mount(fujiHost *host, fnFile *f, uint32_t size)
+    {
+        media._disk_host = host;
+        return media.mount(f, size) != MEDIATYPE_UNKNOWN;
+    }
+
+    bool access(const trace_access &a)
+    {
+        uint16_t count;
+        if (a.write)
+            return media.write(a.n, false);
+        return media.read(a.n, &count);
+    }
+
+    uint32_t hits() { return media.sector_cache_hits; }
+    uint32_t misses() { return media.sector_cache_misses; }
+#elif defined(BUILD_APPLE)
+    MediaTypePO media;
+    uint8_t buffer[DISK_SECTORBUF_SIZE];
+
+    bool mount(fujiHost *host, fnFile *f, uint32_t size)
+    {
+        media._media_host = host;
+        return media.mount(f, size) != MEDIATYPE_UNKNOWN;
+    }
+
+    bool access(const trace_access &a)
+    {
+        uint16_t count = DISK_SECTORBUF_SIZE;
+        if (a.write)
+            return media.write(a.n, &count, buffer);
+        return media.read(a.n, &count, buffer);
+    }
+
+    uint32_t hits() { return media.cache_hits; }
+    uint32_t misses() { return media.cache_misses; }
+#endif
+};
+
+static void usage()
+{
+    fprintf(stderr, "usage: media_bench [-s sd_dir] [-n repeat] [-w] <host> <image path> <trace | seq:first:count>\n");
+}
+
+int main(int argc, char *argv[])
+{
+#if !defined(BUILD_ATARI) && !defined(BUILD_APPLE)
+    fprintf(stderr, "media_bench: no media type to bench on this target\n");
+    return 1;
+#else
+    const char *sd_dir = ".";
+    int repeat = 1;
+    bool writes = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:w")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            sd_dir = optarg;
+            break;
+        case 'n':
+            repeat = atoi(optarg);
+            break;
+        case 'w':
+            writes = true;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (argc - optind != 3 || repeat < 1)
+    {
+        usage();
+        return 1;
+    }
+
+    std::vector<trace_access> trace;
+    if (!load_trace(argv[optind + 2], trace) || trace.empty())
+    {
+        fprintf(stderr, "media_bench: no accesses in \"%s\"\n", argv[optind + 2]);
+        return 1;
+    }
+
+    fnSDFAT.start(sd_dir);
+
+    fujiHost host;
+    host.set_hostname(argv[optind]);
+    if (!host.mount())
+    {
+        fprintf(stderr, "media_bench: couldn't mount host \"%s\"\n", argv[optind]);
+        return 1;
+    }
+
+    char fullpath[MAX_HOST_PREFIX_LEN];
+    fnFile *f = host.fnfile_open(argv[optind + 1], fullpath, sizeof(fullpath), writes ? "rb+" : "rb");
+    if (f == nullptr)
+    {
+        fprintf(stderr, "media_bench: couldn't open \"%s\"\n", argv[optind + 1]);
+        return 1;
+    }
+
+    bench_media bench;
+    uint32_t size = host.file_size(f);
+    auto mount_start = std::chrono::steady_clock::now();
+    if (!bench.mount(&host, f, size))
+    {
+        fprintf(stderr, "media_bench: couldn't mount the image\n");
+        return 1;
+    }
+    double mount_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mount_start).count();
+
+    std::vector<uint32_t> latency_us;
+    latency_us.reserve(trace.size() * repeat);
+    uint32_t reads = 0, written = 0, skipped = 0, errors = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++)
+    {
+        for (const trace_access &a : trace)
+        {
+            if (a.write && !writes)
+            {
+                skipped++;
+                continue;
+            }
+
+            auto t0 = std::chrono::steady_clock::now();
+            if (bench.access(a))
+                errors++;
+            auto t1 = std::chrono::steady_clock::now();
+
+            latency_us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count());
+            if (a.write)
+                written++;
+            else
+                reads++;
+        }
+    }
+    double total_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bench.media.unmount();
+    host.umount();
+
+    std::sort(latency_us.begin(), latency_us.end());
+    auto percentile = [&](int p) { return latency_us.empty() ? 0 : latency_us[(latency_us.size() - 1) * p / 100]; };
+
+    uint32_t hits = bench.hits(), misses = bench.misses();
+    printf("\nimage    %s on %s, %u bytes, mounted in %.1f ms\n", argv[optind + 1], argv[optind], size, mount_ms);
+    printf("trace    %u accesses x %d: %u reads, %u writes, %u writes skipped, %u errors\n",
+           (unsigned)trace.size(), repeat, reads, written, skipped, errors);
+    printf("rate     %.0f accesses/s over %.3f s\n", total_s > 0 ? latency_us.size() / total_s : 0.0, total_s);
+    printf("latency  p50 %u us, p90 %u us, p99 %u us, max %u us\n",
+           percentile(50), percentile(90), percentile(99), latency_us.empty() ? 0 : latency_us.back());
+    printf("cache    %u hits, %u misses, %.1f%% hit rate\n", hits, misses,
+           hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+
+    return errors ? 2 : 0;
+#endif
+}
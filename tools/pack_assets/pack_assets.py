@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""
+Packs a directory into an image for the read-only asset partition
+(lib/hardware/fnAssets.h). Files keep their path from the root of the
+directory as their name, the same path the firmware opens them by on the
+flash filesystem, e.g. f/a820/F2 for /f/a820/F2.
+
+    pack_assets.py <directory> <image> [partition size]
+
+Then write the image to the partition's offset, for the 16MB table:
+
+    esptool.py write_flash 0xE10000 <image>
+
+The image is a 16 byte header ("FNAS", version, count, reserved), an index
+of 64 byte entries (56 byte NUL padded name, offset, size) sorted by name,
+then the file data, each file starting on a 4 byte boundary. All numbers
+are little endian 32 bit.
+"""
+
+import os
+import struct
+import sys
+
+MAGIC = b'FNAS'
+VERSION = 1
+NAME_LEN = 56
+HEADER = struct.Struct('<4sIII')
+ENTRY = struct.Struct('<%dsII' % NAME_LEN)
+DEFAULT_PARTITION_SIZE = 0x1F0000
+
+
+def collect(root):
+    files = []
+    for dirpath, _, filenames in os.walk(root):
+        for fname in filenames:
+            path = os.path.join(dirpath, fname)
+            name = os.path.relpath(path, root).replace(os.sep, '/')
+            encoded = name.encode('ascii')
+            if len(encoded) >= NAME_LEN:
+                sys.exit(f"pack_assets: name too long for the index: {name}")
+            files.append((encoded, path))
+    # The firmware binary searches with strncmp, so sort by bytes
+    files.sort()
+    return files
+
+
+def main():
+    if len(sys.argv) not in (3, 4):
+        sys.exit(__doc__)
+    root, image = sys.argv[1], sys.argv[2]
+    limit = int(sys.argv[3], 0) if len(sys.argv) == 4 else DEFAULT_PARTITION_SIZE
+
+    files = collect(root)
+    base = HEADER.size + ENTRY.size * len(files)
+    index = []
+    data = bytearray()
+    for name, path in files:
+        with open(path, 'rb') as f:
+            content = f.read()
+        data += b'\0' * ((-(base + len(data))) % 4)
+        index.append(ENTRY.pack(name, base + len(data), len(content)))
+        data += content
+    offset = base + len(data)
+
+    if offset > limit:
+        sys.exit(f"pack_assets: {offset} bytes won't fit the {limit} byte partition")
+
+    with open(image, 'wb') as out:
+        out.write(HEADER.pack(MAGIC, VERSION, len(files), 0))
+        out.write(b''.join(index))
+        out.write(data)
+    print(f"pack_assets: {len(files)} files, {offset} of {limit} bytes")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,138 @@
+/*
+ * FujiNet-PC network protocol translation benchmark
+ *
+ * Times the end of line translation in the NetworkProtocol base class over
+ * a large buffer of text lines, receive and transmit, for each translation
+ * mode. The functional tests for the same code are in
+ * test/test_networkprotocol_translation.cpp.
+ *
+ * Built from a FujiNet-PC build directory with
+ *   cmake --build . --target protocol_bench
+ *
+ *   protocol_bench [-s size] [-n passes]
+ *
+ * size is the buffer size in bytes (default 16384), passes how many times
+ * each mode translates it (default 64).
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+
+#include "Protocol.h"
+
+// The translation calls are protected, this gets at them
+class BenchProtocol : public NetworkProtocol
+{
+public:
+    BenchProtocol(std::string *rx_buf, std::string *tx_buf, std::string *sp_buf)
+        : NetworkProtocol(rx_buf, tx_buf, sp_buf) {}
+
+    void rx() { translate_receive_buffer(); }
+    unsigned short tx() { return translate_transmit_buffer(); }
+};
+
+// Text lines of typical length, ending the way each mode expects
+static const char *line_eol = "The quick brown fox jumps over the lazy dog, 0123456789.\x9B";
+static const char *line_cr = "The quick brown fox jumps over the lazy dog, 0123456789.\x0D";
+static const char *line_lf = "The quick brown fox jumps over the lazy dog, 0123456789.\x0A";
+static const char *line_crlf = "The quick brown fox jumps over the lazy dog, 0123456789.\x0D\x0A";
+
+static size_t bench_size = 16384;
+static int bench_passes = 64;
+
+static std::string fill(const char *line)
+{
+    std::string s;
+    while (s.size() < bench_size)
+        s += line;
+    s.resize(bench_size);
+    return s;
+}
+
+static void report(const char *name, double seconds)
+{
+    double kb = (double)bench_size * bench_passes / 1024;
+    printf("%-16s %10.0f us for %.0f KB, %10.0f KB/s\n", name, seconds * 1e6, kb, seconds > 0 ? kb / seconds : 0.0);
+}
+
+static void bench_rx(const char *name, uint8_t mode, const char *line)
+{
+    std::string rx_buf, tx_buf, sp_buf;
+    BenchProtocol protocol(&rx_buf, &tx_buf, &sp_buf);
+    std::string fixture = fill(line);
+    std::chrono::steady_clock::duration total{};
+
+    protocol.set_open_params(0x0C, mode);
+    for (int i = 0; i < bench_passes; i++)
+    {
+        rx_buf = fixture;
+        auto start = std::chrono::steady_clock::now();
+        protocol.rx();
+        total += std::chrono::steady_clock::now() - start;
+    }
+    report(name, std::chrono::duration<double>(total).count());
+}
+
+static void bench_tx(const char *name, uint8_t mode)
+{
+    std::string rx_buf, tx_buf, sp_buf;
+    BenchProtocol protocol(&rx_buf, &tx_buf, &sp_buf);
+    std::string fixture = fill(line_eol);
+    std::chrono::steady_clock::duration total{};
+
+    protocol.set_open_params(0x0C, mode);
+    for (int i = 0; i < bench_passes; i++)
+    {
+        tx_buf = fixture;
+        auto start = std::chrono::steady_clock::now();
+        protocol.tx();
+        total += std::chrono::steady_clock::now() - start;
+    }
+    report(name, std::chrono::duration<double>(total).count());
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: protocol_bench [-s size] [-n passes]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            bench_size = strtoul(optarg, nullptr, 0);
+            break;
+        case 'n':
+            bench_passes = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (bench_size == 0 || bench_passes < 1)
+    {
+        usage();
+        return 1;
+    }
+
+    bench_rx("RX none", 0, line_crlf);
+    bench_rx("RX CR to EOL", 1, line_cr);
+    bench_rx("RX LF to EOL", 2, line_lf);
+    bench_rx("RX CR/LF to EOL", 3, line_crlf);
+
+    bench_tx("TX none", 0);
+    bench_tx("TX EOL to CR", 1);
+    bench_tx("TX EOL to LF", 2);
+    bench_tx("TX EOL to CR/LF", 3);
+
+    return 0;
+}